@@ -0,0 +1,48 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t
+bench_now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000ull + (uint64_t) time.tv_nsec;
+}
+
+static inline void
+bench_report(const char *name, uint64_t iterations, uint64_t elapsed_ns)
+{
+    printf("%-40s %12llu iterations %10.2f ns/op\n", name, (unsigned long long) iterations,
+           (double) elapsed_ns / (double) iterations);
+}
+
+static inline void
+bench_report_throughput(const char *name, uint64_t bytes, uint64_t elapsed_ns)
+{
+    printf("%-40s %12.1f MB/s\n", name, (double) bytes * 1e3 / (double) elapsed_ns);
+}
+
+#endif //BENCH_H
@@ -0,0 +1,245 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * AAC-ELD decode cost of the bundled fdk-aac, configured exactly like the audio renderers.
+ * Takes a trace recorded with rpiplay -trace, whose audio packets get decrypted with the
+ * recorded session keys, or a file of decrypted packets each prefixed with their 16 bit
+ * big endian length.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "aacdecoder_lib.h"
+#include "trace.h"
+#include "raop_buffer.h"
+#include "logger.h"
+
+#define MIN_FRAMES 100000
+#define MAX_CHANNELS 2
+#define MAX_FRAME_SAMPLES 2048
+
+typedef struct {
+    UCHAR *data;
+    UINT length;
+} packet_t;
+
+/* Decrypts the audio data packets of a trace, with the keys of the session they belong to */
+static packet_t *
+read_trace_packets(trace_reader_t *reader, int *count, UCHAR **storage)
+{
+    logger_t *logger = logger_init();
+    raop_buffer_t *raop_buffer = NULL;
+    size_t packets_size = 1024, storage_size = 1024 * 1024;
+    packet_t *packets = malloc(packets_size * sizeof(packet_t));
+    UCHAR *buf = malloc(storage_size);
+    size_t used = 0;
+    int n = 0;
+
+    trace_record_header_t record;
+    const unsigned char *data;
+    while ((data = trace_reader_next(reader, &record))) {
+        if (record.type == TRACE_RECORD_SESSION_KEYS && record.length == sizeof(trace_session_keys_t)) {
+            const trace_session_keys_t *keys = (const trace_session_keys_t *) data;
+            raop_buffer_destroy(raop_buffer);
+            raop_buffer = raop_buffer_init(logger, RAOP_BUFFER_DEFAULT_LENGTH, keys->aeskey, keys->aesiv,
+                                           keys->ecdh_secret);
+            continue;
+        }
+        /* Packets without audio are just the 12 byte header and 4 bytes of silence marker */
+        if (record.type != TRACE_RECORD_RTP_DATA || !raop_buffer || record.length <= 16) {
+            continue;
+        }
+        unsigned int payload_size = record.length - 12;
+        if (used + payload_size > storage_size) {
+            storage_size *= 2;
+            buf = realloc(buf, storage_size);
+        }
+        if (n == packets_size) {
+            packets_size *= 2;
+            packets = realloc(packets, packets_size * sizeof(packet_t));
+        }
+        unsigned int output_len;
+        raop_buffer_decrypt(raop_buffer, (unsigned char *) data, buf + used, payload_size, &output_len);
+        /* Offsets until the storage stops moving */
+        packets[n].data = (UCHAR *) (uintptr_t) used;
+        packets[n].length = output_len;
+        used += output_len;
+        n++;
+    }
+    for (int i = 0; i < n; i++) {
+        packets[i].data = buf + (uintptr_t) packets[i].data;
+    }
+    raop_buffer_destroy(raop_buffer);
+    logger_destroy(logger);
+    *count = n;
+    *storage = buf;
+    return packets;
+}
+
+static packet_t *
+read_packets(const char *path, int *count, UCHAR **storage)
+{
+    trace_reader_t *reader = trace_reader_open(path);
+    if (reader) {
+        packet_t *packets = read_trace_packets(reader, count, storage);
+        trace_reader_close(reader);
+        return packets;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    UCHAR *buf = malloc(length);
+    if (!buf || fread(buf, 1, length, file) != (size_t) length) {
+        free(buf);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    /* Every packet takes at least three bytes, which bounds the count */
+    packet_t *packets = malloc((length / 3 + 1) * sizeof(packet_t));
+    int n = 0;
+    long pos = 0;
+    while (pos + 2 <= length) {
+        UINT packet_length = (buf[pos] << 8) | buf[pos + 1];
+        pos += 2;
+        if (packet_length == 0 || pos + packet_length > length) break;
+        packets[n].data = buf + pos;
+        packets[n].length = packet_length;
+        n++;
+        pos += packet_length;
+    }
+    *count = n;
+    *storage = buf;
+    return packets;
+}
+
+static HANDLE_AACDECODER
+open_decoder(void)
+{
+    HANDLE_AACDECODER decoder = aacDecoder_Open(TT_MP4_RAW, 1);
+    if (decoder == NULL) {
+        return NULL;
+    }
+    /* ASC config binary data, the same as the renderers use */
+    UCHAR eld_conf[] = { 0xF8, 0xE8, 0x50, 0x00 };
+    UCHAR *conf[] = { eld_conf };
+    UINT conf_len = sizeof(eld_conf);
+    if (aacDecoder_ConfigRaw(decoder, conf, &conf_len) != AAC_DEC_OK) {
+        aacDecoder_Close(decoder);
+        return NULL;
+    }
+    return decoder;
+}
+
+static int
+decode_packet(HANDLE_AACDECODER decoder, const packet_t *packet, INT_PCM *pcm, int pcm_samples)
+{
+    UCHAR *p_buffer[1] = { packet->data };
+    UINT buffer_size = packet->length;
+    UINT bytes_valid = packet->length;
+    if (aacDecoder_Fill(decoder, p_buffer, &buffer_size, &bytes_valid) != AAC_DEC_OK) {
+        return -1;
+    }
+    return aacDecoder_DecodeFrame(decoder, pcm, pcm_samples, 0) == AAC_DEC_OK ? 0 : -1;
+}
+
+static int
+compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace or audio capture>\n", argv[0]);
+        return 1;
+    }
+    int count;
+    UCHAR *storage;
+    packet_t *packets = read_packets(argv[1], &count, &storage);
+    if (!packets || count == 0) {
+        fprintf(stderr, "could not read packets from %s\n", argv[1]);
+        return 1;
+    }
+
+    HANDLE_AACDECODER decoder = open_decoder();
+    if (!decoder) {
+        fprintf(stderr, "could not configure the AAC-ELD decoder\n");
+        return 1;
+    }
+    static INT_PCM pcm[MAX_FRAME_SAMPLES * MAX_CHANNELS];
+    const int pcm_samples = sizeof(pcm) / sizeof(pcm[0]);
+
+    /* Warm up once over the capture, which also checks that it actually decodes */
+    int errors = 0;
+    for (int i = 0; i < count; i++) {
+        if (decode_packet(decoder, &packets[i], pcm, pcm_samples) < 0) errors++;
+    }
+    CStreamInfo *info = aacDecoder_GetStreamInfo(decoder);
+    printf("%d packets, %d decode errors, %d Hz, %d channels, %d samples per frame\n",
+           count, errors, info->sampleRate, info->numChannels, info->frameSize);
+    if (errors == count) {
+        fprintf(stderr, "no packet of %s decoded, does it hold an audio session?\n", argv[1]);
+        return 1;
+    }
+
+    int passes = MIN_FRAMES / count + 1;
+    uint64_t frames = (uint64_t) passes * count;
+    uint64_t *frame_ns = malloc(frames * sizeof(uint64_t));
+    uint64_t n = 0;
+
+    uint64_t start = bench_now_ns();
+    for (int pass = 0; pass < passes; pass++) {
+        for (int i = 0; i < count; i++) {
+            uint64_t frame_start = bench_now_ns();
+            decode_packet(decoder, &packets[i], pcm, pcm_samples);
+            frame_ns[n++] = bench_now_ns() - frame_start;
+        }
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    qsort(frame_ns, frames, sizeof(uint64_t), compare_u64);
+    bench_report("aacDecoder_DecodeFrame per frame", frames, elapsed);
+    printf("%-40s %12.0f frames/s\n", "", (double) frames * 1e9 / (double) elapsed);
+    printf("%-40s %12.2f us p50 %10.2f us p99\n", "", frame_ns[frames / 2] / 1000.0,
+           frame_ns[frames * 99 / 100] / 1000.0);
+    if (info->sampleRate > 0) {
+        /* Share of one core the decoder takes in real time playback */
+        double frame_duration_ns = 1e9 * info->frameSize / info->sampleRate;
+        printf("%-40s %12.2f %% of real time\n", "", 100.0 * elapsed / frames / frame_duration_ns);
+    }
+
+    free(frame_ns);
+    aacDecoder_Close(decoder);
+    free(packets);
+    free(storage);
+    return 0;
+}
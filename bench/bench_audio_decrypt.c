@@ -0,0 +1,106 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Packets per second for the AirPlay audio decryption path. Compares creating a
+ * fresh AES-CBC context for every packet with the per-session context that only
+ * reloads its IV.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "crypto.h"
+#include "raop_buffer.h"
+#include "logger.h"
+
+#define PACKETS 500000ull
+/* RTP header plus a typical AAC-ELD frame */
+#define PACKET_LEN (12 + 368)
+
+static volatile unsigned char sink;
+
+static void
+report_packets(const char *name, uint64_t elapsed_ns)
+{
+    bench_report(name, PACKETS, elapsed_ns);
+    printf("%-40s %12.0f packets/s\n", "", (double) PACKETS * 1e9 / (double) elapsed_ns);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned char key[16], iv[16], secret[32];
+    unsigned char packet[PACKET_LEN];
+    unsigned char output[PACKET_LEN];
+    unsigned int output_len;
+
+    for (int i = 0; i < sizeof(key); i++) key[i] = i;
+    for (int i = 0; i < sizeof(iv); i++) iv[i] = 0xf0 + i;
+    for (int i = 0; i < sizeof(secret); i++) secret[i] = 3 * i;
+    for (int i = 0; i < sizeof(packet); i++) packet[i] = rand();
+
+    logger_t *logger = logger_init();
+    raop_buffer_t *raop_buffer = raop_buffer_init(logger, RAOP_BUFFER_DEFAULT_LENGTH, key, iv, secret);
+
+    // raop_buffer derives the session key from the announced key and the pairing secret
+    unsigned char session_key[64];
+    sha_ctx_t *sha = sha_init();
+    sha_update(sha, key, 16);
+    sha_update(sha, secret, 32);
+    sha_final(sha, session_key, NULL);
+    sha_destroy(sha);
+
+    int payload_len = PACKET_LEN - 12;
+    int encrypted_len = payload_len / 16 * 16;
+
+    // Both paths have to produce the same plaintext, also for consecutive packets
+    unsigned char reference[PACKET_LEN];
+    aes_ctx_t *check_ctx = aes_cbc_init(session_key, iv, AES_DECRYPT);
+    aes_cbc_decrypt(check_ctx, packet + 12, reference, encrypted_len);
+    aes_cbc_destroy(check_ctx);
+    for (int i = 0; i < 2; i++) {
+        raop_buffer_decrypt(raop_buffer, packet, output, payload_len, &output_len);
+        if (memcmp(reference, output, encrypted_len) != 0) {
+            fprintf(stderr, "decryption mismatch\n");
+            return 1;
+        }
+    }
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < PACKETS; i++) {
+        aes_ctx_t *ctx = aes_cbc_init(session_key, iv, AES_DECRYPT);
+        aes_cbc_decrypt(ctx, packet + 12, output, encrypted_len);
+        aes_cbc_destroy(ctx);
+        sink = output[0];
+    }
+    report_packets("aes_cbc_init per packet", bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < PACKETS; i++) {
+        raop_buffer_decrypt(raop_buffer, packet, output, payload_len, &output_len);
+        sink = output[0];
+    }
+    report_packets("raop_buffer_decrypt", bench_now_ns() - start);
+
+    raop_buffer_destroy(raop_buffer);
+    logger_destroy(logger);
+    return 0;
+}
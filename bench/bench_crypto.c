@@ -0,0 +1,94 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * AES throughput of every backend crypto.c can use on this device, for the mirror stream
+ * (CTR over whole frames) and the audio stream (CBC per packet with a fresh IV). Use the
+ * fastest with rpiplay -aes, auto picks without measuring.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "crypto.h"
+
+/* A typical mirror frame and one AAC-ELD packet payload */
+#define FRAME_LEN (64 * 1024)
+#define FRAMES 2000ull
+#define PACKET_LEN (368 / 16 * 16)
+#define PACKETS 500000ull
+
+static volatile unsigned char sink;
+
+static void
+bench_backend(crypto_aes_backend_t backend, const unsigned char *key, const unsigned char *iv,
+              unsigned char *input, unsigned char *output)
+{
+    char name[64];
+
+    if (crypto_set_aes_backend(backend) < 0) {
+        printf("%-40s not available\n", crypto_aes_backend_name(backend));
+        return;
+    }
+
+    aes_ctx_t *ctr = aes_ctr_init(key, iv);
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < FRAMES; i++) {
+        aes_ctr_decrypt(ctr, input, output, FRAME_LEN);
+        sink = output[0];
+    }
+    snprintf(name, sizeof(name), "%s mirror ctr %d KB frames", crypto_aes_backend_name(backend), FRAME_LEN / 1024);
+    bench_report_throughput(name, FRAMES * FRAME_LEN, bench_now_ns() - start);
+    aes_ctr_destroy(ctr);
+
+    aes_ctx_t *cbc = aes_cbc_init(key, iv, AES_DECRYPT);
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < PACKETS; i++) {
+        aes_cbc_reset_iv(cbc, iv);
+        aes_cbc_decrypt(cbc, input, output, PACKET_LEN);
+        sink = output[0];
+    }
+    snprintf(name, sizeof(name), "%s audio cbc %d byte packets", crypto_aes_backend_name(backend), PACKET_LEN);
+    bench_report_throughput(name, PACKETS * PACKET_LEN, bench_now_ns() - start);
+    aes_cbc_destroy(cbc);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned char key[16], iv[16];
+    unsigned char *input = malloc(FRAME_LEN);
+    unsigned char *output = malloc(FRAME_LEN);
+
+    for (int i = 0; i < sizeof(key); i++) key[i] = i;
+    for (int i = 0; i < sizeof(iv); i++) iv[i] = 0xf0 + i;
+    for (int i = 0; i < FRAME_LEN; i++) input[i] = rand();
+
+    printf("CPU AES instructions: %s\n", crypto_cpu_has_aes() ? "yes" : "no");
+    printf("auto picks %s for ctr, %s for cbc\n",
+           crypto_aes_backend_name(crypto_get_aes_backend(0)), crypto_aes_backend_name(crypto_get_aes_backend(1)));
+
+    bench_backend(CRYPTO_AES_OPENSSL, key, iv, input, output);
+    bench_backend(CRYPTO_AES_AFALG, key, iv, input, output);
+
+    free(input);
+    free(output);
+    return 0;
+}
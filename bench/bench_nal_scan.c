@@ -0,0 +1,227 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Start code scanning speed of find_nal_unit against the original byte by byte scanner.
+ * Pass a trace recorded with rpiplay -trace, or an Annex-B stream, to measure on real AirPlay
+ * video; without one a synthetic stream of random slices is used.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "h264_stream.h"
+#include "trace.h"
+#include "mirror_buffer.h"
+#include "logger.h"
+
+#define SYNTHETIC_NALS 2000
+#define SYNTHETIC_NAL_SIZE 20000
+#define MIN_BYTES (256ull * 1024 * 1024)
+
+static int
+find_nal_unit_bytewise(uint8_t *buf, int size, int *nal_start, int *nal_end)
+{
+    int i;
+    *nal_start = 0;
+    *nal_end = 0;
+
+    i = 0;
+    while ((buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0x01) &&
+           (buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0 || buf[i+3] != 0x01)) {
+        i++;
+        if (i+4 >= size) { return 0; }
+    }
+    if (buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0x01) {
+        i++;
+    }
+    if (buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0x01) { return 0; }
+    i += 3;
+    *nal_start = i;
+
+    while ((buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0) &&
+           (buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0x01)) {
+        i++;
+        if (i+3 >= size) { *nal_end = size; return -1; }
+    }
+    *nal_end = i;
+    return (*nal_end - *nal_start);
+}
+
+static uint8_t *
+make_synthetic_stream(int *size)
+{
+    uint8_t *buf = malloc(SYNTHETIC_NALS * (SYNTHETIC_NAL_SIZE + 4));
+    int pos = 0;
+    for (int n = 0; n < SYNTHETIC_NALS; n++) {
+        buf[pos++] = 0; buf[pos++] = 0; buf[pos++] = 0; buf[pos++] = 1;
+        buf[pos++] = n % 30 ? 0x41 : 0x65;
+        for (int i = 1; i < SYNTHETIC_NAL_SIZE; i++) {
+            uint8_t b = rand();
+            // Emulation prevention keeps 00 00 0x out of real slice data
+            if (b <= 3 && pos >= 2 && buf[pos-1] == 0 && buf[pos-2] == 0) b = 3 + (rand() % 252);
+            buf[pos++] = b;
+        }
+    }
+    *size = pos;
+    return buf;
+}
+
+/* Decrypts the mirror video frames of a trace into one Annex-B stream, like raop_rtp_mirror does */
+static uint8_t *
+read_trace_stream(trace_reader_t *reader, int *size)
+{
+    logger_t *logger = logger_init();
+    trace_session_keys_t keys;
+    int have_keys = 0;
+    mirror_buffer_t *mirror_buffer = NULL;
+    size_t capacity = 16 * 1024 * 1024;
+    uint8_t *buf = malloc(capacity);
+    size_t used = 0;
+
+    trace_record_header_t record;
+    const unsigned char *data;
+    while ((data = trace_reader_next(reader, &record))) {
+        if (record.type == TRACE_RECORD_SESSION_KEYS && record.length == sizeof(keys)) {
+            memcpy(&keys, data, sizeof(keys));
+            have_keys = 1;
+        } else if (record.type == TRACE_RECORD_MIRROR_STREAM && record.length == sizeof(uint64_t) && have_keys) {
+            uint64_t stream_connection_id;
+            memcpy(&stream_connection_id, data, sizeof(stream_connection_id));
+            mirror_buffer_destroy(mirror_buffer);
+            mirror_buffer = mirror_buffer_init(logger, keys.aeskey, keys.ecdh_secret);
+            mirror_buffer_init_aes(mirror_buffer, stream_connection_id);
+        } else if (record.type == TRACE_RECORD_MIRROR_PACKET && record.length > 128 && mirror_buffer &&
+                   data[4] == 0) {
+            int payload_size = record.length - 128;
+            if (used + payload_size > capacity) {
+                capacity = 2 * (used + payload_size);
+                buf = realloc(buf, capacity);
+            }
+            uint8_t *frame = buf + used;
+            mirror_buffer_decrypt(mirror_buffer, (unsigned char *) data + 128, frame, payload_size);
+            /* Swap the 4 byte NAL lengths for start codes, drop the frame if they do not add up */
+            int offset = 0;
+            while (offset + 4 <= payload_size) {
+                int nal_size = (frame[offset] << 24) | (frame[offset + 1] << 16) | (frame[offset + 2] << 8) | frame[offset + 3];
+                if (nal_size <= 0 || nal_size > payload_size - offset - 4) break;
+                frame[offset] = 0; frame[offset + 1] = 0; frame[offset + 2] = 0; frame[offset + 3] = 1;
+                offset += 4 + nal_size;
+            }
+            if (offset == payload_size) {
+                used += payload_size;
+            }
+        }
+    }
+    mirror_buffer_destroy(mirror_buffer);
+    logger_destroy(logger);
+    if (used == 0) {
+        free(buf);
+        return NULL;
+    }
+    *size = (int) used;
+    return buf;
+}
+
+static uint8_t *
+read_stream(const char *path, int *size)
+{
+    trace_reader_t *reader = trace_reader_open(path);
+    if (reader) {
+        uint8_t *buf = read_trace_stream(reader, size);
+        trace_reader_close(reader);
+        return buf;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *buf = malloc(length);
+    if (!buf || fread(buf, 1, length, file) != (size_t) length) {
+        free(buf);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *size = (int) length;
+    return buf;
+}
+
+typedef int (*scan_func_t)(uint8_t *buf, int size, int *nal_start, int *nal_end);
+
+/* Walks every NAL of the stream, returns the number found */
+static int
+scan_stream(scan_func_t scan, uint8_t *buf, int size, int64_t *checksum)
+{
+    int nal_start, nal_end;
+    int offset = 0;
+    int count = 0;
+    while (offset < size) {
+        int ret = scan(buf + offset, size - offset, &nal_start, &nal_end);
+        if (ret == 0) break;
+        *checksum += offset + nal_start;
+        count++;
+        offset += nal_end;
+        if (ret < 0) break;
+    }
+    return count;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int size;
+    uint8_t *buf = argc > 1 ? read_stream(argv[1], &size) : make_synthetic_stream(&size);
+    if (!buf) {
+        fprintf(stderr, "could not read %s\n", argv[1]);
+        return 1;
+    }
+
+    int64_t reference_sum = 0, fast_sum = 0;
+    int reference_count = scan_stream(find_nal_unit_bytewise, buf, size, &reference_sum);
+    int fast_count = scan_stream(find_nal_unit, buf, size, &fast_sum);
+    if (reference_count != fast_count || reference_sum != fast_sum) {
+        fprintf(stderr, "scanner mismatch: %d vs %d nals\n", reference_count, fast_count);
+        return 1;
+    }
+    printf("%d bytes, %d nals\n", size, fast_count);
+
+    uint64_t passes = MIN_BYTES / size + 1;
+    int64_t sink = 0;
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < passes; i++) scan_stream(find_nal_unit_bytewise, buf, size, &sink);
+    uint64_t elapsed = bench_now_ns() - start;
+    bench_report("bytewise find_nal_unit per nal", passes * fast_count, elapsed);
+    printf("%-40s %12.2f GB/s\n", "", (double) passes * size / (double) elapsed);
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < passes; i++) scan_stream(find_nal_unit, buf, size, &sink);
+    elapsed = bench_now_ns() - start;
+    bench_report("find_nal_unit per nal", passes * fast_count, elapsed);
+    printf("%-40s %12.2f GB/s\n", "", (double) passes * size / (double) elapsed);
+
+    free(buf);
+    return sink == 42;
+}
@@ -0,0 +1,111 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Per-call cost of converting between the remote and local clock, which happens for
+ * every audio packet and video frame. Compares the lock-free raop_ntp path with the
+ * mutex-guarded read it replaced, with one and several concurrent readers.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "raop_ntp.h"
+#include "logger.h"
+
+#define ITERATIONS 10000000ull
+#define MAX_READERS 4
+
+static raop_ntp_t *ntp;
+static pthread_mutex_t reference_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int64_t reference_offset = 0;
+static volatile uint64_t sink;
+
+static uint64_t
+reference_convert_remote_time(uint64_t remote_time)
+{
+    pthread_mutex_lock(&reference_mutex);
+    int64_t offset = reference_offset;
+    pthread_mutex_unlock(&reference_mutex);
+    return (uint64_t) ((int64_t) remote_time) - offset;
+}
+
+static void *
+seqlock_reader(void *arg)
+{
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < ITERATIONS; i++) {
+        acc += raop_ntp_convert_remote_time(ntp, i);
+    }
+    sink = acc;
+    return NULL;
+}
+
+static void *
+mutex_reader(void *arg)
+{
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < ITERATIONS; i++) {
+        acc += reference_convert_remote_time(i);
+    }
+    sink = acc;
+    return NULL;
+}
+
+static void
+run(const char *name, void *(*reader)(void *), int readers)
+{
+    pthread_t threads[MAX_READERS];
+    char label[64];
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < readers; i++) {
+        pthread_create(&threads[i], NULL, reader, NULL);
+    }
+    for (int i = 0; i < readers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t elapsed = bench_now_ns() - start;
+
+    snprintf(label, sizeof(label), "%s, %d reader%s", name, readers, readers > 1 ? "s" : "");
+    // Wall time per call on each reader
+    bench_report(label, ITERATIONS, elapsed);
+}
+
+int
+main(int argc, char *argv[])
+{
+    const unsigned char remote[4] = {127, 0, 0, 1};
+    logger_t *logger = logger_init();
+    ntp = raop_ntp_init(logger, remote, sizeof(remote), 7010);
+    if (!ntp) {
+        fprintf(stderr, "could not create raop_ntp\n");
+        return 1;
+    }
+
+    for (int readers = 1; readers <= MAX_READERS; readers *= 2) {
+        run("mutex convert_remote_time", mutex_reader, readers);
+        run("seqlock convert_remote_time", seqlock_reader, readers);
+    }
+
+    raop_ntp_destroy(ntp);
+    logger_destroy(logger);
+    return 0;
+}
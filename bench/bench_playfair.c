@@ -0,0 +1,133 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Cost of the FairPlay key decryption every SETUP with an ekey does. Compares the full
+ * playfair_decrypt, which derives the SAP key schedule from the handshake message each time,
+ * with fairplay_decrypt, which keeps the schedule for further SETUPs and reconnects.
+ * Before timing it checks the rewritten SAP session key derivation against the original code
+ * for random handshake messages in all four modes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "fairplay.h"
+#include "logger.h"
+#include "playfair/playfair.h"
+
+#define DECRYPTS 2000ull
+#define SESSION_KEY_VECTORS 1000
+
+static volatile unsigned char sink;
+
+int
+main(int argc, char *argv[])
+{
+    // Same message layout rpiplay_loadgen sends, the content is random
+    unsigned char setup[16] = { 'F', 'P', 'L', 'Y', 0x03, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x04, 0x02, 0x00, 0x00, 0xbb };
+    unsigned char handshake[164] = { 'F', 'P', 'L', 'Y', 0x03, 0x01, 0x03, 0x00, 0x00, 0x00, 0x00, 0x98, 0x00 };
+    unsigned char ekey[72] = { 'F', 'P', 'L', 'Y', 0x01, 0x02, 0x01, 0x00, 0x00, 0x00, 0x00, 0x3c };
+    unsigned char setup_response[142], handshake_response[32];
+    unsigned char key[16], reference[16];
+
+    for (int i = 13; i < sizeof(handshake); i++) handshake[i] = rand();
+    for (int i = 12; i < sizeof(ekey); i++) ekey[i] = rand();
+
+    for (int i = 0; i < SESSION_KEY_VECTORS; i++) {
+        unsigned char message[164];
+        memcpy(message, handshake, 13);
+        for (int j = 13; j < sizeof(message); j++) message[j] = rand();
+        message[12] = i % 4;
+        playfair_session_key_reference(message, reference);
+        playfair_session_key_fast(message, key);
+        if (memcmp(reference, key, sizeof(key)) != 0) {
+            fprintf(stderr, "session key mismatch for vector %d\n", i);
+            return 1;
+        }
+    }
+
+    uint64_t start = bench_now_ns();
+    for (uint64_t i = 0; i < DECRYPTS; i++) {
+        playfair_session_key_reference(handshake, key);
+        sink = key[0];
+    }
+    bench_report("session key, reference", DECRYPTS, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < DECRYPTS; i++) {
+        playfair_session_key_fast(handshake, key);
+        sink = key[0];
+    }
+    bench_report("session key, fast", DECRYPTS, bench_now_ns() - start);
+
+    logger_t *logger = logger_init();
+    fairplay_t *fairplay = fairplay_init(logger);
+    if (!fairplay || fairplay_setup(fairplay, setup, setup_response) < 0 ||
+        fairplay_handshake(fairplay, handshake, handshake_response) < 0) {
+        fprintf(stderr, "fairplay setup failed\n");
+        return 1;
+    }
+
+    // The cached schedule has to give the same keys, also for a different ekey
+    for (int i = 0; i < 2; i++) {
+        unsigned char message[164];
+        memcpy(message, handshake, sizeof(message));
+        playfair_decrypt(message, ekey, reference);
+        fairplay_decrypt(fairplay, ekey, key);
+        if (memcmp(reference, key, sizeof(key)) != 0) {
+            fprintf(stderr, "decryption mismatch\n");
+            return 1;
+        }
+        ekey[40] ^= 0x5a;
+    }
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < DECRYPTS; i++) {
+        unsigned char message[164];
+        memcpy(message, handshake, sizeof(message));
+        playfair_decrypt(message, ekey, key);
+        sink = key[0];
+    }
+    bench_report("playfair_decrypt", DECRYPTS, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < DECRYPTS; i++) {
+        fairplay_decrypt(fairplay, ekey, key);
+        sink = key[0];
+    }
+    bench_report("fairplay_decrypt, schedule kept", DECRYPTS, bench_now_ns() - start);
+
+    // A reconnecting sender gets a new fairplay_t but finds the schedule in the shared cache
+    start = bench_now_ns();
+    for (uint64_t i = 0; i < DECRYPTS; i++) {
+        fairplay_t *reconnect = fairplay_init(logger);
+        fairplay_setup(reconnect, setup, setup_response);
+        fairplay_handshake(reconnect, handshake, handshake_response);
+        fairplay_decrypt(reconnect, ekey, key);
+        fairplay_destroy(reconnect);
+        sink = key[0];
+    }
+    bench_report("fairplay_decrypt, reconnect", DECRYPTS, bench_now_ns() - start);
+
+    fairplay_destroy(fairplay);
+    logger_destroy(logger);
+    return 0;
+}
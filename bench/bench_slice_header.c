@@ -0,0 +1,122 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Slice header parsing speed of read_slice_header_info against the bit by bit bs_t reader on
+ * an RBSP copy, as h264_stream does it. The synthetic slices carry emulation prevention bytes
+ * inside their headers, so both readers are also checked to agree on every field.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "h264_stream.h"
+#include "h264_slice_info.h"
+
+#define SLICES 4096
+#define SLICE_SIZE 64
+#define RBSP_HEADER_BYTES 32
+#define ITERATIONS 2000
+
+typedef struct {
+    uint8_t data[SLICE_SIZE + SLICE_SIZE / 2];
+    int size;
+} slice_t;
+
+static void
+make_slice(slice_t *slice, const h264_slice_sps_t *sps, int n)
+{
+    uint8_t rbsp[SLICE_SIZE];
+    bs_t b;
+    bs_init(&b, rbsp, sizeof(rbsp));
+    memset(rbsp, 0, sizeof(rbsp));
+    // Mostly zero fields, as in real streams, so emulation prevention kicks in within the header
+    bs_write_ue(&b, n % 7 ? 0 : rand() % 8160); // first_mb_in_slice
+    bs_write_ue(&b, n % 30 ? 5 : 7); // slice_type
+    bs_write_ue(&b, 0); // pic_parameter_set_id
+    bs_write_u(&b, sps->log2_max_frame_num, n % 3 ? 0 : n & ((1 << sps->log2_max_frame_num) - 1)); // frame_num
+    for (int i = bs_pos(&b) + 1; i < SLICE_SIZE; i++) rbsp[i] = rand() % 4 ? 0 : rand();
+    int rbsp_size = SLICE_SIZE;
+    slice->size = sizeof(slice->data);
+    rbsp_to_nal(rbsp, &rbsp_size, slice->data, &slice->size);
+    slice->data[0] = n % 30 ? 0x41 : 0x65;
+}
+
+/* The same fields through nal_to_rbsp and bs_read_ue */
+static int
+read_slice_header_bitwise(const uint8_t *nal, int nal_size, const h264_slice_sps_t *sps, h264_slice_info_t *info)
+{
+    uint8_t rbsp[RBSP_HEADER_BYTES];
+    int size = nal_size - 1 < RBSP_HEADER_BYTES ? nal_size - 1 : RBSP_HEADER_BYTES;
+    int rbsp_size = sizeof(rbsp);
+    nal_to_rbsp(nal + 1, &size, rbsp, &rbsp_size);
+    bs_t b;
+    bs_init(&b, rbsp, rbsp_size);
+    info->nal_unit_type = nal[0] & 0x1F;
+    info->nal_ref_idc = (nal[0] >> 5) & 0x03;
+    info->first_mb_in_slice = bs_read_ue(&b);
+    info->slice_type = bs_read_ue(&b);
+    info->pic_parameter_set_id = bs_read_ue(&b);
+    if (sps->separate_colour_plane_flag) bs_skip_u(&b, 2);
+    info->frame_num = bs_read_u(&b, sps->log2_max_frame_num);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    h264_slice_sps_t sps = { 0, 8 };
+    slice_t *slices = malloc(SLICES * sizeof(slice_t));
+    for (int n = 0; n < SLICES; n++) make_slice(&slices[n], &sps, n);
+
+    for (int n = 0; n < SLICES; n++) {
+        h264_slice_info_t reference, fast;
+        read_slice_header_bitwise(slices[n].data, slices[n].size, &sps, &reference);
+        if (read_slice_header_info(slices[n].data, slices[n].size, &sps, &fast) < 0 ||
+            memcmp(&reference, &fast, sizeof(fast)) != 0) {
+            fprintf(stderr, "reader mismatch at slice %d\n", n);
+            return 1;
+        }
+    }
+
+    h264_slice_info_t info;
+    int64_t sink = 0;
+
+    uint64_t start = bench_now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int n = 0; n < SLICES; n++) {
+            read_slice_header_bitwise(slices[n].data, slices[n].size, &sps, &info);
+            sink += info.frame_num;
+        }
+    }
+    bench_report("bitwise slice header", (uint64_t) ITERATIONS * SLICES, bench_now_ns() - start);
+
+    start = bench_now_ns();
+    for (int i = 0; i < ITERATIONS; i++) {
+        for (int n = 0; n < SLICES; n++) {
+            read_slice_header_info(slices[n].data, slices[n].size, &sps, &info);
+            sink += info.frame_num;
+        }
+    }
+    bench_report("read_slice_header_info", (uint64_t) ITERATIONS * SLICES, bench_now_ns() - start);
+
+    free(slices);
+    return sink == 42;
+}
@@ -0,0 +1,605 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * All hot path primitives in one run, one result per line as CSV or JSON, so runs on different
+ * devices or before and after a change can be diffed or loaded as they are. The mirror cases use
+ * the video of a trace recorded with rpiplay -trace when given one, the RTSP case a file of raw
+ * requests as captured off the wire; everything else, and both without a file, is synthetic.
+ *
+ *   rpiplay_bench [-f csv|json] [-t trace] [-r requests] [name filter]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "crypto.h"
+#include "mirror_buffer.h"
+#include "raop_buffer.h"
+#include "raop_ntp.h"
+#include "http_request.h"
+#include "trace.h"
+#include "logger.h"
+#include "h264_avcc.h"
+#include "h264_stream.h"
+#include "audio_resampler.h"
+
+#if defined(__aarch64__)
+#define BENCH_ARCH "aarch64"
+#elif defined(__arm__)
+#define BENCH_ARCH "arm"
+#elif defined(__x86_64__)
+#define BENCH_ARCH "x86_64"
+#elif defined(__i386__)
+#define BENCH_ARCH "x86"
+#else
+#define BENCH_ARCH "unknown"
+#endif
+
+/* Every case runs for about this long */
+#define MIN_RUN_NS 500000000ull
+#define SYNTHETIC_FRAMES 60
+#define SYNTHETIC_SLICES 4
+#define AUDIO_PACKET_LEN (12 + 368)
+#define AUDIO_PACKETS 4096
+#define MAX_READERS 4
+
+typedef struct {
+    unsigned char *data;
+    int size;
+} frame_t;
+
+typedef struct {
+    frame_t *frames;
+    int count;
+    int capacity;
+    uint64_t bytes;
+} frame_list_t;
+
+static int json_output = 0;
+static const char *filter = NULL;
+static volatile uint64_t sink;
+
+static void
+emit(const char *name, uint64_t ops, uint64_t bytes, uint64_t elapsed_ns)
+{
+    double ns_per_op = (double) elapsed_ns / (double) ops;
+    double mb_per_s = bytes ? (double) bytes * 1e3 / (double) elapsed_ns : 0.0;
+    if (json_output) {
+        printf("{\"bench\":\"%s\",\"arch\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.2f,\"mb_per_s\":%.1f}\n",
+               name, BENCH_ARCH, (unsigned long long) ops, ns_per_op, mb_per_s);
+    } else {
+        printf("%s,%s,%llu,%.2f,%.1f\n", name, BENCH_ARCH, (unsigned long long) ops, ns_per_op, mb_per_s);
+    }
+    fflush(stdout);
+}
+
+static int
+selected(const char *name)
+{
+    return !filter || strstr(name, filter);
+}
+
+static void
+frame_list_add(frame_list_t *list, const unsigned char *data, int size)
+{
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? 2 * list->capacity : 64;
+        list->frames = realloc(list->frames, list->capacity * sizeof(frame_t));
+    }
+    frame_t *frame = &list->frames[list->count++];
+    frame->data = malloc(size);
+    memcpy(frame->data, data, size);
+    frame->size = size;
+    list->bytes += size;
+}
+
+static void
+frame_list_free(frame_list_t *list)
+{
+    for (int i = 0; i < list->count; i++) free(list->frames[i].data);
+    free(list->frames);
+}
+
+/* AVCC frames of slices with emulation prevented random data, an IDR every 30 frames */
+static void
+make_synthetic_frames(frame_list_t *frames)
+{
+    for (int n = 0; n < SYNTHETIC_FRAMES; n++) {
+        int slice_size = n % 30 ? 4000 + rand() % 8000 : 60000 + rand() % 20000;
+        int size = SYNTHETIC_SLICES * (4 + slice_size);
+        unsigned char *frame = malloc(size);
+        int pos = 0;
+        for (int s = 0; s < SYNTHETIC_SLICES; s++) {
+            frame[pos++] = slice_size >> 24; frame[pos++] = slice_size >> 16;
+            frame[pos++] = slice_size >> 8; frame[pos++] = slice_size;
+            frame[pos++] = n % 30 ? 0x41 : 0x65;
+            for (int i = 1; i < slice_size; i++) {
+                unsigned char b = rand();
+                if (b <= 3 && frame[pos-1] == 0 && frame[pos-2] == 0) b = 3 + (rand() % 252);
+                frame[pos++] = b;
+            }
+        }
+        frame_list_add(frames, frame, size);
+        free(frame);
+    }
+}
+
+/* Decrypts the mirror video frames of a trace, keeping the encrypted payloads as well */
+static int
+read_trace_frames(const char *path, frame_list_t *encrypted, frame_list_t *frames)
+{
+    trace_reader_t *reader = trace_reader_open(path);
+    if (!reader) {
+        return -1;
+    }
+    logger_t *logger = logger_init();
+    trace_session_keys_t keys;
+    int have_keys = 0;
+    mirror_buffer_t *mirror_buffer = NULL;
+    unsigned char *frame = NULL;
+    int frame_capacity = 0;
+
+    trace_record_header_t record;
+    const unsigned char *data;
+    while ((data = trace_reader_next(reader, &record))) {
+        if (record.type == TRACE_RECORD_SESSION_KEYS && record.length == sizeof(keys)) {
+            memcpy(&keys, data, sizeof(keys));
+            have_keys = 1;
+        } else if (record.type == TRACE_RECORD_MIRROR_STREAM && record.length == sizeof(uint64_t) && have_keys) {
+            uint64_t stream_connection_id;
+            memcpy(&stream_connection_id, data, sizeof(stream_connection_id));
+            mirror_buffer_destroy(mirror_buffer);
+            mirror_buffer = mirror_buffer_init(logger, keys.aeskey, keys.ecdh_secret);
+            mirror_buffer_init_aes(mirror_buffer, stream_connection_id);
+        } else if (record.type == TRACE_RECORD_MIRROR_PACKET && record.length > 128 && mirror_buffer &&
+                   data[4] == 0) {
+            int payload_size = record.length - 128;
+            if (payload_size > frame_capacity) {
+                frame_capacity = payload_size;
+                frame = realloc(frame, frame_capacity);
+            }
+            mirror_buffer_decrypt(mirror_buffer, (unsigned char *) data + 128, frame, payload_size);
+            frame_list_add(encrypted, data + 128, payload_size);
+            frame_list_add(frames, frame, payload_size);
+        }
+    }
+    free(frame);
+    mirror_buffer_destroy(mirror_buffer);
+    logger_destroy(logger);
+    trace_reader_close(reader);
+    return frames->count ? 0 : -1;
+}
+
+static void
+bench_mirror_decrypt(logger_t *logger, frame_list_t *frames)
+{
+    unsigned char key[16], secret[32];
+    for (int i = 0; i < sizeof(key); i++) key[i] = i;
+    for (int i = 0; i < sizeof(secret); i++) secret[i] = 3 * i;
+    mirror_buffer_t *mirror_buffer = mirror_buffer_init(logger, key, secret);
+    mirror_buffer_init_aes(mirror_buffer, 0x1234567890abcdefull);
+
+    int max_size = 0;
+    for (int i = 0; i < frames->count; i++) max_size = frames->frames[i].size > max_size ? frames->frames[i].size : max_size;
+    unsigned char *output = malloc(max_size);
+
+    uint64_t ops = 0, bytes = 0;
+    uint64_t start = bench_now_ns();
+    do {
+        for (int i = 0; i < frames->count; i++) {
+            mirror_buffer_decrypt(mirror_buffer, frames->frames[i].data, output, frames->frames[i].size);
+            sink += output[0];
+        }
+        ops += frames->count;
+        bytes += frames->bytes;
+    } while (bench_now_ns() - start < MIN_RUN_NS);
+    emit("mirror_buffer_decrypt", ops, bytes, bench_now_ns() - start);
+
+    free(output);
+    mirror_buffer_destroy(mirror_buffer);
+}
+
+/* The rewrite is in place, the length prefixes are put back from the index after every frame */
+static void
+bench_avcc_rewrite(frame_list_t *frames)
+{
+    h264_nal_index_t index;
+    uint64_t ops = 0, bytes = 0, nals = 0;
+    uint64_t start = bench_now_ns();
+    do {
+        for (int i = 0; i < frames->count; i++) {
+            unsigned char *data = frames->frames[i].data;
+            if (avcc_to_annexb(data, frames->frames[i].size, &index) < 0) continue;
+            for (int n = 0; n < index.count; n++) {
+                unsigned char *prefix = data + index.nals[n].offset - 4;
+                int size = index.nals[n].size;
+                prefix[0] = size >> 24; prefix[1] = size >> 16; prefix[2] = size >> 8; prefix[3] = size;
+            }
+            nals += index.count;
+        }
+        ops += frames->count;
+        bytes += frames->bytes;
+    } while (bench_now_ns() - start < MIN_RUN_NS);
+    sink += nals;
+    emit("avcc_to_annexb", ops, bytes, bench_now_ns() - start);
+}
+
+static void
+bench_find_nal_unit(frame_list_t *frames)
+{
+    // One Annex-B stream of all frames, as the renderers scan it
+    uint8_t *stream = malloc(frames->bytes);
+    int size = 0;
+    for (int i = 0; i < frames->count; i++) {
+        h264_nal_index_t index;
+        memcpy(stream + size, frames->frames[i].data, frames->frames[i].size);
+        if (avcc_to_annexb(stream + size, frames->frames[i].size, &index) >= 0) size += frames->frames[i].size;
+    }
+
+    uint64_t ops = 0, bytes = 0;
+    uint64_t start = bench_now_ns();
+    do {
+        int nal_start, nal_end;
+        int offset = 0;
+        while (offset < size) {
+            int ret = find_nal_unit(stream + offset, size - offset, &nal_start, &nal_end);
+            if (ret == 0) break;
+            sink += nal_start;
+            ops++;
+            offset += nal_end;
+            if (ret < 0) break;
+        }
+        bytes += size;
+    } while (bench_now_ns() - start < MIN_RUN_NS && ops);
+    if (ops) emit("find_nal_unit", ops, bytes, bench_now_ns() - start);
+    free(stream);
+}
+
+static void
+make_audio_packets(unsigned char packets[][AUDIO_PACKET_LEN])
+{
+    for (int i = 0; i < AUDIO_PACKETS; i++) {
+        for (int j = 0; j < AUDIO_PACKET_LEN; j++) packets[i][j] = rand();
+        packets[i][0] = 0x80;
+        packets[i][1] = 0x60;
+    }
+}
+
+static raop_buffer_t *
+make_raop_buffer(logger_t *logger)
+{
+    unsigned char key[16], iv[16], secret[32];
+    for (int i = 0; i < sizeof(key); i++) key[i] = i;
+    for (int i = 0; i < sizeof(iv); i++) iv[i] = 0xf0 + i;
+    for (int i = 0; i < sizeof(secret); i++) secret[i] = 3 * i;
+    return raop_buffer_init(logger, RAOP_BUFFER_DEFAULT_LENGTH, key, iv, secret);
+}
+
+static void
+bench_raop_buffer_decrypt(logger_t *logger, unsigned char packets[][AUDIO_PACKET_LEN])
+{
+    raop_buffer_t *raop_buffer = make_raop_buffer(logger);
+    unsigned char output[AUDIO_PACKET_LEN];
+    unsigned int output_len;
+    uint64_t ops = 0;
+    uint64_t start = bench_now_ns();
+    do {
+        for (int i = 0; i < AUDIO_PACKETS; i++) {
+            raop_buffer_decrypt(raop_buffer, packets[i], output, AUDIO_PACKET_LEN - 12, &output_len);
+            sink += output[0];
+        }
+        ops += AUDIO_PACKETS;
+    } while (bench_now_ns() - start < MIN_RUN_NS);
+    emit("raop_buffer_decrypt", ops, ops * (AUDIO_PACKET_LEN - 12), bench_now_ns() - start);
+    raop_buffer_destroy(raop_buffer);
+}
+
+/*
+ * Packets go in with every eighth pair swapped and one in a hundred lost, and are taken out as
+ * the audio thread does, waiting for the gap up to the target depth before giving up on it.
+ */
+static void
+bench_raop_buffer_queue(logger_t *logger, unsigned char packets[][AUDIO_PACKET_LEN])
+{
+    raop_buffer_t *raop_buffer = make_raop_buffer(logger);
+    unsigned short seqnum = 0;
+    uint64_t ops = 0, lost_packets = 0;
+    uint64_t start = bench_now_ns();
+    do {
+        for (int i = 0; i < AUDIO_PACKETS; i++) {
+            int k = (i % 8 == 6) ? i + 1 : (i % 8 == 7) ? i - 1 : i;
+            if (k % 100 == 99) continue;
+            unsigned short packet_seqnum = seqnum + k;
+            unsigned char *packet = packets[i];
+            packet[2] = packet_seqnum >> 8;
+            packet[3] = packet_seqnum;
+            raop_buffer_enqueue(raop_buffer, packet, AUDIO_PACKET_LEN, (uint64_t) k * 8000, 1);
+
+            void *payload;
+            unsigned int length;
+            uint64_t timestamp;
+            int lost;
+            while ((payload = raop_buffer_dequeue(raop_buffer, &length, &timestamp, 0, &lost)) || lost) {
+                if (payload) {
+                    sink += length;
+                    raop_buffer_release(raop_buffer, payload);
+                } else {
+                    lost_packets++;
+                }
+            }
+        }
+        seqnum += AUDIO_PACKETS;
+        ops += AUDIO_PACKETS;
+    } while (bench_now_ns() - start < MIN_RUN_NS);
+    sink += lost_packets;
+    emit("raop_buffer_enqueue_dequeue", ops, 0, bench_now_ns() - start);
+    raop_buffer_destroy(raop_buffer);
+}
+
+/* What a sender sends from connecting to mirroring, bodies shortened to their usual size */
+static char *
+make_rtsp_transcript(int *size)
+{
+    static const char *requests[] = {
+        "GET /info RTSP/1.0\r\nX-Apple-ProtocolVersion: 1\r\nContent-Length: 0\r\nCSeq: 0\r\n"
+        "DACP-ID: 14413BE4996FEA4D\r\nActive-Remote: 2543110914\r\nUser-Agent: AirPlay/550.10\r\n\r\n",
+        "POST /pair-setup RTSP/1.0\r\nContent-Length: 32\r\nContent-Type: application/octet-stream\r\nCSeq: 1\r\n"
+        "DACP-ID: 14413BE4996FEA4D\r\nActive-Remote: 2543110914\r\nUser-Agent: AirPlay/550.10\r\n\r\n"
+        "0123456789abcdef0123456789abcdef",
+        "POST /fp-setup RTSP/1.0\r\nX-Apple-ET: 32\r\nContent-Length: 164\r\nContent-Type: application/octet-stream\r\n"
+        "CSeq: 4\r\nDACP-ID: 14413BE4996FEA4D\r\nActive-Remote: 2543110914\r\nUser-Agent: AirPlay/550.10\r\n\r\n"
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef"
+        "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef0123",
+        "SETUP rtsp://192.168.1.20/4175152262744291186 RTSP/1.0\r\nContent-Length: 256\r\n"
+        "Content-Type: application/x-apple-binary-plist\r\nCSeq: 6\r\nDACP-ID: 14413BE4996FEA4D\r\n"
+        "Active-Remote: 2543110914\r\nUser-Agent: AirPlay/550.10\r\n\r\n"
+        "bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00"
+        "bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00bplist00"
+        "bplist00bplist00bplist00bplist00bplist00bplist00",
+        "GET_PARAMETER rtsp://192.168.1.20/4175152262744291186 RTSP/1.0\r\nContent-Length: 8\r\n"
+        "Content-Type: text/parameters\r\nCSeq: 8\r\nDACP-ID: 14413BE4996FEA4D\r\nActive-Remote: 2543110914\r\n"
+        "User-Agent: AirPlay/550.10\r\n\r\nvolume\r\n",
+        "RECORD rtsp://192.168.1.20/4175152262744291186 RTSP/1.0\r\nCSeq: 9\r\nDACP-ID: 14413BE4996FEA4D\r\n"
+        "Active-Remote: 2543110914\r\nUser-Agent: AirPlay/550.10\r\n\r\n",
+        "SET_PARAMETER rtsp://192.168.1.20/4175152262744291186 RTSP/1.0\r\nContent-Length: 20\r\n"
+        "Content-Type: text/parameters\r\nCSeq: 10\r\nDACP-ID: 14413BE4996FEA4D\r\nActive-Remote: 2543110914\r\n"
+        "User-Agent: AirPlay/550.10\r\n\r\nvolume: -11.123877\r\n",
+        "POST /feedback RTSP/1.0\r\nCSeq: 11\r\nDACP-ID: 14413BE4996FEA4D\r\nActive-Remote: 2543110914\r\n"
+        "User-Agent: AirPlay/550.10\r\n\r\n",
+    };
+    int total = 0;
+    for (int i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) total += strlen(requests[i]);
+    char *transcript = malloc(total);
+    *size = 0;
+    for (int i = 0; i < sizeof(requests) / sizeof(requests[0]); i++) {
+        memcpy(transcript + *size, requests[i], strlen(requests[i]));
+        *size += strlen(requests[i]);
+    }
+    return transcript;
+}
+
+static char *
+read_file(const char *path, int *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *buf = malloc(length);
+    if (!buf || fread(buf, 1, length, file) != (size_t) length) {
+        free(buf);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *size = (int) length;
+    return buf;
+}
+
+/* Parses the transcript request by request on one connection, as httpd feeds it */
+static void
+bench_http_request(const char *transcript, int size)
+{
+    http_request_t *request = http_request_init();
+    uint64_t ops = 0, bytes = 0;
+    uint64_t start = bench_now_ns();
+    do {
+        int offset = 0;
+        while (offset < size) {
+            int ret = http_request_add_data(request, transcript + offset, size - offset);
+            if (ret <= 0 || http_request_has_error(request)) break;
+            offset += ret;
+            if (http_request_is_complete(request)) {
+                sink += strlen(http_request_get_method(request));
+                http_request_reset(request);
+                ops++;
+            }
+        }
+        bytes += offset;
+    } while (bench_now_ns() - start < MIN_RUN_NS && ops);
+    if (ops) emit("http_request_add_data", ops, bytes, bench_now_ns() - start);
+    http_request_destroy(request);
+}
+
+static void
+logger_discard(void *cls, int level, const char *msg)
+{
+    sink += msg[0];
+}
+
+static void
+bench_logger(void)
+{
+    logger_t *logger = logger_init();
+    logger_set_callback(logger, logger_discard, NULL);
+
+    const char *names[] = { "logger_log_filtered", "logger_log_unfiltered" };
+    for (int unfiltered = 0; unfiltered <= 1; unfiltered++) {
+        if (!selected(names[unfiltered])) continue;
+        logger_set_level(logger, unfiltered ? LOGGER_DEBUG : LOGGER_INFO);
+        uint64_t ops = 0;
+        uint64_t start = bench_now_ns();
+        do {
+            for (int i = 0; i < 1000; i++) {
+                logger_log(logger, LOGGER_DEBUG, "raop_rtp_mirror render queue %d/%d", i, 4);
+            }
+            ops += 1000;
+        } while (bench_now_ns() - start < MIN_RUN_NS);
+        emit(names[unfiltered], ops, 0, bench_now_ns() - start);
+    }
+    logger_destroy(logger);
+}
+
+typedef struct {
+    raop_ntp_t *ntp;
+    uint64_t calls;
+} ntp_reader_t;
+
+static void *
+ntp_reader(void *arg)
+{
+    ntp_reader_t *reader = arg;
+    uint64_t acc = 0;
+    for (uint64_t i = 0; i < reader->calls; i++) {
+        acc += raop_ntp_convert_remote_time(reader->ntp, i);
+    }
+    sink += acc;
+    return NULL;
+}
+
+static void
+bench_ntp_convert(logger_t *logger)
+{
+    const unsigned char remote[4] = {127, 0, 0, 1};
+    raop_ntp_t *ntp = raop_ntp_init(logger, remote, sizeof(remote), 7010);
+    if (!ntp) {
+        return;
+    }
+    for (int readers = 1; readers <= MAX_READERS; readers *= 2) {
+        char name[64];
+        snprintf(name, sizeof(name), "raop_ntp_convert_remote_time_%d", readers);
+        if (!selected(name)) continue;
+
+        pthread_t threads[MAX_READERS];
+        ntp_reader_t reader = { ntp, 10000000ull };
+        uint64_t start = bench_now_ns();
+        for (int i = 0; i < readers; i++) pthread_create(&threads[i], NULL, ntp_reader, &reader);
+        for (int i = 0; i < readers; i++) pthread_join(threads[i], NULL);
+        // Wall time per call on each reader
+        emit(name, reader.calls, 0, bench_now_ns() - start);
+    }
+    raop_ntp_destroy(ntp);
+}
+
+static void
+bench_audio_resampler(void)
+{
+    int16_t in[480 * 2], out[512 * 2];
+    audio_resampler_t *resampler = audio_resampler_init(2, 44100);
+    if (!resampler) {
+        return;
+    }
+    for (int i = 0; i < 480 * 2; i++) {
+        in[i] = (int16_t) (rand() - RAND_MAX / 2);
+    }
+    /* Steered off 1:1, as it runs while correcting drift */
+    for (int i = 0; i < 300; i++) {
+        audio_resampler_steer(resampler, i < 200 ? 0 : 20000);
+        audio_resampler_process(resampler, in, 480, out, 512);
+    }
+
+    uint64_t ops = 0;
+    uint64_t start = bench_now_ns();
+    do {
+        for (int i = 0; i < 100; i++) {
+            sink += audio_resampler_process(resampler, in, 480, out, 512);
+        }
+        ops += 100;
+    } while (bench_now_ns() - start < MIN_RUN_NS);
+    emit("audio_resampler_process", ops, ops * sizeof(in), bench_now_ns() - start);
+    audio_resampler_destroy(resampler);
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *trace_path = NULL;
+    const char *requests_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            json_output = !strcmp(argv[++i], "json");
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            requests_path = argv[++i];
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "Usage: %s [-f csv|json] [-t trace] [-r requests] [name filter]\n", argv[0]);
+            return 1;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    logger_t *logger = logger_init();
+    logger_set_level(logger, LOGGER_WARNING);
+
+    frame_list_t encrypted = { 0 }, frames = { 0 };
+    if (trace_path) {
+        if (read_trace_frames(trace_path, &encrypted, &frames) < 0) {
+            fprintf(stderr, "no mirror video in %s\n", trace_path);
+            return 1;
+        }
+    } else {
+        make_synthetic_frames(&frames);
+    }
+
+    int transcript_size;
+    char *transcript = requests_path ? read_file(requests_path, &transcript_size) : make_rtsp_transcript(&transcript_size);
+    if (!transcript) {
+        fprintf(stderr, "could not read %s\n", requests_path);
+        return 1;
+    }
+
+    unsigned char (*packets)[AUDIO_PACKET_LEN] = malloc(AUDIO_PACKETS * AUDIO_PACKET_LEN);
+    make_audio_packets(packets);
+
+    if (!json_output) printf("bench,arch,ops,ns_per_op,mb_per_s\n");
+    if (selected("mirror_buffer_decrypt")) bench_mirror_decrypt(logger, trace_path ? &encrypted : &frames);
+    if (selected("avcc_to_annexb")) bench_avcc_rewrite(&frames);
+    if (selected("find_nal_unit")) bench_find_nal_unit(&frames);
+    if (selected("raop_buffer_decrypt")) bench_raop_buffer_decrypt(logger, packets);
+    if (selected("raop_buffer_enqueue_dequeue")) bench_raop_buffer_queue(logger, packets);
+    if (selected("http_request_add_data")) bench_http_request(transcript, transcript_size);
+    bench_logger();
+    bench_ntp_convert(logger);
+    if (selected("audio_resampler_process")) bench_audio_resampler();
+
+    free(packets);
+    free(transcript);
+    frame_list_free(&encrypted);
+    frame_list_free(&frames);
+    logger_destroy(logger);
+    return sink == 42;
+}
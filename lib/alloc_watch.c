@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "alloc_watch.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if defined(ALLOC_WATCH) && defined(__GLIBC__)
+#define ALLOC_WATCH_HOOKS
+#endif
+
+#define ALLOC_WATCH_MAX_THREADS 64
+
+#define ALLOC_WATCH_ROLE_NONE (-1)
+
+typedef struct alloc_watch_counter_s {
+    unsigned long allocations;
+    unsigned long frees;
+    unsigned long long bytes;
+    void *first_caller;
+} alloc_watch_counter_t;
+
+static const int alloc_watch_watched_roles[] = {
+    THREAD_ROLE_MIRROR,
+    THREAD_ROLE_RENDER,
+    THREAD_ROLE_AUDIO,
+    THREAD_ROLE_ADECODE,
+};
+
+#ifdef ALLOC_WATCH_HOOKS
+typedef struct alloc_watch_thread_s {
+    thread_handle_t handle;
+    int role;
+} alloc_watch_thread_t;
+
+static alloc_watch_thread_t alloc_watch_threads[ALLOC_WATCH_MAX_THREADS];
+static int alloc_watch_thread_count;
+/* Bumped by every registration, so threads that looked themselves up too early look again */
+static unsigned int alloc_watch_generation = 1;
+#endif
+static int alloc_watch_armed;
+static alloc_watch_counter_t alloc_watch_counters[THREAD_ROLE_COUNT];
+
+int
+alloc_watch_is_available(void)
+{
+#ifdef ALLOC_WATCH_HOOKS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void
+alloc_watch_set_role(thread_handle_t handle, thread_role_t role)
+{
+#ifdef ALLOC_WATCH_HOOKS
+    static mutex_handle_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    int i;
+
+    MUTEX_LOCK(mutex);
+    // Handles of finished threads are reused by new ones, which then take over the entry
+    for (i = 0; i < alloc_watch_thread_count; i++) {
+        if (pthread_equal(alloc_watch_threads[i].handle, handle)) {
+            break;
+        }
+    }
+    if (i < ALLOC_WATCH_MAX_THREADS) {
+        __atomic_store_n(&alloc_watch_threads[i].role, role, __ATOMIC_RELAXED);
+        __atomic_store_n(&alloc_watch_threads[i].handle, handle, __ATOMIC_RELAXED);
+        if (i == alloc_watch_thread_count) {
+            __atomic_store_n(&alloc_watch_thread_count, i + 1, __ATOMIC_RELEASE);
+        }
+        __atomic_add_fetch(&alloc_watch_generation, 1, __ATOMIC_RELEASE);
+    }
+    MUTEX_UNLOCK(mutex);
+#else
+    (void) handle;
+    (void) role;
+#endif
+}
+
+void
+alloc_watch_arm(void)
+{
+    memset(alloc_watch_counters, 0, sizeof(alloc_watch_counters));
+    __atomic_store_n(&alloc_watch_armed, 1, __ATOMIC_RELEASE);
+}
+
+void
+alloc_watch_disarm(void)
+{
+    __atomic_store_n(&alloc_watch_armed, 0, __ATOMIC_RELEASE);
+}
+
+unsigned long
+alloc_watch_count(thread_role_t role)
+{
+    return __atomic_load_n(&alloc_watch_counters[role].allocations, __ATOMIC_RELAXED);
+}
+
+unsigned long
+alloc_watch_report(logger_t *logger)
+{
+    unsigned long total = 0;
+
+    for (unsigned int i = 0; i < sizeof(alloc_watch_watched_roles) / sizeof(alloc_watch_watched_roles[0]); i++) {
+        int role = alloc_watch_watched_roles[i];
+        alloc_watch_counter_t *counter = &alloc_watch_counters[role];
+        unsigned long allocations = __atomic_load_n(&counter->allocations, __ATOMIC_RELAXED);
+        unsigned long frees = __atomic_load_n(&counter->frees, __ATOMIC_RELAXED);
+
+        if (allocations || frees) {
+            // The caller address resolves with addr2line -e on the binary
+            logger_log(logger, LOGGER_WARNING, "%s threads: %lu allocations of %llu bytes and %lu frees after warm-up, first from %p",
+                       thread_role_name(role), allocations,
+                       (unsigned long long) __atomic_load_n(&counter->bytes, __ATOMIC_RELAXED), frees,
+                       __atomic_load_n(&counter->first_caller, __ATOMIC_RELAXED));
+        } else {
+            logger_log(logger, LOGGER_INFO, "%s threads: no allocations after warm-up", thread_role_name(role));
+        }
+        total += allocations + frees;
+    }
+    return total;
+}
+
+#ifdef ALLOC_WATCH_HOOKS
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+static __thread int alloc_watch_thread_role = ALLOC_WATCH_ROLE_NONE;
+static __thread unsigned int alloc_watch_thread_generation;
+
+static alloc_watch_counter_t *
+alloc_watch_counter(void)
+{
+    if (!__atomic_load_n(&alloc_watch_armed, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+
+    unsigned int generation = __atomic_load_n(&alloc_watch_generation, __ATOMIC_ACQUIRE);
+    if (alloc_watch_thread_generation != generation) {
+        // The creating thread registers the role, which may be after the thread's first allocations
+        thread_handle_t self = pthread_self();
+        int count = __atomic_load_n(&alloc_watch_thread_count, __ATOMIC_ACQUIRE);
+        alloc_watch_thread_role = ALLOC_WATCH_ROLE_NONE;
+        for (int i = 0; i < count; i++) {
+            if (pthread_equal(__atomic_load_n(&alloc_watch_threads[i].handle, __ATOMIC_RELAXED), self)) {
+                alloc_watch_thread_role = __atomic_load_n(&alloc_watch_threads[i].role, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+        alloc_watch_thread_generation = generation;
+    }
+    if (alloc_watch_thread_role == ALLOC_WATCH_ROLE_NONE) {
+        return NULL;
+    }
+    return &alloc_watch_counters[alloc_watch_thread_role];
+}
+
+static void
+alloc_watch_record_allocation(size_t size, void *caller)
+{
+    alloc_watch_counter_t *counter = alloc_watch_counter();
+    if (!counter) {
+        return;
+    }
+    void *expected = NULL;
+    __atomic_compare_exchange_n(&counter->first_caller, &expected, caller, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counter->allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counter->bytes, size, __ATOMIC_RELAXED);
+}
+
+void *
+malloc(size_t size)
+{
+    alloc_watch_record_allocation(size, __builtin_return_address(0));
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t count, size_t size)
+{
+    alloc_watch_record_allocation(count * size, __builtin_return_address(0));
+    return __libc_calloc(count, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    alloc_watch_record_allocation(size, __builtin_return_address(0));
+    return __libc_realloc(ptr, size);
+}
+
+void *
+memalign(size_t alignment, size_t size)
+{
+    alloc_watch_record_allocation(size, __builtin_return_address(0));
+    return __libc_memalign(alignment, size);
+}
+
+void *
+aligned_alloc(size_t alignment, size_t size)
+{
+    alloc_watch_record_allocation(size, __builtin_return_address(0));
+    return __libc_memalign(alignment, size);
+}
+
+int
+posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1))) {
+        return EINVAL;
+    }
+    alloc_watch_record_allocation(size, __builtin_return_address(0));
+    void *ptr = __libc_memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+void
+free(void *ptr)
+{
+    if (ptr) {
+        alloc_watch_counter_t *counter = alloc_watch_counter();
+        if (counter) {
+            __atomic_add_fetch(&counter->frees, 1, __ATOMIC_RELAXED);
+        }
+    }
+    __libc_free(ptr);
+}
+
+#endif
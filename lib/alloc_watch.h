@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef ALLOC_WATCH_H
+#define ALLOC_WATCH_H
+
+#include "threads.h"
+#include "logger.h"
+
+/*
+ * Checks that the media threads run allocation free once a session is warmed up. Built with
+ * the ALLOC_WATCH option, malloc and friends are interposed and, while the watch is armed,
+ * every call is counted against the role of the calling thread, as registered by
+ * thread_apply_role. The mirror, audio, audio decode and render threads are expected to work
+ * from their pools and slabs only; anything they allocate after warm-up is a regression.
+ *
+ * The interposers need glibc, without the option or on other platforms the watch is a no-op
+ * and alloc_watch_is_available says so.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Nonzero if the build counts allocations */
+int alloc_watch_is_available(void);
+/* Called by thread_apply_role, attributes the allocations of the thread to its role */
+void alloc_watch_set_role(thread_handle_t handle, thread_role_t role);
+
+/* Starts counting from zero, typically once the session is warmed up */
+void alloc_watch_arm(void);
+void alloc_watch_disarm(void);
+
+/* Allocations on the threads of the role while armed */
+unsigned long alloc_watch_count(thread_role_t role);
+/* Logs the allocations on the media threads, returns how many there were */
+unsigned long alloc_watch_report(logger_t *logger);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ALLOC_WATCH_H
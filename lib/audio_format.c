@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "audio_format.h"
+
+/* Compression types of a SETUP audio stream */
+#define AUDIO_FORMAT_CT_ALAC 2
+#define AUDIO_FORMAT_CT_AAC_LC 4
+#define AUDIO_FORMAT_CT_AAC_ELD 8
+
+/* Audio object types of an AudioSpecificConfig */
+#define AUDIO_FORMAT_AOT_AAC_LC 2
+#define AUDIO_FORMAT_AOT_ER_AAC_ELD 39
+
+/* Rice coding parameters and run limit Apple's encoder uses, as AirPlay 1 announced them in SDP */
+#define AUDIO_FORMAT_ALAC_PB 40
+#define AUDIO_FORMAT_ALAC_MB 10
+#define AUDIO_FORMAT_ALAC_KB 14
+#define AUDIO_FORMAT_ALAC_MAX_RUN 255
+
+typedef struct audio_format_entry_s {
+    uint64_t mask;
+    audio_codec_t codec;
+    int sample_rate;
+    int sample_size;
+} audio_format_entry_t;
+
+static const audio_format_entry_t audio_format_entries[] = {
+    { AUDIO_FORMAT_ALAC_44100_16, AUDIO_CODEC_ALAC, 44100, 16 },
+    { AUDIO_FORMAT_ALAC_44100_24, AUDIO_CODEC_ALAC, 44100, 24 },
+    { AUDIO_FORMAT_ALAC_48000_16, AUDIO_CODEC_ALAC, 48000, 16 },
+    { AUDIO_FORMAT_ALAC_48000_24, AUDIO_CODEC_ALAC, 48000, 24 },
+    { AUDIO_FORMAT_AAC_LC_44100, AUDIO_CODEC_AAC_LC, 44100, 16 },
+    { AUDIO_FORMAT_AAC_LC_48000, AUDIO_CODEC_AAC_LC, 48000, 16 },
+    { AUDIO_FORMAT_AAC_ELD_44100, AUDIO_CODEC_AAC_ELD, 44100, 16 },
+    { AUDIO_FORMAT_AAC_ELD_48000, AUDIO_CODEC_AAC_ELD, 48000, 16 },
+};
+
+#define AUDIO_FORMAT_ENTRY_COUNT ((int) (sizeof(audio_format_entries) / sizeof(audio_format_entries[0])))
+
+static int
+audio_format_default_frame_samples(audio_codec_t codec)
+{
+    switch (codec) {
+        case AUDIO_CODEC_ALAC:
+            return 352;
+        case AUDIO_CODEC_AAC_LC:
+            return 1024;
+        default:
+            return 480;
+    }
+}
+
+void
+audio_format_init_default(audio_format_t *format)
+{
+    assert(format);
+    format->codec = AUDIO_CODEC_AAC_ELD;
+    format->sample_rate = 44100;
+    format->channels = 2;
+    format->sample_size = 16;
+    format->frame_samples = 480;
+}
+
+int
+audio_format_from_setup(uint64_t audio_format, uint64_t ct, uint64_t sr, uint64_t spf, audio_format_t *format)
+{
+    assert(format);
+
+    const audio_format_entry_t *entry = NULL;
+    for (int i = 0; i < AUDIO_FORMAT_ENTRY_COUNT && audio_format; i++) {
+        if (audio_format_entries[i].mask == audio_format) {
+            entry = &audio_format_entries[i];
+        }
+    }
+    if (entry) {
+        format->codec = entry->codec;
+        format->sample_rate = entry->sample_rate;
+        format->sample_size = entry->sample_size;
+    } else if (audio_format) {
+        return -1;
+    } else {
+        switch (ct) {
+            case AUDIO_FORMAT_CT_ALAC:
+                format->codec = AUDIO_CODEC_ALAC;
+                break;
+            case AUDIO_FORMAT_CT_AAC_LC:
+                format->codec = AUDIO_CODEC_AAC_LC;
+                break;
+            case 0:
+            case AUDIO_FORMAT_CT_AAC_ELD:
+                format->codec = AUDIO_CODEC_AAC_ELD;
+                break;
+            default:
+                return -1;
+        }
+        format->sample_rate = sr ? (int) sr : 44100;
+        format->sample_size = 16;
+        if (format->sample_rate != 44100 && format->sample_rate != 48000) {
+            return -1;
+        }
+    }
+    format->channels = 2;
+    format->frame_samples = spf ? (int) spf : audio_format_default_frame_samples(format->codec);
+    return 0;
+}
+
+uint64_t
+audio_format_get_mask(const audio_format_t *format)
+{
+    assert(format);
+    for (int i = 0; i < AUDIO_FORMAT_ENTRY_COUNT; i++) {
+        const audio_format_entry_t *entry = &audio_format_entries[i];
+        if (entry->codec == format->codec && entry->sample_rate == format->sample_rate &&
+            entry->sample_size == format->sample_size && format->channels == 2) {
+            return entry->mask;
+        }
+    }
+    return 0;
+}
+
+static int
+audio_format_get_frequency_index(int sample_rate)
+{
+    static const int rates[] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000 };
+    for (int i = 0; i < (int) (sizeof(rates) / sizeof(rates[0])); i++) {
+        if (rates[i] == sample_rate) {
+            return i;
+        }
+    }
+    return 4;
+}
+
+int
+audio_format_get_config(const audio_format_t *format, unsigned char config[AUDIO_FORMAT_MAX_CONFIG])
+{
+    assert(format);
+    int frequency_index = audio_format_get_frequency_index(format->sample_rate);
+
+    switch (format->codec) {
+        case AUDIO_CODEC_AAC_LC:
+            /* Object type, frequency index, channels, then 1024 sample frames and no extensions */
+            config[0] = (AUDIO_FORMAT_AOT_AAC_LC << 3) | (frequency_index >> 1);
+            config[1] = ((frequency_index & 1) << 7) | (format->channels << 3);
+            return 2;
+        case AUDIO_CODEC_AAC_ELD:
+            /* Escaped object type 39, frequency index, channels, then the ELDSpecificConfig:
+             * 480 sample frames, no resilience tools, no low delay SBR and no extensions */
+            config[0] = 0xf8 | ((AUDIO_FORMAT_AOT_ER_AAC_ELD - 32) >> 3);
+            config[1] = (((AUDIO_FORMAT_AOT_ER_AAC_ELD - 32) & 7) << 5) | (frequency_index << 1) | (format->channels >> 3);
+            config[2] = ((format->channels & 7) << 5) | ((format->frame_samples == 480) << 4);
+            config[3] = 0;
+            return 4;
+        case AUDIO_CODEC_ALAC:
+            memset(config, 0, 24);
+            config[0] = format->frame_samples >> 24;
+            config[1] = format->frame_samples >> 16;
+            config[2] = format->frame_samples >> 8;
+            config[3] = format->frame_samples;
+            config[5] = format->sample_size;
+            config[6] = AUDIO_FORMAT_ALAC_PB;
+            config[7] = AUDIO_FORMAT_ALAC_MB;
+            config[8] = AUDIO_FORMAT_ALAC_KB;
+            config[9] = format->channels;
+            config[10] = AUDIO_FORMAT_ALAC_MAX_RUN >> 8;
+            config[11] = AUDIO_FORMAT_ALAC_MAX_RUN & 0xff;
+            /* Maximum frame size and average bit rate stay 0, unknown */
+            config[20] = format->sample_rate >> 24;
+            config[21] = format->sample_rate >> 16;
+            config[22] = format->sample_rate >> 8;
+            config[23] = format->sample_rate;
+            return 24;
+    }
+    return 0;
+}
+
+const char *
+audio_format_get_codec_name(audio_codec_t codec)
+{
+    switch (codec) {
+        case AUDIO_CODEC_ALAC:
+            return "ALAC";
+        case AUDIO_CODEC_AAC_LC:
+            return "AAC-LC";
+        case AUDIO_CODEC_AAC_ELD:
+            return "AAC-ELD";
+    }
+    return "unknown";
+}
+
+int
+audio_format_equal(const audio_format_t *a, const audio_format_t *b)
+{
+    return a->codec == b->codec && a->sample_rate == b->sample_rate && a->channels == b->channels &&
+           a->sample_size == b->sample_size && a->frame_samples == b->frame_samples;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef AUDIO_FORMAT_H
+#define AUDIO_FORMAT_H
+
+#include <stdint.h>
+
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bits of the AirPlay audioFormat mask. GET /info lists the formats a receiver takes, the
+ * sender picks one of them and names it in the SETUP of the audio stream.
+ */
+#define AUDIO_FORMAT_ALAC_44100_16  (1ull << 18)
+#define AUDIO_FORMAT_ALAC_44100_24  (1ull << 19)
+#define AUDIO_FORMAT_ALAC_48000_16  (1ull << 20)
+#define AUDIO_FORMAT_ALAC_48000_24  (1ull << 21)
+#define AUDIO_FORMAT_AAC_LC_44100   (1ull << 22)
+#define AUDIO_FORMAT_AAC_LC_48000   (1ull << 23)
+#define AUDIO_FORMAT_AAC_ELD_44100  (1ull << 24)
+#define AUDIO_FORMAT_AAC_ELD_48000  (1ull << 25)
+
+#define AUDIO_FORMATS_ALAC (AUDIO_FORMAT_ALAC_44100_16 | AUDIO_FORMAT_ALAC_44100_24 | \
+                            AUDIO_FORMAT_ALAC_48000_16 | AUDIO_FORMAT_ALAC_48000_24)
+#define AUDIO_FORMATS_AAC (AUDIO_FORMAT_AAC_LC_44100 | AUDIO_FORMAT_AAC_LC_48000 | \
+                           AUDIO_FORMAT_AAC_ELD_44100 | AUDIO_FORMAT_AAC_ELD_48000)
+
+/* Longest codec configuration audio_format_get_config writes */
+#define AUDIO_FORMAT_MAX_CONFIG 24
+
+/* Stereo AAC-ELD at 44.1 kHz, which screen mirroring always uses */
+void audio_format_init_default(audio_format_t *format);
+/*
+ * Fills format from the keys of a SETUP audio stream: the audioFormat bit if the sender sent
+ * one, else the compression type ct, sample rate sr and samples per frame spf. Keys that are
+ * missing are 0. Returns -1 for a format that is not one of the above.
+ */
+int audio_format_from_setup(uint64_t audio_format, uint64_t ct, uint64_t sr, uint64_t spf, audio_format_t *format);
+/* The audioFormat bit of format, 0 if AirPlay has none for it */
+uint64_t audio_format_get_mask(const audio_format_t *format);
+/*
+ * Writes the configuration a decoder needs for format: the AudioSpecificConfig of AAC or the
+ * ALACSpecificConfig (the magic cookie without its atom header). Returns its length.
+ */
+int audio_format_get_config(const audio_format_t *format, unsigned char config[AUDIO_FORMAT_MAX_CONFIG]);
+const char *audio_format_get_codec_name(audio_codec_t codec);
+int audio_format_equal(const audio_format_t *a, const audio_format_t *b);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //AUDIO_FORMAT_H
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "audio_gain.h"
+
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "threads.h"
+
+/* Gain change per frame while ramping */
+#define AUDIO_GAIN_STEP ((AUDIO_GAIN_UNITY + AUDIO_GAIN_RAMP_FRAMES - 1) / AUDIO_GAIN_RAMP_FRAMES)
+
+static int
+audio_gain_clamp(int value)
+{
+    if (value < 0) {
+        return 0;
+    } else if (value > AUDIO_GAIN_UNITY) {
+        return AUDIO_GAIN_UNITY;
+    }
+    return value;
+}
+
+void
+audio_gain_init(audio_gain_t *gain, int value)
+{
+    assert(gain);
+    gain->target = gain->current = audio_gain_clamp(value);
+}
+
+void
+audio_gain_set(audio_gain_t *gain, int value)
+{
+    assert(gain);
+    ATOMIC_STORE(gain->target, audio_gain_clamp(value));
+}
+
+int
+audio_gain_from_db(float db)
+{
+    return audio_gain_clamp((int) (powf(10.0f, db / 20.0f) * AUDIO_GAIN_UNITY));
+}
+
+int
+audio_gain_ramping(audio_gain_t *gain)
+{
+    return gain->current != ATOMIC_LOAD(gain->target);
+}
+
+int
+audio_gain_get(audio_gain_t *gain)
+{
+    return gain->current;
+}
+
+void
+audio_gain_apply(audio_gain_t *gain, int16_t *dst, const int16_t *src, int frames, int channels)
+{
+    int target = ATOMIC_LOAD(gain->target);
+    int current = gain->current;
+    int frame = 0;
+
+    for (; frame < frames && current != target; frame++) {
+        if (current < target) {
+            current = target - current > AUDIO_GAIN_STEP ? current + AUDIO_GAIN_STEP : target;
+        } else {
+            current = current - target > AUDIO_GAIN_STEP ? current - AUDIO_GAIN_STEP : target;
+        }
+        for (int c = 0; c < channels; c++) {
+            dst[c] = (int16_t) (((int32_t) src[c] * current) >> 15);
+        }
+        dst += channels;
+        src += channels;
+    }
+    gain->current = current;
+
+    int samples = (frames - frame) * channels;
+    if (current == AUDIO_GAIN_UNITY) {
+        if (dst != src) {
+            memcpy(dst, src, samples * sizeof(int16_t));
+        }
+    } else {
+        for (int i = 0; i < samples; i++) {
+            dst[i] = (int16_t) (((int32_t) src[i] * current) >> 15);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef AUDIO_GAIN_H
+#define AUDIO_GAIN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The volume of a stream of 16 bit PCM. A new gain is not stepped to between two buffers,
+ * which clicks with every move of the sender's volume slider, but ramped to linearly frame by
+ * frame, from mute to unity in AUDIO_GAIN_RAMP_FRAMES. The gain can be set from any thread,
+ * only the thread producing the audio may apply it.
+ */
+typedef struct audio_gain_s {
+    int target;
+    int current;
+} audio_gain_t;
+
+/* Unity gain, gains are Q15 */
+#define AUDIO_GAIN_UNITY 32768
+/* About 23 ms at 44.1 kHz */
+#define AUDIO_GAIN_RAMP_FRAMES 1024
+
+void audio_gain_init(audio_gain_t *gain, int value);
+void audio_gain_set(audio_gain_t *gain, int value);
+/* The gain of a level in dB, 0 dB is unity */
+int audio_gain_from_db(float db);
+
+/* 1 while the gain is on its way to the last one set */
+int audio_gain_ramping(audio_gain_t *gain);
+/* The gain the next frame gets */
+int audio_gain_get(audio_gain_t *gain);
+
+/* Scales frames of channels interleaved samples from src into dst, which may be src */
+void audio_gain_apply(audio_gain_t *gain, int16_t *dst, const int16_t *src, int frames, int channels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //AUDIO_GAIN_H
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "audio_mixer.h"
+#include "audio_gain.h"
+#include "simd_kernels.h"
+#include "threads.h"
+
+/* How far the timeline may run apart from the output's clock before it is anchored anew */
+#define AUDIO_MIXER_MAX_SKEW_US (2 * AUDIO_MIXER_SLIP_US)
+/* Samples a stream whose gain is ramping is scaled into before they are added */
+#define AUDIO_MIXER_RAMP_SAMPLES 512
+
+struct audio_mixer_s {
+    int channels;
+    int sample_rate;
+
+    /* capacity frames of interleaved samples, the frame at position p is at p % capacity */
+    int16_t *ring;
+    int capacity;
+    /* Position of the next frame audio_mixer_take returns, everything before it is gone */
+    int64_t read_position;
+
+    /* The frame at anchor_position plays at the local time anchor_time */
+    int anchored;
+    int64_t anchor_position;
+    uint64_t anchor_time;
+
+    /* The mix_add kernel for the CPU, see simd_kernels.h */
+    void (*add)(int16_t *dst, const int16_t *src, int samples, int gain);
+
+    mutex_handle_t mutex;
+};
+
+struct audio_mixer_stream_s {
+    audio_mixer_t *mixer;
+    audio_gain_t gain;
+    /* Position right after the last frames written, the next ones go there if they are close */
+    int placed;
+    int64_t next_position;
+};
+
+audio_mixer_t *
+audio_mixer_init(int channels, int sample_rate, int capacity_frames)
+{
+    audio_mixer_t *mixer;
+
+    assert(channels > 0);
+    assert(sample_rate > 0);
+    assert(capacity_frames > 0);
+
+    mixer = calloc(1, sizeof(audio_mixer_t));
+    if (!mixer) {
+        return NULL;
+    }
+    mixer->ring = calloc((size_t) capacity_frames * channels, sizeof(int16_t));
+    if (!mixer->ring) {
+        free(mixer);
+        return NULL;
+    }
+    mixer->channels = channels;
+    mixer->sample_rate = sample_rate;
+    mixer->capacity = capacity_frames;
+    mixer->add = simd_kernels()->mix_add;
+    MUTEX_CREATE(mixer->mutex);
+    return mixer;
+}
+
+void
+audio_mixer_destroy(audio_mixer_t *mixer)
+{
+    if (mixer) {
+        MUTEX_DESTROY(mixer->mutex);
+        free(mixer->ring);
+        free(mixer);
+    }
+}
+
+static int64_t
+audio_mixer_position_at(audio_mixer_t *mixer, uint64_t time)
+{
+    int64_t delta = (int64_t) (time - mixer->anchor_time);
+    return mixer->anchor_position + delta * mixer->sample_rate / 1000000;
+}
+
+void
+audio_mixer_take(audio_mixer_t *mixer, int16_t *out, int frames, uint64_t play_time)
+{
+    assert(mixer);
+
+    MUTEX_LOCK(mixer->mutex);
+    int64_t expected = mixer->anchored ? audio_mixer_position_at(mixer, play_time) : 0;
+    int64_t skew = expected - mixer->read_position;
+    if (!mixer->anchored || llabs(skew) * 1000000 > (int64_t) AUDIO_MIXER_MAX_SKEW_US * mixer->sample_rate) {
+        mixer->anchored = 1;
+        mixer->anchor_position = mixer->read_position;
+        mixer->anchor_time = play_time;
+    }
+
+    while (frames > 0) {
+        int index = (int) (mixer->read_position % mixer->capacity);
+        int count = mixer->capacity - index < frames ? mixer->capacity - index : frames;
+        int16_t *slot = mixer->ring + (size_t) index * mixer->channels;
+        memcpy(out, slot, (size_t) count * mixer->channels * sizeof(int16_t));
+        memset(slot, 0, (size_t) count * mixer->channels * sizeof(int16_t));
+        out += count * mixer->channels;
+        frames -= count;
+        mixer->read_position += count;
+    }
+    MUTEX_UNLOCK(mixer->mutex);
+}
+
+audio_mixer_stream_t *
+audio_mixer_stream_init(audio_mixer_t *mixer)
+{
+    audio_mixer_stream_t *stream;
+
+    assert(mixer);
+
+    stream = calloc(1, sizeof(audio_mixer_stream_t));
+    if (!stream) {
+        return NULL;
+    }
+    stream->mixer = mixer;
+    audio_gain_init(&stream->gain, AUDIO_MIXER_UNITY);
+    return stream;
+}
+
+void
+audio_mixer_stream_destroy(audio_mixer_stream_t *stream)
+{
+    free(stream);
+}
+
+void
+audio_mixer_stream_set_gain(audio_mixer_stream_t *stream, int gain)
+{
+    assert(stream);
+
+    audio_gain_set(&stream->gain, gain);
+}
+
+void
+audio_mixer_stream_reset(audio_mixer_stream_t *stream)
+{
+    assert(stream);
+
+    MUTEX_LOCK(stream->mixer->mutex);
+    stream->placed = 0;
+    MUTEX_UNLOCK(stream->mixer->mutex);
+}
+
+/* Adds frames of the stream at dst, ramping its gain sample by sample while it changes */
+static void
+audio_mixer_stream_add(audio_mixer_stream_t *stream, int16_t *dst, const int16_t *pcm, int frames)
+{
+    audio_mixer_t *mixer = stream->mixer;
+    int16_t ramp[AUDIO_MIXER_RAMP_SAMPLES];
+
+    while (frames > 0 && audio_gain_ramping(&stream->gain)) {
+        int count = frames < AUDIO_MIXER_RAMP_SAMPLES / mixer->channels ? frames : AUDIO_MIXER_RAMP_SAMPLES / mixer->channels;
+        audio_gain_apply(&stream->gain, ramp, pcm, count, mixer->channels);
+        mixer->add(dst, ramp, count * mixer->channels, AUDIO_MIXER_UNITY);
+        dst += count * mixer->channels;
+        pcm += count * mixer->channels;
+        frames -= count;
+    }
+    int gain = audio_gain_get(&stream->gain);
+    if (frames > 0 && gain > 0) {
+        mixer->add(dst, pcm, frames * mixer->channels, gain);
+    }
+}
+
+int
+audio_mixer_stream_write(audio_mixer_stream_t *stream, const int16_t *pcm, int frames, uint64_t play_time)
+{
+    audio_mixer_t *mixer;
+    int mixed = 0;
+
+    assert(stream);
+    assert(pcm);
+    mixer = stream->mixer;
+
+    MUTEX_LOCK(mixer->mutex);
+    // Until the output runs there is no telling where the frames go
+    if (!mixer->anchored) {
+        MUTEX_UNLOCK(mixer->mutex);
+        return 0;
+    }
+
+    int64_t position = audio_mixer_position_at(mixer, play_time);
+    int64_t slip = (int64_t) AUDIO_MIXER_SLIP_US * mixer->sample_rate / 1000000;
+    if (stream->placed && llabs(position - stream->next_position) <= slip) {
+        position = stream->next_position;
+    }
+    stream->placed = 1;
+    stream->next_position = position + frames;
+
+    int64_t start = position > mixer->read_position ? position : mixer->read_position;
+    int64_t end = position + frames;
+    if (end > mixer->read_position + mixer->capacity) {
+        end = mixer->read_position + mixer->capacity;
+    }
+    pcm += (start - position) * mixer->channels;
+    while (start < end) {
+        int index = (int) (start % mixer->capacity);
+        int count = (int) (end - start < mixer->capacity - index ? end - start : mixer->capacity - index);
+        audio_mixer_stream_add(stream, mixer->ring + (size_t) index * mixer->channels, pcm, count);
+        pcm += count * mixer->channels;
+        start += count;
+        mixed += count;
+    }
+    MUTEX_UNLOCK(mixer->mutex);
+    return mixed;
+}
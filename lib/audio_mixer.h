@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <stdint.h>
+
+/*
+ * Mixes the decoded audio of simultaneous streams into one output. The mix is a ring of
+ * interleaved 16 bit samples on a timeline of its own, which the output anchors to the local
+ * clock as it takes the mix out period by period. Every stream adds its frames at the place of
+ * the local time they are to play, scaled by its gain and with saturating adds, in NEON or SSE2
+ * where the compiler targets them. Frames of a stream follow on its previous ones as long as
+ * their time stays within AUDIO_MIXER_SLIP_US of there, so the jitter of the timestamps does not
+ * tear gaps into it. What arrives after its place was taken out or further ahead than the ring
+ * reaches is dropped.
+ *
+ * Streams write from their own threads and the output takes from another one, the mixer
+ * serializes them.
+ */
+typedef struct audio_mixer_s audio_mixer_t;
+typedef struct audio_mixer_stream_s audio_mixer_stream_t;
+
+#define AUDIO_MIXER_SLIP_US 20000
+/* Unity gain, gains are Q15 */
+#define AUDIO_MIXER_UNITY 32768
+
+audio_mixer_t *audio_mixer_init(int channels, int sample_rate, int capacity_frames);
+/* All streams have to be destroyed before */
+void audio_mixer_destroy(audio_mixer_t *mixer);
+
+/**
+ * Takes the next frames of the mix into out, silence where no stream added any, and clears
+ * them in the ring. play_time is the local time in micro seconds the first of them plays at;
+ * the timeline follows it when it was not anchored yet or has run too far apart from it.
+ */
+void audio_mixer_take(audio_mixer_t *mixer, int16_t *out, int frames, uint64_t play_time);
+
+audio_mixer_stream_t *audio_mixer_stream_init(audio_mixer_t *mixer);
+void audio_mixer_stream_destroy(audio_mixer_stream_t *stream);
+/* The stream ramps to the new gain over the frames it writes next, see audio_gain.h */
+void audio_mixer_stream_set_gain(audio_mixer_stream_t *stream, int gain);
+/* Places the next frames by their time alone, after a flush or a jump in the stream */
+void audio_mixer_stream_reset(audio_mixer_stream_t *stream);
+
+/**
+ * Adds frames of interleaved PCM that are to play at the local time play_time, in micro
+ * seconds. Returns the number of frames that went into the mix.
+ */
+int audio_mixer_stream_write(audio_mixer_stream_t *stream, const int16_t *pcm, int frames, uint64_t play_time);
+
+#endif //AUDIO_MIXER_H
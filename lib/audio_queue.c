@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "audio_queue.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+#include "threads.h"
+#include "metrics.h"
+#include "memlock.h"
+#include "mem_account.h"
+
+/* Large enough for any AAC frame and most ALAC ones, slots grow past it on demand */
+#define AUDIO_QUEUE_MIN_SLOT 2048
+
+typedef struct {
+    unsigned char *data;
+    int capacity;
+    int data_len;
+    int lost;
+    uint64_t pts;
+    /* Flushes before the frame was pushed */
+    unsigned int generation;
+} audio_queue_slot_t;
+
+struct audio_queue_s {
+    logger_t *logger;
+
+    audio_queue_slot_t *slots;
+    int depth;
+
+    // Written by the producer only, slots before tail are ready
+    atomic_uint tail;
+    // Written by the consumer only, slots before head are free again
+    atomic_uint head;
+    atomic_uint generation;
+    atomic_uint wakeups;
+    atomic_int stopped;
+    atomic_int waiters;
+
+    // Consumer only: the slot handed out by the last pop, and the flushes and wakeups seen
+    int holding;
+    unsigned int popped_generation;
+    unsigned int seen_wakeups;
+
+    // Producer only, set while frames are dropped to log it once
+    int overflowing;
+
+    mutex_handle_t wait_mutex;
+    cond_handle_t wait_cond;
+};
+
+audio_queue_t *
+audio_queue_init(logger_t *logger, int depth)
+{
+    audio_queue_t *queue;
+
+    assert(depth > 1);
+
+    queue = calloc(1, sizeof(audio_queue_t));
+    if (!queue) {
+        return NULL;
+    }
+    queue->slots = calloc(depth, sizeof(audio_queue_slot_t));
+    if (!queue->slots) {
+        free(queue);
+        return NULL;
+    }
+    // Allocated and touched up front, so the first frames do not fault on new slots
+    for (int i = 0; i < depth; i++) {
+        queue->slots[i].data = mem_account_malloc(MEM_TAG_AUDIO_BUFFERS, AUDIO_QUEUE_MIN_SLOT);
+        if (queue->slots[i].data) {
+            memlock_prefault(queue->slots[i].data, AUDIO_QUEUE_MIN_SLOT);
+            queue->slots[i].capacity = AUDIO_QUEUE_MIN_SLOT;
+        }
+    }
+    queue->logger = logger;
+    queue->depth = depth;
+    MUTEX_CREATE(queue->wait_mutex);
+    COND_CREATE(queue->wait_cond);
+    audio_queue_start(queue);
+    return queue;
+}
+
+void
+audio_queue_destroy(audio_queue_t *queue)
+{
+    if (queue) {
+        MUTEX_DESTROY(queue->wait_mutex);
+        COND_DESTROY(queue->wait_cond);
+        for (int i = 0; i < queue->depth; i++) {
+            mem_account_free(queue->slots[i].data);
+        }
+        free(queue->slots);
+        free(queue);
+    }
+}
+
+static void
+audio_queue_notify(audio_queue_t *queue)
+{
+    // Either the waiter sees the update or we see the waiter, both are sequentially consistent
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&queue->waiters) > 0) {
+        MUTEX_LOCK(queue->wait_mutex);
+        COND_BROADCAST(queue->wait_cond);
+        MUTEX_UNLOCK(queue->wait_mutex);
+    }
+}
+
+int
+audio_queue_push(audio_queue_t *queue, const unsigned char *data, int data_len, uint64_t pts)
+{
+    assert(queue);
+
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&queue->head, memory_order_acquire) >= (unsigned int) queue->depth) {
+        metrics_add(METRIC_AUDIO_FRAMES_DROPPED, 1);
+        if (!queue->overflowing) {
+            logger_log(queue->logger, LOGGER_WARNING, "Audio decoding fell behind, dropping frames");
+        }
+        queue->overflowing = 1;
+        return -1;
+    }
+    queue->overflowing = 0;
+
+    audio_queue_slot_t *slot = &queue->slots[tail % queue->depth];
+    slot->lost = (data == NULL);
+    slot->data_len = 0;
+    if (data && data_len > slot->capacity) {
+        int capacity = AUDIO_QUEUE_MIN_SLOT;
+        while (capacity < data_len) {
+            capacity *= 2;
+        }
+        unsigned char *grown = mem_account_realloc(MEM_TAG_AUDIO_BUFFERS, slot->data, capacity);
+        if (grown) {
+            slot->data = grown;
+            slot->capacity = capacity;
+        }
+    }
+    if (data && data_len <= slot->capacity) {
+        memcpy(slot->data, data, data_len);
+        slot->data_len = data_len;
+    } else if (data) {
+        // Out of memory, let the renderer conceal it
+        slot->lost = 1;
+    }
+    slot->pts = pts;
+    slot->generation = atomic_load_explicit(&queue->generation, memory_order_relaxed);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    audio_queue_notify(queue);
+    return 0;
+}
+
+void
+audio_queue_flush(audio_queue_t *queue)
+{
+    assert(queue);
+    atomic_fetch_add(&queue->generation, 1);
+    audio_queue_notify(queue);
+}
+
+void
+audio_queue_wakeup(audio_queue_t *queue)
+{
+    assert(queue);
+    atomic_fetch_add(&queue->wakeups, 1);
+    audio_queue_notify(queue);
+}
+
+static int
+audio_queue_idle(audio_queue_t *queue)
+{
+    return atomic_load(&queue->head) == atomic_load(&queue->tail) &&
+           atomic_load(&queue->generation) == queue->popped_generation &&
+           atomic_load(&queue->wakeups) == queue->seen_wakeups &&
+           !atomic_load(&queue->stopped);
+}
+
+int
+audio_queue_pop(audio_queue_t *queue, aac_decode_struct *frame)
+{
+    assert(queue);
+    assert(frame);
+
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (queue->holding) {
+        queue->holding = 0;
+        atomic_store_explicit(&queue->head, ++head, memory_order_release);
+    }
+
+    while (1) {
+        if (atomic_load(&queue->stopped)) {
+            return -1;
+        }
+        unsigned int generation = atomic_load(&queue->generation);
+        if (generation != queue->popped_generation) {
+            queue->popped_generation = generation;
+            return AUDIO_QUEUE_FLUSHED;
+        }
+        unsigned int wakeups = atomic_load(&queue->wakeups);
+        if (wakeups != queue->seen_wakeups) {
+            queue->seen_wakeups = wakeups;
+            return AUDIO_QUEUE_WOKEN;
+        }
+
+        if (head != atomic_load_explicit(&queue->tail, memory_order_acquire)) {
+            audio_queue_slot_t *slot = &queue->slots[head % queue->depth];
+            int age = (int) (slot->generation - queue->popped_generation);
+            if (age < 0) {
+                // Pushed before a flush
+                atomic_store_explicit(&queue->head, ++head, memory_order_release);
+                continue;
+            } else if (age > 0) {
+                // Pushed after a flush this loop has yet to see
+                continue;
+            }
+            frame->data = slot->lost ? NULL : slot->data;
+            frame->data_len = slot->data_len;
+            frame->pts = slot->pts;
+            queue->holding = 1;
+            return AUDIO_QUEUE_FRAME;
+        }
+
+        MUTEX_LOCK(queue->wait_mutex);
+        atomic_fetch_add(&queue->waiters, 1);
+        while (audio_queue_idle(queue)) {
+            COND_WAIT(queue->wait_cond, queue->wait_mutex);
+        }
+        atomic_fetch_sub(&queue->waiters, 1);
+        MUTEX_UNLOCK(queue->wait_mutex);
+    }
+}
+
+void
+audio_queue_stop(audio_queue_t *queue)
+{
+    assert(queue);
+    atomic_store(&queue->stopped, 1);
+    MUTEX_LOCK(queue->wait_mutex);
+    COND_BROADCAST(queue->wait_cond);
+    MUTEX_UNLOCK(queue->wait_mutex);
+}
+
+void
+audio_queue_start(audio_queue_t *queue)
+{
+    assert(queue);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->generation, 0);
+    atomic_init(&queue->wakeups, 0);
+    atomic_init(&queue->waiters, 0);
+    queue->holding = 0;
+    queue->popped_generation = 0;
+    queue->seen_wakeups = 0;
+    queue->overflowing = 0;
+    atomic_store(&queue->stopped, 0);
+}
+
+int
+audio_queue_get_count(audio_queue_t *queue)
+{
+    assert(queue);
+    return (int) (atomic_load(&queue->tail) - atomic_load(&queue->head));
+}
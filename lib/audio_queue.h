@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef AUDIO_QUEUE_H
+#define AUDIO_QUEUE_H
+
+#include <stdint.h>
+#include "logger.h"
+#include "stream.h"
+
+/*
+ * Bounded single-producer/single-consumer ring of audio frames, used to hand the frames the
+ * RTP receiver takes out of its jitter buffer to the thread that decodes and renders them.
+ * Unlike the frame_queue of the mirror the payloads are copied in, into slots the queue
+ * keeps, so the jitter buffer gets its entries back at once. The producer never blocks,
+ * the ring indices are atomics and the mutex is only taken by the consumer to sleep.
+ */
+typedef struct audio_queue_s audio_queue_t;
+
+#define AUDIO_QUEUE_FRAME 0
+#define AUDIO_QUEUE_FLUSHED 1
+#define AUDIO_QUEUE_WOKEN 2
+
+audio_queue_t *audio_queue_init(logger_t *logger, int depth);
+void audio_queue_destroy(audio_queue_t *queue);
+
+/* Copies the frame in, data NULL for a lost one. Returns -1 if the queue is full and the frame was dropped. */
+int audio_queue_push(audio_queue_t *queue, const unsigned char *data, int data_len, uint64_t pts);
+/* Has the consumer drop everything pushed so far, frames pushed after the call are kept */
+void audio_queue_flush(audio_queue_t *queue);
+/* Has a blocked or the next pop return AUDIO_QUEUE_WOKEN, for work the consumer picks up elsewhere */
+void audio_queue_wakeup(audio_queue_t *queue);
+
+/**
+ * Blocks while the queue is empty. Returns AUDIO_QUEUE_FRAME with the data, data_len and pts
+ * of frame filled in, the data stays valid until the next call. Returns AUDIO_QUEUE_FLUSHED
+ * once for one or more flushes, before the frames pushed after them, AUDIO_QUEUE_WOKEN after
+ * a wakeup, and -1 once the queue is stopped.
+ */
+int audio_queue_pop(audio_queue_t *queue, aac_decode_struct *frame);
+
+/* Wakes up and fails all blocked and future pop calls until audio_queue_start */
+void audio_queue_stop(audio_queue_t *queue);
+/* Empties the queue for a new stream, neither side may be using it */
+void audio_queue_start(audio_queue_t *queue);
+
+int audio_queue_get_count(audio_queue_t *queue);
+
+#endif //AUDIO_QUEUE_H
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+
+
+#include "audio_resampler.h"
+#include "simd_kernels.h"
+
+/* Taps per phase, the length the SIMD kernels are written for */
+#define RESAMPLER_TAPS SIMD_RESAMPLER_TAPS
+#define RESAMPLER_PHASES 128
+#define RESAMPLER_KAISER_BETA 8.0
+/* Frames buffered initially, so that the first frame in is the first out */
+#define RESAMPLER_DELAY (RESAMPLER_TAPS / 2 - 1)
+
+/* Seconds the error settles for after a reset before it is taken as the baseline */
+#define STEER_SETTLE_S 2.0
+/* Time constant the reported error is smoothed over, it jitters with the output's buffering */
+#define STEER_SMOOTHING_S 0.5
+/* A PI controller, critically damped; 10 ms off corrects by 500 ppm */
+#define STEER_KP 0.05
+#define STEER_KI (STEER_KP * STEER_KP / 4)
+/* Further behind than this the input is played at AUDIO_RESAMPLER_CATCH_UP_PPM until nearly back */
+#define STEER_CATCH_UP_S 0.04
+#define STEER_CATCH_UP_EXIT_S 0.005
+
+struct audio_resampler_s {
+    int channels;
+    int sample_rate;
+
+    /* Windowed sinc for RESAMPLER_PHASES + 1 fractional positions from 0 to 1, both ends included */
+    float kernels[(RESAMPLER_PHASES + 1) * RESAMPLER_TAPS];
+    /* The kernels for the CPU that apply them */
+    const simd_kernels_t *simd;
+
+    /* Input, a row of capacity frames per channel */
+    float *buffer;
+    int capacity;
+    int buffered;
+    /* Frame the next output's filter starts at, and how far it moves per output frame */
+    double position;
+    double step;
+
+    int steer_frames;
+    int measured;
+    int settled;
+    /* Set by audio_resampler_hold, the baseline is then given rather than measured */
+    int held;
+    double settle_left;
+    double smoothed;
+    double baseline;
+    double integral;
+    int catching_up;
+};
+
+/* Modified Bessel function of the first kind, order 0, for the Kaiser window */
+static double
+resampler_bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/*
+ * The cutoff stays at Nyquist: a step within AUDIO_RESAMPLER_CATCH_UP_PPM of 1 only folds back
+ * what lies above 21.8 kHz at 44.1 kHz, and the sinc is then 0 at every other whole frame, so
+ * phase 0 passes samples through.
+ */
+static void
+resampler_make_kernels(audio_resampler_t *resampler)
+{
+    const double half = RESAMPLER_TAPS / 2;
+    for (int p = 0; p <= RESAMPLER_PHASES; p++) {
+        float *kernel = resampler->kernels + p * RESAMPLER_TAPS;
+        double sum = 0;
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            double t = k - RESAMPLER_DELAY - (double) p / RESAMPLER_PHASES;
+            double sinc = t == 0 ? 1 : sin(M_PI * t) / (M_PI * t);
+            double w = 1 - (t / half) * (t / half);
+            double window = w > 0 ? resampler_bessel_i0(RESAMPLER_KAISER_BETA * sqrt(w)) /
+                                    resampler_bessel_i0(RESAMPLER_KAISER_BETA) : 0;
+            kernel[k] = (float) (sinc * window);
+            sum += kernel[k];
+        }
+        for (int k = 0; k < RESAMPLER_TAPS; k++) {
+            kernel[k] = (float) (kernel[k] / sum);
+        }
+    }
+}
+
+audio_resampler_t *
+audio_resampler_init(int channels, int sample_rate)
+{
+    audio_resampler_t *resampler;
+
+    assert(channels > 0 && channels <= AUDIO_RESAMPLER_MAX_CHANNELS);
+    assert(sample_rate > 0);
+
+    resampler = calloc(1, sizeof(audio_resampler_t));
+    if (!resampler) {
+        return NULL;
+    }
+    resampler->channels = channels;
+    resampler->sample_rate = sample_rate;
+    resampler->capacity = 4096;
+    resampler->buffer = malloc(channels * resampler->capacity * sizeof(float));
+    if (!resampler->buffer) {
+        free(resampler);
+        return NULL;
+    }
+    resampler_make_kernels(resampler);
+    resampler->simd = simd_kernels();
+    audio_resampler_reset(resampler);
+    return resampler;
+}
+
+void
+audio_resampler_destroy(audio_resampler_t *resampler)
+{
+    if (resampler) {
+        free(resampler->buffer);
+        free(resampler);
+    }
+}
+
+void
+audio_resampler_reset(audio_resampler_t *resampler)
+{
+    assert(resampler);
+
+    memset(resampler->buffer, 0, resampler->channels * resampler->capacity * sizeof(float));
+    resampler->buffered = RESAMPLER_DELAY;
+    resampler->position = 0;
+    resampler->step = 1;
+    resampler->steer_frames = 0;
+    resampler->measured = 0;
+    resampler->settled = resampler->held;
+    resampler->settle_left = STEER_SETTLE_S;
+    resampler->smoothed = 0;
+    if (!resampler->held) {
+        resampler->baseline = 0;
+    }
+    resampler->integral = 0;
+    resampler->catching_up = 0;
+}
+
+static int
+resampler_reserve(audio_resampler_t *resampler, int frames)
+{
+    int capacity = resampler->capacity;
+    if (frames <= capacity) {
+        return 0;
+    }
+    while (capacity < frames) {
+        capacity *= 2;
+    }
+    float *buffer = malloc(resampler->channels * capacity * sizeof(float));
+    if (!buffer) {
+        return -1;
+    }
+    for (int c = 0; c < resampler->channels; c++) {
+        memcpy(buffer + c * capacity, resampler->buffer + c * resampler->capacity, resampler->buffered * sizeof(float));
+    }
+    free(resampler->buffer);
+    resampler->buffer = buffer;
+    resampler->capacity = capacity;
+    return 0;
+}
+
+int
+audio_resampler_process(audio_resampler_t *resampler, const int16_t *in, int in_frames,
+                        int16_t *out, int max_out_frames)
+{
+    float kernel[RESAMPLER_TAPS];
+    int out_frames = 0;
+
+    assert(resampler);
+    assert(in || in_frames == 0);
+
+    const int channels = resampler->channels;
+
+    if (in_frames > 0 && resampler_reserve(resampler, resampler->buffered + in_frames) == 0) {
+        for (int c = 0; c < channels; c++) {
+            float *x = resampler->buffer + c * resampler->capacity + resampler->buffered;
+            for (int i = 0; i < in_frames; i++) {
+                x[i] = in[i * channels + c];
+            }
+        }
+        resampler->buffered += in_frames;
+        resampler->steer_frames += in_frames;
+    }
+
+    while (out_frames < max_out_frames) {
+        int index = (int) resampler->position;
+        if (index + RESAMPLER_TAPS > resampler->buffered) {
+            break;
+        }
+        float phase = (float) ((resampler->position - index) * RESAMPLER_PHASES);
+        int p = (int) phase;
+        if (p >= RESAMPLER_PHASES) {
+            p = RESAMPLER_PHASES - 1;
+        }
+        const float *h0 = resampler->kernels + p * RESAMPLER_TAPS;
+        resampler->simd->resampler_interpolate(kernel, h0, h0 + RESAMPLER_TAPS, phase - p);
+
+        int16_t *frame = out + out_frames * channels;
+        for (int c = 0; c < channels; c++) {
+            float v = resampler->simd->resampler_dot(resampler->buffer + c * resampler->capacity + index, kernel);
+            long sample = lrintf(v);
+            frame[c] = (int16_t) (sample > INT16_MAX ? INT16_MAX : sample < INT16_MIN ? INT16_MIN : sample);
+        }
+        out_frames++;
+        resampler->position += resampler->step;
+    }
+
+    /* Drop the frames no filter will start at again */
+    int consumed = (int) resampler->position;
+    if (consumed > resampler->buffered) {
+        consumed = resampler->buffered;
+    }
+    if (consumed > 0) {
+        for (int c = 0; c < channels; c++) {
+            float *x = resampler->buffer + c * resampler->capacity;
+            memmove(x, x + consumed, (resampler->buffered - consumed) * sizeof(float));
+        }
+        resampler->buffered -= consumed;
+        resampler->position -= consumed;
+    }
+    return out_frames;
+}
+
+void
+audio_resampler_steer(audio_resampler_t *resampler, int64_t error_us)
+{
+    const double max = AUDIO_RESAMPLER_MAX_PPM / 1e6;
+
+    assert(resampler);
+
+    double dt = (double) resampler->steer_frames / resampler->sample_rate;
+    resampler->steer_frames = 0;
+    if (dt <= 0) {
+        return;
+    }
+
+    double error = error_us / 1e6;
+    if (!resampler->measured) {
+        resampler->smoothed = error;
+        resampler->measured = 1;
+    } else {
+        resampler->smoothed += (error - resampler->smoothed) * dt / (STEER_SMOOTHING_S + dt);
+    }
+    if (!resampler->settled) {
+        resampler->settle_left -= dt;
+        if (resampler->settle_left <= 0) {
+            resampler->baseline = resampler->smoothed;
+            resampler->settled = 1;
+        }
+        return;
+    }
+
+    /* Playing later than planned means the queue grew, so take input in faster */
+    double drift = resampler->smoothed - resampler->baseline;
+    if (drift > STEER_CATCH_UP_S) {
+        resampler->catching_up = 1;
+    } else if (drift < STEER_CATCH_UP_EXIT_S) {
+        resampler->catching_up = 0;
+    }
+    if (resampler->catching_up) {
+        /* At a fixed rate, which the integral would only wind up against */
+        resampler->step = 1 + AUDIO_RESAMPLER_CATCH_UP_PPM / 1e6;
+        return;
+    }
+    resampler->integral += drift * dt;
+    if (resampler->integral > max / STEER_KI) resampler->integral = max / STEER_KI;
+    if (resampler->integral < -max / STEER_KI) resampler->integral = -max / STEER_KI;
+    double correction = STEER_KP * drift + STEER_KI * resampler->integral;
+    if (correction > max) correction = max;
+    if (correction < -max) correction = -max;
+    resampler->step = 1 + correction;
+}
+
+int
+audio_resampler_available(const audio_resampler_t *resampler)
+{
+    int frames = 0;
+    double position;
+
+    assert(resampler);
+
+    /* Steps through the positions exactly as process does */
+    for (position = resampler->position; (int) position + RESAMPLER_TAPS <= resampler->buffered; position += resampler->step) {
+        frames++;
+    }
+    return frames;
+}
+
+void
+audio_resampler_hold(audio_resampler_t *resampler, int64_t target_us)
+{
+    assert(resampler);
+    resampler->held = 1;
+    resampler->settled = 1;
+    resampler->baseline = target_us / 1e6;
+}
+
+int
+audio_resampler_get_ppm(const audio_resampler_t *resampler)
+{
+    assert(resampler);
+    return (int) lrint((resampler->step - 1) * 1e6);
+}
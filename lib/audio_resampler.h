@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef AUDIO_RESAMPLER_H
+#define AUDIO_RESAMPLER_H
+
+#include <stdint.h>
+
+/*
+ * Asynchronous sample rate conversion for the few hundred ppm the sender's clock and the
+ * audio output's run apart. Left alone, the queue in front of the output grows or drains with
+ * that drift until a renderer has to jump to catch up; instead the renderer reports how much
+ * later than the NTP timeline says the audio it passes in will play, and the resampler plays
+ * it out that much faster or slower, within AUDIO_RESAMPLER_MAX_PPM, which is inaudible.
+ * Audio that has fallen more than a few tens of milliseconds behind, held up on the way rather
+ * than drifted, is played AUDIO_RESAMPLER_CATCH_UP_PPM fast until it is nearly back, so the
+ * latency comes down within seconds without a jump.
+ *
+ * The conversion is a windowed sinc polyphase filter over interleaved 16 bit samples, with
+ * NEON or SSE kernels where the compiler targets them. Until it is steered off 1:1 the filter
+ * passes samples through unchanged. An audio_resampler_t has a single user thread.
+ */
+typedef struct audio_resampler_s audio_resampler_t;
+
+#define AUDIO_RESAMPLER_MAX_CHANNELS 8
+#define AUDIO_RESAMPLER_MAX_PPM 1000
+#define AUDIO_RESAMPLER_CATCH_UP_PPM 10000
+
+audio_resampler_t *audio_resampler_init(int channels, int sample_rate);
+void audio_resampler_destroy(audio_resampler_t *resampler);
+
+/* Forgets the buffered samples and the drift measured so far, for a flush or a jump in the stream */
+void audio_resampler_reset(audio_resampler_t *resampler);
+
+/**
+ * Takes in_frames frames from in, all of them, and writes up to max_out_frames frames to out.
+ * Returns the number of frames written; input that did not fit out yet is kept for the next
+ * call, which may pass no input to drain it.
+ */
+int audio_resampler_process(audio_resampler_t *resampler, const int16_t *in, int in_frames,
+                            int16_t *out, int max_out_frames);
+
+/* Frames the next call to process can write without more input */
+int audio_resampler_available(const audio_resampler_t *resampler);
+
+/**
+ * Reports how many micro seconds later the audio passed in next will play out than its pts
+ * says, once per frame. Only changes in it count, the offset measured over the first seconds
+ * after a reset is taken as the pipeline's own latency.
+ */
+void audio_resampler_steer(audio_resampler_t *resampler, int64_t error_us);
+
+/**
+ * Makes steer hold the audio at target_us after its pts instead of at the offset it measures
+ * after a reset, for playout on a timeline shared with other receivers. Stays in effect over
+ * resets, and may be called again whenever the target moves.
+ */
+void audio_resampler_hold(audio_resampler_t *resampler, int64_t target_us);
+
+/* How much faster than real time the input is being played, in ppm */
+int audio_resampler_get_ppm(const audio_resampler_t *resampler);
+
+#endif //AUDIO_RESAMPLER_H
@@ -0,0 +1,807 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "bplist.h"
+
+#define BPLIST_MAGIC "bplist00"
+#define BPLIST_MAGIC_LEN 8
+#define BPLIST_TRAILER_LEN 32
+
+/* The high nibble of an object's marker byte */
+#define BPLIST_MARKER_SIMPLE 0x00
+#define BPLIST_MARKER_INT 0x10
+#define BPLIST_MARKER_REAL 0x20
+#define BPLIST_MARKER_DATA 0x40
+#define BPLIST_MARKER_ASCII 0x50
+#define BPLIST_MARKER_UTF16 0x60
+#define BPLIST_MARKER_ARRAY 0xA0
+#define BPLIST_MARKER_DICT 0xD0
+
+#define BPLIST_FALSE 0x08
+#define BPLIST_TRUE 0x09
+
+/* Lengths from 15 on follow the marker as an integer object */
+#define BPLIST_LEN_EXTENDED 0x0F
+
+/* Keys in UTF-16 are rare enough to be converted for the comparison */
+#define BPLIST_KEY_MAX 256
+
+static uint64_t
+bplist_read_be(const unsigned char *data, int size)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++) {
+        value = value << 8 | data[i];
+    }
+    return value;
+}
+
+static void
+bplist_write_be(unsigned char *data, uint64_t value, int size)
+{
+    for (int i = size - 1; i >= 0; i--) {
+        data[i] = value & 0xff;
+        value >>= 8;
+    }
+}
+
+int
+bplist_parse(bplist_t *plist, const void *data, size_t size)
+{
+    memset(plist, 0, sizeof(bplist_t));
+    if (!data || size < BPLIST_MAGIC_LEN + BPLIST_TRAILER_LEN || memcmp(data, BPLIST_MAGIC, BPLIST_MAGIC_LEN)) {
+        return -1;
+    }
+
+    const unsigned char *trailer = (const unsigned char *) data + size - BPLIST_TRAILER_LEN;
+    int offset_size = trailer[6];
+    int ref_size = trailer[7];
+    uint64_t count = bplist_read_be(trailer + 8, 8);
+    uint64_t root = bplist_read_be(trailer + 16, 8);
+    uint64_t table = bplist_read_be(trailer + 24, 8);
+    uint64_t objects_end = size - BPLIST_TRAILER_LEN;
+
+    if (offset_size < 1 || offset_size > 8 || ref_size < 1 || ref_size > 8 ||
+        count == 0 || count > INT_MAX || root >= count ||
+        table < BPLIST_MAGIC_LEN || table > objects_end || count > (objects_end - table) / offset_size) {
+        return -1;
+    }
+    plist->data = data;
+    plist->size = size;
+    plist->offset_size = offset_size;
+    plist->ref_size = ref_size;
+    plist->count = (int) count;
+    plist->root = (int) root;
+    plist->table = table;
+    return 0;
+}
+
+int
+bplist_root(const bplist_t *plist)
+{
+    return plist->data ? plist->root : BPLIST_NONE;
+}
+
+/*
+ * Finds the object's marker, its length, and where its payload starts. The payload is checked
+ * to end before the offset table, which every object has to.
+ */
+static int
+bplist_get_object(const bplist_t *plist, int object, unsigned char *marker, uint64_t *len, size_t *start)
+{
+    if (!plist->data || object < 0 || object >= plist->count) {
+        return -1;
+    }
+    uint64_t offset = bplist_read_be(plist->data + plist->table + (size_t) object * plist->offset_size,
+                                     plist->offset_size);
+    if (offset < BPLIST_MAGIC_LEN || offset >= plist->table) {
+        return -1;
+    }
+
+    size_t pos = offset;
+    unsigned char byte = plist->data[pos++];
+    uint64_t length = byte & 0x0F;
+    uint64_t payload;
+
+    switch (byte & 0xF0) {
+        case BPLIST_MARKER_SIMPLE:
+            payload = 0;
+            break;
+        case BPLIST_MARKER_INT:
+        case BPLIST_MARKER_REAL:
+            if (length > 4) {
+                return -1;
+            }
+            length = payload = (uint64_t) 1 << length;
+            break;
+        case BPLIST_MARKER_DATA:
+        case BPLIST_MARKER_ASCII:
+        case BPLIST_MARKER_UTF16:
+        case BPLIST_MARKER_ARRAY:
+        case BPLIST_MARKER_DICT:
+            if (length == BPLIST_LEN_EXTENDED) {
+                if (pos >= plist->table || (plist->data[pos] & 0xF0) != BPLIST_MARKER_INT) {
+                    return -1;
+                }
+                int size = 1 << (plist->data[pos] & 0x0F);
+                pos++;
+                if (size > 8 || (size_t) size > plist->table - pos) {
+                    return -1;
+                }
+                length = bplist_read_be(plist->data + pos, size);
+                pos += size;
+            }
+            if (length > INT_MAX) {
+                return -1;
+            }
+            switch (byte & 0xF0) {
+                case BPLIST_MARKER_UTF16:
+                    payload = length * 2;
+                    break;
+                case BPLIST_MARKER_ARRAY:
+                    payload = length * plist->ref_size;
+                    break;
+                case BPLIST_MARKER_DICT:
+                    payload = length * 2 * plist->ref_size;
+                    break;
+                default:
+                    payload = length;
+                    break;
+            }
+            break;
+        default:
+            return -1;
+    }
+    if (pos > plist->table || payload > plist->table - pos) {
+        return -1;
+    }
+    *marker = byte;
+    *len = length;
+    *start = pos;
+    return 0;
+}
+
+static int
+bplist_read_ref(const bplist_t *plist, size_t pos)
+{
+    uint64_t ref = bplist_read_be(plist->data + pos, plist->ref_size);
+    return ref < (uint64_t) plist->count ? (int) ref : BPLIST_NONE;
+}
+
+bplist_type_t
+bplist_get_type(const bplist_t *plist, int object)
+{
+    unsigned char marker;
+    uint64_t len;
+    size_t start;
+
+    if (bplist_get_object(plist, object, &marker, &len, &start) < 0) {
+        return BPLIST_INVALID;
+    }
+    switch (marker & 0xF0) {
+        case BPLIST_MARKER_SIMPLE:
+            return marker == BPLIST_FALSE || marker == BPLIST_TRUE ? BPLIST_BOOL : BPLIST_INVALID;
+        case BPLIST_MARKER_INT:
+            return BPLIST_UINT;
+        case BPLIST_MARKER_REAL:
+            return len == 4 || len == 8 ? BPLIST_REAL : BPLIST_INVALID;
+        case BPLIST_MARKER_DATA:
+            return BPLIST_DATA;
+        case BPLIST_MARKER_ASCII:
+        case BPLIST_MARKER_UTF16:
+            return BPLIST_STRING;
+        case BPLIST_MARKER_ARRAY:
+            return BPLIST_ARRAY;
+        case BPLIST_MARKER_DICT:
+            return BPLIST_DICT;
+    }
+    return BPLIST_INVALID;
+}
+
+int
+bplist_dict_get_size(const bplist_t *plist, int dict)
+{
+    unsigned char marker;
+    uint64_t len;
+    size_t start;
+
+    if (bplist_get_object(plist, dict, &marker, &len, &start) < 0 || (marker & 0xF0) != BPLIST_MARKER_DICT) {
+        return 0;
+    }
+    return (int) len;
+}
+
+int
+bplist_dict_get_entry(const bplist_t *plist, int dict, int index, int *key)
+{
+    unsigned char marker;
+    uint64_t len;
+    size_t start;
+
+    *key = BPLIST_NONE;
+    if (bplist_get_object(plist, dict, &marker, &len, &start) < 0 || (marker & 0xF0) != BPLIST_MARKER_DICT ||
+        index < 0 || (uint64_t) index >= len) {
+        return BPLIST_NONE;
+    }
+    *key = bplist_read_ref(plist, start + (size_t) index * plist->ref_size);
+    return bplist_read_ref(plist, start + (len + index) * plist->ref_size);
+}
+
+int
+bplist_dict_get(const bplist_t *plist, int dict, const char *key)
+{
+    size_t key_len = strlen(key);
+    int count = bplist_dict_get_size(plist, dict);
+
+    for (int i = 0; i < count; i++) {
+        unsigned char marker;
+        uint64_t len;
+        size_t start;
+        int item_key;
+        int value = bplist_dict_get_entry(plist, dict, i, &item_key);
+
+        if (bplist_get_object(plist, item_key, &marker, &len, &start) < 0) {
+            continue;
+        }
+        if ((marker & 0xF0) == BPLIST_MARKER_ASCII) {
+            if (len == key_len && !memcmp(plist->data + start, key, key_len)) {
+                return value;
+            }
+        } else if ((marker & 0xF0) == BPLIST_MARKER_UTF16) {
+            char text[BPLIST_KEY_MAX];
+            int text_len = bplist_get_string(plist, item_key, text, sizeof(text));
+            if (text_len >= 0 && (size_t) text_len == key_len && !memcmp(text, key, key_len)) {
+                return value;
+            }
+        }
+    }
+    return BPLIST_NONE;
+}
+
+int
+bplist_array_get_size(const bplist_t *plist, int array)
+{
+    unsigned char marker;
+    uint64_t len;
+    size_t start;
+
+    if (bplist_get_object(plist, array, &marker, &len, &start) < 0 || (marker & 0xF0) != BPLIST_MARKER_ARRAY) {
+        return 0;
+    }
+    return (int) len;
+}
+
+int
+bplist_array_get_item(const bplist_t *plist, int array, int index)
+{
+    unsigned char marker;
+    uint64_t len;
+    size_t start;
+
+    if (bplist_get_object(plist, array, &marker, &len, &start) < 0 || (marker & 0xF0) != BPLIST_MARKER_ARRAY ||
+        index < 0 || (uint64_t) index >= len) {
+        return BPLIST_NONE;
+    }
+    return bplist_read_ref(plist, start + (size_t) index * plist->ref_size);
+}
+
+int
+bplist_get_uint(const bplist_t *plist, int object, uint64_t *value)
+{
+    unsigned char marker;
+    uint64_t len;
+    size_t start;
+
+    if (bplist_get_object(plist, object, &marker, &len, &start) < 0 || (marker & 0xF0) != BPLIST_MARKER_INT) {
+        return -1;
+    }
+    // Values above 2^63 are written in 16 bytes, the upper half is zero then
+    *value = len > 8 ? bplist_read_be(plist->data + start + len - 8, 8) : bplist_read_be(plist->data + start, len);
+    return 0;
+}
+
+int
+bplist_get_real(const bplist_t *plist, int object, double *value)
+{
+    unsigned char marker;
+    uint64_t len;
+    size_t start;
+
+    if (bplist_get_object(plist, object, &marker, &len, &start) < 0 || (marker & 0xF0) != BPLIST_MARKER_REAL) {
+        return -1;
+    }
+    uint64_t bits = bplist_read_be(plist->data + start, len);
+    if (len == 8) {
+        memcpy(value, &bits, sizeof(double));
+    } else if (len == 4) {
+        uint32_t bits32 = (uint32_t) bits;
+        float real32;
+        memcpy(&real32, &bits32, sizeof(float));
+        *value = real32;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int
+bplist_get_bool(const bplist_t *plist, int object, int *value)
+{
+    unsigned char marker;
+    uint64_t len;
+    size_t start;
+
+    if (bplist_get_object(plist, object, &marker, &len, &start) < 0 ||
+        (marker != BPLIST_FALSE && marker != BPLIST_TRUE)) {
+        return -1;
+    }
+    *value = marker == BPLIST_TRUE;
+    return 0;
+}
+
+int
+bplist_get_data(const bplist_t *plist, int object, const unsigned char **data, int *len)
+{
+    unsigned char marker;
+    uint64_t length;
+    size_t start;
+
+    if (bplist_get_object(plist, object, &marker, &length, &start) < 0 || (marker & 0xF0) != BPLIST_MARKER_DATA) {
+        return -1;
+    }
+    *data = plist->data + start;
+    *len = (int) length;
+    return 0;
+}
+
+/* Appends the code point as UTF-8 as far as it fits, returns its full length */
+static int
+bplist_put_utf8(char *text, int size, int used, uint32_t code)
+{
+    unsigned char bytes[4];
+    int count;
+
+    if (code < 0x80) {
+        bytes[0] = code;
+        count = 1;
+    } else if (code < 0x800) {
+        bytes[0] = 0xC0 | code >> 6;
+        bytes[1] = 0x80 | (code & 0x3F);
+        count = 2;
+    } else if (code < 0x10000) {
+        bytes[0] = 0xE0 | code >> 12;
+        bytes[1] = 0x80 | (code >> 6 & 0x3F);
+        bytes[2] = 0x80 | (code & 0x3F);
+        count = 3;
+    } else {
+        bytes[0] = 0xF0 | code >> 18;
+        bytes[1] = 0x80 | (code >> 12 & 0x3F);
+        bytes[2] = 0x80 | (code >> 6 & 0x3F);
+        bytes[3] = 0x80 | (code & 0x3F);
+        count = 4;
+    }
+    // Characters are not split, a cut string stays valid UTF-8
+    if (used + count < size) {
+        memcpy(text + used, bytes, count);
+    }
+    return count;
+}
+
+int
+bplist_get_string(const bplist_t *plist, int object, char *text, int size)
+{
+    unsigned char marker;
+    uint64_t len;
+    size_t start;
+    int used = 0;
+
+    if (size > 0) {
+        text[0] = '\0';
+    }
+    if (bplist_get_object(plist, object, &marker, &len, &start) < 0) {
+        return -1;
+    }
+    const unsigned char *data = plist->data + start;
+    if ((marker & 0xF0) == BPLIST_MARKER_ASCII) {
+        if (size > 0) {
+            int copy = len < (uint64_t) size ? (int) len : size - 1;
+            memcpy(text, data, copy);
+            text[copy] = '\0';
+        }
+        return (int) len;
+    }
+    if ((marker & 0xF0) != BPLIST_MARKER_UTF16) {
+        return -1;
+    }
+
+    int fits = 1;
+    for (uint64_t i = 0; i < len; i++) {
+        uint32_t code = data[2 * i] << 8 | data[2 * i + 1];
+        if (code >= 0xD800 && code < 0xDC00 && i + 1 < len) {
+            uint32_t low = data[2 * i + 2] << 8 | data[2 * i + 3];
+            if (low >= 0xDC00 && low < 0xE000) {
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                i++;
+            }
+        }
+        if (code >= 0xD800 && code < 0xE000) {
+            code = 0xFFFD;
+        }
+        int count = bplist_put_utf8(text, fits ? size : 0, used, code);
+        if (fits && used + count < size) {
+            text[used + count] = '\0';
+        } else {
+            fits = 0;
+        }
+        used += count;
+    }
+    return used;
+}
+
+void
+bplist_writer_init(bplist_writer_t *writer)
+{
+    writer->count = 0;
+    writer->overflow = 0;
+}
+
+static int
+bplist_new_object(bplist_writer_t *writer, unsigned char type)
+{
+    if (writer->count >= BPLIST_WRITER_MAX_OBJECTS) {
+        writer->overflow = 1;
+        return BPLIST_NONE;
+    }
+    bplist_writer_object_t *object = &writer->objects[writer->count];
+    object->type = type;
+    object->first = BPLIST_NONE;
+    object->last = BPLIST_NONE;
+    object->next = BPLIST_NONE;
+    object->key = BPLIST_NONE;
+    object->count = 0;
+    return writer->count++;
+}
+
+int
+bplist_new_dict(bplist_writer_t *writer)
+{
+    return bplist_new_object(writer, BPLIST_DICT);
+}
+
+int
+bplist_new_array(bplist_writer_t *writer)
+{
+    return bplist_new_object(writer, BPLIST_ARRAY);
+}
+
+int
+bplist_new_uint(bplist_writer_t *writer, uint64_t value)
+{
+    int object = bplist_new_object(writer, BPLIST_UINT);
+    if (object != BPLIST_NONE) {
+        writer->objects[object].value.uint = value;
+    }
+    return object;
+}
+
+int
+bplist_new_real(bplist_writer_t *writer, double value)
+{
+    int object = bplist_new_object(writer, BPLIST_REAL);
+    if (object != BPLIST_NONE) {
+        writer->objects[object].value.real = value;
+    }
+    return object;
+}
+
+int
+bplist_new_bool(bplist_writer_t *writer, int value)
+{
+    int object = bplist_new_object(writer, BPLIST_BOOL);
+    if (object != BPLIST_NONE) {
+        writer->objects[object].value.boolean = value != 0;
+    }
+    return object;
+}
+
+int
+bplist_new_string(bplist_writer_t *writer, const char *value)
+{
+    int object = bplist_new_object(writer, BPLIST_STRING);
+    if (object != BPLIST_NONE) {
+        writer->objects[object].value.bytes.data = value;
+        writer->objects[object].value.bytes.len = strlen(value);
+    }
+    return object;
+}
+
+int
+bplist_new_data(bplist_writer_t *writer, const void *data, int len)
+{
+    int object = bplist_new_object(writer, BPLIST_DATA);
+    if (object != BPLIST_NONE) {
+        writer->objects[object].value.bytes.data = data;
+        writer->objects[object].value.bytes.len = len;
+    }
+    return object;
+}
+
+static void
+bplist_append_child(bplist_writer_t *writer, int container, int child)
+{
+    bplist_writer_object_t *parent = &writer->objects[container];
+    if (parent->last == BPLIST_NONE) {
+        parent->first = child;
+    } else {
+        writer->objects[parent->last].next = child;
+    }
+    parent->last = child;
+    parent->count++;
+}
+
+void
+bplist_dict_set(bplist_writer_t *writer, int dict, const char *key, int value)
+{
+    int key_object = bplist_new_string(writer, key);
+    if (dict == BPLIST_NONE || value == BPLIST_NONE || key_object == BPLIST_NONE ||
+        writer->objects[dict].type != BPLIST_DICT) {
+        writer->overflow = 1;
+        return;
+    }
+    writer->objects[value].key = key_object;
+    bplist_append_child(writer, dict, value);
+}
+
+void
+bplist_array_append(bplist_writer_t *writer, int array, int value)
+{
+    if (array == BPLIST_NONE || value == BPLIST_NONE || writer->objects[array].type != BPLIST_ARRAY) {
+        writer->overflow = 1;
+        return;
+    }
+    bplist_append_child(writer, array, value);
+}
+
+/* Decodes one UTF-8 sequence, invalid bytes become U+FFFD one at a time */
+static uint32_t
+bplist_next_utf8(const unsigned char *text, int len, int *pos)
+{
+    unsigned char byte = text[*pos];
+    int count;
+    uint32_t code;
+
+    if (byte < 0x80) {
+        (*pos)++;
+        return byte;
+    } else if ((byte & 0xE0) == 0xC0) {
+        count = 1;
+        code = byte & 0x1F;
+    } else if ((byte & 0xF0) == 0xE0) {
+        count = 2;
+        code = byte & 0x0F;
+    } else if ((byte & 0xF8) == 0xF0) {
+        count = 3;
+        code = byte & 0x07;
+    } else {
+        (*pos)++;
+        return 0xFFFD;
+    }
+    if (*pos + count >= len) {
+        (*pos)++;
+        return 0xFFFD;
+    }
+    for (int i = 1; i <= count; i++) {
+        if ((text[*pos + i] & 0xC0) != 0x80) {
+            (*pos)++;
+            return 0xFFFD;
+        }
+        code = code << 6 | (text[*pos + i] & 0x3F);
+    }
+    *pos += count + 1;
+    if (code > 0x10FFFF || (code >= 0xD800 && code < 0xE000)) {
+        return 0xFFFD;
+    }
+    return code;
+}
+
+static int
+bplist_is_ascii(const unsigned char *text, int len)
+{
+    for (int i = 0; i < len; i++) {
+        if (text[i] >= 0x80) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Strings with anything beyond ASCII are written in UTF-16, as length in code units */
+static int
+bplist_utf16_len(const unsigned char *text, int len)
+{
+    int units = 0;
+    for (int pos = 0; pos < len;) {
+        units += bplist_next_utf8(text, len, &pos) >= 0x10000 ? 2 : 1;
+    }
+    return units;
+}
+
+static int
+bplist_int_size(uint64_t value)
+{
+    if (value <= 0xff) return 1;
+    if (value <= 0xffff) return 2;
+    if (value <= 0xffffffff) return 4;
+    return 8;
+}
+
+static int
+bplist_int_power(int size)
+{
+    return size == 1 ? 0 : size == 2 ? 1 : size == 4 ? 2 : 3;
+}
+
+/* The marker with its length, returns the bytes written or, without out, needed */
+static int
+bplist_put_marker(unsigned char *out, unsigned char type, uint64_t len)
+{
+    if (len < BPLIST_LEN_EXTENDED) {
+        if (out) out[0] = type | len;
+        return 1;
+    }
+    int size = bplist_int_size(len);
+    if (out) {
+        out[0] = type | BPLIST_LEN_EXTENDED;
+        out[1] = BPLIST_MARKER_INT | bplist_int_power(size);
+        bplist_write_be(out + 2, len, size);
+    }
+    return 2 + size;
+}
+
+static size_t
+bplist_put_object(bplist_writer_t *writer, int index, unsigned char *out, int ref_size)
+{
+    bplist_writer_object_t *object = &writer->objects[index];
+    const unsigned char *bytes = object->value.bytes.data;
+    int len = object->value.bytes.len;
+    size_t used;
+
+    switch (object->type) {
+        case BPLIST_BOOL:
+            if (out) out[0] = object->value.boolean ? BPLIST_TRUE : BPLIST_FALSE;
+            return 1;
+        case BPLIST_UINT: {
+            // Values above 2^63 would read as negative in 8 bytes and take 16
+            int size = object->value.uint > INT64_MAX ? 16 : bplist_int_size(object->value.uint);
+            if (out) {
+                out[0] = BPLIST_MARKER_INT | (size == 16 ? 4 : bplist_int_power(size));
+                memset(out + 1, 0, size);
+                bplist_write_be(out + 1 + size - (size == 16 ? 8 : size), object->value.uint, size == 16 ? 8 : size);
+            }
+            return 1 + size;
+        }
+        case BPLIST_REAL:
+            if (out) {
+                uint64_t bits;
+                memcpy(&bits, &object->value.real, sizeof(bits));
+                out[0] = BPLIST_MARKER_REAL | 3;
+                bplist_write_be(out + 1, bits, 8);
+            }
+            return 9;
+        case BPLIST_DATA:
+            used = bplist_put_marker(out, BPLIST_MARKER_DATA, len);
+            if (out && len) memcpy(out + used, bytes, len);
+            return used + len;
+        case BPLIST_STRING:
+            if (bplist_is_ascii(bytes, len)) {
+                used = bplist_put_marker(out, BPLIST_MARKER_ASCII, len);
+                if (out && len) memcpy(out + used, bytes, len);
+                return used + len;
+            } else {
+                int units = bplist_utf16_len(bytes, len);
+                used = bplist_put_marker(out, BPLIST_MARKER_UTF16, units);
+                if (out) {
+                    unsigned char *unit = out + used;
+                    for (int pos = 0; pos < len;) {
+                        uint32_t code = bplist_next_utf8(bytes, len, &pos);
+                        if (code >= 0x10000) {
+                            code -= 0x10000;
+                            bplist_write_be(unit, 0xD800 | code >> 10, 2);
+                            bplist_write_be(unit + 2, 0xDC00 | (code & 0x3FF), 2);
+                            unit += 4;
+                        } else {
+                            bplist_write_be(unit, code, 2);
+                            unit += 2;
+                        }
+                    }
+                }
+                return used + 2 * (size_t) units;
+            }
+        case BPLIST_ARRAY:
+            used = bplist_put_marker(out, BPLIST_MARKER_ARRAY, object->count);
+            if (out) {
+                unsigned char *ref = out + used;
+                for (int child = object->first; child != BPLIST_NONE; child = writer->objects[child].next) {
+                    bplist_write_be(ref, child, ref_size);
+                    ref += ref_size;
+                }
+            }
+            return used + (size_t) object->count * ref_size;
+        case BPLIST_DICT:
+            used = bplist_put_marker(out, BPLIST_MARKER_DICT, object->count);
+            if (out) {
+                // All keys first, then the values in the same order
+                unsigned char *key = out + used;
+                unsigned char *value = key + (size_t) object->count * ref_size;
+                for (int child = object->first; child != BPLIST_NONE; child = writer->objects[child].next) {
+                    bplist_write_be(key, writer->objects[child].key, ref_size);
+                    bplist_write_be(value, child, ref_size);
+                    key += ref_size;
+                    value += ref_size;
+                }
+            }
+            return used + 2 * (size_t) object->count * ref_size;
+    }
+    return 0;
+}
+
+int
+bplist_write(bplist_writer_t *writer, int root, char **data, uint32_t *len)
+{
+    size_t offsets[BPLIST_WRITER_MAX_OBJECTS];
+
+    *data = NULL;
+    *len = 0;
+    if (writer->overflow || root < 0 || root >= writer->count) {
+        return -1;
+    }
+
+    // Every object of the arena is written, the object references are the arena indices
+    int ref_size = bplist_int_size(writer->count - 1);
+    size_t table = BPLIST_MAGIC_LEN;
+    for (int i = 0; i < writer->count; i++) {
+        offsets[i] = table;
+        table += bplist_put_object(writer, i, NULL, ref_size);
+    }
+    int offset_size = bplist_int_size(offsets[writer->count - 1]);
+    size_t size = table + (size_t) writer->count * offset_size + BPLIST_TRAILER_LEN;
+    if (size > UINT32_MAX) {
+        return -1;
+    }
+
+    unsigned char *out = malloc(size);
+    if (!out) {
+        return -1;
+    }
+    memcpy(out, BPLIST_MAGIC, BPLIST_MAGIC_LEN);
+    for (int i = 0; i < writer->count; i++) {
+        bplist_put_object(writer, i, out + offsets[i], ref_size);
+        bplist_write_be(out + table + (size_t) i * offset_size, offsets[i], offset_size);
+    }
+    unsigned char *trailer = out + size - BPLIST_TRAILER_LEN;
+    memset(trailer, 0, 6);
+    trailer[6] = offset_size;
+    trailer[7] = ref_size;
+    bplist_write_be(trailer + 8, writer->count, 8);
+    bplist_write_be(trailer + 16, root, 8);
+    bplist_write_be(trailer + 24, table, 8);
+
+    *data = (char *) out;
+    *len = size;
+    return 0;
+}
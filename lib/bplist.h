@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef BPLIST_H
+#define BPLIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reads and writes the binary property lists (bplist00) of the RTSP bodies, just the types
+ * AirPlay uses: dictionaries, arrays, unsigned integers, reals, booleans, strings and data.
+ *
+ * The reader does not allocate, it checks the trailer and then works on the received buffer
+ * through its offset table. Objects are referred to by their index in that table, and every
+ * lookup checks its bounds, so a malformed body reads as missing keys. Data values point into
+ * the buffer, which has to outlive the bplist_t.
+ *
+ * The writer collects its objects in the fixed arena of a bplist_writer_t, which fits on the
+ * stack, and only allocates the serialized result. Strings and data are not copied, they have
+ * to stay valid until bplist_write. Once the arena is full, new objects come back as
+ * BPLIST_NONE and bplist_write fails.
+ */
+
+#define BPLIST_NONE (-1)
+#define BPLIST_WRITER_MAX_OBJECTS 256
+
+typedef enum bplist_type_e {
+    BPLIST_INVALID,
+    BPLIST_BOOL,
+    BPLIST_UINT,
+    BPLIST_REAL,
+    BPLIST_DATA,
+    BPLIST_STRING,
+    BPLIST_ARRAY,
+    BPLIST_DICT,
+} bplist_type_t;
+
+typedef struct bplist_s {
+    const unsigned char *data;
+    size_t size;
+    int offset_size;
+    int ref_size;
+    int count;
+    int root;
+    size_t table;
+} bplist_t;
+
+/* Returns 0 if the buffer has a valid bplist00 header and trailer, -1 if not */
+int bplist_parse(bplist_t *plist, const void *data, size_t size);
+int bplist_root(const bplist_t *plist);
+bplist_type_t bplist_get_type(const bplist_t *plist, int object);
+
+/* BPLIST_NONE if the object is not a dictionary or has no such key */
+int bplist_dict_get(const bplist_t *plist, int dict, const char *key);
+int bplist_dict_get_size(const bplist_t *plist, int dict);
+/* The value of the index-th entry, with its key in *key */
+int bplist_dict_get_entry(const bplist_t *plist, int dict, int index, int *key);
+int bplist_array_get_size(const bplist_t *plist, int array);
+int bplist_array_get_item(const bplist_t *plist, int array, int index);
+
+/* Return 0 and leave the value alone if the object has another type */
+int bplist_get_uint(const bplist_t *plist, int object, uint64_t *value);
+int bplist_get_real(const bplist_t *plist, int object, double *value);
+int bplist_get_bool(const bplist_t *plist, int object, int *value);
+int bplist_get_data(const bplist_t *plist, int object, const unsigned char **data, int *len);
+/* Copies the string as UTF-8, cut to fit and always terminated, returns the full length or -1 */
+int bplist_get_string(const bplist_t *plist, int object, char *text, int size);
+
+typedef struct bplist_writer_object_s {
+    unsigned char type;
+    int first;
+    int last;
+    int next;
+    int key;
+    int count;
+    union {
+        uint64_t uint;
+        double real;
+        int boolean;
+        struct {
+            const void *data;
+            int len;
+        } bytes;
+    } value;
+} bplist_writer_object_t;
+
+typedef struct bplist_writer_s {
+    bplist_writer_object_t objects[BPLIST_WRITER_MAX_OBJECTS];
+    int count;
+    int overflow;
+} bplist_writer_t;
+
+void bplist_writer_init(bplist_writer_t *writer);
+int bplist_new_dict(bplist_writer_t *writer);
+int bplist_new_array(bplist_writer_t *writer);
+int bplist_new_uint(bplist_writer_t *writer, uint64_t value);
+int bplist_new_real(bplist_writer_t *writer, double value);
+int bplist_new_bool(bplist_writer_t *writer, int value);
+/* A NUL terminated UTF-8 string */
+int bplist_new_string(bplist_writer_t *writer, const char *value);
+int bplist_new_data(bplist_writer_t *writer, const void *data, int len);
+/* Each object can be added to one container only, in the order they are to be written */
+void bplist_dict_set(bplist_writer_t *writer, int dict, const char *key, int value);
+void bplist_array_append(bplist_writer_t *writer, int array, int value);
+/* Serializes the tree under root into a malloc'd buffer, returns 0 or -1 */
+int bplist_write(bplist_writer_t *writer, int root, char **data, uint32_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //BPLIST_H
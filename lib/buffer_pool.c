@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "buffer_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "threads.h"
+#include "memlock.h"
+#include "mem_account.h"
+
+/* Smallest size class handed out, smaller requests are rounded up to this */
+#define BUFFER_POOL_MIN_CLASS 4096
+
+typedef struct {
+    unsigned char *data;
+    size_t capacity;
+    int in_use;
+} buffer_pool_slot_t;
+
+struct buffer_pool_s {
+    logger_t *logger;
+
+    mutex_handle_t mutex;
+    int slot_count;
+    int max_slots;
+    buffer_pool_slot_t *slots;
+    int destroyed;
+
+    /* Charged with the buffers, the session is the one the pool was created in */
+    mem_tag_t mem_tag;
+    int mem_session;
+};
+
+static size_t
+buffer_pool_size_class(size_t size)
+{
+    size_t size_class = BUFFER_POOL_MIN_CLASS;
+    while (size_class < size) {
+        size_class <<= 1;
+    }
+    return size_class;
+}
+
+buffer_pool_t *
+buffer_pool_init(logger_t *logger, int slots)
+{
+    buffer_pool_t *pool;
+
+    assert(slots > 0);
+
+    pool = calloc(1, sizeof(buffer_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    pool->slots = calloc(slots, sizeof(buffer_pool_slot_t));
+    if (!pool->slots) {
+        free(pool);
+        return NULL;
+    }
+    pool->logger = logger;
+    pool->slot_count = slots;
+    pool->max_slots = slots;
+    pool->mem_tag = MEM_TAG_FRAME_POOLS;
+    pool->mem_session = mem_account_session();
+    MUTEX_CREATE(pool->mutex);
+    return pool;
+}
+
+static unsigned char *
+buffer_pool_alloc_data(buffer_pool_t *pool, size_t capacity)
+{
+    unsigned char *data = memlock_alloc(capacity);
+    if (data) {
+        mem_account_charge(pool->mem_tag, pool->mem_session, (long) capacity);
+    }
+    return data;
+}
+
+static void
+buffer_pool_free_data(buffer_pool_t *pool, unsigned char *data, size_t capacity)
+{
+    if (data) {
+        memlock_free(data, capacity);
+        mem_account_charge(pool->mem_tag, pool->mem_session, -(long) capacity);
+    }
+}
+
+static void
+buffer_pool_free(buffer_pool_t *pool)
+{
+    MUTEX_DESTROY(pool->mutex);
+    free(pool->slots);
+    free(pool);
+}
+
+void
+buffer_pool_destroy(buffer_pool_t *pool)
+{
+    int in_use = 0;
+
+    if (!pool) {
+        return;
+    }
+    MUTEX_LOCK(pool->mutex);
+    for (int i = 0; i < pool->slot_count; i++) {
+        if (pool->slots[i].in_use) {
+            in_use++;
+            continue;
+        }
+        buffer_pool_free_data(pool, pool->slots[i].data, pool->slots[i].capacity);
+        pool->slots[i].data = NULL;
+        pool->slots[i].capacity = 0;
+    }
+    pool->destroyed = 1;
+    MUTEX_UNLOCK(pool->mutex);
+
+    if (in_use) {
+        logger_log(pool->logger, LOGGER_DEBUG, "buffer_pool destroyed with %d buffers still in use, "
+                   "it goes once they are released", in_use);
+    } else {
+        buffer_pool_free(pool);
+    }
+}
+
+void
+buffer_pool_set_mem_tag(buffer_pool_t *pool, mem_tag_t tag)
+{
+    assert(pool);
+    pool->mem_tag = tag;
+}
+
+void
+buffer_pool_set_max_slots(buffer_pool_t *pool, int max_slots)
+{
+    assert(pool);
+
+    MUTEX_LOCK(pool->mutex);
+    pool->max_slots = max_slots > pool->slot_count ? max_slots : pool->slot_count;
+    MUTEX_UNLOCK(pool->mutex);
+}
+
+/* Doubles the slots up to max_slots, returns the first new one or NULL. Called with the mutex held. */
+static buffer_pool_slot_t *
+buffer_pool_add_slots(buffer_pool_t *pool)
+{
+    int old_count = pool->slot_count;
+    int count = old_count * 2 < pool->max_slots ? old_count * 2 : pool->max_slots;
+    buffer_pool_slot_t *slots = realloc(pool->slots, count * sizeof(buffer_pool_slot_t));
+    if (!slots) {
+        return NULL;
+    }
+    memset(slots + old_count, 0, (count - old_count) * sizeof(buffer_pool_slot_t));
+    logger_log(pool->logger, LOGGER_DEBUG, "buffer_pool grew from %d to %d buffers", old_count, count);
+    pool->slots = slots;
+    pool->slot_count = count;
+    return &slots[old_count];
+}
+
+unsigned char *
+buffer_pool_acquire(buffer_pool_t *pool, size_t size)
+{
+    buffer_pool_slot_t *best = NULL;
+    buffer_pool_slot_t *largest = NULL;
+    unsigned char *data = NULL;
+
+    assert(pool);
+
+    MUTEX_LOCK(pool->mutex);
+    for (int i = 0; i < pool->slot_count; i++) {
+        buffer_pool_slot_t *slot = &pool->slots[i];
+        if (slot->in_use) continue;
+        if (slot->data && slot->capacity >= size && (!best || slot->capacity < best->capacity)) {
+            best = slot;
+        }
+        if (!largest || slot->capacity > largest->capacity) {
+            largest = slot;
+        }
+    }
+    if (!largest && pool->slot_count < pool->max_slots) {
+        largest = buffer_pool_add_slots(pool);
+    }
+
+    if (!best && largest) {
+        // Nothing free is big enough, so grow the largest free buffer to the next size class.
+        // It keeps that capacity from now on, so the next frame of this size is served without allocating.
+        // The old contents are of no use, so the new buffer is allocated rather than reallocated.
+        size_t capacity = buffer_pool_size_class(size);
+        unsigned char *grown = buffer_pool_alloc_data(pool, capacity);
+        if (grown) {
+            logger_log(pool->logger, LOGGER_DEBUG, "buffer_pool grew buffer from %zu to %zu bytes",
+                       largest->capacity, capacity);
+            buffer_pool_free_data(pool, largest->data, largest->capacity);
+            largest->data = grown;
+            largest->capacity = capacity;
+            best = largest;
+        } else {
+            logger_log(pool->logger, LOGGER_ERR, "buffer_pool could not grow buffer to %zu bytes", capacity);
+        }
+    } else if (!largest) {
+        logger_log(pool->logger, LOGGER_ERR, "buffer_pool exhausted, all %d buffers in use", pool->slot_count);
+    }
+
+    if (best) {
+        best->in_use = 1;
+        data = best->data;
+    }
+    MUTEX_UNLOCK(pool->mutex);
+    return data;
+}
+
+void
+buffer_pool_reserve(buffer_pool_t *pool, size_t size)
+{
+    size_t capacity = buffer_pool_size_class(size);
+
+    assert(pool);
+
+    MUTEX_LOCK(pool->mutex);
+    for (int i = 0; i < pool->slot_count; i++) {
+        buffer_pool_slot_t *slot = &pool->slots[i];
+        if (slot->in_use || slot->capacity >= capacity) continue;
+        unsigned char *data = buffer_pool_alloc_data(pool, capacity);
+        if (!data) {
+            logger_log(pool->logger, LOGGER_WARNING, "buffer_pool could not reserve %zu bytes", capacity);
+            break;
+        }
+        buffer_pool_free_data(pool, slot->data, slot->capacity);
+        slot->data = data;
+        slot->capacity = capacity;
+    }
+    MUTEX_UNLOCK(pool->mutex);
+}
+
+void
+buffer_pool_release(buffer_pool_t *pool, unsigned char *buffer)
+{
+    assert(pool);
+
+    if (!buffer) {
+        return;
+    }
+
+    MUTEX_LOCK(pool->mutex);
+    for (int i = 0; i < pool->slot_count; i++) {
+        buffer_pool_slot_t *slot = &pool->slots[i];
+        if (slot->in_use && slot->data == buffer) {
+            slot->in_use = 0;
+            if (!pool->destroyed) {
+                MUTEX_UNLOCK(pool->mutex);
+                return;
+            }
+            // The last user of a destroyed pool frees it
+            int in_use = 0;
+            buffer_pool_free_data(pool, slot->data, slot->capacity);
+            slot->data = NULL;
+            slot->capacity = 0;
+            for (int j = 0; j < pool->slot_count; j++) {
+                in_use += pool->slots[j].in_use;
+            }
+            MUTEX_UNLOCK(pool->mutex);
+            if (!in_use) {
+                buffer_pool_free(pool);
+            }
+            return;
+        }
+    }
+    MUTEX_UNLOCK(pool->mutex);
+    logger_log(pool->logger, LOGGER_ERR, "buffer_pool release of a buffer that does not belong to the pool");
+}
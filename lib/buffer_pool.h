@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include "logger.h"
+#include "mem_account.h"
+
+/*
+ * A small pool of reusable, size-classed byte buffers. Buffer capacities are
+ * rounded up to a power of two and never shrink, so after the first few large
+ * frames of a stream the pool stops calling into the allocator entirely.
+ * Buffers come from memlock_alloc, prefaulted and, from 2 MB on, huge page backed.
+ */
+typedef struct buffer_pool_s buffer_pool_t;
+
+/* The buffers are charged to MEM_TAG_FRAME_POOLS and the session of the calling thread */
+buffer_pool_t *buffer_pool_init(logger_t *logger, int slots);
+/* Buffers still acquired stay valid, the pool is freed once the last of them is released */
+void buffer_pool_destroy(buffer_pool_t *pool);
+/* Lets the pool add slots while all are in use, up to max_slots in all, for users that hold buffers for a while */
+void buffer_pool_set_max_slots(buffer_pool_t *pool, int max_slots);
+/* Charges the buffers to tag instead, call before the first buffer is acquired or reserved */
+void buffer_pool_set_mem_tag(buffer_pool_t *pool, mem_tag_t tag);
+
+/* Hands out a buffer of at least size bytes, or NULL if the pool is exhausted */
+unsigned char *buffer_pool_acquire(buffer_pool_t *pool, size_t size);
+/* Grows every free buffer to at least size bytes now, so the first frames of a stream do not allocate */
+void buffer_pool_reserve(buffer_pool_t *pool, size_t size);
+/* Returns a buffer obtained from buffer_pool_acquire to the pool */
+void buffer_pool_release(buffer_pool_t *pool, unsigned char *buffer);
+
+#endif //BUFFER_POOL_H
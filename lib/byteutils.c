@@ -13,6 +13,7 @@
  */
 
 #include <time.h>
+#include <string.h>
 #include <netinet/in.h>
 #include "byteutils.h"
 
@@ -27,50 +28,50 @@
 /**
  * Reads a little endian unsigned 16 bit integer from the buffer at position offset
  */
-uint16_t byteutils_get_short(unsigned char* b, int offset) {
-    return *((uint16_t*)(b + offset));
+uint16_t byteutils_get_short(const unsigned char* b, int offset) {
+    return *((const uint16_t*)(b + offset));
 }
 
 /**
  * Reads a little endian unsigned 32 bit integer from the buffer at position offset
  */
-uint32_t byteutils_get_int(unsigned char* b, int offset) {
-    return *((uint32_t*)(b + offset));
+uint32_t byteutils_get_int(const unsigned char* b, int offset) {
+    return *((const uint32_t*)(b + offset));
 }
 
 /**
  * Reads a little endian unsigned 64 bit integer from the buffer at position offset
  */
-uint64_t byteutils_get_long(unsigned char* b, int offset) {
-    return *((uint64_t*)(b + offset));
+uint64_t byteutils_get_long(const unsigned char* b, int offset) {
+    return *((const uint64_t*)(b + offset));
 }
 
 /**
  * Reads a big endian unsigned 16 bit integer from the buffer at position offset
  */
-uint16_t byteutils_get_short_be(unsigned char* b, int offset) {
+uint16_t byteutils_get_short_be(const unsigned char* b, int offset) {
     return ntohs(byteutils_get_short(b, offset));
 }
 
 /**
  * Reads a big endian unsigned 32 bit integer from the buffer at position offset
  */
-uint32_t byteutils_get_int_be(unsigned char* b, int offset) {
+uint32_t byteutils_get_int_be(const unsigned char* b, int offset) {
     return ntohl(byteutils_get_int(b, offset));
 }
 
 /**
  * Reads a big endian unsigned 64 bit integer from the buffer at position offset
  */
-uint64_t byteutils_get_long_be(unsigned char* b, int offset) {
+uint64_t byteutils_get_long_be(const unsigned char* b, int offset) {
     return ntohll(byteutils_get_long(b, offset));
 }
 
 /**
  * Reads a float from the buffer at position offset
  */
-float byteutils_get_float(unsigned char* b, int offset) {
-    return *((float*)(b + offset));
+float byteutils_get_float(const unsigned char* b, int offset) {
+    return *((const float*)(b + offset));
 }
 
 /**
@@ -80,10 +81,25 @@ void byteutils_put_int(unsigned char* b, int offset, uint32_t value) {
     *((uint32_t*)(b + offset)) = value;
 }
 
+/**
+ * Writes a big endian unsigned 32 bit integer to the buffer at position offset
+ */
+void byteutils_put_int_be(unsigned char* b, int offset, uint32_t value) {
+    byteutils_put_int(b, offset, htonl(value));
+}
+
+/**
+ * Writes a big endian unsigned 64 bit integer to the buffer at position offset
+ */
+void byteutils_put_long_be(unsigned char* b, int offset, uint64_t value) {
+    uint64_t be = htonll(value);
+    memcpy(b + offset, &be, sizeof(be));
+}
+
 /**
  * Reads an ntp timestamp and returns it as micro seconds since the Unix epoch
  */
-uint64_t byteutils_get_ntp_timestamp(unsigned char *b, int offset) {
+uint64_t byteutils_get_ntp_timestamp(const unsigned char *b, int offset) {
     uint64_t seconds = ntohl(((unsigned int) byteutils_get_int(b, offset))) - SECONDS_FROM_1900_TO_1970;
     uint64_t fraction = ntohl((unsigned int) byteutils_get_int(b, offset + 4));
     return (seconds * 1000000L) + ((fraction * 1000000L) >> 32);
@@ -16,17 +16,19 @@
 #define AIRPLAYSERVER_BYTEUTILS_H
 #include <stdint.h>
 
-uint16_t byteutils_get_short(unsigned char* b, int offset);
-uint32_t byteutils_get_int(unsigned char* b, int offset);
-uint64_t byteutils_get_long(unsigned char* b, int offset);
-uint16_t byteutils_get_short_be(unsigned char* b, int offset);
-uint32_t byteutils_get_int_be(unsigned char* b, int offset);
-uint64_t byteutils_get_long_be(unsigned char* b, int offset);
-float byteutils_get_float(unsigned char* b, int offset);
+uint16_t byteutils_get_short(const unsigned char* b, int offset);
+uint32_t byteutils_get_int(const unsigned char* b, int offset);
+uint64_t byteutils_get_long(const unsigned char* b, int offset);
+uint16_t byteutils_get_short_be(const unsigned char* b, int offset);
+uint32_t byteutils_get_int_be(const unsigned char* b, int offset);
+uint64_t byteutils_get_long_be(const unsigned char* b, int offset);
+float byteutils_get_float(const unsigned char* b, int offset);
+void byteutils_put_int_be(unsigned char* b, int offset, uint32_t value);
+void byteutils_put_long_be(unsigned char* b, int offset, uint64_t value);
 
 #define SECONDS_FROM_1900_TO_1970 2208988800ULL
 
-uint64_t byteutils_get_ntp_timestamp(unsigned char *b, int offset);
+uint64_t byteutils_get_ntp_timestamp(const unsigned char *b, int offset);
 void byteutils_put_ntp_timestamp(unsigned char *b, int offset, uint64_t us_since_1970);
 
 #endif //AIRPLAYSERVER_BYTEUTILS_H
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(__arm__)
+#include <sys/auxv.h>
+#endif
+
+#include "cpu_features.h"
+#include "threads.h"
+
+/* Marks the cached features as detected, so a CPU without any is not detected again every call */
+#define CPU_FEATURES_DETECTED (1u << 31)
+
+#ifndef HWCAP_NEON
+#define HWCAP_NEON (1 << 12)
+#endif
+
+static unsigned int cpu_features_cached;
+
+static unsigned int
+cpu_features_detect(void)
+{
+    unsigned int features = 0;
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        features |= CPU_FEATURE_SSE2;
+    }
+    // Only set where the OS saves the AVX registers too
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        features |= CPU_FEATURE_AVX2;
+    }
+#elif defined(__aarch64__)
+    features |= CPU_FEATURE_NEON;
+#elif defined(__linux__) && defined(__arm__)
+    // The Pi 1 and Zero have none, 32 bit builds for them cannot assume it
+    if (getauxval(AT_HWCAP) & HWCAP_NEON) {
+        features |= CPU_FEATURE_NEON;
+    }
+#endif
+    return features;
+}
+
+/* RPIPLAY_SIMD=name keeps the features up to that one */
+static unsigned int
+cpu_features_limit(unsigned int features)
+{
+    const char *limit = getenv("RPIPLAY_SIMD");
+    if (!limit) {
+        return features;
+    }
+    if (!strcmp(limit, "sse2")) {
+        return features & CPU_FEATURE_SSE2;
+    } else if (!strcmp(limit, "avx2")) {
+        return features & (CPU_FEATURE_SSE2 | CPU_FEATURE_AVX2);
+    } else if (!strcmp(limit, "neon")) {
+        return features & CPU_FEATURE_NEON;
+    }
+    return 0;
+}
+
+unsigned int
+cpu_features(void)
+{
+    unsigned int features = ATOMIC_LOAD(cpu_features_cached);
+    if (!features) {
+        // Racing threads detect the same, whichever stores last does no harm
+        features = cpu_features_limit(cpu_features_detect()) | CPU_FEATURES_DETECTED;
+        ATOMIC_STORE(cpu_features_cached, features);
+    }
+    return features & ~CPU_FEATURES_DETECTED;
+}
+
+const char *
+cpu_features_format(unsigned int features, char *buf, int size)
+{
+    snprintf(buf, size, "%s%s%s", features & CPU_FEATURE_SSE2 ? " sse2" : "",
+             features & CPU_FEATURE_AVX2 ? " avx2" : "", features & CPU_FEATURE_NEON ? " neon" : "");
+    if (!buf[0]) {
+        snprintf(buf, size, "none");
+    } else {
+        memmove(buf, buf + 1, strlen(buf));
+    }
+    return buf;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The SIMD instruction sets of the CPU rpiplay runs on, as opposed to the ones it was built
+ * for, from cpuid on x86 and the kernel's hwcaps on ARM. simd_kernels.h picks its kernels by them.
+ *
+ * RPIPLAY_SIMD in the environment caps them for comparisons and for ruling a kernel out:
+ * "none" leaves only the plain C kernels, "sse2" or "neon" everything up to that.
+ */
+
+#define CPU_FEATURE_SSE2 (1u << 0)
+#define CPU_FEATURE_AVX2 (1u << 1) // Together with FMA, which every AVX2 CPU has
+#define CPU_FEATURE_NEON (1u << 2)
+
+/* The CPU_FEATURE_ flags, detected on the first call */
+unsigned int cpu_features(void);
+
+/* Space separated names of the features, "none" without any, into buf of size bytes */
+const char *cpu_features_format(unsigned int features, char *buf, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CPU_FEATURES_H
@@ -19,27 +19,43 @@
  */
 
 #include "crypto.h"
+#include "crypto_afalg.h"
 
 #include <openssl/evp.h>
 #include <openssl/err.h>
+#include <openssl/rand.h>
 
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__linux__) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
 
 struct aes_ctx_s {
+    /* Either an OpenSSL context or an AF_ALG operation fd */
     EVP_CIPHER_CTX *cipher_ctx;
+    int alg_fd;
+    int cbc;
     uint8_t key[AES_128_BLOCK_SIZE];
     uint8_t iv[AES_128_BLOCK_SIZE];
     aes_direction_t direction;
     uint8_t block_offset;
+
+    /* AF_ALG only: the counter or CBC chaining block, and the unused rest of the last keystream block */
+    uint8_t chain[AES_128_BLOCK_SIZE];
+    uint8_t keystream[AES_128_BLOCK_SIZE];
+    uint8_t keystream_used;
 };
 
 uint8_t waste[AES_128_BLOCK_SIZE];
 
-// Common AES utilities
-
 void handle_error(const char* location) {
     long error = ERR_get_error();
     const char* error_str = ERR_error_string(error, NULL);
@@ -47,14 +63,290 @@ void handle_error(const char* location) {
     exit(EXIT_FAILURE);
 }
 
+/*
+ * Digest and cipher implementations are looked up once. OpenSSL 3 fetches them from the
+ * providers, which it would otherwise repeat on every init with the EVP_sha512() style
+ * getters. Every thread also keeps one EVP_MD_CTX for the one-shot helpers and Ed25519,
+ * freed when the thread exits.
+ */
+static pthread_once_t crypto_once = PTHREAD_ONCE_INIT;
+static pthread_key_t crypto_md_ctx_key;
+static const EVP_MD *crypto_sha512;
+static const EVP_MD *crypto_sha1;
+static const EVP_CIPHER *crypto_aes_128_ctr;
+static const EVP_CIPHER *crypto_aes_128_cbc;
+/* What new CTR and CBC contexts use, AUTO is resolved per mode on first use */
+static crypto_aes_backend_t crypto_aes_backend = CRYPTO_AES_AUTO;
+static crypto_aes_backend_t crypto_aes_ctr_backend;
+static crypto_aes_backend_t crypto_aes_cbc_backend;
+
+static void crypto_md_ctx_free(void *md_ctx) {
+    EVP_MD_CTX_free(md_ctx);
+}
+
+static void crypto_apply_aes_backend(crypto_aes_backend_t backend);
+static int crypto_afalg_self_test(int cbc);
+
+static void crypto_init_once(void) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    crypto_sha512 = EVP_MD_fetch(NULL, "SHA512", NULL);
+    crypto_sha1 = EVP_MD_fetch(NULL, "SHA1", NULL);
+    crypto_aes_128_ctr = EVP_CIPHER_fetch(NULL, "AES-128-CTR", NULL);
+    crypto_aes_128_cbc = EVP_CIPHER_fetch(NULL, "AES-128-CBC", NULL);
+#endif
+    if (!crypto_sha512) crypto_sha512 = EVP_sha512();
+    if (!crypto_sha1) crypto_sha1 = EVP_sha1();
+    if (!crypto_aes_128_ctr) crypto_aes_128_ctr = EVP_aes_128_ctr();
+    if (!crypto_aes_128_cbc) crypto_aes_128_cbc = EVP_aes_128_cbc();
+    pthread_key_create(&crypto_md_ctx_key, crypto_md_ctx_free);
+    crypto_apply_aes_backend(crypto_aes_backend);
+}
+
+void crypto_init(void) {
+    pthread_once(&crypto_once, crypto_init_once);
+}
+
+/* The calling thread's digest context, reset and ready for an init */
+static EVP_MD_CTX *crypto_get_md_ctx(void) {
+    crypto_init();
+    EVP_MD_CTX *md_ctx = pthread_getspecific(crypto_md_ctx_key);
+    if (!md_ctx) {
+        md_ctx = EVP_MD_CTX_new();
+        if (!md_ctx || pthread_setspecific(crypto_md_ctx_key, md_ctx)) {
+            handle_error(__func__);
+        }
+    }
+    return md_ctx;
+}
+
+// AES backend selection
+
+int crypto_cpu_has_aes(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES);
+#elif defined(__linux__) && defined(__aarch64__) && defined(HWCAP_AES)
+    return !!(getauxval(AT_HWCAP) & HWCAP_AES);
+#elif defined(__linux__) && defined(__arm__) && defined(HWCAP2_AES)
+    return !!(getauxval(AT_HWCAP2) & HWCAP2_AES);
+#else
+    return 0;
+#endif
+}
+
+/* The kernel only has an edge on cores without AES instructions, and only with something better than aes-generic */
+static crypto_aes_backend_t crypto_resolve_backend(const char *mode) {
+    char driver[128];
+
+    if (crypto_cpu_has_aes() || afalg_aes_get_driver(mode, driver, sizeof(driver)) < 0 || strstr(driver, "generic")) {
+        return CRYPTO_AES_OPENSSL;
+    }
+    return crypto_afalg_self_test(strcmp(mode, "cbc(aes)") == 0) == 0 ? CRYPTO_AES_AFALG : CRYPTO_AES_OPENSSL;
+}
+
+int crypto_set_aes_backend(crypto_aes_backend_t backend) {
+    crypto_init();
+    if (backend == CRYPTO_AES_AFALG && (crypto_afalg_self_test(0) < 0 || crypto_afalg_self_test(1) < 0)) {
+        return -1;
+    }
+    crypto_apply_aes_backend(backend);
+    return 0;
+}
+
+static void crypto_apply_aes_backend(crypto_aes_backend_t backend) {
+    crypto_aes_backend = backend;
+    if (backend == CRYPTO_AES_AUTO) {
+        crypto_aes_ctr_backend = crypto_resolve_backend("ctr(aes)");
+        // Audio packets are a few hundred bytes, too short to make up for the system calls
+        crypto_aes_cbc_backend = CRYPTO_AES_OPENSSL;
+    } else {
+        crypto_aes_ctr_backend = crypto_aes_cbc_backend = backend;
+    }
+}
+
+crypto_aes_backend_t crypto_get_aes_backend(int cbc) {
+    crypto_init();
+    return cbc ? crypto_aes_cbc_backend : crypto_aes_ctr_backend;
+}
+
+const char *crypto_aes_backend_name(crypto_aes_backend_t backend) {
+    switch (backend) {
+        case CRYPTO_AES_AUTO: return "auto";
+        case CRYPTO_AES_OPENSSL: return "openssl";
+        case CRYPTO_AES_AFALG: return "afalg";
+    }
+    return "unknown";
+}
+
+/* Adds blocks to the big endian 128 bit counter, like OpenSSL's CTR mode */
+static void aes_ctr_add(uint8_t counter[AES_128_BLOCK_SIZE], uint64_t blocks) {
+    for (int i = AES_128_BLOCK_SIZE - 1; i >= 0 && blocks; i--) {
+        uint32_t sum = counter[i] + (blocks & 0xff);
+        counter[i] = sum;
+        blocks = (blocks >> 8) + (sum >> 8);
+    }
+}
+
+/* Returns -1 if the kernel failed a request */
+static int afalg_ctr_crypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int len) {
+    // Finish the keystream block the last call started
+    while (len > 0 && ctx->keystream_used && ctx->keystream_used < AES_128_BLOCK_SIZE) {
+        *out++ = *in++ ^ ctx->keystream[ctx->keystream_used++];
+        len--;
+    }
+    while (len >= AES_128_BLOCK_SIZE) {
+        int chunk = len < AFALG_MAX_CHUNK ? len & ~(AES_128_BLOCK_SIZE - 1) : AFALG_MAX_CHUNK;
+        if (afalg_aes_crypt(ctx->alg_fd, 1, ctx->chain, in, out, chunk) < 0) {
+            return -1;
+        }
+        aes_ctr_add(ctx->chain, chunk / AES_128_BLOCK_SIZE);
+        in += chunk;
+        out += chunk;
+        len -= chunk;
+        ctx->keystream_used = 0;
+    }
+    if (len > 0) {
+        memset(ctx->keystream, 0, sizeof(ctx->keystream));
+        if (afalg_aes_crypt(ctx->alg_fd, 1, ctx->chain, ctx->keystream, ctx->keystream, AES_128_BLOCK_SIZE) < 0) {
+            return -1;
+        }
+        aes_ctr_add(ctx->chain, 1);
+        for (ctx->keystream_used = 0; ctx->keystream_used < len; ctx->keystream_used++) {
+            out[ctx->keystream_used] = in[ctx->keystream_used] ^ ctx->keystream[ctx->keystream_used];
+        }
+    }
+    return 0;
+}
+
+/* Returns -1 if the kernel failed a request */
+static int afalg_cbc_crypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int len) {
+    int encrypt = ctx->direction == AES_ENCRYPT;
+
+    assert(len % AES_128_BLOCK_SIZE == 0);
+    while (len > 0) {
+        int chunk = len < AFALG_MAX_CHUNK ? len : AFALG_MAX_CHUNK;
+        uint8_t next[AES_128_BLOCK_SIZE];
+
+        // The next chunk chains on the last ciphertext block, which decrypting in place overwrites
+        if (!encrypt) {
+            memcpy(next, in + chunk - AES_128_BLOCK_SIZE, AES_128_BLOCK_SIZE);
+        }
+        if (afalg_aes_crypt(ctx->alg_fd, encrypt, ctx->chain, in, out, chunk) < 0) {
+            return -1;
+        }
+        memcpy(ctx->chain, encrypt ? out + chunk - AES_128_BLOCK_SIZE : next, AES_128_BLOCK_SIZE);
+        in += chunk;
+        out += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+/* Lengths of the self test's calls, which split blocks, span several AF_ALG requests and add up to full blocks */
+static const int crypto_afalg_test_ctr_calls[] = { 5, 16, 37, AFALG_MAX_CHUNK + 23, 11, 2 * AFALG_MAX_CHUNK, 4 };
+static const int crypto_afalg_test_cbc_calls[] = { 16, 48, AFALG_MAX_CHUNK + 32, 2 * AFALG_MAX_CHUNK };
+#define CRYPTO_AFALG_TEST_SIZE (3 * AFALG_MAX_CHUNK + 96)
+
+/*
+ * Runs the AF_ALG chaining of CTR or CBC against OpenSSL, 0 if every byte matched. The IV has
+ * the low 64 bits of the counter about to wrap, so the carry into the high half is covered too.
+ * CBC is also decrypted back in place. A kernel whose driver disagrees is never used.
+ */
+static int crypto_afalg_self_test(int cbc) {
+    static const uint8_t key[AES_128_BLOCK_SIZE] = {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+    };
+    static const uint8_t iv[AES_128_BLOCK_SIZE] = {
+        0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0x00
+    };
+    const int *calls = cbc ? crypto_afalg_test_cbc_calls : crypto_afalg_test_ctr_calls;
+    int call_count = cbc ? sizeof(crypto_afalg_test_cbc_calls) / sizeof(int) : sizeof(crypto_afalg_test_ctr_calls) / sizeof(int);
+    aes_ctx_t afalg;
+    EVP_CIPHER_CTX *cipher_ctx;
+    uint8_t *plain, *expected, *actual;
+    int ret = -1;
+
+    memset(&afalg, 0, sizeof(afalg));
+    afalg.cbc = cbc;
+    afalg.direction = AES_ENCRYPT;
+    memcpy(afalg.chain, iv, AES_128_BLOCK_SIZE);
+    afalg.alg_fd = afalg_aes_open(cbc ? "cbc(aes)" : "ctr(aes)", key);
+    if (afalg.alg_fd < 0) {
+        return -1;
+    }
+    cipher_ctx = EVP_CIPHER_CTX_new();
+    plain = malloc(3 * CRYPTO_AFALG_TEST_SIZE);
+    if (!cipher_ctx || !plain ||
+        !EVP_EncryptInit_ex(cipher_ctx, cbc ? crypto_aes_128_cbc : crypto_aes_128_ctr, NULL, key, iv)) {
+        goto done;
+    }
+    EVP_CIPHER_CTX_set_padding(cipher_ctx, 0);
+    expected = plain + CRYPTO_AFALG_TEST_SIZE;
+    actual = expected + CRYPTO_AFALG_TEST_SIZE;
+    for (int i = 0; i < CRYPTO_AFALG_TEST_SIZE; i++) {
+        plain[i] = i * 7 + (i >> 8);
+    }
+
+    int offset = 0;
+    for (int i = 0; i < call_count; i++) {
+        int out_len;
+        if (!EVP_EncryptUpdate(cipher_ctx, expected + offset, &out_len, plain + offset, calls[i]) ||
+            out_len != calls[i] ||
+            (cbc ? afalg_cbc_crypt : afalg_ctr_crypt)(&afalg, plain + offset, actual + offset, calls[i]) < 0) {
+            goto done;
+        }
+        offset += calls[i];
+    }
+    assert(offset <= CRYPTO_AFALG_TEST_SIZE);
+    if (memcmp(expected, actual, offset) != 0) {
+        fprintf(stderr, "The kernel's %s does not match OpenSSL, AES stays on OpenSSL\n", cbc ? "cbc(aes)" : "ctr(aes)");
+        goto done;
+    }
+    if (cbc) {
+        afalg.direction = AES_DECRYPT;
+        memcpy(afalg.chain, iv, AES_128_BLOCK_SIZE);
+        for (int i = 0, at = 0; i < call_count; at += calls[i++]) {
+            if (afalg_cbc_crypt(&afalg, actual + at, actual + at, calls[i]) < 0) {
+                goto done;
+            }
+        }
+        if (memcmp(plain, actual, offset) != 0) {
+            fprintf(stderr, "The kernel's cbc(aes) does not decrypt what it encrypted, AES stays on OpenSSL\n");
+            goto done;
+        }
+    }
+    ret = 0;
+
+done:
+    free(plain);
+    EVP_CIPHER_CTX_free(cipher_ctx);
+    afalg_aes_close(afalg.alg_fd);
+    return ret;
+}
+
+// Common AES utilities
+
 aes_ctx_t *aes_init(const uint8_t *key, const uint8_t *iv, const EVP_CIPHER *type, aes_direction_t direction) {
-    aes_ctx_t *ctx = malloc(sizeof(aes_ctx_t));
+    aes_ctx_t *ctx = calloc(1, sizeof(aes_ctx_t));
     assert(ctx != NULL);
-    ctx->cipher_ctx = EVP_CIPHER_CTX_new();
-    assert(ctx->cipher_ctx != NULL);
 
     ctx->block_offset = 0;
     ctx->direction = direction;
+    memcpy(ctx->key, key, AES_128_BLOCK_SIZE);
+    memcpy(ctx->iv, iv, AES_128_BLOCK_SIZE);
+    memcpy(ctx->chain, iv, AES_128_BLOCK_SIZE);
+
+    ctx->cbc = type == crypto_aes_128_cbc;
+    ctx->alg_fd = -1;
+    if (crypto_get_aes_backend(ctx->cbc) == CRYPTO_AES_AFALG) {
+        ctx->alg_fd = afalg_aes_open(ctx->cbc ? "cbc(aes)" : "ctr(aes)", key);
+        if (ctx->alg_fd >= 0) {
+            return ctx;
+        }
+    }
+
+    ctx->cipher_ctx = EVP_CIPHER_CTX_new();
+    assert(ctx->cipher_ctx != NULL);
 
     if (direction == AES_ENCRYPT) {
         if (!EVP_EncryptInit_ex(ctx->cipher_ctx, type, NULL, key, iv)) {
@@ -66,13 +358,17 @@ aes_ctx_t *aes_init(const uint8_t *key, const uint8_t *iv, const EVP_CIPHER *typ
         }
     }
 
-    memcpy(ctx->key, key, AES_128_BLOCK_SIZE);
-    memcpy(ctx->iv, iv, AES_128_BLOCK_SIZE);
     EVP_CIPHER_CTX_set_padding(ctx->cipher_ctx, 0);
     return ctx;
 }
 
 void aes_encrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int in_len) {
+    if (ctx->alg_fd >= 0) {
+        if ((ctx->cbc ? afalg_cbc_crypt : afalg_ctr_crypt)(ctx, in, out, in_len) < 0) {
+            handle_error(__func__);
+        }
+        return;
+    }
     int out_len_e = 0;
     if (!EVP_EncryptUpdate(ctx->cipher_ctx, out, &out_len_e, in, in_len)) {
         handle_error(__func__);
@@ -85,6 +381,12 @@ void aes_encrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int in_len) {
 }
 
 void aes_decrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int in_len) {
+    if (ctx->alg_fd >= 0) {
+        if (afalg_cbc_crypt(ctx, in, out, in_len) < 0) {
+            handle_error(__func__);
+        }
+        return;
+    }
     int out_len_d = 0;
     if (!EVP_DecryptUpdate(ctx->cipher_ctx, out, &out_len_d, in, in_len)) {
         handle_error(__func__);
@@ -99,11 +401,17 @@ void aes_decrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int in_len) {
 void aes_destroy(aes_ctx_t *ctx) {
     if (ctx) {
         EVP_CIPHER_CTX_free(ctx->cipher_ctx);
+        afalg_aes_close(ctx->alg_fd);
         free(ctx);
     }
 }
 
 void aes_reset(aes_ctx_t *ctx, const EVP_CIPHER *type, aes_direction_t direction) {
+    if (ctx->alg_fd >= 0) {
+        memcpy(ctx->chain, ctx->iv, AES_128_BLOCK_SIZE);
+        ctx->keystream_used = 0;
+        return;
+    }
     if (!EVP_CIPHER_CTX_reset(ctx->cipher_ctx)) {
         handle_error(__func__);
     }
@@ -122,7 +430,8 @@ void aes_reset(aes_ctx_t *ctx, const EVP_CIPHER *type, aes_direction_t direction
 // AES CTR
 
 aes_ctx_t *aes_ctr_init(const uint8_t *key, const uint8_t *iv) {
-    return aes_init(key, iv, EVP_aes_128_ctr(), AES_ENCRYPT);
+    crypto_init();
+    return aes_init(key, iv, crypto_aes_128_ctr, AES_ENCRYPT);
 }
 
 void aes_ctr_encrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int len) {
@@ -140,8 +449,32 @@ void aes_ctr_decrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int len) {
     aes_encrypt(ctx, in, out, len);
 }
 
+void aes_ctr_seek(aes_ctx_t *ctx, uint64_t offset) {
+    uint8_t counter[AES_128_BLOCK_SIZE];
+    uint8_t skipped[AES_128_BLOCK_SIZE] = {0};
+
+    memcpy(counter, ctx->iv, AES_128_BLOCK_SIZE);
+    aes_ctr_add(counter, offset / AES_128_BLOCK_SIZE);
+    if (ctx->alg_fd >= 0) {
+        memcpy(ctx->chain, counter, AES_128_BLOCK_SIZE);
+        ctx->keystream_used = 0;
+    } else if (!EVP_EncryptInit_ex(ctx->cipher_ctx, NULL, NULL, NULL, counter)) {
+        handle_error(__func__);
+    }
+    ctx->block_offset = 0;
+    // Into the block, not the shared waste buffer, contexts may be seeked on several threads at once
+    if (offset % AES_128_BLOCK_SIZE) {
+        aes_ctr_encrypt(ctx, skipped, skipped, offset % AES_128_BLOCK_SIZE);
+    }
+}
+
 void aes_ctr_reset(aes_ctx_t *ctx) {
-    aes_reset(ctx, EVP_aes_128_ctr(), AES_ENCRYPT);
+    aes_reset(ctx, crypto_aes_128_ctr, AES_ENCRYPT);
+}
+
+void aes_ctr_reset_iv(aes_ctx_t *ctx, const uint8_t *iv) {
+    memcpy(ctx->iv, iv, AES_128_BLOCK_SIZE);
+    aes_ctr_seek(ctx, 0);
 }
 
 void aes_ctr_destroy(aes_ctx_t *ctx) {
@@ -151,7 +484,8 @@ void aes_ctr_destroy(aes_ctx_t *ctx) {
 // AES CBC
 
 aes_ctx_t *aes_cbc_init(const uint8_t *key, const uint8_t *iv, aes_direction_t direction) {
-    return aes_init(key, iv, EVP_aes_128_cbc(), direction);
+    crypto_init();
+    return aes_init(key, iv, crypto_aes_128_cbc, direction);
 }
 
 void aes_cbc_encrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int len) {
@@ -165,7 +499,24 @@ void aes_cbc_decrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int len) {
 }
 
 void aes_cbc_reset(aes_ctx_t *ctx) {
-    aes_reset(ctx, EVP_aes_128_ctr(), ctx->direction);
+    aes_reset(ctx, crypto_aes_128_cbc, ctx->direction);
+}
+
+void aes_cbc_reset_iv(aes_ctx_t *ctx, const uint8_t *iv) {
+    if (ctx->alg_fd >= 0) {
+        memcpy(ctx->chain, iv, AES_128_BLOCK_SIZE);
+        return;
+    }
+    // Passing no cipher and no key keeps the expanded key schedule, only the IV is loaded
+    if (ctx->direction == AES_ENCRYPT) {
+        if (!EVP_EncryptInit_ex(ctx->cipher_ctx, NULL, NULL, NULL, iv)) {
+            handle_error(__func__);
+        }
+    } else {
+        if (!EVP_DecryptInit_ex(ctx->cipher_ctx, NULL, NULL, NULL, iv)) {
+            handle_error(__func__);
+        }
+    }
 }
 
 void aes_cbc_destroy(aes_ctx_t *ctx) {
@@ -299,6 +650,27 @@ void ed25519_key_get_raw(unsigned char data[ED25519_KEY_SIZE], const ed25519_key
     }
 }
 
+ed25519_key_t *ed25519_key_from_raw_private(const unsigned char data[ED25519_KEY_SIZE]) {
+    ed25519_key_t *key;
+
+    key = malloc(sizeof(ed25519_key_t));
+    assert(key);
+
+    key->pkey = EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, NULL, data, ED25519_KEY_SIZE);
+    if (!key->pkey) {
+        handle_error(__func__);
+    }
+
+    return key;
+}
+
+void ed25519_key_get_raw_private(unsigned char data[ED25519_KEY_SIZE], const ed25519_key_t *key) {
+    assert(key);
+    if (!EVP_PKEY_get_raw_private_key(key->pkey, data, &(size_t) {ED25519_KEY_SIZE})) {
+        handle_error(__func__);
+    }
+}
+
 ed25519_key_t *ed25519_key_copy(const ed25519_key_t *key) {
     ed25519_key_t *new_key;
 
@@ -319,12 +691,7 @@ void ed25519_sign(unsigned char *signature, size_t signature_len,
                   const unsigned char *data, size_t data_len,
                   const ed25519_key_t *key)
 {
-    EVP_MD_CTX *mctx;
-
-    mctx = EVP_MD_CTX_new();
-    if (!mctx) {
-        handle_error(__func__);
-    }
+    EVP_MD_CTX *mctx = crypto_get_md_ctx();
 
     if (!EVP_DigestSignInit(mctx, NULL, NULL, NULL, key->pkey)) {
         handle_error(__func__);
@@ -333,19 +700,14 @@ void ed25519_sign(unsigned char *signature, size_t signature_len,
         handle_error(__func__);
     }
 
-    EVP_MD_CTX_free(mctx);
+    EVP_MD_CTX_reset(mctx);
 }
 
 int ed25519_verify(const unsigned char *signature, size_t signature_len,
                    const unsigned char *data, size_t data_len,
                    const ed25519_key_t *key)
 {
-    EVP_MD_CTX *mctx;
-
-    mctx = EVP_MD_CTX_new();
-    if (!mctx) {
-        handle_error(__func__);
-    }
+    EVP_MD_CTX *mctx = crypto_get_md_ctx();
 
     if (!EVP_DigestVerifyInit(mctx, NULL, NULL, NULL, key->pkey)) {
         handle_error(__func__);
@@ -356,7 +718,7 @@ int ed25519_verify(const unsigned char *signature, size_t signature_len,
         handle_error(__func__);
     }
 
-    EVP_MD_CTX_free(mctx);
+    EVP_MD_CTX_reset(mctx);
 
     return ret;
 }
@@ -368,6 +730,52 @@ void ed25519_key_destroy(ed25519_key_t *key) {
     }
 }
 
+// ChaCha20-Poly1305
+
+struct chacha_ctx_s {
+    EVP_CIPHER_CTX *cipher_ctx;
+};
+
+chacha_ctx_t *chacha20_poly1305_init(const uint8_t *key) {
+    chacha_ctx_t *ctx = malloc(sizeof(chacha_ctx_t));
+    assert(ctx != NULL);
+    ctx->cipher_ctx = EVP_CIPHER_CTX_new();
+    assert(ctx->cipher_ctx != NULL);
+
+    // The key stays set up, every packet only brings its nonce
+    if (!EVP_DecryptInit_ex(ctx->cipher_ctx, EVP_chacha20_poly1305(), NULL, key, NULL) ||
+        !EVP_CIPHER_CTX_ctrl(ctx->cipher_ctx, EVP_CTRL_AEAD_SET_IVLEN, CHACHA20_POLY1305_NONCE_SIZE, NULL)) {
+        handle_error(__func__);
+    }
+    return ctx;
+}
+
+int chacha20_poly1305_decrypt(chacha_ctx_t *ctx, const uint8_t *nonce, const uint8_t *aad, int aad_len,
+                              const uint8_t *in, uint8_t *out, int len, const uint8_t *tag) {
+    int out_len = 0;
+    if (!EVP_DecryptInit_ex(ctx->cipher_ctx, NULL, NULL, NULL, nonce)) {
+        handle_error(__func__);
+    }
+    if (aad_len > 0 && !EVP_DecryptUpdate(ctx->cipher_ctx, NULL, &out_len, aad, aad_len)) {
+        handle_error(__func__);
+    }
+    if (len > 0 && !EVP_DecryptUpdate(ctx->cipher_ctx, out, &out_len, in, len)) {
+        handle_error(__func__);
+    }
+    if (!EVP_CIPHER_CTX_ctrl(ctx->cipher_ctx, EVP_CTRL_AEAD_SET_TAG, CHACHA20_POLY1305_TAG_SIZE, (void *) tag)) {
+        handle_error(__func__);
+    }
+    // A tag mismatch is the sender's data, not our error
+    return EVP_DecryptFinal_ex(ctx->cipher_ctx, out + out_len, &out_len) > 0 ? 0 : -1;
+}
+
+void chacha20_poly1305_destroy(chacha_ctx_t *ctx) {
+    if (ctx) {
+        EVP_CIPHER_CTX_free(ctx->cipher_ctx);
+        free(ctx);
+    }
+}
+
 // SHA 512
 
 struct sha_ctx_s {
@@ -380,7 +788,8 @@ sha_ctx_t *sha_init() {
     ctx->digest_ctx = EVP_MD_CTX_new();
     assert(ctx->digest_ctx != NULL);
 
-    if (!EVP_DigestInit_ex(ctx->digest_ctx, EVP_sha512(), NULL)) {
+    crypto_init();
+    if (!EVP_DigestInit_ex(ctx->digest_ctx, crypto_sha512, NULL)) {
         handle_error(__func__);
     }
     return ctx;
@@ -400,7 +809,7 @@ void sha_final(sha_ctx_t *ctx, uint8_t *out, unsigned int *len) {
 
 void sha_reset(sha_ctx_t *ctx) {
     if (!EVP_MD_CTX_reset(ctx->digest_ctx) ||
-        !EVP_DigestInit_ex(ctx->digest_ctx, EVP_sha512(), NULL)) {
+        !EVP_DigestInit_ex(ctx->digest_ctx, crypto_sha512, NULL)) {
 
         handle_error(__func__);
     }
@@ -412,3 +821,94 @@ void sha_destroy(sha_ctx_t *ctx) {
         free(ctx);
     }
 }
+
+void sha512_oneshot(const uint8_t *in, int len, uint8_t out[SHA512_DIGEST_SIZE]) {
+    sha512_oneshot2(in, len, NULL, 0, out);
+}
+
+void sha512_oneshot2(const uint8_t *in1, int len1, const uint8_t *in2, int len2, uint8_t out[SHA512_DIGEST_SIZE]) {
+    EVP_MD_CTX *mctx = crypto_get_md_ctx();
+
+    if (!EVP_DigestInit_ex(mctx, crypto_sha512, NULL) ||
+        !EVP_DigestUpdate(mctx, in1, len1) ||
+        (len2 > 0 && !EVP_DigestUpdate(mctx, in2, len2)) ||
+        !EVP_DigestFinal_ex(mctx, out, NULL)) {
+        handle_error(__func__);
+    }
+    EVP_MD_CTX_reset(mctx);
+}
+
+// HMAC-SHA1
+
+/* The hash states after the padded key, copied for every message instead of hashing the key again */
+struct hmac_ctx_s {
+    EVP_MD_CTX *inner;
+    EVP_MD_CTX *outer;
+    EVP_MD_CTX *work;
+};
+
+hmac_ctx_t *hmac_sha1_init(const uint8_t *key, int key_len) {
+    uint8_t block[SHA1_BLOCK_SIZE];
+    uint8_t hashed_key[SHA1_DIGEST_SIZE];
+
+    crypto_init();
+    hmac_ctx_t *ctx = calloc(1, sizeof(hmac_ctx_t));
+    if (!ctx) {
+        return NULL;
+    }
+    ctx->inner = EVP_MD_CTX_new();
+    ctx->outer = EVP_MD_CTX_new();
+    ctx->work = EVP_MD_CTX_new();
+    if (!ctx->inner || !ctx->outer || !ctx->work) {
+        hmac_sha1_destroy(ctx);
+        return NULL;
+    }
+    if (key_len > SHA1_BLOCK_SIZE) {
+        if (!EVP_Digest(key, key_len, hashed_key, NULL, crypto_sha1, NULL)) {
+            handle_error(__func__);
+        }
+        key = hashed_key;
+        key_len = SHA1_DIGEST_SIZE;
+    }
+    memset(block, 0x36, sizeof(block));
+    for (int i = 0; i < key_len; i++) block[i] ^= key[i];
+    if (!EVP_DigestInit_ex(ctx->inner, crypto_sha1, NULL) || !EVP_DigestUpdate(ctx->inner, block, sizeof(block))) {
+        handle_error(__func__);
+    }
+    memset(block, 0x5c, sizeof(block));
+    for (int i = 0; i < key_len; i++) block[i] ^= key[i];
+    if (!EVP_DigestInit_ex(ctx->outer, crypto_sha1, NULL) || !EVP_DigestUpdate(ctx->outer, block, sizeof(block))) {
+        handle_error(__func__);
+    }
+    return ctx;
+}
+
+void hmac_sha1(hmac_ctx_t *ctx, const uint8_t *in, int len, uint8_t out[SHA1_DIGEST_SIZE]) {
+    uint8_t inner[SHA1_DIGEST_SIZE];
+
+    if (!EVP_MD_CTX_copy_ex(ctx->work, ctx->inner) ||
+        !EVP_DigestUpdate(ctx->work, in, len) ||
+        !EVP_DigestFinal_ex(ctx->work, inner, NULL) ||
+        !EVP_MD_CTX_copy_ex(ctx->work, ctx->outer) ||
+        !EVP_DigestUpdate(ctx->work, inner, sizeof(inner)) ||
+        !EVP_DigestFinal_ex(ctx->work, out, NULL)) {
+        handle_error(__func__);
+    }
+}
+
+void hmac_sha1_destroy(hmac_ctx_t *ctx) {
+    if (ctx) {
+        EVP_MD_CTX_free(ctx->inner);
+        EVP_MD_CTX_free(ctx->outer);
+        EVP_MD_CTX_free(ctx->work);
+        free(ctx);
+    }
+}
+
+// Random
+
+void crypto_random(uint8_t *out, int len) {
+    if (RAND_bytes(out, len) != 1) {
+        handle_error(__func__);
+    }
+}
@@ -33,6 +33,29 @@
 extern "C" {
 #endif
 
+/* Looks up the digest and cipher implementations, done on first use if not called up front */
+void crypto_init(void);
+
+/*
+ * Where AES runs. OpenSSL uses AES-NI or the ARMv8 Crypto Extensions if the CPU has them,
+ * AF_ALG hands the work to the kernel, which may have a crypto engine or bitsliced NEON code
+ * for cores without AES instructions. AUTO takes the kernel only for CTR on such cores, if it
+ * has more than aes-generic. bench_crypto shows what is fastest on a device.
+ */
+typedef enum crypto_aes_backend_e {
+    CRYPTO_AES_AUTO,
+    CRYPTO_AES_OPENSSL,
+    CRYPTO_AES_AFALG
+} crypto_aes_backend_t;
+
+/* Applies to contexts created afterwards. Returns -1 if the backend is not available here */
+int crypto_set_aes_backend(crypto_aes_backend_t backend);
+/* What new CTR (cbc 0) or CBC (cbc 1) contexts use, never AUTO */
+crypto_aes_backend_t crypto_get_aes_backend(int cbc);
+const char *crypto_aes_backend_name(crypto_aes_backend_t backend);
+/* Nonzero if the CPU has AES instructions, AES-NI or the ARMv8 Crypto Extensions */
+int crypto_cpu_has_aes(void);
+
 // 128bit AES in CTR mode
 
 #define AES_128_BLOCK_SIZE 16
@@ -46,10 +69,15 @@ void aes_ctr_reset(aes_ctx_t *ctx);
 void aes_ctr_encrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int len);
 void aes_ctr_decrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int len);
 void aes_ctr_start_fresh_block(aes_ctx_t *ctx);
+/* Positions the keystream at a byte offset from the IV, contexts with the same key and IV can split a stream */
+void aes_ctr_seek(aes_ctx_t *ctx, uint64_t offset);
+/* Starts over with another IV and the same key, as SRTP does for every packet */
+void aes_ctr_reset_iv(aes_ctx_t *ctx, const uint8_t *iv);
 void aes_ctr_destroy(aes_ctx_t *ctx);
 
 aes_ctx_t *aes_cbc_init(const uint8_t *key, const uint8_t *iv, aes_direction_t direction);
 void aes_cbc_reset(aes_ctx_t *ctx);
+void aes_cbc_reset_iv(aes_ctx_t *ctx, const uint8_t *iv);
 void aes_cbc_encrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int len);
 void aes_cbc_decrypt(aes_ctx_t *ctx, const uint8_t *in, uint8_t *out, int len);
 void aes_cbc_destroy(aes_ctx_t *ctx);
@@ -76,6 +104,9 @@ typedef struct ed25519_key_s ed25519_key_t;
 ed25519_key_t *ed25519_key_generate(void);
 ed25519_key_t *ed25519_key_from_raw(const unsigned char data[ED25519_KEY_SIZE]);
 void ed25519_key_get_raw(unsigned char data[ED25519_KEY_SIZE], const ed25519_key_t *key);
+/* The 32 byte seed of a key pair, for keeping our own identity across restarts */
+ed25519_key_t *ed25519_key_from_raw_private(const unsigned char data[ED25519_KEY_SIZE]);
+void ed25519_key_get_raw_private(unsigned char data[ED25519_KEY_SIZE], const ed25519_key_t *key);
 /*
  * Note that this function does *not copy* the OpenSSL key but only the wrapper. The internal OpenSSL key is still the
  * same. Only the reference count is increased so destroying both the original and the copy is allowed.
@@ -90,6 +121,20 @@ int ed25519_verify(const unsigned char *signature, size_t signature_len,
                    const unsigned char *data, size_t data_len,
                    const ed25519_key_t *key);
 
+// ChaCha20-Poly1305, as the buffered audio stream is sealed
+
+#define CHACHA20_POLY1305_KEY_SIZE 32
+#define CHACHA20_POLY1305_NONCE_SIZE 12
+#define CHACHA20_POLY1305_TAG_SIZE 16
+
+typedef struct chacha_ctx_s chacha_ctx_t;
+
+chacha_ctx_t *chacha20_poly1305_init(const uint8_t *key);
+/* Decrypts len bytes from in to out, which may be the same. Returns -1 if the tag does not authenticate them */
+int chacha20_poly1305_decrypt(chacha_ctx_t *ctx, const uint8_t *nonce, const uint8_t *aad, int aad_len,
+                              const uint8_t *in, uint8_t *out, int len, const uint8_t *tag);
+void chacha20_poly1305_destroy(chacha_ctx_t *ctx);
+
 // SHA512
 
 typedef struct sha_ctx_s sha_ctx_t;
@@ -99,6 +144,27 @@ void sha_final(sha_ctx_t *ctx, uint8_t *out, unsigned int *len);
 void sha_reset(sha_ctx_t *ctx);
 void sha_destroy(sha_ctx_t *ctx);
 
+#define SHA512_DIGEST_SIZE 64
+
+/* Hash without a sha_ctx_t, on a digest context the calling thread keeps. in2 may be NULL if len2 is 0 */
+void sha512_oneshot(const uint8_t *in, int len, uint8_t out[SHA512_DIGEST_SIZE]);
+void sha512_oneshot2(const uint8_t *in1, int len1, const uint8_t *in2, int len2, uint8_t out[SHA512_DIGEST_SIZE]);
+
+// HMAC-SHA1, for SRTP and STUN
+
+#define SHA1_DIGEST_SIZE 20
+#define SHA1_BLOCK_SIZE 64
+
+typedef struct hmac_ctx_s hmac_ctx_t;
+hmac_ctx_t *hmac_sha1_init(const uint8_t *key, int key_len);
+void hmac_sha1(hmac_ctx_t *ctx, const uint8_t *in, int len, uint8_t out[SHA1_DIGEST_SIZE]);
+void hmac_sha1_destroy(hmac_ctx_t *ctx);
+
+// Random
+
+/* Cryptographically strong random bytes */
+void crypto_random(uint8_t *out, int len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,179 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include "crypto_afalg.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/if_alg.h>
+
+#ifndef AF_ALG
+#define AF_ALG 38
+#endif
+#ifndef SOL_ALG
+#define SOL_ALG 279
+#endif
+
+int afalg_aes_open(const char *mode, const uint8_t *key) {
+    struct sockaddr_alg sa;
+    int tfm_fd, op_fd;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.salg_family = AF_ALG;
+    strncpy((char *) sa.salg_type, "skcipher", sizeof(sa.salg_type) - 1);
+    strncpy((char *) sa.salg_name, mode, sizeof(sa.salg_name) - 1);
+
+    tfm_fd = socket(AF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (tfm_fd < 0) {
+        return -1;
+    }
+    if (bind(tfm_fd, (struct sockaddr *) &sa, sizeof(sa)) < 0 ||
+        setsockopt(tfm_fd, SOL_ALG, ALG_SET_KEY, key, 16) < 0) {
+        close(tfm_fd);
+        return -1;
+    }
+    // The operation socket keeps the transform alive on its own
+    op_fd = accept(tfm_fd, NULL, 0);
+    close(tfm_fd);
+    return op_fd;
+}
+
+void afalg_aes_close(int fd) {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+int afalg_aes_crypt(int fd, int encrypt, const uint8_t *iv, const uint8_t *in, uint8_t *out, int len) {
+    char control[CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(struct af_alg_iv) + 16)];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    struct af_alg_iv *alg_iv;
+    int done;
+
+    if (len <= 0 || len > AFALG_MAX_CHUNK || len % 16) {
+        return -1;
+    }
+
+    memset(control, 0, sizeof(control));
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_ALG;
+    cmsg->cmsg_type = ALG_SET_OP;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+    *(uint32_t *) CMSG_DATA(cmsg) = encrypt ? ALG_OP_ENCRYPT : ALG_OP_DECRYPT;
+
+    cmsg = CMSG_NXTHDR(&msg, cmsg);
+    cmsg->cmsg_level = SOL_ALG;
+    cmsg->cmsg_type = ALG_SET_IV;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(struct af_alg_iv) + 16);
+    alg_iv = (struct af_alg_iv *) CMSG_DATA(cmsg);
+    alg_iv->ivlen = 16;
+    memcpy(alg_iv->iv, iv, 16);
+
+    iov.iov_base = (void *) in;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    if (sendmsg(fd, &msg, 0) != len) {
+        return -1;
+    }
+    for (done = 0; done < len;) {
+        ssize_t ret = read(fd, out + done, len - done);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        } else if (ret <= 0) {
+            return -1;
+        }
+        done += ret;
+    }
+    return 0;
+}
+
+int afalg_aes_get_driver(const char *mode, char *driver, int driver_len) {
+    char line[256], name[128] = "", best[128] = "";
+    int priority, best_priority = -1;
+    FILE *file;
+
+    // Opening a transform makes the kernel load the module, /proc/crypto only lists loaded ones
+    static const uint8_t zero_key[16];
+    int fd = afalg_aes_open(mode, zero_key);
+    if (fd < 0) {
+        return -1;
+    }
+    afalg_aes_close(fd);
+
+    file = fopen("/proc/crypto", "r");
+    if (!file) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        char value[128];
+        if (sscanf(line, "name : %127s", value) == 1) {
+            name[0] = '\0';
+            if (!strcmp(value, mode)) {
+                strcpy(name, value);
+            }
+        } else if (name[0] && sscanf(line, "driver : %127s", value) == 1) {
+            strcpy(name, value);
+        } else if (name[0] && sscanf(line, "priority : %d", &priority) == 1) {
+            if (priority > best_priority) {
+                best_priority = priority;
+                strcpy(best, name);
+            }
+            name[0] = '\0';
+        }
+    }
+    fclose(file);
+
+    if (!best[0]) {
+        return -1;
+    }
+    snprintf(driver, driver_len, "%s", best);
+    return 0;
+}
+
+#else
+
+int afalg_aes_open(const char *mode, const uint8_t *key) {
+    return -1;
+}
+
+void afalg_aes_close(int fd) {
+}
+
+int afalg_aes_crypt(int fd, int encrypt, const uint8_t *iv, const uint8_t *in, uint8_t *out, int len) {
+    return -1;
+}
+
+int afalg_aes_get_driver(const char *mode, char *driver, int driver_len) {
+    return -1;
+}
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * AES through the Linux kernel crypto API. Depending on the kernel this reaches a crypto engine
+ * or the kernel's bitsliced NEON code, which can beat OpenSSL's table based AES on cores without
+ * AES instructions. Every call is a sendmsg and a read, so it only pays off for larger buffers.
+ * Only used by crypto.c, elsewhere every function fails.
+ */
+
+#ifndef CRYPTO_AFALG_H
+#define CRYPTO_AFALG_H
+
+#include <stdint.h>
+
+/* Longest buffer a single afalg_aes_crypt takes, a multiple of the block size */
+#define AFALG_MAX_CHUNK (16 * 1024)
+
+/* Returns an operation fd for mode, "ctr(aes)" or "cbc(aes)", keyed with the 128 bit key, or -1 */
+int afalg_aes_open(const char *mode, const uint8_t *key);
+void afalg_aes_close(int fd);
+
+/* len at most AFALG_MAX_CHUNK and a multiple of 16. Returns -1 on errors */
+int afalg_aes_crypt(int fd, int encrypt, const uint8_t *iv, const uint8_t *in, uint8_t *out, int len);
+
+/* Copies the name of the driver the kernel uses for mode, returns -1 if there is none */
+int afalg_aes_get_driver(const char *mode, char *driver, int driver_len);
+
+#endif //CRYPTO_AFALG_H
@@ -136,6 +136,10 @@ struct dnssd_s {
     DNSServiceRef raop_service;
     DNSServiceRef airplay_service;
 
+    char raop_servname[MAX_SERVNAME];
+    unsigned short raop_port;
+    unsigned short airplay_port;
+
     char *name;
     int name_len;
 
@@ -292,6 +296,8 @@ dnssd_register_raop(dnssd_t *dnssd, unsigned short port)
 
     strncat(servname, "@", sizeof(servname)-strlen(servname)-1);
     strncat(servname, dnssd->name, sizeof(servname)-strlen(servname)-1);
+    memcpy(dnssd->raop_servname, servname, sizeof(servname));
+    dnssd->raop_port = port;
 
     /* Register the service */
     dnssd->DNSServiceRegister(&dnssd->raop_service, 0, 0,
@@ -330,6 +336,8 @@ dnssd_register_airplay(dnssd_t *dnssd, unsigned short port)
     dnssd->TXTRecordSetValue(&dnssd->airplay_record, "srcvers", strlen(AIRPLAY_SRCVERS), AIRPLAY_SRCVERS);
     dnssd->TXTRecordSetValue(&dnssd->airplay_record, "vv", strlen(AIRPLAY_VV), AIRPLAY_VV);
 
+    dnssd->airplay_port = port;
+
     /* Register the service */
     dnssd->DNSServiceRegister(&dnssd->airplay_service, 0, 0,
                               dnssd->name, "_airplay._tcp",
@@ -342,6 +350,37 @@ dnssd_register_airplay(dnssd_t *dnssd, unsigned short port)
     return 1;
 }
 
+int
+dnssd_reregister(dnssd_t *dnssd)
+{
+    assert(dnssd);
+
+    /* The TXT records stay, /info is built from the AirPlay one on other threads */
+    if (dnssd->raop_service) {
+        dnssd->DNSServiceRefDeallocate(dnssd->raop_service);
+        dnssd->raop_service = NULL;
+        dnssd->DNSServiceRegister(&dnssd->raop_service, 0, 0,
+                                  dnssd->raop_servname, "_raop._tcp",
+                                  NULL, NULL,
+                                  htons(dnssd->raop_port),
+                                  dnssd->TXTRecordGetLength(&dnssd->raop_record),
+                                  dnssd->TXTRecordGetBytesPtr(&dnssd->raop_record),
+                                  NULL, NULL);
+    }
+    if (dnssd->airplay_service) {
+        dnssd->DNSServiceRefDeallocate(dnssd->airplay_service);
+        dnssd->airplay_service = NULL;
+        dnssd->DNSServiceRegister(&dnssd->airplay_service, 0, 0,
+                                  dnssd->name, "_airplay._tcp",
+                                  NULL, NULL,
+                                  htons(dnssd->airplay_port),
+                                  dnssd->TXTRecordGetLength(&dnssd->airplay_record),
+                                  dnssd->TXTRecordGetBytesPtr(&dnssd->airplay_record),
+                                  NULL, NULL);
+    }
+    return 1;
+}
+
 const char *
 dnssd_get_airplay_txt(dnssd_t *dnssd, int *length)
 {
@@ -24,6 +24,12 @@ DNSSD_API dnssd_t *dnssd_init(const char *name, int name_len, const char *hw_add
 DNSSD_API int dnssd_register_raop(dnssd_t *dnssd, unsigned short port);
 DNSSD_API int dnssd_register_airplay(dnssd_t *dnssd, unsigned short port);
 
+/*
+ * Registers both services anew, so the daemon probes and announces them again on the
+ * interfaces and addresses there are now. Must not run concurrently with the calls above.
+ */
+DNSSD_API int dnssd_reregister(dnssd_t *dnssd);
+
 DNSSD_API void dnssd_unregister_raop(dnssd_t *dnssd);
 DNSSD_API void dnssd_unregister_airplay(dnssd_t *dnssd);
 
@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/rand.h>
+
+#include "dtls.h"
+
+/* Datagrams are kept below what fits any path with some tunnel overhead */
+#define DTLS_MTU 1200
+#define DTLS_CERTIFICATE_DAYS 30
+#define DTLS_SRTP_PROFILE "SRTP_AES128_CM_SHA1_80"
+#define DTLS_SRTP_LABEL "EXTRACTOR-dtls_srtp"
+
+struct dtls_context_s {
+    logger_t *logger;
+    SSL_CTX *ssl_ctx;
+    BIO_METHOD *bio_method;
+    char fingerprint[DTLS_FINGERPRINT_SIZE];
+};
+
+struct dtls_session_s {
+    dtls_context_t *context;
+    SSL *ssl;
+    /* Datagrams from the peer are written here for OpenSSL to read */
+    BIO *in;
+    dtls_send_func_t send;
+    void *cls;
+    char peer_fingerprint[DTLS_FINGERPRINT_SIZE];
+    int state;
+};
+
+static void
+dtls_format_fingerprint(X509 *certificate, char *out)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int digest_len = 0;
+
+    out[0] = '\0';
+    if (!X509_digest(certificate, EVP_sha256(), digest, &digest_len)) {
+        return;
+    }
+    int length = snprintf(out, DTLS_FINGERPRINT_SIZE, "sha-256 ");
+    for (unsigned int i = 0; i < digest_len && length + 3 < DTLS_FINGERPRINT_SIZE; i++) {
+        length += snprintf(out + length, DTLS_FINGERPRINT_SIZE - length, i ? ":%02X" : "%02X", digest[i]);
+    }
+}
+
+/* The outgoing side of a session, every write of OpenSSL is one datagram */
+static int
+dtls_bio_write(BIO *bio, const char *data, int len)
+{
+    dtls_session_t *session = BIO_get_data(bio);
+    session->send(session->cls, (const unsigned char *) data, len);
+    return len;
+}
+
+static long
+dtls_bio_ctrl(BIO *bio, int cmd, long num, void *ptr)
+{
+    switch (cmd) {
+        case BIO_CTRL_FLUSH:
+            return 1;
+        case BIO_CTRL_DGRAM_QUERY_MTU:
+            return DTLS_MTU;
+        default:
+            return 0;
+    }
+}
+
+static int
+dtls_bio_create(BIO *bio)
+{
+    BIO_set_init(bio, 1);
+    return 1;
+}
+
+/* The certificate is only checked against the fingerprint, once the handshake is done */
+static int
+dtls_verify(int preverify_ok, X509_STORE_CTX *store)
+{
+    return 1;
+}
+
+static EVP_PKEY *
+dtls_generate_key(void)
+{
+    EVP_PKEY *key = NULL;
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    if (ctx && EVP_PKEY_keygen_init(ctx) > 0 &&
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1) > 0) {
+        EVP_PKEY_keygen(ctx, &key);
+    }
+    EVP_PKEY_CTX_free(ctx);
+    return key;
+}
+
+static X509 *
+dtls_generate_certificate(EVP_PKEY *key)
+{
+    unsigned char serial[8];
+    X509 *certificate = X509_new();
+    if (!certificate) {
+        return NULL;
+    }
+    RAND_bytes(serial, sizeof(serial));
+    serial[0] &= 0x7f;
+    BIGNUM *number = BN_bin2bn(serial, sizeof(serial), NULL);
+    X509_NAME *name = X509_NAME_new();
+    int ok = number && name &&
+             X509_set_version(certificate, 2) &&
+             BN_to_ASN1_INTEGER(number, X509_get_serialNumber(certificate)) &&
+             X509_gmtime_adj(X509_getm_notBefore(certificate), -24 * 3600) &&
+             X509_gmtime_adj(X509_getm_notAfter(certificate), DTLS_CERTIFICATE_DAYS * 24 * 3600L) &&
+             X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char *) "rpiplay", -1, -1, 0) &&
+             X509_set_subject_name(certificate, name) &&
+             X509_set_issuer_name(certificate, name) &&
+             X509_set_pubkey(certificate, key) &&
+             X509_sign(certificate, key, EVP_sha256());
+    BN_free(number);
+    X509_NAME_free(name);
+    if (!ok) {
+        X509_free(certificate);
+        return NULL;
+    }
+    return certificate;
+}
+
+dtls_context_t *
+dtls_context_init(logger_t *logger)
+{
+    assert(logger);
+
+    dtls_context_t *context = calloc(1, sizeof(dtls_context_t));
+    if (!context) {
+        return NULL;
+    }
+    context->logger = logger;
+
+    EVP_PKEY *key = dtls_generate_key();
+    X509 *certificate = key ? dtls_generate_certificate(key) : NULL;
+    context->ssl_ctx = SSL_CTX_new(DTLS_server_method());
+    context->bio_method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "dtls datagram");
+    if (!certificate || !context->ssl_ctx || !context->bio_method ||
+        SSL_CTX_use_certificate(context->ssl_ctx, certificate) != 1 ||
+        SSL_CTX_use_PrivateKey(context->ssl_ctx, key) != 1 ||
+        SSL_CTX_set_tlsext_use_srtp(context->ssl_ctx, DTLS_SRTP_PROFILE) != 0) {
+        logger_log(logger, LOGGER_ERR, "dtls could not set up a certificate: %s",
+                   ERR_error_string(ERR_get_error(), NULL));
+        X509_free(certificate);
+        EVP_PKEY_free(key);
+        dtls_context_destroy(context);
+        return NULL;
+    }
+    dtls_format_fingerprint(certificate, context->fingerprint);
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+
+    SSL_CTX_set_min_proto_version(context->ssl_ctx, DTLS1_2_VERSION);
+    SSL_CTX_set_verify(context->ssl_ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, dtls_verify);
+    SSL_CTX_set_read_ahead(context->ssl_ctx, 1);
+    BIO_meth_set_write(context->bio_method, dtls_bio_write);
+    BIO_meth_set_ctrl(context->bio_method, dtls_bio_ctrl);
+    BIO_meth_set_create(context->bio_method, dtls_bio_create);
+    return context;
+}
+
+const char *
+dtls_context_get_fingerprint(dtls_context_t *context)
+{
+    assert(context);
+    return context->fingerprint;
+}
+
+void
+dtls_context_destroy(dtls_context_t *context)
+{
+    if (!context) {
+        return;
+    }
+    SSL_CTX_free(context->ssl_ctx);
+    BIO_meth_free(context->bio_method);
+    free(context);
+}
+
+dtls_session_t *
+dtls_session_init(dtls_context_t *context, const char *peer_fingerprint, dtls_send_func_t send, void *cls)
+{
+    assert(context);
+    assert(peer_fingerprint);
+    assert(send);
+
+    dtls_session_t *session = calloc(1, sizeof(dtls_session_t));
+    if (!session) {
+        return NULL;
+    }
+    session->context = context;
+    session->send = send;
+    session->cls = cls;
+    snprintf(session->peer_fingerprint, sizeof(session->peer_fingerprint), "%s", peer_fingerprint);
+
+    session->ssl = SSL_new(context->ssl_ctx);
+    session->in = BIO_new(BIO_s_mem());
+    BIO *out = BIO_new(context->bio_method);
+    if (!session->ssl || !session->in || !out) {
+        BIO_free(session->in);
+        BIO_free(out);
+        SSL_free(session->ssl);
+        free(session);
+        return NULL;
+    }
+    BIO_set_data(out, session);
+    /* Nothing to read is a retry, not the end of the stream */
+    BIO_set_mem_eof_return(session->in, -1);
+    SSL_set_bio(session->ssl, session->in, out);
+    SSL_set_options(session->ssl, SSL_OP_NO_QUERY_MTU);
+    DTLS_set_link_mtu(session->ssl, DTLS_MTU);
+    SSL_set_accept_state(session->ssl);
+    return session;
+}
+
+/* Compares the fingerprints case-insensitively, browsers write their hex either way */
+static int
+dtls_session_check_peer(dtls_session_t *session)
+{
+    char fingerprint[DTLS_FINGERPRINT_SIZE];
+    X509 *certificate = SSL_get_peer_certificate(session->ssl);
+    if (!certificate) {
+        return -1;
+    }
+    dtls_format_fingerprint(certificate, fingerprint);
+    X509_free(certificate);
+    if (strcasecmp(fingerprint, session->peer_fingerprint)) {
+        logger_log(session->context->logger, LOGGER_WARNING, "dtls peer certificate does not match its fingerprint");
+        return -1;
+    }
+    SRTP_PROTECTION_PROFILE *profile = SSL_get_selected_srtp_profile(session->ssl);
+    if (!profile || profile->id != SRTP_AES128_CM_SHA1_80) {
+        logger_log(session->context->logger, LOGGER_WARNING, "dtls peer did not agree on %s", DTLS_SRTP_PROFILE);
+        return -1;
+    }
+    return 0;
+}
+
+int
+dtls_session_receive(dtls_session_t *session, const unsigned char *data, int len)
+{
+    unsigned char discard[DTLS_MTU];
+
+    assert(session);
+
+    if (session->state == DTLS_SESSION_FAILED) {
+        return session->state;
+    }
+    BIO_write(session->in, data, len);
+    if (session->state == DTLS_SESSION_HANDSHAKE) {
+        int ret = SSL_do_handshake(session->ssl);
+        if (ret == 1) {
+            session->state = dtls_session_check_peer(session) < 0 ? DTLS_SESSION_FAILED : DTLS_SESSION_ESTABLISHED;
+        } else if (SSL_get_error(session->ssl, ret) != SSL_ERROR_WANT_READ) {
+            logger_log(session->context->logger, LOGGER_WARNING, "dtls handshake failed: %s",
+                       ERR_error_string(ERR_get_error(), NULL));
+            session->state = DTLS_SESSION_FAILED;
+        }
+    } else {
+        /* Media goes over SRTP, application data would only be alerts like close_notify */
+        while (SSL_read(session->ssl, discard, sizeof(discard)) > 0) {
+        }
+        if (SSL_get_shutdown(session->ssl) & SSL_RECEIVED_SHUTDOWN) {
+            session->state = DTLS_SESSION_FAILED;
+        }
+    }
+    ERR_clear_error();
+    return session->state;
+}
+
+int
+dtls_session_get_timeout(dtls_session_t *session)
+{
+    struct timeval timeout;
+    assert(session);
+    if (session->state != DTLS_SESSION_HANDSHAKE || !DTLSv1_get_timeout(session->ssl, &timeout)) {
+        return -1;
+    }
+    return timeout.tv_sec * 1000 + timeout.tv_usec / 1000;
+}
+
+int
+dtls_session_handle_timeout(dtls_session_t *session)
+{
+    assert(session);
+    if (session->state == DTLS_SESSION_HANDSHAKE && DTLSv1_handle_timeout(session->ssl) < 0) {
+        session->state = DTLS_SESSION_FAILED;
+    }
+    return session->state;
+}
+
+int
+dtls_session_get_srtp_keys(dtls_session_t *session, unsigned char keys[DTLS_SRTP_KEYS_SIZE])
+{
+    assert(session);
+    if (session->state != DTLS_SESSION_ESTABLISHED ||
+        SSL_export_keying_material(session->ssl, keys, DTLS_SRTP_KEYS_SIZE, DTLS_SRTP_LABEL,
+                                   strlen(DTLS_SRTP_LABEL), NULL, 0, 0) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+void
+dtls_session_destroy(dtls_session_t *session)
+{
+    if (!session) {
+        return;
+    }
+    /* Frees both BIOs */
+    SSL_free(session->ssl);
+    free(session);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef DTLS_H
+#define DTLS_H
+
+#include "logger.h"
+#include "srtp.h"
+
+/*
+ * The server side of DTLS-SRTP (RFC 5764) as WebRTC uses it, on OpenSSL. The context holds a
+ * self-signed certificate made at startup, which peers know by the fingerprint exchanged in
+ * the signaling instead of a certificate chain. A session is driven with the datagrams that
+ * arrive for it and sends its own through a callback, it never touches a socket. Once the
+ * handshake is done, the SRTP master keys are exported from it.
+ */
+
+/* "sha-256 " and 32 bytes as colon separated hex, as SDP a=fingerprint puts it */
+#define DTLS_FINGERPRINT_SIZE 104
+/* The master keys and salts of both directions, in the order of RFC 5764 4.2 */
+#define DTLS_SRTP_KEYS_SIZE (2 * (SRTP_MASTER_KEY_SIZE + SRTP_MASTER_SALT_SIZE))
+
+#define DTLS_SESSION_FAILED -1
+#define DTLS_SESSION_HANDSHAKE 0
+#define DTLS_SESSION_ESTABLISHED 1
+
+typedef struct dtls_context_s dtls_context_t;
+typedef struct dtls_session_s dtls_session_t;
+
+/* Sends one datagram of the session to the peer */
+typedef void (*dtls_send_func_t)(void *cls, const unsigned char *data, int len);
+
+dtls_context_t *dtls_context_init(logger_t *logger);
+/* The fingerprint of the certificate, like "sha-256 AB:CD:..." */
+const char *dtls_context_get_fingerprint(dtls_context_t *context);
+void dtls_context_destroy(dtls_context_t *context);
+
+/* The peer's certificate must have the fingerprint given, in the format of dtls_context_get_fingerprint */
+dtls_session_t *dtls_session_init(dtls_context_t *context, const char *peer_fingerprint,
+                                  dtls_send_func_t send, void *cls);
+/* Feeds the session a datagram from the peer, returns its DTLS_SESSION_ state after it */
+int dtls_session_receive(dtls_session_t *session, const unsigned char *data, int len);
+/* Milliseconds until dtls_session_handle_timeout is due to resend a flight, -1 if nothing waits */
+int dtls_session_get_timeout(dtls_session_t *session);
+int dtls_session_handle_timeout(dtls_session_t *session);
+/* The client's master key, the server's master key, the client's salt and the server's salt */
+int dtls_session_get_srtp_keys(dtls_session_t *session, unsigned char keys[DTLS_SRTP_KEYS_SIZE]);
+void dtls_session_destroy(dtls_session_t *session);
+
+#endif //DTLS_H
@@ -0,0 +1,355 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "event_loop.h"
+#include "reactor.h"
+
+/* Loops a role may start, more cores than this share them */
+#define EVENT_LOOP_MAX_LOOPS 16
+/* Sockets a loop reports ready per wait, the rest are reported by the next one */
+#define EVENT_LOOP_MAX_READY 32
+
+typedef struct event_loop_s event_loop_t;
+
+struct event_source_s {
+    event_loop_t *loop;
+    event_callback_t callback;
+    void *cls;
+
+    /* Only touched with the loop's mutex held */
+    int fds[EVENT_SOURCE_MAX_FDS];
+    int registered[EVENT_SOURCE_MAX_FDS]; // Whether the loop added the fd to its reactor yet
+    int fd_count;
+    uint64_t deadline; // Monotonic micro seconds, 0 without a timer
+    int pending; // Woken up
+    int removed; // Waits for the loop to drop it
+    unsigned int round; // Last dispatch round the source was called back in
+    event_source_t *next;
+};
+
+/*
+ * Sockets are only added to and removed from the reactor by the loop's own thread, between two
+ * waits, as the select() reactor cannot change its set while another thread waits on it.
+ */
+struct event_loop_s {
+    logger_t *logger;
+    reactor_t *reactor;
+    thread_handle_t thread;
+
+    mutex_handle_t mutex;
+    /* Broadcast once a callback returned and once removed sources are dropped */
+    cond_handle_t cond;
+    event_source_t *sources;
+    int source_count;
+    event_source_t *dispatching;
+    int changed; // Sources were added or removed since the last wait
+    unsigned int round;
+};
+
+typedef struct event_loop_pool_s {
+    event_loop_t *loops[EVENT_LOOP_MAX_LOOPS];
+    int loop_count;
+} event_loop_pool_t;
+
+/* Loops live as long as the process, an idle one only costs its thread's stack */
+static pthread_mutex_t event_loop_pools_mutex = PTHREAD_MUTEX_INITIALIZER;
+static event_loop_pool_t event_loop_pools[THREAD_ROLE_COUNT];
+
+static uint64_t
+event_loop_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Brings the reactor in line with the sources, with the mutex held */
+static void
+event_loop_apply_changes(event_loop_t *loop)
+{
+    event_source_t **link = &loop->sources;
+    while (*link) {
+        event_source_t *source = *link;
+        if (source->removed) {
+            for (int i = 0; i < source->fd_count; i++) {
+                if (source->registered[i]) {
+                    reactor_remove(loop->reactor, source->fds[i]);
+                }
+            }
+            *link = source->next;
+            source->loop = NULL;
+            loop->source_count--;
+            continue;
+        }
+        for (int i = 0; i < source->fd_count; i++) {
+            if (!source->registered[i] && reactor_add(loop->reactor, source->fds[i]) == 0) {
+                source->registered[i] = 1;
+            }
+        }
+        link = &source->next;
+    }
+    loop->changed = 0;
+    COND_BROADCAST(loop->cond);
+}
+
+/* The next source due in this round, with the mutex held, and the fds to call it back with */
+static event_source_t *
+event_loop_next_due(event_loop_t *loop, const int *ready, int nready, uint64_t now, int *fds, int *fd_count,
+                    int *expired)
+{
+    for (event_source_t *source = loop->sources; source; source = source->next) {
+        if (source->removed || source->round == loop->round) {
+            continue;
+        }
+        *fd_count = 0;
+        for (int i = 0; i < source->fd_count; i++) {
+            if (source->registered[i] && reactor_is_ready(ready, nready, source->fds[i])) {
+                fds[(*fd_count)++] = source->fds[i];
+            }
+        }
+        *expired = source->pending || (source->deadline && source->deadline <= now);
+        if (!*fd_count && !*expired) {
+            continue;
+        }
+        source->round = loop->round;
+        source->pending = 0;
+        if (source->deadline && source->deadline <= now) {
+            source->deadline = 0;
+        }
+        return source;
+    }
+    return NULL;
+}
+
+static THREAD_RETVAL
+event_loop_thread(void *arg)
+{
+    event_loop_t *loop = arg;
+    int ready[EVENT_LOOP_MAX_READY];
+
+    while (1) {
+        MUTEX_LOCK(loop->mutex);
+        if (loop->changed) {
+            event_loop_apply_changes(loop);
+        }
+        int timeout_ms = -1;
+        uint64_t now = event_loop_now();
+        for (event_source_t *source = loop->sources; source; source = source->next) {
+            if (source->pending) {
+                timeout_ms = 0;
+            } else if (source->deadline) {
+                // Rounded up, so the timer is never early
+                int64_t left = source->deadline > now ? (int64_t) ((source->deadline - now + 999) / 1000) : 0;
+                if (timeout_ms < 0 || left < timeout_ms) {
+                    timeout_ms = (int) left;
+                }
+            }
+        }
+        MUTEX_UNLOCK(loop->mutex);
+
+        int nready = reactor_wait(loop->reactor, ready, EVENT_LOOP_MAX_READY, timeout_ms);
+        if (nready < 0) {
+            logger_log(loop->logger, LOGGER_ERR, "event_loop error in reactor wait");
+            nready = 0;
+            sleepms(10);
+        }
+
+        MUTEX_LOCK(loop->mutex);
+        now = event_loop_now();
+        loop->round++;
+        event_source_t *source;
+        int fds[EVENT_SOURCE_MAX_FDS];
+        int fd_count;
+        int expired;
+        while ((source = event_loop_next_due(loop, ready, nready, now, fds, &fd_count, &expired))) {
+            loop->dispatching = source;
+            MUTEX_UNLOCK(loop->mutex);
+            for (int i = 0; i < fd_count; i++) {
+                source->callback(source->cls, fds[i]);
+            }
+            if (expired) {
+                source->callback(source->cls, -1);
+            }
+            MUTEX_LOCK(loop->mutex);
+            loop->dispatching = NULL;
+            COND_BROADCAST(loop->cond);
+        }
+        MUTEX_UNLOCK(loop->mutex);
+    }
+    return 0;
+}
+
+static event_loop_t *
+event_loop_init(logger_t *logger, thread_role_t role)
+{
+    event_loop_t *loop = calloc(1, sizeof(event_loop_t));
+    if (!loop) {
+        return NULL;
+    }
+    loop->logger = logger;
+    loop->reactor = reactor_init(logger);
+    if (!loop->reactor) {
+        free(loop);
+        return NULL;
+    }
+    MUTEX_CREATE(loop->mutex);
+    COND_CREATE(loop->cond);
+    THREAD_CREATE(loop->thread, event_loop_thread, loop);
+    if (!loop->thread) {
+        logger_log(logger, LOGGER_ERR, "event_loop could not start a %s thread", thread_role_name(role));
+        COND_DESTROY(loop->cond);
+        MUTEX_DESTROY(loop->mutex);
+        reactor_destroy(loop->reactor);
+        free(loop);
+        return NULL;
+    }
+    if (thread_apply_role(loop->thread, role) < 0) {
+        logger_log(logger, LOGGER_WARNING, "Could not apply the scheduling settings of the %s thread",
+                   thread_role_name(role));
+    }
+    return loop;
+}
+
+/* The loop with the fewest sources, or a new one while the role has fewer than one per core */
+static event_loop_t *
+event_loop_pick(logger_t *logger, thread_role_t role)
+{
+    event_loop_pool_t *pool = &event_loop_pools[role];
+    event_loop_t *best = NULL;
+    int best_count = 0;
+
+    pthread_mutex_lock(&event_loop_pools_mutex);
+    for (int i = 0; i < pool->loop_count; i++) {
+        MUTEX_LOCK(pool->loops[i]->mutex);
+        int count = pool->loops[i]->source_count;
+        MUTEX_UNLOCK(pool->loops[i]->mutex);
+        if (!best || count < best_count) {
+            best = pool->loops[i];
+            best_count = count;
+        }
+    }
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) {
+        cores = 1;
+    }
+    if ((!best || best_count > 0) && pool->loop_count < EVENT_LOOP_MAX_LOOPS && pool->loop_count < cores) {
+        event_loop_t *loop = event_loop_init(logger, role);
+        if (loop) {
+            pool->loops[pool->loop_count++] = loop;
+            best = loop;
+        }
+    }
+    pthread_mutex_unlock(&event_loop_pools_mutex);
+    return best;
+}
+
+event_source_t *
+event_source_init(logger_t *logger, thread_role_t role, event_callback_t callback, void *cls)
+{
+    assert(role >= 0 && role < THREAD_ROLE_COUNT);
+    assert(callback);
+
+    event_loop_t *loop = event_loop_pick(logger, role);
+    if (!loop) {
+        return NULL;
+    }
+    event_source_t *source = calloc(1, sizeof(event_source_t));
+    if (!source) {
+        return NULL;
+    }
+    source->loop = loop;
+    source->callback = callback;
+    source->cls = cls;
+
+    MUTEX_LOCK(loop->mutex);
+    source->next = loop->sources;
+    loop->sources = source;
+    loop->source_count++;
+    MUTEX_UNLOCK(loop->mutex);
+    return source;
+}
+
+void
+event_source_destroy(event_source_t *source)
+{
+    if (!source) {
+        return;
+    }
+    event_loop_t *loop = source->loop;
+    MUTEX_LOCK(loop->mutex);
+    assert(loop->dispatching != source || !pthread_equal(pthread_self(), loop->thread));
+    source->removed = 1;
+    loop->changed = 1;
+    reactor_wakeup(loop->reactor);
+    // Dropped by the loop once no callback of it runs any more, with its sockets out of the reactor
+    while (source->loop) {
+        COND_WAIT(loop->cond, loop->mutex);
+    }
+    MUTEX_UNLOCK(loop->mutex);
+    free(source);
+}
+
+int
+event_source_add_fd(event_source_t *source, int fd)
+{
+    event_loop_t *loop = source->loop;
+    assert(fd >= 0);
+
+    MUTEX_LOCK(loop->mutex);
+    if (source->fd_count == EVENT_SOURCE_MAX_FDS) {
+        MUTEX_UNLOCK(loop->mutex);
+        return -1;
+    }
+    source->fds[source->fd_count] = fd;
+    source->registered[source->fd_count] = 0;
+    source->fd_count++;
+    loop->changed = 1;
+    MUTEX_UNLOCK(loop->mutex);
+    reactor_wakeup(loop->reactor);
+    return 0;
+}
+
+void
+event_source_set_timer(event_source_t *source, int timeout_ms)
+{
+    event_loop_t *loop = source->loop;
+    uint64_t deadline = timeout_ms < 0 ? 0 : event_loop_now() + (uint64_t) timeout_ms * 1000;
+
+    MUTEX_LOCK(loop->mutex);
+    source->deadline = deadline;
+    MUTEX_UNLOCK(loop->mutex);
+    // The loop's own thread computes its next timeout before waiting again anyway
+    if (!pthread_equal(pthread_self(), loop->thread)) {
+        reactor_wakeup(loop->reactor);
+    }
+}
+
+void
+event_source_wakeup(event_source_t *source)
+{
+    event_loop_t *loop = source->loop;
+
+    MUTEX_LOCK(loop->mutex);
+    source->pending = 1;
+    MUTEX_UNLOCK(loop->mutex);
+    if (!pthread_equal(pthread_self(), loop->thread)) {
+        reactor_wakeup(loop->reactor);
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "logger.h"
+#include "threads.h"
+
+/*
+ * Threads shared by the sockets and timers of every session, instead of each session running
+ * I/O threads of its own that sleep most of the time. An event source is a socket or two and a
+ * timer of one session, served by one of the event loops of its thread role: a thread with a
+ * reactor, which keeps that role's name and scheduling. A role starts a loop for each source up
+ * to one loop per core, then sources share the loop with the fewest, so the number of threads
+ * stops growing with the number of sessions.
+ *
+ * The callback of a source runs on its loop's thread and never concurrently with itself. It
+ * holds up every other source of the loop while it runs, so it must not block: anything slow,
+ * like decoding, goes to a thread of its own.
+ */
+
+typedef struct event_source_s event_source_t;
+
+/* fd is the socket that became readable, or -1 when the timer expired or after a wakeup */
+typedef void (*event_callback_t)(void *cls, int fd);
+
+event_source_t *event_source_init(logger_t *logger, thread_role_t role, event_callback_t callback, void *cls);
+/**
+ * Unregisters the source, once it returns the callback neither runs nor will run again and the
+ * sockets may be closed. Must not be called from a callback, which would wait on its own loop.
+ */
+void event_source_destroy(event_source_t *source);
+
+/* Watches the socket for reading, at most EVENT_SOURCE_MAX_FDS per source, returns -1 if full */
+#define EVENT_SOURCE_MAX_FDS 4
+int event_source_add_fd(event_source_t *source, int fd);
+
+/* Calls back with -1 in timeout_ms, replacing the previous timer, -1 cancels it. Any thread. */
+void event_source_set_timer(event_source_t *source, int timeout_ms);
+/* Calls back with -1 as soon as the loop gets to it, from any thread */
+void event_source_wakeup(event_source_t *source);
+
+#endif //EVENT_LOOP_H
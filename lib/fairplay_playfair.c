@@ -3,8 +3,12 @@
 #include <assert.h>
 
 #include "fairplay.h"
+#include "threads.h"
 #include "playfair/playfair.h"
 
+/* Key schedules remembered across connections, a few senders reconnecting in turn */
+#define FAIRPLAY_CACHE_SIZE 4
+
 char reply_message[4][142] = {{0x46,0x50,0x4c,0x59,0x03,0x01,0x02,0x00,0x00,0x00,0x00,0x82,0x02,0x00,0x0f,0x9f,0x3f,0x9e,0x0a,0x25,0x21,0xdb,0xdf,0x31,0x2a,0xb2,0xbf,0xb2,0x9e,0x8d,0x23,0x2b,0x63,0x76,0xa8,0xc8,0x18,0x70,0x1d,0x22,0xae,0x93,0xd8,0x27,0x37,0xfe,0xaf,0x9d,0xb4,0xfd,0xf4,0x1c,0x2d,0xba,0x9d,0x1f,0x49,0xca,0xaa,0xbf,0x65,0x91,0xac,0x1f,0x7b,0xc6,0xf7,0xe0,0x66,0x3d,0x21,0xaf,0xe0,0x15,0x65,0x95,0x3e,0xab,0x81,0xf4,0x18,0xce,0xed,0x09,0x5a,0xdb,0x7c,0x3d,0x0e,0x25,0x49,0x09,0xa7,0x98,0x31,0xd4,0x9c,0x39,0x82,0x97,0x34,0x34,0xfa,0xcb,0x42,0xc6,0x3a,0x1c,0xd9,0x11,0xa6,0xfe,0x94,0x1a,0x8a,0x6d,0x4a,0x74,0x3b,0x46,0xc3,0xa7,0x64,0x9e,0x44,0xc7,0x89,0x55,0xe4,0x9d,0x81,0x55,0x00,0x95,0x49,0xc4,0xe2,0xf7,0xa3,0xf6,0xd5,0xba},
                               {0x46,0x50,0x4c,0x59,0x03,0x01,0x02,0x00,0x00,0x00,0x00,0x82,0x02,0x01,0xcf,0x32,0xa2,0x57,0x14,0xb2,0x52,0x4f,0x8a,0xa0,0xad,0x7a,0xf1,0x64,0xe3,0x7b,0xcf,0x44,0x24,0xe2,0x00,0x04,0x7e,0xfc,0x0a,0xd6,0x7a,0xfc,0xd9,0x5d,0xed,0x1c,0x27,0x30,0xbb,0x59,0x1b,0x96,0x2e,0xd6,0x3a,0x9c,0x4d,0xed,0x88,0xba,0x8f,0xc7,0x8d,0xe6,0x4d,0x91,0xcc,0xfd,0x5c,0x7b,0x56,0xda,0x88,0xe3,0x1f,0x5c,0xce,0xaf,0xc7,0x43,0x19,0x95,0xa0,0x16,0x65,0xa5,0x4e,0x19,0x39,0xd2,0x5b,0x94,0xdb,0x64,0xb9,0xe4,0x5d,0x8d,0x06,0x3e,0x1e,0x6a,0xf0,0x7e,0x96,0x56,0x16,0x2b,0x0e,0xfa,0x40,0x42,0x75,0xea,0x5a,0x44,0xd9,0x59,0x1c,0x72,0x56,0xb9,0xfb,0xe6,0x51,0x38,0x98,0xb8,0x02,0x27,0x72,0x19,0x88,0x57,0x16,0x50,0x94,0x2a,0xd9,0x46,0x68,0x8a},
                               {0x46,0x50,0x4c,0x59,0x03,0x01,0x02,0x00,0x00,0x00,0x00,0x82,0x02,0x02,0xc1,0x69,0xa3,0x52,0xee,0xed,0x35,0xb1,0x8c,0xdd,0x9c,0x58,0xd6,0x4f,0x16,0xc1,0x51,0x9a,0x89,0xeb,0x53,0x17,0xbd,0x0d,0x43,0x36,0xcd,0x68,0xf6,0x38,0xff,0x9d,0x01,0x6a,0x5b,0x52,0xb7,0xfa,0x92,0x16,0xb2,0xb6,0x54,0x82,0xc7,0x84,0x44,0x11,0x81,0x21,0xa2,0xc7,0xfe,0xd8,0x3d,0xb7,0x11,0x9e,0x91,0x82,0xaa,0xd7,0xd1,0x8c,0x70,0x63,0xe2,0xa4,0x57,0x55,0x59,0x10,0xaf,0x9e,0x0e,0xfc,0x76,0x34,0x7d,0x16,0x40,0x43,0x80,0x7f,0x58,0x1e,0xe4,0xfb,0xe4,0x2c,0xa9,0xde,0xdc,0x1b,0x5e,0xb2,0xa3,0xaa,0x3d,0x2e,0xcd,0x59,0xe7,0xee,0xe7,0x0b,0x36,0x29,0xf2,0x2a,0xfd,0x16,0x1d,0x87,0x73,0x53,0xdd,0xb9,0x9a,0xdc,0x8e,0x07,0x00,0x6e,0x56,0xf8,0x50,0xce},
@@ -17,8 +21,65 @@ struct fairplay_s {
 
     unsigned char keymsg[164];
     unsigned int keymsglen;
+
+    /*
+     * Decrypting a key starts with deriving the SAP session key and its key schedule from keymsg,
+     * which is the expensive part. The audio and mirror SETUP both decrypt with the same keymsg,
+     * so the schedule is kept until the next handshake.
+     */
+    uint32_t key_schedule[11][4];
+    int key_schedule_valid;
 };
 
+/*
+ * Senders that reconnect may repeat the handshake with the same keymsg, so the last few schedules
+ * are also kept for all connections, evicting the one unused for longest.
+ */
+typedef struct fairplay_cache_entry_s {
+    unsigned char keymsg[164];
+    uint32_t key_schedule[11][4];
+    unsigned int last_used;
+    int valid;
+} fairplay_cache_entry_t;
+
+static fairplay_cache_entry_t fairplay_cache[FAIRPLAY_CACHE_SIZE];
+static unsigned int fairplay_cache_clock;
+static mutex_handle_t fairplay_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+fairplay_get_key_schedule(const unsigned char keymsg[164], uint32_t key_schedule[11][4])
+{
+    fairplay_cache_entry_t *oldest = &fairplay_cache[0];
+    int i;
+
+    MUTEX_LOCK(fairplay_cache_mutex);
+    for (i = 0; i < FAIRPLAY_CACHE_SIZE; i++) {
+        fairplay_cache_entry_t *entry = &fairplay_cache[i];
+        if (entry->valid && !memcmp(entry->keymsg, keymsg, 164)) {
+            entry->last_used = ++fairplay_cache_clock;
+            memcpy(key_schedule, entry->key_schedule, sizeof(entry->key_schedule));
+            MUTEX_UNLOCK(fairplay_cache_mutex);
+            return;
+        }
+        if (!entry->valid || entry->last_used < oldest->last_used) {
+            oldest = entry;
+        }
+    }
+    MUTEX_UNLOCK(fairplay_cache_mutex);
+
+    /* Not holding the lock for this, two connections may both compute the same schedule */
+    unsigned char message[164];
+    memcpy(message, keymsg, sizeof(message));
+    playfair_key_schedule(message, key_schedule);
+
+    MUTEX_LOCK(fairplay_cache_mutex);
+    memcpy(oldest->keymsg, keymsg, 164);
+    memcpy(oldest->key_schedule, key_schedule, sizeof(oldest->key_schedule));
+    oldest->last_used = ++fairplay_cache_clock;
+    oldest->valid = 1;
+    MUTEX_UNLOCK(fairplay_cache_mutex);
+}
+
 fairplay_t *
 fairplay_init(logger_t *logger)
 {
@@ -61,6 +122,9 @@ fairplay_handshake(fairplay_t *fp, const unsigned char req[164], unsigned char r
         return -1;
     }
 
+    if (fp->keymsglen != 164 || memcmp(fp->keymsg, req, 164)) {
+        fp->key_schedule_valid = 0;
+    }
     memcpy(fp->keymsg, req, 164);
     fp->keymsglen = 164;
 
@@ -76,7 +140,11 @@ fairplay_decrypt(fairplay_t *fp, const unsigned char input[72], unsigned char ou
         return -1;
     }
 
-    playfair_decrypt(fp->keymsg, (unsigned char *) input, output);
+    if (!fp->key_schedule_valid) {
+        fairplay_get_key_schedule(fp->keymsg, fp->key_schedule);
+        fp->key_schedule_valid = 1;
+    }
+    playfair_decrypt_scheduled(fp->key_schedule, (unsigned char *) input, output);
     return 0;
 }
 
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "flight_recorder.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "media_clock.h"
+#include "metrics.h"
+#include "threads.h"
+
+/* A mirror at 60 fps with its audio records about a thousand events a second, this holds 16 s */
+#define FLIGHT_RECORDER_SIZE 16384
+/* Least time between two dumps a stall asked for */
+#define FLIGHT_RECORDER_TRIGGER_INTERVAL 60000000
+
+typedef struct flight_recorder_entry_s {
+    /* Number of the event plus one once it is complete, 0 while it is being written */
+    uint32_t seq;
+    uint16_t event;
+    uint64_t time;
+    int64_t values[3];
+} flight_recorder_entry_t;
+
+typedef struct flight_recorder_s {
+    /* Number of the next event, wraps around harmlessly as the ring size divides 2^32 */
+    uint32_t head;
+    flight_recorder_entry_t ring[FLIGHT_RECORDER_SIZE];
+
+    /* Reason of the dump asked for, requested ones are not rate limited */
+    const char *triggered;
+    const char *requested;
+    /* Only touched by the thread calling flight_recorder_dump_pending */
+    uint64_t last_triggered_dump;
+} flight_recorder_t;
+
+static flight_recorder_t flight;
+
+#define FLIGHT_RECORDER_EVENT(name, description) #name,
+static const char *const flight_recorder_event_names[FLIGHT_RECORDER_EVENT_COUNT] = {
+    FLIGHT_RECORDER_EVENTS(FLIGHT_RECORDER_EVENT)
+};
+#undef FLIGHT_RECORDER_EVENT
+
+#define FLIGHT_RECORDER_EVENT(name, description) description,
+static const char *const flight_recorder_event_descriptions[FLIGHT_RECORDER_EVENT_COUNT] = {
+    FLIGHT_RECORDER_EVENTS(FLIGHT_RECORDER_EVENT)
+};
+#undef FLIGHT_RECORDER_EVENT
+
+void
+flight_recorder_record(flight_recorder_event_t event, int64_t a, int64_t b, int64_t c)
+{
+    uint32_t seq = ATOMIC_FETCH_ADD(flight.head, 1);
+    flight_recorder_entry_t *entry = &flight.ring[seq % FLIGHT_RECORDER_SIZE];
+
+    /* A seqlock of one writer per slot: a dump copying it meanwhile sees the number change */
+    ATOMIC_STORE(entry->seq, 0);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    entry->event = event;
+    entry->time = media_clock_now();
+    entry->values[0] = a;
+    entry->values[1] = b;
+    entry->values[2] = c;
+    ATOMIC_STORE(entry->seq, seq + 1);
+}
+
+void
+flight_recorder_trigger(const char *reason)
+{
+    flight_recorder_record(FLIGHT_RECORDER_EVENT_trigger, (int64_t) (intptr_t) reason, 0, 0);
+    ATOMIC_STORE(flight.triggered, reason);
+}
+
+/* Copies the complete events out of the ring oldest first, returns how many */
+static int
+flight_recorder_snapshot(flight_recorder_entry_t *entries)
+{
+    uint32_t head = ATOMIC_LOAD(flight.head);
+    int count = 0;
+    for (uint32_t i = 0; i < FLIGHT_RECORDER_SIZE; i++) {
+        uint32_t seq = head - FLIGHT_RECORDER_SIZE + i;
+        flight_recorder_entry_t *entry = &flight.ring[seq % FLIGHT_RECORDER_SIZE];
+        uint32_t before = ATOMIC_LOAD(entry->seq);
+        entries[count] = *entry;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t after = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+        /* Left out: not written yet, still being written, or overwritten by a newer event */
+        if (before == seq + 1 && after == before && entries[count].event < FLIGHT_RECORDER_EVENT_COUNT) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int
+flight_recorder_dump(const char *path, const char *reason)
+{
+    flight_recorder_entry_t *entries = malloc(sizeof(flight_recorder_entry_t) * FLIGHT_RECORDER_SIZE);
+    if (!entries) {
+        errno = ENOMEM;
+        return -1;
+    }
+    /* Taken before the file is opened, so the disk does not push the events out */
+    uint64_t now = media_clock_now();
+    int count = flight_recorder_snapshot(entries);
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        int error = errno;
+        free(entries);
+        errno = error;
+        return -1;
+    }
+    char wall[64];
+    time_t wall_time = time(NULL);
+    struct tm tm;
+    strftime(wall, sizeof(wall), "%Y-%m-%d %H:%M:%S %z", localtime_r(&wall_time, &tm));
+    fprintf(file, "# rpiplay flight recorder, dumped at %s for %s\n", wall, reason);
+    fprintf(file, "# media clock at the dump: %llu us, %d events since %.3f s before\n",
+            (unsigned long long) now, count, count ? (double) (now - entries[0].time) / 1000000 : 0.0);
+    fprintf(file, "# columns: media clock time in us, event, its values:\n");
+    for (int i = 0; i < FLIGHT_RECORDER_EVENT_COUNT; i++) {
+        fprintf(file, "#   %-22s %s\n", flight_recorder_event_names[i], flight_recorder_event_descriptions[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        const flight_recorder_entry_t *entry = &entries[i];
+        const int64_t *values = entry->values;
+        fprintf(file, "%llu %s", (unsigned long long) entry->time, flight_recorder_event_names[entry->event]);
+        switch (entry->event) {
+            case FLIGHT_RECORDER_EVENT_gauge:
+                fprintf(file, " %s %lld\n", metrics_get_name((metric_t) values[0]), (long long) values[1]);
+                break;
+            case FLIGHT_RECORDER_EVENT_trigger:
+                fprintf(file, " %s\n", (const char *) (intptr_t) values[0]);
+                break;
+            default:
+                fprintf(file, " %lld %lld %lld\n", (long long) values[0], (long long) values[1], (long long) values[2]);
+                break;
+        }
+    }
+    free(entries);
+
+    int error = ferror(file) ? EIO : 0;
+    if (fclose(file) != 0 && !error) {
+        error = errno;
+    }
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+void
+flight_recorder_dump_pending(const char *directory, logger_t *logger)
+{
+    const char *reason = ATOMIC_EXCHANGE(flight.requested, (const char *) NULL);
+    const char *triggered = ATOMIC_EXCHANGE(flight.triggered, (const char *) NULL);
+    if (!reason && triggered) {
+        uint64_t now = media_clock_now();
+        if (flight.last_triggered_dump && now - flight.last_triggered_dump < FLIGHT_RECORDER_TRIGGER_INTERVAL) {
+            logger_log(logger, LOGGER_DEBUG, "Flight recorder not dumped for %s, the last dump was too recent", triggered);
+            return;
+        }
+        flight.last_triggered_dump = now;
+        reason = triggered;
+    }
+    if (!reason) {
+        return;
+    }
+
+    char name[64];
+    time_t wall_time = time(NULL);
+    struct tm tm;
+    strftime(name, sizeof(name), "rpiplay-flight-%Y%m%d-%H%M%S.txt", localtime_r(&wall_time, &tm));
+    size_t path_len = strlen(directory) + 1 + strlen(name) + 1;
+    char *path = malloc(path_len);
+    if (!path) {
+        return;
+    }
+    snprintf(path, path_len, "%s/%s", directory, name);
+    if (flight_recorder_dump(path, reason) < 0) {
+        logger_log(logger, LOGGER_ERR, "Could not write the flight recorder to %s: %s", path, strerror(errno));
+    } else {
+        logger_log(logger, LOGGER_INFO, "Flight recorder of the last seconds written to %s for %s", path, reason);
+    }
+    free(path);
+}
+
+void
+flight_recorder_request(const char *reason)
+{
+    flight_recorder_record(FLIGHT_RECORDER_EVENT_trigger, (int64_t) (intptr_t) reason, 0, 0);
+    ATOMIC_STORE(flight.requested, reason);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdint.h>
+
+#include "logger.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Always-on memory of the last seconds of per frame and per packet timings, for finding out
+ * after the fact why a mirror stuttered. Every probe of probes.h, every gauge set with
+ * metrics_set and the decode and display times of frame_stages.h go into a fixed ring in
+ * memory, at the cost of a few stores; nothing is written anywhere until a stall triggers a
+ * dump or one is asked for, then the ring goes into a text file as it was, one event a line.
+ *
+ * Writers on any thread claim a slot with one atomic add and never wait. A dump that reads a
+ * slot being overwritten leaves it out.
+ */
+
+/* Name and the meaning of its three values, all times in micro seconds on media_clock_now */
+#define FLIGHT_RECORDER_EVENTS(X) \
+    X(mirror_frame_receive, "pts, payload bytes, arrival time") \
+    X(mirror_decrypt_done, "pts, payload bytes, time") \
+    X(mirror_rewrite_done, "pts, frame bytes, NAL units") \
+    X(mirror_render_submit, "pts, frame bytes, time spent queued") \
+    X(audio_enqueue, "seqnum, payload bytes, play time") \
+    X(audio_dequeue, "seqnum, payload bytes or -1 if lost, play time") \
+    X(audio_resend_request, "first seqnum, count") \
+    X(audio_sync, "rtp time, remote time, local time") \
+    X(ntp_sample, "local time, offset, round trip delay") \
+    X(omx_video_submit, "pts, bytes, OMX flags") \
+    X(omx_video_return, "input buffers owned by the client") \
+    X(omx_audio_submit, "pts, bytes") \
+    X(omx_audio_return, "pts of the batch the buffer starts") \
+    X(frame_decoded, "pts, time spent in the decoder") \
+    X(frame_presented, "pts, time from decoder to display") \
+    X(gauge, "metric, value") \
+    X(trigger, "what asked for the dump")
+
+#define FLIGHT_RECORDER_EVENT(name, description) FLIGHT_RECORDER_EVENT_##name,
+typedef enum flight_recorder_event_e {
+    FLIGHT_RECORDER_EVENTS(FLIGHT_RECORDER_EVENT)
+    FLIGHT_RECORDER_EVENT_COUNT
+} flight_recorder_event_t;
+#undef FLIGHT_RECORDER_EVENT
+
+/* Safe from any thread, stamps the event with the current time */
+void flight_recorder_record(flight_recorder_event_t event, int64_t a, int64_t b, int64_t c);
+
+/*
+ * Asks for a dump at the next flight_recorder_dump_pending, for stall detectors on the media
+ * threads. reason must be a string constant. Dumps asked for this way are at least a minute
+ * apart, a decoder that keeps stalling writes one file and not one a second.
+ */
+void flight_recorder_trigger(const char *reason);
+/* Asks for a dump like flight_recorder_trigger but without the rate limit, safe in a signal handler */
+void flight_recorder_request(const char *reason);
+
+/* Writes the ring into path, returns 0 on success and -1 with errno set otherwise */
+int flight_recorder_dump(const char *path, const char *reason);
+
+/*
+ * Writes the dump asked for with flight_recorder_trigger or _request, if any, into a file
+ * named after the time in directory and logs its name. Called periodically from a thread
+ * that may block on the disk, not a media one.
+ */
+void flight_recorder_dump_pending(const char *directory, logger_t *logger);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FLIGHT_RECORDER_H
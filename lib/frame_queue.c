@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "frame_queue.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+#include "threads.h"
+
+struct frame_queue_s {
+    logger_t *logger;
+
+    h264_decode_struct *frames;
+    int depth;
+
+    // Written by the producer only, frames before tail are ready
+    atomic_uint tail;
+    // Written by the consumer only, frames before head are handled
+    atomic_uint head;
+    atomic_int stopped;
+    atomic_int high_watermark;
+    // Threads sleeping on wait_cond
+    atomic_int waiters;
+
+    mutex_handle_t wait_mutex;
+    cond_handle_t wait_cond;
+};
+
+frame_queue_t *
+frame_queue_init(logger_t *logger, int depth)
+{
+    frame_queue_t *queue;
+
+    assert(depth > 0);
+
+    queue = calloc(1, sizeof(frame_queue_t));
+    if (!queue) {
+        return NULL;
+    }
+    queue->frames = calloc(depth, sizeof(h264_decode_struct));
+    if (!queue->frames) {
+        free(queue);
+        return NULL;
+    }
+    queue->logger = logger;
+    queue->depth = depth;
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->stopped, 0);
+    atomic_init(&queue->high_watermark, 0);
+    atomic_init(&queue->waiters, 0);
+    MUTEX_CREATE(queue->wait_mutex);
+    COND_CREATE(queue->wait_cond);
+    return queue;
+}
+
+void
+frame_queue_destroy(frame_queue_t *queue)
+{
+    if (queue) {
+        MUTEX_DESTROY(queue->wait_mutex);
+        COND_DESTROY(queue->wait_cond);
+        free(queue->frames);
+        free(queue);
+    }
+}
+
+static void
+frame_queue_notify(frame_queue_t *queue)
+{
+    // Either the waiter sees the index update or we see the waiter, both are sequentially consistent
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&queue->waiters) > 0) {
+        MUTEX_LOCK(queue->wait_mutex);
+        COND_BROADCAST(queue->wait_cond);
+        MUTEX_UNLOCK(queue->wait_mutex);
+    }
+}
+
+int
+frame_queue_push(frame_queue_t *queue, const h264_decode_struct *frame)
+{
+    assert(queue);
+    assert(frame);
+
+    unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&queue->head, memory_order_acquire) >= (unsigned int) queue->depth) {
+        MUTEX_LOCK(queue->wait_mutex);
+        atomic_fetch_add(&queue->waiters, 1);
+        while (tail - atomic_load(&queue->head) >= (unsigned int) queue->depth && !atomic_load(&queue->stopped)) {
+            COND_WAIT(queue->wait_cond, queue->wait_mutex);
+        }
+        atomic_fetch_sub(&queue->waiters, 1);
+        MUTEX_UNLOCK(queue->wait_mutex);
+    }
+    if (atomic_load(&queue->stopped)) {
+        return -1;
+    }
+
+    queue->frames[tail % queue->depth] = *frame;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+    int count = (int) (tail + 1 - atomic_load_explicit(&queue->head, memory_order_relaxed));
+    if (count > atomic_load_explicit(&queue->high_watermark, memory_order_relaxed)) {
+        atomic_store_explicit(&queue->high_watermark, count, memory_order_relaxed);
+    }
+    frame_queue_notify(queue);
+    return 0;
+}
+
+int
+frame_queue_try_pop(frame_queue_t *queue, h264_decode_struct *frame)
+{
+    assert(queue);
+    assert(frame);
+
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) {
+        return -1;
+    }
+    *frame = queue->frames[head % queue->depth];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    frame_queue_notify(queue);
+    return 0;
+}
+
+int
+frame_queue_pop(frame_queue_t *queue, h264_decode_struct *frame)
+{
+    assert(queue);
+
+    unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire)) {
+        MUTEX_LOCK(queue->wait_mutex);
+        atomic_fetch_add(&queue->waiters, 1);
+        while (head == atomic_load(&queue->tail) && !atomic_load(&queue->stopped)) {
+            COND_WAIT(queue->wait_cond, queue->wait_mutex);
+        }
+        atomic_fetch_sub(&queue->waiters, 1);
+        MUTEX_UNLOCK(queue->wait_mutex);
+    }
+    if (atomic_load(&queue->stopped)) {
+        return -1;
+    }
+    return frame_queue_try_pop(queue, frame);
+}
+
+void
+frame_queue_stop(frame_queue_t *queue)
+{
+    assert(queue);
+    atomic_store(&queue->stopped, 1);
+    MUTEX_LOCK(queue->wait_mutex);
+    COND_BROADCAST(queue->wait_cond);
+    MUTEX_UNLOCK(queue->wait_mutex);
+}
+
+void
+frame_queue_start(frame_queue_t *queue)
+{
+    assert(queue);
+    atomic_store(&queue->stopped, 0);
+}
+
+int
+frame_queue_get_depth(frame_queue_t *queue)
+{
+    assert(queue);
+    return queue->depth;
+}
+
+int
+frame_queue_get_count(frame_queue_t *queue)
+{
+    assert(queue);
+    return (int) (atomic_load(&queue->tail) - atomic_load(&queue->head));
+}
+
+int
+frame_queue_get_high_watermark(frame_queue_t *queue)
+{
+    assert(queue);
+    return atomic_exchange(&queue->high_watermark, 0);
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include "logger.h"
+#include "stream.h"
+
+/*
+ * Bounded single-producer/single-consumer ring of video frames, used to hand decrypted
+ * frames from the mirror socket thread to the render thread. Only the frame descriptors
+ * are queued, the data buffers stay owned by whoever allocated them. The ring indices are
+ * atomics, the mutex is only taken to sleep on an empty or full queue.
+ */
+typedef struct frame_queue_s frame_queue_t;
+
+frame_queue_t *frame_queue_init(logger_t *logger, int depth);
+void frame_queue_destroy(frame_queue_t *queue);
+
+/* Blocks while the queue is full. Returns -1 without queueing once the queue is stopped. */
+int frame_queue_push(frame_queue_t *queue, const h264_decode_struct *frame);
+/* Blocks while the queue is empty. Returns -1 once the queue is stopped. */
+int frame_queue_pop(frame_queue_t *queue, h264_decode_struct *frame);
+/* Never blocks, returns -1 if the queue is empty */
+int frame_queue_try_pop(frame_queue_t *queue, h264_decode_struct *frame);
+
+/* Wakes up and fails all blocked and future push and pop calls until frame_queue_start */
+void frame_queue_stop(frame_queue_t *queue);
+void frame_queue_start(frame_queue_t *queue);
+
+int frame_queue_get_depth(frame_queue_t *queue);
+int frame_queue_get_count(frame_queue_t *queue);
+/* Highest number of queued frames seen since the last call */
+int frame_queue_get_high_watermark(frame_queue_t *queue);
+
+#endif //FRAME_QUEUE_H
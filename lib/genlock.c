@@ -0,0 +1,549 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "genlock.h"
+#include "threads.h"
+#include "reactor.h"
+#include "byteutils.h"
+#include "media_clock.h"
+#include "metrics.h"
+
+// The sync group's address, on a port of its own
+#define GENLOCK_ADDRESS "239.255.82.80"
+#define GENLOCK_PORT 7011
+#define GENLOCK_MAGIC "RPGL"
+#define GENLOCK_VERSION 1
+// Magic, version, type, two reserved bytes, node id, NUL padded group name, then the payload
+#define GENLOCK_NAME_OFFSET 12
+#define GENLOCK_PAYLOAD_OFFSET (GENLOCK_NAME_OFFSET + GENLOCK_MAX_NAME + 1)
+#define GENLOCK_MESSAGE_SIZE (GENLOCK_PAYLOAD_OFFSET + 28)
+
+// Leader to group: schedule offset, a vsync and the refresh period of its display, group lag, clock port
+#define GENLOCK_TYPE_ANNOUNCE 1
+// Follower to leader: its send time and how much later than the schedule it needs frames
+#define GENLOCK_TYPE_REQUEST 2
+// Leader to follower: the request's send time, its own receive and send times
+#define GENLOCK_TYPE_RESPONSE 3
+
+// All in micro seconds
+#define GENLOCK_ANNOUNCE_INTERVAL 100000
+#define GENLOCK_POLL_INTERVAL 250000
+// A leader silent for this long is gone, its followers play on their own
+#define GENLOCK_EXPIRE 3000000
+// A leader only announces a schedule its frames still follow
+#define GENLOCK_SCHEDULE_EXPIRE 1000000
+// The lag a follower reported is kept this long, unless it reports a larger one
+#define GENLOCK_LAG_WINDOW 5000000
+// The group lag moves in steps, so the jitter of the followers' lag does not move every frame
+#define GENLOCK_LAG_STEP 5000
+// Beyond anything a follower buffers, lags above it are garbage
+#define GENLOCK_MAX_LAG 500000
+#define GENLOCK_MAX_PEERS 16
+// Clock exchanges with the leader, the one of the shortest round trip holds the offset
+#define GENLOCK_CLOCK_SAMPLES 8
+
+typedef struct {
+    uint32_t id;
+    int64_t lag;
+    uint64_t lag_time;
+    uint64_t last_seen;
+} genlock_peer_t;
+
+typedef struct {
+    int64_t offset;
+    int64_t delay;
+} genlock_clock_sample_t;
+
+struct genlock_s {
+    logger_t *logger;
+    char name[GENLOCK_MAX_NAME + 1];
+    uint32_t id;
+    genlock_role_t role;
+
+    int sock;
+    // Clock requests and responses, apart from the group socket that every node on a host shares
+    int clock_sock;
+    unsigned short clock_port;
+    struct sockaddr_in group_addr;
+    reactor_t *reactor;
+    thread_handle_t thread;
+    int running;
+
+    // The schedule, between the thread and genlock_schedule
+    mutex_handle_t mutex;
+    int64_t base_offset;        // Release on the leader's clock minus pts on the sender's
+    uint64_t vsync;             // Of the leader's display, on its clock
+    uint64_t vsync_period;
+    int64_t group_lag;          // Added to every release of the group
+    uint64_t schedule_time;     // Leader: local time of the latest frame
+    uint32_t leader_id;         // Follower: 0 until one is heard
+    uint64_t leader_time;       // Follower: local time of the leader's latest announcement
+    bool clock_valid;
+    int64_t clock_offset;       // Follower: leader's clock minus ours
+    int64_t lag;                // Follower: most a frame needed since the last request
+    bool has_lag;
+
+    // Only touched by the thread
+    genlock_peer_t peers[GENLOCK_MAX_PEERS];
+    int peer_count;
+    struct sockaddr_in leader_addr;
+    genlock_clock_sample_t samples[GENLOCK_CLOCK_SAMPLES];
+    int sample_count;
+    int sample_next;
+    uint32_t rival_id;
+};
+
+static void
+genlock_message_init(genlock_t *genlock, unsigned char *message, int type)
+{
+    memset(message, 0, GENLOCK_MESSAGE_SIZE);
+    memcpy(message, GENLOCK_MAGIC, 4);
+    message[4] = GENLOCK_VERSION;
+    message[5] = type;
+    byteutils_put_int_be(message, 8, genlock->id);
+    memcpy(message + GENLOCK_NAME_OFFSET, genlock->name, strlen(genlock->name));
+}
+
+static void
+genlock_send(genlock_t *genlock, const unsigned char *message, const struct sockaddr_in *addr)
+{
+    if (sendto(genlock->sock, message, GENLOCK_MESSAGE_SIZE, 0, (const struct sockaddr *) addr, sizeof(*addr)) < 0) {
+        logger_log(genlock->logger, LOGGER_DEBUG, "genlock could not send to %s: %d", inet_ntoa(addr->sin_addr), errno);
+    }
+}
+
+static void
+genlock_announce(genlock_t *genlock, uint64_t now)
+{
+    unsigned char message[GENLOCK_MESSAGE_SIZE];
+    genlock_message_init(genlock, message, GENLOCK_TYPE_ANNOUNCE);
+    MUTEX_LOCK(genlock->mutex);
+    bool scheduled = genlock->schedule_time && now - genlock->schedule_time < GENLOCK_SCHEDULE_EXPIRE;
+    byteutils_put_long_be(message, GENLOCK_PAYLOAD_OFFSET, (uint64_t) genlock->base_offset);
+    byteutils_put_long_be(message, GENLOCK_PAYLOAD_OFFSET + 8, genlock->vsync);
+    byteutils_put_int_be(message, GENLOCK_PAYLOAD_OFFSET + 16, (uint32_t) genlock->vsync_period);
+    byteutils_put_int_be(message, GENLOCK_PAYLOAD_OFFSET + 20, (uint32_t) genlock->group_lag);
+    MUTEX_UNLOCK(genlock->mutex);
+    byteutils_put_int_be(message, GENLOCK_PAYLOAD_OFFSET + 24, genlock->clock_port);
+    if (scheduled) {
+        genlock_send(genlock, message, &genlock->group_addr);
+    }
+}
+
+static void
+genlock_request(genlock_t *genlock, uint64_t now)
+{
+    unsigned char message[GENLOCK_MESSAGE_SIZE];
+    genlock_message_init(genlock, message, GENLOCK_TYPE_REQUEST);
+    MUTEX_LOCK(genlock->mutex);
+    bool following = genlock->leader_id && now - genlock->leader_time < GENLOCK_EXPIRE;
+    int64_t lag = genlock->has_lag ? genlock->lag : 0;
+    genlock->has_lag = false;
+    MUTEX_UNLOCK(genlock->mutex);
+    if (!following) {
+        return;
+    }
+    lag = lag < 0 ? 0 : lag > GENLOCK_MAX_LAG ? GENLOCK_MAX_LAG : lag;
+    byteutils_put_long_be(message, GENLOCK_PAYLOAD_OFFSET, media_clock_now());
+    byteutils_put_int_be(message, GENLOCK_PAYLOAD_OFFSET + 8, (uint32_t) lag);
+    if (sendto(genlock->clock_sock, message, GENLOCK_MESSAGE_SIZE, 0, (const struct sockaddr *) &genlock->leader_addr,
+               sizeof(genlock->leader_addr)) < 0) {
+        logger_log(genlock->logger, LOGGER_DEBUG, "genlock could not send a clock request: %d", errno);
+    }
+}
+
+/* Leader: forgets the followers that went quiet and plays as late as the latest of those left needs */
+static void
+genlock_update_lag(genlock_t *genlock, uint64_t now)
+{
+    int64_t lag = 0;
+    for (int i = 0; i < genlock->peer_count;) {
+        genlock_peer_t *peer = &genlock->peers[i];
+        if (now - peer->last_seen > GENLOCK_EXPIRE) {
+            logger_log(genlock->logger, LOGGER_INFO, "Follower %08x left video wall %s", peer->id, genlock->name);
+            *peer = genlock->peers[--genlock->peer_count];
+            continue;
+        }
+        if (peer->lag > lag) {
+            lag = peer->lag;
+        }
+        i++;
+    }
+    lag = (lag + GENLOCK_LAG_STEP - 1) / GENLOCK_LAG_STEP * GENLOCK_LAG_STEP;
+    MUTEX_LOCK(genlock->mutex);
+    bool changed = lag != genlock->group_lag;
+    genlock->group_lag = lag;
+    MUTEX_UNLOCK(genlock->mutex);
+    if (changed) {
+        logger_log(genlock->logger, LOGGER_INFO, "Video wall %s of %d nodes plays %lld ms behind its leader's own schedule",
+                   genlock->name, genlock->peer_count + 1, (long long) lag / 1000);
+    }
+}
+
+static void
+genlock_handle_request(genlock_t *genlock, unsigned char *message, const struct sockaddr_in *from, uint64_t now)
+{
+    uint32_t id = byteutils_get_int_be(message, 8);
+    unsigned char response[GENLOCK_MESSAGE_SIZE];
+    genlock_message_init(genlock, response, GENLOCK_TYPE_RESPONSE);
+    memcpy(response + GENLOCK_PAYLOAD_OFFSET, message + GENLOCK_PAYLOAD_OFFSET, 8);
+    byteutils_put_long_be(response, GENLOCK_PAYLOAD_OFFSET + 8, now);
+    byteutils_put_int_be(response, GENLOCK_PAYLOAD_OFFSET + 24, id);
+    byteutils_put_long_be(response, GENLOCK_PAYLOAD_OFFSET + 16, media_clock_now());
+    if (sendto(genlock->clock_sock, response, GENLOCK_MESSAGE_SIZE, 0, (const struct sockaddr *) from, sizeof(*from)) < 0) {
+        logger_log(genlock->logger, LOGGER_DEBUG, "genlock could not answer a clock request: %d", errno);
+    }
+
+    int64_t lag = byteutils_get_int_be(message, GENLOCK_PAYLOAD_OFFSET + 8);
+    if (lag > GENLOCK_MAX_LAG) {
+        return;
+    }
+    int i;
+    for (i = 0; i < genlock->peer_count && genlock->peers[i].id != id; i++);
+    if (i == genlock->peer_count) {
+        if (i == GENLOCK_MAX_PEERS) {
+            return;
+        }
+        genlock->peer_count++;
+        memset(&genlock->peers[i], 0, sizeof(genlock_peer_t));
+        genlock->peers[i].id = id;
+        logger_log(genlock->logger, LOGGER_INFO, "Follower %08x at %s joined video wall %s", id,
+                   inet_ntoa(from->sin_addr), genlock->name);
+    }
+    genlock_peer_t *peer = &genlock->peers[i];
+    if (lag >= peer->lag || now - peer->lag_time > GENLOCK_LAG_WINDOW) {
+        peer->lag = lag;
+        peer->lag_time = now;
+    }
+    peer->last_seen = now;
+}
+
+static void
+genlock_handle_announce(genlock_t *genlock, unsigned char *message, const struct sockaddr_in *from, uint64_t now)
+{
+    uint32_t id = byteutils_get_int_be(message, 8);
+    if (genlock->role == GENLOCK_LEADER) {
+        if (id != genlock->rival_id) {
+            genlock->rival_id = id;
+            logger_log(genlock->logger, LOGGER_WARNING, "Node %08x at %s leads video wall %s as well, only one may",
+                       id, inet_ntoa(from->sin_addr), genlock->name);
+        }
+        return;
+    }
+    uint32_t clock_port = byteutils_get_int_be(message, GENLOCK_PAYLOAD_OFFSET + 24);
+    if (!clock_port || clock_port > 65535) {
+        return;
+    }
+    MUTEX_LOCK(genlock->mutex);
+    bool new_leader = id != genlock->leader_id;
+    if (new_leader) {
+        genlock->leader_id = id;
+        genlock->clock_valid = false;
+        genlock->sample_count = genlock->sample_next = 0;
+    }
+    genlock->leader_addr = *from;
+    genlock->leader_addr.sin_port = htons((unsigned short) clock_port);
+    genlock->base_offset = (int64_t) byteutils_get_long_be(message, GENLOCK_PAYLOAD_OFFSET);
+    genlock->vsync = byteutils_get_long_be(message, GENLOCK_PAYLOAD_OFFSET + 8);
+    genlock->vsync_period = byteutils_get_int_be(message, GENLOCK_PAYLOAD_OFFSET + 16);
+    genlock->group_lag = byteutils_get_int_be(message, GENLOCK_PAYLOAD_OFFSET + 20);
+    genlock->leader_time = now;
+    MUTEX_UNLOCK(genlock->mutex);
+    if (new_leader) {
+        logger_log(genlock->logger, LOGGER_INFO, "Following leader %08x at %s of video wall %s", id,
+                   inet_ntoa(from->sin_addr), genlock->name);
+    }
+}
+
+static void
+genlock_handle_response(genlock_t *genlock, unsigned char *message, uint64_t now)
+{
+    if (byteutils_get_int_be(message, 8) != genlock->leader_id ||
+        byteutils_get_int_be(message, GENLOCK_PAYLOAD_OFFSET + 24) != genlock->id) {
+        return;
+    }
+    uint64_t sent = byteutils_get_long_be(message, GENLOCK_PAYLOAD_OFFSET);
+    uint64_t leader_received = byteutils_get_long_be(message, GENLOCK_PAYLOAD_OFFSET + 8);
+    uint64_t leader_sent = byteutils_get_long_be(message, GENLOCK_PAYLOAD_OFFSET + 16);
+    if (sent > now || leader_sent < leader_received) {
+        return;
+    }
+    genlock_clock_sample_t *sample = &genlock->samples[genlock->sample_next];
+    sample->offset = ((int64_t) (leader_received - sent) + (int64_t) (leader_sent - now)) / 2;
+    sample->delay = (int64_t) (now - sent) - (int64_t) (leader_sent - leader_received);
+    genlock->sample_next = (genlock->sample_next + 1) % GENLOCK_CLOCK_SAMPLES;
+    if (genlock->sample_count < GENLOCK_CLOCK_SAMPLES) {
+        genlock->sample_count++;
+    }
+
+    // Queueing only ever makes a round trip longer, the shortest one is the most accurate
+    int best = 0;
+    for (int i = 1; i < genlock->sample_count; i++) {
+        if (genlock->samples[i].delay < genlock->samples[best].delay) {
+            best = i;
+        }
+    }
+    MUTEX_LOCK(genlock->mutex);
+    genlock->clock_offset = genlock->samples[best].offset;
+    genlock->clock_valid = true;
+    MUTEX_UNLOCK(genlock->mutex);
+}
+
+static void
+genlock_receive(genlock_t *genlock, int sock)
+{
+    unsigned char message[GENLOCK_MESSAGE_SIZE];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    ssize_t len;
+    while ((len = recvfrom(sock, message, sizeof(message), MSG_DONTWAIT, (struct sockaddr *) &from,
+                           &from_len)) >= 0) {
+        uint64_t now = media_clock_now();
+        from_len = sizeof(from);
+        if (len != GENLOCK_MESSAGE_SIZE || memcmp(message, GENLOCK_MAGIC, 4) || message[4] != GENLOCK_VERSION) {
+            continue;
+        }
+        message[GENLOCK_PAYLOAD_OFFSET - 1] = 0;
+        // Our own announcements loop back
+        if (byteutils_get_int_be(message, 8) == genlock->id ||
+            strcmp((const char *) message + GENLOCK_NAME_OFFSET, genlock->name)) {
+            continue;
+        }
+        if (message[5] == GENLOCK_TYPE_ANNOUNCE) {
+            genlock_handle_announce(genlock, message, &from, now);
+        } else if (message[5] == GENLOCK_TYPE_REQUEST && genlock->role == GENLOCK_LEADER) {
+            genlock_handle_request(genlock, message, &from, now);
+        } else if (message[5] == GENLOCK_TYPE_RESPONSE && genlock->role == GENLOCK_FOLLOWER) {
+            genlock_handle_response(genlock, message, now);
+        }
+    }
+}
+
+static THREAD_RETVAL
+genlock_thread(void *arg)
+{
+    genlock_t *genlock = arg;
+    int ready[2];
+    uint64_t interval = genlock->role == GENLOCK_LEADER ? GENLOCK_ANNOUNCE_INTERVAL : GENLOCK_POLL_INTERVAL;
+    uint64_t next_send = 0;
+
+    while (ATOMIC_LOAD(genlock->running)) {
+        uint64_t now = media_clock_now();
+        if (now >= next_send) {
+            if (genlock->role == GENLOCK_LEADER) {
+                genlock_update_lag(genlock, now);
+                genlock_announce(genlock, now);
+            } else {
+                genlock_request(genlock, now);
+            }
+            next_send = now + interval;
+        }
+        int nready = reactor_wait(genlock->reactor, ready, 2, (int) ((next_send - now + 999) / 1000));
+        if (nready < 0) {
+            logger_log(genlock->logger, LOGGER_ERR, "genlock error in reactor wait");
+            break;
+        }
+        if (reactor_is_ready(ready, nready, genlock->sock)) {
+            genlock_receive(genlock, genlock->sock);
+        }
+        if (reactor_is_ready(ready, nready, genlock->clock_sock)) {
+            genlock_receive(genlock, genlock->clock_sock);
+        }
+    }
+    return 0;
+}
+
+genlock_t *
+genlock_init(logger_t *logger, const char *name, genlock_role_t role)
+{
+    genlock_t *genlock;
+    struct sockaddr_in addr;
+    struct ip_mreq mreq;
+    int reuse = 1;
+
+    assert(name);
+
+    genlock = calloc(1, sizeof(genlock_t));
+    if (!genlock) {
+        return NULL;
+    }
+    genlock->logger = logger;
+    snprintf(genlock->name, sizeof(genlock->name), "%s", name);
+    genlock->role = role;
+    genlock->id = (uint32_t) getpid() * 2654435761u ^ (uint32_t) time(NULL) ^ (uint32_t) (uintptr_t) genlock;
+    if (!genlock->id) genlock->id = 1;
+    MUTEX_CREATE(genlock->mutex);
+
+    memset(&genlock->group_addr, 0, sizeof(genlock->group_addr));
+    genlock->group_addr.sin_family = AF_INET;
+    genlock->group_addr.sin_port = htons(GENLOCK_PORT);
+    inet_pton(AF_INET, GENLOCK_ADDRESS, &genlock->group_addr.sin_addr);
+
+    genlock->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (genlock->sock < 0) {
+        logger_log(logger, LOGGER_ERR, "genlock could not open a socket: %d", errno);
+        MUTEX_DESTROY(genlock->mutex);
+        free(genlock);
+        return NULL;
+    }
+    setsockopt(genlock->sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#ifdef SO_REUSEPORT
+    setsockopt(genlock->sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+#endif
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(GENLOCK_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.imr_multiaddr = genlock->group_addr.sin_addr;
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (bind(genlock->sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        setsockopt(genlock->sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        logger_log(logger, LOGGER_ERR, "genlock could not join %s port %d: %d", GENLOCK_ADDRESS, GENLOCK_PORT, errno);
+        close(genlock->sock);
+        MUTEX_DESTROY(genlock->mutex);
+        free(genlock);
+        return NULL;
+    }
+
+    // On a port of its own, the kernel would hand unicast to the group port to any node of the host
+    struct sockaddr_in clock_addr;
+    socklen_t clock_addr_len = sizeof(clock_addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    genlock->clock_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (genlock->clock_sock >= 0 && bind(genlock->clock_sock, (struct sockaddr *) &addr, sizeof(addr)) == 0 &&
+        getsockname(genlock->clock_sock, (struct sockaddr *) &clock_addr, &clock_addr_len) == 0) {
+        genlock->clock_port = ntohs(clock_addr.sin_port);
+    }
+    genlock->reactor = reactor_init(logger);
+    if (!genlock->clock_port || !genlock->reactor || reactor_add(genlock->reactor, genlock->sock) < 0 ||
+        reactor_add(genlock->reactor, genlock->clock_sock) < 0) {
+        logger_log(logger, LOGGER_ERR, "genlock could not set up its sockets: %d", errno);
+        if (genlock->reactor) reactor_destroy(genlock->reactor);
+        if (genlock->clock_sock >= 0) close(genlock->clock_sock);
+        close(genlock->sock);
+        MUTEX_DESTROY(genlock->mutex);
+        free(genlock);
+        return NULL;
+    }
+
+    ATOMIC_STORE(genlock->running, 1);
+    THREAD_CREATE(genlock->thread, genlock_thread, genlock);
+    if (!genlock->thread) {
+        reactor_destroy(genlock->reactor);
+        if (genlock->clock_sock >= 0) close(genlock->clock_sock);
+        close(genlock->sock);
+        MUTEX_DESTROY(genlock->mutex);
+        free(genlock);
+        return NULL;
+    }
+    thread_set_name(genlock->thread, "genlock");
+    logger_log(logger, LOGGER_INFO, "Joined video wall %s as its %s", genlock->name,
+               role == GENLOCK_LEADER ? "leader" : "follower");
+    return genlock;
+}
+
+void
+genlock_destroy(genlock_t *genlock)
+{
+    if (!genlock) {
+        return;
+    }
+    ATOMIC_STORE(genlock->running, 0);
+    reactor_wakeup(genlock->reactor);
+    THREAD_JOIN(genlock->thread);
+    reactor_destroy(genlock->reactor);
+    if (genlock->clock_sock >= 0) close(genlock->clock_sock);
+    close(genlock->sock);
+    MUTEX_DESTROY(genlock->mutex);
+    free(genlock);
+}
+
+/* The first refresh at or after time on the grid of vsync and period */
+static uint64_t
+genlock_vsync_at_or_after(uint64_t time, uint64_t vsync, uint64_t period)
+{
+    if (!vsync || !period) {
+        return time;
+    }
+    if (time <= vsync) {
+        return vsync - (vsync - time) / period * period;
+    }
+    return vsync + (time - vsync + period - 1) / period * period;
+}
+
+/* The refresh closest to time on the grid of vsync and period */
+static uint64_t
+genlock_vsync_nearest(uint64_t time, uint64_t vsync, uint64_t period)
+{
+    if (!vsync || !period) {
+        return time;
+    }
+    if (time <= vsync) {
+        return vsync - (vsync - time + period / 2) / period * period;
+    }
+    return vsync + (time - vsync + period / 2) / period * period;
+}
+
+uint64_t
+genlock_schedule(genlock_t *genlock, uint64_t remote_pts, uint64_t release, uint64_t vsync,
+                 uint64_t vsync_period)
+{
+    assert(genlock);
+    uint64_t now = media_clock_now();
+    MUTEX_LOCK(genlock->mutex);
+    if (genlock->role == GENLOCK_LEADER) {
+        // The leader's own frames flip on the vsync at or after, as they always do
+        genlock->base_offset = (int64_t) (release - remote_pts);
+        genlock->vsync = vsync;
+        genlock->vsync_period = vsync_period;
+        genlock->schedule_time = now;
+        release += genlock->group_lag;
+        MUTEX_UNLOCK(genlock->mutex);
+        return release;
+    }
+
+    if (!genlock->leader_id || !genlock->clock_valid || now - genlock->leader_time > GENLOCK_EXPIRE) {
+        MUTEX_UNLOCK(genlock->mutex);
+        return release;
+    }
+    // How much later than the leader's own schedule this node has the frame, on our clock
+    uint64_t base = remote_pts + genlock->base_offset;
+    int64_t lag = (int64_t) (release - (base - genlock->clock_offset));
+    if (!genlock->has_lag || lag > genlock->lag) {
+        genlock->lag = lag;
+        genlock->has_lag = true;
+    }
+    uint64_t leader_flip = genlock_vsync_at_or_after(base + genlock->group_lag, genlock->vsync, genlock->vsync_period);
+    uint64_t target = leader_flip - genlock->clock_offset;
+    MUTEX_UNLOCK(genlock->mutex);
+
+    uint64_t flip = genlock_vsync_nearest(target, vsync, vsync_period);
+    metrics_set(METRIC_GENLOCK_ERROR, (int64_t) (flip - target));
+    return flip;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef GENLOCK_H
+#define GENLOCK_H
+
+#include <stdint.h>
+
+#include "logger.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Video walls: receivers that mirror the same sender show each frame on the same display
+ * refresh. Their own playout times disagree by the error of each node's NTP sync with the
+ * sender plus up to a refresh of vsync alignment, tens of milliseconds between free-running
+ * displays. One node leads: it multicasts its presentation schedule, the offset from a frame's
+ * pts on the sender's clock to its release on the leader's clock, along with the refresh grid
+ * of its display. The followers sync their clock to the leader's over the LAN and release each
+ * frame on the refresh of their own display closest to the one the leader flips it on.
+ *
+ * A follower that needs a frame later than the schedule says, as its network is worse, tells
+ * the leader, and the whole group then plays that much later. Without a leader heard lately a
+ * follower plays on its own. The displays keep their own refresh clocks, which this cannot
+ * lock, so two of them stay apart by their phase difference, less than half a refresh.
+ *
+ * Nodes only talk to those with the same group name, and the frames of one group must all come
+ * from the same sender. genlock_schedule is called from a single thread.
+ */
+typedef struct genlock_s genlock_t;
+
+#define GENLOCK_MAX_NAME 31
+
+typedef enum genlock_role_e {
+    GENLOCK_LEADER,
+    GENLOCK_FOLLOWER
+} genlock_role_t;
+
+genlock_t *genlock_init(logger_t *logger, const char *name, genlock_role_t role);
+void genlock_destroy(genlock_t *genlock);
+
+/**
+ * Local time to release a frame at so it flips together with the rest of the group
+ * @param remote_pts the frame's pts on the sender's clock
+ * @param release local time the frame's own playout schedule releases it at
+ * @param vsync a refresh of the local display at or after release, 0 if the renderer cannot tell
+ * @param vsync_period the refresh period of the local display, 0 if unknown
+ */
+uint64_t genlock_schedule(genlock_t *genlock, uint64_t remote_pts, uint64_t release, uint64_t vsync,
+                          uint64_t vsync_period);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GENLOCK_H
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "gop_cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* What the frame data and the frame list start out with, both grown by doubling */
+#define GOP_CACHE_INITIAL_CAPACITY (256 * 1024)
+#define GOP_CACHE_INITIAL_FRAMES 16
+
+struct gop_cache_s {
+    int max_frames;
+    int max_bytes;
+
+    h264_decode_struct parameter_sets;
+    unsigned char *parameter_sets_data;
+    int has_parameter_sets;
+
+    /* The group, each frame's data at offsets[i] in data, which realloc may move */
+    h264_decode_struct *frames;
+    int *offsets;
+    int count;
+    int frames_capacity;
+    int valid;
+    unsigned char *data;
+    int size;
+    int capacity;
+};
+
+gop_cache_t *
+gop_cache_init(int max_frames, int max_bytes)
+{
+    assert(max_frames > 0);
+    assert(max_bytes > 0);
+
+    gop_cache_t *gop_cache = calloc(1, sizeof(gop_cache_t));
+    if (!gop_cache) {
+        return NULL;
+    }
+    gop_cache->max_frames = max_frames;
+    gop_cache->max_bytes = max_bytes;
+    return gop_cache;
+}
+
+/* Gives the group up, until the next IDR starts one */
+static void
+gop_cache_drop(gop_cache_t *gop_cache)
+{
+    gop_cache->count = 0;
+    gop_cache->size = 0;
+    gop_cache->valid = 0;
+}
+
+void
+gop_cache_reset(gop_cache_t *gop_cache)
+{
+    assert(gop_cache);
+    gop_cache->has_parameter_sets = 0;
+    gop_cache_drop(gop_cache);
+}
+
+static void
+gop_cache_set_parameter_sets(gop_cache_t *gop_cache, const h264_decode_struct *data)
+{
+    unsigned char *copy = realloc(gop_cache->parameter_sets_data, data->data_len);
+    if (!copy) {
+        gop_cache->has_parameter_sets = 0;
+        return;
+    }
+    memcpy(copy, data->data, data->data_len);
+    gop_cache->parameter_sets_data = copy;
+    gop_cache->parameter_sets = *data;
+    gop_cache->parameter_sets.data = copy;
+    gop_cache->parameter_sets.buffer_handle = NULL;
+    gop_cache->has_parameter_sets = 1;
+}
+
+void
+gop_cache_add(gop_cache_t *gop_cache, const h264_decode_struct *data)
+{
+    assert(gop_cache);
+    assert(data);
+
+    if (!data->data || data->data_len <= 0) {
+        return;
+    }
+    if (data->frame_type == 0) {
+        gop_cache_set_parameter_sets(gop_cache, data);
+        /* What was kept is in the old parameter sets */
+        gop_cache_drop(gop_cache);
+        return;
+    }
+    if (data->is_idr) {
+        gop_cache->count = 0;
+        gop_cache->size = 0;
+        gop_cache->valid = 1;
+    }
+    if (!gop_cache->valid) {
+        return;
+    }
+    if (gop_cache->count == gop_cache->max_frames || data->data_len > gop_cache->max_bytes - gop_cache->size) {
+        gop_cache_drop(gop_cache);
+        return;
+    }
+    if (gop_cache->count == gop_cache->frames_capacity) {
+        int frames_capacity = gop_cache->frames_capacity ? gop_cache->frames_capacity * 2 : GOP_CACHE_INITIAL_FRAMES;
+        if (frames_capacity > gop_cache->max_frames) {
+            frames_capacity = gop_cache->max_frames;
+        }
+        h264_decode_struct *frames = realloc(gop_cache->frames, frames_capacity * sizeof(h264_decode_struct));
+        if (frames) {
+            gop_cache->frames = frames;
+        }
+        int *offsets = realloc(gop_cache->offsets, frames_capacity * sizeof(int));
+        if (offsets) {
+            gop_cache->offsets = offsets;
+        }
+        if (!frames || !offsets) {
+            gop_cache_drop(gop_cache);
+            return;
+        }
+        gop_cache->frames_capacity = frames_capacity;
+    }
+    if (gop_cache->size + data->data_len > gop_cache->capacity) {
+        int capacity = gop_cache->capacity ? gop_cache->capacity : GOP_CACHE_INITIAL_CAPACITY;
+        while (capacity < gop_cache->size + data->data_len) {
+            capacity *= 2;
+        }
+        unsigned char *buffer = realloc(gop_cache->data, capacity);
+        if (!buffer) {
+            gop_cache_drop(gop_cache);
+            return;
+        }
+        gop_cache->data = buffer;
+        gop_cache->capacity = capacity;
+    }
+    h264_decode_struct *frame = &gop_cache->frames[gop_cache->count];
+    *frame = *data;
+    frame->buffer_handle = NULL;
+    gop_cache->offsets[gop_cache->count++] = gop_cache->size;
+    memcpy(gop_cache->data + gop_cache->size, data->data, data->data_len);
+    gop_cache->size += data->data_len;
+}
+
+int
+gop_cache_get_count(gop_cache_t *gop_cache)
+{
+    assert(gop_cache);
+    return gop_cache->valid ? gop_cache->count : 0;
+}
+
+const h264_decode_struct *
+gop_cache_get_parameter_sets(gop_cache_t *gop_cache)
+{
+    assert(gop_cache);
+    return gop_cache->has_parameter_sets ? &gop_cache->parameter_sets : NULL;
+}
+
+const h264_decode_struct *
+gop_cache_get_frame(gop_cache_t *gop_cache, int index)
+{
+    assert(gop_cache);
+    assert(index >= 0 && index < gop_cache_get_count(gop_cache));
+    h264_decode_struct *frame = &gop_cache->frames[index];
+    frame->data = gop_cache->data + gop_cache->offsets[index];
+    return frame;
+}
+
+void
+gop_cache_destroy(gop_cache_t *gop_cache)
+{
+    if (gop_cache) {
+        free(gop_cache->parameter_sets_data);
+        free(gop_cache->frames);
+        free(gop_cache->offsets);
+        free(gop_cache->data);
+        free(gop_cache);
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef GOP_CACHE_H
+#define GOP_CACHE_H
+
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Copies of the current group of pictures of a mirror: its parameter sets and every frame from
+ * the latest IDR on. Senders only send an IDR frame when the mirror starts or the decoder asks
+ * for one, which a static screen share does not do for many seconds, so whatever starts
+ * decoding in the middle of a mirror is fed these frames instead of waiting for the next IDR.
+ *
+ * A group that outgrows the limits is given up on until the next IDR, new parameter sets give
+ * up the group they came after. Not thread safe, every call has to come from the same thread
+ * or under the same lock.
+ */
+typedef struct gop_cache_s gop_cache_t;
+
+gop_cache_t *gop_cache_init(int max_frames, int max_bytes);
+/* Forgets everything, for a new mirror */
+void gop_cache_reset(gop_cache_t *gop_cache);
+/* Keeps the parameter sets of a frame_type 0 frame and the frames of the current group */
+void gop_cache_add(gop_cache_t *gop_cache, const h264_decode_struct *data);
+/* Number of frames kept, the first one an IDR, 0 if there is no complete group */
+int gop_cache_get_count(gop_cache_t *gop_cache);
+/*
+ * The parameter sets, NULL if there are none, or the index-th frame of the group. The frame and
+ * its data stay valid until the next call that changes the cache.
+ */
+const h264_decode_struct *gop_cache_get_parameter_sets(gop_cache_t *gop_cache);
+const h264_decode_struct *gop_cache_get_frame(gop_cache_t *gop_cache, int index);
+void gop_cache_destroy(gop_cache_t *gop_cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //GOP_CACHE_H
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "histogram.h"
+
+static int
+histogram_bucket(uint32_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+    int msb = 31 - __builtin_clz(value);
+    int shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+    int sub = (value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (shift + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+/* Largest value that falls into the bucket */
+static uint32_t
+histogram_bucket_upper(int bucket)
+{
+    if (bucket < HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    int sub = bucket % HISTOGRAM_SUB_BUCKETS;
+    uint64_t lower = (uint64_t) (HISTOGRAM_SUB_BUCKETS + sub) << shift;
+    return (uint32_t) (lower + ((uint64_t) 1 << shift) - 1);
+}
+
+void
+histogram_init(histogram_t *histogram)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        atomic_init(&histogram->counts[i], 0);
+    }
+    atomic_init(&histogram->total, 0);
+    atomic_init(&histogram->max, 0);
+}
+
+void
+histogram_record(histogram_t *histogram, uint64_t value)
+{
+    uint32_t clamped = value > UINT32_MAX ? UINT32_MAX : (uint32_t) value;
+    atomic_uint *count = &histogram->counts[histogram_bucket(clamped)];
+    /* There is only one writer, so a plain load and store does what an atomic increment would */
+    atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&histogram->total, atomic_load_explicit(&histogram->total, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    if (clamped > atomic_load_explicit(&histogram->max, memory_order_relaxed)) {
+        atomic_store_explicit(&histogram->max, clamped, memory_order_relaxed);
+    }
+}
+
+uint32_t
+histogram_percentile(const histogram_t *histogram, double percentile)
+{
+    uint32_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        counts[i] = atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t) (total * percentile / 100.0 + 0.5);
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= target) {
+            uint32_t upper = histogram_bucket_upper(i);
+            uint32_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+            return upper < max ? upper : max;
+        }
+    }
+    return atomic_load_explicit(&histogram->max, memory_order_relaxed);
+}
+
+void
+histogram_log(const histogram_t *histogram, logger_t *logger, int level, const char *name)
+{
+    unsigned int total = atomic_load_explicit(&histogram->total, memory_order_relaxed);
+    if (total == 0) {
+        return;
+    }
+    logger_log(logger, level, "%s: %u samples, p50 %u us, p90 %u us, p99 %u us, max %u us", name, total,
+               histogram_percentile(histogram, 50), histogram_percentile(histogram, 90),
+               histogram_percentile(histogram, 99), atomic_load_explicit(&histogram->max, memory_order_relaxed));
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "logger.h"
+
+/*
+ * Log-linear latency histogram in the spirit of HdrHistogram: every power of two is split into
+ * HISTOGRAM_SUB_BUCKETS buckets, so any recorded value is known to within 25% over the whole
+ * range up to 2^32. Buckets are fixed, recording is a handful of instructions and never allocates.
+ *
+ * A histogram has a single writer thread, which records with relaxed stores and no lock. Any
+ * other thread may read it at the same time and sees a close, if not exact, snapshot.
+ */
+#define HISTOGRAM_SUB_BUCKET_BITS 2
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_VALUE_BITS 32
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct histogram_s {
+    atomic_uint counts[HISTOGRAM_BUCKETS];
+    atomic_uint total;
+    atomic_uint max;
+} histogram_t;
+
+void histogram_init(histogram_t *histogram);
+/* Only ever called from the histogram's writer thread */
+void histogram_record(histogram_t *histogram, uint64_t value);
+/* Smallest bucket bound at least percentile percent of the values stay below, 0 if empty */
+uint32_t histogram_percentile(const histogram_t *histogram, double percentile);
+void histogram_log(const histogram_t *histogram, logger_t *logger, int level, const char *name);
+
+#endif //HISTOGRAM_H
@@ -13,100 +13,187 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <assert.h>
 
 #include "http_request.h"
 #include "llhttp/llhttp.h"
 
+/* Initial arena, a typical RTSP request with a bplist body fits */
+#define HTTP_REQUEST_ARENA_SIZE 4096
+/* An arena grown past this for one large request is given back when the request is reset */
+#define HTTP_REQUEST_ARENA_KEEP (64 * 1024)
+/* How much of a announced Content-Length is reserved up front at most */
+#define HTTP_REQUEST_BODY_RESERVE_MAX (1024 * 1024)
+/* Bodies announced at least this large get a buffer of their own, which the caller can take over */
+#define HTTP_REQUEST_BODY_OWN_MIN (16 * 1024)
+#define HTTP_REQUEST_MAX_HEADERS 64
+/* Open addressed index of header names, a power of two at least twice HTTP_REQUEST_MAX_HEADERS */
+#define HTTP_REQUEST_INDEX_SIZE 128
+
+/* A string in the arena, which is always followed by a terminating zero */
+typedef struct http_request_span_s {
+    int offset;
+    int length;
+} http_request_span_t;
+
+/*
+ * Every string of a request lives in one arena that is kept across the requests of a
+ * connection. llhttp hands out fragments in order and the string they belong to is always
+ * the last one in the arena, so a fragment is appended in place. Strings are spans rather
+ * than pointers, the arena may move as it grows. Only a large body, like cover art, is put
+ * in a buffer of its own instead, so it can be handed on without copying it again.
+ */
 struct http_request_s {
     llhttp_t parser;
     llhttp_settings_t parser_settings;
 
     const char *method;
-    char *url;
 
-    char **headers;
-    int headers_size;
-    int headers_index;
+    char *arena;
+    int arena_size;
+    int arena_used;
 
-    char *data;
-    int datalen;
+    http_request_span_t url;
+    /* Field and value of every header in turn */
+    http_request_span_t headers[2 * HTTP_REQUEST_MAX_HEADERS];
+    int headers_count;
+    /* Header number plus one, 0 for an empty slot, built once the headers are complete */
+    unsigned char index[HTTP_REQUEST_INDEX_SIZE];
+    int indexed;
+
+    /* Relative to body_buffer if there is one, to the arena otherwise */
+    http_request_span_t body;
+    char *body_buffer;
+    int body_buffer_size;
 
     int complete;
 };
 
 static int
-on_url(llhttp_t *parser, const char *at, size_t length)
+http_request_reserve(http_request_t *request, int length)
 {
-    http_request_t *request = parser->data;
-    int urllen = request->url ? strlen(request->url) : 0;
-
-    request->url = realloc(request->url, urllen+length+1);
-    assert(request->url);
+    if (request->arena_used + length <= request->arena_size) {
+        return 0;
+    }
+    int size = request->arena_size;
+    while (size < request->arena_used + length) {
+        size *= 2;
+    }
+    char *arena = realloc(request->arena, size);
+    if (!arena) {
+        return -1;
+    }
+    request->arena = arena;
+    request->arena_size = size;
+    return 0;
+}
 
-    request->url[urllen] = '\0';
-    strncat(request->url, at, length);
+/* Appends a fragment to span, which has to be the last string in the arena unless it is still empty */
+static int
+http_request_append(http_request_t *request, http_request_span_t *span, const char *at, size_t length)
+{
+    if (http_request_reserve(request, length + 1) < 0) {
+        return -1;
+    }
+    if (span->offset < 0) {
+        span->offset = request->arena_used;
+        span->length = 0;
+        request->arena_used++;
+    }
+    memcpy(request->arena + span->offset + span->length, at, length);
+    span->length += length;
+    request->arena[span->offset + span->length] = '\0';
+    request->arena_used += length;
     return 0;
 }
 
+static uint32_t
+http_request_hash(const char *name, int length)
+{
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int
+on_url(llhttp_t *parser, const char *at, size_t length)
+{
+    http_request_t *request = parser->data;
+    return http_request_append(request, &request->url, at, length);
+}
+
 static int
 on_header_field(llhttp_t *parser, const char *at, size_t length)
 {
     http_request_t *request = parser->data;
 
-    /* Check if our index is a value */
-    if (request->headers_index%2 == 1) {
-        request->headers_index++;
+    /* A field after a value starts the next header */
+    if (request->headers_count % 2 == 0) {
+        if (request->headers_count == 2 * HTTP_REQUEST_MAX_HEADERS) {
+            return -1;
+        }
+        request->headers[request->headers_count].offset = -1;
+        request->headers_count++;
     }
+    return http_request_append(request, &request->headers[request->headers_count - 1], at, length);
+}
 
-    /* Allocate space for new field-value pair */
-    if (request->headers_index == request->headers_size) {
-        request->headers_size += 2;
-        request->headers = realloc(request->headers,
-                                   request->headers_size*sizeof(char*));
-        assert(request->headers);
-        request->headers[request->headers_index] = NULL;
-        request->headers[request->headers_index+1] = NULL;
-    }
+static int
+on_header_value(llhttp_t *parser, const char *at, size_t length)
+{
+    http_request_t *request = parser->data;
 
-    /* Allocate space in the current header string */
-    if (request->headers[request->headers_index] == NULL) {
-        request->headers[request->headers_index] = calloc(1, length+1);
-    } else {
-        request->headers[request->headers_index] = realloc(
-                request->headers[request->headers_index],
-                strlen(request->headers[request->headers_index])+length+1
-        );
+    if (request->headers_count % 2 == 1) {
+        request->headers[request->headers_count].offset = -1;
+        request->headers_count++;
     }
-    assert(request->headers[request->headers_index]);
-
-    strncat(request->headers[request->headers_index], at, length);
-    return 0;
+    return http_request_append(request, &request->headers[request->headers_count - 1], at, length);
 }
 
 static int
-on_header_value(llhttp_t *parser, const char *at, size_t length)
+on_headers_complete(llhttp_t *parser)
 {
     http_request_t *request = parser->data;
 
-    /* Check if our index is a field */
-    if (request->headers_index%2 == 0) {
-        request->headers_index++;
+    /* A header without a value gets an empty one, so every field has its pair */
+    if (request->headers_count % 2 == 1) {
+        request->headers[request->headers_count].offset = -1;
+        if (http_request_append(request, &request->headers[request->headers_count], "", 0) < 0) {
+            return -1;
+        }
+        request->headers_count++;
     }
-
-    /* Allocate space in the current header string */
-    if (request->headers[request->headers_index] == NULL) {
-        request->headers[request->headers_index] = calloc(1, length+1);
-    } else {
-        request->headers[request->headers_index] = realloc(
-                request->headers[request->headers_index],
-                strlen(request->headers[request->headers_index])+length+1
-        );
+    for (int i = 0; i < request->headers_count / 2; i++) {
+        const http_request_span_t *field = &request->headers[2 * i];
+        uint32_t slot = http_request_hash(request->arena + field->offset, field->length);
+        while (request->index[slot % HTTP_REQUEST_INDEX_SIZE]) {
+            slot++;
+        }
+        request->index[slot % HTTP_REQUEST_INDEX_SIZE] = i + 1;
+    }
+    request->indexed = 1;
+
+    /* The body only has to be copied in once */
+    if (parser->content_length > 0) {
+        uint64_t reserve = parser->content_length < HTTP_REQUEST_BODY_RESERVE_MAX ?
+                           parser->content_length : HTTP_REQUEST_BODY_RESERVE_MAX;
+        if (reserve >= HTTP_REQUEST_BODY_OWN_MIN) {
+            request->body_buffer = malloc(reserve + 1);
+            if (request->body_buffer) {
+                request->body_buffer_size = (int) reserve + 1;
+                request->body.offset = 0;
+                request->body.length = 0;
+                request->body_buffer[0] = '\0';
+                return 0;
+            }
+        }
+        http_request_reserve(request, (int) reserve + 1);
     }
-    assert(request->headers[request->headers_index]);
-
-    strncat(request->headers[request->headers_index], at, length);
     return 0;
 }
 
@@ -115,11 +202,24 @@ on_body(llhttp_t *parser, const char *at, size_t length)
 {
     http_request_t *request = parser->data;
 
-    request->data = realloc(request->data, request->datalen+length);
-    assert(request->data);
-
-    memcpy(request->data+request->datalen, at, length);
-    request->datalen += length;
+    if (!request->body_buffer) {
+        return http_request_append(request, &request->body, at, length);
+    }
+    if (request->body.length + length + 1 > (size_t) request->body_buffer_size) {
+        int size = request->body_buffer_size;
+        while (request->body.length + length + 1 > (size_t) size) {
+            size *= 2;
+        }
+        char *body_buffer = realloc(request->body_buffer, size);
+        if (!body_buffer) {
+            return -1;
+        }
+        request->body_buffer = body_buffer;
+        request->body_buffer_size = size;
+    }
+    memcpy(request->body_buffer + request->body.length, at, length);
+    request->body.length += length;
+    request->body_buffer[request->body.length] = '\0';
     return 0;
 }
 
@@ -130,7 +230,24 @@ on_message_complete(llhttp_t *parser)
 
     request->method = llhttp_method_name(request->parser.method);
     request->complete = 1;
-    return 0;
+    /* Stop right behind this request, the rest of the data belongs to the next one */
+    return HPE_PAUSED;
+}
+
+static void
+http_request_clear(http_request_t *request)
+{
+    request->method = NULL;
+    request->arena_used = 0;
+    request->url.offset = -1;
+    request->headers_count = 0;
+    memset(request->index, 0, sizeof(request->index));
+    request->indexed = 0;
+    request->body.offset = -1;
+    free(request->body_buffer);
+    request->body_buffer = NULL;
+    request->body_buffer_size = 0;
+    request->complete = 0;
 }
 
 http_request_t *
@@ -142,11 +259,19 @@ http_request_init(void)
     if (!request) {
         return NULL;
     }
+    request->arena = malloc(HTTP_REQUEST_ARENA_SIZE);
+    if (!request->arena) {
+        free(request);
+        return NULL;
+    }
+    request->arena_size = HTTP_REQUEST_ARENA_SIZE;
+    http_request_clear(request);
 
     llhttp_settings_init(&request->parser_settings);
     request->parser_settings.on_url = &on_url;
     request->parser_settings.on_header_field = &on_header_field;
     request->parser_settings.on_header_value = &on_header_value;
+    request->parser_settings.on_headers_complete = &on_headers_complete;
     request->parser_settings.on_body = &on_body;
     request->parser_settings.on_message_complete = &on_message_complete;
 
@@ -157,17 +282,27 @@ http_request_init(void)
 }
 
 void
-http_request_destroy(http_request_t *request)
+http_request_reset(http_request_t *request)
 {
-    int i;
+    assert(request);
 
-    if (request) {
-        free(request->url);
-        for (i=0; i<request->headers_size; i++) {
-            free(request->headers[i]);
+    if (request->arena_size > HTTP_REQUEST_ARENA_KEEP) {
+        char *arena = realloc(request->arena, HTTP_REQUEST_ARENA_SIZE);
+        if (arena) {
+            request->arena = arena;
+            request->arena_size = HTTP_REQUEST_ARENA_SIZE;
         }
-        free(request->headers);
-        free(request->data);
+    }
+    http_request_clear(request);
+    llhttp_reset(&request->parser);
+}
+
+void
+http_request_destroy(http_request_t *request)
+{
+    if (request) {
+        free(request->body_buffer);
+        free(request->arena);
         free(request);
     }
 }
@@ -175,13 +310,17 @@ http_request_destroy(http_request_t *request)
 int
 http_request_add_data(http_request_t *request, const char *data, int datalen)
 {
-    int ret;
+    llhttp_errno_t ret;
 
     assert(request);
 
-    ret = llhttp_execute(&request->parser,
-                              data, datalen);
-    return ret;
+    ret = llhttp_execute(&request->parser, data, datalen);
+    if (ret == HPE_PAUSED) {
+        return llhttp_get_error_pos(&request->parser) - data;
+    } else if (ret != HPE_OK) {
+        return -1;
+    }
+    return datalen;
 }
 
 int
@@ -195,7 +334,8 @@ int
 http_request_has_error(http_request_t *request)
 {
     assert(request);
-    return (llhttp_get_errno(&request->parser) != HPE_OK);
+    llhttp_errno_t error = llhttp_get_errno(&request->parser);
+    return error != HPE_OK && error != HPE_PAUSED;
 }
 
 const char *
@@ -223,7 +363,7 @@ const char *
 http_request_get_url(http_request_t *request)
 {
     assert(request);
-    return request->url;
+    return request->url.offset >= 0 ? request->arena + request->url.offset : NULL;
 }
 
 const char *
@@ -233,9 +373,19 @@ http_request_get_header(http_request_t *request, const char *name)
 
     assert(request);
 
-    for (i=0; i<request->headers_size; i+=2) {
-        if (!strcmp(request->headers[i], name)) {
-            return request->headers[i+1];
+    if (!request->indexed) {
+        for (i=0; i<request->headers_count - 1; i+=2) {
+            if (!strcmp(request->arena + request->headers[i].offset, name)) {
+                return request->arena + request->headers[i+1].offset;
+            }
+        }
+        return NULL;
+    }
+    uint32_t slot = http_request_hash(name, strlen(name));
+    for (i=0; i<HTTP_REQUEST_INDEX_SIZE && request->index[slot % HTTP_REQUEST_INDEX_SIZE]; i++, slot++) {
+        int header = 2 * (request->index[slot % HTTP_REQUEST_INDEX_SIZE] - 1);
+        if (!strcmp(request->arena + request->headers[header].offset, name)) {
+            return request->arena + request->headers[header+1].offset;
         }
     }
     return NULL;
@@ -247,7 +397,39 @@ http_request_get_data(http_request_t *request, int *datalen)
     assert(request);
 
     if (datalen) {
-        *datalen = request->datalen;
+        *datalen = request->body.offset >= 0 ? request->body.length : 0;
+    }
+    if (request->body.offset < 0) {
+        return NULL;
+    }
+    return (request->body_buffer ? request->body_buffer : request->arena) + request->body.offset;
+}
+
+char *
+http_request_take_data(http_request_t *request, int *datalen)
+{
+    char *data;
+
+    assert(request);
+    assert(datalen);
+
+    *datalen = 0;
+    if (request->body.offset < 0) {
+        return NULL;
+    }
+    if (request->body_buffer) {
+        data = request->body_buffer;
+        request->body_buffer = NULL;
+        request->body_buffer_size = 0;
+    } else {
+        /* Small enough to have been kept in the arena, a copy is cheap */
+        data = malloc(request->body.length + 1);
+        if (!data) {
+            return NULL;
+        }
+        memcpy(data, request->arena + request->body.offset, request->body.length + 1);
     }
-    return request->data;
+    *datalen = request->body.length;
+    request->body.offset = -1;
+    return data;
 }
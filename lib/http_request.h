@@ -19,7 +19,10 @@ typedef struct http_request_s http_request_t;
 
 
 http_request_t *http_request_init(void);
+/* Readies the request for the next one on the connection, anything gotten from it becomes invalid */
+void http_request_reset(http_request_t *request);
 
+/* Returns how much of data was parsed, less than datalen once the request is complete, or -1 on errors */
 int http_request_add_data(http_request_t *request, const char *data, int datalen);
 int http_request_is_complete(http_request_t *request);
 int http_request_has_error(http_request_t *request);
@@ -30,6 +33,9 @@ const char *http_request_get_method(http_request_t *request);
 const char *http_request_get_url(http_request_t *request);
 const char *http_request_get_header(http_request_t *request, const char *name);
 const char *http_request_get_data(http_request_t *request, int *datalen);
+/* Hands the body over to the caller to free, zero terminated, and leaves the request without one.
+ * A large body is passed on as it was received, without a copy. */
+char *http_request_take_data(http_request_t *request, int *datalen);
 
 void http_request_destroy(http_request_t *request);
 
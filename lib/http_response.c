@@ -20,13 +20,36 @@
 #include "http_response.h"
 #include "compat.h"
 
+/* Status line, headers and the blank line, kept in the response itself unless a reply has many headers */
+#define HTTP_RESPONSE_HEAD_SIZE 512
+
+/* Status lines of nearly every reply, formatted once */
+static const struct {
+    const char *protocol;
+    int code;
+    const char *message;
+    const char *line;
+} http_response_status_lines[] = {
+    { "RTSP/1.0", 200, "OK", "RTSP/1.0 200 OK\r\n" },
+    { "HTTP/1.1", 200, "OK", "HTTP/1.1 200 OK\r\n" },
+    { "HTTP/1.1", 404, "Not Found", "HTTP/1.1 404 Not Found\r\n" },
+};
+
+/*
+ * A response goes out as two parts, the head and the body. The body is either copied in or
+ * handed over by the caller, in which case it is sent from where it already is.
+ */
 struct http_response_s {
     int complete;
     int disconnect;
 
-    char *data;
-    int data_size;
-    int data_length;
+    char head_buffer[HTTP_RESPONSE_HEAD_SIZE];
+    char *head;
+    int head_size;
+    int head_length;
+
+    char *body;
+    int body_length;
 };
 
 
@@ -39,16 +62,23 @@ http_response_add_data(http_response_t *response, const char *data, int datalen)
     assert(data);
     assert(datalen > 0);
 
-    newdatasize = response->data_size;
-    while (response->data_size+datalen > newdatasize) {
+    newdatasize = response->head_size;
+    while (response->head_length+datalen > newdatasize) {
         newdatasize *= 2;
     }
-    if (newdatasize != response->data_size) {
-        response->data = realloc(response->data, newdatasize);
-        assert(response->data);
+    if (newdatasize != response->head_size) {
+        if (response->head == response->head_buffer) {
+            response->head = malloc(newdatasize);
+            assert(response->head);
+            memcpy(response->head, response->head_buffer, response->head_length);
+        } else {
+            response->head = realloc(response->head, newdatasize);
+            assert(response->head);
+        }
+        response->head_size = newdatasize;
     }
-    memcpy(response->data+response->data_length, data, datalen);
-    response->data_length += datalen;
+    memcpy(response->head+response->head_length, data, datalen);
+    response->head_length += datalen;
 }
 
 http_response_t *
@@ -56,34 +86,34 @@ http_response_init(const char *protocol, int code, const char *message)
 {
     http_response_t *response;
     char codestr[4];
+    size_t i;
 
     assert(code >= 100 && code < 1000);
 
-    /* Convert code into string */
-    memset(codestr, 0, sizeof(codestr));
-    snprintf(codestr, sizeof(codestr), "%u", code);
-
     response = calloc(1, sizeof(http_response_t));
     if (!response) {
         return NULL;
     }
-
-    /* Allocate response data */
-    response->data_size = 1024;
-    response->data = malloc(response->data_size);
-    if (!response->data) {
-        free(response);
-        return NULL;
+    response->head = response->head_buffer;
+    response->head_size = sizeof(response->head_buffer);
+
+    /* Add first line of response to the head */
+    for (i = 0; i < sizeof(http_response_status_lines) / sizeof(http_response_status_lines[0]); i++) {
+        if (http_response_status_lines[i].code == code &&
+            !strcmp(http_response_status_lines[i].protocol, protocol) &&
+            !strcmp(http_response_status_lines[i].message, message)) {
+            http_response_add_data(response, http_response_status_lines[i].line,
+                                   strlen(http_response_status_lines[i].line));
+            return response;
+        }
     }
-
-    /* Add first line of response to the data array */
+    snprintf(codestr, sizeof(codestr), "%u", code);
     http_response_add_data(response, protocol, strlen(protocol));
     http_response_add_data(response, " ", 1);
     http_response_add_data(response, codestr, strlen(codestr));
     http_response_add_data(response, " ", 1);
     http_response_add_data(response, message, strlen(message));
     http_response_add_data(response, "\r\n", 2);
-
     return response;
 }
 
@@ -91,7 +121,10 @@ void
 http_response_destroy(http_response_t *response)
 {
     if (response) {
-        free(response->data);
+        if (response->head != response->head_buffer) {
+            free(response->head);
+        }
+        free(response->body);
         free(response);
     }
 }
@@ -99,10 +132,18 @@ http_response_destroy(http_response_t *response)
 void
 http_response_add_header(http_response_t *response, const char *name, const char *value)
 {
+    char line[256];
+    int linelen;
+
     assert(response);
     assert(name);
     assert(value);
 
+    linelen = snprintf(line, sizeof(line), "%s: %s\r\n", name, value);
+    if (linelen < (int) sizeof(line)) {
+        http_response_add_data(response, line, linelen);
+        return;
+    }
     http_response_add_data(response, name, strlen(name));
     http_response_add_data(response, ": ", 2);
     http_response_add_data(response, value, strlen(value));
@@ -110,26 +151,25 @@ http_response_add_header(http_response_t *response, const char *name, const char
 }
 
 void
-http_response_finish(http_response_t *response, const char *data, int datalen)
+http_response_add_header_line(http_response_t *response, const char *line, int linelen)
 {
     assert(response);
-    assert(datalen==0 || (data && datalen > 0));
-
-    if (data && datalen > 0) {
-        const char *hdrname = "Content-Length";
-        char hdrvalue[16];
+    assert(line);
+    assert(linelen > 2 && !memcmp(line + linelen - 2, "\r\n", 2));
 
-        memset(hdrvalue, 0, sizeof(hdrvalue));
-        snprintf(hdrvalue, sizeof(hdrvalue)-1, "%d", datalen);
+    http_response_add_data(response, line, linelen);
+}
 
-        /* Add Content-Length header first */
-        http_response_add_data(response, hdrname, strlen(hdrname));
-        http_response_add_data(response, ": ", 2);
-        http_response_add_data(response, hdrvalue, strlen(hdrvalue));
-        http_response_add_data(response, "\r\n\r\n", 4);
+static void
+http_response_finish_head(http_response_t *response, int datalen)
+{
+    if (datalen > 0) {
+        char line[32];
+        int linelen;
 
-        /* Add data to the end of response */
-        http_response_add_data(response, data, datalen);
+        /* Add Content-Length header last, with the blank line ending the head */
+        linelen = snprintf(line, sizeof(line), "Content-Length: %d\r\n\r\n", datalen);
+        http_response_add_data(response, line, linelen);
     } else {
         /* Add extra end of line after headers */
         http_response_add_data(response, "\r\n", 2);
@@ -137,6 +177,37 @@ http_response_finish(http_response_t *response, const char *data, int datalen)
     response->complete = 1;
 }
 
+void
+http_response_finish(http_response_t *response, const char *data, int datalen)
+{
+    assert(response);
+    assert(datalen==0 || (data && datalen > 0));
+
+    if (data && datalen > 0) {
+        response->body = malloc(datalen);
+        assert(response->body);
+        memcpy(response->body, data, datalen);
+        response->body_length = datalen;
+    }
+    http_response_finish_head(response, datalen);
+}
+
+void
+http_response_finish_owned(http_response_t *response, char *data, int datalen)
+{
+    assert(response);
+    assert(datalen==0 || (data && datalen > 0));
+
+    if (data && datalen > 0) {
+        response->body = data;
+        response->body_length = datalen;
+    } else {
+        free(data);
+        datalen = 0;
+    }
+    http_response_finish_head(response, datalen);
+}
+
 void
 http_response_set_disconnect(http_response_t *response, int disconnect)
 {
@@ -154,12 +225,23 @@ http_response_get_disconnect(http_response_t *response)
 }
 
 const char *
-http_response_get_data(http_response_t *response, int *datalen)
+http_response_get_head(http_response_t *response, int *headlen)
+{
+    assert(response);
+    assert(headlen);
+    assert(response->complete);
+
+    *headlen = response->head_length;
+    return response->head;
+}
+
+const char *
+http_response_get_body(http_response_t *response, int *bodylen)
 {
     assert(response);
-    assert(datalen);
+    assert(bodylen);
     assert(response->complete);
 
-    *datalen = response->data_length;
-    return response->data;
+    *bodylen = response->body_length;
+    return response->body;
 }
@@ -20,12 +20,18 @@ typedef struct http_response_s http_response_t;
 http_response_t *http_response_init(const char *protocol, int code, const char *message);
 
 void http_response_add_header(http_response_t *response, const char *name, const char *value);
+/* Adds a preformatted "Name: value\r\n" line, for headers that are the same on every reply */
+void http_response_add_header_line(http_response_t *response, const char *line, int linelen);
 void http_response_finish(http_response_t *response, const char *data, int datalen);
+/* Like http_response_finish, but takes over the malloc'd data and sends it without a copy */
+void http_response_finish_owned(http_response_t *response, char *data, int datalen);
 
 void http_response_set_disconnect(http_response_t *response, int disconnect);
 int http_response_get_disconnect(http_response_t *response);
 
-const char *http_response_get_data(http_response_t *response, int *datalen);
+/* The head is the status line and headers, the body may be NULL. Both are sent in one go */
+const char *http_response_get_head(http_response_t *response, int *headlen);
+const char *http_response_get_body(http_response_t *response, int *bodylen);
 
 void http_response_destroy(http_response_t *response);
 
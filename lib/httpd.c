@@ -22,6 +22,21 @@
 #include "http_request.h"
 #include "compat.h"
 #include "logger.h"
+#include "reactor.h"
+#include "worker_pool.h"
+#include "mem_account.h"
+
+/* Ready sockets handled per wakeup, any others are picked up on the next one */
+#define HTTPD_MAX_READY 16
+/* Fits the fp-setup, pair-setup and SETUP bodies, every read that fills it doubles it up to the maximum */
+#define HTTPD_READ_BUFFER_SIZE (16 * 1024)
+#define HTTPD_READ_BUFFER_MAX (256 * 1024)
+/* Threads answering the requests conn_offload picks, slow handshakes rarely overlap */
+#define HTTPD_WORKER_THREADS 2
+/* Responses to pipelined requests answered in one pass go out together in a single sendmsg */
+#define HTTPD_MAX_QUEUED_RESPONSES 8
+/* How often conn_is_idle is asked while nothing else wakes the httpd thread up */
+#define HTTPD_IDLE_CHECK_MS 1000
 
 struct http_connection_s {
     int connected;
@@ -29,6 +44,30 @@ struct http_connection_s {
     int socket_fd;
     void *user_data;
     http_request_t *request;
+
+    /* Read buffer, kept by the slot across requests and connections */
+    char *buffer;
+    int buffer_size;
+
+    /*
+     * Set while a worker answers the request. The socket is not watched meanwhile, so the
+     * requests of a connection are still answered in order, and data already read behind
+     * the request waits in the buffer at pending_offset.
+     */
+    httpd_t *httpd;
+    int offloaded;
+    int pending_offset;
+    int pending_length;
+    /* Written by the worker with async_mutex locked, picked up by the httpd thread */
+    int async_done;
+    http_response_t *async_response;
+
+    /* Answered but not yet sent, see httpd_flush_responses */
+    http_response_t *queued[HTTPD_MAX_QUEUED_RESPONSES];
+    int queued_count;
+
+    /* Value of the httpd's activity counter when the connection was last accepted or read from */
+    unsigned int last_active;
 };
 typedef struct http_connection_s http_connection_t;
 
@@ -39,6 +78,7 @@ struct httpd_s {
     int max_connections;
     int open_connections;
     http_connection_t *connections;
+    unsigned int activity;
 
     /* These variables only edited mutex locked */
     int running;
@@ -49,8 +89,31 @@ struct httpd_s {
     /* Server fds for accepting connections */
     int server_fd4;
     int server_fd6;
+    /* Handed over already listening, taken as the server socket by the next start, -1 for none */
+    int listen_fd;
+    int server_watched;
+
+    /* Wakes the thread up for readable sockets and stop requests */
+    reactor_t *reactor;
+
+    /* Only exists while running and if conn_offload is set */
+    worker_pool_t *worker_pool;
+    mutex_handle_t async_mutex;
+
+    /*
+     * A guest is served by the thread of its host, with the host's reactor and workers, see
+     * httpd_set_host. The host walks its guests list, joined_cond tells a guest's httpd_stop
+     * that the host thread has closed its connections.
+     */
+    httpd_t *host;
+    httpd_t *guests;
+    httpd_t *next_guest;
+    cond_handle_t joined_cond;
 };
 
+/* The httpd whose thread, reactor and workers serve httpd */
+#define HTTPD_HOST(httpd) ((httpd)->host ? (httpd)->host : (httpd))
+
 httpd_t *
 httpd_init(logger_t *logger, httpd_callbacks_t *callbacks, int max_connections)
 {
@@ -73,15 +136,29 @@ httpd_init(logger_t *logger, httpd_callbacks_t *callbacks, int max_connections)
         return NULL;
     }
 
+    for (int i = 0; i < max_connections; i++) {
+        httpd->connections[i].httpd = httpd;
+    }
+
+    httpd->reactor = reactor_init(logger);
+    if (!httpd->reactor) {
+        free(httpd->connections);
+        free(httpd);
+        return NULL;
+    }
+
     /* Use the logger provided */
     httpd->logger = logger;
 
     /* Save callback pointers */
     memcpy(&httpd->callbacks, callbacks, sizeof(httpd_callbacks_t));
+    MUTEX_CREATE(httpd->async_mutex);
+    COND_CREATE(httpd->joined_cond);
 
     /* Initial status joined */
-    httpd->running = 0;
+    ATOMIC_STORE(httpd->running, 0);
     httpd->joined = 1;
+    httpd->listen_fd = -1;
 
     return httpd;
 }
@@ -92,11 +169,57 @@ httpd_destroy(httpd_t *httpd)
     if (httpd) {
         httpd_stop(httpd);
 
+        if (httpd->host) {
+            httpd_t **guest = &httpd->host->guests;
+            while (*guest != httpd) {
+                guest = &(*guest)->next_guest;
+            }
+            *guest = httpd->next_guest;
+        } else {
+            assert(!httpd->guests);
+            reactor_destroy(httpd->reactor);
+        }
+        MUTEX_DESTROY(httpd->async_mutex);
+        COND_DESTROY(httpd->joined_cond);
+        for (int i = 0; i < httpd->max_connections; i++) {
+            mem_account_free(httpd->connections[i].buffer);
+        }
         free(httpd->connections);
         free(httpd);
     }
 }
 
+static void httpd_remove_connection(httpd_t *httpd, http_connection_t *connection);
+
+/* The least recently active connection conn_is_probe lets go of, NULL if there is none */
+static http_connection_t *
+httpd_find_probe(httpd_t *httpd)
+{
+    http_connection_t *oldest = NULL;
+
+    if (!httpd->callbacks.conn_is_probe) {
+        return NULL;
+    }
+    for (int i = 0; i < httpd->max_connections; i++) {
+        http_connection_t *connection = &httpd->connections[i];
+        if (!connection->connected || connection->offloaded || connection->queued_count ||
+            !httpd->callbacks.conn_is_probe(connection->user_data)) {
+            continue;
+        }
+        if (!oldest || (int) (connection->last_active - oldest->last_active) < 0) {
+            oldest = connection;
+        }
+    }
+    return oldest;
+}
+
+/* Whether a new connection can be accepted, into a free slot or that of a probe */
+static int
+httpd_has_room(httpd_t *httpd)
+{
+    return httpd->open_connections < httpd->max_connections || httpd_find_probe(httpd) != NULL;
+}
+
 static int
 httpd_add_connection(httpd_t *httpd, int fd, unsigned char *local, int local_len, unsigned char *remote, int remote_len)
 {
@@ -109,9 +232,16 @@ httpd_add_connection(httpd_t *httpd, int fd, unsigned char *local, int local_len
         }
     }
     if (i == httpd->max_connections) {
-        /* This code should never be reached, we do not select server_fds when full */
-        logger_log(httpd->logger, LOGGER_INFO, "Max connections reached");
-        return -1;
+        /* Probes from the senders around must not keep out the one that wants to stream */
+        http_connection_t *probe = httpd_find_probe(httpd);
+        if (!probe) {
+            /* This code should never be reached, we do not select server_fds when full */
+            logger_log(httpd->logger, LOGGER_INFO, "Max connections reached");
+            return -1;
+        }
+        logger_log(httpd->logger, LOGGER_DEBUG, "Closing the probe on socket %d to make room", probe->socket_fd);
+        httpd_remove_connection(httpd, probe);
+        i = probe - httpd->connections;
     }
 
     user_data = httpd->callbacks.conn_init(httpd->callbacks.opaque, local, local_len, remote, remote_len);
@@ -119,11 +249,16 @@ httpd_add_connection(httpd_t *httpd, int fd, unsigned char *local, int local_len
         logger_log(httpd->logger, LOGGER_ERR, "Error initializing HTTP request handler");
         return -1;
     }
+    if (reactor_add(httpd->reactor, fd) < 0) {
+        httpd->callbacks.conn_destroy(user_data);
+        return -1;
+    }
 
     httpd->open_connections++;
     httpd->connections[i].socket_fd = fd;
     httpd->connections[i].connected = 1;
     httpd->connections[i].user_data = user_data;
+    httpd->connections[i].last_active = ++httpd->activity;
     return 0;
 }
 
@@ -153,7 +288,7 @@ httpd_accept_connection(httpd_t *httpd, int server_fd, int is_ipv6)
         return 0;
     }
 
-    logger_log(httpd->logger, LOGGER_INFO, "Accepted %s client on socket %d",
+    logger_log(httpd->logger, LOGGER_DEBUG, "Accepted %s client on socket %d",
                (is_ipv6 ? "IPv6"  : "IPv4"), fd);
     local = netutils_get_address(&local_saddr, &local_len);
     remote = netutils_get_address(&remote_saddr, &remote_len);
@@ -167,173 +302,371 @@ httpd_accept_connection(httpd_t *httpd, int server_fd, int is_ipv6)
     return 1;
 }
 
+static void httpd_flush_responses(httpd_t *httpd, http_connection_t *connection);
+
 static void
 httpd_remove_connection(httpd_t *httpd, http_connection_t *connection)
 {
+    /* What was answered before the connection went away is still sent */
+    httpd_flush_responses(httpd, connection);
     if (connection->request) {
         http_request_destroy(connection->request);
         connection->request = NULL;
     }
     httpd->callbacks.conn_destroy(connection->user_data);
+    reactor_remove(httpd->reactor, connection->socket_fd);
     shutdown(connection->socket_fd, SHUT_WR);
     closesocket(connection->socket_fd);
     connection->connected = 0;
     httpd->open_connections--;
 }
 
-static THREAD_RETVAL
-httpd_thread(void *arg)
+/* Only watch the server sockets while there is room for another connection, see httpd_has_room */
+static void
+httpd_watch_server_sockets(httpd_t *httpd, int watch)
 {
-    httpd_t *httpd = arg;
-    char buffer[1024];
-    int i;
+    if (watch == httpd->server_watched) {
+        return;
+    }
+    if (httpd->server_fd4 != -1) {
+        if (watch) reactor_add(httpd->reactor, httpd->server_fd4);
+        else reactor_remove(httpd->reactor, httpd->server_fd4);
+    }
+    if (httpd->server_fd6 != -1) {
+        if (watch) reactor_add(httpd->reactor, httpd->server_fd6);
+        else reactor_remove(httpd->reactor, httpd->server_fd6);
+    }
+    httpd->server_watched = watch;
+}
 
-    assert(httpd);
+/* Sends heads and bodies of responses with as few sendmsg calls as the socket allows */
+static int
+httpd_send_responses(int fd, http_response_t **responses, int count)
+{
+    struct iovec iov[2 * HTTPD_MAX_QUEUED_RESPONSES];
+    struct msghdr msg;
+    const char *head, *body;
+    int headlen, bodylen;
+    int iovcnt = 0;
+
+    for (int i = 0; i < count; i++) {
+        head = http_response_get_head(responses[i], &headlen);
+        body = http_response_get_body(responses[i], &bodylen);
+        iov[iovcnt].iov_base = (void *) head;
+        iov[iovcnt++].iov_len = headlen;
+        if (body && bodylen > 0) {
+            iov[iovcnt].iov_base = (void *) body;
+            iov[iovcnt++].iov_len = bodylen;
+        }
+    }
 
-    while (1) {
-        fd_set rfds;
-        struct timeval tv;
-        int nfds=0;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    while (msg.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(fd, &msg, 0);
+        if (sent == -1) {
+            if (SOCKET_GET_ERROR() == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        /* Skip what was sent, a short send leaves the rest of the current part */
+        while (msg.msg_iovlen > 0 && (size_t) sent >= msg.msg_iov->iov_len) {
+            sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + sent;
+            msg.msg_iov->iov_len -= sent;
+        }
+    }
+    return 0;
+}
+
+/* Sends the responses queued on a connection, in the order their requests came in */
+static void
+httpd_flush_responses(httpd_t *httpd, http_connection_t *connection)
+{
+    if (!connection->queued_count) {
+        return;
+    }
+    if (httpd_send_responses(connection->socket_fd, connection->queued, connection->queued_count) < 0) {
+        logger_log(httpd->logger, LOGGER_ERR, "httpd error in sending data");
+    }
+    for (int i = 0; i < connection->queued_count; i++) {
+        http_response_destroy(connection->queued[i]);
+    }
+    connection->queued_count = 0;
+}
+
+/*
+ * Queues the response to a request and readies the connection for the next, returns -1 if the
+ * connection was closed. Responses go out once the pipelined requests read so far are answered.
+ */
+static int
+httpd_finish_request(httpd_t *httpd, http_connection_t *connection, http_response_t *response)
+{
+    http_request_reset(connection->request);
+
+    if (!response) {
+        logger_log(httpd->logger, LOGGER_WARNING, "httpd didn't get response");
+        return 0;
+    }
+    if (connection->queued_count == HTTPD_MAX_QUEUED_RESPONSES) {
+        httpd_flush_responses(httpd, connection);
+    }
+    connection->queued[connection->queued_count++] = response;
+    if (http_response_get_disconnect(response)) {
+        logger_log(httpd->logger, LOGGER_INFO, "Disconnecting on software request");
+        httpd_remove_connection(httpd, connection);
+        return -1;
+    }
+    return 0;
+}
+
+/* Runs on a worker, the connection is left alone by the httpd thread until async_done is seen */
+static void
+httpd_async_request(void *arg)
+{
+    http_connection_t *connection = arg;
+    httpd_t *httpd = connection->httpd;
+    http_response_t *response = NULL;
+
+    httpd->callbacks.conn_request(connection->user_data, connection->request, &response);
+
+    MUTEX_LOCK(httpd->async_mutex);
+    connection->async_response = response;
+    connection->async_done = 1;
+    MUTEX_UNLOCK(httpd->async_mutex);
+    reactor_wakeup(httpd->reactor);
+}
+
+/*
+ * Hands a complete request to the callbacks and sends the response. Returns -1 if the connection
+ * was closed and 1 if a worker took the request over, its response is sent by httpd_complete_async.
+ */
+static int
+httpd_respond(httpd_t *httpd, http_connection_t *connection)
+{
+    worker_pool_t *worker_pool = HTTPD_HOST(httpd)->worker_pool;
+    http_response_t *response = NULL;
+
+    if (worker_pool && httpd->callbacks.conn_offload &&
+        httpd->callbacks.conn_offload(connection->user_data, connection->request)) {
+        connection->offloaded = 1;
+        reactor_remove(httpd->reactor, connection->socket_fd);
+        if (!worker_pool_submit(worker_pool, &httpd_async_request, connection)) {
+            return 1;
+        }
+        /* All workers busy and the queue full, answer it here rather than drop it */
+        connection->offloaded = 0;
+        reactor_add(httpd->reactor, connection->socket_fd);
+    }
+
+    // Callback the received data to raop
+    httpd->callbacks.conn_request(connection->user_data, connection->request, &response);
+    return httpd_finish_request(httpd, connection, response);
+}
+
+/*
+ * Parses data, answering every request completed on the way, and sends the responses together
+ * at the end. The parser copies what it keeps of a request, so all of data is consumed unless a
+ * request is offloaded, then the rest is left in the connection buffer for later and 1 returned.
+ * Returns -1 if the connection was closed.
+ */
+static int
+httpd_parse(httpd_t *httpd, http_connection_t *connection, const char *data, int datalen)
+{
+    int offset = 0;
+
+    while (offset < datalen) {
+        int parsed;
         int ret;
 
-        MUTEX_LOCK(httpd->run_mutex);
-        if (!httpd->running) {
-            MUTEX_UNLOCK(httpd->run_mutex);
-            break;
+        /* The request is allocated once per connection and reset after each one */
+        if (!connection->request) {
+            connection->request = http_request_init();
+            assert(connection->request);
         }
-        MUTEX_UNLOCK(httpd->run_mutex);
 
-        /* Set timeout value to 5ms */
-        tv.tv_sec = 1;
-        tv.tv_usec = 5000;
-
-        /* Get the correct nfds value and set rfds */
-        FD_ZERO(&rfds);
-        if (httpd->open_connections < httpd->max_connections) {
-            if (httpd->server_fd4 != -1) {
-                FD_SET(httpd->server_fd4, &rfds);
-                if (nfds <= httpd->server_fd4) {
-                    nfds = httpd->server_fd4+1;
-                }
-            }
-            if (httpd->server_fd6 != -1) {
-                FD_SET(httpd->server_fd6, &rfds);
-                if (nfds <= httpd->server_fd6) {
-                    nfds = httpd->server_fd6+1;
-                }
-            }
+        /* Parse HTTP request from data read from connection */
+        parsed = http_request_add_data(connection->request, data + offset, datalen - offset);
+        if (parsed < 0) {
+            logger_log(httpd->logger, LOGGER_ERR, "httpd error in parsing: %s", http_request_get_error_name(connection->request));
+            httpd_remove_connection(httpd, connection);
+            return -1;
         }
-        for (i=0; i<httpd->max_connections; i++) {
-            int socket_fd;
-            if (!httpd->connections[i].connected) {
-                continue;
-            }
-            socket_fd = httpd->connections[i].socket_fd;
-            FD_SET(socket_fd, &rfds);
-            if (nfds <= socket_fd) {
-                nfds = socket_fd+1;
-            }
+        offset += parsed;
+
+        /* If request is finished, process and deallocate, pipelined requests follow in data */
+        if (!http_request_is_complete(connection->request)) {
+            logger_log(httpd->logger, LOGGER_DEBUG, "Request not complete, waiting for more data...");
+            break;
+        }
+        ret = httpd_respond(httpd, connection);
+        if (ret < 0) {
+            return -1;
+        } else if (ret > 0) {
+            connection->pending_offset = (data - connection->buffer) + offset;
+            connection->pending_length = datalen - offset;
+            httpd_flush_responses(httpd, connection);
+            return 1;
         }
+    }
+    httpd_flush_responses(httpd, connection);
+    return 0;
+}
 
-        ret = select(nfds, &rfds, NULL, NULL, &tv);
-        if (ret == 0) {
-            /* Timeout happened */
+/* Sends the responses workers have finished and goes on with what each connection had read since */
+static void
+httpd_complete_async(httpd_t *httpd)
+{
+    for (int i = 0; i < httpd->max_connections; i++) {
+        http_connection_t *connection = &httpd->connections[i];
+        http_response_t *response;
+
+        if (!connection->connected || !connection->offloaded) {
             continue;
-        } else if (ret == -1) {
-            logger_log(httpd->logger, LOGGER_ERR, "httpd error in select");
-            break;
         }
+        MUTEX_LOCK(httpd->async_mutex);
+        if (!connection->async_done) {
+            MUTEX_UNLOCK(httpd->async_mutex);
+            continue;
+        }
+        response = connection->async_response;
+        connection->async_response = NULL;
+        connection->async_done = 0;
+        MUTEX_UNLOCK(httpd->async_mutex);
 
-        if (httpd->open_connections < httpd->max_connections &&
-            httpd->server_fd4 != -1 && FD_ISSET(httpd->server_fd4, &rfds)) {
-            ret = httpd_accept_connection(httpd, httpd->server_fd4, 0);
-            if (ret == -1) {
-                logger_log(httpd->logger, LOGGER_ERR, "httpd error in accept ipv4");
-                break;
-            } else if (ret == 0) {
-                continue;
-            }
+        connection->offloaded = 0;
+        if (httpd_finish_request(httpd, connection, response) < 0) {
+            continue;
         }
-        if (httpd->open_connections < httpd->max_connections &&
-            httpd->server_fd6 != -1 && FD_ISSET(httpd->server_fd6, &rfds)) {
-            ret = httpd_accept_connection(httpd, httpd->server_fd6, 1);
-            if (ret == -1) {
-                logger_log(httpd->logger, LOGGER_ERR, "httpd error in accept ipv6");
-                break;
-            } else if (ret == 0) {
+        if (connection->pending_length > 0) {
+            int ret = httpd_parse(httpd, connection, connection->buffer + connection->pending_offset,
+                                  connection->pending_length);
+            if (ret != 0) {
                 continue;
             }
+        } else {
+            httpd_flush_responses(httpd, connection);
         }
-        for (i=0; i<httpd->max_connections; i++) {
-            http_connection_t *connection = &httpd->connections[i];
+        reactor_add(httpd->reactor, connection->socket_fd);
+    }
+}
 
-            if (!connection->connected) {
+/*
+ * Reads everything the socket has, not just one chunk per wakeup, so a request body arriving
+ * in several segments is parsed in one go. The first recv is the one the reactor promised data
+ * for, the socket is drained without blocking from there.
+ */
+static void
+httpd_receive(httpd_t *httpd, http_connection_t *connection)
+{
+    int flags = 0;
+
+    if (!connection->buffer) {
+        connection->buffer = mem_account_malloc(MEM_TAG_CONNECTIONS, HTTPD_READ_BUFFER_SIZE);
+        if (!connection->buffer) {
+            logger_log(httpd->logger, LOGGER_ERR, "httpd out of memory for socket %d", connection->socket_fd);
+            httpd_remove_connection(httpd, connection);
+            return;
+        }
+        connection->buffer_size = HTTPD_READ_BUFFER_SIZE;
+    }
+
+    logger_log(httpd->logger, LOGGER_DEBUG, "httpd receiving on socket %d", connection->socket_fd);
+    connection->last_active = ++httpd->activity;
+    while (1) {
+        int ret = recv(connection->socket_fd, connection->buffer, connection->buffer_size, flags);
+        if (ret == 0) {
+            logger_log(httpd->logger, LOGGER_DEBUG, "Connection closed for socket %d", connection->socket_fd);
+            httpd_remove_connection(httpd, connection);
+            return;
+        } else if (ret < 0) {
+            if (errno == EINTR) {
                 continue;
+            } else if (flags && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
             }
-            if (!FD_ISSET(connection->socket_fd, &rfds)) {
-                continue;
+            logger_log(httpd->logger, LOGGER_ERR, "httpd error in receiving on socket %d", connection->socket_fd);
+            httpd_remove_connection(httpd, connection);
+            return;
+        }
+        if (httpd_parse(httpd, connection, connection->buffer, ret) != 0) {
+            return;
+        }
+        /* A short read already emptied the socket */
+        if (ret < connection->buffer_size) {
+            return;
+        }
+        if (connection->buffer_size < HTTPD_READ_BUFFER_MAX) {
+            char *buffer = mem_account_realloc(MEM_TAG_CONNECTIONS, connection->buffer, connection->buffer_size * 2);
+            if (buffer) {
+                connection->buffer = buffer;
+                connection->buffer_size *= 2;
             }
+        }
+        flags = MSG_DONTWAIT;
+    }
+}
 
-            /* If not in the middle of request, allocate one */
-            if (!connection->request) {
-                connection->request = http_request_init();
-                assert(connection->request);
-            }
+/* Accepts and reads what the wakeup found ready, -1 if the server sockets failed */
+static int
+httpd_serve(httpd_t *httpd, int *ready, int nready)
+{
+    int ret;
+    int i;
 
-            logger_log(httpd->logger, LOGGER_DEBUG, "httpd receiving on socket %d", connection->socket_fd);
-            ret = recv(connection->socket_fd, buffer, sizeof(buffer), 0);
-            if (ret == 0) {
-                logger_log(httpd->logger, LOGGER_INFO, "Connection closed for socket %d", connection->socket_fd);
-                httpd_remove_connection(httpd, connection);
-                continue;
-            }
+    if (httpd->server_fd4 != -1 && reactor_is_ready(ready, nready, httpd->server_fd4) && httpd_has_room(httpd)) {
+        ret = httpd_accept_connection(httpd, httpd->server_fd4, 0);
+        if (ret == -1) {
+            logger_log(httpd->logger, LOGGER_ERR, "httpd error in accept ipv4");
+            return -1;
+        } else if (ret == 0) {
+            return 0;
+        }
+    }
+    if (httpd->server_fd6 != -1 && reactor_is_ready(ready, nready, httpd->server_fd6) && httpd_has_room(httpd)) {
+        ret = httpd_accept_connection(httpd, httpd->server_fd6, 1);
+        if (ret == -1) {
+            logger_log(httpd->logger, LOGGER_ERR, "httpd error in accept ipv6");
+            return -1;
+        } else if (ret == 0) {
+            return 0;
+        }
+    }
+    for (i=0; i<httpd->max_connections; i++) {
+        http_connection_t *connection = &httpd->connections[i];
 
-            /* Parse HTTP request from data read from connection */
-            http_request_add_data(connection->request, buffer, ret);
-            if (http_request_has_error(connection->request)) {
-                logger_log(httpd->logger, LOGGER_ERR, "httpd error in parsing: %s", http_request_get_error_name(connection->request));
-                httpd_remove_connection(httpd, connection);
-                continue;
-            }
+        if (!connection->connected) {
+            continue;
+        }
+        if (!reactor_is_ready(ready, nready, connection->socket_fd)) {
+            continue;
+        }
 
-            /* If request is finished, process and deallocate */
-            if (http_request_is_complete(connection->request)) {
-                http_response_t *response = NULL;
-                // Callback the received data to raop
-                httpd->callbacks.conn_request(connection->user_data, connection->request, &response);
-                http_request_destroy(connection->request);
-                connection->request = NULL;
-
-                if (response) {
-                    const char *data;
-                    int datalen;
-                    int written;
-                    int ret;
-
-                    /* Get response data and datalen */
-                    data = http_response_get_data(response, &datalen);
-
-                    written = 0;
-                    while (written < datalen) {
-                        ret = send(connection->socket_fd, data+written, datalen-written, 0);
-                        if (ret == -1) {
-                            logger_log(httpd->logger, LOGGER_ERR, "httpd error in sending data");
-                            break;
-                        }
-                        written += ret;
-                    }
-
-                    if (http_response_get_disconnect(response)) {
-                        logger_log(httpd->logger, LOGGER_INFO, "Disconnecting on software request");
-                        httpd_remove_connection(httpd, connection);
-                    }
-                } else {
-                    logger_log(httpd->logger, LOGGER_WARNING, "httpd didn't get response");
-                }
-                http_response_destroy(response);
-            } else {
-                logger_log(httpd->logger, LOGGER_DEBUG, "Request not complete, waiting for more data...");
-            }
+        httpd_receive(httpd, connection);
+    }
+    return 0;
+}
+
+/* Closes the connections and server sockets, no worker may be answering a request any more */
+static void
+httpd_close(httpd_t *httpd)
+{
+    int i;
+
+    for (i=0; i<httpd->max_connections; i++) {
+        http_connection_t *connection = &httpd->connections[i];
+
+        if (connection->offloaded) {
+            http_response_destroy(connection->async_response);
+            connection->async_response = NULL;
+            connection->async_done = 0;
+            connection->offloaded = 0;
         }
     }
 
@@ -349,6 +682,7 @@ httpd_thread(void *arg)
     }
 
     /* Close server sockets since they are not used any more */
+    httpd_watch_server_sockets(httpd, 0);
     if (httpd->server_fd4 != -1) {
         shutdown(httpd->server_fd4, SHUT_RDWR);
         closesocket(httpd->server_fd4);
@@ -359,10 +693,148 @@ httpd_thread(void *arg)
         closesocket(httpd->server_fd6);
         httpd->server_fd6 = -1;
     }
+}
+
+static void
+httpd_release_guest(httpd_t *guest)
+{
+    httpd_close(guest);
+
+    MUTEX_LOCK(guest->run_mutex);
+    ATOMIC_STORE(guest->running, 0);
+    guest->joined = 1;
+    COND_BROADCAST(guest->joined_cond);
+    MUTEX_UNLOCK(guest->run_mutex);
+}
+
+/*
+ * On the host thread, whether the guest is to be served. A guest httpd_stop is waiting for is
+ * closed here, once the workers are done with its requests, their completion wakes the host up.
+ */
+static int
+httpd_guest_serving(httpd_t *guest)
+{
+    int stopping;
+    int i;
+
+    MUTEX_LOCK(guest->run_mutex);
+    if (ATOMIC_LOAD(guest->running)) {
+        MUTEX_UNLOCK(guest->run_mutex);
+        return 1;
+    }
+    stopping = !guest->joined;
+    MUTEX_UNLOCK(guest->run_mutex);
+
+    if (stopping) {
+        MUTEX_LOCK(guest->async_mutex);
+        for (i=0; i<guest->max_connections; i++) {
+            if (guest->connections[i].offloaded && !guest->connections[i].async_done) {
+                stopping = 0;
+            }
+        }
+        MUTEX_UNLOCK(guest->async_mutex);
+        if (stopping) {
+            httpd_release_guest(guest);
+        }
+    }
+    return 0;
+}
+
+/* Closes the connections conn_is_idle gave up on */
+static void
+httpd_reap_idle(httpd_t *httpd)
+{
+    if (!httpd->callbacks.conn_is_idle) {
+        return;
+    }
+    for (int i = 0; i < httpd->max_connections; i++) {
+        http_connection_t *connection = &httpd->connections[i];
+        if (!connection->connected || connection->offloaded ||
+            !httpd->callbacks.conn_is_idle(connection->user_data)) {
+            continue;
+        }
+        logger_log(httpd->logger, LOGGER_INFO, "Closing idle connection for socket %d", connection->socket_fd);
+        httpd_remove_connection(httpd, connection);
+    }
+}
+
+static THREAD_RETVAL
+httpd_thread(void *arg)
+{
+    httpd_t *httpd = arg;
+    httpd_t *served;
+    int ready[HTTPD_MAX_READY];
+    int nready;
+    int timeout;
+    int failed = 0;
+
+    assert(httpd);
+
+    while (!failed) {
+        if (!ATOMIC_LOAD(httpd->running)) {
+            break;
+        }
+
+        /* Between rounds, so no socket reaped here is still in the ready list */
+        httpd_reap_idle(httpd);
+        httpd_watch_server_sockets(httpd, httpd_has_room(httpd));
+        timeout = httpd->callbacks.conn_is_idle ? HTTPD_IDLE_CHECK_MS : -1;
+        for (served = httpd->guests; served; served = served->next_guest) {
+            if (httpd_guest_serving(served)) {
+                httpd_reap_idle(served);
+                httpd_watch_server_sockets(served, httpd_has_room(served));
+                if (served->callbacks.conn_is_idle) {
+                    timeout = HTTPD_IDLE_CHECK_MS;
+                }
+            }
+        }
+
+        nready = reactor_wait(httpd->reactor, ready, HTTPD_MAX_READY, timeout);
+        if (httpd->worker_pool) {
+            httpd_complete_async(httpd);
+            for (served = httpd->guests; served; served = served->next_guest) {
+                if (ATOMIC_LOAD(served->running)) {
+                    httpd_complete_async(served);
+                }
+            }
+        }
+        if (nready == 0) {
+            /* Woken up, recheck the running state */
+            continue;
+        } else if (nready == -1) {
+            logger_log(httpd->logger, LOGGER_ERR, "httpd error in reactor wait");
+            break;
+        }
+
+        if (httpd_serve(httpd, ready, nready) < 0) {
+            failed = 1;
+        }
+        for (served = httpd->guests; served; served = served->next_guest) {
+            if (ATOMIC_LOAD(served->running) && httpd_serve(served, ready, nready) < 0) {
+                /* A guest failing alone is closed on the next round, as if httpd_stop asked for it */
+                MUTEX_LOCK(served->run_mutex);
+                ATOMIC_STORE(served->running, 0);
+                MUTEX_UNLOCK(served->run_mutex);
+            }
+        }
+    }
+
+    /* Let the workers finish, their responses are not sent any more */
+    worker_pool_destroy(httpd->worker_pool);
+    httpd->worker_pool = NULL;
+    httpd_close(httpd);
+    for (served = httpd->guests; served; served = served->next_guest) {
+        MUTEX_LOCK(served->run_mutex);
+        int joined = served->joined;
+        MUTEX_UNLOCK(served->run_mutex);
+        if (!joined) {
+            httpd_release_guest(served);
+        }
+    }
 
     // Ensure running reflects the actual state
     MUTEX_LOCK(httpd->run_mutex);
-    httpd->running = 0;
+    ATOMIC_STORE(httpd->running, 0);
     MUTEX_UNLOCK(httpd->run_mutex);
 
     logger_log(httpd->logger, LOGGER_DEBUG, "Exiting HTTP thread");
@@ -370,25 +842,54 @@ httpd_thread(void *arg)
     return 0;
 }
 
-int
-httpd_start(httpd_t *httpd, unsigned short *port)
+void
+httpd_set_host(httpd_t *httpd, httpd_t *host)
 {
-    /* How many connection attempts are kept in queue */
-    int backlog = 5;
+    assert(httpd);
+    assert(host);
+    assert(httpd != host && !httpd->host && !httpd->guests && !host->host);
+    assert(!httpd_is_running(httpd) && !httpd_is_running(host));
+
+    reactor_destroy(httpd->reactor);
+    httpd->reactor = host->reactor;
+    httpd->host = host;
+    httpd->next_guest = host->guests;
+    host->guests = httpd;
+}
 
+void
+httpd_set_listen_fd(httpd_t *httpd, int fd)
+{
     assert(httpd);
-    assert(port);
+    assert(!httpd_is_running(httpd));
 
-    MUTEX_LOCK(httpd->run_mutex);
-    if (httpd->running || !httpd->joined) {
-        MUTEX_UNLOCK(httpd->run_mutex);
+    httpd->listen_fd = fd;
+}
+
+static int
+httpd_listen(httpd_t *httpd, unsigned short *port)
+{
+    /* How many connection attempts are kept in queue */
+    int backlog = 5;
+
+    if (httpd->listen_fd != -1) {
+        /* Its owner chose address and backlog, it may well be dual-stack */
+        *port = netutils_get_local_port(httpd->listen_fd);
+        if (!*port) {
+            logger_log(httpd->logger, LOGGER_ERR, "Error reading the port of the passed socket %d", SOCKET_GET_ERROR());
+            return -1;
+        }
+        /* Closed along with the connections, a restart binds a port of its own */
+        httpd->server_fd4 = httpd->listen_fd;
+        httpd->server_fd6 = -1;
+        httpd->listen_fd = -1;
+        logger_log(httpd->logger, LOGGER_INFO, "Using the passed server socket");
         return 0;
     }
 
     httpd->server_fd4 = netutils_init_socket(port, 0, 0);
     if (httpd->server_fd4 == -1) {
         logger_log(httpd->logger, LOGGER_ERR, "Error initialising socket %d", SOCKET_GET_ERROR());
-        MUTEX_UNLOCK(httpd->run_mutex);
         return -1;
     }
     httpd->server_fd6 = -1;/*= netutils_init_socket(port, 1, 0);
@@ -401,22 +902,83 @@ httpd_start(httpd_t *httpd, unsigned short *port)
         logger_log(httpd->logger, LOGGER_ERR, "Error listening to IPv4 socket");
         closesocket(httpd->server_fd4);
         closesocket(httpd->server_fd6);
-        MUTEX_UNLOCK(httpd->run_mutex);
         return -2;
     }
     if (httpd->server_fd6 != -1 && listen(httpd->server_fd6, backlog) == -1) {
         logger_log(httpd->logger, LOGGER_ERR, "Error listening to IPv6 socket");
         closesocket(httpd->server_fd4);
         closesocket(httpd->server_fd6);
-        MUTEX_UNLOCK(httpd->run_mutex);
         return -2;
     }
     logger_log(httpd->logger, LOGGER_INFO, "Initialized server socket(s)");
+    return 0;
+}
+
+/* The host thread picks the guest's server sockets up on its next round */
+static int
+httpd_start_guest(httpd_t *httpd, unsigned short *port)
+{
+    httpd_t *host = httpd->host;
+    int ret;
+
+    MUTEX_LOCK(host->run_mutex);
+    if (!ATOMIC_LOAD(host->running)) {
+        MUTEX_UNLOCK(host->run_mutex);
+        logger_log(httpd->logger, LOGGER_ERR, "Cannot start httpd before its host");
+        return -1;
+    }
+    ret = httpd_listen(httpd, port);
+    if (ret < 0) {
+        MUTEX_UNLOCK(host->run_mutex);
+        return ret;
+    }
+    ATOMIC_STORE(httpd->running, 1);
+    httpd->joined = 0;
+    MUTEX_UNLOCK(host->run_mutex);
+
+    reactor_wakeup(httpd->reactor);
+    return 1;
+}
+
+int
+httpd_start(httpd_t *httpd, unsigned short *port)
+{
+    int ret;
+
+    assert(httpd);
+    assert(port);
+
+    MUTEX_LOCK(httpd->run_mutex);
+    if (ATOMIC_LOAD(httpd->running) || !httpd->joined) {
+        MUTEX_UNLOCK(httpd->run_mutex);
+        return 0;
+    }
+    if (httpd->host) {
+        ret = httpd_start_guest(httpd, port);
+        MUTEX_UNLOCK(httpd->run_mutex);
+        return ret;
+    }
+
+    ret = httpd_listen(httpd, port);
+    if (ret < 0) {
+        MUTEX_UNLOCK(httpd->run_mutex);
+        return ret;
+    }
+
+    if (httpd->callbacks.conn_offload) {
+        httpd->worker_pool = worker_pool_init(httpd->logger, HTTPD_WORKER_THREADS, httpd->max_connections);
+        if (!httpd->worker_pool) {
+            logger_log(httpd->logger, LOGGER_WARNING, "Answering all requests on the httpd thread");
+        }
+    }
 
     /* Set values correctly and create new thread */
-    httpd->running = 1;
+    ATOMIC_STORE(httpd->running, 1);
     httpd->joined = 0;
     THREAD_CREATE(httpd->thread, httpd_thread, httpd);
+    if (httpd->thread && thread_apply_role(httpd->thread, THREAD_ROLE_HTTPD) < 0) {
+        logger_log(httpd->logger, LOGGER_WARNING, "Could not apply the scheduling settings of the httpd thread");
+    }
     MUTEX_UNLOCK(httpd->run_mutex);
 
     return 1;
@@ -430,7 +992,7 @@ httpd_is_running(httpd_t *httpd)
     assert(httpd);
 
     MUTEX_LOCK(httpd->run_mutex);
-    running = httpd->running || !httpd->joined;
+    running = ATOMIC_LOAD(httpd->running) || !httpd->joined;
     MUTEX_UNLOCK(httpd->run_mutex);
 
     return running;
@@ -441,18 +1003,32 @@ httpd_stop(httpd_t *httpd)
 {
     assert(httpd);
 
+    if (httpd->host) {
+        /* Closed by the host thread, also when it already stopped serving the guest by itself */
+        MUTEX_LOCK(httpd->run_mutex);
+        if (!httpd->joined) {
+            ATOMIC_STORE(httpd->running, 0);
+            reactor_wakeup(httpd->reactor);
+            while (!httpd->joined) {
+                COND_WAIT(httpd->joined_cond, httpd->run_mutex);
+            }
+        }
+        MUTEX_UNLOCK(httpd->run_mutex);
+        return;
+    }
+
     MUTEX_LOCK(httpd->run_mutex);
-    if (!httpd->running || httpd->joined) {
+    if (!ATOMIC_LOAD(httpd->running) || httpd->joined) {
         MUTEX_UNLOCK(httpd->run_mutex);
         return;
     }
-    httpd->running = 0;
+    ATOMIC_STORE(httpd->running, 0);
     MUTEX_UNLOCK(httpd->run_mutex);
 
+    reactor_wakeup(httpd->reactor);
     THREAD_JOIN(httpd->thread);
 
     MUTEX_LOCK(httpd->run_mutex);
     httpd->joined = 1;
     MUTEX_UNLOCK(httpd->run_mutex);
 }
-
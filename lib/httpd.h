@@ -26,11 +26,27 @@ struct httpd_callbacks_s {
 	void* (*conn_init)(void *opaque, unsigned char *local, int locallen, unsigned char *remote, int remotelen);
 	void  (*conn_request)(void *ptr, http_request_t *request, http_response_t **response);
 	void  (*conn_destroy)(void *ptr);
+	/* Optional, nonzero if conn_request should answer this request on a worker thread */
+	int   (*conn_offload)(void *ptr, http_request_t *request);
+	/* Optional, nonzero while the connection holds nothing worth keeping, like one that only probed
+	 * GET /info. With every slot taken, the least recently active of these is closed for a new one. */
+	int   (*conn_is_probe)(void *ptr);
+	/* Optional, nonzero once the connection has gone quiet for too long, it is then closed. Asked on
+	 * the httpd thread about once a second, never while a worker answers one of its requests. */
+	int   (*conn_is_idle)(void *ptr);
 };
 typedef struct httpd_callbacks_s httpd_callbacks_t;
 
 
 httpd_t *httpd_init(logger_t *logger, httpd_callbacks_t *callbacks, int max_connections);
+/*
+ * Serves httpd on the thread of host, with its reactor and workers, instead of a thread of its
+ * own. Call while both are stopped. The guest starts only while the host runs, the host stopping
+ * closes its guests too, and guests are destroyed before their host and while it is stopped.
+ */
+void httpd_set_host(httpd_t *httpd, httpd_t *host);
+/* Serves on fd, a socket already listening, instead of binding a port on the next start. Call while stopped. */
+void httpd_set_listen_fd(httpd_t *httpd, int fd);
 
 int httpd_is_running(httpd_t *httpd);
 
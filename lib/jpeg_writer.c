@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "jpeg_writer.h"
+
+static const uint8_t jpeg_zigzag[64] = {
+    0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+/* Annex K.1 and K.2, in natural order */
+static const uint8_t jpeg_luma_quant[64] = {
+    16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99,
+};
+static const uint8_t jpeg_chroma_quant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+/* Annex K.3 to K.6, code lengths 1 to 16 and the symbols in code order */
+static const uint8_t jpeg_dc_luma_bits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t jpeg_dc_chroma_bits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t jpeg_dc_values[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const uint8_t jpeg_ac_luma_bits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t jpeg_ac_luma_values[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+static const uint8_t jpeg_ac_chroma_bits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t jpeg_ac_chroma_values[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa,
+};
+
+typedef struct jpeg_huffman_s {
+    uint16_t codes[256];
+    uint8_t lengths[256];
+} jpeg_huffman_t;
+
+typedef struct jpeg_writer_s {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+    int failed;
+
+    uint32_t bits;
+    int bit_count;
+
+    /* Quantization tables in natural order, and DCT basis functions scaled for the AAN-free float DCT */
+    uint8_t quant[2][64];
+    float cosines[8][8];
+    jpeg_huffman_t dc[2];
+    jpeg_huffman_t ac[2];
+} jpeg_writer_t;
+
+static void
+jpeg_put_bytes(jpeg_writer_t *writer, const void *bytes, size_t count)
+{
+    if (writer->failed) {
+        return;
+    }
+    if (writer->size + count > writer->capacity) {
+        size_t capacity = writer->capacity * 2 + count;
+        unsigned char *data = realloc(writer->data, capacity);
+        if (!data) {
+            writer->failed = 1;
+            return;
+        }
+        writer->data = data;
+        writer->capacity = capacity;
+    }
+    memcpy(writer->data + writer->size, bytes, count);
+    writer->size += count;
+}
+
+static void
+jpeg_put_byte(jpeg_writer_t *writer, uint8_t byte)
+{
+    jpeg_put_bytes(writer, &byte, 1);
+}
+
+static void
+jpeg_put_short(jpeg_writer_t *writer, int value)
+{
+    jpeg_put_byte(writer, (uint8_t) (value >> 8));
+    jpeg_put_byte(writer, (uint8_t) value);
+}
+
+/* Entropy coded data, a 0xFF byte is followed by a stuffed 0 */
+static void
+jpeg_put_bits(jpeg_writer_t *writer, uint32_t value, int count)
+{
+    writer->bits = (writer->bits << count) | (value & ((1u << count) - 1));
+    writer->bit_count += count;
+    while (writer->bit_count >= 8) {
+        uint8_t byte = (uint8_t) (writer->bits >> (writer->bit_count - 8));
+        jpeg_put_byte(writer, byte);
+        if (byte == 0xff) {
+            jpeg_put_byte(writer, 0);
+        }
+        writer->bit_count -= 8;
+    }
+}
+
+static void
+jpeg_flush_bits(jpeg_writer_t *writer)
+{
+    if (writer->bit_count > 0) {
+        // Padded with 1 bits
+        jpeg_put_bits(writer, 0x7f, 8 - writer->bit_count);
+    }
+}
+
+static void
+jpeg_build_huffman(jpeg_huffman_t *table, const uint8_t bits[16], const uint8_t *values)
+{
+    uint16_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; length++) {
+        for (int i = 0; i < bits[length - 1]; i++) {
+            table->codes[values[k]] = code++;
+            table->lengths[values[k]] = (uint8_t) length;
+            k++;
+        }
+        code <<= 1;
+    }
+}
+
+static void
+jpeg_scale_quant(uint8_t *table, const uint8_t *base, int quality)
+{
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (int i = 0; i < 64; i++) {
+        int q = (base[i] * scale + 50) / 100;
+        table[i] = (uint8_t) (q < 1 ? 1 : q > 255 ? 255 : q);
+    }
+}
+
+static void
+jpeg_write_headers(jpeg_writer_t *writer, int width, int height)
+{
+    static const uint8_t jfif[] = { 0xff, 0xe0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+
+    jpeg_put_short(writer, 0xffd8);
+    jpeg_put_bytes(writer, jfif, sizeof(jfif));
+
+    jpeg_put_short(writer, 0xffdb);
+    jpeg_put_short(writer, 2 + 2 * 65);
+    for (int t = 0; t < 2; t++) {
+        jpeg_put_byte(writer, (uint8_t) t);
+        for (int i = 0; i < 64; i++) {
+            jpeg_put_byte(writer, writer->quant[t][jpeg_zigzag[i]]);
+        }
+    }
+
+    // Luma sampled 2x2, both chroma components 1x1
+    jpeg_put_short(writer, 0xffc0);
+    jpeg_put_short(writer, 8 + 3 * 3);
+    jpeg_put_byte(writer, 8);
+    jpeg_put_short(writer, height);
+    jpeg_put_short(writer, width);
+    jpeg_put_byte(writer, 3);
+    const uint8_t components[9] = { 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+    jpeg_put_bytes(writer, components, sizeof(components));
+
+    const struct {
+        uint8_t id;
+        const uint8_t *bits;
+        const uint8_t *values;
+        int count;
+    } tables[4] = {
+        { 0x00, jpeg_dc_luma_bits, jpeg_dc_values, 12 },
+        { 0x10, jpeg_ac_luma_bits, jpeg_ac_luma_values, 162 },
+        { 0x01, jpeg_dc_chroma_bits, jpeg_dc_values, 12 },
+        { 0x11, jpeg_ac_chroma_bits, jpeg_ac_chroma_values, 162 },
+    };
+    jpeg_put_short(writer, 0xffc4);
+    jpeg_put_short(writer, 2 + 4 * 17 + 2 * 12 + 2 * 162);
+    for (int t = 0; t < 4; t++) {
+        jpeg_put_byte(writer, tables[t].id);
+        jpeg_put_bytes(writer, tables[t].bits, 16);
+        jpeg_put_bytes(writer, tables[t].values, tables[t].count);
+    }
+
+    const uint8_t scan[] = { 0xff, 0xda, 0, 12, 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+    jpeg_put_bytes(writer, scan, sizeof(scan));
+}
+
+/* Number of bits of value and their representation, as for the DC differences and AC coefficients */
+static int
+jpeg_category(int value, uint32_t *bits)
+{
+    int magnitude = value < 0 ? -value : value;
+    int category = 0;
+    while (magnitude >> category) {
+        category++;
+    }
+    *bits = (uint32_t) (value < 0 ? value - 1 : value);
+    return category;
+}
+
+/* Transforms, quantizes and codes one block of samples, returns its DC for the next block's prediction */
+static int
+jpeg_encode_block(jpeg_writer_t *writer, const uint8_t block[64], int table, int previous_dc)
+{
+    float rows[64];
+    int coefficients[64];
+
+    for (int y = 0; y < 8; y++) {
+        for (int u = 0; u < 8; u++) {
+            float sum = 0.0f;
+            for (int x = 0; x < 8; x++) {
+                sum += ((float) block[y * 8 + x] - 128.0f) * writer->cosines[u][x];
+            }
+            rows[y * 8 + u] = sum;
+        }
+    }
+    for (int u = 0; u < 8; u++) {
+        for (int v = 0; v < 8; v++) {
+            float sum = 0.0f;
+            for (int y = 0; y < 8; y++) {
+                sum += rows[y * 8 + u] * writer->cosines[v][y];
+            }
+            coefficients[v * 8 + u] = (int) lrintf(sum / writer->quant[table][v * 8 + u]);
+        }
+    }
+
+    const jpeg_huffman_t *dc = &writer->dc[table];
+    const jpeg_huffman_t *ac = &writer->ac[table];
+    uint32_t bits;
+    int category = jpeg_category(coefficients[0] - previous_dc, &bits);
+    jpeg_put_bits(writer, dc->codes[category], dc->lengths[category]);
+    if (category) {
+        jpeg_put_bits(writer, bits, category);
+    }
+
+    int run = 0;
+    for (int i = 1; i < 64; i++) {
+        int coefficient = coefficients[jpeg_zigzag[i]];
+        if (coefficient == 0) {
+            run++;
+            continue;
+        }
+        while (run >= 16) {
+            jpeg_put_bits(writer, ac->codes[0xf0], ac->lengths[0xf0]);
+            run -= 16;
+        }
+        category = jpeg_category(coefficient, &bits);
+        int symbol = (run << 4) | category;
+        jpeg_put_bits(writer, ac->codes[symbol], ac->lengths[symbol]);
+        jpeg_put_bits(writer, bits, category);
+        run = 0;
+    }
+    if (run) {
+        jpeg_put_bits(writer, ac->codes[0x00], ac->lengths[0x00]);
+    }
+    return coefficients[0];
+}
+
+/* An 8x8 block of a plane from x, y on, with the edge pixels repeated beyond its size */
+static void
+jpeg_load_block(uint8_t block[64], const uint8_t *plane, int stride, int width, int height, int x, int y)
+{
+    for (int j = 0; j < 8; j++) {
+        const uint8_t *row = plane + (size_t) (y + j < height ? y + j : height - 1) * stride;
+        for (int i = 0; i < 8; i++) {
+            block[j * 8 + i] = row[x + i < width ? x + i : width - 1];
+        }
+    }
+}
+
+int
+jpeg_write_yuv420(const uint8_t *y, int y_stride, const uint8_t *u, const uint8_t *v, int uv_stride,
+                  int width, int height, int quality, unsigned char **jpeg)
+{
+    jpeg_writer_t *writer;
+    uint8_t block[64];
+    int dc[3] = { 0, 0, 0 };
+
+    if (width <= 0 || height <= 0 || width > 0xffff || height > 0xffff) {
+        return -1;
+    }
+    quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
+
+    writer = calloc(1, sizeof(jpeg_writer_t));
+    if (!writer) {
+        return -1;
+    }
+    writer->capacity = (size_t) width * height / 4 + 1024;
+    writer->data = malloc(writer->capacity);
+    if (!writer->data) {
+        free(writer);
+        return -1;
+    }
+    jpeg_scale_quant(writer->quant[0], jpeg_luma_quant, quality);
+    jpeg_scale_quant(writer->quant[1], jpeg_chroma_quant, quality);
+    jpeg_build_huffman(&writer->dc[0], jpeg_dc_luma_bits, jpeg_dc_values);
+    jpeg_build_huffman(&writer->ac[0], jpeg_ac_luma_bits, jpeg_ac_luma_values);
+    jpeg_build_huffman(&writer->dc[1], jpeg_dc_chroma_bits, jpeg_dc_values);
+    jpeg_build_huffman(&writer->ac[1], jpeg_ac_chroma_bits, jpeg_ac_chroma_values);
+    for (int k = 0; k < 8; k++) {
+        float scale = k == 0 ? sqrtf(0.125f) : 0.5f;
+        for (int n = 0; n < 8; n++) {
+            writer->cosines[k][n] = scale * cosf((float) ((2 * n + 1) * k) * (float) M_PI / 16.0f);
+        }
+    }
+
+    jpeg_write_headers(writer, width, height);
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    for (int my = 0; my < height; my += 16) {
+        for (int mx = 0; mx < width; mx += 16) {
+            for (int b = 0; b < 4; b++) {
+                int bx = mx + (b & 1) * 8;
+                int by = my + (b >> 1) * 8;
+                // Blocks wholly beyond the picture still have to be there, they repeat its edge
+                jpeg_load_block(block, y, y_stride, width, height, bx < width ? bx : width - 1, by < height ? by : height - 1);
+                dc[0] = jpeg_encode_block(writer, block, 0, dc[0]);
+            }
+            jpeg_load_block(block, u, uv_stride, chroma_width, chroma_height, mx / 2, my / 2);
+            dc[1] = jpeg_encode_block(writer, block, 1, dc[1]);
+            jpeg_load_block(block, v, uv_stride, chroma_width, chroma_height, mx / 2, my / 2);
+            dc[2] = jpeg_encode_block(writer, block, 1, dc[2]);
+        }
+    }
+    jpeg_flush_bits(writer);
+    jpeg_put_short(writer, 0xffd9);
+
+    int size = writer->failed ? -1 : (int) writer->size;
+    if (size < 0) {
+        free(writer->data);
+    } else {
+        *jpeg = writer->data;
+    }
+    free(writer);
+    return size;
+}
+
+int
+jpeg_write_rgb(const uint8_t *pixels, int stride, int bytes_per_pixel, int width, int height, int quality,
+               unsigned char **jpeg)
+{
+    if (width <= 0 || height <= 0 || bytes_per_pixel < 3) {
+        return -1;
+    }
+    int chroma_width = (width + 1) / 2;
+    int chroma_height = (height + 1) / 2;
+    size_t luma_size = (size_t) width * height;
+    size_t chroma_size = (size_t) chroma_width * chroma_height;
+    uint8_t *planes = malloc(luma_size + 2 * chroma_size);
+    if (!planes) {
+        return -1;
+    }
+    uint8_t *y = planes;
+    uint8_t *u = planes + luma_size;
+    uint8_t *v = u + chroma_size;
+
+    // BT.601 full range as JFIF has it, chroma averaged over each 2x2 square
+    for (int j = 0; j < height; j++) {
+        const uint8_t *p = pixels + (size_t) j * stride;
+        for (int i = 0; i < width; i++, p += bytes_per_pixel) {
+            y[(size_t) j * width + i] = (uint8_t) ((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+        }
+    }
+    for (int j = 0; j < chroma_height; j++) {
+        for (int i = 0; i < chroma_width; i++) {
+            int r = 0, g = 0, b = 0, count = 0;
+            for (int dy = 0; dy < 2 && 2 * j + dy < height; dy++) {
+                for (int dx = 0; dx < 2 && 2 * i + dx < width; dx++) {
+                    const uint8_t *p = pixels + (size_t) (2 * j + dy) * stride + (size_t) (2 * i + dx) * bytes_per_pixel;
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                    count++;
+                }
+            }
+            r /= count;
+            g /= count;
+            b /= count;
+            int cb = (-43 * r - 85 * g + 128 * b + 128) / 256 + 128;
+            int cr = (128 * r - 107 * g - 21 * b + 128) / 256 + 128;
+            u[(size_t) j * chroma_width + i] = (uint8_t) (cb < 0 ? 0 : cb > 255 ? 255 : cb);
+            v[(size_t) j * chroma_width + i] = (uint8_t) (cr < 0 ? 0 : cr > 255 ? 255 : cr);
+        }
+    }
+
+    int size = jpeg_write_yuv420(y, width, u, v, chroma_width, width, height, quality, jpeg);
+    free(planes);
+    return size;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef JPEG_WRITER_H
+#define JPEG_WRITER_H
+
+#include <stdint.h>
+
+/*
+ * A small baseline JPEG encoder for thumbnails, 4:2:0 with the example tables of ITU-T T.81
+ * Annex K. Meant for pictures of a few hundred pixels across, where it takes a millisecond or
+ * two, so renderers that can read a picture back need no JPEG library for it.
+ */
+
+/**
+ * Encodes 8 bit 4:2:0 planes, the chroma planes half the size of the luma plane rounded up,
+ * with quality 1 to 100 as in libjpeg. Returns the size of the malloc'd *jpeg, or -1.
+ */
+int jpeg_write_yuv420(const uint8_t *y, int y_stride, const uint8_t *u, const uint8_t *v, int uv_stride,
+                      int width, int height, int quality, unsigned char **jpeg);
+
+/* jpeg_write_yuv420 for packed pixels of bytes_per_pixel bytes that start with red, green and blue */
+int jpeg_write_rgb(const uint8_t *pixels, int stride, int bytes_per_pixel, int width, int height, int quality,
+                   unsigned char **jpeg);
+
+#endif //JPEG_WRITER_H
@@ -15,18 +15,48 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 #include <assert.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #include "logger.h"
 #include "compat.h"
+#include "threads.h"
+
+/* Messages that may wait for the writer thread in async mode, a power of two */
+#define LOGGER_ASYNC_SLOTS 256
+/* Longer messages are cut short in async mode */
+#define LOGGER_ASYNC_MESSAGE_LEN 512
+/* The writer rechecks the ring this often in case a wakeup got lost */
+#define LOGGER_ASYNC_POLL_MS 100
+
+/*
+ * Slot of the async ring. A slot at ring position pos is free while its sequence is pos and
+ * filled once it is pos + 1, as in Vyukov's bounded queue.
+ */
+typedef struct logger_slot_s {
+	atomic_uint sequence;
+	int level;
+	char message[LOGGER_ASYNC_MESSAGE_LEN];
+} logger_slot_t;
 
 struct logger_s {
-	mutex_handle_t lvl_mutex;
 	mutex_handle_t cb_mutex;
 
-	int level;
+	atomic_int level;
 	void *cls;
 	logger_callback_t callback;
+
+	/* Async mode, the ring is only allocated once it is enabled */
+	logger_slot_t *slots;
+	atomic_uint head;
+	unsigned int tail;
+	atomic_uint dropped;
+	atomic_int async_running;
+	thread_handle_t async_thread;
+	mutex_handle_t async_mutex;
+	cond_handle_t async_cond;
 };
 
 logger_t *
@@ -35,10 +65,14 @@ logger_init()
 	logger_t *logger = calloc(1, sizeof(logger_t));
 	assert(logger);
 
-	MUTEX_CREATE(logger->lvl_mutex);
 	MUTEX_CREATE(logger->cb_mutex);
+	MUTEX_CREATE(logger->async_mutex);
+	COND_CREATE(logger->async_cond);
 
-	logger->level = LOGGER_WARNING;
+	atomic_init(&logger->level, LOGGER_WARNING);
+	atomic_init(&logger->head, 0);
+	atomic_init(&logger->dropped, 0);
+	atomic_init(&logger->async_running, 0);
 	logger->callback = NULL;
 	return logger;
 }
@@ -46,7 +80,10 @@ logger_init()
 void
 logger_destroy(logger_t *logger)
 {
-	MUTEX_DESTROY(logger->lvl_mutex);
+	logger_set_async(logger, 0);
+	free(logger->slots);
+	COND_DESTROY(logger->async_cond);
+	MUTEX_DESTROY(logger->async_mutex);
 	MUTEX_DESTROY(logger->cb_mutex);
 	free(logger);
 }
@@ -56,9 +93,15 @@ logger_set_level(logger_t *logger, int level)
 {
 	assert(logger);
 
-	MUTEX_LOCK(logger->lvl_mutex);
-	logger->level = level;
-	MUTEX_UNLOCK(logger->lvl_mutex);
+	atomic_store_explicit(&logger->level, level, memory_order_relaxed);
+}
+
+int
+logger_get_level(logger_t *logger)
+{
+	assert(logger);
+
+	return atomic_load_explicit(&logger->level, memory_order_relaxed);
 }
 
 void
@@ -102,38 +145,166 @@ logger_utf8_to_local(const char *str)
 	return ret;
 }
 
-void
-logger_log(logger_t *logger, int level, const char *fmt, ...)
+static void
+logger_output(logger_t *logger, int level, const char *message)
 {
-	char buffer[4096];
-	va_list ap;
-
-	MUTEX_LOCK(logger->lvl_mutex);
-	if (level > logger->level) {
-		MUTEX_UNLOCK(logger->lvl_mutex);
-		return;
-	}
-	MUTEX_UNLOCK(logger->lvl_mutex);
-
-	buffer[sizeof(buffer)-1] = '\0';
-	va_start(ap, fmt);
-	vsnprintf(buffer, sizeof(buffer)-1, fmt, ap);
-	va_end(ap);
-
 	MUTEX_LOCK(logger->cb_mutex);
 	if (logger->callback) {
-		logger->callback(logger->cls, level, buffer);
+		logger->callback(logger->cls, level, message);
 		MUTEX_UNLOCK(logger->cb_mutex);
 	} else {
 		char *local;
 		MUTEX_UNLOCK(logger->cb_mutex);
-		local = logger_utf8_to_local(buffer);
+		local = logger_utf8_to_local(message);
 		if (local) {
 			fprintf(stderr, "%s\n", local);
 			free(local);
 		} else {
-			fprintf(stderr, "%s\n", buffer);
+			fprintf(stderr, "%s\n", message);
 		}
 	}
 }
 
+/*
+ * Writes out every filled slot in ring order, only ever called by one thread at a time.
+ * Returns the number of messages written.
+ */
+static int
+logger_drain(logger_t *logger)
+{
+	int count = 0;
+	while (1) {
+		logger_slot_t *slot = &logger->slots[logger->tail % LOGGER_ASYNC_SLOTS];
+		unsigned int sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		if (sequence != logger->tail + 1) {
+			break;
+		}
+		logger_output(logger, slot->level, slot->message);
+		atomic_store_explicit(&slot->sequence, logger->tail + LOGGER_ASYNC_SLOTS, memory_order_release);
+		logger->tail++;
+		count++;
+	}
+
+	unsigned int dropped = atomic_exchange_explicit(&logger->dropped, 0, memory_order_relaxed);
+	if (dropped) {
+		char message[64];
+		snprintf(message, sizeof(message), "logger dropped %u messages, the ring was full", dropped);
+		logger_output(logger, LOGGER_WARNING, message);
+	}
+	return count;
+}
+
+static THREAD_RETVAL
+logger_async_thread(void *arg)
+{
+	logger_t *logger = arg;
+
+	while (atomic_load_explicit(&logger->async_running, memory_order_acquire)) {
+		if (logger_drain(logger) > 0) {
+			continue;
+		}
+		struct timespec deadline;
+		clock_gettime(COND_CLOCK, &deadline);
+		deadline.tv_nsec += LOGGER_ASYNC_POLL_MS * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		MUTEX_LOCK(logger->async_mutex);
+		COND_TIMEDWAIT(logger->async_cond, logger->async_mutex, &deadline);
+		MUTEX_UNLOCK(logger->async_mutex);
+	}
+	/* Whatever was logged before async mode was turned off still goes out */
+	logger_drain(logger);
+	return 0;
+}
+
+void
+logger_set_async(logger_t *logger, int async)
+{
+	assert(logger);
+
+	int running = atomic_load_explicit(&logger->async_running, memory_order_relaxed);
+	if (async && !running) {
+		if (!logger->slots) {
+			logger->slots = calloc(LOGGER_ASYNC_SLOTS, sizeof(logger_slot_t));
+			if (!logger->slots) {
+				return;
+			}
+			for (unsigned int i = 0; i < LOGGER_ASYNC_SLOTS; i++) {
+				atomic_init(&logger->slots[i].sequence, logger->tail + i);
+			}
+		}
+		atomic_store_explicit(&logger->async_running, 1, memory_order_release);
+		THREAD_CREATE(logger->async_thread, logger_async_thread, logger);
+		if (!logger->async_thread) {
+			atomic_store_explicit(&logger->async_running, 0, memory_order_relaxed);
+		} else {
+			thread_set_name(logger->async_thread, "log");
+		}
+	} else if (!async && running) {
+		atomic_store_explicit(&logger->async_running, 0, memory_order_release);
+		MUTEX_LOCK(logger->async_mutex);
+		COND_SIGNAL(logger->async_cond);
+		MUTEX_UNLOCK(logger->async_mutex);
+		THREAD_JOIN(logger->async_thread);
+	}
+}
+
+/*
+ * Claims a ring slot, formats into it and hands it to the writer thread. Never blocks, a
+ * message that finds the ring full is counted and dropped.
+ */
+static void
+logger_log_async(logger_t *logger, int level, const char *fmt, va_list ap)
+{
+	unsigned int position = atomic_load_explicit(&logger->head, memory_order_relaxed);
+	logger_slot_t *slot;
+	while (1) {
+		slot = &logger->slots[position % LOGGER_ASYNC_SLOTS];
+		unsigned int sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		int diff = (int) (sequence - position);
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&logger->head, &position, position + 1,
+			                                          memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			atomic_fetch_add_explicit(&logger->dropped, 1, memory_order_relaxed);
+			return;
+		} else {
+			position = atomic_load_explicit(&logger->head, memory_order_relaxed);
+		}
+	}
+
+	slot->level = level;
+	vsnprintf(slot->message, sizeof(slot->message), fmt, ap);
+	atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+	/* Without waiters this stays in user space, and a missed wakeup only delays the message */
+	COND_SIGNAL(logger->async_cond);
+}
+
+void
+logger_log(logger_t *logger, int level, const char *fmt, ...)
+{
+	char buffer[4096];
+	va_list ap;
+
+	if (level > atomic_load_explicit(&logger->level, memory_order_relaxed)) {
+		return;
+	}
+
+	if (atomic_load_explicit(&logger->async_running, memory_order_acquire)) {
+		va_start(ap, fmt);
+		logger_log_async(logger, level, fmt, ap);
+		va_end(ap);
+		return;
+	}
+
+	buffer[sizeof(buffer)-1] = '\0';
+	va_start(ap, fmt);
+	vsnprintf(buffer, sizeof(buffer)-1, fmt, ap);
+	va_end(ap);
+
+	logger_output(logger, level, buffer);
+}
@@ -37,10 +37,21 @@ logger_t *logger_init();
 void logger_destroy(logger_t *logger);
 
 void logger_set_level(logger_t *logger, int level);
+int logger_get_level(logger_t *logger);
 void logger_set_callback(logger_t *logger, logger_callback_t callback, void *cls);
+/* In async mode messages are formatted into a ring and a background thread hands them to the
+ * callback, so logging never blocks the caller. Messages are dropped while the ring is full. */
+void logger_set_async(logger_t *logger, int async);
 
 void logger_log(logger_t *logger, int level, const char *fmt, ...);
 
+/* Debug logging on per packet paths, compiled out of release builds */
+#ifdef NDEBUG
+#define LOGGER_DEBUG_HOT(logger, ...) do { if (0) logger_log(logger, LOGGER_DEBUG, __VA_ARGS__); } while (0)
+#else
+#define LOGGER_DEBUG_HOT(logger, ...) logger_log(logger, LOGGER_DEBUG, __VA_ARGS__)
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef MEDIA_CLOCK_H
+#define MEDIA_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * The local clock all media timing runs on: raop_ntp_get_local_time, the pts handed to the
+ * renderers, their deadlines and the receive timestamps of packets. Setting the system time
+ * does not step CLOCK_MONOTONIC, so a time sync daemon no longer moves every pts at once; its
+ * slewing is drift like any other, which the NTP offset to the sender follows. It is read
+ * from the vDSO without a system call, and DRM vblank events and GStreamer's monotonic system
+ * clock are on it as well.
+ */
+#define MEDIA_CLOCK CLOCK_MONOTONIC
+/* Older receive timestamps are taken for a system time step and not converted */
+#define MEDIA_CLOCK_MAX_REALTIME_AGE 1000000
+
+static inline uint64_t
+media_clock_from_timespec(const struct timespec *time)
+{
+    return (uint64_t) time->tv_sec * 1000000 + (uint64_t) time->tv_nsec / 1000;
+}
+
+/* Micro seconds on MEDIA_CLOCK */
+static inline uint64_t
+media_clock_now(void)
+{
+    struct timespec time;
+    clock_gettime(MEDIA_CLOCK, &time);
+    return media_clock_from_timespec(&time);
+}
+
+/*
+ * Converts a recent CLOCK_REALTIME time from an interface that has no other clock, like
+ * SO_TIMESTAMPNS, by how long ago it was. Returns 0 if the system time was set since, then
+ * the time is unknown.
+ */
+static inline uint64_t
+media_clock_from_realtime(const struct timespec *time)
+{
+    struct timespec realtime;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    uint64_t now = media_clock_now();
+    int64_t age = ((int64_t) realtime.tv_sec - time->tv_sec) * 1000000 + (realtime.tv_nsec - time->tv_nsec) / 1000;
+    if (age < 0 || age > MEDIA_CLOCK_MAX_REALTIME_AGE || (uint64_t) age >= now) {
+        return 0;
+    }
+    return now - age;
+}
+
+#endif //MEDIA_CLOCK_H
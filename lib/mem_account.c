@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "mem_account.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#define MEM_ACCOUNT_MAGIC 0x6d61
+
+typedef struct mem_account_counter_s {
+    atomic_uint current;
+    atomic_uint peak;
+} mem_account_counter_t;
+
+typedef struct mem_account_session_s {
+    mem_account_counter_t counter;
+    /* Taken while open, and after that until everything it held is freed */
+    atomic_uint open;
+} mem_account_session_t;
+
+/* In front of every block of the wrappers, as large as the alignment malloc guarantees */
+typedef union mem_account_header_u {
+    struct {
+        size_t size;
+        unsigned char tag;
+        unsigned char session;
+        unsigned short magic;
+    } block;
+    max_align_t align;
+} mem_account_header_t;
+
+static const char *const mem_account_tag_names[MEM_TAG_COUNT] = {
+    [MEM_TAG_CONNECTIONS] = "connections",
+    [MEM_TAG_FRAME_POOLS] = "frame_pools",
+    [MEM_TAG_AUDIO_BUFFERS] = "audio_buffers",
+    [MEM_TAG_AAC_DECODER] = "aac_decoder",
+    [MEM_TAG_OMX] = "omx",
+    [MEM_TAG_GSTREAMER] = "gstreamer",
+};
+
+static mem_account_counter_t mem_account_tags[MEM_TAG_COUNT];
+static mem_account_session_t mem_account_sessions[MEM_ACCOUNT_MAX_SESSIONS];
+static __thread int mem_account_thread_session;
+
+static void
+mem_account_counter_add(mem_account_counter_t *counter, long bytes)
+{
+    if (bytes < 0) {
+        atomic_fetch_sub_explicit(&counter->current, (unsigned int) -bytes, memory_order_relaxed);
+        return;
+    }
+    unsigned int current = atomic_fetch_add_explicit(&counter->current, (unsigned int) bytes, memory_order_relaxed) + bytes;
+    unsigned int peak = atomic_load_explicit(&counter->peak, memory_order_relaxed);
+    while (current > peak && !atomic_compare_exchange_weak_explicit(&counter->peak, &peak, current,
+                                                                    memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+int
+mem_account_session_open(void)
+{
+    for (int i = 0; i < MEM_ACCOUNT_MAX_SESSIONS; i++) {
+        mem_account_session_t *session = &mem_account_sessions[i];
+        unsigned int open = 0;
+        if (atomic_load_explicit(&session->counter.current, memory_order_relaxed) == 0 &&
+            atomic_compare_exchange_strong_explicit(&session->open, &open, 1, memory_order_relaxed, memory_order_relaxed)) {
+            atomic_store_explicit(&session->counter.peak, 0, memory_order_relaxed);
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+unsigned int
+mem_account_session_close(int session)
+{
+    if (session <= 0 || session > MEM_ACCOUNT_MAX_SESSIONS) {
+        return 0;
+    }
+    mem_account_session_t *slot = &mem_account_sessions[session - 1];
+    unsigned int peak = atomic_load_explicit(&slot->counter.peak, memory_order_relaxed);
+    // Not reused before the frames and buffers still out there come back, see mem_account_session_open
+    atomic_store_explicit(&slot->open, 0, memory_order_relaxed);
+    return peak;
+}
+
+int
+mem_account_enter(int session)
+{
+    int previous = mem_account_thread_session;
+    mem_account_thread_session = session;
+    return previous;
+}
+
+int
+mem_account_session(void)
+{
+    return mem_account_thread_session;
+}
+
+void
+mem_account_charge(mem_tag_t tag, int session, long bytes)
+{
+    assert(tag < MEM_TAG_COUNT);
+    mem_account_counter_add(&mem_account_tags[tag], bytes);
+    if (session > 0 && session <= MEM_ACCOUNT_MAX_SESSIONS) {
+        mem_account_counter_add(&mem_account_sessions[session - 1].counter, bytes);
+    }
+}
+
+static void *
+mem_account_init_block(mem_account_header_t *header, mem_tag_t tag, int session, size_t size)
+{
+    header->block.size = size;
+    header->block.tag = (unsigned char) tag;
+    header->block.session = (unsigned char) session;
+    header->block.magic = MEM_ACCOUNT_MAGIC;
+    mem_account_charge(tag, session, (long) size);
+    return header + 1;
+}
+
+void *
+mem_account_malloc(mem_tag_t tag, size_t size)
+{
+    if (size > SIZE_MAX - sizeof(mem_account_header_t)) {
+        return NULL;
+    }
+    mem_account_header_t *header = malloc(sizeof(mem_account_header_t) + size);
+    if (!header) {
+        return NULL;
+    }
+    return mem_account_init_block(header, tag, mem_account_thread_session, size);
+}
+
+void *
+mem_account_calloc(mem_tag_t tag, size_t count, size_t size)
+{
+    if (size && count > (SIZE_MAX - sizeof(mem_account_header_t)) / size) {
+        return NULL;
+    }
+    mem_account_header_t *header = calloc(1, sizeof(mem_account_header_t) + count * size);
+    if (!header) {
+        return NULL;
+    }
+    return mem_account_init_block(header, tag, mem_account_thread_session, count * size);
+}
+
+void *
+mem_account_realloc(mem_tag_t tag, void *ptr, size_t size)
+{
+    if (!ptr) {
+        return mem_account_malloc(tag, size);
+    }
+    if (size > SIZE_MAX - sizeof(mem_account_header_t)) {
+        return NULL;
+    }
+    mem_account_header_t *header = (mem_account_header_t *) ptr - 1;
+    assert(header->block.magic == MEM_ACCOUNT_MAGIC);
+    size_t old_size = header->block.size;
+    mem_account_header_t *grown = realloc(header, sizeof(mem_account_header_t) + size);
+    if (!grown) {
+        return NULL;
+    }
+    grown->block.size = size;
+    mem_account_charge((mem_tag_t) grown->block.tag, grown->block.session, (long) size - (long) old_size);
+    return grown + 1;
+}
+
+void
+mem_account_free(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    mem_account_header_t *header = (mem_account_header_t *) ptr - 1;
+    assert(header->block.magic == MEM_ACCOUNT_MAGIC);
+    header->block.magic = 0;
+    mem_account_charge((mem_tag_t) header->block.tag, header->block.session, -(long) header->block.size);
+    free(header);
+}
+
+unsigned int
+mem_account_current(mem_tag_t tag)
+{
+    assert(tag < MEM_TAG_COUNT);
+    return atomic_load_explicit(&mem_account_tags[tag].current, memory_order_relaxed);
+}
+
+unsigned int
+mem_account_peak(mem_tag_t tag)
+{
+    assert(tag < MEM_TAG_COUNT);
+    return atomic_load_explicit(&mem_account_tags[tag].peak, memory_order_relaxed);
+}
+
+static int
+mem_account_append(char *text, int size, int length, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static int
+mem_account_append(char *text, int size, int length, const char *format, ...)
+{
+    if (length >= size) {
+        return length;
+    }
+    va_list args;
+    va_start(args, format);
+    length += vsnprintf(text + length, size - length, format, args);
+    va_end(args);
+    return length;
+}
+
+int
+mem_account_format(char *text, int size)
+{
+    static const char *const kinds[2] = { "current", "peak" };
+    int length = 0;
+
+    for (int kind = 0; kind < 2; kind++) {
+        const char *suffix = kind ? "_peak" : "";
+        length = mem_account_append(text, size, length,
+                                    "# HELP rpiplay_memory%s_bytes Memory the receiver holds, %s, by subsystem\n"
+                                    "# TYPE rpiplay_memory%s_bytes gauge\n", suffix, kinds[kind], suffix);
+        for (int i = 0; i < MEM_TAG_COUNT; i++) {
+            const mem_account_counter_t *counter = &mem_account_tags[i];
+            length = mem_account_append(text, size, length, "rpiplay_memory%s_bytes{subsystem=\"%s\"} %u\n", suffix,
+                                        mem_account_tag_names[i],
+                                        atomic_load_explicit(kind ? &counter->peak : &counter->current, memory_order_relaxed));
+        }
+        length = mem_account_append(text, size, length,
+                                    "# HELP rpiplay_session_memory%s_bytes Memory the receiver holds, %s, by open session\n"
+                                    "# TYPE rpiplay_session_memory%s_bytes gauge\n", suffix, kinds[kind], suffix);
+        for (int i = 0; i < MEM_ACCOUNT_MAX_SESSIONS; i++) {
+            const mem_account_session_t *session = &mem_account_sessions[i];
+            if (!atomic_load_explicit(&session->open, memory_order_relaxed)) {
+                continue;
+            }
+            length = mem_account_append(text, size, length, "rpiplay_session_memory%s_bytes{session=\"%d\"} %u\n", suffix,
+                                        i + 1, atomic_load_explicit(kind ? &session->counter.peak : &session->counter.current,
+                                                                    memory_order_relaxed));
+        }
+    }
+    return length < size ? length : size - 1;
+}
+
+void
+mem_account_log(logger_t *logger, int level)
+{
+    char line[512];
+    int length = 0;
+
+    for (int i = 0; i < MEM_TAG_COUNT; i++) {
+        length = mem_account_append(line, sizeof(line), length, "%s%s %u/%u KB", i ? ", " : "",
+                                    mem_account_tag_names[i], mem_account_current(i) / 1024, mem_account_peak(i) / 1024);
+    }
+    logger_log(logger, level, "Memory current/peak: %s", line);
+}
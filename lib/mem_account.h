@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef MEM_ACCOUNT_H
+#define MEM_ACCOUNT_H
+
+#include <stddef.h>
+
+#include "logger.h"
+
+/*
+ * Tells where the memory of the receiver goes, by subsystem and by session. The big consumers
+ * charge what they hold: the pools and slabs that know their sizes with mem_account_charge,
+ * everything else by allocating through the counting wrappers, which keep the tag and session
+ * in a small header in front of the block, so it is credited back wherever it is freed.
+ *
+ * A session is one RTSP connection that went beyond /info. Allocations are charged to the
+ * session the calling thread entered; objects that outlive the call, like pools grown later on
+ * a media thread, remember the session they were created in and charge that one explicitly.
+ * Counts are 32 bit relaxed atomics like the metrics, current and peak per tag and session,
+ * exported by the metrics server.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum mem_tag_e {
+    MEM_TAG_CONNECTIONS,    /* RTSP connection state and request buffers */
+    MEM_TAG_FRAME_POOLS,    /* Decrypted video frames */
+    MEM_TAG_AUDIO_BUFFERS,  /* Audio jitter buffer and decode queue */
+    MEM_TAG_AAC_DECODER,    /* fdk-aac */
+    MEM_TAG_OMX,            /* Input buffers of the OMX components */
+    MEM_TAG_GSTREAMER,      /* Frames lent to GStreamer */
+    MEM_TAG_COUNT
+} mem_tag_t;
+
+/* Sessions counted at once, the ones beyond are only counted by tag */
+#define MEM_ACCOUNT_MAX_SESSIONS 16
+
+/* Returns the number of a new session, from 1 on, or 0 if all are taken */
+int mem_account_session_open(void);
+/* Ends the session, returns its peak in bytes. What it still holds is credited back as it is freed. */
+unsigned int mem_account_session_close(int session);
+/* Charges the allocations of the calling thread to session, 0 for none, returns the one charged so far */
+int mem_account_enter(int session);
+/* The session the calling thread charges */
+int mem_account_session(void);
+
+/* For memory allocated elsewhere, bytes is negative when it is given back */
+void mem_account_charge(mem_tag_t tag, int session, long bytes);
+
+/* Counting malloc and friends, charged to tag and the session of the calling thread */
+void *mem_account_malloc(mem_tag_t tag, size_t size);
+void *mem_account_calloc(mem_tag_t tag, size_t count, size_t size);
+/* Keeps the tag and session of ptr */
+void *mem_account_realloc(mem_tag_t tag, void *ptr, size_t size);
+void mem_account_free(void *ptr);
+
+unsigned int mem_account_current(mem_tag_t tag);
+unsigned int mem_account_peak(mem_tag_t tag);
+
+/* Appends the counts in the Prometheus text format, returns the length written */
+int mem_account_format(char *text, int size);
+void mem_account_log(logger_t *logger, int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEM_ACCOUNT_H
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "memlock.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+#if !defined(WIN32)
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#endif
+
+static int memlock_active;
+
+int
+memlock_all(void)
+{
+#if defined(WIN32)
+    errno = ENOSYS;
+    return -1;
+#else
+#if defined(__GLIBC__)
+    /* Locked stacks are resident in full, the default of 8 MB per thread would add up quickly */
+    pthread_attr_t attr;
+    if (!pthread_attr_init(&attr)) {
+        pthread_attr_setstacksize(&attr, MEMLOCK_STACK_SIZE);
+        pthread_setattr_default_np(&attr);
+        pthread_attr_destroy(&attr);
+    }
+#endif
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+        return -1;
+    }
+    memlock_active = 1;
+    return 0;
+#endif
+}
+
+int
+memlock_is_active(void)
+{
+    return memlock_active;
+}
+
+void
+memlock_prefault(void *data, size_t size)
+{
+    volatile unsigned char *bytes = data;
+    size_t page_size = 4096;
+#if !defined(WIN32)
+    long system_page_size = sysconf(_SC_PAGESIZE);
+    if (system_page_size > 0) {
+        page_size = system_page_size;
+    }
+#endif
+    // A write, a read would map the shared zero page and fault again on the first write
+    for (size_t offset = 0; offset < size; offset += page_size) {
+        bytes[offset] = 0;
+    }
+}
+
+void *
+memlock_alloc(size_t size)
+{
+    void *data = NULL;
+
+#if !defined(WIN32)
+    if (size >= MEMLOCK_HUGE_PAGE_SIZE) {
+        size_t mapped = (size + MEMLOCK_HUGE_PAGE_SIZE - 1) / MEMLOCK_HUGE_PAGE_SIZE * MEMLOCK_HUGE_PAGE_SIZE;
+#ifdef MAP_HUGETLB
+        // Only succeeds if huge pages were reserved in /proc/sys/vm/nr_hugepages
+        data = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (data != MAP_FAILED) {
+            return data;
+        }
+#endif
+        data = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        // Transparent huge pages, where the kernel only gives them to those who ask
+        madvise(data, mapped, MADV_HUGEPAGE);
+#endif
+        memlock_prefault(data, mapped);
+        return data;
+    }
+#endif
+    data = malloc(size);
+    if (data) {
+        memlock_prefault(data, size);
+    }
+    return data;
+}
+
+void
+memlock_free(void *data, size_t size)
+{
+    if (!data) {
+        return;
+    }
+#if !defined(WIN32)
+    if (size >= MEMLOCK_HUGE_PAGE_SIZE) {
+        munmap(data, (size + MEMLOCK_HUGE_PAGE_SIZE - 1) / MEMLOCK_HUGE_PAGE_SIZE * MEMLOCK_HUGE_PAGE_SIZE);
+        return;
+    }
+#endif
+    free(data);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef MEMLOCK_H
+#define MEMLOCK_H
+
+#include <stddef.h>
+
+/*
+ * Keeps the media threads from taking page faults: on the first touch of a new buffer, and,
+ * on a device short of memory, on pages of code and data the kernel dropped or swapped out
+ * while they were idle, which on an SD card can take tens of milli seconds.
+ *
+ * memlock_all locks everything the process maps, now and later, into memory. Locking faults
+ * every page in up front, so the buffers and thread stacks allocated from then on come
+ * prefaulted as well; stacks are capped at MEMLOCK_STACK_SIZE so a locked process does not
+ * pin the megabytes a thread reserves by default.
+ *
+ * Large buffers, like the packet slab of the audio buffer and the frames of the mirror
+ * payload pool, are allocated with memlock_alloc, which backs them with huge pages where the
+ * kernel has them, explicit ones if reserved and transparent ones otherwise, and touches
+ * every page before handing them out.
+ */
+#define MEMLOCK_STACK_SIZE (512 * 1024)
+#define MEMLOCK_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Call before any thread is created. Returns -1 with errno set if the memory could not be locked. */
+int memlock_all(void);
+/* Nonzero after a successful memlock_all */
+int memlock_is_active(void);
+
+/* Prefaulted, huge page backed from MEMLOCK_HUGE_PAGE_SIZE on, NULL if out of memory */
+void *memlock_alloc(size_t size);
+/* Frees a memlock_alloc buffer, size as allocated */
+void memlock_free(void *data, size_t size);
+/* Touches every page of the range, so the first real access does not fault */
+void memlock_prefault(void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MEMLOCK_H
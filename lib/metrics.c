@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "metrics.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "flight_recorder.h"
+#include "httpd.h"
+#include "mem_account.h"
+#include "perf_counters.h"
+#include "thread_stats.h"
+
+/* Concurrent scrapes, one per Prometheus server is the usual */
+#define METRICS_SERVER_MAX_CONNECTIONS 4
+/* Room for every metric with its HELP and TYPE lines, the memory accounting, the stage counters
+ * and a few dozen threads */
+#define METRICS_MAX_TEXT 49152
+
+typedef struct {
+    const char *name;
+    const char *type;
+    const char *help;
+} metric_info_t;
+
+static const metric_info_t metric_info[METRIC_COUNT] = {
+    [METRIC_AUDIO_PACKETS] = { "rpiplay_audio_packets_total", "counter",
+                               "Audio packets received into the jitter buffer" },
+    [METRIC_AUDIO_PACKETS_LATE] = { "rpiplay_audio_packets_late_total", "counter",
+                                    "Audio packets that arrived after their slot was played" },
+    [METRIC_AUDIO_PACKETS_DUPLICATE] = { "rpiplay_audio_packets_duplicate_total", "counter",
+                                         "Audio packets that were already buffered" },
+    [METRIC_AUDIO_PACKETS_LOST] = { "rpiplay_audio_packets_lost_total", "counter",
+                                    "Audio packets skipped because they did not arrive in time" },
+    [METRIC_AUDIO_PACKETS_RESENT] = { "rpiplay_audio_packets_resent_total", "counter",
+                                      "Audio packets received as the answer to a resend request" },
+    [METRIC_AUDIO_RESEND_REQUESTS] = { "rpiplay_audio_resend_requests_total", "counter",
+                                       "Resend requests sent for missing audio packets" },
+    [METRIC_AUDIO_UNDERRUNS] = { "rpiplay_audio_underruns_total", "counter",
+                                 "Audio output underruns" },
+    [METRIC_NTP_SYNCS] = { "rpiplay_ntp_syncs_total", "counter",
+                           "Completed NTP exchanges with the sender" },
+    [METRIC_NTP_TIMEOUTS] = { "rpiplay_ntp_timeouts_total", "counter",
+                              "NTP requests the sender did not answer" },
+    [METRIC_VIDEO_FRAMES] = { "rpiplay_video_frames_total", "counter",
+                              "Mirrored video frames received" },
+    [METRIC_VIDEO_FRAMES_DROPPED] = { "rpiplay_video_frames_dropped_total", "counter",
+                                      "Video frames dropped for being late or while the decoder was busy" },
+    [METRIC_VIDEO_FRAMES_LOST] = { "rpiplay_video_frames_lost_total", "counter",
+                                   "Video frames of the UDP mirroring transport given up on for missing datagrams" },
+    [METRIC_VIDEO_DECODER_STALLS] = { "rpiplay_video_decoder_stalls_total", "counter",
+                                      "Times the video decoder stopped taking input" },
+    [METRIC_VIDEO_DECODER_RECOVERIES] = { "rpiplay_video_decoder_recoveries_total", "counter",
+                                          "Times the video decoder was restarted after its output stalled" },
+    [METRIC_MIRROR_SESSIONS] = { "rpiplay_mirror_sessions_total", "counter",
+                                 "Screen mirroring sessions started" },
+    [METRIC_RECORDING_FRAGMENTS_DROPPED] = { "rpiplay_recording_fragments_dropped_total", "counter",
+                                             "Recording fragments left out because the disk fell behind" },
+    [METRIC_RESTREAM_PACKETS_DROPPED] = { "rpiplay_restream_packets_dropped_total", "counter",
+                                          "Restreamed RTP packets dropped because a socket buffer was full" },
+    [METRIC_AUDIO_FRAMES_DROPPED] = { "rpiplay_audio_frames_dropped_total", "counter",
+                                      "Audio frames dropped because decoding fell behind the receiver" },
+    [METRIC_THERMAL_PRESSURE_EVENTS] = { "rpiplay_thermal_pressure_events_total", "counter",
+                                         "Times throttling made the receiver switch to its cheaper profile" },
+    [METRIC_AUDIO_PACKETS_EXPECTED] = { "rpiplay_audio_packets_expected_total", "counter",
+                                        "Audio packets the sequence numbers accounted for, as in RTCP receiver reports" },
+    [METRIC_AUDIO_RECEIVER_REPORTS] = { "rpiplay_audio_receiver_reports_total", "counter",
+                                        "RTCP receiver reports sent on the audio control channel" },
+    [METRIC_TRANSCODE_FRAMES_DROPPED] = { "rpiplay_transcode_frames_dropped_total", "counter",
+                                          "Mirror frames the restream transcoder left out because it fell behind" },
+    [METRIC_AUDIO_BUFFER_DEPTH] = { "rpiplay_audio_buffer_depth_packets", "gauge",
+                                    "Current target depth of the audio jitter buffer" },
+    [METRIC_NTP_OFFSET] = { "rpiplay_ntp_offset_microseconds", "gauge",
+                            "Remote minus local clock offset of the latest NTP sync" },
+    [METRIC_NTP_DISPERSION] = { "rpiplay_ntp_dispersion", "gauge",
+                                "Dispersion of the latest NTP sync" },
+    [METRIC_VIDEO_QUEUE_FRAMES] = { "rpiplay_video_queue_frames", "gauge",
+                                    "Video frames waiting for the renderer" },
+    [METRIC_THERMAL_PRESSURE] = { "rpiplay_thermal_pressure", "gauge",
+                                  "1 while throttling keeps the receiver on its cheaper profile" },
+    [METRIC_SOC_TEMPERATURE] = { "rpiplay_soc_temperature_millicelsius", "gauge",
+                                 "Temperature of the SoC" },
+    [METRIC_THROTTLED_FLAGS] = { "rpiplay_throttled_flags", "gauge",
+                                 "Throttle flags of the firmware, as vcgencmd get_throttled" },
+    [METRIC_AUDIO_JITTER] = { "rpiplay_audio_jitter_microseconds", "gauge",
+                              "Interarrival jitter of the audio packets, RFC 3550 Section 6.4.1" },
+    [METRIC_AUDIO_FRACTION_LOST] = { "rpiplay_audio_fraction_lost", "gauge",
+                                     "Audio packets lost in the latest report interval, in 1/256" },
+    [METRIC_SYNC_GROUP_NODES] = { "rpiplay_sync_group_nodes", "gauge",
+                                  "Nodes of the sync group heard from lately, this one included" },
+    [METRIC_SYNC_GROUP_ERROR] = { "rpiplay_sync_group_error_microseconds", "gauge",
+                                  "How much later than the group's playout time the audio plays" },
+    [METRIC_GENLOCK_ERROR] = { "rpiplay_genlock_error_microseconds", "gauge",
+                               "How much later than the video wall leader's display this one flips frames" },
+};
+
+atomic_uint metrics_values[METRIC_COUNT];
+
+struct metrics_server_s {
+    logger_t *logger;
+    httpd_t *httpd;
+
+    metrics_snapshot_func_t snapshot;
+    void *snapshot_cls;
+};
+
+void
+metrics_set(metric_t metric, int64_t value)
+{
+    if (value > INT32_MAX) {
+        value = INT32_MAX;
+    } else if (value < INT32_MIN) {
+        value = INT32_MIN;
+    }
+    atomic_store_explicit(&metrics_values[metric], (unsigned int) (int32_t) value, memory_order_relaxed);
+    flight_recorder_record(FLIGHT_RECORDER_EVENT_gauge, metric, value, 0);
+}
+
+const char *
+metrics_get_name(metric_t metric)
+{
+    return metric >= 0 && metric < METRIC_COUNT ? metric_info[metric].name : "unknown";
+}
+
+static int
+metrics_format(char *text, int size)
+{
+    int length = 0;
+    for (int i = 0; i < METRIC_COUNT && length < size; i++) {
+        unsigned int value = atomic_load_explicit(&metrics_values[i], memory_order_relaxed);
+        const metric_info_t *info = &metric_info[i];
+        if (!strcmp(info->type, "gauge")) {
+            length += snprintf(text + length, size - length, "# HELP %s %s\n# TYPE %s gauge\n%s %d\n",
+                               info->name, info->help, info->name, info->name, (int) value);
+        } else {
+            length += snprintf(text + length, size - length, "# HELP %s %s\n# TYPE %s counter\n%s %u\n",
+                               info->name, info->help, info->name, info->name, value);
+        }
+    }
+    if (length < size) {
+        length += mem_account_format(text + length, size - length);
+    }
+    if (length < size) {
+        length += perf_counters_format(text + length, size - length);
+    }
+    if (length < size) {
+        length += thread_stats_format(text + length, size - length);
+    }
+    return length < size ? length : size - 1;
+}
+
+static void *
+metrics_conn_init(void *opaque, unsigned char *local, int locallen, unsigned char *remote, int remotelen)
+{
+    /* Requests carry no state, the server itself is the connection context */
+    return opaque;
+}
+
+static void
+metrics_conn_request(void *ptr, http_request_t *request, http_response_t **response)
+{
+    metrics_server_t *metrics_server = ptr;
+    const char *method = http_request_get_method(request);
+    const char *url = http_request_get_url(request);
+
+    if (method && url && !strcmp(method, "GET") && !strcmp(url, "/snapshot.jpg") && metrics_server->snapshot) {
+        unsigned char *jpeg = NULL;
+        int size = metrics_server->snapshot(metrics_server->snapshot_cls, &jpeg);
+        if (size > 0) {
+            *response = http_response_init("HTTP/1.1", 200, "OK");
+            http_response_add_header(*response, "Content-Type", "image/jpeg");
+            http_response_add_header(*response, "Cache-Control", "no-store");
+            http_response_add_header(*response, "Connection", "close");
+            http_response_finish_owned(*response, (char *) jpeg, size);
+            http_response_set_disconnect(*response, 1);
+            return;
+        }
+        // Nothing on display, which answers like an unknown URL
+        free(jpeg);
+    }
+    if (!method || !url || strcmp(method, "GET") || strcmp(url, "/metrics")) {
+        logger_log(metrics_server->logger, LOGGER_DEBUG, "metrics server has nothing at %s %s",
+                   method ? method : "", url ? url : "");
+        *response = http_response_init("HTTP/1.1", 404, "Not Found");
+        http_response_add_header(*response, "Connection", "close");
+        http_response_finish(*response, NULL, 0);
+        http_response_set_disconnect(*response, 1);
+        return;
+    }
+
+    char text[METRICS_MAX_TEXT];
+    int length = metrics_format(text, sizeof(text));
+    *response = http_response_init("HTTP/1.1", 200, "OK");
+    http_response_add_header(*response, "Content-Type", "text/plain; version=0.0.4");
+    // Scrapes are seconds apart, a held open connection would only take up one of the few slots
+    http_response_add_header(*response, "Connection", "close");
+    http_response_finish(*response, text, length);
+    http_response_set_disconnect(*response, 1);
+}
+
+static void
+metrics_conn_destroy(void *ptr)
+{
+}
+
+metrics_server_t *
+metrics_server_init(logger_t *logger)
+{
+    metrics_server_t *metrics_server;
+    httpd_callbacks_t httpd_cbs;
+
+    assert(logger);
+
+    metrics_server = calloc(1, sizeof(metrics_server_t));
+    if (!metrics_server) {
+        return NULL;
+    }
+    metrics_server->logger = logger;
+
+    memset(&httpd_cbs, 0, sizeof(httpd_cbs));
+    httpd_cbs.opaque = metrics_server;
+    httpd_cbs.conn_init = &metrics_conn_init;
+    httpd_cbs.conn_request = &metrics_conn_request;
+    httpd_cbs.conn_destroy = &metrics_conn_destroy;
+    metrics_server->httpd = httpd_init(logger, &httpd_cbs, METRICS_SERVER_MAX_CONNECTIONS);
+    if (!metrics_server->httpd) {
+        free(metrics_server);
+        return NULL;
+    }
+    return metrics_server;
+}
+
+int
+metrics_server_start(metrics_server_t *metrics_server, unsigned short *port)
+{
+    assert(metrics_server);
+    assert(port);
+
+    int ret = httpd_start(metrics_server->httpd, port);
+    if (ret < 0) {
+        logger_log(metrics_server->logger, LOGGER_ERR, "metrics server could not listen on port %u", *port);
+    } else {
+        logger_log(metrics_server->logger, LOGGER_INFO, "metrics server listening on port %u", *port);
+    }
+    return ret;
+}
+
+void
+metrics_server_set_snapshot(metrics_server_t *metrics_server, metrics_snapshot_func_t snapshot, void *cls)
+{
+    assert(metrics_server);
+    metrics_server->snapshot = snapshot;
+    metrics_server->snapshot_cls = cls;
+}
+
+void
+metrics_server_stop(metrics_server_t *metrics_server)
+{
+    assert(metrics_server);
+    httpd_stop(metrics_server->httpd);
+}
+
+void
+metrics_server_destroy(metrics_server_t *metrics_server)
+{
+    if (metrics_server) {
+        httpd_destroy(metrics_server->httpd);
+        free(metrics_server);
+    }
+}
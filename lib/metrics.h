@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "logger.h"
+
+/*
+ * Process wide counters and gauges, exported in the Prometheus text format by the metrics
+ * server. Updates are relaxed 32 bit atomics, which stay lock-free on every Pi, so the media
+ * threads can bump them per packet. Counters wrap around at 2^32, which Prometheus treats
+ * like a restart. Gauges hold the value last set by any session.
+ */
+typedef enum metric_e {
+    METRIC_AUDIO_PACKETS,
+    METRIC_AUDIO_PACKETS_LATE,
+    METRIC_AUDIO_PACKETS_DUPLICATE,
+    METRIC_AUDIO_PACKETS_LOST,
+    METRIC_AUDIO_PACKETS_RESENT,
+    METRIC_AUDIO_RESEND_REQUESTS,
+    METRIC_AUDIO_UNDERRUNS,
+    METRIC_NTP_SYNCS,
+    METRIC_NTP_TIMEOUTS,
+    METRIC_VIDEO_FRAMES,
+    METRIC_VIDEO_FRAMES_DROPPED,
+    METRIC_VIDEO_FRAMES_LOST,
+    METRIC_VIDEO_DECODER_STALLS,
+    METRIC_VIDEO_DECODER_RECOVERIES,
+    METRIC_MIRROR_SESSIONS,
+    METRIC_RECORDING_FRAGMENTS_DROPPED,
+    METRIC_RESTREAM_PACKETS_DROPPED,
+    METRIC_AUDIO_FRAMES_DROPPED,
+    METRIC_THERMAL_PRESSURE_EVENTS,
+    METRIC_AUDIO_PACKETS_EXPECTED,
+    METRIC_AUDIO_RECEIVER_REPORTS,
+    METRIC_TRANSCODE_FRAMES_DROPPED,
+    /* Gauges */
+    METRIC_AUDIO_BUFFER_DEPTH,
+    METRIC_NTP_OFFSET,
+    METRIC_NTP_DISPERSION,
+    METRIC_VIDEO_QUEUE_FRAMES,
+    METRIC_THERMAL_PRESSURE,
+    METRIC_SOC_TEMPERATURE,
+    METRIC_THROTTLED_FLAGS,
+    METRIC_AUDIO_JITTER,
+    METRIC_AUDIO_FRACTION_LOST,
+    METRIC_SYNC_GROUP_NODES,
+    METRIC_SYNC_GROUP_ERROR,
+    METRIC_GENLOCK_ERROR,
+    METRIC_COUNT
+} metric_t;
+
+typedef struct metrics_server_s metrics_server_t;
+
+/* A malloc'd JPEG of what is on display in *jpeg, returns its size or -1 if there is none */
+typedef int (*metrics_snapshot_func_t)(void *cls, unsigned char **jpeg);
+
+extern atomic_uint metrics_values[METRIC_COUNT];
+
+static inline void
+metrics_add(metric_t metric, unsigned int value)
+{
+    atomic_fetch_add_explicit(&metrics_values[metric], value, memory_order_relaxed);
+}
+
+/* Sets a gauge, values beyond 32 bit signed are clamped */
+void metrics_set(metric_t metric, int64_t value);
+/* Name the metric is served under */
+const char *metrics_get_name(metric_t metric);
+
+metrics_server_t *metrics_server_init(logger_t *logger);
+/* Serves the metrics over HTTP on *port, any free port if it is 0, which is then set to the one used */
+int metrics_server_start(metrics_server_t *metrics_server, unsigned short *port);
+/* Also serves snapshot at /snapshot.jpg, a GET there 404s until it is set */
+void metrics_server_set_snapshot(metrics_server_t *metrics_server, metrics_snapshot_func_t snapshot, void *cls);
+void metrics_server_stop(metrics_server_t *metrics_server);
+void metrics_server_destroy(metrics_server_t *metrics_server);
+
+#endif //METRICS_H
@@ -18,6 +18,10 @@
 #include <stdint.h>
 #include "crypto.h"
 #include "compat.h"
+#include "byteutils.h"
+#include "threads.h"
+#include "worker_pool.h"
+#include "simd_kernels.h"
 #include <math.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -25,27 +29,193 @@
 #include <stdio.h>
 #include <inttypes.h>
 
-//#define DUMP_KEI_IV
+/* Datagrams held for reordering, a power of two so seqnum wraparound keeps the index contiguous */
+#define MIRROR_BUFFER_REORDER_SLOTS 1024
+#define MIRROR_BUFFER_RTP_HEADER_LEN 12
+
+/*
+ * CTR keystream does not depend on the ciphertext, so a helper thread generates it ahead into a
+ * ring while the receiving thread waits for the next frame, and decrypting is left with an XOR.
+ * The ring holds more than most frames, only larger ones have to wait for a part of theirs.
+ */
+#define MIRROR_BUFFER_KEYSTREAM_LEN (512 * 1024)
+/* Keystream generated per lock, what a decrypt may wait for when it catches up with the helper */
+#define MIRROR_BUFFER_KEYSTREAM_CHUNK (16 * 1024)
+/*
+ * A frame that runs the ring dry with this much left is decrypted straight from the input,
+ * split over worker threads by stream offset, with parts of at least MIRROR_BUFFER_PART_MIN.
+ */
+#define MIRROR_BUFFER_PARALLEL_MIN (128 * 1024)
+#define MIRROR_BUFFER_PART_MIN (32 * 1024)
+#define MIRROR_BUFFER_DECRYPT_WORKERS 3
+
+typedef struct mirror_buffer_part_s {
+    mirror_buffer_t *mirror_buffer;
+    aes_ctx_t *aes_ctx;
+    const unsigned char *input;
+    unsigned char *output;
+    size_t len;
+    uint64_t offset;
+} mirror_buffer_part_t;
+
+typedef struct {
+    int filled;
+    unsigned short seqnum;
+    int marker;
+    uint32_t keystream_offset;
+    uint64_t arrival_time;
+    /* Datagram without the RTP header */
+    int len;
+    int capacity;
+    unsigned char *data;
+} mirror_buffer_entry_t;
+
 struct mirror_buffer_s {
     logger_t *logger;
     aes_ctx_t *aes_ctx;
-    int nextDecryptCount;
-    uint8_t og[16];
+    /* Bytes decrypted so far, modulo 2^32 like the offsets of the UDP transport */
+    uint32_t keystream_pos;
+
+    /* Keystream ring, bytes between consumed and produced are ready. The lock covers aes_ctx too. */
+    unsigned char *keystream;
+    uint64_t keystream_produced;
+    uint64_t keystream_consumed;
+    /* Set while keystream is generated outside the lock, by the helper thread or a decrypt */
+    int keystream_generating;
+    /* Set for the whole decrypt of a frame that may go parallel, keeps the helper off aes_ctx */
+    int keystream_hold;
+    int keystream_running;
+    thread_handle_t keystream_thread;
+    mutex_handle_t keystream_mutex;
+    cond_handle_t keystream_cond;
+    /* Applies the keystream, the xor_bytes kernel for the CPU from simd_kernels.h */
+    void (*xor_bytes)(const unsigned char *input, const unsigned char *keystream, unsigned char *output, size_t len);
+
+    /* Parallel decrypt, one context per worker, none on a single core */
+    worker_pool_t *decrypt_pool;
+    int decrypt_workers;
+    mirror_buffer_part_t parts[MIRROR_BUFFER_DECRYPT_WORKERS];
+    int parts_pending;
+
+    /* UDP transport reordering, the entries are only allocated with the first datagram */
+    mirror_buffer_entry_t *entries;
+    int reorder_started;
+    unsigned short next_seqnum;
+    unsigned short highest_seqnum;
+    int held;
+    /* Cleared after a loss until the next marker, datagrams before it belong to a lost frame */
+    int at_frame_start;
+    int gap_pending;
+    /* Set once a frame was handed out, until then the first datagrams may still arrive out of order */
+    int delivered;
+    /* Datagrams of the frame returned by mirror_buffer_next_frame */
+    int frame_datagrams;
+    int lost_frames;
     /* AES key and IV */
     // Need secondary processing to use
     unsigned char aeskey[RAOP_AESKEY_LEN];
     unsigned char ecdh_secret[32];
 };
 
+/*
+ * Generates the next chunk of keystream into the free part of the ring. Called and returning
+ * with the lock held, which is dropped meanwhile so the ready keystream stays available.
+ */
+static void
+mirror_buffer_generate_keystream(mirror_buffer_t *mirror_buffer)
+{
+    size_t space = MIRROR_BUFFER_KEYSTREAM_LEN - (size_t) (mirror_buffer->keystream_produced - mirror_buffer->keystream_consumed);
+    size_t start = mirror_buffer->keystream_produced % MIRROR_BUFFER_KEYSTREAM_LEN;
+    size_t len = MIRROR_BUFFER_KEYSTREAM_LEN - start;
+    if (len > space) {
+        len = space;
+    }
+    if (len > MIRROR_BUFFER_KEYSTREAM_CHUNK) {
+        len = MIRROR_BUFFER_KEYSTREAM_CHUNK;
+    }
+    mirror_buffer->keystream_generating = 1;
+    MUTEX_UNLOCK(mirror_buffer->keystream_mutex);
+    // Encrypting zeros yields the keystream itself
+    memset(mirror_buffer->keystream + start, 0, len);
+    aes_ctr_encrypt(mirror_buffer->aes_ctx, mirror_buffer->keystream + start, mirror_buffer->keystream + start, (int) len);
+    MUTEX_LOCK(mirror_buffer->keystream_mutex);
+    mirror_buffer->keystream_produced += len;
+    mirror_buffer->keystream_generating = 0;
+    COND_BROADCAST(mirror_buffer->keystream_cond);
+}
+
+static THREAD_RETVAL
+mirror_buffer_keystream_thread(void *arg)
+{
+    mirror_buffer_t *mirror_buffer = arg;
+    assert(mirror_buffer);
+
+    MUTEX_LOCK(mirror_buffer->keystream_mutex);
+    while (mirror_buffer->keystream_running) {
+        size_t space = MIRROR_BUFFER_KEYSTREAM_LEN - (size_t) (mirror_buffer->keystream_produced - mirror_buffer->keystream_consumed);
+        if (mirror_buffer->keystream_generating || mirror_buffer->keystream_hold || space < MIRROR_BUFFER_KEYSTREAM_CHUNK) {
+            COND_WAIT(mirror_buffer->keystream_cond, mirror_buffer->keystream_mutex);
+            continue;
+        }
+        mirror_buffer_generate_keystream(mirror_buffer);
+    }
+    MUTEX_UNLOCK(mirror_buffer->keystream_mutex);
+    return 0;
+}
+
+static void
+mirror_buffer_stop_keystream(mirror_buffer_t *mirror_buffer)
+{
+    if (!mirror_buffer->keystream_thread) {
+        return;
+    }
+    MUTEX_LOCK(mirror_buffer->keystream_mutex);
+    mirror_buffer->keystream_running = 0;
+    COND_BROADCAST(mirror_buffer->keystream_cond);
+    MUTEX_UNLOCK(mirror_buffer->keystream_mutex);
+    THREAD_JOIN(mirror_buffer->keystream_thread);
+    mirror_buffer->keystream_thread = 0;
+}
+
+static void
+mirror_buffer_destroy_workers(mirror_buffer_t *mirror_buffer)
+{
+    worker_pool_destroy(mirror_buffer->decrypt_pool);
+    mirror_buffer->decrypt_pool = NULL;
+    for (int i = 0; i < mirror_buffer->decrypt_workers; i++) {
+        aes_ctr_destroy(mirror_buffer->parts[i].aes_ctx);
+        mirror_buffer->parts[i].aes_ctx = NULL;
+    }
+    mirror_buffer->decrypt_workers = 0;
+}
+
+static void
+mirror_buffer_init_workers(mirror_buffer_t *mirror_buffer, const unsigned char *key, const unsigned char *iv)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    // The calling thread decrypts a part too
+    int workers = cpus > MIRROR_BUFFER_DECRYPT_WORKERS ? MIRROR_BUFFER_DECRYPT_WORKERS : (int) cpus - 1;
+    if (workers <= 0) {
+        return;
+    }
+    mirror_buffer->decrypt_pool = worker_pool_init(mirror_buffer->logger, workers, workers);
+    if (!mirror_buffer->decrypt_pool) {
+        logger_log(mirror_buffer->logger, LOGGER_WARNING, "mirror_buffer could not start the decrypt workers");
+        return;
+    }
+    for (int i = 0; i < workers; i++) {
+        mirror_buffer->parts[i].mirror_buffer = mirror_buffer;
+        mirror_buffer->parts[i].aes_ctx = aes_ctr_init(key, iv);
+    }
+    mirror_buffer->decrypt_workers = workers;
+}
+
 void
 mirror_buffer_init_aes(mirror_buffer_t *mirror_buffer, uint64_t streamConnectionID)
 {
-    sha_ctx_t *ctx = sha_init();
     unsigned char eaeskey[64] = {};
     memcpy(eaeskey, mirror_buffer->aeskey, 16);
-    sha_update(ctx, eaeskey, 16);
-    sha_update(ctx, mirror_buffer->ecdh_secret, 32);
-    sha_final(ctx, eaeskey, NULL);
+    sha512_oneshot2(eaeskey, 16, mirror_buffer->ecdh_secret, 32, eaeskey);
 
     unsigned char hash1[64];
     unsigned char hash2[64];
@@ -55,30 +225,32 @@ mirror_buffer_init_aes(mirror_buffer_t *mirror_buffer, uint64_t streamConnection
     unsigned char sivall[255];
     sprintf((char*) skeyall, "%s%" PRIu64, skey, streamConnectionID);
     sprintf((char*) sivall, "%s%" PRIu64, siv, streamConnectionID);
-    sha_reset(ctx);
-    sha_update(ctx, skeyall, strlen((char*) skeyall));
-    sha_update(ctx, eaeskey, 16);
-    sha_final(ctx, hash1, NULL);
-
-    sha_reset(ctx);
-    sha_update(ctx, sivall, strlen((char*) sivall));
-    sha_update(ctx, eaeskey, 16);
-    sha_final(ctx, hash2, NULL);
-    sha_destroy(ctx);
+    sha512_oneshot2(skeyall, strlen((char*) skeyall), eaeskey, 16, hash1);
+    sha512_oneshot2(sivall, strlen((char*) sivall), eaeskey, 16, hash2);
 
     unsigned char decrypt_aeskey[16];
     unsigned char decrypt_aesiv[16];
     memcpy(decrypt_aeskey, hash1, 16);
     memcpy(decrypt_aesiv, hash2, 16);
-#ifdef DUMP_KEI_IV
-    FILE* keyfile = fopen("/sdcard/111.keyiv", "wb");
-    fwrite(decrypt_aeskey, 16, 1, keyfile);
-    fwrite(decrypt_aesiv, 16, 1, keyfile);
-    fclose(keyfile);
-#endif
     // Need to be initialized externally
+    mirror_buffer_stop_keystream(mirror_buffer);
+    mirror_buffer_destroy_workers(mirror_buffer);
+    aes_ctr_destroy(mirror_buffer->aes_ctx);
     mirror_buffer->aes_ctx = aes_ctr_init(decrypt_aeskey, decrypt_aesiv);
-    mirror_buffer->nextDecryptCount = 0;
+    mirror_buffer_init_workers(mirror_buffer, decrypt_aeskey, decrypt_aesiv);
+    mirror_buffer->keystream_pos = 0;
+    mirror_buffer->keystream_produced = 0;
+    mirror_buffer->keystream_consumed = 0;
+
+    // Without the helper, decrypting generates all of the keystream itself
+    mirror_buffer->keystream_running = 1;
+    THREAD_CREATE(mirror_buffer->keystream_thread, mirror_buffer_keystream_thread, mirror_buffer);
+    if (!mirror_buffer->keystream_thread) {
+        mirror_buffer->keystream_running = 0;
+        logger_log(mirror_buffer->logger, LOGGER_WARNING, "mirror_buffer could not start the keystream thread");
+    } else {
+        thread_set_name(mirror_buffer->keystream_thread, "keys");
+    }
 }
 
 mirror_buffer_t *
@@ -93,51 +265,367 @@ mirror_buffer_init(logger_t *logger,
     if (!mirror_buffer) {
         return NULL;
     }
+    mirror_buffer->keystream = malloc(MIRROR_BUFFER_KEYSTREAM_LEN);
+    if (!mirror_buffer->keystream) {
+        free(mirror_buffer);
+        return NULL;
+    }
     memcpy(mirror_buffer->aeskey, aeskey, RAOP_AESKEY_LEN);
     memcpy(mirror_buffer->ecdh_secret, ecdh_secret, 32);
     mirror_buffer->logger = logger;
-    mirror_buffer->nextDecryptCount = 0;
+    mirror_buffer->xor_bytes = simd_kernels()->xor_bytes;
+    MUTEX_CREATE(mirror_buffer->keystream_mutex);
+    COND_CREATE(mirror_buffer->keystream_cond);
     //mirror_buffer_init_aes(mirror_buffer, aeskey, ecdh_secret, streamConnectionID);
     return mirror_buffer;
 }
 
+static void
+mirror_buffer_decrypt_part(void *arg)
+{
+    mirror_buffer_part_t *part = arg;
+    aes_ctr_seek(part->aes_ctx, part->offset);
+    aes_ctr_decrypt(part->aes_ctx, part->input, part->output, (int) part->len);
+
+    MUTEX_LOCK(part->mirror_buffer->keystream_mutex);
+    part->mirror_buffer->parts_pending--;
+    COND_BROADCAST(part->mirror_buffer->keystream_cond);
+    MUTEX_UNLOCK(part->mirror_buffer->keystream_mutex);
+}
+
+/*
+ * Decrypts the rest of a frame that ran the ring dry straight from the input, split over the
+ * workers by stream offset. Called and returning with the lock held, which is dropped meanwhile.
+ * The last part runs here on aes_ctx, which leaves it right where the ring continues.
+ */
+static void
+mirror_buffer_decrypt_parallel(mirror_buffer_t *mirror_buffer, const unsigned char *input, unsigned char *output, size_t len)
+{
+    uint64_t offset = mirror_buffer->keystream_consumed;
+    int parts = (int) (len / MIRROR_BUFFER_PART_MIN);
+    if (parts > mirror_buffer->decrypt_workers + 1) {
+        parts = mirror_buffer->decrypt_workers + 1;
+    }
+    size_t part_len = (len / parts) & ~((size_t) AES_128_BLOCK_SIZE - 1);
+
+    mirror_buffer->keystream_generating = 1;
+    mirror_buffer->parts_pending = parts - 1;
+    MUTEX_UNLOCK(mirror_buffer->keystream_mutex);
+    for (int i = 0; i < parts - 1; i++) {
+        mirror_buffer_part_t *part = &mirror_buffer->parts[i];
+        part->input = input + i * part_len;
+        part->output = output + i * part_len;
+        part->len = part_len;
+        part->offset = offset + i * part_len;
+        if (worker_pool_submit(mirror_buffer->decrypt_pool, &mirror_buffer_decrypt_part, part) < 0) {
+            mirror_buffer_decrypt_part(part);
+        }
+    }
+    size_t done = (parts - 1) * part_len;
+    aes_ctr_seek(mirror_buffer->aes_ctx, offset + done);
+    aes_ctr_decrypt(mirror_buffer->aes_ctx, input + done, output + done, (int) (len - done));
+
+    MUTEX_LOCK(mirror_buffer->keystream_mutex);
+    while (mirror_buffer->parts_pending > 0) {
+        COND_WAIT(mirror_buffer->keystream_cond, mirror_buffer->keystream_mutex);
+    }
+    mirror_buffer->keystream_consumed += len;
+    mirror_buffer->keystream_produced = mirror_buffer->keystream_consumed;
+    mirror_buffer->keystream_generating = 0;
+}
+
+/* Takes len bytes of keystream from the ring and XORs them over the input, a NULL output only skips them */
+static void
+mirror_buffer_apply_keystream(mirror_buffer_t *mirror_buffer, const unsigned char *input, unsigned char *output, size_t len)
+{
+    int parallel = output && mirror_buffer->decrypt_workers && len >= MIRROR_BUFFER_PARALLEL_MIN;
+
+    MUTEX_LOCK(mirror_buffer->keystream_mutex);
+    mirror_buffer->keystream_hold = parallel;
+    while (len > 0) {
+        if (mirror_buffer->keystream_produced == mirror_buffer->keystream_consumed) {
+            // Caught up with the helper, wait for its chunk or take over from here
+            if (mirror_buffer->keystream_generating) {
+                COND_WAIT(mirror_buffer->keystream_cond, mirror_buffer->keystream_mutex);
+            } else if (!output) {
+                // CTR jumps, skipped keystream need not be generated
+                mirror_buffer->keystream_consumed += len;
+                mirror_buffer->keystream_produced = mirror_buffer->keystream_consumed;
+                aes_ctr_seek(mirror_buffer->aes_ctx, mirror_buffer->keystream_produced);
+                len = 0;
+            } else if (parallel && len >= MIRROR_BUFFER_PARALLEL_MIN) {
+                mirror_buffer_decrypt_parallel(mirror_buffer, input, output, len);
+                len = 0;
+            } else {
+                mirror_buffer_generate_keystream(mirror_buffer);
+            }
+            continue;
+        }
+        size_t start = mirror_buffer->keystream_consumed % MIRROR_BUFFER_KEYSTREAM_LEN;
+        size_t ready = (size_t) (mirror_buffer->keystream_produced - mirror_buffer->keystream_consumed);
+        if (ready > MIRROR_BUFFER_KEYSTREAM_LEN - start) {
+            ready = MIRROR_BUFFER_KEYSTREAM_LEN - start;
+        }
+        if (ready > len) {
+            ready = len;
+        }
+        // Bytes up to produced are never written while consumed has not passed them
+        MUTEX_UNLOCK(mirror_buffer->keystream_mutex);
+        if (output) {
+            mirror_buffer->xor_bytes(input, mirror_buffer->keystream + start, output, ready);
+            input += ready;
+            output += ready;
+        }
+        len -= ready;
+        MUTEX_LOCK(mirror_buffer->keystream_mutex);
+        mirror_buffer->keystream_consumed += ready;
+    }
+    mirror_buffer->keystream_hold = 0;
+    COND_BROADCAST(mirror_buffer->keystream_cond);
+    MUTEX_UNLOCK(mirror_buffer->keystream_mutex);
+}
+
 void mirror_buffer_decrypt(mirror_buffer_t *mirror_buffer, unsigned char* input, unsigned char* output, int inputLen) {
-    // Start decrypting
-    if (mirror_buffer->nextDecryptCount > 0) {//mirror_buffer->nextDecryptCount = 10
-        for (int i = 0; i < mirror_buffer->nextDecryptCount; i++) {
-            output[i] = (input[i] ^ mirror_buffer->og[(16 - mirror_buffer->nextDecryptCount) + i]);
-        }
-    }
-    // Handling encrypted bytes
-    int encryptlen = ((inputLen - mirror_buffer->nextDecryptCount) / 16) * 16;
-    // Aes decryption
-    aes_ctr_start_fresh_block(mirror_buffer->aes_ctx);
-    aes_ctr_decrypt(mirror_buffer->aes_ctx, input + mirror_buffer->nextDecryptCount,
-                    input + mirror_buffer->nextDecryptCount, encryptlen);
-    // Copy to output
-    memcpy(output + mirror_buffer->nextDecryptCount, input + mirror_buffer->nextDecryptCount, encryptlen);
-    int outputlength = mirror_buffer->nextDecryptCount + encryptlen;
-    // Processing remaining length
-    int restlen = (inputLen - mirror_buffer->nextDecryptCount) % 16;
-    int reststart = inputLen - restlen;
-    mirror_buffer->nextDecryptCount = 0;
-    if (restlen > 0) {
-        memset(mirror_buffer->og, 0, 16);
-        memcpy(mirror_buffer->og, input + reststart, restlen);
-        aes_ctr_decrypt(mirror_buffer->aes_ctx, mirror_buffer->og, mirror_buffer->og, 16);
-        for (int j = 0; j < restlen; j++) {
-            output[reststart + j] = mirror_buffer->og[j];
-        }
-        outputlength += restlen;
-        mirror_buffer->nextDecryptCount = 16 - restlen;// Difference 16-6=10 bytes
+    if (inputLen <= 0) {
+        return;
+    }
+    mirror_buffer->keystream_pos += (uint32_t) inputLen;
+    mirror_buffer_apply_keystream(mirror_buffer, input, output, (size_t) inputLen);
+}
+
+void mirror_buffer_decrypt_inplace(mirror_buffer_t *mirror_buffer, unsigned char* data, int dataLen) {
+    mirror_buffer_decrypt(mirror_buffer, data, data, dataLen);
+}
+
+int
+mirror_buffer_seek_keystream(mirror_buffer_t *mirror_buffer, uint32_t keystream_offset)
+{
+    uint32_t skip = keystream_offset - mirror_buffer->keystream_pos;
+    if (skip > INT32_MAX) {
+        return -1;
+    }
+    mirror_buffer->keystream_pos += skip;
+    mirror_buffer_apply_keystream(mirror_buffer, NULL, NULL, skip);
+    return (int) skip;
+}
+
+static void
+mirror_buffer_free_entry(mirror_buffer_t *mirror_buffer, mirror_buffer_entry_t *entry)
+{
+    if (entry->filled) {
+        entry->filled = 0;
+        mirror_buffer->held--;
+    }
+}
+
+int
+mirror_buffer_queue(mirror_buffer_t *mirror_buffer, unsigned char *datagram, int datalen, uint64_t arrival_time)
+{
+    if (datalen < MIRROR_BUFFER_RTP_HEADER_LEN || (datagram[0] >> 6) != 2) {
+        return -1;
+    }
+    if (!mirror_buffer->entries) {
+        mirror_buffer->entries = calloc(MIRROR_BUFFER_REORDER_SLOTS, sizeof(mirror_buffer_entry_t));
+        if (!mirror_buffer->entries) {
+            return -1;
+        }
+    }
+
+    unsigned short seqnum = byteutils_get_short_be(datagram, 2);
+    if (!mirror_buffer->reorder_started) {
+        // Senders start the stream at a frame
+        mirror_buffer->reorder_started = 1;
+        mirror_buffer->next_seqnum = seqnum;
+        mirror_buffer->highest_seqnum = seqnum;
+        mirror_buffer->at_frame_start = 1;
+    }
+    short ahead = (short) (seqnum - mirror_buffer->next_seqnum);
+    if (ahead < 0 && !mirror_buffer->delivered &&
+        (short) (mirror_buffer->highest_seqnum - seqnum) < MIRROR_BUFFER_REORDER_SLOTS) {
+        mirror_buffer->next_seqnum = seqnum;
+        ahead = 0;
+    }
+    if (ahead < 0) {
+        return -1;
+    }
+    if (ahead >= MIRROR_BUFFER_REORDER_SLOTS) {
+        // Too much went missing to wait for any of it, start over at this datagram
+        logger_log(mirror_buffer->logger, LOGGER_WARNING, "mirror_buffer jumped %d datagrams ahead, dropping %d held",
+                   ahead, mirror_buffer->held);
+        for (int i = 0; i < MIRROR_BUFFER_REORDER_SLOTS; i++) {
+            mirror_buffer_free_entry(mirror_buffer, &mirror_buffer->entries[i]);
+        }
+        mirror_buffer->lost_frames++;
+        mirror_buffer->next_seqnum = seqnum;
+        mirror_buffer->highest_seqnum = seqnum;
+        mirror_buffer->at_frame_start = 0;
+        mirror_buffer->gap_pending = 0;
+    }
+
+    mirror_buffer_entry_t *entry = &mirror_buffer->entries[seqnum & (MIRROR_BUFFER_REORDER_SLOTS - 1)];
+    if (entry->filled) {
+        return -1;
+    }
+    int len = datalen - MIRROR_BUFFER_RTP_HEADER_LEN;
+    if (len > entry->capacity) {
+        unsigned char *data = realloc(entry->data, len);
+        if (!data) {
+            return -1;
+        }
+        entry->data = data;
+        entry->capacity = len;
+    }
+    memcpy(entry->data, datagram + MIRROR_BUFFER_RTP_HEADER_LEN, len);
+    entry->len = len;
+    entry->seqnum = seqnum;
+    entry->marker = (datagram[1] & 0x80) != 0;
+    entry->keystream_offset = byteutils_get_int_be(datagram, 4);
+    entry->arrival_time = arrival_time;
+    entry->filled = 1;
+    mirror_buffer->held++;
+    if ((short) (seqnum - mirror_buffer->highest_seqnum) > 0) {
+        mirror_buffer->highest_seqnum = seqnum;
     }
+    return 0;
+}
+
+static mirror_buffer_entry_t *
+mirror_buffer_get_entry(mirror_buffer_t *mirror_buffer, unsigned short seqnum)
+{
+    mirror_buffer_entry_t *entry = &mirror_buffer->entries[seqnum & (MIRROR_BUFFER_REORDER_SLOTS - 1)];
+    return entry->filled ? entry : NULL;
+}
+
+int
+mirror_buffer_next_frame(mirror_buffer_t *mirror_buffer, uint64_t now, mirror_buffer_frame_t *frame)
+{
+    while (mirror_buffer->held > 0) {
+        mirror_buffer_entry_t *entry;
+        if (!mirror_buffer->at_frame_start) {
+            // What is left of a lost frame, up to and including its last datagram
+            entry = mirror_buffer_get_entry(mirror_buffer, mirror_buffer->next_seqnum);
+            if (entry) {
+                mirror_buffer->at_frame_start = entry->marker;
+                mirror_buffer_free_entry(mirror_buffer, entry);
+            }
+            mirror_buffer->next_seqnum++;
+            continue;
+        }
+
+        unsigned short seqnum = mirror_buffer->next_seqnum;
+        int datagrams = 0;
+        int total = 0;
+        int complete = 0;
+        while (datagrams < MIRROR_BUFFER_REORDER_SLOTS && (entry = mirror_buffer_get_entry(mirror_buffer, seqnum)) != NULL) {
+            total += entry->len;
+            datagrams++;
+            if (entry->marker) {
+                complete = 1;
+                break;
+            }
+            seqnum++;
+        }
+
+        if (!complete) {
+            if ((short) (seqnum - mirror_buffer->highest_seqnum) > 0) {
+                // Nothing missing, the rest of the frame is still on its way
+                mirror_buffer->gap_pending = 0;
+                return 0;
+            }
+            // The gap is as old as the first datagram that arrived behind it
+            mirror_buffer_entry_t *behind = NULL;
+            for (unsigned short next = seqnum + 1; !behind && (short) (next - mirror_buffer->highest_seqnum) <= 0; next++) {
+                behind = mirror_buffer_get_entry(mirror_buffer, next);
+            }
+            mirror_buffer->gap_pending = 1;
+            if (behind && (int64_t) (now - behind->arrival_time) < MIRROR_BUFFER_REORDER_WAIT &&
+                mirror_buffer->held < MIRROR_BUFFER_REORDER_SLOTS / 4 * 3) {
+                return 0;
+            }
+            logger_log(mirror_buffer->logger, LOGGER_DEBUG, "mirror_buffer datagram %u missing, dropping its frame", seqnum);
+            mirror_buffer->lost_frames++;
+            mirror_buffer->at_frame_start = 0;
+            continue;
+        }
+        mirror_buffer->gap_pending = 0;
+
+        // The header may be split over datagrams like the payload
+        int header_len = 0;
+        seqnum = mirror_buffer->next_seqnum;
+        for (int i = 0; i < datagrams && header_len < MIRROR_BUFFER_FRAME_HEADER_LEN; i++, seqnum++) {
+            entry = mirror_buffer_get_entry(mirror_buffer, seqnum);
+            int len = entry->len;
+            if (len > MIRROR_BUFFER_FRAME_HEADER_LEN - header_len) {
+                len = MIRROR_BUFFER_FRAME_HEADER_LEN - header_len;
+            }
+            memcpy(frame->header + header_len, entry->data, len);
+            header_len += len;
+        }
+        entry = mirror_buffer_get_entry(mirror_buffer, mirror_buffer->next_seqnum);
+        frame->keystream_offset = entry->keystream_offset;
+        frame->arrival_time = entry->arrival_time;
+        frame->payload_size = header_len == MIRROR_BUFFER_FRAME_HEADER_LEN ? (int) byteutils_get_int(frame->header, 0) : -1;
+        mirror_buffer->frame_datagrams = datagrams;
+        if (frame->payload_size < 0 || frame->payload_size != total - MIRROR_BUFFER_FRAME_HEADER_LEN) {
+            logger_log(mirror_buffer->logger, LOGGER_ERR, "mirror_buffer dropping malformed frame of %d bytes in %d datagrams",
+                       total, datagrams);
+            mirror_buffer_take_frame(mirror_buffer, NULL);
+            mirror_buffer->lost_frames++;
+            continue;
+        }
+        mirror_buffer->delivered = 1;
+        return 1;
+    }
+    mirror_buffer->gap_pending = 0;
+    return 0;
 }
 
+void
+mirror_buffer_take_frame(mirror_buffer_t *mirror_buffer, unsigned char *payload)
+{
+    int skip = MIRROR_BUFFER_FRAME_HEADER_LEN;
+    for (int i = 0; i < mirror_buffer->frame_datagrams; i++, mirror_buffer->next_seqnum++) {
+        mirror_buffer_entry_t *entry = mirror_buffer_get_entry(mirror_buffer, mirror_buffer->next_seqnum);
+        int offset = skip < entry->len ? skip : entry->len;
+        skip -= offset;
+        if (payload) {
+            memcpy(payload, entry->data + offset, entry->len - offset);
+            payload += entry->len - offset;
+        }
+        mirror_buffer_free_entry(mirror_buffer, entry);
+    }
+    mirror_buffer->frame_datagrams = 0;
+}
+
+int
+mirror_buffer_has_gap(mirror_buffer_t *mirror_buffer)
+{
+    return mirror_buffer->gap_pending;
+}
+
+int
+mirror_buffer_take_lost_frames(mirror_buffer_t *mirror_buffer)
+{
+    int lost = mirror_buffer->lost_frames;
+    mirror_buffer->lost_frames = 0;
+    return lost;
+}
 void
 mirror_buffer_destroy(mirror_buffer_t *mirror_buffer)
 {
     if (mirror_buffer) {
+        if (mirror_buffer->entries) {
+            for (int i = 0; i < MIRROR_BUFFER_REORDER_SLOTS; i++) {
+                free(mirror_buffer->entries[i].data);
+            }
+            free(mirror_buffer->entries);
+        }
+        mirror_buffer_stop_keystream(mirror_buffer);
+        mirror_buffer_destroy_workers(mirror_buffer);
         aes_ctr_destroy(mirror_buffer->aes_ctx);
+        MUTEX_DESTROY(mirror_buffer->keystream_mutex);
+        COND_DESTROY(mirror_buffer->keystream_cond);
+        free(mirror_buffer->keystream);
         free(mirror_buffer);
     }
 }
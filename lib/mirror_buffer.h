@@ -20,11 +20,48 @@
 
 typedef struct mirror_buffer_s mirror_buffer_t;
 
+/*
+ * The UDP mirroring transport carries the same stream as the TCP one, 128 byte frame headers
+ * each followed by their payload, split into datagrams behind a 12 byte RTP header. Every frame
+ * starts a new datagram and the marker bit flags its last one. The RTP timestamp holds the
+ * count of encrypted payload bytes sent before the frame, modulo 2^32, so the keystream can be
+ * caught up after a lost frame.
+ */
+#define MIRROR_BUFFER_FRAME_HEADER_LEN 128
+/* Micro seconds a gap is waited on for its datagrams to arrive out of order */
+#define MIRROR_BUFFER_REORDER_WAIT 20000
+
+typedef struct {
+    unsigned char header[MIRROR_BUFFER_FRAME_HEADER_LEN];
+    int payload_size;
+    uint32_t keystream_offset;
+    /* Arrival of the first datagram */
+    uint64_t arrival_time;
+} mirror_buffer_frame_t;
+
 
 mirror_buffer_t *mirror_buffer_init( logger_t *logger,
         const unsigned char *aeskey,
         const unsigned char *ecdh_secret);
 void mirror_buffer_init_aes(mirror_buffer_t *mirror_buffer, uint64_t streamConnectionID);
+/* Decrypts and copies in a single pass, input and output may be the same buffer */
 void mirror_buffer_decrypt(mirror_buffer_t *raop_mirror, unsigned char* input, unsigned char* output, int datalen);
+void mirror_buffer_decrypt_inplace(mirror_buffer_t *raop_mirror, unsigned char* data, int datalen);
+/* Advances the keystream to a frame of the UDP transport, returns the bytes skipped or -1 if it is already past it */
+int mirror_buffer_seek_keystream(mirror_buffer_t *mirror_buffer, uint32_t keystream_offset);
+
+/* Queues a datagram of the UDP transport for reordering, returns -1 if it is malformed, late or a duplicate */
+int mirror_buffer_queue(mirror_buffer_t *mirror_buffer, unsigned char *datagram, int datalen, uint64_t arrival_time);
+/*
+ * Returns 1 and the header of the next complete frame, 0 if there is none yet. Frames hit by a gap
+ * that stays open for longer than MIRROR_BUFFER_REORDER_WAIT are given up on and counted as lost.
+ */
+int mirror_buffer_next_frame(mirror_buffer_t *mirror_buffer, uint64_t now, mirror_buffer_frame_t *frame);
+/* Copies out the payload of the frame returned by mirror_buffer_next_frame, a NULL payload discards it */
+void mirror_buffer_take_frame(mirror_buffer_t *mirror_buffer, unsigned char *payload);
+/* Whether datagrams are held back behind a gap, mirror_buffer_next_frame has to be called again soon then */
+int mirror_buffer_has_gap(mirror_buffer_t *mirror_buffer);
+/* Frames lost since the last call */
+int mirror_buffer_take_lost_frames(mirror_buffer_t *mirror_buffer);
 void mirror_buffer_destroy(mirror_buffer_t *mirror_buffer);
 #endif //MIRROR_BUFFER_H
@@ -13,10 +13,31 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
+#include <strings.h>
+#ifndef WIN32
+#include <ifaddrs.h>
+#endif
+
+#include "netutils.h"
+#include "media_clock.h"
+
+static netutils_qos_t netutils_qos[NETUTILS_QOS_COUNT] = {
+    [NETUTILS_QOS_TIMING] = { NETUTILS_DSCP_EF, 6 },
+    [NETUTILS_QOS_AUDIO_CONTROL] = { NETUTILS_DSCP_EF, 6 },
+    [NETUTILS_QOS_AUDIO] = { NETUTILS_DSCP_EF, 6 },
+    [NETUTILS_QOS_MIRROR] = { NETUTILS_DSCP_AF41, 5 },
+};
 
-#include "compat.h"
+static const char *netutils_qos_roles[NETUTILS_QOS_COUNT] = {
+    [NETUTILS_QOS_TIMING] = "timing",
+    [NETUTILS_QOS_AUDIO_CONTROL] = "control",
+    [NETUTILS_QOS_AUDIO] = "audio",
+    [NETUTILS_QOS_MIRROR] = "mirror",
+};
 
 int
 netutils_init()
@@ -81,6 +102,23 @@ netutils_get_address(void *sockaddr, int *length)
     return NULL;
 }
 
+unsigned short
+netutils_get_local_port(int fd)
+{
+    struct sockaddr_storage saddr;
+    socklen_t saddrlen = sizeof(saddr);
+
+    if (getsockname(fd, (struct sockaddr *) &saddr, &saddrlen) < 0) {
+        return 0;
+    }
+    if (saddr.ss_family == AF_INET6) {
+        return ntohs(((struct sockaddr_in6 *) &saddr)->sin6_port);
+    } else if (saddr.ss_family == AF_INET) {
+        return ntohs(((struct sockaddr_in *) &saddr)->sin_port);
+    }
+    return 0;
+}
+
 int
 netutils_init_socket(unsigned short *port, int use_ipv6, int use_udp)
 {
@@ -106,6 +144,9 @@ netutils_init_socket(unsigned short *port, int use_ipv6, int use_udp)
         goto cleanup;
     }
 
+    /* Not fatal, the receive paths fall back to reading the clock themselves */
+    netutils_enable_timestamps(server_fd);
+
     memset(&saddr, 0, sizeof(saddr));
     if (use_ipv6) {
         struct sockaddr_in6 *sin6ptr = (struct sockaddr_in6 *)&saddr;
@@ -164,6 +205,67 @@ netutils_init_socket(unsigned short *port, int use_ipv6, int use_udp)
     return -1;
 }
 
+int
+netutils_enable_timestamps(int fd)
+{
+#ifdef SO_TIMESTAMPNS
+    int enable = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+#else
+    return -1;
+#endif
+}
+
+uint64_t
+netutils_get_recv_timestamp(struct msghdr *msg)
+{
+#ifdef SCM_TIMESTAMPNS
+    struct cmsghdr *cmsg;
+    for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec time;
+            memcpy(&time, CMSG_DATA(cmsg), sizeof(time));
+            return media_clock_from_realtime(&time);
+        }
+    }
+#endif
+    return 0;
+}
+
+int
+netutils_recv_timestamped(int fd, void *buf, int len, void *saddr, socklen_t *saddrlen, uint64_t *timestamp)
+{
+#ifdef SCM_TIMESTAMPNS
+    struct msghdr msg;
+    struct iovec iov;
+    union {
+        char buf[NETUTILS_CMSG_SPACE];
+        struct cmsghdr align;
+    } control;
+    int ret;
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_name = saddr;
+    msg.msg_namelen = saddrlen ? *saddrlen : 0;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ret = recvmsg(fd, &msg, 0);
+    if (ret >= 0) {
+        if (saddrlen) *saddrlen = msg.msg_namelen;
+        if (timestamp) *timestamp = netutils_get_recv_timestamp(&msg);
+    }
+    return ret;
+#else
+    if (timestamp) *timestamp = 0;
+    return recvfrom(fd, buf, len, 0, saddr, saddrlen);
+#endif
+}
+
 // Src is the ip address
 int
 netutils_parse_address(int family, const char *src, void *dst, int dstlen)
@@ -201,3 +303,184 @@ netutils_parse_address(int family, const char *src, void *dst, int dstlen)
     freeaddrinfo(result);
     return length;
 }
+
+int
+netutils_init_address(void *dst, int dstlen, const unsigned char *addr, int addrlen, unsigned short port, unsigned int scope_id)
+{
+    if (!dst || !addr) {
+        return -1;
+    }
+    if (addrlen == 4 && dstlen >= (int) sizeof(struct sockaddr_in)) {
+        struct sockaddr_in *sin = dst;
+        memset(sin, 0, sizeof(*sin));
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(port);
+        memcpy(&sin->sin_addr.s_addr, addr, 4);
+        return sizeof(*sin);
+    } else if (addrlen == 16 && dstlen >= (int) sizeof(struct sockaddr_in6)) {
+        struct sockaddr_in6 *sin6 = dst;
+        memset(sin6, 0, sizeof(*sin6));
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(port);
+        memcpy(sin6->sin6_addr.s6_addr, addr, 16);
+        sin6->sin6_scope_id = scope_id;
+        return sizeof(*sin6);
+    }
+    return -1;
+}
+
+unsigned int
+netutils_get_scope_id(const unsigned char *local, int locallen)
+{
+    unsigned int scope_id = 0;
+#ifndef WIN32
+    struct ifaddrs *ifaddrs;
+    struct ifaddrs *ifa;
+
+    /* Only fe80::/10 addresses are ambiguous without their interface */
+    if (locallen != 16 || local[0] != 0xfe || (local[1] & 0xc0) != 0x80) {
+        return 0;
+    }
+    if (getifaddrs(&ifaddrs) < 0) {
+        return 0;
+    }
+    for (ifa = ifaddrs; ifa != NULL; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr && ifa->ifa_addr->sa_family == AF_INET6 &&
+            !memcmp(((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_addr.s6_addr, local, 16)) {
+            scope_id = ((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_scope_id;
+            break;
+        }
+    }
+    freeifaddrs(ifaddrs);
+#endif
+    return scope_id;
+}
+
+const char *
+netutils_format_address(const unsigned char *addr, int addrlen, char *dst, int dstlen)
+{
+    if (addrlen == 4 && inet_ntop(AF_INET, addr, dst, dstlen)) {
+        return dst;
+    } else if (addrlen == 16 && inet_ntop(AF_INET6, addr, dst, dstlen)) {
+        return dst;
+    }
+    snprintf(dst, dstlen, "(invalid)");
+    return dst;
+}
+
+static int
+netutils_parse_dscp(const char *text, int len)
+{
+    char name[8];
+    char *end;
+    long value;
+
+    if (len <= 0 || len >= (int) sizeof(name)) {
+        return -1;
+    }
+    memcpy(name, text, len);
+    name[len] = '\0';
+
+    if (!strcasecmp(name, "ef")) {
+        return NETUTILS_DSCP_EF;
+    }
+    if (!strncasecmp(name, "af", 2) && len == 4 &&
+        name[2] >= '1' && name[2] <= '4' && name[3] >= '1' && name[3] <= '3') {
+        return (name[2] - '0') * 8 + (name[3] - '0') * 2;
+    }
+    if (!strncasecmp(name, "cs", 2) && len == 3 && name[2] >= '0' && name[2] <= '7') {
+        return (name[2] - '0') * 8;
+    }
+    value = strtol(name, &end, 10);
+    if (*end || value < 0 || value > 63) {
+        return -1;
+    }
+    return (int) value;
+}
+
+int
+netutils_qos_parse(const char *spec, netutils_qos_role_t *role, netutils_qos_t *qos)
+{
+    const char *dscp = strchr(spec, ':');
+    const char *priority;
+    char *end;
+    int i;
+
+    if (!dscp) {
+        return -1;
+    }
+    for (i = 0; i < NETUTILS_QOS_COUNT; i++) {
+        if ((int) strlen(netutils_qos_roles[i]) == dscp - spec && !strncmp(spec, netutils_qos_roles[i], dscp - spec)) {
+            break;
+        }
+    }
+    if (i == NETUTILS_QOS_COUNT) {
+        return -1;
+    }
+    dscp++;
+    priority = strchr(dscp, ':');
+    qos->dscp = netutils_parse_dscp(dscp, priority ? (int) (priority - dscp) : (int) strlen(dscp));
+    if (qos->dscp < 0) {
+        return -1;
+    }
+    // Without a priority the DSCP class alone decides, as 802.1p would from the top three bits
+    qos->priority = qos->dscp >> 3;
+    if (priority) {
+        long value = strtol(priority + 1, &end, 10);
+        if (end == priority + 1 || *end || value < 0 || value > 6) {
+            return -1;
+        }
+        qos->priority = (int) value;
+    }
+    *role = (netutils_qos_role_t) i;
+    return 0;
+}
+
+void
+netutils_set_qos(netutils_qos_role_t role, const netutils_qos_t *qos)
+{
+    assert(role < NETUTILS_QOS_COUNT);
+    netutils_qos[role] = *qos;
+}
+
+void
+netutils_disable_qos()
+{
+    for (int i = 0; i < NETUTILS_QOS_COUNT; i++) {
+        netutils_qos[i].dscp = -1;
+        netutils_qos[i].priority = -1;
+    }
+}
+
+int
+netutils_apply_qos(int fd, netutils_qos_role_t role)
+{
+    const netutils_qos_t *qos = &netutils_qos[role];
+    struct sockaddr_storage saddr;
+    socklen_t saddrlen = sizeof(saddr);
+    int ret = 0;
+
+    if (qos->dscp >= 0) {
+        int tos = qos->dscp << 2;
+        if (getsockname(fd, (struct sockaddr *) &saddr, &saddrlen) < 0) {
+            return -1;
+        }
+        if (saddr.ss_family == AF_INET6) {
+            // Dual stack sockets send IPv4 with the IPv4 option, so set both
+            if (setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS, (const void *) &tos, sizeof(tos)) < 0) {
+                ret = -1;
+            }
+            setsockopt(fd, IPPROTO_IP, IP_TOS, (const void *) &tos, sizeof(tos));
+        } else if (setsockopt(fd, IPPROTO_IP, IP_TOS, (const void *) &tos, sizeof(tos)) < 0) {
+            ret = -1;
+        }
+    }
+#ifdef SO_PRIORITY
+    // Setting IP_TOS resets the priority to the one of the TOS, so it comes second
+    if (qos->priority >= 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_PRIORITY, (const void *) &qos->priority, sizeof(qos->priority)) < 0) {
+        ret = -1;
+    }
+#endif
+    return ret;
+}
@@ -15,11 +15,75 @@
 #ifndef NETUTILS_H
 #define NETUTILS_H
 
+#include <stdint.h>
+#include "compat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Room for the SCM_TIMESTAMPNS control message of a received datagram */
+#define NETUTILS_CMSG_SPACE 64
+
 int netutils_init();
 void netutils_cleanup();
 
 int netutils_init_socket(unsigned short *port, int use_ipv6, int use_udp);
 unsigned char *netutils_get_address(void *sockaddr, int *length);
+/* The local port socket fd is bound to, 0 if it cannot be read */
+unsigned short netutils_get_local_port(int fd);
 int netutils_parse_address(int family, const char *src, void *dst, int dstlen);
+/*
+ * Fills dst with the sockaddr for a 4 or 16 byte address as returned by netutils_get_address,
+ * returns its length or -1. The scope id is only needed for IPv6 link-local addresses.
+ */
+int netutils_init_address(void *dst, int dstlen, const unsigned char *addr, int addrlen, unsigned short port, unsigned int scope_id);
+/* Index of the interface holding this local IPv6 link-local address, 0 for any other address */
+unsigned int netutils_get_scope_id(const unsigned char *local, int locallen);
+/* Formats a 4 or 16 byte address for logging, dst needs room for INET6_ADDRSTRLEN characters */
+const char *netutils_format_address(const unsigned char *addr, int addrlen, char *dst, int dstlen);
+
+/*
+ * Kernel receive timestamps (SO_TIMESTAMPNS) in micro seconds, converted from the wall clock
+ * to MEDIA_CLOCK, the clock of raop_ntp_get_local_time. A timestamp of 0 means the kernel did not
+ * provide one and the caller has to read the clock itself.
+ */
+int netutils_enable_timestamps(int fd);
+uint64_t netutils_get_recv_timestamp(struct msghdr *msg);
+int netutils_recv_timestamped(int fd, void *buf, int len, void *saddr, socklen_t *saddrlen, uint64_t *timestamp);
+
+/*
+ * QoS marking per socket role. The DSCP goes into IP_TOS or IPV6_TCLASS, where WMM access
+ * points map it to their voice and video queues, and the priority into SO_PRIORITY for the
+ * local qdisc. By default timing and audio control are sent as voice (EF) and the mirror
+ * stream, whose ACKs are all we send there, as video (AF41); -1 keeps the system default.
+ */
+typedef enum netutils_qos_role_e {
+    NETUTILS_QOS_TIMING,
+    NETUTILS_QOS_AUDIO_CONTROL,
+    NETUTILS_QOS_AUDIO,
+    NETUTILS_QOS_MIRROR,
+    NETUTILS_QOS_COUNT
+} netutils_qos_role_t;
+
+typedef struct netutils_qos_s {
+    int dscp;
+    int priority;
+} netutils_qos_t;
+
+#define NETUTILS_DSCP_EF 46
+#define NETUTILS_DSCP_AF41 34
+
+/* Parses role:dscp[:priority], the dscp a number or ef, afXY or csN; returns -1 if invalid */
+int netutils_qos_parse(const char *spec, netutils_qos_role_t *role, netutils_qos_t *qos);
+void netutils_set_qos(netutils_qos_role_t role, const netutils_qos_t *qos);
+/* Leaves every role at the system default */
+void netutils_disable_qos();
+/* Marks the socket for its role, returns -1 if the kernel refused, e.g. a priority above 6 without CAP_NET_ADMIN */
+int netutils_apply_qos(int fd, netutils_qos_role_t role);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
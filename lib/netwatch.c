@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "netwatch.h"
+
+#ifdef __linux__
+
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <unistd.h>
+
+#include "threads.h"
+#include "reactor.h"
+
+// Changes come in bursts, a new address usually with a route and a link update or two
+#define NETWATCH_SETTLE_MS 250
+#define NETWATCH_SNAPSHOT_SIZE 2048
+#define NETWATCH_MAX_LINKS 32
+
+struct netwatch_s {
+    logger_t *logger;
+    netwatch_callback_t callback;
+    void *cls;
+
+    int sock;
+    reactor_t *reactor;
+    thread_handle_t thread;
+    int running;
+
+    // The addresses of the running interfaces as of the last callback, see netwatch_snapshot
+    char snapshot[NETWATCH_SNAPSHOT_SIZE];
+    // Interface index and carrier of the links seen so far, to tell a lost carrier from repeats
+    int link_index[NETWATCH_MAX_LINKS];
+    int link_running[NETWATCH_MAX_LINKS];
+    int link_count;
+};
+
+/* Records the carrier of a link, returns 1 if it just lost it */
+static int
+netwatch_update_link(netwatch_t *netwatch, int index, int running)
+{
+    int i;
+    for (i = 0; i < netwatch->link_count && netwatch->link_index[i] != index; i++);
+    if (i == netwatch->link_count) {
+        if (i == NETWATCH_MAX_LINKS) {
+            return 0;
+        }
+        netwatch->link_index[i] = index;
+        netwatch->link_running[i] = 0;
+        netwatch->link_count++;
+    }
+    int lost = netwatch->link_running[i] && !running;
+    netwatch->link_running[i] = running;
+    return lost;
+}
+
+/* Lists the addresses senders can reach us at, in the order the kernel reports them */
+static void
+netwatch_snapshot(netwatch_t *netwatch, char *snapshot, int size, int seed_links)
+{
+    struct ifaddrs *ifaddrs, *ifa;
+    int used = 0;
+
+    snapshot[0] = '\0';
+    if (getifaddrs(&ifaddrs) < 0) {
+        return;
+    }
+    for (ifa = ifaddrs; ifa; ifa = ifa->ifa_next) {
+        char address[INET6_ADDRSTRLEN];
+        const void *in_addr;
+
+        if (!ifa->ifa_addr || (ifa->ifa_flags & IFF_LOOPBACK)) {
+            continue;
+        }
+        if (seed_links) {
+            netwatch_update_link(netwatch, if_nametoindex(ifa->ifa_name), !!(ifa->ifa_flags & IFF_RUNNING));
+        }
+        if (!(ifa->ifa_flags & IFF_RUNNING)) {
+            continue;
+        }
+        if (ifa->ifa_addr->sa_family == AF_INET) {
+            in_addr = &((struct sockaddr_in *) ifa->ifa_addr)->sin_addr;
+        } else if (ifa->ifa_addr->sa_family == AF_INET6) {
+            in_addr = &((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_addr;
+        } else {
+            continue;
+        }
+        if (!inet_ntop(ifa->ifa_addr->sa_family, in_addr, address, sizeof(address))) {
+            continue;
+        }
+        int written = snprintf(snapshot + used, size - used, "%s/%s ", ifa->ifa_name, address);
+        if (written < 0 || written >= size - used) {
+            break;
+        }
+        used += written;
+    }
+    freeifaddrs(ifaddrs);
+}
+
+/* Reads the pending messages, returns 1 if a link went down, 0 if not and -1 on error */
+static int
+netwatch_receive(netwatch_t *netwatch)
+{
+    char buffer[8192];
+    int link_lost = 0;
+
+    for (;;) {
+        ssize_t len = recv(netwatch->sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (len < 0) {
+            // ENOBUFS means messages were lost, which is a change all the same
+            return errno == EAGAIN || errno == EWOULDBLOCK ? link_lost : errno == ENOBUFS ? 1 : -1;
+        }
+        for (struct nlmsghdr *nh = (struct nlmsghdr *) buffer; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type == RTM_NEWLINK) {
+                struct ifinfomsg *ifi = NLMSG_DATA(nh);
+                // Wireless drivers also send these for scan results, only a lost carrier counts
+                if (!(ifi->ifi_flags & IFF_LOOPBACK) &&
+                    netwatch_update_link(netwatch, ifi->ifi_index, !!(ifi->ifi_flags & IFF_RUNNING))) {
+                    link_lost = 1;
+                }
+            } else if (nh->nlmsg_type == RTM_DELLINK) {
+                struct ifinfomsg *ifi = NLMSG_DATA(nh);
+                link_lost |= netwatch_update_link(netwatch, ifi->ifi_index, 0);
+            }
+        }
+    }
+}
+
+static THREAD_RETVAL
+netwatch_thread(void *arg)
+{
+    netwatch_t *netwatch = arg;
+    int ready[1];
+    int pending = 0, link_lost = 0;
+
+    while (ATOMIC_LOAD(netwatch->running)) {
+        int nready = reactor_wait(netwatch->reactor, ready, 1, pending ? NETWATCH_SETTLE_MS : -1);
+        if (nready < 0) {
+            logger_log(netwatch->logger, LOGGER_ERR, "netwatch error in reactor wait");
+            break;
+        }
+        if (nready > 0) {
+            int ret = netwatch_receive(netwatch);
+            if (ret < 0) {
+                logger_log(netwatch->logger, LOGGER_ERR, "netwatch error receiving from netlink: %d", errno);
+                break;
+            }
+            link_lost |= ret;
+            pending = 1;
+            continue;
+        }
+        if (!pending) {
+            continue;
+        }
+
+        // Quiet for NETWATCH_SETTLE_MS, see whether anything senders would notice changed
+        char snapshot[NETWATCH_SNAPSHOT_SIZE];
+        netwatch_snapshot(netwatch, snapshot, sizeof(snapshot), 0);
+        if (link_lost || strcmp(snapshot, netwatch->snapshot)) {
+            logger_log(netwatch->logger, LOGGER_INFO, "Network changed, now at %s", snapshot[0] ? snapshot : "no address");
+            memcpy(netwatch->snapshot, snapshot, sizeof(snapshot));
+            netwatch->callback(netwatch->cls);
+        }
+        pending = link_lost = 0;
+    }
+    return 0;
+}
+
+netwatch_t *
+netwatch_init(logger_t *logger, netwatch_callback_t callback, void *cls)
+{
+    netwatch_t *netwatch;
+    struct sockaddr_nl addr;
+
+    assert(callback);
+
+    netwatch = calloc(1, sizeof(netwatch_t));
+    if (!netwatch) {
+        return NULL;
+    }
+    netwatch->logger = logger;
+    netwatch->callback = callback;
+    netwatch->cls = cls;
+
+    netwatch->sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (netwatch->sock < 0) {
+        logger_log(logger, LOGGER_WARNING, "netwatch could not open a netlink socket: %d", errno);
+        free(netwatch);
+        return NULL;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (bind(netwatch->sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        logger_log(logger, LOGGER_WARNING, "netwatch could not subscribe to interface changes: %d", errno);
+        close(netwatch->sock);
+        free(netwatch);
+        return NULL;
+    }
+
+    netwatch->reactor = reactor_init(logger);
+    if (!netwatch->reactor || reactor_add(netwatch->reactor, netwatch->sock) < 0) {
+        if (netwatch->reactor) reactor_destroy(netwatch->reactor);
+        close(netwatch->sock);
+        free(netwatch);
+        return NULL;
+    }
+    netwatch_snapshot(netwatch, netwatch->snapshot, sizeof(netwatch->snapshot), 1);
+
+    ATOMIC_STORE(netwatch->running, 1);
+    THREAD_CREATE(netwatch->thread, netwatch_thread, netwatch);
+    if (!netwatch->thread) {
+        reactor_destroy(netwatch->reactor);
+        close(netwatch->sock);
+        free(netwatch);
+        return NULL;
+    }
+    thread_set_name(netwatch->thread, "netwtch");
+    return netwatch;
+}
+
+void
+netwatch_destroy(netwatch_t *netwatch)
+{
+    if (!netwatch) {
+        return;
+    }
+    ATOMIC_STORE(netwatch->running, 0);
+    reactor_wakeup(netwatch->reactor);
+    THREAD_JOIN(netwatch->thread);
+    reactor_destroy(netwatch->reactor);
+    close(netwatch->sock);
+    free(netwatch);
+}
+
+#else
+
+netwatch_t *
+netwatch_init(logger_t *logger, netwatch_callback_t callback, void *cls)
+{
+    logger_log(logger, LOGGER_DEBUG, "Watching for network changes needs rtnetlink");
+    return NULL;
+}
+
+void
+netwatch_destroy(netwatch_t *netwatch)
+{
+}
+
+#endif
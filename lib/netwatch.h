@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef NETWATCH_H
+#define NETWATCH_H
+
+#include "logger.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Watches the network interfaces through rtnetlink and calls back once they settled after
+ * a change that senders may have noticed: an address came or went, or a link lost its
+ * carrier, as on a Wi-Fi roam. A DHCP renewal that keeps the addresses does not count.
+ * Linux only, elsewhere netwatch_init returns NULL.
+ */
+typedef struct netwatch_s netwatch_t;
+
+/* Runs on the watcher's own thread */
+typedef void (*netwatch_callback_t)(void *cls);
+
+netwatch_t *netwatch_init(logger_t *logger, netwatch_callback_t callback, void *cls);
+void netwatch_destroy(netwatch_t *netwatch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //NETWATCH_H
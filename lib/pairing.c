@@ -14,19 +14,56 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
-
-#include <openssl/sha.h> // for SHA512_DIGEST_LENGTH
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "pairing.h"
 #include "crypto.h"
+#include "threads.h"
 
 #define SALT_KEY "Pair-Verify-AES-Key"
 #define SALT_IV "Pair-Verify-AES-IV"
 
+/* Ephemeral keys kept ready, a sender pairs once per connection and rarely more than two connect at once */
+#define PAIRING_ECDH_POOL_SIZE 4
+
+/* Sender identities remembered across connections, least recently used one replaced first */
+#define PAIRING_IDENTITY_CACHE_SIZE 8
+
+typedef struct pairing_identity_s {
+    unsigned char raw[ED25519_KEY_SIZE];
+    ed25519_key_t *key;
+    uint64_t last_used;
+    int verified;
+} pairing_identity_t;
+
+/*
+ * Generating the ephemeral ECDH key is the one part of a pair-verify that does not depend on the
+ * sender, so a thread keeps a few generated ahead and a handshake only takes one out of the pool.
+ */
 struct pairing_s {
     ed25519_key_t *ed;
+
+    /* Everything below only touched with ecdh_mutex locked */
+    x25519_key_t *ecdh_pool[PAIRING_ECDH_POOL_SIZE];
+    int ecdh_count;
+    int ecdh_stopping;
+    int ecdh_running;
+    thread_handle_t ecdh_thread;
+    mutex_handle_t ecdh_mutex;
+    cond_handle_t ecdh_cond;
+
+    /* Senders reconnect every time mirroring is started, keep their parsed public keys */
+    pairing_identity_t identities[PAIRING_IDENTITY_CACHE_SIZE];
+    uint64_t identity_clock;
+    mutex_handle_t identity_mutex;
+
+    /* Where ed and the verified identities are kept across restarts, NULL for a new key each time */
+    char *key_file;
 };
 
 typedef enum {
@@ -37,6 +74,7 @@ typedef enum {
 } status_t;
 
 struct pairing_session_s {
+    pairing_t *pairing;
     status_t status;
 
     ed25519_key_t *ed_ours;
@@ -45,27 +83,188 @@ struct pairing_session_s {
     x25519_key_t *ecdh_ours;
     x25519_key_t *ecdh_theirs;
     unsigned char ecdh_secret[X25519_KEY_SIZE];
+
+    unsigned char ed_theirs_raw[ED25519_KEY_SIZE];
+    int resumed;
+
+    /* Encrypts our signature and then decrypts theirs, the counter simply continues */
+    aes_ctx_t *aes_ctx;
+    int signature_sent;
 };
 
 static int
 derive_key_internal(pairing_session_t *session, const unsigned char *salt, unsigned int saltlen, unsigned char *key, unsigned int keylen)
 {
-    unsigned char hash[SHA512_DIGEST_LENGTH];
+    unsigned char hash[SHA512_DIGEST_SIZE];
 
     if (keylen > sizeof(hash)) {
         return -1;
     }
 
-    sha_ctx_t *ctx = sha_init();
-    sha_update(ctx, salt, saltlen);
-    sha_update(ctx, session->ecdh_secret, X25519_KEY_SIZE);
-    sha_final(ctx, hash, NULL);
-    sha_destroy(ctx);
+    sha512_oneshot2(salt, saltlen, session->ecdh_secret, X25519_KEY_SIZE, hash);
 
     memcpy(key, hash, keylen);
     return 0;
 }
 
+static THREAD_RETVAL
+pairing_ecdh_thread(void *arg)
+{
+    pairing_t *pairing = arg;
+
+    MUTEX_LOCK(pairing->ecdh_mutex);
+    while (!pairing->ecdh_stopping) {
+        if (pairing->ecdh_count == PAIRING_ECDH_POOL_SIZE) {
+            COND_WAIT(pairing->ecdh_cond, pairing->ecdh_mutex);
+            continue;
+        }
+        MUTEX_UNLOCK(pairing->ecdh_mutex);
+        x25519_key_t *key = x25519_key_generate();
+        MUTEX_LOCK(pairing->ecdh_mutex);
+        if (!key) {
+            break;
+        }
+        pairing->ecdh_pool[pairing->ecdh_count++] = key;
+    }
+    MUTEX_UNLOCK(pairing->ecdh_mutex);
+    return 0;
+}
+
+/* Takes a key out of the pool and has the thread replace it, generates one if the pool ran dry */
+static x25519_key_t *
+pairing_take_ecdh_key(pairing_t *pairing)
+{
+    x25519_key_t *key = NULL;
+
+    MUTEX_LOCK(pairing->ecdh_mutex);
+    if (pairing->ecdh_count > 0) {
+        key = pairing->ecdh_pool[--pairing->ecdh_count];
+        COND_SIGNAL(pairing->ecdh_cond);
+    }
+    MUTEX_UNLOCK(pairing->ecdh_mutex);
+
+    return key ? key : x25519_key_generate();
+}
+
+/*
+ * Returns a reference to the public key of a sender, parsed only the first time it is seen.
+ * known is set when the sender completed a pair-verify with this key before.
+ */
+static ed25519_key_t *
+pairing_get_identity(pairing_t *pairing, const unsigned char raw[ED25519_KEY_SIZE], int *known)
+{
+    pairing_identity_t *oldest = &pairing->identities[0];
+    ed25519_key_t *key;
+
+    MUTEX_LOCK(pairing->identity_mutex);
+    for (int i = 0; i < PAIRING_IDENTITY_CACHE_SIZE; i++) {
+        pairing_identity_t *identity = &pairing->identities[i];
+        if (identity->key && !memcmp(identity->raw, raw, ED25519_KEY_SIZE)) {
+            identity->last_used = ++pairing->identity_clock;
+            *known = identity->verified;
+            key = ed25519_key_copy(identity->key);
+            MUTEX_UNLOCK(pairing->identity_mutex);
+            return key;
+        }
+        if (!identity->key || identity->last_used < oldest->last_used) {
+            oldest = identity;
+        }
+    }
+
+    *known = 0;
+    key = ed25519_key_from_raw(raw);
+    ed25519_key_destroy(oldest->key);
+    memcpy(oldest->raw, raw, ED25519_KEY_SIZE);
+    oldest->key = ed25519_key_copy(key);
+    oldest->last_used = ++pairing->identity_clock;
+    oldest->verified = 0;
+    MUTEX_UNLOCK(pairing->identity_mutex);
+    return key;
+}
+
+static int
+pairing_parse_key(const char *hex, unsigned char raw[ED25519_KEY_SIZE])
+{
+    for (int i = 0; i < ED25519_KEY_SIZE; i++) {
+        unsigned int byte;
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+            return -1;
+        }
+        raw[i] = byte;
+    }
+    return 0;
+}
+
+static void
+pairing_print_key(FILE *file, const char *name, const unsigned char raw[ED25519_KEY_SIZE])
+{
+    fprintf(file, "%s ", name);
+    for (int i = 0; i < ED25519_KEY_SIZE; i++) {
+        fprintf(file, "%02x", raw[i]);
+    }
+    fprintf(file, "\n");
+}
+
+/*
+ * Writes the key file next to the old one and renames it over, so a crash never leaves half a
+ * key behind. Called with identity_mutex locked, or before any session exists.
+ */
+static int
+pairing_save(pairing_t *pairing)
+{
+    unsigned char raw[ED25519_KEY_SIZE];
+    size_t len = strlen(pairing->key_file);
+    char *temp = malloc(len + 5);
+    if (!temp) {
+        return -1;
+    }
+    memcpy(temp, pairing->key_file, len);
+    memcpy(temp + len, ".new", 5);
+
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    FILE *file = fd < 0 ? NULL : fdopen(fd, "w");
+    if (!file) {
+        if (fd >= 0) close(fd);
+        free(temp);
+        return -1;
+    }
+    fprintf(file, "# The AirPlay identity of this receiver, keep it private\n");
+    ed25519_key_get_raw_private(raw, pairing->ed);
+    pairing_print_key(file, "key", raw);
+    for (int i = 0; i < PAIRING_IDENTITY_CACHE_SIZE; i++) {
+        if (pairing->identities[i].key && pairing->identities[i].verified) {
+            pairing_print_key(file, "sender", pairing->identities[i].raw);
+        }
+    }
+    memset(raw, 0, sizeof(raw));
+
+    int ret = (fflush(file) == 0 && fsync(fd) == 0) ? 0 : -1;
+    if (fclose(file) != 0) ret = -1;
+    if (ret == 0 && rename(temp, pairing->key_file) < 0) ret = -1;
+    if (ret < 0) unlink(temp);
+    free(temp);
+    return ret;
+}
+
+static void
+pairing_set_identity_verified(pairing_t *pairing, const unsigned char raw[ED25519_KEY_SIZE])
+{
+    MUTEX_LOCK(pairing->identity_mutex);
+    for (int i = 0; i < PAIRING_IDENTITY_CACHE_SIZE; i++) {
+        pairing_identity_t *identity = &pairing->identities[i];
+        if (identity->key && !memcmp(identity->raw, raw, ED25519_KEY_SIZE)) {
+            /* Only a sender new to the file rewrites it, not every reconnect */
+            if (!identity->verified && pairing->key_file) {
+                identity->verified = 1;
+                pairing_save(pairing);
+            }
+            identity->verified = 1;
+            break;
+        }
+    }
+    MUTEX_UNLOCK(pairing->identity_mutex);
+}
+
 pairing_t *
 pairing_init_generate()
 {
@@ -78,9 +277,70 @@ pairing_init_generate()
 
     pairing->ed = ed25519_key_generate();
 
+    MUTEX_CREATE(pairing->identity_mutex);
+    MUTEX_CREATE(pairing->ecdh_mutex);
+    COND_CREATE(pairing->ecdh_cond);
+    THREAD_CREATE(pairing->ecdh_thread, pairing_ecdh_thread, pairing);
+    pairing->ecdh_running = !!pairing->ecdh_thread;
+    if (pairing->ecdh_thread) thread_set_name(pairing->ecdh_thread, "ecdh");
+
     return pairing;
 }
 
+int
+pairing_set_key_file(pairing_t *pairing, const char *path)
+{
+    char line[128];
+    unsigned char raw[ED25519_KEY_SIZE];
+    ed25519_key_t *ed = NULL;
+    int senders = 0;
+
+    assert(pairing);
+    free(pairing->key_file);
+    pairing->key_file = strdup(path);
+    if (!pairing->key_file) {
+        return -1;
+    }
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        if (pairing_save(pairing) == 0) {
+            return 0;
+        }
+        free(pairing->key_file);
+        pairing->key_file = NULL;
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        if (!strncmp(line, "key ", 4) && !ed && !pairing_parse_key(line + 4, raw)) {
+            ed = ed25519_key_from_raw_private(raw);
+        } else if (!strncmp(line, "sender ", 7) && senders < PAIRING_IDENTITY_CACHE_SIZE &&
+                   !pairing_parse_key(line + 7, raw)) {
+            pairing_identity_t *identity = &pairing->identities[senders++];
+            memcpy(identity->raw, raw, ED25519_KEY_SIZE);
+            identity->key = ed25519_key_from_raw(raw);
+            identity->last_used = ++pairing->identity_clock;
+            identity->verified = 1;
+        }
+    }
+    fclose(file);
+    memset(raw, 0, sizeof(raw));
+
+    /* Never overwrite a file that is not ours, the key in it may be needed elsewhere */
+    if (!ed) {
+        for (int i = 0; i < senders; i++) {
+            ed25519_key_destroy(pairing->identities[i].key);
+            pairing->identities[i].key = NULL;
+        }
+        free(pairing->key_file);
+        pairing->key_file = NULL;
+        return -1;
+    }
+    ed25519_key_destroy(pairing->ed);
+    pairing->ed = ed;
+    return 1;
+}
+
 void
 pairing_get_public_key(pairing_t *pairing, unsigned char public_key[ED25519_KEY_SIZE])
 {
@@ -110,6 +370,7 @@ pairing_session_init(pairing_t *pairing)
         return NULL;
     }
 
+    session->pairing = pairing;
     session->ed_ours = ed25519_key_copy(pairing->ed);
 
     session->status = STATUS_INITIAL;
@@ -145,16 +406,33 @@ pairing_session_handshake(pairing_session_t *session, const unsigned char ecdh_k
     }
 
     session->ecdh_theirs = x25519_key_from_raw(ecdh_key);
-    session->ed_theirs = ed25519_key_from_raw(ed_key);
+    memcpy(session->ed_theirs_raw, ed_key, ED25519_KEY_SIZE);
+    session->ed_theirs = pairing_get_identity(session->pairing, ed_key, &session->resumed);
 
-    session->ecdh_ours = x25519_key_generate();
+    session->ecdh_ours = pairing_take_ecdh_key(session->pairing);
 
     x25519_derive_secret(session->ecdh_secret, session->ecdh_ours, session->ecdh_theirs);
 
+    /* Both directions use the same key and IV, derive them once */
+    unsigned char key[AES_128_BLOCK_SIZE];
+    unsigned char iv[AES_128_BLOCK_SIZE];
+    derive_key_internal(session, (const unsigned char *) SALT_KEY, strlen(SALT_KEY), key, sizeof(key));
+    derive_key_internal(session, (const unsigned char *) SALT_IV, strlen(SALT_IV), iv, sizeof(iv));
+    aes_ctr_destroy(session->aes_ctx);
+    session->aes_ctx = aes_ctr_init(key, iv);
+    session->signature_sent = 0;
+
     session->status = STATUS_HANDSHAKE;
     return 0;
 }
 
+int
+pairing_session_is_resumed(pairing_session_t *session)
+{
+    assert(session);
+    return session->resumed;
+}
+
 int
 pairing_session_get_public_key(pairing_session_t *session, unsigned char ecdh_key[X25519_KEY_SIZE])
 {
@@ -173,13 +451,10 @@ int
 pairing_session_get_signature(pairing_session_t *session, unsigned char signature[PAIRING_SIG_SIZE])
 {
     unsigned char sig_msg[PAIRING_SIG_SIZE];
-    unsigned char key[AES_128_BLOCK_SIZE];
-    unsigned char iv[AES_128_BLOCK_SIZE];
-    aes_ctx_t *aes_ctx;
 
     assert(session);
 
-    if (session->status != STATUS_HANDSHAKE) {
+    if (session->status != STATUS_HANDSHAKE || session->signature_sent) {
         return -1;
     }
 
@@ -190,12 +465,8 @@ pairing_session_get_signature(pairing_session_t *session, unsigned char signatur
     ed25519_sign(signature, PAIRING_SIG_SIZE, sig_msg, PAIRING_SIG_SIZE, session->ed_ours);
 
     /* Then encrypt the result with keys derived from the shared secret */
-    derive_key_internal(session, (const unsigned char *) SALT_KEY, strlen(SALT_KEY), key, sizeof(key));
-    derive_key_internal(session, (const unsigned char *) SALT_IV, strlen(SALT_IV), iv, sizeof(iv));
-
-    aes_ctx = aes_ctr_init(key, iv);
-    aes_ctr_encrypt(aes_ctx, signature, signature, PAIRING_SIG_SIZE);
-    aes_ctr_destroy(aes_ctx);
+    aes_ctr_encrypt(session->aes_ctx, signature, signature, PAIRING_SIG_SIZE);
+    session->signature_sent = 1;
 
     return 0;
 }
@@ -205,9 +476,6 @@ pairing_session_finish(pairing_session_t *session, const unsigned char signature
 {
     unsigned char sig_buffer[PAIRING_SIG_SIZE];
     unsigned char sig_msg[PAIRING_SIG_SIZE];
-    unsigned char key[AES_128_BLOCK_SIZE];
-    unsigned char iv[AES_128_BLOCK_SIZE];
-    aes_ctx_t *aes_ctx;
 
     assert(session);
 
@@ -215,15 +483,12 @@ pairing_session_finish(pairing_session_t *session, const unsigned char signature
         return -1;
     }
 
-    /* First decrypt the signature with keys derived from the shared secret */
-    derive_key_internal(session, (const unsigned char *) SALT_KEY, strlen(SALT_KEY), key, sizeof(key));
-    derive_key_internal(session, (const unsigned char *) SALT_IV, strlen(SALT_IV), iv, sizeof(iv));
-
-    aes_ctx = aes_ctr_init(key, iv);
-    /* One fake round for the initial handshake encryption */
-    aes_ctr_encrypt(aes_ctx, sig_buffer, sig_buffer, PAIRING_SIG_SIZE);
-    aes_ctr_encrypt(aes_ctx, signature, sig_buffer, PAIRING_SIG_SIZE);
-    aes_ctr_destroy(aes_ctx);
+    /* First decrypt the signature, the counter continues after the one we sent */
+    if (!session->signature_sent) {
+        aes_ctr_encrypt(session->aes_ctx, sig_buffer, sig_buffer, PAIRING_SIG_SIZE);
+        session->signature_sent = 1;
+    }
+    aes_ctr_encrypt(session->aes_ctx, signature, sig_buffer, PAIRING_SIG_SIZE);
 
     /* Then verify the signature with public ECDH keys of both parties */
     x25519_key_get_raw(sig_msg, session->ecdh_theirs);
@@ -233,6 +498,7 @@ pairing_session_finish(pairing_session_t *session, const unsigned char signature
         return -2;
     }
 
+    pairing_set_identity_verified(session->pairing, session->ed_theirs_raw);
     session->status = STATUS_FINISHED;
     return 0;
 }
@@ -247,6 +513,7 @@ pairing_session_destroy(pairing_session_t *session)
         x25519_key_destroy(session->ecdh_ours);
         x25519_key_destroy(session->ecdh_theirs);
 
+        aes_ctr_destroy(session->aes_ctx);
         free(session);
     }
 }
@@ -255,7 +522,24 @@ void
 pairing_destroy(pairing_t *pairing)
 {
     if (pairing) {
+        if (pairing->ecdh_running) {
+            MUTEX_LOCK(pairing->ecdh_mutex);
+            pairing->ecdh_stopping = 1;
+            COND_SIGNAL(pairing->ecdh_cond);
+            MUTEX_UNLOCK(pairing->ecdh_mutex);
+            THREAD_JOIN(pairing->ecdh_thread);
+        }
+        for (int i = 0; i < pairing->ecdh_count; i++) {
+            x25519_key_destroy(pairing->ecdh_pool[i]);
+        }
+        for (int i = 0; i < PAIRING_IDENTITY_CACHE_SIZE; i++) {
+            ed25519_key_destroy(pairing->identities[i].key);
+        }
+        MUTEX_DESTROY(pairing->identity_mutex);
+        MUTEX_DESTROY(pairing->ecdh_mutex);
+        COND_DESTROY(pairing->ecdh_cond);
         ed25519_key_destroy(pairing->ed);
+        free(pairing->key_file);
         free(pairing);
     }
 }
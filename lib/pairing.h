@@ -24,6 +24,13 @@ typedef struct pairing_s pairing_t;
 typedef struct pairing_session_s pairing_session_t;
 
 pairing_t *pairing_init_generate();
+/*
+ * Keeps our Ed25519 identity, and the senders that completed a pair-verify, in the file at path,
+ * so senders see the same receiver after a restart. The file is created readable by its owner
+ * only if there is none. Call before the first session. Returns 1 if the file was read, 0 if it
+ * was created, and -1 if it could not be created or holds no key, keeping a new key then.
+ */
+int pairing_set_key_file(pairing_t *pairing, const char *path);
 void pairing_get_public_key(pairing_t *pairing, unsigned char public_key[ED25519_KEY_SIZE]);
 
 pairing_session_t *pairing_session_init(pairing_t *pairing);
@@ -31,6 +38,8 @@ void pairing_session_set_setup_status(pairing_session_t *session);
 int pairing_session_check_handshake_status(pairing_session_t *session);
 int pairing_session_handshake(pairing_session_t *session, const unsigned char ecdh_key[X25519_KEY_SIZE],
                               const unsigned char ed_key[ED25519_KEY_SIZE]);
+/* Whether the sender's identity already completed a pair-verify with us, valid after the handshake */
+int pairing_session_is_resumed(pairing_session_t *session);
 int pairing_session_get_public_key(pairing_session_t *session, unsigned char ecdh_key[X25519_KEY_SIZE]);
 int pairing_session_get_signature(pairing_session_t *session, unsigned char signature[PAIRING_SIG_SIZE]);
 int pairing_session_finish(pairing_session_t *session, const unsigned char signature[PAIRING_SIG_SIZE]);
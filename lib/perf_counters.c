@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "perf_counters.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+#include "histogram.h"
+#include "threads.h"
+
+#define PERF_COUNTER_CYCLES 0
+#define PERF_COUNTER_INSTRUCTIONS 1
+#define PERF_COUNTER_CACHE_MISSES 2
+#define PERF_COUNTER_BRANCH_MISSES 3
+#define PERF_COUNTER_COUNT 4
+
+typedef struct perf_counters_stage_s {
+    atomic_ullong totals[PERF_COUNTER_COUNT];
+    atomic_ullong frames;
+    /* Cycles per frame. Sessions mark the same stages from their own threads, the histogram
+     * takes one writer at a time. */
+    mutex_handle_t mutex;
+    histogram_t cycles;
+} perf_counters_stage_t;
+
+static const char *const perf_counters_stage_names[PERF_STAGE_COUNT] = {
+    [PERF_STAGE_VIDEO_RECEIVE] = "video_receive",
+    [PERF_STAGE_VIDEO_DECRYPT] = "video_decrypt",
+    [PERF_STAGE_VIDEO_REWRITE] = "video_rewrite",
+    [PERF_STAGE_VIDEO_SUBMIT] = "video_submit",
+    [PERF_STAGE_AUDIO_ENQUEUE] = "audio_enqueue",
+    [PERF_STAGE_AUDIO_DECRYPT] = "audio_decrypt",
+    [PERF_STAGE_AUDIO_DECODE] = "audio_decode",
+    [PERF_STAGE_AUDIO_SUBMIT] = "audio_submit",
+};
+
+static const char *const perf_counters_names[PERF_COUNTER_COUNT] = {
+    "cycles", "instructions", "cache_misses", "branch_misses"
+};
+
+int perf_counters_active;
+static perf_counters_stage_t perf_counters_stages[PERF_STAGE_COUNT];
+
+static int
+perf_counters_append(char *text, int size, int length, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static int
+perf_counters_append(char *text, int size, int length, const char *format, ...)
+{
+    if (length >= size) {
+        return length;
+    }
+    va_list args;
+    va_start(args, format);
+    length += vsnprintf(text + length, size - length, format, args);
+    va_end(args);
+    return length;
+}
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/* The counters of one thread, a group read at once with the cycles as the leader */
+typedef struct perf_counters_thread_s {
+    int fds[PERF_COUNTER_COUNT];
+    int valid;
+    uint64_t last[PERF_COUNTER_COUNT];
+} perf_counters_thread_t;
+
+static const uint64_t perf_counters_configs[PERF_COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+/* Decided once at the start: which counters the PMU has, and whether the kernel side may be counted */
+static int perf_counters_available[PERF_COUNTER_COUNT];
+static int perf_counters_exclude_kernel;
+static pthread_key_t perf_counters_key;
+static __thread perf_counters_thread_t *perf_counters_thread;
+
+static int
+perf_counters_open(uint64_t config, int exclude_kernel, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    // The calling thread on whatever CPU it runs
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, PERF_FLAG_FD_CLOEXEC);
+}
+
+static void
+perf_counters_close_group(perf_counters_thread_t *thread)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (thread->fds[i] >= 0) {
+            close(thread->fds[i]);
+            thread->fds[i] = -1;
+        }
+    }
+}
+
+/* The group of the calling thread, the leader is left at -1 if it could not be opened */
+static void
+perf_counters_open_group(perf_counters_thread_t *thread)
+{
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        thread->fds[i] = -1;
+    }
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (!perf_counters_available[i]) {
+            continue;
+        }
+        thread->fds[i] = perf_counters_open(perf_counters_configs[i], perf_counters_exclude_kernel,
+                                            i == PERF_COUNTER_CYCLES ? -1 : thread->fds[PERF_COUNTER_CYCLES]);
+        if (thread->fds[i] < 0) {
+            perf_counters_close_group(thread);
+            return;
+        }
+    }
+}
+
+static void
+perf_counters_thread_exit(void *arg)
+{
+    perf_counters_thread_t *thread = arg;
+    perf_counters_close_group(thread);
+    free(thread);
+}
+
+static perf_counters_thread_t *
+perf_counters_get_thread(void)
+{
+    if (!perf_counters_thread) {
+        perf_counters_thread_t *thread = calloc(1, sizeof(perf_counters_thread_t));
+        if (!thread) {
+            return NULL;
+        }
+        perf_counters_open_group(thread);
+        pthread_setspecific(perf_counters_key, thread);
+        perf_counters_thread = thread;
+    }
+    return perf_counters_thread->fds[PERF_COUNTER_CYCLES] >= 0 ? perf_counters_thread : NULL;
+}
+
+/* Values in the order of perf_counters_configs, 0 for the ones the PMU does not have */
+static int
+perf_counters_read(perf_counters_thread_t *thread, uint64_t *values)
+{
+    uint64_t group[1 + PERF_COUNTER_COUNT];
+    if (read(thread->fds[PERF_COUNTER_CYCLES], group, sizeof(group)) < (ssize_t) (2 * sizeof(uint64_t))) {
+        return -1;
+    }
+    int member = 1;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        values[i] = perf_counters_available[i] && member <= (int) group[0] ? group[member++] : 0;
+    }
+    return 0;
+}
+
+int
+perf_counters_start(logger_t *logger)
+{
+    // Counting the kernel side too, AF_ALG decryption happens there, unless the kernel only allows user space
+    int leader = perf_counters_open(perf_counters_configs[PERF_COUNTER_CYCLES], 0, -1);
+    if (leader < 0 && (errno == EACCES || errno == EPERM)) {
+        perf_counters_exclude_kernel = 1;
+        leader = perf_counters_open(perf_counters_configs[PERF_COUNTER_CYCLES], 1, -1);
+    }
+    if (leader < 0) {
+        return -1;
+    }
+    perf_counters_available[PERF_COUNTER_CYCLES] = 1;
+    for (int i = PERF_COUNTER_CYCLES + 1; i < PERF_COUNTER_COUNT; i++) {
+        int fd = perf_counters_open(perf_counters_configs[i], perf_counters_exclude_kernel, leader);
+        perf_counters_available[i] = fd >= 0;
+        if (fd < 0) {
+            logger_log(logger, LOGGER_WARNING, "No %s counter on this CPU", perf_counters_names[i]);
+        } else {
+            close(fd);
+        }
+    }
+    close(leader);
+
+    if (pthread_key_create(&perf_counters_key, perf_counters_thread_exit) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+        MUTEX_CREATE(perf_counters_stages[i].mutex);
+        histogram_init(&perf_counters_stages[i].cycles);
+    }
+    logger_log(logger, LOGGER_INFO, "Counting CPU cycles by pipeline stage%s",
+               perf_counters_exclude_kernel ? ", in user space only" : "");
+    __atomic_store_n(&perf_counters_active, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void
+perf_counters_begin_slow(void)
+{
+    perf_counters_thread_t *thread = perf_counters_get_thread();
+    if (thread) {
+        thread->valid = perf_counters_read(thread, thread->last) == 0;
+    }
+}
+
+void
+perf_counters_mark_slow(perf_stage_t stage, int frames)
+{
+    perf_counters_thread_t *thread = perf_counters_get_thread();
+    uint64_t values[PERF_COUNTER_COUNT];
+    if (!thread || perf_counters_read(thread, values) < 0) {
+        return;
+    }
+    if (!thread->valid) {
+        // The first mark of a thread only begins its first stage
+        memcpy(thread->last, values, sizeof(values));
+        thread->valid = 1;
+        return;
+    }
+
+    perf_counters_stage_t *totals = &perf_counters_stages[stage];
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        atomic_fetch_add_explicit(&totals->totals[i], values[i] - thread->last[i], memory_order_relaxed);
+    }
+    if (frames > 0) {
+        atomic_fetch_add_explicit(&totals->frames, frames, memory_order_relaxed);
+        MUTEX_LOCK(totals->mutex);
+        histogram_record(&totals->cycles, (values[PERF_COUNTER_CYCLES] - thread->last[PERF_COUNTER_CYCLES]) / frames);
+        MUTEX_UNLOCK(totals->mutex);
+    }
+    memcpy(thread->last, values, sizeof(values));
+}
+
+#else
+
+int
+perf_counters_start(logger_t *logger)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+void
+perf_counters_begin_slow(void)
+{
+}
+
+void
+perf_counters_mark_slow(perf_stage_t stage, int frames)
+{
+}
+
+#endif
+
+int
+perf_counters_format(char *text, int size)
+{
+    static const char *const helps[PERF_COUNTER_COUNT] = {
+        "CPU cycles", "Instructions", "Cache misses", "Branch misses"
+    };
+    int length = 0;
+
+    if (!perf_counters_enabled()) {
+        return 0;
+    }
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+        const char *name = perf_counters_names[counter];
+        length = perf_counters_append(text, size, length,
+                                      "# HELP rpiplay_stage_%s_total %s of the pipeline threads, by stage\n"
+                                      "# TYPE rpiplay_stage_%s_total counter\n", name, helps[counter], name);
+        for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+            length = perf_counters_append(text, size, length, "rpiplay_stage_%s_total{stage=\"%s\"} %llu\n", name,
+                                          perf_counters_stage_names[i],
+                                          atomic_load_explicit(&perf_counters_stages[i].totals[counter], memory_order_relaxed));
+        }
+    }
+    length = perf_counters_append(text, size, length,
+                                  "# HELP rpiplay_stage_frames_total Frames that went through each stage\n"
+                                  "# TYPE rpiplay_stage_frames_total counter\n");
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+        length = perf_counters_append(text, size, length, "rpiplay_stage_frames_total{stage=\"%s\"} %llu\n",
+                                      perf_counters_stage_names[i],
+                                      atomic_load_explicit(&perf_counters_stages[i].frames, memory_order_relaxed));
+    }
+    length = perf_counters_append(text, size, length,
+                                  "# HELP rpiplay_stage_cycles_per_frame Median CPU cycles a frame takes in each stage\n"
+                                  "# TYPE rpiplay_stage_cycles_per_frame gauge\n");
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+        length = perf_counters_append(text, size, length, "rpiplay_stage_cycles_per_frame{stage=\"%s\"} %u\n",
+                                      perf_counters_stage_names[i], histogram_percentile(&perf_counters_stages[i].cycles, 50));
+    }
+    length = perf_counters_append(text, size, length,
+                                  "# HELP rpiplay_stage_ipc Instructions per cycle of each stage\n"
+                                  "# TYPE rpiplay_stage_ipc gauge\n");
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+        unsigned long long cycles = atomic_load_explicit(&perf_counters_stages[i].totals[PERF_COUNTER_CYCLES], memory_order_relaxed);
+        unsigned long long instructions = atomic_load_explicit(&perf_counters_stages[i].totals[PERF_COUNTER_INSTRUCTIONS],
+                                                               memory_order_relaxed);
+        length = perf_counters_append(text, size, length, "rpiplay_stage_ipc{stage=\"%s\"} %.3f\n",
+                                      perf_counters_stage_names[i], cycles ? (double) instructions / cycles : 0.0);
+    }
+    return length < size ? length : size - 1;
+}
+
+void
+perf_counters_log(logger_t *logger, int level)
+{
+    if (!perf_counters_enabled()) {
+        return;
+    }
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+        perf_counters_stage_t *stage = &perf_counters_stages[i];
+        unsigned long long frames = atomic_load_explicit(&stage->frames, memory_order_relaxed);
+        if (frames == 0) {
+            continue;
+        }
+        unsigned long long totals[PERF_COUNTER_COUNT];
+        for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++) {
+            totals[counter] = atomic_load_explicit(&stage->totals[counter], memory_order_relaxed);
+        }
+        logger_log(logger, level, "perf %s: %llu frames, cycles/frame p50 %u p99 %u, IPC %.2f, "
+                   "%llu cache misses and %llu branch misses per frame", perf_counters_stage_names[i], frames,
+                   histogram_percentile(&stage->cycles, 50), histogram_percentile(&stage->cycles, 99),
+                   totals[PERF_COUNTER_CYCLES] ? (double) totals[PERF_COUNTER_INSTRUCTIONS] / totals[PERF_COUNTER_CYCLES] : 0.0,
+                   totals[PERF_COUNTER_CACHE_MISSES] / frames, totals[PERF_COUNTER_BRANCH_MISSES] / frames);
+    }
+}
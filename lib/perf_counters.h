@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include "logger.h"
+
+/*
+ * Hardware performance counters by pipeline stage, to see where the cycles of a frame go on a
+ * given SoC. Every thread that marks stages gets its own perf_event_open counters, which only
+ * count while it runs: cycles, instructions, cache misses and branch misses. A mark reads them
+ * once and puts what the thread did since its previous mark towards the stage that just ended,
+ * so a thread going through its stages in turn pays one read per stage boundary.
+ *
+ * Totals and a histogram of the cycles per frame are kept per stage over all sessions, and go
+ * to the log with the mirror statistics and to the metrics server. Off unless started, a mark
+ * then costs a relaxed load. Linux only, and the kernel must allow counting the own process,
+ * see /proc/sys/kernel/perf_event_paranoid.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum perf_stage_e {
+    PERF_STAGE_VIDEO_RECEIVE,  /* Reading and reassembling frames, with what is decrypted as it arrives */
+    PERF_STAGE_VIDEO_DECRYPT,  /* What is left to decrypt once the frame is complete */
+    PERF_STAGE_VIDEO_REWRITE,  /* AVCC to Annex-B */
+    PERF_STAGE_VIDEO_SUBMIT,   /* Handing the frame to the renderer */
+    PERF_STAGE_AUDIO_ENQUEUE,  /* Jitter buffer bookkeeping of a packet */
+    PERF_STAGE_AUDIO_DECRYPT,
+    PERF_STAGE_AUDIO_DECODE,   /* Only where AAC is decoded in process, with fdk-aac */
+    PERF_STAGE_AUDIO_SUBMIT,   /* Everything else the renderer does with the frame */
+    PERF_STAGE_COUNT
+} perf_stage_t;
+
+/* Read with the GCC builtins, this header is also included from C++ */
+extern int perf_counters_active;
+
+static inline int
+perf_counters_enabled(void)
+{
+    return __atomic_load_n(&perf_counters_active, __ATOMIC_RELAXED);
+}
+
+/* Starts counting, returns -1 with errno set if the kernel gives no counters */
+int perf_counters_start(logger_t *logger);
+
+void perf_counters_begin_slow(void);
+void perf_counters_mark_slow(perf_stage_t stage, int frames);
+
+/* Begins the calling thread's next stage, what it did since its last mark is not counted */
+static inline void
+perf_counters_begin(void)
+{
+    if (perf_counters_enabled()) perf_counters_begin_slow();
+}
+
+/* Counts what the calling thread did since its last mark or begin towards stage, as frames
+ * frames, which may be 0 for work that belongs to frames counted elsewhere */
+static inline void
+perf_counters_mark(perf_stage_t stage, int frames)
+{
+    if (perf_counters_enabled()) perf_counters_mark_slow(stage, frames);
+}
+
+/* The totals and per frame figures of the stages in the Prometheus text format, nothing while off */
+int perf_counters_format(char *text, int size);
+void perf_counters_log(logger_t *logger, int level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //PERF_COUNTERS_H
@@ -3,23 +3,27 @@
 #include "playfair.h"
 
 void generate_key_schedule(unsigned char* key_material, uint32_t key_schedule[11][4]);
-void generate_session_key(unsigned char* oldSap, unsigned char* messageIn, unsigned char* sessionKey);
 void cycle(unsigned char* block, uint32_t key_schedule[11][4]);
 void z_xor(unsigned char* in, unsigned char* out, int blocks);
 void x_xor(unsigned char* in, unsigned char* out, int blocks);
 
-extern unsigned char default_sap[];
+void playfair_key_schedule(unsigned char* message3, uint32_t key_schedule[11][4])
+{
+	unsigned char sapKey[16];
+#ifdef PLAYFAIR_REFERENCE
+	playfair_session_key_reference(message3, sapKey);
+#else
+	playfair_session_key_fast(message3, sapKey);
+#endif
+	generate_key_schedule(sapKey, key_schedule);
+}
 
-void playfair_decrypt(unsigned char* message3, unsigned char* cipherText, unsigned char* keyOut)
+void playfair_decrypt_scheduled(uint32_t key_schedule[11][4], unsigned char* cipherText, unsigned char* keyOut)
 {
 	unsigned char* chunk1 = &cipherText[16];
 	unsigned char* chunk2 = &cipherText[56];
 	int i;
 	unsigned char blockIn[16];
-	unsigned char sapKey[16];
-	uint32_t key_schedule[11][4];
-	generate_session_key(default_sap, message3, sapKey);	
-	generate_key_schedule(sapKey, key_schedule);
 	z_xor(chunk2, blockIn, 1);
 	cycle(blockIn, key_schedule);
 	for (i = 0; i < 16; i++) {
@@ -29,3 +33,9 @@ void playfair_decrypt(unsigned char* message3, unsigned char* cipherText, unsign
 	z_xor(keyOut, keyOut, 1);
 }
 
+void playfair_decrypt(unsigned char* message3, unsigned char* cipherText, unsigned char* keyOut)
+{
+	uint32_t key_schedule[11][4];
+	playfair_key_schedule(message3, key_schedule);
+	playfair_decrypt_scheduled(key_schedule, cipherText, keyOut);
+}
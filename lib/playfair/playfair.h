@@ -1,6 +1,17 @@
 #ifndef PLAYFAIR_H
 #define PLAYFAIR_H
 
+#include <stdint.h>
+
 void playfair_decrypt(unsigned char* message3, unsigned char* cipherText, unsigned char* keyOut);
 
+/* playfair_decrypt in two steps, the expensive first one only depends on message3 */
+void playfair_key_schedule(unsigned char* message3, uint32_t key_schedule[11][4]);
+void playfair_decrypt_scheduled(uint32_t key_schedule[11][4], unsigned char* cipherText, unsigned char* keyOut);
+
+/* The SAP session key playfair_key_schedule starts from. The fast version is the default,
+ * PLAYFAIR_REFERENCE switches to the original code it is checked against */
+void playfair_session_key_fast(unsigned char* message3, unsigned char* sessionKey);
+void playfair_session_key_reference(unsigned char* message3, unsigned char* sessionKey);
+
 #endif
@@ -0,0 +1,358 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "playfair.h"
+#include "sap_scramble_table.h"
+
+// Faster versions of the SAP session key derivation in omg_hax.c, modified_md5.c and sap_hash.c.
+// They have to stay bit-exact with those, bench_playfair compares the two on random messages.
+// Build with PLAYFAIR_REFERENCE defined to use the original code instead.
+
+void garble(unsigned char*, unsigned char*, unsigned char*, unsigned char*, unsigned char*);
+void generate_session_key(unsigned char* oldSap, unsigned char* messageIn, unsigned char* sessionKey);
+
+extern unsigned char message_key[4][144];
+extern unsigned char message_iv[4][16];
+extern unsigned char table_s2[];
+extern uint32_t table_s9[];
+extern unsigned char table_s10[];
+extern unsigned char static_source_1[];
+extern unsigned char static_source_2[];
+extern unsigned char initial_session_key[];
+extern unsigned char default_sap[];
+
+// (int)((1LL << 32) * fabs(sin(i + 1))) from modified_md5, the usual MD5 constants
+static const uint32_t md5_constant[64] = {
+   0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+   0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+   0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+   0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+   0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+   0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+   0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+   0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+   0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+   0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+   0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+   0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+   0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+   0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+   0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+   0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const unsigned char md5_shift[64] = {
+   7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+   5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+   4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+   6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+// message_table_index(i) as an offset into table_s2, saves a multiplication and a modulo per byte
+static const uint16_t message_table_offset[144] = {
+   0x0000, 0x6100, 0x3200, 0x0300, 0x6400, 0x3500, 0x0600, 0x6700, 0x3800, 0x0900, 0x6a00, 0x3b00,
+   0x0c00, 0x6d00, 0x3e00, 0x0f00, 0x7000, 0x4100, 0x1200, 0x7300, 0x4400, 0x1500, 0x7600, 0x4700,
+   0x1800, 0x7900, 0x4a00, 0x1b00, 0x7c00, 0x4d00, 0x1e00, 0x7f00, 0x5000, 0x2100, 0x8200, 0x5300,
+   0x2400, 0x8500, 0x5600, 0x2700, 0x8800, 0x5900, 0x2a00, 0x8b00, 0x5c00, 0x2d00, 0x8e00, 0x5f00,
+   0x3000, 0x0100, 0x6200, 0x3300, 0x0400, 0x6500, 0x3600, 0x0700, 0x6800, 0x3900, 0x0a00, 0x6b00,
+   0x3c00, 0x0d00, 0x6e00, 0x3f00, 0x1000, 0x7100, 0x4200, 0x1300, 0x7400, 0x4500, 0x1600, 0x7700,
+   0x4800, 0x1900, 0x7a00, 0x4b00, 0x1c00, 0x7d00, 0x4e00, 0x1f00, 0x8000, 0x5100, 0x2200, 0x8300,
+   0x5400, 0x2500, 0x8600, 0x5700, 0x2800, 0x8900, 0x5a00, 0x2b00, 0x8c00, 0x5d00, 0x2e00, 0x8f00,
+   0x6000, 0x3100, 0x0200, 0x6300, 0x3400, 0x0500, 0x6600, 0x3700, 0x0800, 0x6900, 0x3a00, 0x0b00,
+   0x6c00, 0x3d00, 0x0e00, 0x6f00, 0x4000, 0x1100, 0x7200, 0x4300, 0x1400, 0x7500, 0x4600, 0x1700,
+   0x7800, 0x4900, 0x1a00, 0x7b00, 0x4c00, 0x1d00, 0x7e00, 0x4f00, 0x2000, 0x8100, 0x5200, 0x2300,
+   0x8400, 0x5500, 0x2600, 0x8700, 0x5800, 0x2900, 0x8a00, 0x5b00, 0x2c00, 0x8d00, 0x5e00, 0x2f00,
+};
+
+// The byte each position of the block is taken from before the table lookups in decryptMessage
+static const unsigned char message_permutation[16] = {0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3};
+
+static inline uint32_t rol32(uint32_t x, int count)
+{
+   return (x << count) | (x >> (32 - count));
+}
+
+// Byte-wise rotate, add and subtract on eight bytes at once
+#define LANES_LOW7 0x7f7f7f7f7f7f7f7full
+#define LANES_HIGH 0x8080808080808080ull
+
+static inline uint64_t rol8_lanes(uint64_t x, int count)
+{
+   uint64_t high = (0xffull << count) & 0xff;
+   high *= 0x0101010101010101ull;
+   return ((x << count) & high) | ((x >> (8 - count)) & ~high);
+}
+
+static inline uint64_t add8_lanes(uint64_t a, uint64_t b)
+{
+   return ((a & LANES_LOW7) + (b & LANES_LOW7)) ^ ((a ^ b) & LANES_HIGH);
+}
+
+static inline uint64_t sub8_lanes(uint64_t a, uint64_t b)
+{
+   return ((a | LANES_HIGH) - (b & LANES_LOW7)) ^ ((a ^ ~b) & LANES_HIGH);
+}
+
+static inline unsigned char rol8_fast(unsigned char x, int count)
+{
+   return (unsigned char)((x << count) | (x >> (8 - count)));
+}
+
+// decryptMessage works on the eight blocks one after the other, but they only depend on the
+// message, so all eight go through each round together to overlap the table lookups
+static void decrypt_message_fast(unsigned char* messageIn, unsigned char* decryptedMessage)
+{
+   int mode = messageIn[12];
+   const unsigned char* key = message_key[mode & 3];
+   unsigned char buffer[8][16], permuted[8][16];
+   uint32_t words[4];
+   int i, j, k;
+
+   for (i = 0; i < 8; i++)
+   {
+      if (mode == 3)
+         memcpy(buffer[i], &messageIn[0x80 - 0x10*i], 16);
+      else
+         memcpy(buffer[i], &messageIn[0x10*(i+1)], 16);
+   }
+
+   for (j = 0; j < 9; j++)
+   {
+      int base = 0x80 - 0x10*j;
+      for (k = 0; k < 16; k++)
+      {
+         const unsigned char* table = &table_s2[message_table_offset[base+k]];
+         unsigned char key_byte = key[base+k];
+         int from = message_permutation[k];
+         for (i = 0; i < 8; i++)
+            permuted[i][k] = table[buffer[i][from]] ^ key_byte;
+      }
+      for (i = 0; i < 8; i++)
+      {
+         for (k = 0; k < 4; k++)
+            words[k] = table_s9[0x000 + permuted[i][4*k]] ^
+                       table_s9[0x100 + permuted[i][4*k+1]] ^
+                       table_s9[0x200 + permuted[i][4*k+2]] ^
+                       table_s9[0x300 + permuted[i][4*k+3]];
+         memcpy(buffer[i], words, 16);
+      }
+   }
+
+   for (i = 0; i < 8; i++)
+   {
+      unsigned char* out;
+      unsigned char* previous;
+      if (mode == 2 || mode == 1 || mode == 0)
+      {
+         out = &decryptedMessage[0x10*i];
+         previous = i > 0 ? &messageIn[0x10*i] : message_iv[mode];
+      }
+      else
+      {
+         out = &decryptedMessage[0x70 - 0x10*i];
+         previous = i < 7 ? &messageIn[0x70 - 0x10*i] : message_iv[mode & 3];
+      }
+      for (k = 0; k < 16; k++)
+         out[k] = table_s10[(k << 8) + buffer[i][message_permutation[k]]] ^ previous[k];
+   }
+}
+
+static void modified_md5_fast(unsigned char* blockIn, unsigned char* keyIn, unsigned char* keyOut)
+{
+   uint32_t words[16];
+   uint32_t key[4];
+   uint32_t A, B, C, D, Z, tmp;
+
+   // modified_md5 reads the block big endian, but swaps whole words in place
+   for (int j = 0; j < 16; j++)
+      words[j] = (uint32_t)blockIn[4*j] << 24 | blockIn[4*j+1] << 16 | blockIn[4*j+2] << 8 | blockIn[4*j+3];
+   memcpy(key, keyIn, 16);
+
+   A = key[0];
+   B = key[1];
+   C = key[2];
+   D = key[3];
+   for (int i = 0; i < 64; i++)
+   {
+      int j;
+      Z = A + md5_constant[i];
+      if (i < 16)
+      {
+         j = i;
+         Z += (B & C) | (~B & D);
+      }
+      else if (i < 32)
+      {
+         j = (5*i + 1) & 15;
+         Z += (B & D) | (C & ~D);
+      }
+      else if (i < 48)
+      {
+         j = (3*i + 5) & 15;
+         Z += B ^ C ^ D;
+      }
+      else
+      {
+         j = (7*i) & 15;
+         Z += C ^ (B | ~D);
+      }
+      Z = rol32(Z + words[j], md5_shift[i]) + B;
+      tmp = D;
+      D = C;
+      C = B;
+      B = Z;
+      A = tmp;
+      if (i == 31)
+      {
+         uint32_t* w = words;
+         tmp = w[A & 15]; w[A & 15] = w[B & 15]; w[B & 15] = tmp;
+         tmp = w[C & 15]; w[C & 15] = w[D & 15]; w[D & 15] = tmp;
+         tmp = w[(A >> 4) & 15]; w[(A >> 4) & 15] = w[(B >> 4) & 15]; w[(B >> 4) & 15] = tmp;
+         tmp = w[(A >> 8) & 15]; w[(A >> 8) & 15] = w[(B >> 8) & 15]; w[(B >> 8) & 15] = tmp;
+         tmp = w[(A >> 12) & 15]; w[(A >> 12) & 15] = w[(B >> 12) & 15]; w[(B >> 12) & 15] = tmp;
+      }
+   }
+   key[0] += A;
+   key[1] += B;
+   key[2] += C;
+   key[3] += D;
+   memcpy(keyOut, key, 16);
+}
+
+// Scramble steps from up to end, reading buffer[i+dx], buffer[i+dy], buffer[i+dz] and buffer[i]
+static inline void sap_scramble_steps(unsigned char* buffer, int from, int to, int dx, int dy, int dz)
+{
+   for (int i = from; i < to; i++)
+      buffer[i] = (rol8_fast(buffer[i+dy], 5) + (rol8_fast(buffer[i+dz], 3) ^ buffer[i]) - rol8_fast(buffer[i+dx], 7)) & 0xff;
+}
+
+static void sap_hash_fast(unsigned char* blockIn, unsigned char* keyOut)
+{
+   uint32_t block_words[16];
+   unsigned char buffer0[20] = {0x96, 0x5F, 0xC6, 0x53, 0xF8, 0x46, 0xCC, 0x18, 0xDF, 0xBE, 0xB2, 0xF8, 0x38, 0xD7, 0xEC, 0x22, 0x03, 0xD1, 0x20, 0x8F};
+   unsigned char buffer1[210];
+   unsigned char buffer2[35] = {0x43, 0x54, 0x62, 0x7A, 0x18, 0xC3, 0xD6, 0xB3, 0x9A, 0x56, 0xF6, 0x1C, 0x14, 0x3F, 0x0C, 0x1D, 0x3B, 0x36, 0x83, 0xB1, 0x39, 0x51, 0x4A, 0xAA, 0x09, 0x3E, 0xFE, 0x44, 0xAF, 0xDE, 0xC3, 0x20, 0x9D, 0x42, 0x3A};
+   unsigned char buffer3[132];
+   unsigned char buffer4[21] = {0xED, 0x25, 0xD1, 0xBB, 0xBC, 0x27, 0x9F, 0x02, 0xA2, 0xA9, 0x11, 0x00, 0x0C, 0xB3, 0x52, 0xC0, 0xBD, 0xE3, 0x1B, 0x49, 0xC7};
+   static const int i0_index[11] = {18, 22, 23, 0, 5, 19, 32, 31, 10, 21, 30};
+   // Every step of the scramble as its own byte, step i reads the results of steps i-155, i-57, i-13 and i-210
+   unsigned char steps[840];
+   int i, j;
+
+   // The block as big endian words, repeated to fill 210 bytes
+   memcpy(block_words, blockIn, 64);
+   for (i = 0; i < 64; i++)
+      buffer1[i] = (block_words[i >> 2] >> ((3 - (i & 3)) << 3)) & 0xff;
+   memcpy(&buffer1[64], buffer1, 64);
+   memcpy(&buffer1[128], buffer1, 64);
+   memcpy(&buffer1[192], buffer1, 18);
+
+   // In the first round sap_hash computes the indices i-155, i-57 and i-13 as unsigned 32 bit
+   // numbers modulo 210. Negative ones wrap to i+101, i+199 and i+33, which cuts the round into
+   // stretches where every index is i plus a constant.
+   sap_scramble_steps(buffer1, 0, 11, 101, 199, 33);
+   sap_scramble_steps(buffer1, 11, 13, 101, -11, 33);
+   sap_scramble_steps(buffer1, 13, 57, 101, -11, -13);
+   sap_scramble_steps(buffer1, 57, 109, 101, -57, -13);
+   sap_scramble_steps(buffer1, 109, 155, -109, -57, -13);
+   sap_scramble_steps(buffer1, 155, 210, -155, -57, -13);
+   memcpy(steps, buffer1, 210);
+
+   // From then on step i reads steps i-155, i-57, i-13 and i-210, eight steps at a time fit in a
+   // word. The words for i-13 span the last two results, which are still in registers.
+   uint64_t previous2, previous1, x8, y8, z8, w8;
+   memcpy(&previous2, &steps[194], 8);
+   memcpy(&previous1, &steps[202], 8);
+   for (i = 210; i < 834; i += 8)
+   {
+      memcpy(&x8, &steps[i-155], 8);
+      memcpy(&y8, &steps[i-57], 8);
+      memcpy(&w8, &steps[i-210], 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      z8 = (previous2 << 24) | (previous1 >> 40);
+#else
+      z8 = (previous2 >> 24) | (previous1 << 40);
+#endif
+      w8 = sub8_lanes(add8_lanes(rol8_lanes(y8, 5), rol8_lanes(z8, 3) ^ w8), rol8_lanes(x8, 7));
+      memcpy(&steps[i], &w8, 8);
+      previous2 = previous1;
+      previous1 = w8;
+   }
+   for (; i < 840; i++)
+      steps[i] = (rol8_fast(steps[i-57], 5) + (rol8_fast(steps[i-13], 3) ^ steps[i-210]) - rol8_fast(steps[i-155], 7)) & 0xff;
+   memcpy(buffer1, &steps[630], 210);
+
+   garble(buffer0, buffer1, buffer2, buffer3, buffer4);
+
+   memset(keyOut, 0xE1, 16);
+   for (i = 0; i < 11; i++)
+   {
+      if (i == 3)
+         keyOut[i] = 0x3d;
+      else
+         keyOut[i] = ((keyOut[i] + buffer3[i0_index[i] * 4]) & 0xff);
+   }
+   // Fold the buffers onto the key 16 bytes at a time
+   unsigned char folded[16] = {0};
+   for (i = 0; i + 16 <= 208; i += 16)
+      for (j = 0; j < 16; j++)
+         folded[j] ^= buffer1[i + j];
+   folded[0] ^= buffer1[208] ^ buffer0[16] ^ buffer2[32];
+   folded[1] ^= buffer1[209] ^ buffer0[17] ^ buffer2[33];
+   folded[2] ^= buffer0[18] ^ buffer2[34];
+   folded[3] ^= buffer0[19];
+   for (j = 0; j < 16; j++)
+      keyOut[j] ^= folded[j] ^ buffer0[j] ^ buffer2[j] ^ buffer2[16 + j];
+
+   // The reverse scramble is linear, look up what each nibble of the key contributes to the result
+   unsigned char scrambled[16] = {0};
+   for (i = 0; i < 32; i++)
+   {
+      const unsigned char* entry = sap_scramble_table[i][(keyOut[i >> 1] >> ((i & 1) << 2)) & 15];
+      for (j = 0; j < 16; j++)
+         scrambled[j] ^= entry[j];
+   }
+   memcpy(keyOut, scrambled, 16);
+}
+
+void playfair_session_key_fast(unsigned char* message3, unsigned char* sessionKey)
+{
+   unsigned char decryptedMessage[128];
+   unsigned char newSap[320];
+   unsigned char md5[16];
+   uint32_t sessionKeyWords[4], md5Words[4];
+
+   decrypt_message_fast(message3, decryptedMessage);
+   memcpy(&newSap[0x000], static_source_1, 0x11);
+   memcpy(&newSap[0x011], decryptedMessage, 0x80);
+   memcpy(&newSap[0x091], &default_sap[0x80], 0x80);
+   memcpy(&newSap[0x111], static_source_2, 0x2f);
+   memcpy(sessionKey, initial_session_key, 16);
+
+   for (int round = 0; round < 5; round++)
+   {
+      unsigned char* base = &newSap[round * 64];
+      modified_md5_fast(base, sessionKey, md5);
+      sap_hash_fast(base, sessionKey);
+      memcpy(sessionKeyWords, sessionKey, 16);
+      memcpy(md5Words, md5, 16);
+      for (int i = 0; i < 4; i++)
+         sessionKeyWords[i] += md5Words[i];
+      memcpy(sessionKey, sessionKeyWords, 16);
+   }
+   for (int i = 0; i < 16; i += 4)
+   {
+      unsigned char tmp = sessionKey[i];
+      sessionKey[i] = sessionKey[i+3];
+      sessionKey[i+3] = tmp;
+      tmp = sessionKey[i+1];
+      sessionKey[i+1] = sessionKey[i+2];
+      sessionKey[i+2] = tmp;
+   }
+   for (int i = 0; i < 16; i++)
+      sessionKey[i] ^= 121;
+}
+
+void playfair_session_key_reference(unsigned char* message3, unsigned char* sessionKey)
+{
+   generate_session_key(default_sap, message3, sessionKey);
+}
@@ -0,0 +1,580 @@
+// Generated: sap_hash reverse scramble applied to every nibble value at every nibble position.
+// The scramble only rotates and xors, so the result for a whole key is the xor of its nibbles' entries.
+static const unsigned char sap_scramble_table[32][16][16] = {
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x00, 0xc0, 0x40, 0x96, 0x10, 0xe2, 0x14, 0x21, 0x00, 0x0c, 0x14, 0xec, 0x11, 0x20, 0x50, 0x11},
+      {0x00, 0x81, 0x80, 0x2d, 0x20, 0xc5, 0x28, 0x42, 0x00, 0x18, 0x28, 0xd9, 0x22, 0x40, 0xa0, 0x22},
+      {0x00, 0x41, 0xc0, 0xbb, 0x30, 0x27, 0x3c, 0x63, 0x00, 0x14, 0x3c, 0x35, 0x33, 0x60, 0xf0, 0x33},
+      {0x00, 0x03, 0x01, 0x5a, 0x40, 0x8b, 0x50, 0x84, 0x00, 0x30, 0x50, 0xb3, 0x44, 0x80, 0x41, 0x44},
+      {0x00, 0xc3, 0x41, 0xcc, 0x50, 0x69, 0x44, 0xa5, 0x00, 0x3c, 0x44, 0x5f, 0x55, 0xa0, 0x11, 0x55},
+      {0x00, 0x82, 0x81, 0x77, 0x60, 0x4e, 0x78, 0xc6, 0x00, 0x28, 0x78, 0x6a, 0x66, 0xc0, 0xe1, 0x66},
+      {0x00, 0x42, 0xc1, 0xe1, 0x70, 0xac, 0x6c, 0xe7, 0x00, 0x24, 0x6c, 0x86, 0x77, 0xe0, 0xb1, 0x77},
+      {0x00, 0x06, 0x02, 0xb4, 0x80, 0x17, 0xa0, 0x09, 0x00, 0x60, 0xa0, 0x67, 0x88, 0x01, 0x82, 0x88},
+      {0x00, 0xc6, 0x42, 0x22, 0x90, 0xf5, 0xb4, 0x28, 0x00, 0x6c, 0xb4, 0x8b, 0x99, 0x21, 0xd2, 0x99},
+      {0x00, 0x87, 0x82, 0x99, 0xa0, 0xd2, 0x88, 0x4b, 0x00, 0x78, 0x88, 0xbe, 0xaa, 0x41, 0x22, 0xaa},
+      {0x00, 0x47, 0xc2, 0x0f, 0xb0, 0x30, 0x9c, 0x6a, 0x00, 0x74, 0x9c, 0x52, 0xbb, 0x61, 0x72, 0xbb},
+      {0x00, 0x05, 0x03, 0xee, 0xc0, 0x9c, 0xf0, 0x8d, 0x00, 0x50, 0xf0, 0xd4, 0xcc, 0x81, 0xc3, 0xcc},
+      {0x00, 0xc5, 0x43, 0x78, 0xd0, 0x7e, 0xe4, 0xac, 0x00, 0x5c, 0xe4, 0x38, 0xdd, 0xa1, 0x93, 0xdd},
+      {0x00, 0x84, 0x83, 0xc3, 0xe0, 0x59, 0xd8, 0xcf, 0x00, 0x48, 0xd8, 0x0d, 0xee, 0xc1, 0x63, 0xee},
+      {0x00, 0x44, 0xc3, 0x55, 0xf0, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0xe1, 0xff, 0xe1, 0x33, 0xff},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x00, 0x0c, 0x04, 0x69, 0x01, 0x2e, 0x41, 0x12, 0x00, 0xc0, 0x41, 0xce, 0x11, 0x02, 0x05, 0x11},
+      {0x00, 0x18, 0x08, 0xd2, 0x02, 0x5c, 0x82, 0x24, 0x00, 0x81, 0x82, 0x9d, 0x22, 0x04, 0x0a, 0x22},
+      {0x00, 0x14, 0x0c, 0xbb, 0x03, 0x72, 0xc3, 0x36, 0x00, 0x41, 0xc3, 0x53, 0x33, 0x06, 0x0f, 0x33},
+      {0x00, 0x30, 0x10, 0xa5, 0x04, 0xb8, 0x05, 0x48, 0x00, 0x03, 0x05, 0x3b, 0x44, 0x08, 0x14, 0x44},
+      {0x00, 0x3c, 0x14, 0xcc, 0x05, 0x96, 0x44, 0x5a, 0x00, 0xc3, 0x44, 0xf5, 0x55, 0x0a, 0x11, 0x55},
+      {0x00, 0x28, 0x18, 0x77, 0x06, 0xe4, 0x87, 0x6c, 0x00, 0x82, 0x87, 0xa6, 0x66, 0x0c, 0x1e, 0x66},
+      {0x00, 0x24, 0x1c, 0x1e, 0x07, 0xca, 0xc6, 0x7e, 0x00, 0x42, 0xc6, 0x68, 0x77, 0x0e, 0x1b, 0x77},
+      {0x00, 0x60, 0x20, 0x4b, 0x08, 0x71, 0x0a, 0x90, 0x00, 0x06, 0x0a, 0x76, 0x88, 0x10, 0x28, 0x88},
+      {0x00, 0x6c, 0x24, 0x22, 0x09, 0x5f, 0x4b, 0x82, 0x00, 0xc6, 0x4b, 0xb8, 0x99, 0x12, 0x2d, 0x99},
+      {0x00, 0x78, 0x28, 0x99, 0x0a, 0x2d, 0x88, 0xb4, 0x00, 0x87, 0x88, 0xeb, 0xaa, 0x14, 0x22, 0xaa},
+      {0x00, 0x74, 0x2c, 0xf0, 0x0b, 0x03, 0xc9, 0xa6, 0x00, 0x47, 0xc9, 0x25, 0xbb, 0x16, 0x27, 0xbb},
+      {0x00, 0x50, 0x30, 0xee, 0x0c, 0xc9, 0x0f, 0xd8, 0x00, 0x05, 0x0f, 0x4d, 0xcc, 0x18, 0x3c, 0xcc},
+      {0x00, 0x5c, 0x34, 0x87, 0x0d, 0xe7, 0x4e, 0xca, 0x00, 0xc5, 0x4e, 0x83, 0xdd, 0x1a, 0x39, 0xdd},
+      {0x00, 0x48, 0x38, 0x3c, 0x0e, 0x95, 0x8d, 0xfc, 0x00, 0x84, 0x8d, 0xd0, 0xee, 0x1c, 0x36, 0xee},
+      {0x00, 0x44, 0x3c, 0x55, 0x0f, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0x1e, 0xff, 0x1e, 0x33, 0xff},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x1e, 0x00, 0xc0, 0x40, 0x96, 0x10, 0xe2, 0x14, 0x21, 0x00, 0x0c, 0x14, 0xec, 0x11, 0x20, 0x50},
+      {0x3c, 0x00, 0x81, 0x80, 0x2d, 0x20, 0xc5, 0x28, 0x42, 0x00, 0x18, 0x28, 0xd9, 0x22, 0x40, 0xa0},
+      {0x22, 0x00, 0x41, 0xc0, 0xbb, 0x30, 0x27, 0x3c, 0x63, 0x00, 0x14, 0x3c, 0x35, 0x33, 0x60, 0xf0},
+      {0x78, 0x00, 0x03, 0x01, 0x5a, 0x40, 0x8b, 0x50, 0x84, 0x00, 0x30, 0x50, 0xb3, 0x44, 0x80, 0x41},
+      {0x66, 0x00, 0xc3, 0x41, 0xcc, 0x50, 0x69, 0x44, 0xa5, 0x00, 0x3c, 0x44, 0x5f, 0x55, 0xa0, 0x11},
+      {0x44, 0x00, 0x82, 0x81, 0x77, 0x60, 0x4e, 0x78, 0xc6, 0x00, 0x28, 0x78, 0x6a, 0x66, 0xc0, 0xe1},
+      {0x5a, 0x00, 0x42, 0xc1, 0xe1, 0x70, 0xac, 0x6c, 0xe7, 0x00, 0x24, 0x6c, 0x86, 0x77, 0xe0, 0xb1},
+      {0xf0, 0x00, 0x06, 0x02, 0xb4, 0x80, 0x17, 0xa0, 0x09, 0x00, 0x60, 0xa0, 0x67, 0x88, 0x01, 0x82},
+      {0xee, 0x00, 0xc6, 0x42, 0x22, 0x90, 0xf5, 0xb4, 0x28, 0x00, 0x6c, 0xb4, 0x8b, 0x99, 0x21, 0xd2},
+      {0xcc, 0x00, 0x87, 0x82, 0x99, 0xa0, 0xd2, 0x88, 0x4b, 0x00, 0x78, 0x88, 0xbe, 0xaa, 0x41, 0x22},
+      {0xd2, 0x00, 0x47, 0xc2, 0x0f, 0xb0, 0x30, 0x9c, 0x6a, 0x00, 0x74, 0x9c, 0x52, 0xbb, 0x61, 0x72},
+      {0x88, 0x00, 0x05, 0x03, 0xee, 0xc0, 0x9c, 0xf0, 0x8d, 0x00, 0x50, 0xf0, 0xd4, 0xcc, 0x81, 0xc3},
+      {0x96, 0x00, 0xc5, 0x43, 0x78, 0xd0, 0x7e, 0xe4, 0xac, 0x00, 0x5c, 0xe4, 0x38, 0xdd, 0xa1, 0x93},
+      {0xb4, 0x00, 0x84, 0x83, 0xc3, 0xe0, 0x59, 0xd8, 0xcf, 0x00, 0x48, 0xd8, 0x0d, 0xee, 0xc1, 0x63},
+      {0xaa, 0x00, 0x44, 0xc3, 0x55, 0xf0, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0xe1, 0xff, 0xe1, 0x33},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0xe1, 0x00, 0x0c, 0x04, 0x69, 0x01, 0x2e, 0x41, 0x12, 0x00, 0xc0, 0x41, 0xce, 0x11, 0x02, 0x05},
+      {0xc3, 0x00, 0x18, 0x08, 0xd2, 0x02, 0x5c, 0x82, 0x24, 0x00, 0x81, 0x82, 0x9d, 0x22, 0x04, 0x0a},
+      {0x22, 0x00, 0x14, 0x0c, 0xbb, 0x03, 0x72, 0xc3, 0x36, 0x00, 0x41, 0xc3, 0x53, 0x33, 0x06, 0x0f},
+      {0x87, 0x00, 0x30, 0x10, 0xa5, 0x04, 0xb8, 0x05, 0x48, 0x00, 0x03, 0x05, 0x3b, 0x44, 0x08, 0x14},
+      {0x66, 0x00, 0x3c, 0x14, 0xcc, 0x05, 0x96, 0x44, 0x5a, 0x00, 0xc3, 0x44, 0xf5, 0x55, 0x0a, 0x11},
+      {0x44, 0x00, 0x28, 0x18, 0x77, 0x06, 0xe4, 0x87, 0x6c, 0x00, 0x82, 0x87, 0xa6, 0x66, 0x0c, 0x1e},
+      {0xa5, 0x00, 0x24, 0x1c, 0x1e, 0x07, 0xca, 0xc6, 0x7e, 0x00, 0x42, 0xc6, 0x68, 0x77, 0x0e, 0x1b},
+      {0x0f, 0x00, 0x60, 0x20, 0x4b, 0x08, 0x71, 0x0a, 0x90, 0x00, 0x06, 0x0a, 0x76, 0x88, 0x10, 0x28},
+      {0xee, 0x00, 0x6c, 0x24, 0x22, 0x09, 0x5f, 0x4b, 0x82, 0x00, 0xc6, 0x4b, 0xb8, 0x99, 0x12, 0x2d},
+      {0xcc, 0x00, 0x78, 0x28, 0x99, 0x0a, 0x2d, 0x88, 0xb4, 0x00, 0x87, 0x88, 0xeb, 0xaa, 0x14, 0x22},
+      {0x2d, 0x00, 0x74, 0x2c, 0xf0, 0x0b, 0x03, 0xc9, 0xa6, 0x00, 0x47, 0xc9, 0x25, 0xbb, 0x16, 0x27},
+      {0x88, 0x00, 0x50, 0x30, 0xee, 0x0c, 0xc9, 0x0f, 0xd8, 0x00, 0x05, 0x0f, 0x4d, 0xcc, 0x18, 0x3c},
+      {0x69, 0x00, 0x5c, 0x34, 0x87, 0x0d, 0xe7, 0x4e, 0xca, 0x00, 0xc5, 0x4e, 0x83, 0xdd, 0x1a, 0x39},
+      {0x4b, 0x00, 0x48, 0x38, 0x3c, 0x0e, 0x95, 0x8d, 0xfc, 0x00, 0x84, 0x8d, 0xd0, 0xee, 0x1c, 0x36},
+      {0xaa, 0x00, 0x44, 0x3c, 0x55, 0x0f, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0x1e, 0xff, 0x1e, 0x33},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x15, 0x1e, 0x00, 0xc0, 0x40, 0x96, 0x10, 0xe2, 0x14, 0x21, 0x00, 0x0c, 0x14, 0xec, 0x11, 0x20},
+      {0x2a, 0x3c, 0x00, 0x81, 0x80, 0x2d, 0x20, 0xc5, 0x28, 0x42, 0x00, 0x18, 0x28, 0xd9, 0x22, 0x40},
+      {0x3f, 0x22, 0x00, 0x41, 0xc0, 0xbb, 0x30, 0x27, 0x3c, 0x63, 0x00, 0x14, 0x3c, 0x35, 0x33, 0x60},
+      {0x54, 0x78, 0x00, 0x03, 0x01, 0x5a, 0x40, 0x8b, 0x50, 0x84, 0x00, 0x30, 0x50, 0xb3, 0x44, 0x80},
+      {0x41, 0x66, 0x00, 0xc3, 0x41, 0xcc, 0x50, 0x69, 0x44, 0xa5, 0x00, 0x3c, 0x44, 0x5f, 0x55, 0xa0},
+      {0x7e, 0x44, 0x00, 0x82, 0x81, 0x77, 0x60, 0x4e, 0x78, 0xc6, 0x00, 0x28, 0x78, 0x6a, 0x66, 0xc0},
+      {0x6b, 0x5a, 0x00, 0x42, 0xc1, 0xe1, 0x70, 0xac, 0x6c, 0xe7, 0x00, 0x24, 0x6c, 0x86, 0x77, 0xe0},
+      {0xa8, 0xf0, 0x00, 0x06, 0x02, 0xb4, 0x80, 0x17, 0xa0, 0x09, 0x00, 0x60, 0xa0, 0x67, 0x88, 0x01},
+      {0xbd, 0xee, 0x00, 0xc6, 0x42, 0x22, 0x90, 0xf5, 0xb4, 0x28, 0x00, 0x6c, 0xb4, 0x8b, 0x99, 0x21},
+      {0x82, 0xcc, 0x00, 0x87, 0x82, 0x99, 0xa0, 0xd2, 0x88, 0x4b, 0x00, 0x78, 0x88, 0xbe, 0xaa, 0x41},
+      {0x97, 0xd2, 0x00, 0x47, 0xc2, 0x0f, 0xb0, 0x30, 0x9c, 0x6a, 0x00, 0x74, 0x9c, 0x52, 0xbb, 0x61},
+      {0xfc, 0x88, 0x00, 0x05, 0x03, 0xee, 0xc0, 0x9c, 0xf0, 0x8d, 0x00, 0x50, 0xf0, 0xd4, 0xcc, 0x81},
+      {0xe9, 0x96, 0x00, 0xc5, 0x43, 0x78, 0xd0, 0x7e, 0xe4, 0xac, 0x00, 0x5c, 0xe4, 0x38, 0xdd, 0xa1},
+      {0xd6, 0xb4, 0x00, 0x84, 0x83, 0xc3, 0xe0, 0x59, 0xd8, 0xcf, 0x00, 0x48, 0xd8, 0x0d, 0xee, 0xc1},
+      {0xc3, 0xaa, 0x00, 0x44, 0xc3, 0x55, 0xf0, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0xe1, 0xff, 0xe1},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x51, 0xe1, 0x00, 0x0c, 0x04, 0x69, 0x01, 0x2e, 0x41, 0x12, 0x00, 0xc0, 0x41, 0xce, 0x11, 0x02},
+      {0xa2, 0xc3, 0x00, 0x18, 0x08, 0xd2, 0x02, 0x5c, 0x82, 0x24, 0x00, 0x81, 0x82, 0x9d, 0x22, 0x04},
+      {0xf3, 0x22, 0x00, 0x14, 0x0c, 0xbb, 0x03, 0x72, 0xc3, 0x36, 0x00, 0x41, 0xc3, 0x53, 0x33, 0x06},
+      {0x45, 0x87, 0x00, 0x30, 0x10, 0xa5, 0x04, 0xb8, 0x05, 0x48, 0x00, 0x03, 0x05, 0x3b, 0x44, 0x08},
+      {0x14, 0x66, 0x00, 0x3c, 0x14, 0xcc, 0x05, 0x96, 0x44, 0x5a, 0x00, 0xc3, 0x44, 0xf5, 0x55, 0x0a},
+      {0xe7, 0x44, 0x00, 0x28, 0x18, 0x77, 0x06, 0xe4, 0x87, 0x6c, 0x00, 0x82, 0x87, 0xa6, 0x66, 0x0c},
+      {0xb6, 0xa5, 0x00, 0x24, 0x1c, 0x1e, 0x07, 0xca, 0xc6, 0x7e, 0x00, 0x42, 0xc6, 0x68, 0x77, 0x0e},
+      {0x8a, 0x0f, 0x00, 0x60, 0x20, 0x4b, 0x08, 0x71, 0x0a, 0x90, 0x00, 0x06, 0x0a, 0x76, 0x88, 0x10},
+      {0xdb, 0xee, 0x00, 0x6c, 0x24, 0x22, 0x09, 0x5f, 0x4b, 0x82, 0x00, 0xc6, 0x4b, 0xb8, 0x99, 0x12},
+      {0x28, 0xcc, 0x00, 0x78, 0x28, 0x99, 0x0a, 0x2d, 0x88, 0xb4, 0x00, 0x87, 0x88, 0xeb, 0xaa, 0x14},
+      {0x79, 0x2d, 0x00, 0x74, 0x2c, 0xf0, 0x0b, 0x03, 0xc9, 0xa6, 0x00, 0x47, 0xc9, 0x25, 0xbb, 0x16},
+      {0xcf, 0x88, 0x00, 0x50, 0x30, 0xee, 0x0c, 0xc9, 0x0f, 0xd8, 0x00, 0x05, 0x0f, 0x4d, 0xcc, 0x18},
+      {0x9e, 0x69, 0x00, 0x5c, 0x34, 0x87, 0x0d, 0xe7, 0x4e, 0xca, 0x00, 0xc5, 0x4e, 0x83, 0xdd, 0x1a},
+      {0x6d, 0x4b, 0x00, 0x48, 0x38, 0x3c, 0x0e, 0x95, 0x8d, 0xfc, 0x00, 0x84, 0x8d, 0xd0, 0xee, 0x1c},
+      {0x3c, 0xaa, 0x00, 0x44, 0x3c, 0x55, 0x0f, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0x1e, 0xff, 0x1e},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x2a, 0x15, 0x1e, 0x00, 0xc0, 0x40, 0x96, 0x10, 0xe2, 0x14, 0x21, 0x00, 0x0c, 0x14, 0xec, 0x11},
+      {0x54, 0x2a, 0x3c, 0x00, 0x81, 0x80, 0x2d, 0x20, 0xc5, 0x28, 0x42, 0x00, 0x18, 0x28, 0xd9, 0x22},
+      {0x7e, 0x3f, 0x22, 0x00, 0x41, 0xc0, 0xbb, 0x30, 0x27, 0x3c, 0x63, 0x00, 0x14, 0x3c, 0x35, 0x33},
+      {0xa8, 0x54, 0x78, 0x00, 0x03, 0x01, 0x5a, 0x40, 0x8b, 0x50, 0x84, 0x00, 0x30, 0x50, 0xb3, 0x44},
+      {0x82, 0x41, 0x66, 0x00, 0xc3, 0x41, 0xcc, 0x50, 0x69, 0x44, 0xa5, 0x00, 0x3c, 0x44, 0x5f, 0x55},
+      {0xfc, 0x7e, 0x44, 0x00, 0x82, 0x81, 0x77, 0x60, 0x4e, 0x78, 0xc6, 0x00, 0x28, 0x78, 0x6a, 0x66},
+      {0xd6, 0x6b, 0x5a, 0x00, 0x42, 0xc1, 0xe1, 0x70, 0xac, 0x6c, 0xe7, 0x00, 0x24, 0x6c, 0x86, 0x77},
+      {0x51, 0xa8, 0xf0, 0x00, 0x06, 0x02, 0xb4, 0x80, 0x17, 0xa0, 0x09, 0x00, 0x60, 0xa0, 0x67, 0x88},
+      {0x7b, 0xbd, 0xee, 0x00, 0xc6, 0x42, 0x22, 0x90, 0xf5, 0xb4, 0x28, 0x00, 0x6c, 0xb4, 0x8b, 0x99},
+      {0x05, 0x82, 0xcc, 0x00, 0x87, 0x82, 0x99, 0xa0, 0xd2, 0x88, 0x4b, 0x00, 0x78, 0x88, 0xbe, 0xaa},
+      {0x2f, 0x97, 0xd2, 0x00, 0x47, 0xc2, 0x0f, 0xb0, 0x30, 0x9c, 0x6a, 0x00, 0x74, 0x9c, 0x52, 0xbb},
+      {0xf9, 0xfc, 0x88, 0x00, 0x05, 0x03, 0xee, 0xc0, 0x9c, 0xf0, 0x8d, 0x00, 0x50, 0xf0, 0xd4, 0xcc},
+      {0xd3, 0xe9, 0x96, 0x00, 0xc5, 0x43, 0x78, 0xd0, 0x7e, 0xe4, 0xac, 0x00, 0x5c, 0xe4, 0x38, 0xdd},
+      {0xad, 0xd6, 0xb4, 0x00, 0x84, 0x83, 0xc3, 0xe0, 0x59, 0xd8, 0xcf, 0x00, 0x48, 0xd8, 0x0d, 0xee},
+      {0x87, 0xc3, 0xaa, 0x00, 0x44, 0xc3, 0x55, 0xf0, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0xe1, 0xff},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0xa2, 0x51, 0xe1, 0x00, 0x0c, 0x04, 0x69, 0x01, 0x2e, 0x41, 0x12, 0x00, 0xc0, 0x41, 0xce, 0x11},
+      {0x45, 0xa2, 0xc3, 0x00, 0x18, 0x08, 0xd2, 0x02, 0x5c, 0x82, 0x24, 0x00, 0x81, 0x82, 0x9d, 0x22},
+      {0xe7, 0xf3, 0x22, 0x00, 0x14, 0x0c, 0xbb, 0x03, 0x72, 0xc3, 0x36, 0x00, 0x41, 0xc3, 0x53, 0x33},
+      {0x8a, 0x45, 0x87, 0x00, 0x30, 0x10, 0xa5, 0x04, 0xb8, 0x05, 0x48, 0x00, 0x03, 0x05, 0x3b, 0x44},
+      {0x28, 0x14, 0x66, 0x00, 0x3c, 0x14, 0xcc, 0x05, 0x96, 0x44, 0x5a, 0x00, 0xc3, 0x44, 0xf5, 0x55},
+      {0xcf, 0xe7, 0x44, 0x00, 0x28, 0x18, 0x77, 0x06, 0xe4, 0x87, 0x6c, 0x00, 0x82, 0x87, 0xa6, 0x66},
+      {0x6d, 0xb6, 0xa5, 0x00, 0x24, 0x1c, 0x1e, 0x07, 0xca, 0xc6, 0x7e, 0x00, 0x42, 0xc6, 0x68, 0x77},
+      {0x15, 0x8a, 0x0f, 0x00, 0x60, 0x20, 0x4b, 0x08, 0x71, 0x0a, 0x90, 0x00, 0x06, 0x0a, 0x76, 0x88},
+      {0xb7, 0xdb, 0xee, 0x00, 0x6c, 0x24, 0x22, 0x09, 0x5f, 0x4b, 0x82, 0x00, 0xc6, 0x4b, 0xb8, 0x99},
+      {0x50, 0x28, 0xcc, 0x00, 0x78, 0x28, 0x99, 0x0a, 0x2d, 0x88, 0xb4, 0x00, 0x87, 0x88, 0xeb, 0xaa},
+      {0xf2, 0x79, 0x2d, 0x00, 0x74, 0x2c, 0xf0, 0x0b, 0x03, 0xc9, 0xa6, 0x00, 0x47, 0xc9, 0x25, 0xbb},
+      {0x9f, 0xcf, 0x88, 0x00, 0x50, 0x30, 0xee, 0x0c, 0xc9, 0x0f, 0xd8, 0x00, 0x05, 0x0f, 0x4d, 0xcc},
+      {0x3d, 0x9e, 0x69, 0x00, 0x5c, 0x34, 0x87, 0x0d, 0xe7, 0x4e, 0xca, 0x00, 0xc5, 0x4e, 0x83, 0xdd},
+      {0xda, 0x6d, 0x4b, 0x00, 0x48, 0x38, 0x3c, 0x0e, 0x95, 0x8d, 0xfc, 0x00, 0x84, 0x8d, 0xd0, 0xee},
+      {0x78, 0x3c, 0xaa, 0x00, 0x44, 0x3c, 0x55, 0x0f, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0x1e, 0xff},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x01, 0x2a, 0x15, 0x1e, 0x00, 0xc0, 0x40, 0x96, 0x10, 0xe2, 0x14, 0x21, 0x00, 0x0c, 0x14, 0xec},
+      {0x02, 0x54, 0x2a, 0x3c, 0x00, 0x81, 0x80, 0x2d, 0x20, 0xc5, 0x28, 0x42, 0x00, 0x18, 0x28, 0xd9},
+      {0x03, 0x7e, 0x3f, 0x22, 0x00, 0x41, 0xc0, 0xbb, 0x30, 0x27, 0x3c, 0x63, 0x00, 0x14, 0x3c, 0x35},
+      {0x04, 0xa8, 0x54, 0x78, 0x00, 0x03, 0x01, 0x5a, 0x40, 0x8b, 0x50, 0x84, 0x00, 0x30, 0x50, 0xb3},
+      {0x05, 0x82, 0x41, 0x66, 0x00, 0xc3, 0x41, 0xcc, 0x50, 0x69, 0x44, 0xa5, 0x00, 0x3c, 0x44, 0x5f},
+      {0x06, 0xfc, 0x7e, 0x44, 0x00, 0x82, 0x81, 0x77, 0x60, 0x4e, 0x78, 0xc6, 0x00, 0x28, 0x78, 0x6a},
+      {0x07, 0xd6, 0x6b, 0x5a, 0x00, 0x42, 0xc1, 0xe1, 0x70, 0xac, 0x6c, 0xe7, 0x00, 0x24, 0x6c, 0x86},
+      {0x08, 0x51, 0xa8, 0xf0, 0x00, 0x06, 0x02, 0xb4, 0x80, 0x17, 0xa0, 0x09, 0x00, 0x60, 0xa0, 0x67},
+      {0x09, 0x7b, 0xbd, 0xee, 0x00, 0xc6, 0x42, 0x22, 0x90, 0xf5, 0xb4, 0x28, 0x00, 0x6c, 0xb4, 0x8b},
+      {0x0a, 0x05, 0x82, 0xcc, 0x00, 0x87, 0x82, 0x99, 0xa0, 0xd2, 0x88, 0x4b, 0x00, 0x78, 0x88, 0xbe},
+      {0x0b, 0x2f, 0x97, 0xd2, 0x00, 0x47, 0xc2, 0x0f, 0xb0, 0x30, 0x9c, 0x6a, 0x00, 0x74, 0x9c, 0x52},
+      {0x0c, 0xf9, 0xfc, 0x88, 0x00, 0x05, 0x03, 0xee, 0xc0, 0x9c, 0xf0, 0x8d, 0x00, 0x50, 0xf0, 0xd4},
+      {0x0d, 0xd3, 0xe9, 0x96, 0x00, 0xc5, 0x43, 0x78, 0xd0, 0x7e, 0xe4, 0xac, 0x00, 0x5c, 0xe4, 0x38},
+      {0x0e, 0xad, 0xd6, 0xb4, 0x00, 0x84, 0x83, 0xc3, 0xe0, 0x59, 0xd8, 0xcf, 0x00, 0x48, 0xd8, 0x0d},
+      {0x0f, 0x87, 0xc3, 0xaa, 0x00, 0x44, 0xc3, 0x55, 0xf0, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0xe1},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x10, 0xa2, 0x51, 0xe1, 0x00, 0x0c, 0x04, 0x69, 0x01, 0x2e, 0x41, 0x12, 0x00, 0xc0, 0x41, 0xce},
+      {0x20, 0x45, 0xa2, 0xc3, 0x00, 0x18, 0x08, 0xd2, 0x02, 0x5c, 0x82, 0x24, 0x00, 0x81, 0x82, 0x9d},
+      {0x30, 0xe7, 0xf3, 0x22, 0x00, 0x14, 0x0c, 0xbb, 0x03, 0x72, 0xc3, 0x36, 0x00, 0x41, 0xc3, 0x53},
+      {0x40, 0x8a, 0x45, 0x87, 0x00, 0x30, 0x10, 0xa5, 0x04, 0xb8, 0x05, 0x48, 0x00, 0x03, 0x05, 0x3b},
+      {0x50, 0x28, 0x14, 0x66, 0x00, 0x3c, 0x14, 0xcc, 0x05, 0x96, 0x44, 0x5a, 0x00, 0xc3, 0x44, 0xf5},
+      {0x60, 0xcf, 0xe7, 0x44, 0x00, 0x28, 0x18, 0x77, 0x06, 0xe4, 0x87, 0x6c, 0x00, 0x82, 0x87, 0xa6},
+      {0x70, 0x6d, 0xb6, 0xa5, 0x00, 0x24, 0x1c, 0x1e, 0x07, 0xca, 0xc6, 0x7e, 0x00, 0x42, 0xc6, 0x68},
+      {0x80, 0x15, 0x8a, 0x0f, 0x00, 0x60, 0x20, 0x4b, 0x08, 0x71, 0x0a, 0x90, 0x00, 0x06, 0x0a, 0x76},
+      {0x90, 0xb7, 0xdb, 0xee, 0x00, 0x6c, 0x24, 0x22, 0x09, 0x5f, 0x4b, 0x82, 0x00, 0xc6, 0x4b, 0xb8},
+      {0xa0, 0x50, 0x28, 0xcc, 0x00, 0x78, 0x28, 0x99, 0x0a, 0x2d, 0x88, 0xb4, 0x00, 0x87, 0x88, 0xeb},
+      {0xb0, 0xf2, 0x79, 0x2d, 0x00, 0x74, 0x2c, 0xf0, 0x0b, 0x03, 0xc9, 0xa6, 0x00, 0x47, 0xc9, 0x25},
+      {0xc0, 0x9f, 0xcf, 0x88, 0x00, 0x50, 0x30, 0xee, 0x0c, 0xc9, 0x0f, 0xd8, 0x00, 0x05, 0x0f, 0x4d},
+      {0xd0, 0x3d, 0x9e, 0x69, 0x00, 0x5c, 0x34, 0x87, 0x0d, 0xe7, 0x4e, 0xca, 0x00, 0xc5, 0x4e, 0x83},
+      {0xe0, 0xda, 0x6d, 0x4b, 0x00, 0x48, 0x38, 0x3c, 0x0e, 0x95, 0x8d, 0xfc, 0x00, 0x84, 0x8d, 0xd0},
+      {0xf0, 0x78, 0x3c, 0xaa, 0x00, 0x44, 0x3c, 0x55, 0x0f, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0x1e},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x4b, 0x01, 0x2a, 0x15, 0x1e, 0x00, 0xc0, 0x40, 0x96, 0x10, 0xe2, 0x14, 0x21, 0x00, 0x0c, 0x14},
+      {0x96, 0x02, 0x54, 0x2a, 0x3c, 0x00, 0x81, 0x80, 0x2d, 0x20, 0xc5, 0x28, 0x42, 0x00, 0x18, 0x28},
+      {0xdd, 0x03, 0x7e, 0x3f, 0x22, 0x00, 0x41, 0xc0, 0xbb, 0x30, 0x27, 0x3c, 0x63, 0x00, 0x14, 0x3c},
+      {0x2d, 0x04, 0xa8, 0x54, 0x78, 0x00, 0x03, 0x01, 0x5a, 0x40, 0x8b, 0x50, 0x84, 0x00, 0x30, 0x50},
+      {0x66, 0x05, 0x82, 0x41, 0x66, 0x00, 0xc3, 0x41, 0xcc, 0x50, 0x69, 0x44, 0xa5, 0x00, 0x3c, 0x44},
+      {0xbb, 0x06, 0xfc, 0x7e, 0x44, 0x00, 0x82, 0x81, 0x77, 0x60, 0x4e, 0x78, 0xc6, 0x00, 0x28, 0x78},
+      {0xf0, 0x07, 0xd6, 0x6b, 0x5a, 0x00, 0x42, 0xc1, 0xe1, 0x70, 0xac, 0x6c, 0xe7, 0x00, 0x24, 0x6c},
+      {0x5a, 0x08, 0x51, 0xa8, 0xf0, 0x00, 0x06, 0x02, 0xb4, 0x80, 0x17, 0xa0, 0x09, 0x00, 0x60, 0xa0},
+      {0x11, 0x09, 0x7b, 0xbd, 0xee, 0x00, 0xc6, 0x42, 0x22, 0x90, 0xf5, 0xb4, 0x28, 0x00, 0x6c, 0xb4},
+      {0xcc, 0x0a, 0x05, 0x82, 0xcc, 0x00, 0x87, 0x82, 0x99, 0xa0, 0xd2, 0x88, 0x4b, 0x00, 0x78, 0x88},
+      {0x87, 0x0b, 0x2f, 0x97, 0xd2, 0x00, 0x47, 0xc2, 0x0f, 0xb0, 0x30, 0x9c, 0x6a, 0x00, 0x74, 0x9c},
+      {0x77, 0x0c, 0xf9, 0xfc, 0x88, 0x00, 0x05, 0x03, 0xee, 0xc0, 0x9c, 0xf0, 0x8d, 0x00, 0x50, 0xf0},
+      {0x3c, 0x0d, 0xd3, 0xe9, 0x96, 0x00, 0xc5, 0x43, 0x78, 0xd0, 0x7e, 0xe4, 0xac, 0x00, 0x5c, 0xe4},
+      {0xe1, 0x0e, 0xad, 0xd6, 0xb4, 0x00, 0x84, 0x83, 0xc3, 0xe0, 0x59, 0xd8, 0xcf, 0x00, 0x48, 0xd8},
+      {0xaa, 0x0f, 0x87, 0xc3, 0xaa, 0x00, 0x44, 0xc3, 0x55, 0xf0, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0xb4, 0x10, 0xa2, 0x51, 0xe1, 0x00, 0x0c, 0x04, 0x69, 0x01, 0x2e, 0x41, 0x12, 0x00, 0xc0, 0x41},
+      {0x69, 0x20, 0x45, 0xa2, 0xc3, 0x00, 0x18, 0x08, 0xd2, 0x02, 0x5c, 0x82, 0x24, 0x00, 0x81, 0x82},
+      {0xdd, 0x30, 0xe7, 0xf3, 0x22, 0x00, 0x14, 0x0c, 0xbb, 0x03, 0x72, 0xc3, 0x36, 0x00, 0x41, 0xc3},
+      {0xd2, 0x40, 0x8a, 0x45, 0x87, 0x00, 0x30, 0x10, 0xa5, 0x04, 0xb8, 0x05, 0x48, 0x00, 0x03, 0x05},
+      {0x66, 0x50, 0x28, 0x14, 0x66, 0x00, 0x3c, 0x14, 0xcc, 0x05, 0x96, 0x44, 0x5a, 0x00, 0xc3, 0x44},
+      {0xbb, 0x60, 0xcf, 0xe7, 0x44, 0x00, 0x28, 0x18, 0x77, 0x06, 0xe4, 0x87, 0x6c, 0x00, 0x82, 0x87},
+      {0x0f, 0x70, 0x6d, 0xb6, 0xa5, 0x00, 0x24, 0x1c, 0x1e, 0x07, 0xca, 0xc6, 0x7e, 0x00, 0x42, 0xc6},
+      {0xa5, 0x80, 0x15, 0x8a, 0x0f, 0x00, 0x60, 0x20, 0x4b, 0x08, 0x71, 0x0a, 0x90, 0x00, 0x06, 0x0a},
+      {0x11, 0x90, 0xb7, 0xdb, 0xee, 0x00, 0x6c, 0x24, 0x22, 0x09, 0x5f, 0x4b, 0x82, 0x00, 0xc6, 0x4b},
+      {0xcc, 0xa0, 0x50, 0x28, 0xcc, 0x00, 0x78, 0x28, 0x99, 0x0a, 0x2d, 0x88, 0xb4, 0x00, 0x87, 0x88},
+      {0x78, 0xb0, 0xf2, 0x79, 0x2d, 0x00, 0x74, 0x2c, 0xf0, 0x0b, 0x03, 0xc9, 0xa6, 0x00, 0x47, 0xc9},
+      {0x77, 0xc0, 0x9f, 0xcf, 0x88, 0x00, 0x50, 0x30, 0xee, 0x0c, 0xc9, 0x0f, 0xd8, 0x00, 0x05, 0x0f},
+      {0xc3, 0xd0, 0x3d, 0x9e, 0x69, 0x00, 0x5c, 0x34, 0x87, 0x0d, 0xe7, 0x4e, 0xca, 0x00, 0xc5, 0x4e},
+      {0x1e, 0xe0, 0xda, 0x6d, 0x4b, 0x00, 0x48, 0x38, 0x3c, 0x0e, 0x95, 0x8d, 0xfc, 0x00, 0x84, 0x8d},
+      {0xaa, 0xf0, 0x78, 0x3c, 0xaa, 0x00, 0x44, 0x3c, 0x55, 0x0f, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x00, 0x4b, 0x01, 0x2a, 0x15, 0x1e, 0x00, 0xc0, 0x40, 0x96, 0x10, 0xe2, 0x14, 0x21, 0x00, 0x0c},
+      {0x00, 0x96, 0x02, 0x54, 0x2a, 0x3c, 0x00, 0x81, 0x80, 0x2d, 0x20, 0xc5, 0x28, 0x42, 0x00, 0x18},
+      {0x00, 0xdd, 0x03, 0x7e, 0x3f, 0x22, 0x00, 0x41, 0xc0, 0xbb, 0x30, 0x27, 0x3c, 0x63, 0x00, 0x14},
+      {0x00, 0x2d, 0x04, 0xa8, 0x54, 0x78, 0x00, 0x03, 0x01, 0x5a, 0x40, 0x8b, 0x50, 0x84, 0x00, 0x30},
+      {0x00, 0x66, 0x05, 0x82, 0x41, 0x66, 0x00, 0xc3, 0x41, 0xcc, 0x50, 0x69, 0x44, 0xa5, 0x00, 0x3c},
+      {0x00, 0xbb, 0x06, 0xfc, 0x7e, 0x44, 0x00, 0x82, 0x81, 0x77, 0x60, 0x4e, 0x78, 0xc6, 0x00, 0x28},
+      {0x00, 0xf0, 0x07, 0xd6, 0x6b, 0x5a, 0x00, 0x42, 0xc1, 0xe1, 0x70, 0xac, 0x6c, 0xe7, 0x00, 0x24},
+      {0x00, 0x5a, 0x08, 0x51, 0xa8, 0xf0, 0x00, 0x06, 0x02, 0xb4, 0x80, 0x17, 0xa0, 0x09, 0x00, 0x60},
+      {0x00, 0x11, 0x09, 0x7b, 0xbd, 0xee, 0x00, 0xc6, 0x42, 0x22, 0x90, 0xf5, 0xb4, 0x28, 0x00, 0x6c},
+      {0x00, 0xcc, 0x0a, 0x05, 0x82, 0xcc, 0x00, 0x87, 0x82, 0x99, 0xa0, 0xd2, 0x88, 0x4b, 0x00, 0x78},
+      {0x00, 0x87, 0x0b, 0x2f, 0x97, 0xd2, 0x00, 0x47, 0xc2, 0x0f, 0xb0, 0x30, 0x9c, 0x6a, 0x00, 0x74},
+      {0x00, 0x77, 0x0c, 0xf9, 0xfc, 0x88, 0x00, 0x05, 0x03, 0xee, 0xc0, 0x9c, 0xf0, 0x8d, 0x00, 0x50},
+      {0x00, 0x3c, 0x0d, 0xd3, 0xe9, 0x96, 0x00, 0xc5, 0x43, 0x78, 0xd0, 0x7e, 0xe4, 0xac, 0x00, 0x5c},
+      {0x00, 0xe1, 0x0e, 0xad, 0xd6, 0xb4, 0x00, 0x84, 0x83, 0xc3, 0xe0, 0x59, 0xd8, 0xcf, 0x00, 0x48},
+      {0x00, 0xaa, 0x0f, 0x87, 0xc3, 0xaa, 0x00, 0x44, 0xc3, 0x55, 0xf0, 0xbb, 0xcc, 0xee, 0x00, 0x44},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x00, 0xb4, 0x10, 0xa2, 0x51, 0xe1, 0x00, 0x0c, 0x04, 0x69, 0x01, 0x2e, 0x41, 0x12, 0x00, 0xc0},
+      {0x00, 0x69, 0x20, 0x45, 0xa2, 0xc3, 0x00, 0x18, 0x08, 0xd2, 0x02, 0x5c, 0x82, 0x24, 0x00, 0x81},
+      {0x00, 0xdd, 0x30, 0xe7, 0xf3, 0x22, 0x00, 0x14, 0x0c, 0xbb, 0x03, 0x72, 0xc3, 0x36, 0x00, 0x41},
+      {0x00, 0xd2, 0x40, 0x8a, 0x45, 0x87, 0x00, 0x30, 0x10, 0xa5, 0x04, 0xb8, 0x05, 0x48, 0x00, 0x03},
+      {0x00, 0x66, 0x50, 0x28, 0x14, 0x66, 0x00, 0x3c, 0x14, 0xcc, 0x05, 0x96, 0x44, 0x5a, 0x00, 0xc3},
+      {0x00, 0xbb, 0x60, 0xcf, 0xe7, 0x44, 0x00, 0x28, 0x18, 0x77, 0x06, 0xe4, 0x87, 0x6c, 0x00, 0x82},
+      {0x00, 0x0f, 0x70, 0x6d, 0xb6, 0xa5, 0x00, 0x24, 0x1c, 0x1e, 0x07, 0xca, 0xc6, 0x7e, 0x00, 0x42},
+      {0x00, 0xa5, 0x80, 0x15, 0x8a, 0x0f, 0x00, 0x60, 0x20, 0x4b, 0x08, 0x71, 0x0a, 0x90, 0x00, 0x06},
+      {0x00, 0x11, 0x90, 0xb7, 0xdb, 0xee, 0x00, 0x6c, 0x24, 0x22, 0x09, 0x5f, 0x4b, 0x82, 0x00, 0xc6},
+      {0x00, 0xcc, 0xa0, 0x50, 0x28, 0xcc, 0x00, 0x78, 0x28, 0x99, 0x0a, 0x2d, 0x88, 0xb4, 0x00, 0x87},
+      {0x00, 0x78, 0xb0, 0xf2, 0x79, 0x2d, 0x00, 0x74, 0x2c, 0xf0, 0x0b, 0x03, 0xc9, 0xa6, 0x00, 0x47},
+      {0x00, 0x77, 0xc0, 0x9f, 0xcf, 0x88, 0x00, 0x50, 0x30, 0xee, 0x0c, 0xc9, 0x0f, 0xd8, 0x00, 0x05},
+      {0x00, 0xc3, 0xd0, 0x3d, 0x9e, 0x69, 0x00, 0x5c, 0x34, 0x87, 0x0d, 0xe7, 0x4e, 0xca, 0x00, 0xc5},
+      {0x00, 0x1e, 0xe0, 0xda, 0x6d, 0x4b, 0x00, 0x48, 0x38, 0x3c, 0x0e, 0x95, 0x8d, 0xfc, 0x00, 0x84},
+      {0x00, 0xaa, 0xf0, 0x78, 0x3c, 0xaa, 0x00, 0x44, 0x3c, 0x55, 0x0f, 0xbb, 0xcc, 0xee, 0x00, 0x44},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x88, 0x00, 0x4b, 0x01, 0x2a, 0x15, 0x1e, 0x00, 0xc0, 0x40, 0x96, 0x10, 0xe2, 0x14, 0x21, 0x00},
+      {0x11, 0x00, 0x96, 0x02, 0x54, 0x2a, 0x3c, 0x00, 0x81, 0x80, 0x2d, 0x20, 0xc5, 0x28, 0x42, 0x00},
+      {0x99, 0x00, 0xdd, 0x03, 0x7e, 0x3f, 0x22, 0x00, 0x41, 0xc0, 0xbb, 0x30, 0x27, 0x3c, 0x63, 0x00},
+      {0x22, 0x00, 0x2d, 0x04, 0xa8, 0x54, 0x78, 0x00, 0x03, 0x01, 0x5a, 0x40, 0x8b, 0x50, 0x84, 0x00},
+      {0xaa, 0x00, 0x66, 0x05, 0x82, 0x41, 0x66, 0x00, 0xc3, 0x41, 0xcc, 0x50, 0x69, 0x44, 0xa5, 0x00},
+      {0x33, 0x00, 0xbb, 0x06, 0xfc, 0x7e, 0x44, 0x00, 0x82, 0x81, 0x77, 0x60, 0x4e, 0x78, 0xc6, 0x00},
+      {0xbb, 0x00, 0xf0, 0x07, 0xd6, 0x6b, 0x5a, 0x00, 0x42, 0xc1, 0xe1, 0x70, 0xac, 0x6c, 0xe7, 0x00},
+      {0x44, 0x00, 0x5a, 0x08, 0x51, 0xa8, 0xf0, 0x00, 0x06, 0x02, 0xb4, 0x80, 0x17, 0xa0, 0x09, 0x00},
+      {0xcc, 0x00, 0x11, 0x09, 0x7b, 0xbd, 0xee, 0x00, 0xc6, 0x42, 0x22, 0x90, 0xf5, 0xb4, 0x28, 0x00},
+      {0x55, 0x00, 0xcc, 0x0a, 0x05, 0x82, 0xcc, 0x00, 0x87, 0x82, 0x99, 0xa0, 0xd2, 0x88, 0x4b, 0x00},
+      {0xdd, 0x00, 0x87, 0x0b, 0x2f, 0x97, 0xd2, 0x00, 0x47, 0xc2, 0x0f, 0xb0, 0x30, 0x9c, 0x6a, 0x00},
+      {0x66, 0x00, 0x77, 0x0c, 0xf9, 0xfc, 0x88, 0x00, 0x05, 0x03, 0xee, 0xc0, 0x9c, 0xf0, 0x8d, 0x00},
+      {0xee, 0x00, 0x3c, 0x0d, 0xd3, 0xe9, 0x96, 0x00, 0xc5, 0x43, 0x78, 0xd0, 0x7e, 0xe4, 0xac, 0x00},
+      {0x77, 0x00, 0xe1, 0x0e, 0xad, 0xd6, 0xb4, 0x00, 0x84, 0x83, 0xc3, 0xe0, 0x59, 0xd8, 0xcf, 0x00},
+      {0xff, 0x00, 0xaa, 0x0f, 0x87, 0xc3, 0xaa, 0x00, 0x44, 0xc3, 0x55, 0xf0, 0xbb, 0xcc, 0xee, 0x00},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x88, 0x00, 0xb4, 0x10, 0xa2, 0x51, 0xe1, 0x00, 0x0c, 0x04, 0x69, 0x01, 0x2e, 0x41, 0x12, 0x00},
+      {0x11, 0x00, 0x69, 0x20, 0x45, 0xa2, 0xc3, 0x00, 0x18, 0x08, 0xd2, 0x02, 0x5c, 0x82, 0x24, 0x00},
+      {0x99, 0x00, 0xdd, 0x30, 0xe7, 0xf3, 0x22, 0x00, 0x14, 0x0c, 0xbb, 0x03, 0x72, 0xc3, 0x36, 0x00},
+      {0x22, 0x00, 0xd2, 0x40, 0x8a, 0x45, 0x87, 0x00, 0x30, 0x10, 0xa5, 0x04, 0xb8, 0x05, 0x48, 0x00},
+      {0xaa, 0x00, 0x66, 0x50, 0x28, 0x14, 0x66, 0x00, 0x3c, 0x14, 0xcc, 0x05, 0x96, 0x44, 0x5a, 0x00},
+      {0x33, 0x00, 0xbb, 0x60, 0xcf, 0xe7, 0x44, 0x00, 0x28, 0x18, 0x77, 0x06, 0xe4, 0x87, 0x6c, 0x00},
+      {0xbb, 0x00, 0x0f, 0x70, 0x6d, 0xb6, 0xa5, 0x00, 0x24, 0x1c, 0x1e, 0x07, 0xca, 0xc6, 0x7e, 0x00},
+      {0x44, 0x00, 0xa5, 0x80, 0x15, 0x8a, 0x0f, 0x00, 0x60, 0x20, 0x4b, 0x08, 0x71, 0x0a, 0x90, 0x00},
+      {0xcc, 0x00, 0x11, 0x90, 0xb7, 0xdb, 0xee, 0x00, 0x6c, 0x24, 0x22, 0x09, 0x5f, 0x4b, 0x82, 0x00},
+      {0x55, 0x00, 0xcc, 0xa0, 0x50, 0x28, 0xcc, 0x00, 0x78, 0x28, 0x99, 0x0a, 0x2d, 0x88, 0xb4, 0x00},
+      {0xdd, 0x00, 0x78, 0xb0, 0xf2, 0x79, 0x2d, 0x00, 0x74, 0x2c, 0xf0, 0x0b, 0x03, 0xc9, 0xa6, 0x00},
+      {0x66, 0x00, 0x77, 0xc0, 0x9f, 0xcf, 0x88, 0x00, 0x50, 0x30, 0xee, 0x0c, 0xc9, 0x0f, 0xd8, 0x00},
+      {0xee, 0x00, 0xc3, 0xd0, 0x3d, 0x9e, 0x69, 0x00, 0x5c, 0x34, 0x87, 0x0d, 0xe7, 0x4e, 0xca, 0x00},
+      {0x77, 0x00, 0x1e, 0xe0, 0xda, 0x6d, 0x4b, 0x00, 0x48, 0x38, 0x3c, 0x0e, 0x95, 0x8d, 0xfc, 0x00},
+      {0xff, 0x00, 0xaa, 0xf0, 0x78, 0x3c, 0xaa, 0x00, 0x44, 0x3c, 0x55, 0x0f, 0xbb, 0xcc, 0xee, 0x00},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x00, 0x88, 0x00, 0x4b, 0x01, 0x2a, 0x15, 0x1e, 0x00, 0xc0, 0x40, 0x96, 0x10, 0xe2, 0x14, 0x21},
+      {0x00, 0x11, 0x00, 0x96, 0x02, 0x54, 0x2a, 0x3c, 0x00, 0x81, 0x80, 0x2d, 0x20, 0xc5, 0x28, 0x42},
+      {0x00, 0x99, 0x00, 0xdd, 0x03, 0x7e, 0x3f, 0x22, 0x00, 0x41, 0xc0, 0xbb, 0x30, 0x27, 0x3c, 0x63},
+      {0x00, 0x22, 0x00, 0x2d, 0x04, 0xa8, 0x54, 0x78, 0x00, 0x03, 0x01, 0x5a, 0x40, 0x8b, 0x50, 0x84},
+      {0x00, 0xaa, 0x00, 0x66, 0x05, 0x82, 0x41, 0x66, 0x00, 0xc3, 0x41, 0xcc, 0x50, 0x69, 0x44, 0xa5},
+      {0x00, 0x33, 0x00, 0xbb, 0x06, 0xfc, 0x7e, 0x44, 0x00, 0x82, 0x81, 0x77, 0x60, 0x4e, 0x78, 0xc6},
+      {0x00, 0xbb, 0x00, 0xf0, 0x07, 0xd6, 0x6b, 0x5a, 0x00, 0x42, 0xc1, 0xe1, 0x70, 0xac, 0x6c, 0xe7},
+      {0x00, 0x44, 0x00, 0x5a, 0x08, 0x51, 0xa8, 0xf0, 0x00, 0x06, 0x02, 0xb4, 0x80, 0x17, 0xa0, 0x09},
+      {0x00, 0xcc, 0x00, 0x11, 0x09, 0x7b, 0xbd, 0xee, 0x00, 0xc6, 0x42, 0x22, 0x90, 0xf5, 0xb4, 0x28},
+      {0x00, 0x55, 0x00, 0xcc, 0x0a, 0x05, 0x82, 0xcc, 0x00, 0x87, 0x82, 0x99, 0xa0, 0xd2, 0x88, 0x4b},
+      {0x00, 0xdd, 0x00, 0x87, 0x0b, 0x2f, 0x97, 0xd2, 0x00, 0x47, 0xc2, 0x0f, 0xb0, 0x30, 0x9c, 0x6a},
+      {0x00, 0x66, 0x00, 0x77, 0x0c, 0xf9, 0xfc, 0x88, 0x00, 0x05, 0x03, 0xee, 0xc0, 0x9c, 0xf0, 0x8d},
+      {0x00, 0xee, 0x00, 0x3c, 0x0d, 0xd3, 0xe9, 0x96, 0x00, 0xc5, 0x43, 0x78, 0xd0, 0x7e, 0xe4, 0xac},
+      {0x00, 0x77, 0x00, 0xe1, 0x0e, 0xad, 0xd6, 0xb4, 0x00, 0x84, 0x83, 0xc3, 0xe0, 0x59, 0xd8, 0xcf},
+      {0x00, 0xff, 0x00, 0xaa, 0x0f, 0x87, 0xc3, 0xaa, 0x00, 0x44, 0xc3, 0x55, 0xf0, 0xbb, 0xcc, 0xee},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x00, 0x88, 0x00, 0xb4, 0x10, 0xa2, 0x51, 0xe1, 0x00, 0x0c, 0x04, 0x69, 0x01, 0x2e, 0x41, 0x12},
+      {0x00, 0x11, 0x00, 0x69, 0x20, 0x45, 0xa2, 0xc3, 0x00, 0x18, 0x08, 0xd2, 0x02, 0x5c, 0x82, 0x24},
+      {0x00, 0x99, 0x00, 0xdd, 0x30, 0xe7, 0xf3, 0x22, 0x00, 0x14, 0x0c, 0xbb, 0x03, 0x72, 0xc3, 0x36},
+      {0x00, 0x22, 0x00, 0xd2, 0x40, 0x8a, 0x45, 0x87, 0x00, 0x30, 0x10, 0xa5, 0x04, 0xb8, 0x05, 0x48},
+      {0x00, 0xaa, 0x00, 0x66, 0x50, 0x28, 0x14, 0x66, 0x00, 0x3c, 0x14, 0xcc, 0x05, 0x96, 0x44, 0x5a},
+      {0x00, 0x33, 0x00, 0xbb, 0x60, 0xcf, 0xe7, 0x44, 0x00, 0x28, 0x18, 0x77, 0x06, 0xe4, 0x87, 0x6c},
+      {0x00, 0xbb, 0x00, 0x0f, 0x70, 0x6d, 0xb6, 0xa5, 0x00, 0x24, 0x1c, 0x1e, 0x07, 0xca, 0xc6, 0x7e},
+      {0x00, 0x44, 0x00, 0xa5, 0x80, 0x15, 0x8a, 0x0f, 0x00, 0x60, 0x20, 0x4b, 0x08, 0x71, 0x0a, 0x90},
+      {0x00, 0xcc, 0x00, 0x11, 0x90, 0xb7, 0xdb, 0xee, 0x00, 0x6c, 0x24, 0x22, 0x09, 0x5f, 0x4b, 0x82},
+      {0x00, 0x55, 0x00, 0xcc, 0xa0, 0x50, 0x28, 0xcc, 0x00, 0x78, 0x28, 0x99, 0x0a, 0x2d, 0x88, 0xb4},
+      {0x00, 0xdd, 0x00, 0x78, 0xb0, 0xf2, 0x79, 0x2d, 0x00, 0x74, 0x2c, 0xf0, 0x0b, 0x03, 0xc9, 0xa6},
+      {0x00, 0x66, 0x00, 0x77, 0xc0, 0x9f, 0xcf, 0x88, 0x00, 0x50, 0x30, 0xee, 0x0c, 0xc9, 0x0f, 0xd8},
+      {0x00, 0xee, 0x00, 0xc3, 0xd0, 0x3d, 0x9e, 0x69, 0x00, 0x5c, 0x34, 0x87, 0x0d, 0xe7, 0x4e, 0xca},
+      {0x00, 0x77, 0x00, 0x1e, 0xe0, 0xda, 0x6d, 0x4b, 0x00, 0x48, 0x38, 0x3c, 0x0e, 0x95, 0x8d, 0xfc},
+      {0x00, 0xff, 0x00, 0xaa, 0xf0, 0x78, 0x3c, 0xaa, 0x00, 0x44, 0x3c, 0x55, 0x0f, 0xbb, 0xcc, 0xee},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0xb3, 0x81, 0x08, 0x2d, 0x6b, 0xc4, 0x02, 0x57, 0x1e, 0x18, 0xe8, 0x99, 0xb4, 0x50, 0x42, 0x36},
+      {0x67, 0x03, 0x10, 0x5a, 0xd6, 0x89, 0x04, 0xae, 0x3c, 0x30, 0xd1, 0x33, 0x69, 0xa0, 0x84, 0x6c},
+      {0xd4, 0x82, 0x18, 0x77, 0xbd, 0x4d, 0x06, 0xf9, 0x22, 0x28, 0x39, 0xaa, 0xdd, 0xf0, 0xc6, 0x5a},
+      {0xce, 0x06, 0x20, 0xb4, 0xad, 0x13, 0x08, 0x5d, 0x78, 0x60, 0xa3, 0x66, 0xd2, 0x41, 0x09, 0xd8},
+      {0x7d, 0x87, 0x28, 0x99, 0xc6, 0xd7, 0x0a, 0x0a, 0x66, 0x78, 0x4b, 0xff, 0x66, 0x11, 0x4b, 0xee},
+      {0xa9, 0x05, 0x30, 0xee, 0x7b, 0x9a, 0x0c, 0xf3, 0x44, 0x50, 0x72, 0x55, 0xbb, 0xe1, 0x8d, 0xb4},
+      {0x1a, 0x84, 0x38, 0xc3, 0x10, 0x5e, 0x0e, 0xa4, 0x5a, 0x48, 0x9a, 0xcc, 0x0f, 0xb1, 0xcf, 0x82},
+      {0x9d, 0x0c, 0x40, 0x69, 0x5b, 0x26, 0x10, 0xba, 0xf0, 0xc0, 0x47, 0xcc, 0xa5, 0x82, 0x12, 0xb1},
+      {0x2e, 0x8d, 0x48, 0x44, 0x30, 0xe2, 0x12, 0xed, 0xee, 0xd8, 0xaf, 0x55, 0x11, 0xd2, 0x50, 0x87},
+      {0xfa, 0x0f, 0x50, 0x33, 0x8d, 0xaf, 0x14, 0x14, 0xcc, 0xf0, 0x96, 0xff, 0xcc, 0x22, 0x96, 0xdd},
+      {0x49, 0x8e, 0x58, 0x1e, 0xe6, 0x6b, 0x16, 0x43, 0xd2, 0xe8, 0x7e, 0x66, 0x78, 0x72, 0xd4, 0xeb},
+      {0x53, 0x0a, 0x60, 0xdd, 0xf6, 0x35, 0x18, 0xe7, 0x88, 0xa0, 0xe4, 0xaa, 0x77, 0xc3, 0x1b, 0x69},
+      {0xe0, 0x8b, 0x68, 0xf0, 0x9d, 0xf1, 0x1a, 0xb0, 0x96, 0xb8, 0x0c, 0x33, 0xc3, 0x93, 0x59, 0x5f},
+      {0x34, 0x09, 0x70, 0x87, 0x20, 0xbc, 0x1c, 0x49, 0xb4, 0x90, 0x35, 0x99, 0x1e, 0x63, 0x9f, 0x05},
+      {0x87, 0x88, 0x78, 0xaa, 0x4b, 0x78, 0x1e, 0x1e, 0xaa, 0x88, 0xdd, 0x00, 0xaa, 0x33, 0xdd, 0x33},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x3b, 0x18, 0x80, 0xd2, 0xb6, 0x4c, 0x20, 0x75, 0xe1, 0x81, 0x8e, 0x99, 0x4b, 0x05, 0x24, 0x63},
+      {0x76, 0x30, 0x01, 0xa5, 0x6d, 0x98, 0x40, 0xea, 0xc3, 0x03, 0x1d, 0x33, 0x96, 0x0a, 0x48, 0xc6},
+      {0x4d, 0x28, 0x81, 0x77, 0xdb, 0xd4, 0x60, 0x9f, 0x22, 0x82, 0x93, 0xaa, 0xdd, 0x0f, 0x6c, 0xa5},
+      {0xec, 0x60, 0x02, 0x4b, 0xda, 0x31, 0x80, 0xd5, 0x87, 0x06, 0x3a, 0x66, 0x2d, 0x14, 0x90, 0x8d},
+      {0xd7, 0x78, 0x82, 0x99, 0x6c, 0x7d, 0xa0, 0xa0, 0x66, 0x87, 0xb4, 0xff, 0x66, 0x11, 0xb4, 0xee},
+      {0x9a, 0x50, 0x03, 0xee, 0xb7, 0xa9, 0xc0, 0x3f, 0x44, 0x05, 0x27, 0x55, 0xbb, 0x1e, 0xd8, 0x4b},
+      {0xa1, 0x48, 0x83, 0x3c, 0x01, 0xe5, 0xe0, 0x4a, 0xa5, 0x84, 0xa9, 0xcc, 0xf0, 0x1b, 0xfc, 0x28},
+      {0xd9, 0xc0, 0x04, 0x96, 0xb5, 0x62, 0x01, 0xab, 0x0f, 0x0c, 0x74, 0xcc, 0x5a, 0x28, 0x21, 0x1b},
+      {0xe2, 0xd8, 0x84, 0x44, 0x03, 0x2e, 0x21, 0xde, 0xee, 0x8d, 0xfa, 0x55, 0x11, 0x2d, 0x05, 0x78},
+      {0xaf, 0xf0, 0x05, 0x33, 0xd8, 0xfa, 0x41, 0x41, 0xcc, 0x0f, 0x69, 0xff, 0xcc, 0x22, 0x69, 0xdd},
+      {0x94, 0xe8, 0x85, 0xe1, 0x6e, 0xb6, 0x61, 0x34, 0x2d, 0x8e, 0xe7, 0x66, 0x87, 0x27, 0x4d, 0xbe},
+      {0x35, 0xa0, 0x06, 0xdd, 0x6f, 0x53, 0x81, 0x7e, 0x88, 0x0a, 0x4e, 0xaa, 0x77, 0x3c, 0xb1, 0x96},
+      {0x0e, 0xb8, 0x86, 0x0f, 0xd9, 0x1f, 0xa1, 0x0b, 0x69, 0x8b, 0xc0, 0x33, 0x3c, 0x39, 0x95, 0xf5},
+      {0x43, 0x90, 0x07, 0x78, 0x02, 0xcb, 0xc1, 0x94, 0x4b, 0x09, 0x53, 0x99, 0xe1, 0x36, 0xf9, 0x50},
+      {0x78, 0x88, 0x87, 0xaa, 0xb4, 0x87, 0xe1, 0xe1, 0xaa, 0x88, 0xdd, 0x00, 0xaa, 0x33, 0xdd, 0x33},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x78, 0xb3, 0x81, 0x08, 0x2d, 0x6b, 0xc4, 0x02, 0x57, 0x1e, 0x18, 0xe8, 0x99, 0xb4, 0x50, 0x42},
+      {0xf0, 0x67, 0x03, 0x10, 0x5a, 0xd6, 0x89, 0x04, 0xae, 0x3c, 0x30, 0xd1, 0x33, 0x69, 0xa0, 0x84},
+      {0x88, 0xd4, 0x82, 0x18, 0x77, 0xbd, 0x4d, 0x06, 0xf9, 0x22, 0x28, 0x39, 0xaa, 0xdd, 0xf0, 0xc6},
+      {0xe1, 0xce, 0x06, 0x20, 0xb4, 0xad, 0x13, 0x08, 0x5d, 0x78, 0x60, 0xa3, 0x66, 0xd2, 0x41, 0x09},
+      {0x99, 0x7d, 0x87, 0x28, 0x99, 0xc6, 0xd7, 0x0a, 0x0a, 0x66, 0x78, 0x4b, 0xff, 0x66, 0x11, 0x4b},
+      {0x11, 0xa9, 0x05, 0x30, 0xee, 0x7b, 0x9a, 0x0c, 0xf3, 0x44, 0x50, 0x72, 0x55, 0xbb, 0xe1, 0x8d},
+      {0x69, 0x1a, 0x84, 0x38, 0xc3, 0x10, 0x5e, 0x0e, 0xa4, 0x5a, 0x48, 0x9a, 0xcc, 0x0f, 0xb1, 0xcf},
+      {0xc3, 0x9d, 0x0c, 0x40, 0x69, 0x5b, 0x26, 0x10, 0xba, 0xf0, 0xc0, 0x47, 0xcc, 0xa5, 0x82, 0x12},
+      {0xbb, 0x2e, 0x8d, 0x48, 0x44, 0x30, 0xe2, 0x12, 0xed, 0xee, 0xd8, 0xaf, 0x55, 0x11, 0xd2, 0x50},
+      {0x33, 0xfa, 0x0f, 0x50, 0x33, 0x8d, 0xaf, 0x14, 0x14, 0xcc, 0xf0, 0x96, 0xff, 0xcc, 0x22, 0x96},
+      {0x4b, 0x49, 0x8e, 0x58, 0x1e, 0xe6, 0x6b, 0x16, 0x43, 0xd2, 0xe8, 0x7e, 0x66, 0x78, 0x72, 0xd4},
+      {0x22, 0x53, 0x0a, 0x60, 0xdd, 0xf6, 0x35, 0x18, 0xe7, 0x88, 0xa0, 0xe4, 0xaa, 0x77, 0xc3, 0x1b},
+      {0x5a, 0xe0, 0x8b, 0x68, 0xf0, 0x9d, 0xf1, 0x1a, 0xb0, 0x96, 0xb8, 0x0c, 0x33, 0xc3, 0x93, 0x59},
+      {0xd2, 0x34, 0x09, 0x70, 0x87, 0x20, 0xbc, 0x1c, 0x49, 0xb4, 0x90, 0x35, 0x99, 0x1e, 0x63, 0x9f},
+      {0xaa, 0x87, 0x88, 0x78, 0xaa, 0x4b, 0x78, 0x1e, 0x1e, 0xaa, 0x88, 0xdd, 0x00, 0xaa, 0x33, 0xdd},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x87, 0x3b, 0x18, 0x80, 0xd2, 0xb6, 0x4c, 0x20, 0x75, 0xe1, 0x81, 0x8e, 0x99, 0x4b, 0x05, 0x24},
+      {0x0f, 0x76, 0x30, 0x01, 0xa5, 0x6d, 0x98, 0x40, 0xea, 0xc3, 0x03, 0x1d, 0x33, 0x96, 0x0a, 0x48},
+      {0x88, 0x4d, 0x28, 0x81, 0x77, 0xdb, 0xd4, 0x60, 0x9f, 0x22, 0x82, 0x93, 0xaa, 0xdd, 0x0f, 0x6c},
+      {0x1e, 0xec, 0x60, 0x02, 0x4b, 0xda, 0x31, 0x80, 0xd5, 0x87, 0x06, 0x3a, 0x66, 0x2d, 0x14, 0x90},
+      {0x99, 0xd7, 0x78, 0x82, 0x99, 0x6c, 0x7d, 0xa0, 0xa0, 0x66, 0x87, 0xb4, 0xff, 0x66, 0x11, 0xb4},
+      {0x11, 0x9a, 0x50, 0x03, 0xee, 0xb7, 0xa9, 0xc0, 0x3f, 0x44, 0x05, 0x27, 0x55, 0xbb, 0x1e, 0xd8},
+      {0x96, 0xa1, 0x48, 0x83, 0x3c, 0x01, 0xe5, 0xe0, 0x4a, 0xa5, 0x84, 0xa9, 0xcc, 0xf0, 0x1b, 0xfc},
+      {0x3c, 0xd9, 0xc0, 0x04, 0x96, 0xb5, 0x62, 0x01, 0xab, 0x0f, 0x0c, 0x74, 0xcc, 0x5a, 0x28, 0x21},
+      {0xbb, 0xe2, 0xd8, 0x84, 0x44, 0x03, 0x2e, 0x21, 0xde, 0xee, 0x8d, 0xfa, 0x55, 0x11, 0x2d, 0x05},
+      {0x33, 0xaf, 0xf0, 0x05, 0x33, 0xd8, 0xfa, 0x41, 0x41, 0xcc, 0x0f, 0x69, 0xff, 0xcc, 0x22, 0x69},
+      {0xb4, 0x94, 0xe8, 0x85, 0xe1, 0x6e, 0xb6, 0x61, 0x34, 0x2d, 0x8e, 0xe7, 0x66, 0x87, 0x27, 0x4d},
+      {0x22, 0x35, 0xa0, 0x06, 0xdd, 0x6f, 0x53, 0x81, 0x7e, 0x88, 0x0a, 0x4e, 0xaa, 0x77, 0x3c, 0xb1},
+      {0xa5, 0x0e, 0xb8, 0x86, 0x0f, 0xd9, 0x1f, 0xa1, 0x0b, 0x69, 0x8b, 0xc0, 0x33, 0x3c, 0x39, 0x95},
+      {0x2d, 0x43, 0x90, 0x07, 0x78, 0x02, 0xcb, 0xc1, 0x94, 0x4b, 0x09, 0x53, 0x99, 0xe1, 0x36, 0xf9},
+      {0xaa, 0x78, 0x88, 0x87, 0xaa, 0xb4, 0x87, 0xe1, 0xe1, 0xaa, 0x88, 0xdd, 0x00, 0xaa, 0x33, 0xdd},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0xe0, 0x48, 0xa3, 0x24, 0x0c, 0x95, 0x6e, 0x8c, 0x02, 0x54, 0x1b, 0x23, 0xac, 0x91, 0xa0, 0x14},
+      {0xc1, 0x90, 0x47, 0x48, 0x18, 0x2b, 0xdc, 0x19, 0x04, 0xa8, 0x36, 0x46, 0x59, 0x23, 0x41, 0x28},
+      {0x21, 0xd8, 0xe4, 0x6c, 0x14, 0xbe, 0xb2, 0x95, 0x06, 0xfc, 0x2d, 0x65, 0xf5, 0xb2, 0xe1, 0x3c},
+      {0x83, 0x21, 0x8e, 0x90, 0x30, 0x56, 0xb9, 0x32, 0x08, 0x51, 0x6c, 0x8c, 0xb2, 0x46, 0x82, 0x50},
+      {0x63, 0x69, 0x2d, 0xb4, 0x3c, 0xc3, 0xd7, 0xbe, 0x0a, 0x05, 0x77, 0xaf, 0x1e, 0xd7, 0x22, 0x44},
+      {0x42, 0xb1, 0xc9, 0xd8, 0x28, 0x7d, 0x65, 0x2b, 0x0c, 0xf9, 0x5a, 0xca, 0xeb, 0x65, 0xc3, 0x78},
+      {0xa2, 0xf9, 0x6a, 0xfc, 0x24, 0xe8, 0x0b, 0xa7, 0x0e, 0xad, 0x41, 0xe9, 0x47, 0xf4, 0x63, 0x6c},
+      {0x07, 0x42, 0x1d, 0x21, 0x60, 0xac, 0x73, 0x64, 0x10, 0xa2, 0xd8, 0x19, 0x65, 0x8c, 0x05, 0xa0},
+      {0xe7, 0x0a, 0xbe, 0x05, 0x6c, 0x39, 0x1d, 0xe8, 0x12, 0xf6, 0xc3, 0x3a, 0xc9, 0x1d, 0xa5, 0xb4},
+      {0xc6, 0xd2, 0x5a, 0x69, 0x78, 0x87, 0xaf, 0x7d, 0x14, 0x0a, 0xee, 0x5f, 0x3c, 0xaf, 0x44, 0x88},
+      {0x26, 0x9a, 0xf9, 0x4d, 0x74, 0x12, 0xc1, 0xf1, 0x16, 0x5e, 0xf5, 0x7c, 0x90, 0x3e, 0xe4, 0x9c},
+      {0x84, 0x63, 0x93, 0xb1, 0x50, 0xfa, 0xca, 0x56, 0x18, 0xf3, 0xb4, 0x95, 0xd7, 0xca, 0x87, 0xf0},
+      {0x64, 0x2b, 0x30, 0x95, 0x5c, 0x6f, 0xa4, 0xda, 0x1a, 0xa7, 0xaf, 0xb6, 0x7b, 0x5b, 0x27, 0xe4},
+      {0x45, 0xf3, 0xd4, 0xf9, 0x48, 0xd1, 0x16, 0x4f, 0x1c, 0x5b, 0x82, 0xd3, 0x8e, 0xe9, 0xc6, 0xd8},
+      {0xa5, 0xbb, 0x77, 0xdd, 0x44, 0x44, 0x78, 0xc3, 0x1e, 0x0f, 0x99, 0xf0, 0x22, 0x78, 0x66, 0xcc},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x0e, 0x84, 0x3a, 0x42, 0xc0, 0x59, 0xe6, 0xc8, 0x20, 0x45, 0xb1, 0x32, 0xca, 0x19, 0x0a, 0x41},
+      {0x1c, 0x09, 0x74, 0x84, 0x81, 0xb2, 0xcd, 0x91, 0x40, 0x8a, 0x63, 0x64, 0x95, 0x32, 0x14, 0x82},
+      {0x12, 0x8d, 0x4e, 0xc6, 0x41, 0xeb, 0x2b, 0x59, 0x60, 0xcf, 0xd2, 0x56, 0x5f, 0x2b, 0x1e, 0xc3},
+      {0x38, 0x12, 0xe8, 0x09, 0x03, 0x65, 0x9b, 0x23, 0x80, 0x15, 0xc6, 0xc8, 0x2b, 0x64, 0x28, 0x05},
+      {0x36, 0x96, 0xd2, 0x4b, 0xc3, 0x3c, 0x7d, 0xeb, 0xa0, 0x50, 0x77, 0xfa, 0xe1, 0x7d, 0x22, 0x44},
+      {0x24, 0x1b, 0x9c, 0x8d, 0x82, 0xd7, 0x56, 0xb2, 0xc0, 0x9f, 0xa5, 0xac, 0xbe, 0x56, 0x3c, 0x87},
+      {0x2a, 0x9f, 0xa6, 0xcf, 0x42, 0x8e, 0xb0, 0x7a, 0xe0, 0xda, 0x14, 0x9e, 0x74, 0x4f, 0x36, 0xc6},
+      {0x70, 0x24, 0xd1, 0x12, 0x06, 0xca, 0x37, 0x46, 0x01, 0x2a, 0x8d, 0x91, 0x56, 0xc8, 0x50, 0x0a},
+      {0x7e, 0xa0, 0xeb, 0x50, 0xc6, 0x93, 0xd1, 0x8e, 0x21, 0x6f, 0x3c, 0xa3, 0x9c, 0xd1, 0x5a, 0x4b},
+      {0x6c, 0x2d, 0xa5, 0x96, 0x87, 0x78, 0xfa, 0xd7, 0x41, 0xa0, 0xee, 0xf5, 0xc3, 0xfa, 0x44, 0x88},
+      {0x62, 0xa9, 0x9f, 0xd4, 0x47, 0x21, 0x1c, 0x1f, 0x61, 0xe5, 0x5f, 0xc7, 0x09, 0xe3, 0x4e, 0xc9},
+      {0x48, 0x36, 0x39, 0x1b, 0x05, 0xaf, 0xac, 0x65, 0x81, 0x3f, 0x4b, 0x59, 0x7d, 0xac, 0x78, 0x0f},
+      {0x46, 0xb2, 0x03, 0x59, 0xc5, 0xf6, 0x4a, 0xad, 0xa1, 0x7a, 0xfa, 0x6b, 0xb7, 0xb5, 0x72, 0x4e},
+      {0x54, 0x3f, 0x4d, 0x9f, 0x84, 0x1d, 0x61, 0xf4, 0xc1, 0xb5, 0x28, 0x3d, 0xe8, 0x9e, 0x6c, 0x8d},
+      {0x5a, 0xbb, 0x77, 0xdd, 0x44, 0x44, 0x87, 0x3c, 0xe1, 0xf0, 0x99, 0x0f, 0x22, 0x87, 0x66, 0xcc},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0xc2, 0xe0, 0x48, 0xa3, 0x24, 0x0c, 0x95, 0x6e, 0x8c, 0x02, 0x54, 0x1b, 0x23, 0xac, 0x91, 0xa0},
+      {0x85, 0xc1, 0x90, 0x47, 0x48, 0x18, 0x2b, 0xdc, 0x19, 0x04, 0xa8, 0x36, 0x46, 0x59, 0x23, 0x41},
+      {0x47, 0x21, 0xd8, 0xe4, 0x6c, 0x14, 0xbe, 0xb2, 0x95, 0x06, 0xfc, 0x2d, 0x65, 0xf5, 0xb2, 0xe1},
+      {0x0b, 0x83, 0x21, 0x8e, 0x90, 0x30, 0x56, 0xb9, 0x32, 0x08, 0x51, 0x6c, 0x8c, 0xb2, 0x46, 0x82},
+      {0xc9, 0x63, 0x69, 0x2d, 0xb4, 0x3c, 0xc3, 0xd7, 0xbe, 0x0a, 0x05, 0x77, 0xaf, 0x1e, 0xd7, 0x22},
+      {0x8e, 0x42, 0xb1, 0xc9, 0xd8, 0x28, 0x7d, 0x65, 0x2b, 0x0c, 0xf9, 0x5a, 0xca, 0xeb, 0x65, 0xc3},
+      {0x4c, 0xa2, 0xf9, 0x6a, 0xfc, 0x24, 0xe8, 0x0b, 0xa7, 0x0e, 0xad, 0x41, 0xe9, 0x47, 0xf4, 0x63},
+      {0x16, 0x07, 0x42, 0x1d, 0x21, 0x60, 0xac, 0x73, 0x64, 0x10, 0xa2, 0xd8, 0x19, 0x65, 0x8c, 0x05},
+      {0xd4, 0xe7, 0x0a, 0xbe, 0x05, 0x6c, 0x39, 0x1d, 0xe8, 0x12, 0xf6, 0xc3, 0x3a, 0xc9, 0x1d, 0xa5},
+      {0x93, 0xc6, 0xd2, 0x5a, 0x69, 0x78, 0x87, 0xaf, 0x7d, 0x14, 0x0a, 0xee, 0x5f, 0x3c, 0xaf, 0x44},
+      {0x51, 0x26, 0x9a, 0xf9, 0x4d, 0x74, 0x12, 0xc1, 0xf1, 0x16, 0x5e, 0xf5, 0x7c, 0x90, 0x3e, 0xe4},
+      {0x1d, 0x84, 0x63, 0x93, 0xb1, 0x50, 0xfa, 0xca, 0x56, 0x18, 0xf3, 0xb4, 0x95, 0xd7, 0xca, 0x87},
+      {0xdf, 0x64, 0x2b, 0x30, 0x95, 0x5c, 0x6f, 0xa4, 0xda, 0x1a, 0xa7, 0xaf, 0xb6, 0x7b, 0x5b, 0x27},
+      {0x98, 0x45, 0xf3, 0xd4, 0xf9, 0x48, 0xd1, 0x16, 0x4f, 0x1c, 0x5b, 0x82, 0xd3, 0x8e, 0xe9, 0xc6},
+      {0x5a, 0xa5, 0xbb, 0x77, 0xdd, 0x44, 0x44, 0x78, 0xc3, 0x1e, 0x0f, 0x99, 0xf0, 0x22, 0x78, 0x66},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x2c, 0x0e, 0x84, 0x3a, 0x42, 0xc0, 0x59, 0xe6, 0xc8, 0x20, 0x45, 0xb1, 0x32, 0xca, 0x19, 0x0a},
+      {0x58, 0x1c, 0x09, 0x74, 0x84, 0x81, 0xb2, 0xcd, 0x91, 0x40, 0x8a, 0x63, 0x64, 0x95, 0x32, 0x14},
+      {0x74, 0x12, 0x8d, 0x4e, 0xc6, 0x41, 0xeb, 0x2b, 0x59, 0x60, 0xcf, 0xd2, 0x56, 0x5f, 0x2b, 0x1e},
+      {0xb0, 0x38, 0x12, 0xe8, 0x09, 0x03, 0x65, 0x9b, 0x23, 0x80, 0x15, 0xc6, 0xc8, 0x2b, 0x64, 0x28},
+      {0x9c, 0x36, 0x96, 0xd2, 0x4b, 0xc3, 0x3c, 0x7d, 0xeb, 0xa0, 0x50, 0x77, 0xfa, 0xe1, 0x7d, 0x22},
+      {0xe8, 0x24, 0x1b, 0x9c, 0x8d, 0x82, 0xd7, 0x56, 0xb2, 0xc0, 0x9f, 0xa5, 0xac, 0xbe, 0x56, 0x3c},
+      {0xc4, 0x2a, 0x9f, 0xa6, 0xcf, 0x42, 0x8e, 0xb0, 0x7a, 0xe0, 0xda, 0x14, 0x9e, 0x74, 0x4f, 0x36},
+      {0x61, 0x70, 0x24, 0xd1, 0x12, 0x06, 0xca, 0x37, 0x46, 0x01, 0x2a, 0x8d, 0x91, 0x56, 0xc8, 0x50},
+      {0x4d, 0x7e, 0xa0, 0xeb, 0x50, 0xc6, 0x93, 0xd1, 0x8e, 0x21, 0x6f, 0x3c, 0xa3, 0x9c, 0xd1, 0x5a},
+      {0x39, 0x6c, 0x2d, 0xa5, 0x96, 0x87, 0x78, 0xfa, 0xd7, 0x41, 0xa0, 0xee, 0xf5, 0xc3, 0xfa, 0x44},
+      {0x15, 0x62, 0xa9, 0x9f, 0xd4, 0x47, 0x21, 0x1c, 0x1f, 0x61, 0xe5, 0x5f, 0xc7, 0x09, 0xe3, 0x4e},
+      {0xd1, 0x48, 0x36, 0x39, 0x1b, 0x05, 0xaf, 0xac, 0x65, 0x81, 0x3f, 0x4b, 0x59, 0x7d, 0xac, 0x78},
+      {0xfd, 0x46, 0xb2, 0x03, 0x59, 0xc5, 0xf6, 0x4a, 0xad, 0xa1, 0x7a, 0xfa, 0x6b, 0xb7, 0xb5, 0x72},
+      {0x89, 0x54, 0x3f, 0x4d, 0x9f, 0x84, 0x1d, 0x61, 0xf4, 0xc1, 0xb5, 0x28, 0x3d, 0xe8, 0x9e, 0x6c},
+      {0xa5, 0x5a, 0xbb, 0x77, 0xdd, 0x44, 0x44, 0x87, 0x3c, 0xe1, 0xf0, 0x99, 0x0f, 0x22, 0x87, 0x66},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x9e, 0xc2, 0xe0, 0x48, 0xa3, 0x24, 0x0c, 0x95, 0x6e, 0x8c, 0x02, 0x54, 0x1b, 0x23, 0xac, 0x91},
+      {0x3d, 0x85, 0xc1, 0x90, 0x47, 0x48, 0x18, 0x2b, 0xdc, 0x19, 0x04, 0xa8, 0x36, 0x46, 0x59, 0x23},
+      {0xa3, 0x47, 0x21, 0xd8, 0xe4, 0x6c, 0x14, 0xbe, 0xb2, 0x95, 0x06, 0xfc, 0x2d, 0x65, 0xf5, 0xb2},
+      {0x7a, 0x0b, 0x83, 0x21, 0x8e, 0x90, 0x30, 0x56, 0xb9, 0x32, 0x08, 0x51, 0x6c, 0x8c, 0xb2, 0x46},
+      {0xe4, 0xc9, 0x63, 0x69, 0x2d, 0xb4, 0x3c, 0xc3, 0xd7, 0xbe, 0x0a, 0x05, 0x77, 0xaf, 0x1e, 0xd7},
+      {0x47, 0x8e, 0x42, 0xb1, 0xc9, 0xd8, 0x28, 0x7d, 0x65, 0x2b, 0x0c, 0xf9, 0x5a, 0xca, 0xeb, 0x65},
+      {0xd9, 0x4c, 0xa2, 0xf9, 0x6a, 0xfc, 0x24, 0xe8, 0x0b, 0xa7, 0x0e, 0xad, 0x41, 0xe9, 0x47, 0xf4},
+      {0xf4, 0x16, 0x07, 0x42, 0x1d, 0x21, 0x60, 0xac, 0x73, 0x64, 0x10, 0xa2, 0xd8, 0x19, 0x65, 0x8c},
+      {0x6a, 0xd4, 0xe7, 0x0a, 0xbe, 0x05, 0x6c, 0x39, 0x1d, 0xe8, 0x12, 0xf6, 0xc3, 0x3a, 0xc9, 0x1d},
+      {0xc9, 0x93, 0xc6, 0xd2, 0x5a, 0x69, 0x78, 0x87, 0xaf, 0x7d, 0x14, 0x0a, 0xee, 0x5f, 0x3c, 0xaf},
+      {0x57, 0x51, 0x26, 0x9a, 0xf9, 0x4d, 0x74, 0x12, 0xc1, 0xf1, 0x16, 0x5e, 0xf5, 0x7c, 0x90, 0x3e},
+      {0x8e, 0x1d, 0x84, 0x63, 0x93, 0xb1, 0x50, 0xfa, 0xca, 0x56, 0x18, 0xf3, 0xb4, 0x95, 0xd7, 0xca},
+      {0x10, 0xdf, 0x64, 0x2b, 0x30, 0x95, 0x5c, 0x6f, 0xa4, 0xda, 0x1a, 0xa7, 0xaf, 0xb6, 0x7b, 0x5b},
+      {0xb3, 0x98, 0x45, 0xf3, 0xd4, 0xf9, 0x48, 0xd1, 0x16, 0x4f, 0x1c, 0x5b, 0x82, 0xd3, 0x8e, 0xe9},
+      {0x2d, 0x5a, 0xa5, 0xbb, 0x77, 0xdd, 0x44, 0x44, 0x78, 0xc3, 0x1e, 0x0f, 0x99, 0xf0, 0x22, 0x78},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0xe9, 0x2c, 0x0e, 0x84, 0x3a, 0x42, 0xc0, 0x59, 0xe6, 0xc8, 0x20, 0x45, 0xb1, 0x32, 0xca, 0x19},
+      {0xd3, 0x58, 0x1c, 0x09, 0x74, 0x84, 0x81, 0xb2, 0xcd, 0x91, 0x40, 0x8a, 0x63, 0x64, 0x95, 0x32},
+      {0x3a, 0x74, 0x12, 0x8d, 0x4e, 0xc6, 0x41, 0xeb, 0x2b, 0x59, 0x60, 0xcf, 0xd2, 0x56, 0x5f, 0x2b},
+      {0xa7, 0xb0, 0x38, 0x12, 0xe8, 0x09, 0x03, 0x65, 0x9b, 0x23, 0x80, 0x15, 0xc6, 0xc8, 0x2b, 0x64},
+      {0x4e, 0x9c, 0x36, 0x96, 0xd2, 0x4b, 0xc3, 0x3c, 0x7d, 0xeb, 0xa0, 0x50, 0x77, 0xfa, 0xe1, 0x7d},
+      {0x74, 0xe8, 0x24, 0x1b, 0x9c, 0x8d, 0x82, 0xd7, 0x56, 0xb2, 0xc0, 0x9f, 0xa5, 0xac, 0xbe, 0x56},
+      {0x9d, 0xc4, 0x2a, 0x9f, 0xa6, 0xcf, 0x42, 0x8e, 0xb0, 0x7a, 0xe0, 0xda, 0x14, 0x9e, 0x74, 0x4f},
+      {0x4f, 0x61, 0x70, 0x24, 0xd1, 0x12, 0x06, 0xca, 0x37, 0x46, 0x01, 0x2a, 0x8d, 0x91, 0x56, 0xc8},
+      {0xa6, 0x4d, 0x7e, 0xa0, 0xeb, 0x50, 0xc6, 0x93, 0xd1, 0x8e, 0x21, 0x6f, 0x3c, 0xa3, 0x9c, 0xd1},
+      {0x9c, 0x39, 0x6c, 0x2d, 0xa5, 0x96, 0x87, 0x78, 0xfa, 0xd7, 0x41, 0xa0, 0xee, 0xf5, 0xc3, 0xfa},
+      {0x75, 0x15, 0x62, 0xa9, 0x9f, 0xd4, 0x47, 0x21, 0x1c, 0x1f, 0x61, 0xe5, 0x5f, 0xc7, 0x09, 0xe3},
+      {0xe8, 0xd1, 0x48, 0x36, 0x39, 0x1b, 0x05, 0xaf, 0xac, 0x65, 0x81, 0x3f, 0x4b, 0x59, 0x7d, 0xac},
+      {0x01, 0xfd, 0x46, 0xb2, 0x03, 0x59, 0xc5, 0xf6, 0x4a, 0xad, 0xa1, 0x7a, 0xfa, 0x6b, 0xb7, 0xb5},
+      {0x3b, 0x89, 0x54, 0x3f, 0x4d, 0x9f, 0x84, 0x1d, 0x61, 0xf4, 0xc1, 0xb5, 0x28, 0x3d, 0xe8, 0x9e},
+      {0xd2, 0xa5, 0x5a, 0xbb, 0x77, 0xdd, 0x44, 0x44, 0x87, 0x3c, 0xe1, 0xf0, 0x99, 0x0f, 0x22, 0x87},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x58, 0x9e, 0xc2, 0xe0, 0x48, 0xa3, 0x24, 0x0c, 0x95, 0x6e, 0x8c, 0x02, 0x54, 0x1b, 0x23, 0xac},
+      {0xb0, 0x3d, 0x85, 0xc1, 0x90, 0x47, 0x48, 0x18, 0x2b, 0xdc, 0x19, 0x04, 0xa8, 0x36, 0x46, 0x59},
+      {0xe8, 0xa3, 0x47, 0x21, 0xd8, 0xe4, 0x6c, 0x14, 0xbe, 0xb2, 0x95, 0x06, 0xfc, 0x2d, 0x65, 0xf5},
+      {0x61, 0x7a, 0x0b, 0x83, 0x21, 0x8e, 0x90, 0x30, 0x56, 0xb9, 0x32, 0x08, 0x51, 0x6c, 0x8c, 0xb2},
+      {0x39, 0xe4, 0xc9, 0x63, 0x69, 0x2d, 0xb4, 0x3c, 0xc3, 0xd7, 0xbe, 0x0a, 0x05, 0x77, 0xaf, 0x1e},
+      {0xd1, 0x47, 0x8e, 0x42, 0xb1, 0xc9, 0xd8, 0x28, 0x7d, 0x65, 0x2b, 0x0c, 0xf9, 0x5a, 0xca, 0xeb},
+      {0x89, 0xd9, 0x4c, 0xa2, 0xf9, 0x6a, 0xfc, 0x24, 0xe8, 0x0b, 0xa7, 0x0e, 0xad, 0x41, 0xe9, 0x47},
+      {0xc2, 0xf4, 0x16, 0x07, 0x42, 0x1d, 0x21, 0x60, 0xac, 0x73, 0x64, 0x10, 0xa2, 0xd8, 0x19, 0x65},
+      {0x9a, 0x6a, 0xd4, 0xe7, 0x0a, 0xbe, 0x05, 0x6c, 0x39, 0x1d, 0xe8, 0x12, 0xf6, 0xc3, 0x3a, 0xc9},
+      {0x72, 0xc9, 0x93, 0xc6, 0xd2, 0x5a, 0x69, 0x78, 0x87, 0xaf, 0x7d, 0x14, 0x0a, 0xee, 0x5f, 0x3c},
+      {0x2a, 0x57, 0x51, 0x26, 0x9a, 0xf9, 0x4d, 0x74, 0x12, 0xc1, 0xf1, 0x16, 0x5e, 0xf5, 0x7c, 0x90},
+      {0xa3, 0x8e, 0x1d, 0x84, 0x63, 0x93, 0xb1, 0x50, 0xfa, 0xca, 0x56, 0x18, 0xf3, 0xb4, 0x95, 0xd7},
+      {0xfb, 0x10, 0xdf, 0x64, 0x2b, 0x30, 0x95, 0x5c, 0x6f, 0xa4, 0xda, 0x1a, 0xa7, 0xaf, 0xb6, 0x7b},
+      {0x13, 0xb3, 0x98, 0x45, 0xf3, 0xd4, 0xf9, 0x48, 0xd1, 0x16, 0x4f, 0x1c, 0x5b, 0x82, 0xd3, 0x8e},
+      {0x4b, 0x2d, 0x5a, 0xa5, 0xbb, 0x77, 0xdd, 0x44, 0x44, 0x78, 0xc3, 0x1e, 0x0f, 0x99, 0xf0, 0x22},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x85, 0xe9, 0x2c, 0x0e, 0x84, 0x3a, 0x42, 0xc0, 0x59, 0xe6, 0xc8, 0x20, 0x45, 0xb1, 0x32, 0xca},
+      {0x0b, 0xd3, 0x58, 0x1c, 0x09, 0x74, 0x84, 0x81, 0xb2, 0xcd, 0x91, 0x40, 0x8a, 0x63, 0x64, 0x95},
+      {0x8e, 0x3a, 0x74, 0x12, 0x8d, 0x4e, 0xc6, 0x41, 0xeb, 0x2b, 0x59, 0x60, 0xcf, 0xd2, 0x56, 0x5f},
+      {0x16, 0xa7, 0xb0, 0x38, 0x12, 0xe8, 0x09, 0x03, 0x65, 0x9b, 0x23, 0x80, 0x15, 0xc6, 0xc8, 0x2b},
+      {0x93, 0x4e, 0x9c, 0x36, 0x96, 0xd2, 0x4b, 0xc3, 0x3c, 0x7d, 0xeb, 0xa0, 0x50, 0x77, 0xfa, 0xe1},
+      {0x1d, 0x74, 0xe8, 0x24, 0x1b, 0x9c, 0x8d, 0x82, 0xd7, 0x56, 0xb2, 0xc0, 0x9f, 0xa5, 0xac, 0xbe},
+      {0x98, 0x9d, 0xc4, 0x2a, 0x9f, 0xa6, 0xcf, 0x42, 0x8e, 0xb0, 0x7a, 0xe0, 0xda, 0x14, 0x9e, 0x74},
+      {0x2c, 0x4f, 0x61, 0x70, 0x24, 0xd1, 0x12, 0x06, 0xca, 0x37, 0x46, 0x01, 0x2a, 0x8d, 0x91, 0x56},
+      {0xa9, 0xa6, 0x4d, 0x7e, 0xa0, 0xeb, 0x50, 0xc6, 0x93, 0xd1, 0x8e, 0x21, 0x6f, 0x3c, 0xa3, 0x9c},
+      {0x27, 0x9c, 0x39, 0x6c, 0x2d, 0xa5, 0x96, 0x87, 0x78, 0xfa, 0xd7, 0x41, 0xa0, 0xee, 0xf5, 0xc3},
+      {0xa2, 0x75, 0x15, 0x62, 0xa9, 0x9f, 0xd4, 0x47, 0x21, 0x1c, 0x1f, 0x61, 0xe5, 0x5f, 0xc7, 0x09},
+      {0x3a, 0xe8, 0xd1, 0x48, 0x36, 0x39, 0x1b, 0x05, 0xaf, 0xac, 0x65, 0x81, 0x3f, 0x4b, 0x59, 0x7d},
+      {0xbf, 0x01, 0xfd, 0x46, 0xb2, 0x03, 0x59, 0xc5, 0xf6, 0x4a, 0xad, 0xa1, 0x7a, 0xfa, 0x6b, 0xb7},
+      {0x31, 0x3b, 0x89, 0x54, 0x3f, 0x4d, 0x9f, 0x84, 0x1d, 0x61, 0xf4, 0xc1, 0xb5, 0x28, 0x3d, 0xe8},
+      {0xb4, 0xd2, 0xa5, 0x5a, 0xbb, 0x77, 0xdd, 0x44, 0x44, 0x87, 0x3c, 0xe1, 0xf0, 0x99, 0x0f, 0x22},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0xc0, 0x40, 0x96, 0x10, 0xe2, 0x14, 0x21, 0x00, 0x0c, 0x14, 0xec, 0x11, 0x20, 0x50, 0x11, 0x01},
+      {0x81, 0x80, 0x2d, 0x20, 0xc5, 0x28, 0x42, 0x00, 0x18, 0x28, 0xd9, 0x22, 0x40, 0xa0, 0x22, 0x02},
+      {0x41, 0xc0, 0xbb, 0x30, 0x27, 0x3c, 0x63, 0x00, 0x14, 0x3c, 0x35, 0x33, 0x60, 0xf0, 0x33, 0x03},
+      {0x03, 0x01, 0x5a, 0x40, 0x8b, 0x50, 0x84, 0x00, 0x30, 0x50, 0xb3, 0x44, 0x80, 0x41, 0x44, 0x04},
+      {0xc3, 0x41, 0xcc, 0x50, 0x69, 0x44, 0xa5, 0x00, 0x3c, 0x44, 0x5f, 0x55, 0xa0, 0x11, 0x55, 0x05},
+      {0x82, 0x81, 0x77, 0x60, 0x4e, 0x78, 0xc6, 0x00, 0x28, 0x78, 0x6a, 0x66, 0xc0, 0xe1, 0x66, 0x06},
+      {0x42, 0xc1, 0xe1, 0x70, 0xac, 0x6c, 0xe7, 0x00, 0x24, 0x6c, 0x86, 0x77, 0xe0, 0xb1, 0x77, 0x07},
+      {0x06, 0x02, 0xb4, 0x80, 0x17, 0xa0, 0x09, 0x00, 0x60, 0xa0, 0x67, 0x88, 0x01, 0x82, 0x88, 0x08},
+      {0xc6, 0x42, 0x22, 0x90, 0xf5, 0xb4, 0x28, 0x00, 0x6c, 0xb4, 0x8b, 0x99, 0x21, 0xd2, 0x99, 0x09},
+      {0x87, 0x82, 0x99, 0xa0, 0xd2, 0x88, 0x4b, 0x00, 0x78, 0x88, 0xbe, 0xaa, 0x41, 0x22, 0xaa, 0x0a},
+      {0x47, 0xc2, 0x0f, 0xb0, 0x30, 0x9c, 0x6a, 0x00, 0x74, 0x9c, 0x52, 0xbb, 0x61, 0x72, 0xbb, 0x0b},
+      {0x05, 0x03, 0xee, 0xc0, 0x9c, 0xf0, 0x8d, 0x00, 0x50, 0xf0, 0xd4, 0xcc, 0x81, 0xc3, 0xcc, 0x0c},
+      {0xc5, 0x43, 0x78, 0xd0, 0x7e, 0xe4, 0xac, 0x00, 0x5c, 0xe4, 0x38, 0xdd, 0xa1, 0x93, 0xdd, 0x0d},
+      {0x84, 0x83, 0xc3, 0xe0, 0x59, 0xd8, 0xcf, 0x00, 0x48, 0xd8, 0x0d, 0xee, 0xc1, 0x63, 0xee, 0x0e},
+      {0x44, 0xc3, 0x55, 0xf0, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0xe1, 0xff, 0xe1, 0x33, 0xff, 0x0f},
+   },
+   {
+      {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+      {0x0c, 0x04, 0x69, 0x01, 0x2e, 0x41, 0x12, 0x00, 0xc0, 0x41, 0xce, 0x11, 0x02, 0x05, 0x11, 0x10},
+      {0x18, 0x08, 0xd2, 0x02, 0x5c, 0x82, 0x24, 0x00, 0x81, 0x82, 0x9d, 0x22, 0x04, 0x0a, 0x22, 0x20},
+      {0x14, 0x0c, 0xbb, 0x03, 0x72, 0xc3, 0x36, 0x00, 0x41, 0xc3, 0x53, 0x33, 0x06, 0x0f, 0x33, 0x30},
+      {0x30, 0x10, 0xa5, 0x04, 0xb8, 0x05, 0x48, 0x00, 0x03, 0x05, 0x3b, 0x44, 0x08, 0x14, 0x44, 0x40},
+      {0x3c, 0x14, 0xcc, 0x05, 0x96, 0x44, 0x5a, 0x00, 0xc3, 0x44, 0xf5, 0x55, 0x0a, 0x11, 0x55, 0x50},
+      {0x28, 0x18, 0x77, 0x06, 0xe4, 0x87, 0x6c, 0x00, 0x82, 0x87, 0xa6, 0x66, 0x0c, 0x1e, 0x66, 0x60},
+      {0x24, 0x1c, 0x1e, 0x07, 0xca, 0xc6, 0x7e, 0x00, 0x42, 0xc6, 0x68, 0x77, 0x0e, 0x1b, 0x77, 0x70},
+      {0x60, 0x20, 0x4b, 0x08, 0x71, 0x0a, 0x90, 0x00, 0x06, 0x0a, 0x76, 0x88, 0x10, 0x28, 0x88, 0x80},
+      {0x6c, 0x24, 0x22, 0x09, 0x5f, 0x4b, 0x82, 0x00, 0xc6, 0x4b, 0xb8, 0x99, 0x12, 0x2d, 0x99, 0x90},
+      {0x78, 0x28, 0x99, 0x0a, 0x2d, 0x88, 0xb4, 0x00, 0x87, 0x88, 0xeb, 0xaa, 0x14, 0x22, 0xaa, 0xa0},
+      {0x74, 0x2c, 0xf0, 0x0b, 0x03, 0xc9, 0xa6, 0x00, 0x47, 0xc9, 0x25, 0xbb, 0x16, 0x27, 0xbb, 0xb0},
+      {0x50, 0x30, 0xee, 0x0c, 0xc9, 0x0f, 0xd8, 0x00, 0x05, 0x0f, 0x4d, 0xcc, 0x18, 0x3c, 0xcc, 0xc0},
+      {0x5c, 0x34, 0x87, 0x0d, 0xe7, 0x4e, 0xca, 0x00, 0xc5, 0x4e, 0x83, 0xdd, 0x1a, 0x39, 0xdd, 0xd0},
+      {0x48, 0x38, 0x3c, 0x0e, 0x95, 0x8d, 0xfc, 0x00, 0x84, 0x8d, 0xd0, 0xee, 0x1c, 0x36, 0xee, 0xe0},
+      {0x44, 0x3c, 0x55, 0x0f, 0xbb, 0xcc, 0xee, 0x00, 0x44, 0xcc, 0x1e, 0xff, 0x1e, 0x33, 0xff, 0xf0},
+   },
+};
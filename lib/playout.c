@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+
+#include "playout.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+// Frames per window of the lowest transit, a few seconds at the frame rates of a mirror
+#define PLAYOUT_WINDOW_FRAMES 256
+// Margin in mean deviations, enough to cover most of the bursts of a Wi-Fi link
+#define PLAYOUT_JITTER_MULTIPLE 4
+
+void
+playout_init(playout_t *playout, int max_delay_ms)
+{
+    playout->max_delay = max_delay_ms > 0 ? (int64_t) max_delay_ms * 1000 : 0;
+    playout_reset(playout);
+}
+
+void
+playout_reset(playout_t *playout)
+{
+    playout->window_min = INT64_MAX;
+    playout->previous_min = INT64_MAX;
+    playout->window_frames = 0;
+    playout->last_transit = 0;
+    playout->jitter = 0;
+    playout->last_release = 0;
+    playout->frames = 0;
+}
+
+uint64_t
+playout_schedule(playout_t *playout, uint64_t pts, uint64_t arrival)
+{
+    int64_t transit = (int64_t) arrival - (int64_t) pts;
+    if (playout->frames++ > 0) {
+        int64_t deviation = llabs(transit - playout->last_transit);
+        playout->jitter += (deviation - playout->jitter) / 16;
+    }
+    playout->last_transit = transit;
+
+    // The lowest transit follows clock drift and route changes within two windows
+    if (transit < playout->window_min) {
+        playout->window_min = transit;
+    }
+    if (++playout->window_frames == PLAYOUT_WINDOW_FRAMES) {
+        playout->previous_min = playout->window_min;
+        playout->window_min = INT64_MAX;
+        playout->window_frames = 0;
+    }
+    int64_t base = playout->window_min < playout->previous_min ? playout->window_min : playout->previous_min;
+    if (base == INT64_MAX) {
+        base = transit;
+    }
+
+    uint64_t release = pts + base + playout_get_margin(playout);
+    if (release < playout->last_release) {
+        release = playout->last_release;
+    }
+    playout->last_release = release;
+    return release;
+}
+
+int64_t
+playout_get_margin(const playout_t *playout)
+{
+    int64_t margin = PLAYOUT_JITTER_MULTIPLE * playout->jitter;
+    return margin < playout->max_delay ? margin : playout->max_delay;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+
+#ifndef PLAYOUT_H
+#define PLAYOUT_H
+
+#include <stdint.h>
+
+/*
+ * Adaptive playout delay for mirror frames. The sender timestamps frames on a steady cadence,
+ * but over Wi-Fi they arrive in bursts. Holding every frame until its pts plus the transit time
+ * of an unqueued frame plus a margin for the jitter seen lately restores the sender's cadence,
+ * with no more delay than the network calls for. The jitter is estimated as in RFC 3550.
+ *
+ * A playout_t has a single user thread and never allocates.
+ */
+typedef struct playout_s {
+    int64_t max_delay;
+    // Lowest transit (arrival minus pts) of the current and the previous window of frames
+    int64_t window_min;
+    int64_t previous_min;
+    int window_frames;
+    int64_t last_transit;
+    int64_t jitter;
+    uint64_t last_release;
+    int frames;
+} playout_t;
+
+/* max_delay_ms caps the margin for jitter, 0 disables the playout delay */
+void playout_init(playout_t *playout, int max_delay_ms);
+/* Forgets the stream so far, for a new stream or after a gap */
+void playout_reset(playout_t *playout);
+/* Local time the frame should be released at, never before that of the frame before it */
+uint64_t playout_schedule(playout_t *playout, uint64_t pts, uint64_t arrival);
+/* Current margin for jitter in micro seconds */
+int64_t playout_get_margin(const playout_t *playout);
+
+#endif //PLAYOUT_H
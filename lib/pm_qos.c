@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "pm_qos.h"
+
+#ifdef __linux__
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glob.h>
+
+#include "threads.h"
+
+#define PM_QOS_LATENCY_PATH "/dev/cpu_dma_latency"
+#define PM_QOS_POLICY_PATTERN "/sys/devices/system/cpu/cpufreq/policy*"
+
+typedef struct pm_qos_policy_s {
+    char path[128];
+    // kHz, scaling_min_freq before the floor was raised, 0 while it is not
+    long saved_min;
+} pm_qos_policy_t;
+
+struct pm_qos_s {
+    logger_t *logger;
+    int latency_us;
+    int floor_percent;
+
+    mutex_handle_t mutex;
+    int sessions;
+    int latency_fd;
+    pm_qos_policy_t policies[PM_QOS_MAX_POLICIES];
+    int policy_count;
+    // Warned once that the hints cannot be held, the next sessions stay quiet about it
+    int warned;
+};
+
+static int
+pm_qos_read_khz(const char *policy, const char *name, long *value)
+{
+    char path[192];
+    char text[32];
+    snprintf(path, sizeof(path), "%s/%s", policy, name);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    int ret = fgets(text, sizeof(text), file) ? 0 : -1;
+    fclose(file);
+    if (ret == 0) {
+        char *end;
+        *value = strtol(text, &end, 10);
+        if (end == text) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static int
+pm_qos_write_khz(const char *policy, const char *name, long value)
+{
+    char path[192];
+    snprintf(path, sizeof(path), "%s/%s", policy, name);
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+    int ret = fprintf(file, "%ld\n", value) > 0 ? 0 : -1;
+    if (fclose(file) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+/* Raises the minimum clock of every policy, returns how many took it */
+static int
+pm_qos_raise_floor(pm_qos_t *pm_qos)
+{
+    int raised = 0;
+    for (int i = 0; i < pm_qos->policy_count; i++) {
+        pm_qos_policy_t *policy = &pm_qos->policies[i];
+        long saved_min, max, limit;
+        if (pm_qos_read_khz(policy->path, "scaling_min_freq", &saved_min) < 0 ||
+            pm_qos_read_khz(policy->path, "cpuinfo_max_freq", &max) < 0 ||
+            pm_qos_read_khz(policy->path, "scaling_max_freq", &limit) < 0) {
+            continue;
+        }
+        long floor = max / 100 * pm_qos->floor_percent;
+        if (floor > limit) {
+            floor = limit;
+        }
+        if (floor <= saved_min) {
+            continue;
+        }
+        if (pm_qos_write_khz(policy->path, "scaling_min_freq", floor) < 0) {
+            continue;
+        }
+        policy->saved_min = saved_min;
+        raised++;
+        logger_log(pm_qos->logger, LOGGER_DEBUG, "Raised the clock floor of %s from %ld to %ld kHz", policy->path,
+                   saved_min, floor);
+    }
+    return raised;
+}
+
+static void
+pm_qos_restore_floor(pm_qos_t *pm_qos)
+{
+    for (int i = 0; i < pm_qos->policy_count; i++) {
+        pm_qos_policy_t *policy = &pm_qos->policies[i];
+        if (policy->saved_min && pm_qos_write_khz(policy->path, "scaling_min_freq", policy->saved_min) < 0) {
+            logger_log(pm_qos->logger, LOGGER_WARNING, "Could not restore the clock floor of %s to %ld kHz",
+                       policy->path, policy->saved_min);
+        }
+        policy->saved_min = 0;
+    }
+}
+
+/* With the mutex held, as the first session starts */
+static void
+pm_qos_hold(pm_qos_t *pm_qos)
+{
+    const char *failed = NULL;
+    int error = 0;
+    // The kernel keeps the request as long as the file stays open
+    int32_t value = pm_qos->latency_us;
+    pm_qos->latency_fd = open(PM_QOS_LATENCY_PATH, O_WRONLY | O_CLOEXEC);
+    if (pm_qos->latency_fd < 0 || write(pm_qos->latency_fd, &value, sizeof(value)) != sizeof(value)) {
+        error = errno;
+        failed = "a CPU latency request";
+        if (pm_qos->latency_fd >= 0) {
+            close(pm_qos->latency_fd);
+            pm_qos->latency_fd = -1;
+        }
+    }
+    if (pm_qos->floor_percent > 0 && pm_qos->policy_count && !pm_qos_raise_floor(pm_qos) && !failed) {
+        error = errno;
+        failed = "a higher CPU clock floor";
+    }
+    if (failed && !pm_qos->warned) {
+        pm_qos->warned = 1;
+        logger_log(pm_qos->logger, LOGGER_WARNING, "Could not hold %s while streaming: %s, this needs root",
+                   failed, strerror(error));
+    }
+}
+
+static void
+pm_qos_release(pm_qos_t *pm_qos)
+{
+    if (pm_qos->latency_fd >= 0) {
+        close(pm_qos->latency_fd);
+        pm_qos->latency_fd = -1;
+    }
+    pm_qos_restore_floor(pm_qos);
+}
+
+pm_qos_t *
+pm_qos_init(logger_t *logger, int latency_us, int floor_percent)
+{
+    pm_qos_t *pm_qos = calloc(1, sizeof(pm_qos_t));
+    if (!pm_qos) {
+        return NULL;
+    }
+    pm_qos->logger = logger;
+    pm_qos->latency_us = latency_us;
+    pm_qos->floor_percent = floor_percent > 100 ? 100 : floor_percent;
+    pm_qos->latency_fd = -1;
+
+    if (pm_qos->floor_percent > 0) {
+        glob_t policies;
+        if (glob(PM_QOS_POLICY_PATTERN, 0, NULL, &policies) == 0) {
+            for (size_t i = 0; i < policies.gl_pathc && pm_qos->policy_count < PM_QOS_MAX_POLICIES; i++) {
+                snprintf(pm_qos->policies[pm_qos->policy_count++].path, sizeof(pm_qos->policies[0].path), "%s",
+                         policies.gl_pathv[i]);
+            }
+            globfree(&policies);
+        }
+        if (!pm_qos->policy_count) {
+            logger_log(logger, LOGGER_WARNING, "Found no cpufreq policies to raise the clock floor of");
+        }
+    }
+    MUTEX_CREATE(pm_qos->mutex);
+    logger_log(logger, LOGGER_DEBUG, "Holding a CPU latency of %d us and a clock floor of %d%% while streaming",
+               latency_us, pm_qos->floor_percent);
+    return pm_qos;
+}
+
+void
+pm_qos_destroy(pm_qos_t *pm_qos)
+{
+    if (!pm_qos) {
+        return;
+    }
+    if (pm_qos->sessions) {
+        pm_qos_release(pm_qos);
+    }
+    MUTEX_DESTROY(pm_qos->mutex);
+    free(pm_qos);
+}
+
+void
+pm_qos_session_start(pm_qos_t *pm_qos)
+{
+    if (!pm_qos) {
+        return;
+    }
+    MUTEX_LOCK(pm_qos->mutex);
+    if (pm_qos->sessions++ == 0) {
+        pm_qos_hold(pm_qos);
+    }
+    MUTEX_UNLOCK(pm_qos->mutex);
+}
+
+void
+pm_qos_session_end(pm_qos_t *pm_qos)
+{
+    if (!pm_qos) {
+        return;
+    }
+    MUTEX_LOCK(pm_qos->mutex);
+    if (pm_qos->sessions > 0 && --pm_qos->sessions == 0) {
+        pm_qos_release(pm_qos);
+    }
+    MUTEX_UNLOCK(pm_qos->mutex);
+}
+
+#else
+
+pm_qos_t *
+pm_qos_init(logger_t *logger, int latency_us, int floor_percent)
+{
+    logger_log(logger, LOGGER_DEBUG, "CPU latency requests need Linux");
+    return NULL;
+}
+
+void
+pm_qos_destroy(pm_qos_t *pm_qos)
+{
+}
+
+void
+pm_qos_session_start(pm_qos_t *pm_qos)
+{
+}
+
+void
+pm_qos_session_end(pm_qos_t *pm_qos)
+{
+}
+
+#endif
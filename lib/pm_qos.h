@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef PM_QOS_H
+#define PM_QOS_H
+
+#include "logger.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Keeps the CPU responsive while sessions stream and lets it save power in between. With
+ * ondemand or schedutil the cores idle at their lowest clock and in their deepest C-states,
+ * so every session starts with the cores clocking up, and every wakeup of a network thread
+ * pays the exit latency of the C-state it slept in.
+ *
+ * From the first session until the last one ended, a PM QoS request on /dev/cpu_dma_latency
+ * keeps the cores out of C-states that take longer than latency_us to wake from, and with a
+ * floor_percent the minimum clock of every cpufreq policy is raised to that share of its
+ * maximum, never above the policy's current maximum. Both need root; without it rpiplay
+ * warns once and carries on. The request ends with its file descriptor, even if rpiplay
+ * crashes, but a raised floor stays until it is restored. Linux only.
+ */
+typedef struct pm_qos_s pm_qos_t;
+
+#define PM_QOS_DEFAULT_LATENCY_US 100
+#define PM_QOS_MAX_POLICIES 16
+
+/* floor_percent 0 leaves the clocks alone */
+pm_qos_t *pm_qos_init(logger_t *logger, int latency_us, int floor_percent);
+/* Ends what is still held */
+void pm_qos_destroy(pm_qos_t *pm_qos);
+
+/* Counted from any thread, the hints hold from the first start until the matching last end */
+void pm_qos_session_start(pm_qos_t *pm_qos);
+void pm_qos_session_end(pm_qos_t *pm_qos);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //PM_QOS_H
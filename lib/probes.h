@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * USDT probes on the hot paths, for tracing a running receiver with bpftrace or perf, e.g.
+ *   bpftrace -e 'usdt:/usr/local/bin/rpiplay:rpiplay:mirror_render_submit { @[arg1 / 1024] = count(); }'
+ *
+ * A probe compiles to a single nop and a note in the ELF file, the arguments are only read
+ * once a tracer attached. Without sys/sdt.h, from systemtap-sdt-dev, there is only the nop
+ * missing. Either way every probe also goes into the flight recorder, which needs a name of
+ * FLIGHT_RECORDER_EVENTS for it. All times are in micro seconds, as raop_ntp_get_local_time;
+ * the probes are:
+ *
+ *   mirror_frame_receive    pts, payload bytes, arrival time
+ *   mirror_decrypt_done     pts, payload bytes, time
+ *   mirror_rewrite_done     pts, frame bytes, NAL units
+ *   mirror_render_submit    pts, frame bytes, time spent queued
+ *   audio_enqueue           seqnum, payload bytes, play time
+ *   audio_dequeue           seqnum, payload bytes or -1 if lost, play time
+ *   audio_resend_request    first seqnum, count
+ *   audio_sync              rtp time, remote time, local time
+ *   ntp_sample              local time, offset, round trip delay
+ *   omx_video_submit        pts, bytes, OMX flags
+ *   omx_video_return        input buffers owned by the client
+ *   omx_audio_submit        pts, bytes
+ *   omx_audio_return        pts of the batch the buffer starts
+ */
+
+#include "flight_recorder.h"
+
+#if defined(HAVE_SYS_SDT_H)
+#include <sys/sdt.h>
+#define PROBE_USDT3(name, a, b, c) DTRACE_PROBE3(rpiplay, name, a, b, c)
+#else
+#define PROBE_USDT3(name, a, b, c) do { } while (0)
+#endif
+
+/* The arguments are evaluated once, they must be integers */
+#define PROBE3(name, a, b, c) do { \
+        int64_t probe_a = (int64_t) (a), probe_b = (int64_t) (b), probe_c = (int64_t) (c); \
+        PROBE_USDT3(name, probe_a, probe_b, probe_c); \
+        flight_recorder_record(FLIGHT_RECORDER_EVENT_##name, probe_a, probe_b, probe_c); \
+    } while (0)
+#define PROBE2(name, a, b) PROBE3(name, a, b, 0)
+#define PROBE1(name, a) PROBE3(name, a, 0, 0)
+
+#endif //PROBES_H
@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #include "raop.h"
 #include "raop_rtp.h"
@@ -30,6 +31,38 @@
 #include "compat.h"
 #include "raop_rtp_mirror.h"
 #include "raop_ntp.h"
+#include "raop_ptp.h"
+#include "raop_buffered.h"
+#include "raop_buffer.h"
+#include "metrics.h"
+#include "mem_account.h"
+#include "trace.h"
+#include "audio_format.h"
+
+#define RAOP_DISPLAY_DEFAULT_WIDTH 1920
+#define RAOP_DISPLAY_DEFAULT_HEIGHT 1080
+#define RAOP_DISPLAY_DEFAULT_REFRESH_RATE 60
+/* Most a throttled receiver advertises, the decoder keeps up with 720p30 even at reduced clocks */
+#define RAOP_DISPLAY_PRESSURE_WIDTH 1280
+#define RAOP_DISPLAY_PRESSURE_HEIGHT 720
+#define RAOP_DISPLAY_PRESSURE_REFRESH_RATE 30
+
+/* Least decode load in pixels per second a mirror is admitted with, 640x360 at 30 Hz */
+#define RAOP_DECODE_MIN_LOAD (640ull * 360 * 30)
+/* Refresh rate and then heights GET /info steps down through to fit the decoder capacity left */
+#define RAOP_DISPLAY_BUDGET_REFRESH_RATE 30
+static const int raop_display_budget_heights[] = { 1080, 900, 720, 540, 360 };
+/* PCM, ALAC, AAC-LC and stereo AAC-ELD in every rate and sample size */
+#define RAOP_AUDIO_FORMATS_DEFAULT 0x3fffffcull
+/* Senders whose clock estimate is kept for their next session, and for how long it is any good */
+#define RAOP_CLOCK_CACHE_SIZE 8
+#define RAOP_CLOCK_CACHE_MAX_AGE (120ull * 1000000)
+
+typedef struct raop_clock_cache_entry_s {
+    char device_id[32];     /* Empty for a free entry */
+    int ptp;                /* The estimate is of the sender's PTP clock rather than its NTP one */
+    raop_ntp_estimate_t estimate;
+} raop_clock_cache_entry_t;
 
 struct raop_s {
     /* Callbacks for audio and video */
@@ -45,27 +78,403 @@ struct raop_s {
     dnssd_t *dnssd;
 
     unsigned short port;
+
+    /* Ceiling for the adaptive audio jitter buffer, in packets */
+    int audio_buffer_length;
+
+    /* Decrypted video frames queued for the renderer, per session */
+    int video_queue_depth;
+
+    /* Frames later than this many milli seconds get dropped, 0 renders every frame */
+    int video_latency_budget;
+    int video_playout_delay;
+    genlock_t *genlock;
+
+    /* Mirror data socket tuning, 0 keeps the system defaults */
+    int mirror_receive_buffer;
+    int mirror_busy_poll;
+
+    /* Bounds of the adaptive NTP polling interval in milli seconds, 0 keeps the raop_ntp default */
+    int ntp_poll_min;
+    int ntp_poll_max;
+
+    /* Display advertised in GET /info, senders encode the mirror to fit it */
+    int display_width;
+    int display_height;
+    double display_refresh_rate;
+
+    /* Set from any thread while the device is throttled, GET /info then advertises less */
+    int thermal_pressure;
+
+    /*
+     * Pixels per second the decoder keeps up with, shared by the admitted mirrors in
+     * decode_conns, oldest first, see conn_admit_video. decode_host is the raop whose
+     * accounting this one uses, itself unless it was given a host.
+     */
+    raop_t *decode_host;
+    uint64_t decode_capacity;
+    int decode_preempt;
+    mutex_handle_t decode_mutex;
+    struct raop_conn_s *decode_conns;
+
+    /* Micro seconds after its pts the renderer plays audio, set from any thread, advertised in GET /info */
+    int audio_output_latency;
+
+    /* AirPlay audioFormat bits advertised in GET /info and accepted in SETUP */
+    uint64_t audio_formats;
+
+    /* Seconds of audio a buffered stream queues, 0 does not offer buffered audio */
+    int buffered_audio_seconds;
+
+    /* Senders may mirror in H.265 */
+    int hevc;
+
+    /* Audio sessions send RTCP receiver reports to the sender */
+    int receiver_reports;
+
+    /* Seconds without a sign of the sender after which a session is closed, 0 never closes one, set from any thread */
+    int idle_timeout;
+
+    /* Where the clocks of the senders last stood, keyed by their deviceID, see conn_seed_clock */
+    raop_clock_cache_entry_t clock_cache[RAOP_CLOCK_CACHE_SIZE];
+    mutex_handle_t clock_cache_mutex;
+
+    /* Optional Prometheus endpoint, only created if a port was set */
+    metrics_server_t *metrics_server;
+    unsigned short metrics_port;
+
+    /* Optional trace of the received streams, recorded from raop_start until raop_destroy */
+    char *trace_path;
+    uint64_t trace_size;
+
+    /* Serialized GET /info reply and the inputs it was built from, see raop_handler_info */
+    char *info_data;
+    uint32_t info_datalen;
+    char *info_key;
+    int info_key_len;
+    int info_display_width;
+    int info_display_height;
+    double info_display_refresh_rate;
+    int info_audio_output_latency;
 };
 
+/* Photos a connection keeps for a slideshow, the current one and those sent ahead of it */
+#define RAOP_PHOTO_CACHE_SIZE 4
+
+typedef struct raop_photo_s {
+    char key[64];
+    unsigned char *data;
+    int size;
+} raop_photo_t;
+
 struct raop_conn_s {
     raop_t *raop;
+    /* Copy of the server callbacks with cls set to this connection's context */
+    raop_callbacks_t callbacks;
     raop_ntp_t *raop_ntp;
+    /* Feeds raop_ntp instead of its own NTP client when the sender asked for PTP timing */
+    raop_ptp_t *raop_ptp;
     raop_rtp_t *raop_rtp;
+    /* Takes the audio instead of raop_rtp when the sender set up a buffered stream */
+    raop_buffered_t *raop_buffered;
     raop_rtp_mirror_t *raop_rtp_mirror;
+    /* Set while the server's video_start holds a renderer for the mirror stream */
+    int video_started;
+    /*
+     * Set while the mirror is charged against the decoder capacity, with what it was admitted
+     * with until its own load is measured. Preempted is set from another connection's SETUP,
+     * conn_is_idle then closes this one.
+     */
+    int decode_admitted;
+    uint64_t decode_reserved;
+    int decode_preempted;
+    struct raop_conn_s *decode_next;
+    /*
+     * Set by the first request other than GET /info, see conn_open. Until then the connection
+     * is a probe, which the server's callbacks never hear of and httpd may close for another.
+     */
+    int opened;
+    /* What the connection and its streams hold is charged to this session once opened, see mem_account.h */
+    int mem_session;
+    /* Requests answered, and the sum of the counters conn_is_idle watches when it last moved and since when */
+    unsigned int requests;
+    unsigned int activity;
+    uint64_t active_since;
+    /* deviceID of the sender from the first SETUP, empty if it sent none, and the clock it is timed by */
+    char device_id[32];
+    int timing_ptp;
+    /* Made by the first request that needs them, see conn_get_fairplay and conn_get_pairing */
     fairplay_t *fairplay;
     pairing_session_t *pairing;
 
-    unsigned char *local;
+    /* Photos the sender sent ahead with X-Apple-AssetAction: cacheOnly, see raop_handler_photo */
+    raop_photo_t photos[RAOP_PHOTO_CACHE_SIZE];
+    int next_photo;
+
+    unsigned char local[16];
     int locallen;
 
-    unsigned char *remote;
+    unsigned char remote[16];
     int remotelen;
 
 };
 typedef struct raop_conn_s raop_conn_t;
 
+/* Pixels per second a sender mirroring the display of raop asks the decoder for */
+static uint64_t
+raop_display_load(raop_t *raop) {
+    return (uint64_t) ((double) raop->display_width * raop->display_height * raop->display_refresh_rate);
+}
+
+/* What an admitted mirror is charged, with the decode_mutex of its host held */
+static uint64_t
+conn_decode_load(raop_conn_t *conn) {
+    raop_rtp_mirror_stats_t stats;
+    raop_rtp_mirror_get_stats(conn->raop_rtp_mirror, &stats);
+    return stats.pixel_rate ? stats.pixel_rate : conn->decode_reserved;
+}
+
+/* Decoder capacity the admitted mirrors leave, with the decode_mutex of host held */
+static uint64_t
+raop_decode_remaining_locked(raop_t *host) {
+    uint64_t used = 0;
+    for (raop_conn_t *conn = host->decode_conns; conn; conn = conn->decode_next) {
+        if (!ATOMIC_LOAD(conn->decode_preempted)) {
+            used += conn_decode_load(conn);
+        }
+    }
+    return used < host->decode_capacity ? host->decode_capacity - used : 0;
+}
+
+/* Decoder capacity a new mirror would get, UINT64_MAX without a limit */
+static uint64_t
+raop_decode_remaining(raop_t *raop) {
+    raop_t *host = raop->decode_host;
+    if (!host->decode_capacity) {
+        return UINT64_MAX;
+    }
+    MUTEX_LOCK(host->decode_mutex);
+    uint64_t remaining = raop_decode_remaining_locked(host);
+    MUTEX_UNLOCK(host->decode_mutex);
+    return remaining;
+}
+
+/*
+ * Rather than have every mirror degrade once the decoder falls behind, a new one is only
+ * admitted if enough of the decoder capacity is left for it. Senders asked GET /info for a
+ * display that fits what was left, which it is charged until its frames tell what it asks
+ * for. With too little left it is refused, or if the server preempts, the oldest mirrors
+ * are closed until it gets the whole display. Called before the mirror thread starts.
+ */
+static int
+conn_admit_video(raop_conn_t *conn) {
+    raop_t *host = conn->raop->decode_host;
+    if (!host->decode_capacity || conn->decode_admitted) {
+        return 1;
+    }
+
+    uint64_t wanted = raop_display_load(conn->raop);
+    MUTEX_LOCK(host->decode_mutex);
+    uint64_t remaining = raop_decode_remaining_locked(host);
+    if (remaining < RAOP_DECODE_MIN_LOAD && host->decode_preempt) {
+        for (raop_conn_t *oldest = host->decode_conns; oldest && remaining < wanted; oldest = oldest->decode_next) {
+            if (ATOMIC_LOAD(oldest->decode_preempted)) {
+                continue;
+            }
+            remaining += conn_decode_load(oldest);
+            ATOMIC_STORE(oldest->decode_preempted, 1);
+            logger_log(conn->raop->logger, LOGGER_INFO, "Preempting an older mirror to make room for a new one");
+        }
+        if (remaining > host->decode_capacity) {
+            remaining = host->decode_capacity;
+        }
+    }
+    if (remaining >= RAOP_DECODE_MIN_LOAD) {
+        conn->decode_reserved = remaining < wanted ? remaining : wanted;
+        conn->decode_admitted = 1;
+        raop_conn_t **tail = &host->decode_conns;
+        while (*tail) {
+            tail = &(*tail)->decode_next;
+        }
+        *tail = conn;
+    }
+    MUTEX_UNLOCK(host->decode_mutex);
+
+    if (!conn->decode_admitted) {
+        logger_log(conn->raop->logger, LOGGER_WARNING, "Refusing the mirror, the decoder has %llu of %llu pixels per second left",
+                   (unsigned long long) remaining, (unsigned long long) host->decode_capacity);
+        return 0;
+    }
+    logger_log(conn->raop->logger, LOGGER_INFO, "Admitting the mirror with %llu of %llu pixels per second",
+               (unsigned long long) conn->decode_reserved, (unsigned long long) host->decode_capacity);
+    return 1;
+}
+
+/* Gives the capacity of the mirror back, before its raop_rtp_mirror goes */
+static void
+conn_release_video(raop_conn_t *conn) {
+    raop_t *host = conn->raop->decode_host;
+    if (!conn->decode_admitted) {
+        return;
+    }
+    MUTEX_LOCK(host->decode_mutex);
+    raop_conn_t **link = &host->decode_conns;
+    while (*link && *link != conn) {
+        link = &(*link)->decode_next;
+    }
+    if (*link) {
+        *link = conn->decode_next;
+    }
+    conn->decode_next = NULL;
+    conn->decode_admitted = 0;
+    MUTEX_UNLOCK(host->decode_mutex);
+}
+
+/* Asks the server for a video renderer before the mirror stream starts, 0 if it has none to give */
+static int
+conn_start_video(raop_conn_t *conn) {
+    if (!conn_admit_video(conn)) {
+        return 0;
+    }
+    if (conn->video_started || !conn->callbacks.video_start) {
+        return 1;
+    }
+    if (conn->callbacks.video_start(conn->callbacks.cls) < 0) {
+        conn_release_video(conn);
+        return 0;
+    }
+    conn->video_started = 1;
+    return 1;
+}
+
+/* Hands the renderer back once the mirror stream is gone, so no thread of it calls back anymore */
+static void
+conn_stop_video(raop_conn_t *conn) {
+    if (conn->video_started) {
+        conn->video_started = 0;
+        conn->callbacks.video_stop(conn->callbacks.cls);
+    }
+}
+
+static fairplay_t *
+conn_get_fairplay(raop_conn_t *conn) {
+    if (!conn->fairplay) {
+        conn->fairplay = fairplay_init(conn->raop->logger);
+        if (!conn->fairplay) {
+            logger_log(conn->raop->logger, LOGGER_ERR, "Could not allocate the FairPlay state");
+        }
+    }
+    return conn->fairplay;
+}
+
+static pairing_session_t *
+conn_get_pairing(raop_conn_t *conn) {
+    if (!conn->pairing) {
+        conn->pairing = pairing_session_init(conn->raop->pairing);
+        if (!conn->pairing) {
+            logger_log(conn->raop->logger, LOGGER_ERR, "Could not allocate the pairing session");
+        }
+    }
+    return conn->pairing;
+}
+
+/*
+ * A sender that reconnects, e.g. after switching between mirroring and audio, would start
+ * its clock sync from scratch and time its first frames with a zero offset. Its clock is
+ * still where it was, give its new raop_ntp the estimate the last session left behind.
+ * Called on the SETUP worker before raop_ntp starts, hence the lock.
+ */
+static void
+conn_seed_clock(raop_conn_t *conn) {
+    raop_t *raop = conn->raop;
+    raop_ntp_estimate_t estimate;
+    int found = 0;
+
+    if (!conn->device_id[0] || !conn->raop_ntp) {
+        return;
+    }
+    MUTEX_LOCK(raop->clock_cache_mutex);
+    for (int i = 0; i < RAOP_CLOCK_CACHE_SIZE; i++) {
+        raop_clock_cache_entry_t *entry = &raop->clock_cache[i];
+        if (!strcmp(entry->device_id, conn->device_id) && entry->ptp == conn->timing_ptp) {
+            estimate = entry->estimate;
+            found = 1;
+            break;
+        }
+    }
+    MUTEX_UNLOCK(raop->clock_cache_mutex);
+    if (found && raop_ntp_get_local_time(conn->raop_ntp) - estimate.time < RAOP_CLOCK_CACHE_MAX_AGE) {
+        logger_log(raop->logger, LOGGER_DEBUG, "Seeding the clock sync of %s from its last session", conn->device_id);
+        raop_ntp_seed(conn->raop_ntp, &estimate);
+    }
+}
+
+/* Keeps the clock estimate of the ending session, in the entry of the sender or the stalest one */
+static void
+conn_save_clock(raop_conn_t *conn) {
+    raop_t *raop = conn->raop;
+    raop_ntp_estimate_t estimate;
+
+    if (!conn->device_id[0] || raop_ntp_get_estimate(conn->raop_ntp, &estimate) < 0) {
+        return;
+    }
+    MUTEX_LOCK(raop->clock_cache_mutex);
+    raop_clock_cache_entry_t *slot = &raop->clock_cache[0];
+    for (int i = 0; i < RAOP_CLOCK_CACHE_SIZE; i++) {
+        raop_clock_cache_entry_t *entry = &raop->clock_cache[i];
+        if (!strcmp(entry->device_id, conn->device_id)) {
+            slot = entry;
+            break;
+        }
+        if (entry->estimate.time < slot->estimate.time) {
+            slot = entry;
+        }
+    }
+    memcpy(slot->device_id, conn->device_id, sizeof(slot->device_id));
+    slot->ptp = conn->timing_ptp;
+    slot->estimate = estimate;
+    MUTEX_UNLOCK(raop->clock_cache_mutex);
+}
+
 #include "raop_handlers.h"
 
+static void
+conn_log_address(raop_conn_t *conn, const char *name, const unsigned char *address, int len) {
+    if (len == 4) {
+        logger_log(conn->raop->logger, LOGGER_INFO,
+                   "%s: %d.%d.%d.%d", name,
+                   address[0], address[1], address[2], address[3]);
+    } else if (len == 16) {
+        logger_log(conn->raop->logger, LOGGER_INFO,
+                   "%s: %02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x", name,
+                   address[0], address[1], address[2], address[3], address[4], address[5], address[6], address[7],
+                   address[8], address[9], address[10], address[11], address[12], address[13], address[14], address[15]);
+    }
+}
+
+/*
+ * Every Apple device around connects now and then only to GET /info, so connections start out
+ * as cheap probes, answered from the cached reply. Everything else, the server's per-connection
+ * context, the FairPlay and pairing state and logging the connection, waits for this.
+ */
+static void
+conn_open(raop_conn_t *conn) {
+    if (conn->opened) {
+        return;
+    }
+    conn->opened = 1;
+    conn->mem_session = mem_account_session_open();
+    mem_account_enter(conn->mem_session);
+    conn_log_address(conn, "Local", conn->local, conn->locallen);
+    conn_log_address(conn, "Remote", conn->remote, conn->remotelen);
+    if (conn->raop->callbacks.conn_init) {
+        void *cls = conn->raop->callbacks.conn_init(conn->raop->callbacks.cls);
+        if (cls) {
+            conn->callbacks.cls = cls;
+        }
+    }
+}
+
 static void *
 conn_init(void *opaque, unsigned char *local, int locallen, unsigned char *remote, int remotelen) {
     raop_t *raop = opaque;
@@ -73,68 +482,152 @@ conn_init(void *opaque, unsigned char *local, int locallen, unsigned char *remot
 
     assert(raop);
 
-    conn = calloc(1, sizeof(raop_conn_t));
+    if (locallen > (int) sizeof(conn->local) || remotelen > (int) sizeof(conn->remote)) {
+        return NULL;
+    }
+    conn = mem_account_calloc(MEM_TAG_CONNECTIONS, 1, sizeof(raop_conn_t));
     if (!conn) {
         return NULL;
     }
     conn->raop = raop;
-    conn->raop_rtp = NULL;
-    conn->raop_ntp = NULL;
-    conn->fairplay = fairplay_init(raop->logger);
+    memcpy(conn->local, local, locallen);
+    memcpy(conn->remote, remote, remotelen);
+    conn->locallen = locallen;
+    conn->remotelen = remotelen;
+    memcpy(&conn->callbacks, &raop->callbacks, sizeof(raop_callbacks_t));
+    return conn;
+}
 
-    if (!conn->fairplay) {
-        free(conn);
-        return NULL;
+static int
+conn_is_probe(void *ptr) {
+    raop_conn_t *conn = ptr;
+    return !conn->opened;
+}
+
+static uint64_t
+conn_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/*
+ * A sender that walked out of range or crashed never sends TEARDOWN, its session would hold
+ * the renderer and a connection slot until TCP gives up, which may take hours. Anything that
+ * comes from the sender counts as a sign of life: requests like the /feedback keepalives, NTP
+ * replies, audio packets and mirror frames or heartbeats. The counters only ever grow, so a
+ * sum that stays put means nothing arrived. On the httpd thread, while no request runs.
+ */
+static int
+conn_is_idle(void *ptr) {
+    raop_conn_t *conn = ptr;
+    int timeout = ATOMIC_LOAD(conn->raop->idle_timeout);
+    if (ATOMIC_LOAD(conn->decode_preempted)) {
+        logger_log(conn->raop->logger, LOGGER_INFO, "Closing the session, a newer mirror took its share of the decoder");
+        return 1;
     }
-    conn->pairing = pairing_session_init(raop->pairing);
-    if (!conn->pairing) {
-        fairplay_destroy(conn->fairplay);
-        free(conn);
-        return NULL;
+    if (conn->callbacks.conn_superseded && conn->callbacks.conn_superseded(conn->callbacks.cls)) {
+        logger_log(conn->raop->logger, LOGGER_INFO, "Closing the session, a newer mirror took the display over");
+        return 1;
+    }
+    if (!conn->opened || timeout <= 0) {
+        return 0;
     }
 
-    if (locallen == 4) {
-        logger_log(conn->raop->logger, LOGGER_INFO,
-                   "Local: %d.%d.%d.%d",
-                   local[0], local[1], local[2], local[3]);
-    } else if (locallen == 16) {
-        logger_log(conn->raop->logger, LOGGER_INFO,
-                   "Local: %02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x",
-                   local[0], local[1], local[2], local[3], local[4], local[5], local[6], local[7],
-                   local[8], local[9], local[10], local[11], local[12], local[13], local[14], local[15]);
+    unsigned int activity = conn->requests;
+    if (conn->raop_ntp) {
+        activity += raop_ntp_get_sample_count(conn->raop_ntp);
     }
-    if (remotelen == 4) {
-        logger_log(conn->raop->logger, LOGGER_INFO,
-                   "Remote: %d.%d.%d.%d",
-                   remote[0], remote[1], remote[2], remote[3]);
-    } else if (remotelen == 16) {
-        logger_log(conn->raop->logger, LOGGER_INFO,
-                   "Remote: %02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x:%02x%02x",
-                   remote[0], remote[1], remote[2], remote[3], remote[4], remote[5], remote[6], remote[7],
-                   remote[8], remote[9], remote[10], remote[11], remote[12], remote[13], remote[14], remote[15]);
+    if (conn->raop_rtp) {
+        activity += raop_rtp_get_received_packets(conn->raop_rtp);
+    }
+    if (conn->raop_buffered) {
+        activity += raop_buffered_get_received_packets(conn->raop_buffered);
+    }
+    if (conn->raop_rtp_mirror) {
+        raop_rtp_mirror_stats_t stats;
+        raop_rtp_mirror_get_stats(conn->raop_rtp_mirror, &stats);
+        activity += stats.received_packets;
     }
 
-    conn->local = malloc(locallen);
-    assert(conn->local);
-    memcpy(conn->local, local, locallen);
+    uint64_t now = conn_now();
+    if (activity != conn->activity || !conn->active_since) {
+        conn->activity = activity;
+        conn->active_since = now;
+        return 0;
+    }
+    if (now - conn->active_since < (uint64_t) timeout * 1000000) {
+        return 0;
+    }
+    logger_log(conn->raop->logger, LOGGER_INFO, "Nothing heard from the sender for %d seconds, closing the session", timeout);
+    return 1;
+}
 
-    conn->remote = malloc(remotelen);
-    assert(conn->remote);
-    memcpy(conn->remote, remote, remotelen);
+/* The AirPlay video requests, HTTP/1.1 instead of RTSP, see raop_handlers.h */
+static void
+conn_request_video(raop_conn_t *conn, http_request_t *request, http_response_t **response) {
+    const char *method = http_request_get_method(request);
+    const char *url = http_request_get_url(request);
+    if (!url) {
+        return;
+    }
+    size_t path_len = strcspn(url, "?");
 
-    conn->locallen = locallen;
-    conn->remotelen = remotelen;
+    raop_video_handler_t handler = NULL;
+    int reverse = 0;
+    if (!strcmp(method, "POST") && path_len == 5 && !strncmp(url, "/play", 5)) {
+        handler = &raop_handler_play;
+    } else if ((!strcmp(method, "POST") || !strcmp(method, "GET")) && path_len == 6 && !strncmp(url, "/scrub", 6)) {
+        handler = &raop_handler_scrub;
+    } else if (!strcmp(method, "POST") && path_len == 5 && !strncmp(url, "/rate", 5)) {
+        handler = &raop_handler_rate;
+    } else if (!strcmp(method, "GET") && path_len == 14 && !strncmp(url, "/playback-info", 14)) {
+        handler = &raop_handler_playback_info;
+    } else if (!strcmp(method, "POST") && path_len == 5 && !strncmp(url, "/stop", 5)) {
+        handler = &raop_handler_stop;
+    } else if (!strcmp(method, "PUT") && path_len == 12 && !strncmp(url, "/setProperty", 12)) {
+        handler = &raop_handler_set_property;
+    } else if (!strcmp(method, "POST") && path_len == 8 && !strncmp(url, "/reverse", 8)) {
+        reverse = 1;
+    } else if (!strcmp(method, "PUT") && path_len == 6 && !strncmp(url, "/photo", 6)) {
+        handler = &raop_handler_photo;
+    }
 
-    if (raop->callbacks.conn_init) {
-        raop->callbacks.conn_init(raop->callbacks.cls);
+    /* Photos and cast movies are separate features, POST /stop ends either */
+    int enabled = handler == &raop_handler_photo ? conn->callbacks.photo_show != NULL :
+                  handler == &raop_handler_stop ? conn->callbacks.playback_start || conn->callbacks.photo_show :
+                  conn->callbacks.playback_start != NULL;
+    if ((!handler && !reverse) || !enabled) {
+        logger_log(conn->raop->logger, LOGGER_DEBUG, "Not handling HTTP request %s with URL %s", method, url);
+        *response = http_response_init("HTTP/1.1", 404, "Not Found");
+        http_response_finish(*response, NULL, 0);
+        return;
+    }
+    logger_log(conn->raop->logger, LOGGER_DEBUG, "Handling HTTP request %s with URL %s", method, url);
+    if (reverse) {
+        /* The sender waits for playback events on this connection, it polls /playback-info without them */
+        *response = http_response_init("HTTP/1.1", 101, "Switching Protocols");
+        http_response_add_header(*response, "Upgrade", "PTTH/1.0");
+        http_response_add_header(*response, "Connection", "Upgrade");
+        http_response_finish(*response, NULL, 0);
+        return;
     }
 
-    return conn;
+    const char *content_type = NULL;
+    char *response_data = NULL;
+    int response_datalen = 0;
+    int code = handler(conn, request, &content_type, &response_data, &response_datalen);
+    *response = http_response_init("HTTP/1.1", code, code == 200 ? "OK" : code == 400 ? "Bad Request" :
+                                   code == 412 ? "Precondition Failed" : "Internal Server Error");
+    http_response_add_header_line(*response, RAOP_HEADER_LINE(raop_header_server));
+    if (content_type) {
+        http_response_add_header(*response, "Content-Type", content_type);
+    }
+    http_response_finish_owned(*response, response_data, response_datalen);
 }
 
 static void
-conn_request(void *ptr, http_request_t *request, http_response_t **response) {
-    raop_conn_t *conn = ptr;
+conn_handle_request(raop_conn_t *conn, http_request_t *request, http_response_t **response) {
     logger_log(conn->raop->logger, LOGGER_DEBUG, "conn_request");
     const char *method;
     const char *url;
@@ -146,15 +639,23 @@ conn_request(void *ptr, http_request_t *request, http_response_t **response) {
     method = http_request_get_method(request);
     url = http_request_get_url(request);
     cseq = http_request_get_header(request, "CSeq");
-    if (!method || !cseq) {
+    if (!method) {
         return;
     }
+    if (!cseq) {
+        conn_open(conn);
+        conn_request_video(conn, request, response);
+        return;
+    }
+    if (strcmp(method, "GET") || !url || strcmp(url, "/info")) {
+        conn_open(conn);
+    }
 
     *response = http_response_init("RTSP/1.0", 200, "OK");
 
     http_response_add_header(*response, "CSeq", cseq);
     //http_response_add_header(*response, "Apple-Jack-Status", "connected; type=analog");
-    http_response_add_header(*response, "Server", "AirTunes/220.68");
+    http_response_add_header_line(*response, RAOP_HEADER_LINE(raop_header_server));
 
     logger_log(conn->raop->logger, LOGGER_DEBUG, "Handling request %s with URL %s", method, url);
     raop_handler_t handler = NULL;
@@ -194,41 +695,89 @@ conn_request(void *ptr, http_request_t *request, http_response_t **response) {
         } else {
             logger_log(conn->raop->logger, LOGGER_WARNING, "RAOP not initialized at FLUSH");
         }
+    } else if (!strcmp(method, "SETRATEANCHORTIME")) {
+        handler = &raop_handler_setrateanchortime;
+    } else if (!strcmp(method, "FLUSHBUFFERED")) {
+        handler = &raop_handler_flushbuffered;
     } else if (!strcmp(method, "TEARDOWN")) {
         //http_response_add_header(*response, "Connection", "close");
-        if (conn->raop_rtp != NULL && raop_rtp_is_running(conn->raop_rtp)) {
+        if (conn->raop_buffered) {
+            /* The buffered stream takes the place of the RTP session */
+            raop_buffered_destroy(conn->raop_buffered);
+            conn->raop_buffered = NULL;
+        } else if (conn->raop_rtp != NULL && raop_rtp_is_running(conn->raop_rtp)) {
             /* Destroy our RTP session */
             raop_rtp_stop(conn->raop_rtp);
         } else if (conn->raop_rtp_mirror) {
             /* Destroy our sessions */
             raop_rtp_destroy(conn->raop_rtp);
             conn->raop_rtp = NULL;
+            conn_release_video(conn);
             raop_rtp_mirror_destroy(conn->raop_rtp_mirror);
             conn->raop_rtp_mirror = NULL;
+            conn_stop_video(conn);
         }
     }
     if (handler != NULL) {
         handler(conn, request, *response, &response_data, &response_datalen);
     }
-    http_response_finish(*response, response_data, response_datalen);
-    if (response_data) {
-        free(response_data);
-        response_data = NULL;
-        response_datalen = 0;
+    /* The response keeps the handler's buffer and frees it once sent */
+    http_response_finish_owned(*response, response_data, response_datalen);
+}
+
+static void
+conn_request(void *ptr, http_request_t *request, http_response_t **response) {
+    raop_conn_t *conn = ptr;
+    /* Requests are served by whichever httpd thread is free, the streams they set up charge the session */
+    int previous = mem_account_enter(conn->mem_session);
+    conn->requests++;
+    conn_handle_request(conn, request, response);
+    mem_account_enter(previous);
+}
+
+/*
+ * The pairing and FairPlay handshakes and the SETUP key decryption take long enough to stall
+ * every other connection's requests, so these are answered on the httpd worker threads.
+ */
+static int
+conn_offload(void *ptr, http_request_t *request) {
+    const char *method = http_request_get_method(request);
+    const char *url = http_request_get_url(request);
+
+    if (!method || !url) {
+        return 0;
+    }
+    if (!strcmp(method, "POST")) {
+        /* /play returns once the movie is loaded, which takes seconds, /stop once it is torn down */
+        return !strcmp(url, "/pair-setup") || !strcmp(url, "/pair-verify") || !strcmp(url, "/fp-setup") ||
+               !strcmp(url, "/play") || !strcmp(url, "/stop");
     }
+    /* A photo is decoded and faded in before the answer */
+    if (!strcmp(method, "PUT")) {
+        return !strcmp(url, "/photo");
+    }
+    return !strcmp(method, "SETUP");
 }
 
 static void
 conn_destroy(void *ptr) {
     raop_conn_t *conn = ptr;
 
+    if (!conn->opened) {
+        logger_log(conn->raop->logger, LOGGER_DEBUG, "Destroying probe connection");
+        mem_account_free(conn);
+        return;
+    }
     logger_log(conn->raop->logger, LOGGER_INFO, "Destroying connection");
 
-    if (conn->raop->callbacks.conn_destroy) {
-        conn->raop->callbacks.conn_destroy(conn->raop->callbacks.cls);
+    if (conn->raop_buffered) {
+        raop_buffered_destroy(conn->raop_buffered);
+    }
+    if (conn->raop_ptp) {
+        raop_ptp_destroy(conn->raop_ptp);
     }
-
     if (conn->raop_ntp) {
+        conn_save_clock(conn);
         raop_ntp_destroy(conn->raop_ntp);
     }
     if (conn->raop_rtp) {
@@ -237,16 +786,28 @@ conn_destroy(void *ptr) {
     }
     if (conn->raop_rtp_mirror) {
         /* This is done in case TEARDOWN was not called */
+        conn_release_video(conn);
         raop_rtp_mirror_destroy(conn->raop_rtp_mirror);
     }
 
-    conn->raop->callbacks.video_flush(conn->raop->callbacks.cls);
+    conn->callbacks.video_flush(conn->callbacks.cls);
+    conn_stop_video(conn);
+
+    /* Only now that no stream thread is left to call back, the connection context may go */
+    if (conn->callbacks.conn_destroy) {
+        conn->callbacks.conn_destroy(conn->callbacks.cls);
+    }
 
-    free(conn->local);
-    free(conn->remote);
     pairing_session_destroy(conn->pairing);
     fairplay_destroy(conn->fairplay);
-    free(conn);
+    for (int i = 0; i < RAOP_PHOTO_CACHE_SIZE; i++) {
+        mem_account_free(conn->photos[i].data);
+    }
+    unsigned int peak = mem_account_session_close(conn->mem_session);
+    if (conn->mem_session) {
+        logger_log(conn->raop->logger, LOGGER_INFO, "Connection held at most %u KB", peak / 1024);
+    }
+    mem_account_free(conn);
 }
 
 raop_t *
@@ -265,6 +826,9 @@ raop_init(int max_clients, raop_callbacks_t *callbacks) {
         return NULL;
     }
 
+    /* Look the ciphers and digests up now rather than during the first SETUP */
+    crypto_init();
+
     /* Validate the callbacks structure */
     if (!callbacks->audio_process ||
         !callbacks->video_process) {
@@ -291,6 +855,9 @@ raop_init(int max_clients, raop_callbacks_t *callbacks) {
     httpd_cbs.conn_init = &conn_init;
     httpd_cbs.conn_request = &conn_request;
     httpd_cbs.conn_destroy = &conn_destroy;
+    httpd_cbs.conn_is_probe = &conn_is_probe;
+    httpd_cbs.conn_is_idle = &conn_is_idle;
+    httpd_cbs.conn_offload = &conn_offload;
 
     /* Initialize the http daemon */
     httpd = httpd_init(raop->logger, &httpd_cbs, max_clients);
@@ -303,6 +870,15 @@ raop_init(int max_clients, raop_callbacks_t *callbacks) {
     memcpy(&raop->callbacks, callbacks, sizeof(raop_callbacks_t));
     raop->pairing = pairing;
     raop->httpd = httpd;
+    raop->audio_buffer_length = RAOP_BUFFER_DEFAULT_LENGTH;
+    raop->video_queue_depth = RAOP_RTP_MIRROR_QUEUE_DEFAULT_DEPTH;
+    raop->display_width = RAOP_DISPLAY_DEFAULT_WIDTH;
+    raop->display_height = RAOP_DISPLAY_DEFAULT_HEIGHT;
+    raop->display_refresh_rate = RAOP_DISPLAY_DEFAULT_REFRESH_RATE;
+    raop->audio_formats = RAOP_AUDIO_FORMATS_DEFAULT;
+    MUTEX_CREATE(raop->clock_cache_mutex);
+    raop->decode_host = raop;
+    MUTEX_CREATE(raop->decode_mutex);
     return raop;
 }
 
@@ -310,9 +886,18 @@ void
 raop_destroy(raop_t *raop) {
     if (raop) {
         raop_stop(raop);
+        if (raop->trace_path) {
+            trace_stop();
+            free(raop->trace_path);
+        }
+        metrics_server_destroy(raop->metrics_server);
         pairing_destroy(raop->pairing);
         httpd_destroy(raop->httpd);
         logger_destroy(raop->logger);
+        free(raop->info_data);
+        free(raop->info_key);
+        MUTEX_DESTROY(raop->clock_cache_mutex);
+        MUTEX_DESTROY(raop->decode_mutex);
         free(raop);
 
         /* Cleanup the network */
@@ -340,6 +925,173 @@ raop_set_port(raop_t *raop, unsigned short port) {
     raop->port = port;
 }
 
+void
+raop_set_audio_buffer_length(raop_t *raop, int packets) {
+    assert(raop);
+    if (packets < 1) {
+        packets = 1;
+    } else if (packets > RAOP_BUFFER_MAX_LENGTH) {
+        logger_log(raop->logger, LOGGER_WARNING, "Audio buffer length %d exceeds the maximum of %d packets",
+                   packets, RAOP_BUFFER_MAX_LENGTH);
+        packets = RAOP_BUFFER_MAX_LENGTH;
+    }
+    raop->audio_buffer_length = packets;
+}
+
+void
+raop_set_video_queue_depth(raop_t *raop, int frames) {
+    assert(raop);
+    if (frames < 1) {
+        frames = 1;
+    } else if (frames > RAOP_RTP_MIRROR_QUEUE_MAX_DEPTH) {
+        logger_log(raop->logger, LOGGER_WARNING, "Video queue depth %d exceeds the maximum of %d frames",
+                   frames, RAOP_RTP_MIRROR_QUEUE_MAX_DEPTH);
+        frames = RAOP_RTP_MIRROR_QUEUE_MAX_DEPTH;
+    }
+    raop->video_queue_depth = frames;
+}
+
+void
+raop_set_video_latency_budget(raop_t *raop, int milliseconds) {
+    assert(raop);
+    raop->video_latency_budget = milliseconds > 0 ? milliseconds : 0;
+}
+
+void
+raop_set_mirror_socket_options(raop_t *raop, int receive_buffer_kb, int busy_poll_us) {
+    assert(raop);
+    raop->mirror_receive_buffer = receive_buffer_kb > 0 ? receive_buffer_kb * 1024 : 0;
+    raop->mirror_busy_poll = busy_poll_us > 0 ? busy_poll_us : 0;
+}
+
+void
+raop_set_video_playout_delay(raop_t *raop, int milliseconds) {
+    assert(raop);
+    raop->video_playout_delay = milliseconds > 0 ? milliseconds : 0;
+}
+
+void
+raop_set_ntp_poll_interval(raop_t *raop, int min_ms, int max_ms) {
+    assert(raop);
+    raop->ntp_poll_min = min_ms > 0 ? min_ms : 0;
+    raop->ntp_poll_max = max_ms > 0 ? max_ms : 0;
+}
+
+void
+raop_set_display(raop_t *raop, int width, int height, double refresh_rate) {
+    assert(raop);
+    if (width > 0 && height > 0) {
+        raop->display_width = width;
+        raop->display_height = height;
+    }
+    if (refresh_rate > 0) {
+        raop->display_refresh_rate = refresh_rate;
+    }
+    /* Rebuilt with the new display on the next GET /info */
+    free(raop->info_data);
+    raop->info_data = NULL;
+    raop->info_datalen = 0;
+}
+
+void
+raop_set_thermal_pressure(raop_t *raop, int pressure) {
+    assert(raop);
+    /* raop_handler_info notices and rebuilds its cached reply on the httpd thread */
+    ATOMIC_STORE(raop->thermal_pressure, pressure ? 1 : 0);
+    raop_rtp_mirror_set_pressure(pressure);
+}
+
+void
+raop_set_decode_capacity(raop_t *raop, uint64_t pixel_rate, int preempt) {
+    assert(raop);
+    raop->decode_capacity = pixel_rate;
+    raop->decode_preempt = preempt;
+}
+
+void
+raop_set_audio_output_latency(raop_t *raop, int microseconds) {
+    assert(raop);
+    /* In whole milliseconds, so the jitter of the measurement does not rebuild the cached /info reply */
+    int latency = microseconds > 0 ? (microseconds + 500) / 1000 * 1000 : 0;
+    ATOMIC_STORE(raop->audio_output_latency, latency);
+}
+
+void
+raop_set_audio_formats(raop_t *raop, uint64_t formats) {
+    assert(raop);
+    raop->audio_formats = formats;
+    free(raop->info_data);
+    raop->info_data = NULL;
+    raop->info_datalen = 0;
+}
+
+void
+raop_set_buffered_audio(raop_t *raop, int seconds) {
+    assert(raop);
+    raop->buffered_audio_seconds = seconds > 0 ? seconds : 0;
+    /* Offered in the features of the next GET /info */
+    free(raop->info_data);
+    raop->info_data = NULL;
+    raop->info_datalen = 0;
+}
+
+void
+raop_set_hevc(raop_t *raop, int enabled) {
+    assert(raop);
+    raop->hevc = enabled;
+    /* Offered in the features of the next GET /info */
+    free(raop->info_data);
+    raop->info_data = NULL;
+    raop->info_datalen = 0;
+}
+
+void
+raop_set_receiver_reports(raop_t *raop, int enabled) {
+    assert(raop);
+    raop->receiver_reports = enabled;
+}
+
+void
+raop_set_idle_timeout(raop_t *raop, int seconds) {
+    assert(raop);
+    ATOMIC_STORE(raop->idle_timeout, seconds > 0 ? seconds : 0);
+}
+
+int
+raop_set_key_file(raop_t *raop, const char *path) {
+    assert(raop);
+    int ret = pairing_set_key_file(raop->pairing, path);
+    if (ret < 0) {
+        logger_log(raop->logger, LOGGER_ERR, "Could not use %s as key file, senders will see a new receiver on restart", path);
+    } else if (ret == 0) {
+        logger_log(raop->logger, LOGGER_INFO, "Created the key file %s", path);
+    } else {
+        logger_log(raop->logger, LOGGER_DEBUG, "Loaded the key file %s", path);
+    }
+    return ret < 0 ? -1 : 0;
+}
+
+void
+raop_set_metrics_port(raop_t *raop, unsigned short port) {
+    assert(raop);
+    raop->metrics_port = port;
+}
+
+void
+raop_set_trace_file(raop_t *raop, const char *path, unsigned int megabytes) {
+    assert(raop);
+    free(raop->trace_path);
+    raop->trace_path = path ? strdup(path) : NULL;
+    raop->trace_size = (uint64_t) megabytes << 20;
+}
+
+void
+raop_log_stats(raop_t *raop) {
+    assert(raop);
+    // The render threads do the logging, nothing here may take a lock
+    raop_rtp_mirror_request_stats();
+}
+
 unsigned short
 raop_get_port(raop_t *raop) {
     assert(raop);
@@ -359,22 +1111,71 @@ raop_set_log_callback(raop_t *raop, raop_log_callback_t callback, void *cls) {
     logger_set_callback(raop->logger, callback, cls);
 }
 
+void
+raop_set_log_async(raop_t *raop, int async) {
+    assert(raop);
+
+    logger_set_async(raop->logger, async);
+}
+
+void
+raop_set_genlock(raop_t *raop, genlock_t *genlock) {
+    assert(raop);
+    raop->genlock = genlock;
+}
+
 void
 raop_set_dnssd(raop_t *raop, dnssd_t *dnssd) {
     assert(dnssd);
     raop->dnssd = dnssd;
 }
 
+void
+raop_set_listen_fd(raop_t *raop, int fd) {
+    assert(raop);
+    httpd_set_listen_fd(raop->httpd, fd);
+}
+
+void
+raop_set_host(raop_t *raop, raop_t *host) {
+    assert(raop);
+    assert(host);
+    httpd_set_host(raop->httpd, host->httpd);
+    /* The mirrors of all receivers share the one decoder */
+    raop->decode_host = host->decode_host;
+}
+
 
 int
 raop_start(raop_t *raop, unsigned short *port) {
     assert(raop);
     assert(port);
-    return httpd_start(raop->httpd, port);
+    int ret = httpd_start(raop->httpd, port);
+    if (ret >= 0 && raop->metrics_port) {
+        // Monitoring is optional, AirPlay keeps working without it
+        if (!raop->metrics_server) {
+            raop->metrics_server = metrics_server_init(raop->logger);
+            if (raop->metrics_server && raop->callbacks.snapshot) {
+                metrics_server_set_snapshot(raop->metrics_server, raop->callbacks.snapshot, raop->callbacks.cls);
+            }
+        }
+        if (raop->metrics_server) {
+            unsigned short metrics_port = raop->metrics_port;
+            metrics_server_start(raop->metrics_server, &metrics_port);
+        }
+    }
+    if (ret >= 0 && raop->trace_path && !trace_enabled()) {
+        // Same for tracing, a restart keeps appending to the running trace
+        trace_start(raop->logger, raop->trace_path, raop->trace_size);
+    }
+    return ret;
 }
 
 void
 raop_stop(raop_t *raop) {
     assert(raop);
+    if (raop->metrics_server) {
+        metrics_server_stop(raop->metrics_server);
+    }
     httpd_stop(raop->httpd);
 }
\ No newline at end of file
@@ -2,8 +2,10 @@
 #define RAOP_H
 
 #include "dnssd.h"
+#include "genlock.h"
 #include "stream.h"
 #include "raop_ntp.h"
+#include "video_frame.h"
 
 #if defined (WIN32) && defined(DLL_EXPORT)
 # define RAOP_API __declspec(dllexport)
@@ -31,14 +33,66 @@ typedef struct raop_s raop_t;
 
 typedef void (*raop_log_callback_t)(void *cls, int level, const char *msg);
 
+/* Steps from connecting to streaming a mirror, each reported once per session */
+typedef enum raop_milestone_e {
+    RAOP_MILESTONE_SETUP,           /* The first RTSP SETUP arrived */
+    RAOP_MILESTONE_FAIRPLAY,        /* The FairPlay stream key is decrypted */
+    RAOP_MILESTONE_MIRROR_ACCEPT,   /* The mirror data connection is accepted */
+    RAOP_MILESTONE_PARAMETER_SETS,  /* The first SPS and PPS arrived */
+    RAOP_MILESTONE_FIRST_FRAME,     /* The first picture (VCL) frame arrived */
+    RAOP_MILESTONE_COUNT
+} raop_milestone_t;
+
+/* Where a movie cast by URL stands, for GET /playback-info */
+typedef struct raop_playback_info_s {
+    double duration;    /* Seconds, 0 while unknown */
+    double position;    /* Seconds */
+    double rate;        /* 0 while paused, 1 while playing */
+    int ready_to_play;
+} raop_playback_info_t;
+
+/* How a photo replaces the one before, from the X-Apple-Transition header of PUT /photo */
+typedef enum raop_photo_transition_e {
+    RAOP_PHOTO_TRANSITION_NONE,
+    RAOP_PHOTO_TRANSITION_DISSOLVE,
+    RAOP_PHOTO_TRANSITION_SLIDE_LEFT,
+    RAOP_PHOTO_TRANSITION_SLIDE_RIGHT
+} raop_photo_transition_t;
+
 struct raop_callbacks_s {
     void* cls;
 
     void  (*audio_process)(void *cls, raop_ntp_t *ntp, aac_decode_struct *data);
     void  (*video_process)(void *cls, raop_ntp_t *ntp, h264_decode_struct *data);
+    /* Optional, takes the place of video_process for the frames decrypted into buffers of the library,
+     * and hands over a reference to the frame, which the callee releases with video_frame_release when
+     * done, on any thread and even after the session ended. No copy is needed to keep it for a while,
+     * but the session runs out of buffers and drops frames once 32 are held. */
+    void  (*video_process_frame)(void *cls, raop_ntp_t *ntp, video_frame_t *frame);
+
+    /* Optional zero-copy video input, frames are decrypted straight into buffers the renderer hands out.
+     * video_process consumes such a buffer, frames that are dropped instead give it back with video_release_buffer. */
+    unsigned char *(*video_acquire_buffer)(void *cls, int size, void **handle);
+    void  (*video_release_buffer)(void *cls, void *handle);
+    /* Optional, non-zero while the renderer cannot take another frame without waiting */
+    int   (*video_backpressure)(void *cls);
+    /* Optional, how often the audio renderer ran dry or got a frame too late to play it on time so
+     * far, asked after every audio_process. The jitter buffer waits longer for late packets while
+     * this keeps growing, and less again once it stops. */
+    int   (*audio_underruns)(void *cls);
+    /* Optional, the raop_ntp_get_local_time of the first display vsync at or after time, or time
+     * itself if the renderer does not know. Frames held back for playout are released on it. */
+    uint64_t (*video_next_vsync)(void *cls, uint64_t time);
+    /* Optional slice pipelining, an idle renderer gets the Annex-B NAL units of a frame as they are
+     * received and decrypted, the last part with end_of_frame set. Only the first part may return -1.
+     * Either way the whole frame goes to video_process once it is complete, with rendered set if
+     * the parts were taken. */
+    int   (*video_process_nals)(void *cls, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts, int end_of_frame);
 
     /* Optional but recommended callback functions */
-    void  (*conn_init)(void *cls);
+    /* conn_init may return a per-connection context, which then replaces cls in every callback made
+     * for that connection, up to and including its conn_destroy. Returning NULL keeps cls. */
+    void* (*conn_init)(void *cls);
     void  (*conn_destroy)(void *cls);
     void  (*audio_flush)(void *cls);
     void  (*video_flush)(void *cls);
@@ -47,6 +101,41 @@ struct raop_callbacks_s {
     void  (*audio_set_coverart)(void *cls, const void *buffer, int buflen);
     void  (*audio_remote_control_id)(void *cls, const char *dacp_id, const char *active_remote_header);
     void  (*audio_set_progress)(void *cls, unsigned int start, unsigned int curr, unsigned int end);
+    /* Optional pair, video_start is called when a mirror stream is SETUP and before any video callback
+     * for it, video_stop once that stream has ended. video_start returns -1 to refuse the mirror. */
+    int   (*video_start)(void *cls);
+    void  (*video_stop)(void *cls);
+    /* Optional, paused is 1 once the sender stopped sending frames but not heartbeats, e.g. because its
+     * screen locked, the renderer may then power its decoder down. On the thread of video_process, with
+     * 0 ahead of the parameter sets that the first frame after the pause comes behind. */
+    void  (*video_pause)(void *cls, int paused);
+    /* Optional, non-zero once a newer mirror took the display over from the connection's. The
+     * connection is then closed on the httpd thread, the newer mirror does not wait for it. */
+    int   (*conn_superseded)(void *cls);
+    /* Optional, time is the raop_ntp_get_local_time at which the session reached the milestone */
+    void  (*session_milestone)(void *cls, raop_milestone_t milestone, uint64_t time);
+    /* Optional, served at /snapshot.jpg on the metrics port, with the global cls and from the metrics
+     * server's thread. A malloc'd JPEG of the picture on display in *jpeg, returns its size or -1. */
+    int   (*snapshot)(void *cls, unsigned char **jpeg);
+    /**
+     * Optional AirPlay video, movies the sender casts by URL for the receiver to fetch and play
+     * itself. All or none of them must be set, without them /play is answered with 404 Not Found. playback_start returns once the movie plays, or -1 if it cannot
+     * be played; it starts at start_seconds if that is positive, otherwise at start_fraction of
+     * the duration. playback_info returns -1 once nothing is playing any more.
+     */
+    int   (*playback_start)(void *cls, const char *url, double start_seconds, double start_fraction);
+    void  (*playback_scrub)(void *cls, double position);
+    void  (*playback_rate)(void *cls, double rate);
+    void  (*playback_stop)(void *cls);
+    int   (*playback_info)(void *cls, raop_playback_info_t *info);
+    /**
+     * Optional AirPlay photos, the JPEGs a sender shows on the receiver with PUT /photo. Without
+     * photo_show they are answered with 404 Not Found. photo_show returns once the photo replaced
+     * the one before, or -1 if it cannot be shown; photo_hide takes it down after POST /stop.
+     * Both are called from the httpd worker threads.
+     */
+    int   (*photo_show)(void *cls, const unsigned char *jpeg, int size, raop_photo_transition_t transition);
+    void  (*photo_hide)(void *cls);
 };
 typedef struct raop_callbacks_s raop_callbacks_t;
 
@@ -54,13 +143,116 @@ RAOP_API raop_t *raop_init(int max_clients, raop_callbacks_t *callbacks);
 
 RAOP_API void raop_set_log_level(raop_t *raop, int level);
 RAOP_API void raop_set_log_callback(raop_t *raop, raop_log_callback_t callback, void *cls);
+/* Hands log messages to a background thread, so the network threads never wait for the callback */
+RAOP_API void raop_set_log_async(raop_t *raop, int async);
 RAOP_API void raop_set_port(raop_t *raop, unsigned short port);
+/* Maximum depth of the adaptive audio jitter buffer in packets, applies to new sessions */
+RAOP_API void raop_set_audio_buffer_length(raop_t *raop, int packets);
+/* Decrypted video frames that may queue up in front of a busy renderer, applies to new sessions */
+RAOP_API void raop_set_video_queue_depth(raop_t *raop, int frames);
+/* End-to-end delay after which late video frames are dropped instead of decoded, 0 disables dropping */
+RAOP_API void raop_set_video_latency_budget(raop_t *raop, int milliseconds);
+/* Longest video frames are held back beyond their transit time to smooth out bursty arrival, 0 disables it */
+RAOP_API void raop_set_video_playout_delay(raop_t *raop, int milliseconds);
+/* Video wall the mirror's playout follows, needs a playout delay, NULL for none. Applies to new sessions, raop does not own it. */
+RAOP_API void raop_set_genlock(raop_t *raop, genlock_t *genlock);
+/* Receive buffer in KB and busy polling time in micro seconds of the mirror data socket, 0 keeps the system defaults */
+RAOP_API void raop_set_mirror_socket_options(raop_t *raop, int receive_buffer_kb, int busy_poll_us);
+/* Bounds in milli seconds the NTP polling interval adapts within, 0 keeps 1000 to 8000, applies to new sessions */
+RAOP_API void raop_set_ntp_poll_interval(raop_t *raop, int min_ms, int max_ms);
+/**
+ * Display size and refresh rate advertised to senders, which scale and pace the mirror to fit
+ * it. The rate may be fractional, like 59.94 Hz. Values of 0 keep the default of 1920x1080 at
+ * 60 Hz. Call before raop_start.
+ */
+RAOP_API void raop_set_display(raop_t *raop, int width, int height, double refresh_rate);
+/**
+ * While the device is throttled, GET /info advertises at most 1280x720 at 30 Hz, so the
+ * next sessions ask less of the decoder, and running mirror sessions drop late frames
+ * sooner. Safe to call from any thread while the server runs.
+ */
+RAOP_API void raop_set_thermal_pressure(raop_t *raop, int pressure);
+/**
+ * Pixels per second the decoder keeps up with, e.g. 1920 * 1080 * 60 for two 1080p mirrors at
+ * 30 Hz, shared by the mirrors of all sessions and of the receivers hosted by this one. Every
+ * mirror is charged what its frames measure, their size times their rate, and GET /info
+ * advertises a display that fits what is left, so that the next sender asks for no more.
+ * A mirror that would get less than 640x360 at 30 Hz is refused, or with preempt the oldest
+ * mirrors are closed to make room for it. 0 (the default) admits every mirror. Call before
+ * raop_start.
+ */
+RAOP_API void raop_set_decode_capacity(raop_t *raop, uint64_t pixel_rate, int preempt);
+/**
+ * Micro seconds after its timestamp the renderer plays audio, which GET /info advertises as
+ * outputLatencyMicros so that senders can line their own timing up with it. 0 (the default)
+ * advertises none. Safe to call from any thread while the server runs, e.g. whenever the
+ * renderer measures anew.
+ */
+RAOP_API void raop_set_audio_output_latency(raop_t *raop, int microseconds);
+/**
+ * AirPlay audioFormat bits (see audio_format.h) to offer senders, which pick one of them for
+ * their audio stream. The default offers every stereo PCM, ALAC and AAC format, so the
+ * renderer must check what it gets. Call before raop_start.
+ */
+RAOP_API void raop_set_audio_formats(raop_t *raop, uint64_t formats);
+/**
+ * Offers senders the buffered audio stream, which they push over TCP seconds ahead of its
+ * play time and which rides out network outages of up to that many seconds. The renderer
+ * then gets audio batches of up to half a second ahead of time. 0 (the default) keeps to
+ * the realtime stream. Call before raop_start.
+ */
+RAOP_API void raop_set_buffered_audio(raop_t *raop, int seconds);
+/**
+ * Lets senders mirror in H.265 where they can, at about half the bitrate of H.264. Only for a
+ * renderer that decodes both, the frames say which one they are in. Off by default, call
+ * before raop_start.
+ */
+RAOP_API void raop_set_hevc(raop_t *raop, int enabled);
+/**
+ * Sends an RTCP receiver report with the loss and jitter of the realtime audio stream to the
+ * control port of the sender every 5 seconds, for senders that adapt their resends and pacing
+ * to it. The statistics go to the metrics either way. Off by default, applies to the audio
+ * sessions set up after the call.
+ */
+RAOP_API void raop_set_receiver_reports(raop_t *raop, int enabled);
+/**
+ * Closes a session, with its streams and renderers, once nothing at all arrived from its sender
+ * for this many seconds, not even the NTP replies or mirror heartbeats it keeps sending while
+ * paused. For senders that vanish without a TEARDOWN. 0 (the default) keeps sessions until the
+ * connection drops. Safe to call from any thread, applies to the running sessions as well.
+ */
+RAOP_API void raop_set_idle_timeout(raop_t *raop, int seconds);
+/**
+ * Keeps the pairing identity of the receiver in the file at path, created readable by its owner
+ * only if there is none, so that senders find the same receiver after a restart. The senders
+ * that completed a pair-verify are remembered there as well. Call before raop_start, returns -1
+ * if the file can neither be read nor created, the receiver then has a new identity each start.
+ */
+RAOP_API int raop_set_key_file(raop_t *raop, const char *path);
+/**
+ * Serves RTSP on fd, a socket that is already listening, like one systemd passed for socket
+ * activation, instead of binding a port of its own. Call before raop_start, which then returns
+ * the port of the socket. The socket is closed by raop_stop.
+ */
+RAOP_API void raop_set_listen_fd(raop_t *raop, int fd);
+/* Serves Prometheus metrics on this port from raop_start on, 0 (the default) serves none */
+RAOP_API void raop_set_metrics_port(raop_t *raop, unsigned short port);
+/* Records the received streams into a ring file of this size at path, see trace.h */
+RAOP_API void raop_set_trace_file(raop_t *raop, const char *path, unsigned int megabytes);
+/* Logs the latency histograms of the mirror sessions, safe to call from a signal handler */
+RAOP_API void raop_log_stats(raop_t *raop);
 RAOP_API unsigned short raop_get_port(raop_t *raop);
 RAOP_API void *raop_get_callback_cls(raop_t *raop);
 RAOP_API int raop_start(raop_t *raop, unsigned short *port);
 RAOP_API int raop_is_running(raop_t *raop);
 RAOP_API void raop_stop(raop_t *raop);
 RAOP_API void raop_set_dnssd(raop_t *raop, dnssd_t *dnssd);
+/**
+ * Runs raop as another receiver of the process host runs in, its RTSP connections are served by
+ * the thread, reactor and request workers of host. Call before starting either and start host
+ * first. Stopping host stops raop as well, raop is destroyed before host and while it is stopped.
+ */
+RAOP_API void raop_set_host(raop_t *raop, raop_t *host);
 RAOP_API void raop_destroy(raop_t *raop);
 
 #ifdef __cplusplus
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #include "raop_buffer.h"
 #include "raop_rtp.h"
@@ -26,8 +27,17 @@
 #include "crypto.h"
 #include "compat.h"
 #include "stream.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "memlock.h"
+#include "mem_account.h"
+#include "probes.h"
 
-#define RAOP_BUFFER_LENGTH 32
+/* Packets that are always waited for before skipping a missing one */
+#define RAOP_BUFFER_MIN_DEPTH 4
+
+/* Received packets a resend request may span to cover two gaps at once */
+#define RAOP_BUFFER_RESEND_MERGE 2
 
 typedef struct {
     /* Data available */
@@ -37,9 +47,15 @@ typedef struct {
     unsigned short seqnum;
     uint64_t timestamp;
 
-    /* Payload data */
+    /* Payload data, points into the slab of the buffer */
     unsigned int payload_size;
     void *payload_data;
+
+    /* Handed out by dequeue and not yet released */
+    int lent;
+
+    /* Local time the missing packet was last asked for, 0 if it never was */
+    uint64_t resend_time;
 } raop_buffer_entry_t;
 
 struct raop_buffer_s {
@@ -47,14 +63,37 @@ struct raop_buffer_s {
     /* Key and IV used for decryption */
     unsigned char aeskey[RAOP_AESKEY_LEN];
     unsigned char aesiv[RAOP_AESIV_LEN];
+    /* Keyed once per session, only the IV is reloaded for every packet */
+    aes_ctx_t *aes_ctx;
 
     /* First and last seqnum */
     int is_empty;
     unsigned short first_seqnum;
     unsigned short last_seqnum;
 
-    /* RTP buffer entries */
-    raop_buffer_entry_t entries[RAOP_BUFFER_LENGTH];
+    /* RTP buffer entries, length is a power of two so seqnum wraparound keeps the index contiguous */
+    int length;
+    raop_buffer_entry_t *entries;
+
+    /* How many packets may queue up behind a missing one before it is given up on */
+    int target_depth;
+    int max_depth;
+
+    /* Preallocated and prefaulted payload storage, one RAOP_PACKET_LEN slot per entry */
+    unsigned char *slab;
+    /* Charged with the slab */
+    int mem_session;
+
+    /* Receiver statistics, see raop_buffer_stats_t. max_seqnum is only valid once stats_started
+     * is set, stats_resync makes the next packet continue the count without a gap */
+    int stats_started;
+    int stats_resync;
+    unsigned short max_seqnum;
+    uint32_t cycles;
+    uint32_t expected;
+    uint32_t received;
+    uint32_t expected_prior;
+    uint32_t received_prior;
 };
 
 void
@@ -68,26 +107,17 @@ raop_buffer_init_key_iv(raop_buffer_t *raop_buffer,
     unsigned char eaeskey[64];
     memcpy(eaeskey, aeskey, 16);
 
-    sha_ctx_t *ctx = sha_init();
-    sha_update(ctx, eaeskey, 16);
-    sha_update(ctx, ecdh_secret, 32);
-    sha_final(ctx, eaeskey, NULL);
-    sha_destroy(ctx);
+    sha512_oneshot2(eaeskey, 16, ecdh_secret, 32, eaeskey);
 
     memcpy(raop_buffer->aeskey, eaeskey, 16);
     memcpy(raop_buffer->aesiv, aesiv, RAOP_AESIV_LEN);
 
-#ifdef DUMP_AUDIO
-    if (file_keyiv != NULL) {
-        fwrite(raop_buffer->aeskey, 16, 1, file_keyiv);
-        fwrite(raop_buffer->aesiv, 16, 1, file_keyiv);
-        fclose(file_keyiv);
-    }
-#endif
+    aes_cbc_destroy(raop_buffer->aes_ctx);
+    raop_buffer->aes_ctx = aes_cbc_init(raop_buffer->aeskey, raop_buffer->aesiv, AES_DECRYPT);
 }
 
 raop_buffer_t *
-raop_buffer_init(logger_t *logger,
+raop_buffer_init(logger_t *logger, int max_length,
                  const unsigned char *aeskey,
                  const unsigned char *aesiv,
                  const unsigned char *ecdh_secret)
@@ -100,13 +130,36 @@ raop_buffer_init(logger_t *logger,
     if (!raop_buffer) {
         return NULL;
     }
+    if (max_length > RAOP_BUFFER_MAX_LENGTH) {
+        max_length = RAOP_BUFFER_MAX_LENGTH;
+    } else if (max_length < RAOP_BUFFER_MIN_DEPTH) {
+        max_length = RAOP_BUFFER_MIN_DEPTH;
+    }
+    raop_buffer->length = RAOP_BUFFER_MIN_DEPTH;
+    while (raop_buffer->length < max_length) {
+        raop_buffer->length <<= 1;
+    }
+    raop_buffer->max_depth = max_length;
+    raop_buffer->target_depth = max_length;
+
+    raop_buffer->entries = calloc(raop_buffer->length, sizeof(raop_buffer_entry_t));
+    raop_buffer->slab = memlock_alloc((size_t) raop_buffer->length * RAOP_PACKET_LEN);
+    if (!raop_buffer->entries || !raop_buffer->slab) {
+        free(raop_buffer->entries);
+        memlock_free(raop_buffer->slab, (size_t) raop_buffer->length * RAOP_PACKET_LEN);
+        free(raop_buffer);
+        return NULL;
+    }
+    raop_buffer->mem_session = mem_account_session();
+    mem_account_charge(MEM_TAG_AUDIO_BUFFERS, raop_buffer->mem_session, (long) raop_buffer->length * RAOP_PACKET_LEN);
     raop_buffer->logger = logger;
     raop_buffer_init_key_iv(raop_buffer, aeskey, aesiv, ecdh_secret);
 
-    for (int i = 0; i < RAOP_BUFFER_LENGTH; i++) {
+    for (int i = 0; i < raop_buffer->length; i++) {
         raop_buffer_entry_t *entry = &raop_buffer->entries[i];
-        entry->payload_data = NULL;
+        entry->payload_data = raop_buffer->slab + i * RAOP_PACKET_LEN;
         entry->payload_size = 0;
+        entry->lent = 0;
     }
 
     raop_buffer->is_empty = 1;
@@ -117,26 +170,13 @@ raop_buffer_init(logger_t *logger,
 void
 raop_buffer_destroy(raop_buffer_t *raop_buffer)
 {
-    for (int i = 0; i < RAOP_BUFFER_LENGTH; i++) {
-        raop_buffer_entry_t *entry = &raop_buffer->entries[i];
-        if (entry->payload_data != NULL) {
-            free(entry->payload_data);
-        }
-    }
-
     if (raop_buffer) {
+        aes_cbc_destroy(raop_buffer->aes_ctx);
+        free(raop_buffer->entries);
+        memlock_free(raop_buffer->slab, (size_t) raop_buffer->length * RAOP_PACKET_LEN);
+        mem_account_charge(MEM_TAG_AUDIO_BUFFERS, raop_buffer->mem_session, -(long) raop_buffer->length * RAOP_PACKET_LEN);
         free(raop_buffer);
     }
-
-#ifdef DUMP_AUDIO
-    if (file_aac != NULL) {
-        fclose(file_aac);
-    }
-    if (file_source != NULL) {
-        fclose(file_source);
-    }
-#endif
-
 }
 
 static short
@@ -145,13 +185,50 @@ seqnum_cmp(unsigned short s1, unsigned short s2)
     return (s1 - s2);
 }
 
-//#define DUMP_AUDIO
+/* Counts a packet that went into the buffer, as in RFC 3550, Appendix A.1 */
+static void
+raop_buffer_update_stats(raop_buffer_t *raop_buffer, unsigned short seqnum)
+{
+    if (!raop_buffer->stats_started || raop_buffer->stats_resync) {
+        raop_buffer->expected++;
+        metrics_add(METRIC_AUDIO_PACKETS_EXPECTED, 1);
+        if (raop_buffer->stats_started && seqnum < raop_buffer->max_seqnum &&
+            seqnum_cmp(seqnum, raop_buffer->max_seqnum) > 0) {
+            raop_buffer->cycles += 0x10000;
+        }
+        raop_buffer->max_seqnum = seqnum;
+        raop_buffer->stats_started = 1;
+        raop_buffer->stats_resync = 0;
+    } else if (seqnum_cmp(seqnum, raop_buffer->max_seqnum) > 0) {
+        unsigned short delta = seqnum - raop_buffer->max_seqnum;
+        raop_buffer->expected += delta;
+        metrics_add(METRIC_AUDIO_PACKETS_EXPECTED, delta);
+        if (seqnum < raop_buffer->max_seqnum) {
+            raop_buffer->cycles += 0x10000;
+        }
+        raop_buffer->max_seqnum = seqnum;
+    }
+    raop_buffer->received++;
+}
+
+void
+raop_buffer_take_stats(raop_buffer_t *raop_buffer, raop_buffer_stats_t *stats)
+{
+    assert(raop_buffer);
 
-#ifdef DUMP_AUDIO
-static FILE* file_aac = NULL;
-static FILE* file_source = NULL;
-static FILE* file_keyiv = NULL;
-#endif
+    stats->extended_max_seqnum = raop_buffer->cycles + raop_buffer->max_seqnum;
+    stats->expected = raop_buffer->expected;
+    stats->received = raop_buffer->received;
+    stats->cumulative_lost = (int32_t) (raop_buffer->expected - raop_buffer->received);
+
+    uint32_t expected_interval = raop_buffer->expected - raop_buffer->expected_prior;
+    uint32_t received_interval = raop_buffer->received - raop_buffer->received_prior;
+    int32_t lost_interval = (int32_t) (expected_interval - received_interval);
+    stats->fraction_lost = (expected_interval == 0 || lost_interval <= 0) ? 0 :
+                           (uint8_t) (((uint64_t) lost_interval << 8) / expected_interval);
+    raop_buffer->expected_prior = raop_buffer->expected;
+    raop_buffer->received_prior = raop_buffer->received;
+}
 
 
 int
@@ -159,41 +236,23 @@ raop_buffer_decrypt(raop_buffer_t *raop_buffer, unsigned char *data, unsigned ch
 {
     assert(raop_buffer);
     int encryptedlen;
-#ifdef DUMP_AUDIO
-    if (file_aac == NULL) {
-        file_aac = fopen("/home/pi/Airplay.aac", "wb");
-        file_source = fopen("/home/pi/Airplay.source", "wb");
-        file_keyiv = fopen("/home/pi/Airplay.keyiv", "wb");
-    }
-    // Undecrypted file
-    if (file_source != NULL) {
-        fwrite(&data[12], payloadsize, 1, file_source);
-    }
-#endif
 
     encryptedlen = payload_size / 16*16;
     memset(output, 0, payload_size);
-    // Need to be initialized internally
-    aes_ctx_t *aes_ctx_audio = aes_cbc_init(raop_buffer->aeskey, raop_buffer->aesiv, AES_DECRYPT);
-    aes_cbc_decrypt(aes_ctx_audio, &data[12], output, encryptedlen);
-    aes_cbc_destroy(aes_ctx_audio);
+    // Every packet is encrypted starting from the session IV
+    aes_cbc_reset_iv(raop_buffer->aes_ctx, raop_buffer->aesiv);
+    aes_cbc_decrypt(raop_buffer->aes_ctx, &data[12], output, encryptedlen);
 
     memcpy(output + encryptedlen, &data[12 + encryptedlen], payload_size - encryptedlen);
     *outputlen = payload_size;
 
-#ifdef DUMP_AUDIO
-    // Decrypted file
-    if (file_aac != NULL) {
-        fwrite(output, payloadsize, 1, file_aac);
-    }
-#endif
-
     return 1;
 }
 
 int
 raop_buffer_enqueue(raop_buffer_t *raop_buffer, unsigned char *data, unsigned short datalen, uint64_t timestamp, int use_seqnum) {
     assert(raop_buffer);
+    perf_counters_begin();
 
     /* Check packet data length is valid */
     if (datalen < 12 || datalen > RAOP_PACKET_LEN) {
@@ -214,18 +273,25 @@ raop_buffer_enqueue(raop_buffer_t *raop_buffer, unsigned char *data, unsigned sh
 
     /* If this packet is too late, just skip it */
     if (!raop_buffer->is_empty && seqnum_cmp(seqnum, raop_buffer->first_seqnum) < 0) {
+        metrics_add(METRIC_AUDIO_PACKETS_LATE, 1);
         return 0;
     }
 
     /* Check that there is always space in the buffer, otherwise flush */
-    if (seqnum_cmp(seqnum, raop_buffer->first_seqnum + RAOP_BUFFER_LENGTH) >= 0) {
+    if (seqnum_cmp(seqnum, raop_buffer->first_seqnum + raop_buffer->length) >= 0) {
         raop_buffer_flush(raop_buffer, seqnum);
     }
 
     /* Get entry corresponding our seqnum */
-    raop_buffer_entry_t *entry = &raop_buffer->entries[seqnum % RAOP_BUFFER_LENGTH];
+    raop_buffer_entry_t *entry = &raop_buffer->entries[seqnum % raop_buffer->length];
     if (entry->filled && seqnum_cmp(entry->seqnum, seqnum) == 0) {
         /* Packet resend, we can safely ignore */
+        metrics_add(METRIC_AUDIO_PACKETS_DUPLICATE, 1);
+        return 0;
+    }
+    if (entry->lent) {
+        /* The slot is still being rendered, which only happens if release was forgotten */
+        logger_log(raop_buffer->logger, LOGGER_WARNING, "raop_buffer dropping packet %d, slot still lent out", seqnum);
         return 0;
     }
 
@@ -234,9 +300,10 @@ raop_buffer_enqueue(raop_buffer_t *raop_buffer, unsigned char *data, unsigned sh
     entry->timestamp = timestamp;
     entry->filled = 1;
 
-    entry->payload_data = malloc(payload_size);
+    perf_counters_mark(PERF_STAGE_AUDIO_ENQUEUE, 1);
     int decrypt_ret = raop_buffer_decrypt(raop_buffer, data, entry->payload_data, payload_size, &entry->payload_size);
     assert(decrypt_ret >= 0);
+    perf_counters_mark(PERF_STAGE_AUDIO_DECRYPT, 1);
     assert(entry->payload_size <= payload_size);
 
     /* Update the raop_buffer seqnums */
@@ -248,12 +315,20 @@ raop_buffer_enqueue(raop_buffer_t *raop_buffer, unsigned char *data, unsigned sh
     if (seqnum_cmp(seqnum, raop_buffer->last_seqnum) > 0) {
         raop_buffer->last_seqnum = seqnum;
     }
+    raop_buffer_update_stats(raop_buffer, seqnum);
+    metrics_add(METRIC_AUDIO_PACKETS, 1);
+    PROBE3(audio_enqueue, seqnum, entry->payload_size, timestamp);
+    // The rest of the bookkeeping, the packet was counted before the decryption
+    perf_counters_mark(PERF_STAGE_AUDIO_ENQUEUE, 0);
     return 1;
 }
 
 void *
-raop_buffer_dequeue(raop_buffer_t *raop_buffer, unsigned int *length, uint64_t *timestamp, int no_resend) {
+raop_buffer_dequeue(raop_buffer_t *raop_buffer, unsigned int *length, uint64_t *timestamp, int no_resend, int *lost) {
     assert(raop_buffer);
+    assert(lost);
+
+    *lost = 0;
 
     /* Calculate number of entries in the current buffer */
     short entry_count = seqnum_cmp(raop_buffer->last_seqnum, raop_buffer->first_seqnum)+1;
@@ -264,65 +339,119 @@ raop_buffer_dequeue(raop_buffer_t *raop_buffer, unsigned int *length, uint64_t *
     }
 
     /* Get the first buffer entry for inspection */
-    raop_buffer_entry_t *entry = &raop_buffer->entries[raop_buffer->first_seqnum % RAOP_BUFFER_LENGTH];
+    raop_buffer_entry_t *entry = &raop_buffer->entries[raop_buffer->first_seqnum % raop_buffer->length];
     if (no_resend) {
         /* If we do no resends, always return the first entry */
     } else if (!entry->filled) {
-        /* Check how much we have space left in the buffer */
-        if (entry_count < RAOP_BUFFER_LENGTH) {
+        /* Wait for the resend as long as the jitter estimate says it may still arrive */
+        if (entry_count < raop_buffer->target_depth) {
             /* Return nothing and hope resend gets on time */
             return NULL;
         }
-        /* Risk of buffer overrun, return empty buffer */
+        /* Waited long enough or risk of buffer overrun, skip the missing entry */
     }
 
     /* Update buffer and validate entry */
+    unsigned short seqnum = raop_buffer->first_seqnum;
     raop_buffer->first_seqnum += 1;
+    entry->resend_time = 0;
     if (!entry->filled) {
+        metrics_add(METRIC_AUDIO_PACKETS_LOST, 1);
+        PROBE3(audio_dequeue, seqnum, -1, entry->timestamp);
+        *lost = 1;
         return NULL;
     }
     entry->filled = 0;
+    PROBE3(audio_dequeue, seqnum, entry->payload_size, entry->timestamp);
 
-    /* Return entry payload buffer */
+    /* Lend the entry payload buffer until raop_buffer_release */
     *timestamp = entry->timestamp;
     *length = entry->payload_size;
     entry->payload_size = 0;
-    void* data = entry->payload_data;
-    entry->payload_data = NULL;
-    return data;
+    entry->lent = 1;
+    return entry->payload_data;
 }
 
-void raop_buffer_handle_resends(raop_buffer_t *raop_buffer, raop_resend_cb_t resend_cb, void *opaque) {
+void
+raop_buffer_release(raop_buffer_t *raop_buffer, void *payload) {
+    assert(raop_buffer);
+
+    ptrdiff_t offset = (unsigned char *) payload - raop_buffer->slab;
+    assert(offset >= 0 && offset % RAOP_PACKET_LEN == 0);
+    int index = offset / RAOP_PACKET_LEN;
+    assert(index < raop_buffer->length);
+    raop_buffer->entries[index].lent = 0;
+}
+
+void raop_buffer_handle_resends(raop_buffer_t *raop_buffer, raop_resend_cb_t resend_cb, void *opaque,
+                                uint64_t now, uint64_t timeout) {
     assert(raop_buffer);
     assert(resend_cb);
 
-    if (seqnum_cmp(raop_buffer->first_seqnum, raop_buffer->last_seqnum) < 0) {
-        int seqnum, count;
+    if (raop_buffer->is_empty) {
+        return;
+    }
 
-        for (seqnum = raop_buffer->first_seqnum; seqnum_cmp(seqnum, raop_buffer->last_seqnum) < 0; seqnum++) {
-            raop_buffer_entry_t *entry = &raop_buffer->entries[seqnum % RAOP_BUFFER_LENGTH];
-            if (entry->filled) {
-                break;
+    /* Gaps a few packets apart go out as one request, the duplicates are dropped on arrival */
+    unsigned short request_seqnum = 0;
+    int request_count = 0;
+    int skipped = 0;
+    unsigned short seqnum;
+    for (seqnum = raop_buffer->first_seqnum; seqnum_cmp(seqnum, raop_buffer->last_seqnum) < 0; seqnum++) {
+        raop_buffer_entry_t *entry = &raop_buffer->entries[seqnum % raop_buffer->length];
+        if (entry->filled || (entry->resend_time && now - entry->resend_time < timeout)) {
+            /* Received, or asked for recently enough that the resend may still be on its way */
+            if (request_count && ++skipped > RAOP_BUFFER_RESEND_MERGE) {
+                resend_cb(opaque, request_seqnum, request_count);
+                request_count = 0;
             }
+            continue;
         }
-        if (seqnum_cmp(seqnum, raop_buffer->first_seqnum) == 0) {
-            return;
+        entry->resend_time = now;
+        if (!request_count) {
+            request_seqnum = seqnum;
+            request_count = 1;
+        } else {
+            request_count += skipped + 1;
         }
-        count = seqnum_cmp(seqnum, raop_buffer->first_seqnum);
-        resend_cb(opaque, raop_buffer->first_seqnum, count);
+        skipped = 0;
+    }
+    if (request_count) {
+        resend_cb(opaque, request_seqnum, request_count);
     }
 }
 
+void raop_buffer_set_target_depth(raop_buffer_t *raop_buffer, int depth) {
+    assert(raop_buffer);
+
+    if (depth < RAOP_BUFFER_MIN_DEPTH) {
+        depth = RAOP_BUFFER_MIN_DEPTH;
+    } else if (depth > raop_buffer->max_depth) {
+        depth = raop_buffer->max_depth;
+    }
+    if (depth != raop_buffer->target_depth) {
+        logger_log(raop_buffer->logger, LOGGER_DEBUG, "raop_buffer target depth %d -> %d packets",
+                   raop_buffer->target_depth, depth);
+        raop_buffer->target_depth = depth;
+        metrics_set(METRIC_AUDIO_BUFFER_DEPTH, depth);
+    }
+}
+
+int raop_buffer_get_length(raop_buffer_t *raop_buffer) {
+    assert(raop_buffer);
+    return raop_buffer->length;
+}
+
 void raop_buffer_flush(raop_buffer_t *raop_buffer, int next_seq) {
     assert(raop_buffer);
 
-    for (int i = 0; i < RAOP_BUFFER_LENGTH; i++) {
-        if (raop_buffer->entries[i].payload_data) {
-            free(raop_buffer->entries[i].payload_data);
-            raop_buffer->entries[i].payload_size = 0;
-        }
+    for (int i = 0; i < raop_buffer->length; i++) {
+        raop_buffer->entries[i].payload_size = 0;
         raop_buffer->entries[i].filled = 0;
+        raop_buffer->entries[i].resend_time = 0;
     }
+    /* The sender skips ahead after a flush, which is no loss */
+    raop_buffer->stats_resync = 1;
     if (next_seq < 0 || next_seq > 0xffff) {
         raop_buffer->is_empty = 1;
     } else {
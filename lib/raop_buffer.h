@@ -18,18 +18,40 @@
 #include "logger.h"
 #include "raop_rtp.h"
 
+/* Default and largest supported jitter buffer length in packets */
+#define RAOP_BUFFER_DEFAULT_LENGTH 32
+#define RAOP_BUFFER_MAX_LENGTH 128
+
 typedef struct raop_buffer_s raop_buffer_t;
 
+/* Receiver statistics as in RTP RFC 3550, Section 6.4.1, for the packets that made it into the buffer */
+typedef struct raop_buffer_stats_s {
+    uint32_t extended_max_seqnum; // Highest seqnum received, with the wraparounds counted above 16 bits
+    uint32_t expected;
+    uint32_t received;
+    int32_t cumulative_lost; // expected - received, packets a flush skipped over are not expected
+    uint8_t fraction_lost; // Lost since the previous raop_buffer_take_stats, in 1/256
+} raop_buffer_stats_t;
+
 typedef int (*raop_resend_cb_t)(void *opaque, unsigned short seqno, unsigned short count);
 
-raop_buffer_t *raop_buffer_init(logger_t *logger,
+raop_buffer_t *raop_buffer_init(logger_t *logger, int max_length,
                                 const unsigned char *aeskey,
                                 const unsigned char *aesiv,
                                 const unsigned char *ecdh_secret);
 int raop_buffer_enqueue(raop_buffer_t *raop_buffer, unsigned char *data, unsigned short datalen, uint64_t timestamp, int use_seqnum);
-void *raop_buffer_dequeue(raop_buffer_t *raop_buffer, unsigned int *length, uint64_t *timestamp, int no_resend);
-void raop_buffer_handle_resends(raop_buffer_t *raop_buffer, raop_resend_cb_t resend_cb, void *opaque);
+/* The returned payload stays owned by the buffer, hand it back with raop_buffer_release when done.
+ * Returns NULL with lost set when the next packet was given up on, the caller may go on dequeuing. */
+void *raop_buffer_dequeue(raop_buffer_t *raop_buffer, unsigned int *length, uint64_t *timestamp, int no_resend, int *lost);
+void raop_buffer_release(raop_buffer_t *raop_buffer, void *payload);
+/* Asks for missing packets not already requested within timeout micro seconds, now is the local time */
+void raop_buffer_handle_resends(raop_buffer_t *raop_buffer, raop_resend_cb_t resend_cb, void *opaque,
+                                uint64_t now, uint64_t timeout);
 void raop_buffer_flush(raop_buffer_t *raop_buffer, int next_seq);
+void raop_buffer_set_target_depth(raop_buffer_t *raop_buffer, int depth);
+int raop_buffer_get_length(raop_buffer_t *raop_buffer);
+/* Fills stats and starts the interval fraction_lost is taken over anew */
+void raop_buffer_take_stats(raop_buffer_t *raop_buffer, raop_buffer_stats_t *stats);
 
 int raop_buffer_decrypt(raop_buffer_t *raop_buffer, unsigned char *data, unsigned char* output,
                         unsigned int datalen, unsigned int *outputlen);
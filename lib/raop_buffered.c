@@ -0,0 +1,654 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "raop_buffered.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+
+#include "compat.h"
+#include "threads.h"
+#include "netutils.h"
+#include "byteutils.h"
+#include "reactor.h"
+#include "crypto.h"
+#include "metrics.h"
+#include "mem_account.h"
+
+/*
+ * Each packet on the stream is a 16 bit big endian length, which counts itself, and an RTP
+ * packet whose payload is sealed with ChaCha20-Poly1305: the ciphertext is followed by the
+ * 16 byte tag and the last 8 bytes of the 12 byte nonce, the header's timestamp and SSRC
+ * are the additional data. The sequence number takes the 24 bits after the first byte.
+ */
+#define RAOP_BUFFERED_HEADER_LEN 12
+#define RAOP_BUFFERED_TRAILER_LEN (CHACHA20_POLY1305_TAG_SIZE + 8)
+#define RAOP_BUFFERED_MIN_PACKET (RAOP_BUFFERED_HEADER_LEN + RAOP_BUFFERED_TRAILER_LEN)
+#define RAOP_BUFFERED_SEQ_MASK 0xffffff
+
+/* Frames the queue holds at least, and the encoded size audioBufferSize assumes for each */
+#define RAOP_BUFFERED_MIN_DEPTH 64
+#define RAOP_BUFFERED_FRAME_BYTES 768
+/* Frames handed over between two looks at the flush and volume requests */
+#define RAOP_BUFFERED_MAX_BATCH 64
+
+typedef struct {
+    unsigned char *data;
+    int capacity;
+    int len;
+    uint32_t seq;
+    uint32_t rtp_time;
+} raop_buffered_slot_t;
+
+struct raop_buffered_s {
+    logger_t *logger;
+    raop_callbacks_t callbacks;
+    raop_ntp_t *ntp;
+    /* Session the play thread charges its allocations to, see mem_account.h */
+    int mem_session;
+    audio_format_t format;
+    chacha_ctx_t *cipher;
+
+    /* Watches the listening socket, then the accepted stream */
+    reactor_t *reactor;
+    int listen_sock;
+    unsigned short data_lport;
+
+    thread_handle_t thread_recv;
+    thread_handle_t thread_play;
+    /* Packets the receive thread took in, see raop_buffered_get_received_packets */
+    unsigned int received_packets;
+
+    /* MUTEX LOCKED VARIABLES START */
+    mutex_handle_t mutex;
+    /* Signalled for the playout thread while it is idle, and for the receiver when room frees up */
+    cond_handle_t play_cond;
+    cond_handle_t space_cond;
+    int running;
+    int joined;
+    int play_idle;
+
+    /* The frames queued, in order, from head on */
+    raop_buffered_slot_t *slots;
+    int depth;
+    int head;
+    int count;
+
+    int anchored;
+    int rate;
+    uint32_t anchor_rtp_time;
+    uint64_t anchor_remote_time;
+
+    /* A flush the playout thread has yet to apply, and the range the receiver still drops */
+    int flush_pending;
+    /* Set for the playout thread to flush the renderer as well */
+    int flush_renderer;
+    int flush_active;
+    int flush_from_seq;
+    uint32_t flush_until_seq;
+
+    float volume;
+    int volume_changed;
+    /* MUTEX LOCKED VARIABLES END */
+};
+
+/* Whether a comes before b in 24 bit sequence numbers */
+static int
+raop_buffered_seq_before(uint32_t a, uint32_t b)
+{
+    return ((b - a) & RAOP_BUFFERED_SEQ_MASK) != 0 && ((b - a) & RAOP_BUFFERED_SEQ_MASK) < 0x800000;
+}
+
+static int
+raop_buffered_in_flush(raop_buffered_t *raop_buffered, uint32_t seq)
+{
+    if (raop_buffered->flush_from_seq >= 0 && raop_buffered_seq_before(seq, raop_buffered->flush_from_seq)) {
+        return 0;
+    }
+    return raop_buffered_seq_before(seq, raop_buffered->flush_until_seq);
+}
+
+raop_buffered_t *
+raop_buffered_init(logger_t *logger, raop_callbacks_t *callbacks, raop_ntp_t *ntp,
+                   const unsigned char *shk, const audio_format_t *format, int seconds)
+{
+    raop_buffered_t *raop_buffered;
+
+    assert(logger);
+    assert(callbacks);
+    assert(ntp);
+    assert(shk);
+    assert(format);
+
+    raop_buffered = calloc(1, sizeof(raop_buffered_t));
+    if (!raop_buffered) {
+        return NULL;
+    }
+    raop_buffered->logger = logger;
+    raop_buffered->mem_session = mem_account_session();
+    raop_buffered->ntp = ntp;
+    memcpy(&raop_buffered->callbacks, callbacks, sizeof(raop_callbacks_t));
+    raop_buffered->format = *format;
+    raop_buffered->listen_sock = -1;
+    raop_buffered->volume = -144.0f;
+
+    raop_buffered->depth = seconds * format->sample_rate / (format->frame_samples > 0 ? format->frame_samples : 1024) + 1;
+    if (raop_buffered->depth < RAOP_BUFFERED_MIN_DEPTH) {
+        raop_buffered->depth = RAOP_BUFFERED_MIN_DEPTH;
+    }
+    raop_buffered->slots = calloc(raop_buffered->depth, sizeof(raop_buffered_slot_t));
+    raop_buffered->reactor = reactor_init(logger);
+    if (!raop_buffered->slots || !raop_buffered->reactor) {
+        reactor_destroy(raop_buffered->reactor);
+        free(raop_buffered->slots);
+        free(raop_buffered);
+        return NULL;
+    }
+    raop_buffered->cipher = chacha20_poly1305_init(shk);
+
+    MUTEX_CREATE(raop_buffered->mutex);
+    COND_CREATE(raop_buffered->play_cond);
+    COND_CREATE(raop_buffered->space_cond);
+    raop_buffered->joined = 1;
+    return raop_buffered;
+}
+
+void
+raop_buffered_destroy(raop_buffered_t *raop_buffered)
+{
+    if (raop_buffered) {
+        raop_buffered_stop(raop_buffered);
+        MUTEX_DESTROY(raop_buffered->mutex);
+        COND_DESTROY(raop_buffered->play_cond);
+        COND_DESTROY(raop_buffered->space_cond);
+        for (int i = 0; i < raop_buffered->depth; i++) {
+            free(raop_buffered->slots[i].data);
+        }
+        free(raop_buffered->slots);
+        chacha20_poly1305_destroy(raop_buffered->cipher);
+        reactor_destroy(raop_buffered->reactor);
+        free(raop_buffered);
+    }
+}
+
+/* Wakes the playout thread if it sleeps without a deadline, called mutex locked */
+static void
+raop_buffered_wake_play(raop_buffered_t *raop_buffered)
+{
+    if (raop_buffered->play_idle) {
+        COND_SIGNAL(raop_buffered->play_cond);
+    }
+}
+
+/* The slot for the next packet, waits for room. Returns NULL once stopped. */
+static raop_buffered_slot_t *
+raop_buffered_reserve(raop_buffered_t *raop_buffered, int len)
+{
+    raop_buffered_slot_t *slot = NULL;
+
+    MUTEX_LOCK(raop_buffered->mutex);
+    while (raop_buffered->running && raop_buffered->count == raop_buffered->depth) {
+        // Not reading on is what makes TCP hold the sender back
+        COND_WAIT(raop_buffered->space_cond, raop_buffered->mutex);
+    }
+    if (raop_buffered->running) {
+        slot = &raop_buffered->slots[(raop_buffered->head + raop_buffered->count) % raop_buffered->depth];
+    }
+    MUTEX_UNLOCK(raop_buffered->mutex);
+
+    // Past head + count the slot is the receiver's alone
+    if (slot && slot->capacity < len) {
+        unsigned char *grown = realloc(slot->data, len);
+        if (!grown) {
+            logger_log(raop_buffered->logger, LOGGER_ERR, "raop_buffered could not get a %d byte packet buffer", len);
+            return NULL;
+        }
+        slot->data = grown;
+        slot->capacity = len;
+    }
+    return slot;
+}
+
+/* Queues the packet received into the reserved slot */
+static void
+raop_buffered_commit(raop_buffered_t *raop_buffered, raop_buffered_slot_t *slot, int len)
+{
+    slot->len = len;
+    slot->seq = byteutils_get_int_be(slot->data, 0) & RAOP_BUFFERED_SEQ_MASK;
+    slot->rtp_time = byteutils_get_int_be(slot->data, 4);
+    metrics_add(METRIC_AUDIO_PACKETS, 1);
+
+    MUTEX_LOCK(raop_buffered->mutex);
+    if (raop_buffered->flush_active && raop_buffered_in_flush(raop_buffered, slot->seq)) {
+        // Sent before the sender saw its flush
+        MUTEX_UNLOCK(raop_buffered->mutex);
+        return;
+    }
+    if (raop_buffered->flush_active && !raop_buffered_seq_before(slot->seq, raop_buffered->flush_until_seq)) {
+        raop_buffered->flush_active = 0;
+    }
+    // A flush since the reservation may have moved the end of the queue
+    raop_buffered_slot_t *tail = &raop_buffered->slots[(raop_buffered->head + raop_buffered->count) % raop_buffered->depth];
+    if (tail != slot) {
+        raop_buffered_slot_t tmp = *tail;
+        *tail = *slot;
+        *slot = tmp;
+    }
+    raop_buffered->count++;
+    metrics_set(METRIC_AUDIO_BUFFER_DEPTH, raop_buffered->count);
+    raop_buffered_wake_play(raop_buffered);
+    MUTEX_UNLOCK(raop_buffered->mutex);
+}
+
+static THREAD_RETVAL
+raop_buffered_thread_recv(void *arg)
+{
+    raop_buffered_t *raop_buffered = arg;
+    assert(raop_buffered);
+
+    int stream_fd = -1;
+    unsigned char length[2];
+    int readstart = 0;
+    raop_buffered_slot_t *slot = NULL;
+    int packet_len = 0;
+    int fatal = 0;
+    int ready[1];
+    int nready;
+
+    while (!fatal && ATOMIC_LOAD(raop_buffered->running)) {
+        nready = reactor_wait(raop_buffered->reactor, ready, 1, -1);
+        if (nready == 0) {
+            /* Woken up, recheck the running state */
+            continue;
+        } else if (nready == -1) {
+            logger_log(raop_buffered->logger, LOGGER_ERR, "raop_buffered error in reactor wait");
+            break;
+        }
+
+        if (stream_fd == -1) {
+            if (!reactor_is_ready(ready, nready, raop_buffered->listen_sock)) {
+                continue;
+            }
+            struct sockaddr_storage saddr;
+            socklen_t saddrlen = sizeof(saddr);
+            stream_fd = accept(raop_buffered->listen_sock, (struct sockaddr *)&saddr, &saddrlen);
+            if (stream_fd == -1) {
+                logger_log(raop_buffered->logger, LOGGER_ERR, "raop_buffered error in accept %d %s", errno, strerror(errno));
+                break;
+            }
+            logger_log(raop_buffered->logger, LOGGER_DEBUG, "raop_buffered accepted the audio stream");
+            reactor_remove(raop_buffered->reactor, raop_buffered->listen_sock);
+            int flags = fcntl(stream_fd, F_GETFL, 0);
+            if (flags == -1 || fcntl(stream_fd, F_SETFL, flags | O_NONBLOCK) == -1 ||
+                reactor_add(raop_buffered->reactor, stream_fd) < 0) {
+                logger_log(raop_buffered->logger, LOGGER_ERR, "raop_buffered could not watch the stream socket");
+                break;
+            }
+            readstart = 0;
+            continue;
+        }
+
+        // Takes in everything the socket holds, packet by packet, until it would block
+        while (1) {
+            int ret;
+            if (slot == NULL) {
+                ret = recv(stream_fd, length + readstart, sizeof(length) - readstart, 0);
+            } else {
+                ret = recv(stream_fd, slot->data + readstart, packet_len - readstart, 0);
+            }
+            if (ret == 0) {
+                logger_log(raop_buffered->logger, LOGGER_INFO, "raop_buffered audio stream closed");
+                reactor_remove(raop_buffered->reactor, stream_fd);
+                closesocket(stream_fd);
+                stream_fd = -1;
+                slot = NULL;
+                readstart = 0;
+                /* Go back to waiting for a new connection */
+                reactor_add(raop_buffered->reactor, raop_buffered->listen_sock);
+                break;
+            } else if (ret == -1) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    logger_log(raop_buffered->logger, LOGGER_ERR, "raop_buffered error in recv: %d", errno);
+                    fatal = 1;
+                }
+                break;
+            }
+
+            readstart += ret;
+            if (slot == NULL) {
+                if (readstart < (int) sizeof(length)) continue;
+                packet_len = byteutils_get_short_be(length, 0) - (int) sizeof(length);
+                if (packet_len < RAOP_BUFFERED_MIN_PACKET) {
+                    logger_log(raop_buffered->logger, LOGGER_ERR, "raop_buffered got a %d byte packet, the stream is out of step", packet_len);
+                    fatal = 1;
+                    break;
+                }
+                slot = raop_buffered_reserve(raop_buffered, packet_len);
+                if (!slot) {
+                    fatal = 1;
+                    break;
+                }
+                readstart = 0;
+            } else if (readstart == packet_len) {
+                raop_buffered_commit(raop_buffered, slot, packet_len);
+                ATOMIC_FETCH_ADD(raop_buffered->received_packets, 1);
+                slot = NULL;
+                readstart = 0;
+            }
+        }
+    }
+
+    if (stream_fd != -1) {
+        reactor_remove(raop_buffered->reactor, stream_fd);
+        closesocket(stream_fd);
+    }
+    logger_log(raop_buffered->logger, LOGGER_DEBUG, "raop_buffered exiting receive thread");
+    return 0;
+}
+
+/* Local time at which a frame plays, called mutex locked with an anchor set */
+static uint64_t
+raop_buffered_get_pts(raop_buffered_t *raop_buffered, uint32_t rtp_time)
+{
+    int64_t offset = (int64_t) (int32_t) (rtp_time - raop_buffered->anchor_rtp_time) * 1000000 / raop_buffered->format.sample_rate;
+    return raop_ntp_convert_remote_time(raop_buffered->ntp, raop_buffered->anchor_remote_time + offset);
+}
+
+/* Drops the queued frames of a flush, called mutex locked by the playout thread */
+static void
+raop_buffered_apply_flush(raop_buffered_t *raop_buffered)
+{
+    int kept = 0;
+    for (int i = 0; i < raop_buffered->count; i++) {
+        raop_buffered_slot_t *slot = &raop_buffered->slots[(raop_buffered->head + i) % raop_buffered->depth];
+        if (raop_buffered_in_flush(raop_buffered, slot->seq)) {
+            continue;
+        }
+        // Slots are only moved towards head, swapping keeps every buffer owned once
+        raop_buffered_slot_t *to = &raop_buffered->slots[(raop_buffered->head + kept) % raop_buffered->depth];
+        if (to != slot) {
+            raop_buffered_slot_t tmp = *to;
+            *to = *slot;
+            *slot = tmp;
+        }
+        kept++;
+    }
+    raop_buffered->count = kept;
+    raop_buffered->flush_pending = 0;
+    metrics_set(METRIC_AUDIO_BUFFER_DEPTH, raop_buffered->count);
+    COND_SIGNAL(raop_buffered->space_cond);
+}
+
+/* Decrypts the frame in place and renders it, lost if it does not authenticate */
+static void
+raop_buffered_render(raop_buffered_t *raop_buffered, raop_buffered_slot_t *slot, uint64_t pts)
+{
+    unsigned char nonce[CHACHA20_POLY1305_NONCE_SIZE];
+    aac_decode_struct aac_data;
+    int len = slot->len - RAOP_BUFFERED_MIN_PACKET;
+
+    memset(nonce, 0, 4);
+    memcpy(nonce + 4, slot->data + slot->len - 8, 8);
+    aac_data.data = slot->data + RAOP_BUFFERED_HEADER_LEN;
+    aac_data.data_len = len;
+    aac_data.pts = pts;
+    aac_data.format = &raop_buffered->format;
+    if (chacha20_poly1305_decrypt(raop_buffered->cipher, nonce, slot->data + 4, 8, aac_data.data, aac_data.data,
+                                  len, slot->data + slot->len - RAOP_BUFFERED_TRAILER_LEN) < 0) {
+        logger_log(raop_buffered->logger, LOGGER_WARNING, "raop_buffered could not authenticate frame %u", slot->seq);
+        metrics_add(METRIC_AUDIO_PACKETS_LOST, 1);
+        aac_data.data = NULL;
+        aac_data.data_len = 0;
+    }
+    raop_buffered->callbacks.audio_process(raop_buffered->callbacks.cls, raop_buffered->ntp, &aac_data);
+}
+
+static THREAD_RETVAL
+raop_buffered_thread_play(void *arg)
+{
+    raop_buffered_t *raop_buffered = arg;
+    assert(raop_buffered);
+
+    mem_account_enter(raop_buffered->mem_session);
+    MUTEX_LOCK(raop_buffered->mutex);
+    while (raop_buffered->running) {
+        if (raop_buffered->flush_pending) {
+            raop_buffered_apply_flush(raop_buffered);
+        }
+        if (raop_buffered->flush_renderer) {
+            raop_buffered->flush_renderer = 0;
+            if (raop_buffered->callbacks.audio_flush) {
+                MUTEX_UNLOCK(raop_buffered->mutex);
+                raop_buffered->callbacks.audio_flush(raop_buffered->callbacks.cls);
+                MUTEX_LOCK(raop_buffered->mutex);
+            }
+            continue;
+        }
+        if (raop_buffered->volume_changed) {
+            float volume = raop_buffered->volume;
+            raop_buffered->volume_changed = 0;
+            if (raop_buffered->callbacks.audio_set_volume) {
+                MUTEX_UNLOCK(raop_buffered->mutex);
+                raop_buffered->callbacks.audio_set_volume(raop_buffered->callbacks.cls, volume);
+                MUTEX_LOCK(raop_buffered->mutex);
+            }
+            continue;
+        }
+        if (!raop_buffered->anchored || !raop_buffered->rate || !raop_buffered->count) {
+            raop_buffered->play_idle = 1;
+            COND_WAIT(raop_buffered->play_cond, raop_buffered->mutex);
+            raop_buffered->play_idle = 0;
+            continue;
+        }
+
+        // The batch is every frame due before the lookahead, only the receiver adds to the queue meanwhile
+        uint64_t now = raop_ntp_get_local_time(raop_buffered->ntp);
+        uint64_t until = now + RAOP_BUFFERED_LOOKAHEAD_MS * 1000;
+        uint64_t pts[RAOP_BUFFERED_MAX_BATCH];
+        int batch = 0;
+        while (batch < raop_buffered->count && batch < RAOP_BUFFERED_MAX_BATCH) {
+            raop_buffered_slot_t *slot = &raop_buffered->slots[(raop_buffered->head + batch) % raop_buffered->depth];
+            pts[batch] = raop_buffered_get_pts(raop_buffered, slot->rtp_time);
+            if (pts[batch] > until) {
+                break;
+            }
+            batch++;
+        }
+        int head = raop_buffered->head;
+
+        if (batch > 0) {
+            MUTEX_UNLOCK(raop_buffered->mutex);
+            for (int i = 0; i < batch; i++) {
+                raop_buffered_slot_t *slot = &raop_buffered->slots[(head + i) % raop_buffered->depth];
+                if (pts[i] < now) {
+                    metrics_add(METRIC_AUDIO_PACKETS_LATE, 1);
+                    continue;
+                }
+                raop_buffered_render(raop_buffered, slot, pts[i]);
+            }
+            MUTEX_LOCK(raop_buffered->mutex);
+            raop_buffered->head = (head + batch) % raop_buffered->depth;
+            raop_buffered->count -= batch;
+            metrics_set(METRIC_AUDIO_BUFFER_DEPTH, raop_buffered->count);
+            COND_SIGNAL(raop_buffered->space_cond);
+            if (batch == RAOP_BUFFERED_MAX_BATCH) {
+                // More is due right away, after a start or a stall
+                continue;
+            }
+        }
+
+        // Sleep until the next batch, anything else that comes up signals
+        struct timespec deadline;
+        clock_gettime(COND_CLOCK, &deadline);
+        deadline.tv_nsec += RAOP_BUFFERED_BATCH_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        raop_buffered->play_idle = 1;
+        COND_TIMEDWAIT(raop_buffered->play_cond, raop_buffered->mutex, &deadline);
+        raop_buffered->play_idle = 0;
+    }
+    MUTEX_UNLOCK(raop_buffered->mutex);
+
+    logger_log(raop_buffered->logger, LOGGER_DEBUG, "raop_buffered exiting playout thread");
+    return 0;
+}
+
+int
+raop_buffered_start(raop_buffered_t *raop_buffered, int use_ipv6, unsigned short *data_lport)
+{
+    unsigned short dport = 0;
+    int dsock;
+
+    assert(raop_buffered);
+
+    MUTEX_LOCK(raop_buffered->mutex);
+    if (raop_buffered->running || !raop_buffered->joined) {
+        MUTEX_UNLOCK(raop_buffered->mutex);
+        return -1;
+    }
+    dsock = netutils_init_socket(&dport, use_ipv6, 0);
+    if (dsock == -1 || listen(dsock, 1) < 0 || reactor_add(raop_buffered->reactor, dsock) < 0) {
+        logger_log(raop_buffered->logger, LOGGER_ERR, "raop_buffered initializing the data socket failed");
+        if (dsock != -1) closesocket(dsock);
+        MUTEX_UNLOCK(raop_buffered->mutex);
+        return -1;
+    }
+    // Accepted streams inherit the marking, all we send on them are ACKs
+    if (netutils_apply_qos(dsock, NETUTILS_QOS_AUDIO) < 0) {
+        logger_log(raop_buffered->logger, LOGGER_WARNING, "raop_buffered could not mark the data socket for QoS");
+    }
+    raop_buffered->listen_sock = dsock;
+    raop_buffered->data_lport = dport;
+    if (data_lport) *data_lport = dport;
+
+    ATOMIC_STORE(raop_buffered->running, 1);
+    raop_buffered->joined = 0;
+    THREAD_CREATE(raop_buffered->thread_play, raop_buffered_thread_play, raop_buffered);
+    if (raop_buffered->thread_play && thread_apply_role(raop_buffered->thread_play, THREAD_ROLE_ADECODE) < 0) {
+        logger_log(raop_buffered->logger, LOGGER_WARNING, "Could not apply the scheduling settings of the audio decode thread");
+    }
+    THREAD_CREATE(raop_buffered->thread_recv, raop_buffered_thread_recv, raop_buffered);
+    if (raop_buffered->thread_recv && thread_apply_role(raop_buffered->thread_recv, THREAD_ROLE_AUDIO) < 0) {
+        logger_log(raop_buffered->logger, LOGGER_WARNING, "Could not apply the scheduling settings of the audio thread");
+    }
+    MUTEX_UNLOCK(raop_buffered->mutex);
+
+    logger_log(raop_buffered->logger, LOGGER_INFO, "raop_buffered holds up to %d frames of audio", raop_buffered->depth);
+    return 0;
+}
+
+int
+raop_buffered_get_buffer_size(raop_buffered_t *raop_buffered)
+{
+    assert(raop_buffered);
+    return raop_buffered->depth * RAOP_BUFFERED_FRAME_BYTES;
+}
+
+unsigned int
+raop_buffered_get_received_packets(raop_buffered_t *raop_buffered)
+{
+    assert(raop_buffered);
+    return ATOMIC_LOAD(raop_buffered->received_packets);
+}
+
+void
+raop_buffered_set_anchor(raop_buffered_t *raop_buffered, int rate, uint32_t rtp_time, uint64_t remote_time)
+{
+    assert(raop_buffered);
+
+    MUTEX_LOCK(raop_buffered->mutex);
+    if (raop_buffered->rate && !rate) {
+        // Whatever the renderer holds already would play on past the pause
+        raop_buffered->flush_renderer = 1;
+    }
+    raop_buffered->rate = rate;
+    if (rate) {
+        raop_buffered->anchored = 1;
+        raop_buffered->anchor_rtp_time = rtp_time;
+        raop_buffered->anchor_remote_time = remote_time;
+    }
+    raop_buffered_wake_play(raop_buffered);
+    MUTEX_UNLOCK(raop_buffered->mutex);
+}
+
+void
+raop_buffered_flush(raop_buffered_t *raop_buffered, int from_seq, uint32_t until_seq)
+{
+    assert(raop_buffered);
+
+    MUTEX_LOCK(raop_buffered->mutex);
+    raop_buffered->flush_pending = 1;
+    raop_buffered->flush_active = 1;
+    raop_buffered->flush_from_seq = from_seq >= 0 ? (from_seq & RAOP_BUFFERED_SEQ_MASK) : -1;
+    raop_buffered->flush_until_seq = until_seq & RAOP_BUFFERED_SEQ_MASK;
+    // Only a flush of everything up to a point touches what the renderer holds
+    raop_buffered->flush_renderer |= (from_seq < 0);
+    raop_buffered_wake_play(raop_buffered);
+    MUTEX_UNLOCK(raop_buffered->mutex);
+}
+
+void
+raop_buffered_set_volume(raop_buffered_t *raop_buffered, float volume)
+{
+    assert(raop_buffered);
+
+    if (volume > 0.0f) {
+        volume = 0.0f;
+    } else if (volume < -144.0f) {
+        volume = -144.0f;
+    }
+    MUTEX_LOCK(raop_buffered->mutex);
+    raop_buffered->volume = volume;
+    raop_buffered->volume_changed = 1;
+    raop_buffered_wake_play(raop_buffered);
+    MUTEX_UNLOCK(raop_buffered->mutex);
+}
+
+void
+raop_buffered_stop(raop_buffered_t *raop_buffered)
+{
+    assert(raop_buffered);
+
+    MUTEX_LOCK(raop_buffered->mutex);
+    if (raop_buffered->joined) {
+        MUTEX_UNLOCK(raop_buffered->mutex);
+        return;
+    }
+    ATOMIC_STORE(raop_buffered->running, 0);
+    COND_BROADCAST(raop_buffered->play_cond);
+    COND_BROADCAST(raop_buffered->space_cond);
+    MUTEX_UNLOCK(raop_buffered->mutex);
+
+    reactor_wakeup(raop_buffered->reactor);
+    THREAD_JOIN(raop_buffered->thread_recv);
+    THREAD_JOIN(raop_buffered->thread_play);
+
+    if (raop_buffered->listen_sock != -1) {
+        reactor_remove(raop_buffered->reactor, raop_buffered->listen_sock);
+        closesocket(raop_buffered->listen_sock);
+        raop_buffered->listen_sock = -1;
+    }
+
+    MUTEX_LOCK(raop_buffered->mutex);
+    raop_buffered->count = 0;
+    raop_buffered->joined = 1;
+    MUTEX_UNLOCK(raop_buffered->mutex);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef RAOP_BUFFERED_H
+#define RAOP_BUFFERED_H
+
+/* For raop_callbacks_t */
+#include "raop.h"
+#include "logger.h"
+#include "raop_ntp.h"
+
+/*
+ * Receiver of the buffered audio stream (SETUP type 103), which senders use for music
+ * instead of the realtime stream when latency does not matter. The sender pushes the audio
+ * over TCP as fast as we take it, seconds ahead of its play time, so this keeps a deep queue
+ * of encrypted frames and lets TCP hold the sender back once it is full. A playout thread
+ * sleeps most of the time and wakes up every RAOP_BUFFERED_BATCH_MS to decrypt and hand
+ * the renderer a batch of the frames due within the next RAOP_BUFFERED_LOOKAHEAD_MS, so
+ * a network outage of up to the queue depth goes unheard.
+ *
+ * Play times come from SETRATEANCHORTIME, which ties an RTP time to the sender's clock;
+ * nothing plays before the first anchor with a rate of 1.
+ */
+typedef struct raop_buffered_s raop_buffered_t;
+
+#define RAOP_BUFFERED_SHK_LEN 32
+#define RAOP_BUFFERED_BATCH_MS 250
+#define RAOP_BUFFERED_LOOKAHEAD_MS 500
+
+/* shk is the stream key of the SETUP, seconds how much audio the queue holds */
+raop_buffered_t *raop_buffered_init(logger_t *logger, raop_callbacks_t *callbacks, raop_ntp_t *ntp,
+                                    const unsigned char *shk, const audio_format_t *format, int seconds);
+
+/* Starts listening, returns -1 on failure. data_lport is the port for the SETUP reply. */
+int raop_buffered_start(raop_buffered_t *raop_buffered, int use_ipv6, unsigned short *data_lport);
+/* The audioBufferSize to reply with, in bytes */
+int raop_buffered_get_buffer_size(raop_buffered_t *raop_buffered);
+/* Packets received so far, wraps around. Safe to call from any thread. */
+unsigned int raop_buffered_get_received_packets(raop_buffered_t *raop_buffered);
+
+/* SETRATEANCHORTIME, rtp_time plays at remote_time of the sender's clock. Rate 0 pauses. */
+void raop_buffered_set_anchor(raop_buffered_t *raop_buffered, int rate, uint32_t rtp_time, uint64_t remote_time);
+/* FLUSHBUFFERED, drops the frames from from_seq (or everything queued for -1) up to before until_seq */
+void raop_buffered_flush(raop_buffered_t *raop_buffered, int from_seq, uint32_t until_seq);
+void raop_buffered_set_volume(raop_buffered_t *raop_buffered, float volume);
+
+void raop_buffered_stop(raop_buffered_t *raop_buffered);
+void raop_buffered_destroy(raop_buffered_t *raop_buffered);
+
+#endif //RAOP_BUFFERED_H
@@ -19,26 +19,66 @@
 #include "utils.h"
 #include <ctype.h>
 #include <stdlib.h>
-#include <plist/plist.h>
+#include "bplist.h"
+
+/* Headers that are the same on every reply, added preformatted */
+#define RAOP_HEADER_LINE(line) line, sizeof(line) - 1
+static const char raop_header_server[] = "Server: AirTunes/220.68\r\n";
+static const char raop_header_audio_latency[] = "Audio-Latency: 11025\r\n";
+static const char raop_header_audio_jack_status[] = "Audio-Jack-Status: connected; type=analog\r\n";
+
+/* Nesting the sender stats are logged to, deeper containers are left out */
+#define RAOP_FORMAT_PLIST_DEPTH 8
 
 typedef void (*raop_handler_t)(raop_conn_t *, http_request_t *,
                                http_response_t *, char **, int *);
 
+/* Scales the display down to fit, keeping the aspect ratio */
 static void
-raop_handler_info(raop_conn_t *conn,
-                  http_request_t *request, http_response_t *response,
-                  char **response_data, int *response_datalen)
+raop_info_fit_display(int *width, int *height, int max_width, int max_height)
 {
-    assert(conn->raop->dnssd);
-
-    int airplay_txt_len = 0;
-    const char *airplay_txt = dnssd_get_airplay_txt(conn->raop->dnssd, &airplay_txt_len);
+    if (*width > max_width) {
+        *height = *height * max_width / *width;
+        *width = max_width;
+    }
+    if (*height > max_height) {
+        *width = *width * max_height / *height;
+        *height = max_height;
+    }
+}
 
-    int name_len = 0;
-    const char *name = dnssd_get_name(conn->raop->dnssd, &name_len);
+/*
+ * The display GET /info advertises, at most 1280x720 at 30 Hz under thermal pressure, and no
+ * more than the decoder capacity left. That is met by stepping down to 30 Hz first, which
+ * keeps the picture sharp, and then through a few heights, so that the cached reply is not
+ * rebuilt for every change of the measured loads.
+ */
+static void
+raop_info_display(raop_t *raop, int pressure, uint64_t budget, int *width, int *height, double *refresh_rate)
+{
+    *width = raop->display_width;
+    *height = raop->display_height;
+    *refresh_rate = raop->display_refresh_rate;
+    if (pressure) {
+        raop_info_fit_display(width, height, RAOP_DISPLAY_PRESSURE_WIDTH, RAOP_DISPLAY_PRESSURE_HEIGHT);
+        if (*refresh_rate > RAOP_DISPLAY_PRESSURE_REFRESH_RATE) {
+            *refresh_rate = RAOP_DISPLAY_PRESSURE_REFRESH_RATE;
+        }
+    }
+    if ((double) *width * *height * *refresh_rate > budget && *refresh_rate > RAOP_DISPLAY_BUDGET_REFRESH_RATE) {
+        *refresh_rate = RAOP_DISPLAY_BUDGET_REFRESH_RATE;
+    }
+    int steps = sizeof(raop_display_budget_heights) / sizeof(raop_display_budget_heights[0]);
+    for (int i = 0; i < steps && (double) *width * *height * *refresh_rate > budget; i++) {
+        raop_info_fit_display(width, height, *width, raop_display_budget_heights[i]);
+    }
+}
 
-    int hw_addr_raw_len = 0;
-    const char *hw_addr_raw = dnssd_get_hw_addr(conn->raop->dnssd, &hw_addr_raw_len);
+/* Builds the binary plist answering GET /info */
+static void
+raop_info_build(raop_t *raop, const char *airplay_txt, int airplay_txt_len, const char *name,
+                const char *hw_addr_raw, int hw_addr_raw_len, char **info_data, uint32_t *info_datalen)
+{
 
     char *hw_addr = calloc(1, 3 * hw_addr_raw_len);
     int hw_addr_len = utils_hwaddr_airplay(hw_addr, 3 * hw_addr_raw_len, hw_addr_raw, hw_addr_raw_len);
@@ -46,124 +86,161 @@ raop_handler_info(raop_conn_t *conn,
     int pk_len = 0;
     char *pk = utils_parse_hex(AIRPLAY_PK, strlen(AIRPLAY_PK), &pk_len);
 
-    plist_t r_node = plist_new_dict();
-
-    plist_t txt_airplay_node = plist_new_data(airplay_txt, airplay_txt_len);
-    plist_dict_set_item(r_node, "txtAirPlay", txt_airplay_node);
-
-    plist_t features_node = plist_new_uint((uint64_t) 0x1E << 32 | 0x5A7FFFF7);
-    plist_dict_set_item(r_node, "features", features_node);
-
-    plist_t name_node = plist_new_string(name);
-    plist_dict_set_item(r_node, "name", name_node);
-
-    plist_t audio_formats_node = plist_new_array();
-    plist_t audio_format_0_node = plist_new_dict();
-    plist_t audio_format_0_type_node = plist_new_uint(100);
-    plist_t audio_format_0_audio_input_formats_node = plist_new_uint(67108860);
-    plist_t audio_format_0_audio_output_formats_node = plist_new_uint(67108860);
-    plist_dict_set_item(audio_format_0_node, "type", audio_format_0_type_node);
-    plist_dict_set_item(audio_format_0_node, "audioInputFormats", audio_format_0_audio_input_formats_node);
-    plist_dict_set_item(audio_format_0_node, "audioOutputFormats", audio_format_0_audio_output_formats_node);
-    plist_array_append_item(audio_formats_node, audio_format_0_node);
-    plist_t audio_format_1_node = plist_new_dict();
-    plist_t audio_format_1_type_node = plist_new_uint(101);
-    plist_t audio_format_1_audio_input_formats_node = plist_new_uint(67108860);
-    plist_t audio_format_1_audio_output_formats_node = plist_new_uint(67108860);
-    plist_dict_set_item(audio_format_1_node, "type", audio_format_1_type_node);
-    plist_dict_set_item(audio_format_1_node, "audioInputFormats", audio_format_1_audio_input_formats_node);
-    plist_dict_set_item(audio_format_1_node, "audioOutputFormats", audio_format_1_audio_output_formats_node);
-    plist_array_append_item(audio_formats_node, audio_format_1_node);
-    plist_dict_set_item(r_node, "audioFormats", audio_formats_node);
-
-    plist_t pi_node = plist_new_string(AIRPLAY_PI);
-    plist_dict_set_item(r_node, "pi", pi_node);
-
-    plist_t vv_node = plist_new_uint(strtol(AIRPLAY_VV, NULL, 10));
-    plist_dict_set_item(r_node, "vv", vv_node);
-
-    plist_t status_flags_node = plist_new_uint(68);
-    plist_dict_set_item(r_node, "statusFlags", status_flags_node);
-
-    plist_t keep_alive_low_power_node = plist_new_bool(1);
-    plist_dict_set_item(r_node, "keepAliveLowPower", keep_alive_low_power_node);
-
-    plist_t source_version_node = plist_new_string(AIRPLAY_SRCVERS);
-    plist_dict_set_item(r_node, "sourceVersion", source_version_node);
-
-    plist_t pk_node = plist_new_data(pk, pk_len);
-    plist_dict_set_item(r_node, "pk", pk_node);
-
-    plist_t keep_alive_send_stats_as_body_node = plist_new_bool(1);
-    plist_dict_set_item(r_node, "keepAliveSendStatsAsBody", keep_alive_send_stats_as_body_node);
-
-    plist_t device_id_node = plist_new_string(hw_addr);
-    plist_dict_set_item(r_node, "deviceID", device_id_node);
-
-    plist_t audio_latencies_node = plist_new_array();
-    plist_t audio_latencies_0_node = plist_new_dict();
-    plist_t audio_latencies_0_output_latency_micros_node = plist_new_uint(0);
-    plist_t audio_latencies_0_type_node = plist_new_uint(100);
-    plist_t audio_latencies_0_audio_type_node = plist_new_string("default");
-    plist_t audio_latencies_0_input_latency_micros_node = plist_new_uint(0);
-    plist_dict_set_item(audio_latencies_0_node, "outputLatencyMicros", audio_latencies_0_output_latency_micros_node);
-    plist_dict_set_item(audio_latencies_0_node, "type", audio_latencies_0_type_node);
-    plist_dict_set_item(audio_latencies_0_node, "audioType", audio_latencies_0_audio_type_node);
-    plist_dict_set_item(audio_latencies_0_node, "inputLatencyMicros", audio_latencies_0_input_latency_micros_node);
-    plist_array_append_item(audio_latencies_node, audio_latencies_0_node);
-    plist_t audio_latencies_1_node = plist_new_dict();
-    plist_t audio_latencies_1_output_latency_micros_node = plist_new_uint(0);
-    plist_t audio_latencies_1_type_node = plist_new_uint(101);
-    plist_t audio_latencies_1_audio_type_node = plist_new_string("default");
-    plist_t audio_latencies_1_input_latency_micros_node = plist_new_uint(0);
-    plist_dict_set_item(audio_latencies_1_node, "outputLatencyMicros", audio_latencies_1_output_latency_micros_node);
-    plist_dict_set_item(audio_latencies_1_node, "type", audio_latencies_1_type_node);
-    plist_dict_set_item(audio_latencies_1_node, "audioType", audio_latencies_1_audio_type_node);
-    plist_dict_set_item(audio_latencies_1_node, "inputLatencyMicros", audio_latencies_1_input_latency_micros_node);
-    plist_array_append_item(audio_latencies_node, audio_latencies_1_node);
-    plist_dict_set_item(r_node, "audioLatencies", audio_latencies_node);
-
-    plist_t model_node = plist_new_string(GLOBAL_MODEL);
-    plist_dict_set_item(r_node, "model", model_node);
-
-    plist_t mac_address_node = plist_new_string(hw_addr);
-    plist_dict_set_item(r_node, "macAddress", mac_address_node);
-
-    plist_t displays_node = plist_new_array();
-    plist_t displays_0_node = plist_new_dict();
-    plist_t displays_0_uuid_node = plist_new_string("e0ff8a27-6738-3d56-8a16-cc53aacee925");
-    plist_t displays_0_width_physical_node = plist_new_uint(0);
-    plist_t displays_0_height_physical_node = plist_new_uint(0);
-    plist_t displays_0_width_node = plist_new_uint(1920);
-    plist_t displays_0_height_node = plist_new_uint(1080);
-    plist_t displays_0_width_pixels_node = plist_new_uint(1920);
-    plist_t displays_0_height_pixels_node = plist_new_uint(1080);
-    plist_t displays_0_rotation_node = plist_new_bool(0);
-    plist_t displays_0_refresh_rate_node = plist_new_real(1.0 / 60.0);
-    plist_t displays_0_overscanned_node = plist_new_bool(1);
-    plist_t displays_0_features = plist_new_uint(14);
-
-    plist_dict_set_item(displays_0_node, "uuid", displays_0_uuid_node);
-    plist_dict_set_item(displays_0_node, "widthPhysical", displays_0_width_physical_node);
-    plist_dict_set_item(displays_0_node, "heightPhysical", displays_0_height_physical_node);
-    plist_dict_set_item(displays_0_node, "width", displays_0_width_node);
-    plist_dict_set_item(displays_0_node, "height", displays_0_height_node);
-    plist_dict_set_item(displays_0_node, "widthPixels", displays_0_width_pixels_node);
-    plist_dict_set_item(displays_0_node, "heightPixels", displays_0_height_pixels_node);
-    plist_dict_set_item(displays_0_node, "rotation", displays_0_rotation_node);
-    plist_dict_set_item(displays_0_node, "refreshRate", displays_0_refresh_rate_node);
-    plist_dict_set_item(displays_0_node, "overscanned", displays_0_overscanned_node);
-    plist_dict_set_item(displays_0_node, "features", displays_0_features);
-    plist_array_append_item(displays_node, displays_0_node);
-    plist_dict_set_item(r_node, "displays", displays_node);
-
-    plist_to_bin(r_node, response_data, (uint32_t *) response_datalen);
-    logger_log(conn->raop->logger, LOGGER_DEBUG, "INFO len = %d", response_datalen);
-    http_response_add_header(response, "Content-Type", "application/x-apple-binary-plist");
+    bplist_writer_t writer_arena;
+    bplist_writer_t *writer = &writer_arena;
+    bplist_writer_init(writer);
+    int r_node = bplist_new_dict(writer);
+
+    bplist_dict_set(writer, r_node, "txtAirPlay", bplist_new_data(writer, airplay_txt, airplay_txt_len));
+
+    /* Bit 40 offers the buffered audio stream, bit 42 mirroring in H.265 */
+    uint64_t features = (uint64_t) 0x1E << 32 | 0x5A7FFFF7;
+    if (raop->buffered_audio_seconds > 0) {
+        features |= (uint64_t) 1 << 40;
+    }
+    if (raop->hevc) {
+        features |= (uint64_t) 1 << 42;
+    }
+    bplist_dict_set(writer, r_node, "features", bplist_new_uint(writer, features));
+    bplist_dict_set(writer, r_node, "name", bplist_new_string(writer, name));
+
+    int audio_formats_node = bplist_new_array(writer);
+    for (int type = 100; type <= 101; type++) {
+        int audio_format_node = bplist_new_dict(writer);
+        bplist_dict_set(writer, audio_format_node, "type", bplist_new_uint(writer, type));
+        bplist_dict_set(writer, audio_format_node, "audioInputFormats", bplist_new_uint(writer, raop->audio_formats));
+        bplist_dict_set(writer, audio_format_node, "audioOutputFormats", bplist_new_uint(writer, raop->audio_formats));
+        bplist_array_append(writer, audio_formats_node, audio_format_node);
+    }
+    bplist_dict_set(writer, r_node, "audioFormats", audio_formats_node);
+
+    bplist_dict_set(writer, r_node, "pi", bplist_new_string(writer, AIRPLAY_PI));
+    bplist_dict_set(writer, r_node, "vv", bplist_new_uint(writer, strtol(AIRPLAY_VV, NULL, 10)));
+    bplist_dict_set(writer, r_node, "statusFlags", bplist_new_uint(writer, 68));
+    bplist_dict_set(writer, r_node, "keepAliveLowPower", bplist_new_bool(writer, 1));
+    bplist_dict_set(writer, r_node, "sourceVersion", bplist_new_string(writer, AIRPLAY_SRCVERS));
+    bplist_dict_set(writer, r_node, "pk", bplist_new_data(writer, pk, pk_len));
+    bplist_dict_set(writer, r_node, "keepAliveSendStatsAsBody", bplist_new_bool(writer, 1));
+    bplist_dict_set(writer, r_node, "deviceID", bplist_new_string(writer, hw_addr));
+
+    int audio_latencies_node = bplist_new_array(writer);
+    for (int type = 100; type <= 101; type++) {
+        int audio_latency_node = bplist_new_dict(writer);
+        bplist_dict_set(writer, audio_latency_node, "outputLatencyMicros",
+                        bplist_new_uint(writer, raop->info_audio_output_latency));
+        bplist_dict_set(writer, audio_latency_node, "type", bplist_new_uint(writer, type));
+        bplist_dict_set(writer, audio_latency_node, "audioType", bplist_new_string(writer, "default"));
+        bplist_dict_set(writer, audio_latency_node, "inputLatencyMicros", bplist_new_uint(writer, 0));
+        bplist_array_append(writer, audio_latencies_node, audio_latency_node);
+    }
+    bplist_dict_set(writer, r_node, "audioLatencies", audio_latencies_node);
+
+    bplist_dict_set(writer, r_node, "model", bplist_new_string(writer, GLOBAL_MODEL));
+    bplist_dict_set(writer, r_node, "macAddress", bplist_new_string(writer, hw_addr));
+
+    int display_width = raop->info_display_width;
+    int display_height = raop->info_display_height;
+    double display_refresh_rate = raop->info_display_refresh_rate;
+
+    int displays_node = bplist_new_array(writer);
+    int display_node = bplist_new_dict(writer);
+    bplist_dict_set(writer, display_node, "uuid", bplist_new_string(writer, "e0ff8a27-6738-3d56-8a16-cc53aacee925"));
+    bplist_dict_set(writer, display_node, "widthPhysical", bplist_new_uint(writer, 0));
+    bplist_dict_set(writer, display_node, "heightPhysical", bplist_new_uint(writer, 0));
+    bplist_dict_set(writer, display_node, "width", bplist_new_uint(writer, display_width));
+    bplist_dict_set(writer, display_node, "height", bplist_new_uint(writer, display_height));
+    bplist_dict_set(writer, display_node, "widthPixels", bplist_new_uint(writer, display_width));
+    bplist_dict_set(writer, display_node, "heightPixels", bplist_new_uint(writer, display_height));
+    bplist_dict_set(writer, display_node, "rotation", bplist_new_bool(writer, 0));
+    bplist_dict_set(writer, display_node, "refreshRate", bplist_new_real(writer, 1.0 / display_refresh_rate));
+    bplist_dict_set(writer, display_node, "maxFPS", bplist_new_uint(writer, (int) (display_refresh_rate + 0.5)));
+    bplist_dict_set(writer, display_node, "overscanned", bplist_new_bool(writer, 1));
+    bplist_dict_set(writer, display_node, "features", bplist_new_uint(writer, 14));
+    bplist_array_append(writer, displays_node, display_node);
+    bplist_dict_set(writer, r_node, "displays", displays_node);
+
+    bplist_write(writer, r_node, info_data, info_datalen);
     free(pk);
     free(hw_addr);
 }
 
+/*
+ * Senders poll /info and every device on the network probing the receiver asks for it too, so
+ * the plist is built once and kept in the raop_t. It only depends on the dnssd record, name and
+ * hardware address, the display advertised and the audio output latency besides constants, and is
+ * rebuilt if any of these no longer match the copy they were built from. Only ever used from the
+ * httpd thread.
+ */
+static void
+raop_handler_info(raop_conn_t *conn,
+                  http_request_t *request, http_response_t *response,
+                  char **response_data, int *response_datalen)
+{
+    raop_t *raop = conn->raop;
+    assert(raop->dnssd);
+
+    int airplay_txt_len = 0;
+    const char *airplay_txt = dnssd_get_airplay_txt(raop->dnssd, &airplay_txt_len);
+
+    int name_len = 0;
+    const char *name = dnssd_get_name(raop->dnssd, &name_len);
+
+    int hw_addr_raw_len = 0;
+    const char *hw_addr_raw = dnssd_get_hw_addr(raop->dnssd, &hw_addr_raw_len);
+
+    int display_width, display_height;
+    double display_refresh_rate;
+    raop_info_display(raop, ATOMIC_LOAD(raop->thermal_pressure), raop_decode_remaining(raop),
+                      &display_width, &display_height, &display_refresh_rate);
+    int audio_output_latency = ATOMIC_LOAD(raop->audio_output_latency);
+    int key_len = airplay_txt_len + name_len + hw_addr_raw_len + 3 * sizeof(int);
+    if (!raop->info_data || raop->info_display_width != display_width ||
+        raop->info_display_height != display_height || raop->info_display_refresh_rate != display_refresh_rate ||
+        raop->info_audio_output_latency != audio_output_latency || raop->info_key_len != key_len ||
+        memcmp(raop->info_key, &airplay_txt_len, sizeof(int)) ||
+        memcmp(raop->info_key + sizeof(int), &name_len, sizeof(int)) ||
+        memcmp(raop->info_key + 2 * sizeof(int), &hw_addr_raw_len, sizeof(int)) ||
+        memcmp(raop->info_key + 3 * sizeof(int), airplay_txt, airplay_txt_len) ||
+        memcmp(raop->info_key + 3 * sizeof(int) + airplay_txt_len, name, name_len) ||
+        memcmp(raop->info_key + 3 * sizeof(int) + airplay_txt_len + name_len, hw_addr_raw, hw_addr_raw_len)) {
+        char *key = malloc(key_len);
+        if (!key) {
+            return;
+        }
+        memcpy(key, &airplay_txt_len, sizeof(int));
+        memcpy(key + sizeof(int), &name_len, sizeof(int));
+        memcpy(key + 2 * sizeof(int), &hw_addr_raw_len, sizeof(int));
+        memcpy(key + 3 * sizeof(int), airplay_txt, airplay_txt_len);
+        memcpy(key + 3 * sizeof(int) + airplay_txt_len, name, name_len);
+        memcpy(key + 3 * sizeof(int) + airplay_txt_len + name_len, hw_addr_raw, hw_addr_raw_len);
+
+        free(raop->info_key);
+        free(raop->info_data);
+        raop->info_key = key;
+        raop->info_key_len = key_len;
+        raop->info_display_width = display_width;
+        raop->info_display_height = display_height;
+        raop->info_display_refresh_rate = display_refresh_rate;
+        raop->info_audio_output_latency = audio_output_latency;
+        raop->info_data = NULL;
+        raop->info_datalen = 0;
+        raop_info_build(raop, airplay_txt, airplay_txt_len, name, hw_addr_raw, hw_addr_raw_len,
+                        &raop->info_data, &raop->info_datalen);
+        logger_log(raop->logger, LOGGER_DEBUG, "Built INFO, len = %u", raop->info_datalen);
+        if (!raop->info_data) {
+            return;
+        }
+    }
+
+    *response_data = malloc(raop->info_datalen);
+    if (!*response_data) {
+        return;
+    }
+    memcpy(*response_data, raop->info_data, raop->info_datalen);
+    *response_datalen = raop->info_datalen;
+    http_response_add_header(response, "Content-Type", "application/x-apple-binary-plist");
+}
+
 static void
 raop_handler_pairsetup(raop_conn_t *conn,
                        http_request_t *request, http_response_t *response,
@@ -178,6 +255,9 @@ raop_handler_pairsetup(raop_conn_t *conn,
         logger_log(conn->raop->logger, LOGGER_ERR, "Invalid pair-setup data");
         return;
     }
+    if (!conn_get_pairing(conn)) {
+        return;
+    }
 
     pairing_get_public_key(conn->raop->pairing, public_key);
     pairing_session_set_setup_status(conn->pairing);
@@ -195,7 +275,7 @@ raop_handler_pairverify(raop_conn_t *conn,
                         http_request_t *request, http_response_t *response,
                         char **response_data, int *response_datalen)
 {
-    if (pairing_session_check_handshake_status(conn->pairing)) {
+    if (!conn_get_pairing(conn) || pairing_session_check_handshake_status(conn->pairing)) {
         return;
     }
     unsigned char public_key[X25519_KEY_SIZE];
@@ -243,6 +323,9 @@ raop_handler_pairverify(raop_conn_t *conn,
                 http_response_set_disconnect(response, 1);
                 return;
             }
+            if (pairing_session_is_resumed(conn->pairing)) {
+                logger_log(conn->raop->logger, LOGGER_DEBUG, "Pair-verify from a known sender");
+            }
             http_response_add_header(response, "Content-Type", "application/octet-stream");
             break;
     }
@@ -257,6 +340,9 @@ raop_handler_fpsetup(raop_conn_t *conn,
     int datalen;
 
     data = (unsigned char *) http_request_get_data(request, &datalen);
+    if (!conn_get_fairplay(conn)) {
+        return;
+    }
     if (datalen == 16) {
         *response_data = malloc(142);
         if (*response_data) {
@@ -309,6 +395,7 @@ raop_handler_setup(raop_conn_t *conn,
 
     const char *data;
     int data_len;
+    uint64_t setup_time = raop_ntp_get_local_time(conn->raop_ntp);
 
     data = http_request_get_data(request, &data_len);
 
@@ -333,16 +420,21 @@ raop_handler_setup(raop_conn_t *conn,
     }
 
     // Parsing bplist
-    plist_t req_root_node = NULL;
-    plist_from_bin(data, data_len, &req_root_node);
-    plist_t req_streams_node = plist_dict_get_item(req_root_node, "streams");
-    plist_t req_eiv_node = plist_dict_get_item(req_root_node, "eiv");
-    plist_t req_ekey_node = plist_dict_get_item(req_root_node, "ekey");
+    bplist_t req;
+    bplist_parse(&req, data, data_len);
+    int req_root_node = bplist_root(&req);
+    int req_streams_node = bplist_dict_get(&req, req_root_node, "streams");
+    const unsigned char *eiv = NULL, *ekey = NULL;
+    int eiv_len = 0, ekey_len = 0;
 
     // For the response
-    plist_t res_root_node = plist_new_dict();
+    bplist_writer_t writer;
+    bplist_writer_init(&writer);
+    int res_root_node = bplist_new_dict(&writer);
 
-    if (PLIST_IS_DATA(req_eiv_node) && PLIST_IS_DATA(req_ekey_node)) {
+    if (!bplist_get_data(&req, bplist_dict_get(&req, req_root_node, "eiv"), &eiv, &eiv_len) &&
+        !bplist_get_data(&req, bplist_dict_get(&req, req_root_node, "ekey"), &ekey, &ekey_len) &&
+        eiv_len >= 16 && ekey_len >= 72) {
         // The first SETUP call that initializes keys and timing
 
         unsigned char aesiv[16];
@@ -350,65 +442,109 @@ raop_handler_setup(raop_conn_t *conn,
         logger_log(conn->raop->logger, LOGGER_DEBUG, "SETUP 1");
 
         // First setup
-        char* eiv = NULL;
-        uint64_t eiv_len = 0;
-        plist_get_data_val(req_eiv_node, &eiv, &eiv_len);
         memcpy(aesiv, eiv, 16);
-        logger_log(conn->raop->logger, LOGGER_DEBUG, "eiv_len = %llu", eiv_len);
-        char* ekey = NULL;
-        uint64_t ekey_len = 0;
-        plist_get_data_val(req_ekey_node, &ekey, &ekey_len);
-        logger_log(conn->raop->logger, LOGGER_DEBUG, "ekey_len = %llu", ekey_len);
+        logger_log(conn->raop->logger, LOGGER_DEBUG, "eiv_len = %d", eiv_len);
+        logger_log(conn->raop->logger, LOGGER_DEBUG, "ekey_len = %d", ekey_len);
 
         // ekey is 72 bytes, aeskey is 16 bytes
-        int ret = fairplay_decrypt(conn->fairplay, (unsigned char*) ekey, aeskey);
+        int ret = conn_get_fairplay(conn) ? fairplay_decrypt(conn->fairplay, ekey, aeskey) : -1;
         logger_log(conn->raop->logger, LOGGER_DEBUG, "fairplay_decrypt ret = %d", ret);
+        if (conn->callbacks.session_milestone) {
+            conn->callbacks.session_milestone(conn->callbacks.cls, RAOP_MILESTONE_SETUP, setup_time);
+            conn->callbacks.session_milestone(conn->callbacks.cls, RAOP_MILESTONE_FAIRPLAY,
+                                              raop_ntp_get_local_time(conn->raop_ntp));
+        }
         unsigned char ecdh_secret[X25519_KEY_SIZE];
-        pairing_get_ecdh_secret_key(conn->pairing, ecdh_secret);
+        memset(ecdh_secret, 0, sizeof(ecdh_secret));
+        if (conn_get_pairing(conn)) {
+            pairing_get_ecdh_secret_key(conn->pairing, ecdh_secret);
+        }
+        if (trace_enabled()) {
+            trace_session_keys_t keys;
+            memcpy(keys.aeskey, aeskey, sizeof(keys.aeskey));
+            memcpy(keys.aesiv, aesiv, sizeof(keys.aesiv));
+            memcpy(keys.ecdh_secret, ecdh_secret, sizeof(keys.ecdh_secret));
+            trace_record(TRACE_RECORD_SESSION_KEYS, setup_time, &keys, sizeof(keys), NULL, 0);
+        }
 
         // Time port
-        uint64_t timing_rport;
-        plist_t time_note = plist_dict_get_item(req_root_node, "timingPort");
-        plist_get_uint_val(time_note, &timing_rport);
+        uint64_t timing_rport = 0;
+        bplist_get_uint(&req, bplist_dict_get(&req, req_root_node, "timingPort"), &timing_rport);
         logger_log(conn->raop->logger, LOGGER_DEBUG, "timing_rport = %llu", timing_rport);
 
-        unsigned short timing_lport;
+        // Senders that ask for PTP have no NTP server, their clock is followed with raop_ptp instead
+        int use_ptp = 0;
+        char timing_protocol[16];
+        if (bplist_get_string(&req, bplist_dict_get(&req, req_root_node, "timingProtocol"),
+                              timing_protocol, sizeof(timing_protocol)) >= 0) {
+            logger_log(conn->raop->logger, LOGGER_DEBUG, "timingProtocol = %s", timing_protocol);
+            use_ptp = !strcmp(timing_protocol, "PTP");
+        }
+
+        // Identifies the sender across sessions, to pick up its clock where the last one left it
+        if (bplist_get_string(&req, bplist_dict_get(&req, req_root_node, "deviceID"),
+                              conn->device_id, sizeof(conn->device_id)) < 0) {
+            conn->device_id[0] = '\0';
+        }
+        conn->timing_ptp = use_ptp;
+
+        unsigned short timing_lport = 0;
         conn->raop_ntp = raop_ntp_init(conn->raop->logger, conn->remote, conn->remotelen, timing_rport);
-        raop_ntp_start(conn->raop_ntp, &timing_lport);
+        raop_ntp_set_scope_id(conn->raop_ntp, netutils_get_scope_id(conn->local, conn->locallen));
+        raop_ntp_set_poll_interval(conn->raop_ntp, conn->raop->ntp_poll_min, conn->raop->ntp_poll_max);
+        conn_seed_clock(conn);
+        if (use_ptp) {
+            conn->raop_ptp = raop_ptp_init(conn->raop->logger, conn->raop_ntp, conn->local, conn->locallen);
+            if (!conn->raop_ptp || raop_ptp_start(conn->raop_ptp) < 0) {
+                logger_log(conn->raop->logger, LOGGER_ERR, "PTP timing unavailable, audio and video will not be in sync");
+            }
+        } else {
+            raop_ntp_start(conn->raop_ntp, &timing_lport);
+        }
 
-        conn->raop_rtp = raop_rtp_init(conn->raop->logger, &conn->raop->callbacks, conn->raop_ntp, conn->remote, conn->remotelen, aeskey, aesiv, ecdh_secret);
-        conn->raop_rtp_mirror = raop_rtp_mirror_init(conn->raop->logger, &conn->raop->callbacks, conn->raop_ntp, conn->remote, conn->remotelen, aeskey, ecdh_secret);
+        conn->raop_rtp = raop_rtp_init(conn->raop->logger, &conn->callbacks, conn->raop_ntp, conn->remote, conn->remotelen, aeskey, aesiv, ecdh_secret, conn->raop->audio_buffer_length);
+        conn->raop_rtp_mirror = raop_rtp_mirror_init(conn->raop->logger, &conn->callbacks, conn->raop_ntp, conn->remote, conn->remotelen, aeskey, ecdh_secret, conn->raop->video_queue_depth, conn->raop->video_latency_budget);
+        if (conn->raop_rtp_mirror) {
+            raop_rtp_mirror_set_socket_options(conn->raop_rtp_mirror, conn->raop->mirror_receive_buffer,
+                                               conn->raop->mirror_busy_poll);
+            raop_rtp_mirror_set_playout(conn->raop_rtp_mirror, conn->raop->video_playout_delay);
+            raop_rtp_mirror_set_genlock(conn->raop_rtp_mirror, conn->raop->genlock);
+        }
 
-        plist_t res_event_port_node = plist_new_uint(conn->raop->port);
-        plist_t res_timing_port_node = plist_new_uint(timing_lport);
-        plist_dict_set_item(res_root_node, "timingPort", res_timing_port_node);
-        plist_dict_set_item(res_root_node, "eventPort", res_event_port_node);
+        if (!use_ptp) {
+            bplist_dict_set(&writer, res_root_node, "timingPort", bplist_new_uint(&writer, timing_lport));
+        }
+        bplist_dict_set(&writer, res_root_node, "eventPort", bplist_new_uint(&writer, conn->raop->port));
 
         logger_log(conn->raop->logger, LOGGER_DEBUG, "eport = %d, tport = %d", conn->raop->port, timing_lport);
     }
 
     // Process stream setup requests
-    if (PLIST_IS_ARRAY(req_streams_node)) {
-        plist_t res_streams_node = plist_new_array();
+    if (bplist_get_type(&req, req_streams_node) == BPLIST_ARRAY) {
+        int res_streams_node = bplist_new_array(&writer);
 
-        int count = plist_array_get_size(req_streams_node);
+        int count = bplist_array_get_size(&req, req_streams_node);
         for (int i = 0; i < count; i++) {
-            plist_t req_stream_node = plist_array_get_item(req_streams_node, i);
-            plist_t req_stream_type_node = plist_dict_get_item(req_stream_node, "type");
-            uint64_t type;
-            plist_get_uint_val(req_stream_type_node, &type);
+            int req_stream_node = bplist_array_get_item(&req, req_streams_node, i);
+            uint64_t type = 0;
+            bplist_get_uint(&req, bplist_dict_get(&req, req_stream_node, "type"), &type);
             logger_log(conn->raop->logger, LOGGER_DEBUG, "type = %llu", type);
 
             switch (type) {
                 case 110: {
                     // Mirroring
                     unsigned short dport = 0;
-                    plist_t stream_id_node = plist_dict_get_item(req_stream_node, "streamConnectionID");
-                    uint64_t stream_connection_id;
-                    plist_get_uint_val(stream_id_node, &stream_connection_id);
+                    uint64_t stream_connection_id = 0;
+                    bplist_get_uint(&req, bplist_dict_get(&req, req_stream_node, "streamConnectionID"),
+                                    &stream_connection_id);
                     logger_log(conn->raop->logger, LOGGER_DEBUG, "streamConnectionID = %llu", stream_connection_id);
 
-                    if (conn->raop_rtp_mirror) {
+                    if (conn->raop_rtp_mirror && !conn_start_video(conn)) {
+                        logger_log(conn->raop->logger, LOGGER_ERR, "No video renderer for the mirror, ending the connection");
+                        http_response_set_disconnect(response, 1);
+                    } else if (conn->raop_rtp_mirror) {
+                        trace_record(TRACE_RECORD_MIRROR_STREAM, raop_ntp_get_local_time(conn->raop_ntp),
+                                     &stream_connection_id, sizeof(stream_connection_id), NULL, 0);
                         raop_rtp_init_mirror_aes(conn->raop_rtp_mirror, stream_connection_id);
                         raop_rtp_start_mirror(conn->raop_rtp_mirror, use_udp, &dport);
                         logger_log(conn->raop->logger, LOGGER_DEBUG, "Mirroring initialized successfully");
@@ -417,12 +553,10 @@ raop_handler_setup(raop_conn_t *conn,
                         http_response_set_disconnect(response, 1);
                     }
 
-                    plist_t res_stream_node = plist_new_dict();
-                    plist_t res_stream_data_port_node = plist_new_uint(dport);
-                    plist_t res_stream_type_node = plist_new_uint(110);
-                    plist_dict_set_item(res_stream_node, "dataPort", res_stream_data_port_node);
-                    plist_dict_set_item(res_stream_node, "type", res_stream_type_node);
-                    plist_array_append_item(res_streams_node, res_stream_node);
+                    int res_stream_node = bplist_new_dict(&writer);
+                    bplist_dict_set(&writer, res_stream_node, "dataPort", bplist_new_uint(&writer, dport));
+                    bplist_dict_set(&writer, res_stream_node, "type", bplist_new_uint(&writer, 110));
+                    bplist_array_append(&writer, res_streams_node, res_stream_node);
 
                     break;
                 } case 96: {
@@ -430,7 +564,28 @@ raop_handler_setup(raop_conn_t *conn,
 
                     unsigned short cport = 0, dport = 0;
 
+                    // The sender picked one of the audioFormats of GET /info, missing keys read as 0
+                    uint64_t audio_format = 0, ct = 0, sr = 0, spf = 0;
+                    bplist_get_uint(&req, bplist_dict_get(&req, req_stream_node, "audioFormat"), &audio_format);
+                    bplist_get_uint(&req, bplist_dict_get(&req, req_stream_node, "ct"), &ct);
+                    bplist_get_uint(&req, bplist_dict_get(&req, req_stream_node, "sr"), &sr);
+                    bplist_get_uint(&req, bplist_dict_get(&req, req_stream_node, "spf"), &spf);
+                    audio_format_t format;
+                    if (audio_format_from_setup(audio_format, ct, sr, spf, &format) < 0) {
+                        logger_log(conn->raop->logger, LOGGER_ERR, "SETUP asks for unknown audio format 0x%llx, ct = %llu",
+                                   audio_format, ct);
+                        audio_format_init_default(&format);
+                    } else if (!(audio_format_get_mask(&format) & conn->raop->audio_formats)) {
+                        logger_log(conn->raop->logger, LOGGER_WARNING, "SETUP asks for %s at %d Hz, which was not offered",
+                                   audio_format_get_codec_name(format.codec), format.sample_rate);
+                    }
+                    logger_log(conn->raop->logger, LOGGER_INFO, "Audio stream is %s, %d Hz, %d bit, %d samples per frame",
+                               audio_format_get_codec_name(format.codec), format.sample_rate, format.sample_size,
+                               format.frame_samples);
+
                     if (conn->raop_rtp) {
+                        raop_rtp_set_audio_format(conn->raop_rtp, &format);
+                        raop_rtp_set_receiver_reports(conn->raop_rtp, conn->raop->receiver_reports);
                         raop_rtp_start_audio(conn->raop_rtp, use_udp, remote_cport, &cport, &dport);
                         logger_log(conn->raop->logger, LOGGER_DEBUG, "RAOP initialized success");
                     } else {
@@ -438,14 +593,61 @@ raop_handler_setup(raop_conn_t *conn,
                         http_response_set_disconnect(response, 1);
                     }
 
-                    plist_t res_stream_node = plist_new_dict();
-                    plist_t res_stream_data_port_node = plist_new_uint(dport);
-                    plist_t res_stream_control_port_node = plist_new_uint(cport);
-                    plist_t res_stream_type_node = plist_new_uint(96);
-                    plist_dict_set_item(res_stream_node, "dataPort", res_stream_data_port_node);
-                    plist_dict_set_item(res_stream_node, "controlPort", res_stream_control_port_node);
-                    plist_dict_set_item(res_stream_node, "type", res_stream_type_node);
-                    plist_array_append_item(res_streams_node, res_stream_node);
+                    int res_stream_node = bplist_new_dict(&writer);
+                    bplist_dict_set(&writer, res_stream_node, "dataPort", bplist_new_uint(&writer, dport));
+                    bplist_dict_set(&writer, res_stream_node, "controlPort", bplist_new_uint(&writer, cport));
+                    bplist_dict_set(&writer, res_stream_node, "type", bplist_new_uint(&writer, 96));
+                    bplist_array_append(&writer, res_streams_node, res_stream_node);
+
+                    break;
+                }
+
+                case 103: {
+                    // Buffered audio, sent over TCP ahead of time and sealed with the stream key shk
+
+                    unsigned short dport = 0;
+                    int buffer_size = 0;
+
+                    uint64_t audio_format = 0, ct = 0, sr = 0, spf = 0;
+                    bplist_get_uint(&req, bplist_dict_get(&req, req_stream_node, "audioFormat"), &audio_format);
+                    bplist_get_uint(&req, bplist_dict_get(&req, req_stream_node, "ct"), &ct);
+                    bplist_get_uint(&req, bplist_dict_get(&req, req_stream_node, "sr"), &sr);
+                    bplist_get_uint(&req, bplist_dict_get(&req, req_stream_node, "spf"), &spf);
+                    audio_format_t format;
+                    if (audio_format_from_setup(audio_format, ct, sr, spf, &format) < 0) {
+                        logger_log(conn->raop->logger, LOGGER_ERR, "SETUP asks for unknown audio format 0x%llx, ct = %llu",
+                                   audio_format, ct);
+                        audio_format_init_default(&format);
+                    }
+                    logger_log(conn->raop->logger, LOGGER_INFO, "Buffered audio stream is %s, %d Hz, %d samples per frame",
+                               audio_format_get_codec_name(format.codec), format.sample_rate, format.frame_samples);
+
+                    const unsigned char *shk = NULL;
+                    int shk_len = 0;
+                    bplist_get_data(&req, bplist_dict_get(&req, req_stream_node, "shk"), &shk, &shk_len);
+
+                    if (!conn->raop_ntp || conn->raop->buffered_audio_seconds <= 0 || shk_len != RAOP_BUFFERED_SHK_LEN) {
+                        logger_log(conn->raop->logger, LOGGER_ERR, "SETUP of a buffered audio stream that was not offered or has no key");
+                        http_response_set_disconnect(response, 1);
+                    } else {
+                        raop_buffered_destroy(conn->raop_buffered);
+                        conn->raop_buffered = raop_buffered_init(conn->raop->logger, &conn->callbacks, conn->raop_ntp,
+                                                                 shk, &format,
+                                                                 conn->raop->buffered_audio_seconds);
+                        if (!conn->raop_buffered ||
+                            raop_buffered_start(conn->raop_buffered, conn->remotelen == 16, &dport) < 0) {
+                            logger_log(conn->raop->logger, LOGGER_ERR, "Could not start the buffered audio stream");
+                            http_response_set_disconnect(response, 1);
+                        } else {
+                            buffer_size = raop_buffered_get_buffer_size(conn->raop_buffered);
+                        }
+                    }
+
+                    int res_stream_node = bplist_new_dict(&writer);
+                    bplist_dict_set(&writer, res_stream_node, "dataPort", bplist_new_uint(&writer, dport));
+                    bplist_dict_set(&writer, res_stream_node, "type", bplist_new_uint(&writer, 103));
+                    bplist_dict_set(&writer, res_stream_node, "audioBufferSize", bplist_new_uint(&writer, buffer_size));
+                    bplist_array_append(&writer, res_streams_node, res_stream_node);
 
                     break;
                 }
@@ -457,10 +659,10 @@ raop_handler_setup(raop_conn_t *conn,
             }
         }
 
-        plist_dict_set_item(res_root_node, "streams", res_streams_node);
+        bplist_dict_set(&writer, res_root_node, "streams", res_streams_node);
     }
 
-    plist_to_bin(res_root_node, response_data, (uint32_t*) response_datalen);
+    bplist_write(&writer, res_root_node, response_data, (uint32_t*) response_datalen);
     http_response_add_header(response, "Content-Type", "application/x-apple-binary-plist");
 }
 
@@ -529,7 +731,11 @@ raop_handler_set_parameter(raop_conn_t *conn,
             if ((datalen >= 8) && !strncmp(datastr, "volume: ", 8)) {
                 float vol = 0.0;
                 sscanf(datastr+8, "%f", &vol);
-                raop_rtp_set_volume(conn->raop_rtp, vol);
+                if (conn->raop_buffered) {
+                    raop_buffered_set_volume(conn->raop_buffered, vol);
+                } else {
+                    raop_rtp_set_volume(conn->raop_rtp, vol);
+                }
             } else if ((datalen >= 10) && !strncmp(datastr, "progress: ", 10)) {
                 unsigned int start, curr, end;
                 sscanf(datastr+10, "%u/%u/%u", &start, &curr, &end);
@@ -542,14 +748,17 @@ raop_handler_set_parameter(raop_conn_t *conn,
     } else if (!strcmp(content_type, "image/jpeg") || !strcmp(content_type, "image/png")) {
         logger_log(conn->raop->logger, LOGGER_INFO, "Got image data of %d bytes", datalen);
         if (conn->raop_rtp) {
-            raop_rtp_set_coverart(conn->raop_rtp, data, datalen);
+            /* Passed on in the buffer it was received into, it is not copied again */
+            char *coverart = http_request_take_data(request, &datalen);
+            if (coverart) raop_rtp_set_coverart(conn->raop_rtp, coverart, datalen);
         } else {
             logger_log(conn->raop->logger, LOGGER_WARNING, "RAOP not initialized at SET_PARAMETER coverart");
         }
     } else if (!strcmp(content_type, "application/x-dmap-tagged")) {
         logger_log(conn->raop->logger, LOGGER_INFO, "Got metadata of %d bytes", datalen);
         if (conn->raop_rtp) {
-            raop_rtp_set_metadata(conn->raop_rtp, data, datalen);
+            char *metadata = http_request_take_data(request, &datalen);
+            if (metadata) raop_rtp_set_metadata(conn->raop_rtp, metadata, datalen);
         } else {
             logger_log(conn->raop->logger, LOGGER_WARNING, "RAOP not initialized at SET_PARAMETER metadata");
         }
@@ -557,12 +766,180 @@ raop_handler_set_parameter(raop_conn_t *conn,
 }
 
 
+/* Appends the values in a plist as key=value pairs, returns the length of the text so far */
+static int
+raop_handler_format_plist(const bplist_t *plist, int node, const char *key, int depth, char *text, int size, int used)
+{
+    int written = 0;
+    // Containers may refer to themselves in a malformed body
+    if (used >= size - 1 || depth > RAOP_FORMAT_PLIST_DEPTH) {
+        return used;
+    }
+    switch (bplist_get_type(plist, node)) {
+        case BPLIST_DICT: {
+            int count = bplist_dict_get_size(plist, node);
+            for (int i = 0; i < count; i++) {
+                char item_key[64];
+                int item_key_node;
+                int item = bplist_dict_get_entry(plist, node, i, &item_key_node);
+                bplist_get_string(plist, item_key_node, item_key, sizeof(item_key));
+                used = raop_handler_format_plist(plist, item, item_key, depth + 1, text, size, used);
+            }
+            return used;
+        }
+        case BPLIST_ARRAY: {
+            int count = bplist_array_get_size(plist, node);
+            for (int i = 0; i < count; i++) {
+                used = raop_handler_format_plist(plist, bplist_array_get_item(plist, node, i), key, depth + 1,
+                                                 text, size, used);
+            }
+            return used;
+        }
+        case BPLIST_UINT: {
+            uint64_t value = 0;
+            bplist_get_uint(plist, node, &value);
+            written = snprintf(text + used, size - used, "%s=%llu ", key, (unsigned long long) value);
+            break;
+        }
+        case BPLIST_REAL: {
+            double value = 0;
+            bplist_get_real(plist, node, &value);
+            written = snprintf(text + used, size - used, "%s=%g ", key, value);
+            break;
+        }
+        case BPLIST_BOOL: {
+            int value = 0;
+            bplist_get_bool(plist, node, &value);
+            written = snprintf(text + used, size - used, "%s=%d ", key, value);
+            break;
+        }
+        case BPLIST_STRING: {
+            char value[128];
+            bplist_get_string(plist, node, value, sizeof(value));
+            written = snprintf(text + used, size - used, "%s=%s ", key, value);
+            break;
+        }
+        default:
+            return used;
+    }
+    if (written < 0) {
+        return used;
+    }
+    return used + written < size ? used + written : size - 1;
+}
+
+/*
+ * Senders POST /feedback every couple of seconds as a keepalive, with their own stream
+ * statistics as the body since /info sets keepAliveSendStatsAsBody. The answer carries the
+ * receiver's side of the mirror, so the two can be read side by side in the log, and a sender
+ * that looks at them sees the decoder queue fill up before frames get dropped.
+ */
 static void
 raop_handler_feedback(raop_conn_t *conn,
                       http_request_t *request, http_response_t *response,
                       char **response_data, int *response_datalen)
 {
-    logger_log(conn->raop->logger, LOGGER_DEBUG, "raop_handler_feedback");
+    const char *data;
+    int data_len;
+    char text[512];
+
+    data = http_request_get_data(request, &data_len);
+    if (data && data_len > 0) {
+        bplist_t req;
+        if (!bplist_parse(&req, data, data_len)) {
+            text[0] = '\0';
+            raop_handler_format_plist(&req, bplist_root(&req), "", 0, text, sizeof(text), 0);
+            logger_log(conn->raop->logger, LOGGER_DEBUG, "raop_handler_feedback sender stats: %s", text);
+        }
+    }
+    if (!conn->raop_rtp_mirror) {
+        logger_log(conn->raop->logger, LOGGER_DEBUG, "raop_handler_feedback");
+        return;
+    }
+
+    raop_rtp_mirror_stats_t stats;
+    raop_rtp_mirror_get_stats(conn->raop_rtp_mirror, &stats);
+    logger_log(conn->raop->logger, LOGGER_DEBUG, "raop_handler_feedback receiver stats: queued=%d/%d dropped=%u lost=%u jitter=%d us",
+               stats.queued_frames, stats.queue_depth, stats.dropped_frames, stats.lost_frames, stats.jitter_us);
+
+    bplist_writer_t writer;
+    bplist_writer_init(&writer);
+    int res_root_node = bplist_new_dict(&writer);
+    int res_streams_node = bplist_new_array(&writer);
+    int res_stream_node = bplist_new_dict(&writer);
+    bplist_dict_set(&writer, res_stream_node, "type", bplist_new_uint(&writer, 110));
+    bplist_dict_set(&writer, res_stream_node, "queuedFrames", bplist_new_uint(&writer, stats.queued_frames));
+    bplist_dict_set(&writer, res_stream_node, "queueDepth", bplist_new_uint(&writer, stats.queue_depth));
+    bplist_dict_set(&writer, res_stream_node, "droppedFrames", bplist_new_uint(&writer, stats.dropped_frames));
+    bplist_dict_set(&writer, res_stream_node, "lostFrames", bplist_new_uint(&writer, stats.lost_frames));
+    bplist_dict_set(&writer, res_stream_node, "jitter", bplist_new_real(&writer, stats.jitter_us / 1000000.0));
+    bplist_array_append(&writer, res_streams_node, res_stream_node);
+    bplist_dict_set(&writer, res_root_node, "streams", res_streams_node);
+
+    bplist_write(&writer, res_root_node, response_data, (uint32_t*) response_datalen);
+    http_response_add_header(response, "Content-Type", "application/x-apple-binary-plist");
+}
+
+/* Ties an RTP time of the buffered stream to the sender's clock, and starts or pauses it */
+static void
+raop_handler_setrateanchortime(raop_conn_t *conn,
+                               http_request_t *request, http_response_t *response,
+                               char **response_data, int *response_datalen)
+{
+    const char *data;
+    int data_len;
+
+    if (!conn->raop_buffered) {
+        logger_log(conn->raop->logger, LOGGER_WARNING, "SETRATEANCHORTIME without a buffered audio stream");
+        return;
+    }
+    data = http_request_get_data(request, &data_len);
+    bplist_t req;
+    bplist_parse(&req, data, data_len);
+    int req_root_node = bplist_root(&req);
+
+    uint64_t rate = 0, rtp_time = 0, seconds = 0, fraction = 0;
+    bplist_get_uint(&req, bplist_dict_get(&req, req_root_node, "rate"), &rate);
+    bplist_get_uint(&req, bplist_dict_get(&req, req_root_node, "rtpTime"), &rtp_time);
+    bplist_get_uint(&req, bplist_dict_get(&req, req_root_node, "networkTimeSecs"), &seconds);
+    bplist_get_uint(&req, bplist_dict_get(&req, req_root_node, "networkTimeFrac"), &fraction);
+
+    // The fraction counts 2^-64 seconds, the clock micro seconds
+    uint64_t remote_time = seconds * 1000000 + (((fraction >> 32) * 1000000) >> 32);
+    logger_log(conn->raop->logger, LOGGER_DEBUG, "SETRATEANCHORTIME rate = %llu, rtpTime = %llu, networkTime = %llu",
+               rate, rtp_time, remote_time);
+    raop_buffered_set_anchor(conn->raop_buffered, rate != 0, (uint32_t) rtp_time, remote_time);
+}
+
+/* Drops buffered audio the sender will not play, after a pause or a skip */
+static void
+raop_handler_flushbuffered(raop_conn_t *conn,
+                           http_request_t *request, http_response_t *response,
+                           char **response_data, int *response_datalen)
+{
+    const char *data;
+    int data_len;
+
+    if (!conn->raop_buffered) {
+        logger_log(conn->raop->logger, LOGGER_WARNING, "FLUSHBUFFERED without a buffered audio stream");
+        return;
+    }
+    data = http_request_get_data(request, &data_len);
+    bplist_t req;
+    bplist_parse(&req, data, data_len);
+    int req_root_node = bplist_root(&req);
+
+    // Without flushFromSeq everything up to flushUntilSeq goes
+    int from_seq = -1;
+    uint64_t value = 0;
+    if (!bplist_get_uint(&req, bplist_dict_get(&req, req_root_node, "flushFromSeq"), &value)) {
+        from_seq = (int) (value & 0xffffff);
+    }
+    value = 0;
+    bplist_get_uint(&req, bplist_dict_get(&req, req_root_node, "flushUntilSeq"), &value);
+
+    logger_log(conn->raop->logger, LOGGER_DEBUG, "FLUSHBUFFERED from %d until %llu", from_seq, value);
+    raop_buffered_flush(conn->raop_buffered, from_seq, (uint32_t) value);
 }
 
 static void
@@ -571,6 +948,294 @@ raop_handler_record(raop_conn_t *conn,
                     char **response_data, int *response_datalen)
 {
     logger_log(conn->raop->logger, LOGGER_DEBUG, "raop_handler_record");
-    http_response_add_header(response, "Audio-Latency", "11025");
-    http_response_add_header(response, "Audio-Jack-Status", "connected; type=analog");
+    http_response_add_header_line(response, RAOP_HEADER_LINE(raop_header_audio_latency));
+    http_response_add_header_line(response, RAOP_HEADER_LINE(raop_header_audio_jack_status));
+}
+
+/*
+ * AirPlay video, movies the sender casts by URL. These come as plain HTTP requests without a
+ * CSeq, their handlers return the HTTP status and leave a body of content_type in response_data.
+ */
+typedef int (*raop_video_handler_t)(raop_conn_t *, http_request_t *, const char **, char **, int *);
+
+static const char raop_playback_info_not_ready[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+    "<plist version=\"1.0\">\n<dict>\n<key>readyToPlay</key>\n<false/>\n</dict>\n</plist>\n";
+
+static const char raop_playback_info_format[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+    "<plist version=\"1.0\">\n<dict>\n"
+    "<key>duration</key>\n<real>%f</real>\n"
+    "<key>loadedTimeRanges</key>\n<array>\n<dict>\n<key>duration</key>\n<real>%f</real>\n"
+    "<key>start</key>\n<real>0.0</real>\n</dict>\n</array>\n"
+    "<key>playbackBufferEmpty</key>\n<false/>\n"
+    "<key>playbackBufferFull</key>\n<false/>\n"
+    "<key>playbackLikelyToKeepUp</key>\n<true/>\n"
+    "<key>position</key>\n<real>%f</real>\n"
+    "<key>rate</key>\n<real>%f</real>\n"
+    "<key>readyToPlay</key>\n<%s/>\n"
+    "<key>seekableTimeRanges</key>\n<array>\n<dict>\n<key>duration</key>\n<real>%f</real>\n"
+    "<key>start</key>\n<real>0.0</real>\n</dict>\n</array>\n"
+    "</dict>\n</plist>\n";
+
+/* The number in name=value of the query of url, returns -1 if there is none */
+static int
+raop_handler_query_double(const char *url, const char *name, double *value)
+{
+    size_t name_len = strlen(name);
+    for (const char *query = strchr(url, '?'); query; query = strchr(query, '&')) {
+        query++;
+        if (!strncmp(query, name, name_len) && query[name_len] == '=') {
+            char *end;
+            *value = strtod(query + name_len + 1, &end);
+            return end == query + name_len + 1 ? -1 : 0;
+        }
+    }
+    return -1;
+}
+
+/* A real or integer number of the plist, left as it is if the object is neither */
+static void
+raop_handler_plist_number(const bplist_t *plist, int object, double *value)
+{
+    uint64_t integer;
+    if (bplist_get_real(plist, object, value) < 0 && !bplist_get_uint(plist, object, &integer)) {
+        *value = (double) integer;
+    }
+}
+
+static int
+raop_handler_play(raop_conn_t *conn, http_request_t *request, const char **content_type,
+                  char **response_data, int *response_datalen)
+{
+    const char *data;
+    int data_len;
+    char *url = NULL;
+    double start_seconds = 0;
+    double start_fraction = 0;
+
+    data = http_request_get_data(request, &data_len);
+    if (!data || data_len <= 0) {
+        logger_log(conn->raop->logger, LOGGER_ERR, "POST /play without a body");
+        return 400;
+    }
+    bplist_t req;
+    if (!bplist_parse(&req, data, data_len)) {
+        int root = bplist_root(&req);
+        int location = bplist_dict_get(&req, root, "Content-Location");
+        int len = bplist_get_string(&req, location, NULL, 0);
+        if (len > 0) {
+            url = malloc(len + 1);
+            if (url) {
+                bplist_get_string(&req, location, url, len + 1);
+            }
+        }
+        raop_handler_plist_number(&req, bplist_dict_get(&req, root, "Start-Position"), &start_fraction);
+        raop_handler_plist_number(&req, bplist_dict_get(&req, root, "Start-Position-Seconds"), &start_seconds);
+    } else {
+        // Older senders send text/parameters, "Name: value" lines
+        char *text = malloc(data_len + 1);
+        memcpy(text, data, data_len);
+        text[data_len] = '\0';
+        char *saveptr = NULL;
+        for (char *line = strtok_r(text, "\r\n", &saveptr); line; line = strtok_r(NULL, "\r\n", &saveptr)) {
+            if (!strncmp(line, "Content-Location: ", 18) && !url) {
+                url = strdup(line + 18);
+            } else if (!strncmp(line, "Start-Position: ", 16)) {
+                start_fraction = strtod(line + 16, NULL);
+            }
+        }
+        free(text);
+    }
+    if (!url) {
+        logger_log(conn->raop->logger, LOGGER_ERR, "POST /play without a Content-Location");
+        return 400;
+    }
+
+    logger_log(conn->raop->logger, LOGGER_INFO, "Sender casts %s", url);
+    int ret = conn->callbacks.playback_start(conn->callbacks.cls, url, start_seconds, start_fraction);
+    free(url);
+    return ret < 0 ? 500 : 200;
+}
+
+static int
+raop_handler_scrub(raop_conn_t *conn, http_request_t *request, const char **content_type,
+                   char **response_data, int *response_datalen)
+{
+    double position;
+    if (!strcmp(http_request_get_method(request), "POST")) {
+        if (raop_handler_query_double(http_request_get_url(request), "position", &position) < 0) {
+            return 400;
+        }
+        logger_log(conn->raop->logger, LOGGER_DEBUG, "Scrubbing to %.3f s", position);
+        conn->callbacks.playback_scrub(conn->callbacks.cls, position);
+        return 200;
+    }
+
+    raop_playback_info_t info;
+    memset(&info, 0, sizeof(info));
+    conn->callbacks.playback_info(conn->callbacks.cls, &info);
+    char text[64];
+    int len = snprintf(text, sizeof(text), "duration: %f\r\nposition: %f\r\n", info.duration, info.position);
+    *response_data = malloc(len);
+    memcpy(*response_data, text, len);
+    *response_datalen = len;
+    *content_type = "text/parameters";
+    return 200;
+}
+
+static int
+raop_handler_rate(raop_conn_t *conn, http_request_t *request, const char **content_type,
+                  char **response_data, int *response_datalen)
+{
+    double rate;
+    if (raop_handler_query_double(http_request_get_url(request), "value", &rate) < 0) {
+        return 400;
+    }
+    logger_log(conn->raop->logger, LOGGER_DEBUG, "Playback rate %.1f", rate);
+    conn->callbacks.playback_rate(conn->callbacks.cls, rate);
+    return 200;
+}
+
+static int
+raop_handler_playback_info(raop_conn_t *conn, http_request_t *request, const char **content_type,
+                           char **response_data, int *response_datalen)
+{
+    raop_playback_info_t info;
+    memset(&info, 0, sizeof(info));
+    *content_type = "text/x-apple-plist+xml";
+    if (conn->callbacks.playback_info(conn->callbacks.cls, &info) < 0) {
+        *response_datalen = sizeof(raop_playback_info_not_ready) - 1;
+        *response_data = malloc(*response_datalen);
+        memcpy(*response_data, raop_playback_info_not_ready, *response_datalen);
+        return 200;
+    }
+    int len = snprintf(NULL, 0, raop_playback_info_format, info.duration, info.duration, info.position, info.rate,
+                       info.ready_to_play ? "true" : "false", info.duration);
+    *response_data = malloc(len + 1);
+    snprintf(*response_data, len + 1, raop_playback_info_format, info.duration, info.duration, info.position,
+             info.rate, info.ready_to_play ? "true" : "false", info.duration);
+    *response_datalen = len;
+    return 200;
+}
+
+static int
+raop_handler_stop(raop_conn_t *conn, http_request_t *request, const char **content_type,
+                  char **response_data, int *response_datalen)
+{
+    logger_log(conn->raop->logger, LOGGER_INFO, "Sender stopped the cast movie or photos");
+    if (conn->callbacks.playback_stop) {
+        conn->callbacks.playback_stop(conn->callbacks.cls);
+    }
+    if (conn->callbacks.photo_hide) {
+        conn->callbacks.photo_hide(conn->callbacks.cls);
+    }
+    return 200;
+}
+
+static raop_photo_transition_t
+raop_handler_photo_transition(const char *name)
+{
+    if (!name || !strcmp(name, "None")) {
+        return RAOP_PHOTO_TRANSITION_NONE;
+    } else if (!strcmp(name, "SlideLeft")) {
+        return RAOP_PHOTO_TRANSITION_SLIDE_LEFT;
+    } else if (!strcmp(name, "SlideRight")) {
+        return RAOP_PHOTO_TRANSITION_SLIDE_RIGHT;
+    }
+    /* Dissolve, and whatever else a sender comes up with */
+    return RAOP_PHOTO_TRANSITION_DISSOLVE;
+}
+
+/* The cached photo with key, NULL if there is none */
+static raop_photo_t *
+raop_handler_find_photo(raop_conn_t *conn, const char *key)
+{
+    for (int i = 0; key && i < RAOP_PHOTO_CACHE_SIZE; i++) {
+        if (conn->photos[i].data && !strcmp(conn->photos[i].key, key)) {
+            return &conn->photos[i];
+        }
+    }
+    return NULL;
+}
+
+/* Keeps a copy of the photo under key in place of the oldest one, NULL if it is out of memory */
+static raop_photo_t *
+raop_handler_cache_photo(raop_conn_t *conn, const char *key, const char *data, int data_len)
+{
+    raop_photo_t *photo = raop_handler_find_photo(conn, key);
+    if (!photo) {
+        photo = &conn->photos[conn->next_photo];
+        conn->next_photo = (conn->next_photo + 1) % RAOP_PHOTO_CACHE_SIZE;
+    }
+    mem_account_free(photo->data);
+    photo->data = mem_account_malloc(MEM_TAG_CONNECTIONS, data_len);
+    if (!photo->data) {
+        return NULL;
+    }
+    memcpy(photo->data, data, data_len);
+    photo->size = data_len;
+    snprintf(photo->key, sizeof(photo->key), "%s", key);
+    return photo;
+}
+
+/*
+ * A JPEG to show, in the body, or sent before with X-Apple-AssetAction: cacheOnly and shown by
+ * its X-Apple-AssetKey with displayCached. Slideshows send the next photos ahead like that, and
+ * are told with 412 Precondition Failed to send one again that is not cached any more.
+ */
+static int
+raop_handler_photo(raop_conn_t *conn, http_request_t *request, const char **content_type,
+                   char **response_data, int *response_datalen)
+{
+    const char *action = http_request_get_header(request, "X-Apple-AssetAction");
+    const char *key = http_request_get_header(request, "X-Apple-AssetKey");
+    raop_photo_transition_t transition = raop_handler_photo_transition(http_request_get_header(request,
+                                                                                               "X-Apple-Transition"));
+    const unsigned char *jpeg;
+    int size;
+
+    if (action && !strcmp(action, "displayCached")) {
+        raop_photo_t *photo = raop_handler_find_photo(conn, key);
+        if (!photo) {
+            logger_log(conn->raop->logger, LOGGER_DEBUG, "Photo %s is not cached", key ? key : "without a key");
+            return 412;
+        }
+        jpeg = photo->data;
+        size = photo->size;
+    } else {
+        const char *data;
+        int data_len;
+        data = http_request_get_data(request, &data_len);
+        if (!data || data_len <= 0) {
+            logger_log(conn->raop->logger, LOGGER_ERR, "PUT /photo without a body");
+            return 400;
+        }
+        if (key) {
+            raop_photo_t *photo = raop_handler_cache_photo(conn, key, data, data_len);
+            if (!photo) {
+                return 500;
+            }
+            if (action && !strcmp(action, "cacheOnly")) {
+                logger_log(conn->raop->logger, LOGGER_DEBUG, "Caching photo %s of %d bytes", key, data_len);
+                return 200;
+            }
+        }
+        jpeg = (const unsigned char *) data;
+        size = data_len;
+    }
+
+    logger_log(conn->raop->logger, LOGGER_INFO, "Showing a photo of %d bytes", size);
+    return conn->callbacks.photo_show(conn->callbacks.cls, jpeg, size, transition) < 0 ? 500 : 200;
+}
+
+/* Properties like the end of the movie to stop at, of no use to a receiver that plays it all */
+static int
+raop_handler_set_property(raop_conn_t *conn, http_request_t *request, const char **content_type,
+                          char **response_data, int *response_datalen)
+{
+    logger_log(conn->raop->logger, LOGGER_DEBUG, "Ignoring %s", http_request_get_url(request));
+    return 200;
 }
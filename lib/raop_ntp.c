@@ -20,12 +20,19 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <fcntl.h>
 
 #include "raop_ntp.h"
 #include "threads.h"
+#include "event_loop.h"
 #include "compat.h"
 #include "netutils.h"
 #include "byteutils.h"
+#include "metrics.h"
+#include "trace.h"
+#include "probes.h"
+#include "media_clock.h"
 
 #define RAOP_NTP_DATA_COUNT   8
 #define RAOP_NTP_PHI_PPM   15ull                   // PPM
@@ -36,6 +43,21 @@
 
 #define RAOP_NTP_CLOCK_BASE (2208988800ull << 32)
 
+// Clock skew estimation and adaptive polling
+#define RAOP_NTP_SKEW_MIN_SAMPLES 4
+#define RAOP_NTP_MAX_SKEW (500.0 / 1000000.0)      // 500 PPM, anything beyond is measurement noise
+#define RAOP_NTP_POLL_MIN_MS 1000
+#define RAOP_NTP_POLL_MAX_MS 8000
+#define RAOP_NTP_JUMP_US 1000                      // prediction error that counts as a clock jump
+#define RAOP_NTP_STABLE_US 200                     // prediction error below which the clock is stable
+
+// Quick requests after the start and after a step, enough to refill every sample
+#define RAOP_NTP_BURST_COUNT (RAOP_NTP_DATA_COUNT - 1)
+#define RAOP_NTP_BURST_INTERVAL_MS 75
+#define RAOP_NTP_STEP_US 50000                     // error of a single sample that counts as a step of the remote clock
+
+#define RAOP_NTP_TIMEOUT_MS 300                    // wait for a response before counting a timeout
+
 typedef struct raop_ntp_data_s {
     uint64_t time; // The local wall clock time at time of ntp packet arrival
     uint64_t dispersion;
@@ -46,20 +68,45 @@ typedef struct raop_ntp_data_s {
 struct raop_ntp_s {
     logger_t *logger;
 
-    thread_handle_t thread;
+    // Sends the requests and reads the responses on a shared NTP event loop
+    event_source_t *source;
     mutex_handle_t run_mutex;
 
-    mutex_handle_t wait_mutex;
-    cond_handle_t wait_cond;
-
     raop_ntp_data_t data[RAOP_NTP_DATA_COUNT];
     int data_index;
-
-    // The clock sync params are periodically updated to the AirPlay client's NTP clock
-    mutex_handle_t sync_params_mutex;
+    // Samples taken so far, read by other threads, see raop_ntp_get_sample_count
+    unsigned int sample_count;
+
+    // The clock sync params are periodically updated to the AirPlay client's NTP clock.
+    // They are read for every audio packet and video frame, but only written by its event source,
+    // so they are guarded by a seqlock: readers retry instead of ever taking a lock.
+    // The offset is remote minus local time at local time sync_time and changes by sync_skew
+    // micro seconds per local micro second.
+    atomic_uint sync_params_seq;
     int64_t sync_offset;
+    uint64_t sync_time;
+    double sync_skew;
     int64_t sync_dispersion;
     int64_t sync_delay;
+    // Skew of the seed, stands in until there are enough samples to estimate it, see raop_ntp_seed
+    double seed_skew;
+
+    // Milli seconds between two requests, only used by the event source
+    int poll_interval;
+    // Requests still to be sent at the burst interval, and whether any response came in yet,
+    // set before the source starts and only used by it after that
+    int burst_left;
+    int synced;
+    // A request is out and its timeout armed, only used by the event source
+    int awaiting;
+    // Bounds poll_interval adapts within, set before the source starts
+    int poll_min;
+    int poll_max;
+
+    // Replaces the clock and the socket if its get_local_time is set, timer_deadline is then
+    // the local time the timer is due at, 0 while it is not armed
+    raop_ntp_transport_t transport;
+    uint64_t timer_deadline;
 
     // Socket address of the AirPlay client
     struct sockaddr_storage remote_saddr;
@@ -98,26 +145,106 @@ raop_ntp_compare(const void* av, const void* bv)
     }
 }
 
+/*
+ * Seqlock writer side, the sequence is odd while an update is in progress
+ */
+static void
+raop_ntp_sync_params_write_begin(raop_ntp_t *raop_ntp)
+{
+    unsigned int seq = atomic_load_explicit(&raop_ntp->sync_params_seq, memory_order_relaxed);
+    atomic_store_explicit(&raop_ntp->sync_params_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void
+raop_ntp_sync_params_write_end(raop_ntp_t *raop_ntp)
+{
+    unsigned int seq = atomic_load_explicit(&raop_ntp->sync_params_seq, memory_order_relaxed);
+    atomic_store_explicit(&raop_ntp->sync_params_seq, seq + 1, memory_order_release);
+}
+
+/*
+ * Seqlock reader side, retries until it has seen a consistent set of params
+ */
+static void
+raop_ntp_get_sync_params(raop_ntp_t *raop_ntp, int64_t *offset, uint64_t *time, double *skew)
+{
+    unsigned int seq_begin, seq_end;
+    do {
+        seq_begin = atomic_load_explicit(&raop_ntp->sync_params_seq, memory_order_acquire);
+        *offset = *(volatile int64_t *) &raop_ntp->sync_offset;
+        *time = *(volatile uint64_t *) &raop_ntp->sync_time;
+        *skew = *(volatile double *) &raop_ntp->sync_skew;
+        atomic_thread_fence(memory_order_acquire);
+        seq_end = atomic_load_explicit(&raop_ntp->sync_params_seq, memory_order_relaxed);
+    } while ((seq_begin & 1) || seq_begin != seq_end);
+}
+
+/*
+ * Returns the remote minus local clock offset at the given local time, extrapolated with the skew
+ */
+static int64_t
+raop_ntp_get_sync_offset(raop_ntp_t *raop_ntp, uint64_t local_time)
+{
+    int64_t offset;
+    uint64_t time;
+    double skew;
+    raop_ntp_get_sync_params(raop_ntp, &offset, &time, &skew);
+    return offset + (int64_t) (skew * (double) (int64_t) (local_time - time));
+}
+
+/*
+ * Fits offset = a + skew * (time - reference) by least squares, leaving out the quarter of samples
+ * with the highest delay, as those were most likely held up by queueing on the way.
+ * Returns the number of samples used, the fit is only meaningful for RAOP_NTP_SKEW_MIN_SAMPLES or more.
+ */
+static int
+raop_ntp_estimate_skew(const raop_ntp_data_t *data_sorted, uint64_t reference, int64_t anchor,
+                       int64_t *offset, double *skew)
+{
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    int count = 0;
+    int valid = 0;
+
+    while (valid < RAOP_NTP_DATA_COUNT && data_sorted[valid].delay < (int64_t) RAOP_NTP_MAX_DISP) {
+        valid++;
+    }
+    for (int i = 0; i < valid - valid / 4; i++) {
+        double x = (double) (int64_t) (data_sorted[i].time - reference);
+        double y = (double) (data_sorted[i].offset - anchor);
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+        count++;
+    }
+    if (count < RAOP_NTP_SKEW_MIN_SAMPLES) {
+        return count;
+    }
+
+    double denominator = count * sum_xx - sum_x * sum_x;
+    if (denominator <= 0) {
+        return 0;
+    }
+    double slope = (count * sum_xy - sum_x * sum_y) / denominator;
+    if (slope > RAOP_NTP_MAX_SKEW) slope = RAOP_NTP_MAX_SKEW;
+    if (slope < -RAOP_NTP_MAX_SKEW) slope = -RAOP_NTP_MAX_SKEW;
+    double intercept = (sum_y - slope * sum_x) / count;
+
+    *offset = anchor + (int64_t) intercept;
+    *skew = slope;
+    return count;
+}
+
 static int
 raop_ntp_parse_remote_address(raop_ntp_t *raop_ntp, const unsigned char *remote_addr, int remote_addr_len)
 {
-    char current[25];
-    int family;
+    char current[INET6_ADDRSTRLEN];
     int ret;
     assert(raop_ntp);
-    if (remote_addr_len == 4) {
-        family = AF_INET;
-    } else if (remote_addr_len == 16) {
-        family = AF_INET6;
-    } else {
-        return -1;
-    }
-    memset(current, 0, sizeof(current));
-    sprintf(current, "%d.%d.%d.%d", remote_addr[0], remote_addr[1], remote_addr[2], remote_addr[3]);
-    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp parse remote ip = %s", current);
-    ret = netutils_parse_address(family, current,
-                                 &raop_ntp->remote_saddr,
-                                 sizeof(raop_ntp->remote_saddr));
+    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp parse remote ip = %s",
+               netutils_format_address(remote_addr, remote_addr_len, current, sizeof(current)));
+    ret = netutils_init_address(&raop_ntp->remote_saddr, sizeof(raop_ntp->remote_saddr), remote_addr, remote_addr_len, raop_ntp->timing_rport, 0);
     if (ret < 0) {
         return -1;
     }
@@ -125,6 +252,31 @@ raop_ntp_parse_remote_address(raop_ntp_t *raop_ntp, const unsigned char *remote_
     return 0;
 }
 
+/*
+ * Forgets the samples and the sync, as of the current local time
+ */
+static void
+raop_ntp_reset(raop_ntp_t *raop_ntp)
+{
+    uint64_t time = raop_ntp_get_local_time(raop_ntp);
+
+    for (int i = 0; i < RAOP_NTP_DATA_COUNT; ++i) {
+        raop_ntp->data[i].offset     = 0ll;
+        raop_ntp->data[i].delay      = RAOP_NTP_MAX_DISP;
+        raop_ntp->data[i].dispersion = RAOP_NTP_MAX_DISP;
+        raop_ntp->data[i].time      = time;
+    }
+
+    raop_ntp_sync_params_write_begin(raop_ntp);
+    raop_ntp->sync_delay = 0;
+    raop_ntp->sync_dispersion = 0;
+    raop_ntp->sync_offset = 0;
+    raop_ntp->sync_time = time;
+    raop_ntp->sync_skew = 0.0;
+    raop_ntp_sync_params_write_end(raop_ntp);
+    raop_ntp->seed_skew = 0.0;
+}
+
 raop_ntp_t *raop_ntp_init(logger_t *logger, const unsigned char *remote_addr, int remote_addr_len, unsigned short timing_rport) {
     raop_ntp_t *raop_ntp;
 
@@ -142,29 +294,16 @@ raop_ntp_t *raop_ntp_init(logger_t *logger, const unsigned char *remote_addr, in
         return NULL;
     }
 
-    // Set port on the remote address struct
-    ((struct sockaddr_in *) &raop_ntp->remote_saddr)->sin_port = htons(timing_rport);
-
-    raop_ntp->running = 0;
+    ATOMIC_STORE(raop_ntp->running, 0);
     raop_ntp->joined = 1;
 
-    uint64_t time = raop_ntp_get_local_time(raop_ntp);
-
-    for (int i = 0; i < RAOP_NTP_DATA_COUNT; ++i) {
-        raop_ntp->data[i].offset     = 0ll;
-        raop_ntp->data[i].delay      = RAOP_NTP_MAX_DISP;
-        raop_ntp->data[i].dispersion = RAOP_NTP_MAX_DISP;
-        raop_ntp->data[i].time      = time;
-    }
-
-    raop_ntp->sync_delay = 0;
-    raop_ntp->sync_dispersion = 0;
-    raop_ntp->sync_offset = 0;
+    atomic_init(&raop_ntp->sync_params_seq, 0);
+    raop_ntp_reset(raop_ntp);
+    raop_ntp->poll_min = RAOP_NTP_POLL_MIN_MS;
+    raop_ntp->poll_max = RAOP_NTP_POLL_MAX_MS;
+    raop_ntp->poll_interval = RAOP_NTP_POLL_MIN_MS;
 
     MUTEX_CREATE(raop_ntp->run_mutex);
-    MUTEX_CREATE(raop_ntp->wait_mutex);
-    COND_CREATE(raop_ntp->wait_cond);
-    MUTEX_CREATE(raop_ntp->sync_params_mutex);
     return raop_ntp;
 }
 
@@ -174,9 +313,6 @@ raop_ntp_destroy(raop_ntp_t *raop_ntp)
     if (raop_ntp) {
         raop_ntp_stop(raop_ntp);
         MUTEX_DESTROY(raop_ntp->run_mutex);
-        MUTEX_DESTROY(raop_ntp->wait_mutex);
-        COND_DESTROY(raop_ntp->wait_cond);
-        MUTEX_DESTROY(raop_ntp->sync_params_mutex);
         free(raop_ntp);
     }
 }
@@ -185,6 +321,30 @@ unsigned short raop_ntp_get_port(raop_ntp_t *raop_ntp) {
     return raop_ntp->timing_lport;
 }
 
+void
+raop_ntp_set_transport(raop_ntp_t *raop_ntp, const raop_ntp_transport_t *transport)
+{
+    assert(raop_ntp);
+    assert(transport && transport->get_local_time && transport->send);
+
+    raop_ntp->transport = *transport;
+    // The samples were stamped with the system clock
+    raop_ntp_reset(raop_ntp);
+}
+
+/*
+ * Arms the timer of the event source, or the simulated one of a transport
+ */
+static void
+raop_ntp_set_timer(raop_ntp_t *raop_ntp, int ms)
+{
+    if (raop_ntp->transport.get_local_time) {
+        raop_ntp->timer_deadline = raop_ntp_get_local_time(raop_ntp) + (uint64_t) ms * 1000;
+    } else {
+        event_source_set_timer(raop_ntp->source, ms);
+    }
+}
+
 static int
 raop_ntp_init_socket(raop_ntp_t *raop_ntp, int use_ipv6)
 {
@@ -199,13 +359,14 @@ raop_ntp_init_socket(raop_ntp_t *raop_ntp, int use_ipv6)
         goto sockets_cleanup;
     }
 
-    // We're calling recvfrom without knowing whether there is any data, so we need a timeout
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 300000;
-    if (setsockopt(tsock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+    // Only read once the loop saw it readable, but a datagram may still be dropped in between
+    int flags = fcntl(tsock, F_GETFL, 0);
+    if (flags == -1 || fcntl(tsock, F_SETFL, flags | O_NONBLOCK) == -1) {
         goto sockets_cleanup;
     }
+    if (netutils_apply_qos(tsock, NETUTILS_QOS_TIMING) < 0) {
+        logger_log(raop_ntp->logger, LOGGER_WARNING, "raop_ntp could not mark the timing socket for QoS");
+    }
 
     /* Set socket descriptors */
     raop_ntp->tsock = tsock;
@@ -236,109 +397,289 @@ raop_ntp_flush_socket(int fd)
     }
 }
 
-static THREAD_RETVAL
-raop_ntp_thread(void *arg)
+void
+raop_ntp_add_sample(raop_ntp_t *raop_ntp, uint64_t local_time, int64_t sample_offset, int64_t sample_delay)
 {
-    raop_ntp_t *raop_ntp = arg;
-    assert(raop_ntp);
-    unsigned char response[128];
-    int response_len;
-    unsigned char request[32] = {0x80, 0xd2, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                                 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-    };
     raop_ntp_data_t data_sorted[RAOP_NTP_DATA_COUNT];
     const unsigned  two_pow_n[RAOP_NTP_DATA_COUNT] = {2, 4, 8, 16, 32, 64, 128, 256};
+    int64_t t3 = (int64_t) local_time;
+
+    PROBE3(ntp_sample, local_time, sample_offset, sample_delay);
+    ATOMIC_FETCH_ADD(raop_ntp->sample_count, 1);
+    raop_ntp->data_index = (raop_ntp->data_index + 1) % RAOP_NTP_DATA_COUNT;
+    raop_ntp->data[raop_ntp->data_index].time = t3;
+    raop_ntp->data[raop_ntp->data_index].offset     = sample_offset;
+    raop_ntp->data[raop_ntp->data_index].delay      = sample_delay;
+    raop_ntp->data[raop_ntp->data_index].dispersion = RAOP_NTP_R_RHO + RAOP_NTP_S_RHO +  sample_delay * RAOP_NTP_PHI_PPM / 1000000u;
+
+    // After a step of the remote clock the older samples only pull the offset back,
+    // drop them and take fresh ones quickly. A slow round trip can only explain half its delay.
+    int64_t sample_error = sample_offset - raop_ntp_get_sync_offset(raop_ntp, t3);
+    if (raop_ntp->synced && llabs(sample_error) - llabs(sample_delay) / 2 > RAOP_NTP_STEP_US) {
+        logger_log(raop_ntp->logger, LOGGER_INFO, "raop_ntp remote clock stepped by %lld us", sample_error);
+        for (int i = 0; i < RAOP_NTP_DATA_COUNT; ++i) {
+            if (i != raop_ntp->data_index) {
+                raop_ntp->data[i].delay = RAOP_NTP_MAX_DISP;
+                raop_ntp->data[i].dispersion = RAOP_NTP_MAX_DISP;
+            }
+        }
+        raop_ntp->burst_left = RAOP_NTP_BURST_COUNT;
+    }
+    raop_ntp->synced = 1;
+
+    // Sort by delay
+    memcpy(data_sorted, raop_ntp->data, sizeof(data_sorted));
+    qsort(data_sorted, RAOP_NTP_DATA_COUNT, sizeof(data_sorted[0]), raop_ntp_compare);
+
+    uint64_t dispersion = 0ull;
+    double skew = raop_ntp->seed_skew;
+    int64_t offset = data_sorted[0].offset + (int64_t) (skew * (double) (t3 - (int64_t) data_sorted[0].time));
+    // Worst round trip among the samples taken so far, the newest one is always valid
+    int64_t delay = data_sorted[0].delay;
+    for (int i = 1; i < RAOP_NTP_DATA_COUNT && data_sorted[i].delay < (int64_t) RAOP_NTP_MAX_DISP; i++) {
+        delay = data_sorted[i].delay;
+    }
 
-    while (1) {
-        MUTEX_LOCK(raop_ntp->run_mutex);
-        if (!raop_ntp->running) {
-            MUTEX_UNLOCK(raop_ntp->run_mutex);
-            break;
+    // Calculate dispersion
+    for(int i = 0; i < RAOP_NTP_DATA_COUNT; ++i) {
+        unsigned long long disp = raop_ntp->data[i].dispersion + (t3 - raop_ntp->data[i].time) * RAOP_NTP_PHI_PPM / 1000000u;
+        dispersion += disp / two_pow_n[i];
+    }
+
+    // Without a line through enough good samples, fall back to the offset of the best one
+    raop_ntp_estimate_skew(data_sorted, t3, data_sorted[0].offset, &offset, &skew);
+
+    // How far off the previously published params were for this point in time
+    int64_t correction = offset - raop_ntp_get_sync_offset(raop_ntp, t3);
+
+    raop_ntp_sync_params_write_begin(raop_ntp);
+    *(volatile int64_t *) &raop_ntp->sync_offset = offset;
+    *(volatile uint64_t *) &raop_ntp->sync_time = t3;
+    *(volatile double *) &raop_ntp->sync_skew = skew;
+    raop_ntp->sync_dispersion = dispersion;
+    *(volatile int64_t *) &raop_ntp->sync_delay = delay;
+    raop_ntp_sync_params_write_end(raop_ntp);
+    metrics_add(METRIC_NTP_SYNCS, 1);
+    metrics_set(METRIC_NTP_OFFSET, offset);
+    metrics_set(METRIC_NTP_DISPERSION, (int64_t) (dispersion > INT64_MAX ? INT64_MAX : dispersion));
+
+    // Poll quickly until the clock has settled, then back off
+    if (llabs(correction) > RAOP_NTP_JUMP_US) {
+        raop_ntp->poll_interval = raop_ntp->poll_min;
+    } else if (llabs(correction) < RAOP_NTP_STABLE_US && raop_ntp->poll_interval < raop_ntp->poll_max) {
+        raop_ntp->poll_interval *= 2;
+        if (raop_ntp->poll_interval > raop_ntp->poll_max) {
+            raop_ntp->poll_interval = raop_ntp->poll_max;
         }
-        MUTEX_UNLOCK(raop_ntp->run_mutex);
+    }
 
+    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp sync correction = %lld, skew = %.3f ppm, next poll in %d ms",
+               correction, skew * 1000000.0, raop_ntp->poll_interval);
+}
+
+int
+raop_ntp_get_estimate(raop_ntp_t *raop_ntp, raop_ntp_estimate_t *estimate)
+{
+    assert(raop_ntp);
+    if (!ATOMIC_LOAD(raop_ntp->sample_count)) {
+        return -1;
+    }
+    raop_ntp_get_sync_params(raop_ntp, &estimate->offset, &estimate->time, &estimate->skew);
+    estimate->delay = raop_ntp_get_round_trip_delay(raop_ntp);
+    return 0;
+}
+
+void
+raop_ntp_seed(raop_ntp_t *raop_ntp, const raop_ntp_estimate_t *estimate)
+{
+    assert(raop_ntp);
+    uint64_t now = raop_ntp_get_local_time(raop_ntp);
+    int64_t age = now > estimate->time ? (int64_t) (now - estimate->time) : 0;
+    int64_t offset = estimate->offset + (int64_t) (estimate->skew * (double) age);
+    // Both clocks may have wandered off the skew since, by as much as the dispersion allows for
+    int64_t delay = estimate->delay + age * 2 * (int64_t) RAOP_NTP_PHI_PPM / 1000000;
+
+    raop_ntp_data_t *data = &raop_ntp->data[raop_ntp->data_index];
+    data->time = now;
+    data->offset = offset;
+    data->delay = delay;
+    data->dispersion = RAOP_NTP_R_RHO + RAOP_NTP_S_RHO + delay * RAOP_NTP_PHI_PPM / 1000000u;
+    raop_ntp->seed_skew = estimate->skew;
+    raop_ntp->synced = 1;
+
+    raop_ntp_sync_params_write_begin(raop_ntp);
+    raop_ntp->sync_offset = offset;
+    raop_ntp->sync_time = now;
+    raop_ntp->sync_skew = estimate->skew;
+    raop_ntp->sync_delay = delay;
+    raop_ntp_sync_params_write_end(raop_ntp);
+    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp seeded with offset = %lld, skew = %.3f ppm from %lld ms ago",
+               offset, estimate->skew * 1000000.0, age / 1000);
+}
+
+/*
+ * Arms the timer for the next request, quickly while a burst is on
+ */
+static void
+raop_ntp_schedule_poll(raop_ntp_t *raop_ntp)
+{
+    int wait_ms = raop_ntp->poll_interval;
+    if (raop_ntp->burst_left > 0) {
+        raop_ntp->burst_left--;
+        wait_ms = RAOP_NTP_BURST_INTERVAL_MS;
+    }
+    raop_ntp->awaiting = 0;
+    raop_ntp_set_timer(raop_ntp, wait_ms);
+}
+
+static void
+raop_ntp_send_request(raop_ntp_t *raop_ntp)
+{
+    unsigned char request[32] = {0x80, 0xd2, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+
+    uint64_t send_time = raop_ntp_get_local_time(raop_ntp);
+    byteutils_put_ntp_timestamp(request, 24, send_time);
+    int send_len;
+    if (raop_ntp->transport.send) {
+        send_len = raop_ntp->transport.send(raop_ntp->transport.cls, request, sizeof(request));
+    } else {
         // Flush the socket in case a super delayed response arrived or something
         raop_ntp_flush_socket(raop_ntp->tsock);
+        send_len = sendto(raop_ntp->tsock, (char *)request, sizeof(request), 0,
+                          (struct sockaddr *) &raop_ntp->remote_saddr, raop_ntp->remote_saddr_len);
+    }
+    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp send_len = %d", send_len);
+    if (send_len < 0) {
+        logger_log(raop_ntp->logger, LOGGER_ERR, "raop_ntp error sending request");
+        raop_ntp_schedule_poll(raop_ntp);
+        return;
+    }
+    raop_ntp->awaiting = 1;
+    raop_ntp_set_timer(raop_ntp, RAOP_NTP_TIMEOUT_MS);
+}
 
-        // Send request
-        uint64_t send_time = raop_ntp_get_local_time(raop_ntp);
-        byteutils_put_ntp_timestamp(request, 24, send_time);
-        int send_len = sendto(raop_ntp->tsock, (char *)request, sizeof(request), 0,
-                              (struct sockaddr *) &raop_ntp->remote_saddr, raop_ntp->remote_saddr_len);
-        logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp send_len = %d", send_len);
-        if (send_len < 0) {
-            logger_log(raop_ntp->logger, LOGGER_ERR, "raop_ntp error sending request");
-        } else {
-            // Read response
-            response_len = recvfrom(raop_ntp->tsock, (char *)response, sizeof(response), 0,
-                                    (struct sockaddr *) &raop_ntp->remote_saddr, &raop_ntp->remote_saddr_len);
-            if (response_len < 0) {
-                logger_log(raop_ntp->logger, LOGGER_ERR, "raop_ntp receive timeout");
-            } else {
-                logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp receive time type_t packetlen = %d", response_len);
-
-                int64_t t3 = (int64_t) raop_ntp_get_local_time(raop_ntp);
-                // Local time of the client when the NTP request packet leaves the client
-                int64_t t0 = (int64_t) byteutils_get_ntp_timestamp(response, 8);
-                // Local time of the server when the NTP request packet arrives at the server
-                int64_t t1 = (int64_t) byteutils_get_ntp_timestamp(response, 16);
-                // Local time of the server when the response message leaves the server
-                int64_t t2 = (int64_t) byteutils_get_ntp_timestamp(response, 24);
-
-                // The iOS device sends its time in micro seconds relative to an arbitrary Epoch (the last boot).
-                // For a little bonus confusion, they add SECONDS_FROM_1900_TO_1970 * 1000000 us.
-                // This means we have to expect some rather huge offset, but its growth or shrink over time should be small.
-
-                raop_ntp->data_index = (raop_ntp->data_index + 1) % RAOP_NTP_DATA_COUNT;
-                raop_ntp->data[raop_ntp->data_index].time = t3;
-                raop_ntp->data[raop_ntp->data_index].offset     = ((t1 - t0) + (t2 - t3)) / 2;
-                raop_ntp->data[raop_ntp->data_index].delay      = ((t3 - t0) - (t2 - t1));
-                raop_ntp->data[raop_ntp->data_index].dispersion = RAOP_NTP_R_RHO + RAOP_NTP_S_RHO +  (t3 - t0) * RAOP_NTP_PHI_PPM / 1000000u;
-
-                // Sort by delay
-                memcpy(data_sorted, raop_ntp->data, sizeof(data_sorted));
-                qsort(data_sorted, RAOP_NTP_DATA_COUNT, sizeof(data_sorted[0]), raop_ntp_compare);
-
-                uint64_t dispersion = 0ull;
-                int64_t offset = data_sorted[0].offset;
-                int64_t delay = data_sorted[RAOP_NTP_DATA_COUNT - 1].delay;
-
-                // Calculate dispersion
-                for(int i = 0; i < RAOP_NTP_DATA_COUNT; ++i) {
-                    unsigned long long disp = raop_ntp->data[i].dispersion + (t3 - raop_ntp->data[i].time) * RAOP_NTP_PHI_PPM / 1000000u;
-                    dispersion += disp / two_pow_n[i];
-                }
-
-                MUTEX_LOCK(raop_ntp->sync_params_mutex);
-
-                int64_t correction = offset - raop_ntp->sync_offset;
-                raop_ntp->sync_offset = offset;
-                raop_ntp->sync_dispersion = dispersion;
-                raop_ntp->sync_delay = delay;
-                MUTEX_UNLOCK(raop_ntp->sync_params_mutex);
-
-                logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp sync correction = %lld", correction);
-            }
-        }
+/*
+ * Takes the sample of a response that arrived at receive_time, 0 if the arrival time is unknown
+ */
+static void
+raop_ntp_process_response(raop_ntp_t *raop_ntp, unsigned char *response, int response_len, uint64_t receive_time)
+{
+    if (!raop_ntp->awaiting || response_len < 32) {
+        // A response that already timed out and would only be a poor sample, or no NTP packet at all
+        return;
+    }
+    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp receive time type_t packetlen = %d", response_len);
+    trace_record(TRACE_RECORD_NTP_RESPONSE, receive_time ? receive_time : raop_ntp_get_local_time(raop_ntp),
+                 response, response_len, NULL, 0);
+
+    int64_t t3 = (int64_t) (receive_time ? receive_time : raop_ntp_get_local_time(raop_ntp));
+    // Local time of the client when the NTP request packet leaves the client
+    int64_t t0 = (int64_t) byteutils_get_ntp_timestamp(response, 8);
+    // Local time of the server when the NTP request packet arrives at the server
+    int64_t t1 = (int64_t) byteutils_get_ntp_timestamp(response, 16);
+    // Local time of the server when the response message leaves the server
+    int64_t t2 = (int64_t) byteutils_get_ntp_timestamp(response, 24);
+
+    // The iOS device sends its time in micro seconds relative to an arbitrary Epoch (the last boot).
+    // For a little bonus confusion, they add SECONDS_FROM_1900_TO_1970 * 1000000 us.
+    // This means we have to expect some rather huge offset, but its growth or shrink over time should be small.
+
+    raop_ntp_add_sample(raop_ntp, t3, ((t1 - t0) + (t2 - t3)) / 2, (t3 - t0) - (t2 - t1));
+    raop_ntp_schedule_poll(raop_ntp);
+}
+
+static void
+raop_ntp_receive_response(raop_ntp_t *raop_ntp)
+{
+    unsigned char response[128];
+    int response_len;
 
-        // Sleep for 3 seconds
-        struct timeval now;
-        struct timespec wait_time;
-        MUTEX_LOCK(raop_ntp->wait_mutex);
-        gettimeofday(&now, NULL);
-        wait_time.tv_sec = now.tv_sec + 3;
-        wait_time.tv_nsec = now.tv_usec * 1000;
-        pthread_cond_timedwait(&raop_ntp->wait_cond, &raop_ntp->wait_mutex, &wait_time);
-        MUTEX_UNLOCK(raop_ntp->wait_mutex);
+    // Read response, the kernel arrival time keeps scheduler latency out of the offset
+    uint64_t receive_time = 0;
+    response_len = netutils_recv_timestamped(raop_ntp->tsock, response, sizeof(response),
+                                             &raop_ntp->remote_saddr, &raop_ntp->remote_saddr_len, &receive_time);
+    if (response_len < 0) {
+        // Nothing after all
+        return;
     }
+    raop_ntp_process_response(raop_ntp, response, response_len, receive_time);
+}
 
-    // Ensure running reflects the actual state
-    MUTEX_LOCK(raop_ntp->run_mutex);
-    raop_ntp->running = false;
-    MUTEX_UNLOCK(raop_ntp->run_mutex);
+/*
+ * Runs on the NTP event loop: the timer alternates between sending a request and timing it out,
+ * a response in between takes the sample and schedules the next request
+ */
+static void
+raop_ntp_event(void *cls, int fd)
+{
+    raop_ntp_t *raop_ntp = cls;
+    assert(raop_ntp);
 
-    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp exiting thread");
-    return 0;
+    if (!ATOMIC_LOAD(raop_ntp->running)) {
+        return;
+    }
+    if (fd != -1 && fd == raop_ntp->tsock) {
+        raop_ntp_receive_response(raop_ntp);
+    } else if (raop_ntp->awaiting) {
+        logger_log(raop_ntp->logger, LOGGER_ERR, "raop_ntp receive timeout");
+        metrics_add(METRIC_NTP_TIMEOUTS, 1);
+        raop_ntp_schedule_poll(raop_ntp);
+    } else {
+        raop_ntp_send_request(raop_ntp);
+    }
+}
+
+uint64_t
+raop_ntp_run_timer(raop_ntp_t *raop_ntp)
+{
+    assert(raop_ntp && raop_ntp->transport.get_local_time);
+
+    uint64_t now = raop_ntp_get_local_time(raop_ntp);
+    if (raop_ntp->timer_deadline && raop_ntp->timer_deadline <= now) {
+        raop_ntp->timer_deadline = 0;
+        raop_ntp_event(raop_ntp, -1);
+    }
+    return raop_ntp->timer_deadline;
+}
+
+void
+raop_ntp_receive(raop_ntp_t *raop_ntp, unsigned char *packet, int len, uint64_t receive_time)
+{
+    assert(raop_ntp && raop_ntp->transport.get_local_time);
+
+    if (ATOMIC_LOAD(raop_ntp->running)) {
+        raop_ntp_process_response(raop_ntp, packet, len, receive_time);
+    }
+}
+
+void
+raop_ntp_set_poll_interval(raop_ntp_t *raop_ntp, int min_ms, int max_ms)
+{
+    assert(raop_ntp);
+
+    if (min_ms > 0) {
+        raop_ntp->poll_min = min_ms;
+    }
+    if (max_ms > 0) {
+        raop_ntp->poll_max = max_ms;
+    }
+    if (raop_ntp->poll_max < raop_ntp->poll_min) {
+        raop_ntp->poll_max = raop_ntp->poll_min;
+    }
+    raop_ntp->poll_interval = raop_ntp->poll_min;
+}
+
+void
+raop_ntp_set_scope_id(raop_ntp_t *raop_ntp, unsigned int scope_id)
+{
+    assert(raop_ntp);
+
+    /* Link-local IPv6 peers are only reachable through the interface they came in on */
+    if (raop_ntp->remote_saddr.ss_family == AF_INET6) {
+        ((struct sockaddr_in6 *) &raop_ntp->remote_saddr)->sin6_scope_id = scope_id;
+    }
 }
 
 void
@@ -350,28 +691,55 @@ raop_ntp_start(raop_ntp_t *raop_ntp, unsigned short *timing_lport)
     assert(raop_ntp);
 
     MUTEX_LOCK(raop_ntp->run_mutex);
-    if (raop_ntp->running || !raop_ntp->joined) {
+    if (ATOMIC_LOAD(raop_ntp->running) || !raop_ntp->joined) {
+        MUTEX_UNLOCK(raop_ntp->run_mutex);
+        return;
+    }
+
+    if (raop_ntp->transport.get_local_time) {
+        /* Driven by whoever set the transport, the first request is due right away */
+        ATOMIC_STORE(raop_ntp->running, 1);
+        raop_ntp->joined = 0;
+        raop_ntp->burst_left = RAOP_NTP_BURST_COUNT;
+        raop_ntp->synced = 0;
+        raop_ntp->awaiting = 0;
+        raop_ntp->timer_deadline = raop_ntp_get_local_time(raop_ntp);
         MUTEX_UNLOCK(raop_ntp->run_mutex);
         return;
     }
 
     /* Initialize ports and sockets */
+    /* Listen on the family the sender connected over */
     if (raop_ntp->remote_saddr.ss_family == AF_INET6) {
         use_ipv6 = 1;
     }
-    use_ipv6 = 0;
     if (raop_ntp_init_socket(raop_ntp, use_ipv6) < 0) {
         logger_log(raop_ntp->logger, LOGGER_ERR, "raop_ntp initializing timing socket failed");
         MUTEX_UNLOCK(raop_ntp->run_mutex);
         return;
     }
-    if (timing_lport) *timing_lport = raop_ntp->timing_lport;
 
-    /* Create the thread and initialize running values */
-    raop_ntp->running = 1;
+    /* Register with an event loop and initialize running values */
+    raop_ntp->source = event_source_init(raop_ntp->logger, THREAD_ROLE_NTP, raop_ntp_event, raop_ntp);
+    if (!raop_ntp->source || event_source_add_fd(raop_ntp->source, raop_ntp->tsock) < 0) {
+        logger_log(raop_ntp->logger, LOGGER_ERR, "raop_ntp could not join an event loop");
+        event_source_destroy(raop_ntp->source);
+        raop_ntp->source = NULL;
+        closesocket(raop_ntp->tsock);
+        raop_ntp->tsock = -1;
+        MUTEX_UNLOCK(raop_ntp->run_mutex);
+        return;
+    }
+    if (timing_lport) *timing_lport = raop_ntp->timing_lport;
+    ATOMIC_STORE(raop_ntp->running, 1);
     raop_ntp->joined = 0;
+    /* Fill the samples in well under a second, so sync is accurate before the first frame */
+    raop_ntp->burst_left = RAOP_NTP_BURST_COUNT;
+    raop_ntp->synced = 0;
+    raop_ntp->awaiting = 0;
 
-    THREAD_CREATE(raop_ntp->thread, raop_ntp_thread, raop_ntp);
+    /* The first request goes out right away */
+    event_source_wakeup(raop_ntp->source);
     MUTEX_UNLOCK(raop_ntp->run_mutex);
 }
 
@@ -380,32 +748,30 @@ raop_ntp_stop(raop_ntp_t *raop_ntp)
 {
     assert(raop_ntp);
 
-    /* Check that we are running and thread is not
-     * joined (should never be while still running) */
+    /* Check that we are running and the source is not
+     * released (should never be while still running) */
     MUTEX_LOCK(raop_ntp->run_mutex);
-    if (!raop_ntp->running || raop_ntp->joined) {
+    if (!ATOMIC_LOAD(raop_ntp->running) || raop_ntp->joined) {
         MUTEX_UNLOCK(raop_ntp->run_mutex);
         return;
     }
-    raop_ntp->running = 0;
+    ATOMIC_STORE(raop_ntp->running, 0);
     MUTEX_UNLOCK(raop_ntp->run_mutex);
 
-    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp stopping time thread");
-
-    MUTEX_LOCK(raop_ntp->wait_mutex);
-    COND_SIGNAL(raop_ntp->wait_cond);
-    MUTEX_UNLOCK(raop_ntp->wait_mutex);
+    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp stopping time");
 
-    if (raop_ntp->tsock != -1) {
+    /* The socket may only be closed once the loop let go of it */
+    event_source_destroy(raop_ntp->source);
+    raop_ntp->source = NULL;
+    raop_ntp->timer_deadline = 0;
+    if (raop_ntp->tsock != -1 && !raop_ntp->transport.get_local_time) {
         closesocket(raop_ntp->tsock);
         raop_ntp->tsock = -1;
     }
 
-    THREAD_JOIN(raop_ntp->thread);
+    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp stopped time");
 
-    logger_log(raop_ntp->logger, LOGGER_DEBUG, "raop_ntp stopped time thread");
-
-    /* Mark thread as joined */
+    /* Mark source as released */
     MUTEX_LOCK(raop_ntp->run_mutex);
     raop_ntp->joined = 1;
     MUTEX_UNLOCK(raop_ntp->run_mutex);
@@ -425,41 +791,60 @@ uint64_t raop_ntp_timestamp_to_micro_seconds(uint64_t ntp_timestamp, bool accoun
 }
 
 /**
- * Returns the current time in micro seconds according to the local wall clock.
- * The system Unix time is used as the local wall clock.
+ * Returns the current time in micro seconds according to the local clock, MEDIA_CLOCK.
  */
 uint64_t raop_ntp_get_local_time(raop_ntp_t *raop_ntp) {
-    struct timespec time;
-    clock_gettime(CLOCK_REALTIME, &time);
-    return (uint64_t)time.tv_sec * 1000000L + (uint64_t)(time.tv_nsec / 1000);
+    if (raop_ntp && raop_ntp->transport.get_local_time) {
+        return raop_ntp->transport.get_local_time(raop_ntp->transport.cls);
+    }
+    return media_clock_now();
 }
 
 /**
  * Returns the current time in micro seconds according to the remote wall clock.
  */
 uint64_t raop_ntp_get_remote_time(raop_ntp_t *raop_ntp) {
-    MUTEX_LOCK(raop_ntp->sync_params_mutex);
-    int64_t offset = raop_ntp->sync_offset;
-    MUTEX_UNLOCK(raop_ntp->sync_params_mutex);
-    return (uint64_t) ((int64_t) raop_ntp_get_local_time(raop_ntp)) + ((int64_t) offset);
+    uint64_t local_time = raop_ntp_get_local_time(raop_ntp);
+    int64_t offset = raop_ntp_get_sync_offset(raop_ntp, local_time);
+    return (uint64_t) ((int64_t) local_time) + ((int64_t) offset);
 }
 
 /**
  * Returns the local wall clock time in micro seconds for the given point in remote clock time
  */
 uint64_t raop_ntp_convert_remote_time(raop_ntp_t *raop_ntp, uint64_t remote_time) {
-    MUTEX_LOCK(raop_ntp->sync_params_mutex);
-    uint64_t offset = raop_ntp->sync_offset;
-    MUTEX_UNLOCK(raop_ntp->sync_params_mutex);
-    return (uint64_t) ((int64_t) remote_time) - ((int64_t) offset);
+    int64_t offset;
+    uint64_t time;
+    double skew;
+    raop_ntp_get_sync_params(raop_ntp, &offset, &time, &skew);
+    // Solve local = remote - (offset + skew * (local - time)) for local
+    int64_t delta = (int64_t) (remote_time - time) - offset;
+    return time + (int64_t) ((double) delta / (1.0 + skew));
 }
 
 /**
  * Returns the remote wall clock time in micro seconds for the given point in local clock time
  */
 uint64_t raop_ntp_convert_local_time(raop_ntp_t *raop_ntp, uint64_t local_time) {
-    MUTEX_LOCK(raop_ntp->sync_params_mutex);
-    uint64_t offset = raop_ntp->sync_offset;
-    MUTEX_UNLOCK(raop_ntp->sync_params_mutex);
+    int64_t offset = raop_ntp_get_sync_offset(raop_ntp, local_time);
     return (uint64_t) ((int64_t) local_time) + ((int64_t) offset);
 }
+
+unsigned int raop_ntp_get_sample_count(raop_ntp_t *raop_ntp) {
+    return ATOMIC_LOAD(raop_ntp->sample_count);
+}
+
+/**
+ * Returns the round trip delay to the AirPlay client in micro seconds, 0 before the first sync
+ */
+int64_t raop_ntp_get_round_trip_delay(raop_ntp_t *raop_ntp) {
+    unsigned int seq_begin, seq_end;
+    int64_t delay;
+    do {
+        seq_begin = atomic_load_explicit(&raop_ntp->sync_params_seq, memory_order_acquire);
+        delay = *(volatile int64_t *) &raop_ntp->sync_delay;
+        atomic_thread_fence(memory_order_acquire);
+        seq_end = atomic_load_explicit(&raop_ntp->sync_params_seq, memory_order_relaxed);
+    } while ((seq_begin & 1) || seq_begin != seq_end);
+    return delay;
+}
@@ -24,6 +24,32 @@ typedef struct raop_ntp_s raop_ntp_t;
 
 raop_ntp_t *raop_ntp_init(logger_t *logger, const unsigned char *remote_addr, int remote_addr_len, unsigned short timing_rport);
 
+/* Bounds of the adaptive polling interval in milli seconds, 0 keeps a default. Call before raop_ntp_start */
+void raop_ntp_set_poll_interval(raop_ntp_t *raop_ntp, int min_ms, int max_ms);
+
+void raop_ntp_set_scope_id(raop_ntp_t *raop_ntp, unsigned int scope_id);
+
+/*
+ * Stands in for the system clock and the timing socket, so the sync algorithm runs against a
+ * simulated sender, see rpiplay_clocksim.c. raop_ntp then neither opens a socket nor joins an
+ * event loop, whoever set the transport drives it with raop_ntp_run_timer and raop_ntp_receive.
+ */
+typedef struct raop_ntp_transport_s {
+    void *cls;
+    /* Local time in micro seconds, on MEDIA_CLOCK */
+    uint64_t (*get_local_time)(void *cls);
+    /* Sends an NTP request to the sender, returns -1 if it could not be sent */
+    int (*send)(void *cls, const unsigned char *packet, int len);
+} raop_ntp_transport_t;
+
+/* Call before raop_ntp_start, the transport is copied */
+void raop_ntp_set_transport(raop_ntp_t *raop_ntp, const raop_ntp_transport_t *transport);
+/* With a transport, sends the request or counts the timeout that is due and returns the local time the next one is */
+uint64_t raop_ntp_run_timer(raop_ntp_t *raop_ntp);
+/* With a transport, takes the sender's response that arrived at local time receive_time */
+void raop_ntp_receive(raop_ntp_t *raop_ntp, unsigned char *packet, int len, uint64_t receive_time);
+
+/* Starts polling the sender's NTP server, not needed when the samples come from raop_ptp */
 void raop_ntp_start(raop_ntp_t *raop_ntp, unsigned short *timing_lport);
 
 void raop_ntp_stop(raop_ntp_t *raop_ntp);
@@ -34,9 +60,38 @@ void raop_ntp_destroy(raop_ntp_t *raop_rtp);
 
 uint64_t raop_ntp_timestamp_to_micro_seconds(uint64_t ntp_timestamp, bool account_for_epoch_diff);
 
+/* Local time in micro seconds on MEDIA_CLOCK, see media_clock.h, raop_ntp may be NULL */
 uint64_t raop_ntp_get_local_time(raop_ntp_t *raop_ntp);
 uint64_t raop_ntp_get_remote_time(raop_ntp_t *raop_ntp);
 uint64_t raop_ntp_convert_remote_time(raop_ntp_t *raop_ntp, uint64_t remote_time);
 uint64_t raop_ntp_convert_local_time(raop_ntp_t *raop_ntp, uint64_t local_time);
+int64_t raop_ntp_get_round_trip_delay(raop_ntp_t *raop_ntp);
+/* Exchanges with the sender's clock so far, each one a sign of life. Wraps around, safe to call from any thread. */
+unsigned int raop_ntp_get_sample_count(raop_ntp_t *raop_ntp);
+
+/* What raop_ntp learnt of the sender's clock, all in micro seconds */
+typedef struct raop_ntp_estimate_s {
+    uint64_t time;      // Local time the offset holds at
+    int64_t offset;     // Remote minus local time
+    double skew;        // Change of the offset per local micro second
+    int64_t delay;      // Round trip delay
+} raop_ntp_estimate_t;
+
+/* Returns -1 while no exchange with the sender's clock came in yet. Safe to call from any thread. */
+int raop_ntp_get_estimate(raop_ntp_t *raop_ntp, raop_ntp_estimate_t *estimate);
+/*
+ * Starts from an estimate an earlier session with the same sender left behind instead of from
+ * nothing, so the first frames are already timed. It counts as one sample, aged by the time
+ * since, which the fresh ones soon push out, and a sender that rebooted in between shows up as
+ * a step of its clock. Call before raop_ntp_start and before raop_ptp feeds any sample.
+ */
+void raop_ntp_seed(raop_ntp_t *raop_ntp, const raop_ntp_estimate_t *estimate);
+
+/*
+ * Feeds one exchange with the sender's clock into the filter, an offset of remote minus local
+ * time measured at local_time over a round trip of delay, all in micro seconds. Called by the
+ * NTP thread or, with PTP timing, by the raop_ptp thread instead; there is only ever one.
+ */
+void raop_ntp_add_sample(raop_ntp_t *raop_ntp, uint64_t local_time, int64_t offset, int64_t delay);
 
 #endif //RAOP_NTP_H
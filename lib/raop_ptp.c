@@ -0,0 +1,417 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+
+#include "raop_ptp.h"
+#include "threads.h"
+#include "compat.h"
+#include "netutils.h"
+#include "byteutils.h"
+#include "metrics.h"
+
+#define RAOP_PTP_EVENT_PORT 319
+#define RAOP_PTP_GENERAL_PORT 320
+
+#define RAOP_PTP_HEADER_LEN 34
+#define RAOP_PTP_SYNC_LEN 44
+#define RAOP_PTP_DELAY_RESP_LEN 54
+
+#define RAOP_PTP_SYNC 0x0
+#define RAOP_PTP_DELAY_REQ 0x1
+#define RAOP_PTP_FOLLOW_UP 0x8
+#define RAOP_PTP_DELAY_RESP 0x9
+#define RAOP_PTP_TWO_STEP 0x02 // In the first octet of the flags
+
+#define RAOP_PTP_POLL_MS 250
+#define RAOP_PTP_DELAY_REQ_MS 250    // Master clocks usually send Sync every 125 ms
+#define RAOP_PTP_DELAY_TIMEOUT_US 1000000
+#define RAOP_PTP_MASTER_TIMEOUT_US 5000000 // Silence after which another master is followed
+
+struct raop_ptp_s {
+    logger_t *logger;
+    raop_ntp_t *clock;
+
+    thread_handle_t thread;
+    mutex_handle_t run_mutex;
+
+    int use_ipv6;
+    // Our port identity, a clock identity derived from the local address and port number 1
+    unsigned char port_identity[10];
+
+    int event_sock;
+    int general_sock;
+
+    // Everything below is only used by the ptp thread
+    unsigned char master_identity[10];
+    int has_master;
+    uint64_t master_heard;
+    struct sockaddr_storage master_saddr;
+    socklen_t master_saddr_len;
+    unsigned char domain;
+
+    // The Sync being completed, and the last one completed
+    uint16_t sync_seq;
+    int64_t sync_correction;
+    uint64_t sync_received;
+    int sync_pending;
+    int64_t master_sent;
+    uint64_t master_sent_received;
+    int has_sync;
+
+    uint16_t delay_req_seq;
+    uint64_t delay_req_sent;
+    int delay_req_pending;
+
+    /* MUTEX LOCKED VARIABLES START */
+    /* These variables only edited mutex locked */
+    int running;
+    int joined;
+};
+
+raop_ptp_t *
+raop_ptp_init(logger_t *logger, raop_ntp_t *clock, const unsigned char *local_addr, int local_addr_len)
+{
+    raop_ptp_t *raop_ptp;
+
+    assert(logger);
+    assert(clock);
+    assert(local_addr);
+
+    raop_ptp = calloc(1, sizeof(raop_ptp_t));
+    if (!raop_ptp) {
+        return NULL;
+    }
+    raop_ptp->logger = logger;
+    raop_ptp->clock = clock;
+    raop_ptp->use_ipv6 = (local_addr_len == 16);
+    raop_ptp->event_sock = -1;
+    raop_ptp->general_sock = -1;
+
+    // The clock identity only has to be unique among the PTP nodes of the network, as our address is
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < local_addr_len; i++) {
+        hash = (hash ^ local_addr[i]) * 1099511628211ull;
+    }
+    for (int i = 0; i < 8; i++) {
+        raop_ptp->port_identity[i] = (unsigned char) (hash >> (56 - 8 * i));
+    }
+    raop_ptp->port_identity[8] = 0;
+    raop_ptp->port_identity[9] = 1;
+
+    ATOMIC_STORE(raop_ptp->running, 0);
+    raop_ptp->joined = 1;
+
+    MUTEX_CREATE(raop_ptp->run_mutex);
+    return raop_ptp;
+}
+
+void
+raop_ptp_destroy(raop_ptp_t *raop_ptp)
+{
+    if (raop_ptp) {
+        raop_ptp_stop(raop_ptp);
+        MUTEX_DESTROY(raop_ptp->run_mutex);
+        free(raop_ptp);
+    }
+}
+
+/* PTP timestamp of 48 bit seconds and 32 bit nano seconds, in micro seconds */
+static int64_t
+raop_ptp_get_timestamp(unsigned char *b, int offset)
+{
+    uint64_t seconds = ((uint64_t) byteutils_get_short_be(b, offset) << 32) | byteutils_get_int_be(b, offset + 2);
+    uint32_t nano_seconds = byteutils_get_int_be(b, offset + 6);
+    return (int64_t) (seconds * 1000000 + nano_seconds / 1000);
+}
+
+/* correctionField, nano seconds times 2^16, in micro seconds */
+static int64_t
+raop_ptp_get_correction(unsigned char *b)
+{
+    return (int64_t) byteutils_get_long_be(b, 8) / 65536 / 1000;
+}
+
+static void
+raop_ptp_send_delay_req(raop_ptp_t *raop_ptp)
+{
+    unsigned char request[RAOP_PTP_SYNC_LEN];
+    struct sockaddr_storage saddr;
+
+    memset(request, 0, sizeof(request));
+    request[0] = RAOP_PTP_DELAY_REQ;
+    request[1] = 2;
+    request[3] = RAOP_PTP_SYNC_LEN;
+    request[4] = raop_ptp->domain;
+    memcpy(request + 20, raop_ptp->port_identity, sizeof(raop_ptp->port_identity));
+    raop_ptp->delay_req_seq++;
+    request[30] = raop_ptp->delay_req_seq >> 8;
+    request[31] = raop_ptp->delay_req_seq & 0xff;
+    request[32] = 1;
+    request[33] = 0x7f;
+
+    // Event messages go to the event port, whichever port the master sent from
+    memcpy(&saddr, &raop_ptp->master_saddr, raop_ptp->master_saddr_len);
+    if (saddr.ss_family == AF_INET6) {
+        ((struct sockaddr_in6 *) &saddr)->sin6_port = htons(RAOP_PTP_EVENT_PORT);
+    } else {
+        ((struct sockaddr_in *) &saddr)->sin_port = htons(RAOP_PTP_EVENT_PORT);
+    }
+
+    raop_ptp->delay_req_sent = raop_ntp_get_local_time(raop_ptp->clock);
+    if (sendto(raop_ptp->event_sock, (char *) request, sizeof(request), 0, (struct sockaddr *) &saddr,
+               raop_ptp->master_saddr_len) < 0) {
+        logger_log(raop_ptp->logger, LOGGER_ERR, "raop_ptp error sending Delay_Req");
+        return;
+    }
+    raop_ptp->delay_req_pending = 1;
+}
+
+static void
+raop_ptp_complete_sync(raop_ptp_t *raop_ptp, int64_t origin)
+{
+    raop_ptp->sync_pending = 0;
+    raop_ptp->master_sent = origin;
+    raop_ptp->master_sent_received = raop_ptp->sync_received;
+    raop_ptp->has_sync = 1;
+
+    if (!raop_ptp->delay_req_pending &&
+        raop_ptp->sync_received - raop_ptp->delay_req_sent >= RAOP_PTP_DELAY_REQ_MS * 1000ull) {
+        raop_ptp_send_delay_req(raop_ptp);
+    }
+}
+
+static void
+raop_ptp_handle_message(raop_ptp_t *raop_ptp, unsigned char *message, int length,
+                        struct sockaddr_storage *saddr, socklen_t saddr_len, uint64_t received)
+{
+    if (length < RAOP_PTP_HEADER_LEN || (message[1] & 0x0f) != 2) {
+        return;
+    }
+    int type = message[0] & 0x0f;
+    uint16_t seq = byteutils_get_short_be(message, 30);
+
+    if (type == RAOP_PTP_SYNC || type == RAOP_PTP_FOLLOW_UP) {
+        if (raop_ptp->has_master && memcmp(message + 20, raop_ptp->master_identity, 10)) {
+            if (received - raop_ptp->master_heard < RAOP_PTP_MASTER_TIMEOUT_US) {
+                return;
+            }
+            raop_ptp->has_master = 0;
+        }
+        if (!raop_ptp->has_master) {
+            if (type != RAOP_PTP_SYNC) {
+                return;
+            }
+            char address[INET6_ADDRSTRLEN];
+            int address_len = 0;
+            unsigned char *address_bytes = netutils_get_address(saddr, &address_len);
+            logger_log(raop_ptp->logger, LOGGER_INFO, "raop_ptp following the master clock at %s",
+                       netutils_format_address(address_bytes, address_len, address, sizeof(address)));
+            memcpy(raop_ptp->master_identity, message + 20, 10);
+            raop_ptp->has_master = 1;
+            raop_ptp->sync_pending = 0;
+            raop_ptp->has_sync = 0;
+            raop_ptp->delay_req_pending = 0;
+        }
+        raop_ptp->master_heard = received;
+        memcpy(&raop_ptp->master_saddr, saddr, saddr_len);
+        raop_ptp->master_saddr_len = saddr_len;
+        raop_ptp->domain = message[4];
+    }
+
+    switch (type) {
+        case RAOP_PTP_SYNC:
+            if (length < RAOP_PTP_SYNC_LEN) {
+                return;
+            }
+            raop_ptp->sync_seq = seq;
+            raop_ptp->sync_correction = raop_ptp_get_correction(message);
+            raop_ptp->sync_received = received;
+            if (message[6] & RAOP_PTP_TWO_STEP) {
+                // The precise time it left the master follows in a Follow_Up
+                raop_ptp->sync_pending = 1;
+            } else {
+                raop_ptp_complete_sync(raop_ptp, raop_ptp_get_timestamp(message, 34) + raop_ptp->sync_correction);
+            }
+            break;
+        case RAOP_PTP_FOLLOW_UP:
+            if (length < RAOP_PTP_SYNC_LEN || !raop_ptp->sync_pending || seq != raop_ptp->sync_seq) {
+                return;
+            }
+            raop_ptp_complete_sync(raop_ptp, raop_ptp_get_timestamp(message, 34) + raop_ptp->sync_correction +
+                                             raop_ptp_get_correction(message));
+            break;
+        case RAOP_PTP_DELAY_RESP:
+            if (length < RAOP_PTP_DELAY_RESP_LEN || !raop_ptp->delay_req_pending || !raop_ptp->has_sync ||
+                seq != raop_ptp->delay_req_seq || memcmp(message + 44, raop_ptp->port_identity, 10)) {
+                return;
+            }
+            raop_ptp->delay_req_pending = 0;
+            {
+                // The Sync leg from master to us and the Delay_Req leg back make up one round trip
+                int64_t master_received = raop_ptp_get_timestamp(message, 34) - raop_ptp_get_correction(message);
+                int64_t to_master = master_received - (int64_t) raop_ptp->delay_req_sent;
+                int64_t from_master = raop_ptp->master_sent - (int64_t) raop_ptp->master_sent_received;
+                raop_ntp_add_sample(raop_ptp->clock, raop_ptp->master_sent_received,
+                                    (to_master + from_master) / 2, to_master - from_master);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static THREAD_RETVAL
+raop_ptp_thread(void *arg)
+{
+    raop_ptp_t *raop_ptp = arg;
+    assert(raop_ptp);
+    unsigned char message[128];
+
+    while (ATOMIC_LOAD(raop_ptp->running)) {
+        struct pollfd fds[2];
+        fds[0].fd = raop_ptp->event_sock;
+        fds[0].events = POLLIN;
+        fds[1].fd = raop_ptp->general_sock;
+        fds[1].events = POLLIN;
+        int ret = poll(fds, 2, RAOP_PTP_POLL_MS);
+        if (ret < 0 && errno != EINTR) {
+            logger_log(raop_ptp->logger, LOGGER_ERR, "raop_ptp error waiting for messages");
+            break;
+        }
+
+        for (int i = 0; ret > 0 && i < 2; i++) {
+            if (!(fds[i].revents & POLLIN)) {
+                continue;
+            }
+            struct sockaddr_storage saddr;
+            socklen_t saddr_len = sizeof(saddr);
+            // Only the arrival of event messages is timed, the kernel timestamp keeps scheduling out of it
+            uint64_t received = 0;
+            int length = netutils_recv_timestamped(fds[i].fd, message, sizeof(message), &saddr, &saddr_len, &received);
+            if (length < 0) {
+                continue;
+            }
+            if (!received) {
+                received = raop_ntp_get_local_time(raop_ptp->clock);
+            }
+            raop_ptp_handle_message(raop_ptp, message, length, &saddr, saddr_len, received);
+        }
+
+        if (raop_ptp->delay_req_pending &&
+            raop_ntp_get_local_time(raop_ptp->clock) - raop_ptp->delay_req_sent > RAOP_PTP_DELAY_TIMEOUT_US) {
+            logger_log(raop_ptp->logger, LOGGER_ERR, "raop_ptp Delay_Resp timeout");
+            metrics_add(METRIC_NTP_TIMEOUTS, 1);
+            raop_ptp->delay_req_pending = 0;
+        }
+    }
+
+    // Ensure running reflects the actual state
+    MUTEX_LOCK(raop_ptp->run_mutex);
+    ATOMIC_STORE(raop_ptp->running, 0);
+    MUTEX_UNLOCK(raop_ptp->run_mutex);
+
+    logger_log(raop_ptp->logger, LOGGER_DEBUG, "raop_ptp exiting thread");
+    return 0;
+}
+
+static void
+raop_ptp_close_sockets(raop_ptp_t *raop_ptp)
+{
+    if (raop_ptp->event_sock != -1) {
+        closesocket(raop_ptp->event_sock);
+        raop_ptp->event_sock = -1;
+    }
+    if (raop_ptp->general_sock != -1) {
+        closesocket(raop_ptp->general_sock);
+        raop_ptp->general_sock = -1;
+    }
+}
+
+int
+raop_ptp_start(raop_ptp_t *raop_ptp)
+{
+    unsigned short event_port = RAOP_PTP_EVENT_PORT;
+    unsigned short general_port = RAOP_PTP_GENERAL_PORT;
+
+    assert(raop_ptp);
+
+    MUTEX_LOCK(raop_ptp->run_mutex);
+    if (ATOMIC_LOAD(raop_ptp->running) || !raop_ptp->joined) {
+        MUTEX_UNLOCK(raop_ptp->run_mutex);
+        return 0;
+    }
+
+    raop_ptp->event_sock = netutils_init_socket(&event_port, raop_ptp->use_ipv6, 1);
+    raop_ptp->general_sock = netutils_init_socket(&general_port, raop_ptp->use_ipv6, 1);
+    if (raop_ptp->event_sock == -1 || raop_ptp->general_sock == -1) {
+        logger_log(raop_ptp->logger, LOGGER_ERR, "raop_ptp could not bind the PTP ports %d and %d, "
+                   "they need the CAP_NET_BIND_SERVICE capability and no other PTP daemon running",
+                   RAOP_PTP_EVENT_PORT, RAOP_PTP_GENERAL_PORT);
+        raop_ptp_close_sockets(raop_ptp);
+        MUTEX_UNLOCK(raop_ptp->run_mutex);
+        return -1;
+    }
+    if (netutils_apply_qos(raop_ptp->event_sock, NETUTILS_QOS_TIMING) < 0 ||
+        netutils_apply_qos(raop_ptp->general_sock, NETUTILS_QOS_TIMING) < 0) {
+        logger_log(raop_ptp->logger, LOGGER_WARNING, "raop_ptp could not mark the PTP sockets for QoS");
+    }
+
+    raop_ptp->has_master = 0;
+    raop_ptp->sync_pending = 0;
+    raop_ptp->has_sync = 0;
+    raop_ptp->delay_req_pending = 0;
+    raop_ptp->delay_req_sent = 0;
+
+    /* Create the thread and initialize running values */
+    ATOMIC_STORE(raop_ptp->running, 1);
+    raop_ptp->joined = 0;
+
+    THREAD_CREATE(raop_ptp->thread, raop_ptp_thread, raop_ptp);
+    if (raop_ptp->thread && thread_apply_role(raop_ptp->thread, THREAD_ROLE_NTP) < 0) {
+        logger_log(raop_ptp->logger, LOGGER_WARNING, "Could not apply the scheduling settings of the PTP thread");
+    }
+    MUTEX_UNLOCK(raop_ptp->run_mutex);
+    return 0;
+}
+
+void
+raop_ptp_stop(raop_ptp_t *raop_ptp)
+{
+    assert(raop_ptp);
+
+    /* Check that we are running and thread is not
+     * joined (should never be while still running) */
+    MUTEX_LOCK(raop_ptp->run_mutex);
+    if (raop_ptp->joined) {
+        MUTEX_UNLOCK(raop_ptp->run_mutex);
+        return;
+    }
+    ATOMIC_STORE(raop_ptp->running, 0);
+    MUTEX_UNLOCK(raop_ptp->run_mutex);
+
+    logger_log(raop_ptp->logger, LOGGER_DEBUG, "raop_ptp stopping thread");
+
+    // The thread notices within one poll interval
+    THREAD_JOIN(raop_ptp->thread);
+    raop_ptp_close_sockets(raop_ptp);
+
+    /* Mark thread as joined */
+    MUTEX_LOCK(raop_ptp->run_mutex);
+    raop_ptp->joined = 1;
+    MUTEX_UNLOCK(raop_ptp->run_mutex);
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef RAOP_PTP_H
+#define RAOP_PTP_H
+
+#include "logger.h"
+#include "raop_ntp.h"
+
+/*
+ * PTP (IEEE 1588-2008) slave for the senders that ask for PTP timing in SETUP. It follows the
+ * Sync and Follow_Up messages of the master clock, measures the path with Delay_Req and feeds
+ * every exchange into a raop_ntp_t, which then converts times for everyone else exactly as it
+ * does for NTP timing; only the source of its samples differs.
+ *
+ * PTP uses the fixed UDP ports 319 and 320, so binding them takes root or the
+ * CAP_NET_BIND_SERVICE capability, and no other PTP daemon may hold them.
+ */
+typedef struct raop_ptp_s raop_ptp_t;
+
+/* Follows the first master heard, clock gets its samples. local_addr is where the sender reached us. */
+raop_ptp_t *raop_ptp_init(logger_t *logger, raop_ntp_t *clock,
+                          const unsigned char *local_addr, int local_addr_len);
+
+/* Returns -1 if the PTP ports could not be bound */
+int raop_ptp_start(raop_ptp_t *raop_ptp);
+void raop_ptp_stop(raop_ptp_t *raop_ptp);
+
+void raop_ptp_destroy(raop_ptp_t *raop_ptp);
+
+#endif //RAOP_PTP_H
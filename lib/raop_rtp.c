@@ -12,12 +12,20 @@
  *  Lesser General Public License for more details.
  */
 
+#if defined(__linux__)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#define RAOP_RTP_USE_RECVMMSG
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <math.h>
 
 #include "raop_rtp.h"
 #include "raop.h"
@@ -28,11 +36,41 @@
 #include "byteutils.h"
 #include "mirror_buffer.h"
 #include "stream.h"
+#include "event_loop.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "mem_account.h"
+#include "trace.h"
+#include "audio_format.h"
+#include "audio_queue.h"
+#include "probes.h"
 
 #define NO_FLUSH (-42)
 
-#define RAOP_RTP_SAMPLE_RATE (44100.0 / 1000000.0)
 #define RAOP_RTP_SYNC_DATA_COUNT 8
+/* Sync points needed before the rtp clock rate is fitted instead of assumed */
+#define RAOP_RTP_SYNC_MIN_FIT 4
+/* Largest accepted deviation of the fitted rate from the nominal one */
+#define RAOP_RTP_SYNC_MAX_SKEW (1000.0 / 1000000.0)
+/* Sync points further off the fitted line than this many micro seconds are ignored */
+#define RAOP_RTP_SYNC_MAX_RESIDUAL 2000.0
+/* Packets seen before the jitter estimate is trusted for sizing the buffer */
+#define RAOP_RTP_JITTER_WARMUP 16
+/* Frames between the receiver and the decode thread, over a second of AAC-ELD */
+#define RAOP_RTP_AUDIO_QUEUE_DEPTH 128
+/* Datagrams drained from a socket per wakeup */
+#define RAOP_RTP_RECV_BATCH 16
+/* Bounds in micro seconds for how long a resend may take before the packet is asked for again */
+#define RAOP_RTP_RESEND_MIN_TIMEOUT 10000
+#define RAOP_RTP_RESEND_MAX_TIMEOUT 250000
+/* Micro seconds between receiver statistics updates, and receiver reports if enabled */
+#define RAOP_RTP_REPORT_INTERVAL 5000000
+/* Packets the buffer waits beyond twice the jitter after the first underrun, doubled on each further one */
+#define RAOP_RTP_MARGIN_STEP 2
+/* Micro seconds between two growths of the margin, so the packets lost to one stall count once */
+#define RAOP_RTP_MARGIN_GROW_INTERVAL 500000
+/* Micro seconds of clean playout after which the margin shrinks by a packet, and again after as many */
+#define RAOP_RTP_MARGIN_SHRINK_INTERVAL 10000000
 
 typedef struct raop_rtp_sync_data_s {
     uint64_t ntp_time; // The local wall clock time at the time of rtp_time
@@ -42,25 +80,57 @@ typedef struct raop_rtp_sync_data_s {
 struct raop_rtp_s {
     logger_t *logger;
     raop_callbacks_t callbacks;
+    // Session the decode thread charges its allocations to, see mem_account.h
+    int mem_session;
+
+    // Codec of the audio packets, and its nominal rtp clock rate in units per micro second
+    audio_format_t format;
+    double sample_rate;
 
     // Time and sync
     raop_ntp_t *ntp;
+    // Fitted from sync_data: local time rtp_sync_ntp at rtp time rtp_sync_rtp, rtp_sync_scale rtp units per micro second
     double rtp_sync_scale;
-    int64_t rtp_sync_offset;
+    uint32_t rtp_sync_rtp;
+    uint64_t rtp_sync_ntp;
     raop_rtp_sync_data_t sync_data[RAOP_RTP_SYNC_DATA_COUNT];
     int sync_data_index;
 
-    // Transmission Stats, could be used if a playout buffer is needed
-    // float interarrival_jitter; // As defined by RTP RFC 3550, Section 6.4.1
-    // unsigned int last_packet_transit_time;
-    //int transit = (packet_receive_time - packet_send_time);
-    // int d = transit - last_packet_transit_time;
-    // if (d < 0) d = -d;
-    // interarrival_jitter = (1.f / 16.f) * ((double) d - interarrival_jitter);
+    // Transmission stats, used for sizing the playout buffer
+    double interarrival_jitter; // As defined by RTP RFC 3550, Section 6.4.1, in micro seconds
+    double packet_duration; // Smoothed duration of one packet in micro seconds
+    uint64_t last_arrival_time;
+    uint32_t last_rtp_time;
+    unsigned short last_seqnum;
+    int jitter_samples;
+
+    // Packets waited for on top of what the jitter asks, grown quickly on underruns and packets
+    // given up on, shrunk slowly while playout is clean, see raop_rtp_update_margin
+    int depth_margin;
+    uint64_t margin_grow_time;
+    uint64_t margin_change_time;
+    // Renderer underruns so far, stored by thread_decode, and the count the margin last saw
+    int renderer_underruns;
+    int seen_underruns;
+
+    // RTCP receiver reports on the control channel, sent every RAOP_RTP_REPORT_INTERVAL if enabled
+    int receiver_reports;
+    uint32_t ssrc;
+    uint32_t remote_ssrc;
+    uint64_t last_report_time;
+
+    // Pts of the last frame handed to the renderer, lost frames are placed one packet after it
+    uint64_t last_audio_pts;
 
     /* Buffer to handle all resends */
     raop_buffer_t *buffer;
 
+    /* Frames out of the buffer, decoded and rendered by thread_decode so the sockets stay served */
+    audio_queue_t *audio_queue;
+    thread_handle_t thread_decode;
+    /* Set when volume changed, for thread_decode to pass it on */
+    int volume_pending;
+
     /* Remote address as sockaddr */
     struct sockaddr_storage remote_saddr;
     socklen_t remote_saddr_len;
@@ -84,16 +154,25 @@ struct raop_rtp_s {
     int progress_changed;
 
     int flush;
-    thread_handle_t thread;
     mutex_handle_t run_mutex;
     /* MUTEX LOCKED VARIABLES END */
 
+    /* Set with the fields above, lets the event source skip the mutex when nothing was queued */
+    int events_pending;
+
     /* Remote control and timing ports */
     unsigned short control_rport;
 
     /* Sockets for control and data */
     int csock, dsock;
 
+    /* Serves both sockets and the queued events on a shared audio event loop */
+    event_source_t *source;
+    /* Reused for every read of the sockets, allocated while started */
+    struct raop_rtp_recv_batch_s *batch;
+    /* Control and data packets so far, see raop_rtp_get_received_packets */
+    unsigned int received_packets;
+
     /* Local control, timing and data ports */
     unsigned short control_lport;
     unsigned short data_lport;
@@ -107,23 +186,12 @@ struct raop_rtp_s {
 static int
 raop_rtp_parse_remote(raop_rtp_t *raop_rtp, const unsigned char *remote, int remotelen)
 {
-    char current[25];
-    int family;
+    char current[INET6_ADDRSTRLEN];
     int ret;
     assert(raop_rtp);
-    if (remotelen == 4) {
-        family = AF_INET;
-    } else if (remotelen == 16) {
-        family = AF_INET6;
-    } else {
-        return -1;
-    }
-    memset(current, 0, sizeof(current));
-    sprintf(current, "%d.%d.%d.%d", remote[0], remote[1], remote[2], remote[3]);
-    logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp parse remote ip = %s", current);
-    ret = netutils_parse_address(family, current,
-                                 &raop_rtp->remote_saddr,
-                                 sizeof(raop_rtp->remote_saddr));
+    logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp parse remote ip = %s",
+               netutils_format_address(remote, remotelen, current, sizeof(current)));
+    ret = netutils_init_address(&raop_rtp->remote_saddr, sizeof(raop_rtp->remote_saddr), remote, remotelen, 0, 0);
     if (ret < 0) {
         return -1;
     }
@@ -133,7 +201,8 @@ raop_rtp_parse_remote(raop_rtp_t *raop_rtp, const unsigned char *remote, int rem
 
 raop_rtp_t *
 raop_rtp_init(logger_t *logger, raop_callbacks_t *callbacks, raop_ntp_t *ntp, const unsigned char *remote, int remotelen,
-              const unsigned char *aeskey, const unsigned char *aesiv, const unsigned char *ecdh_secret)
+              const unsigned char *aeskey, const unsigned char *aesiv, const unsigned char *ecdh_secret,
+              int max_buffer_length)
 {
     raop_rtp_t *raop_rtp;
 
@@ -145,10 +214,14 @@ raop_rtp_init(logger_t *logger, raop_callbacks_t *callbacks, raop_ntp_t *ntp, co
         return NULL;
     }
     raop_rtp->logger = logger;
+    raop_rtp->mem_session = mem_account_session();
     raop_rtp->ntp = ntp;
 
-    raop_rtp->rtp_sync_offset = 0;
-    raop_rtp->rtp_sync_scale = RAOP_RTP_SAMPLE_RATE;
+    raop_rtp->rtp_sync_rtp = 0;
+    raop_rtp->rtp_sync_ntp = 0;
+    audio_format_init_default(&raop_rtp->format);
+    raop_rtp->sample_rate = raop_rtp->format.sample_rate / 1000000.0;
+    raop_rtp->rtp_sync_scale = raop_rtp->sample_rate;
     raop_rtp->sync_data_index = 0;
     for (int i = 0; i < RAOP_RTP_SYNC_DATA_COUNT; ++i) {
         raop_rtp->sync_data[i].ntp_time = 0;
@@ -156,17 +229,24 @@ raop_rtp_init(logger_t *logger, raop_callbacks_t *callbacks, raop_ntp_t *ntp, co
     }
 
     memcpy(&raop_rtp->callbacks, callbacks, sizeof(raop_callbacks_t));
-    raop_rtp->buffer = raop_buffer_init(logger, aeskey, aesiv, ecdh_secret);
+    raop_rtp->buffer = raop_buffer_init(logger, max_buffer_length, aeskey, aesiv, ecdh_secret);
     if (!raop_rtp->buffer) {
         free(raop_rtp);
         return NULL;
     }
     if (raop_rtp_parse_remote(raop_rtp, remote, remotelen) < 0) {
+        raop_buffer_destroy(raop_rtp->buffer);
+        free(raop_rtp);
+        return NULL;
+    }
+    raop_rtp->audio_queue = audio_queue_init(logger, RAOP_RTP_AUDIO_QUEUE_DEPTH);
+    if (!raop_rtp->audio_queue) {
+        raop_buffer_destroy(raop_rtp->buffer);
         free(raop_rtp);
         return NULL;
     }
 
-    raop_rtp->running = 0;
+    ATOMIC_STORE(raop_rtp->running, 0);
     raop_rtp->joined = 1;
     raop_rtp->flush = NO_FLUSH;
 
@@ -182,6 +262,7 @@ raop_rtp_destroy(raop_rtp_t *raop_rtp)
         raop_rtp_stop(raop_rtp);
         MUTEX_DESTROY(raop_rtp->run_mutex);
         raop_buffer_destroy(raop_rtp->buffer);
+        audio_queue_destroy(raop_rtp->audio_queue);
         free(raop_rtp->metadata);
         free(raop_rtp->coverart);
         free(raop_rtp->dacp_id);
@@ -203,7 +284,9 @@ raop_rtp_resend_callback(void *opaque, unsigned short seqnum, unsigned short cou
     addr = (struct sockaddr *)&raop_rtp->control_saddr;
     addrlen = raop_rtp->control_saddr_len;
 
-    logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp got resend request %d %d", seqnum, count);
+    LOGGER_DEBUG_HOT(raop_rtp->logger, "raop_rtp got resend request %d %d", seqnum, count);
+    metrics_add(METRIC_AUDIO_RESEND_REQUESTS, 1);
+    PROBE2(audio_resend_request, seqnum, count);
     ourseqnum = raop_rtp->control_seqnum++;
 
     /* Fill the request buffer */
@@ -224,6 +307,61 @@ raop_rtp_resend_callback(void *opaque, unsigned short seqnum, unsigned short cou
     return 0;
 }
 
+/*
+ * Publishes the receiver statistics of the past interval and, if enabled, sends them to the
+ * sender as an RTCP receiver report, RFC 3550 Section 6.4.2. Without sender reports to refer
+ * to, LSR and DLSR stay 0.
+ */
+static void
+raop_rtp_report(raop_rtp_t *raop_rtp)
+{
+    raop_buffer_stats_t stats;
+    unsigned char packet[32];
+    int32_t lost;
+    uint32_t jitter;
+    int ret;
+
+    raop_buffer_take_stats(raop_rtp->buffer, &stats);
+    metrics_set(METRIC_AUDIO_JITTER, (int64_t) raop_rtp->interarrival_jitter);
+    metrics_set(METRIC_AUDIO_FRACTION_LOST, stats.fraction_lost);
+    logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp received %u of %u packets up to %u, fraction lost %u/256, jitter %.0f us",
+               stats.received, stats.expected, stats.extended_max_seqnum, stats.fraction_lost,
+               raop_rtp->interarrival_jitter);
+
+    if (!raop_rtp->receiver_reports || !raop_rtp->control_saddr_len) {
+        return;
+    }
+
+    // The cumulative number of packets lost is a signed 24 bit field
+    lost = stats.cumulative_lost;
+    if (lost > 0x7fffff) {
+        lost = 0x7fffff;
+    } else if (lost < -0x800000) {
+        lost = -0x800000;
+    }
+    jitter = (uint32_t) (raop_rtp->interarrival_jitter * raop_rtp->sample_rate);
+
+    packet[0] = 0x81;
+    packet[1] = 201;
+    packet[2] = 0;
+    packet[3] = 7;
+    byteutils_put_int_be(packet, 4, raop_rtp->ssrc);
+    byteutils_put_int_be(packet, 8, raop_rtp->remote_ssrc);
+    byteutils_put_int_be(packet, 12, ((uint32_t) stats.fraction_lost << 24) | ((uint32_t) lost & 0xffffff));
+    byteutils_put_int_be(packet, 16, stats.extended_max_seqnum);
+    byteutils_put_int_be(packet, 20, jitter);
+    byteutils_put_int_be(packet, 24, 0);
+    byteutils_put_int_be(packet, 28, 0);
+
+    ret = sendto(raop_rtp->csock, (const char *)packet, sizeof(packet), 0,
+                 (struct sockaddr *)&raop_rtp->control_saddr, raop_rtp->control_saddr_len);
+    if (ret == -1) {
+        logger_log(raop_rtp->logger, LOGGER_WARNING, "raop_rtp receiver report failed: %d", SOCKET_GET_ERROR());
+        return;
+    }
+    metrics_add(METRIC_AUDIO_RECEIVER_REPORTS, 1);
+}
+
 static int
 raop_rtp_init_sockets(raop_rtp_t *raop_rtp, int use_ipv6, int use_udp)
 {
@@ -238,6 +376,9 @@ raop_rtp_init_sockets(raop_rtp_t *raop_rtp, int use_ipv6, int use_udp)
     if (csock == -1 || dsock == -1) {
         goto sockets_cleanup;
     }
+    if (netutils_apply_qos(csock, NETUTILS_QOS_AUDIO_CONTROL) < 0 || netutils_apply_qos(dsock, NETUTILS_QOS_AUDIO) < 0) {
+        logger_log(raop_rtp->logger, LOGGER_WARNING, "raop_rtp could not mark the audio sockets for QoS");
+    }
 
     /* Set socket descriptors */
     raop_rtp->csock = csock;
@@ -245,6 +386,8 @@ raop_rtp_init_sockets(raop_rtp_t *raop_rtp, int use_ipv6, int use_udp)
 
     /* Set port values */
     raop_rtp->control_lport = cport;
+    /* Only has to differ from the SSRC of the sender */
+    raop_rtp->ssrc = (uint32_t) raop_ntp_get_local_time(raop_rtp->ntp) ^ ((uint32_t) cport << 16);
     raop_rtp->data_lport = dport;
     return 0;
 
@@ -258,7 +401,6 @@ static int
 raop_rtp_process_events(raop_rtp_t *raop_rtp, void *cb_data)
 {
     int flush;
-    float volume;
     int volume_changed;
     unsigned char *metadata;
     int metadata_len;
@@ -273,14 +415,17 @@ raop_rtp_process_events(raop_rtp_t *raop_rtp, void *cb_data)
 
     assert(raop_rtp);
 
-    MUTEX_LOCK(raop_rtp->run_mutex);
-    if (!raop_rtp->running) {
-        MUTEX_UNLOCK(raop_rtp->run_mutex);
+    if (!ATOMIC_LOAD(raop_rtp->running)) {
         return 1;
     }
+    if (!ATOMIC_LOAD(raop_rtp->events_pending)) {
+        return 0;
+    }
+
+    MUTEX_LOCK(raop_rtp->run_mutex);
+    ATOMIC_STORE(raop_rtp->events_pending, 0);
 
     /* Read the volume level */
-    volume = raop_rtp->volume;
     volume_changed = raop_rtp->volume_changed;
     raop_rtp->volume_changed = 0;
 
@@ -315,19 +460,18 @@ raop_rtp_process_events(raop_rtp_t *raop_rtp, void *cb_data)
 
     MUTEX_UNLOCK(raop_rtp->run_mutex);
 
-    /* Call set_volume callback if changed */
+    /* The renderer gets the volume and the flush on the decode thread, the volume leaves what
+     * is buffered alone, the renderer ramps to it */
     if (volume_changed) {
-        raop_buffer_flush(raop_rtp->buffer, flush);
-        if (raop_rtp->callbacks.audio_set_volume) {
-            raop_rtp->callbacks.audio_set_volume(raop_rtp->callbacks.cls, volume);
-        }
+        ATOMIC_STORE(raop_rtp->volume_pending, 1);
+        audio_queue_wakeup(raop_rtp->audio_queue);
     }
 
     /* Handle flush if requested */
     if (flush != NO_FLUSH) {
-        if (raop_rtp->callbacks.audio_flush) {
-            raop_rtp->callbacks.audio_flush(raop_rtp->callbacks.cls);
-        }
+        raop_buffer_flush(raop_rtp->buffer, flush);
+        raop_rtp->last_audio_pts = 0;
+        audio_queue_flush(raop_rtp->audio_queue);
     }
 
     if (metadata != NULL) {
@@ -363,160 +507,464 @@ raop_rtp_process_events(raop_rtp_t *raop_rtp, void *cb_data)
     return 0;
 }
 
+uint64_t raop_rtp_convert_rtp_time(raop_rtp_t *raop_rtp, uint32_t rtp_time) {
+    // Relative to the last sync point, so the 32 bit rtp clock may wrap around
+    int32_t rtp_delta = (int32_t) (rtp_time - raop_rtp->rtp_sync_rtp);
+    return raop_rtp->rtp_sync_ntp + (int64_t) ((double) rtp_delta / raop_rtp->rtp_sync_scale);
+}
+
+/*
+ * Least squares fit of ntp = ntp_ref + slope * rtp over the sync points flagged in use,
+ * with both clocks relative to the newest sync point. Returns the fitted point count.
+ */
+static int
+raop_rtp_fit_sync_data(raop_rtp_t *raop_rtp, const int *use, double *intercept, double *slope)
+{
+    const raop_rtp_sync_data_t *ref = &raop_rtp->sync_data[raop_rtp->sync_data_index];
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    int count = 0;
+
+    for (int i = 0; i < RAOP_RTP_SYNC_DATA_COUNT; ++i) {
+        if (!use[i]) continue;
+        double x = (double) (int32_t) (raop_rtp->sync_data[i].rtp_time - ref->rtp_time);
+        double y = (double) (int64_t) (raop_rtp->sync_data[i].ntp_time - ref->ntp_time);
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+        count++;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    double denominator = count * sum_xx - sum_x * sum_x;
+    *slope = 1.0 / raop_rtp->sample_rate;
+    if (count >= RAOP_RTP_SYNC_MIN_FIT && denominator > 0) {
+        double fitted = (count * sum_xy - sum_x * sum_y) / denominator;
+        // Only believe the fit if it is close to the nominal sample rate
+        if (fabs(fitted * raop_rtp->sample_rate - 1.0) < RAOP_RTP_SYNC_MAX_SKEW) {
+            *slope = fitted;
+        }
+    }
+    *intercept = (sum_y - *slope * sum_x) / count;
+    return count;
+}
+
 void raop_rtp_sync_clock(raop_rtp_t *raop_rtp, uint32_t rtp_time, uint64_t ntp_time) {
     raop_rtp->sync_data_index = (raop_rtp->sync_data_index + 1) % RAOP_RTP_SYNC_DATA_COUNT;
     raop_rtp->sync_data[raop_rtp->sync_data_index].rtp_time = rtp_time;
     raop_rtp->sync_data[raop_rtp->sync_data_index].ntp_time = ntp_time;
 
-    uint32_t valid_data_count = 0;
-    valid_data_count = 0;
-    int64_t total_offsets = 0;
+    int use[RAOP_RTP_SYNC_DATA_COUNT];
+    double intercept, slope;
     for (int i = 0; i < RAOP_RTP_SYNC_DATA_COUNT; ++i) {
-        if (raop_rtp->sync_data[i].ntp_time == 0) continue;
-        total_offsets += (int64_t) (((double) raop_rtp->sync_data[i].rtp_time) / raop_rtp->rtp_sync_scale) - raop_rtp->sync_data[i].ntp_time;
-        valid_data_count++;
+        use[i] = raop_rtp->sync_data[i].ntp_time != 0;
+    }
+    if (!raop_rtp_fit_sync_data(raop_rtp, use, &intercept, &slope)) {
+        return;
     }
-    int64_t avg_offset = total_offsets / valid_data_count;
-    int64_t correction = avg_offset - raop_rtp->rtp_sync_offset;
-    raop_rtp->rtp_sync_offset = avg_offset;
 
-    logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp sync correction=%lld", correction);
+    // Drop sync points that arrived far off the line, typically after a network hiccup, and fit again
+    const raop_rtp_sync_data_t *ref = &raop_rtp->sync_data[raop_rtp->sync_data_index];
+    int rejected = 0;
+    for (int i = 0; i < RAOP_RTP_SYNC_DATA_COUNT; ++i) {
+        if (!use[i]) continue;
+        double x = (double) (int32_t) (raop_rtp->sync_data[i].rtp_time - ref->rtp_time);
+        double y = (double) (int64_t) (raop_rtp->sync_data[i].ntp_time - ref->ntp_time);
+        if (fabs(y - (intercept + slope * x)) > RAOP_RTP_SYNC_MAX_RESIDUAL) {
+            use[i] = 0;
+            rejected++;
+        }
+    }
+    if (rejected && !raop_rtp_fit_sync_data(raop_rtp, use, &intercept, &slope)) {
+        // Everything is off the line, so the clock jumped; start over from the newest point
+        intercept = 0;
+        slope = 1.0 / raop_rtp->sample_rate;
+        for (int i = 0; i < RAOP_RTP_SYNC_DATA_COUNT; ++i) {
+            if (i != raop_rtp->sync_data_index) raop_rtp->sync_data[i].ntp_time = 0;
+        }
+    }
+
+    uint64_t previous = raop_rtp_convert_rtp_time(raop_rtp, ref->rtp_time);
+    raop_rtp->rtp_sync_rtp = ref->rtp_time;
+    raop_rtp->rtp_sync_ntp = ref->ntp_time + (int64_t) intercept;
+    raop_rtp->rtp_sync_scale = 1.0 / slope;
+    int64_t correction = (int64_t) (raop_rtp->rtp_sync_ntp - previous);
+
+    logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp sync correction=%lld, rate=%.2f Hz, rejected=%d",
+               correction, raop_rtp->rtp_sync_scale * 1000000.0, rejected);
 }
 
-uint64_t raop_rtp_convert_rtp_time(raop_rtp_t *raop_rtp, uint32_t rtp_time) {
-    return (uint64_t) (((double) rtp_time) / raop_rtp->rtp_sync_scale) - raop_rtp->rtp_sync_offset;
+/* A missing packet is waited for about twice the jitter, plus the margin playout health asks for */
+static void
+raop_rtp_update_depth(raop_rtp_t *raop_rtp)
+{
+    if (raop_rtp->jitter_samples < RAOP_RTP_JITTER_WARMUP || raop_rtp->packet_duration <= 0.0) {
+        return;
+    }
+    int depth = (int) (2.0 * raop_rtp->interarrival_jitter / raop_rtp->packet_duration + 0.5);
+    raop_buffer_set_target_depth(raop_rtp->buffer, depth + 1 + raop_rtp->depth_margin);
 }
 
-static THREAD_RETVAL
-raop_rtp_thread_udp(void *arg)
+/*
+ * Sizes the margin by how the playout went: packets the buffer gave up on, and underruns of
+ * the renderer, which a packet that came too late for it shows up as, double it at once, a
+ * jitter estimate that settles on the calm between the bursts of a bad Wi-Fi otherwise keeps
+ * costing audio. Clean playout takes it back a packet at a time, so a good network ends up
+ * with twice its jitter and no more.
+ */
+static void
+raop_rtp_update_margin(raop_rtp_t *raop_rtp, int lost, uint64_t now)
 {
-    raop_rtp_t *raop_rtp = arg;
-    unsigned char packet[RAOP_PACKET_LEN];
-    unsigned int packetlen;
-    struct sockaddr_storage saddr;
-    socklen_t saddrlen;
-    assert(raop_rtp);
+    int underruns = ATOMIC_LOAD(raop_rtp->renderer_underruns);
+    // Counted by the renderer, which may have been replaced by one counting from 0
+    int trouble = lost || underruns != raop_rtp->seen_underruns;
+    raop_rtp->seen_underruns = underruns;
+
+    int margin = raop_rtp->depth_margin;
+    if (trouble) {
+        if (now - raop_rtp->margin_grow_time >= RAOP_RTP_MARGIN_GROW_INTERVAL) {
+            margin = margin ? margin * 2 : RAOP_RTP_MARGIN_STEP;
+            raop_rtp->margin_grow_time = now;
+        }
+        raop_rtp->margin_change_time = now;
+    } else if (margin > 0 && now - raop_rtp->margin_change_time >= RAOP_RTP_MARGIN_SHRINK_INTERVAL) {
+        margin--;
+        raop_rtp->margin_change_time = now;
+    }
+    if (margin > RAOP_BUFFER_MAX_LENGTH) {
+        margin = RAOP_BUFFER_MAX_LENGTH;
+    }
+    if (margin != raop_rtp->depth_margin) {
+        logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp %s the playout margin to %d packets",
+                   margin > raop_rtp->depth_margin ? "grew" : "shrank", margin);
+        raop_rtp->depth_margin = margin;
+        raop_rtp_update_depth(raop_rtp);
+    }
+}
 
-    while(1) {
-        fd_set rfds;
-        struct timeval tv;
-        int nfds, ret;
+/*
+ * Updates the RFC 3550 interarrival jitter estimate with a freshly received data packet and
+ * resizes the playout buffer to match.
+ */
+static void
+raop_rtp_update_jitter(raop_rtp_t *raop_rtp, unsigned short seqnum, uint32_t rtp_time, uint64_t arrival_time)
+{
+    if (raop_rtp->jitter_samples > 0 && (unsigned short) (seqnum - raop_rtp->last_seqnum) == 1) {
+        // Wraparound safe, the difference of the rtp clock is all that matters
+        int32_t rtp_delta = (int32_t) (rtp_time - raop_rtp->last_rtp_time);
+        double expected = (double) rtp_delta / raop_rtp->rtp_sync_scale;
+        double d = (double) (int64_t) (arrival_time - raop_rtp->last_arrival_time) - expected;
+        if (d < 0) d = -d;
+        raop_rtp->interarrival_jitter += (d - raop_rtp->interarrival_jitter) / 16.0;
+        if (raop_rtp->packet_duration == 0.0) {
+            raop_rtp->packet_duration = expected;
+        } else if (expected > 0) {
+            raop_rtp->packet_duration += (expected - raop_rtp->packet_duration) / 16.0;
+        }
+    }
+    if (raop_rtp->jitter_samples < RAOP_RTP_JITTER_WARMUP) {
+        raop_rtp->jitter_samples++;
+    } else {
+        raop_rtp_update_depth(raop_rtp);
+    }
+    raop_rtp->last_seqnum = seqnum;
+    raop_rtp->last_rtp_time = rtp_time;
+    raop_rtp->last_arrival_time = arrival_time;
+}
 
-        /* Check if we are still running and process callbacks */
-        if (raop_rtp_process_events(raop_rtp, NULL)) {
+/*
+ * Preallocated packet buffers for draining a socket with as few syscalls as possible
+ */
+typedef struct raop_rtp_recv_batch_s {
+    unsigned char packets[RAOP_RTP_RECV_BATCH][RAOP_PACKET_LEN];
+    int lengths[RAOP_RTP_RECV_BATCH];
+    struct sockaddr_storage saddrs[RAOP_RTP_RECV_BATCH];
+    socklen_t saddr_lens[RAOP_RTP_RECV_BATCH];
+    uint64_t arrival_times[RAOP_RTP_RECV_BATCH]; // Kernel receive timestamps, 0 if unavailable
+#ifdef RAOP_RTP_USE_RECVMMSG
+    struct mmsghdr msgs[RAOP_RTP_RECV_BATCH];
+    struct iovec iovecs[RAOP_RTP_RECV_BATCH];
+    union {
+        char buf[NETUTILS_CMSG_SPACE];
+        struct cmsghdr align;
+    } controls[RAOP_RTP_RECV_BATCH];
+#endif
+} raop_rtp_recv_batch_t;
+
+/*
+ * Reads every datagram that is already queued on the socket, up to RAOP_RTP_RECV_BATCH.
+ * Returns the number of packets read or -1 on error.
+ */
+static int
+raop_rtp_recv_batch(int fd, raop_rtp_recv_batch_t *batch)
+{
+#ifdef RAOP_RTP_USE_RECVMMSG
+    for (int i = 0; i < RAOP_RTP_RECV_BATCH; i++) {
+        batch->iovecs[i].iov_base = batch->packets[i];
+        batch->iovecs[i].iov_len = RAOP_PACKET_LEN;
+        memset(&batch->msgs[i].msg_hdr, 0, sizeof(batch->msgs[i].msg_hdr));
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovecs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+        batch->msgs[i].msg_hdr.msg_name = &batch->saddrs[i];
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(batch->saddrs[i]);
+        batch->msgs[i].msg_hdr.msg_control = batch->controls[i].buf;
+        batch->msgs[i].msg_hdr.msg_controllen = sizeof(batch->controls[i].buf);
+    }
+    int count = recvmmsg(fd, batch->msgs, RAOP_RTP_RECV_BATCH, MSG_DONTWAIT, NULL);
+    if (count < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+    for (int i = 0; i < count; i++) {
+        batch->lengths[i] = batch->msgs[i].msg_len;
+        batch->saddr_lens[i] = batch->msgs[i].msg_hdr.msg_namelen;
+        batch->arrival_times[i] = netutils_get_recv_timestamp(&batch->msgs[i].msg_hdr);
+    }
+    return count;
+#else
+    int count;
+    for (count = 0; count < RAOP_RTP_RECV_BATCH; count++) {
+        batch->saddr_lens[count] = sizeof(batch->saddrs[count]);
+        int ret = recvfrom(fd, (char *) batch->packets[count], RAOP_PACKET_LEN, MSG_DONTWAIT,
+                           (struct sockaddr *) &batch->saddrs[count], &batch->saddr_lens[count]);
+        if (ret < 0) {
+            if (count == 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                return -1;
+            }
             break;
         }
+        batch->lengths[count] = ret;
+        batch->arrival_times[count] = 0;
+    }
+    return count;
+#endif
+}
+
+static void
+raop_rtp_handle_control_packet(raop_rtp_t *raop_rtp, unsigned char *packet, unsigned int packetlen,
+                               struct sockaddr_storage *saddr, socklen_t saddrlen)
+{
+    memcpy(&raop_rtp->control_saddr, saddr, saddrlen);
+    raop_rtp->control_saddr_len = saddrlen;
+    trace_record(TRACE_RECORD_RTP_CONTROL, raop_ntp_get_local_time(raop_rtp->ntp), packet, packetlen, NULL, 0);
+    int type_c = packet[1] & ~0x80;
+    LOGGER_DEBUG_HOT(raop_rtp->logger, "raop_rtp type_c 0x%02x, packetlen = %d", type_c, packetlen);
+    if (type_c == 0x56 && packetlen >= 16) {
+        /* Handle resent data packet */
+        uint32_t rtp_timestamp =  (packet[4 + 4] << 24) | (packet[4 + 5] << 16) | (packet[4 + 6] << 8) | packet[4 + 7];
+        uint64_t ntp_timestamp = raop_rtp_convert_rtp_time(raop_rtp, rtp_timestamp);
+        uint64_t ntp_now = raop_ntp_get_local_time(raop_rtp->ntp);
+        LOGGER_DEBUG_HOT(raop_rtp->logger, "raop_rtp audio resent: ntp = %llu, now = %llu, latency=%lld, rtp=%u",
+                   ntp_timestamp, ntp_now, ((int64_t) ntp_now) - ((int64_t) ntp_timestamp), rtp_timestamp);
+        metrics_add(METRIC_AUDIO_PACKETS_RESENT, 1);
+        int result = raop_buffer_enqueue(raop_rtp->buffer, packet + 4, packetlen - 4, ntp_timestamp, 1);
+        assert(result >= 0);
+    } else if (type_c == 0x54 && packetlen >= 20) {
+        // The unit for the rtp clock is 1 / sample rate, the sender stamps its time a quarter second early
+        uint32_t sync_rtp = byteutils_get_int_be(packet, 4) - raop_rtp->format.sample_rate / 4;
+        uint64_t sync_ntp_raw = byteutils_get_long_be(packet, 8);
+        uint64_t sync_ntp_remote = raop_ntp_timestamp_to_micro_seconds(sync_ntp_raw, true);
+        uint64_t sync_ntp_local = raop_ntp_convert_remote_time(raop_rtp->ntp, sync_ntp_remote);
+        // It's not clear what the additional rtp timestamp indicates
+        uint32_t next_rtp = byteutils_get_int_be(packet, 16);
+        logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp sync: ntp=%llu, local ntp: %llu, rtp=%u, rtp_next=%u",
+                   sync_ntp_remote, sync_ntp_local, sync_rtp, next_rtp);
+        PROBE3(audio_sync, sync_rtp, sync_ntp_remote, sync_ntp_local);
+        raop_rtp_sync_clock(raop_rtp, sync_rtp, sync_ntp_local);
+    } else {
+        logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp unknown packet");
+    }
+}
 
-        /* Set timeout value to 5ms */
-        tv.tv_sec = 0;
-        tv.tv_usec = 5000;
+/*
+ * Returns 1 if the packet was audio data that went into the buffer
+ */
+static int
+raop_rtp_handle_data_packet(raop_rtp_t *raop_rtp, unsigned char *packet, unsigned int packetlen, uint64_t arrival_time)
+{
+    // rtp payload type
+    int type_d = packet[1] & ~0x80;
+    //logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_udp type_d 0x%02x, packetlen = %d", type_d, packetlen);
 
-        /* Get the correct nfds value */
-        nfds = raop_rtp->csock+1;
-        if (raop_rtp->dsock >= nfds)
-            nfds = raop_rtp->dsock+1;
+    trace_record(TRACE_RECORD_RTP_DATA, arrival_time ? arrival_time : raop_ntp_get_local_time(raop_rtp->ntp),
+                 packet, packetlen, NULL, 0);
 
-        /* Set rfds and call select */
-        FD_ZERO(&rfds);
-        FD_SET(raop_rtp->csock, &rfds);
-        FD_SET(raop_rtp->dsock, &rfds);
+    // Len = 16 appears if there is no time
+    if (packetlen < 12) {
+        return 0;
+    }
 
-        ret = select(nfds, &rfds, NULL, NULL, &tv);
-        if (ret == 0) {
-            /* Timeout happened */
+    uint32_t rtp_timestamp =  (packet[4] << 24) | (packet[5] << 16) | (packet[6] << 8) | packet[7];
+    uint64_t ntp_timestamp = raop_rtp_convert_rtp_time(raop_rtp, rtp_timestamp);
+    uint64_t ntp_now = arrival_time ? arrival_time : raop_ntp_get_local_time(raop_rtp->ntp);
+    raop_rtp->remote_ssrc = byteutils_get_int_be(packet, 8);
+    LOGGER_DEBUG_HOT(raop_rtp->logger, "raop_rtp audio: ntp = %llu, now = %llu, latency=%lld, rtp=%u",
+               ntp_timestamp, ntp_now, ((int64_t) ntp_now) - ((int64_t) ntp_timestamp), rtp_timestamp);
+
+    int result = raop_buffer_enqueue(raop_rtp->buffer, packet, packetlen, ntp_timestamp, 1);
+    assert(result >= 0);
+    if (result > 0) {
+        raop_rtp_update_jitter(raop_rtp, (packet[2] << 8) | packet[3], rtp_timestamp, ntp_now);
+    }
+    return 1;
+}
+
+static void
+raop_rtp_render_audio(raop_rtp_t *raop_rtp)
+{
+    int no_resend = (raop_rtp->control_rport == 0);// false
+
+    // Render continuous buffer entries
+    void *payload = NULL;
+    unsigned int payload_size;
+    uint64_t timestamp;
+    int lost;
+    int given_up = 0;
+    while ((payload = raop_buffer_dequeue(raop_rtp->buffer, &payload_size, &timestamp, no_resend, &lost)) || lost) {
+        if (!payload) {
+            given_up = 1;
+            /* Hand the gap on so the renderer can conceal it and its clock keeps running */
+            if (!raop_rtp->last_audio_pts) {
+                continue;
+            }
+            raop_rtp->last_audio_pts += (uint64_t) raop_rtp->packet_duration;
+            audio_queue_push(raop_rtp->audio_queue, NULL, 0, raop_rtp->last_audio_pts);
             continue;
-        } else if (ret == -1) {
-            logger_log(raop_rtp->logger, LOGGER_ERR, "raop_rtp error in select");
-            break;
         }
+        raop_rtp->last_audio_pts = timestamp;
+        audio_queue_push(raop_rtp->audio_queue, payload, payload_size, timestamp);
+        raop_buffer_release(raop_rtp->buffer, payload);
+    }
 
-        if (FD_ISSET(raop_rtp->csock, &rfds)) {
-            saddrlen = sizeof(saddr);
-            packetlen = recvfrom(raop_rtp->csock, (char *)packet, sizeof(packet), 0,
-                                 (struct sockaddr *)&saddr, &saddrlen);
-
-            memcpy(&raop_rtp->control_saddr, &saddr, saddrlen);
-            raop_rtp->control_saddr_len = saddrlen;
-            int type_c = packet[1] & ~0x80;
-            logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp type_c 0x%02x, packetlen = %d", type_c, packetlen);
-            if (type_c == 0x56) {
-                /* Handle resent data packet */
-                uint32_t rtp_timestamp =  (packet[4 + 4] << 24) | (packet[4 + 5] << 16) | (packet[4 + 6] << 8) | packet[4 + 7];
-                uint64_t ntp_timestamp = raop_rtp_convert_rtp_time(raop_rtp, rtp_timestamp);
-                uint64_t ntp_now = raop_ntp_get_local_time(raop_rtp->ntp);
-                logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp audio resent: ntp = %llu, now = %llu, latency=%lld, rtp=%u",
-                           ntp_timestamp, ntp_now, ((int64_t) ntp_now) - ((int64_t) ntp_timestamp), rtp_timestamp);
-                int result = raop_buffer_enqueue(raop_rtp->buffer, packet + 4, packetlen - 4, ntp_timestamp, 1);
-                assert(result >= 0);
-            } else if (type_c == 0x54 && packetlen >= 20) {
-                // The unit for the rtp clock is 1 / sample rate = 1 / 44100
-                uint32_t sync_rtp = byteutils_get_int_be(packet, 4) - 11025;
-                uint64_t sync_ntp_raw = byteutils_get_long_be(packet, 8);
-                uint64_t sync_ntp_remote = raop_ntp_timestamp_to_micro_seconds(sync_ntp_raw, true);
-                uint64_t sync_ntp_local = raop_ntp_convert_remote_time(raop_rtp->ntp, sync_ntp_remote);
-                // It's not clear what the additional rtp timestamp indicates
-                uint32_t next_rtp = byteutils_get_int_be(packet, 16);
-                logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp sync: ntp=%llu, local ntp: %llu, rtp=%u, rtp_next=%u",
-                           sync_ntp_remote, sync_ntp_local, sync_rtp, next_rtp);
-                raop_rtp_sync_clock(raop_rtp, sync_rtp, sync_ntp_local);
-            } else {
-                logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp unknown packet");
-            }
+    /* Handle possible resend requests, a resend is overdue after a round trip plus its jitter */
+    if (!no_resend) {
+        int64_t timeout = raop_ntp_get_round_trip_delay(raop_rtp->ntp) + (int64_t) (4.0 * raop_rtp->interarrival_jitter);
+        if (timeout < RAOP_RTP_RESEND_MIN_TIMEOUT) {
+            timeout = RAOP_RTP_RESEND_MIN_TIMEOUT;
+        } else if (timeout > RAOP_RTP_RESEND_MAX_TIMEOUT) {
+            timeout = RAOP_RTP_RESEND_MAX_TIMEOUT;
         }
+        raop_buffer_handle_resends(raop_rtp->buffer, raop_rtp_resend_callback, raop_rtp,
+                                   raop_ntp_get_local_time(raop_rtp->ntp), timeout);
+    }
 
-        if (FD_ISSET(raop_rtp->dsock, &rfds)) {
-            //logger_log(raop_rtp->logger, LOGGER_INFO, "Would have data packet in queue");
-            // Receiving audio data here
-            saddrlen = sizeof(saddr);
-            packetlen = recvfrom(raop_rtp->dsock, (char *)packet, sizeof(packet), 0,
-                                 (struct sockaddr *)&saddr, &saddrlen);
-            // rtp payload type
-            int type_d = packet[1] & ~0x80;
-            //logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp_thread_udp type_d 0x%02x, packetlen = %d", type_d, packetlen);
-
-            // Len = 16 appears if there is no time
-            if (packetlen >= 12) {
-                int no_resend = (raop_rtp->control_rport == 0);// false
-
-                uint32_t rtp_timestamp =  (packet[4] << 24) | (packet[5] << 16) | (packet[6] << 8) | packet[7];
-                uint64_t ntp_timestamp = raop_rtp_convert_rtp_time(raop_rtp, rtp_timestamp);
-                uint64_t ntp_now = raop_ntp_get_local_time(raop_rtp->ntp);
-                logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp audio: ntp = %llu, now = %llu, latency=%lld, rtp=%u",
-                           ntp_timestamp, ntp_now, ((int64_t) ntp_now) - ((int64_t) ntp_timestamp), rtp_timestamp);
-
-                int result = raop_buffer_enqueue(raop_rtp->buffer, packet, packetlen, ntp_timestamp, 1);
-                assert(result >= 0);
-
-                // Render continuous buffer entries
-                void *payload = NULL;
-                unsigned int payload_size;
-                uint64_t timestamp;
-                while ((payload = raop_buffer_dequeue(raop_rtp->buffer, &payload_size, &timestamp, no_resend))) {
-                    aac_decode_struct aac_data;
-                    aac_data.data_len = payload_size;
-                    aac_data.data = payload;
-                    aac_data.pts = timestamp;
-                    raop_rtp->callbacks.audio_process(raop_rtp->callbacks.cls, raop_rtp->ntp, &aac_data);
-                    free(payload);
-                }
-
-                /* Handle possible resend requests */
-                if (!no_resend) {
-                    raop_buffer_handle_resends(raop_rtp->buffer, raop_rtp_resend_callback, raop_rtp);
-                }
-            }
+    uint64_t now = raop_ntp_get_local_time(raop_rtp->ntp);
+    raop_rtp_update_margin(raop_rtp, given_up, now);
+    if (!raop_rtp->last_report_time) {
+        raop_rtp->last_report_time = now;
+    } else if (now - raop_rtp->last_report_time >= RAOP_RTP_REPORT_INTERVAL) {
+        raop_rtp->last_report_time = now;
+        raop_rtp_report(raop_rtp);
+    }
+}
 
+static THREAD_RETVAL
+raop_rtp_thread_decode(void *arg)
+{
+    raop_rtp_t *raop_rtp = arg;
+    aac_decode_struct aac_data;
+    int ret;
+    assert(raop_rtp);
+
+    mem_account_enter(raop_rtp->mem_session);
+
+    while ((ret = audio_queue_pop(raop_rtp->audio_queue, &aac_data)) >= 0) {
+        if (ATOMIC_EXCHANGE(raop_rtp->volume_pending, 0) && raop_rtp->callbacks.audio_set_volume) {
+            MUTEX_LOCK(raop_rtp->run_mutex);
+            float volume = raop_rtp->volume;
+            MUTEX_UNLOCK(raop_rtp->run_mutex);
+            raop_rtp->callbacks.audio_set_volume(raop_rtp->callbacks.cls, volume);
+        }
+        if (ret == AUDIO_QUEUE_FLUSHED) {
+            if (raop_rtp->callbacks.audio_flush) {
+                raop_rtp->callbacks.audio_flush(raop_rtp->callbacks.cls);
+            }
+        } else if (ret == AUDIO_QUEUE_FRAME) {
+            aac_data.format = &raop_rtp->format;
+            // A renderer that decodes in process marks the decode stage in between
+            perf_counters_begin();
+            raop_rtp->callbacks.audio_process(raop_rtp->callbacks.cls, raop_rtp->ntp, &aac_data);
+            perf_counters_mark(PERF_STAGE_AUDIO_SUBMIT, 1);
+            if (raop_rtp->callbacks.audio_underruns) {
+                ATOMIC_STORE(raop_rtp->renderer_underruns, raop_rtp->callbacks.audio_underruns(raop_rtp->callbacks.cls));
+            }
         }
     }
 
-    // Ensure running reflects the actual state
+    logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp exiting decode thread");
+    return 0;
+}
+
+/*
+ * Ends the session after a socket error, the way a stop would but without waiting on the loop
+ * this runs on: the decode thread goes once the queue is empty and raop_rtp_stop cleans up
+ */
+static void
+raop_rtp_fail(raop_rtp_t *raop_rtp)
+{
     MUTEX_LOCK(raop_rtp->run_mutex);
-    raop_rtp->running = false;
+    ATOMIC_STORE(raop_rtp->running, 0);
     MUTEX_UNLOCK(raop_rtp->run_mutex);
+    audio_queue_stop(raop_rtp->audio_queue);
+}
 
-    logger_log(raop_rtp->logger, LOGGER_DEBUG, "raop_rtp exiting thread");
+/*
+ * Runs on the audio event loop for incoming packets and, with fd -1, for queued events
+ */
+static void
+raop_rtp_event(void *cls, int fd)
+{
+    raop_rtp_t *raop_rtp = cls;
+    raop_rtp_recv_batch_t *batch = raop_rtp->batch;
+    assert(raop_rtp);
 
-    return 0;
+    /* Check if we are still running and process callbacks */
+    if (raop_rtp_process_events(raop_rtp, NULL)) {
+        return;
+    }
+
+    if (fd == raop_rtp->csock) {
+        int count = raop_rtp_recv_batch(raop_rtp->csock, batch);
+        if (count < 0) {
+            logger_log(raop_rtp->logger, LOGGER_ERR, "raop_rtp error receiving control packets: %d", SOCKET_GET_ERROR());
+            raop_rtp_fail(raop_rtp);
+            return;
+        }
+        ATOMIC_FETCH_ADD(raop_rtp->received_packets, count);
+        for (int i = 0; i < count; i++) {
+            raop_rtp_handle_control_packet(raop_rtp, batch->packets[i], batch->lengths[i],
+                                           &batch->saddrs[i], batch->saddr_lens[i]);
+        }
+    } else if (fd == raop_rtp->dsock) {
+        // Receiving audio data here, everything queued so far goes into the buffer before rendering
+        int count = raop_rtp_recv_batch(raop_rtp->dsock, batch);
+        if (count < 0) {
+            logger_log(raop_rtp->logger, LOGGER_ERR, "raop_rtp error receiving data packets: %d", SOCKET_GET_ERROR());
+            raop_rtp_fail(raop_rtp);
+            return;
+        }
+        ATOMIC_FETCH_ADD(raop_rtp->received_packets, count);
+        int enqueued = 0;
+        for (int i = 0; i < count; i++) {
+            enqueued += raop_rtp_handle_data_packet(raop_rtp, batch->packets[i], batch->lengths[i],
+                                                    batch->arrival_times[i]);
+        }
+        if (enqueued) {
+            raop_rtp_render_audio(raop_rtp);
+        }
+    }
+}
+
+/*
+ * Has the event source process the queued events, with run_mutex held so it cannot go away meanwhile
+ */
+static void
+raop_rtp_wakeup(raop_rtp_t *raop_rtp)
+{
+    if (raop_rtp->source) {
+        event_source_wakeup(raop_rtp->source);
+    }
 }
 
 // Start rtp service, three udp ports
@@ -530,32 +978,80 @@ raop_rtp_start_audio(raop_rtp_t *raop_rtp, int use_udp, unsigned short control_r
     assert(raop_rtp);
 
     MUTEX_LOCK(raop_rtp->run_mutex);
-    if (raop_rtp->running || !raop_rtp->joined) {
+    if (ATOMIC_LOAD(raop_rtp->running) || !raop_rtp->joined) {
         MUTEX_UNLOCK(raop_rtp->run_mutex);
         return;
     }
 
     /* Initialize ports and sockets */
     raop_rtp->control_rport = control_rport;
+    /* Listen on the family the sender connected over */
     if (raop_rtp->remote_saddr.ss_family == AF_INET6) {
         use_ipv6 = 1;
     }
-    use_ipv6 = 0;
     if (raop_rtp_init_sockets(raop_rtp, use_ipv6, use_udp) < 0) {
         logger_log(raop_rtp->logger, LOGGER_ERR, "raop_rtp initializing sockets failed");
         MUTEX_UNLOCK(raop_rtp->run_mutex);
         return;
     }
+    raop_rtp->batch = malloc(sizeof(raop_rtp_recv_batch_t));
+    raop_rtp->source = event_source_init(raop_rtp->logger, THREAD_ROLE_AUDIO, raop_rtp_event, raop_rtp);
+    if (!raop_rtp->batch || !raop_rtp->source ||
+        event_source_add_fd(raop_rtp->source, raop_rtp->csock) < 0 ||
+        event_source_add_fd(raop_rtp->source, raop_rtp->dsock) < 0) {
+        logger_log(raop_rtp->logger, LOGGER_ERR, "raop_rtp could not join an event loop");
+        event_source_destroy(raop_rtp->source);
+        raop_rtp->source = NULL;
+        free(raop_rtp->batch);
+        raop_rtp->batch = NULL;
+        closesocket(raop_rtp->csock);
+        closesocket(raop_rtp->dsock);
+        MUTEX_UNLOCK(raop_rtp->run_mutex);
+        return;
+    }
     if (control_lport) *control_lport = raop_rtp->control_lport;
     if (data_lport) *data_lport = raop_rtp->data_lport;
-    /* Create the thread and initialize running values */
-    raop_rtp->running = 1;
+    /* Create the decode thread and initialize running values */
+    ATOMIC_STORE(raop_rtp->running, 1);
     raop_rtp->joined = 0;
 
-    THREAD_CREATE(raop_rtp->thread, raop_rtp_thread_udp, raop_rtp);
+    audio_queue_start(raop_rtp->audio_queue);
+    THREAD_CREATE(raop_rtp->thread_decode, raop_rtp_thread_decode, raop_rtp);
+    if (raop_rtp->thread_decode && thread_apply_role(raop_rtp->thread_decode, THREAD_ROLE_ADECODE) < 0) {
+        logger_log(raop_rtp->logger, LOGGER_WARNING, "Could not apply the scheduling settings of the audio decode thread");
+    }
+    /* Pass on whatever was set before the start */
+    raop_rtp_wakeup(raop_rtp);
     MUTEX_UNLOCK(raop_rtp->run_mutex);
 }
 
+void
+raop_rtp_set_audio_format(raop_rtp_t *raop_rtp, const audio_format_t *format)
+{
+    assert(raop_rtp);
+    assert(format);
+
+    if (ATOMIC_LOAD(raop_rtp->running)) {
+        logger_log(raop_rtp->logger, LOGGER_WARNING, "raop_rtp keeps its audio format while streaming");
+        return;
+    }
+    raop_rtp->format = *format;
+    raop_rtp->sample_rate = format->sample_rate / 1000000.0;
+    raop_rtp->rtp_sync_scale = raop_rtp->sample_rate;
+}
+
+void
+raop_rtp_set_receiver_reports(raop_rtp_t *raop_rtp, int enabled)
+{
+    assert(raop_rtp);
+
+    if (ATOMIC_LOAD(raop_rtp->running)) {
+        logger_log(raop_rtp->logger, LOGGER_WARNING, "raop_rtp keeps its receiver report setting while streaming");
+        return;
+    }
+    raop_rtp->receiver_reports = enabled;
+}
+
 void
 raop_rtp_set_volume(raop_rtp_t *raop_rtp, float volume)
 {
@@ -571,49 +1067,55 @@ raop_rtp_set_volume(raop_rtp_t *raop_rtp, float volume)
     MUTEX_LOCK(raop_rtp->run_mutex);
     raop_rtp->volume = volume;
     raop_rtp->volume_changed = 1;
+    ATOMIC_STORE(raop_rtp->events_pending, 1);
+    raop_rtp_wakeup(raop_rtp);
     MUTEX_UNLOCK(raop_rtp->run_mutex);
 }
 
 void
-raop_rtp_set_metadata(raop_rtp_t *raop_rtp, const char *data, int datalen)
+raop_rtp_set_metadata(raop_rtp_t *raop_rtp, char *data, int datalen)
 {
-    unsigned char *metadata;
+    unsigned char *previous;
 
     assert(raop_rtp);
 
     if (datalen <= 0) {
+        free(data);
         return;
     }
-    metadata = malloc(datalen);
-    assert(metadata);
-    memcpy(metadata, data, datalen);
 
-    /* Set metadata in thread instead */
+    /* Set metadata in thread instead, replacing any the thread has not picked up yet */
     MUTEX_LOCK(raop_rtp->run_mutex);
-    raop_rtp->metadata = metadata;
+    previous = raop_rtp->metadata;
+    raop_rtp->metadata = (unsigned char *) data;
     raop_rtp->metadata_len = datalen;
+    ATOMIC_STORE(raop_rtp->events_pending, 1);
+    raop_rtp_wakeup(raop_rtp);
     MUTEX_UNLOCK(raop_rtp->run_mutex);
+    free(previous);
 }
 
 void
-raop_rtp_set_coverart(raop_rtp_t *raop_rtp, const char *data, int datalen)
+raop_rtp_set_coverart(raop_rtp_t *raop_rtp, char *data, int datalen)
 {
-    unsigned char *coverart;
+    unsigned char *previous;
 
     assert(raop_rtp);
 
     if (datalen <= 0) {
+        free(data);
         return;
     }
-    coverart = malloc(datalen);
-    assert(coverart);
-    memcpy(coverart, data, datalen);
 
-    /* Set coverart in thread instead */
+    /* Set coverart in thread instead, replacing any the thread has not picked up yet */
     MUTEX_LOCK(raop_rtp->run_mutex);
-    raop_rtp->coverart = coverart;
+    previous = raop_rtp->coverart;
+    raop_rtp->coverart = (unsigned char *) data;
     raop_rtp->coverart_len = datalen;
+    ATOMIC_STORE(raop_rtp->events_pending, 1);
+    raop_rtp_wakeup(raop_rtp);
     MUTEX_UNLOCK(raop_rtp->run_mutex);
+    free(previous);
 }
 
 void
@@ -629,6 +1131,8 @@ raop_rtp_remote_control_id(raop_rtp_t *raop_rtp, const char *dacp_id, const char
     MUTEX_LOCK(raop_rtp->run_mutex);
     raop_rtp->dacp_id = strdup(dacp_id);
     raop_rtp->active_remote_header = strdup(active_remote_header);
+    ATOMIC_STORE(raop_rtp->events_pending, 1);
+    raop_rtp_wakeup(raop_rtp);
     MUTEX_UNLOCK(raop_rtp->run_mutex);
 }
 
@@ -643,6 +1147,8 @@ raop_rtp_set_progress(raop_rtp_t *raop_rtp, unsigned int start, unsigned int cur
     raop_rtp->progress_curr = curr;
     raop_rtp->progress_end = end;
     raop_rtp->progress_changed = 1;
+    ATOMIC_STORE(raop_rtp->events_pending, 1);
+    raop_rtp_wakeup(raop_rtp);
     MUTEX_UNLOCK(raop_rtp->run_mutex);
 }
 
@@ -654,6 +1160,8 @@ raop_rtp_flush(raop_rtp_t *raop_rtp, int next_seq)
     /* Call flush in thread instead */
     MUTEX_LOCK(raop_rtp->run_mutex);
     raop_rtp->flush = next_seq;
+    ATOMIC_STORE(raop_rtp->events_pending, 1);
+    raop_rtp_wakeup(raop_rtp);
     MUTEX_UNLOCK(raop_rtp->run_mutex);
 }
 
@@ -662,21 +1170,31 @@ raop_rtp_stop(raop_rtp_t *raop_rtp)
 {
     assert(raop_rtp);
 
-    /* Check that we are running and thread is not
-     * joined (should never be while still running) */
+    /* Check that the session was started and is not stopped yet, it may
+     * have stopped running on its own after a socket error */
     MUTEX_LOCK(raop_rtp->run_mutex);
-    if (!raop_rtp->running || raop_rtp->joined) {
+    if (raop_rtp->joined) {
         MUTEX_UNLOCK(raop_rtp->run_mutex);
         return;
     }
-    raop_rtp->running = 0;
+    ATOMIC_STORE(raop_rtp->running, 0);
+    event_source_t *source = raop_rtp->source;
+    raop_rtp->source = NULL;
     MUTEX_UNLOCK(raop_rtp->run_mutex);
 
-    /* Join the thread */
-    THREAD_JOIN(raop_rtp->thread);
+    /* Leave the event loop first, then let the decoder go with nothing left to come */
+    event_source_destroy(source);
+    audio_queue_stop(raop_rtp->audio_queue);
+    THREAD_JOIN(raop_rtp->thread_decode);
+    free(raop_rtp->batch);
+    raop_rtp->batch = NULL;
 
-    if (raop_rtp->csock != -1) closesocket(raop_rtp->csock);
-    if (raop_rtp->dsock != -1) closesocket(raop_rtp->dsock);
+    if (raop_rtp->csock != -1) {
+        closesocket(raop_rtp->csock);
+    }
+    if (raop_rtp->dsock != -1) {
+        closesocket(raop_rtp->dsock);
+    }
 
     /* Flush buffer into initial state */
     raop_buffer_flush(raop_rtp->buffer, -1);
@@ -691,9 +1209,13 @@ int
 raop_rtp_is_running(raop_rtp_t *raop_rtp)
 {
     assert(raop_rtp);
-    MUTEX_LOCK(raop_rtp->run_mutex);
-    int running = raop_rtp->running;
-    MUTEX_UNLOCK(raop_rtp->run_mutex);
-    return running;
+    return ATOMIC_LOAD(raop_rtp->running);
+}
+
+unsigned int
+raop_rtp_get_received_packets(raop_rtp_t *raop_rtp)
+{
+    assert(raop_rtp);
+    return ATOMIC_LOAD(raop_rtp->received_packets);
 }
 
@@ -27,19 +27,31 @@
 typedef struct raop_rtp_s raop_rtp_t;
 
 raop_rtp_t *raop_rtp_init(logger_t *logger, raop_callbacks_t *callbacks, raop_ntp_t *ntp, const unsigned char *remote, int remotelen,
-                          const unsigned char *aeskey, const unsigned char *aesiv, const unsigned char *ecdh_secret);
+                          const unsigned char *aeskey, const unsigned char *aesiv, const unsigned char *ecdh_secret,
+                          int max_buffer_length);
 
 void raop_rtp_start_audio(raop_rtp_t *raop_rtp, int use_udp, unsigned short control_rport,
                           unsigned short *control_lport, unsigned short *data_lport);
 
+/* Codec and clock rate of the audio stream, set before raop_rtp_start_audio */
+void raop_rtp_set_audio_format(raop_rtp_t *raop_rtp, const audio_format_t *format);
+/* Sends RTCP receiver reports to the control port of the sender, set before raop_rtp_start_audio */
+void raop_rtp_set_receiver_reports(raop_rtp_t *raop_rtp, int enabled);
 void raop_rtp_set_volume(raop_rtp_t *raop_rtp, float volume);
-void raop_rtp_set_metadata(raop_rtp_t *raop_rtp, const char *data, int datalen);
-void raop_rtp_set_coverart(raop_rtp_t *raop_rtp, const char *data, int datalen);
+/* Both take over data, which is freed once the callback has seen it */
+void raop_rtp_set_metadata(raop_rtp_t *raop_rtp, char *data, int datalen);
+void raop_rtp_set_coverart(raop_rtp_t *raop_rtp, char *data, int datalen);
 void raop_rtp_remote_control_id(raop_rtp_t *raop_rtp, const char *dacp_id, const char *active_remote_header);
 void raop_rtp_set_progress(raop_rtp_t *raop_rtp, unsigned int start, unsigned int curr, unsigned int end);
 void raop_rtp_flush(raop_rtp_t *raop_rtp, int next_seq);
+/* Takes a sync point of the sender, the local time its audio sample rtp_time plays at */
+void raop_rtp_sync_clock(raop_rtp_t *raop_rtp, uint32_t rtp_time, uint64_t ntp_time);
+/* Local time the audio sample rtp_time plays at, after the sync points taken so far */
+uint64_t raop_rtp_convert_rtp_time(raop_rtp_t *raop_rtp, uint32_t rtp_time);
 void raop_rtp_stop(raop_rtp_t *raop_rtp);
 int raop_rtp_is_running(raop_rtp_t *raop_rtp);
+/* Control and data packets received so far, wraps around. Safe to call from any thread. */
+unsigned int raop_rtp_get_received_packets(raop_rtp_t *raop_rtp);
 void raop_rtp_destroy(raop_rtp_t *raop_rtp);
 
 #endif
@@ -17,9 +17,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <netinet/tcp.h>
 
 #include "raop.h"
@@ -28,7 +31,22 @@
 #include "logger.h"
 #include "byteutils.h"
 #include "mirror_buffer.h"
+#include "buffer_pool.h"
+#include "frame_queue.h"
+#include "playout.h"
+#include "genlock.h"
+#include "reactor.h"
 #include "stream.h"
+#include "h264_avcc.h"
+#include "h265_hvcc.h"
+#include "histogram.h"
+#include "perf_counters.h"
+#include "metrics.h"
+#include "mem_account.h"
+#include "trace.h"
+#include "memlock.h"
+#include "probes.h"
+#include "flight_recorder.h"
 
 
 struct h264codec_s {
@@ -45,14 +63,133 @@ struct h264codec_s {
     unsigned char version;
 };
 
+/* Parameter sets remembered per session, one per stream geometry, portrait and landscape mostly */
+#define RAOP_RTP_MIRROR_CODEC_CACHE_SIZE 4
+#define RAOP_RTP_MIRROR_MAX_PARAMETER_SETS 1024
+/* Interval in micro seconds of the stage latency dump at debug level */
+#define RAOP_RTP_MIRROR_STATS_INTERVAL 10000000
+/* Largest datagram of the UDP transport, and how often a gap in it is rechecked */
+#define RAOP_RTP_MIRROR_MAX_DATAGRAM 65536
+#define RAOP_RTP_MIRROR_GAP_POLL_MS 5
+/* Highest receive low water mark, the kernel caps it at half the receive buffer anyway */
+#define RAOP_RTP_MIRROR_MAX_LOWAT 65536
+/* Longest a frame waits for the vsync after its playout time, a frame at 24 Hz */
+#define RAOP_RTP_MIRROR_MAX_VSYNC_WAIT 42000
+/* Payload buffers are grown to this up front in a memory locked process, about a 1080p keyframe */
+#define RAOP_RTP_MIRROR_RESERVE_SIZE (512 * 1024)
+/* Frames a video_process_frame callee may hold on to before the payload pool runs dry */
+#define RAOP_RTP_MIRROR_HELD_FRAMES 32
+/* Latency budget in micro seconds while the device is throttled, unless a tighter one was set */
+#define RAOP_RTP_MIRROR_PRESSURE_BUDGET 100000
+
+/* Heartbeats without a frame for this long in micro seconds mean the sender paused the mirror */
+#define RAOP_RTP_MIRROR_PAUSE_AFTER 2000000
+/* frame_type of the marker the render thread pauses the renderer on, it carries no data */
+#define RAOP_RTP_MIRROR_FRAME_PAUSE -1
+/* Micro seconds of frames the decode load of the stream is measured over */
+#define RAOP_RTP_MIRROR_LOAD_WINDOW 1000000
+
+/* pipeline_state of a frame under slice pipelining */
+#define RAOP_RTP_MIRROR_PIPELINE_RECEIVING 0
+#define RAOP_RTP_MIRROR_PIPELINE_COMPLETE 1
+#define RAOP_RTP_MIRROR_PIPELINE_FAILED 2
+
+typedef struct {
+    video_codec_t codec;
+    int width;
+    int height;
+    /* The SPS and the PPS, for H.265 behind the VPS, each behind a 4 byte start code */
+    int data_len;
+    unsigned char data[RAOP_RTP_MIRROR_MAX_PARAMETER_SETS];
+    h264_nal_index_t sets;
+} raop_rtp_mirror_codec_t;
+
 struct raop_rtp_mirror_s {
     logger_t *logger;
     raop_callbacks_t callbacks;
     raop_ntp_t *ntp;
+    /* Session the render thread charges its allocations to, see mem_account.h */
+    int mem_session;
 
     /* Buffer to handle all resends */
     mirror_buffer_t *buffer;
 
+    /* Reusable frame payload buffers */
+    buffer_pool_t *payload_pool;
+    /* The frames passed to video_process_frame, one for every payload buffer */
+    video_frame_pool_t *frame_pool;
+
+    /* Decrypted frames on their way from the socket thread to the render thread */
+    frame_queue_t *frame_queue;
+
+    /* Drop policy, only used by the render thread. A budget of 0 disables dropping. */
+    int64_t latency_budget;
+    int waiting_for_idr;
+    uint64_t idr_wait_start;
+    int dropped_non_reference;
+    int dropped_backpressure;
+    int dropped_to_idr;
+
+    /* Playout delay, only used by the render thread. A max_delay of 0 disables it. */
+    playout_t playout;
+    /* Video wall the playout times follow, NULL for none, owned by whoever set it */
+    genlock_t *genlock;
+
+    /*
+     * Slice pipelining, a video frame queued as soon as its header arrived. The mirror thread
+     * rewrites its NAL units as they are decrypted and the render thread hands each run of them
+     * to the renderer right away. One frame at a time, busy until the render thread is done.
+     */
+    mutex_handle_t pipeline_mutex;
+    cond_handle_t pipeline_cond;
+    int pipeline_busy;
+    int pipeline_ready; // Bytes rewritten to Annex-B so far
+    int pipeline_state;
+    h264_nal_index_t pipeline_index; // Complete once pipeline_state is
+
+    /* Copies of the counters for raop_rtp_mirror_get_stats */
+    atomic_uint stats_dropped;
+    atomic_uint stats_lost;
+    atomic_int stats_jitter;
+    atomic_uint stats_received;
+    atomic_uint stats_pixel_rate;
+
+    /* Wakes the thread up for incoming data and stop requests */
+    reactor_t *reactor;
+
+    /* Parameter sets seen so far, only used by the mirror thread */
+    raop_rtp_mirror_codec_t codecs[RAOP_RTP_MIRROR_CODEC_CACHE_SIZE];
+    int next_codec;
+    /* Of the parameter sets last seen, which the frames after them are coded in */
+    video_codec_t codec;
+    const raop_rtp_mirror_codec_t *current_codec;
+
+    /*
+     * A sender whose screen locked or whose app paused sends heartbeats but no frames. The
+     * mirror thread notices, see raop_rtp_mirror_note_payload, and the render thread lets the
+     * renderer power its decoder down until the next frame.
+     */
+    uint64_t last_video_time;
+    int paused;
+    int renderer_paused; // Render thread only
+
+    /* Frames since load_since, for the pixel rate in the stats, see raop_rtp_mirror_note_payload */
+    uint64_t load_since;
+    unsigned int load_frames;
+
+    /* Bit per raop_milestone_t already reported, only used by the mirror thread */
+    unsigned int milestones;
+
+    /* Per stage latencies in micro seconds, the first three written by the mirror thread, the
+     * others by the render thread */
+    histogram_t hist_network;
+    histogram_t hist_decrypt;
+    histogram_t hist_rewrite;
+    histogram_t hist_queue;
+    histogram_t hist_submit;
+    uint64_t last_stats_dump;
+    unsigned int stats_requests_seen;
+
     /* Remote address as sockaddr */
     struct sockaddr_storage remote_saddr;
     socklen_t remote_saddr_len;
@@ -64,34 +201,49 @@ struct raop_rtp_mirror_s {
 
     int flush;
     thread_handle_t thread_mirror;
+    thread_handle_t thread_render;
     mutex_handle_t run_mutex;
 
     /* MUTEX LOCKED VARIABLES END */
+    int use_udp;
     int mirror_data_sock;
 
+    /* Socket tuning, 0 keeps the system defaults */
+    int receive_buffer;
+    int busy_poll;
+
     unsigned short mirror_data_lport;
 };
 
+/* Bumped by raop_rtp_mirror_request_stats, every render thread dumps its stats once it changes */
+static atomic_uint raop_rtp_mirror_stats_requests;
+/* Set by raop_rtp_mirror_set_pressure, read by every render thread */
+static atomic_int raop_rtp_mirror_pressure;
+
+static int raop_rtp_init_mirror_sockets(raop_rtp_mirror_t *raop_rtp_mirror, int use_ipv6, int use_udp);
+
+static void
+raop_rtp_mirror_milestone(raop_rtp_mirror_t *raop_rtp_mirror, raop_milestone_t milestone)
+{
+    if (raop_rtp_mirror->milestones & (1u << milestone)) {
+        return;
+    }
+    raop_rtp_mirror->milestones |= 1u << milestone;
+    if (raop_rtp_mirror->callbacks.session_milestone) {
+        raop_rtp_mirror->callbacks.session_milestone(raop_rtp_mirror->callbacks.cls, milestone,
+                                                     raop_ntp_get_local_time(raop_rtp_mirror->ntp));
+    }
+}
+
 static int
 raop_rtp_parse_remote(raop_rtp_mirror_t *raop_rtp_mirror, const unsigned char *remote, int remotelen)
 {
-    char current[25];
-    int family;
+    char current[INET6_ADDRSTRLEN];
     int ret;
     assert(raop_rtp_mirror);
-    if (remotelen == 4) {
-        family = AF_INET;
-    } else if (remotelen == 16) {
-        family = AF_INET6;
-    } else {
-        return -1;
-    }
-    memset(current, 0, sizeof(current));
-    sprintf(current, "%d.%d.%d.%d", remote[0], remote[1], remote[2], remote[3]);
-    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror parse remote ip = %s", current);
-    ret = netutils_parse_address(family, current,
-                                 &raop_rtp_mirror->remote_saddr,
-                                 sizeof(raop_rtp_mirror->remote_saddr));
+    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror parse remote ip = %s",
+               netutils_format_address(remote, remotelen, current, sizeof(current)));
+    ret = netutils_init_address(&raop_rtp_mirror->remote_saddr, sizeof(raop_rtp_mirror->remote_saddr), remote, remotelen, 0, 0);
     if (ret < 0) {
         return -1;
     }
@@ -102,7 +254,8 @@ raop_rtp_parse_remote(raop_rtp_mirror_t *raop_rtp_mirror, const unsigned char *r
 #define NO_FLUSH (-42)
 raop_rtp_mirror_t *raop_rtp_mirror_init(logger_t *logger, raop_callbacks_t *callbacks, raop_ntp_t *ntp,
                                         const unsigned char *remote, int remotelen,
-                                        const unsigned char *aeskey, const unsigned char *ecdh_secret)
+                                        const unsigned char *aeskey, const unsigned char *ecdh_secret,
+                                        int queue_depth, int latency_budget_ms)
 {
     raop_rtp_mirror_t *raop_rtp_mirror;
 
@@ -114,6 +267,7 @@ raop_rtp_mirror_t *raop_rtp_mirror_init(logger_t *logger, raop_callbacks_t *call
         return NULL;
     }
     raop_rtp_mirror->logger = logger;
+    raop_rtp_mirror->mem_session = mem_account_session();
     raop_rtp_mirror->ntp = ntp;
 
     memcpy(&raop_rtp_mirror->callbacks, callbacks, sizeof(raop_callbacks_t));
@@ -122,30 +276,1077 @@ raop_rtp_mirror_t *raop_rtp_mirror_init(logger_t *logger, raop_callbacks_t *call
         free(raop_rtp_mirror);
         return NULL;
     }
+    if (queue_depth < 1) {
+        queue_depth = 1;
+    } else if (queue_depth > RAOP_RTP_MIRROR_QUEUE_MAX_DEPTH) {
+        queue_depth = RAOP_RTP_MIRROR_QUEUE_MAX_DEPTH;
+    }
+    // Frames are decrypted in place, so besides the queued ones only the frame being received
+    // and the frame being rendered need a buffer
+    raop_rtp_mirror->payload_pool = buffer_pool_init(logger, queue_depth + 2);
+    if (!raop_rtp_mirror->payload_pool) {
+        mirror_buffer_destroy(raop_rtp_mirror->buffer);
+        free(raop_rtp_mirror);
+        return NULL;
+    }
+    if (callbacks->video_process_frame) {
+        buffer_pool_set_max_slots(raop_rtp_mirror->payload_pool, queue_depth + 2 + RAOP_RTP_MIRROR_HELD_FRAMES);
+        raop_rtp_mirror->frame_pool = video_frame_pool_init(queue_depth + 2 + RAOP_RTP_MIRROR_HELD_FRAMES);
+        if (!raop_rtp_mirror->frame_pool) {
+            buffer_pool_destroy(raop_rtp_mirror->payload_pool);
+            mirror_buffer_destroy(raop_rtp_mirror->buffer);
+            free(raop_rtp_mirror);
+            return NULL;
+        }
+    }
+    if (memlock_is_active()) {
+        buffer_pool_reserve(raop_rtp_mirror->payload_pool, RAOP_RTP_MIRROR_RESERVE_SIZE);
+    }
+    raop_rtp_mirror->frame_queue = frame_queue_init(logger, queue_depth);
+    if (!raop_rtp_mirror->frame_queue) {
+        video_frame_pool_destroy(raop_rtp_mirror->frame_pool);
+        buffer_pool_destroy(raop_rtp_mirror->payload_pool);
+        mirror_buffer_destroy(raop_rtp_mirror->buffer);
+        free(raop_rtp_mirror);
+        return NULL;
+    }
+    raop_rtp_mirror->reactor = reactor_init(logger);
+    if (!raop_rtp_mirror->reactor) {
+        frame_queue_destroy(raop_rtp_mirror->frame_queue);
+        video_frame_pool_destroy(raop_rtp_mirror->frame_pool);
+        buffer_pool_destroy(raop_rtp_mirror->payload_pool);
+        mirror_buffer_destroy(raop_rtp_mirror->buffer);
+        free(raop_rtp_mirror);
+        return NULL;
+    }
     if (raop_rtp_parse_remote(raop_rtp_mirror, remote, remotelen) < 0) {
+        reactor_destroy(raop_rtp_mirror->reactor);
+        frame_queue_destroy(raop_rtp_mirror->frame_queue);
+        video_frame_pool_destroy(raop_rtp_mirror->frame_pool);
+        buffer_pool_destroy(raop_rtp_mirror->payload_pool);
+        mirror_buffer_destroy(raop_rtp_mirror->buffer);
         free(raop_rtp_mirror);
         return NULL;
     }
-    raop_rtp_mirror->running = 0;
+    ATOMIC_STORE(raop_rtp_mirror->running, 0);
     raop_rtp_mirror->joined = 1;
     raop_rtp_mirror->flush = NO_FLUSH;
+    raop_rtp_mirror->latency_budget = latency_budget_ms > 0 ? (int64_t) latency_budget_ms * 1000 : 0;
+    playout_init(&raop_rtp_mirror->playout, 0);
+    histogram_init(&raop_rtp_mirror->hist_network);
+    histogram_init(&raop_rtp_mirror->hist_decrypt);
+    histogram_init(&raop_rtp_mirror->hist_rewrite);
+    histogram_init(&raop_rtp_mirror->hist_queue);
+    histogram_init(&raop_rtp_mirror->hist_submit);
 
     MUTEX_CREATE(raop_rtp_mirror->run_mutex);
+    MUTEX_CREATE(raop_rtp_mirror->pipeline_mutex);
+    COND_CREATE(raop_rtp_mirror->pipeline_cond);
     return raop_rtp_mirror;
 }
 
+void
+raop_rtp_mirror_set_socket_options(raop_rtp_mirror_t *raop_rtp_mirror, int receive_buffer, int busy_poll_us)
+{
+    assert(raop_rtp_mirror);
+    raop_rtp_mirror->receive_buffer = receive_buffer > 0 ? receive_buffer : 0;
+    raop_rtp_mirror->busy_poll = busy_poll_us > 0 ? busy_poll_us : 0;
+}
+
+void
+raop_rtp_mirror_set_playout(raop_rtp_mirror_t *raop_rtp_mirror, int max_delay_ms)
+{
+    assert(raop_rtp_mirror);
+    playout_init(&raop_rtp_mirror->playout, max_delay_ms);
+}
+
+void
+raop_rtp_mirror_set_genlock(raop_rtp_mirror_t *raop_rtp_mirror, genlock_t *genlock)
+{
+    assert(raop_rtp_mirror);
+    raop_rtp_mirror->genlock = genlock;
+}
+
+void
+raop_rtp_mirror_get_stats(raop_rtp_mirror_t *raop_rtp_mirror, raop_rtp_mirror_stats_t *stats)
+{
+    assert(raop_rtp_mirror);
+    stats->queued_frames = frame_queue_get_count(raop_rtp_mirror->frame_queue);
+    stats->queue_depth = frame_queue_get_depth(raop_rtp_mirror->frame_queue);
+    stats->dropped_frames = atomic_load_explicit(&raop_rtp_mirror->stats_dropped, memory_order_relaxed);
+    stats->lost_frames = atomic_load_explicit(&raop_rtp_mirror->stats_lost, memory_order_relaxed);
+    stats->jitter_us = atomic_load_explicit(&raop_rtp_mirror->stats_jitter, memory_order_relaxed);
+    stats->received_packets = atomic_load_explicit(&raop_rtp_mirror->stats_received, memory_order_relaxed);
+    stats->pixel_rate = atomic_load_explicit(&raop_rtp_mirror->stats_pixel_rate, memory_order_relaxed);
+}
+
 void
 raop_rtp_init_mirror_aes(raop_rtp_mirror_t *raop_rtp_mirror, uint64_t streamConnectionID)
 {
     mirror_buffer_init_aes(raop_rtp_mirror->buffer, streamConnectionID);
 }
 
-//#define DUMP_H264
+/*
+ * Gives back the buffer of a frame that is not going to be rendered
+ */
+static void
+raop_rtp_mirror_release_frame(raop_rtp_mirror_t *raop_rtp_mirror, h264_decode_struct *h264_data)
+{
+    if (h264_data->buffer_handle) {
+        raop_rtp_mirror->callbacks.video_release_buffer(raop_rtp_mirror->callbacks.cls, h264_data->buffer_handle);
+    } else {
+        buffer_pool_release(raop_rtp_mirror->payload_pool, h264_data->data);
+    }
+}
+
+/* Frees a frame passed to video_process_frame, the pools outlive the session if need be */
+static void
+raop_rtp_mirror_free_frame(void *opaque, unsigned char *data)
+{
+    buffer_pool_release(opaque, data);
+}
+
+/*
+ * Hands a frame to video_process_frame, or to video_process if the callback is not set, the
+ * frame is in a renderer buffer or no reference could be made. Releases the payload buffer.
+ */
+static void
+raop_rtp_mirror_render_frame(raop_rtp_mirror_t *raop_rtp_mirror, h264_decode_struct *h264_data)
+{
+    if (raop_rtp_mirror->callbacks.video_process_frame && !h264_data->buffer_handle) {
+        video_frame_t *frame = video_frame_pool_wrap(raop_rtp_mirror->frame_pool, h264_data, raop_rtp_mirror_free_frame,
+                                                     raop_rtp_mirror->payload_pool);
+        if (frame) {
+            raop_rtp_mirror->callbacks.video_process_frame(raop_rtp_mirror->callbacks.cls, raop_rtp_mirror->ntp, frame);
+            return;
+        }
+    }
+    raop_rtp_mirror->callbacks.video_process(raop_rtp_mirror->callbacks.cls, raop_rtp_mirror->ntp, h264_data);
+    // Renderer buffers were consumed by video_process
+    if (!h264_data->buffer_handle) {
+        buffer_pool_release(raop_rtp_mirror->payload_pool, h264_data->data);
+    }
+}
+
+/*
+ * Hands a frame over to the render thread, which releases its buffer.
+ * Returns -1 and releases the buffer itself if the queue was stopped.
+ */
+static int
+raop_rtp_mirror_queue_frame(raop_rtp_mirror_t *raop_rtp_mirror, h264_decode_struct *h264_data)
+{
+    int depth = frame_queue_get_depth(raop_rtp_mirror->frame_queue);
+    int count = frame_queue_get_count(raop_rtp_mirror->frame_queue);
+    if (count >= depth) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror render queue full (%d frames), receiving stalls", depth);
+        flight_recorder_trigger("render queue full");
+    } else {
+        LOGGER_DEBUG_HOT(raop_rtp_mirror->logger, "raop_rtp_mirror render queue %d/%d", count + 1, depth);
+    }
+    metrics_set(METRIC_VIDEO_QUEUE_FRAMES, count + 1);
+    h264_data->queued_time = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+    if (frame_queue_push(raop_rtp_mirror->frame_queue, h264_data) < 0) {
+        raop_rtp_mirror_release_frame(raop_rtp_mirror, h264_data);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Decides whether a late frame is skipped instead of decoded. Over the latency budget, frames no
+ * other frame refers to go first. A late reference frame means everything up to the next IDR has
+ * to go, as the following frames cannot be decoded without it. While the renderer reports
+ * backpressure, non-reference frames are skipped whatever the budget, so the render thread does
+ * not block on a full decoder. Under pressure the budget shrinks to RAOP_RTP_MIRROR_PRESSURE_BUDGET
+ * and non-reference frames are skipped as soon as another frame queues up behind them.
+ */
+static int
+raop_rtp_mirror_should_drop(raop_rtp_mirror_t *raop_rtp_mirror, const h264_decode_struct *h264_data)
+{
+    // Parameter sets are tiny and the decoder needs every one of them
+    if (h264_data->frame_type == 0) {
+        return 0;
+    }
+    if (!h264_data->is_reference && raop_rtp_mirror->callbacks.video_backpressure &&
+        raop_rtp_mirror->callbacks.video_backpressure(raop_rtp_mirror->callbacks.cls)) {
+        raop_rtp_mirror->dropped_backpressure++;
+        LOGGER_DEBUG_HOT(raop_rtp_mirror->logger, "raop_rtp_mirror renderer busy, dropping non-reference frame");
+        return 1;
+    }
+    int64_t latency_budget = raop_rtp_mirror->latency_budget;
+    if (atomic_load_explicit(&raop_rtp_mirror_pressure, memory_order_relaxed)) {
+        if (!h264_data->is_reference && frame_queue_get_count(raop_rtp_mirror->frame_queue) > 0) {
+            raop_rtp_mirror->dropped_backpressure++;
+            LOGGER_DEBUG_HOT(raop_rtp_mirror->logger, "raop_rtp_mirror throttled and behind, dropping non-reference frame");
+            return 1;
+        }
+        if (latency_budget == 0 || latency_budget > RAOP_RTP_MIRROR_PRESSURE_BUDGET) {
+            latency_budget = RAOP_RTP_MIRROR_PRESSURE_BUDGET;
+        }
+    }
+    if (latency_budget == 0) {
+        return 0;
+    }
+
+    uint64_t now = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+    if (raop_rtp_mirror->waiting_for_idr) {
+        if (h264_data->is_idr) {
+            logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "raop_rtp_mirror resuming at IDR after dropping %d frames",
+                       raop_rtp_mirror->dropped_to_idr);
+            raop_rtp_mirror->waiting_for_idr = 0;
+            raop_rtp_mirror->dropped_to_idr = 0;
+        } else if (now - raop_rtp_mirror->idr_wait_start > RAOP_RTP_MIRROR_MAX_IDR_WAIT) {
+            // The stream has no keyframes coming, a few corrupt frames beat a frozen picture
+            logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror no IDR after dropping %d frames, resuming anyway",
+                       raop_rtp_mirror->dropped_to_idr);
+            raop_rtp_mirror->waiting_for_idr = 0;
+            raop_rtp_mirror->dropped_to_idr = 0;
+            return 0;
+        } else {
+            raop_rtp_mirror->dropped_to_idr++;
+            return 1;
+        }
+    }
+
+    int64_t delay = (int64_t) now - (int64_t) h264_data->pts;
+    if (delay <= latency_budget || h264_data->is_idr) {
+        return 0;
+    }
+    if (!h264_data->is_reference) {
+        raop_rtp_mirror->dropped_non_reference++;
+        LOGGER_DEBUG_HOT(raop_rtp_mirror->logger, "raop_rtp_mirror dropping non-reference frame %lld us late", delay);
+        return 1;
+    }
+    logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror video %lld ms behind, dropping frames until the next IDR",
+               delay / 1000);
+    raop_rtp_mirror->waiting_for_idr = 1;
+    raop_rtp_mirror->idr_wait_start = now;
+    raop_rtp_mirror->dropped_to_idr = 1;
+    return 1;
+}
+
+void
+raop_rtp_mirror_request_stats(void)
+{
+    atomic_fetch_add_explicit(&raop_rtp_mirror_stats_requests, 1, memory_order_relaxed);
+}
+
+void
+raop_rtp_mirror_set_pressure(int pressure)
+{
+    atomic_store_explicit(&raop_rtp_mirror_pressure, pressure, memory_order_relaxed);
+}
+
+static void
+raop_rtp_mirror_log_stats(raop_rtp_mirror_t *raop_rtp_mirror, int level)
+{
+    histogram_log(&raop_rtp_mirror->hist_network, raop_rtp_mirror->logger, level, "raop_rtp_mirror network");
+    histogram_log(&raop_rtp_mirror->hist_decrypt, raop_rtp_mirror->logger, level, "raop_rtp_mirror decrypt");
+    histogram_log(&raop_rtp_mirror->hist_rewrite, raop_rtp_mirror->logger, level, "raop_rtp_mirror nal rewrite");
+    histogram_log(&raop_rtp_mirror->hist_queue, raop_rtp_mirror->logger, level, "raop_rtp_mirror render queue");
+    histogram_log(&raop_rtp_mirror->hist_submit, raop_rtp_mirror->logger, level, "raop_rtp_mirror renderer submit");
+    if (raop_rtp_mirror->playout.max_delay) {
+        logger_log(raop_rtp_mirror->logger, level, "raop_rtp_mirror playout margin %lld us",
+                   playout_get_margin(&raop_rtp_mirror->playout));
+    }
+    perf_counters_log(raop_rtp_mirror->logger, level);
+}
+
+/*
+ * Follows a pipelined frame until the mirror thread finished it, handing the renderer every run
+ * of NAL units as soon as it was rewritten. A renderer that refuses the first part gets the
+ * frame through video_process once it is complete instead.
+ */
+/* Sets is_idr and is_reference from the NAL unit types in the index of a frame */
+static void
+raop_rtp_mirror_classify_frame(h264_decode_struct *h264_data)
+{
+    h264_data->is_idr = 0;
+    h264_data->is_reference = 0;
+    for (int i = 0; i < h264_data->nal_index.count; i++) {
+        const h264_nal_index_entry_t *nal = &h264_data->nal_index.nals[i];
+        if (h264_data->codec == VIDEO_CODEC_H265) {
+            // Not at a CRA picture, the leading pictures after it may refer to frames before it
+            if (nal->nal_unit_type >= H265_NAL_TYPE_BLA_W_LP && nal->nal_unit_type <= H265_NAL_TYPE_IDR_N_LP) h264_data->is_idr = 1;
+            if (nal->nal_unit_type < H265_NAL_TYPE_VPS && nal->nal_ref_idc) h264_data->is_reference = 1;
+        } else {
+            if (nal->nal_unit_type == NAL_UNIT_TYPE_CODED_SLICE_IDR) h264_data->is_idr = 1;
+            if (nal->nal_unit_type <= NAL_UNIT_TYPE_CODED_SLICE_IDR && nal->nal_ref_idc) h264_data->is_reference = 1;
+        }
+    }
+}
+
+static void
+raop_rtp_mirror_render_pipelined(raop_rtp_mirror_t *raop_rtp_mirror, h264_decode_struct *h264_data)
+{
+    int submitted = 0;
+    int in_parts = 1;
+    int state;
+
+    MUTEX_LOCK(raop_rtp_mirror->pipeline_mutex);
+    do {
+        while (raop_rtp_mirror->pipeline_ready == submitted &&
+               raop_rtp_mirror->pipeline_state == RAOP_RTP_MIRROR_PIPELINE_RECEIVING) {
+            COND_WAIT(raop_rtp_mirror->pipeline_cond, raop_rtp_mirror->pipeline_mutex);
+        }
+        int ready = raop_rtp_mirror->pipeline_ready;
+        state = raop_rtp_mirror->pipeline_state;
+        MUTEX_UNLOCK(raop_rtp_mirror->pipeline_mutex);
+
+        if (in_parts) {
+            int end_of_frame = state != RAOP_RTP_MIRROR_PIPELINE_RECEIVING;
+            if (raop_rtp_mirror->callbacks.video_process_nals(raop_rtp_mirror->callbacks.cls, raop_rtp_mirror->ntp,
+                                                              h264_data->data + submitted, ready - submitted,
+                                                              h264_data->pts, end_of_frame) < 0) {
+                in_parts = 0;
+            }
+        }
+        submitted = ready;
+        MUTEX_LOCK(raop_rtp_mirror->pipeline_mutex);
+    } while (state == RAOP_RTP_MIRROR_PIPELINE_RECEIVING);
+    raop_rtp_mirror->pipeline_busy = 0;
+    MUTEX_UNLOCK(raop_rtp_mirror->pipeline_mutex);
+
+    if (state == RAOP_RTP_MIRROR_PIPELINE_FAILED) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror pipelined frame of %d bytes ended after %d",
+                   h264_data->data_len, submitted);
+    } else {
+        // Whole again for whatever besides the renderer looks at the frames
+        h264_data->nal_index = raop_rtp_mirror->pipeline_index;
+        h264_data->rendered = in_parts;
+        raop_rtp_mirror_classify_frame(h264_data);
+        raop_rtp_mirror->callbacks.video_process(raop_rtp_mirror->callbacks.cls, raop_rtp_mirror->ntp, h264_data);
+    }
+}
+
+/*
+ * Holds a frame back until its playout time, moved on to the next vsync if the renderer knows
+ * when that comes, so frames reach the display on the sender's cadence instead of in bursts.
+ */
+static void
+raop_rtp_mirror_wait_playout(raop_rtp_mirror_t *raop_rtp_mirror, uint64_t release)
+{
+    if (raop_rtp_mirror->callbacks.video_next_vsync) {
+        release = raop_rtp_mirror->callbacks.video_next_vsync(raop_rtp_mirror->callbacks.cls, release);
+    }
+    uint64_t now = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+    if (release <= now) {
+        return;
+    }
+    // A stepped clock must not hold up the stream for longer than the playout delay allows
+    uint64_t wait = release - now;
+    uint64_t max_wait = raop_rtp_mirror->playout.max_delay + RAOP_RTP_MIRROR_MAX_VSYNC_WAIT;
+    usleep(wait < max_wait ? wait : max_wait);
+}
+
+/*
+ * Moves a frame's playout time onto the schedule of the video wall. The frame is known to the
+ * other receivers by its pts on the sender's clock, which they all agree on, the local pts went
+ * through this node's own NTP sync. The refresh grid of the display is taken from two vsyncs.
+ */
+static uint64_t
+raop_rtp_mirror_genlock_release(raop_rtp_mirror_t *raop_rtp_mirror, uint64_t pts, uint64_t release)
+{
+    uint64_t vsync = 0;
+    uint64_t period = 0;
+    if (raop_rtp_mirror->callbacks.video_next_vsync) {
+        vsync = raop_rtp_mirror->callbacks.video_next_vsync(raop_rtp_mirror->callbacks.cls, release);
+        uint64_t after = raop_rtp_mirror->callbacks.video_next_vsync(raop_rtp_mirror->callbacks.cls, vsync + 1);
+        // A renderer that does not know the refresh hands the time back as it was
+        if (after > vsync + 1 && after - vsync <= RAOP_RTP_MIRROR_MAX_VSYNC_WAIT) {
+            period = after - vsync;
+        } else {
+            vsync = 0;
+        }
+    }
+    uint64_t remote_pts = raop_ntp_convert_local_time(raop_rtp_mirror->ntp, pts);
+    return genlock_schedule(raop_rtp_mirror->genlock, remote_pts, release, vsync, period);
+}
+
+/* Tells the renderer when the stream pauses and resumes, on the render thread like every other frame */
+static void
+raop_rtp_mirror_pause_renderer(raop_rtp_mirror_t *raop_rtp_mirror, int paused)
+{
+    if (raop_rtp_mirror->renderer_paused == paused) {
+        return;
+    }
+    raop_rtp_mirror->renderer_paused = paused;
+    if (raop_rtp_mirror->callbacks.video_pause) {
+        raop_rtp_mirror->callbacks.video_pause(raop_rtp_mirror->callbacks.cls, paused);
+    }
+}
+
+/**
+ * Render, takes decrypted frames off the queue so a slow decoder never blocks the socket
+ */
+static THREAD_RETVAL
+raop_rtp_mirror_render_thread(void *arg)
+{
+    raop_rtp_mirror_t *raop_rtp_mirror = arg;
+    h264_decode_struct h264_data;
+    assert(raop_rtp_mirror);
+
+    mem_account_enter(raop_rtp_mirror->mem_session);
+
+    raop_rtp_mirror->last_stats_dump = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+    raop_rtp_mirror->stats_requests_seen = atomic_load_explicit(&raop_rtp_mirror_stats_requests, memory_order_relaxed);
+    while (frame_queue_pop(raop_rtp_mirror->frame_queue, &h264_data) == 0) {
+        if (h264_data.frame_type == RAOP_RTP_MIRROR_FRAME_PAUSE) {
+            raop_rtp_mirror_pause_renderer(raop_rtp_mirror, 1);
+            continue;
+        }
+        raop_rtp_mirror_pause_renderer(raop_rtp_mirror, 0);
+        perf_counters_begin();
+
+        uint64_t start = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+        uint64_t queued = start > h264_data.queued_time ? start - h264_data.queued_time : 0;
+        histogram_record(&raop_rtp_mirror->hist_queue, queued);
+
+        unsigned int requests = atomic_load_explicit(&raop_rtp_mirror_stats_requests, memory_order_relaxed);
+        if (requests != raop_rtp_mirror->stats_requests_seen) {
+            raop_rtp_mirror->stats_requests_seen = requests;
+            raop_rtp_mirror_log_stats(raop_rtp_mirror, LOGGER_INFO);
+        } else if (start - raop_rtp_mirror->last_stats_dump > RAOP_RTP_MIRROR_STATS_INTERVAL) {
+            raop_rtp_mirror->last_stats_dump = start;
+            raop_rtp_mirror_log_stats(raop_rtp_mirror, LOGGER_DEBUG);
+        }
+
+        // Only pipelined when nothing was queued, there is nothing to drop or to hold back
+        if (h264_data.pipelined) {
+            raop_rtp_mirror_render_pipelined(raop_rtp_mirror, &h264_data);
+            PROBE3(mirror_render_submit, h264_data.pts, h264_data.data_len, queued);
+            histogram_record(&raop_rtp_mirror->hist_submit, raop_ntp_get_local_time(raop_rtp_mirror->ntp) - start);
+            perf_counters_mark(PERF_STAGE_VIDEO_SUBMIT, 1);
+            buffer_pool_release(raop_rtp_mirror->payload_pool, h264_data.data);
+            continue;
+        }
+
+        // Parameter sets do not show up on screen, they go to the decoder right away
+        uint64_t release = 0;
+        if (h264_data.frame_type != 0) {
+            // Scheduled even without a playout delay, for the jitter estimate
+            release = playout_schedule(&raop_rtp_mirror->playout, h264_data.pts, h264_data.queued_time);
+            if (raop_rtp_mirror->genlock && raop_rtp_mirror->playout.max_delay) {
+                release = raop_rtp_mirror_genlock_release(raop_rtp_mirror, h264_data.pts, release);
+            }
+            atomic_store_explicit(&raop_rtp_mirror->stats_jitter, (int) raop_rtp_mirror->playout.jitter, memory_order_relaxed);
+        }
+        if (raop_rtp_mirror_should_drop(raop_rtp_mirror, &h264_data)) {
+            metrics_add(METRIC_VIDEO_FRAMES_DROPPED, 1);
+            atomic_fetch_add_explicit(&raop_rtp_mirror->stats_dropped, 1, memory_order_relaxed);
+            raop_rtp_mirror_release_frame(raop_rtp_mirror, &h264_data);
+            continue;
+        }
+        if (raop_rtp_mirror->playout.max_delay && release) {
+            raop_rtp_mirror_wait_playout(raop_rtp_mirror, release);
+        }
+        raop_rtp_mirror_render_frame(raop_rtp_mirror, &h264_data);
+        PROBE3(mirror_render_submit, h264_data.pts, h264_data.data_len, queued);
+        histogram_record(&raop_rtp_mirror->hist_submit, raop_ntp_get_local_time(raop_rtp_mirror->ntp) - start);
+        perf_counters_mark(PERF_STAGE_VIDEO_SUBMIT, 1);
+    }
+
+    // The renderer is flushed once the session ends, which a powered down decoder would not get through
+    raop_rtp_mirror_pause_renderer(raop_rtp_mirror, 0);
+    raop_rtp_mirror_log_stats(raop_rtp_mirror, LOGGER_INFO);
+
+    if (raop_rtp_mirror->dropped_non_reference) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "raop_rtp_mirror dropped %d late non-reference frames",
+                   raop_rtp_mirror->dropped_non_reference);
+    }
+    if (raop_rtp_mirror->dropped_backpressure) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "raop_rtp_mirror dropped %d non-reference frames while the renderer was busy",
+                   raop_rtp_mirror->dropped_backpressure);
+    }
+
+    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror exiting render thread");
+    return 0;
+}
 
 #define RAOP_PACKET_LEN 32768
 /**
  * Mirror
  */
+/* Appends a parameter set behind a start code, -1 if the sets grow too large */
+static int
+raop_rtp_mirror_codec_append(raop_rtp_mirror_codec_t *codec, const unsigned char *nal, int size,
+                             int nal_unit_type, int nal_ref_idc)
+{
+    static const unsigned char start_code[] = { 0, 0, 0, 1 };
+    if (size <= 0 || size > RAOP_RTP_MIRROR_MAX_PARAMETER_SETS - 4 - codec->data_len ||
+        codec->sets.count == H264_NAL_INDEX_MAX) {
+        return -1;
+    }
+    h264_nal_index_entry_t *entry = &codec->sets.nals[codec->sets.count++];
+    entry->offset = codec->data_len + 4;
+    entry->size = size;
+    entry->nal_unit_type = nal_unit_type;
+    entry->nal_ref_idc = nal_ref_idc;
+    memcpy(codec->data + codec->data_len, start_code, 4);
+    memcpy(codec->data + entry->offset, nal, size);
+    codec->data_len += 4 + size;
+    return 0;
+}
+
+/*
+ * Stores the parameter sets for a geometry in the session cache, replacing whatever was
+ * cached for it before. known is set if exactly these sets were already cached, which is
+ * the case whenever the sender rotates back to an orientation it already streamed in.
+ */
+static const raop_rtp_mirror_codec_t *
+raop_rtp_mirror_cache_codec(raop_rtp_mirror_t *raop_rtp_mirror, const raop_rtp_mirror_codec_t *parsed, int *known)
+{
+    raop_rtp_mirror_codec_t *codec = NULL;
+
+    *known = 0;
+    for (int i = 0; i < RAOP_RTP_MIRROR_CODEC_CACHE_SIZE; i++) {
+        if (raop_rtp_mirror->codecs[i].data_len > 0 && raop_rtp_mirror->codecs[i].width == parsed->width &&
+            raop_rtp_mirror->codecs[i].height == parsed->height) {
+            codec = &raop_rtp_mirror->codecs[i];
+            break;
+        }
+    }
+    if (codec && codec->codec == parsed->codec && codec->data_len == parsed->data_len &&
+        !memcmp(codec->data, parsed->data, parsed->data_len)) {
+        *known = 1;
+        return codec;
+    }
+    if (!codec) {
+        codec = &raop_rtp_mirror->codecs[raop_rtp_mirror->next_codec];
+        raop_rtp_mirror->next_codec = (raop_rtp_mirror->next_codec + 1) % RAOP_RTP_MIRROR_CODEC_CACHE_SIZE;
+    }
+    *codec = *parsed;
+    return codec;
+}
+
+/* The SPS and PPS of an H.264 sender, laid out like an avcC record with a single set of each */
+static int
+raop_rtp_mirror_parse_h264(raop_rtp_mirror_t *raop_rtp_mirror, unsigned char *payload, int payload_size,
+                           raop_rtp_mirror_codec_t *codec)
+{
+    if (payload_size < 11) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror sps/pps payload of %d bytes is too short", payload_size);
+        return -1;
+    }
+    h264codec_t h264;
+    h264.version = payload[0];
+    h264.profile_high = payload[1];
+    h264.compatibility = payload[2];
+    h264.level = payload[3];
+    h264.reserved_6_and_nal = payload[4];
+    h264.reserved_3_and_sps = payload[5];
+    h264.sps_size = (short) (((payload[6] & 255) << 8) + (payload[7] & 255));
+    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror sps size = %d", h264.sps_size);
+    if (h264.sps_size <= 0 || h264.sps_size + 11 > payload_size) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror invalid sps size %d", h264.sps_size);
+        return -1;
+    }
+    h264.sequence_parameter_set = payload + 8;
+    h264.number_of_pps = payload[h264.sps_size + 8];
+    h264.pps_size = (short) (((payload[h264.sps_size + 9] & 2040) + payload[h264.sps_size + 10]) & 255);
+    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror pps size = %d", h264.pps_size);
+    if (h264.pps_size <= 0 || h264.sps_size + h264.pps_size + 11 > payload_size) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror invalid pps size %d", h264.pps_size);
+        return -1;
+    }
+    h264.picture_parameter_set = payload + h264.sps_size + 11;
+
+    codec->codec = VIDEO_CODEC_H264;
+    if (raop_rtp_mirror_codec_append(codec, h264.sequence_parameter_set, h264.sps_size, NAL_UNIT_TYPE_SPS,
+                                     (h264.sequence_parameter_set[0] >> 5) & 0x03) < 0 ||
+        raop_rtp_mirror_codec_append(codec, h264.picture_parameter_set, h264.pps_size, NAL_UNIT_TYPE_PPS,
+                                     (h264.picture_parameter_set[0] >> 5) & 0x03) < 0) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror sps and pps of %d bytes are too large",
+                   h264.sps_size + h264.pps_size);
+        return -1;
+    }
+    return 0;
+}
+
+/* Where the content of the hvcC box of an H.265 sender starts, NULL for an H.264 sender */
+static const unsigned char *
+raop_rtp_mirror_find_hvcc(unsigned char *payload, int payload_size, int *record_size)
+{
+    for (int i = 4; i + 4 <= payload_size; i++) {
+        if (memcmp(payload + i, "hvcC", 4)) {
+            continue;
+        }
+        // The box size in front of the type, the record may not run past the payload anyway
+        int box_size = (int) byteutils_get_int_be(payload, i - 4);
+        *record_size = payload_size - i - 4;
+        if (box_size >= 8 && box_size - 8 < *record_size) {
+            *record_size = box_size - 8;
+        }
+        return payload + i + 4;
+    }
+    return NULL;
+}
+
+/* The VPS, SPS and PPS of an H.265 sender, from the hvcC box of the sample description it sends */
+static int
+raop_rtp_mirror_parse_h265(raop_rtp_mirror_t *raop_rtp_mirror, const unsigned char *record, int record_size,
+                           raop_rtp_mirror_codec_t *codec)
+{
+    h264_nal_index_t sets;
+    if (read_hvcc_parameter_sets(record, record_size, &sets) <= 0) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror invalid hvcC record of %d bytes", record_size);
+        return -1;
+    }
+    codec->codec = VIDEO_CODEC_H265;
+    for (int i = 0; i < sets.count; i++) {
+        const h264_nal_index_entry_t *nal = &sets.nals[i];
+        if (raop_rtp_mirror_codec_append(codec, record + nal->offset, nal->size, nal->nal_unit_type, nal->nal_ref_idc) < 0) {
+            logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror %d parameter sets of %d bytes are too large",
+                       sets.count, record_size);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Parses the parameter sets of a payload type 1 packet and caches them for its geometry.
+ * Returns NULL if the packet is malformed.
+ */
+static const raop_rtp_mirror_codec_t *
+raop_rtp_mirror_parse_codec(raop_rtp_mirror_t *raop_rtp_mirror, const unsigned char *packet,
+                            unsigned char *payload, int payload_size, int *known)
+{
+    float width_source = byteutils_get_float(packet, 40);
+    float height_source = byteutils_get_float(packet, 44);
+    float width = byteutils_get_float(packet, 56);
+    float height = byteutils_get_float(packet, 60);
+    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror width_source = %f height_source = %f width = %f height = %f",
+               width_source, height_source, width, height);
+
+    // The parameter sets are not encrypted
+    raop_rtp_mirror_codec_t parsed;
+    parsed.width = (int) width;
+    parsed.height = (int) height;
+    parsed.data_len = 0;
+    parsed.sets.count = 0;
+    int record_size = 0;
+    const unsigned char *hvcc = raop_rtp_mirror_find_hvcc(payload, payload_size, &record_size);
+    int ret = hvcc ? raop_rtp_mirror_parse_h265(raop_rtp_mirror, hvcc, record_size, &parsed) :
+              raop_rtp_mirror_parse_h264(raop_rtp_mirror, payload, payload_size, &parsed);
+    if (ret < 0) {
+        return NULL;
+    }
+
+    const raop_rtp_mirror_codec_t *codec = raop_rtp_mirror_cache_codec(raop_rtp_mirror, &parsed, known);
+    if (raop_rtp_mirror->codec != codec->codec) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "raop_rtp_mirror stream switches to %s",
+                   codec->codec == VIDEO_CODEC_H265 ? "H.265" : "H.264");
+    }
+    raop_rtp_mirror->codec = codec->codec;
+    raop_rtp_mirror->current_codec = codec;
+    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror %s %s geometry %dx%d", *known ? "known" : "new",
+               codec->codec == VIDEO_CODEC_H265 ? "H.265" : "H.264", codec->width, codec->height);
+    return codec;
+}
+
+/* Hands the decoder a copy of the parameter sets, the cached ones stay with the session */
+static int
+raop_rtp_mirror_queue_codec(raop_rtp_mirror_t *raop_rtp_mirror, const raop_rtp_mirror_codec_t *codec, int known)
+{
+    h264_decode_struct h264_data;
+    h264_data.data_len = codec->data_len;
+    h264_data.data = buffer_pool_acquire(raop_rtp_mirror->payload_pool, codec->data_len);
+    h264_data.frame_type = 0;
+    h264_data.pts = 0;
+    h264_data.is_idr = 0;
+    h264_data.is_reference = 1;
+    h264_data.width = codec->width;
+    h264_data.height = codec->height;
+    h264_data.known_geometry = known;
+    h264_data.buffer_handle = NULL;
+    h264_data.pipelined = 0;
+    h264_data.rendered = 0;
+    h264_data.codec = codec->codec;
+    h264_data.nal_index = codec->sets;
+    if (!h264_data.data) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror could not get a buffer for sps and pps");
+        return 0;
+    }
+    memcpy(h264_data.data, codec->data, codec->data_len);
+    return raop_rtp_mirror_queue_frame(raop_rtp_mirror, &h264_data);
+}
+
+/*
+ * The decode load of the stream, the frames that arrived over the last window times the size
+ * the parameter sets give them. Stays at what it was while the sender pauses, it is going to
+ * come back at that rate.
+ */
+static void
+raop_rtp_mirror_measure_load(raop_rtp_mirror_t *raop_rtp_mirror, uint64_t arrival_time)
+{
+    if (!raop_rtp_mirror->load_since || raop_rtp_mirror->paused) {
+        raop_rtp_mirror->load_since = arrival_time;
+        raop_rtp_mirror->load_frames = 0;
+        return;
+    }
+    raop_rtp_mirror->load_frames++;
+    uint64_t elapsed = arrival_time - raop_rtp_mirror->load_since;
+    if (elapsed < RAOP_RTP_MIRROR_LOAD_WINDOW || !raop_rtp_mirror->current_codec) {
+        return;
+    }
+    const raop_rtp_mirror_codec_t *codec = raop_rtp_mirror->current_codec;
+    uint64_t rate = (uint64_t) raop_rtp_mirror->load_frames * codec->width * codec->height * 1000000 / elapsed;
+    atomic_store_explicit(&raop_rtp_mirror->stats_pixel_rate, rate < UINT_MAX ? (unsigned int) rate : UINT_MAX,
+                          memory_order_relaxed);
+    raop_rtp_mirror->load_since = arrival_time;
+    raop_rtp_mirror->load_frames = 0;
+}
+
+/*
+ * Called with the header of every payload as soon as it arrived, before anything of a video
+ * frame goes to the render thread. Heartbeats keep coming while the sender is paused, once
+ * they did for RAOP_RTP_MIRROR_PAUSE_AFTER without a frame, a pause marker is queued. The
+ * first frame after that comes behind the parameter sets in use, for a decoder that was
+ * powered down and lost them. Returns -1 once the render queue was stopped.
+ */
+static int
+raop_rtp_mirror_note_payload(raop_rtp_mirror_t *raop_rtp_mirror, unsigned short payload_type, uint64_t arrival_time)
+{
+    if (payload_type == 0) {
+        raop_rtp_mirror_measure_load(raop_rtp_mirror, arrival_time);
+        raop_rtp_mirror->last_video_time = arrival_time;
+        if (!raop_rtp_mirror->paused) {
+            return 0;
+        }
+        raop_rtp_mirror->paused = 0;
+        logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "raop_rtp_mirror the sender resumed the mirror");
+        if (raop_rtp_mirror->current_codec) {
+            return raop_rtp_mirror_queue_codec(raop_rtp_mirror, raop_rtp_mirror->current_codec, 1);
+        }
+        return 0;
+    }
+    if (payload_type == 1 || raop_rtp_mirror->paused || !raop_rtp_mirror->last_video_time ||
+        arrival_time - raop_rtp_mirror->last_video_time < RAOP_RTP_MIRROR_PAUSE_AFTER) {
+        return 0;
+    }
+    raop_rtp_mirror->paused = 1;
+    logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "raop_rtp_mirror the sender paused the mirror");
+    h264_decode_struct marker;
+    memset(&marker, 0, sizeof(marker));
+    marker.frame_type = RAOP_RTP_MIRROR_FRAME_PAUSE;
+    return raop_rtp_mirror_queue_frame(raop_rtp_mirror, &marker);
+}
+
+/*
+ * Decryption of a video frame's payload, which may start while the rest is still being
+ * received. The payload goes straight into renderer memory if the renderer offers some, else
+ * it is decrypted in place.
+ */
+typedef struct {
+    unsigned char *frame;
+    void *buffer_handle;
+    int size;
+    int decrypted;
+    int pipelined; // Queued already, see raop_rtp_mirror_pipeline_frame
+    int rewritten; // Bytes of a pipelined frame rewritten to Annex-B
+} raop_rtp_mirror_decrypt_t;
+
+/* Local time a video frame was captured, from the sender's timestamp in its header */
+static uint64_t
+raop_rtp_mirror_frame_pts(raop_rtp_mirror_t *raop_rtp_mirror, unsigned char *packet)
+{
+    // Conveniently, the video data is already stamped with the remote wall clock time,
+    // so no additional clock syncing needed. The only thing odd here is that the video
+    // ntp time stamps don't include the SECONDS_FROM_1900_TO_1970, so it's really just
+    // counting micro seconds since last boot.
+    uint64_t ntp_timestamp_raw = byteutils_get_long(packet, 8);
+    uint64_t ntp_timestamp_remote = raop_ntp_timestamp_to_micro_seconds(ntp_timestamp_raw, false);
+    return raop_ntp_convert_remote_time(raop_rtp_mirror->ntp, ntp_timestamp_remote);
+}
+
+/*
+ * Queues a video frame for slice pipelining as soon as its header arrived. Only done while the
+ * render thread has nothing else queued, and without a drop policy or playout delay, which both
+ * need the whole frame first. Returns 1 if queued, the payload then belongs to the render thread,
+ * 0 if not and -1 once the render queue was stopped, the payload is then gone.
+ */
+static int
+raop_rtp_mirror_pipeline_frame(raop_rtp_mirror_t *raop_rtp_mirror, unsigned char *packet,
+                               unsigned char *payload, int payload_size)
+{
+    if (!raop_rtp_mirror->callbacks.video_process_nals || raop_rtp_mirror->latency_budget ||
+        raop_rtp_mirror->playout.max_delay || frame_queue_get_count(raop_rtp_mirror->frame_queue) > 0) {
+        return 0;
+    }
+    MUTEX_LOCK(raop_rtp_mirror->pipeline_mutex);
+    if (raop_rtp_mirror->pipeline_busy) {
+        MUTEX_UNLOCK(raop_rtp_mirror->pipeline_mutex);
+        return 0;
+    }
+    raop_rtp_mirror->pipeline_busy = 1;
+    raop_rtp_mirror->pipeline_ready = 0;
+    raop_rtp_mirror->pipeline_state = RAOP_RTP_MIRROR_PIPELINE_RECEIVING;
+    raop_rtp_mirror->pipeline_index.count = 0;
+    MUTEX_UNLOCK(raop_rtp_mirror->pipeline_mutex);
+
+    h264_decode_struct h264_data;
+    memset(&h264_data, 0, sizeof(h264_data));
+    h264_data.data = payload;
+    h264_data.data_len = payload_size;
+    h264_data.frame_type = 1;
+    h264_data.pts = raop_rtp_mirror_frame_pts(raop_rtp_mirror, packet);
+    h264_data.pipelined = 1;
+    h264_data.codec = raop_rtp_mirror->codec;
+    return raop_rtp_mirror_queue_frame(raop_rtp_mirror, &h264_data) < 0 ? -1 : 1;
+}
+
+/* Rewrites the NAL units of a pipelined frame decrypted so far and passes them on, final ends the frame */
+static void
+raop_rtp_mirror_pipeline_progress(raop_rtp_mirror_t *raop_rtp_mirror, raop_rtp_mirror_decrypt_t *decrypt, int final)
+{
+    // A malformed frame stops short and fails once it is complete, the keystream has to go on till then
+    int ret = raop_rtp_mirror->codec == VIDEO_CODEC_H265 ?
+              hvcc_to_annexb_partial(decrypt->frame, decrypt->size, decrypt->decrypted, &decrypt->rewritten,
+                                     &raop_rtp_mirror->pipeline_index) :
+              avcc_to_annexb_partial(decrypt->frame, decrypt->size, decrypt->decrypted, &decrypt->rewritten,
+                                     &raop_rtp_mirror->pipeline_index);
+    MUTEX_LOCK(raop_rtp_mirror->pipeline_mutex);
+    raop_rtp_mirror->pipeline_ready = decrypt->rewritten;
+    if (final) {
+        raop_rtp_mirror->pipeline_state = ret == 1 ? RAOP_RTP_MIRROR_PIPELINE_COMPLETE : RAOP_RTP_MIRROR_PIPELINE_FAILED;
+    }
+    COND_SIGNAL(raop_rtp_mirror->pipeline_cond);
+    MUTEX_UNLOCK(raop_rtp_mirror->pipeline_mutex);
+}
+
+static void
+raop_rtp_mirror_begin_decrypt(raop_rtp_mirror_t *raop_rtp_mirror, unsigned char *payload, int payload_size,
+                              raop_rtp_mirror_decrypt_t *decrypt, int pipelined)
+{
+    decrypt->frame = NULL;
+    decrypt->buffer_handle = NULL;
+    decrypt->size = payload_size;
+    decrypt->decrypted = 0;
+    decrypt->pipelined = pipelined;
+    decrypt->rewritten = 0;
+    // The render thread reads a pipelined frame from the payload buffer
+    if (!pipelined && raop_rtp_mirror->callbacks.video_acquire_buffer && raop_rtp_mirror->callbacks.video_release_buffer) {
+        decrypt->frame = raop_rtp_mirror->callbacks.video_acquire_buffer(raop_rtp_mirror->callbacks.cls, payload_size,
+                                                                         &decrypt->buffer_handle);
+    }
+    if (!decrypt->frame) {
+        decrypt->buffer_handle = NULL;
+        decrypt->frame = payload;
+    }
+}
+
+/* Decrypts what arrived of the payload since the last call, up to received bytes */
+static void
+raop_rtp_mirror_decrypt_span(raop_rtp_mirror_t *raop_rtp_mirror, unsigned char *payload, int received,
+                             raop_rtp_mirror_decrypt_t *decrypt)
+{
+    if (received > decrypt->decrypted) {
+        mirror_buffer_decrypt(raop_rtp_mirror->buffer, payload + decrypt->decrypted, decrypt->frame + decrypt->decrypted,
+                              received - decrypt->decrypted);
+        decrypt->decrypted = received;
+        if (decrypt->pipelined) {
+            raop_rtp_mirror_pipeline_progress(raop_rtp_mirror, decrypt, 0);
+        }
+    }
+}
+
+/* Gives back the buffers of a frame that is not going to be completed, a pipelined one fails on the render thread */
+static void
+raop_rtp_mirror_abort_frame(raop_rtp_mirror_t *raop_rtp_mirror, raop_rtp_mirror_decrypt_t *decrypt, unsigned char *payload)
+{
+    if (decrypt->buffer_handle) {
+        raop_rtp_mirror->callbacks.video_release_buffer(raop_rtp_mirror->callbacks.cls, decrypt->buffer_handle);
+    }
+    if (decrypt->pipelined) {
+        MUTEX_LOCK(raop_rtp_mirror->pipeline_mutex);
+        raop_rtp_mirror->pipeline_state = RAOP_RTP_MIRROR_PIPELINE_FAILED;
+        COND_SIGNAL(raop_rtp_mirror->pipeline_cond);
+        MUTEX_UNLOCK(raop_rtp_mirror->pipeline_mutex);
+    } else {
+        buffer_pool_release(raop_rtp_mirror->payload_pool, payload);
+    }
+    memset(decrypt, 0, sizeof(*decrypt));
+}
+
+/*
+ * Handles a complete frame, its 128 byte header and the payload, whichever transport it came in
+ * over. The payload buffer is handed to the render thread or released. A video payload may be
+ * partly decrypted already, as decrypt tells, else decrypt has a NULL frame. Returns -1 once the
+ * render queue was stopped.
+ */
+static int
+raop_rtp_mirror_process_frame(raop_rtp_mirror_t *raop_rtp_mirror, unsigned char *packet,
+                              unsigned char *payload, int payload_size, uint64_t arrival_time,
+                              raop_rtp_mirror_decrypt_t *decrypt)
+{
+    unsigned short payload_type = byteutils_get_short(packet, 4) & 0xff;
+    atomic_fetch_add_explicit(&raop_rtp_mirror->stats_received, 1, memory_order_relaxed);
+    // Traces hold the encrypted payload, which is gone once it was decrypted in place
+    if (!decrypt->decrypted || decrypt->frame != payload) {
+        trace_record(TRACE_RECORD_MIRROR_PACKET, arrival_time, packet, 128, payload, payload_size);
+    }
+
+    if (payload_type == 0) {
+        // Normal video data (VCL NAL)
+        raop_rtp_mirror_milestone(raop_rtp_mirror, RAOP_MILESTONE_FIRST_FRAME);
+        metrics_add(METRIC_VIDEO_FRAMES, 1);
+
+        uint64_t ntp_timestamp = raop_rtp_mirror_frame_pts(raop_rtp_mirror, packet);
+
+        histogram_record(&raop_rtp_mirror->hist_network,
+                         arrival_time > ntp_timestamp ? arrival_time - ntp_timestamp : 0);
+        PROBE3(mirror_frame_receive, ntp_timestamp, payload_size, arrival_time);
+
+        // Decrypt what is left, the decrypt stage only counts what happened after the last byte arrived
+        uint64_t decrypt_start = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+        h264_decode_struct h264_data;
+        if (!decrypt->frame) {
+            raop_rtp_mirror_begin_decrypt(raop_rtp_mirror, payload, payload_size, decrypt, 0);
+        }
+        raop_rtp_mirror_decrypt_span(raop_rtp_mirror, payload, payload_size, decrypt);
+        if (decrypt->pipelined) {
+            // Queued with its header already, the render thread takes it from here
+            raop_rtp_mirror_pipeline_progress(raop_rtp_mirror, decrypt, 1);
+            memset(decrypt, 0, sizeof(*decrypt));
+            uint64_t decrypt_end = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+            histogram_record(&raop_rtp_mirror->hist_decrypt, decrypt_end - decrypt_start);
+            perf_counters_mark(PERF_STAGE_VIDEO_DECRYPT, 1);
+            // The NAL units were rewritten as they were decrypted
+            PROBE3(mirror_decrypt_done, ntp_timestamp, payload_size, decrypt_end);
+            PROBE3(mirror_rewrite_done, ntp_timestamp, payload_size, raop_rtp_mirror->pipeline_index.count);
+            return 0;
+        }
+        unsigned char *frame = decrypt->frame;
+        h264_data.buffer_handle = decrypt->buffer_handle;
+        decrypt->frame = NULL;
+        decrypt->buffer_handle = NULL;
+        decrypt->decrypted = 0;
+        uint64_t rewrite_start = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+        histogram_record(&raop_rtp_mirror->hist_decrypt, rewrite_start - decrypt_start);
+        perf_counters_mark(PERF_STAGE_VIDEO_DECRYPT, 1);
+        PROBE3(mirror_decrypt_done, ntp_timestamp, payload_size, rewrite_start);
+
+        // It seems the AirPlay protocol prepends NALs with their size, which we're replacing with the 4-byte
+        // start code for the NAL Byte-Stream Format.
+        int rewritten = raop_rtp_mirror->codec == VIDEO_CODEC_H265 ?
+                        hvcc_to_annexb(frame, payload_size, &h264_data.nal_index) :
+                        avcc_to_annexb(frame, payload_size, &h264_data.nal_index);
+        histogram_record(&raop_rtp_mirror->hist_rewrite, raop_ntp_get_local_time(raop_rtp_mirror->ntp) - rewrite_start);
+        perf_counters_mark(PERF_STAGE_VIDEO_REWRITE, 1);
+        if (rewritten < 0) {
+            logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror dropping malformed %d byte frame", payload_size);
+            if (h264_data.buffer_handle) {
+                raop_rtp_mirror->callbacks.video_release_buffer(raop_rtp_mirror->callbacks.cls, h264_data.buffer_handle);
+            }
+            buffer_pool_release(raop_rtp_mirror->payload_pool, payload);
+            return 0;
+        }
+        PROBE3(mirror_rewrite_done, ntp_timestamp, payload_size, h264_data.nal_index.count);
+
+        h264_data.codec = raop_rtp_mirror->codec;
+        h264_data.width = 0;
+        h264_data.height = 0;
+        h264_data.known_geometry = 0;
+        raop_rtp_mirror_classify_frame(&h264_data);
+
+        h264_data.data_len = payload_size;
+        h264_data.data = frame;
+        h264_data.frame_type = 1;
+        h264_data.pts = ntp_timestamp;
+        h264_data.pipelined = 0;
+        h264_data.rendered = 0;
+
+        // The render thread owns the frame buffer from now on. After decrypting into
+        // a renderer buffer the payload buffer is not needed anymore and goes back below.
+        if (frame == payload) {
+            payload = NULL;
+        }
+        if (raop_rtp_mirror_queue_frame(raop_rtp_mirror, &h264_data) < 0) {
+            buffer_pool_release(raop_rtp_mirror->payload_pool, payload);
+            return -1;
+        }
+
+    } else if ((payload_type & 255) == 1) {
+        // The information in the payload contains an SPS and a PPS NAL, and a VPS for H.265
+        raop_rtp_mirror_milestone(raop_rtp_mirror, RAOP_MILESTONE_PARAMETER_SETS);
+
+        int known = 0;
+        const raop_rtp_mirror_codec_t *codec = raop_rtp_mirror_parse_codec(raop_rtp_mirror, packet, payload,
+                                                                           payload_size, &known);
+        if (codec) {
+            raop_rtp_mirror_queue_codec(raop_rtp_mirror, codec, known);
+        }
+    }
+
+    buffer_pool_release(raop_rtp_mirror->payload_pool, payload);
+    return 0;
+}
+
+/*
+ * Moves the wakeup threshold of the stream socket to what the frame being assembled still
+ * misses, so a frame takes two wakeups, one for its header and one for its payload
+ */
+static void
+raop_rtp_mirror_set_lowat(int fd, int missing, int *lowat)
+{
+    if (missing > RAOP_RTP_MIRROR_MAX_LOWAT) {
+        missing = RAOP_RTP_MIRROR_MAX_LOWAT;
+    } else if (missing < 1) {
+        missing = 1;
+    }
+    if (missing != *lowat && setsockopt(fd, SOL_SOCKET, SO_RCVLOWAT, &missing, sizeof(missing)) == 0) {
+        *lowat = missing;
+    }
+}
+
+/*
+ * Sets up an accepted stream socket, the receive buffer size is inherited from the listening socket
+ */
+static void
+raop_rtp_mirror_tune_stream(raop_rtp_mirror_t *raop_rtp_mirror, int stream_fd)
+{
+    int option;
+
+    // Usually inherited from the listening socket, but not guaranteed on every platform
+    netutils_enable_timestamps(stream_fd);
+
+    option = 1;
+    if (setsockopt(stream_fd, SOL_SOCKET, SO_KEEPALIVE, &option, sizeof(option)) < 0) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set stream socket keepalive %d %s", errno, strerror(errno));
+    }
+    option = 60;
+    if (setsockopt(stream_fd, SOL_TCP, TCP_KEEPIDLE, &option, sizeof(option)) < 0) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set stream socket keepalive time %d %s", errno, strerror(errno));
+    }
+    option = 10;
+    if (setsockopt(stream_fd, SOL_TCP, TCP_KEEPINTVL, &option, sizeof(option)) < 0) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set stream socket keepalive interval %d %s", errno, strerror(errno));
+    }
+    option = 6;
+    if (setsockopt(stream_fd, SOL_TCP, TCP_KEEPCNT, &option, sizeof(option)) < 0) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set stream socket keepalive probes %d %s", errno, strerror(errno));
+    }
+#ifdef TCP_QUICKACK
+    // Acks right away, so the sender's congestion window opens up without waiting for delayed acks
+    option = 1;
+    if (setsockopt(stream_fd, SOL_TCP, TCP_QUICKACK, &option, sizeof(option)) < 0) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set stream socket quick ack %d %s", errno, strerror(errno));
+    }
+#endif
+    if (netutils_apply_qos(stream_fd, NETUTILS_QOS_MIRROR) < 0) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not mark the stream socket for QoS %d %s", errno, strerror(errno));
+    }
+#ifdef SO_BUSY_POLL
+    if (raop_rtp_mirror->busy_poll > 0) {
+        option = raop_rtp_mirror->busy_poll;
+        if (setsockopt(stream_fd, SOL_SOCKET, SO_BUSY_POLL, &option, sizeof(option)) < 0) {
+            logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set stream socket busy poll %d %s", errno, strerror(errno));
+        }
+    }
+#endif
+}
+
 static THREAD_RETVAL
 raop_rtp_mirror_thread(void *arg)
 {
@@ -153,53 +1354,39 @@ raop_rtp_mirror_thread(void *arg)
     assert(raop_rtp_mirror);
 
     int stream_fd = -1;
+    int stream_lowat = 1;
     unsigned char packet[128];
     memset(packet, 0 , 128);
     unsigned char* payload = NULL;
-    unsigned int readstart = 0;
-
-#ifdef DUMP_H264
-    // C decrypted
-    FILE* file = fopen("/home/pi/Airplay.h264", "wb");
-    // Encrypted source file
-    FILE* file_source = fopen("/home/pi/Airplay.source", "wb");
-    FILE* file_len = fopen("/home/pi/Airplay.len", "wb");
-#endif
-
-    while (1) {
-        fd_set rfds;
-        struct timeval tv;
-        int nfds, ret;
-        MUTEX_LOCK(raop_rtp_mirror->run_mutex);
-        if (!raop_rtp_mirror->running) {
-            MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
+    int payload_size = 0;
+    int readstart = 0;
+    uint64_t arrival_time = 0;
+    int fatal = 0;
+    // Video payloads are decrypted span by span as they arrive, unless a trace wants them encrypted
+    raop_rtp_mirror_decrypt_t decrypt;
+    memset(&decrypt, 0, sizeof(decrypt));
+
+    int ready[1];
+    int nready;
+
+    perf_counters_begin();
+    while (!fatal) {
+        int ret;
+        if (!ATOMIC_LOAD(raop_rtp_mirror->running)) {
             break;
         }
-        MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
-
-        /* Set timeout value to 5ms */
-        tv.tv_sec = 0;
-        tv.tv_usec = 5000;
 
-        /* Get the correct nfds value and set rfds */
-        FD_ZERO(&rfds);
-        if (stream_fd == -1) {
-            FD_SET(raop_rtp_mirror->mirror_data_sock, &rfds);
-            nfds = raop_rtp_mirror->mirror_data_sock+1;
-        } else {
-            FD_SET(stream_fd, &rfds);
-            nfds = stream_fd+1;
-        }
-        ret = select(nfds, &rfds, NULL, NULL, &tv);
-        if (ret == 0) {
-            /* Timeout happened */
+        /* Only the listening socket or the accepted stream is watched at a time */
+        nready = reactor_wait(raop_rtp_mirror->reactor, ready, 1, -1);
+        if (nready == 0) {
+            /* Woken up, recheck the running state */
             continue;
-        } else if (ret == -1) {
-            logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror error in select");
+        } else if (nready == -1) {
+            logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror error in reactor wait");
             break;
         }
 
-        if (stream_fd == -1 && FD_ISSET(raop_rtp_mirror->mirror_data_sock, &rfds)) {
+        if (stream_fd == -1 && reactor_is_ready(ready, nready, raop_rtp_mirror->mirror_data_sock)) {
             struct sockaddr_storage saddr;
             socklen_t saddrlen;
 
@@ -210,222 +1397,242 @@ raop_rtp_mirror_thread(void *arg)
                 logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror error in accept %d %s", errno, strerror(errno));
                 break;
             }
-
-            // We're calling recv for a certain amount of data, so we need a timeout
-            struct timeval tv;
-            tv.tv_sec = 0;
-            tv.tv_usec = 5000;
-            if (setsockopt(stream_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
-                logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror could not set stream socket timeout %d %s", errno, strerror(errno));
+            raop_rtp_mirror_milestone(raop_rtp_mirror, RAOP_MILESTONE_MIRROR_ACCEPT);
+            metrics_add(METRIC_MIRROR_SESSIONS, 1);
+            reactor_remove(raop_rtp_mirror->reactor, raop_rtp_mirror->mirror_data_sock);
+            if (reactor_add(raop_rtp_mirror->reactor, stream_fd) < 0) {
+                closesocket(stream_fd);
+                stream_fd = -1;
                 break;
             }
-            int option;
-            option = 1;
-            if (setsockopt(stream_fd, SOL_SOCKET, SO_KEEPALIVE, &option, sizeof(option)) < 0) {
-                logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set stream socket keepalive %d %s", errno, strerror(errno));
-            }
-            option = 60;
-            if (setsockopt(stream_fd, SOL_TCP, TCP_KEEPIDLE, &option, sizeof(option)) < 0) {
-                logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set stream socket keepalive time %d %s", errno, strerror(errno));
-            }
-            option = 10;
-            if (setsockopt(stream_fd, SOL_TCP, TCP_KEEPINTVL, &option, sizeof(option)) < 0) {
-                logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set stream socket keepalive interval %d %s", errno, strerror(errno));
-            }
-            option = 6;
-            if (setsockopt(stream_fd, SOL_TCP, TCP_KEEPCNT, &option, sizeof(option)) < 0) {
-                logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set stream socket keepalive probes %d %s", errno, strerror(errno));
+
+            // Frames are assembled from whatever each wakeup brings, reads must never block
+            int flags = fcntl(stream_fd, F_GETFL, 0);
+            if (flags == -1 || fcntl(stream_fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+                logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror could not make the stream socket non-blocking %d %s", errno, strerror(errno));
+                break;
             }
+            raop_rtp_mirror_tune_stream(raop_rtp_mirror, stream_fd);
+            stream_lowat = 1;
+            raop_rtp_mirror_set_lowat(stream_fd, 128, &stream_lowat);
             readstart = 0;
         }
 
-        if (stream_fd != -1 && FD_ISSET(stream_fd, &rfds)) {
+        if (stream_fd != -1 && reactor_is_ready(ready, nready, stream_fd)) {
+            // Takes in everything the socket holds, frame by frame, until it would block
+            while (1) {
+                if (payload == NULL) {
+                    // The first 128 bytes are some kind of header for the payload that follows
+                    uint64_t receive_time = 0;
+                    ret = netutils_recv_timestamped(stream_fd, packet + readstart, 128 - readstart, NULL, NULL, &receive_time);
+                    if (ret > 0 && readstart == 0) {
+                        // Arrival of the first header byte is the arrival of the frame
+                        arrival_time = receive_time ? receive_time : raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+                    }
+                } else {
+                    ret = recv(stream_fd, payload + readstart, payload_size - readstart, 0);
+                }
+                if (ret == 0) {
+                    logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror tcp socket closed");
+                    reactor_remove(raop_rtp_mirror->reactor, stream_fd);
+                    closesocket(stream_fd);
+                    stream_fd = -1;
+                    raop_rtp_mirror_abort_frame(raop_rtp_mirror, &decrypt, payload);
+                    payload = NULL;
+                    readstart = 0;
+                    /* Go back to waiting for a new connection */
+                    reactor_add(raop_rtp_mirror->reactor, raop_rtp_mirror->mirror_data_sock);
+                    break;
+                } else if (ret == -1) {
+                    if (errno == EINTR) continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror error in recv: %d", errno);
+                        fatal = 1;
+                    }
+                    break;
+                }
 
-            // The first 128 bytes are some kind of header for the payload that follows
-            while (payload == NULL && readstart < 128) {
-                ret = recv(stream_fd, packet + readstart, 128 - readstart, 0);
-                if (ret <= 0) break;
-                readstart = readstart + ret;
+                readstart += ret;
+                if (payload == NULL) {
+                    if (readstart < 128) continue;
+                    payload_size = byteutils_get_int(packet, 0);
+                    payload = buffer_pool_acquire(raop_rtp_mirror->payload_pool, payload_size);
+                    if (payload == NULL) {
+                        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror could not get a %d byte payload buffer", payload_size);
+                        fatal = 1;
+                        break;
+                    }
+                    readstart = 0;
+                    if (raop_rtp_mirror_note_payload(raop_rtp_mirror, byteutils_get_short(packet, 4) & 0xff, arrival_time) < 0) {
+                        buffer_pool_release(raop_rtp_mirror->payload_pool, payload);
+                        payload = NULL;
+                        fatal = 1;
+                        break;
+                    }
+                    if ((byteutils_get_short(packet, 4) & 0xff) == 0 && !trace_enabled()) {
+                        int pipelined = raop_rtp_mirror_pipeline_frame(raop_rtp_mirror, packet, payload, payload_size);
+                        if (pipelined < 0) {
+                            payload = NULL;
+                            fatal = 1;
+                            break;
+                        }
+                        raop_rtp_mirror_begin_decrypt(raop_rtp_mirror, payload, payload_size, &decrypt, pipelined);
+                    }
+                }
+                if (readstart < payload_size) {
+                    if (decrypt.frame) {
+                        raop_rtp_mirror_decrypt_span(raop_rtp_mirror, payload, readstart, &decrypt);
+                    }
+                    continue;
+                }
+
+                perf_counters_mark(PERF_STAGE_VIDEO_RECEIVE, 1);
+                ret = raop_rtp_mirror_process_frame(raop_rtp_mirror, packet, payload, payload_size, arrival_time, &decrypt);
+                payload = NULL;
+                readstart = 0;
+                if (ret < 0) {
+                    fatal = 1;
+                    break;
+                }
             }
 
-            if (payload == NULL && ret == 0) {
-                logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror tcp socket closed");
-                FD_CLR(stream_fd, &rfds);
-                stream_fd = -1;
-                continue;
-            } else if (payload == NULL && ret == -1) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) continue; // Timeouts can happen even if the connection is fine
-                logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror error in header recv: %d", errno);
-                break;
+            if (stream_fd != -1 && !fatal) {
+                raop_rtp_mirror_set_lowat(stream_fd, payload ? payload_size - readstart : 128 - readstart, &stream_lowat);
+#ifdef TCP_QUICKACK
+                // Quick ack mode ends whenever the kernel decides the connection is interactive, keep it on
+                int option = 1;
+                setsockopt(stream_fd, SOL_TCP, TCP_QUICKACK, &option, sizeof(option));
+#endif
             }
+        }
+    }
 
-            int payload_size = byteutils_get_int(packet, 0);
-            unsigned short payload_type = byteutils_get_short(packet, 4) & 0xff;
-            unsigned short payload_option = byteutils_get_short(packet, 6);
+    raop_rtp_mirror_abort_frame(raop_rtp_mirror, &decrypt, payload);
 
-            if (payload == NULL) {
-                payload = malloc(payload_size);
-                readstart = 0;
-            }
+    /* Close the stream file descriptor */
+    if (stream_fd != -1) {
+        reactor_remove(raop_rtp_mirror->reactor, stream_fd);
+        closesocket(stream_fd);
+    }
 
-            while (readstart < payload_size) {
-                // Payload data
-                ret = recv(stream_fd, payload + readstart, payload_size - readstart, 0);
-                if (ret <= 0) break;
-                readstart = readstart + ret;
-            }
+    // Ensure running reflects the actual state
+    MUTEX_LOCK(raop_rtp_mirror->run_mutex);
+    ATOMIC_STORE(raop_rtp_mirror->running, 0);
+    MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
 
-            if (ret == 0) {
-                logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror tcp socket closed");
-                break;
-            } else if (ret == -1) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) continue; // Timeouts can happen even if the connection is fine
-                logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror error in recv: %d", errno);
-                break;
-            }
+    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror exiting TCP thread");
 
-            if (payload_type == 0) {
-                // Normal video data (VCL NAL)
-
-                // Conveniently, the video data is already stamped with the remote wall clock time,
-                // so no additional clock syncing needed. The only thing odd here is that the video
-                // ntp time stamps don't include the SECONDS_FROM_1900_TO_1970, so it's really just
-                // counting micro seconds since last boot.
-                uint64_t ntp_timestamp_raw = byteutils_get_long(packet, 8);
-                uint64_t ntp_timestamp_remote = raop_ntp_timestamp_to_micro_seconds(ntp_timestamp_raw, false);
-                uint64_t ntp_timestamp = raop_ntp_convert_remote_time(raop_rtp_mirror->ntp, ntp_timestamp_remote);
-
-                uint64_t ntp_now = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
-                logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror video ntp = %llu, now = %llu, latency = %lld",
-                           ntp_timestamp, ntp_now, ((int64_t) ntp_now) - ((int64_t) ntp_timestamp));
-
-#ifdef DUMP_H264
-                fwrite(payload, payload_size, 1, file_source);
-                fwrite(&readstart, sizeof(readstart), 1, file_len);
-#endif
+    return 0;
+}
 
-                // Decrypt data
-                unsigned char* payload_decrypted = malloc(payload_size);
-                mirror_buffer_decrypt(raop_rtp_mirror->buffer, payload, payload_decrypted, payload_size);
-
-                int nalu_type = payload[4] & 0x1f;
-                int nalu_size = 0;
-                int nalus_count = 0;
-
-                // It seems the AirPlay protocol prepends NALs with their size, which we're replacing with the 4-byte
-                // start code for the NAL Byte-Stream Format.
-                while (nalu_size < payload_size) {
-                    int nc_len = (payload_decrypted[nalu_size + 0] << 24) | (payload_decrypted[nalu_size + 1] << 16) |
-                                 (payload_decrypted[nalu_size + 2] << 8) | (payload_decrypted[nalu_size + 3]);
-                    assert(nc_len > 0);
-
-                    payload_decrypted[nalu_size + 0] = 0;
-                    payload_decrypted[nalu_size + 1] = 0;
-                    payload_decrypted[nalu_size + 2] = 0;
-                    payload_decrypted[nalu_size + 3] = 1;
-                    nalu_size += nc_len + 4;
-                    nalus_count++;
-                }
+/**
+ * Mirror over UDP, see mirror_buffer.h for the framing. A lost datagram costs the frame it
+ * belongs to instead of stalling the stream until TCP has resent it.
+ */
+static THREAD_RETVAL
+raop_rtp_mirror_udp_thread(void *arg)
+{
+    raop_rtp_mirror_t *raop_rtp_mirror = arg;
+    assert(raop_rtp_mirror);
 
-                // logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "nalutype = %d", nalu_type);
-                // logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "nalu_size = %d, payloadsize = %d nalus_count = %d",
-                //        nalu_size, payload_size, nalus_count);
+    unsigned char datagram[RAOP_RTP_MIRROR_MAX_DATAGRAM];
+    mirror_buffer_frame_t frame;
+    int stream_started = 0;
 
-#ifdef DUMP_H264
-                fwrite(payload_decrypted, payload_size, 1, file);
-#endif
+    int ready[1];
+    int nready;
 
-                h264_decode_struct h264_data;
-                h264_data.data_len = payload_size;
-                h264_data.data = payload_decrypted;
-                h264_data.frame_type = 1;
-                h264_data.pts = ntp_timestamp;
-
-                raop_rtp_mirror->callbacks.video_process(raop_rtp_mirror->callbacks.cls, raop_rtp_mirror->ntp, &h264_data);
-                free(payload_decrypted);
-
-            } else if ((payload_type & 255) == 1) {
-                // The information in the payload contains an SPS and a PPS NAL
-
-                float width_source = byteutils_get_float(packet, 40);
-                float height_source = byteutils_get_float(packet, 44);
-                float width = byteutils_get_float(packet, 56);
-                float height = byteutils_get_float(packet, 60);
-                logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror width_source = %f height_source = %f width = %f height = %f",
-                           width_source, height_source, width, height);
-
-                // The sps_pps is not encrypted
-                h264codec_t h264;
-                h264.version = payload[0];
-                h264.profile_high = payload[1];
-                h264.compatibility = payload[2];
-                h264.level = payload[3];
-                h264.reserved_6_and_nal = payload[4];
-                h264.reserved_3_and_sps = payload[5];
-                h264.sps_size = (short) (((payload[6] & 255) << 8) + (payload[7] & 255));
-                logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror sps size = %d", h264.sps_size);
-                h264.sequence_parameter_set = malloc(h264.sps_size);
-                memcpy(h264.sequence_parameter_set, payload + 8, h264.sps_size);
-                h264.number_of_pps = payload[h264.sps_size + 8];
-                h264.pps_size = (short) (((payload[h264.sps_size + 9] & 2040) + payload[h264.sps_size + 10]) & 255);
-                h264.picture_parameter_set = malloc(h264.pps_size);
-                logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror pps size = %d", h264.pps_size);
-                memcpy(h264.picture_parameter_set, payload + h264.sps_size + 11, h264.pps_size);
-
-                if (h264.sps_size + h264.pps_size < 102400) {
-                    // Copy the sps and pps into a buffer to hand to the decoder
-                    int sps_pps_len = (h264.sps_size + h264.pps_size) + 8;
-                    unsigned char sps_pps[sps_pps_len];
-                    sps_pps[0] = 0;
-                    sps_pps[1] = 0;
-                    sps_pps[2] = 0;
-                    sps_pps[3] = 1;
-                    memcpy(sps_pps + 4, h264.sequence_parameter_set, h264.sps_size);
-                    sps_pps[h264.sps_size + 4] = 0;
-                    sps_pps[h264.sps_size + 5] = 0;
-                    sps_pps[h264.sps_size + 6] = 0;
-                    sps_pps[h264.sps_size + 7] = 1;
-                    memcpy(sps_pps + h264.sps_size + 8, h264.picture_parameter_set, h264.pps_size);
-
-#ifdef DUMP_H264
-                    fwrite(sps_pps, sps_pps_len, 1, file);
-#endif
+    perf_counters_begin();
+    while (1) {
+        if (!ATOMIC_LOAD(raop_rtp_mirror->running)) {
+            break;
+        }
+
+        // Datagrams held back behind a gap are only given up on after a while, so keep polling until it closes
+        nready = reactor_wait(raop_rtp_mirror->reactor, ready, 1,
+                              mirror_buffer_has_gap(raop_rtp_mirror->buffer) ? RAOP_RTP_MIRROR_GAP_POLL_MS : -1);
+        if (nready == -1) {
+            logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror error in reactor wait");
+            break;
+        }
 
-                    h264_decode_struct h264_data;
-                    h264_data.data_len = sps_pps_len;
-                    h264_data.data = sps_pps;
-                    h264_data.frame_type = 0;
-                    h264_data.pts = 0;
-                    raop_rtp_mirror->callbacks.video_process(raop_rtp_mirror->callbacks.cls, raop_rtp_mirror->ntp, &h264_data);
+        if (nready > 0 && reactor_is_ready(ready, nready, raop_rtp_mirror->mirror_data_sock)) {
+            while (1) {
+                uint64_t arrival_time = 0;
+                int ret = netutils_recv_timestamped(raop_rtp_mirror->mirror_data_sock, datagram, sizeof(datagram),
+                                                    NULL, NULL, &arrival_time);
+                if (ret < 0) {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror error in recv: %d", errno);
+                    }
+                    break;
+                }
+                if (!stream_started) {
+                    stream_started = 1;
+                    raop_rtp_mirror_milestone(raop_rtp_mirror, RAOP_MILESTONE_MIRROR_ACCEPT);
+                    metrics_add(METRIC_MIRROR_SESSIONS, 1);
+                }
+                if (!arrival_time) {
+                    arrival_time = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+                }
+                if (mirror_buffer_queue(raop_rtp_mirror->buffer, datagram, ret, arrival_time) < 0) {
+                    LOGGER_DEBUG_HOT(raop_rtp_mirror->logger, "raop_rtp_mirror ignoring late or malformed %d byte datagram", ret);
                 }
-                free(h264.picture_parameter_set);
-                free(h264.sequence_parameter_set);
             }
-
-            free(payload);
-            payload = NULL;
-            memset(packet, 0, 128);
-            readstart = 0;
         }
-    }
 
-    /* Close the stream file descriptor */
-    if (stream_fd != -1) {
-        closesocket(stream_fd);
+        uint64_t now = raop_ntp_get_local_time(raop_rtp_mirror->ntp);
+        int stopped = 0;
+        while (!stopped && mirror_buffer_next_frame(raop_rtp_mirror->buffer, now, &frame) == 1) {
+            unsigned short payload_type = byteutils_get_short(frame.header, 4) & 0xff;
+            unsigned char *payload = buffer_pool_acquire(raop_rtp_mirror->payload_pool, frame.payload_size);
+            mirror_buffer_take_frame(raop_rtp_mirror->buffer, payload);
+            if (payload == NULL) {
+                logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not get a %d byte payload buffer, dropping the frame",
+                           frame.payload_size);
+                continue;
+            }
+            if (raop_rtp_mirror_note_payload(raop_rtp_mirror, payload_type, frame.arrival_time) < 0) {
+                buffer_pool_release(raop_rtp_mirror->payload_pool, payload);
+                stopped = 1;
+                break;
+            }
+            // Only video payloads are encrypted, the keystream skips over what was lost before them
+            if (payload_type == 0) {
+                int skipped = mirror_buffer_seek_keystream(raop_rtp_mirror->buffer, frame.keystream_offset);
+                if (skipped < 0) {
+                    logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror frame at keystream offset %u arrived too late",
+                               frame.keystream_offset);
+                    buffer_pool_release(raop_rtp_mirror->payload_pool, payload);
+                    continue;
+                } else if (skipped > 0) {
+                    LOGGER_DEBUG_HOT(raop_rtp_mirror->logger, "raop_rtp_mirror skipped %d bytes of keystream", skipped);
+                }
+            }
+            // Complete when handed out, the whole payload is decrypted at once
+            raop_rtp_mirror_decrypt_t decrypt;
+            memset(&decrypt, 0, sizeof(decrypt));
+            perf_counters_mark(PERF_STAGE_VIDEO_RECEIVE, 1);
+            stopped = raop_rtp_mirror_process_frame(raop_rtp_mirror, frame.header, payload, frame.payload_size,
+                                                    frame.arrival_time, &decrypt) < 0;
+        }
+        int lost = mirror_buffer_take_lost_frames(raop_rtp_mirror->buffer);
+        if (lost > 0) {
+            metrics_add(METRIC_VIDEO_FRAMES_LOST, lost);
+            atomic_fetch_add_explicit(&raop_rtp_mirror->stats_lost, lost, memory_order_relaxed);
+            logger_log(raop_rtp_mirror->logger, LOGGER_INFO, "raop_rtp_mirror lost %d frames to missing datagrams", lost);
+        }
+        if (stopped) {
+            break;
+        }
     }
 
-#ifdef DUMP_H264
-        fclose(file);
-    fclose(file_source);
-    fclose(file_len);
-#endif
-
     // Ensure running reflects the actual state
     MUTEX_LOCK(raop_rtp_mirror->run_mutex);
-    raop_rtp_mirror->running = false;
+    ATOMIC_STORE(raop_rtp_mirror->running, 0);
     MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
 
-    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror exiting TCP thread");
+    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror exiting UDP thread");
 
     return 0;
 }
@@ -439,27 +1646,42 @@ raop_rtp_start_mirror(raop_rtp_mirror_t *raop_rtp_mirror, int use_udp, unsigned
     assert(raop_rtp_mirror);
 
     MUTEX_LOCK(raop_rtp_mirror->run_mutex);
-    if (raop_rtp_mirror->running || !raop_rtp_mirror->joined) {
+    if (ATOMIC_LOAD(raop_rtp_mirror->running) || !raop_rtp_mirror->joined) {
         MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
         return;
     }
 
+    /* Listen on the family the sender connected over */
     if (raop_rtp_mirror->remote_saddr.ss_family == AF_INET6) {
         use_ipv6 = 1;
     }
-    use_ipv6 = 0;
-    if (raop_rtp_init_mirror_sockets(raop_rtp_mirror, use_ipv6) < 0) {
+    if (raop_rtp_init_mirror_sockets(raop_rtp_mirror, use_ipv6, use_udp) < 0) {
         logger_log(raop_rtp_mirror->logger, LOGGER_ERR, "raop_rtp_mirror initializing sockets failed");
         MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
         return;
     }
     if (mirror_data_lport) *mirror_data_lport = raop_rtp_mirror->mirror_data_lport;
+    raop_rtp_mirror->use_udp = use_udp;
+    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror receiving over %s", use_udp ? "UDP" : "TCP");
 
-    /* Create the thread and initialize running values */
-    raop_rtp_mirror->running = 1;
+    /* Create the threads and initialize running values */
+    ATOMIC_STORE(raop_rtp_mirror->running, 1);
     raop_rtp_mirror->joined = 0;
 
-    THREAD_CREATE(raop_rtp_mirror->thread_mirror, raop_rtp_mirror_thread, raop_rtp_mirror);
+    frame_queue_start(raop_rtp_mirror->frame_queue);
+    raop_rtp_mirror->waiting_for_idr = 0;
+    raop_rtp_mirror->dropped_non_reference = 0;
+    raop_rtp_mirror->dropped_to_idr = 0;
+    THREAD_CREATE(raop_rtp_mirror->thread_render, raop_rtp_mirror_render_thread, raop_rtp_mirror);
+    if (use_udp) {
+        THREAD_CREATE(raop_rtp_mirror->thread_mirror, raop_rtp_mirror_udp_thread, raop_rtp_mirror);
+    } else {
+        THREAD_CREATE(raop_rtp_mirror->thread_mirror, raop_rtp_mirror_thread, raop_rtp_mirror);
+    }
+    if ((raop_rtp_mirror->thread_render && thread_apply_role(raop_rtp_mirror->thread_render, THREAD_ROLE_RENDER) < 0) ||
+        (raop_rtp_mirror->thread_mirror && thread_apply_role(raop_rtp_mirror->thread_mirror, THREAD_ROLE_MIRROR) < 0)) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "Could not apply the scheduling settings of the mirror threads");
+    }
     MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
 }
 
@@ -469,21 +1691,37 @@ void raop_rtp_mirror_stop(raop_rtp_mirror_t *raop_rtp_mirror) {
     /* Check that we are running and thread is not
      * joined (should never be while still running) */
     MUTEX_LOCK(raop_rtp_mirror->run_mutex);
-    if (!raop_rtp_mirror->running || raop_rtp_mirror->joined) {
+    if (!ATOMIC_LOAD(raop_rtp_mirror->running) || raop_rtp_mirror->joined) {
         MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
         return;
     }
-    raop_rtp_mirror->running = 0;
+    ATOMIC_STORE(raop_rtp_mirror->running, 0);
     MUTEX_UNLOCK(raop_rtp_mirror->run_mutex);
 
+    /* Join the threads, stopping the queue unblocks both of them */
+    frame_queue_stop(raop_rtp_mirror->frame_queue);
+    reactor_wakeup(raop_rtp_mirror->reactor);
+    THREAD_JOIN(raop_rtp_mirror->thread_mirror);
+    THREAD_JOIN(raop_rtp_mirror->thread_render);
+
+    /* Drop frames that never made it to the renderer */
+    h264_decode_struct h264_data;
+    int dropped = 0;
+    while (frame_queue_try_pop(raop_rtp_mirror->frame_queue, &h264_data) == 0) {
+        raop_rtp_mirror_release_frame(raop_rtp_mirror, &h264_data);
+        dropped++;
+    }
+    raop_rtp_mirror->pipeline_busy = 0;
+    logger_log(raop_rtp_mirror->logger, LOGGER_DEBUG, "raop_rtp_mirror render queue peaked at %d/%d frames, %d dropped on stop",
+               frame_queue_get_high_watermark(raop_rtp_mirror->frame_queue),
+               frame_queue_get_depth(raop_rtp_mirror->frame_queue), dropped);
+
     if (raop_rtp_mirror->mirror_data_sock != -1) {
+        reactor_remove(raop_rtp_mirror->reactor, raop_rtp_mirror->mirror_data_sock);
         closesocket(raop_rtp_mirror->mirror_data_sock);
         raop_rtp_mirror->mirror_data_sock = -1;
     }
 
-    /* Join the thread */
-    THREAD_JOIN(raop_rtp_mirror->thread_mirror);
-
     /* Mark thread as joined */
     MUTEX_LOCK(raop_rtp_mirror->run_mutex);
     raop_rtp_mirror->joined = 1;
@@ -494,26 +1732,57 @@ void raop_rtp_mirror_destroy(raop_rtp_mirror_t *raop_rtp_mirror) {
     if (raop_rtp_mirror) {
         raop_rtp_mirror_stop(raop_rtp_mirror);
         MUTEX_DESTROY(raop_rtp_mirror->run_mutex);
+        MUTEX_DESTROY(raop_rtp_mirror->pipeline_mutex);
+        COND_DESTROY(raop_rtp_mirror->pipeline_cond);
         mirror_buffer_destroy(raop_rtp_mirror->buffer);
+        frame_queue_destroy(raop_rtp_mirror->frame_queue);
+        video_frame_pool_destroy(raop_rtp_mirror->frame_pool);
+        buffer_pool_destroy(raop_rtp_mirror->payload_pool);
+        reactor_destroy(raop_rtp_mirror->reactor);
         free(raop_rtp_mirror);
     }
 }
 
 static int
-raop_rtp_init_mirror_sockets(raop_rtp_mirror_t *raop_rtp_mirror, int use_ipv6)
+raop_rtp_init_mirror_sockets(raop_rtp_mirror_t *raop_rtp_mirror, int use_ipv6, int use_udp)
 {
     int dsock = -1;
     unsigned short dport = 0;
 
     assert(raop_rtp_mirror);
 
-    dsock = netutils_init_socket(&dport, use_ipv6, 0);
+    dsock = netutils_init_socket(&dport, use_ipv6, use_udp);
     if (dsock == -1) {
         goto sockets_cleanup;
     }
 
-    /* Listen to the data socket if using TCP */
-    if (listen(dsock, 1) < 0) {
+    /* Set before listen, so the window scale offered to the sender covers it */
+    if (raop_rtp_mirror->receive_buffer > 0 &&
+        setsockopt(dsock, SOL_SOCKET, SO_RCVBUF, &raop_rtp_mirror->receive_buffer, sizeof(raop_rtp_mirror->receive_buffer)) < 0) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set a %d byte receive buffer %d %s",
+                   raop_rtp_mirror->receive_buffer, errno, strerror(errno));
+    }
+    if (netutils_apply_qos(dsock, NETUTILS_QOS_MIRROR) < 0) {
+        logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not mark the data socket for QoS %d %s", errno, strerror(errno));
+    }
+
+    if (use_udp) {
+        /* Drained until empty on every wakeup */
+        int flags = fcntl(dsock, F_GETFL, 0);
+        if (flags == -1 || fcntl(dsock, F_SETFL, flags | O_NONBLOCK) == -1) {
+            goto sockets_cleanup;
+        }
+#ifdef SO_BUSY_POLL
+        if (raop_rtp_mirror->busy_poll > 0 &&
+            setsockopt(dsock, SOL_SOCKET, SO_BUSY_POLL, &raop_rtp_mirror->busy_poll, sizeof(raop_rtp_mirror->busy_poll)) < 0) {
+            logger_log(raop_rtp_mirror->logger, LOGGER_WARNING, "raop_rtp_mirror could not set socket busy poll %d %s", errno, strerror(errno));
+        }
+#endif
+    } else if (listen(dsock, 1) < 0) {
+        /* Listen to the data socket if using TCP */
+        goto sockets_cleanup;
+    }
+    if (reactor_add(raop_rtp_mirror->reactor, dsock) < 0) {
         goto sockets_cleanup;
     }
 
@@ -20,16 +20,47 @@
 #include "logger.h"
 #include "raop_ntp.h"
 
+/* Decrypted frames that may wait for the renderer before receiving stalls */
+#define RAOP_RTP_MIRROR_QUEUE_DEFAULT_DEPTH 4
+#define RAOP_RTP_MIRROR_QUEUE_MAX_DEPTH 32
+/* Longest wait in micro seconds for an IDR after a late reference frame was dropped */
+#define RAOP_RTP_MIRROR_MAX_IDR_WAIT 1000000
+
 typedef struct raop_rtp_mirror_s raop_rtp_mirror_t;
 typedef struct h264codec_s h264codec_t;
 
+/* What the receiving end of a mirror went through so far, see raop_rtp_mirror_get_stats */
+typedef struct raop_rtp_mirror_stats_s {
+    int queued_frames; // Frames waiting for the renderer
+    int queue_depth;
+    unsigned int dropped_frames; // Late frames, or frames a busy renderer could not take
+    unsigned int lost_frames; // Frames of the UDP transport given up on for missing datagrams
+    int jitter_us; // Interarrival jitter of the frames, RFC 3550 style
+    unsigned int received_packets; // Frames, parameter sets and heartbeats, wraps around
+    unsigned int pixel_rate; // Pixels per second the stream asks the decoder for, 0 until measured
+} raop_rtp_mirror_stats_t;
+
 raop_rtp_mirror_t *raop_rtp_mirror_init(logger_t *logger, raop_callbacks_t *callbacks, raop_ntp_t *ntp,
                                         const unsigned char *remote, int remotelen,
-                                        const unsigned char *aeskey, const unsigned char *ecdh_secret);
+                                        const unsigned char *aeskey, const unsigned char *ecdh_secret,
+                                        int queue_depth, int latency_budget_ms);
+/* SO_RCVBUF in bytes and SO_BUSY_POLL in micro seconds of the data socket, 0 keeps the system default. Call before starting. */
+void raop_rtp_mirror_set_socket_options(raop_rtp_mirror_t *raop_rtp_mirror, int receive_buffer, int busy_poll_us);
+/* Holds frames back for smooth pacing, at most max_delay_ms longer than the network needs, see playout.h.
+ * 0 renders frames as soon as they arrive. Call before starting. */
+void raop_rtp_mirror_set_playout(raop_rtp_mirror_t *raop_rtp_mirror, int max_delay_ms);
+/* Releases frames on the schedule of a video wall, see genlock.h, needs a playout delay. Call before starting. */
+void raop_rtp_mirror_set_genlock(raop_rtp_mirror_t *raop_rtp_mirror, genlock_t *genlock);
 void raop_rtp_init_mirror_aes(raop_rtp_mirror_t *raop_rtp_mirror, uint64_t streamConnectionID);
 void raop_rtp_start_mirror(raop_rtp_mirror_t *raop_rtp_mirror, int use_udp, unsigned short *mirror_data_lport);
 
-static int raop_rtp_init_mirror_sockets(raop_rtp_mirror_t *raop_rtp_mirror, int use_ipv6);
+/* Safe to call from any thread while the mirror runs */
+void raop_rtp_mirror_get_stats(raop_rtp_mirror_t *raop_rtp_mirror, raop_rtp_mirror_stats_t *stats);
+
+/* Makes every running session dump its stage latencies at info level, safe to call from a signal handler */
+void raop_rtp_mirror_request_stats(void);
+/* While set, every running session drops late and non-reference frames sooner, for a throttled device */
+void raop_rtp_mirror_set_pressure(int pressure);
 
 void raop_rtp_mirror_stop(raop_rtp_mirror_t *raop_rtp_mirror);
 void raop_rtp_mirror_destroy(raop_rtp_mirror_t *raop_rtp_mirror);
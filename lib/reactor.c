@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "reactor.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "compat.h"
+
+#if defined(__linux__)
+#define REACTOR_USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#else
+#include <sys/select.h>
+#endif
+
+/* Upper bound of fds a single reactor watches, I/O threads only ever use a handful */
+#define REACTOR_MAX_FDS 64
+
+struct reactor_s {
+    logger_t *logger;
+
+#ifdef REACTOR_USE_EPOLL
+    int epoll_fd;
+    int event_fd;
+#else
+    int pipe_fds[2];
+    int fds[REACTOR_MAX_FDS];
+    int fd_count;
+#endif
+};
+
+reactor_t *
+reactor_init(logger_t *logger)
+{
+    reactor_t *reactor;
+
+    reactor = calloc(1, sizeof(reactor_t));
+    if (!reactor) {
+        return NULL;
+    }
+    reactor->logger = logger;
+
+#ifdef REACTOR_USE_EPOLL
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd == -1) {
+        logger_log(logger, LOGGER_ERR, "reactor could not create epoll instance %d %s", errno, strerror(errno));
+        free(reactor);
+        return NULL;
+    }
+    reactor->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (reactor->event_fd == -1) {
+        logger_log(logger, LOGGER_ERR, "reactor could not create eventfd %d %s", errno, strerror(errno));
+        close(reactor->epoll_fd);
+        free(reactor);
+        return NULL;
+    }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = reactor->event_fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->event_fd, &event) == -1) {
+        logger_log(logger, LOGGER_ERR, "reactor could not watch eventfd %d %s", errno, strerror(errno));
+        close(reactor->event_fd);
+        close(reactor->epoll_fd);
+        free(reactor);
+        return NULL;
+    }
+#else
+    if (pipe(reactor->pipe_fds) == -1) {
+        logger_log(logger, LOGGER_ERR, "reactor could not create wakeup pipe %d %s", errno, strerror(errno));
+        free(reactor);
+        return NULL;
+    }
+    fcntl(reactor->pipe_fds[0], F_SETFL, fcntl(reactor->pipe_fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(reactor->pipe_fds[1], F_SETFL, fcntl(reactor->pipe_fds[1], F_GETFL) | O_NONBLOCK);
+    reactor->fd_count = 0;
+#endif
+    return reactor;
+}
+
+void
+reactor_destroy(reactor_t *reactor)
+{
+    if (reactor) {
+#ifdef REACTOR_USE_EPOLL
+        close(reactor->event_fd);
+        close(reactor->epoll_fd);
+#else
+        close(reactor->pipe_fds[0]);
+        close(reactor->pipe_fds[1]);
+#endif
+        free(reactor);
+    }
+}
+
+int
+reactor_add(reactor_t *reactor, int fd)
+{
+    assert(reactor);
+    assert(fd >= 0);
+
+#ifdef REACTOR_USE_EPOLL
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        logger_log(reactor->logger, LOGGER_ERR, "reactor could not watch fd %d: %d %s", fd, errno, strerror(errno));
+        return -1;
+    }
+#else
+    if (reactor->fd_count == REACTOR_MAX_FDS || fd >= FD_SETSIZE) {
+        logger_log(reactor->logger, LOGGER_ERR, "reactor could not watch fd %d", fd);
+        return -1;
+    }
+    reactor->fds[reactor->fd_count++] = fd;
+#endif
+    return 0;
+}
+
+int
+reactor_remove(reactor_t *reactor, int fd)
+{
+    assert(reactor);
+
+#ifdef REACTOR_USE_EPOLL
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, NULL) == -1) {
+        return -1;
+    }
+#else
+    int i;
+    for (i = 0; i < reactor->fd_count; i++) {
+        if (reactor->fds[i] == fd) break;
+    }
+    if (i == reactor->fd_count) {
+        return -1;
+    }
+    reactor->fds[i] = reactor->fds[--reactor->fd_count];
+#endif
+    return 0;
+}
+
+int
+reactor_wait(reactor_t *reactor, int *ready, int max_ready, int timeout_ms)
+{
+    int count = 0;
+
+    assert(reactor);
+    assert(ready);
+
+#ifdef REACTOR_USE_EPOLL
+    struct epoll_event events[REACTOR_MAX_FDS];
+    if (max_ready > REACTOR_MAX_FDS - 1) {
+        max_ready = REACTOR_MAX_FDS - 1;
+    }
+    /* One extra slot, so the eventfd can never push out a ready socket */
+    int nevents = epoll_wait(reactor->epoll_fd, events, max_ready + 1, timeout_ms);
+    if (nevents == -1) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < nevents; i++) {
+        if (events[i].data.fd == reactor->event_fd) {
+            uint64_t value;
+            if (read(reactor->event_fd, &value, sizeof(value)) < 0) {
+                /* Already drained by a concurrent wait */
+            }
+        } else if (count < max_ready) {
+            ready[count++] = events[i].data.fd;
+        }
+    }
+#else
+    fd_set rfds;
+    struct timeval tv;
+    int nfds = reactor->pipe_fds[0] + 1;
+
+    FD_ZERO(&rfds);
+    FD_SET(reactor->pipe_fds[0], &rfds);
+    for (int i = 0; i < reactor->fd_count; i++) {
+        FD_SET(reactor->fds[i], &rfds);
+        if (reactor->fds[i] >= nfds) {
+            nfds = reactor->fds[i] + 1;
+        }
+    }
+    if (timeout_ms >= 0) {
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+    }
+    int ret = select(nfds, &rfds, NULL, NULL, timeout_ms >= 0 ? &tv : NULL);
+    if (ret == -1) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (FD_ISSET(reactor->pipe_fds[0], &rfds)) {
+        unsigned char drain[64];
+        while (read(reactor->pipe_fds[0], drain, sizeof(drain)) > 0);
+    }
+    for (int i = 0; i < reactor->fd_count && count < max_ready; i++) {
+        if (FD_ISSET(reactor->fds[i], &rfds)) {
+            ready[count++] = reactor->fds[i];
+        }
+    }
+#endif
+    return count;
+}
+
+void
+reactor_wakeup(reactor_t *reactor)
+{
+    assert(reactor);
+
+#ifdef REACTOR_USE_EPOLL
+    uint64_t value = 1;
+    if (write(reactor->event_fd, &value, sizeof(value)) < 0) {
+        /* The counter is already non-zero, the waiter will wake up anyway */
+    }
+#else
+    unsigned char value = 1;
+    if (write(reactor->pipe_fds[1], &value, sizeof(value)) < 0) {
+        /* The pipe is full, the waiter will wake up anyway */
+    }
+#endif
+}
+
+int
+reactor_is_ready(const int *ready, int count, int fd)
+{
+    for (int i = 0; i < count; i++) {
+        if (ready[i] == fd) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "logger.h"
+
+/*
+ * Waits for a set of sockets to become readable. On Linux this is backed by
+ * epoll and an eventfd, elsewhere by select() and a self-pipe. Any thread can
+ * interrupt a waiting thread with reactor_wakeup(), which is how I/O threads
+ * learn about stop requests and state changes without polling.
+ */
+typedef struct reactor_s reactor_t;
+
+reactor_t *reactor_init(logger_t *logger);
+void reactor_destroy(reactor_t *reactor);
+
+int reactor_add(reactor_t *reactor, int fd);
+int reactor_remove(reactor_t *reactor, int fd);
+
+/*
+ * Blocks until a registered fd is readable, reactor_wakeup() is called or timeout_ms
+ * passes (-1 waits forever). Readable fds are stored in ready. Returns their count,
+ * 0 after a wakeup or timeout and -1 on error.
+ */
+int reactor_wait(reactor_t *reactor, int *ready, int max_ready, int timeout_ms);
+void reactor_wakeup(reactor_t *reactor);
+
+int reactor_is_ready(const int *ready, int count, int fd);
+
+#endif //REACTOR_H
@@ -0,0 +1,888 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "recorder.h"
+#include "threads.h"
+#include "metrics.h"
+
+/* Memory the file writes may fall behind by before fragments are dropped */
+#define RECORDER_RING_SIZE (32 * 1024 * 1024)
+#define RECORDER_RING_ALIGN 4096
+/* Largest single write, keeps the ring freeing up while a big fragment goes out */
+#define RECORDER_WRITE_CHUNK (1024 * 1024)
+
+/* Micro seconds of media per fragment, video fragments also end at every IDR frame */
+#define RECORDER_FRAGMENT_DURATION 1000000
+
+#define RECORDER_VIDEO_TRACK 1
+#define RECORDER_AUDIO_TRACK 2
+#define RECORDER_VIDEO_TIMESCALE 90000
+/* Duration of the last video sample of a recording, which has no successor to measure it by */
+#define RECORDER_VIDEO_DEFAULT_DURATION (RECORDER_VIDEO_TIMESCALE / 30)
+
+/* AirPlay always sends stereo AAC-ELD at 44.1 kHz with 480 samples per frame */
+#define RECORDER_AUDIO_TIMESCALE 44100
+#define RECORDER_AUDIO_FRAME_SAMPLES 480
+#define RECORDER_AUDIO_CHANNELS 2
+/* Audio arriving this far from where the previous frames put it starts a new timeline */
+#define RECORDER_AUDIO_RESYNC 100000
+
+#define RECORDER_SAMPLE_SYNC 0x02000000
+#define RECORDER_SAMPLE_NON_SYNC 0x01010000
+
+static const unsigned char recorder_eld_config[] = { 0xF8, 0xE8, 0x50, 0x00 };
+
+typedef struct recorder_buffer_s {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+} recorder_buffer_t;
+
+typedef struct recorder_sample_s {
+    uint32_t size;
+    uint32_t duration;
+    uint32_t flags;
+    uint64_t decode_time;
+} recorder_sample_t;
+
+typedef struct recorder_track_s {
+    uint32_t track_id;
+    uint32_t timescale;
+
+    /* Samples of the fragment being collected and their data */
+    recorder_sample_t *samples;
+    int sample_count;
+    int sample_capacity;
+    recorder_buffer_t data;
+
+    /* Decode time right after the last sample, 0 before the first one */
+    uint64_t next_decode_time;
+    int started;
+} recorder_track_t;
+
+struct recorder_s {
+    logger_t *logger;
+
+    /* Muxing state, the video and audio callbacks may come from different threads */
+    mutex_handle_t mutex;
+    int initialized;
+    uint64_t base_time;
+    uint32_t sequence_number;
+    int video_needs_idr;
+    recorder_buffer_t parameter_sets;
+    recorder_buffer_t boxes;
+    recorder_track_t video;
+    recorder_track_t audio;
+
+    /* Ring of bytes waiting for the file, head and tail count every byte ever written */
+    int fd;
+    unsigned char *ring;
+    uint64_t head;
+    uint64_t tail;
+    int failed;
+    int dropping;
+    uint64_t fragments_dropped;
+
+    thread_handle_t thread;
+    mutex_handle_t ring_mutex;
+    cond_handle_t ring_cond;
+    int running;
+};
+
+static int
+recorder_buffer_reserve(recorder_buffer_t *buffer, size_t length)
+{
+    if (buffer->length + length <= buffer->capacity) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + length) {
+        capacity *= 2;
+    }
+    unsigned char *data = realloc(buffer->data, capacity);
+    if (!data) {
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+/* Box writers, allocation failures are caught once when the box buffer is handed on */
+static void
+put_bytes(recorder_buffer_t *buffer, const void *data, size_t length)
+{
+    if (recorder_buffer_reserve(buffer, length) < 0) {
+        return;
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+static void
+put_zeros(recorder_buffer_t *buffer, size_t length)
+{
+    if (recorder_buffer_reserve(buffer, length) < 0) {
+        return;
+    }
+    memset(buffer->data + buffer->length, 0, length);
+    buffer->length += length;
+}
+
+static void
+put_u8(recorder_buffer_t *buffer, uint8_t value)
+{
+    put_bytes(buffer, &value, 1);
+}
+
+static void
+put_u16(recorder_buffer_t *buffer, uint16_t value)
+{
+    unsigned char bytes[2] = { value >> 8, value };
+    put_bytes(buffer, bytes, sizeof(bytes));
+}
+
+static void
+put_u32(recorder_buffer_t *buffer, uint32_t value)
+{
+    unsigned char bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+    put_bytes(buffer, bytes, sizeof(bytes));
+}
+
+static void
+put_u64(recorder_buffer_t *buffer, uint64_t value)
+{
+    put_u32(buffer, value >> 32);
+    put_u32(buffer, value);
+}
+
+static void
+set_u32(recorder_buffer_t *buffer, size_t offset, uint32_t value)
+{
+    if (offset + 4 <= buffer->length) {
+        buffer->data[offset] = value >> 24;
+        buffer->data[offset + 1] = value >> 16;
+        buffer->data[offset + 2] = value >> 8;
+        buffer->data[offset + 3] = value;
+    }
+}
+
+/* Starts a box and returns where its size goes once box_end knows it */
+static size_t
+box_begin(recorder_buffer_t *buffer, const char *type)
+{
+    size_t offset = buffer->length;
+    put_u32(buffer, 0);
+    put_bytes(buffer, type, 4);
+    return offset;
+}
+
+static size_t
+full_box_begin(recorder_buffer_t *buffer, const char *type, uint8_t version, uint32_t flags)
+{
+    size_t offset = box_begin(buffer, type);
+    put_u32(buffer, ((uint32_t) version << 24) | flags);
+    return offset;
+}
+
+static void
+box_end(recorder_buffer_t *buffer, size_t offset)
+{
+    set_u32(buffer, offset, buffer->length - offset);
+}
+
+static void
+put_matrix(recorder_buffer_t *buffer)
+{
+    static const uint32_t unity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+    for (int i = 0; i < 9; i++) {
+        put_u32(buffer, unity[i]);
+    }
+}
+
+static THREAD_RETVAL
+recorder_thread(void *arg)
+{
+    recorder_t *recorder = arg;
+
+    MUTEX_LOCK(recorder->ring_mutex);
+    while (1) {
+        while (recorder->head == recorder->tail && recorder->running) {
+            COND_WAIT(recorder->ring_cond, recorder->ring_mutex);
+        }
+        if (recorder->head == recorder->tail) {
+            break;
+        }
+        uint64_t position = recorder->tail % RECORDER_RING_SIZE;
+        size_t length = recorder->head - recorder->tail;
+        if (length > RECORDER_RING_SIZE - position) {
+            length = RECORDER_RING_SIZE - position;
+        }
+        if (length > RECORDER_WRITE_CHUNK) {
+            length = RECORDER_WRITE_CHUNK;
+        }
+        MUTEX_UNLOCK(recorder->ring_mutex);
+
+        ssize_t written = length;
+        if (!ATOMIC_LOAD(recorder->failed)) {
+            written = write(recorder->fd, recorder->ring + position, length);
+        }
+        if (written < 0 && errno == EINTR) {
+            written = 0;
+        } else if (written < 0) {
+            logger_log(recorder->logger, LOGGER_ERR, "recorder could not write the recording %d %s, stopping it",
+                       errno, strerror(errno));
+            ATOMIC_STORE(recorder->failed, 1);
+            written = length;
+        }
+
+        MUTEX_LOCK(recorder->ring_mutex);
+        recorder->tail += written;
+    }
+    MUTEX_UNLOCK(recorder->ring_mutex);
+    return 0;
+}
+
+/*
+ * Queues the box buffer plus an optional payload for the file, both or nothing. Returns -1 if
+ * the ring has no room, the disk is then further behind than the ring holds.
+ */
+static int
+recorder_queue(recorder_t *recorder, const recorder_buffer_t *boxes, const recorder_buffer_t *payload)
+{
+    size_t length = boxes->length + (payload ? payload->length : 0);
+    if (ATOMIC_LOAD(recorder->failed)) {
+        return -1;
+    }
+
+    MUTEX_LOCK(recorder->ring_mutex);
+    uint64_t head = recorder->head;
+    int fits = RECORDER_RING_SIZE - (head - recorder->tail) >= length;
+    MUTEX_UNLOCK(recorder->ring_mutex);
+    if (!fits) {
+        return -1;
+    }
+
+    /* Only this side moves head, so the space stays ours while copying without the lock */
+    const recorder_buffer_t *parts[2] = { boxes, payload };
+    for (int i = 0; i < 2; i++) {
+        const unsigned char *data = parts[i] ? parts[i]->data : NULL;
+        size_t remaining = parts[i] ? parts[i]->length : 0;
+        while (remaining > 0) {
+            uint64_t position = head % RECORDER_RING_SIZE;
+            size_t chunk = RECORDER_RING_SIZE - position;
+            if (chunk > remaining) {
+                chunk = remaining;
+            }
+            memcpy(recorder->ring + position, data, chunk);
+            data += chunk;
+            head += chunk;
+            remaining -= chunk;
+        }
+    }
+
+    MUTEX_LOCK(recorder->ring_mutex);
+    recorder->head = head;
+    COND_SIGNAL(recorder->ring_cond);
+    MUTEX_UNLOCK(recorder->ring_mutex);
+    return 0;
+}
+
+static void
+recorder_write_trex(recorder_buffer_t *b, uint32_t track_id)
+{
+    size_t trex = full_box_begin(b, "trex", 0, 0);
+    put_u32(b, track_id);
+    put_u32(b, 1);
+    put_u32(b, 0);
+    put_u32(b, 0);
+    put_u32(b, 0);
+    box_end(b, trex);
+}
+
+/* Writes tkhd and opens mdia with its mdhd and hdlr, returns the mdia offset to close after minf */
+static size_t
+recorder_write_track_header(recorder_buffer_t *b, uint32_t track_id, uint32_t timescale, const char *handler,
+                            const char *handler_name, int width, int height)
+{
+    size_t tkhd = full_box_begin(b, "tkhd", 0, 0x000003);
+    put_u32(b, 0);
+    put_u32(b, 0);
+    put_u32(b, track_id);
+    put_u32(b, 0);
+    put_u32(b, 0);
+    put_zeros(b, 8);
+    put_u16(b, 0);
+    put_u16(b, 0);
+    put_u16(b, width ? 0 : 0x0100);
+    put_u16(b, 0);
+    put_matrix(b);
+    put_u32(b, (uint32_t) width << 16);
+    put_u32(b, (uint32_t) height << 16);
+    box_end(b, tkhd);
+
+    size_t mdia = box_begin(b, "mdia");
+    size_t mdhd = full_box_begin(b, "mdhd", 0, 0);
+    put_u32(b, 0);
+    put_u32(b, 0);
+    put_u32(b, timescale);
+    put_u32(b, 0);
+    put_u16(b, 0x55c4); /* und */
+    put_u16(b, 0);
+    box_end(b, mdhd);
+
+    size_t hdlr = full_box_begin(b, "hdlr", 0, 0);
+    put_u32(b, 0);
+    put_bytes(b, handler, 4);
+    put_zeros(b, 12);
+    put_bytes(b, handler_name, strlen(handler_name) + 1);
+    box_end(b, hdlr);
+    return mdia;
+}
+
+static void
+recorder_write_data_information(recorder_buffer_t *b)
+{
+    size_t dinf = box_begin(b, "dinf");
+    size_t dref = full_box_begin(b, "dref", 0, 0);
+    put_u32(b, 1);
+    size_t url = full_box_begin(b, "url ", 0, 0x000001);
+    box_end(b, url);
+    box_end(b, dref);
+    box_end(b, dinf);
+}
+
+/* Empty sample tables, the samples are all in the fragments */
+static void
+recorder_write_empty_tables(recorder_buffer_t *b)
+{
+    static const char *tables[] = { "stts", "stsc", "stco" };
+    for (int i = 0; i < 3; i++) {
+        size_t table = full_box_begin(b, tables[i], 0, 0);
+        put_u32(b, 0);
+        box_end(b, table);
+    }
+    size_t stsz = full_box_begin(b, "stsz", 0, 0);
+    put_u32(b, 0);
+    put_u32(b, 0);
+    box_end(b, stsz);
+}
+
+static void
+recorder_write_avcc(recorder_buffer_t *b, const unsigned char *sps, int sps_len, const unsigned char *pps, int pps_len)
+{
+    size_t avcc = box_begin(b, "avcC");
+    put_u8(b, 1);
+    put_u8(b, sps[1]);
+    put_u8(b, sps[2]);
+    put_u8(b, sps[3]);
+    put_u8(b, 0xfc | 3); /* 4 byte NAL lengths */
+    put_u8(b, 0xe0 | 1);
+    put_u16(b, sps_len);
+    put_bytes(b, sps, sps_len);
+    put_u8(b, 1);
+    put_u16(b, pps_len);
+    put_bytes(b, pps, pps_len);
+    if (sps[1] == 100 || sps[1] == 110 || sps[1] == 122 || sps[1] == 144) {
+        /* Mirroring is always 8 bit 4:2:0 */
+        put_u8(b, 0xfc | 1);
+        put_u8(b, 0xf8);
+        put_u8(b, 0xf8);
+        put_u8(b, 0);
+    }
+    box_end(b, avcc);
+}
+
+static void
+recorder_write_esds(recorder_buffer_t *b)
+{
+    size_t esds = full_box_begin(b, "esds", 0, 0);
+    /* ES_Descriptor, with a DecoderConfigDescriptor, the AudioSpecificConfig and an SLConfigDescriptor */
+    put_u8(b, 0x03);
+    put_u8(b, 3 + 2 + 13 + 2 + sizeof(recorder_eld_config) + 3);
+    put_u16(b, RECORDER_AUDIO_TRACK);
+    put_u8(b, 0);
+    put_u8(b, 0x04);
+    put_u8(b, 13 + 2 + sizeof(recorder_eld_config));
+    put_u8(b, 0x40); /* MPEG-4 audio */
+    put_u8(b, (0x05 << 2) | 1);
+    put_u8(b, 0);
+    put_u16(b, 0);
+    put_u32(b, 0);
+    put_u32(b, 0);
+    put_u8(b, 0x05);
+    put_u8(b, sizeof(recorder_eld_config));
+    put_bytes(b, recorder_eld_config, sizeof(recorder_eld_config));
+    put_u8(b, 0x06);
+    put_u8(b, 1);
+    put_u8(b, 0x02);
+    box_end(b, esds);
+}
+
+/* ftyp and moov, written once before the first fragment */
+static void
+recorder_write_init_segment(recorder_buffer_t *b, const unsigned char *sps, int sps_len,
+                            const unsigned char *pps, int pps_len, int width, int height)
+{
+    size_t ftyp = box_begin(b, "ftyp");
+    put_bytes(b, "iso6", 4);
+    put_u32(b, 0);
+    put_bytes(b, "iso6isomavc1mp41", 16);
+    box_end(b, ftyp);
+
+    size_t moov = box_begin(b, "moov");
+    size_t mvhd = full_box_begin(b, "mvhd", 0, 0);
+    put_u32(b, 0);
+    put_u32(b, 0);
+    put_u32(b, 1000);
+    put_u32(b, 0);
+    put_u32(b, 0x00010000);
+    put_u16(b, 0x0100);
+    put_zeros(b, 10);
+    put_matrix(b);
+    put_zeros(b, 24);
+    put_u32(b, RECORDER_AUDIO_TRACK + 1);
+    box_end(b, mvhd);
+
+    /* Video, avc3 so that parameter sets may change within the recording */
+    size_t trak = box_begin(b, "trak");
+    size_t mdia = recorder_write_track_header(b, RECORDER_VIDEO_TRACK, RECORDER_VIDEO_TIMESCALE, "vide",
+                                              "VideoHandler", width, height);
+    size_t minf = box_begin(b, "minf");
+    size_t vmhd = full_box_begin(b, "vmhd", 0, 0x000001);
+    put_zeros(b, 8);
+    box_end(b, vmhd);
+    recorder_write_data_information(b);
+    size_t stbl = box_begin(b, "stbl");
+    size_t stsd = full_box_begin(b, "stsd", 0, 0);
+    put_u32(b, 1);
+    size_t avc3 = box_begin(b, "avc3");
+    put_zeros(b, 6);
+    put_u16(b, 1);
+    put_zeros(b, 16);
+    put_u16(b, width);
+    put_u16(b, height);
+    put_u32(b, 0x00480000);
+    put_u32(b, 0x00480000);
+    put_u32(b, 0);
+    put_u16(b, 1);
+    put_zeros(b, 32);
+    put_u16(b, 0x0018);
+    put_u16(b, 0xffff);
+    recorder_write_avcc(b, sps, sps_len, pps, pps_len);
+    box_end(b, avc3);
+    box_end(b, stsd);
+    recorder_write_empty_tables(b);
+    box_end(b, stbl);
+    box_end(b, minf);
+    box_end(b, mdia);
+    box_end(b, trak);
+
+    trak = box_begin(b, "trak");
+    mdia = recorder_write_track_header(b, RECORDER_AUDIO_TRACK, RECORDER_AUDIO_TIMESCALE, "soun", "SoundHandler",
+                                       0, 0);
+    minf = box_begin(b, "minf");
+    size_t smhd = full_box_begin(b, "smhd", 0, 0);
+    put_u32(b, 0);
+    box_end(b, smhd);
+    recorder_write_data_information(b);
+    stbl = box_begin(b, "stbl");
+    stsd = full_box_begin(b, "stsd", 0, 0);
+    put_u32(b, 1);
+    size_t mp4a = box_begin(b, "mp4a");
+    put_zeros(b, 6);
+    put_u16(b, 1);
+    put_zeros(b, 8);
+    put_u16(b, RECORDER_AUDIO_CHANNELS);
+    put_u16(b, 16);
+    put_u32(b, 0);
+    put_u32(b, (uint32_t) RECORDER_AUDIO_TIMESCALE << 16);
+    recorder_write_esds(b);
+    box_end(b, mp4a);
+    box_end(b, stsd);
+    recorder_write_empty_tables(b);
+    box_end(b, stbl);
+    box_end(b, minf);
+    box_end(b, mdia);
+    box_end(b, trak);
+
+    size_t mvex = box_begin(b, "mvex");
+    recorder_write_trex(b, RECORDER_VIDEO_TRACK);
+    recorder_write_trex(b, RECORDER_AUDIO_TRACK);
+    box_end(b, mvex);
+    box_end(b, moov);
+}
+
+/* moof and mdat of the samples collected for a track, then starts collecting the next fragment */
+static void
+recorder_flush_track(recorder_t *recorder, recorder_track_t *track)
+{
+    if (!track->sample_count) {
+        return;
+    }
+    recorder_buffer_t *b = &recorder->boxes;
+    b->length = 0;
+
+    size_t moof = box_begin(b, "moof");
+    size_t mfhd = full_box_begin(b, "mfhd", 0, 0);
+    put_u32(b, ++recorder->sequence_number);
+    box_end(b, mfhd);
+    size_t traf = box_begin(b, "traf");
+    size_t tfhd = full_box_begin(b, "tfhd", 0, 0x020000); /* Offsets are relative to the moof */
+    put_u32(b, track->track_id);
+    box_end(b, tfhd);
+    size_t tfdt = full_box_begin(b, "tfdt", 1, 0);
+    put_u64(b, track->samples[0].decode_time);
+    box_end(b, tfdt);
+    size_t trun = full_box_begin(b, "trun", 0, 0x000701); /* Data offset, duration, size and flags */
+    put_u32(b, track->sample_count);
+    size_t data_offset = b->length;
+    put_u32(b, 0);
+    for (int i = 0; i < track->sample_count; i++) {
+        put_u32(b, track->samples[i].duration);
+        put_u32(b, track->samples[i].size);
+        put_u32(b, track->samples[i].flags);
+    }
+    box_end(b, trun);
+    box_end(b, traf);
+    box_end(b, moof);
+    set_u32(b, data_offset, b->length - moof + 8);
+    put_u32(b, 8 + track->data.length);
+    put_bytes(b, "mdat", 4);
+
+    /* Short box buffers mean an allocation failed somewhere */
+    int complete = b->length == data_offset + 4 + track->sample_count * 12 + 8;
+    if (!complete || recorder_queue(recorder, b, &track->data) < 0) {
+        recorder->fragments_dropped++;
+        metrics_add(METRIC_RECORDING_FRAGMENTS_DROPPED, 1);
+        if (!recorder->dropping && !ATOMIC_LOAD(recorder->failed)) {
+            logger_log(recorder->logger, LOGGER_WARNING, "recorder dropping fragments, the disk is falling behind");
+        }
+        recorder->dropping = 1;
+        /* Later video would reference the frames just lost */
+        if (track == &recorder->video) {
+            recorder->video_needs_idr = 1;
+        }
+    } else {
+        recorder->dropping = 0;
+    }
+    track->sample_count = 0;
+    track->data.length = 0;
+}
+
+static recorder_sample_t *
+recorder_add_sample(recorder_track_t *track, uint64_t decode_time, uint32_t flags)
+{
+    if (track->sample_count == track->sample_capacity) {
+        int capacity = track->sample_capacity ? track->sample_capacity * 2 : 64;
+        recorder_sample_t *samples = realloc(track->samples, capacity * sizeof(recorder_sample_t));
+        if (!samples) {
+            return NULL;
+        }
+        track->samples = samples;
+        track->sample_capacity = capacity;
+    }
+    recorder_sample_t *sample = &track->samples[track->sample_count++];
+    sample->size = 0;
+    sample->duration = 0;
+    sample->flags = flags;
+    sample->decode_time = decode_time;
+    return sample;
+}
+
+static uint64_t
+recorder_to_timescale(recorder_t *recorder, uint64_t pts, uint32_t timescale)
+{
+    if (pts <= recorder->base_time) {
+        return 0;
+    }
+    return (pts - recorder->base_time) * timescale / 1000000;
+}
+
+/* Appends the NAL units as 4 byte length prefixed units, the way MP4 stores them */
+static int
+recorder_append_nals(recorder_buffer_t *buffer, const h264_decode_struct *data, int parameter_sets)
+{
+    for (int i = 0; i < data->nal_index.count; i++) {
+        const h264_nal_index_entry_t *nal = &data->nal_index.nals[i];
+        int is_parameter_set = nal->nal_unit_type == 7 || nal->nal_unit_type == 8;
+        if (is_parameter_set != parameter_sets) {
+            continue;
+        }
+        if (recorder_buffer_reserve(buffer, 4 + nal->size) < 0) {
+            return -1;
+        }
+        put_u32(buffer, nal->size);
+        put_bytes(buffer, data->data + nal->offset, nal->size);
+    }
+    return 0;
+}
+
+static void
+recorder_start(recorder_t *recorder, const h264_decode_struct *data)
+{
+    const h264_nal_index_entry_t *sps = NULL, *pps = NULL;
+    for (int i = 0; i < data->nal_index.count; i++) {
+        if (data->nal_index.nals[i].nal_unit_type == 7 && !sps && data->nal_index.nals[i].size >= 4) {
+            sps = &data->nal_index.nals[i];
+        } else if (data->nal_index.nals[i].nal_unit_type == 8 && !pps) {
+            pps = &data->nal_index.nals[i];
+        }
+    }
+    if (!sps || !pps) {
+        return;
+    }
+
+    recorder_buffer_t *b = &recorder->boxes;
+    b->length = 0;
+    recorder_write_init_segment(b, data->data + sps->offset, sps->size, data->data + pps->offset, pps->size,
+                                data->width, data->height);
+    if (recorder_queue(recorder, b, NULL) < 0) {
+        logger_log(recorder->logger, LOGGER_ERR, "recorder could not queue the file header");
+        return;
+    }
+    recorder->initialized = 1;
+    recorder->video_needs_idr = 1;
+    logger_log(recorder->logger, LOGGER_INFO, "recorder started recording %dx%d video", data->width, data->height);
+}
+
+void
+recorder_video(recorder_t *recorder, const h264_decode_struct *data)
+{
+    assert(recorder);
+    assert(data);
+
+    if (!data->data || data->nal_index.count == 0 || ATOMIC_LOAD(recorder->failed)) {
+        return;
+    }
+
+    MUTEX_LOCK(recorder->mutex);
+    if (data->frame_type == 0) {
+        /* Parameter sets go in-band in front of the next frame, avc3 allows them to change */
+        if (!recorder->initialized) {
+            recorder_start(recorder, data);
+        }
+        recorder->parameter_sets.length = 0;
+        recorder_append_nals(&recorder->parameter_sets, data, 1);
+        MUTEX_UNLOCK(recorder->mutex);
+        return;
+    }
+    if (!recorder->initialized || (recorder->video_needs_idr && !data->is_idr)) {
+        MUTEX_UNLOCK(recorder->mutex);
+        return;
+    }
+    recorder->video_needs_idr = 0;
+
+    /* The parameter sets come without a timestamp, the recording's time starts at the first frame */
+    recorder_track_t *track = &recorder->video;
+    if (!track->started && !recorder->base_time) {
+        recorder->base_time = data->pts;
+    }
+    uint64_t decode_time = recorder_to_timescale(recorder, data->pts, track->timescale);
+    /* Sample durations cannot be negative, frames out of order are squeezed in right after */
+    if (track->started && decode_time < track->next_decode_time) {
+        decode_time = track->next_decode_time;
+    }
+    if (track->sample_count > 0) {
+        recorder_sample_t *last = &track->samples[track->sample_count - 1];
+        last->duration = decode_time > last->decode_time ? decode_time - last->decode_time : 1;
+        decode_time = last->decode_time + last->duration;
+        uint64_t fragment_duration = decode_time - track->samples[0].decode_time;
+        if (data->is_idr ||
+            fragment_duration >= (uint64_t) RECORDER_FRAGMENT_DURATION * track->timescale / 1000000) {
+            recorder_flush_track(recorder, track);
+            if (recorder->video_needs_idr && !data->is_idr) {
+                MUTEX_UNLOCK(recorder->mutex);
+                return;
+            }
+        }
+    }
+
+    size_t data_start = track->data.length;
+    recorder_sample_t *sample = recorder_add_sample(track, decode_time,
+                                                    data->is_idr ? RECORDER_SAMPLE_SYNC : RECORDER_SAMPLE_NON_SYNC);
+    if (!sample) {
+        MUTEX_UNLOCK(recorder->mutex);
+        return;
+    }
+    if (data->is_idr && recorder->parameter_sets.length) {
+        put_bytes(&track->data, recorder->parameter_sets.data, recorder->parameter_sets.length);
+    }
+    if (recorder_append_nals(&track->data, data, 0) < 0) {
+        track->sample_count--;
+        track->data.length = data_start;
+        recorder->video_needs_idr = 1;
+        MUTEX_UNLOCK(recorder->mutex);
+        return;
+    }
+    sample->size = track->data.length - data_start;
+    sample->duration = RECORDER_VIDEO_DEFAULT_DURATION;
+    track->next_decode_time = decode_time + 1;
+    track->started = 1;
+    MUTEX_UNLOCK(recorder->mutex);
+}
+
+void
+recorder_audio(recorder_t *recorder, const aac_decode_struct *data)
+{
+    assert(recorder);
+    assert(data);
+
+    if (ATOMIC_LOAD(recorder->failed)) {
+        return;
+    }
+
+    MUTEX_LOCK(recorder->mutex);
+    recorder_track_t *track = &recorder->audio;
+    if (!recorder->video.started || data->pts < recorder->base_time) {
+        MUTEX_UNLOCK(recorder->mutex);
+        return;
+    }
+    if (!data->data) {
+        /* A lost frame stretches the one before it, so the later frames stay in place */
+        if (track->sample_count > 0) {
+            track->samples[track->sample_count - 1].duration += RECORDER_AUDIO_FRAME_SAMPLES;
+            track->next_decode_time += RECORDER_AUDIO_FRAME_SAMPLES;
+        }
+        MUTEX_UNLOCK(recorder->mutex);
+        return;
+    }
+    if (data->data_len <= 0) {
+        MUTEX_UNLOCK(recorder->mutex);
+        return;
+    }
+
+    /* Frames follow each other back to back, unless the stream paused or was flushed */
+    uint64_t decode_time = recorder_to_timescale(recorder, data->pts, track->timescale);
+    int64_t drift = (int64_t) decode_time - (int64_t) track->next_decode_time;
+    if (!track->started || drift > (int64_t) RECORDER_AUDIO_RESYNC * track->timescale / 1000000 ||
+        drift < -(int64_t) RECORDER_AUDIO_RESYNC * track->timescale / 1000000) {
+        recorder_flush_track(recorder, track);
+        if (track->started && decode_time < track->next_decode_time) {
+            decode_time = track->next_decode_time;
+        }
+    } else {
+        decode_time = track->next_decode_time;
+    }
+
+    recorder_sample_t *sample = recorder_add_sample(track, decode_time, RECORDER_SAMPLE_SYNC);
+    if (!sample || recorder_buffer_reserve(&track->data, data->data_len) < 0) {
+        if (sample) {
+            track->sample_count--;
+        }
+        MUTEX_UNLOCK(recorder->mutex);
+        return;
+    }
+    put_bytes(&track->data, data->data, data->data_len);
+    sample->size = data->data_len;
+    sample->duration = RECORDER_AUDIO_FRAME_SAMPLES;
+    track->next_decode_time = decode_time + RECORDER_AUDIO_FRAME_SAMPLES;
+    track->started = 1;
+
+    if (decode_time + RECORDER_AUDIO_FRAME_SAMPLES - track->samples[0].decode_time >=
+        (uint64_t) RECORDER_FRAGMENT_DURATION * track->timescale / 1000000) {
+        recorder_flush_track(recorder, track);
+    }
+    MUTEX_UNLOCK(recorder->mutex);
+}
+
+recorder_t *
+recorder_init(logger_t *logger, const char *path)
+{
+    recorder_t *recorder;
+
+    assert(logger);
+    assert(path);
+
+    recorder = calloc(1, sizeof(recorder_t));
+    if (!recorder) {
+        return NULL;
+    }
+    recorder->logger = logger;
+    recorder->video.track_id = RECORDER_VIDEO_TRACK;
+    recorder->video.timescale = RECORDER_VIDEO_TIMESCALE;
+    recorder->audio.track_id = RECORDER_AUDIO_TRACK;
+    recorder->audio.timescale = RECORDER_AUDIO_TIMESCALE;
+
+    /* Page aligned, so the writes can go straight from the ring to the page cache */
+    if (posix_memalign((void **) &recorder->ring, RECORDER_RING_ALIGN, RECORDER_RING_SIZE) != 0) {
+        logger_log(logger, LOGGER_ERR, "recorder could not allocate its write buffer");
+        free(recorder);
+        return NULL;
+    }
+    recorder->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (recorder->fd == -1) {
+        logger_log(logger, LOGGER_ERR, "recorder could not open %s %d %s", path, errno, strerror(errno));
+        free(recorder->ring);
+        free(recorder);
+        return NULL;
+    }
+
+    MUTEX_CREATE(recorder->mutex);
+    MUTEX_CREATE(recorder->ring_mutex);
+    COND_CREATE(recorder->ring_cond);
+    recorder->running = 1;
+    THREAD_CREATE(recorder->thread, recorder_thread, recorder);
+    if (recorder->thread) thread_set_name(recorder->thread, "record");
+    logger_log(logger, LOGGER_INFO, "recorder recording into %s", path);
+    return recorder;
+}
+
+void
+recorder_destroy(recorder_t *recorder)
+{
+    if (!recorder) {
+        return;
+    }
+
+    MUTEX_LOCK(recorder->mutex);
+    if (recorder->initialized) {
+        recorder_flush_track(recorder, &recorder->video);
+        recorder_flush_track(recorder, &recorder->audio);
+    }
+    MUTEX_UNLOCK(recorder->mutex);
+
+    /* The thread drains the ring before it exits */
+    MUTEX_LOCK(recorder->ring_mutex);
+    recorder->running = 0;
+    COND_SIGNAL(recorder->ring_cond);
+    MUTEX_UNLOCK(recorder->ring_mutex);
+    THREAD_JOIN(recorder->thread);
+
+    if (recorder->fragments_dropped) {
+        logger_log(recorder->logger, LOGGER_WARNING, "recorder dropped %llu fragments",
+                   (unsigned long long) recorder->fragments_dropped);
+    }
+    close(recorder->fd);
+
+    COND_DESTROY(recorder->ring_cond);
+    MUTEX_DESTROY(recorder->ring_mutex);
+    MUTEX_DESTROY(recorder->mutex);
+    free(recorder->video.samples);
+    free(recorder->video.data.data);
+    free(recorder->audio.samples);
+    free(recorder->audio.data.data);
+    free(recorder->parameter_sets.data);
+    free(recorder->boxes.data);
+    free(recorder->ring);
+    free(recorder);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <stdint.h>
+
+#include "logger.h"
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Archives a mirroring session as fragmented MP4, without decoding anything: the Annex-B
+ * access units become length prefixed avc3 samples and the AAC-ELD frames are stored as they
+ * came. The file starts with an ftyp and moov, every track then gets a moof and mdat about
+ * once a second, and video fragments start at IDR frames where possible. A file cut off by a
+ * crash still plays up to its last complete fragment.
+ *
+ * The media threads only copy the frames and build the boxes in memory. The file is written by
+ * a thread of the recorder from an aligned ring buffer, if the disk falls behind so far that a
+ * fragment does not fit in there anymore, that fragment is dropped instead of waiting.
+ *
+ * Recording starts with the first video frame carrying the parameter sets, audio before that
+ * is left out. Video and audio may be passed from different threads.
+ */
+typedef struct recorder_s recorder_t;
+
+recorder_t *recorder_init(logger_t *logger, const char *path);
+void recorder_video(recorder_t *recorder, const h264_decode_struct *data);
+void recorder_audio(recorder_t *recorder, const aac_decode_struct *data);
+/* Writes out the last fragments and closes the file once they are on disk */
+void recorder_destroy(recorder_t *recorder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //RECORDER_H
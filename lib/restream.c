@@ -0,0 +1,425 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#if defined(__linux__)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#define RESTREAM_USE_SENDMMSG
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "restream.h"
+#include "compat.h"
+#include "metrics.h"
+
+#define RESTREAM_MAX_SUBSCRIBERS 16
+/* RTP payload bytes per datagram, leaves room for IPv6 and tunnel headers within a 1500 byte MTU */
+#define RESTREAM_MAX_PAYLOAD 1400
+#define RESTREAM_RTP_HEADER_LEN 12
+#define RESTREAM_FU_HEADER_LEN 2
+#define RESTREAM_PAYLOAD_TYPE 96
+#define RESTREAM_CLOCK_RATE 90000
+/* Room for the packets of one frame to queue up in the kernel, an IDR frame is a few hundred */
+#define RESTREAM_SEND_BUFFER (1024 * 1024)
+/* Multicast stays on the local network unless routers are set up for it */
+#define RESTREAM_MULTICAST_TTL 1
+#define RESTREAM_MAX_PARAMETER_SETS 512
+
+#define NAL_TYPE_SPS 7
+#define NAL_TYPE_PPS 8
+#define NAL_TYPE_AUD 9
+#define NAL_TYPE_FU_A 28
+
+typedef struct restream_subscriber_s {
+    struct sockaddr_storage saddr;
+    socklen_t saddr_len;
+    int sock;
+    /* Set while packets to this subscriber are being dropped, to log it once */
+    int congested;
+} restream_subscriber_t;
+
+/* One datagram: the RTP header plus the FU-A bytes if any, then a slice of a NAL unit */
+typedef struct restream_packet_s {
+    unsigned char header[RESTREAM_RTP_HEADER_LEN + RESTREAM_FU_HEADER_LEN];
+    int header_len;
+    const unsigned char *payload;
+    int payload_len;
+} restream_packet_t;
+
+struct restream_s {
+    logger_t *logger;
+
+    restream_subscriber_t subscribers[RESTREAM_MAX_SUBSCRIBERS];
+    int subscriber_count;
+    int sock_ipv4;
+    int sock_ipv6;
+
+    uint32_t ssrc;
+    uint16_t seqnum;
+    uint32_t timestamp_offset;
+
+    /* Parameter sets of the mirror, sent again in front of every IDR frame */
+    unsigned char parameter_sets[RESTREAM_MAX_PARAMETER_SETS];
+    int parameter_set_offsets[2];
+    int parameter_set_sizes[2];
+    int parameter_set_count;
+
+    /* Packets of the frame being sent, built once and sent to every subscriber */
+    restream_packet_t *packets;
+    int packet_count;
+    int packet_capacity;
+    struct iovec *iovecs;
+#ifdef RESTREAM_USE_SENDMMSG
+    struct mmsghdr *msgs;
+#endif
+};
+
+static uint32_t
+restream_new_ssrc(restream_t *restream)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_REALTIME, &time);
+    uint64_t seed = (uint64_t) time.tv_sec * 1000000000ull + time.tv_nsec;
+    seed ^= (uint64_t) (uintptr_t) restream;
+    seed *= 0x9e3779b97f4a7c15ull;
+    return (uint32_t) (seed >> 32);
+}
+
+restream_t *
+restream_init(logger_t *logger)
+{
+    restream_t *restream;
+
+    assert(logger);
+
+    restream = calloc(1, sizeof(restream_t));
+    if (!restream) {
+        return NULL;
+    }
+    restream->logger = logger;
+    restream->sock_ipv4 = -1;
+    restream->sock_ipv6 = -1;
+    restream_reset(restream);
+    return restream;
+}
+
+void
+restream_reset(restream_t *restream)
+{
+    assert(restream);
+
+    restream->ssrc = restream_new_ssrc(restream);
+    restream->seqnum = (uint16_t) restream->ssrc;
+    restream->timestamp_offset = restream->ssrc * 2654435761u;
+    restream->parameter_set_count = 0;
+}
+
+static int
+restream_open_socket(restream_t *restream, int family)
+{
+    int sock = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == -1) {
+        return -1;
+    }
+    int nonblocking = 1;
+    ioctl(sock, FIONBIO, &nonblocking);
+    int size = RESTREAM_SEND_BUFFER;
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (const char *) &size, sizeof(size));
+    int ttl = RESTREAM_MULTICAST_TTL;
+    if (family == AF_INET6) {
+        setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, (const char *) &ttl, sizeof(ttl));
+    } else {
+        unsigned char ttl_byte = ttl;
+        setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, (const char *) &ttl_byte, sizeof(ttl_byte));
+    }
+    return sock;
+}
+
+int
+restream_add_subscriber(restream_t *restream, const char *address)
+{
+    char host[64];
+    const char *port;
+    struct addrinfo hints, *result;
+
+    assert(restream);
+    assert(address);
+
+    if (restream->subscriber_count == RESTREAM_MAX_SUBSCRIBERS) {
+        logger_log(restream->logger, LOGGER_ERR, "restream takes at most %d subscribers", RESTREAM_MAX_SUBSCRIBERS);
+        return -1;
+    }
+
+    /* [ipv6]:port or ipv4:port, names are not resolved */
+    if (address[0] == '[') {
+        const char *end = strchr(address, ']');
+        if (!end || end[1] != ':' || end - address - 1 >= (int) sizeof(host)) {
+            return -1;
+        }
+        memcpy(host, address + 1, end - address - 1);
+        host[end - address - 1] = '\0';
+        port = end + 2;
+    } else {
+        const char *colon = strrchr(address, ':');
+        if (!colon || colon - address >= (int) sizeof(host)) {
+            return -1;
+        }
+        memcpy(host, address, colon - address);
+        host[colon - address] = '\0';
+        port = colon + 1;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    if (getaddrinfo(host, port, &hints, &result) != 0) {
+        return -1;
+    }
+
+    restream_subscriber_t *subscriber = &restream->subscribers[restream->subscriber_count];
+    memcpy(&subscriber->saddr, result->ai_addr, result->ai_addrlen);
+    subscriber->saddr_len = result->ai_addrlen;
+    int family = result->ai_family;
+    freeaddrinfo(result);
+
+    int *sock = family == AF_INET6 ? &restream->sock_ipv6 : &restream->sock_ipv4;
+    if (*sock == -1 && (*sock = restream_open_socket(restream, family)) == -1) {
+        logger_log(restream->logger, LOGGER_ERR, "restream could not open a socket %d", SOCKET_GET_ERROR());
+        return -1;
+    }
+    subscriber->sock = *sock;
+    subscriber->congested = 0;
+    restream->subscriber_count++;
+    logger_log(restream->logger, LOGGER_INFO, "restream sending the mirror to %s", address);
+    return 0;
+}
+
+static restream_packet_t *
+restream_add_packet(restream_t *restream, uint32_t timestamp)
+{
+    if (restream->packet_count == restream->packet_capacity) {
+        int capacity = restream->packet_capacity ? restream->packet_capacity * 2 : 256;
+        restream_packet_t *packets = realloc(restream->packets, capacity * sizeof(restream_packet_t));
+        if (!packets) {
+            return NULL;
+        }
+        restream->packets = packets;
+        struct iovec *iovecs = realloc(restream->iovecs, capacity * 2 * sizeof(struct iovec));
+        if (!iovecs) {
+            return NULL;
+        }
+        restream->iovecs = iovecs;
+#ifdef RESTREAM_USE_SENDMMSG
+        struct mmsghdr *msgs = realloc(restream->msgs, capacity * sizeof(struct mmsghdr));
+        if (!msgs) {
+            return NULL;
+        }
+        restream->msgs = msgs;
+#endif
+        restream->packet_capacity = capacity;
+    }
+
+    restream_packet_t *packet = &restream->packets[restream->packet_count++];
+    uint16_t seqnum = restream->seqnum++;
+    packet->header[0] = 0x80;
+    packet->header[1] = RESTREAM_PAYLOAD_TYPE;
+    packet->header[2] = seqnum >> 8;
+    packet->header[3] = seqnum;
+    packet->header[4] = timestamp >> 24;
+    packet->header[5] = timestamp >> 16;
+    packet->header[6] = timestamp >> 8;
+    packet->header[7] = timestamp;
+    packet->header[8] = restream->ssrc >> 24;
+    packet->header[9] = restream->ssrc >> 16;
+    packet->header[10] = restream->ssrc >> 8;
+    packet->header[11] = restream->ssrc;
+    packet->header_len = RESTREAM_RTP_HEADER_LEN;
+    return packet;
+}
+
+/* Single NAL unit packet if it fits, FU-A fragments otherwise (RFC 6184, 5.6 and 5.8) */
+static int
+restream_packetize_nal(restream_t *restream, const unsigned char *nal, int size, uint32_t timestamp)
+{
+    if (size <= RESTREAM_MAX_PAYLOAD) {
+        restream_packet_t *packet = restream_add_packet(restream, timestamp);
+        if (!packet) {
+            return -1;
+        }
+        packet->payload = nal;
+        packet->payload_len = size;
+        return 0;
+    }
+
+    const unsigned char *data = nal + 1;
+    int remaining = size - 1;
+    int first = 1;
+    while (remaining > 0) {
+        int chunk = remaining > RESTREAM_MAX_PAYLOAD - RESTREAM_FU_HEADER_LEN ?
+                    RESTREAM_MAX_PAYLOAD - RESTREAM_FU_HEADER_LEN : remaining;
+        restream_packet_t *packet = restream_add_packet(restream, timestamp);
+        if (!packet) {
+            return -1;
+        }
+        packet->header[RESTREAM_RTP_HEADER_LEN] = (nal[0] & 0xe0) | NAL_TYPE_FU_A;
+        packet->header[RESTREAM_RTP_HEADER_LEN + 1] = (first ? 0x80 : 0) | (chunk == remaining ? 0x40 : 0) |
+                                                      (nal[0] & 0x1f);
+        packet->header_len = RESTREAM_RTP_HEADER_LEN + RESTREAM_FU_HEADER_LEN;
+        packet->payload = data;
+        packet->payload_len = chunk;
+        data += chunk;
+        remaining -= chunk;
+        first = 0;
+    }
+    return 0;
+}
+
+static void
+restream_send(restream_t *restream, restream_subscriber_t *subscriber)
+{
+    int sent = 0;
+#ifdef RESTREAM_USE_SENDMMSG
+    for (int i = 0; i < restream->packet_count; i++) {
+        restream->msgs[i].msg_hdr.msg_name = &subscriber->saddr;
+        restream->msgs[i].msg_hdr.msg_namelen = subscriber->saddr_len;
+    }
+    while (sent < restream->packet_count) {
+        int ret = sendmmsg(subscriber->sock, restream->msgs + sent, restream->packet_count - sent, MSG_DONTWAIT);
+        if (ret <= 0) {
+            break;
+        }
+        sent += ret;
+    }
+#else
+    for (; sent < restream->packet_count; sent++) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &subscriber->saddr;
+        msg.msg_namelen = subscriber->saddr_len;
+        msg.msg_iov = &restream->iovecs[2 * sent];
+        msg.msg_iovlen = 2;
+        if (sendmsg(subscriber->sock, &msg, MSG_DONTWAIT) < 0) {
+            break;
+        }
+    }
+#endif
+    if (sent < restream->packet_count) {
+        metrics_add(METRIC_RESTREAM_PACKETS_DROPPED, restream->packet_count - sent);
+        if (!subscriber->congested) {
+            logger_log(restream->logger, LOGGER_WARNING, "restream dropping packets to a subscriber %d",
+                       SOCKET_GET_ERROR());
+        }
+        subscriber->congested = 1;
+    } else {
+        subscriber->congested = 0;
+    }
+}
+
+void
+restream_video(restream_t *restream, const h264_decode_struct *data)
+{
+    assert(restream);
+    assert(data);
+
+    if (!restream->subscriber_count || !data->data) {
+        return;
+    }
+
+    if (data->frame_type == 0) {
+        /* Kept for the next IDR frame, the parameter set frame itself has no timestamp */
+        int used = 0;
+        restream->parameter_set_count = 0;
+        for (int i = 0; i < data->nal_index.count && restream->parameter_set_count < 2; i++) {
+            const h264_nal_index_entry_t *nal = &data->nal_index.nals[i];
+            if ((nal->nal_unit_type != NAL_TYPE_SPS && nal->nal_unit_type != NAL_TYPE_PPS) ||
+                used + nal->size > RESTREAM_MAX_PARAMETER_SETS) {
+                continue;
+            }
+            memcpy(restream->parameter_sets + used, data->data + nal->offset, nal->size);
+            restream->parameter_set_offsets[restream->parameter_set_count] = used;
+            restream->parameter_set_sizes[restream->parameter_set_count] = nal->size;
+            restream->parameter_set_count++;
+            used += nal->size;
+        }
+        return;
+    }
+
+    uint32_t timestamp = (uint32_t) (data->pts * RESTREAM_CLOCK_RATE / 1000000) + restream->timestamp_offset;
+    restream->packet_count = 0;
+    if (data->is_idr) {
+        for (int i = 0; i < restream->parameter_set_count; i++) {
+            restream_packetize_nal(restream, restream->parameter_sets + restream->parameter_set_offsets[i],
+                                   restream->parameter_set_sizes[i], timestamp);
+        }
+    }
+    for (int i = 0; i < data->nal_index.count; i++) {
+        const h264_nal_index_entry_t *nal = &data->nal_index.nals[i];
+        /* RFC 6184 leaves access unit delimiters to the marker bit */
+        if (nal->nal_unit_type == NAL_TYPE_AUD || nal->size <= 0) {
+            continue;
+        }
+        if (restream_packetize_nal(restream, data->data + nal->offset, nal->size, timestamp) < 0) {
+            logger_log(restream->logger, LOGGER_ERR, "restream could not allocate packets");
+            return;
+        }
+    }
+    if (!restream->packet_count) {
+        return;
+    }
+    restream->packets[restream->packet_count - 1].header[1] |= 0x80;
+
+    /* The headers and payload slices are gathered straight from the frame, nothing is copied */
+    for (int i = 0; i < restream->packet_count; i++) {
+        restream_packet_t *packet = &restream->packets[i];
+        restream->iovecs[2 * i].iov_base = packet->header;
+        restream->iovecs[2 * i].iov_len = packet->header_len;
+        restream->iovecs[2 * i + 1].iov_base = (void *) packet->payload;
+        restream->iovecs[2 * i + 1].iov_len = packet->payload_len;
+#ifdef RESTREAM_USE_SENDMMSG
+        memset(&restream->msgs[i], 0, sizeof(restream->msgs[i]));
+        restream->msgs[i].msg_hdr.msg_iov = &restream->iovecs[2 * i];
+        restream->msgs[i].msg_hdr.msg_iovlen = 2;
+#endif
+    }
+    for (int i = 0; i < restream->subscriber_count; i++) {
+        restream_send(restream, &restream->subscribers[i]);
+    }
+}
+
+void
+restream_destroy(restream_t *restream)
+{
+    if (!restream) {
+        return;
+    }
+    if (restream->sock_ipv4 != -1) {
+        closesocket(restream->sock_ipv4);
+    }
+    if (restream->sock_ipv6 != -1) {
+        closesocket(restream->sock_ipv6);
+    }
+    free(restream->packets);
+    free(restream->iovecs);
+#ifdef RESTREAM_USE_SENDMMSG
+    free(restream->msgs);
+#endif
+    free(restream);
+}
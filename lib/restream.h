@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef RESTREAM_H
+#define RESTREAM_H
+
+#include "logger.h"
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Passes the mirrored video on to other receivers as RTP (RFC 6184, payload type 96, 90 kHz),
+ * without decoding it. NAL units that fit a datagram go out as they are, larger ones as FU-A
+ * fragments, and the last packet of every frame carries the marker bit. The parameter sets are
+ * repeated in front of every IDR frame, so a viewer can join at any time.
+ *
+ * Every subscriber is a unicast or multicast address, a multicast group serves any number of
+ * viewers with one copy. The packets of a frame are sent without waiting: if a socket buffer
+ * is full the rest of that frame is dropped for the subscriber instead.
+ */
+typedef struct restream_s restream_t;
+
+restream_t *restream_init(logger_t *logger);
+/* Adds a destination given as ipv4:port or [ipv6]:port, -1 if it is not one */
+int restream_add_subscriber(restream_t *restream, const char *address);
+/* Starts a new RTP stream with a new SSRC, for when the mirror being passed on changes */
+void restream_reset(restream_t *restream);
+/* Called with every frame before the renderer takes it, data must stay valid only for the call */
+void restream_video(restream_t *restream, const h264_decode_struct *data);
+void restream_destroy(restream_t *restream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //RESTREAM_H
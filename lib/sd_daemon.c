@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "sd_daemon.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if !defined(WIN32)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+int
+sd_daemon_listen_fds(void)
+{
+#if defined(WIN32)
+    return 0;
+#else
+    const char *pid = getenv("LISTEN_PID");
+    const char *fds = getenv("LISTEN_FDS");
+    int count = 0;
+
+    /* The sockets are meant for the process systemd started, not one it forked off */
+    if (pid && fds && strtol(pid, NULL, 10) == (long) getpid()) {
+        count = (int) strtol(fds, NULL, 10);
+        if (count < 0) {
+            count = 0;
+        }
+        for (int fd = SD_LISTEN_FDS_START; fd < SD_LISTEN_FDS_START + count; fd++) {
+            int flags = fcntl(fd, F_GETFD);
+            if (flags == -1) {
+                count = fd - SD_LISTEN_FDS_START;
+                break;
+            }
+            fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+        }
+    }
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    return count;
+#endif
+}
+
+int
+sd_daemon_is_listening_stream(int fd)
+{
+#if defined(WIN32)
+    return 0;
+#else
+    int type = 0;
+    int listening = 0;
+    socklen_t len = sizeof(type);
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0 || type != SOCK_STREAM) {
+        return 0;
+    }
+    len = sizeof(listening);
+    if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0) {
+        return 0;
+    }
+    return listening != 0;
+#endif
+}
+
+int
+sd_daemon_notify(const char *state)
+{
+#if defined(WIN32)
+    return 0;
+#else
+    const char *path = getenv("NOTIFY_SOCKET");
+    struct sockaddr_un addr;
+    socklen_t addr_len;
+    size_t path_len;
+    int fd;
+    int ret;
+
+    if (!path || !*path) {
+        return 0;
+    }
+    path_len = strlen(path);
+    if ((path[0] != '/' && path[0] != '@') || path_len >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, path_len);
+    if (path[0] == '@') {
+        /* An abstract socket, its name starts with a zero byte and is not terminated */
+        addr.sun_path[0] = 0;
+    }
+    addr_len = (socklen_t) (offsetof(struct sockaddr_un, sun_path) + path_len + (path[0] == '/'));
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    ret = sendto(fd, state, strlen(state), MSG_NOSIGNAL, (struct sockaddr *) &addr, addr_len);
+    close(fd);
+    return ret < 0 ? -1 : 1;
+#endif
+}
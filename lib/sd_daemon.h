@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef SD_DAEMON_H
+#define SD_DAEMON_H
+
+/*
+ * The two halves of the systemd service protocol rpiplay speaks, without linking libsystemd:
+ * socket activation, where systemd binds and listens on the RTSP port at boot and hands the
+ * socket over once rpiplay runs, so senders connecting early wait in its backlog instead of
+ * being refused, and readiness notification for Type=notify units. Both do nothing when not
+ * started by systemd.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The first file descriptor systemd passes */
+#define SD_LISTEN_FDS_START 3
+
+/**
+ * Returns how many sockets systemd passed, numbered from SD_LISTEN_FDS_START on, 0 if none.
+ * Clears the environment that told, so child processes do not take them for their own.
+ */
+int sd_daemon_listen_fds(void);
+/* Whether fd is a listening stream socket, the only kind rpiplay can serve RTSP on */
+int sd_daemon_is_listening_stream(int fd);
+
+/* Sends state, e.g. "READY=1" or "STOPPING=1", to the service manager. Returns -1 on failure, 0 if not under systemd. */
+int sd_daemon_notify(const char *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SD_DAEMON_H
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_ring.h"
+
+#define SHM_RING_ALIGN(size) (((size) + 7) & ~(uint64_t) 7)
+
+/* Fields the other side changes, accessed as in the protocol of shm_ring.h */
+#define SHM_RING_LOAD(var) __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#define SHM_RING_STORE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELAXED)
+#define SHM_RING_LOAD_ACQUIRE(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define SHM_RING_STORE_RELEASE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELEASE)
+
+struct shm_ring_s {
+    logger_t *logger;
+    char *name;
+    shm_ring_header_t *header;
+    unsigned char *data;
+    uint64_t mapped_size;
+    uint64_t pos;
+    uint64_t sequence;
+    /* Set while frames are too large for the ring, to log it once */
+    int oversized;
+};
+
+shm_ring_t *
+shm_ring_init(logger_t *logger, const char *name, unsigned int megabytes)
+{
+    shm_ring_t *ring;
+    int fd;
+
+    assert(logger);
+    assert(name);
+    assert(megabytes > 0);
+
+    ring = calloc(1, sizeof(shm_ring_t));
+    if (!ring) {
+        return NULL;
+    }
+    ring->logger = logger;
+    ring->name = strdup(name);
+    ring->mapped_size = sizeof(shm_ring_header_t) + ((uint64_t) megabytes << 20);
+
+    /* A fresh object, readers still mapping the one of an earlier run keep that one */
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd == -1) {
+        logger_log(logger, LOGGER_ERR, "Could not create the shared memory object %s: %s", name, strerror(errno));
+        free(ring->name);
+        free(ring);
+        return NULL;
+    }
+    if (ftruncate(fd, ring->mapped_size) == -1) {
+        logger_log(logger, LOGGER_ERR, "Could not size the shared memory object %s: %s", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        free(ring->name);
+        free(ring);
+        return NULL;
+    }
+    void *mapping = mmap(NULL, ring->mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        logger_log(logger, LOGGER_ERR, "Could not map the shared memory object %s: %s", name, strerror(errno));
+        shm_unlink(name);
+        free(ring->name);
+        free(ring);
+        return NULL;
+    }
+    ring->header = mapping;
+    ring->data = (unsigned char *) mapping + sizeof(shm_ring_header_t);
+
+    /* The object starts out zeroed, readers only trust it once the magic is there */
+    ring->header->version = SHM_RING_VERSION;
+    ring->header->data_size = (uint64_t) megabytes << 20;
+    SHM_RING_STORE_RELEASE(ring->header->magic, SHM_RING_MAGIC);
+    logger_log(logger, LOGGER_INFO, "Publishing the mirror into shared memory %s, %u MB", name, megabytes);
+    return ring;
+}
+
+static void
+shm_ring_write(shm_ring_t *ring, uint32_t flags, uint64_t pts, const unsigned char *data, int size)
+{
+    shm_ring_header_t *header = ring->header;
+    uint64_t data_size = header->data_size;
+    uint64_t total = sizeof(shm_ring_record_t) + SHM_RING_ALIGN(size);
+    uint64_t offset = ring->pos % data_size;
+    uint64_t pos = ring->pos;
+
+    /* A frame taking up more than half the ring would leave readers no time to copy it */
+    if (total > data_size / 2) {
+        if (!ring->oversized) {
+            logger_log(ring->logger, LOGGER_WARNING, "A frame of %d bytes does not fit the shared memory ring", size);
+        }
+        ring->oversized = 1;
+        return;
+    }
+    ring->oversized = 0;
+
+    if (data_size - offset < total) {
+        pos += data_size - offset;
+    }
+    SHM_RING_STORE(header->reserve_pos, pos + total);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    if (pos != ring->pos && data_size - offset >= sizeof(shm_ring_record_t)) {
+        shm_ring_record_t padding = { (uint32_t) (data_size - offset - sizeof(shm_ring_record_t)),
+                                      SHM_RING_FLAG_PADDING, 0, 0 };
+        memcpy(ring->data + offset, &padding, sizeof(padding));
+    }
+    shm_ring_record_t record = { (uint32_t) size, flags, pts, ring->sequence++ };
+    memcpy(ring->data + pos % data_size, &record, sizeof(record));
+    memcpy(ring->data + pos % data_size + sizeof(record), data, size);
+
+    ring->pos = pos + total;
+    if (flags & SHM_RING_FLAG_PARAMETER_SETS) {
+        SHM_RING_STORE(header->sync_pos, pos);
+    }
+    SHM_RING_STORE(header->frames, ring->sequence);
+    SHM_RING_STORE_RELEASE(header->write_pos, ring->pos);
+}
+
+void
+shm_ring_video(shm_ring_t *ring, const h264_decode_struct *data)
+{
+    shm_ring_header_t *header;
+
+    assert(ring);
+    assert(data);
+
+    header = ring->header;
+    if (data->frame_type == 0) {
+        if (data->data_len <= SHM_RING_MAX_PARAMETER_SETS) {
+            uint32_t seq = header->parameter_sets_seq;
+            SHM_RING_STORE(header->parameter_sets_seq, seq + 1);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            memcpy(header->parameter_sets, data->data, data->data_len);
+            header->parameter_sets_size = data->data_len;
+            header->width = data->width;
+            header->height = data->height;
+            SHM_RING_STORE_RELEASE(header->parameter_sets_seq, seq + 2);
+        }
+        shm_ring_write(ring, SHM_RING_FLAG_PARAMETER_SETS, data->pts, data->data, data->data_len);
+    } else {
+        shm_ring_write(ring, data->is_idr ? SHM_RING_FLAG_IDR : 0, data->pts, data->data, data->data_len);
+    }
+}
+
+void
+shm_ring_destroy(shm_ring_t *ring)
+{
+    if (ring) {
+        SHM_RING_STORE_RELEASE(ring->header->magic, 0);
+        munmap(ring->header, ring->mapped_size);
+        shm_unlink(ring->name);
+        free(ring->name);
+        free(ring);
+    }
+}
+
+/* The newest parameter sets, from where the stream decodes, or the newest frame once those are overwritten */
+static uint64_t
+shm_ring_sync_pos(shm_ring_reader_t *reader)
+{
+    uint64_t write_pos = SHM_RING_LOAD_ACQUIRE(reader->header->write_pos);
+    uint64_t sync_pos = SHM_RING_LOAD(reader->header->sync_pos);
+    uint64_t reserve_pos;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    reserve_pos = SHM_RING_LOAD(reader->header->reserve_pos);
+    return reserve_pos - sync_pos <= reader->header->data_size ? sync_pos : write_pos;
+}
+
+int
+shm_ring_reader_open(shm_ring_reader_t *reader, const char *name)
+{
+    struct stat st;
+    void *mapping;
+    int fd;
+
+    assert(reader);
+    assert(name);
+
+    memset(reader, 0, sizeof(*reader));
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t) sizeof(shm_ring_header_t)) {
+        close(fd);
+        return -1;
+    }
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+    reader->header = mapping;
+    reader->data = (const unsigned char *) mapping + sizeof(shm_ring_header_t);
+    reader->mapped_size = st.st_size;
+    if (SHM_RING_LOAD_ACQUIRE(reader->header->magic) != SHM_RING_MAGIC ||
+        reader->header->version != SHM_RING_VERSION ||
+        sizeof(shm_ring_header_t) + reader->header->data_size > reader->mapped_size) {
+        shm_ring_reader_close(reader);
+        return -1;
+    }
+
+    reader->pos = shm_ring_sync_pos(reader);
+    return 0;
+}
+
+static void
+shm_ring_resync(shm_ring_reader_t *reader)
+{
+    reader->pos = shm_ring_sync_pos(reader);
+    reader->lost++;
+}
+
+int
+shm_ring_read(shm_ring_reader_t *reader, shm_ring_record_t *record, unsigned char *buffer, int buffer_size)
+{
+    const shm_ring_header_t *header;
+    uint64_t data_size;
+
+    assert(reader && reader->header);
+    assert(record);
+
+    header = reader->header;
+    data_size = header->data_size;
+    while (1) {
+        if (SHM_RING_LOAD_ACQUIRE(header->magic) != SHM_RING_MAGIC) {
+            return SHM_RING_READ_CLOSED;
+        }
+        uint64_t write_pos = SHM_RING_LOAD_ACQUIRE(header->write_pos);
+        if (reader->pos == write_pos) {
+            return SHM_RING_READ_AGAIN;
+        }
+        if (write_pos - reader->pos > data_size) {
+            shm_ring_resync(reader);
+            continue;
+        }
+
+        uint64_t offset = reader->pos % data_size;
+        if (data_size - offset < sizeof(shm_ring_record_t)) {
+            reader->pos += data_size - offset;
+            continue;
+        }
+        memcpy(record, reader->data + offset, sizeof(*record));
+        int copied = 0;
+        if (!(record->flags & SHM_RING_FLAG_PADDING) && record->size <= (uint32_t) buffer_size &&
+            record->size <= data_size - offset - sizeof(*record)) {
+            memcpy(buffer, reader->data + offset + sizeof(*record), record->size);
+            copied = 1;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint64_t total = sizeof(*record) + SHM_RING_ALIGN((uint64_t) record->size);
+        if (SHM_RING_LOAD(header->reserve_pos) > reader->pos + data_size) {
+            /* Overwritten while it was being copied */
+            shm_ring_resync(reader);
+            continue;
+        }
+        if (record->flags & SHM_RING_FLAG_PADDING) {
+            reader->pos += total;
+            continue;
+        }
+        if (!copied) {
+            return SHM_RING_READ_SMALL_BUFFER;
+        }
+        reader->pos += total;
+        return record->size;
+    }
+}
+
+int
+shm_ring_read_parameter_sets(shm_ring_reader_t *reader, unsigned char *buffer, int buffer_size)
+{
+    const shm_ring_header_t *header;
+    uint32_t seq, size;
+
+    assert(reader && reader->header);
+
+    header = reader->header;
+    do {
+        seq = SHM_RING_LOAD_ACQUIRE(header->parameter_sets_seq);
+        size = SHM_RING_LOAD(header->parameter_sets_size);
+        if (size > SHM_RING_MAX_PARAMETER_SETS || size > (uint32_t) buffer_size) {
+            size = 0;
+        }
+        memcpy(buffer, header->parameter_sets, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || SHM_RING_LOAD(header->parameter_sets_seq) != seq);
+    return size;
+}
+
+void
+shm_ring_reader_close(shm_ring_reader_t *reader)
+{
+    if (reader && reader->header) {
+        munmap((void *) reader->header, reader->mapped_size);
+        reader->header = NULL;
+    }
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdint.h>
+
+#include "logger.h"
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Publishes the mirrored video into a POSIX shared memory object, for other processes on the
+ * same machine to read without sockets or copies through the kernel. There is one writer and
+ * any number of readers, which never write to the object and so never hold the writer up: a
+ * reader that falls behind by more than the ring loses frames, not the writer.
+ *
+ * The object is a shm_ring_header_t followed by data_size bytes of records. Positions count
+ * the bytes ever written, a record at pos starts at byte pos % data_size of the record area.
+ * Every record is a shm_ring_record_t and the Annex-B access unit, padded to 8 bytes, and
+ * never wraps around the end of the area: a PADDING record fills what is left there, or if
+ * even its header does not fit, the next record simply starts at the beginning.
+ *
+ * Writing a record, the writer first stores its end in reserve_pos, then the record, then
+ * its end in write_pos. A reader loads write_pos (acquire), copies the records up to it, and
+ * then loads reserve_pos (after an acquire fence): if reserve_pos is beyond the copied pos +
+ * data_size, the writer overwrote the copy meanwhile and the reader must resynchronise. The
+ * copy may as well be decoding straight from the mapping, as long as it is checked after.
+ *
+ * Frames come as they arrive, parameter sets (SPS and PPS) in a record of their own ahead
+ * of the IDR frame they belong to. sync_pos is the newest parameter sets record, readers
+ * start and resynchronise there while the ring still holds it, and at write_pos otherwise,
+ * with the latest parameter sets from the header under parameter_sets_seq, a sequence lock.
+ *
+ * pts is the time in micro seconds on CLOCK_MONOTONIC the frame is due on screen.
+ * The writer sets magic to 0 before it removes the object, readers then reopen it.
+ */
+
+#define SHM_RING_MAGIC 0x48535052u /* "RPSH" */
+#define SHM_RING_VERSION 2
+#define SHM_RING_MAX_PARAMETER_SETS 512
+
+#define SHM_RING_FLAG_PARAMETER_SETS 0x1 /* The record holds the SPS and PPS of the stream */
+#define SHM_RING_FLAG_IDR 0x2            /* The frame has an IDR slice, decoding can start here */
+#define SHM_RING_FLAG_PADDING 0x4        /* Fills the end of the area, the next record is at its start */
+
+typedef struct shm_ring_header_s {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t data_size;
+    uint64_t reserve_pos;
+    uint64_t write_pos;
+    uint64_t sync_pos;
+    uint64_t frames;               /* Records published, padding excluded */
+    uint32_t parameter_sets_seq;   /* Odd while the writer updates the fields below */
+    uint32_t parameter_sets_size;
+    int32_t width;                 /* Of the current stream, 0 until parameter sets arrive */
+    int32_t height;
+    uint8_t parameter_sets[SHM_RING_MAX_PARAMETER_SETS];
+} shm_ring_header_t;
+
+typedef struct shm_ring_record_s {
+    uint32_t size;                 /* Bytes following the record header, without the padding */
+    uint32_t flags;
+    uint64_t pts;
+    uint64_t sequence;             /* Counts the records the writer published */
+} shm_ring_record_t;
+
+/* Writer, the object is named like for shm_open, e.g. "/rpiplay" */
+typedef struct shm_ring_s shm_ring_t;
+
+shm_ring_t *shm_ring_init(logger_t *logger, const char *name, unsigned int megabytes);
+/* Called with every frame before the renderer takes it, data must stay valid only for the call */
+void shm_ring_video(shm_ring_t *ring, const h264_decode_struct *data);
+void shm_ring_destroy(shm_ring_t *ring);
+
+/* Reader, the implementation of the protocol above for consumers that link the library */
+typedef struct shm_ring_reader_s {
+    const shm_ring_header_t *header;
+    const unsigned char *data;
+    uint64_t mapped_size;
+    uint64_t pos;
+    uint64_t lost;                 /* Times the reader fell behind and resynchronised */
+} shm_ring_reader_t;
+
+#define SHM_RING_READ_AGAIN 0
+#define SHM_RING_READ_SMALL_BUFFER -1 /* record->size tells the size the buffer needs */
+#define SHM_RING_READ_CLOSED -2       /* The writer went away, close and open again */
+
+int shm_ring_reader_open(shm_ring_reader_t *reader, const char *name);
+/**
+ * Copies the next record into buffer, returns its size or one of the SHM_RING_READ_ codes.
+ * After a resynchronisation, noted in lost, the frames up to the next IDR may not decode.
+ */
+int shm_ring_read(shm_ring_reader_t *reader, shm_ring_record_t *record, unsigned char *buffer, int buffer_size);
+/* The parameter sets of the current stream, 0 if there are none yet */
+int shm_ring_read_parameter_sets(shm_ring_reader_t *reader, unsigned char *buffer, int buffer_size);
+void shm_ring_reader_close(shm_ring_reader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SHM_RING_H
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "simd_kernels.h"
+#include "cpu_features.h"
+
+/* The plain C kernels, which every other table falls back to for the remainders */
+
+static void
+mix_add_scalar(int16_t *dst, const int16_t *src, int samples, int gain)
+{
+    for (int i = 0; i < samples; i++) {
+        int32_t sum = dst[i] + (((int32_t) src[i] * gain) >> 15);
+        dst[i] = sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : (int16_t) sum;
+    }
+}
+
+static void
+xor_bytes_scalar(const unsigned char *input, const unsigned char *keystream, unsigned char *output, size_t len)
+{
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t data, key;
+        memcpy(&data, input + i, sizeof(data));
+        memcpy(&key, keystream + i, sizeof(key));
+        data ^= key;
+        memcpy(output + i, &data, sizeof(data));
+    }
+    for (; i < len; i++) {
+        output[i] = input[i] ^ keystream[i];
+    }
+}
+
+static void
+resampler_interpolate_scalar(float *kernel, const float *h0, const float *h1, float a)
+{
+    for (int i = 0; i < SIMD_RESAMPLER_TAPS; i++) {
+        kernel[i] = h0[i] + (h1[i] - h0[i]) * a;
+    }
+}
+
+static float
+resampler_dot_scalar(const float *x, const float *kernel)
+{
+    float acc = 0;
+    for (int i = 0; i < SIMD_RESAMPLER_TAPS; i++) {
+        acc += x[i] * kernel[i];
+    }
+    return acc;
+}
+
+static void
+interleave_bytes_scalar(unsigned char *dst, const unsigned char *a, const unsigned char *b, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        dst[2 * i] = a[i];
+        dst[2 * i + 1] = b[i];
+    }
+}
+
+static const simd_kernels_t simd_kernels_scalar = {
+    "scalar",
+    mix_add_scalar,
+    xor_bytes_scalar,
+    resampler_interpolate_scalar,
+    resampler_dot_scalar,
+    interleave_bytes_scalar,
+};
+
+#if defined(__SSE2__)
+
+/* SSE2 is part of x86-64, whatever the build targets it can use these */
+
+static void
+mix_add_sse2(int16_t *dst, const int16_t *src, int samples, int gain)
+{
+    int i = 0;
+    if (gain == 32768) {
+        for (; i + 8 <= samples; i += 8) {
+            __m128i sum = _mm_adds_epi16(_mm_loadu_si128((const __m128i *) (dst + i)),
+                                         _mm_loadu_si128((const __m128i *) (src + i)));
+            _mm_storeu_si128((__m128i *) (dst + i), sum);
+        }
+    } else {
+        __m128i g = _mm_set1_epi16((int16_t) gain);
+        for (; i + 8 <= samples; i += 8) {
+            // The product shifted down by 15, put together from its high and low halves
+            __m128i x = _mm_loadu_si128((const __m128i *) (src + i));
+            __m128i scaled = _mm_or_si128(_mm_slli_epi16(_mm_mulhi_epi16(x, g), 1),
+                                          _mm_srli_epi16(_mm_mullo_epi16(x, g), 15));
+            __m128i sum = _mm_adds_epi16(_mm_loadu_si128((const __m128i *) (dst + i)), scaled);
+            _mm_storeu_si128((__m128i *) (dst + i), sum);
+        }
+    }
+    mix_add_scalar(dst + i, src + i, samples - i, gain);
+}
+
+static void
+xor_bytes_sse2(const unsigned char *input, const unsigned char *keystream, unsigned char *output, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i data = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (input + i)),
+                                     _mm_loadu_si128((const __m128i *) (keystream + i)));
+        _mm_storeu_si128((__m128i *) (output + i), data);
+    }
+    xor_bytes_scalar(input + i, keystream + i, output + i, len - i);
+}
+
+static void
+resampler_interpolate_sse2(float *kernel, const float *h0, const float *h1, float a)
+{
+    __m128 va = _mm_set1_ps(a);
+    for (int i = 0; i < SIMD_RESAMPLER_TAPS; i += 4) {
+        __m128 v0 = _mm_loadu_ps(h0 + i);
+        __m128 v1 = _mm_loadu_ps(h1 + i);
+        _mm_storeu_ps(kernel + i, _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), va)));
+    }
+}
+
+static float
+resampler_dot_sse2(const float *x, const float *kernel)
+{
+    __m128 acc = _mm_mul_ps(_mm_loadu_ps(x), _mm_loadu_ps(kernel));
+    for (int i = 4; i < SIMD_RESAMPLER_TAPS; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(kernel + i)));
+    }
+    __m128 sum = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+static void
+interleave_bytes_sse2(unsigned char *dst, const unsigned char *a, const unsigned char *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *) (a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *) (b + i));
+        _mm_storeu_si128((__m128i *) (dst + 2 * i), _mm_unpacklo_epi8(va, vb));
+        _mm_storeu_si128((__m128i *) (dst + 2 * i + 16), _mm_unpackhi_epi8(va, vb));
+    }
+    interleave_bytes_scalar(dst + 2 * i, a + i, b + i, count - i);
+}
+
+static const simd_kernels_t simd_kernels_sse2 = {
+    "sse2",
+    mix_add_sse2,
+    xor_bytes_sse2,
+    resampler_interpolate_sse2,
+    resampler_dot_sse2,
+    interleave_bytes_sse2,
+};
+
+#endif
+
+const simd_kernels_t *
+simd_kernels(void)
+{
+    unsigned int features = cpu_features();
+    const simd_kernels_t *kernels;
+
+    if ((features & CPU_FEATURE_AVX2) && (kernels = simd_kernels_avx2())) {
+        return kernels;
+    }
+    if ((features & CPU_FEATURE_NEON) && (kernels = simd_kernels_neon())) {
+        return kernels;
+    }
+#if defined(__SSE2__)
+    if (features & CPU_FEATURE_SSE2) {
+        return &simd_kernels_sse2;
+    }
+#endif
+    return &simd_kernels_scalar;
+}
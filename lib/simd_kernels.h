@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The vectorized inner loops of the library, in one table per instruction set. Every set is
+ * compiled in wherever the compiler can target it, AVX2 and 32 bit NEON from source files of
+ * their own built with just those instruction sets enabled, so one binary serves every CPU of
+ * its architecture. simd_kernels returns the table of the best set cpu_features finds.
+ *
+ * The kernels give the results of the plain C ones, but for the rounding of the float sums
+ * and NEON rounding the scaled samples of mix_add where C truncates.
+ */
+
+/* Taps of the resampler's polyphase filter, the length the resampler kernels work on */
+#define SIMD_RESAMPLER_TAPS 16
+
+typedef struct simd_kernels_s {
+    const char *name;
+    /* dst[i] = saturated dst[i] + ((src[i] * gain) >> 15), gain in Q15 up to 32768 */
+    void (*mix_add)(int16_t *dst, const int16_t *src, int samples, int gain);
+    /* output[i] = input[i] ^ keystream[i], input and output may be the same */
+    void (*xor_bytes)(const unsigned char *input, const unsigned char *keystream, unsigned char *output, size_t len);
+    /* kernel[i] = h0[i] + (h1[i] - h0[i]) * a, for SIMD_RESAMPLER_TAPS */
+    void (*resampler_interpolate)(float *kernel, const float *h0, const float *h1, float a);
+    /* The sum of x[i] * kernel[i], for SIMD_RESAMPLER_TAPS */
+    float (*resampler_dot)(const float *x, const float *kernel);
+    /* dst[2 * i] = a[i], dst[2 * i + 1] = b[i], for count bytes of each, e.g. U and V planes into NV12 */
+    void (*interleave_bytes)(unsigned char *dst, const unsigned char *a, const unsigned char *b, size_t count);
+} simd_kernels_t;
+
+const simd_kernels_t *simd_kernels(void);
+
+/* The tables of the sets that need compiler flags of their own, NULL where they were not built */
+const simd_kernels_t *simd_kernels_avx2(void);
+const simd_kernels_t *simd_kernels_neon(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SIMD_KERNELS_H
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Built with -mavx2 -mfma on x86, see lib/CMakeLists.txt. Nothing here may run before
+ * cpu_features has found both, so this file holds the kernels and nothing else.
+ */
+
+#include "simd_kernels.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+
+#include <immintrin.h>
+
+static void
+mix_add_avx2(int16_t *dst, const int16_t *src, int samples, int gain)
+{
+    int i = 0;
+    if (gain == 32768) {
+        for (; i + 16 <= samples; i += 16) {
+            __m256i sum = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i *) (dst + i)),
+                                            _mm256_loadu_si256((const __m256i *) (src + i)));
+            _mm256_storeu_si256((__m256i *) (dst + i), sum);
+        }
+    } else {
+        __m256i g = _mm256_set1_epi16((int16_t) gain);
+        for (; i + 16 <= samples; i += 16) {
+            // The product shifted down by 15, as in the SSE2 kernel
+            __m256i x = _mm256_loadu_si256((const __m256i *) (src + i));
+            __m256i scaled = _mm256_or_si256(_mm256_slli_epi16(_mm256_mulhi_epi16(x, g), 1),
+                                             _mm256_srli_epi16(_mm256_mullo_epi16(x, g), 15));
+            __m256i sum = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i *) (dst + i)), scaled);
+            _mm256_storeu_si256((__m256i *) (dst + i), sum);
+        }
+    }
+    for (; i < samples; i++) {
+        int32_t sum = dst[i] + (((int32_t) src[i] * gain) >> 15);
+        dst[i] = sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : (int16_t) sum;
+    }
+}
+
+static void
+xor_bytes_avx2(const unsigned char *input, const unsigned char *keystream, unsigned char *output, size_t len)
+{
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i data = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) (input + i)),
+                                        _mm256_loadu_si256((const __m256i *) (keystream + i)));
+        _mm256_storeu_si256((__m256i *) (output + i), data);
+    }
+    for (; i < len; i++) {
+        output[i] = input[i] ^ keystream[i];
+    }
+}
+
+static void
+resampler_interpolate_avx2(float *kernel, const float *h0, const float *h1, float a)
+{
+    __m256 va = _mm256_set1_ps(a);
+    for (int i = 0; i < SIMD_RESAMPLER_TAPS; i += 8) {
+        __m256 v0 = _mm256_loadu_ps(h0 + i);
+        __m256 v1 = _mm256_loadu_ps(h1 + i);
+        _mm256_storeu_ps(kernel + i, _mm256_fmadd_ps(_mm256_sub_ps(v1, v0), va, v0));
+    }
+}
+
+static float
+resampler_dot_avx2(const float *x, const float *kernel)
+{
+    __m256 acc = _mm256_mul_ps(_mm256_loadu_ps(x), _mm256_loadu_ps(kernel));
+    for (int i = 8; i < SIMD_RESAMPLER_TAPS; i += 8) {
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(kernel + i), acc);
+    }
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+static void
+interleave_bytes_avx2(unsigned char *dst, const unsigned char *a, const unsigned char *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *) (b + i));
+        // The unpacks work within 128 bit lanes, so the halves are put back in order after
+        __m256i lo = _mm256_unpacklo_epi8(va, vb);
+        __m256i hi = _mm256_unpackhi_epi8(va, vb);
+        _mm256_storeu_si256((__m256i *) (dst + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *) (dst + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    for (; i < count; i++) {
+        dst[2 * i] = a[i];
+        dst[2 * i + 1] = b[i];
+    }
+}
+
+static const simd_kernels_t simd_kernels_avx2_table = {
+    "avx2",
+    mix_add_avx2,
+    xor_bytes_avx2,
+    resampler_interpolate_avx2,
+    resampler_dot_avx2,
+    interleave_bytes_avx2,
+};
+
+const simd_kernels_t *
+simd_kernels_avx2(void)
+{
+    return &simd_kernels_avx2_table;
+}
+
+#else
+
+const simd_kernels_t *
+simd_kernels_avx2(void)
+{
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+/*
+ * Built with -mfpu=neon on 32 bit ARM, see lib/CMakeLists.txt, where armhf builds for the
+ * Pi 1 and Zero would otherwise leave NEON out. Nothing here may run before cpu_features
+ * has found it, so this file holds the kernels and nothing else. AArch64 always has NEON.
+ */
+
+#include "simd_kernels.h"
+
+#if defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+static void
+mix_add_neon(int16_t *dst, const int16_t *src, int samples, int gain)
+{
+    int i = 0;
+    if (gain == 32768) {
+        for (; i + 8 <= samples; i += 8) {
+            vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+        }
+    } else {
+        for (; i + 8 <= samples; i += 8) {
+            int16x8_t scaled = vqrdmulhq_n_s16(vld1q_s16(src + i), (int16_t) gain);
+            vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), scaled));
+        }
+    }
+    for (; i < samples; i++) {
+        int32_t sum = dst[i] + (((int32_t) src[i] * gain) >> 15);
+        dst[i] = sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : (int16_t) sum;
+    }
+}
+
+static void
+xor_bytes_neon(const unsigned char *input, const unsigned char *keystream, unsigned char *output, size_t len)
+{
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        vst1q_u8(output + i, veorq_u8(vld1q_u8(input + i), vld1q_u8(keystream + i)));
+    }
+    for (; i < len; i++) {
+        output[i] = input[i] ^ keystream[i];
+    }
+}
+
+static void
+resampler_interpolate_neon(float *kernel, const float *h0, const float *h1, float a)
+{
+    float32x4_t va = vdupq_n_f32(a);
+    for (int i = 0; i < SIMD_RESAMPLER_TAPS; i += 4) {
+        float32x4_t v0 = vld1q_f32(h0 + i);
+        float32x4_t v1 = vld1q_f32(h1 + i);
+        vst1q_f32(kernel + i, vmlaq_f32(v0, vsubq_f32(v1, v0), va));
+    }
+}
+
+static float
+resampler_dot_neon(const float *x, const float *kernel)
+{
+    float32x4_t acc = vmulq_f32(vld1q_f32(x), vld1q_f32(kernel));
+    for (int i = 4; i < SIMD_RESAMPLER_TAPS; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(x + i), vld1q_f32(kernel + i));
+    }
+#if defined(__aarch64__)
+    return vaddvq_f32(acc);
+#else
+    float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#endif
+}
+
+static void
+interleave_bytes_neon(unsigned char *dst, const unsigned char *a, const unsigned char *b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x2_t pair;
+        pair.val[0] = vld1q_u8(a + i);
+        pair.val[1] = vld1q_u8(b + i);
+        vst2q_u8(dst + 2 * i, pair);
+    }
+    for (; i < count; i++) {
+        dst[2 * i] = a[i];
+        dst[2 * i + 1] = b[i];
+    }
+}
+
+static const simd_kernels_t simd_kernels_neon_table = {
+    "neon",
+    mix_add_neon,
+    xor_bytes_neon,
+    resampler_interpolate_neon,
+    resampler_dot_neon,
+    interleave_bytes_neon,
+};
+
+const simd_kernels_t *
+simd_kernels_neon(void)
+{
+    return &simd_kernels_neon_table;
+}
+
+#else
+
+const simd_kernels_t *
+simd_kernels_neon(void)
+{
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "srtp.h"
+#include "crypto.h"
+
+#define SRTP_SESSION_AUTH_KEY_SIZE 20
+#define SRTP_LABEL_ENCRYPTION 0
+#define SRTP_LABEL_AUTH 1
+#define SRTP_LABEL_SALT 2
+#define SRTP_RTP_HEADER_LEN 12
+
+struct srtp_sender_s {
+    aes_ctx_t *cipher;
+    hmac_ctx_t *auth;
+    unsigned char salt[SRTP_MASTER_SALT_SIZE];
+
+    /* Rollover counter, the upper 32 bits of the packet index, and the last sequence number sent */
+    uint32_t roc;
+    uint16_t last_seq;
+    int started;
+};
+
+/* The AES-CM key derivation of RFC 3711 4.3.3, with a key derivation rate of 0 */
+static void
+srtp_derive(const unsigned char *master_key, const unsigned char *master_salt, int label,
+            unsigned char *out, int len)
+{
+    unsigned char iv[AES_128_BLOCK_SIZE] = {0};
+    memcpy(iv, master_salt, SRTP_MASTER_SALT_SIZE);
+    iv[7] ^= label;
+    memset(out, 0, len);
+    aes_ctx_t *ctx = aes_ctr_init(master_key, iv);
+    aes_ctr_encrypt(ctx, out, out, len);
+    aes_ctr_destroy(ctx);
+}
+
+srtp_sender_t *
+srtp_sender_init(const unsigned char *master_key, const unsigned char *master_salt)
+{
+    unsigned char key[SRTP_MASTER_KEY_SIZE];
+    unsigned char auth_key[SRTP_SESSION_AUTH_KEY_SIZE];
+    unsigned char iv[AES_128_BLOCK_SIZE] = {0};
+
+    assert(master_key);
+    assert(master_salt);
+
+    srtp_sender_t *srtp = calloc(1, sizeof(srtp_sender_t));
+    if (!srtp) {
+        return NULL;
+    }
+    srtp_derive(master_key, master_salt, SRTP_LABEL_ENCRYPTION, key, sizeof(key));
+    srtp_derive(master_key, master_salt, SRTP_LABEL_AUTH, auth_key, sizeof(auth_key));
+    srtp_derive(master_key, master_salt, SRTP_LABEL_SALT, srtp->salt, sizeof(srtp->salt));
+    srtp->cipher = aes_ctr_init(key, iv);
+    srtp->auth = hmac_sha1_init(auth_key, sizeof(auth_key));
+    memset(key, 0, sizeof(key));
+    memset(auth_key, 0, sizeof(auth_key));
+    if (!srtp->cipher || !srtp->auth) {
+        srtp_sender_destroy(srtp);
+        return NULL;
+    }
+    return srtp;
+}
+
+int
+srtp_sender_protect(srtp_sender_t *srtp, unsigned char *packet, int len)
+{
+    unsigned char iv[AES_128_BLOCK_SIZE] = {0};
+    unsigned char tag[SHA1_DIGEST_SIZE];
+
+    assert(srtp);
+    assert(len >= SRTP_RTP_HEADER_LEN);
+
+    int header_len = SRTP_RTP_HEADER_LEN + 4 * (packet[0] & 0x0f);
+    if ((packet[0] & 0x10) && header_len + 4 <= len) {
+        header_len += 4 + 4 * ((packet[header_len + 2] << 8) | packet[header_len + 3]);
+    }
+    if (header_len > len) {
+        header_len = len;
+    }
+
+    uint16_t seq = (packet[2] << 8) | packet[3];
+    if (srtp->started && seq < srtp->last_seq) {
+        srtp->roc++;
+    }
+    srtp->started = 1;
+    srtp->last_seq = seq;
+
+    /* IV = salt * 2^16 XOR SSRC * 2^64 XOR index * 2^16, RFC 3711 4.1.1 */
+    memcpy(iv, srtp->salt, SRTP_MASTER_SALT_SIZE);
+    for (int i = 0; i < 4; i++) {
+        iv[4 + i] ^= packet[8 + i];
+    }
+    iv[8] ^= srtp->roc >> 24;
+    iv[9] ^= srtp->roc >> 16;
+    iv[10] ^= srtp->roc >> 8;
+    iv[11] ^= srtp->roc;
+    iv[12] ^= seq >> 8;
+    iv[13] ^= seq;
+    aes_ctr_reset_iv(srtp->cipher, iv);
+    aes_ctr_encrypt(srtp->cipher, packet + header_len, packet + header_len, len - header_len);
+
+    /* The tag covers the packet and the rollover counter, which goes where the tag ends up */
+    packet[len] = srtp->roc >> 24;
+    packet[len + 1] = srtp->roc >> 16;
+    packet[len + 2] = srtp->roc >> 8;
+    packet[len + 3] = srtp->roc;
+    hmac_sha1(srtp->auth, packet, len + 4, tag);
+    memcpy(packet + len, tag, SRTP_AUTH_TAG_SIZE);
+    return len + SRTP_AUTH_TAG_SIZE;
+}
+
+void
+srtp_sender_destroy(srtp_sender_t *srtp)
+{
+    if (!srtp) {
+        return;
+    }
+    if (srtp->cipher) {
+        aes_ctr_destroy(srtp->cipher);
+    }
+    hmac_sha1_destroy(srtp->auth);
+    free(srtp);
+}
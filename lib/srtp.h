@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef SRTP_H
+#define SRTP_H
+
+#include <stdint.h>
+
+/*
+ * The sending side of SRTP (RFC 3711) with the AES_CM_128_HMAC_SHA1_80 profile, the one
+ * every browser offers over DTLS-SRTP. The session keys are derived from the master key and
+ * salt once, every packet is then encrypted with AES in counter mode and authenticated with
+ * an 80 bit HMAC-SHA1 tag. One SSRC per sender, whose packets are protected in the order
+ * they are sent.
+ *
+ * Named srtp_sender so as not to clash with libsrtp, which GStreamer plugins may load.
+ */
+
+#define SRTP_MASTER_KEY_SIZE 16
+#define SRTP_MASTER_SALT_SIZE 14
+#define SRTP_AUTH_TAG_SIZE 10
+
+typedef struct srtp_sender_s srtp_sender_t;
+
+srtp_sender_t *srtp_sender_init(const unsigned char *master_key, const unsigned char *master_salt);
+/* Protects the RTP packet of len bytes in place, packet needs room for SRTP_AUTH_TAG_SIZE more. Returns the new length */
+int srtp_sender_protect(srtp_sender_t *srtp, unsigned char *packet, int len);
+void srtp_sender_destroy(srtp_sender_t *srtp);
+
+#endif //SRTP_H
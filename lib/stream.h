@@ -16,6 +16,12 @@
 #define AIRPLAYSERVER_STREAM_H
 
 #include <stdint.h>
+#include "../renderers/h264-bitstream/h264_nal_index.h"
+
+typedef enum {
+    VIDEO_CODEC_H264,
+    VIDEO_CODEC_H265
+} video_codec_t;
 
 typedef struct {
     int n_gop_index;
@@ -25,12 +31,39 @@ typedef struct {
     int data_len;
     unsigned int n_time_stamp;
     uint64_t pts;
+    int is_idr; // The frame contains an IDR slice, decoding can start here
+    int is_reference; // Some slice has a non-zero nal_ref_idc, so later frames may depend on it
+    h264_nal_index_t nal_index; // Where each NAL unit of data starts
+    int width; // Stream geometry, only set for frame_type 0
+    int height;
+    int known_geometry; // The parameter sets of frame_type 0 were already seen earlier in the session
+    void *buffer_handle; // Set if data came from video_acquire_buffer and belongs to the renderer
+    uint64_t queued_time; // Local time the frame entered the render queue
+    int pipelined; // Queued while still arriving, the render thread hands it over in parts, see raop_rtp_mirror.c
+    int rendered; // The renderer took the frame in parts through video_process_nals, the rest only looks at it
+    video_codec_t codec; // Despite the name, data and nal_index may be H.265 as well
 } h264_decode_struct;
 
+typedef enum {
+    AUDIO_CODEC_ALAC,
+    AUDIO_CODEC_AAC_LC,
+    AUDIO_CODEC_AAC_ELD
+} audio_codec_t;
+
+// An audio stream as negotiated in SETUP, see audio_format.h
 typedef struct {
-    unsigned char *data;
+    audio_codec_t codec;
+    int sample_rate;
+    int channels;
+    int sample_size; // Bits per sample after decoding
+    int frame_samples; // Samples per channel in every packet
+} audio_format_t;
+
+typedef struct {
+    unsigned char *data; // NULL for a frame that was lost, pts is then where it should have played
     int data_len;
     uint64_t pts;
+    const audio_format_t *format; // Codec of data, the same for the whole stream
 } aac_decode_struct;
 
 #endif //AIRPLAYSERVER_STREAM_H
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sync_group.h"
+#include "threads.h"
+#include "reactor.h"
+#include "byteutils.h"
+#include "metrics.h"
+
+// Administratively scoped, so announcements stay on the local network
+#define SYNC_GROUP_ADDRESS "239.255.82.80"
+#define SYNC_GROUP_PORT 7010
+#define SYNC_GROUP_MAGIC "RPSG"
+#define SYNC_GROUP_VERSION 1
+// Magic, version and three reserved bytes, node id, delay in ms, NUL padded group name
+#define SYNC_GROUP_MESSAGE_SIZE (16 + SYNC_GROUP_MAX_NAME + 1)
+#define SYNC_GROUP_ANNOUNCE_MS 1000
+// A node that missed this many announcements left, its delay no longer counts
+#define SYNC_GROUP_EXPIRE_MS 5000
+#define SYNC_GROUP_MAX_PEERS 16
+// Beyond anything a renderer buffers, announcements above it are garbage
+#define SYNC_GROUP_MAX_DELAY_MS 10000
+
+typedef struct {
+    uint32_t id;
+    int delay_ms;
+    uint64_t last_seen;
+} sync_group_peer_t;
+
+struct sync_group_s {
+    logger_t *logger;
+    char name[SYNC_GROUP_MAX_NAME + 1];
+    uint32_t id;
+    int delay_ms;
+
+    int sock;
+    struct sockaddr_in group_addr;
+    reactor_t *reactor;
+    thread_handle_t thread;
+    int running;
+
+    // Only touched by the thread
+    sync_group_peer_t peers[SYNC_GROUP_MAX_PEERS];
+    int peer_count;
+
+    // The agreed delay in micro seconds, read by the renderers
+    int delay;
+};
+
+static uint64_t
+sync_group_now_ms(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000 + (uint64_t) time.tv_nsec / 1000000;
+}
+
+static void
+sync_group_announce(sync_group_t *sync_group)
+{
+    unsigned char message[SYNC_GROUP_MESSAGE_SIZE];
+    memset(message, 0, sizeof(message));
+    memcpy(message, SYNC_GROUP_MAGIC, 4);
+    message[4] = SYNC_GROUP_VERSION;
+    byteutils_put_int_be(message, 8, sync_group->id);
+    byteutils_put_int_be(message, 12, (uint32_t) sync_group->delay_ms);
+    memcpy(message + 16, sync_group->name, strlen(sync_group->name));
+    if (sendto(sync_group->sock, message, sizeof(message), 0, (struct sockaddr *) &sync_group->group_addr,
+               sizeof(sync_group->group_addr)) < 0) {
+        logger_log(sync_group->logger, LOGGER_DEBUG, "sync group could not announce itself: %d", errno);
+    }
+}
+
+static void
+sync_group_receive(sync_group_t *sync_group, uint64_t now)
+{
+    unsigned char message[SYNC_GROUP_MESSAGE_SIZE];
+    ssize_t len;
+    while ((len = recv(sync_group->sock, message, sizeof(message), MSG_DONTWAIT)) >= 0) {
+        if (len != SYNC_GROUP_MESSAGE_SIZE || memcmp(message, SYNC_GROUP_MAGIC, 4) || message[4] != SYNC_GROUP_VERSION) {
+            continue;
+        }
+        message[SYNC_GROUP_MESSAGE_SIZE - 1] = 0;
+        uint32_t id = byteutils_get_int_be(message, 8);
+        // Our own announcements loop back
+        if (id == sync_group->id || strcmp((const char *) message + 16, sync_group->name)) {
+            continue;
+        }
+        uint32_t delay_ms = byteutils_get_int_be(message, 12);
+        if (delay_ms > SYNC_GROUP_MAX_DELAY_MS) {
+            continue;
+        }
+        int i;
+        for (i = 0; i < sync_group->peer_count && sync_group->peers[i].id != id; i++);
+        if (i == sync_group->peer_count) {
+            if (i == SYNC_GROUP_MAX_PEERS) {
+                continue;
+            }
+            sync_group->peer_count++;
+            logger_log(sync_group->logger, LOGGER_INFO, "Node %08x joined sync group %s, it needs %u ms",
+                       id, sync_group->name, delay_ms);
+        }
+        sync_group->peers[i].id = id;
+        sync_group->peers[i].delay_ms = (int) delay_ms;
+        sync_group->peers[i].last_seen = now;
+    }
+}
+
+/* Forgets the nodes that went quiet and agrees on the largest delay of those left */
+static void
+sync_group_update(sync_group_t *sync_group, uint64_t now)
+{
+    int delay_ms = sync_group->delay_ms;
+    for (int i = 0; i < sync_group->peer_count;) {
+        sync_group_peer_t *peer = &sync_group->peers[i];
+        if (now - peer->last_seen > SYNC_GROUP_EXPIRE_MS) {
+            logger_log(sync_group->logger, LOGGER_INFO, "Node %08x left sync group %s", peer->id, sync_group->name);
+            *peer = sync_group->peers[--sync_group->peer_count];
+            continue;
+        }
+        if (peer->delay_ms > delay_ms) {
+            delay_ms = peer->delay_ms;
+        }
+        i++;
+    }
+    metrics_set(METRIC_SYNC_GROUP_NODES, sync_group->peer_count + 1);
+    int delay = delay_ms * 1000;
+    if (delay != ATOMIC_LOAD(sync_group->delay)) {
+        logger_log(sync_group->logger, LOGGER_INFO, "Sync group %s of %d nodes plays %d ms after the pts",
+                   sync_group->name, sync_group->peer_count + 1, delay_ms);
+        ATOMIC_STORE(sync_group->delay, delay);
+    }
+}
+
+static THREAD_RETVAL
+sync_group_thread(void *arg)
+{
+    sync_group_t *sync_group = arg;
+    int ready[1];
+    uint64_t next_announce = 0;
+
+    while (ATOMIC_LOAD(sync_group->running)) {
+        uint64_t now = sync_group_now_ms();
+        if (now >= next_announce) {
+            sync_group_announce(sync_group);
+            sync_group_update(sync_group, now);
+            next_announce = now + SYNC_GROUP_ANNOUNCE_MS;
+        }
+        int nready = reactor_wait(sync_group->reactor, ready, 1, (int) (next_announce - now));
+        if (nready < 0) {
+            logger_log(sync_group->logger, LOGGER_ERR, "sync group error in reactor wait");
+            break;
+        }
+        if (nready > 0) {
+            now = sync_group_now_ms();
+            sync_group_receive(sync_group, now);
+            sync_group_update(sync_group, now);
+        }
+    }
+    return 0;
+}
+
+sync_group_t *
+sync_group_init(logger_t *logger, const char *name, int delay_ms)
+{
+    sync_group_t *sync_group;
+    struct sockaddr_in addr;
+    struct ip_mreq mreq;
+    int reuse = 1;
+
+    assert(name);
+    assert(delay_ms >= 0);
+
+    sync_group = calloc(1, sizeof(sync_group_t));
+    if (!sync_group) {
+        return NULL;
+    }
+    sync_group->logger = logger;
+    snprintf(sync_group->name, sizeof(sync_group->name), "%s", name);
+    sync_group->delay_ms = delay_ms;
+    sync_group->delay = delay_ms * 1000;
+    sync_group->id = (uint32_t) getpid() * 2654435761u ^ (uint32_t) time(NULL) ^ (uint32_t) (uintptr_t) sync_group;
+
+    memset(&sync_group->group_addr, 0, sizeof(sync_group->group_addr));
+    sync_group->group_addr.sin_family = AF_INET;
+    sync_group->group_addr.sin_port = htons(SYNC_GROUP_PORT);
+    inet_pton(AF_INET, SYNC_GROUP_ADDRESS, &sync_group->group_addr.sin_addr);
+
+    sync_group->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sync_group->sock < 0) {
+        logger_log(logger, LOGGER_ERR, "sync group could not open a socket: %d", errno);
+        free(sync_group);
+        return NULL;
+    }
+    setsockopt(sync_group->sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#ifdef SO_REUSEPORT
+    setsockopt(sync_group->sock, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+#endif
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SYNC_GROUP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.imr_multiaddr = sync_group->group_addr.sin_addr;
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (bind(sync_group->sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        setsockopt(sync_group->sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        logger_log(logger, LOGGER_ERR, "sync group could not join %s port %d: %d", SYNC_GROUP_ADDRESS,
+                   SYNC_GROUP_PORT, errno);
+        close(sync_group->sock);
+        free(sync_group);
+        return NULL;
+    }
+
+    sync_group->reactor = reactor_init(logger);
+    if (!sync_group->reactor || reactor_add(sync_group->reactor, sync_group->sock) < 0) {
+        if (sync_group->reactor) reactor_destroy(sync_group->reactor);
+        close(sync_group->sock);
+        free(sync_group);
+        return NULL;
+    }
+
+    ATOMIC_STORE(sync_group->running, 1);
+    THREAD_CREATE(sync_group->thread, sync_group_thread, sync_group);
+    if (!sync_group->thread) {
+        reactor_destroy(sync_group->reactor);
+        close(sync_group->sock);
+        free(sync_group);
+        return NULL;
+    }
+    thread_set_name(sync_group->thread, "sync");
+    logger_log(logger, LOGGER_INFO, "Joined sync group %s, this node needs %d ms", sync_group->name, delay_ms);
+    return sync_group;
+}
+
+void
+sync_group_destroy(sync_group_t *sync_group)
+{
+    if (!sync_group) {
+        return;
+    }
+    ATOMIC_STORE(sync_group->running, 0);
+    reactor_wakeup(sync_group->reactor);
+    THREAD_JOIN(sync_group->thread);
+    reactor_destroy(sync_group->reactor);
+    close(sync_group->sock);
+    free(sync_group);
+}
+
+int64_t
+sync_group_get_delay(sync_group_t *sync_group)
+{
+    assert(sync_group);
+    return ATOMIC_LOAD(sync_group->delay);
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef SYNC_GROUP_H
+#define SYNC_GROUP_H
+
+#include <stdint.h>
+
+#include "logger.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Receivers in one room that play the same sender agree on a common playout delay. Every
+ * node announces the delay it needs on a multicast group of the local network once a second,
+ * and all of them play at the largest one heard in the last few seconds. The pts already
+ * stand for the sender's clock on every node, so frames then come out at the same instant
+ * everywhere, up to the accuracy of each node's NTP sync with the sender.
+ *
+ * Nodes only listen to announcements with their own group name. Their delay can change as
+ * nodes come and go, renderers read it once per frame.
+ */
+typedef struct sync_group_s sync_group_t;
+
+#define SYNC_GROUP_MAX_NAME 31
+
+sync_group_t *sync_group_init(logger_t *logger, const char *name, int delay_ms);
+void sync_group_destroy(sync_group_t *sync_group);
+
+/* The delay from a frame's pts to its playout that the group agreed on, in micro seconds */
+int64_t sync_group_get_delay(sync_group_t *sync_group);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //SYNC_GROUP_H
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "thermal.h"
+
+#ifdef __linux__
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+#include "threads.h"
+#include "metrics.h"
+
+#define THERMAL_THROTTLED_PATH "/sys/devices/platform/soc/soc:firmware/get_throttled"
+#define THERMAL_TEMPERATURE_PATH "/sys/class/thermal/thermal_zone0/temp"
+#define THERMAL_VCIO_PATH "/dev/vcio"
+#define THERMAL_MBOX_PROPERTY _IOWR(100, 0, char *)
+#define THERMAL_MBOX_TAG_GET_THROTTLED 0x00030046
+
+#define THERMAL_PRESSURE_FLAGS (THERMAL_FLAG_FREQUENCY_CAPPED | THERMAL_FLAG_THROTTLED | THERMAL_FLAG_SOFT_LIMIT)
+
+struct thermal_s {
+    logger_t *logger;
+    thermal_callback_t callback;
+    void *cls;
+
+    // Where the throttle flags come from, the mailbox only if the sysfs node is missing
+    int has_sysfs;
+    int vcio;
+    int has_temperature;
+
+    int pressure;
+    int calm_polls;
+
+    thread_handle_t thread;
+    mutex_handle_t wait_mutex;
+    cond_handle_t wait_cond;
+    int running;
+};
+
+/* Reads the first number in the file, -1 if there is none */
+static int
+thermal_read_number(const char *path, int base, long *value)
+{
+    char text[32];
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    int ret = fgets(text, sizeof(text), file) ? 0 : -1;
+    fclose(file);
+    if (ret == 0) {
+        char *end;
+        *value = strtol(text, &end, base);
+        if (end == text) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+/* The property interface of the VideoCore mailbox, as vcgencmd get_throttled uses it */
+static int
+thermal_read_mailbox(int vcio, long *flags)
+{
+    uint32_t message[7];
+    message[0] = sizeof(message);
+    message[1] = 0;
+    message[2] = THERMAL_MBOX_TAG_GET_THROTTLED;
+    message[3] = 4;
+    message[4] = 4;
+    message[5] = 0;
+    message[6] = 0;
+    if (ioctl(vcio, THERMAL_MBOX_PROPERTY, message) < 0 || message[1] != 0x80000000) {
+        return -1;
+    }
+    *flags = message[5];
+    return 0;
+}
+
+static int
+thermal_read_flags(thermal_t *thermal, long *flags)
+{
+    if (thermal->has_sysfs) {
+        return thermal_read_number(THERMAL_THROTTLED_PATH, 16, flags);
+    }
+    if (thermal->vcio >= 0) {
+        return thermal_read_mailbox(thermal->vcio, flags);
+    }
+    return -1;
+}
+
+static void
+thermal_poll(thermal_t *thermal)
+{
+    long flags = 0, temperature = 0;
+    int hot = 0;
+
+    if (thermal_read_flags(thermal, &flags) == 0) {
+        metrics_set(METRIC_THROTTLED_FLAGS, flags);
+        hot = (flags & THERMAL_PRESSURE_FLAGS) != 0;
+    }
+    if (thermal->has_temperature && thermal_read_number(THERMAL_TEMPERATURE_PATH, 10, &temperature) == 0) {
+        metrics_set(METRIC_SOC_TEMPERATURE, temperature);
+        hot |= temperature >= THERMAL_HOT_MILLI;
+    }
+
+    if (!thermal->pressure) {
+        if (hot) {
+            if (thermal->has_temperature) {
+                logger_log(thermal->logger, LOGGER_WARNING, "Throttling at %.1f C, flags 0x%lx, asking senders for less",
+                           temperature / 1000.0, flags);
+            } else {
+                logger_log(thermal->logger, LOGGER_WARNING, "Throttling, flags 0x%lx, asking senders for less", flags);
+            }
+            thermal->pressure = 1;
+            thermal->calm_polls = 0;
+            metrics_add(METRIC_THERMAL_PRESSURE_EVENTS, 1);
+            metrics_set(METRIC_THERMAL_PRESSURE, 1);
+            thermal->callback(thermal->cls, 1);
+        }
+        return;
+    }
+    // Clocks come back at once when the flags clear, so only the temperature makes sure it stays that way
+    if (hot || (thermal->has_temperature && temperature >= THERMAL_COOL_MILLI)) {
+        thermal->calm_polls = 0;
+    } else if (++thermal->calm_polls >= THERMAL_RECOVER_POLLS) {
+        logger_log(thermal->logger, LOGGER_INFO, "No longer throttled, back to the full profile");
+        thermal->pressure = 0;
+        metrics_set(METRIC_THERMAL_PRESSURE, 0);
+        thermal->callback(thermal->cls, 0);
+    }
+}
+
+static THREAD_RETVAL
+thermal_thread(void *arg)
+{
+    thermal_t *thermal = arg;
+
+    while (ATOMIC_LOAD(thermal->running)) {
+        thermal_poll(thermal);
+
+        struct timespec wait_time;
+        MUTEX_LOCK(thermal->wait_mutex);
+        clock_gettime(COND_CLOCK, &wait_time);
+        uint64_t wait_ns = (uint64_t) wait_time.tv_nsec + (uint64_t) THERMAL_POLL_MS * 1000000;
+        wait_time.tv_sec += wait_ns / 1000000000;
+        wait_time.tv_nsec = wait_ns % 1000000000;
+        if (ATOMIC_LOAD(thermal->running)) {
+            COND_TIMEDWAIT(thermal->wait_cond, thermal->wait_mutex, &wait_time);
+        }
+        MUTEX_UNLOCK(thermal->wait_mutex);
+    }
+    return 0;
+}
+
+thermal_t *
+thermal_init(logger_t *logger, thermal_callback_t callback, void *cls)
+{
+    thermal_t *thermal;
+    long value;
+
+    assert(callback);
+
+    thermal = calloc(1, sizeof(thermal_t));
+    if (!thermal) {
+        return NULL;
+    }
+    thermal->logger = logger;
+    thermal->callback = callback;
+    thermal->cls = cls;
+
+    thermal->has_sysfs = thermal_read_number(THERMAL_THROTTLED_PATH, 16, &value) == 0;
+    thermal->vcio = -1;
+    if (!thermal->has_sysfs) {
+        thermal->vcio = open(THERMAL_VCIO_PATH, O_RDONLY | O_CLOEXEC);
+        if (thermal->vcio >= 0 && thermal_read_mailbox(thermal->vcio, &value) < 0) {
+            close(thermal->vcio);
+            thermal->vcio = -1;
+        }
+    }
+    // The temperature alone would also throttle desktops whose thermal zone runs hotter by design
+    if (!thermal->has_sysfs && thermal->vcio < 0) {
+        logger_log(logger, LOGGER_DEBUG, "Found no firmware throttle flags to watch");
+        free(thermal);
+        return NULL;
+    }
+    thermal->has_temperature = thermal_read_number(THERMAL_TEMPERATURE_PATH, 10, &value) == 0;
+    logger_log(logger, LOGGER_DEBUG, "Watching the throttle flags %s%s", thermal->has_sysfs ? "in sysfs" : "in the mailbox",
+               thermal->has_temperature ? " and the temperature" : "");
+
+    MUTEX_CREATE(thermal->wait_mutex);
+    COND_CREATE(thermal->wait_cond);
+    ATOMIC_STORE(thermal->running, 1);
+    THREAD_CREATE(thermal->thread, thermal_thread, thermal);
+    if (!thermal->thread) {
+        COND_DESTROY(thermal->wait_cond);
+        MUTEX_DESTROY(thermal->wait_mutex);
+        if (thermal->vcio >= 0) close(thermal->vcio);
+        free(thermal);
+        return NULL;
+    }
+    thread_set_name(thermal->thread, "thermal");
+    return thermal;
+}
+
+void
+thermal_destroy(thermal_t *thermal)
+{
+    if (!thermal) {
+        return;
+    }
+    MUTEX_LOCK(thermal->wait_mutex);
+    ATOMIC_STORE(thermal->running, 0);
+    COND_SIGNAL(thermal->wait_cond);
+    MUTEX_UNLOCK(thermal->wait_mutex);
+    THREAD_JOIN(thermal->thread);
+    COND_DESTROY(thermal->wait_cond);
+    MUTEX_DESTROY(thermal->wait_mutex);
+    if (thermal->vcio >= 0) close(thermal->vcio);
+    free(thermal);
+}
+
+#else
+
+thermal_t *
+thermal_init(logger_t *logger, thermal_callback_t callback, void *cls)
+{
+    logger_log(logger, LOGGER_DEBUG, "Watching the throttle state needs Linux");
+    return NULL;
+}
+
+void
+thermal_destroy(thermal_t *thermal)
+{
+}
+
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include "logger.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Watches the SoC temperature and the firmware's throttle state, what vcgencmd get_throttled
+ * reports, and calls back when the receiver comes under thermal or power pressure and again
+ * once it recovered. Under pressure the firmware caps the clocks and the decoder falls behind,
+ * so the receiver is better off asking senders for less and dropping sooner.
+ *
+ * The throttle flags come from the firmware's sysfs node of recent kernels or else from the
+ * mailbox in /dev/vcio, the temperature from the first thermal zone. Pressure starts with any
+ * of the current throttled, frequency capped or soft limit flags, or at THERMAL_HOT_MILLI, and
+ * ends after THERMAL_RECOVER_POLLS polls in a row below THERMAL_COOL_MILLI without a flag.
+ * Linux only, and thermal_init returns NULL without the throttle flags, as anywhere but on a Pi.
+ */
+typedef struct thermal_s thermal_t;
+
+#define THERMAL_POLL_MS 2000
+#define THERMAL_HOT_MILLI 80000
+#define THERMAL_COOL_MILLI 75000
+#define THERMAL_RECOVER_POLLS 15
+
+/* Bits of get_throttled that are current, the ones above bit 16 only tell it happened since boot */
+#define THERMAL_FLAG_UNDER_VOLTAGE 0x1
+#define THERMAL_FLAG_FREQUENCY_CAPPED 0x2
+#define THERMAL_FLAG_THROTTLED 0x4
+#define THERMAL_FLAG_SOFT_LIMIT 0x8
+
+/* Runs on the watcher's own thread, pressure is 1 when it starts and 0 when it ends */
+typedef void (*thermal_callback_t)(void *cls, int pressure);
+
+thermal_t *thermal_init(logger_t *logger, thermal_callback_t callback, void *cls);
+void thermal_destroy(thermal_t *thermal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //THERMAL_H
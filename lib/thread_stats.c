@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "thread_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <time.h>
+
+/* More than the process runs with every renderer and a few sessions, the rest are left out */
+#define THREAD_STATS_MAX_THREADS 128
+
+/* The kernel's CPU clock of a thread, as glibc's pthread_getcpuclockid makes it: the negated
+ * id shifted past the flags for a per thread clock counting scheduled time */
+#define THREAD_STATS_CPU_CLOCK(tid) ((clockid_t) ((~(unsigned int) (tid) << 3) | 4 | 2))
+
+typedef struct thread_stats_entry_s {
+    int tid;
+    char name[16];
+    unsigned long long cpu_ns;
+    unsigned long long voluntary;
+    unsigned long long involuntary;
+} thread_stats_entry_t;
+
+static int
+thread_stats_append(char *text, int size, int length, const char *format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+static int
+thread_stats_append(char *text, int size, int length, const char *format, ...)
+{
+    if (length >= size) {
+        return length;
+    }
+    va_list args;
+    va_start(args, format);
+    length += vsnprintf(text + length, size - length, format, args);
+    va_end(args);
+    return length;
+}
+
+/* Fills in the name and switches of a thread, -1 if it is gone */
+static int
+thread_stats_read(thread_stats_entry_t *entry)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", entry->tid);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), file)) {
+        if (!strncmp(line, "Name:", 5)) {
+            sscanf(line + 5, " %15[^\n]", entry->name);
+        } else {
+            sscanf(line, "voluntary_ctxt_switches: %llu", &entry->voluntary);
+            sscanf(line, "nonvoluntary_ctxt_switches: %llu", &entry->involuntary);
+        }
+    }
+    fclose(file);
+
+    /* Label values are quoted, names are whatever the thread set */
+    for (char *c = entry->name; *c; c++) {
+        if (*c == '"' || *c == '\\') *c = '_';
+    }
+    struct timespec cpu;
+    if (clock_gettime(THREAD_STATS_CPU_CLOCK(entry->tid), &cpu) < 0) {
+        return -1;
+    }
+    entry->cpu_ns = (unsigned long long) cpu.tv_sec * 1000000000ull + cpu.tv_nsec;
+    return 0;
+}
+
+int
+thread_stats_format(char *text, int size)
+{
+    DIR *dir = opendir("/proc/self/task");
+    if (!dir) {
+        return 0;
+    }
+    thread_stats_entry_t *entries = calloc(THREAD_STATS_MAX_THREADS, sizeof(thread_stats_entry_t));
+    if (!entries) {
+        closedir(dir);
+        return 0;
+    }
+    int count = 0;
+    struct dirent *dirent;
+    while (count < THREAD_STATS_MAX_THREADS && (dirent = readdir(dir))) {
+        thread_stats_entry_t *entry = &entries[count];
+        entry->tid = atoi(dirent->d_name);
+        if (entry->tid > 0 && thread_stats_read(entry) == 0) {
+            count++;
+        } else {
+            memset(entry, 0, sizeof(thread_stats_entry_t));
+        }
+    }
+    closedir(dir);
+
+    int length = thread_stats_append(text, size, 0,
+                                     "# HELP rpiplay_thread_cpu_seconds_total CPU time of each thread\n"
+                                     "# TYPE rpiplay_thread_cpu_seconds_total counter\n");
+    for (int i = 0; i < count; i++) {
+        length = thread_stats_append(text, size, length,
+                                     "rpiplay_thread_cpu_seconds_total{thread=\"%s\",tid=\"%d\"} %llu.%09llu\n",
+                                     entries[i].name, entries[i].tid,
+                                     entries[i].cpu_ns / 1000000000ull, entries[i].cpu_ns % 1000000000ull);
+    }
+    length = thread_stats_append(text, size, length,
+                                 "# HELP rpiplay_thread_context_switches_total Times each thread gave up its CPU, "
+                                 "by waiting or by being preempted\n"
+                                 "# TYPE rpiplay_thread_context_switches_total counter\n");
+    for (int i = 0; i < count; i++) {
+        length = thread_stats_append(text, size, length,
+                                     "rpiplay_thread_context_switches_total{thread=\"%s\",tid=\"%d\",kind=\"voluntary\"} %llu\n"
+                                     "rpiplay_thread_context_switches_total{thread=\"%s\",tid=\"%d\",kind=\"involuntary\"} %llu\n",
+                                     entries[i].name, entries[i].tid, entries[i].voluntary,
+                                     entries[i].name, entries[i].tid, entries[i].involuntary);
+    }
+    free(entries);
+    return length;
+}
+
+#else
+
+int
+thread_stats_format(char *text, int size)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef THREAD_STATS_H
+#define THREAD_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * CPU time and context switches of every thread of the process, by the name it runs under, for
+ * telling which of them keeps a core busy when top only shows rpiplay. Covers the threads of
+ * the libraries too, like the OMX callbacks of the VideoCore host interface or GStreamer's
+ * streaming threads. The CPU time is that of each thread's CLOCK_THREAD_CPUTIME_ID, read from
+ * outside the thread, the switches come from /proc. Gathered when asked for, costs nothing
+ * otherwise. Linux only, elsewhere there is nothing to format.
+ */
+
+/* The figures of the threads alive right now in the Prometheus text format */
+int thread_stats_format(char *text, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //THREAD_STATS_H
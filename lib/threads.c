@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "threads.h"
+#include "alloc_watch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if !defined(WIN32)
+#include <sched.h>
+#endif
+
+static const char *thread_role_names[THREAD_ROLE_COUNT] = {
+    "httpd",
+    "worker",
+    "ntp",
+    "audio",
+    "mirror",
+    "render",
+    "adecode",
+};
+
+/* Written while parsing the command line, before any of the threads exist */
+static thread_config_t thread_role_configs[THREAD_ROLE_COUNT];
+
+const char *
+thread_role_name(thread_role_t role)
+{
+    assert(role >= 0 && role < THREAD_ROLE_COUNT);
+    return thread_role_names[role];
+}
+
+void
+thread_set_role_config(thread_role_t role, const thread_config_t *config)
+{
+    assert(role >= 0 && role < THREAD_ROLE_COUNT);
+    thread_role_configs[role] = *config;
+}
+
+/* A comma separated list of CPUs and ranges like 0,2-3 */
+static int
+thread_parse_cpus(const char *str, unsigned long long *cpus)
+{
+    *cpus = 0;
+    while (*str) {
+        char *end;
+        long first = strtol(str, &end, 10);
+        long last = first;
+        if (end == str) {
+            return -1;
+        }
+        if (*end == '-') {
+            str = end + 1;
+            last = strtol(str, &end, 10);
+            if (end == str) {
+                return -1;
+            }
+        }
+        if (first < 0 || last < first || last >= 64) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            *cpus |= 1ull << cpu;
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end) {
+            return -1;
+        }
+        str = end;
+    }
+    return 0;
+}
+
+int
+thread_config_parse(const char *spec, thread_role_t *role, thread_config_t *config)
+{
+    char buffer[128];
+    char *fields[4] = { NULL };
+    int count = 0;
+
+    if (strlen(spec) >= sizeof(buffer)) {
+        return -1;
+    }
+    strcpy(buffer, spec);
+    for (char *field = buffer; field && count < 4; count++) {
+        fields[count] = field;
+        field = strchr(field, ':');
+        if (field) {
+            *field++ = '\0';
+        }
+    }
+    if (count < 2) {
+        return -1;
+    }
+
+    int found = -1;
+    for (int i = 0; i < THREAD_ROLE_COUNT; i++) {
+        if (!strcmp(fields[0], thread_role_names[i])) {
+            found = i;
+        }
+    }
+    if (found < 0) {
+        return -1;
+    }
+    *role = found;
+
+    memset(config, 0, sizeof(*config));
+    if (!strcmp(fields[1], "fifo")) {
+        config->policy = THREAD_POLICY_FIFO;
+    } else if (!strcmp(fields[1], "rr")) {
+        config->policy = THREAD_POLICY_RR;
+    } else if (!strcmp(fields[1], "other")) {
+        config->policy = THREAD_POLICY_DEFAULT;
+    } else {
+        return -1;
+    }
+
+    if (fields[2]) {
+        config->priority = atoi(fields[2]);
+    } else if (config->policy != THREAD_POLICY_DEFAULT) {
+        config->priority = 1;
+    }
+    if (config->policy == THREAD_POLICY_DEFAULT ? config->priority != 0 :
+        config->priority < 1 || config->priority > 99) {
+        return -1;
+    }
+
+    if (fields[3] && thread_parse_cpus(fields[3], &config->cpus) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int
+thread_apply_role(thread_handle_t handle, thread_role_t role)
+{
+    const thread_config_t *config;
+    int ret = 0;
+
+    assert(role >= 0 && role < THREAD_ROLE_COUNT);
+    config = &thread_role_configs[role];
+    alloc_watch_set_role(handle, role);
+
+#if defined(WIN32)
+    (void) config;
+#else
+#if defined(__linux__)
+    thread_set_name(handle, thread_role_names[role]);
+
+    if (config->cpus) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu = 0; cpu < 64; cpu++) {
+            if (config->cpus & (1ull << cpu)) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (pthread_setaffinity_np(handle, sizeof(set), &set)) {
+            ret = -1;
+        }
+    }
+#endif
+
+    if (config->policy != THREAD_POLICY_DEFAULT) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = config->priority;
+        if (pthread_setschedparam(handle, config->policy == THREAD_POLICY_FIFO ? SCHED_FIFO : SCHED_RR, &param)) {
+            ret = -1;
+        }
+    }
+#endif
+
+    return ret;
+}
+
+void
+thread_set_name(thread_handle_t handle, const char *name)
+{
+#if defined(__linux__)
+    /* Linux allows 15 characters */
+    char thread_name[16];
+    snprintf(thread_name, sizeof(thread_name), "rpiplay-%s", name);
+    pthread_setname_np(handle, thread_name);
+#else
+    (void) handle;
+    (void) name;
+#endif
+}
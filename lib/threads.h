@@ -38,6 +38,7 @@ typedef HANDLE mutex_handle_t;
 
 #include <pthread.h>
 #include <unistd.h>
+#include <time.h>
 
 #define sleepms(x) usleep((x)*1000)
 
@@ -57,10 +58,82 @@ typedef pthread_cond_t cond_handle_t;
 #define MUTEX_UNLOCK(handle) pthread_mutex_unlock(&(handle))
 #define MUTEX_DESTROY(handle) pthread_mutex_destroy(&(handle))
 
+#if defined(__APPLE__)
+/* pthread_cond_timedwait on macOS only knows the wall clock */
+#define COND_CLOCK CLOCK_REALTIME
 #define COND_CREATE(handle) pthread_cond_init(&(handle), NULL)
+#else
+/* Timed waits run on the monotonic clock, so setting the system time does not stretch them */
+#define COND_CLOCK CLOCK_MONOTONIC
+static inline int cond_create_monotonic(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int ret = pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+    return ret;
+}
+#define COND_CREATE(handle) cond_create_monotonic(&(handle))
+#endif
 #define COND_SIGNAL(handle) pthread_cond_signal(&(handle))
+#define COND_BROADCAST(handle) pthread_cond_broadcast(&(handle))
+#define COND_WAIT(handle, mutex) pthread_cond_wait(&(handle), &(mutex))
+/* abstime is a struct timespec * on COND_CLOCK */
+#define COND_TIMEDWAIT(handle, mutex, abstime) pthread_cond_timedwait(&(handle), &(mutex), abstime)
 #define COND_DESTROY(handle) pthread_cond_destroy(&(handle))
 
 #endif
 
+/*
+ * Lock-free access to ints shared between threads, like run flags checked on every loop iteration.
+ * These are the GCC/Clang builtins behind C11 stdatomic.h, which also work on plain ints and in C++.
+ */
+#define ATOMIC_LOAD(var) __atomic_load_n(&(var), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(var, value) __atomic_store_n(&(var), (value), __ATOMIC_RELEASE)
+#define ATOMIC_EXCHANGE(var, value) __atomic_exchange_n(&(var), (value), __ATOMIC_ACQ_REL)
+#define ATOMIC_FETCH_OR(var, value) __atomic_fetch_or(&(var), (value), __ATOMIC_ACQ_REL)
+#define ATOMIC_FETCH_ADD(var, value) __atomic_fetch_add(&(var), (value), __ATOMIC_ACQ_REL)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Threads with deadlines of their own, each role can get a name, a scheduling policy and CPUs */
+typedef enum thread_role_e {
+    THREAD_ROLE_HTTPD,
+    THREAD_ROLE_WORKER,
+    THREAD_ROLE_NTP,
+    THREAD_ROLE_AUDIO,
+    THREAD_ROLE_MIRROR,
+    THREAD_ROLE_RENDER,
+    THREAD_ROLE_ADECODE,
+    THREAD_ROLE_COUNT
+} thread_role_t;
+
+typedef enum thread_policy_e {
+    THREAD_POLICY_DEFAULT,
+    THREAD_POLICY_FIFO,
+    THREAD_POLICY_RR
+} thread_policy_t;
+
+typedef struct thread_config_s {
+    thread_policy_t policy;
+    int priority;               /* 1 to 99 for FIFO and RR */
+    unsigned long long cpus;    /* Bit n allows CPU n, 0 leaves the affinity alone */
+} thread_config_t;
+
+/* Parses role:policy[:priority[:cpus]], e.g. audio:fifo:50:3 or mirror:other:0:1-2, returns -1 if invalid */
+int thread_config_parse(const char *spec, thread_role_t *role, thread_config_t *config);
+void thread_set_role_config(thread_role_t role, const thread_config_t *config);
+const char *thread_role_name(thread_role_t role);
+
+/* Names the thread after its role and applies the configured settings, -1 if they were refused */
+int thread_apply_role(thread_handle_t handle, thread_role_t role);
+/* Names a thread without a role rpiplay-name, for top and the thread metrics, name is cut at 7 characters */
+void thread_set_name(thread_handle_t handle, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* THREADS_H */
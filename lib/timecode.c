@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "timecode.h"
+
+#define TIMECODE_THRESHOLD ((TIMECODE_BLACK + TIMECODE_WHITE) / 2)
+
+/* Neither an all black nor an all white picture passes */
+static uint8_t
+timecode_checksum(uint64_t time)
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < TIMECODE_TIME_BITS / 8; i++) {
+        sum += (uint8_t) (time >> (i * 8));
+    }
+    return sum ^ 0x5a;
+}
+
+void
+timecode_render(uint8_t *luma, int width, int height, int stride, uint64_t time)
+{
+    uint64_t code = (time << 8) | timecode_checksum(time);
+    for (int y = 0; y < height; y++) {
+        int row = y * TIMECODE_ROWS / height;
+        for (int x = 0; x < width; x++) {
+            int bit = row * TIMECODE_COLUMNS + x * TIMECODE_COLUMNS / width;
+            luma[y * stride + x] = (code >> (63 - bit)) & 1 ? TIMECODE_WHITE : TIMECODE_BLACK;
+        }
+    }
+}
+
+bool
+timecode_read(const uint8_t *data, int width, int height, int stride, int pixel_stride, uint64_t *time)
+{
+    if (width < TIMECODE_COLUMNS || height < TIMECODE_ROWS) {
+        return false;
+    }
+    uint64_t code = 0;
+    for (int row = 0; row < TIMECODE_ROWS; row++) {
+        int y = (2 * row + 1) * height / (2 * TIMECODE_ROWS);
+        for (int column = 0; column < TIMECODE_COLUMNS; column++) {
+            int x = (2 * column + 1) * width / (2 * TIMECODE_COLUMNS);
+            code = (code << 1) | (data[y * stride + x * pixel_stride] >= TIMECODE_THRESHOLD);
+        }
+    }
+    uint64_t value = code >> 8;
+    if (value == 0 || (uint8_t) code != timecode_checksum(value)) {
+        return false;
+    }
+    *time = value;
+    return true;
+}
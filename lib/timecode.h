@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef TIMECODE_H
+#define TIMECODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Machine readable timecode for glass-to-glass latency measurements. The picture is cut into a
+ * grid of TIMECODE_COLUMNS by TIMECODE_ROWS cells, each one black or white for one bit of a 56
+ * bit wall clock time in micro seconds and an 8 bit checksum, most significant bit top left.
+ * Reading only samples the centre of every cell, so the code survives scaling and any format
+ * whose first component is 8 bit.
+ */
+#define TIMECODE_COLUMNS 16
+#define TIMECODE_ROWS 4
+#define TIMECODE_TIME_BITS 56
+#define TIMECODE_BLACK 16
+#define TIMECODE_WHITE 235
+
+/* Fills the whole of a luma plane with the timecode of time */
+void timecode_render(uint8_t *luma, int width, int height, int stride, uint64_t time);
+/* Returns false if the picture carries no timecode or a damaged one */
+bool timecode_read(const uint8_t *data, int width, int height, int stride, int pixel_stride, uint64_t *time);
+
+#endif //TIMECODE_H
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "threads.h"
+
+/* How often the background thread hands the dirty pages to the kernel for writing */
+#define TRACE_FLUSH_INTERVAL_MS 1000
+/* Keeps the ring from being wiped out by a single huge record */
+#define TRACE_MAX_RECORD_SHARE 4
+
+#define TRACE_ALIGNED(n) (((n) + TRACE_ALIGN - 1) & ~(uint64_t) (TRACE_ALIGN - 1))
+
+typedef struct trace_s {
+    logger_t *logger;
+    int fd;
+    unsigned char *map;
+    uint64_t map_size;
+    trace_file_header_t *header;
+    unsigned char *ring;
+
+    /* Record writers, taken for the memcpy of a single record only. Created once and never
+     * destroyed, a writer may still be waiting for it as tracing stops. */
+    mutex_handle_t mutex;
+    int mutex_created;
+
+    int running;
+    thread_handle_t thread;
+    mutex_handle_t run_mutex;
+    cond_handle_t run_cond;
+} trace_t;
+
+atomic_int trace_active;
+
+static trace_t trace;
+
+static THREAD_RETVAL
+trace_flush_thread(void *arg)
+{
+    MUTEX_LOCK(trace.run_mutex);
+    while (trace.running) {
+        struct timespec deadline;
+        clock_gettime(COND_CLOCK, &deadline);
+        deadline.tv_sec += TRACE_FLUSH_INTERVAL_MS / 1000;
+        COND_TIMEDWAIT(trace.run_cond, trace.run_mutex, &deadline);
+        /* Only schedules the writeback, the media threads never wait for the disk */
+        msync(trace.map, trace.map_size, MS_ASYNC);
+    }
+    MUTEX_UNLOCK(trace.run_mutex);
+    return 0;
+}
+
+int
+trace_start(logger_t *logger, const char *path, uint64_t size)
+{
+    assert(logger);
+    assert(path);
+
+    if (trace.map) {
+        logger_log(logger, LOGGER_WARNING, "trace already recording");
+        return -1;
+    }
+    size = TRACE_ALIGNED(size);
+    if (size < 64 * 1024) {
+        logger_log(logger, LOGGER_ERR, "trace ring of %llu bytes is too small", (unsigned long long) size);
+        return -1;
+    }
+
+    /* The file holds the session keys */
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        logger_log(logger, LOGGER_ERR, "trace could not open %s %d %s", path, errno, strerror(errno));
+        return -1;
+    }
+    uint64_t map_size = sizeof(trace_file_header_t) + size;
+    /* Allocating the blocks up front keeps page faults on the media threads cheap */
+    int ret = posix_fallocate(fd, 0, map_size);
+    if (ret != 0) {
+        logger_log(logger, LOGGER_ERR, "trace could not allocate %llu bytes for %s %d %s",
+                   (unsigned long long) map_size, path, ret, strerror(ret));
+        close(fd);
+        return -1;
+    }
+    unsigned char *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        logger_log(logger, LOGGER_ERR, "trace could not map %s %d %s", path, errno, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (!trace.mutex_created) {
+        MUTEX_CREATE(trace.mutex);
+        trace.mutex_created = 1;
+    }
+    MUTEX_LOCK(trace.mutex);
+    trace.logger = logger;
+    trace.fd = fd;
+    trace.map = map;
+    trace.map_size = map_size;
+    trace.header = (trace_file_header_t *) map;
+    trace.ring = map + sizeof(trace_file_header_t);
+    memcpy(trace.header->magic, TRACE_MAGIC, sizeof(trace.header->magic));
+    trace.header->version = TRACE_VERSION;
+    trace.header->header_size = sizeof(trace_file_header_t);
+    trace.header->ring_size = size;
+    trace.header->tail = 0;
+    trace.header->used = 0;
+    trace.header->head = 0;
+    trace.header->records = 0;
+    trace.header->dropped = 0;
+    MUTEX_UNLOCK(trace.mutex);
+
+    MUTEX_CREATE(trace.run_mutex);
+    COND_CREATE(trace.run_cond);
+    trace.running = 1;
+    THREAD_CREATE(trace.thread, trace_flush_thread, NULL);
+    if (trace.thread) thread_set_name(trace.thread, "trace");
+
+    atomic_store_explicit(&trace_active, 1, memory_order_release);
+    logger_log(logger, LOGGER_INFO, "trace recording into %s, keeping the last %llu MB", path,
+               (unsigned long long) (size >> 20));
+    return 0;
+}
+
+void
+trace_stop(void)
+{
+    if (!trace.map) {
+        return;
+    }
+    atomic_store_explicit(&trace_active, 0, memory_order_release);
+
+    MUTEX_LOCK(trace.run_mutex);
+    trace.running = 0;
+    COND_SIGNAL(trace.run_cond);
+    MUTEX_UNLOCK(trace.run_mutex);
+    THREAD_JOIN(trace.thread);
+
+    /* Waits for a record that was being written when tracing got turned off */
+    MUTEX_LOCK(trace.mutex);
+    logger_log(trace.logger, LOGGER_INFO, "trace stopped after %llu records, %llu too large to keep",
+               (unsigned long long) trace.header->records, (unsigned long long) trace.header->dropped);
+    msync(trace.map, trace.map_size, MS_SYNC);
+    munmap(trace.map, trace.map_size);
+    close(trace.fd);
+    trace.map = NULL;
+    trace.header = NULL;
+    trace.ring = NULL;
+    MUTEX_UNLOCK(trace.mutex);
+
+    COND_DESTROY(trace.run_cond);
+    MUTEX_DESTROY(trace.run_mutex);
+}
+
+/* Frees the oldest record, must hold the mutex */
+static void
+trace_evict_oldest(trace_file_header_t *header, const unsigned char *ring)
+{
+    uint64_t left = header->ring_size - header->tail;
+    uint64_t size;
+    if (left < sizeof(trace_record_header_t)) {
+        size = left;
+    } else {
+        const trace_record_header_t *record = (const trace_record_header_t *) (ring + header->tail);
+        size = record->type == TRACE_RECORD_PAD ? left : TRACE_ALIGNED(sizeof(trace_record_header_t) + record->length);
+    }
+    header->tail = (header->tail + size) % header->ring_size;
+    header->used -= size;
+}
+
+void
+trace_record(trace_record_type_t type, uint64_t time, const void *header, unsigned int header_len,
+             const void *payload, unsigned int payload_len)
+{
+    if (!trace_enabled()) {
+        return;
+    }
+
+    MUTEX_LOCK(trace.mutex);
+    if (!trace.map) {
+        MUTEX_UNLOCK(trace.mutex);
+        return;
+    }
+    trace_file_header_t *file = trace.header;
+    uint64_t length = (uint64_t) header_len + payload_len;
+    uint64_t size = TRACE_ALIGNED(sizeof(trace_record_header_t) + length);
+    if (size > file->ring_size / TRACE_MAX_RECORD_SHARE) {
+        file->dropped++;
+        MUTEX_UNLOCK(trace.mutex);
+        return;
+    }
+
+    /* A record never wraps, the end of the ring is skipped if it does not fit there */
+    uint64_t waste = file->ring_size - file->head < size ? file->ring_size - file->head : 0;
+    while (file->used + waste + size > file->ring_size) {
+        trace_evict_oldest(file, trace.ring);
+    }
+    if (waste) {
+        if (waste >= sizeof(trace_record_header_t)) {
+            trace_record_header_t *pad = (trace_record_header_t *) (trace.ring + file->head);
+            pad->length = waste - sizeof(trace_record_header_t);
+            pad->type = TRACE_RECORD_PAD;
+            pad->reserved = 0;
+            pad->time = time;
+        }
+        file->used += waste;
+        file->head = 0;
+    }
+
+    trace_record_header_t *record = (trace_record_header_t *) (trace.ring + file->head);
+    record->length = length;
+    record->type = type;
+    record->reserved = 0;
+    record->time = time;
+    unsigned char *data = (unsigned char *) (record + 1);
+    if (header_len) memcpy(data, header, header_len);
+    if (payload_len) memcpy(data + header_len, payload, payload_len);
+    file->head = (file->head + size) % file->ring_size;
+    file->used += size;
+    file->records++;
+    MUTEX_UNLOCK(trace.mutex);
+}
+
+struct trace_reader_s {
+    unsigned char *data;
+    trace_file_header_t header;
+    const unsigned char *ring;
+    uint64_t position;
+    uint64_t left;
+};
+
+trace_reader_t *
+trace_reader_open(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    trace_reader_t *reader = calloc(1, sizeof(trace_reader_t));
+    if (!reader) {
+        fclose(file);
+        return NULL;
+    }
+    if (fread(&reader->header, sizeof(reader->header), 1, file) != 1 ||
+        memcmp(reader->header.magic, TRACE_MAGIC, sizeof(reader->header.magic)) ||
+        reader->header.version != TRACE_VERSION || reader->header.header_size != sizeof(trace_file_header_t) ||
+        reader->header.used > reader->header.ring_size || reader->header.tail >= reader->header.ring_size) {
+        free(reader);
+        fclose(file);
+        return NULL;
+    }
+    reader->data = malloc(reader->header.ring_size);
+    if (!reader->data || fread(reader->data, 1, reader->header.ring_size, file) != reader->header.ring_size) {
+        free(reader->data);
+        free(reader);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    reader->ring = reader->data;
+    reader->position = reader->header.tail;
+    reader->left = reader->header.used;
+    return reader;
+}
+
+const unsigned char *
+trace_reader_next(trace_reader_t *reader, trace_record_header_t *record)
+{
+    assert(reader);
+    assert(record);
+
+    uint64_t ring_size = reader->header.ring_size;
+    while (reader->left > 0) {
+        uint64_t end_left = ring_size - reader->position;
+        if (end_left < sizeof(trace_record_header_t)) {
+            reader->left -= end_left < reader->left ? end_left : reader->left;
+            reader->position = 0;
+            continue;
+        }
+        memcpy(record, reader->ring + reader->position, sizeof(*record));
+        uint64_t size = record->type == TRACE_RECORD_PAD ? end_left :
+                        TRACE_ALIGNED(sizeof(trace_record_header_t) + record->length);
+        if (size > end_left || size > reader->left) {
+            /* Cut off, e.g. by a crash in the middle of a record */
+            reader->left = 0;
+            return NULL;
+        }
+        const unsigned char *payload = reader->ring + reader->position + sizeof(trace_record_header_t);
+        reader->position = (reader->position + size) % ring_size;
+        reader->left -= size;
+        if (record->type != TRACE_RECORD_PAD) {
+            return payload;
+        }
+    }
+    return NULL;
+}
+
+void
+trace_reader_close(trace_reader_t *reader)
+{
+    if (reader) {
+        free(reader->data);
+        free(reader);
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "logger.h"
+
+/*
+ * Binary trace of what the senders sent, for replaying sessions offline. Records go into a
+ * fixed size memory mapped ring file: once it is full the oldest records are overwritten, so a
+ * trace can stay enabled on a production receiver and always holds the latest minutes.
+ *
+ * File layout, all integers in host byte order:
+ *   trace_file_header_t, then the ring of header.ring_size bytes. The valid records start at
+ *   header.tail and span header.used bytes, wrapping around at the end of the ring. Records are
+ *   aligned to TRACE_ALIGN bytes. A TRACE_RECORD_PAD record, or a gap too short for a record
+ *   header, fills the end of the ring whenever the next record did not fit there.
+ *
+ * The file holds the session keys, whoever can read it can decrypt the recorded streams.
+ */
+#define TRACE_MAGIC "RPITRACE"
+#define TRACE_VERSION 1
+#define TRACE_ALIGN 8
+
+typedef enum trace_record_type_e {
+    TRACE_RECORD_PAD = 0,
+    /* trace_session_keys_t, written at the SETUP that starts a session */
+    TRACE_RECORD_SESSION_KEYS = 1,
+    /* 64 bit streamConnectionID the mirror stream keys are derived from */
+    TRACE_RECORD_MIRROR_STREAM = 2,
+    /* 128 byte mirror packet header followed by the still encrypted payload */
+    TRACE_RECORD_MIRROR_PACKET = 3,
+    /* Audio RTP packet as received on the data port */
+    TRACE_RECORD_RTP_DATA = 4,
+    /* Packet as received on the audio control port, sync packets and answered resends */
+    TRACE_RECORD_RTP_CONTROL = 5,
+    /* NTP response as received on the timing port */
+    TRACE_RECORD_NTP_RESPONSE = 6,
+} trace_record_type_t;
+
+typedef struct trace_file_header_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t ring_size;
+    uint64_t tail;
+    uint64_t used;
+    uint64_t head;
+    uint64_t records;
+    uint64_t dropped;
+} trace_file_header_t;
+
+typedef struct trace_record_header_s {
+    /* Payload bytes following the header, without the alignment padding */
+    uint32_t length;
+    uint16_t type;
+    uint16_t reserved;
+    /* Local time in micro seconds the data arrived, as raop_ntp_get_local_time */
+    uint64_t time;
+} trace_record_header_t;
+
+typedef struct trace_session_keys_s {
+    /* FairPlay decrypted key, the one raop_rtp_init and raop_rtp_mirror_init take */
+    unsigned char aeskey[16];
+    unsigned char aesiv[16];
+    unsigned char ecdh_secret[32];
+} trace_session_keys_t;
+
+extern atomic_int trace_active;
+
+/* Whether records are being written, cheap enough to check per packet */
+static inline int
+trace_enabled(void)
+{
+    return atomic_load_explicit(&trace_active, memory_order_relaxed);
+}
+
+/* Starts recording into a ring file of size bytes at path, which is created or reset */
+int trace_start(logger_t *logger, const char *path, uint64_t size);
+void trace_stop(void);
+
+/* Appends a record made of header and payload, either of which may be empty. Does nothing
+ * while tracing is off. */
+void trace_record(trace_record_type_t type, uint64_t time, const void *header, unsigned int header_len,
+                  const void *payload, unsigned int payload_len);
+
+/* Sequential reading of a trace file, oldest record first */
+typedef struct trace_reader_s trace_reader_t;
+
+trace_reader_t *trace_reader_open(const char *path);
+/* Returns the payload of the next record and fills in its header, NULL after the last one */
+const unsigned char *trace_reader_next(trace_reader_t *reader, trace_record_header_t *record);
+void trace_reader_close(trace_reader_t *reader);
+
+#endif //TRACE_H
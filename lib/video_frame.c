@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "video_frame.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "threads.h"
+
+struct video_frame_s {
+    int refs;
+    h264_decode_struct data;
+    video_frame_free_t free_func;
+    void *opaque;
+
+    /* The pool the frame goes back to, NULL if it was allocated on its own */
+    video_frame_pool_t *pool;
+    video_frame_t *next_free;
+};
+
+struct video_frame_pool_s {
+    mutex_handle_t mutex;
+    video_frame_t *frames;
+    video_frame_t *free_frames;
+    int in_use;
+    int destroyed;
+};
+
+static void
+video_frame_init(video_frame_t *frame, const h264_decode_struct *data, video_frame_free_t free_func, void *opaque)
+{
+    frame->refs = 1;
+    frame->data = *data;
+    frame->free_func = free_func;
+    frame->opaque = opaque;
+}
+
+video_frame_t *
+video_frame_wrap(const h264_decode_struct *data, video_frame_free_t free_func, void *opaque)
+{
+    video_frame_t *frame;
+
+    assert(data);
+    assert(free_func);
+
+    frame = malloc(sizeof(video_frame_t));
+    if (!frame) {
+        return NULL;
+    }
+    video_frame_init(frame, data, free_func, opaque);
+    frame->pool = NULL;
+    frame->next_free = NULL;
+    return frame;
+}
+
+video_frame_t *
+video_frame_acquire(video_frame_t *frame)
+{
+    assert(frame);
+    ATOMIC_FETCH_ADD(frame->refs, 1);
+    return frame;
+}
+
+static void
+video_frame_pool_free(video_frame_pool_t *pool)
+{
+    MUTEX_DESTROY(pool->mutex);
+    free(pool->frames);
+    free(pool);
+}
+
+/* Gives a frame back to its pool, the last frame of a destroyed pool frees it */
+static void
+video_frame_pool_put(video_frame_pool_t *pool, video_frame_t *frame)
+{
+    MUTEX_LOCK(pool->mutex);
+    frame->next_free = pool->free_frames;
+    pool->free_frames = frame;
+    int last = --pool->in_use == 0 && pool->destroyed;
+    MUTEX_UNLOCK(pool->mutex);
+    if (last) {
+        video_frame_pool_free(pool);
+    }
+}
+
+void
+video_frame_release(video_frame_t *frame)
+{
+    if (!frame) {
+        return;
+    }
+    if (ATOMIC_FETCH_ADD(frame->refs, -1) == 1) {
+        frame->free_func(frame->opaque, frame->data.data);
+        if (frame->pool) {
+            video_frame_pool_put(frame->pool, frame);
+        } else {
+            free(frame);
+        }
+    }
+}
+
+const h264_decode_struct *
+video_frame_get(const video_frame_t *frame)
+{
+    assert(frame);
+    return &frame->data;
+}
+
+video_frame_pool_t *
+video_frame_pool_init(int frames)
+{
+    video_frame_pool_t *pool;
+
+    assert(frames > 0);
+
+    pool = calloc(1, sizeof(video_frame_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    pool->frames = calloc(frames, sizeof(video_frame_t));
+    if (!pool->frames) {
+        free(pool);
+        return NULL;
+    }
+    for (int i = frames - 1; i >= 0; i--) {
+        pool->frames[i].pool = pool;
+        pool->frames[i].next_free = pool->free_frames;
+        pool->free_frames = &pool->frames[i];
+    }
+    MUTEX_CREATE(pool->mutex);
+    return pool;
+}
+
+void
+video_frame_pool_destroy(video_frame_pool_t *pool)
+{
+    if (!pool) {
+        return;
+    }
+    MUTEX_LOCK(pool->mutex);
+    pool->destroyed = 1;
+    int in_use = pool->in_use;
+    MUTEX_UNLOCK(pool->mutex);
+    if (!in_use) {
+        video_frame_pool_free(pool);
+    }
+}
+
+video_frame_t *
+video_frame_pool_wrap(video_frame_pool_t *pool, const h264_decode_struct *data, video_frame_free_t free_func,
+                      void *opaque)
+{
+    video_frame_t *frame;
+
+    assert(pool);
+    assert(data);
+    assert(free_func);
+
+    MUTEX_LOCK(pool->mutex);
+    frame = pool->free_frames;
+    if (frame) {
+        pool->free_frames = frame->next_free;
+        pool->in_use++;
+    }
+    MUTEX_UNLOCK(pool->mutex);
+    if (frame) {
+        video_frame_init(frame, data, free_func, opaque);
+    }
+    return frame;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef VIDEO_FRAME_H
+#define VIDEO_FRAME_H
+
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A reference counted video frame, its h264_decode_struct and the data that points to. Whoever
+ * holds a reference may keep the frame for as long as it likes and on any thread, the data is
+ * given back once the last reference is released. Frames are read only, several holders may
+ * read one at the same time.
+ */
+typedef struct video_frame_s video_frame_t;
+
+typedef void (*video_frame_free_t)(void *opaque, unsigned char *data);
+
+/* A frame with one reference to data, which free_func gets back with opaque. NULL if out of memory. */
+video_frame_t *video_frame_wrap(const h264_decode_struct *data, video_frame_free_t free_func, void *opaque);
+/* Another reference to frame, returns frame */
+video_frame_t *video_frame_acquire(video_frame_t *frame);
+/* Drops a reference, the last one frees the frame. NULL is ignored. */
+void video_frame_release(video_frame_t *frame);
+const h264_decode_struct *video_frame_get(const video_frame_t *frame);
+
+/*
+ * Frames wrapped without allocating, for producers that must not allocate once streaming. The
+ * pool has room for a fixed number of frames, as many as the producer has buffers to wrap.
+ */
+typedef struct video_frame_pool_s video_frame_pool_t;
+
+video_frame_pool_t *video_frame_pool_init(int frames);
+/* Frames still referenced stay valid, the pool is freed once the last of them is released */
+void video_frame_pool_destroy(video_frame_pool_t *pool);
+/* Like video_frame_wrap, with a frame of the pool. NULL if all of them are in use. */
+video_frame_t *video_frame_pool_wrap(video_frame_pool_t *pool, const h264_decode_struct *data,
+                                     video_frame_free_t free_func, void *opaque);
+
+#ifdef __cplusplus
+}
+
+/* Owns one reference to a video frame, which it releases when it goes. Moves, but does not copy. */
+class video_frame_ptr {
+public:
+    video_frame_ptr() : frame(nullptr) {}
+    /* Takes over the reference the caller holds */
+    explicit video_frame_ptr(video_frame_t *frame) : frame(frame) {}
+    video_frame_ptr(video_frame_ptr &&other) noexcept : frame(other.release()) {}
+    video_frame_ptr &operator=(video_frame_ptr &&other) noexcept {
+        reset(other.release());
+        return *this;
+    }
+    video_frame_ptr(const video_frame_ptr &) = delete;
+    video_frame_ptr &operator=(const video_frame_ptr &) = delete;
+    ~video_frame_ptr() { video_frame_release(frame); }
+
+    const h264_decode_struct *get() const { return frame ? video_frame_get(frame) : nullptr; }
+    const h264_decode_struct *operator->() const { return get(); }
+    explicit operator bool() const { return frame != nullptr; }
+
+    /* Another reference, for a second holder */
+    video_frame_ptr share() const { return video_frame_ptr(frame ? video_frame_acquire(frame) : nullptr); }
+    /* Hands the reference over to C code that takes ownership of it */
+    video_frame_t *release() {
+        video_frame_t *released = frame;
+        frame = nullptr;
+        return released;
+    }
+    void reset(video_frame_t *other = nullptr) {
+        video_frame_t *old = frame;
+        frame = other;
+        video_frame_release(old);
+    }
+
+private:
+    video_frame_t *frame;
+};
+#endif
+
+#endif //VIDEO_FRAME_H
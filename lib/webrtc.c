@@ -0,0 +1,1027 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "webrtc.h"
+#include "compat.h"
+#include "netutils.h"
+#include "httpd.h"
+#include "reactor.h"
+#include "crypto.h"
+#include "dtls.h"
+#include "srtp.h"
+#include "gop_cache.h"
+
+#define WEBRTC_MAX_VIEWERS 4
+#define WEBRTC_HTTP_CONNECTIONS 8
+/* RTP payload bytes per packet, the SRTP tag and IPv6 still fit a 1280 byte minimum MTU */
+#define WEBRTC_MAX_PAYLOAD 1200
+#define WEBRTC_RTP_HEADER_LEN 12
+#define WEBRTC_FU_HEADER_LEN 2
+#define WEBRTC_CLOCK_RATE 90000
+#define WEBRTC_SEND_BUFFER (1024 * 1024)
+#define WEBRTC_MAX_DATAGRAM 1500
+#define WEBRTC_MAX_PARAMETER_SETS 512
+/* Frames since the last IDR kept for new viewers, a longer stretch waits for the next IDR */
+#define WEBRTC_GOP_MAX_FRAMES 600
+#define WEBRTC_GOP_MAX_BYTES (8 * 1024 * 1024)
+/* Browsers check the connectivity every few seconds while they watch */
+#define WEBRTC_VIEWER_TIMEOUT (30ull * 1000000)
+#define WEBRTC_POLL_MS 1000
+
+#define WEBRTC_UFRAG_LEN 8
+#define WEBRTC_PWD_LEN 24
+#define WEBRTC_MAX_OFFER_PAYLOAD_TYPES 32
+
+#define NAL_TYPE_SPS 7
+#define NAL_TYPE_PPS 8
+#define NAL_TYPE_AUD 9
+#define NAL_TYPE_FU_A 28
+
+#define STUN_HEADER_LEN 20
+#define STUN_MAGIC_COOKIE 0x2112a442
+#define STUN_BINDING_REQUEST 0x0001
+#define STUN_BINDING_SUCCESS 0x0101
+#define STUN_ATTR_USERNAME 0x0006
+#define STUN_ATTR_MESSAGE_INTEGRITY 0x0008
+#define STUN_ATTR_XOR_MAPPED_ADDRESS 0x0020
+#define STUN_ATTR_USE_CANDIDATE 0x0025
+#define STUN_ATTR_FINGERPRINT 0x8028
+#define STUN_FINGERPRINT_XOR 0x5354554e
+
+typedef enum webrtc_viewer_state_e {
+    WEBRTC_VIEWER_FREE,
+    WEBRTC_VIEWER_CONNECTING, // Waiting for the connectivity checks and the DTLS handshake
+    WEBRTC_VIEWER_STREAMING
+} webrtc_viewer_state_t;
+
+typedef struct webrtc_viewer_s {
+    webrtc_t *webrtc;
+    webrtc_viewer_state_t state;
+    char local_ufrag[WEBRTC_UFRAG_LEN + 1];
+    char local_pwd[WEBRTC_PWD_LEN + 1];
+    /* Authenticates the connectivity checks, keyed with local_pwd */
+    hmac_ctx_t *stun_auth;
+    int payload_type;
+
+    /* Where the checks the browser nominated came from, the media goes there */
+    struct sockaddr_storage saddr;
+    socklen_t saddr_len;
+    int sock;
+    uint64_t last_check;
+
+    dtls_session_t *dtls;
+    srtp_sender_t *srtp;
+    uint16_t seqnum;
+    uint32_t timestamp_offset;
+    /* Set once the viewer got an IDR frame, frames before that could not be decoded */
+    int synced;
+    int congested;
+} webrtc_viewer_t;
+
+/* The SDP offer of a browser, as far as the answer needs it */
+typedef struct webrtc_offer_s {
+    char ufrag[64];
+    char fingerprint[DTLS_FINGERPRINT_SIZE];
+    char mid[32];
+    int payload_type;
+    char fmtp[256];
+} webrtc_offer_t;
+
+/* Context of an HTTP connection, the local address goes into the candidate */
+typedef struct webrtc_conn_s {
+    webrtc_t *webrtc;
+    unsigned char local[16];
+    int locallen;
+} webrtc_conn_t;
+
+struct webrtc_s {
+    logger_t *logger;
+    httpd_t *httpd;
+    dtls_context_t *dtls;
+
+    int sock_ipv4;
+    int sock_ipv6;
+    unsigned short port;
+    reactor_t *reactor;
+    thread_handle_t thread;
+    int running;
+
+    /* Guards everything below, taken by the video thread, the UDP thread and the HTTP thread */
+    mutex_handle_t mutex;
+    uint32_t ssrc;
+    webrtc_viewer_t viewers[WEBRTC_MAX_VIEWERS];
+
+    unsigned char parameter_sets[WEBRTC_MAX_PARAMETER_SETS];
+    int parameter_set_offsets[2];
+    int parameter_set_sizes[2];
+    int parameter_set_count;
+
+    /* The frames since the last IDR, for new viewers */
+    gop_cache_t *gop;
+
+    unsigned char packet[WEBRTC_MAX_DATAGRAM];
+};
+
+static const char webrtc_page[] =
+    "<!DOCTYPE html>\n"
+    "<html><head><meta charset=\"utf-8\"><title>RPiPlay</title>\n"
+    "<style>html,body{margin:0;height:100%;background:#000;color:#fff}"
+    "video{width:100%;height:100%;object-fit:contain}</style></head>\n"
+    "<body><video id=\"mirror\" autoplay muted playsinline></video>\n"
+    "<script>\n"
+    "(async () => {\n"
+    "  const pc = new RTCPeerConnection();\n"
+    "  pc.addTransceiver('video', {direction: 'recvonly'});\n"
+    "  pc.ontrack = e => { document.getElementById('mirror').srcObject = new MediaStream([e.track]); };\n"
+    "  await pc.setLocalDescription(await pc.createOffer());\n"
+    "  const answer = await fetch('offer', {method: 'POST', headers: {'Content-Type': 'application/sdp'},\n"
+    "                                       body: pc.localDescription.sdp});\n"
+    "  if (!answer.ok) { document.body.textContent = 'The receiver has no room for another viewer'; return; }\n"
+    "  await pc.setRemoteDescription({type: 'answer', sdp: await answer.text()});\n"
+    "})();\n"
+    "</script></body></html>\n";
+
+static uint64_t
+webrtc_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* ICE wants the credentials in the characters of base64 */
+static void
+webrtc_random_string(char *out, int len)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned char random[64];
+    assert(len <= (int) sizeof(random));
+    crypto_random(random, len);
+    for (int i = 0; i < len; i++) {
+        out[i] = alphabet[random[i] & 63];
+    }
+    out[len] = '\0';
+}
+
+static uint32_t
+webrtc_random_uint32(void)
+{
+    uint32_t value;
+    crypto_random((uint8_t *) &value, sizeof(value));
+    return value;
+}
+
+static void
+webrtc_viewer_close(webrtc_viewer_t *viewer)
+{
+    dtls_session_destroy(viewer->dtls);
+    srtp_sender_destroy(viewer->srtp);
+    hmac_sha1_destroy(viewer->stun_auth);
+    memset(viewer, 0, sizeof(webrtc_viewer_t));
+}
+
+/* RTP timestamp of a frame for a viewer, on the local clock the pts are on */
+static uint32_t
+webrtc_viewer_timestamp(webrtc_viewer_t *viewer, uint64_t pts)
+{
+    return (uint32_t) (pts * WEBRTC_CLOCK_RATE / 1000000) + viewer->timestamp_offset;
+}
+
+/* One RTP packet with the FU-A header if fu is set, protected and sent without waiting */
+static void
+webrtc_send_packet(webrtc_t *webrtc, webrtc_viewer_t *viewer, const unsigned char *fu,
+                   const unsigned char *payload, int payload_len, uint32_t timestamp, int marker)
+{
+    unsigned char *packet = webrtc->packet;
+    uint16_t seqnum = viewer->seqnum++;
+    packet[0] = 0x80;
+    packet[1] = (marker ? 0x80 : 0) | viewer->payload_type;
+    packet[2] = seqnum >> 8;
+    packet[3] = seqnum;
+    packet[4] = timestamp >> 24;
+    packet[5] = timestamp >> 16;
+    packet[6] = timestamp >> 8;
+    packet[7] = timestamp;
+    packet[8] = webrtc->ssrc >> 24;
+    packet[9] = webrtc->ssrc >> 16;
+    packet[10] = webrtc->ssrc >> 8;
+    packet[11] = webrtc->ssrc;
+    int len = WEBRTC_RTP_HEADER_LEN;
+    if (fu) {
+        memcpy(packet + len, fu, WEBRTC_FU_HEADER_LEN);
+        len += WEBRTC_FU_HEADER_LEN;
+    }
+    memcpy(packet + len, payload, payload_len);
+    len = srtp_sender_protect(viewer->srtp, packet, len + payload_len);
+
+    if (sendto(viewer->sock, (const char *) packet, len, MSG_DONTWAIT, (struct sockaddr *) &viewer->saddr,
+               viewer->saddr_len) < 0) {
+        if (!viewer->congested) {
+            logger_log(webrtc->logger, LOGGER_WARNING, "webrtc dropping packets to a viewer %d", SOCKET_GET_ERROR());
+        }
+        viewer->congested = 1;
+    } else {
+        viewer->congested = 0;
+    }
+}
+
+/* Single NAL unit packet if it fits, FU-A fragments otherwise (RFC 6184, 5.6 and 5.8) */
+static void
+webrtc_send_nal(webrtc_t *webrtc, webrtc_viewer_t *viewer, const unsigned char *nal, int size,
+                uint32_t timestamp, int last)
+{
+    if (size <= WEBRTC_MAX_PAYLOAD) {
+        webrtc_send_packet(webrtc, viewer, NULL, nal, size, timestamp, last);
+        return;
+    }
+
+    unsigned char fu[WEBRTC_FU_HEADER_LEN];
+    const unsigned char *data = nal + 1;
+    int remaining = size - 1;
+    int first = 1;
+    while (remaining > 0) {
+        int chunk = remaining > WEBRTC_MAX_PAYLOAD - WEBRTC_FU_HEADER_LEN ?
+                    WEBRTC_MAX_PAYLOAD - WEBRTC_FU_HEADER_LEN : remaining;
+        fu[0] = (nal[0] & 0xe0) | NAL_TYPE_FU_A;
+        fu[1] = (first ? 0x80 : 0) | (chunk == remaining ? 0x40 : 0) | (nal[0] & 0x1f);
+        webrtc_send_packet(webrtc, viewer, fu, data, chunk, timestamp, last && chunk == remaining);
+        data += chunk;
+        remaining -= chunk;
+        first = 0;
+    }
+}
+
+/* A whole frame, behind the parameter sets if it is an IDR frame */
+static void
+webrtc_send_frame(webrtc_t *webrtc, webrtc_viewer_t *viewer, const unsigned char *data,
+                  const h264_nal_index_t *nal_index, int is_idr, uint32_t timestamp)
+{
+    int last = -1;
+    for (int i = 0; i < nal_index->count; i++) {
+        if (nal_index->nals[i].nal_unit_type != NAL_TYPE_AUD && nal_index->nals[i].size > 0) {
+            last = i;
+        }
+    }
+    if (last < 0) {
+        return;
+    }
+    if (is_idr) {
+        for (int i = 0; i < webrtc->parameter_set_count; i++) {
+            webrtc_send_nal(webrtc, viewer, webrtc->parameter_sets + webrtc->parameter_set_offsets[i],
+                            webrtc->parameter_set_sizes[i], timestamp, 0);
+        }
+        viewer->synced = 1;
+    }
+    for (int i = 0; i <= last; i++) {
+        const h264_nal_index_entry_t *nal = &nal_index->nals[i];
+        /* RFC 6184 leaves access unit delimiters to the marker bit */
+        if (nal->nal_unit_type == NAL_TYPE_AUD || nal->size <= 0) {
+            continue;
+        }
+        webrtc_send_nal(webrtc, viewer, data + nal->offset, nal->size, timestamp, i == last);
+    }
+}
+
+/*
+ * Catches a viewer that just connected up with the frames since the last IDR. They get
+ * timestamps one tick apart that end just before the live ones, so that the browser decodes
+ * them all and shows the last without waiting out their real time.
+ */
+static void
+webrtc_send_gop(webrtc_t *webrtc, webrtc_viewer_t *viewer)
+{
+    int count = gop_cache_get_count(webrtc->gop);
+    if (!count) {
+        logger_log(webrtc->logger, LOGGER_INFO, "webrtc viewer connected, waiting for the next IDR frame");
+        return;
+    }
+    uint32_t last = webrtc_viewer_timestamp(viewer, gop_cache_get_frame(webrtc->gop, count - 1)->pts);
+    for (int i = 0; i < count; i++) {
+        const h264_decode_struct *frame = gop_cache_get_frame(webrtc->gop, i);
+        webrtc_send_frame(webrtc, viewer, frame->data, &frame->nal_index, i == 0, last - (count - 1 - i));
+    }
+    logger_log(webrtc->logger, LOGGER_INFO, "webrtc viewer connected, sent the %d frames since the last IDR", count);
+}
+
+static void
+webrtc_dtls_send(void *cls, const unsigned char *data, int len)
+{
+    webrtc_viewer_t *viewer = cls;
+    sendto(viewer->sock, (const char *) data, len, MSG_DONTWAIT, (struct sockaddr *) &viewer->saddr, viewer->saddr_len);
+}
+
+/* Once the handshake is done the SRTP keys are in, and the viewer gets the picture */
+static void
+webrtc_viewer_dtls_state(webrtc_t *webrtc, webrtc_viewer_t *viewer, int state)
+{
+    unsigned char keys[DTLS_SRTP_KEYS_SIZE];
+
+    if (state == DTLS_SESSION_FAILED) {
+        logger_log(webrtc->logger, LOGGER_INFO, "webrtc viewer disconnected");
+        webrtc_viewer_close(viewer);
+        return;
+    }
+    if (state != DTLS_SESSION_ESTABLISHED || viewer->state == WEBRTC_VIEWER_STREAMING) {
+        return;
+    }
+    if (dtls_session_get_srtp_keys(viewer->dtls, keys) < 0 ||
+        !(viewer->srtp = srtp_sender_init(keys + SRTP_MASTER_KEY_SIZE,
+                                          keys + 2 * SRTP_MASTER_KEY_SIZE + SRTP_MASTER_SALT_SIZE))) {
+        logger_log(webrtc->logger, LOGGER_ERR, "webrtc could not set up SRTP for a viewer");
+        webrtc_viewer_close(viewer);
+        return;
+    }
+    viewer->state = WEBRTC_VIEWER_STREAMING;
+    webrtc_send_gop(webrtc, viewer);
+}
+
+static uint32_t
+webrtc_crc32(const unsigned char *data, int len)
+{
+    uint32_t crc = 0xffffffff;
+    for (int i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void
+webrtc_stun_set_length(unsigned char *message, int length)
+{
+    message[2] = (length - STUN_HEADER_LEN) >> 8;
+    message[3] = length - STUN_HEADER_LEN;
+}
+
+static int
+webrtc_stun_add_attribute(unsigned char *message, int length, int type, const unsigned char *value, int value_len)
+{
+    message[length] = type >> 8;
+    message[length + 1] = type;
+    message[length + 2] = value_len >> 8;
+    message[length + 3] = value_len;
+    memcpy(message + length + 4, value, value_len);
+    length += 4 + value_len;
+    while (length % 4) {
+        message[length++] = 0;
+    }
+    return length;
+}
+
+/* Answers a connectivity check, with where it came from and signed like the request */
+static void
+webrtc_stun_respond(webrtc_viewer_t *viewer, int sock, const unsigned char *request,
+                    const struct sockaddr_storage *saddr, socklen_t saddr_len)
+{
+    unsigned char response[128];
+    unsigned char value[20];
+    unsigned char integrity[SHA1_DIGEST_SIZE];
+    int value_len;
+
+    response[0] = STUN_BINDING_SUCCESS >> 8;
+    response[1] = STUN_BINDING_SUCCESS & 0xff;
+    memcpy(response + 4, request + 4, STUN_HEADER_LEN - 4);
+    int length = STUN_HEADER_LEN;
+
+    /* XOR-MAPPED-ADDRESS, the port and address xored with the cookie and transaction id */
+    value[0] = 0;
+    if (saddr->ss_family == AF_INET6) {
+        const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) saddr;
+        value[1] = 0x02;
+        memcpy(value + 2, &sin6->sin6_port, 2);
+        memcpy(value + 4, &sin6->sin6_addr, 16);
+        value_len = 20;
+    } else {
+        const struct sockaddr_in *sin = (const struct sockaddr_in *) saddr;
+        value[1] = 0x01;
+        memcpy(value + 2, &sin->sin_port, 2);
+        memcpy(value + 4, &sin->sin_addr, 4);
+        value_len = 8;
+    }
+    value[2] ^= response[4];
+    value[3] ^= response[5];
+    for (int i = 4; i < value_len && i < (int) sizeof(value); i++) {
+        value[i] ^= response[i];
+    }
+    length = webrtc_stun_add_attribute(response, length, STUN_ATTR_XOR_MAPPED_ADDRESS, value, value_len);
+
+    webrtc_stun_set_length(response, length + 4 + SHA1_DIGEST_SIZE);
+    hmac_sha1(viewer->stun_auth, response, length, integrity);
+    length = webrtc_stun_add_attribute(response, length, STUN_ATTR_MESSAGE_INTEGRITY, integrity, sizeof(integrity));
+
+    webrtc_stun_set_length(response, length + 8);
+    uint32_t crc = webrtc_crc32(response, length) ^ STUN_FINGERPRINT_XOR;
+    value[0] = crc >> 24;
+    value[1] = crc >> 16;
+    value[2] = crc >> 8;
+    value[3] = crc;
+    length = webrtc_stun_add_attribute(response, length, STUN_ATTR_FINGERPRINT, value, 4);
+
+    sendto(sock, (const char *) response, length, MSG_DONTWAIT, (const struct sockaddr *) saddr, saddr_len);
+}
+
+/*
+ * ICE-lite: the browser checks the connectivity to our candidate with STUN binding requests
+ * and nominates the pair it picked with USE-CANDIDATE. The first check, and then the
+ * nominated one, tell where the media goes.
+ */
+static void
+webrtc_receive_stun(webrtc_t *webrtc, int sock, unsigned char *message, int len,
+                    const struct sockaddr_storage *saddr, socklen_t saddr_len)
+{
+    unsigned char integrity[SHA1_DIGEST_SIZE];
+    const unsigned char *username = NULL;
+    int username_len = 0;
+    int integrity_offset = -1;
+    int use_candidate = 0;
+
+    if (len < STUN_HEADER_LEN || ((message[0] << 8) | message[1]) != STUN_BINDING_REQUEST ||
+        ((uint32_t) message[4] << 24 | message[5] << 16 | message[6] << 8 | message[7]) != STUN_MAGIC_COOKIE ||
+        STUN_HEADER_LEN + ((message[2] << 8) | message[3]) > len) {
+        return;
+    }
+    len = STUN_HEADER_LEN + ((message[2] << 8) | message[3]);
+    for (int offset = STUN_HEADER_LEN; offset + 4 <= len && integrity_offset < 0;) {
+        int type = (message[offset] << 8) | message[offset + 1];
+        int value_len = (message[offset + 2] << 8) | message[offset + 3];
+        if (offset + 4 + value_len > len) {
+            return;
+        }
+        if (type == STUN_ATTR_USERNAME) {
+            username = message + offset + 4;
+            username_len = value_len;
+        } else if (type == STUN_ATTR_USE_CANDIDATE) {
+            use_candidate = 1;
+        } else if (type == STUN_ATTR_MESSAGE_INTEGRITY && value_len == SHA1_DIGEST_SIZE) {
+            integrity_offset = offset;
+        }
+        offset += 4 + ((value_len + 3) & ~3);
+    }
+    if (!username || integrity_offset < 0) {
+        return;
+    }
+
+    /* USERNAME is our ufrag, a colon and the browser's */
+    webrtc_viewer_t *viewer = NULL;
+    for (int i = 0; i < WEBRTC_MAX_VIEWERS; i++) {
+        webrtc_viewer_t *candidate = &webrtc->viewers[i];
+        if (candidate->state != WEBRTC_VIEWER_FREE && username_len > WEBRTC_UFRAG_LEN &&
+            username[WEBRTC_UFRAG_LEN] == ':' && !memcmp(username, candidate->local_ufrag, WEBRTC_UFRAG_LEN)) {
+            viewer = candidate;
+            break;
+        }
+    }
+    if (!viewer) {
+        return;
+    }
+
+    /* The integrity covers the message up to it, with the length as if it ended after it */
+    webrtc_stun_set_length(message, integrity_offset + 4 + SHA1_DIGEST_SIZE);
+    hmac_sha1(viewer->stun_auth, message, integrity_offset, integrity);
+    if (memcmp(integrity, message + integrity_offset + 4, SHA1_DIGEST_SIZE)) {
+        logger_log(webrtc->logger, LOGGER_DEBUG, "webrtc connectivity check with a bad MESSAGE-INTEGRITY");
+        return;
+    }
+
+    viewer->last_check = webrtc_now();
+    if (!viewer->saddr_len || use_candidate) {
+        if (viewer->saddr_len && (viewer->saddr_len != saddr_len || memcmp(&viewer->saddr, saddr, saddr_len))) {
+            logger_log(webrtc->logger, LOGGER_DEBUG, "webrtc viewer nominated another address");
+        }
+        memcpy(&viewer->saddr, saddr, saddr_len);
+        viewer->saddr_len = saddr_len;
+        viewer->sock = sock;
+    }
+    webrtc_stun_respond(viewer, sock, message, saddr, saddr_len);
+}
+
+static void
+webrtc_receive(webrtc_t *webrtc, int sock, unsigned char *data, int len,
+               const struct sockaddr_storage *saddr, socklen_t saddr_len)
+{
+    /* Demultiplexed by the first byte, RFC 7983 */
+    if (len <= 0) {
+        return;
+    }
+    if (data[0] <= 3) {
+        webrtc_receive_stun(webrtc, sock, data, len, saddr, saddr_len);
+        return;
+    }
+    if (data[0] < 20 || data[0] > 63) {
+        /* SRTCP receiver reports and keyframe requests, there is no encoder to act on them */
+        return;
+    }
+    for (int i = 0; i < WEBRTC_MAX_VIEWERS; i++) {
+        webrtc_viewer_t *viewer = &webrtc->viewers[i];
+        if (viewer->state != WEBRTC_VIEWER_FREE && viewer->saddr_len == saddr_len &&
+            !memcmp(&viewer->saddr, saddr, saddr_len)) {
+            webrtc_viewer_dtls_state(webrtc, viewer, dtls_session_receive(viewer->dtls, data, len));
+            return;
+        }
+    }
+}
+
+static void
+webrtc_read_socket(webrtc_t *webrtc, int sock)
+{
+    unsigned char data[WEBRTC_MAX_DATAGRAM];
+    struct sockaddr_storage saddr;
+
+    for (;;) {
+        socklen_t saddr_len = sizeof(saddr);
+        int len = recvfrom(sock, (char *) data, sizeof(data), MSG_DONTWAIT, (struct sockaddr *) &saddr, &saddr_len);
+        if (len < 0) {
+            return;
+        }
+        webrtc_receive(webrtc, sock, data, len, &saddr, saddr_len);
+    }
+}
+
+/* Resends lost handshake flights and drops the viewers that went away, returns when to look again */
+static int
+webrtc_service_viewers(webrtc_t *webrtc)
+{
+    int timeout = WEBRTC_POLL_MS;
+    uint64_t now = webrtc_now();
+    for (int i = 0; i < WEBRTC_MAX_VIEWERS; i++) {
+        webrtc_viewer_t *viewer = &webrtc->viewers[i];
+        if (viewer->state == WEBRTC_VIEWER_FREE) {
+            continue;
+        }
+        if (now - viewer->last_check > WEBRTC_VIEWER_TIMEOUT) {
+            logger_log(webrtc->logger, LOGGER_INFO, "webrtc viewer timed out");
+            webrtc_viewer_close(viewer);
+            continue;
+        }
+        int due = dtls_session_get_timeout(viewer->dtls);
+        if (due == 0) {
+            webrtc_viewer_dtls_state(webrtc, viewer, dtls_session_handle_timeout(viewer->dtls));
+            due = viewer->state != WEBRTC_VIEWER_FREE ? dtls_session_get_timeout(viewer->dtls) : -1;
+        }
+        if (due >= 0 && due < timeout) {
+            timeout = due;
+        }
+    }
+    return timeout;
+}
+
+static THREAD_RETVAL
+webrtc_thread(void *arg)
+{
+    webrtc_t *webrtc = arg;
+    int ready[2];
+    int timeout = WEBRTC_POLL_MS;
+
+    while (ATOMIC_LOAD(webrtc->running)) {
+        int count = reactor_wait(webrtc->reactor, ready, 2, timeout);
+        if (!ATOMIC_LOAD(webrtc->running)) {
+            break;
+        }
+        MUTEX_LOCK(webrtc->mutex);
+        if (count > 0 && webrtc->sock_ipv4 != -1 && reactor_is_ready(ready, count, webrtc->sock_ipv4)) {
+            webrtc_read_socket(webrtc, webrtc->sock_ipv4);
+        }
+        if (count > 0 && webrtc->sock_ipv6 != -1 && reactor_is_ready(ready, count, webrtc->sock_ipv6)) {
+            webrtc_read_socket(webrtc, webrtc->sock_ipv6);
+        }
+        timeout = webrtc_service_viewers(webrtc);
+        MUTEX_UNLOCK(webrtc->mutex);
+    }
+    return 0;
+}
+
+/* Copies the value of the SDP line at line, up to the end of the line, into out */
+static void
+webrtc_sdp_value(const char *line, int len, char *out, int size)
+{
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(out, line, len);
+    out[len] = '\0';
+}
+
+/*
+ * Reads the browser's ICE credentials, certificate fingerprint and the mid of the video
+ * section, and picks the H.264 payload type for the mirror: packetization mode 1, and the
+ * High profile the senders encode if the browser names it, any profile otherwise.
+ */
+static int
+webrtc_parse_offer(const char *sdp, int sdp_len, webrtc_offer_t *offer)
+{
+    int payload_types[WEBRTC_MAX_OFFER_PAYLOAD_TYPES];
+    int payload_type_count = 0;
+    int in_video = 0;
+    int best_score = 0;
+
+    memset(offer, 0, sizeof(webrtc_offer_t));
+    offer->payload_type = -1;
+
+    for (const char *line = sdp; line < sdp + sdp_len;) {
+        const char *end = memchr(line, '\n', sdp + sdp_len - line);
+        if (!end) {
+            end = sdp + sdp_len;
+        }
+        int len = end - line;
+        if (len > 0 && line[len - 1] == '\r') {
+            len--;
+        }
+
+        if (len >= 2 && !strncmp(line, "m=", 2)) {
+            in_video = len >= 8 && !strncmp(line, "m=video ", 8);
+        } else if (len > 12 && !strncmp(line, "a=ice-ufrag:", 12)) {
+            webrtc_sdp_value(line + 12, len - 12, offer->ufrag, sizeof(offer->ufrag));
+        } else if (len > 22 && !strncmp(line, "a=fingerprint:sha-256 ", 22)) {
+            webrtc_sdp_value(line + 14, len - 14, offer->fingerprint, sizeof(offer->fingerprint));
+        } else if (in_video && len > 6 && !strncmp(line, "a=mid:", 6) && !offer->mid[0]) {
+            webrtc_sdp_value(line + 6, len - 6, offer->mid, sizeof(offer->mid));
+        } else if (in_video && len > 9 && !strncmp(line, "a=rtpmap:", 9)) {
+            int payload_type;
+            char encoding[16];
+            if (sscanf(line + 9, "%d %15[^/]", &payload_type, encoding) == 2 && !strcasecmp(encoding, "H264") &&
+                payload_type_count < WEBRTC_MAX_OFFER_PAYLOAD_TYPES) {
+                payload_types[payload_type_count++] = payload_type;
+            }
+        } else if (in_video && len > 7 && !strncmp(line, "a=fmtp:", 7)) {
+            char fmtp[256];
+            int payload_type;
+            int consumed = 0;
+            webrtc_sdp_value(line + 7, len - 7, fmtp, sizeof(fmtp));
+            if (sscanf(fmtp, "%d %n", &payload_type, &consumed) == 1 && consumed > 0) {
+                for (int i = 0; i < payload_type_count; i++) {
+                    if (payload_types[i] != payload_type || !strstr(fmtp, "packetization-mode=1")) {
+                        continue;
+                    }
+                    int score = strstr(fmtp, "profile-level-id=64") ? 3 : strstr(fmtp, "profile-level-id=4d") ? 2 : 1;
+                    if (score > best_score) {
+                        best_score = score;
+                        offer->payload_type = payload_type;
+                        snprintf(offer->fmtp, sizeof(offer->fmtp), "%s", fmtp + consumed);
+                    }
+                }
+            }
+        }
+        line = end + 1;
+    }
+    return offer->ufrag[0] && offer->fingerprint[0] && offer->payload_type >= 0 ? 0 : -1;
+}
+
+/* Sets up a viewer for the offer and writes the answer, NULL if there is no room or no match */
+static char *
+webrtc_answer(webrtc_t *webrtc, const webrtc_conn_t *conn, const char *sdp, int sdp_len, int *answer_len)
+{
+    webrtc_offer_t offer;
+    char address[INET6_ADDRSTRLEN];
+
+    if (webrtc_parse_offer(sdp, sdp_len, &offer) < 0) {
+        logger_log(webrtc->logger, LOGGER_WARNING, "webrtc offer without ICE credentials, fingerprint or H.264");
+        return NULL;
+    }
+    netutils_format_address(conn->local, conn->locallen, address, sizeof(address));
+    const char *family = conn->locallen == 16 ? "IP6" : "IP4";
+    char *answer = malloc(4096);
+    if (!answer) {
+        return NULL;
+    }
+
+    MUTEX_LOCK(webrtc->mutex);
+    webrtc_viewer_t *viewer = NULL;
+    for (int i = 0; i < WEBRTC_MAX_VIEWERS && !viewer; i++) {
+        if (webrtc->viewers[i].state == WEBRTC_VIEWER_FREE) {
+            viewer = &webrtc->viewers[i];
+        }
+    }
+    if (viewer) {
+        viewer->webrtc = webrtc;
+        webrtc_random_string(viewer->local_ufrag, WEBRTC_UFRAG_LEN);
+        webrtc_random_string(viewer->local_pwd, WEBRTC_PWD_LEN);
+        viewer->stun_auth = hmac_sha1_init((const uint8_t *) viewer->local_pwd, WEBRTC_PWD_LEN);
+        viewer->dtls = dtls_session_init(webrtc->dtls, offer.fingerprint, webrtc_dtls_send, viewer);
+        viewer->payload_type = offer.payload_type;
+        viewer->seqnum = (uint16_t) webrtc_random_uint32();
+        viewer->timestamp_offset = webrtc_random_uint32();
+        viewer->last_check = webrtc_now();
+        viewer->state = WEBRTC_VIEWER_CONNECTING;
+        if (!viewer->stun_auth || !viewer->dtls) {
+            webrtc_viewer_close(viewer);
+            viewer = NULL;
+        }
+    }
+    if (!viewer) {
+        MUTEX_UNLOCK(webrtc->mutex);
+        logger_log(webrtc->logger, LOGGER_WARNING, "webrtc has no room for another viewer");
+        free(answer);
+        return NULL;
+    }
+
+    int mid = offer.mid[0] != '\0';
+    *answer_len = snprintf(answer, 4096,
+                           "v=0\r\n"
+                           "o=rpiplay %u 1 IN %s %s\r\n"
+                           "s=-\r\n"
+                           "t=0 0\r\n"
+                           "a=ice-lite\r\n"
+                           "%s%s%s"
+                           "a=msid-semantic: WMS rpiplay\r\n"
+                           "m=video %u UDP/TLS/RTP/SAVPF %d\r\n"
+                           "c=IN %s %s\r\n"
+                           "%s%s%s"
+                           "a=sendonly\r\n"
+                           "a=rtcp-mux\r\n"
+                           "a=ice-ufrag:%s\r\n"
+                           "a=ice-pwd:%s\r\n"
+                           "a=fingerprint:%s\r\n"
+                           "a=setup:passive\r\n"
+                           "a=rtpmap:%d H264/90000\r\n"
+                           "a=fmtp:%d %s\r\n"
+                           "a=msid:rpiplay mirror\r\n"
+                           "a=ssrc:%u cname:rpiplay\r\n"
+                           "a=ssrc:%u msid:rpiplay mirror\r\n"
+                           "a=candidate:1 1 udp 2130706431 %s %u typ host\r\n"
+                           "a=end-of-candidates\r\n",
+                           webrtc->ssrc, family, address,
+                           mid ? "a=group:BUNDLE " : "", offer.mid, mid ? "\r\n" : "",
+                           webrtc->port, offer.payload_type,
+                           family, address,
+                           mid ? "a=mid:" : "", offer.mid, mid ? "\r\n" : "",
+                           viewer->local_ufrag, viewer->local_pwd,
+                           dtls_context_get_fingerprint(webrtc->dtls),
+                           offer.payload_type, offer.payload_type, offer.fmtp,
+                           webrtc->ssrc, webrtc->ssrc,
+                           address, webrtc->port);
+    MUTEX_UNLOCK(webrtc->mutex);
+
+    if (*answer_len >= 4096) {
+        free(answer);
+        return NULL;
+    }
+    logger_log(webrtc->logger, LOGGER_INFO, "webrtc answering a viewer at %s:%u", address, webrtc->port);
+    return answer;
+}
+
+static void *
+webrtc_conn_init(void *opaque, unsigned char *local, int locallen, unsigned char *remote, int remotelen)
+{
+    if (locallen > 16) {
+        return NULL;
+    }
+    webrtc_conn_t *conn = calloc(1, sizeof(webrtc_conn_t));
+    if (!conn) {
+        return NULL;
+    }
+    conn->webrtc = opaque;
+    memcpy(conn->local, local, locallen);
+    conn->locallen = locallen;
+    return conn;
+}
+
+static void
+webrtc_respond(http_response_t **response, int code, const char *message, const char *content_type,
+               char *data, int datalen)
+{
+    *response = http_response_init("HTTP/1.1", code, message);
+    if (content_type) {
+        http_response_add_header(*response, "Content-Type", content_type);
+    }
+    http_response_add_header(*response, "Cache-Control", "no-store");
+    http_response_add_header(*response, "Connection", "close");
+    if (data) {
+        http_response_finish_owned(*response, data, datalen);
+    } else {
+        http_response_finish(*response, NULL, 0);
+    }
+    http_response_set_disconnect(*response, 1);
+}
+
+static void
+webrtc_conn_request(void *ptr, http_request_t *request, http_response_t **response)
+{
+    webrtc_conn_t *conn = ptr;
+    webrtc_t *webrtc = conn->webrtc;
+    const char *method = http_request_get_method(request);
+    const char *url = http_request_get_url(request);
+
+    if (method && url && !strcmp(method, "GET") && (!strcmp(url, "/") || !strcmp(url, "/index.html"))) {
+        char *page = strdup(webrtc_page);
+        webrtc_respond(response, 200, "OK", "text/html; charset=utf-8", page, page ? strlen(page) : 0);
+        return;
+    }
+    if (method && url && !strcmp(method, "POST") && !strcmp(url, "/offer")) {
+        int sdp_len = 0;
+        const char *sdp = http_request_get_data(request, &sdp_len);
+        int answer_len = 0;
+        char *answer = sdp ? webrtc_answer(webrtc, conn, sdp, sdp_len, &answer_len) : NULL;
+        if (answer) {
+            webrtc_respond(response, 200, "OK", "application/sdp", answer, answer_len);
+        } else {
+            webrtc_respond(response, 503, "Service Unavailable", NULL, NULL, 0);
+        }
+        return;
+    }
+    logger_log(webrtc->logger, LOGGER_DEBUG, "webrtc server has nothing at %s %s", method ? method : "", url ? url : "");
+    webrtc_respond(response, 404, "Not Found", NULL, NULL, 0);
+}
+
+static void
+webrtc_conn_destroy(void *ptr)
+{
+    free(ptr);
+}
+
+webrtc_t *
+webrtc_init(logger_t *logger)
+{
+    httpd_callbacks_t httpd_cbs;
+
+    assert(logger);
+
+    webrtc_t *webrtc = calloc(1, sizeof(webrtc_t));
+    if (!webrtc) {
+        return NULL;
+    }
+    webrtc->logger = logger;
+    webrtc->sock_ipv4 = -1;
+    webrtc->sock_ipv6 = -1;
+    webrtc->ssrc = webrtc_random_uint32();
+    MUTEX_CREATE(webrtc->mutex);
+
+    memset(&httpd_cbs, 0, sizeof(httpd_cbs));
+    httpd_cbs.opaque = webrtc;
+    httpd_cbs.conn_init = &webrtc_conn_init;
+    httpd_cbs.conn_request = &webrtc_conn_request;
+    httpd_cbs.conn_destroy = &webrtc_conn_destroy;
+    webrtc->httpd = httpd_init(logger, &httpd_cbs, WEBRTC_HTTP_CONNECTIONS);
+    webrtc->dtls = dtls_context_init(logger);
+    webrtc->reactor = reactor_init(logger);
+    webrtc->gop = gop_cache_init(WEBRTC_GOP_MAX_FRAMES, WEBRTC_GOP_MAX_BYTES);
+    if (!webrtc->httpd || !webrtc->dtls || !webrtc->reactor || !webrtc->gop) {
+        webrtc_destroy(webrtc);
+        return NULL;
+    }
+    return webrtc;
+}
+
+static int
+webrtc_open_socket(webrtc_t *webrtc, unsigned short *port, int use_ipv6)
+{
+    int sock = netutils_init_socket(port, use_ipv6, 1);
+    if (sock == -1) {
+        return -1;
+    }
+    int nonblocking = 1;
+    ioctl(sock, FIONBIO, &nonblocking);
+    int size = WEBRTC_SEND_BUFFER;
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (const char *) &size, sizeof(size));
+    reactor_add(webrtc->reactor, sock);
+    return sock;
+}
+
+int
+webrtc_start(webrtc_t *webrtc, unsigned short *port)
+{
+    assert(webrtc);
+    assert(port);
+
+    if (httpd_start(webrtc->httpd, port) < 0) {
+        logger_log(webrtc->logger, LOGGER_ERR, "webrtc server could not listen on port %u", *port);
+        return -1;
+    }
+    /* The media on the same port number if it is free, on any port otherwise */
+    unsigned short media_port = *port;
+    webrtc->sock_ipv4 = webrtc_open_socket(webrtc, &media_port, 0);
+    if (webrtc->sock_ipv4 == -1) {
+        media_port = 0;
+        webrtc->sock_ipv4 = webrtc_open_socket(webrtc, &media_port, 0);
+    }
+    webrtc->sock_ipv6 = webrtc_open_socket(webrtc, &media_port, 1);
+    if (webrtc->sock_ipv4 == -1 && webrtc->sock_ipv6 == -1) {
+        logger_log(webrtc->logger, LOGGER_ERR, "webrtc server could not open a UDP socket %d", SOCKET_GET_ERROR());
+        httpd_stop(webrtc->httpd);
+        return -1;
+    }
+    webrtc->port = media_port;
+
+    ATOMIC_STORE(webrtc->running, 1);
+    THREAD_CREATE(webrtc->thread, webrtc_thread, webrtc);
+    if (!webrtc->thread) {
+        ATOMIC_STORE(webrtc->running, 0);
+        httpd_stop(webrtc->httpd);
+        return -1;
+    }
+    thread_set_name(webrtc->thread, "webrtc");
+    logger_log(webrtc->logger, LOGGER_INFO, "webrtc viewers can watch at http://<address>:%u/", *port);
+    return 0;
+}
+
+void
+webrtc_reset(webrtc_t *webrtc)
+{
+    assert(webrtc);
+    MUTEX_LOCK(webrtc->mutex);
+    webrtc->parameter_set_count = 0;
+    gop_cache_reset(webrtc->gop);
+    for (int i = 0; i < WEBRTC_MAX_VIEWERS; i++) {
+        webrtc->viewers[i].synced = 0;
+    }
+    MUTEX_UNLOCK(webrtc->mutex);
+}
+
+void
+webrtc_video(webrtc_t *webrtc, const h264_decode_struct *data)
+{
+    assert(webrtc);
+    assert(data);
+
+    if (!data->data) {
+        return;
+    }
+    MUTEX_LOCK(webrtc->mutex);
+    if (data->frame_type == 0) {
+        /* Kept for the IDR frames, the parameter set frame itself has no timestamp */
+        int used = 0;
+        webrtc->parameter_set_count = 0;
+        for (int i = 0; i < data->nal_index.count && webrtc->parameter_set_count < 2; i++) {
+            const h264_nal_index_entry_t *nal = &data->nal_index.nals[i];
+            if ((nal->nal_unit_type != NAL_TYPE_SPS && nal->nal_unit_type != NAL_TYPE_PPS) ||
+                used + nal->size > WEBRTC_MAX_PARAMETER_SETS) {
+                continue;
+            }
+            memcpy(webrtc->parameter_sets + used, data->data + nal->offset, nal->size);
+            webrtc->parameter_set_offsets[webrtc->parameter_set_count] = used;
+            webrtc->parameter_set_sizes[webrtc->parameter_set_count] = nal->size;
+            webrtc->parameter_set_count++;
+            used += nal->size;
+        }
+        /* Drops what was kept in the old parameter sets */
+        gop_cache_add(webrtc->gop, data);
+        MUTEX_UNLOCK(webrtc->mutex);
+        return;
+    }
+
+    gop_cache_add(webrtc->gop, data);
+    for (int i = 0; i < WEBRTC_MAX_VIEWERS; i++) {
+        webrtc_viewer_t *viewer = &webrtc->viewers[i];
+        if (viewer->state != WEBRTC_VIEWER_STREAMING || (!viewer->synced && !data->is_idr)) {
+            continue;
+        }
+        webrtc_send_frame(webrtc, viewer, data->data, &data->nal_index, data->is_idr,
+                          webrtc_viewer_timestamp(viewer, data->pts));
+    }
+    MUTEX_UNLOCK(webrtc->mutex);
+}
+
+void
+webrtc_destroy(webrtc_t *webrtc)
+{
+    if (!webrtc) {
+        return;
+    }
+    if (webrtc->httpd) {
+        httpd_stop(webrtc->httpd);
+        httpd_destroy(webrtc->httpd);
+    }
+    if (ATOMIC_LOAD(webrtc->running)) {
+        ATOMIC_STORE(webrtc->running, 0);
+        reactor_wakeup(webrtc->reactor);
+        THREAD_JOIN(webrtc->thread);
+    }
+    for (int i = 0; i < WEBRTC_MAX_VIEWERS; i++) {
+        if (webrtc->viewers[i].state != WEBRTC_VIEWER_FREE) {
+            webrtc_viewer_close(&webrtc->viewers[i]);
+        }
+    }
+    if (webrtc->sock_ipv4 != -1) {
+        closesocket(webrtc->sock_ipv4);
+    }
+    if (webrtc->sock_ipv6 != -1) {
+        closesocket(webrtc->sock_ipv6);
+    }
+    if (webrtc->reactor) {
+        reactor_destroy(webrtc->reactor);
+    }
+    dtls_context_destroy(webrtc->dtls);
+    gop_cache_destroy(webrtc->gop);
+    MUTEX_DESTROY(webrtc->mutex);
+    free(webrtc);
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef WEBRTC_H
+#define WEBRTC_H
+
+#include "logger.h"
+#include "stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lets browsers watch the mirror over WebRTC, with the H.264 of the sender as it is, neither
+ * decoded nor encoded again. A page served over HTTP makes the offer and posts it to /offer,
+ * the answer comes back in the reply. The receiver is an ICE-lite agent with one host
+ * candidate per address family and the DTLS server, media goes over SRTP as RTP packetized
+ * like the restream (RFC 6184), all on one UDP port with the number of the HTTP port.
+ *
+ * Senders only send an IDR frame when the mirror starts or changes, so the frames since the
+ * last one are kept and sent to a new viewer ahead of the live ones, squeezed into a few
+ * milliseconds of timestamps so the browser shows the present at once. A viewer the browser
+ * stops checking the connectivity of for 30 seconds is dropped.
+ */
+typedef struct webrtc_s webrtc_t;
+
+webrtc_t *webrtc_init(logger_t *logger);
+/* Serves the page and the signaling on *port over TCP and the media on the same port over UDP */
+int webrtc_start(webrtc_t *webrtc, unsigned short *port);
+/* Forgets the frames kept for new viewers, for when the mirror being shown changes */
+void webrtc_reset(webrtc_t *webrtc);
+/* Called with every frame before the renderer takes it, data must stay valid only for the call */
+void webrtc_video(webrtc_t *webrtc, const h264_decode_struct *data);
+void webrtc_destroy(webrtc_t *webrtc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //WEBRTC_H
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include "worker_pool.h"
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "threads.h"
+
+typedef struct worker_pool_entry_s {
+    worker_pool_job_t job;
+    void *arg;
+} worker_pool_entry_t;
+
+struct worker_pool_s {
+    logger_t *logger;
+
+    thread_handle_t *threads;
+    int thread_count;
+
+    /* Ring of queued jobs, only touched with mutex locked */
+    worker_pool_entry_t *entries;
+    int queue_size;
+    int head;
+    int count;
+    int stopping;
+
+    mutex_handle_t mutex;
+    cond_handle_t cond;
+};
+
+static THREAD_RETVAL
+worker_pool_thread(void *arg)
+{
+    worker_pool_t *pool = arg;
+
+    while (1) {
+        worker_pool_entry_t entry;
+
+        MUTEX_LOCK(pool->mutex);
+        while (!pool->count && !pool->stopping) {
+            COND_WAIT(pool->cond, pool->mutex);
+        }
+        if (!pool->count) {
+            MUTEX_UNLOCK(pool->mutex);
+            break;
+        }
+        entry = pool->entries[pool->head];
+        pool->head = (pool->head + 1) % pool->queue_size;
+        pool->count--;
+        MUTEX_UNLOCK(pool->mutex);
+
+        entry.job(entry.arg);
+    }
+    return 0;
+}
+
+worker_pool_t *
+worker_pool_init(logger_t *logger, int threads, int queue_size)
+{
+    worker_pool_t *pool;
+
+    assert(threads > 0);
+    assert(queue_size > 0);
+
+    pool = calloc(1, sizeof(worker_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    pool->threads = calloc(threads, sizeof(thread_handle_t));
+    pool->entries = calloc(queue_size, sizeof(worker_pool_entry_t));
+    if (!pool->threads || !pool->entries) {
+        free(pool->threads);
+        free(pool->entries);
+        free(pool);
+        return NULL;
+    }
+    pool->logger = logger;
+    pool->queue_size = queue_size;
+    MUTEX_CREATE(pool->mutex);
+    COND_CREATE(pool->cond);
+
+    for (int i = 0; i < threads; i++) {
+        THREAD_CREATE(pool->threads[pool->thread_count], worker_pool_thread, pool);
+        if (!pool->threads[pool->thread_count]) {
+            logger_log(logger, LOGGER_WARNING, "Could only start %d of %d worker threads", i, threads);
+            break;
+        }
+        if (thread_apply_role(pool->threads[pool->thread_count], THREAD_ROLE_WORKER) < 0) {
+            logger_log(logger, LOGGER_WARNING, "Could not apply the scheduling settings of the worker threads");
+        }
+        pool->thread_count++;
+    }
+    if (!pool->thread_count) {
+        worker_pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void
+worker_pool_destroy(worker_pool_t *pool)
+{
+    if (pool) {
+        MUTEX_LOCK(pool->mutex);
+        pool->stopping = 1;
+        COND_BROADCAST(pool->cond);
+        MUTEX_UNLOCK(pool->mutex);
+
+        for (int i = 0; i < pool->thread_count; i++) {
+            THREAD_JOIN(pool->threads[i]);
+        }
+        MUTEX_DESTROY(pool->mutex);
+        COND_DESTROY(pool->cond);
+        free(pool->threads);
+        free(pool->entries);
+        free(pool);
+    }
+}
+
+int
+worker_pool_submit(worker_pool_t *pool, worker_pool_job_t job, void *arg)
+{
+    int ret = -1;
+
+    assert(pool);
+    assert(job);
+
+    MUTEX_LOCK(pool->mutex);
+    if (!pool->stopping && pool->count < pool->queue_size) {
+        worker_pool_entry_t *entry = &pool->entries[(pool->head + pool->count) % pool->queue_size];
+        entry->job = job;
+        entry->arg = arg;
+        pool->count++;
+        COND_SIGNAL(pool->cond);
+        ret = 0;
+    }
+    MUTEX_UNLOCK(pool->mutex);
+    return ret;
+}
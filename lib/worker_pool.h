@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "logger.h"
+
+/*
+ * A few threads running jobs from a bounded FIFO queue, for work that would otherwise
+ * block an I/O thread. Jobs report back on their own, the pool only runs them.
+ */
+typedef struct worker_pool_s worker_pool_t;
+
+typedef void (*worker_pool_job_t)(void *arg);
+
+worker_pool_t *worker_pool_init(logger_t *logger, int threads, int queue_size);
+/* Runs the jobs still queued, then joins the threads */
+void worker_pool_destroy(worker_pool_t *pool);
+
+/* Never blocks, returns -1 if the queue is full */
+int worker_pool_submit(worker_pool_t *pool, worker_pool_job_t job, void *arg);
+
+#endif //WORKER_POOL_H
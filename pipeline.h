@@ -0,0 +1,126 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Chains of stages that a buffer passes through, put together at compile time. Every stage
+ * knows the type of the rest of the chain, so a push is a direct call the compiler inlines,
+ * with no function pointer or virtual call per buffer, and the buffer is moved along rather
+ * than copied. Adding a stage is adding it to the list the source is made of.
+ *
+ * A stage has process(buffer, next), which hands the buffer on with next.push or keeps it:
+ *  - transform wraps a callable that sees the buffer and returns whether it goes on,
+ *  - sink wraps one that takes the buffer over and ends the chain,
+ *  - source turns the arguments of a callback into the buffer and pushes it down the chain.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <type_traits>
+#include <utility>
+
+namespace pipeline {
+
+template <class... Stages>
+class chain;
+
+// What lies past the last stage, buffers that get here are dropped
+template <>
+class chain<> {
+public:
+    template <class Buffer>
+    void push(Buffer &&) {}
+};
+
+template <class Stage, class... Rest>
+class chain<Stage, Rest...> {
+public:
+    explicit chain(Stage stage, Rest... rest) : stage(std::move(stage)), rest(std::move(rest)...) {}
+
+    template <class Buffer>
+    void push(Buffer &&buffer) { stage.process(std::forward<Buffer>(buffer), rest); }
+
+private:
+    Stage stage;
+    chain<Rest...> rest;
+};
+
+// Calls function(buffer), which may change it, and passes the buffer on if it returned true
+template <class Function>
+class transform {
+public:
+    explicit transform(Function function) : function(std::move(function)) {}
+
+    template <class Buffer, class Next>
+    void process(Buffer &&buffer, Next &next) {
+        if (function(buffer)) next.push(std::forward<Buffer>(buffer));
+    }
+
+private:
+    Function function;
+};
+
+// Hands the buffer over to function, nothing comes after it
+template <class Function>
+class sink {
+public:
+    explicit sink(Function function) : function(std::move(function)) {}
+
+    template <class Buffer, class Next>
+    void process(Buffer &&buffer, Next &) {
+        static_assert(std::is_same<Next, chain<>>::value, "A sink ends the chain");
+        function(std::forward<Buffer>(buffer));
+    }
+
+private:
+    Function function;
+};
+
+// Makes a buffer of whatever it is called with, with make, and pushes it through the stages
+template <class Make, class... Stages>
+class source {
+public:
+    explicit source(Make make, Stages... stages) : make(std::move(make)), stages(std::move(stages)...) {}
+
+    template <class... Args>
+    void operator()(Args &&... args) { stages.push(make(std::forward<Args>(args)...)); }
+
+private:
+    Make make;
+    chain<Stages...> stages;
+};
+
+template <class Function>
+transform<Function> make_transform(Function function) {
+    return transform<Function>(std::move(function));
+}
+
+template <class Function>
+sink<Function> make_sink(Function function) {
+    return sink<Function>(std::move(function));
+}
+
+template <class Make, class... Stages>
+source<Make, Stages...> make_source(Make make, Stages... stages) {
+    return source<Make, Stages...>(std::move(make), std::move(stages)...);
+}
+
+}
+
+#endif //PIPELINE_H
@@ -0,0 +1,35 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef AAC_DECODER_MEMORY_H
+#define AAC_DECODER_MEMORY_H
+
+#include "fdk-aac/libAACdec/include/aacdecoder_lib.h"
+#include "../lib/mem_account.h"
+
+static void *aac_decoder_memory_calloc(size_t count, size_t size) {
+    return mem_account_calloc(MEM_TAG_AAC_DECODER, count, size);
+}
+
+/* Charges the memory of fdk-aac to its own tag, call before every aacDecoder_Open, only the first one counts */
+static inline void aac_decoder_account_memory(void) {
+    aacDecoder_SetAllocator(aac_decoder_memory_calloc, mem_account_free);
+}
+
+#endif //AAC_DECODER_MEMORY_H
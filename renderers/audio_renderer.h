@@ -28,6 +28,7 @@ extern "C" {
 #include <stdbool.h>
 #include "../lib/logger.h"
 #include "../lib/raop_ntp.h"
+#include "../lib/audio_format.h"
 #include "video_renderer.h"
 
 typedef enum audio_device_e { AUDIO_DEVICE_HDMI, AUDIO_DEVICE_ANALOG, AUDIO_DEVICE_NONE } audio_device_t;
@@ -35,33 +36,62 @@ typedef enum audio_device_e { AUDIO_DEVICE_HDMI, AUDIO_DEVICE_ANALOG, AUDIO_DEVI
 typedef enum audio_renderer_type_e {
     AUDIO_RENDERER_DUMMY,
     AUDIO_RENDERER_RPI,
-    AUDIO_RENDERER_GSTREAMER
+    AUDIO_RENDERER_GSTREAMER,
+    AUDIO_RENDERER_ALSA
 } audio_renderer_type_t;
 
 typedef struct audio_renderer_config_s {
     audio_device_t device;
     bool low_latency;
+    int latency_target; // ms between a frame's pts and its playback, where the renderer honours it
+    int resync_threshold; // ms, a quarter of how late a frame may be before the rpi renderer restarts its clock from it, 0 keeps 100
+    int batch_ms; // PCM the rpi renderer collects into one OMX buffer, 0 for a buffer per decoded frame
+    int omx_latency_target; // ms the rpi renderer's output holds its queue at by steering the clock itself, 0 resamples instead
+    int omx_latency_speed; // Speed factor and inflection point of that steering, 0 keeps the renderer's defaults
+    int omx_latency_inflection;
+    bool decode_aac; // The gstreamer renderer decodes AAC with the bundled fdk-aac and plays PCM, no ALAC then
+    bool mix; // Renderers that can, mix the streams from open_stream into their output
+    const char *sync_group; // Name of the group of receivers to play in sync with, NULL for none (alsa)
+    int bench_interval; // Seconds between the dummy renderer's throughput summaries, -1 measures nothing, 0 only at the end
 } audio_renderer_config_t;
 
 typedef struct audio_renderer_s audio_renderer_t;
 
 typedef struct audio_renderer_funcs_s {
     void (*start)(audio_renderer_t *renderer);
+    // Optional, switches to format before the first frame of a stream in it. Renderers without
+    // it get the default AAC-ELD stream, or take every format they list without being told.
+    void (*set_format)(audio_renderer_t *renderer, const audio_format_t *format);
+    // data is NULL for a lost frame, renderers that run the AAC decoder themselves conceal it
     void (*render_buffer)(audio_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts);
     void (*set_volume)(audio_renderer_t *renderer, float volume);
     void (*flush)(audio_renderer_t *renderer);
     void (*destroy)(audio_renderer_t *renderer);
+    // Optional, a renderer for one more stream that plays at the same time, mixed into the
+    // output of this one with a volume of its own, or NULL without config->mix. Its start does
+    // nothing, and it is destroyed before this one.
+    audio_renderer_t *(*open_stream)(audio_renderer_t *renderer);
 } audio_renderer_funcs_t;
 
 typedef struct audio_renderer_s {
     audio_renderer_funcs_t const *funcs;
     logger_t *logger;
     audio_renderer_type_t type;
+    uint64_t formats; // AirPlay audioFormat bits the renderer can play, offered to senders
+    // Micro seconds after its pts a frame is heard, an estimate from init on and then as last measured
+    // while playing, 0 while unknown. Written with ATOMIC_STORE by the renderer, read from any thread.
+    int output_latency;
+    // Times the output ran dry or a frame came too late to be played on time, counted up with
+    // ATOMIC_FETCH_ADD by the renderers that can tell, read from any thread
+    int underruns;
 } audio_renderer_t;
 
+typedef audio_renderer_t *(*audio_init_func_t)(logger_t *logger, video_renderer_t *video_renderer, audio_renderer_config_t const *config);
+
 audio_renderer_t *audio_renderer_dummy_init(logger_t *logger, video_renderer_t *video_renderer, audio_renderer_config_t const *config);
 audio_renderer_t *audio_renderer_rpi_init(logger_t *logger, video_renderer_t *video_renderer, audio_renderer_config_t const *config);
 audio_renderer_t *audio_renderer_gstreamer_init(logger_t *logger, video_renderer_t *video_renderer, audio_renderer_config_t const *config);
+audio_renderer_t *audio_renderer_alsa_init(logger_t *logger, video_renderer_t *video_renderer, audio_renderer_config_t const *config);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,677 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * AAC-ELD and AAC-LC renderer using fdk-aac for decoding and ALSA in mmap mode for playback.
+ *
+ * With config->mix the renderer and every stream open_stream adds decode into an audio_mixer_t
+ * instead, at the local time each frame is to play, and a thread of the renderer feeds the mix
+ * to the device period by period. All of them then play at 44.1 kHz.
+ */
+
+#include "audio_renderer.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <alsa/asoundlib.h>
+
+#include "fdk-aac/libAACdec/include/aacdecoder_lib.h"
+#include "aac_decoder_memory.h"
+#include "../lib/metrics.h"
+#include "../lib/perf_counters.h"
+#include "../lib/audio_mixer.h"
+#include "../lib/audio_gain.h"
+#include "../lib/audio_resampler.h"
+#include "../lib/sync_group.h"
+#include "../lib/threads.h"
+#include "../lib/media_clock.h"
+
+#define ALSA_DEVICE "default"
+#define ALSA_CHANNELS 2
+// Periods left for network jitter when playing without pts sync
+#define ALSA_LOW_LATENCY_PERIODS 4
+// Headroom above the latency target, so a late packet does not cause an underrun right away
+#define ALSA_HEADROOM_PERIODS 2
+// Rate all mixed streams have to share, that of screen mirroring
+#define ALSA_MIX_RATE 44100
+// Periods the output thread feeds the mix in, 10 ms
+#define ALSA_MIX_PERIOD_FRAMES (ALSA_MIX_RATE / 100)
+// Device buffer in a sync group, room for the delay of whichever node needs the most
+#define ALSA_SYNC_BUFFER_MS 1000
+// Further off the group's playout time than the resampler catches up with, the device starts over
+#define ALSA_SYNC_RESYNC_US 10000
+
+typedef struct audio_renderer_alsa_s {
+    audio_renderer_t base;
+    audio_renderer_config_t const *config;
+
+    HANDLE_AACDECODER audio_decoder;
+    INT_PCM *pcm;
+    int pcm_samples;
+    int frame_samples;
+    int sample_rate;
+
+    snd_pcm_t *handle;
+    bool mmap;
+    snd_pcm_uframes_t period_frames;
+    snd_pcm_uframes_t buffer_frames;
+    // Set after opening, an underrun or a flush, the next frame then primes the buffer
+    bool needs_prefill;
+    // Decoder history to drop with the next frame after a flush
+    UINT decode_flags;
+    // Software volume, ramped as the decoded PCM goes out
+    audio_gain_t gain;
+
+    // Set with config->mix. Streams from open_stream have a parent and neither device nor thread.
+    struct audio_renderer_alsa_s *parent;
+    audio_mixer_t *mixer;
+    audio_mixer_stream_t *mixer_stream;
+    // How long after its pts a frame goes into the mix
+    uint64_t mix_delay;
+    INT_PCM *mix_pcm;
+    thread_handle_t output_thread;
+    int output_running;
+
+    // Set with config->sync_group, frames then play at their pts plus the group's delay
+    sync_group_t *sync_group;
+    audio_resampler_t *resampler;
+    INT_PCM *resampled;
+    int resampled_frames;
+} audio_renderer_alsa_t;
+
+static const audio_renderer_funcs_t audio_renderer_alsa_funcs;
+
+static void audio_renderer_alsa_destroy_decoder(audio_renderer_alsa_t *renderer) {
+    if (renderer->audio_decoder) {
+        aacDecoder_Close(renderer->audio_decoder);
+        renderer->audio_decoder = NULL;
+    }
+    free(renderer->pcm);
+    renderer->pcm = NULL;
+    audio_resampler_destroy(renderer->resampler);
+    renderer->resampler = NULL;
+    free(renderer->resampled);
+    renderer->resampled = NULL;
+}
+
+static int audio_renderer_alsa_init_decoder(audio_renderer_alsa_t *renderer, const audio_format_t *format) {
+    aac_decoder_account_memory();
+    renderer->audio_decoder = aacDecoder_Open(TT_MP4_RAW, 1);
+    if (renderer->audio_decoder == NULL) {
+        logger_log(renderer->base.logger, LOGGER_ERR, "aacDecoder open failed!");
+        return -1;
+    }
+    /* ASC config binary data */
+    UCHAR asc[AUDIO_FORMAT_MAX_CONFIG];
+    UCHAR *conf[] = { asc };
+    UINT conf_len = audio_format_get_config(format, asc);
+    if (aacDecoder_ConfigRaw(renderer->audio_decoder, conf, &conf_len) != AAC_DEC_OK) {
+        logger_log(renderer->base.logger, LOGGER_ERR, "Unable to set configRaw");
+        return -2;
+    }
+    CStreamInfo *aac_stream_info = aacDecoder_GetStreamInfo(renderer->audio_decoder);
+    if (aac_stream_info == NULL) {
+        logger_log(renderer->base.logger, LOGGER_ERR, "aacDecoder_GetStreamInfo failed!");
+        return -3;
+    }
+
+    int samples_per_frame = aac_stream_info->aacSamplesPerFrame > 0 ? aac_stream_info->aacSamplesPerFrame : format->frame_samples;
+    renderer->sample_rate = format->sample_rate;
+    renderer->frame_samples = samples_per_frame;
+    renderer->pcm_samples = samples_per_frame * ALSA_CHANNELS;
+    renderer->pcm = malloc(renderer->pcm_samples * sizeof(INT_PCM));
+    if (renderer->pcm == NULL) {
+        return -4;
+    }
+    if (renderer->sync_group) {
+        // The resampler turns out a frame or so more than it takes in while it catches up
+        renderer->resampled_frames = samples_per_frame + 16;
+        renderer->resampler = audio_resampler_init(ALSA_CHANNELS, format->sample_rate);
+        renderer->resampled = malloc(renderer->resampled_frames * ALSA_CHANNELS * sizeof(INT_PCM));
+        if (!renderer->resampler || !renderer->resampled) {
+            return -5;
+        }
+    }
+    return 1;
+}
+
+static int audio_renderer_alsa_init_pcm(audio_renderer_alsa_t *renderer) {
+    logger_t *logger = renderer->base.logger;
+    int ret;
+
+    // Non-blocking, a full buffer drops the frame instead of stalling the RTP thread
+    if ((ret = snd_pcm_open(&renderer->handle, ALSA_DEVICE, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK)) < 0) {
+        logger_log(logger, LOGGER_ERR, "Could not open ALSA device %s: %s", ALSA_DEVICE, snd_strerror(ret));
+        renderer->handle = NULL;
+        return -1;
+    }
+
+    // One AAC frame per period, the buffer holds the latency target, or that of any node of the
+    // sync group. The mix waits in the mixer for its time instead, the device only buffers
+    // enough to ride out the output thread's wakeups.
+    snd_pcm_uframes_t period_frames = renderer->mixer ? ALSA_MIX_PERIOD_FRAMES : renderer->frame_samples;
+    snd_pcm_uframes_t buffer_frames;
+    if (renderer->config->low_latency || renderer->mixer) {
+        buffer_frames = period_frames * ALSA_LOW_LATENCY_PERIODS;
+    } else {
+        int target_ms = renderer->config->latency_target;
+        if (renderer->sync_group && target_ms < ALSA_SYNC_BUFFER_MS) target_ms = ALSA_SYNC_BUFFER_MS;
+        snd_pcm_uframes_t target_frames = (snd_pcm_uframes_t) target_ms * renderer->sample_rate / 1000;
+        buffer_frames = ((target_frames + period_frames - 1) / period_frames + ALSA_HEADROOM_PERIODS) * period_frames;
+    }
+
+    snd_pcm_hw_params_t *hw_params;
+    snd_pcm_hw_params_malloc(&hw_params);
+    snd_pcm_hw_params_any(renderer->handle, hw_params);
+    renderer->mmap = snd_pcm_hw_params_set_access(renderer->handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0;
+    if (!renderer->mmap) {
+        logger_log(logger, LOGGER_INFO, "ALSA device %s does not support mmap, falling back to writes", ALSA_DEVICE);
+        snd_pcm_hw_params_set_access(renderer->handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+    }
+    unsigned int rate = renderer->sample_rate;
+    if ((ret = snd_pcm_hw_params_set_format(renderer->handle, hw_params, SND_PCM_FORMAT_S16)) < 0 ||
+        (ret = snd_pcm_hw_params_set_channels(renderer->handle, hw_params, ALSA_CHANNELS)) < 0 ||
+        (ret = snd_pcm_hw_params_set_rate_near(renderer->handle, hw_params, &rate, NULL)) < 0 ||
+        (ret = snd_pcm_hw_params_set_period_size_near(renderer->handle, hw_params, &period_frames, NULL)) < 0 ||
+        (ret = snd_pcm_hw_params_set_buffer_size_near(renderer->handle, hw_params, &buffer_frames)) < 0 ||
+        (ret = snd_pcm_hw_params(renderer->handle, hw_params)) < 0) {
+        logger_log(logger, LOGGER_ERR, "Could not configure ALSA device %s: %s", ALSA_DEVICE, snd_strerror(ret));
+        snd_pcm_hw_params_free(hw_params);
+        return -2;
+    }
+    snd_pcm_hw_params_free(hw_params);
+    if (rate != (unsigned int) renderer->sample_rate) {
+        logger_log(logger, LOGGER_WARNING, "ALSA device %s plays at %u Hz instead of %d Hz", ALSA_DEVICE, rate,
+                   renderer->sample_rate);
+    }
+    renderer->period_frames = period_frames;
+    renderer->buffer_frames = buffer_frames;
+
+    // Start as soon as the first period is in, the prefill decides the actual delay
+    snd_pcm_sw_params_t *sw_params;
+    snd_pcm_sw_params_malloc(&sw_params);
+    snd_pcm_sw_params_current(renderer->handle, sw_params);
+    snd_pcm_sw_params_set_start_threshold(renderer->handle, sw_params, period_frames);
+    snd_pcm_sw_params_set_avail_min(renderer->handle, sw_params, period_frames);
+    ret = snd_pcm_sw_params(renderer->handle, sw_params);
+    snd_pcm_sw_params_free(sw_params);
+    if (ret < 0) {
+        logger_log(logger, LOGGER_ERR, "Could not set ALSA software parameters: %s", snd_strerror(ret));
+        return -3;
+    }
+
+    logger_log(logger, LOGGER_DEBUG, "ALSA %s: %lu frame periods, %lu frame buffer, %s", ALSA_DEVICE,
+               (unsigned long) period_frames, (unsigned long) buffer_frames, renderer->mmap ? "mmap" : "read/write");
+    return 1;
+}
+
+static void audio_renderer_alsa_destroy(audio_renderer_t *renderer);
+
+// Sets up mixing for a renderer whose decoder is open, before the device is
+static int audio_renderer_alsa_init_mixer(audio_renderer_alsa_t *renderer) {
+    const audio_renderer_config_t *config = renderer->config;
+    int capacity = ALSA_MIX_RATE + (config->low_latency ? 0 : config->latency_target * ALSA_MIX_RATE / 1000);
+    renderer->mixer = audio_mixer_init(ALSA_CHANNELS, ALSA_MIX_RATE, capacity);
+    renderer->mixer_stream = renderer->mixer ? audio_mixer_stream_init(renderer->mixer) : NULL;
+    renderer->mix_pcm = malloc(ALSA_MIX_PERIOD_FRAMES * ALSA_CHANNELS * sizeof(INT_PCM));
+    if (!renderer->mixer_stream || !renderer->mix_pcm) {
+        logger_log(renderer->base.logger, LOGGER_ERR, "Could not allocate the audio mixer");
+        return -1;
+    }
+    return 1;
+}
+
+// After the device is open: frames go into the mix at their pts plus the latency target, or
+// with just enough room for the device buffer and some jitter in low latency mode
+static void audio_renderer_alsa_init_mix_delay(audio_renderer_alsa_t *renderer) {
+    uint64_t device = (uint64_t) renderer->buffer_frames * 1000000 / ALSA_MIX_RATE;
+    uint64_t headroom = (uint64_t) ALSA_HEADROOM_PERIODS * renderer->frame_samples * 1000000 / ALSA_MIX_RATE;
+    renderer->mix_delay = renderer->config->low_latency ? 0 : (uint64_t) renderer->config->latency_target * 1000;
+    if (renderer->mix_delay < device + headroom) {
+        renderer->mix_delay = device + headroom;
+    }
+}
+
+audio_renderer_t *audio_renderer_alsa_init(logger_t *logger, video_renderer_t *video_renderer, audio_renderer_config_t const *config) {
+    audio_renderer_alsa_t *renderer;
+    renderer = calloc(1, sizeof(audio_renderer_alsa_t));
+    if (!renderer) {
+        return NULL;
+    }
+    renderer->base.logger = logger;
+    renderer->base.funcs = &audio_renderer_alsa_funcs;
+    renderer->base.type = AUDIO_RENDERER_ALSA;
+    renderer->config = config;
+    audio_gain_init(&renderer->gain, AUDIO_GAIN_UNITY);
+    renderer->needs_prefill = true;
+    renderer->base.formats = config->mix ? AUDIO_FORMAT_AAC_LC_44100 | AUDIO_FORMAT_AAC_ELD_44100 : AUDIO_FORMATS_AAC;
+
+    if (config->sync_group && (config->low_latency || config->mix)) {
+        logger_log(logger, LOGGER_WARNING, "The ALSA renderer plays in a sync group on the sender's clock without mixing only, "
+                   "ignoring the group");
+    } else if (config->sync_group) {
+        renderer->sync_group = sync_group_init(logger, config->sync_group, config->latency_target);
+        if (!renderer->sync_group) {
+            free(renderer);
+            return NULL;
+        }
+    }
+
+    audio_format_t format;
+    audio_format_init_default(&format);
+    if (audio_renderer_alsa_init_decoder(renderer, &format) != 1 ||
+        (config->mix && audio_renderer_alsa_init_mixer(renderer) != 1) ||
+        audio_renderer_alsa_init_pcm(renderer) != 1) {
+        audio_renderer_alsa_destroy(&renderer->base);
+        return NULL;
+    }
+    if (renderer->mixer) {
+        audio_renderer_alsa_init_mix_delay(renderer);
+        logger_log(logger, LOGGER_INFO, "Mixing the audio of simultaneous senders, %llu ms behind their pts",
+                   (unsigned long long) renderer->mix_delay / 1000);
+        // The mix plays every frame exactly that late
+        renderer->base.output_latency = (int) renderer->mix_delay;
+    } else if (renderer->sync_group) {
+        renderer->base.output_latency = config->latency_target * 1000;
+    } else {
+        // Until the first frames tell, the prefill puts them at the latency target, or a period behind with -l
+        renderer->base.output_latency = config->low_latency ? (int) (renderer->period_frames * 1000000 / renderer->sample_rate)
+                                                            : config->latency_target * 1000;
+    }
+    return &renderer->base;
+}
+
+static THREAD_RETVAL audio_renderer_alsa_output_thread(void *arg);
+
+static void audio_renderer_alsa_start(audio_renderer_t *renderer) {
+    audio_renderer_alsa_t *r = (audio_renderer_alsa_t *)renderer;
+    if (r->parent) return;
+    snd_pcm_prepare(r->handle);
+    r->needs_prefill = true;
+    if (r->mixer && !r->output_thread) {
+        ATOMIC_STORE(r->output_running, 1);
+        THREAD_CREATE(r->output_thread, audio_renderer_alsa_output_thread, r);
+        if (!r->output_thread) {
+            logger_log(renderer->logger, LOGGER_ERR, "Could not start the ALSA output thread");
+        } else {
+            thread_set_name(r->output_thread, "alsa");
+        }
+    }
+}
+
+static void audio_renderer_alsa_close_pcm(audio_renderer_alsa_t *r) {
+    if (r->handle) {
+        snd_pcm_drop(r->handle);
+        snd_pcm_close(r->handle);
+        r->handle = NULL;
+    }
+}
+
+static void audio_renderer_alsa_set_format(audio_renderer_t *renderer, const audio_format_t *format) {
+    audio_renderer_alsa_t *r = (audio_renderer_alsa_t *)renderer;
+    if (format->codec == AUDIO_CODEC_ALAC) {
+        logger_log(renderer->logger, LOGGER_ERR, "The ALSA renderer cannot decode ALAC");
+        audio_renderer_alsa_destroy_decoder(r);
+        return;
+    }
+    if (r->mixer_stream) {
+        // The device stays as it is for the other streams, this one only needs a decoder
+        audio_renderer_alsa_destroy_decoder(r);
+        if (format->sample_rate != ALSA_MIX_RATE) {
+            logger_log(renderer->logger, LOGGER_ERR, "Cannot mix audio at %d Hz into the %d Hz output",
+                       format->sample_rate, ALSA_MIX_RATE);
+            return;
+        }
+        if (audio_renderer_alsa_init_decoder(r, format) != 1) {
+            audio_renderer_alsa_destroy_decoder(r);
+            return;
+        }
+        r->decode_flags = 0;
+        audio_mixer_stream_reset(r->mixer_stream);
+        return;
+    }
+    // The period follows the frame size of the codec, so the device is opened anew with the decoder
+    audio_renderer_alsa_destroy_decoder(r);
+    audio_renderer_alsa_close_pcm(r);
+    if (audio_renderer_alsa_init_decoder(r, format) != 1 || audio_renderer_alsa_init_pcm(r) != 1) {
+        logger_log(renderer->logger, LOGGER_ERR, "Could not switch ALSA playback to %s at %d Hz",
+                   audio_format_get_codec_name(format->codec), format->sample_rate);
+        audio_renderer_alsa_destroy_decoder(r);
+        audio_renderer_alsa_close_pcm(r);
+        return;
+    }
+    snd_pcm_prepare(r->handle);
+    r->decode_flags = 0;
+    r->needs_prefill = true;
+}
+
+static void audio_renderer_alsa_copy(audio_renderer_alsa_t *r, INT_PCM *dst, const INT_PCM *src, snd_pcm_uframes_t frames) {
+    if (src == NULL) {
+        memset(dst, 0, frames * ALSA_CHANNELS * sizeof(INT_PCM));
+    } else {
+        audio_gain_apply(&r->gain, dst, src, (int) frames, ALSA_CHANNELS);
+    }
+}
+
+/*
+ * Writes frames of interleaved PCM, or silence if pcm is NULL. Whatever does not fit
+ * into the free part of the buffer is dropped, which bounds the latency to the buffer size.
+ */
+static void audio_renderer_alsa_write(audio_renderer_alsa_t *r, INT_PCM *pcm, snd_pcm_uframes_t frames) {
+    logger_t *logger = r->base.logger;
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(r->handle);
+    if (avail < 0) {
+        logger_log(logger, LOGGER_DEBUG, "ALSA underrun, restarting playback");
+        metrics_add(METRIC_AUDIO_UNDERRUNS, 1);
+        ATOMIC_FETCH_ADD(r->base.underruns, 1);
+        snd_pcm_recover(r->handle, (int) avail, 1);
+        r->needs_prefill = true;
+        return;
+    }
+    if ((snd_pcm_uframes_t) avail < frames) {
+        LOGGER_DEBUG_HOT(logger, "ALSA buffer full, dropping %lu frames", (unsigned long) (frames - avail));
+        frames = avail;
+    }
+
+    if (!r->mmap) {
+        if (pcm) {
+            audio_renderer_alsa_copy(r, pcm, pcm, frames);
+        } else {
+            pcm = r->pcm;
+            frames = frames < r->period_frames ? frames : r->period_frames;
+            memset(pcm, 0, frames * ALSA_CHANNELS * sizeof(INT_PCM));
+        }
+        snd_pcm_sframes_t written = snd_pcm_writei(r->handle, pcm, frames);
+        if (written < 0) {
+            snd_pcm_recover(r->handle, (int) written, 1);
+            r->needs_prefill = true;
+        }
+        return;
+    }
+
+    // Decoded PCM goes into the DMA buffer in a single pass that also applies the volume
+    while (frames > 0) {
+        const snd_pcm_channel_area_t *areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t count = frames;
+        int ret = snd_pcm_mmap_begin(r->handle, &areas, &offset, &count);
+        if (ret < 0) {
+            snd_pcm_recover(r->handle, ret, 1);
+            r->needs_prefill = true;
+            return;
+        }
+        INT_PCM *dst = (INT_PCM *) ((unsigned char *) areas[0].addr + areas[0].first / 8 + offset * areas[0].step / 8);
+        audio_renderer_alsa_copy(r, dst, pcm, count);
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(r->handle, offset, count);
+        if (committed < 0 || (snd_pcm_uframes_t) committed != count) {
+            snd_pcm_recover(r->handle, committed < 0 ? (int) committed : -EPIPE, 1);
+            r->needs_prefill = true;
+            return;
+        }
+        if (pcm) pcm += count * ALSA_CHANNELS;
+        frames -= count;
+    }
+}
+
+static uint64_t audio_renderer_alsa_now_us(void) {
+    // Same clock as raop_ntp_get_local_time()
+    return media_clock_now();
+}
+
+/*
+ * Plays a decoded frame at its pts plus the delay the sync group agreed on. The prefill puts
+ * it there, then the resampler holds it there against the drift of the device's clock, which
+ * snd_pcm_delay shows frame by frame.
+ */
+static void audio_renderer_alsa_render_synced(audio_renderer_alsa_t *r, uint64_t pts, int frames) {
+    int64_t delay = sync_group_get_delay(r->sync_group);
+    audio_resampler_hold(r->resampler, delay);
+
+    snd_pcm_sframes_t queued;
+    if (!r->needs_prefill && snd_pcm_delay(r->handle, &queued) == 0 && queued >= 0) {
+        int64_t late = (int64_t) audio_renderer_alsa_now_us() + (int64_t) queued * 1000000 / r->sample_rate - (int64_t) pts;
+        metrics_set(METRIC_SYNC_GROUP_ERROR, late - delay);
+        if (late > 0) ATOMIC_STORE(r->base.output_latency, (int) late);
+        if (late - delay > ALSA_SYNC_RESYNC_US || late - delay < -ALSA_SYNC_RESYNC_US) {
+            logger_log(r->base.logger, LOGGER_DEBUG, "Audio plays %lld us off the sync group, starting over",
+                       (long long) (late - delay));
+            snd_pcm_drop(r->handle);
+            snd_pcm_prepare(r->handle);
+            r->needs_prefill = true;
+        } else {
+            audio_resampler_steer(r->resampler, late);
+        }
+    }
+
+    if (r->needs_prefill) {
+        int64_t silence_us = (int64_t) pts + delay - (int64_t) audio_renderer_alsa_now_us();
+        snd_pcm_uframes_t max_silence = r->buffer_frames - 2 * r->period_frames;
+        snd_pcm_uframes_t silence = silence_us > 0 ? (snd_pcm_uframes_t) (silence_us * r->sample_rate / 1000000) : 0;
+        if (silence > max_silence) {
+            logger_log(r->base.logger, LOGGER_WARNING, "The sync group's delay of %lld ms is more than ALSA can buffer",
+                       (long long) delay / 1000);
+            silence = max_silence;
+        }
+        audio_resampler_reset(r->resampler);
+        r->needs_prefill = false;
+        // Silence goes in a period at a time, which is all a write takes of it
+        while (silence > 0 && !r->needs_prefill) {
+            snd_pcm_uframes_t count = silence < r->period_frames ? silence : r->period_frames;
+            audio_renderer_alsa_write(r, NULL, count);
+            silence -= count;
+        }
+    }
+
+    audio_resampler_process(r->resampler, r->pcm, frames, NULL, 0);
+    int available;
+    while ((available = audio_resampler_available(r->resampler)) > 0) {
+        int count = audio_resampler_process(r->resampler, NULL, 0, r->resampled,
+                                            available < r->resampled_frames ? available : r->resampled_frames);
+        audio_renderer_alsa_write(r, r->resampled, count);
+    }
+}
+
+static void audio_renderer_alsa_render_buffer(audio_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts) {
+    audio_renderer_alsa_t *r = (audio_renderer_alsa_t *)renderer;
+    AAC_DECODER_ERROR error;
+    UINT conceal = 0;
+
+    // Left without a decoder or device by a format it could not switch to
+    if (!r->audio_decoder || !(r->handle || r->mixer_stream)) return;
+
+    if (data == NULL) {
+        // A lost frame is concealed from the decoder history, of which there is none right after a flush
+        if (r->decode_flags & AACDEC_CLRHIST) return;
+        conceal = AACDEC_CONCEAL;
+    } else {
+        if (data_len == 0) return;
+
+        // We assume that every buffer contains exactly 1 frame.
+        UCHAR *p_buffer[1] = {data};
+        UINT buffer_size = data_len;
+        UINT bytes_valid = data_len;
+        error = aacDecoder_Fill(r->audio_decoder, p_buffer, &buffer_size, &bytes_valid);
+        if (error != AAC_DEC_OK) {
+            logger_log(renderer->logger, LOGGER_ERR, "aacDecoder_Fill error : %x", error);
+            return;
+        }
+    }
+    error = aacDecoder_DecodeFrame(r->audio_decoder, r->pcm, r->pcm_samples, r->decode_flags | conceal);
+    r->decode_flags = 0;
+    perf_counters_mark(PERF_STAGE_AUDIO_DECODE, 1);
+    if (error != AAC_DEC_OK) {
+        logger_log(renderer->logger, LOGGER_ERR, "aacDecoder_DecodeFrame error : 0x%x", error);
+        return;
+    }
+    CStreamInfo *aac_stream_info = aacDecoder_GetStreamInfo(r->audio_decoder);
+    if (aac_stream_info->numChannels != ALSA_CHANNELS) {
+        logger_log(renderer->logger, LOGGER_ERR, "Unexpected number of audio channels %d", aac_stream_info->numChannels);
+        return;
+    }
+
+    if (r->mixer_stream) {
+        audio_mixer_stream_write(r->mixer_stream, r->pcm, aac_stream_info->frameSize, pts + r->mix_delay);
+        return;
+    }
+    if (r->sync_group) {
+        audio_renderer_alsa_render_synced(r, pts, aac_stream_info->frameSize);
+        return;
+    }
+
+    // The frame is heard once everything queued in the device ahead of it has played
+    snd_pcm_sframes_t queued;
+    if (!r->needs_prefill && snd_pcm_delay(r->handle, &queued) == 0 && queued >= 0) {
+        int64_t latency = (int64_t) audio_renderer_alsa_now_us() + (int64_t) queued * 1000000 / r->sample_rate - (int64_t) pts;
+        if (latency > 0) ATOMIC_STORE(r->base.output_latency, (int) latency);
+    }
+
+    if (r->needs_prefill) {
+        // Silence up front puts this frame at its pts plus the latency target, or just
+        // leaves a period of slack for jitter in low latency mode
+        snd_pcm_uframes_t silence = r->period_frames;
+        if (!r->config->low_latency) {
+            int64_t delay = (int64_t) pts + (int64_t) r->config->latency_target * 1000 - (int64_t) audio_renderer_alsa_now_us();
+            snd_pcm_uframes_t max_silence = r->buffer_frames - 2 * r->period_frames;
+            silence = delay > 0 ? (snd_pcm_uframes_t) (delay * r->sample_rate / 1000000) : 0;
+            if (silence > max_silence) silence = max_silence;
+        }
+        r->needs_prefill = false;
+        if (silence > 0) audio_renderer_alsa_write(r, NULL, silence);
+    }
+
+    audio_renderer_alsa_write(r, r->pcm, aac_stream_info->frameSize);
+}
+
+static void audio_renderer_alsa_set_volume(audio_renderer_t *renderer, float volume) {
+    audio_renderer_alsa_t *r = (audio_renderer_alsa_t *)renderer;
+    // AirPlay sends 0 dB down to -30 dB, and -144 dB for mute
+    int gain = volume <= -30.0f ? 0 : audio_gain_from_db(volume);
+    if (r->mixer_stream) {
+        // Every stream has its own volume in the mix, the output plays it unchanged
+        audio_mixer_stream_set_gain(r->mixer_stream, gain);
+    } else {
+        audio_gain_set(&r->gain, gain);
+    }
+}
+
+static void audio_renderer_alsa_flush(audio_renderer_t *renderer) {
+    audio_renderer_alsa_t *r = (audio_renderer_alsa_t *)renderer;
+    if (!r->audio_decoder) return;
+    if (r->mixer_stream) {
+        // What is in the mix already plays out, the other streams go on
+        aacDecoder_SetParam(r->audio_decoder, AAC_TPDEC_CLEAR_BUFFER, 1);
+        r->decode_flags = AACDEC_INTR | AACDEC_CLRHIST;
+        audio_mixer_stream_reset(r->mixer_stream);
+        return;
+    }
+    if (!r->handle) return;
+    aacDecoder_SetParam(r->audio_decoder, AAC_TPDEC_CLEAR_BUFFER, 1);
+    r->decode_flags = AACDEC_INTR | AACDEC_CLRHIST;
+    snd_pcm_drop(r->handle);
+    snd_pcm_prepare(r->handle);
+    r->needs_prefill = true;
+}
+
+/*
+ * Feeds the mix to the device whenever a period of it is free, with the time the period will
+ * play at from the delay the device reports, so the mixer places every stream's frames there.
+ */
+static THREAD_RETVAL audio_renderer_alsa_output_thread(void *arg) {
+    audio_renderer_alsa_t *r = arg;
+    logger_t *logger = r->base.logger;
+
+    while (ATOMIC_LOAD(r->output_running)) {
+        int ret = snd_pcm_wait(r->handle, 100);
+        snd_pcm_sframes_t avail = ret < 0 ? ret : snd_pcm_avail_update(r->handle);
+        if (avail < 0) {
+            logger_log(logger, LOGGER_DEBUG, "ALSA underrun, restarting playback");
+            metrics_add(METRIC_AUDIO_UNDERRUNS, 1);
+            ATOMIC_FETCH_ADD(r->base.underruns, 1);
+            snd_pcm_recover(r->handle, (int) avail, 1);
+            continue;
+        }
+        while (avail >= (snd_pcm_sframes_t) r->period_frames) {
+            snd_pcm_sframes_t delay;
+            if (snd_pcm_delay(r->handle, &delay) < 0 || delay < 0) {
+                delay = 0;
+            }
+            uint64_t play_time = audio_renderer_alsa_now_us() + (uint64_t) delay * 1000000 / ALSA_MIX_RATE;
+            audio_mixer_take(r->mixer, r->mix_pcm, r->period_frames, play_time);
+            audio_renderer_alsa_write(r, r->mix_pcm, r->period_frames);
+            avail -= r->period_frames;
+        }
+    }
+    return 0;
+}
+
+static audio_renderer_t *audio_renderer_alsa_open_stream(audio_renderer_t *renderer) {
+    audio_renderer_alsa_t *r = (audio_renderer_alsa_t *)renderer;
+    if (!r->mixer) return NULL;
+
+    audio_renderer_alsa_t *stream = calloc(1, sizeof(audio_renderer_alsa_t));
+    if (!stream) {
+        return NULL;
+    }
+    stream->base = r->base;
+    stream->config = r->config;
+    stream->parent = r;
+    stream->mix_delay = r->mix_delay;
+    audio_gain_init(&stream->gain, AUDIO_GAIN_UNITY);
+
+    audio_format_t format;
+    audio_format_init_default(&format);
+    stream->mixer_stream = audio_mixer_stream_init(r->mixer);
+    if (!stream->mixer_stream || audio_renderer_alsa_init_decoder(stream, &format) != 1) {
+        audio_renderer_alsa_destroy(&stream->base);
+        return NULL;
+    }
+    return &stream->base;
+}
+
+static void audio_renderer_alsa_destroy(audio_renderer_t *renderer) {
+    if (renderer) {
+        audio_renderer_alsa_t *r = (audio_renderer_alsa_t *)renderer;
+        if (r->output_thread) {
+            ATOMIC_STORE(r->output_running, 0);
+            THREAD_JOIN(r->output_thread);
+        }
+        audio_renderer_alsa_close_pcm(r);
+        audio_renderer_alsa_destroy_decoder(r);
+        audio_mixer_stream_destroy(r->mixer_stream);
+        audio_mixer_destroy(r->mixer);
+        free(r->mix_pcm);
+        sync_group_destroy(r->sync_group);
+        free(renderer);
+    }
+}
+
+static const audio_renderer_funcs_t audio_renderer_alsa_funcs = {
+    .start = audio_renderer_alsa_start,
+    .set_format = audio_renderer_alsa_set_format,
+    .render_buffer = audio_renderer_alsa_render_buffer,
+    .set_volume = audio_renderer_alsa_set_volume,
+    .flush = audio_renderer_alsa_flush,
+    .destroy = audio_renderer_alsa_destroy,
+    .open_stream = audio_renderer_alsa_open_stream,
+};
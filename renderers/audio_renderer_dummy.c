@@ -18,6 +18,7 @@
  */
 
 #include "audio_renderer.h"
+#include "sink_stats.h"
 
 #include <stdlib.h>
 #include <assert.h>
@@ -28,6 +29,8 @@
 
 typedef struct audio_renderer_dummy_s {
     audio_renderer_t base;
+    bool bench; // Measures what it gets instead of dropping it unseen
+    sink_stats_t stats;
 } audio_renderer_dummy_t;
 
 static const audio_renderer_funcs_t audio_renderer_dummy_funcs;
@@ -41,6 +44,12 @@ audio_renderer_t *audio_renderer_dummy_init(logger_t *logger, video_renderer_t *
     renderer->base.logger = logger;
     renderer->base.funcs = &audio_renderer_dummy_funcs;
     renderer->base.type = AUDIO_RENDERER_DUMMY;
+    // Nothing is decoded, so any format will do
+    renderer->base.formats = AUDIO_FORMATS_ALAC | AUDIO_FORMATS_AAC;
+    if (config->bench_interval >= 0) {
+        renderer->bench = true;
+        sink_stats_init(&renderer->stats, logger, "Dummy audio renderer", config->bench_interval, false);
+    }
     return &renderer->base;
 }
 
@@ -48,16 +57,28 @@ static void audio_renderer_dummy_start(audio_renderer_t *renderer) {
 }
 
 static void audio_renderer_dummy_render_buffer(audio_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts) {
+    audio_renderer_dummy_t *r = (audio_renderer_dummy_t *) renderer;
+    if (r->bench) {
+        sink_stats_add(&r->stats, raop_ntp_get_local_time(ntp), data, data_len, pts, NULL);
+    }
 }
 
 static void audio_renderer_dummy_set_volume(audio_renderer_t *renderer, float volume) {
 }
 
 static void audio_renderer_dummy_flush(audio_renderer_t *renderer) {
+    audio_renderer_dummy_t *r = (audio_renderer_dummy_t *) renderer;
+    if (r->bench) {
+        sink_stats_flush(&r->stats);
+    }
 }
 
 static void audio_renderer_dummy_destroy(audio_renderer_t *renderer) {
     if (renderer) {
+        audio_renderer_dummy_t *r = (audio_renderer_dummy_t *) renderer;
+        if (r->bench) {
+            sink_stats_finish(&r->stats, raop_ntp_get_local_time(NULL));
+        }
         free(renderer);
     }
 }
@@ -21,41 +21,205 @@
 #include <assert.h>
 #include <math.h>
 #include <gst/app/gstappsrc.h>
+#include "gstreamer_frame_pool.h"
+#include "gstreamer_clock.h"
+#include "gstreamer_registry.h"
+#include "video_renderer_gstreamer.h"
+#include "fdk-aac/libAACdec/include/aacdecoder_lib.h"
+#include "aac_decoder_memory.h"
+#include "../lib/threads.h"
+#include "../lib/metrics.h"
+#include "../lib/perf_counters.h"
+
+// Audio frames are a few hundred bytes up to about 1.5 KB for ALAC, this covers what sits in the
+// appsrc queue and decoder
+#define AUDIO_FRAME_POOL_SIZE 32
+// Channels of the PCM decoded in process, AirPlay only sends stereo
+#define AUDIO_PCM_CHANNELS 2
+// Frames between two latency queries of the pipeline, about 2 seconds of AAC-ELD
+#define AUDIO_LATENCY_QUERY_FRAMES 200
+// What the appsrc queues for a sink that falls behind, about a second of decoded PCM
+#define AUDIO_SOURCE_MAX_BYTES (192 * 1024)
 
 typedef struct audio_renderer_gstreamer_s {
     audio_renderer_t base;
     GstElement *appsrc;
+    // From the enough-data of appsrc to its next need-data, frames are dropped in between
+    bool full;
+    unsigned int dropped;
+    // Next to a GStreamer video renderer this is only the audio branch, a bin inside its pipeline
     GstElement *pipeline;
+    GstElement *shared_pipeline;
     GstElement *volume;
+    gstreamer_frame_pool_t *frame_pool;
+    bool synced;
+    int latency_target;
+    // A pipeline of its own is only built once the first session needs it, see audio_renderer_gstreamer_prepare
+    gsize prepared;
+    bool started;
+
+    // With decode_aac, AAC is decoded here with fdk-aac and appsrc takes the PCM, no decodebin
+    bool decode_aac;
+    HANDLE_AACDECODER audio_decoder;
+    int pcm_samples;
+    int sample_rate;
+    // Decoder history to drop with the next frame after a flush
+    UINT decode_flags;
+    // Counts down to the next latency query
+    int latency_query_frames;
 } audio_renderer_gstreamer_t;
 
 static const audio_renderer_funcs_t audio_renderer_gstreamer_funcs;
 
-static gboolean check_plugins(void)
-{
-    int i;
-    gboolean ret;
-    GstRegistry *registry;
-    const gchar *needed[] = {"app", "libav", "playback", "autodetect", NULL};
-
-    registry = gst_registry_get();
-    ret = TRUE;
-    for (i = 0; i < g_strv_length((gchar **)needed); i++) {
-        GstPlugin *plugin;
-        plugin = gst_registry_find_plugin(registry, needed[i]);
-        if (!plugin) {
-            g_print("Required gstreamer plugin '%s' not found\n", needed[i]);
-            ret = FALSE;
-            continue;
+static void audio_renderer_gstreamer_destroy_decoder(audio_renderer_gstreamer_t *renderer) {
+    if (renderer->audio_decoder) {
+        aacDecoder_Close(renderer->audio_decoder);
+        renderer->audio_decoder = NULL;
+    }
+}
+
+static int audio_renderer_gstreamer_init_decoder(audio_renderer_gstreamer_t *renderer, const audio_format_t *format) {
+    aac_decoder_account_memory();
+    renderer->audio_decoder = aacDecoder_Open(TT_MP4_RAW, 1);
+    if (renderer->audio_decoder == NULL) {
+        logger_log(renderer->base.logger, LOGGER_ERR, "aacDecoder open failed!");
+        return -1;
+    }
+    UCHAR asc[AUDIO_FORMAT_MAX_CONFIG];
+    UCHAR *conf[] = { asc };
+    UINT conf_len = audio_format_get_config(format, asc);
+    if (aacDecoder_ConfigRaw(renderer->audio_decoder, conf, &conf_len) != AAC_DEC_OK) {
+        logger_log(renderer->base.logger, LOGGER_ERR, "Unable to set configRaw");
+        audio_renderer_gstreamer_destroy_decoder(renderer);
+        return -2;
+    }
+    CStreamInfo *aac_stream_info = aacDecoder_GetStreamInfo(renderer->audio_decoder);
+    int samples_per_frame = aac_stream_info && aac_stream_info->aacSamplesPerFrame > 0 ?
+                            aac_stream_info->aacSamplesPerFrame : format->frame_samples;
+    renderer->pcm_samples = samples_per_frame * AUDIO_PCM_CHANNELS;
+    renderer->sample_rate = format->sample_rate;
+    renderer->decode_flags = 0;
+    return 1;
+}
+
+/* Caps of the encoded frames, decodebin picks the decoder from them, or of the PCM decoded in process */
+static GstCaps *audio_renderer_gstreamer_get_caps(audio_renderer_gstreamer_t *renderer, const audio_format_t *format) {
+    unsigned char config[AUDIO_FORMAT_MAX_CONFIG];
+    int config_len = audio_format_get_config(format, config);
+    GstBuffer *codec_data;
+    GstCaps *caps;
+
+    if (renderer->decode_aac) {
+        // fdk-aac puts out interleaved 16 bit samples in host order
+        return gst_caps_new_simple("audio/x-raw",
+            "format", G_TYPE_STRING, G_BYTE_ORDER == G_LITTLE_ENDIAN ? "S16LE" : "S16BE",
+            "layout", G_TYPE_STRING, "interleaved",
+            "rate", G_TYPE_INT, format->sample_rate,
+            "channels", G_TYPE_INT, AUDIO_PCM_CHANNELS,
+            NULL);
+    } else if (format->codec == AUDIO_CODEC_ALAC) {
+        // libav takes the magic cookie wrapped in its alac atom, as MP4 files carry it
+        static const unsigned char atom[] = {0, 0, 0, 36, 'a', 'l', 'a', 'c', 0, 0, 0, 0};
+        codec_data = gst_buffer_new_and_alloc(sizeof(atom) + config_len);
+        gst_buffer_fill(codec_data, 0, atom, sizeof(atom));
+        gst_buffer_fill(codec_data, sizeof(atom), config, config_len);
+        caps = gst_caps_new_simple("audio/x-alac",
+            "rate", G_TYPE_INT, format->sample_rate,
+            "channels", G_TYPE_INT, format->channels,
+            "codec_data", GST_TYPE_BUFFER, codec_data,
+            NULL);
+    } else {
+        codec_data = gst_buffer_new_and_alloc(config_len);
+        gst_buffer_fill(codec_data, 0, config, config_len);
+        caps = gst_caps_new_simple("audio/mpeg",
+            "rate", G_TYPE_INT, format->sample_rate,
+            "channels", G_TYPE_INT, format->channels,
+            "mpegversion", G_TYPE_INT, 4,
+            "stream-format", G_TYPE_STRING, "raw",
+            "codec_data", GST_TYPE_BUFFER, codec_data,
+            NULL);
+    }
+    gst_buffer_unref(codec_data);
+    return caps;
+}
+
+static const gchar *const required_plugins[] = {"app", "libav", "playback", "autodetect", NULL};
+static const gchar *const required_plugins_pcm[] = {"app", "autodetect", NULL};
+
+static void audio_renderer_gstreamer_need_data(GstAppSrc *source, guint length, gpointer data) {
+    audio_renderer_gstreamer_t *r = (audio_renderer_gstreamer_t *) data;
+    ATOMIC_STORE(r->full, false);
+}
+
+static void audio_renderer_gstreamer_enough_data(GstAppSrc *source, gpointer data) {
+    audio_renderer_gstreamer_t *r = (audio_renderer_gstreamer_t *) data;
+    ATOMIC_STORE(r->full, true);
+}
+
+static void audio_renderer_gstreamer_build(audio_renderer_gstreamer_t *renderer, video_renderer_t *video_renderer) {
+    GError *error = NULL;
+
+    // Synced, the pipeline clock keeps audio and video in step and a leaky queue bounds the latency
+    gchar *launch;
+    const gchar *decoder = renderer->decode_aac ? "" : "decodebin !";
+    if (renderer->synced) {
+        launch = g_strdup_printf("appsrc name=audio_source stream-type=0 format=GST_FORMAT_TIME is-live=true ! queue ! %s"
+                                 "audioconvert ! volume name=volume ! level ! queue max-size-buffers=0 max-size-bytes=0 "
+                                 "max-size-time=%llu leaky=downstream ! autoaudiosink sync=true",
+                                 decoder, (unsigned long long) renderer->latency_target * GST_MSECOND);
+    } else {
+        launch = g_strdup_printf("appsrc name=audio_source stream-type=0 format=GST_FORMAT_TIME is-live=true ! queue ! %s"
+                                 "audioconvert ! volume name=volume ! level ! autoaudiosink sync=false", decoder);
+    }
+    if (video_renderer) {
+        // Join the video pipeline, lip sync then comes from its single clock and latency
+        renderer->shared_pipeline = gst_object_ref(video_renderer_gstreamer_get_pipeline(video_renderer));
+        renderer->pipeline = gst_parse_bin_from_description(launch, FALSE, &error);
+        g_assert(renderer->pipeline);
+        gst_object_ref_sink(renderer->pipeline);
+        gst_bin_add(GST_BIN(renderer->shared_pipeline), renderer->pipeline);
+        logger_log(renderer->base.logger, LOGGER_DEBUG, "Audio plays in the GStreamer video pipeline");
+    } else {
+        renderer->pipeline = gst_parse_launch(launch, &error);
+        g_assert(renderer->pipeline);
+        if (renderer->synced) {
+            gstreamer_clock_setup(renderer->pipeline, renderer->latency_target);
         }
-        gst_object_unref(plugin);
     }
-    return ret;
+    g_free(launch);
+
+    renderer->appsrc = gst_bin_get_by_name(GST_BIN(renderer->pipeline), "audio_source");
+    renderer->volume = gst_bin_get_by_name(GST_BIN(renderer->pipeline), "volume");
+    // The raop thread never blocks on a sink that falls behind, the sink gets a gap instead
+    g_object_set(renderer->appsrc, "max-bytes", (guint64) AUDIO_SOURCE_MAX_BYTES, NULL);
+    g_signal_connect(renderer->appsrc, "need-data", G_CALLBACK(audio_renderer_gstreamer_need_data), renderer);
+    g_signal_connect(renderer->appsrc, "enough-data", G_CALLBACK(audio_renderer_gstreamer_enough_data), renderer);
+
+    audio_format_t format;
+    audio_format_init_default(&format);
+    GstCaps *caps = audio_renderer_gstreamer_get_caps(renderer, &format);
+    g_object_set(renderer->appsrc, "caps", caps, NULL);
+    gst_caps_unref(caps);
+}
+
+/*
+ * Builds the stand-alone pipeline on first use, from whichever raop thread gets there first.
+ * Until then the registry loads in the background, so the server is announced without waiting.
+ */
+static void audio_renderer_gstreamer_prepare(audio_renderer_gstreamer_t *renderer) {
+    if (g_once_init_enter(&renderer->prepared)) {
+        gstreamer_registry_wait();
+        assert(gstreamer_registry_has_plugins(renderer->decode_aac ? required_plugins_pcm : required_plugins));
+        audio_renderer_gstreamer_build(renderer, NULL);
+        if (renderer->started) {
+            gst_element_set_state(renderer->pipeline, GST_STATE_PLAYING);
+        }
+        g_once_init_leave(&renderer->prepared, 1);
+    }
 }
 
 audio_renderer_t *audio_renderer_gstreamer_init(logger_t *logger, video_renderer_t *video_renderer, audio_renderer_config_t const *config) {
     audio_renderer_gstreamer_t *renderer;
-    GError *error = NULL;
 
     renderer = calloc(1, sizeof(audio_renderer_gstreamer_t));
     if (!renderer) {
@@ -64,70 +228,207 @@ audio_renderer_t *audio_renderer_gstreamer_init(logger_t *logger, video_renderer
     renderer->base.logger = logger;
     renderer->base.funcs = &audio_renderer_gstreamer_funcs;
     renderer->base.type = AUDIO_RENDERER_GSTREAMER;
-    
-    // If the video renderer is not a gstreamer renderer, we need to initialize gstreamer
-    if (!video_renderer || video_renderer->type != VIDEO_RENDERER_GSTREAMER) {
-        gst_init(NULL, NULL);
+    renderer->base.formats = AUDIO_FORMATS_ALAC | AUDIO_FORMATS_AAC;
+    renderer->decode_aac = config->decode_aac;
+    if (renderer->decode_aac) {
+        // fdk-aac has no ALAC decoder, senders are only offered AAC then
+        renderer->base.formats = AUDIO_FORMATS_AAC;
+        audio_format_t format;
+        audio_format_init_default(&format);
+        if (audio_renderer_gstreamer_init_decoder(renderer, &format) != 1) {
+            free(renderer);
+            return NULL;
+        }
     }
 
-    assert(check_plugins());
+    renderer->frame_pool = gstreamer_frame_pool_init(logger, AUDIO_FRAME_POOL_SIZE);
+    if (!renderer->frame_pool) {
+        audio_renderer_gstreamer_destroy_decoder(renderer);
+        free(renderer);
+        return NULL;
+    }
+    renderer->synced = !config->low_latency;
+    renderer->latency_target = config->latency_target;
+    // Synced frames play at their pts plus the pipeline latency, which is set to the target
+    if (renderer->synced) renderer->base.output_latency = renderer->latency_target * 1000;
 
-    renderer->pipeline = gst_parse_launch("appsrc name=audio_source stream-type=0 format=GST_FORMAT_TIME is-live=true ! queue ! decodebin !"
-    "audioconvert ! volume name=volume ! level ! autoaudiosink sync=false", &error);
-    g_assert(renderer->pipeline);
+    if (video_renderer && video_renderer->type == VIDEO_RENDERER_GSTREAMER) {
+        // The video renderer already initialized GStreamer, and its pipeline is there to join
+        if (g_once_init_enter(&renderer->prepared)) {
+            assert(gstreamer_registry_has_plugins(renderer->decode_aac ? required_plugins_pcm : required_plugins));
+            audio_renderer_gstreamer_build(renderer, video_renderer);
+            g_once_init_leave(&renderer->prepared, 1);
+        }
+    } else {
+        gstreamer_registry_prewarm();
+    }
 
-    renderer->appsrc = gst_bin_get_by_name(GST_BIN(renderer->pipeline), "audio_source");
-    renderer->volume = gst_bin_get_by_name(GST_BIN(renderer->pipeline), "volume");
+    return &renderer->base;
+}
 
-    gchar eld_conf[] = {0xF8, 0xE8, 0x50, 0x00};
-    GstBuffer *codec_data = gst_buffer_new_and_alloc(sizeof(eld_conf));
-    GstMapInfo map;
-
-    gst_buffer_map(codec_data, &map, GST_MAP_WRITE);
-    memset(map.data, eld_conf[0], map.size);
-    memset(map.data+1, eld_conf[1], map.size);
-    memset(map.data+2, eld_conf[2], map.size);
-    memset(map.data+3, eld_conf[3], map.size);
-
-    GstCaps *caps = gst_caps_new_simple("audio/mpeg",
-        "rate", G_TYPE_INT, 44100,
-        "channels", G_TYPE_INT, 2,
-        "mpegversion", G_TYPE_INT, 4,
-        "stream-format", G_TYPE_STRING, "raw",
-        "codec_data", GST_TYPE_BUFFER, codec_data,
-        NULL);
-    g_object_set(renderer->appsrc, "caps", caps, NULL);
+void audio_renderer_gstreamer_start(audio_renderer_t *renderer) {
+    audio_renderer_gstreamer_t *r = (audio_renderer_gstreamer_t *)renderer;
+    if (!r->pipeline) {
+        // Comes before any session, audio_renderer_gstreamer_prepare starts the pipeline once built
+        r->started = true;
+    } else if (r->shared_pipeline) {
+        // Started along with the video pipeline, this only catches up if that already runs
+        gst_element_sync_state_with_parent(r->pipeline);
+    } else {
+        gst_element_set_state(r->pipeline, GST_STATE_PLAYING);
+    }
+}
 
+void audio_renderer_gstreamer_set_format(audio_renderer_t *renderer, const audio_format_t *format) {
+    audio_renderer_gstreamer_t *r = (audio_renderer_gstreamer_t *)renderer;
+    audio_renderer_gstreamer_prepare(r);
+    if (r->decode_aac) {
+        audio_renderer_gstreamer_destroy_decoder(r);
+        if (format->codec == AUDIO_CODEC_ALAC) {
+            logger_log(renderer->logger, LOGGER_ERR, "fdk-aac cannot decode ALAC");
+            return;
+        }
+        if (audio_renderer_gstreamer_init_decoder(r, format) != 1) {
+            logger_log(renderer->logger, LOGGER_ERR, "Could not switch to %s at %d Hz",
+                       audio_format_get_codec_name(format->codec), format->sample_rate);
+            return;
+        }
+    }
+    GstCaps *caps = audio_renderer_gstreamer_get_caps(r, format);
+    GstCaps *current = NULL;
+    g_object_get(r->appsrc, "caps", &current, NULL);
+    if (!current || !gst_caps_is_equal(caps, current)) {
+        // decodebin sticks to the decoder it plugged for the old caps, so the branch starts over
+        gst_element_set_state(r->pipeline, GST_STATE_READY);
+        g_object_set(r->appsrc, "caps", caps, NULL);
+        audio_renderer_gstreamer_start(renderer);
+    }
+    if (current) gst_caps_unref(current);
     gst_caps_unref(caps);
-    gst_buffer_unmap(codec_data, &map);
-    gst_buffer_unref(codec_data);
+}
 
-    return &renderer->base;
+/* Decodes a frame into pooled memory, NULL for a lost frame is concealed from the decoder history */
+static GstBuffer *audio_renderer_gstreamer_decode(audio_renderer_gstreamer_t *r, unsigned char *data, int data_len) {
+    AAC_DECODER_ERROR error;
+    UINT conceal = 0;
+
+    // Left without a decoder by a format it could not switch to
+    if (!r->audio_decoder) return NULL;
+
+    if (data == NULL) {
+        // Right after a flush there is no history to conceal from
+        if (r->decode_flags & AACDEC_CLRHIST) return NULL;
+        conceal = AACDEC_CONCEAL;
+    } else {
+        // We assume that every buffer contains exactly 1 frame.
+        UCHAR *p_buffer[1] = {data};
+        UINT buffer_size = data_len;
+        UINT bytes_valid = data_len;
+        error = aacDecoder_Fill(r->audio_decoder, p_buffer, &buffer_size, &bytes_valid);
+        if (error != AAC_DEC_OK) {
+            logger_log(r->base.logger, LOGGER_ERR, "aacDecoder_Fill error : %x", error);
+            return NULL;
+        }
+    }
+
+    void *handle;
+    INT_PCM *pcm = (INT_PCM *) gstreamer_frame_pool_acquire(r->frame_pool, r->pcm_samples * sizeof(INT_PCM), &handle);
+    if (!pcm) {
+        logger_log(r->base.logger, LOGGER_WARNING, "Audio pipeline holds every buffer, dropping a frame");
+        return NULL;
+    }
+    error = aacDecoder_DecodeFrame(r->audio_decoder, pcm, r->pcm_samples, r->decode_flags | conceal);
+    r->decode_flags = 0;
+    perf_counters_mark(PERF_STAGE_AUDIO_DECODE, 1);
+    CStreamInfo *aac_stream_info = aacDecoder_GetStreamInfo(r->audio_decoder);
+    if (error != AAC_DEC_OK || aac_stream_info->numChannels != AUDIO_PCM_CHANNELS) {
+        if (error != AAC_DEC_OK) {
+            logger_log(r->base.logger, LOGGER_ERR, "aacDecoder_DecodeFrame error : 0x%x", error);
+        } else {
+            logger_log(r->base.logger, LOGGER_ERR, "Unexpected number of audio channels %d", aac_stream_info->numChannels);
+        }
+        gstreamer_frame_pool_release(r->frame_pool, handle);
+        return NULL;
+    }
+
+    int frame_size = aac_stream_info->frameSize;
+    GstBuffer *buffer = gstreamer_frame_pool_wrap(r->frame_pool, handle, frame_size * AUDIO_PCM_CHANNELS * sizeof(INT_PCM));
+    GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale_int(frame_size, GST_SECOND, r->sample_rate);
+    return buffer;
 }
 
-void audio_renderer_gstreamer_start(audio_renderer_t *renderer) {
-    audio_renderer_gstreamer_t *r = (audio_renderer_gstreamer_t *)renderer;
-    gst_element_set_state(r->pipeline, GST_STATE_PLAYING);
+/* The jitter buffer reuses its slot right away, so the frame is copied once, into pooled memory */
+static GstBuffer *audio_renderer_gstreamer_copy(audio_renderer_gstreamer_t *r, unsigned char *data, int data_len) {
+    GstBuffer *buffer;
+    void *handle;
+    unsigned char *frame = gstreamer_frame_pool_acquire(r->frame_pool, data_len, &handle);
+    if (frame) {
+        memcpy(frame, data, data_len);
+        buffer = gstreamer_frame_pool_wrap(r->frame_pool, handle, data_len);
+    } else {
+        buffer = gst_buffer_new_and_alloc(data_len);
+        if (buffer) gst_buffer_fill(buffer, 0, data, data_len);
+    }
+    assert(buffer != NULL);
+    return buffer;
+}
+
+/*
+ * Asks the sinks how far behind the input they play. A synced pipeline plays at least its
+ * configured latency behind the pts, or more if the sinks need it.
+ */
+static void audio_renderer_gstreamer_measure_latency(audio_renderer_gstreamer_t *r) {
+    if (--r->latency_query_frames > 0) return;
+    r->latency_query_frames = AUDIO_LATENCY_QUERY_FRAMES;
+
+    GstQuery *query = gst_query_new_latency();
+    if (gst_element_query(r->pipeline, query)) {
+        gboolean live;
+        GstClockTime min_latency, max_latency;
+        gst_query_parse_latency(query, &live, &min_latency, &max_latency);
+        GstClockTime latency = min_latency;
+        if (r->synced && latency < (GstClockTime) r->latency_target * GST_MSECOND) {
+            latency = (GstClockTime) r->latency_target * GST_MSECOND;
+        }
+        ATOMIC_STORE(r->base.output_latency, (int) (latency / GST_USECOND));
+    }
+    gst_query_unref(query);
 }
 
 void audio_renderer_gstreamer_render_buffer(audio_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts) {
     GstBuffer *buffer;
-
-    if (data_len == 0) return;
-    
     audio_renderer_gstreamer_t *r = (audio_renderer_gstreamer_t *)renderer;
 
-    buffer = gst_buffer_new_and_alloc(data_len);
-    assert(buffer != NULL);
-    GST_BUFFER_DTS(buffer) = (GstClockTime)pts;
-    gst_buffer_fill(buffer, 0, data, data_len);
+    if (r->decode_aac) {
+        audio_renderer_gstreamer_prepare(r);
+        buffer = audio_renderer_gstreamer_decode(r, data, data_len);
+        if (!buffer) return;
+    } else {
+        // Lost frames are left as a gap, the sink places the next buffer by its timestamp
+        if (data == NULL || data_len == 0) return;
+        audio_renderer_gstreamer_prepare(r);
+        buffer = audio_renderer_gstreamer_copy(r, data, data_len);
+    }
+    // Decoded all the same, the decoder keeps its history for the frames after the gap
+    if (ATOMIC_LOAD(r->full)) {
+        gst_buffer_unref(buffer);
+        r->dropped++;
+        metrics_add(METRIC_AUDIO_FRAMES_DROPPED, 1);
+        return;
+    }
+    if (r->synced) {
+        GST_BUFFER_PTS(buffer) = gstreamer_clock_pts(pts);
+    } else {
+        GST_BUFFER_DTS(buffer) = (GstClockTime)pts;
+    }
     gst_app_src_push_buffer(GST_APP_SRC(r->appsrc), buffer);
-
+    audio_renderer_gstreamer_measure_latency(r);
 }
 
 void audio_renderer_gstreamer_set_volume(audio_renderer_t *renderer, float volume) {
     audio_renderer_gstreamer_t *r = (audio_renderer_gstreamer_t *)renderer;
     float avol;
+    audio_renderer_gstreamer_prepare(r);
     if (fabs(volume) < 28) {
         avol = floorf(((28-fabs(volume))/28)*10)/10;
         g_object_set(r->volume, "volume", avol, NULL);
@@ -135,15 +436,44 @@ void audio_renderer_gstreamer_set_volume(audio_renderer_t *renderer, float volum
 }
 
 void audio_renderer_gstreamer_flush(audio_renderer_t *renderer) {
+    audio_renderer_gstreamer_t *r = (audio_renderer_gstreamer_t *)renderer;
+    audio_renderer_gstreamer_prepare(r);
+    // Sent to the sinks of our own pipeline or audio bin only, so shared video keeps playing.
+    // Timestamps are absolute, so the running time must not be reset.
+    gst_element_send_event(r->pipeline, gst_event_new_flush_start());
+    gst_element_send_event(r->pipeline, gst_event_new_flush_stop(FALSE));
+    if (r->audio_decoder) {
+        aacDecoder_SetParam(r->audio_decoder, AAC_TPDEC_CLEAR_BUFFER, 1);
+        r->decode_flags = AACDEC_INTR | AACDEC_CLRHIST;
+    }
+    ATOMIC_STORE(r->full, false);
+    if (r->dropped) {
+        logger_log(renderer->logger, LOGGER_INFO, "Dropped %u audio frames the sink could not keep up with", r->dropped);
+        r->dropped = 0;
+    }
 }
 
 void audio_renderer_gstreamer_destroy(audio_renderer_t *renderer) {
     audio_renderer_gstreamer_t *r = (audio_renderer_gstreamer_t *)renderer;
-    gst_app_src_end_of_stream(GST_APP_SRC(r->appsrc));
-    gst_element_set_state(r->pipeline, GST_STATE_NULL);
-    gst_object_unref(r->pipeline);
-    gst_object_unref(r->appsrc);
-    gst_object_unref(r->volume);
+    if (!r->pipeline) {
+        // No session ever played, only the registry may still be loading
+        gstreamer_registry_wait();
+    } else if (r->shared_pipeline) {
+        // The video renderer goes on playing, only the audio branch is taken out
+        gst_element_set_state(r->pipeline, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(r->shared_pipeline), r->pipeline);
+        gst_object_unref(r->shared_pipeline);
+    } else {
+        gst_app_src_end_of_stream(GST_APP_SRC(r->appsrc));
+        gst_element_set_state(r->pipeline, GST_STATE_NULL);
+    }
+    if (r->pipeline) {
+        gst_object_unref(r->pipeline);
+        gst_object_unref(r->appsrc);
+        gst_object_unref(r->volume);
+    }
+    gstreamer_frame_pool_destroy(r->frame_pool);
+    audio_renderer_gstreamer_destroy_decoder(r);
     if (renderer) {
         free(renderer);
     }
@@ -151,6 +481,7 @@ void audio_renderer_gstreamer_destroy(audio_renderer_t *renderer) {
 
 static const audio_renderer_funcs_t audio_renderer_gstreamer_funcs = {
     .start = audio_renderer_gstreamer_start,
+    .set_format = audio_renderer_gstreamer_set_format,
     .render_buffer = audio_renderer_gstreamer_render_buffer,
     .set_volume = audio_renderer_gstreamer_set_volume,
     .flush = audio_renderer_gstreamer_flush,
@@ -31,12 +31,36 @@
 #include <unistd.h>
 
 #include "fdk-aac/libAACdec/include/aacdecoder_lib.h"
+#include "aac_decoder_memory.h"
 
 #include "bcm_host.h"
 #include "ilclient.h"
 #include "../lib/threads.h"
+#include "../lib/metrics.h"
+#include "../lib/audio_resampler.h"
+#include "../lib/audio_gain.h"
+#include "../lib/probes.h"
+#include "../lib/mem_account.h"
+#include "../lib/perf_counters.h"
 
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
+#define MAX(X, Y) (((X) > (Y)) ? (X) : (Y))
+#define RESYNC_THRESHOLD_MS 100
+// The resampler catches up with frames up to this many times the resync threshold late, later ones restart the clock
+#define RESYNC_LAST_RESORT_FACTOR 4
+// Less PCM queued in the render component than this while playing counts as an underrun
+#define UNDERRUN_US 2000
+#define SAMPLE_RATE 44100
+// The OMX port is stereo 16 bit, and AAC-LC has the longest frames
+#define PORT_FRAME_BYTES (2 * sizeof(INT_PCM))
+#define MAX_FRAME_SAMPLES 1024
+#define MAX_INPUT_BUFFERS 64
+// OMX_IndexConfigLatencyTarget of the output when it is the clock master, as the firmware's own players use it
+#define LATENCY_TARGET_FILTER 10
+#define LATENCY_TARGET_SHIFT 3
+#define LATENCY_TARGET_SPEED -60
+#define LATENCY_TARGET_INFLECTION 100
+#define LATENCY_TARGET_ADJUST_CAP 100
 
 extern ILCLIENT_T *video_renderer_rpi_get_ilclient(video_renderer_t *renderer);
 extern COMPONENT_T *video_renderer_rpi_get_clock(video_renderer_t *renderer);
@@ -47,39 +71,71 @@ typedef struct audio_renderer_rpi_s {
     audio_renderer_config_t const *config;
 
     HANDLE_AACDECODER audio_decoder;
+    INT_PCM *pcm; // The decoded frame, resampled from here into the OMX buffers
+    int pcm_samples;
+    int channels;
+    // Plays the stream that much faster or slower that the output's clock drifting from the
+    // sender's neither grows nor drains the audio queued in the render component
+    audio_resampler_t *resampler;
+    // The volume, ramped into the PCM as it goes into the OMX buffers
+    audio_gain_t gain;
 
     ILCLIENT_T *client;
     COMPONENT_T *audio_renderer;
-    COMPONENT_T *clock; // Owned by the video renderer if one is used, so don't destroy!
+    COMPONENT_T *clock; // Owned by the video renderer if it has one, so don't destroy!
+    bool own_clock;
 
     COMPONENT_T *components[3];
     TUNNEL_T tunnels[2];
 
+    // Buffer the PCM of a few frames is collected in, to save round trips to the VideoCore
+    OMX_BUFFERHEADERTYPE *pending;
+    uint64_t pending_pts;
+    unsigned int batch_bytes;
+    // Bytes of input buffers, charged to MEM_TAG_OMX while input_memory_charged is set
+    long input_memory;
+    bool input_memory_charged;
+
     uint64_t first_packet_time;
     uint64_t last_packet_time;
     uint64_t input_frames;
+    // Set while the render component has nothing queued, so only running dry counts as an underrun,
+    // once per dry spell, and not starting out empty
+    bool starved;
+    // Decoder history to drop with the next frame after a flush
+    UINT decode_flags;
 } audio_renderer_rpi_t;
 
 static const audio_renderer_funcs_t audio_renderer_rpi_funcs;
 
 static void audio_renderer_rpi_destroy_decoder(audio_renderer_rpi_t *renderer) {
-    aacDecoder_Close(renderer->audio_decoder);
+    if (renderer->audio_decoder) {
+        aacDecoder_Close(renderer->audio_decoder);
+        renderer->audio_decoder = NULL;
+    }
+    free(renderer->pcm);
+    renderer->pcm = NULL;
+    audio_resampler_destroy(renderer->resampler);
+    renderer->resampler = NULL;
 }
 
-static int audio_renderer_rpi_init_decoder(audio_renderer_rpi_t *renderer) {
+static int audio_renderer_rpi_init_decoder(audio_renderer_rpi_t *renderer, const audio_format_t *format) {
     int ret = 0;
+    aac_decoder_account_memory();
     renderer->audio_decoder = aacDecoder_Open(TT_MP4_RAW, 1);
     if (renderer->audio_decoder == NULL) {
         logger_log(renderer->base.logger, LOGGER_ERR, "aacDecoder open faild!");
         return -1;
     }
     /* ASC config binary data */
-    UCHAR eld_conf[] = { 0xF8, 0xE8, 0x50, 0x00 };
-    UCHAR *conf[] = { eld_conf };
-    static UINT conf_len = sizeof(eld_conf);
+    UCHAR asc[AUDIO_FORMAT_MAX_CONFIG];
+    UCHAR *conf[] = { asc };
+    UINT conf_len = audio_format_get_config(format, asc);
     ret = aacDecoder_ConfigRaw(renderer->audio_decoder, conf, &conf_len);
     if (ret != AAC_DEC_OK) {
         logger_log(renderer->base.logger, LOGGER_ERR, "Unable to set configRaw");
+        aacDecoder_Close(renderer->audio_decoder);
+        renderer->audio_decoder = NULL;
         return -2;
     }
     CStreamInfo *aac_stream_info = aacDecoder_GetStreamInfo(renderer->audio_decoder);
@@ -88,15 +144,31 @@ static int audio_renderer_rpi_init_decoder(audio_renderer_rpi_t *renderer) {
         return -3;
     }
 
-    logger_log(renderer->base.logger, LOGGER_DEBUG, "> stream info: channel = %d\tsample_rate = %d\tframe_size = %d\taot = %d\tbitrate = %d",   \
+    LOGGER_DEBUG_HOT(renderer->base.logger, "> stream info: channel = %d\tsample_rate = %d\tframe_size = %d\taot = %d\tbitrate = %d",   \
             aac_stream_info->channelConfig, aac_stream_info->aacSampleRate,
             aac_stream_info->aacSamplesPerFrame, aac_stream_info->aot, aac_stream_info->bitRate);
+
+    // Size the PCM buffer for one decoded frame, the configuration only changes with set_format
+    int samples_per_frame = aac_stream_info->aacSamplesPerFrame > 0 ? aac_stream_info->aacSamplesPerFrame : format->frame_samples;
+    int channels = aac_stream_info->channelConfig > 0 ? aac_stream_info->channelConfig : 2;
+    renderer->pcm_samples = samples_per_frame * channels;
+    renderer->pcm = malloc(renderer->pcm_samples * sizeof(INT_PCM));
+    renderer->channels = channels;
+    renderer->resampler = audio_resampler_init(channels, SAMPLE_RATE);
+    if (renderer->pcm == NULL || renderer->resampler == NULL) {
+        audio_renderer_rpi_destroy_decoder(renderer);
+        return -4;
+    }
     return 1;
 }
 
 static void audio_renderer_rpi_destroy_renderer(audio_renderer_rpi_t *renderer) {
     ilclient_disable_tunnel(&renderer->tunnels[0]);
     ilclient_disable_port_buffers(renderer->audio_renderer, 100, NULL, NULL, NULL);
+    if (renderer->input_memory_charged) {
+        mem_account_charge(MEM_TAG_OMX, 0, -renderer->input_memory);
+        renderer->input_memory_charged = false;
+    }
     ilclient_teardown_tunnels(renderer->tunnels);
 
     ilclient_state_transition(renderer->components, OMX_StateIdle);
@@ -109,6 +181,64 @@ static void audio_renderer_rpi_destroy_renderer(audio_renderer_rpi_t *renderer)
     }
 }
 
+// Sizes the input buffers for a batch of PCM each, and enough of them to cover the latency target
+static int audio_renderer_rpi_setup_buffers(audio_renderer_rpi_t *renderer) {
+    int batch_samples = renderer->config->batch_ms * SAMPLE_RATE / 1000;
+    renderer->batch_bytes = MAX(batch_samples, 1) * PORT_FRAME_BYTES;
+
+    OMX_PARAM_PORTDEFINITIONTYPE port_def;
+    memset(&port_def, 0, sizeof(OMX_PARAM_PORTDEFINITIONTYPE));
+    port_def.nSize = sizeof(OMX_PARAM_PORTDEFINITIONTYPE);
+    port_def.nVersion.nVersion = OMX_VERSION;
+    port_def.nPortIndex = 100;
+    if (OMX_GetParameter(ilclient_get_handle(renderer->audio_renderer), OMX_IndexParamPortDefinition,
+                         &port_def) != OMX_ErrorNone) {
+        return -1;
+    }
+
+    // Room for a whole frame on top of the batch, resampled a little longer, so frames are not split
+    unsigned int size = (batch_samples + MAX_FRAME_SAMPLES + MAX_FRAME_SAMPLES / 64) * PORT_FRAME_BYTES;
+    if (port_def.nBufferAlignment > 1) {
+        size = (size + port_def.nBufferAlignment - 1) / port_def.nBufferAlignment * port_def.nBufferAlignment;
+    }
+    // An AAC-ELD frame is about 11 ms, a buffer never holds less
+    int count = MAX(renderer->config->latency_target, 0) / MAX(renderer->config->batch_ms, 11) + 2;
+    port_def.nBufferSize = size;
+    port_def.nBufferCountActual = MAX(port_def.nBufferCountMin, (OMX_U32) MIN(count, MAX_INPUT_BUFFERS));
+    if (OMX_SetParameter(ilclient_get_handle(renderer->audio_renderer), OMX_IndexParamPortDefinition,
+                         &port_def) != OMX_ErrorNone) {
+        return -1;
+    }
+    renderer->input_memory = (long) port_def.nBufferCountActual * size;
+    logger_log(renderer->base.logger, LOGGER_DEBUG, "Audio render input: %u buffers of %u bytes, sent every %d ms",
+               (unsigned int) port_def.nBufferCountActual, size, renderer->config->batch_ms);
+    return 0;
+}
+
+/*
+ * Lets the render component run the clock it masters faster or slower to hold the PCM it has
+ * queued at the configured latency, instead of the resampler doing it.
+ */
+static void audio_renderer_rpi_set_latency_target(audio_renderer_rpi_t *renderer) {
+    const audio_renderer_config_t *config = renderer->config;
+    OMX_CONFIG_LATENCYTARGETTYPE latency_target;
+    memset(&latency_target, 0, sizeof(OMX_CONFIG_LATENCYTARGETTYPE));
+    latency_target.nSize = sizeof(OMX_CONFIG_LATENCYTARGETTYPE);
+    latency_target.nVersion.nVersion = OMX_VERSION;
+    latency_target.nPortIndex = 100;
+    latency_target.bEnabled = OMX_TRUE;
+    latency_target.nFilter = LATENCY_TARGET_FILTER;
+    latency_target.nTarget = config->omx_latency_target * 1000;
+    latency_target.nShift = LATENCY_TARGET_SHIFT;
+    latency_target.nSpeedFactor = config->omx_latency_speed ? config->omx_latency_speed : LATENCY_TARGET_SPEED;
+    latency_target.nInterFactor = config->omx_latency_inflection ? config->omx_latency_inflection : LATENCY_TARGET_INFLECTION;
+    latency_target.nAdjCap = LATENCY_TARGET_ADJUST_CAP;
+    if (OMX_SetConfig(ilclient_get_handle(renderer->audio_renderer), OMX_IndexConfigLatencyTarget,
+                      &latency_target) != OMX_ErrorNone) {
+        logger_log(renderer->base.logger, LOGGER_DEBUG, "Could not set the audio latency target");
+    }
+}
+
 static int audio_renderer_rpi_init_renderer(audio_renderer_rpi_t *renderer, video_renderer_t *video_renderer) {
     memset(renderer->components, 0, sizeof(renderer->components));
 
@@ -133,9 +263,9 @@ static int audio_renderer_rpi_init_renderer(audio_renderer_rpi_t *renderer, vide
     }
     renderer->components[0] = renderer->audio_renderer;
 
-    if (video_renderer) {
-        renderer->clock = video_renderer_rpi_get_clock(video_renderer);
-
+    // A video renderer in low-latency mode shows frames without a clock
+    renderer->clock = video_renderer ? video_renderer_rpi_get_clock(video_renderer) : NULL;
+    if (renderer->clock) {
         // Tell the audio render component that it's not the clock master
         OMX_CONFIG_BOOLEANTYPE audio_is_clock_source;
         memset(&audio_is_clock_source, 0, sizeof(OMX_CONFIG_BOOLEANTYPE));
@@ -149,7 +279,8 @@ static int audio_renderer_rpi_init_renderer(audio_renderer_rpi_t *renderer, vide
             return -13;
         }
     } else {
-        // Create clock if no video renderer is used
+        // Create clock if no video renderer provides one
+        renderer->own_clock = true;
         if (ilclient_create_component(renderer->client, &renderer->clock, "clock",
                                       ILCLIENT_DISABLE_ALL_PORTS) != 0) {
             audio_renderer_rpi_destroy_decoder(renderer);
@@ -204,7 +335,7 @@ static int audio_renderer_rpi_init_renderer(audio_renderer_rpi_t *renderer, vide
     pcm_mode.nChannels = 2;
     pcm_mode.eNumData = OMX_NumericalDataSigned;
     pcm_mode.eEndian = OMX_EndianLittle;
-    pcm_mode.nSamplingRate = 44100;
+    pcm_mode.nSamplingRate = SAMPLE_RATE;
     pcm_mode.bInterleaved = OMX_TRUE;
     pcm_mode.nBitPerSample = 16;
     pcm_mode.ePCMMode = OMX_AUDIO_PCMModeLinear;
@@ -216,6 +347,14 @@ static int audio_renderer_rpi_init_renderer(audio_renderer_rpi_t *renderer, vide
         return -13;
     }
 
+    if (audio_renderer_rpi_setup_buffers(renderer) < 0) {
+        logger_log(renderer->base.logger, LOGGER_DEBUG, "Could not size the audio buffers, keeping the defaults");
+    }
+
+    if (renderer->own_clock && renderer->config->omx_latency_target > 0) {
+        audio_renderer_rpi_set_latency_target(renderer);
+    }
+
     // Set audio device
     const char *device_name = renderer->config->device == AUDIO_DEVICE_HDMI ? "hdmi" : "local";
     OMX_CONFIG_BRCMAUDIODESTINATIONTYPE audio_destination;
@@ -252,11 +391,17 @@ audio_renderer_t *audio_renderer_rpi_init(logger_t *logger, video_renderer_t *vi
     }
     renderer->video_renderer = video_renderer;
     renderer->config = config;
+    audio_gain_init(&renderer->gain, AUDIO_GAIN_UNITY);
 
     renderer->first_packet_time = 0;
+    renderer->starved = true;
     renderer->input_frames = 0;
+    // The PCM port of the audio render component is set up for 44.1 kHz once
+    renderer->base.formats = AUDIO_FORMAT_AAC_LC_44100 | AUDIO_FORMAT_AAC_ELD_44100;
 
-    if (audio_renderer_rpi_init_decoder(renderer) != 1) {
+    audio_format_t format;
+    audio_format_init_default(&format);
+    if (audio_renderer_rpi_init_decoder(renderer, &format) != 1) {
         free(renderer);
         renderer = NULL;
     }
@@ -272,45 +417,121 @@ audio_renderer_t *audio_renderer_rpi_init(logger_t *logger, video_renderer_t *vi
 
 static void audio_renderer_rpi_start(audio_renderer_t *renderer) {
     audio_renderer_rpi_t *r = (audio_renderer_rpi_t *)renderer;
-    if (!r->video_renderer) {
-        // If no video renderer is used, we're responsible for starting the clock here
+    if (r->own_clock) {
+        // If no video renderer provides the clock, we're responsible for starting it here
         ilclient_change_component_state(r->clock, OMX_StateExecuting);
     }
 
     ilclient_change_component_state(r->audio_renderer, OMX_StateIdle);
-    ilclient_enable_port_buffers(r->audio_renderer, 100, NULL, NULL, NULL);
+    if (ilclient_enable_port_buffers(r->audio_renderer, 100, NULL, NULL, NULL) == 0 && !r->input_memory_charged) {
+        mem_account_charge(MEM_TAG_OMX, 0, r->input_memory);
+        r->input_memory_charged = true;
+    }
     ilclient_change_component_state(r->audio_renderer, OMX_StateExecuting);
 }
 
+static void audio_renderer_rpi_set_format(audio_renderer_t *renderer, const audio_format_t *format) {
+    audio_renderer_rpi_t *r = (audio_renderer_rpi_t *)renderer;
+    audio_renderer_rpi_destroy_decoder(r);
+    if (format->codec == AUDIO_CODEC_ALAC || format->sample_rate != SAMPLE_RATE ||
+        audio_renderer_rpi_init_decoder(r, format) != 1) {
+        logger_log(renderer->logger, LOGGER_ERR, "The rpi audio renderer cannot play %s at %d Hz",
+                   audio_format_get_codec_name(format->codec), format->sample_rate);
+        return;
+    }
+    r->decode_flags = 0;
+}
+
 #ifdef DUMP_AUDIO
 static FILE* file_pcm = NULL;
 #endif
 
+// PCM the render component holds on to and has yet to play, -1 if it does not say
+static int64_t audio_renderer_rpi_get_queued_us(audio_renderer_rpi_t *renderer) {
+    OMX_PARAM_U32TYPE latency;
+    memset(&latency, 0, sizeof(OMX_PARAM_U32TYPE));
+    latency.nSize = sizeof(OMX_PARAM_U32TYPE);
+    latency.nVersion.nVersion = OMX_VERSION;
+    latency.nPortIndex = 100;
+    if (OMX_GetConfig(ILC_GET_HANDLE(renderer->audio_renderer), OMX_IndexConfigAudioRenderingLatency,
+                      &latency) != OMX_ErrorNone) {
+        return -1;
+    }
+    return (int64_t) latency.nU32 * 1000000 / SAMPLE_RATE;
+}
+
+static void audio_renderer_rpi_send_pending(audio_renderer_rpi_t *r, raop_ntp_t *ntp) {
+    OMX_BUFFERHEADERTYPE *buffer = r->pending;
+    r->pending = NULL;
+    buffer->nOffset = 0;
+    buffer->nFlags = 0;
+
+    if (!r->config->low_latency) buffer->nTimeStamp = ilclient_ticks_from_s64(r->pending_pts);
+    if (r->first_packet_time == 0) {
+        buffer->nFlags = OMX_BUFFERFLAG_STARTTIME;
+        r->first_packet_time = raop_ntp_get_local_time(ntp);
+        if (!r->config->low_latency) buffer->nTimeStamp = ilclient_ticks_from_s64(r->first_packet_time);
+    }
+
+    PROBE2(omx_audio_submit, r->pending_pts, buffer->nFilledLen);
+    if (OMX_EmptyThisBuffer(ILC_GET_HANDLE(r->audio_renderer), buffer) != OMX_ErrorNone) {
+        logger_log(r->base.logger, LOGGER_ERR, "Audio renderer refused processing buffer");
+    }
+}
+
 static void audio_renderer_rpi_render_buffer(audio_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts) {
-    if (data_len == 0) return;
-    
     audio_renderer_rpi_t *r = (audio_renderer_rpi_t *)renderer;
+    AAC_DECODER_ERROR error = 0;
+    UINT conceal = 0;
 
-    logger_log(renderer->logger, LOGGER_DEBUG, "Got AAC data of %d bytes", data_len);
-    r->input_frames++;
+    // Left without a decoder by a format it could not switch to
+    if (!r->audio_decoder) return;
 
-    // We assume that every buffer contains exactly 1 frame.
+    if (data == NULL) {
+        // Conceal the lost frame so the OMX clock keeps running, unless there is no history since a flush
+        if (r->decode_flags & AACDEC_CLRHIST) return;
+        LOGGER_DEBUG_HOT(renderer->logger, "Concealing lost AAC frame");
+        conceal = AACDEC_CONCEAL;
+    } else {
+        if (data_len == 0) return;
 
-    AAC_DECODER_ERROR error = 0;
+        LOGGER_DEBUG_HOT(renderer->logger, "Got AAC data of %d bytes", data_len);
 
-    UCHAR *p_buffer[1] = {data};
-    UINT buffer_size = data_len;
-    UINT bytes_valid = data_len;
-    error = aacDecoder_Fill(r->audio_decoder, p_buffer, &buffer_size, &bytes_valid);
-    if (error != AAC_DEC_OK) {
-        logger_log(renderer->logger, LOGGER_ERR, "aacDecoder_Fill error : %x", error);
+        // We assume that every buffer contains exactly 1 frame.
+        UCHAR *p_buffer[1] = {data};
+        UINT buffer_size = data_len;
+        UINT bytes_valid = data_len;
+        error = aacDecoder_Fill(r->audio_decoder, p_buffer, &buffer_size, &bytes_valid);
+        if (error != AAC_DEC_OK) {
+            logger_log(renderer->logger, LOGGER_ERR, "aacDecoder_Fill error : %x", error);
+        }
+    }
+    r->input_frames++;
+
+    int64_t audio_delay = ((int64_t) raop_ntp_get_local_time(ntp)) - ((int64_t) pts);
+    LOGGER_DEBUG_HOT(renderer->logger, "Audio delay is %lld", audio_delay);
+    // Clock drift and frames held up on the way are taken out by the resampler, this only catches stalls
+    int resync_threshold = r->config->resync_threshold > 0 ? r->config->resync_threshold : RESYNC_THRESHOLD_MS;
+    if (audio_delay > resync_threshold * RESYNC_LAST_RESORT_FACTOR * 1000ll && r->first_packet_time != 0) {
+        metrics_add(METRIC_AUDIO_UNDERRUNS, 1);
+        ATOMIC_FETCH_ADD(r->base.underruns, 1);
+        r->first_packet_time = 0;
+        r->starved = true;
+        audio_resampler_reset(r->resampler);
     }
 
-    INT time_data_size = 4 * 480;
-    INT_PCM *p_time_data = malloc(time_data_size); // The buffer for the decoded AAC frames
-    error = aacDecoder_DecodeFrame(r->audio_decoder, p_time_data, time_data_size, 0);
+    error = aacDecoder_DecodeFrame(r->audio_decoder, r->pcm, r->pcm_samples, r->decode_flags | conceal);
+    r->decode_flags = 0;
+    perf_counters_mark(PERF_STAGE_AUDIO_DECODE, 1);
     if (error != AAC_DEC_OK) {
         logger_log(renderer->logger, LOGGER_ERR, "aacDecoder_DecodeFrame error : 0x%x", error);
+        return;
+    }
+
+    CStreamInfo *aac_stream_info = aacDecoder_GetStreamInfo(r->audio_decoder);
+    if (aac_stream_info->numChannels != r->channels) {
+        logger_log(renderer->logger, LOGGER_ERR, "Unexpected number of audio channels %d", aac_stream_info->numChannels);
+        return;
     }
 
 #ifdef DUMP_AUDIO
@@ -318,64 +539,110 @@ static void audio_renderer_rpi_render_buffer(audio_renderer_t *renderer, raop_nt
         file_pcm = fopen("/home/pi/Airplay.pcm", "wb");
     }
 
-    fwrite(p_time_data, time_data_size, 1, file_pcm);
+    fwrite(r->pcm, aac_stream_info->frameSize * r->channels * sizeof(INT_PCM), 1, file_pcm);
 #endif
 
-    int offset = 0;
-    while (offset < time_data_size) {
-        int64_t audio_delay = ((int64_t) raop_ntp_get_local_time(ntp)) - ((int64_t) pts);
-        logger_log(renderer->logger, LOGGER_DEBUG, "Audio delay is %lld", audio_delay);
-        if (audio_delay > 100000)
-            r->first_packet_time = 0;
-
-        OMX_BUFFERHEADERTYPE *buffer = ilclient_get_input_buffer(r->audio_renderer, 100, 0);
-        if (!buffer)
-            break;
-
-        int chunk_size = MIN(time_data_size - offset, buffer->nAllocLen);
-        memcpy(buffer->pBuffer, p_time_data, chunk_size);
-        offset += chunk_size;
-
-        buffer->nFilledLen = chunk_size;
-        buffer->nOffset = 0;
-
-        if (!r->config->low_latency) buffer->nTimeStamp = ilclient_ticks_from_s64(pts);
-        if (r->first_packet_time == 0) {
-            buffer->nFlags = OMX_BUFFERFLAG_STARTTIME;
-            r->first_packet_time = raop_ntp_get_local_time(ntp);
-            if (!r->config->low_latency) buffer->nTimeStamp = ilclient_ticks_from_s64(r->first_packet_time);
+    int frame_bytes = r->channels * sizeof(INT_PCM);
+    if (r->first_packet_time != 0) {
+        // This frame plays once everything queued ahead of it has, which drifts away from its pts
+        int64_t queued_us = audio_renderer_rpi_get_queued_us(r);
+        if (queued_us >= 0 && (queued_us < UNDERRUN_US) != r->starved) {
+            r->starved = !r->starved;
+            if (r->starved) {
+                LOGGER_DEBUG_HOT(renderer->logger, "Audio render component ran dry");
+                metrics_add(METRIC_AUDIO_UNDERRUNS, 1);
+                ATOMIC_FETCH_ADD(r->base.underruns, 1);
+            }
         }
-
-        if (OMX_EmptyThisBuffer(ILC_GET_HANDLE(r->audio_renderer), buffer) != OMX_ErrorNone) {
-            logger_log(renderer->logger, LOGGER_ERR, "Audio renderer refused processing buffer");
+        if (queued_us >= 0) {
+            if (r->pending) queued_us += (int64_t) (r->pending->nFilledLen / frame_bytes) * 1000000 / SAMPLE_RATE;
+            // The clock is steered by a latency target instead, see audio_renderer_rpi_set_latency_target
+            if (r->config->omx_latency_target <= 0) audio_resampler_steer(r->resampler, audio_delay + queued_us);
+            if (audio_delay + queued_us > 0) ATOMIC_STORE(r->base.output_latency, (int) (audio_delay + queued_us));
+            LOGGER_DEBUG_HOT(renderer->logger, "Audio queued %lld us, resampling at %d ppm", queued_us,
+                             audio_resampler_get_ppm(r->resampler));
         }
     }
 
-    free(p_time_data);
+    // Resampling takes the place of copying the frame into the OMX buffers
+    audio_resampler_process(r->resampler, r->pcm, aac_stream_info->frameSize, NULL, 0);
+    int available;
+    while ((available = audio_resampler_available(r->resampler)) > 0) {
+        if (!r->pending) {
+            r->pending = ilclient_get_input_buffer(r->audio_renderer, 100, 0);
+            if (!r->pending)
+                break;
+            r->pending->nFilledLen = 0;
+            r->pending_pts = pts;
+            PROBE1(omx_audio_return, pts);
+        }
+
+        OMX_BUFFERHEADERTYPE *buffer = r->pending;
+        int room = (buffer->nAllocLen - buffer->nFilledLen) / frame_bytes;
+        int16_t *out = (int16_t *) (buffer->pBuffer + buffer->nFilledLen);
+        int frames = audio_resampler_process(r->resampler, NULL, 0, out, MIN(available, room));
+        audio_gain_apply(&r->gain, out, out, frames, r->channels);
+        buffer->nFilledLen += frames * frame_bytes;
+        if (buffer->nFilledLen >= r->batch_bytes || frames == room) {
+            audio_renderer_rpi_send_pending(r, ntp);
+        }
+    }
 }
 
 static void audio_renderer_rpi_set_volume(audio_renderer_t *renderer, float volume) {
     audio_renderer_rpi_t *r = (audio_renderer_rpi_t *)renderer;
-    OMX_AUDIO_CONFIG_VOLUMETYPE audio_volume;
-    memset(&audio_volume, 0, sizeof(audio_volume));
-    audio_volume.nSize = sizeof(OMX_AUDIO_CONFIG_VOLUMETYPE);
-    audio_volume.nVersion.nVersion = OMX_VERSION;
-
-    audio_volume.bLinear = OMX_FALSE;
-    audio_volume.nPortIndex = 100;
-    // Factor 100 for dB -> mB (millibel)
-    // It's not clear where the additional factor of 2 comes from,
-    // but without it, volume is too high.
-    audio_volume.sVolume.nValue = volume * 200.0;
-
-    if (OMX_SetConfig(ilclient_get_handle(r->audio_renderer), OMX_IndexConfigAudioVolume,
-                      &audio_volume) != OMX_ErrorNone) {
-        logger_log(renderer->logger, LOGGER_DEBUG, "Could not set audio volume");
-    }
+    // The render component's own volume steps to a new level and clicks, so it stays at 0 dB.
+    // Twice the dB the sender asks for, as that volume was set to, keeps the loudness it had.
+    audio_gain_set(&r->gain, volume <= -144.0f ? 0 : audio_gain_from_db(volume * 2.0f));
 }
 
 static void audio_renderer_rpi_flush(audio_renderer_t *renderer) {
-    // TODO
+    audio_renderer_rpi_t *r = (audio_renderer_rpi_t *)renderer;
+
+    // Whatever the decoder still holds belongs to the stream before the flush
+    if (r->audio_decoder) aacDecoder_SetParam(r->audio_decoder, AAC_TPDEC_CLEAR_BUFFER, 1);
+    r->decode_flags = AACDEC_INTR | AACDEC_CLRHIST;
+
+    // The batch being collected belongs to the stream before the flush too
+    if (r->pending) {
+        r->pending->nFilledLen = 0;
+        r->pending->nOffset = 0;
+        r->pending->nFlags = 0;
+        OMX_EmptyThisBuffer(ILC_GET_HANDLE(r->audio_renderer), r->pending);
+        r->pending = NULL;
+    }
+
+    // Only flush if data was sent through, gets stuck otherwise
+    if (!r->input_frames) return;
+
+    // Hand the queued PCM back instead of letting it play out at real time
+    if (OMX_SendCommand(ILC_GET_HANDLE(r->audio_renderer), OMX_CommandFlush, 100, NULL) != OMX_ErrorNone) {
+        logger_log(renderer->logger, LOGGER_ERR, "Audio renderer refused flushing its input port");
+    } else {
+        ilclient_wait_for_command_complete(r->audio_renderer, OMX_CommandFlush, 100);
+    }
+    ilclient_flush_tunnels(r->tunnels, 0);
+
+    if (r->own_clock) {
+        // Our own clock waits for the start time of the next buffer again
+        OMX_TIME_CONFIG_CLOCKSTATETYPE clock_state;
+        memset(&clock_state, 0, sizeof(OMX_TIME_CONFIG_CLOCKSTATETYPE));
+        clock_state.nSize = sizeof(OMX_TIME_CONFIG_CLOCKSTATETYPE);
+        clock_state.nVersion.nVersion = OMX_VERSION;
+        clock_state.eState = OMX_TIME_ClockStateStopped;
+        OMX_SetConfig(ilclient_get_handle(r->clock), OMX_IndexConfigTimeClockState, &clock_state);
+        clock_state.eState = OMX_TIME_ClockStateWaitingForStartTime;
+        clock_state.nWaitMask = 1;
+        if (OMX_SetConfig(ilclient_get_handle(r->clock), OMX_IndexConfigTimeClockState,
+                          &clock_state) != OMX_ErrorNone) {
+            logger_log(renderer->logger, LOGGER_ERR, "Could not reset the audio clock");
+        }
+    }
+
+    r->first_packet_time = 0;
+    r->starved = true;
+    r->input_frames = 0;
+    if (r->resampler) audio_resampler_reset(r->resampler);
 }
 
 static void audio_renderer_rpi_destroy(audio_renderer_t *renderer) {
@@ -390,6 +657,7 @@ static void audio_renderer_rpi_destroy(audio_renderer_t *renderer) {
 
 static const audio_renderer_funcs_t audio_renderer_rpi_funcs = {
     .start = audio_renderer_rpi_start,
+    .set_format = audio_renderer_rpi_set_format,
     .render_buffer = audio_renderer_rpi_render_buffer,
     .set_volume = audio_renderer_rpi_set_volume,
     .flush = audio_renderer_rpi_flush,
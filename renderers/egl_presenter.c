@@ -0,0 +1,552 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include "egl_presenter.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+#include <gbm.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#define MAX_EGL_CONFIGS 64
+// Longest a page flip may take before the picture is given up on, a few refreshes even at 24 Hz
+#define PAGE_FLIP_TIMEOUT_MS 200
+
+struct egl_presenter_image_s {
+    EGLImageKHR image;
+    int width, height;
+    int crop_x, crop_y, crop_width, crop_height;
+};
+
+struct egl_presenter_s {
+    logger_t *logger;
+    int drm_fd;
+    uint32_t crtc_id;
+    uint32_t connector_id;
+    drmModeModeInfo mode;
+    // What the CRTC showed before, restored on destroy
+    drmModeCrtc *saved_crtc;
+    bool mode_set;
+    bool flip_pending;
+
+    struct gbm_device *gbm;
+    struct gbm_surface *surface;
+    // The buffer being scanned out, locked until the next one replaced it
+    struct gbm_bo *shown_bo;
+
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface egl_surface;
+    bool import_modifiers;
+    PFNEGLCREATEIMAGEKHRPROC create_image;
+    PFNEGLDESTROYIMAGEKHRPROC destroy_image;
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture;
+
+    GLuint program;
+    GLuint texture;
+    GLint position_location;
+    GLint texcoord_location;
+
+    int rotation;
+    flip_mode_t flip;
+};
+
+static const char *vertex_shader_source =
+    "attribute vec2 position;\n"
+    "attribute vec2 texcoord;\n"
+    "varying vec2 v_texcoord;\n"
+    "void main() {\n"
+    "    gl_Position = vec4(position, 0.0, 1.0);\n"
+    "    v_texcoord = texcoord;\n"
+    "}\n";
+
+// The driver converts YUV to RGB when sampling external images
+static const char *fragment_shader_source =
+    "#extension GL_OES_EGL_image_external : require\n"
+    "precision mediump float;\n"
+    "uniform samplerExternalOES picture;\n"
+    "varying vec2 v_texcoord;\n"
+    "void main() {\n"
+    "    gl_FragColor = texture2D(picture, v_texcoord);\n"
+    "}\n";
+
+static bool egl_presenter_has_extension(const char *extensions, const char *name) {
+    size_t length = strlen(name);
+    for (const char *found = extensions; found && (found = strstr(found, name)); found += length) {
+        if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool egl_presenter_make_current(egl_presenter_t *p) {
+    return eglMakeCurrent(p->display, p->egl_surface, p->egl_surface, p->context);
+}
+
+static void egl_presenter_done_current(egl_presenter_t *p) {
+    eglMakeCurrent(p->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+/* The connector the CRTC drives, the presenter sets the mode on both together */
+static bool egl_presenter_find_connector(egl_presenter_t *p) {
+    drmModeRes *res = drmModeGetResources(p->drm_fd);
+    if (!res) {
+        return false;
+    }
+    p->connector_id = 0;
+    for (int i = 0; i < res->count_connectors && !p->connector_id; i++) {
+        drmModeConnector *connector = drmModeGetConnector(p->drm_fd, res->connectors[i]);
+        if (!connector) continue;
+        if (connector->connection == DRM_MODE_CONNECTED && connector->encoder_id) {
+            drmModeEncoder *encoder = drmModeGetEncoder(p->drm_fd, connector->encoder_id);
+            if (encoder && encoder->crtc_id == p->crtc_id) {
+                p->connector_id = connector->connector_id;
+            }
+            drmModeFreeEncoder(encoder);
+        }
+        drmModeFreeConnector(connector);
+    }
+    drmModeFreeResources(res);
+    return p->connector_id != 0;
+}
+
+static GLuint egl_presenter_compile(egl_presenter_t *p, GLenum type, const char *source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    GLint compiled = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        logger_log(p->logger, LOGGER_ERR, "Could not compile the presentation shader: %s", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+static int egl_presenter_setup_gl(egl_presenter_t *p) {
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    if (!egl_presenter_has_extension(extensions, "GL_OES_EGL_image_external")) {
+        logger_log(p->logger, LOGGER_ERR, "The GPU cannot sample EGL images");
+        return -1;
+    }
+    p->image_target_texture = (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
+    if (!p->image_target_texture) {
+        return -1;
+    }
+
+    GLuint vertex_shader = egl_presenter_compile(p, GL_VERTEX_SHADER, vertex_shader_source);
+    GLuint fragment_shader = egl_presenter_compile(p, GL_FRAGMENT_SHADER, fragment_shader_source);
+    if (!vertex_shader || !fragment_shader) {
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+        return -1;
+    }
+    p->program = glCreateProgram();
+    glAttachShader(p->program, vertex_shader);
+    glAttachShader(p->program, fragment_shader);
+    glLinkProgram(p->program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+    GLint linked = 0;
+    glGetProgramiv(p->program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        logger_log(p->logger, LOGGER_ERR, "Could not link the presentation shaders");
+        return -1;
+    }
+    glUseProgram(p->program);
+    glUniform1i(glGetUniformLocation(p->program, "picture"), 0);
+    p->position_location = glGetAttribLocation(p->program, "position");
+    p->texcoord_location = glGetAttribLocation(p->program, "texcoord");
+
+    glGenTextures(1, &p->texture);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, p->texture);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glViewport(0, 0, p->mode.hdisplay, p->mode.vdisplay);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    return 0;
+}
+
+static int egl_presenter_setup_egl(egl_presenter_t *p) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!get_platform_display) {
+        return -1;
+    }
+    p->display = get_platform_display(EGL_PLATFORM_GBM_KHR, p->gbm, NULL);
+    if (p->display == EGL_NO_DISPLAY || !eglInitialize(p->display, NULL, NULL)) {
+        p->display = EGL_NO_DISPLAY;
+        logger_log(p->logger, LOGGER_ERR, "Could not initialize EGL on the display device");
+        return -1;
+    }
+    const char *extensions = eglQueryString(p->display, EGL_EXTENSIONS);
+    if (!egl_presenter_has_extension(extensions, "EGL_EXT_image_dma_buf_import")) {
+        logger_log(p->logger, LOGGER_ERR, "EGL cannot import DMABUFs");
+        return -1;
+    }
+    p->import_modifiers = egl_presenter_has_extension(extensions, "EGL_EXT_image_dma_buf_import_modifiers");
+    p->create_image = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+    p->destroy_image = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+    if (!p->create_image || !p->destroy_image || !eglBindAPI(EGL_OPENGL_ES_API)) {
+        return -1;
+    }
+
+    // The config has to render in the format the GBM surface was created with
+    static const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig configs[MAX_EGL_CONFIGS];
+    EGLint count = 0;
+    EGLConfig config = NULL;
+    eglChooseConfig(p->display, config_attribs, configs, MAX_EGL_CONFIGS, &count);
+    for (int i = 0; i < count && !config; i++) {
+        EGLint visual;
+        if (eglGetConfigAttrib(p->display, configs[i], EGL_NATIVE_VISUAL_ID, &visual) && visual == GBM_FORMAT_XRGB8888) {
+            config = configs[i];
+        }
+    }
+    if (!config) {
+        logger_log(p->logger, LOGGER_ERR, "No EGL config renders XRGB8888");
+        return -1;
+    }
+
+    static const EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    p->context = eglCreateContext(p->display, config, EGL_NO_CONTEXT, context_attribs);
+    if (p->context == EGL_NO_CONTEXT) {
+        return -1;
+    }
+    p->egl_surface = eglCreateWindowSurface(p->display, config, (EGLNativeWindowType) p->surface, NULL);
+    if (p->egl_surface == EGL_NO_SURFACE) {
+        return -1;
+    }
+    if (!egl_presenter_make_current(p)) {
+        return -1;
+    }
+    int ret = egl_presenter_setup_gl(p);
+    egl_presenter_done_current(p);
+    return ret;
+}
+
+egl_presenter_t *egl_presenter_init(logger_t *logger, int drm_fd, uint32_t crtc_id, video_renderer_config_t const *config) {
+    egl_presenter_t *p = calloc(1, sizeof(egl_presenter_t));
+    if (!p) {
+        return NULL;
+    }
+    p->logger = logger;
+    p->drm_fd = drm_fd;
+    p->crtc_id = crtc_id;
+    p->rotation = ((config->rotation % 360) + 360) % 360;
+    p->flip = config->flip;
+    p->display = EGL_NO_DISPLAY;
+    p->context = EGL_NO_CONTEXT;
+    p->egl_surface = EGL_NO_SURFACE;
+
+    p->saved_crtc = drmModeGetCrtc(drm_fd, crtc_id);
+    if (!p->saved_crtc || !p->saved_crtc->mode_valid || !egl_presenter_find_connector(p)) {
+        logger_log(logger, LOGGER_ERR, "Could not find the connector of the display");
+        goto fail;
+    }
+    p->mode = p->saved_crtc->mode;
+
+    p->gbm = gbm_create_device(drm_fd);
+    if (p->gbm) {
+        p->surface = gbm_surface_create(p->gbm, p->mode.hdisplay, p->mode.vdisplay, GBM_FORMAT_XRGB8888,
+                                        GBM_BO_USE_SCANOUT | GBM_BO_USE_RENDERING);
+    }
+    if (!p->surface) {
+        logger_log(logger, LOGGER_ERR, "Could not allocate %dx%d scanout buffers", p->mode.hdisplay, p->mode.vdisplay);
+        goto fail;
+    }
+    if (egl_presenter_setup_egl(p) < 0) {
+        goto fail;
+    }
+    logger_log(logger, LOGGER_INFO, "Presenting through the GPU at %dx%d", p->mode.hdisplay, p->mode.vdisplay);
+    return p;
+
+    fail:
+    egl_presenter_destroy(p);
+    return NULL;
+}
+
+static void egl_presenter_destroy_fb(struct gbm_bo *bo, void *data) {
+    uint32_t fb_id = (uint32_t) (uintptr_t) data;
+    drmModeRmFB(gbm_device_get_fd(gbm_bo_get_device(bo)), fb_id);
+}
+
+/* A framebuffer per scanout buffer, kept with the buffer for as long as the surface lives */
+static uint32_t egl_presenter_get_fb(egl_presenter_t *p, struct gbm_bo *bo) {
+    uint32_t fb_id = (uint32_t) (uintptr_t) gbm_bo_get_user_data(bo);
+    if (fb_id) {
+        return fb_id;
+    }
+    uint32_t handles[4] = { gbm_bo_get_handle(bo).u32 };
+    uint32_t pitches[4] = { gbm_bo_get_stride(bo) };
+    uint32_t offsets[4] = { 0 };
+    if (drmModeAddFB2(p->drm_fd, gbm_bo_get_width(bo), gbm_bo_get_height(bo), DRM_FORMAT_XRGB8888,
+                      handles, pitches, offsets, &fb_id, 0)) {
+        logger_log(p->logger, LOGGER_ERR, "Could not create framebuffer for a scanout buffer %d %s", errno, strerror(errno));
+        return 0;
+    }
+    gbm_bo_set_user_data(bo, (void *) (uintptr_t) fb_id, egl_presenter_destroy_fb);
+    return fb_id;
+}
+
+static void egl_presenter_page_flip_handler(int fd, unsigned int sequence, unsigned int tv_sec, unsigned int tv_usec,
+                                            void *data) {
+    egl_presenter_t *p = data;
+    p->flip_pending = false;
+}
+
+static void egl_presenter_wait_flip(egl_presenter_t *p) {
+    drmEventContext context;
+    memset(&context, 0, sizeof(context));
+    context.version = 2;
+    context.page_flip_handler = egl_presenter_page_flip_handler;
+    while (p->flip_pending) {
+        struct pollfd pfd;
+        pfd.fd = p->drm_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, PAGE_FLIP_TIMEOUT_MS) <= 0) {
+            logger_log(p->logger, LOGGER_WARNING, "The display did not flip in %d ms", PAGE_FLIP_TIMEOUT_MS);
+            p->flip_pending = false;
+            return;
+        }
+        drmHandleEvent(p->drm_fd, &context);
+    }
+}
+
+void egl_presenter_destroy(egl_presenter_t *p) {
+    if (!p) {
+        return;
+    }
+    if (p->mode_set && p->saved_crtc) {
+        // Before the framebuffers go, removing the one on screen would switch the display off
+        drmModeCrtc *saved = p->saved_crtc;
+        drmModeSetCrtc(p->drm_fd, saved->crtc_id, saved->buffer_id, saved->x, saved->y, &p->connector_id, 1,
+                       &saved->mode);
+    }
+    if (p->display != EGL_NO_DISPLAY) {
+        if (p->context != EGL_NO_CONTEXT && egl_presenter_make_current(p)) {
+            glDeleteTextures(1, &p->texture);
+            glDeleteProgram(p->program);
+            egl_presenter_done_current(p);
+        }
+        if (p->egl_surface != EGL_NO_SURFACE) eglDestroySurface(p->display, p->egl_surface);
+        if (p->context != EGL_NO_CONTEXT) eglDestroyContext(p->display, p->context);
+        eglTerminate(p->display);
+    }
+    if (p->shown_bo) {
+        gbm_surface_release_buffer(p->surface, p->shown_bo);
+    }
+    if (p->surface) {
+        gbm_surface_destroy(p->surface);
+    }
+    if (p->gbm) {
+        gbm_device_destroy(p->gbm);
+    }
+    if (p->saved_crtc) {
+        drmModeFreeCrtc(p->saved_crtc);
+    }
+    free(p);
+}
+
+egl_presenter_image_t *egl_presenter_import(egl_presenter_t *p, const egl_presenter_picture_t *picture) {
+    static const EGLint plane_attribs[EGL_PRESENTER_MAX_PLANES][5] = {
+        { EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE0_PITCH_EXT,
+          EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT,
+          EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE2_FD_EXT, EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE2_PITCH_EXT,
+          EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT },
+        { EGL_DMA_BUF_PLANE3_FD_EXT, EGL_DMA_BUF_PLANE3_OFFSET_EXT, EGL_DMA_BUF_PLANE3_PITCH_EXT,
+          EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT },
+    };
+    EGLint attribs[64];
+    int n = 0;
+    attribs[n++] = EGL_WIDTH;
+    attribs[n++] = picture->width;
+    attribs[n++] = EGL_HEIGHT;
+    attribs[n++] = picture->height;
+    attribs[n++] = EGL_LINUX_DRM_FOURCC_EXT;
+    attribs[n++] = picture->format;
+    // Mirrored video is limited range BT.709
+    attribs[n++] = EGL_YUV_COLOR_SPACE_HINT_EXT;
+    attribs[n++] = EGL_ITU_REC709_EXT;
+    attribs[n++] = EGL_SAMPLE_RANGE_HINT_EXT;
+    attribs[n++] = EGL_YUV_NARROW_RANGE_EXT;
+    bool modifier = p->import_modifiers && picture->modifier != DRM_FORMAT_MOD_INVALID;
+    for (int i = 0; i < picture->num_planes && i < EGL_PRESENTER_MAX_PLANES; i++) {
+        attribs[n++] = plane_attribs[i][0];
+        attribs[n++] = picture->fds[i];
+        attribs[n++] = plane_attribs[i][1];
+        attribs[n++] = picture->offsets[i];
+        attribs[n++] = plane_attribs[i][2];
+        attribs[n++] = picture->pitches[i];
+        if (modifier) {
+            attribs[n++] = plane_attribs[i][3];
+            attribs[n++] = (EGLint) (picture->modifier & 0xffffffff);
+            attribs[n++] = plane_attribs[i][4];
+            attribs[n++] = (EGLint) (picture->modifier >> 32);
+        }
+    }
+    attribs[n++] = EGL_NONE;
+
+    EGLImageKHR image = p->create_image(p->display, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+    if (image == EGL_NO_IMAGE_KHR) {
+        logger_log(p->logger, LOGGER_ERR, "Could not import a %dx%d picture into EGL, error 0x%x",
+                   picture->width, picture->height, eglGetError());
+        return NULL;
+    }
+    egl_presenter_image_t *result = calloc(1, sizeof(egl_presenter_image_t));
+    if (!result) {
+        p->destroy_image(p->display, image);
+        return NULL;
+    }
+    result->image = image;
+    result->width = picture->width;
+    result->height = picture->height;
+    result->crop_x = picture->crop_x;
+    result->crop_y = picture->crop_y;
+    result->crop_width = picture->crop_width > 0 ? picture->crop_width : picture->width;
+    result->crop_height = picture->crop_height > 0 ? picture->crop_height : picture->height;
+    return result;
+}
+
+void egl_presenter_release(egl_presenter_t *p, egl_presenter_image_t *image) {
+    if (image) {
+        p->destroy_image(p->display, image->image);
+        free(image);
+    }
+}
+
+/*
+ * The corner of the picture that lands on the display corner (x, y), with 0 or 1 for left and right,
+ * top and bottom. The picture is turned clockwise by rotation, then flipped, like videoflip and the
+ * KMS plane rotation of the other renderers do.
+ */
+static void egl_presenter_source_corner(egl_presenter_t *p, int x, int y, int *u, int *v) {
+    if (p->flip == FLIP_HORIZONTAL || p->flip == FLIP_BOTH) x = 1 - x;
+    if (p->flip == FLIP_VERTICAL || p->flip == FLIP_BOTH) y = 1 - y;
+    switch (p->rotation) {
+        case 90: *u = y; *v = 1 - x; break;
+        case 180: *u = 1 - x; *v = 1 - y; break;
+        case 270: *u = 1 - y; *v = x; break;
+        default: *u = x; *v = y; break;
+    }
+}
+
+static void egl_presenter_draw(egl_presenter_t *p, egl_presenter_image_t *image) {
+    bool rotated = p->rotation == 90 || p->rotation == 270;
+    int width = rotated ? image->crop_height : image->crop_width;
+    int height = rotated ? image->crop_width : image->crop_height;
+    int display_width = p->mode.hdisplay;
+    int display_height = p->mode.vdisplay;
+    float scale_x = 1.0f, scale_y = 1.0f;
+    // Fits the picture to the display keeping its aspect ratio, the rest stays black
+    if ((int64_t) width * display_height > (int64_t) height * display_width) {
+        scale_y = (float) ((double) display_width * height / width / display_height);
+    } else {
+        scale_x = (float) ((double) display_height * width / height / display_width);
+    }
+
+    // Triangle strip over the top left, top right, bottom left and bottom right display corners
+    GLfloat positions[8], texcoords[8];
+    for (int i = 0; i < 4; i++) {
+        int x = i & 1, y = i >> 1, u, v;
+        positions[2 * i] = (x ? 1.0f : -1.0f) * scale_x;
+        positions[2 * i + 1] = (y ? -1.0f : 1.0f) * scale_y;
+        egl_presenter_source_corner(p, x, y, &u, &v);
+        texcoords[2 * i] = (float) (image->crop_x + u * image->crop_width) / image->width;
+        texcoords[2 * i + 1] = (float) (image->crop_y + v * image->crop_height) / image->height;
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, p->texture);
+    p->image_target_texture(GL_TEXTURE_EXTERNAL_OES, image->image);
+    glVertexAttribPointer(p->position_location, 2, GL_FLOAT, GL_FALSE, 0, positions);
+    glVertexAttribPointer(p->texcoord_location, 2, GL_FLOAT, GL_FALSE, 0, texcoords);
+    glEnableVertexAttribArray(p->position_location);
+    glEnableVertexAttribArray(p->texcoord_location);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+int egl_presenter_show(egl_presenter_t *p, egl_presenter_image_t *image) {
+    if (!egl_presenter_make_current(p)) {
+        return -1;
+    }
+    egl_presenter_draw(p, image);
+    // The caller reuses the picture as soon as this returns
+    glFinish();
+    bool swapped = eglSwapBuffers(p->display, p->egl_surface);
+    egl_presenter_done_current(p);
+    if (!swapped) {
+        logger_log(p->logger, LOGGER_ERR, "Could not draw the picture, error 0x%x", eglGetError());
+        return -1;
+    }
+
+    struct gbm_bo *bo = gbm_surface_lock_front_buffer(p->surface);
+    if (!bo) {
+        return -1;
+    }
+    uint32_t fb_id = egl_presenter_get_fb(p, bo);
+    int ret = -1;
+    if (fb_id && !p->mode_set) {
+        ret = drmModeSetCrtc(p->drm_fd, p->crtc_id, fb_id, 0, 0, &p->connector_id, 1, &p->mode);
+        p->mode_set = ret == 0;
+    } else if (fb_id) {
+        ret = drmModePageFlip(p->drm_fd, p->crtc_id, fb_id, DRM_MODE_PAGE_FLIP_EVENT, p);
+        if (ret == 0) {
+            p->flip_pending = true;
+            egl_presenter_wait_flip(p);
+        }
+    }
+    if (ret) {
+        logger_log(p->logger, LOGGER_ERR, "Could not show picture %d %s", errno, strerror(errno));
+        gbm_surface_release_buffer(p->surface, bo);
+        return -1;
+    }
+    // The display scans out of the new buffer now, the previous one can be drawn into again
+    if (p->shown_bo) {
+        gbm_surface_release_buffer(p->surface, p->shown_bo);
+    }
+    p->shown_bo = bo;
+    return 0;
+}
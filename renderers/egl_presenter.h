@@ -0,0 +1,69 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef EGL_PRESENTER_H
+#define EGL_PRESENTER_H
+
+#include <stdint.h>
+#include "video_renderer.h"
+#include "../lib/logger.h"
+
+/*
+ * Shows decoded pictures through the GPU for the DRM/KMS renderers, for when their overlay
+ * plane cannot rotate or flip. Pictures are imported as DMABUF EGLImages, without a copy,
+ * and drawn onto the primary plane of the CRTC by a GLES2 quad, whose texture coordinates
+ * apply the rotation and flip. The presenter takes the CRTC over until it is destroyed.
+ *
+ * The EGL context is made current for each call and released again, so the presenter may
+ * be used from any thread, but from one at a time.
+ */
+typedef struct egl_presenter_s egl_presenter_t;
+typedef struct egl_presenter_image_s egl_presenter_image_t;
+
+#define EGL_PRESENTER_MAX_PLANES 4
+
+/* A picture in DMABUFs, as V4L2 exports it or libavcodec maps it to DRM PRIME */
+typedef struct egl_presenter_picture_s {
+    int width;
+    int height;
+    uint32_t format;   // DRM fourcc, e.g. DRM_FORMAT_NV12
+    uint64_t modifier; // DRM_FORMAT_MOD_INVALID when the layout is implicit
+    int num_planes;
+    int fds[EGL_PRESENTER_MAX_PLANES];
+    uint32_t offsets[EGL_PRESENTER_MAX_PLANES];
+    uint32_t pitches[EGL_PRESENTER_MAX_PLANES];
+    // The visible part, all 0 for the whole picture
+    int crop_x, crop_y, crop_width, crop_height;
+} egl_presenter_picture_t;
+
+egl_presenter_t *egl_presenter_init(logger_t *logger, int drm_fd, uint32_t crtc_id, video_renderer_config_t const *config);
+/* Hands the CRTC back to whatever showed on it before */
+void egl_presenter_destroy(egl_presenter_t *presenter);
+
+/* The fds may be closed after the call, the image keeps the buffers. NULL if the GPU cannot sample the picture. */
+egl_presenter_image_t *egl_presenter_import(egl_presenter_t *presenter, const egl_presenter_picture_t *picture);
+void egl_presenter_release(egl_presenter_t *presenter, egl_presenter_image_t *image);
+
+/**
+ * Draws the image fitted to the display and flips to it at the next vblank, which the call waits
+ * for. The GPU is done with the image when the call returns, so it may be decoded into again.
+ */
+int egl_presenter_show(egl_presenter_t *presenter, egl_presenter_image_t *image);
+
+#endif //EGL_PRESENTER_H
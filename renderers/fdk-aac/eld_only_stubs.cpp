@@ -0,0 +1,243 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Stand-ins for the fdk-aac modules that AirPlay's AAC-ELD stream never reaches:
+ * MPEG Surround (libSACdec), MPEG-D DRC (libDRCdec) and the USAC arithmetic
+ * coder (libArithCoding). Built instead of those libraries with FDK_AAC_ELD_ONLY.
+ *
+ * Each module behaves as if its stream payload was absent or unsupported: opening
+ * succeeds without a handle, configuration is rejected the way the real module
+ * rejects a config it cannot decode, and DRC never reports itself active. The
+ * AAC decoder then plays out the core ELD signal, which is all AirPlay sends.
+ */
+
+#include "sac_dec_lib.h"
+#include "FDK_drcDecLib.h"
+#include "ac_arith_coder.h"
+
+/* MPEG Surround */
+
+SAC_INSTANCE_AVAIL
+mpegSurroundDecoder_IsFullMpegSurroundDecoderInstanceAvailable(
+    CMpegSurroundDecoder *pMpegSurroundDecoder) {
+  return SAC_INSTANCE_NOT_FULL_AVAILABLE;
+}
+
+SACDEC_ERROR mpegSurroundDecoder_Open(
+    CMpegSurroundDecoder **pMpegSurroundDecoder, int stereoConfigIndex,
+    HANDLE_FDK_QMF_DOMAIN pQmfDomain) {
+  *pMpegSurroundDecoder = NULL;
+  return MPS_OK;
+}
+
+SACDEC_ERROR mpegSurroundDecoder_Config(
+    CMpegSurroundDecoder *pMpegSurroundDecoder, HANDLE_FDK_BITSTREAM hBs,
+    AUDIO_OBJECT_TYPE coreCodec, INT samplingRate, INT frameSize,
+    INT stereoConfigIndex, INT coreSbrFrameLengthIndex, INT configBytes,
+    const UCHAR configMode, UCHAR *configChanged) {
+  /* Makes the AAC decoder switch MPEG Surround off and keep going */
+  return MPS_UNSUPPORTED_CONFIG;
+}
+
+SACDEC_ERROR
+mpegSurroundDecoder_ConfigureQmfDomain(
+    CMpegSurroundDecoder *pMpegSurroundDecoder,
+    SAC_INPUT_CONFIG sac_dec_interface, UINT coreSamplingRate,
+    AUDIO_OBJECT_TYPE coreCodec) {
+  return MPS_UNSUPPORTED_CONFIG;
+}
+
+int mpegSurroundDecoder_ParseNoHeader(
+    CMpegSurroundDecoder *pMpegSurroundDecoder, HANDLE_FDK_BITSTREAM hBs,
+    int *pMpsDataBits, int fGlobalIndependencyFlag) {
+  return MPS_UNSUPPORTED_CONFIG;
+}
+
+int mpegSurroundDecoder_Parse(CMpegSurroundDecoder *pMpegSurroundDecoder,
+                              HANDLE_FDK_BITSTREAM hBs, int *pMpsDataBits,
+                              AUDIO_OBJECT_TYPE coreCodec, int sampleRate,
+                              int frameSize, int fGlobalIndependencyFlag) {
+  return MPS_UNSUPPORTED_CONFIG;
+}
+
+int mpegSurroundDecoder_Apply(CMpegSurroundDecoder *pMpegSurroundDecoder,
+                              PCM_MPS *input, PCM_MPS *pTimeData,
+                              const int timeDataSize, int timeDataFrameSize,
+                              int *nChannels, int *frameSize, int sampleRate,
+                              AUDIO_OBJECT_TYPE coreCodec,
+                              AUDIO_CHANNEL_TYPE channelType[],
+                              UCHAR channelIndices[],
+                              const FDK_channelMapDescr *const mapDescr,
+                              const INT inDataHeadroom, INT *outDataHeadroom) {
+  return MPS_NOTOK;
+}
+
+void mpegSurroundDecoder_Close(CMpegSurroundDecoder *pMpegSurroundDecoder) {}
+
+SACDEC_ERROR mpegSurroundDecoder_FreeMem(
+    CMpegSurroundDecoder *pMpegSurroundDecoder) {
+  return MPS_OK;
+}
+
+SACDEC_ERROR mpegSurroundDecoder_SetParam(
+    CMpegSurroundDecoder *pMpegSurroundDecoder, const SACDEC_PARAM param,
+    const INT value) {
+  return MPS_OK;
+}
+
+int mpegSurroundDecoder_GetLibInfo(LIB_INFO *libInfo) { return 0; }
+
+UINT mpegSurroundDecoder_GetDelay(const CMpegSurroundDecoder *self) {
+  return 0;
+}
+
+SACDEC_ERROR mpegSurroundDecoder_IsPseudoLR(
+    CMpegSurroundDecoder *pMpegSurroundDecoder, int *bsPseudoLr) {
+  *bsPseudoLr = 0;
+  return MPS_OK;
+}
+
+/* MPEG-D DRC */
+
+DRC_DEC_ERROR
+FDK_drcDec_Open(HANDLE_DRC_DECODER *phDrcDec,
+                const DRC_DEC_FUNCTIONAL_RANGE functionalRange) {
+  *phDrcDec = NULL;
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_SetCodecMode(HANDLE_DRC_DECODER hDrcDec,
+                        const DRC_DEC_CODEC_MODE codecMode) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_Init(HANDLE_DRC_DECODER hDrcDec, const int frameSize,
+                const int sampleRate, const int baseChannelCount) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_Close(HANDLE_DRC_DECODER *phDrcDec) { return DRC_DEC_OK; }
+
+DRC_DEC_ERROR
+FDK_drcDec_SetParam(HANDLE_DRC_DECODER hDrcDec,
+                    const DRC_DEC_USERPARAM requestType,
+                    const FIXP_DBL requestValue) {
+  return DRC_DEC_OK;
+}
+
+LONG FDK_drcDec_GetParam(HANDLE_DRC_DECODER hDrcDec,
+                         const DRC_DEC_USERPARAM requestType) {
+  /* Never active, so the decoder skips loudness and DRC processing */
+  return 0;
+}
+
+void FDK_drcDec_SetChannelGains(HANDLE_DRC_DECODER hDrcDec,
+                                const int numChannels, const int frameSize,
+                                FIXP_DBL *channelGainDb, FIXP_DBL *audioBuffer,
+                                const int audioBufferChannelOffset) {}
+
+DRC_DEC_ERROR
+FDK_drcDec_ReadUniDrcConfig(HANDLE_DRC_DECODER hDrcDec,
+                            HANDLE_FDK_BITSTREAM hBitstream) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_ReadLoudnessInfoSet(HANDLE_DRC_DECODER hDrcDec,
+                               HANDLE_FDK_BITSTREAM hBitstream) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_ReadLoudnessBox(HANDLE_DRC_DECODER hDrcDec,
+                           HANDLE_FDK_BITSTREAM hBitstream) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_ReadDownmixInstructions_Box(HANDLE_DRC_DECODER hDrcDec,
+                                       HANDLE_FDK_BITSTREAM hBitstream) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_ReadUniDrcInstructions_Box(HANDLE_DRC_DECODER hDrcDec,
+                                      HANDLE_FDK_BITSTREAM hBitstream) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_ReadUniDrcCoefficients_Box(HANDLE_DRC_DECODER hDrcDec,
+                                      HANDLE_FDK_BITSTREAM hBitstream) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_ReadUniDrcGain(HANDLE_DRC_DECODER hDrcDec,
+                          HANDLE_FDK_BITSTREAM hBitstream) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_ReadUniDrc(HANDLE_DRC_DECODER hDrcDec,
+                      HANDLE_FDK_BITSTREAM hBitstream) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_Preprocess(HANDLE_DRC_DECODER hDrcDec) { return DRC_DEC_OK; }
+
+DRC_DEC_ERROR
+FDK_drcDec_ProcessTime(HANDLE_DRC_DECODER hDrcDec, const int delaySamples,
+                       const DRC_DEC_LOCATION drcLocation,
+                       const int channelOffset, const int drcChannelOffset,
+                       const int numChannelsProcessed, FIXP_DBL *realBuffer,
+                       const int timeDataChannelOffset) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_ApplyDownmix(HANDLE_DRC_DECODER hDrcDec, int *reverseInChannelMap,
+                        int *reverseOutChannelMap, FIXP_DBL *realBuffer,
+                        int *pNChannels) {
+  return DRC_DEC_OK;
+}
+
+DRC_DEC_ERROR
+FDK_drcDec_GetLibInfo(LIB_INFO *info) { return DRC_DEC_OK; }
+
+/* USAC arithmetic coder */
+
+CArcoData *CArco_Create(void) {
+  /* Fails USAC configs cleanly, the decoder treats it as out of memory */
+  return NULL;
+}
+
+void CArco_Destroy(CArcoData *pArcoData) {}
+
+ARITH_CODING_ERROR CArco_DecodeArithData(CArcoData *pArcoData,
+                                         HANDLE_FDK_BITSTREAM hBs,
+                                         FIXP_DBL *RESTRICT spectrum, int lg,
+                                         int lg_max, int arith_reset_flag) {
+  return ARITH_CODER_ERROR;
+}
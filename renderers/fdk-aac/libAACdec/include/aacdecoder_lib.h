@@ -952,6 +952,17 @@ aacDecoder_GetFreeBytes(const HANDLE_AACDECODER self, UINT *pFreeBytes);
 LINKSPEC_H HANDLE_AACDECODER aacDecoder_Open(TRANSPORT_TYPE transportFmt,
                                              UINT nrOfLayers);
 
+/**
+ * \brief               Replace calloc() and free() for all heap memory of the
+ * library, e.g. to account for it. Only takes effect before the first decoder
+ * is opened, later calls are ignored.
+ * \param callocFunc    Allocates and clears memory like calloc().
+ * \param freeFunc      Frees memory obtained from callocFunc.
+ */
+LINKSPEC_H void aacDecoder_SetAllocator(void *(*callocFunc)(size_t n,
+                                                            size_t size),
+                                        void (*freeFunc)(void *ptr));
+
 /**
  * \brief Explicitly configure the decoder by passing a raw AudioSpecificConfig
  * (ASC) or a StreamMuxConfig (SMC), contained in a binary buffer. This is
@@ -123,15 +123,17 @@ C_ALLOC_MEM(AacDecoder, struct AAC_DECODER_INSTANCE, 1)
 /*! The structure CAacDecoderStaticChannelInfo contains the static sideinfo
    which is needed for the decoding of one aac channel. <br> Dimension:
    #AacDecoderChannels                                                      */
-C_ALLOC_MEM2(AacDecoderStaticChannelInfo, CAacDecoderStaticChannelInfo, 1, (8))
+C_ALLOC_MEM2(AacDecoderStaticChannelInfo, CAacDecoderStaticChannelInfo, 1,
+             AACDEC_RAM_CHANNELS)
 
 /*! The structure CAacDecoderChannelInfo contains the dynamic sideinfo which is
    needed for the decoding of one aac channel. <br> Dimension:
    #AacDecoderChannels                                                      */
-C_AALLOC_MEM2(AacDecoderChannelInfo, CAacDecoderChannelInfo, 1, (8))
+C_AALLOC_MEM2(AacDecoderChannelInfo, CAacDecoderChannelInfo, 1,
+              AACDEC_RAM_CHANNELS)
 
 /*! Overlap buffer */
-C_AALLOC_MEM2(OverlapBuffer, FIXP_DBL, OverlapBufferSize, (8))
+C_AALLOC_MEM2(OverlapBuffer, FIXP_DBL, OverlapBufferSize, AACDEC_RAM_CHANNELS)
 
 C_ALLOC_MEM(DrcInfo, CDrcInfo, 1)
 
@@ -148,7 +150,8 @@ C_ALLOC_MEM(CplxPredictionData, CCplxPredictionData, 1)
 /*! The buffer holds time samples for the crossfade in case of an USAC DASH IPF
    config change Dimension: (8)
  */
-C_ALLOC_MEM2(TimeDataFlush, INT_PCM, TIME_DATA_FLUSH_SIZE, (8))
+C_ALLOC_MEM2(TimeDataFlush, INT_PCM, TIME_DATA_FLUSH_SIZE,
+             AACDEC_RAM_CHANNELS)
 
 /* @} */
 
@@ -161,8 +164,8 @@ C_ALLOC_MEM2(TimeDataFlush, INT_PCM, TIME_DATA_FLUSH_SIZE, (8))
 
 /* Take into consideration to make use of the WorkBufferCore[3/4] for decoder
  * configurations with more than 2 channels */
-C_ALLOC_MEM_OVERLAY(WorkBufferCore2, FIXP_DBL, ((8) * 1024), SECT_DATA_L2,
-                    WORKBUFFER2_TAG)
+C_ALLOC_MEM_OVERLAY(WorkBufferCore2, FIXP_DBL, (AACDEC_RAM_CHANNELS * 1024),
+                    SECT_DATA_L2, WORKBUFFER2_TAG)
 
 C_ALLOC_MEM_OVERLAY(WorkBufferCore6, SCHAR,
                     fMax((INT)(sizeof(FIXP_DBL) * WB_SECTION_SIZE),
@@ -173,5 +176,6 @@ C_ALLOC_MEM_OVERLAY(WorkBufferCore1, CWorkBufferCore1, 1, SECT_DATA_L1,
                     WORKBUFFER1_TAG)
 
 /* double buffer size needed for de-/interleaving */
-C_ALLOC_MEM_OVERLAY(WorkBufferCore5, PCM_DEC, (8) * (1024 * 4) * 2,
+C_ALLOC_MEM_OVERLAY(WorkBufferCore5, PCM_DEC,
+                    AACDEC_RAM_CHANNELS * (1024 * 4) * 2,
                     SECT_DATA_EXTERN, WORKBUFFER5_TAG)
@@ -119,6 +119,15 @@ amm-info@iis.fraunhofer.de
 #define MAX_SYNCHS 10
 #define SAMPL_FREQS 12
 
+/* Channels the work buffers are sized for. The AAC-ELD-only build of RPiPlay
+   sizes them for the stereo stream AirPlay sends, which saves about 220 kB of
+   RAM per decoder and keeps the buffers of the decode loop closer together. */
+#ifdef FDK_AAC_ELD_ONLY
+#define AACDEC_RAM_CHANNELS (2)
+#else
+#define AACDEC_RAM_CHANNELS (8)
+#endif
+
 H_ALLOC_MEM(AacDecoder, AAC_DECODER_INSTANCE)
 
 H_ALLOC_MEM(DrcInfo, CDrcInfo)
@@ -1643,7 +1643,7 @@ CAacDecoder_Init(HANDLE_AACDECODER self, const CSAudioSpecificConfig *asc,
   aacChannelsOffset = 0;
   aacChannelsOffsetIdx = 0;
   elementOffset = 0;
-  if ((ascChannels <= 0) || (ascChannels > (8)) ||
+  if ((ascChannels <= 0) || (ascChannels > AACDEC_RAM_CHANNELS) ||
       (asc->m_channelConfiguration > AACDEC_MAX_CH_CONF)) {
     return AAC_DEC_UNSUPPORTED_CHANNELCONFIG;
   }
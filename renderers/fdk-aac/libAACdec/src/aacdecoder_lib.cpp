@@ -938,6 +938,12 @@ bail:
 
   return (errorStatus);
 }
+LINKSPEC_CPP void aacDecoder_SetAllocator(void *(*callocFunc)(size_t n,
+                                                              size_t size),
+                                          void (*freeFunc)(void *ptr)) {
+  FDKsetAllocator(callocFunc, freeFunc);
+}
+
 LINKSPEC_CPP HANDLE_AACDECODER aacDecoder_Open(TRANSPORT_TYPE transportFmt,
                                                UINT nrOfLayers) {
   AAC_DECODER_INSTANCE *aacDec = NULL;
@@ -112,6 +112,84 @@ amm-info@iis.fraunhofer.de
 #if defined(__arm__)
 #endif
 
+/* The windowing below is the hot loop of AAC-ELD decoding. On targets with
+   128-bit integer SIMD (NEON, SSE2 and up) it is processed four samples at a
+   time with GCC vector extensions, which the compiler lowers to the native
+   instruction set. The per-lane arithmetic reproduces fMultDiv2(),
+   fAddSaturate() and SATURATE_LEFT_SHIFT() bit-exactly. */
+#if defined(__GNUC__) && (defined(__ARM_NEON) || defined(__SSE2__)) && \
+    defined(WINDOWTABLE_16BIT) && (PCM_OUT_BITS == DFRACT_BITS)
+#define FUNCTION_multE2_DinvF_fdk_simd
+#endif
+
+#ifdef FUNCTION_multE2_DinvF_fdk_simd
+typedef INT ldfb_v4 __attribute__((vector_size(16)));
+
+static inline ldfb_v4 ldfb_reverse(const ldfb_v4 v) {
+#if defined(__clang__)
+  return __builtin_shufflevector(v, v, 3, 2, 1, 0);
+#else
+  const ldfb_v4 idx = {3, 2, 1, 0};
+  return __builtin_shuffle(v, idx);
+#endif
+}
+
+static inline ldfb_v4 ldfb_load(const FIXP_DBL *p) {
+  ldfb_v4 v;
+  __builtin_memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/* Loads p[3], p[2], p[1], p[0] */
+static inline ldfb_v4 ldfb_load_rev(const FIXP_DBL *p) {
+  return ldfb_reverse(ldfb_load(p));
+}
+
+static inline void ldfb_store(FIXP_DBL *p, const ldfb_v4 v) {
+  __builtin_memcpy(p, &v, sizeof(v));
+}
+
+/* Stores v into p[3], p[2], p[1], p[0] */
+static inline void ldfb_store_rev(FIXP_DBL *p, const ldfb_v4 v) {
+  ldfb_store(p, ldfb_reverse(v));
+}
+
+static inline ldfb_v4 ldfb_load_coef(const FIXP_WTB *p) {
+  const ldfb_v4 v = {p[0], p[1], p[2], p[3]};
+  return v;
+}
+
+/* Loads p[0], p[-1], p[-2], p[-3] */
+static inline ldfb_v4 ldfb_load_coef_rev(const FIXP_WTB *p) {
+  const ldfb_v4 v = {p[0], p[-1], p[-2], p[-3]};
+  return v;
+}
+
+/* fMultDiv2(FIXP_DBL, FIXP_SGL), i.e. (a * b) >> 16, split so that no lane
+   product needs more than 32 bits */
+static inline ldfb_v4 ldfb_mult_div2(const ldfb_v4 a, const ldfb_v4 b) {
+  return (a >> 16) * b + (((a & 0xFFFF) * b) >> 16);
+}
+
+static inline ldfb_v4 ldfb_add_saturate(const ldfb_v4 a, const ldfb_v4 b) {
+  ldfb_v4 sum = (a >> 1) + (b >> 1);
+  const ldfb_v4 hi = sum > (INT)(MAXVAL_DBL >> 1);
+  const ldfb_v4 lo = sum < (INT)(MINVAL_DBL >> 1);
+  sum = (sum & ~(hi | lo)) | (hi & (INT)(MAXVAL_DBL >> 1)) |
+        (lo & (INT)(MINVAL_DBL >> 1));
+  return sum << 1;
+}
+
+static inline ldfb_v4 ldfb_saturate_left_shift(const ldfb_v4 src,
+                                               const int scale) {
+  const INT limit = (INT)MAXVAL_DBL >> scale;
+  const ldfb_v4 hi = src > limit;
+  const ldfb_v4 lo = src < ~limit;
+  return ((src << scale) & ~(hi | lo)) | (hi & (INT)MAXVAL_DBL) |
+         (lo & (INT)MINVAL_DBL);
+}
+#endif /* FUNCTION_multE2_DinvF_fdk_simd */
+
 static void multE2_DinvF_fdk(PCM_DEC *output, FIXP_DBL *x, const FIXP_WTB *fb,
                              FIXP_DBL *z, const int N) {
   int i;
@@ -130,7 +208,33 @@ static void multE2_DinvF_fdk(PCM_DEC *output, FIXP_DBL *x, const FIXP_WTB *fb,
     rnd_val_wts1 = (FIXP_DBL)(1 << (-WTS1 - 1 + scale - 1));
 #endif
 
-  for (i = 0; i < N / 4; i++) {
+  i = 0;
+
+#ifdef FUNCTION_multE2_DinvF_fdk_simd
+  for (; i + 4 <= N / 4; i += 4) {
+    const ldfb_v4 z2 = ldfb_load(&x[N / 2 + i]);
+    const ldfb_v4 z0 = ldfb_add_saturate(
+        z2, ldfb_mult_div2(ldfb_load(&z[N / 2 + i]),
+                           ldfb_load_coef(&fb[2 * N + i])) >>
+                (-WTS2 - 1));
+    const ldfb_v4 z1 = ldfb_add_saturate(
+        ldfb_load_rev(&x[N / 2 - 4 - i]),
+        ldfb_mult_div2(ldfb_load(&z[N + i]),
+                       ldfb_load_coef(&fb[2 * N + N / 2 + i])) >>
+            (-WTS2 - 1));
+    const ldfb_v4 tmp =
+        ldfb_mult_div2(z1, ldfb_load_coef_rev(&fb[N + N / 2 - 1 - i])) +
+        ldfb_mult_div2(ldfb_load(&z[i]), ldfb_load_coef(&fb[N + N / 2 + i]));
+
+    ldfb_store_rev(&output[N * 3 / 4 - 4 - i],
+                   ldfb_saturate_left_shift(tmp, WTS1 + 1 - scale));
+    ldfb_store(&z[N / 2 + i], z1);
+    ldfb_store(&z[i], z0);
+    ldfb_store(&z[N + i], z2);
+  }
+#endif
+
+  for (; i < N / 4; i++) {
     FIXP_DBL z0, z2, tmp;
 
     z2 = x[N / 2 + i];
@@ -160,7 +264,37 @@ static void multE2_DinvF_fdk(PCM_DEC *output, FIXP_DBL *x, const FIXP_WTB *fb,
     z[N + i] = z2;
   }
 
-  for (i = N / 4; i < N / 2; i++) {
+#ifdef FUNCTION_multE2_DinvF_fdk_simd
+  for (; i + 4 <= N / 2; i += 4) {
+    const ldfb_v4 z2 = ldfb_load(&x[N / 2 + i]);
+    const ldfb_v4 z0 = ldfb_add_saturate(
+        z2, ldfb_mult_div2(ldfb_load(&z[N / 2 + i]),
+                           ldfb_load_coef(&fb[2 * N + i])) >>
+                (-WTS2 - 1));
+    const ldfb_v4 z1 = ldfb_add_saturate(
+        ldfb_load_rev(&x[N / 2 - 4 - i]),
+        ldfb_mult_div2(ldfb_load(&z[N + i]),
+                       ldfb_load_coef(&fb[2 * N + N / 2 + i])) >>
+            (-WTS2 - 1));
+    const ldfb_v4 zi = ldfb_load(&z[i]);
+    const ldfb_v4 tmp0 =
+        ldfb_mult_div2(z1, ldfb_load_coef_rev(&fb[N / 2 - 1 - i])) +
+        ldfb_mult_div2(zi, ldfb_load_coef(&fb[N / 2 + i]));
+    const ldfb_v4 tmp1 =
+        ldfb_mult_div2(z1, ldfb_load_coef_rev(&fb[N + N / 2 - 1 - i])) +
+        ldfb_mult_div2(zi, ldfb_load_coef(&fb[N + N / 2 + i]));
+
+    ldfb_store(&output[i - N / 4],
+               ldfb_saturate_left_shift(tmp0, WTS0 + 1 - scale));
+    ldfb_store_rev(&output[N * 3 / 4 - 4 - i],
+                   ldfb_saturate_left_shift(tmp1, WTS1 + 1 - scale));
+    ldfb_store(&z[N / 2 + i], z1);
+    ldfb_store(&z[i], z0);
+    ldfb_store(&z[N + i], z2);
+  }
+#endif
+
+  for (; i < N / 2; i++) {
     FIXP_DBL z0, z2, tmp0, tmp1;
 
     z2 = x[N / 2 + i];
@@ -198,7 +332,19 @@ static void multE2_DinvF_fdk(PCM_DEC *output, FIXP_DBL *x, const FIXP_WTB *fb,
   }
 
   /* Exchange quarter parts of x to bring them in the "right" order */
-  for (i = 0; i < N / 4; i++) {
+  i = 0;
+
+#ifdef FUNCTION_multE2_DinvF_fdk_simd
+  for (; i + 4 <= N / 4; i += 4) {
+    const ldfb_v4 tmp0 =
+        ldfb_mult_div2(ldfb_load(&z[i]), ldfb_load_coef(&fb[N / 2 + i]));
+
+    ldfb_store(&output[N * 3 / 4 + i],
+               ldfb_saturate_left_shift(tmp0, WTS0 + 1 - scale));
+  }
+#endif
+
+  for (; i < N / 4; i++) {
     FIXP_DBL tmp0 = fMultDiv2(z[i], fb[N / 2 + i]);
 
 #if ((DFRACT_BITS - PCM_OUT_BITS - LDFB_HEADROOM + (3) - 1) > 0)
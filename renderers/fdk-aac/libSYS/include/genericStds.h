@@ -403,6 +403,19 @@ void *FDKcalloc(const UINT n, const UINT size);
 void *FDKmalloc(const UINT size);
 void FDKfree(void *ptr);
 
+typedef void *(*FDK_CALLOC_FUNC)(size_t n, size_t size);
+typedef void (*FDK_FREE_FUNC)(void *ptr);
+
+/**
+ *  Replace calloc() and free() for all heap memory of the library, e.g. to
+ * account for it. Only takes effect before the first allocation, later calls
+ * are ignored so that memory is never freed by a different allocator.
+ *
+ * \param callocFunc  Allocates and clears memory like calloc().
+ * \param freeFunc    Frees memory obtained from callocFunc.
+ */
+void FDKsetAllocator(FDK_CALLOC_FUNC callocFunc, FDK_FREE_FUNC freeFunc);
+
 /**
  *  Allocate and clear an aligned memory area. Use FDKafree() instead of
  * FDKfree() for these memory areas.
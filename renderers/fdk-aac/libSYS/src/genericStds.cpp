@@ -189,10 +189,26 @@ char *FDKstrncpy(char *dest, const char *src, UINT n) {
  * DYNAMIC MEMORY management (heap)
  *************************************************************************/
 
+static FDK_CALLOC_FUNC fdkCallocFunc = NULL;
+static FDK_FREE_FUNC fdkFreeFunc = NULL;
+static int fdkAllocated = 0;
+
+void FDKsetAllocator(FDK_CALLOC_FUNC callocFunc, FDK_FREE_FUNC freeFunc) {
+  if (!fdkAllocated && !fdkCallocFunc && callocFunc && freeFunc) {
+    fdkCallocFunc = callocFunc;
+    fdkFreeFunc = freeFunc;
+  }
+}
+
 void *FDKcalloc(const UINT n, const UINT size) {
   void *ptr;
 
-  ptr = calloc(n, size);
+  fdkAllocated = 1;
+  if (fdkCallocFunc) {
+    ptr = fdkCallocFunc(n, size);
+  } else {
+    ptr = calloc(n, size);
+  }
 
   return ptr;
 }
@@ -200,12 +216,23 @@ void *FDKcalloc(const UINT n, const UINT size) {
 void *FDKmalloc(const UINT size) {
   void *ptr;
 
-  ptr = malloc(size);
+  fdkAllocated = 1;
+  if (fdkCallocFunc) {
+    ptr = fdkCallocFunc(1, size);
+  } else {
+    ptr = malloc(size);
+  }
 
   return ptr;
 }
 
-void FDKfree(void *ptr) { free((INT *)ptr); }
+void FDKfree(void *ptr) {
+  if (fdkFreeFunc) {
+    fdkFreeFunc(ptr);
+  } else {
+    free((INT *)ptr);
+  }
+}
 
 void *FDKaalloc(const UINT size, const UINT alignment) {
   void *addr, *result = NULL;
@@ -0,0 +1,135 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Splits the time a frame spends inside a video renderer, after the mirror pipeline's submit
+ * stage handed it over, into decode, from render_buffer until the decoder gave the picture out,
+ * and present, from there until it is on display. The renderer notes each step with the pts of
+ * the frame, which its decoder carries along, and the time as raop_ntp_get_local_time(NULL).
+ * The steps usually happen on different threads, the lock keeps the ring and the histograms to
+ * one writer at a time. Both steps also go into the flight recorder. Header only, so plugins get
+ * their own copy.
+ */
+
+#ifndef FRAME_STAGES_H
+#define FRAME_STAGES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "../lib/flight_recorder.h"
+#include "../lib/logger.h"
+#include "../lib/histogram.h"
+#include "../lib/threads.h"
+
+// Frames in flight that are told apart, more than any decoder holds on to
+#define FRAME_STAGES_SLOTS 64
+
+typedef struct frame_stages_slot_s {
+    uint64_t pts;
+    uint64_t submitted;
+    uint64_t decoded; // 0 until the decoder gave the picture out
+} frame_stages_slot_t;
+
+typedef struct frame_stages_s {
+    mutex_handle_t mutex;
+    frame_stages_slot_t slots[FRAME_STAGES_SLOTS];
+    unsigned int next;
+    histogram_t decode;
+    histogram_t present;
+} frame_stages_t;
+
+static inline void frame_stages_init(frame_stages_t *stages) {
+    memset(stages->slots, 0, sizeof(stages->slots));
+    stages->next = 0;
+    histogram_init(&stages->decode);
+    histogram_init(&stages->present);
+    MUTEX_CREATE(stages->mutex);
+}
+
+static inline void frame_stages_destroy(frame_stages_t *stages) {
+    MUTEX_DESTROY(stages->mutex);
+}
+
+/* The newest slot of pts, NULL if it fell out of the ring. Called with the lock held. */
+static inline frame_stages_slot_t *frame_stages_find(frame_stages_t *stages, uint64_t pts) {
+    for (unsigned int i = 1; i <= FRAME_STAGES_SLOTS; i++) {
+        frame_stages_slot_t *slot = &stages->slots[(stages->next - i) % FRAME_STAGES_SLOTS];
+        if (slot->pts == pts && slot->submitted) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/* Parameter sets have no pts of their own and are not tracked */
+static inline void frame_stages_submitted(frame_stages_t *stages, uint64_t pts, uint64_t time) {
+    if (!pts) {
+        return;
+    }
+    MUTEX_LOCK(stages->mutex);
+    frame_stages_slot_t *slot = &stages->slots[stages->next++ % FRAME_STAGES_SLOTS];
+    slot->pts = pts;
+    slot->submitted = time;
+    slot->decoded = 0;
+    MUTEX_UNLOCK(stages->mutex);
+}
+
+static inline void frame_stages_decoded(frame_stages_t *stages, uint64_t pts, uint64_t time) {
+    MUTEX_LOCK(stages->mutex);
+    frame_stages_slot_t *slot = frame_stages_find(stages, pts);
+    if (slot && !slot->decoded) {
+        slot->decoded = time;
+        uint64_t decode = time > slot->submitted ? time - slot->submitted : 0;
+        histogram_record(&stages->decode, decode);
+        flight_recorder_record(FLIGHT_RECORDER_EVENT_frame_decoded, pts, decode, 0);
+    }
+    MUTEX_UNLOCK(stages->mutex);
+}
+
+/* Each frame counts once, the slot is freed for the ring */
+static inline void frame_stages_presented(frame_stages_t *stages, uint64_t pts, uint64_t time) {
+    MUTEX_LOCK(stages->mutex);
+    frame_stages_slot_t *slot = frame_stages_find(stages, pts);
+    if (slot && slot->decoded) {
+        uint64_t present = time > slot->decoded ? time - slot->decoded : 0;
+        histogram_record(&stages->present, present);
+        flight_recorder_record(FLIGHT_RECORDER_EVENT_frame_presented, pts, present, 0);
+        slot->submitted = 0;
+    }
+    MUTEX_UNLOCK(stages->mutex);
+}
+
+/* Forgets the frames in flight, e.g. the ones a flush threw away */
+static inline void frame_stages_flush(frame_stages_t *stages) {
+    MUTEX_LOCK(stages->mutex);
+    memset(stages->slots, 0, sizeof(stages->slots));
+    MUTEX_UNLOCK(stages->mutex);
+}
+
+static inline void frame_stages_log(frame_stages_t *stages, logger_t *logger) {
+    if (atomic_load(&stages->decode.total) > 0) {
+        histogram_log(&stages->decode, logger, LOGGER_INFO, "video decode");
+    }
+    if (atomic_load(&stages->present.total) > 0) {
+        histogram_log(&stages->present, logger, LOGGER_INFO, "video present");
+    }
+}
+
+#endif //FRAME_STAGES_H
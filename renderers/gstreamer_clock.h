@@ -0,0 +1,39 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef GSTREAMER_CLOCK_H
+#define GSTREAMER_CLOCK_H
+
+#include <stdint.h>
+#include <gst/gst.h>
+
+/*
+ * Runs a pipeline on the monotonic clock raop_ntp measures local time with, with a base time
+ * of 0. The running time of the pipeline then equals raop_ntp local time, so a frame
+ * stamped with gstreamer_clock_pts() of its pts plays latency_ms after that instant,
+ * and every pipeline set up this way plays in sync with the others.
+ */
+void gstreamer_clock_setup(GstElement *pipeline, int latency_ms);
+
+/* raop_ntp local microseconds to pipeline running time */
+static inline GstClockTime gstreamer_clock_pts(uint64_t pts) {
+    return (GstClockTime) pts * GST_USECOND;
+}
+
+#endif //GSTREAMER_CLOCK_H
@@ -0,0 +1,132 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include "gstreamer_frame_pool.h"
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "../lib/buffer_pool.h"
+#include "../lib/threads.h"
+
+typedef struct gstreamer_frame_s {
+    gstreamer_frame_pool_t *pool;
+    unsigned char *data;
+    int size;
+    bool in_use;
+} gstreamer_frame_t;
+
+struct gstreamer_frame_pool_s {
+    logger_t *logger;
+    buffer_pool_t *buffers;
+
+    // Frames are released from whichever GStreamer thread drops the last reference
+    mutex_handle_t mutex;
+    int frame_count;
+    gstreamer_frame_t *frames;
+};
+
+gstreamer_frame_pool_t *gstreamer_frame_pool_init(logger_t *logger, int frames) {
+    gstreamer_frame_pool_t *pool;
+
+    assert(frames > 0);
+
+    pool = calloc(1, sizeof(gstreamer_frame_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    pool->frames = calloc(frames, sizeof(gstreamer_frame_t));
+    // One buffer per frame, so the buffer pool itself never runs dry
+    pool->buffers = buffer_pool_init(logger, frames);
+    if (!pool->frames || !pool->buffers) {
+        buffer_pool_destroy(pool->buffers);
+        free(pool->frames);
+        free(pool);
+        return NULL;
+    }
+    buffer_pool_set_mem_tag(pool->buffers, MEM_TAG_GSTREAMER);
+    pool->logger = logger;
+    pool->frame_count = frames;
+    for (int i = 0; i < frames; i++) {
+        pool->frames[i].pool = pool;
+    }
+    MUTEX_CREATE(pool->mutex);
+    return pool;
+}
+
+void gstreamer_frame_pool_destroy(gstreamer_frame_pool_t *pool) {
+    if (pool) {
+        buffer_pool_destroy(pool->buffers);
+        MUTEX_DESTROY(pool->mutex);
+        free(pool->frames);
+        free(pool);
+    }
+}
+
+unsigned char *gstreamer_frame_pool_acquire(gstreamer_frame_pool_t *pool, int size, void **handle) {
+    gstreamer_frame_t *frame = NULL;
+
+    MUTEX_LOCK(pool->mutex);
+    for (int i = 0; i < pool->frame_count; i++) {
+        if (!pool->frames[i].in_use) {
+            frame = &pool->frames[i];
+            frame->in_use = true;
+            break;
+        }
+    }
+    MUTEX_UNLOCK(pool->mutex);
+    if (!frame) {
+        return NULL;
+    }
+
+    frame->data = buffer_pool_acquire(pool->buffers, size);
+    if (!frame->data) {
+        MUTEX_LOCK(pool->mutex);
+        frame->in_use = false;
+        MUTEX_UNLOCK(pool->mutex);
+        return NULL;
+    }
+    frame->size = size;
+    *handle = frame;
+    return frame->data;
+}
+
+void gstreamer_frame_pool_release(gstreamer_frame_pool_t *pool, void *handle) {
+    gstreamer_frame_t *frame = handle;
+
+    buffer_pool_release(pool->buffers, frame->data);
+    MUTEX_LOCK(pool->mutex);
+    frame->data = NULL;
+    frame->in_use = false;
+    MUTEX_UNLOCK(pool->mutex);
+}
+
+static void gstreamer_frame_pool_buffer_freed(gpointer user_data) {
+    gstreamer_frame_t *frame = user_data;
+    gstreamer_frame_pool_release(frame->pool, frame);
+}
+
+GstBuffer *gstreamer_frame_pool_wrap(gstreamer_frame_pool_t *pool, void *handle, int data_len) {
+    gstreamer_frame_t *frame = handle;
+
+    assert(data_len <= frame->size);
+    return gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, frame->data, frame->size, 0, data_len,
+                                       frame, gstreamer_frame_pool_buffer_freed);
+}
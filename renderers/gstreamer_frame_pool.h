@@ -0,0 +1,44 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef GSTREAMER_FRAME_POOL_H
+#define GSTREAMER_FRAME_POOL_H
+
+#include <gst/gst.h>
+#include "../lib/logger.h"
+
+/*
+ * Pooled frame memory the GStreamer renderers hand to appsrc without copying. A frame
+ * is wrapped into a GstBuffer that owns it until the pipeline lets go of the buffer,
+ * which returns the memory to the pool. At most frames buffers are out at a time.
+ */
+typedef struct gstreamer_frame_pool_s gstreamer_frame_pool_t;
+
+gstreamer_frame_pool_t *gstreamer_frame_pool_init(logger_t *logger, int frames);
+/* Must only be called once the pipeline released every buffer, i.e. after it went to GST_STATE_NULL */
+void gstreamer_frame_pool_destroy(gstreamer_frame_pool_t *pool);
+
+/* Returns memory for a frame of size bytes, or NULL while all frames are out */
+unsigned char *gstreamer_frame_pool_acquire(gstreamer_frame_pool_t *pool, int size, void **handle);
+/* Gives back an acquired frame that is not going to be wrapped */
+void gstreamer_frame_pool_release(gstreamer_frame_pool_t *pool, void *handle);
+/* Wraps the first data_len bytes of an acquired frame, the buffer owns the frame from now on */
+GstBuffer *gstreamer_frame_pool_wrap(gstreamer_frame_pool_t *pool, void *handle, int data_len);
+
+#endif //GSTREAMER_FRAME_POOL_H
@@ -0,0 +1,80 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include "gstreamer_registry.h"
+
+static GMutex registry_mutex;
+static GThread *registry_thread = NULL;
+
+static gpointer gstreamer_registry_thread(gpointer data) {
+    gst_init(NULL, NULL);
+    return NULL;
+}
+
+void gstreamer_registry_prewarm(void) {
+    g_mutex_lock(&registry_mutex);
+    if (!registry_thread && !gst_is_initialized()) {
+        registry_thread = g_thread_new("gst-registry", gstreamer_registry_thread, NULL);
+    }
+    g_mutex_unlock(&registry_mutex);
+}
+
+void gstreamer_registry_wait(void) {
+    g_mutex_lock(&registry_mutex);
+    if (registry_thread) {
+        g_thread_join(registry_thread);
+        registry_thread = NULL;
+    }
+    g_mutex_unlock(&registry_mutex);
+    gst_init(NULL, NULL);
+}
+
+gboolean gstreamer_registry_has_plugins(const gchar *const *plugins) {
+    GstRegistry *registry = gst_registry_get();
+    gboolean ret = TRUE;
+    for (int i = 0; plugins[i]; i++) {
+        GstPlugin *plugin = gst_registry_find_plugin(registry, plugins[i]);
+        if (!plugin) {
+            g_print("Required gstreamer plugin '%s' not found\n", plugins[i]);
+            ret = FALSE;
+            continue;
+        }
+        gst_object_unref(plugin);
+    }
+    return ret;
+}
+
+gchar *gstreamer_registry_find_element(const char *preference, const char *caps_string, GstPadDirection direction) {
+    gchar **names = g_strsplit(preference, ",", -1);
+    GstCaps *caps = gst_caps_from_string(caps_string);
+    gchar *found = NULL;
+    for (int i = 0; names[i] && !found; i++) {
+        GstElementFactory *factory = gst_element_factory_find(g_strstrip(names[i]));
+        if (factory) {
+            if (direction == GST_PAD_SINK ? gst_element_factory_can_sink_any_caps(factory, caps) :
+                                            gst_element_factory_can_src_any_caps(factory, caps)) {
+                found = g_strdup(names[i]);
+            }
+            gst_object_unref(factory);
+        }
+    }
+    gst_caps_unref(caps);
+    g_strfreev(names);
+    return found;
+}
@@ -0,0 +1,48 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef GSTREAMER_REGISTRY_H
+#define GSTREAMER_REGISTRY_H
+
+#include <gst/gst.h>
+
+/*
+ * gst_init loads the plugin registry, which means scanning every plugin when the cache is
+ * cold and takes seconds on an SD card after boot. The renderers start it on a thread of
+ * their own while the server comes up, and only wait for it once they build a pipeline.
+ */
+void gstreamer_registry_prewarm(void);
+
+/* Returns once GStreamer is initialized, initializing it right here if no prewarm did */
+void gstreamer_registry_wait(void);
+
+/* Whether all of the NULL terminated plugins are installed, the missing ones are printed */
+gboolean gstreamer_registry_has_plugins(const gchar *const *plugins);
+
+/* Hardware decoders first, the software decoder from gst-libav is the last resort */
+#define GSTREAMER_H264_DECODERS "v4l2h264dec,vah264dec,vaapih264dec,nvh264dec,avdec_h264"
+#define GSTREAMER_H265_DECODERS "v4l2h265dec,vah265dec,vaapih265dec,nvh265dec,avdec_h265"
+
+/**
+ * Returns the first installed element of a comma separated list that takes the caps on its sink
+ * pads, or puts them out on its src pads, as the direction says. NULL if none does, g_free the name.
+ */
+gchar *gstreamer_registry_find_element(const char *preference, const char *caps_string, GstPadDirection direction);
+
+#endif //GSTREAMER_REGISTRY_H
@@ -379,6 +379,102 @@ static inline uint64_t bs_next_bytes(bs_t* bs, int nbytes)
    return val;
 }
 
+/*
+ * Fast reader for parsing headers straight out of a NAL unit. Bits are served from a 64-bit
+ * cache refilled a byte at a time, Exp-Golomb codes are decoded with a single leading-zero count
+ * instead of bit by bit, and emulation prevention bytes are dropped on the fly, so no RBSP copy
+ * is needed. Reads past the end return zero bits and set overrun.
+ */
+typedef struct
+{
+	const uint8_t* p;
+	const uint8_t* end;
+	uint64_t cache; // next bits of the stream, MSB first
+	int cached;     // valid bits in cache
+	int zeros;      // zero bytes just read, for emulation prevention
+	int overrun;
+} bs_cache_t;
+
+static inline void bs_cache_init(bs_cache_t* b, const uint8_t* buf, size_t size)
+{
+    b->p = buf;
+    b->end = buf + size;
+    b->cache = 0;
+    b->cached = 0;
+    b->zeros = 0;
+    b->overrun = 0;
+}
+
+static inline void bs_cache_refill(bs_cache_t* b)
+{
+    while (b->cached <= 56 && b->p < b->end)
+    {
+        uint8_t byte = *b->p++;
+        if (b->zeros >= 2 && byte == 0x03) { b->zeros = 0; continue; }
+        b->zeros = (byte == 0) ? b->zeros + 1 : 0;
+        b->cache |= (uint64_t)byte << (56 - b->cached);
+        b->cached += 8;
+    }
+}
+
+static inline int bs_cache_clz64(uint64_t v)
+{
+#if defined(__GNUC__)
+    return v ? __builtin_clzll(v) : 64;
+#else
+    int n = 0;
+    if (v == 0) { return 64; }
+    while (!(v & 0x8000000000000000ull)) { v <<= 1; n++; }
+    return n;
+#endif
+}
+
+// n up to 32
+static inline uint32_t bs_cache_read_u(bs_cache_t* b, int n)
+{
+    if (n == 0) { return 0; }
+    if (b->cached < n)
+    {
+        bs_cache_refill(b);
+        if (b->cached < n) { b->overrun = 1; b->cached = n; }
+    }
+    uint32_t r = (uint32_t)(b->cache >> (64 - n));
+    b->cache <<= n;
+    b->cached -= n;
+    return r;
+}
+
+static inline uint32_t bs_cache_read_u1(bs_cache_t* b) { return bs_cache_read_u(b, 1); }
+
+static inline void bs_cache_skip_u(bs_cache_t* b, int n)
+{
+    while (n > 32) { bs_cache_read_u(b, 32); n -= 32; }
+    bs_cache_read_u(b, n);
+}
+
+static inline uint32_t bs_cache_read_ue(bs_cache_t* b)
+{
+    if (b->cached < 32) { bs_cache_refill(b); }
+    int i = bs_cache_clz64(b->cache);
+    if (i >= b->cached)
+    {
+        // Only zero bits left in the stream
+        b->overrun = 1;
+        b->cache = 0;
+        b->cached = 0;
+        return 0;
+    }
+    if (i > 31) { b->overrun = 1; i = 31; }
+    bs_cache_read_u(b, i + 1);
+    return ((1u << i) - 1) + bs_cache_read_u(b, i);
+}
+
+static inline int32_t bs_cache_read_se(bs_cache_t* b)
+{
+    uint32_t r = bs_cache_read_ue(b);
+    return (r & 0x01) ? (int32_t)((r + 1) / 2) : -(int32_t)(r / 2);
+}
+
 #define bs_print_state(b) fprintf( stderr,  "%s:%d@%s: b->p=0x%02hhX, b->left = %d\n", __FILE__, __LINE__, __FUNCTION__, *b->p, b->bits_left )
 
 #ifdef __cplusplus
@@ -140,3 +140,44 @@ void debug_avcc(avcc_t* avcc)
     debug_pps(avcc->pps_table[i]);
   }
 }
+
+int avcc_to_annexb(uint8_t* buf, int size, h264_nal_index_t* index)
+{
+  int pos = 0;
+  index->count = 0;
+
+  if (avcc_to_annexb_partial(buf, size, size, &pos, index) != 1) { return -1; }
+  return index->count;
+}
+
+int avcc_to_annexb_partial(uint8_t* buf, int size, int available, int* next, h264_nal_index_t* index)
+{
+  int pos = *next;
+
+  if (size <= 0) { return -1; }
+  while (pos < size)
+  {
+    // A NAL needs its prefix and at least its header byte
+    if (size - pos < 5) { return -1; }
+    if (available - pos < 5) { break; }
+    uint32_t len = ((uint32_t)buf[pos] << 24) | ((uint32_t)buf[pos + 1] << 16) |
+                   ((uint32_t)buf[pos + 2] << 8) | (uint32_t)buf[pos + 3];
+    if (len == 0 || len > (uint32_t)(size - pos - 4)) { return -1; }
+    if (len > (uint32_t)(available - pos - 4)) { break; }
+    if (index->count == H264_NAL_INDEX_MAX) { return -1; }
+
+    buf[pos] = 0;
+    buf[pos + 1] = 0;
+    buf[pos + 2] = 0;
+    buf[pos + 3] = 1;
+
+    h264_nal_index_entry_t* nal = &index->nals[index->count++];
+    nal->offset = pos + 4;
+    nal->size = (int)len;
+    nal->nal_unit_type = buf[pos + 4] & 0x1f;
+    nal->nal_ref_idc = (buf[pos + 4] >> 5) & 0x03;
+    pos += 4 + (int)len;
+  }
+  *next = pos;
+  return pos == size;
+}
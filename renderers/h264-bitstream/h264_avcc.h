@@ -6,6 +6,7 @@
 
 #include "bs.h"
 #include "h264_stream.h"
+#include "h264_nal_index.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +38,22 @@ int read_avcc(avcc_t* avcc, h264_stream_t* h, bs_t* b);
 int write_avcc(avcc_t* avcc, h264_stream_t* h, bs_t* b);
 void debug_avcc(avcc_t* avcc);
 
+/**
+   Rewrites the 4 byte big endian length prefixes of an AVCC access unit into Annex-B start codes
+   in place and indexes every NAL unit on the way. Each length is checked against the rest of the
+   buffer. Returns the number of NAL units, or -1 if the buffer is not a well formed access unit,
+   in which case its content is undefined.
+*/
+int avcc_to_annexb(uint8_t* buf, int size, h264_nal_index_t* index);
+
+/**
+   avcc_to_annexb for an access unit of size bytes of which only the first available have arrived.
+   Rewrites the NAL units that are complete from *next on and moves *next past them, index keeps
+   growing from call to call and needs a count of 0 before the first. Returns 1 once the whole
+   access unit is rewritten, 0 while the rest is missing, -1 if it is not well formed.
+*/
+int avcc_to_annexb_partial(uint8_t* buf, int size, int available, int* next, h264_nal_index_t* index);
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,6 +23,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "bs.h"
 #include "h264_stream.h"
@@ -67,6 +71,49 @@ h264_stream_t* h264_new()
 }
 
 
+/**
+ Reset an H264 stream object to its state right after h264_new, without freeing and allocating
+ its structures again, so one object can be kept for a whole stream or reused for the next.
+ Buffers that only grow, like the RBSP scratch and the slice data, keep their memory.
+ @param[in,out] h   the stream object
+ */
+void h264_reset(h264_stream_t* h)
+{
+    memset(h->nal->nal_svc_ext, 0, sizeof(nal_svc_ext_t));
+    memset(h->nal->prefix_nal_svc, 0, sizeof(prefix_nal_svc_t));
+    nal_svc_ext_t* nal_svc_ext = h->nal->nal_svc_ext;
+    prefix_nal_svc_t* prefix_nal_svc = h->nal->prefix_nal_svc;
+    memset(h->nal, 0, sizeof(nal_t));
+    h->nal->nal_svc_ext = nal_svc_ext;
+    h->nal->prefix_nal_svc = prefix_nal_svc;
+
+    for ( int i = 0; i < 32; i++ ) { memset(h->sps_table[i], 0, sizeof(sps_t)); }
+    for ( int i = 0; i < 64; i++ )
+    {
+        memset(h->sps_subset_table[i]->sps, 0, sizeof(sps_t));
+        memset(h->sps_subset_table[i]->sps_svc_ext, 0, sizeof(sps_svc_ext_t));
+    }
+    for ( int i = 0; i < 256; i++ ) { memset(h->pps_table[i], 0, sizeof(pps_t)); }
+
+    memset(h->sps, 0, sizeof(sps_t));
+    memset(h->sps_subset->sps, 0, sizeof(sps_t));
+    memset(h->sps_subset->sps_svc_ext, 0, sizeof(sps_svc_ext_t));
+    memset(h->pps, 0, sizeof(pps_t));
+    memset(h->aud, 0, sizeof(aud_t));
+    if(h->seis != NULL)
+    {
+        for( int i = 0; i < h->num_seis; i++ ) { sei_free(h->seis[i]); }
+        free(h->seis);
+    }
+    h->num_seis = 0;
+    h->seis = NULL;
+    h->sei = NULL;
+    memset(h->sh, 0, sizeof(slice_header_t));
+    memset(h->sh_svc_ext, 0, sizeof(slice_header_svc_ext_t));
+    h->slice_data->rbsp_size = 0;
+}
+
+
 /**
  Free an existing H264 stream object.  Frees all contained structures.
  @param[in,out] h   the stream object
@@ -119,16 +166,66 @@ void h264_free(h264_stream_t* h)
     free(h->sps_subset->sps_svc_ext);
     free(h->sps_subset);
 
+    free(h->rbsp_scratch);
+
     free(h);
 }
 
+/**
+ Find the first pair of zero bytes in a byte buffer, which is where every start code begins.
+ Blocks without any zero byte are skipped a machine word (or an SSE2 register) at a time,
+ so the scan costs a fraction of a byte compare per byte on slice data.
+ @param[in]   buf        the buffer, readable up to and including last + 1
+ @param[in]   from       the first offset to test
+ @param[in]   last       the last offset to test
+ @return                 offset of the first zero pair in [from, last], or -1 if there is none
+ */
+static int find_zero_pair(const uint8_t* buf, int from, int last)
+{
+    int i = from;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 16 <= last)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(buf + i));
+        unsigned int z = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        // bit j of pairs is set when bytes j and j+1 are both zero, the last byte pairs with buf[i+16]
+        unsigned int pairs = (z & (z >> 1)) | ((z >> 15) & (buf[i+16] == 0)) << 15;
+        if (pairs) { return i + __builtin_ctz(pairs); }
+        i += 16;
+    }
+#else
+    while (i + 8 <= last)
+    {
+        uint64_t v;
+        memcpy(&v, buf + i, sizeof(v));
+        // non-zero if any byte of v is zero
+        if ((v - 0x0101010101010101ull) & ~v & 0x8080808080808080ull)
+        {
+            for (int j = i; j < i + 8; j++)
+            {
+                if (buf[j] == 0 && buf[j+1] == 0) { return j; }
+            }
+        }
+        i += 8;
+    }
+#endif
+
+    for (; i <= last; i++)
+    {
+        if (buf[i] == 0 && buf[i+1] == 0) { return i; }
+    }
+    return -1;
+}
+
 /**
  Find the beginning and end of a NAL (Network Abstraction Layer) unit in a byte buffer containing H264 bitstream data.
  @param[in]   buf        the buffer
  @param[in]   size       the size of the buffer
  @param[out]  nal_start  the beginning offset of the nal
  @param[out]  nal_end    the end offset of the nal
- @return                 the length of the nal, or 0 if did not find start of nal, or -1 if did not find end of nal
+ @return                 the length of the nal, or 0 if did not find start of nal. A nal that no start code follows ends at the end of the data.
  */
 // DEPRECATED - this will be replaced by a similar function with a slightly different API
 int find_nal_unit(uint8_t* buf, int size, int* nal_start, int* nal_end)
@@ -137,41 +234,40 @@ int find_nal_unit(uint8_t* buf, int size, int* nal_start, int* nal_end)
     // find start
     *nal_start = 0;
     *nal_end = 0;
-    
-    i = 0;
-    while (   //( next_bits( 24 ) != 0x000001 && next_bits( 32 ) != 0x00000001 )
-        (buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0x01) && 
-        (buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0 || buf[i+3] != 0x01) 
-        )
+    if (size < 4) { return 0; } // no room for a start code and a nal
+
+    i = -1;
+    do
     {
-        i++; // skip leading zero
-        if (i+4 >= size) { return 0; } // did not find nal start
+        i = find_zero_pair(buf, i + 1, (size - 5 > 0) ? size - 5 : 0);
+        if (i < 0) { return 0; } // did not find nal start
     }
+    while ( //( next_bits( 24 ) != 0x000001 && next_bits( 32 ) != 0x00000001 )
+        buf[i+2] != 0x01 && (buf[i+2] != 0 || buf[i+3] != 0x01)
+        );
 
-    if  (buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0x01) // ( next_bits( 24 ) != 0x000001 )
+    if  (buf[i+2] != 0x01) // ( next_bits( 24 ) != 0x000001 )
     {
         i++;
     }
-
-    if  (buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0x01) { /* error, should never happen */ return 0; }
     i+= 3;
     *nal_start = i;
-    
-    while (   //( next_bits( 24 ) != 0x000000 && next_bits( 24 ) != 0x000001 )
-        (buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0) && 
-        (buf[i] != 0 || buf[i+1] != 0 || buf[i+2] != 0x01) 
-        )
+
+    i--;
+    do
     {
-        i++;
-        // FIXME the next line fails when reading a nal that ends exactly at the end of the data
-        if (i+3 >= size) { *nal_end = size; return -1; } // did not find nal end, stream ended first
+        // a start code in the last three bytes still ends the nal
+        i = find_zero_pair(buf, i + 1, size - 3);
+        if (i < 0) { *nal_end = size; return (*nal_end - *nal_start); } // the nal ends with the data
     }
-    
+    while ( //( next_bits( 24 ) != 0x000000 && next_bits( 24 ) != 0x000001 )
+        buf[i+2] != 0 && buf[i+2] != 0x01
+        );
+
     *nal_end = i;
     return (*nal_end - *nal_start);
 }
 
-
 /**
    Convert RBSP data to NAL data (Annex B format).
    The size of nal_buf must be 3/2 * the size of the rbsp_buf (rounded up) to guarantee the output will fit.
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef _H264_NAL_INDEX_H
+#define _H264_NAL_INDEX_H        1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// More NALs than this in one access unit is treated as a corrupt frame
+#define H264_NAL_INDEX_MAX 32
+
+/**
+   Position of one NAL unit in an Annex-B access unit. The offset points at the NAL header,
+   just past its start code, and the size does not include the start code.
+*/
+typedef struct h264_nal_index_entry_s
+{
+  int offset;
+  int size;
+  int nal_unit_type;
+  int nal_ref_idc;
+} h264_nal_index_entry_t;
+
+/**
+   All NAL units of one access unit, built while converting it to Annex-B, so renderers
+   never have to scan for start codes again.
+*/
+typedef struct h264_nal_index_s
+{
+  int count;
+  h264_nal_index_entry_t nals[H264_NAL_INDEX_MAX];
+} h264_nal_index_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdint.h>
+
+#include "bs.h"
+#include "h264_stream.h"
+#include "h264_slice_info.h"
+
+//7.3.2.1.1.1 Scaling list syntax
+static void skip_scaling_list(bs_cache_t* b, int size)
+{
+    int last_scale = 8;
+    int next_scale = 8;
+    for( int j = 0; j < size && !b->overrun; j++ )
+    {
+        if( next_scale != 0 )
+        {
+            int delta_scale = bs_cache_read_se(b);
+            next_scale = ( last_scale + delta_scale + 256 ) % 256;
+        }
+        last_scale = ( next_scale == 0 ) ? last_scale : next_scale;
+    }
+}
+
+int read_slice_sps_info(const uint8_t* sps, int sps_size, h264_slice_sps_t* out)
+{
+    bs_cache_t b;
+
+    if( sps_size < 2 || (sps[0] & 0x1F) != NAL_UNIT_TYPE_SPS )
+    {
+        return -1;
+    }
+    bs_cache_init(&b, sps + 1, sps_size - 1);
+
+    //7.3.2.1 Sequence parameter set RBSP syntax
+    int profile_idc = bs_cache_read_u(&b, 8);
+    bs_cache_skip_u(&b, 16); // constraint_set flags, reserved_zero_2bits and level_idc
+    bs_cache_read_ue(&b); // seq_parameter_set_id
+    out->separate_colour_plane_flag = 0;
+    if( profile_idc == 100 || profile_idc == 110 ||
+        profile_idc == 122 || profile_idc == 244 ||
+        profile_idc == 44 || profile_idc == 83 ||
+        profile_idc == 86 || profile_idc == 118 ||
+        profile_idc == 128 || profile_idc == 138 ||
+        profile_idc == 139 || profile_idc == 134 ||
+        profile_idc == 135
+       )
+    {
+        int chroma_format_idc = bs_cache_read_ue(&b);
+        if( chroma_format_idc == 3 )
+        {
+            out->separate_colour_plane_flag = bs_cache_read_u1(&b);
+        }
+        bs_cache_read_ue(&b); // bit_depth_luma_minus8
+        bs_cache_read_ue(&b); // bit_depth_chroma_minus8
+        bs_cache_read_u1(&b); // qpprime_y_zero_transform_bypass_flag
+        if( bs_cache_read_u1(&b) ) // seq_scaling_matrix_present_flag
+        {
+            for( int i = 0; i < ((chroma_format_idc != 3) ? 8 : 12); i++ )
+            {
+                if( bs_cache_read_u1(&b) ) // seq_scaling_list_present_flag
+                {
+                    skip_scaling_list(&b, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+    uint32_t log2_max_frame_num_minus4 = bs_cache_read_ue(&b);
+    if( b.overrun || log2_max_frame_num_minus4 > 12 )
+    {
+        return -1;
+    }
+    out->log2_max_frame_num = log2_max_frame_num_minus4 + 4;
+    return 0;
+}
+
+int read_slice_header_info(const uint8_t* nal, int nal_size, const h264_slice_sps_t* sps, h264_slice_info_t* info)
+{
+    bs_cache_t b;
+
+    if( nal_size < 2 )
+    {
+        return -1;
+    }
+    info->nal_unit_type = nal[0] & 0x1F;
+    info->nal_ref_idc = (nal[0] >> 5) & 0x03;
+    if( info->nal_unit_type != NAL_UNIT_TYPE_CODED_SLICE_NON_IDR &&
+        info->nal_unit_type != NAL_UNIT_TYPE_CODED_SLICE_IDR &&
+        info->nal_unit_type != NAL_UNIT_TYPE_CODED_SLICE_AUX )
+    {
+        return -1;
+    }
+    bs_cache_init(&b, nal + 1, nal_size - 1);
+
+    //7.3.3 Slice header syntax
+    info->first_mb_in_slice = bs_cache_read_ue(&b);
+    info->slice_type = bs_cache_read_ue(&b);
+    info->pic_parameter_set_id = bs_cache_read_ue(&b);
+    info->frame_num = -1;
+    if( sps )
+    {
+        if( sps->separate_colour_plane_flag )
+        {
+            bs_cache_skip_u(&b, 2); // colour_plane_id
+        }
+        info->frame_num = bs_cache_read_u(&b, sps->log2_max_frame_num);
+    }
+    return ( b.overrun || info->slice_type > 9 ) ? -1 : 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef _H264_SLICE_INFO_H
+#define _H264_SLICE_INFO_H        1
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   The few SPS fields a slice header depends on up to frame_num.
+*/
+typedef struct h264_slice_sps_s
+{
+  int separate_colour_plane_flag;
+  int log2_max_frame_num;
+} h264_slice_sps_t;
+
+/**
+   Leading fields of a slice header, enough to tell frame types and frame boundaries apart.
+*/
+typedef struct h264_slice_info_s
+{
+  int nal_unit_type;
+  int nal_ref_idc;
+  int first_mb_in_slice;
+  int slice_type; // 0 to 9, modulo 5 it is one of SH_SLICE_TYPE_*
+  int pic_parameter_set_id;
+  int frame_num; // -1 when read without an SPS
+} h264_slice_info_t;
+
+/**
+   Reads what read_slice_header_info needs from an SPS NAL unit (NAL header included, no start
+   code), skipping everything else.
+   @return 0, or -1 if it is no SPS or is cut short
+*/
+int read_slice_sps_info(const uint8_t* sps, int sps_size, h264_slice_sps_t* out);
+
+/**
+   Parses a coded slice NAL unit (NAL header included, no start code) up to frame_num and stops
+   there, reading straight from the NAL data with the bs_cache_t reader. Cheap enough for every
+   slice of a stream. Without an SPS it stops after pic_parameter_set_id.
+   @return 0, or -1 if it is no coded slice or is cut short
+*/
+int read_slice_header_info(const uint8_t* nal, int nal_size, const h264_slice_sps_t* sps, h264_slice_info_t* info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
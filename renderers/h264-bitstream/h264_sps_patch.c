@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "bs.h"
+#include "h264_stream.h"
+#include "h264_sps_patch.h"
+
+/**
+   Reads the SPS syntax elements and writes each straight back out, so everything in front of
+   the patched field is reproduced bit for bit without ever materialising an sps_t.
+*/
+typedef struct
+{
+    bs_t* r;
+    bs_t* w;
+} sps_copy_t;
+
+static inline uint32_t copy_u(sps_copy_t* c, int n)
+{
+    uint32_t v = bs_read_u(c->r, n);
+    bs_write_u(c->w, n, v);
+    return v;
+}
+
+static inline uint32_t copy_ue(sps_copy_t* c)
+{
+    uint32_t v = bs_read_ue(c->r);
+    bs_write_ue(c->w, v);
+    return v;
+}
+
+static inline int32_t copy_se(sps_copy_t* c)
+{
+    int32_t v = bs_read_se(c->r);
+    bs_write_se(c->w, v);
+    return v;
+}
+
+//7.3.2.1.1.1 Scaling list syntax
+static void copy_scaling_list(sps_copy_t* c, int size)
+{
+    int last_scale = 8;
+    int next_scale = 8;
+    for( int j = 0; j < size; j++ )
+    {
+        if( next_scale != 0 )
+        {
+            int delta_scale = copy_se(c);
+            next_scale = ( last_scale + delta_scale + 256 ) % 256;
+        }
+        last_scale = ( next_scale == 0 ) ? last_scale : next_scale;
+    }
+}
+
+//E.1.2 HRD parameters syntax
+static void copy_hrd_parameters(sps_copy_t* c)
+{
+    int cpb_cnt_minus1 = copy_ue(c);
+    copy_u(c, 4); // bit_rate_scale
+    copy_u(c, 4); // cpb_size_scale
+    for( int i = 0; i <= cpb_cnt_minus1 && i < 32; i++ )
+    {
+        copy_ue(c); // bit_rate_value_minus1
+        copy_ue(c); // cpb_size_value_minus1
+        copy_u(c, 1); // cbr_flag
+    }
+    copy_u(c, 5); // initial_cpb_removal_delay_length_minus1
+    copy_u(c, 5); // cpb_removal_delay_length_minus1
+    copy_u(c, 5); // dpb_output_delay_length_minus1
+    copy_u(c, 5); // time_offset_length
+}
+
+static void write_bitstream_restriction(bs_t* w, int motion_vectors_over_pic_boundaries_flag,
+                                        int max_bytes_per_pic_denom, int max_bits_per_mb_denom,
+                                        int log2_max_mv_length_horizontal, int log2_max_mv_length_vertical,
+                                        int max_num_reorder_frames, int max_dec_frame_buffering)
+{
+    bs_write_u1(w, 1); // bitstream_restriction_flag
+    bs_write_u1(w, motion_vectors_over_pic_boundaries_flag);
+    bs_write_ue(w, max_bytes_per_pic_denom);
+    bs_write_ue(w, max_bits_per_mb_denom);
+    bs_write_ue(w, log2_max_mv_length_horizontal);
+    bs_write_ue(w, log2_max_mv_length_vertical);
+    bs_write_ue(w, max_num_reorder_frames);
+    bs_write_ue(w, max_dec_frame_buffering);
+}
+
+int patch_sps_max_dec_frame_buffering(const uint8_t* sps, int sps_size, uint8_t* out, int out_size,
+                                      int max_dec_frame_buffering)
+{
+    uint8_t rbsp[H264_SPS_PATCH_MAX_SIZE];
+    uint8_t patched_rbsp[H264_SPS_PATCH_MAX_SIZE + H264_SPS_PATCH_MAX_GROWTH];
+    int nal_size = sps_size - 1;
+    int rbsp_size = sizeof(rbsp);
+    bs_t r, w;
+    sps_copy_t c = { &r, &w };
+
+    if( sps_size < 2 || sps_size > H264_SPS_PATCH_MAX_SIZE || (sps[0] & 0x1F) != NAL_UNIT_TYPE_SPS )
+    {
+        return -1;
+    }
+    if( nal_to_rbsp(sps + 1, &nal_size, rbsp, &rbsp_size) < 0 )
+    {
+        return -1;
+    }
+    bs_init(&r, rbsp, rbsp_size);
+    bs_init(&w, patched_rbsp, sizeof(patched_rbsp));
+
+    //7.3.2.1 Sequence parameter set RBSP syntax
+    int profile_idc = copy_u(&c, 8);
+    copy_u(&c, 8); // constraint_set flags and reserved_zero_2bits
+    copy_u(&c, 8); // level_idc
+    copy_ue(&c); // seq_parameter_set_id
+    if( profile_idc == 100 || profile_idc == 110 ||
+        profile_idc == 122 || profile_idc == 244 ||
+        profile_idc == 44 || profile_idc == 83 ||
+        profile_idc == 86 || profile_idc == 118 ||
+        profile_idc == 128 || profile_idc == 138 ||
+        profile_idc == 139 || profile_idc == 134 ||
+        profile_idc == 135
+       )
+    {
+        int chroma_format_idc = copy_ue(&c);
+        if( chroma_format_idc == 3 )
+        {
+            copy_u(&c, 1); // separate_colour_plane_flag
+        }
+        copy_ue(&c); // bit_depth_luma_minus8
+        copy_ue(&c); // bit_depth_chroma_minus8
+        copy_u(&c, 1); // qpprime_y_zero_transform_bypass_flag
+        if( copy_u(&c, 1) ) // seq_scaling_matrix_present_flag
+        {
+            for( int i = 0; i < ((chroma_format_idc != 3) ? 8 : 12); i++ )
+            {
+                if( copy_u(&c, 1) ) // seq_scaling_list_present_flag
+                {
+                    copy_scaling_list(&c, i < 6 ? 16 : 64);
+                }
+            }
+        }
+    }
+    copy_ue(&c); // log2_max_frame_num_minus4
+    int pic_order_cnt_type = copy_ue(&c);
+    if( pic_order_cnt_type == 0 )
+    {
+        copy_ue(&c); // log2_max_pic_order_cnt_lsb_minus4
+    }
+    else if( pic_order_cnt_type == 1 )
+    {
+        copy_u(&c, 1); // delta_pic_order_always_zero_flag
+        copy_se(&c); // offset_for_non_ref_pic
+        copy_se(&c); // offset_for_top_to_bottom_field
+        int num_ref_frames_in_pic_order_cnt_cycle = copy_ue(&c);
+        for( int i = 0; i < num_ref_frames_in_pic_order_cnt_cycle && i < 256; i++ )
+        {
+            copy_se(&c); // offset_for_ref_frame
+        }
+    }
+    int max_num_ref_frames = copy_ue(&c);
+    copy_u(&c, 1); // gaps_in_frame_num_value_allowed_flag
+    copy_ue(&c); // pic_width_in_mbs_minus1
+    copy_ue(&c); // pic_height_in_map_units_minus1
+    if( !copy_u(&c, 1) ) // frame_mbs_only_flag
+    {
+        copy_u(&c, 1); // mb_adaptive_frame_field_flag
+    }
+    copy_u(&c, 1); // direct_8x8_inference_flag
+    if( copy_u(&c, 1) ) // frame_cropping_flag
+    {
+        copy_ue(&c); // frame_crop_left_offset
+        copy_ue(&c); // frame_crop_right_offset
+        copy_ue(&c); // frame_crop_top_offset
+        copy_ue(&c); // frame_crop_bottom_offset
+    }
+
+    // The DPB has to hold every reference frame, a smaller value would make the stream non-conforming
+    if( max_dec_frame_buffering < max_num_ref_frames )
+    {
+        max_dec_frame_buffering = max_num_ref_frames;
+    }
+
+    if( !bs_read_u1(&r) ) // vui_parameters_present_flag
+    {
+        bs_write_u1(&w, 1);
+        bs_write_u1(&w, 0); // aspect_ratio_info_present_flag
+        bs_write_u1(&w, 0); // overscan_info_present_flag
+        bs_write_u1(&w, 0); // video_signal_type_present_flag
+        bs_write_u1(&w, 0); // chroma_loc_info_present_flag
+        bs_write_u1(&w, 0); // timing_info_present_flag
+        bs_write_u1(&w, 0); // nal_hrd_parameters_present_flag
+        bs_write_u1(&w, 0); // vcl_hrd_parameters_present_flag
+        bs_write_u1(&w, 0); // pic_struct_present_flag
+        // Inferred values of an absent bitstream restriction (E.2.1), only reordering is disabled
+        write_bitstream_restriction(&w, 1, 2, 1, 16, 16, 0, max_dec_frame_buffering);
+    }
+    else
+    {
+        //E.1.1 VUI parameters syntax
+        bs_write_u1(&w, 1);
+        if( copy_u(&c, 1) ) // aspect_ratio_info_present_flag
+        {
+            if( copy_u(&c, 8) == 255 ) // aspect_ratio_idc == Extended_SAR
+            {
+                copy_u(&c, 16); // sar_width
+                copy_u(&c, 16); // sar_height
+            }
+        }
+        if( copy_u(&c, 1) ) // overscan_info_present_flag
+        {
+            copy_u(&c, 1); // overscan_appropriate_flag
+        }
+        if( copy_u(&c, 1) ) // video_signal_type_present_flag
+        {
+            copy_u(&c, 3); // video_format
+            copy_u(&c, 1); // video_full_range_flag
+            if( copy_u(&c, 1) ) // colour_description_present_flag
+            {
+                copy_u(&c, 8); // colour_primaries
+                copy_u(&c, 8); // transfer_characteristics
+                copy_u(&c, 8); // matrix_coefficients
+            }
+        }
+        if( copy_u(&c, 1) ) // chroma_loc_info_present_flag
+        {
+            copy_ue(&c); // chroma_sample_loc_type_top_field
+            copy_ue(&c); // chroma_sample_loc_type_bottom_field
+        }
+        if( copy_u(&c, 1) ) // timing_info_present_flag
+        {
+            copy_u(&c, 32); // num_units_in_tick
+            copy_u(&c, 32); // time_scale
+            copy_u(&c, 1); // fixed_frame_rate_flag
+        }
+        int nal_hrd_parameters_present_flag = copy_u(&c, 1);
+        if( nal_hrd_parameters_present_flag )
+        {
+            copy_hrd_parameters(&c);
+        }
+        int vcl_hrd_parameters_present_flag = copy_u(&c, 1);
+        if( vcl_hrd_parameters_present_flag )
+        {
+            copy_hrd_parameters(&c);
+        }
+        if( nal_hrd_parameters_present_flag || vcl_hrd_parameters_present_flag )
+        {
+            copy_u(&c, 1); // low_delay_hrd_flag
+        }
+        copy_u(&c, 1); // pic_struct_present_flag
+        if( bs_read_u1(&r) ) // bitstream_restriction_flag
+        {
+            int motion_vectors_over_pic_boundaries_flag = bs_read_u1(&r);
+            int max_bytes_per_pic_denom = bs_read_ue(&r);
+            int max_bits_per_mb_denom = bs_read_ue(&r);
+            int log2_max_mv_length_horizontal = bs_read_ue(&r);
+            int log2_max_mv_length_vertical = bs_read_ue(&r);
+            int max_num_reorder_frames = bs_read_ue(&r);
+            bs_read_ue(&r); // max_dec_frame_buffering
+            // Output order is a property of the stream, keep enough buffering for its reordering
+            if( max_dec_frame_buffering < max_num_reorder_frames )
+            {
+                max_dec_frame_buffering = max_num_reorder_frames;
+            }
+            write_bitstream_restriction(&w, motion_vectors_over_pic_boundaries_flag,
+                                        max_bytes_per_pic_denom, max_bits_per_mb_denom,
+                                        log2_max_mv_length_horizontal, log2_max_mv_length_vertical,
+                                        max_num_reorder_frames, max_dec_frame_buffering);
+        }
+        else
+        {
+            write_bitstream_restriction(&w, 1, 2, 1, 16, 16, 0, max_dec_frame_buffering);
+        }
+    }
+
+    //7.3.2.11 RBSP trailing bits syntax
+    bs_write_u1(&w, 1);
+    while( !bs_byte_aligned(&w) )
+    {
+        bs_write_u1(&w, 0);
+    }
+    if( bs_overrun(&r) || bs_overrun(&w) )
+    {
+        return -1;
+    }
+
+    int patched_rbsp_size = bs_pos(&w);
+    int patched_size = out_size;
+    if( rbsp_to_nal(patched_rbsp, &patched_rbsp_size, out, &patched_size) < 0 )
+    {
+        return -1;
+    }
+    out[0] = sps[0];
+    return patched_size;
+}
+
+const uint8_t* sps_patch_cache_get(sps_patch_cache_t* cache, const uint8_t* sps, int sps_size,
+                                   int max_dec_frame_buffering, int* patched_size)
+{
+    if( sps_size <= 0 || sps_size > H264_SPS_PATCH_MAX_SIZE )
+    {
+        return NULL;
+    }
+
+    for( int i = 0; i < H264_SPS_PATCH_CACHE_SIZE; i++ )
+    {
+        sps_patch_cache_entry_t* entry = &cache->entries[i];
+        if( entry->sps_size == sps_size && entry->max_dec_frame_buffering == max_dec_frame_buffering &&
+            memcmp(entry->sps, sps, sps_size) == 0 )
+        {
+            *patched_size = entry->patched_size;
+            return entry->patched;
+        }
+    }
+
+    sps_patch_cache_entry_t* entry = &cache->entries[cache->next];
+    int size = patch_sps_max_dec_frame_buffering(sps, sps_size, entry->patched, sizeof(entry->patched),
+                                                 max_dec_frame_buffering);
+    if( size < 0 )
+    {
+        entry->sps_size = 0;
+        return NULL;
+    }
+    memcpy(entry->sps, sps, sps_size);
+    entry->sps_size = sps_size;
+    entry->patched_size = size;
+    entry->max_dec_frame_buffering = max_dec_frame_buffering;
+    cache->next = (cache->next + 1) % H264_SPS_PATCH_CACHE_SIZE;
+
+    *patched_size = size;
+    return entry->patched;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef _H264_SPS_PATCH_H
+#define _H264_SPS_PATCH_H        1
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Largest SPS NAL unit (header included) the patcher accepts
+#define H264_SPS_PATCH_MAX_SIZE 512
+// Upper bound of bytes the patched SPS can grow by, a minimal VUI plus emulation prevention
+#define H264_SPS_PATCH_MAX_GROWTH 16
+// Distinct SPS remembered by a cache, enough for both orientations of a stream
+#define H264_SPS_PATCH_CACHE_SIZE 4
+
+/**
+   Rewrites a single SPS NAL unit (NAL header included, no start code) so that its VUI carries
+   bitstream_restriction_flag = 1 and the given max_dec_frame_buffering. All other fields of the
+   original SPS are kept, a missing VUI is added with nothing but the bitstream restriction.
+   Works entirely on the stack, the result is written to out.
+   @return size of the patched SPS in out, or -1 if the SPS could not be parsed or out is too small
+*/
+int patch_sps_max_dec_frame_buffering(const uint8_t* sps, int sps_size, uint8_t* out, int out_size,
+                                      int max_dec_frame_buffering);
+
+typedef struct
+{
+    int sps_size;
+    int patched_size;
+    int max_dec_frame_buffering;
+    uint8_t sps[H264_SPS_PATCH_MAX_SIZE];
+    uint8_t patched[H264_SPS_PATCH_MAX_SIZE + H264_SPS_PATCH_MAX_GROWTH];
+} sps_patch_cache_entry_t;
+
+/**
+   Patched SPS keyed by the bytes of the original one, so the bitstream is only rewritten
+   the first time a stream geometry shows up. Zero initialise before use.
+*/
+typedef struct
+{
+    int next;
+    sps_patch_cache_entry_t entries[H264_SPS_PATCH_CACHE_SIZE];
+} sps_patch_cache_t;
+
+/**
+   Looks up the patched version of sps, patching and caching it on a miss.
+   @return pointer to the patched SPS owned by the cache, or NULL if it could not be patched
+*/
+const uint8_t* sps_patch_cache_get(sps_patch_cache_t* cache, const uint8_t* sps, int sps_size,
+                                   int max_dec_frame_buffering, int* patched_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
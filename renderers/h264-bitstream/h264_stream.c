@@ -163,13 +163,21 @@ int read_nal_unit(h264_stream_t* h, uint8_t* buf, int size)
 
     int nal_size = size;
     int rbsp_size = size;
-    uint8_t* rbsp_buf = (uint8_t*)calloc(1, rbsp_size);
+    // A stream that is kept around reads its NAL units without allocating
+    if (h->rbsp_scratch_size < rbsp_size)
+    {
+        uint8_t* scratch = (uint8_t*)realloc(h->rbsp_scratch, rbsp_size);
+        if (scratch == NULL) { return -1; }
+        h->rbsp_scratch = scratch;
+        h->rbsp_scratch_size = rbsp_size;
+    }
+    uint8_t* rbsp_buf = h->rbsp_scratch;
 
     if( 1 )
     {
         int rc = nal_to_rbsp(buf, &nal_size, rbsp_buf, &rbsp_size);
 
-        if (rc < 0) { free(rbsp_buf); return -1; } // handle conversion error
+        if (rc < 0) { return -1; } // handle conversion error
     }
 
     if( 0 )
@@ -177,7 +185,8 @@ int read_nal_unit(h264_stream_t* h, uint8_t* buf, int size)
         rbsp_size = size*3/4; // NOTE this may have to be slightly smaller (3/4 smaller, worst case) in order to be guaranteed to fit
     }
 
-    bs_t* b = bs_new(rbsp_buf, rbsp_size);
+    bs_t bs;
+    bs_t* b = bs_init(&bs, rbsp_buf, rbsp_size);
     /* forbidden_zero_bit */ bs_skip_u(b, 1);
     nal->nal_ref_idc = bs_read_u(b, 2);
     nal->nal_unit_type = bs_read_u(b, 5);
@@ -279,12 +288,10 @@ int read_nal_unit(h264_stream_t* h, uint8_t* buf, int size)
         case NAL_UNIT_TYPE_CODED_SLICE_DATA_PARTITION_B: 
         case NAL_UNIT_TYPE_CODED_SLICE_DATA_PARTITION_C:
         default:
-            bs_free(b);
-            free(rbsp_buf);
             return -1;
     }
 
-    if (bs_overrun(b)) { bs_free(b); free(rbsp_buf); return -1; }
+    if (bs_overrun(b)) { return -1; }
 
     if( 0 )
     {
@@ -292,12 +299,9 @@ int read_nal_unit(h264_stream_t* h, uint8_t* buf, int size)
         rbsp_size = bs_pos(b);
 
         int rc = rbsp_to_nal(rbsp_buf, &rbsp_size, buf, &nal_size);
-        if (rc < 0) { bs_free(b); free(rbsp_buf); return -1; }
+        if (rc < 0) { return -1; }
     }
 
-    bs_free(b);
-    free(rbsp_buf);
-
     return nal_size;
 }
 
@@ -890,11 +894,17 @@ void read_slice_layer_rbsp(h264_stream_t* h,  bs_t* b)
 
     if ( slice_data != NULL )
     {
-        if ( slice_data->rbsp_buf != NULL ) free( slice_data->rbsp_buf ); 
         uint8_t *sptr = b->p + (!!b->bits_left); // CABAC-specific: skip alignment bits, if there are any
         slice_data->rbsp_size = b->end - sptr;
         
-        slice_data->rbsp_buf = (uint8_t*)malloc(slice_data->rbsp_size);
+        // The buffer is reused for the next slice, so only larger slices allocate
+        if ( slice_data->rbsp_capacity < slice_data->rbsp_size )
+        {
+            free( slice_data->rbsp_buf );
+            slice_data->rbsp_buf = (uint8_t*)malloc(slice_data->rbsp_size);
+            slice_data->rbsp_capacity = slice_data->rbsp_buf ? slice_data->rbsp_size : 0;
+            if ( slice_data->rbsp_buf == NULL ) { slice_data->rbsp_size = 0; return; }
+        }
         memcpy( slice_data->rbsp_buf, sptr, slice_data->rbsp_size );
         // ugly hack: since next NALU starts at byte border, we are going to be padded by trailing_bits;
         return;
@@ -2219,11 +2229,17 @@ void write_slice_layer_rbsp(h264_stream_t* h,  bs_t* b)
 
     if ( slice_data != NULL )
     {
-        if ( slice_data->rbsp_buf != NULL ) free( slice_data->rbsp_buf ); 
         uint8_t *sptr = b->p + (!!b->bits_left); // CABAC-specific: skip alignment bits, if there are any
         slice_data->rbsp_size = b->end - sptr;
         
-        slice_data->rbsp_buf = (uint8_t*)malloc(slice_data->rbsp_size);
+        // The buffer is reused for the next slice, so only larger slices allocate
+        if ( slice_data->rbsp_capacity < slice_data->rbsp_size )
+        {
+            free( slice_data->rbsp_buf );
+            slice_data->rbsp_buf = (uint8_t*)malloc(slice_data->rbsp_size);
+            slice_data->rbsp_capacity = slice_data->rbsp_buf ? slice_data->rbsp_size : 0;
+            if ( slice_data->rbsp_buf == NULL ) { slice_data->rbsp_size = 0; return; }
+        }
         memcpy( slice_data->rbsp_buf, sptr, slice_data->rbsp_size );
         // ugly hack: since next NALU starts at byte border, we are going to be padded by trailing_bits;
         return;
@@ -496,6 +496,7 @@ typedef struct
 {
     int rbsp_size;
     uint8_t* rbsp_buf;
+    int rbsp_capacity; // allocated size of rbsp_buf, which only grows
 } slice_data_rbsp_t;
 
 /**
@@ -524,9 +525,14 @@ typedef struct
     pps_t* pps_table[256];
     sei_t** seis;
 
+    // RBSP of the NAL unit read_nal_unit is reading, kept between calls and only ever grown
+    uint8_t* rbsp_scratch;
+    int rbsp_scratch_size;
+
 } h264_stream_t;
 
 h264_stream_t* h264_new();
+void h264_reset(h264_stream_t* h);
 void h264_free(h264_stream_t* h);
 
 int find_nal_unit(uint8_t* buf, int size, int* nal_start, int* nal_end);
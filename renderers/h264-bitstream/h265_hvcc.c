@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#include <stdint.h>
+
+#include "h265_hvcc.h"
+#include "h264_avcc.h"
+
+static void hvcc_classify_nal(const uint8_t* buf, h264_nal_index_entry_t* nal)
+{
+  int type = (buf[nal->offset] >> 1) & 0x3f;
+  nal->nal_unit_type = type;
+  nal->nal_ref_idc = (type < H265_NAL_TYPE_BLA_W_LP && !(type & 1)) ? 0 : 1;
+}
+
+int read_hvcc_parameter_sets(const uint8_t* buf, int size, h264_nal_index_t* sets)
+{
+  sets->count = 0;
+  if (size < HVCC_HEADER_SIZE) { return -1; }
+  // lengthSizeMinusOne
+  if ((buf[21] & 0x03) != 3) { return -1; }
+
+  int arrays = buf[22];
+  int pos = HVCC_HEADER_SIZE;
+  for (int i = 0; i < arrays; i++)
+  {
+    if (size - pos < 3) { return -1; }
+    int nalus = (buf[pos + 1] << 8) | buf[pos + 2];
+    pos += 3;
+    for (int j = 0; j < nalus; j++)
+    {
+      if (size - pos < 2) { return -1; }
+      int len = (buf[pos] << 8) | buf[pos + 1];
+      pos += 2;
+      if (len == 0 || len > size - pos) { return -1; }
+      if (sets->count == H264_NAL_INDEX_MAX) { return -1; }
+
+      h264_nal_index_entry_t* nal = &sets->nals[sets->count++];
+      nal->offset = pos;
+      nal->size = len;
+      hvcc_classify_nal(buf, nal);
+      pos += len;
+    }
+  }
+  return sets->count;
+}
+
+int hvcc_to_annexb(uint8_t* buf, int size, h264_nal_index_t* index)
+{
+  int pos = 0;
+  index->count = 0;
+
+  if (hvcc_to_annexb_partial(buf, size, size, &pos, index) != 1) { return -1; }
+  return index->count;
+}
+
+int hvcc_to_annexb_partial(uint8_t* buf, int size, int available, int* next, h264_nal_index_t* index)
+{
+  // Same length prefixes as H.264, only the NAL unit header differs
+  int first = index->count;
+  int ret = avcc_to_annexb_partial(buf, size, available, next, index);
+  for (int i = first; i < index->count; i++)
+  {
+    hvcc_classify_nal(buf, &index->nals[i]);
+  }
+  return ret;
+}
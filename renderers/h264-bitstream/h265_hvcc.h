@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026 RPiPlay contributors, All Rights Reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ */
+
+#ifndef _H265_HVCC_H
+#define _H265_HVCC_H        1
+
+#include <stdint.h>
+
+#include "h264_nal_index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   H.265 nal_unit_type values, ITU-T H.265 Table 7-1. Types below 32 are VCL NAL units, and
+   those below 16 are sub-layer non-reference pictures when even.
+*/
+#define H265_NAL_TYPE_BLA_W_LP 16
+#define H265_NAL_TYPE_IDR_W_RADL 19
+#define H265_NAL_TYPE_IDR_N_LP 20
+#define H265_NAL_TYPE_CRA 21
+#define H265_NAL_TYPE_VPS 32
+#define H265_NAL_TYPE_SPS 33
+#define H265_NAL_TYPE_PPS 34
+
+// Size of the fixed part of an HEVC decoder configuration record, up to numOfArrays
+#define HVCC_HEADER_SIZE 23
+
+/**
+   Indexes the parameter sets of an HEVC decoder configuration record, ISO/IEC 14496-15 Section
+   8.3.3.1, the 'hvcC' box content. The entries point into buf, at the NAL units without any
+   prefix, in the order of the record, which lists VPS, SPS and PPS in that order. Only records
+   of 4 byte NAL unit lengths are accepted, the only ones hvcc_to_annexb can convert.
+   Returns the number of parameter sets, or -1 if the record is malformed.
+*/
+int read_hvcc_parameter_sets(const uint8_t* buf, int size, h264_nal_index_t* sets);
+
+/**
+   avcc_to_annexb for an H.265 access unit. The index holds H.265 NAL unit types, nal_ref_idc is
+   0 for sub-layer non-reference pictures and 1 for every other NAL unit.
+*/
+int hvcc_to_annexb(uint8_t* buf, int size, h264_nal_index_t* index);
+
+/**
+   avcc_to_annexb_partial for an H.265 access unit, the index as with hvcc_to_annexb
+*/
+int hvcc_to_annexb_partial(uint8_t* buf, int size, int available, int* next, h264_nal_index_t* index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * The renderers this build has, in order of preference, shared by rpiplay and rpiplay_replay.
+ * Which ones exist is decided by the HAS_*_RENDERER flags renderers/CMakeLists.txt sets.
+ */
+
+#ifndef RENDERER_LIST_H
+#define RENDERER_LIST_H
+
+#include <string.h>
+
+#include "video_renderer.h"
+#include "audio_renderer.h"
+
+typedef struct video_renderer_list_entry_s {
+    const char *name;
+    const char *description;
+    video_init_func_t init_func;
+} video_renderer_list_entry_t;
+
+typedef struct audio_renderer_list_entry_s {
+    const char *name;
+    const char *description;
+    audio_init_func_t init_func;
+} audio_renderer_list_entry_t;
+
+static const video_renderer_list_entry_t video_renderers[] = {
+#if defined(HAS_RPI_RENDERER)
+    {"rpi", "Raspberry Pi OpenMAX accelerated H.264 renderer", video_renderer_rpi_init},
+#endif
+#if defined(HAS_GSTREAMER_RENDERER)
+    {"gstreamer", "GStreamer H.264 renderer", video_renderer_gstreamer_init},
+#endif
+#if defined(HAS_V4L2_RENDERER)
+    {"v4l2", "V4L2 hardware H.264 decoder presenting through DRM/KMS", video_renderer_v4l2_init},
+#endif
+#if defined(HAS_FFMPEG_RENDERER)
+    {"ffmpeg", "libavcodec H.264 decoder with VAAPI, NVDEC or in software presenting through DRM/KMS", video_renderer_ffmpeg_init},
+#endif
+#if defined(HAS_DUMMY_RENDERER)
+    {"dummy", "Dummy renderer; does not actually display video", video_renderer_dummy_init},
+#endif
+};
+
+static const audio_renderer_list_entry_t audio_renderers[] = {
+#if defined(HAS_RPI_RENDERER)
+    {"rpi", "AAC renderer using fdk-aac for decoding and OpenMAX for rendering", audio_renderer_rpi_init},
+#endif
+#if defined(HAS_GSTREAMER_RENDERER)
+    {"gstreamer", "GStreamer audio renderer", audio_renderer_gstreamer_init},
+#endif
+#if defined(HAS_ALSA_RENDERER)
+    {"alsa", "AAC renderer using fdk-aac for decoding and ALSA for playback", audio_renderer_alsa_init},
+#endif
+#if defined(HAS_DUMMY_RENDERER)
+    {"dummy", "Dummy renderer; does not actually play audio", audio_renderer_dummy_init},
+#endif
+};
+
+static inline video_init_func_t find_video_init_func(const char *name) {
+    for (unsigned int i = 0; i < sizeof(video_renderers)/sizeof(video_renderers[0]); i++) {
+        if (!strcmp(name, video_renderers[i].name)) {
+            return video_renderers[i].init_func;
+        }
+    }
+    return NULL;
+}
+
+static inline audio_init_func_t find_audio_init_func(const char *name) {
+    for (unsigned int i = 0; i < sizeof(audio_renderers)/sizeof(audio_renderers[0]); i++) {
+        if (!strcmp(name, audio_renderers[i].name)) {
+            return audio_renderers[i].init_func;
+        }
+    }
+    return NULL;
+}
+
+#endif //RENDERER_LIST_H
@@ -0,0 +1,179 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Stands in for the init functions of the backends built as plugins, see renderer_plugin.h.
+ * A plugin is looked for in $RPIPLAY_PLUGIN_DIR, then in plugins/ next to the executable, where
+ * the build puts them, then in RENDERER_PLUGIN_DIR, where they are installed. Loaded plugins
+ * stay loaded, their renderers may leave threads behind.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include "renderer_plugin.h"
+
+#ifndef RENDERER_PLUGIN_DIR
+#define RENDERER_PLUGIN_DIR "/usr/local/lib/rpiplay"
+#endif
+
+#define RENDERER_PLUGIN_MAX 8
+
+typedef struct renderer_plugin_entry_s {
+    const char *name;
+    const renderer_plugin_t *plugin;
+} renderer_plugin_entry_t;
+
+static renderer_plugin_entry_t loaded[RENDERER_PLUGIN_MAX];
+static int loaded_count = 0;
+/* The lazily started video renderer is created off the main thread */
+static pthread_mutex_t loader_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *renderer_plugin_open(logger_t *logger, const char *dir, const char *name) {
+    char path[PATH_MAX];
+    void *handle;
+
+    snprintf(path, sizeof(path), "%s/" RENDERER_PLUGIN_FILE_PREFIX "%s" RENDERER_PLUGIN_FILE_SUFFIX, dir, name);
+    if (access(path, F_OK) != 0) {
+        return NULL;
+    }
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        logger_log(logger, LOGGER_ERR, "Could not load the renderer plugin %s: %s", path, dlerror());
+        return NULL;
+    }
+    logger_log(logger, LOGGER_DEBUG, "Loaded the renderer plugin %s", path);
+    return handle;
+}
+
+static void *renderer_plugin_find(logger_t *logger, const char *name) {
+    char dir[PATH_MAX];
+    const char *env = getenv("RPIPLAY_PLUGIN_DIR");
+    void *handle;
+
+    if (env && (handle = renderer_plugin_open(logger, env, name))) {
+        return handle;
+    }
+    ssize_t len = readlink("/proc/self/exe", dir, sizeof(dir) - sizeof("/plugins"));
+    if (len > 0) {
+        dir[len] = '\0';
+        char *slash = strrchr(dir, '/');
+        if (slash) {
+            strcpy(slash, "/plugins");
+            if ((handle = renderer_plugin_open(logger, dir, name))) {
+                return handle;
+            }
+        }
+    }
+    return renderer_plugin_open(logger, RENDERER_PLUGIN_DIR, name);
+}
+
+static const renderer_plugin_t *renderer_plugin_load(logger_t *logger, const char *name) {
+    static const renderer_plugin_t expected = { RENDERER_PLUGIN_ABI_VERSION, RENDERER_PLUGIN_SIZES };
+    const renderer_plugin_t *plugin = NULL;
+
+    pthread_mutex_lock(&loader_mutex);
+    for (int i = 0; i < loaded_count; i++) {
+        if (!strcmp(loaded[i].name, name)) {
+            plugin = loaded[i].plugin;
+            pthread_mutex_unlock(&loader_mutex);
+            return plugin;
+        }
+    }
+
+    void *handle = renderer_plugin_find(logger, name);
+    if (!handle) {
+        logger_log(logger, LOGGER_ERR, "The renderer plugin %s" RENDERER_PLUGIN_FILE_PREFIX "%s" RENDERER_PLUGIN_FILE_SUFFIX
+                   " is not installed, set RPIPLAY_PLUGIN_DIR to where it is", RENDERER_PLUGIN_DIR "/", name);
+    } else {
+        plugin = dlsym(handle, RENDERER_PLUGIN_SYMBOL);
+        if (!plugin || plugin->abi_version != expected.abi_version ||
+            plugin->video_config_size != expected.video_config_size ||
+            plugin->video_funcs_size != expected.video_funcs_size ||
+            plugin->video_renderer_size != expected.video_renderer_size ||
+            plugin->audio_config_size != expected.audio_config_size ||
+            plugin->audio_funcs_size != expected.audio_funcs_size ||
+            plugin->audio_renderer_size != expected.audio_renderer_size ||
+            plugin->transcoder_config_size != expected.transcoder_config_size ||
+            plugin->url_player_config_size != expected.url_player_config_size) {
+            logger_log(logger, LOGGER_ERR, "The renderer plugin %s was built for another version of rpiplay", name);
+            dlclose(handle);
+            plugin = NULL;
+        }
+    }
+    // Failures are not remembered, so the next attempt looks again
+    if (plugin && loaded_count < RENDERER_PLUGIN_MAX) {
+        loaded[loaded_count].name = name;
+        loaded[loaded_count].plugin = plugin;
+        loaded_count++;
+    }
+    pthread_mutex_unlock(&loader_mutex);
+    return plugin;
+}
+
+#define RENDERER_PLUGIN_VIDEO_STUB(backend) \
+video_renderer_t *video_renderer_##backend##_init(logger_t *logger, video_renderer_config_t const *config) { \
+    const renderer_plugin_t *plugin = renderer_plugin_load(logger, #backend); \
+    return plugin && plugin->video_init ? plugin->video_init(logger, config) : NULL; \
+}
+
+#define RENDERER_PLUGIN_AUDIO_STUB(backend) \
+audio_renderer_t *audio_renderer_##backend##_init(logger_t *logger, video_renderer_t *video_renderer, \
+                                                  audio_renderer_config_t const *config) { \
+    const renderer_plugin_t *plugin = renderer_plugin_load(logger, #backend); \
+    return plugin && plugin->audio_init ? plugin->audio_init(logger, video_renderer, config) : NULL; \
+}
+
+#define RENDERER_PLUGIN_TRANSCODER_STUB(backend) \
+video_transcoder_t *video_transcoder_##backend##_init(logger_t *logger, video_transcoder_config_t const *config, \
+                                                      video_transcoder_output_t output, void *cls) { \
+    const renderer_plugin_t *plugin = renderer_plugin_load(logger, #backend); \
+    return plugin && plugin->transcoder_init ? plugin->transcoder_init(logger, config, output, cls) : NULL; \
+}
+
+#define RENDERER_PLUGIN_URL_PLAYER_STUB(backend) \
+url_player_t *url_player_##backend##_init(logger_t *logger, url_player_config_t const *config) { \
+    const renderer_plugin_t *plugin = renderer_plugin_load(logger, #backend); \
+    return plugin && plugin->url_player_init ? plugin->url_player_init(logger, config) : NULL; \
+}
+
+#if defined(HAS_RPI_RENDERER)
+RENDERER_PLUGIN_VIDEO_STUB(rpi)
+RENDERER_PLUGIN_AUDIO_STUB(rpi)
+#endif
+#if defined(HAS_GSTREAMER_RENDERER)
+RENDERER_PLUGIN_VIDEO_STUB(gstreamer)
+RENDERER_PLUGIN_AUDIO_STUB(gstreamer)
+RENDERER_PLUGIN_TRANSCODER_STUB(gstreamer)
+RENDERER_PLUGIN_URL_PLAYER_STUB(gstreamer)
+#endif
+#if defined(HAS_V4L2_RENDERER)
+RENDERER_PLUGIN_VIDEO_STUB(v4l2)
+#endif
+#if defined(HAS_FFMPEG_RENDERER)
+RENDERER_PLUGIN_VIDEO_STUB(ffmpeg)
+#endif
+#if defined(HAS_ALSA_RENDERER)
+RENDERER_PLUGIN_AUDIO_STUB(alsa)
+#endif
@@ -0,0 +1,54 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * The descriptor of a renderer plugin, compiled into every plugin with RENDERER_PLUGIN_NAME and
+ * the init functions of its backend, RENDERER_PLUGIN_VIDEO, RENDERER_PLUGIN_AUDIO,
+ * RENDERER_PLUGIN_TRANSCODER and RENDERER_PLUGIN_URL_PLAYER, defined.
+ * Everything else in a plugin is hidden, so its init functions never bind to the executable's
+ * stubs of the same name.
+ */
+
+#include <stddef.h>
+
+#include "renderer_plugin.h"
+
+#ifndef RENDERER_PLUGIN_VIDEO
+#define RENDERER_PLUGIN_VIDEO NULL
+#endif
+#ifndef RENDERER_PLUGIN_AUDIO
+#define RENDERER_PLUGIN_AUDIO NULL
+#endif
+#ifndef RENDERER_PLUGIN_TRANSCODER
+#define RENDERER_PLUGIN_TRANSCODER NULL
+#endif
+#ifndef RENDERER_PLUGIN_URL_PLAYER
+#define RENDERER_PLUGIN_URL_PLAYER NULL
+#endif
+
+__attribute__((visibility("default")))
+const renderer_plugin_t rpiplay_renderer_plugin = {
+    RENDERER_PLUGIN_ABI_VERSION,
+    RENDERER_PLUGIN_SIZES,
+    RENDERER_PLUGIN_NAME,
+    RENDERER_PLUGIN_VIDEO,
+    RENDERER_PLUGIN_AUDIO,
+    RENDERER_PLUGIN_TRANSCODER,
+    RENDERER_PLUGIN_URL_PLAYER,
+};
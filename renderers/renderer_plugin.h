@@ -0,0 +1,76 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Renderer backends built as plugins, shared objects rpiplay loads once a backend is selected,
+ * so a process only maps the libraries of the backends it uses. Configure with
+ * -DRENDERER_PLUGINS=ON. Each plugin exports one renderer_plugin_t named
+ * RENDERER_PLUGIN_SYMBOL, and takes every other symbol it needs from the executable.
+ *
+ * With plugins, the *_init functions renderer_list.h lists come from renderer_loader.c: each
+ * one loads the plugin of its backend on the first call and forwards to it.
+ */
+
+#ifndef RENDERER_PLUGIN_H
+#define RENDERER_PLUGIN_H
+
+#include "video_renderer.h"
+#include "audio_renderer.h"
+#include "video_transcoder.h"
+#include "url_player.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Raised with every change to the renderer interfaces that the structure sizes do not reveal */
+#define RENDERER_PLUGIN_ABI_VERSION 3
+#define RENDERER_PLUGIN_SYMBOL "rpiplay_renderer_plugin"
+/* Plugin file name, for a backend name like "gstreamer" */
+#define RENDERER_PLUGIN_FILE_PREFIX "rpiplay_renderer_"
+#define RENDERER_PLUGIN_FILE_SUFFIX ".so"
+
+typedef struct renderer_plugin_s {
+    int abi_version;
+    /* The sizes the plugin was compiled with, a plugin built against other headers is refused */
+    unsigned int video_config_size;
+    unsigned int video_funcs_size;
+    unsigned int video_renderer_size;
+    unsigned int audio_config_size;
+    unsigned int audio_funcs_size;
+    unsigned int audio_renderer_size;
+    unsigned int transcoder_config_size;
+    unsigned int url_player_config_size;
+    const char *name;
+    video_init_func_t video_init; /* NULL for a backend without a video renderer */
+    audio_init_func_t audio_init; /* NULL for a backend without an audio renderer */
+    video_transcoder_init_func_t transcoder_init; /* NULL for a backend without a transcoder */
+    url_player_init_func_t url_player_init; /* NULL for a backend without a URL player */
+} renderer_plugin_t;
+
+#define RENDERER_PLUGIN_SIZES \
+    sizeof(video_renderer_config_t), sizeof(video_renderer_funcs_t), sizeof(video_renderer_t), \
+    sizeof(audio_renderer_config_t), sizeof(audio_renderer_funcs_t), sizeof(audio_renderer_t), \
+    sizeof(video_transcoder_config_t), sizeof(url_player_config_t)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //RENDERER_PLUGIN_H
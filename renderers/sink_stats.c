@@ -0,0 +1,165 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include "sink_stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void sink_stats_period_reset(sink_stats_period_t *period, uint64_t start) {
+    memset(period, 0, sizeof(*period));
+    period->start = start;
+}
+
+/* Length of the start code at pos, 0 if there is none */
+static int sink_stats_start_code(const unsigned char *data, int len, int pos) {
+    if (pos + 3 <= len && data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 1) {
+        return 3;
+    }
+    if (pos + 4 <= len && data[pos] == 0 && data[pos + 1] == 0 && data[pos + 2] == 0 && data[pos + 3] == 1) {
+        return 4;
+    }
+    return 0;
+}
+
+/**
+ * Whether data is a well formed Annex-B access unit: start codes all the way through, no empty
+ * NAL units or ones with the forbidden bit set, and every NAL unit where the index says it is
+ */
+static bool sink_stats_check_annexb(const unsigned char *data, int len, h264_nal_index_t const *nal_index) {
+    int pos = 0;
+    int count = 0;
+
+    while (pos < len) {
+        int start_code = sink_stats_start_code(data, len, pos);
+        if (!start_code) {
+            return false;
+        }
+        int begin = pos + start_code;
+        int end = begin;
+        // Emulation prevention keeps 00 00 01 out of the NAL units, so it always starts the next one
+        while (end + 3 <= len && !(data[end] == 0 && data[end + 1] == 0 && data[end + 2] == 1)) {
+            end++;
+        }
+        if (end + 3 > len) {
+            end = len;
+        } else if (end > begin && data[end - 1] == 0) {
+            end--; // Four byte start code
+        }
+        if (end <= begin || (data[begin] & 0x80)) {
+            return false;
+        }
+        if (nal_index && (count >= nal_index->count || nal_index->nals[count].offset != begin ||
+                          nal_index->nals[count].size != end - begin)) {
+            return false;
+        }
+        count++;
+        pos = end;
+    }
+    return count > 0 && (!nal_index || count == nal_index->count);
+}
+
+static void sink_stats_log(sink_stats_t *stats, const char *what, sink_stats_period_t const *period, uint64_t now) {
+    double seconds = now > period->start ? (now - period->start) / 1000000.0 : 0.0;
+    double rate = seconds > 0 ? period->frames / seconds : 0.0;
+    double bitrate = seconds > 0 ? period->bytes * 8 / seconds / 1000000.0 : 0.0;
+
+    if (!period->latency_count) {
+        logger_log(stats->logger, LOGGER_INFO, "%s %s: %llu frames in %.1f s, %.1f fps, %.2f Mbit/s, %llu lost, %llu malformed",
+                   stats->name, what, (unsigned long long) period->frames, seconds, rate, bitrate,
+                   (unsigned long long) period->lost, (unsigned long long) period->malformed);
+        return;
+    }
+    logger_log(stats->logger, LOGGER_INFO, "%s %s: %llu frames in %.1f s, %.1f fps, %.2f Mbit/s, %llu lost, %llu malformed, "
+               "latency %.1f/%.1f/%.1f ms min/avg/max, jitter %.2f ms (max %.2f)",
+               stats->name, what, (unsigned long long) period->frames, seconds, rate, bitrate,
+               (unsigned long long) period->lost, (unsigned long long) period->malformed,
+               period->latency_min / 1000.0, (double) period->latency_sum / period->latency_count / 1000.0,
+               period->latency_max / 1000.0, stats->jitter / 1000.0, period->jitter_max / 1000.0);
+}
+
+static void sink_stats_period_add(sink_stats_period_t *period, int data_len, bool lost, bool malformed,
+                                  bool has_latency, int64_t latency, int64_t jitter) {
+    period->frames++;
+    period->bytes += data_len;
+    period->lost += lost;
+    period->malformed += malformed;
+    if (has_latency) {
+        if (!period->latency_count || latency < period->latency_min) period->latency_min = latency;
+        if (!period->latency_count || latency > period->latency_max) period->latency_max = latency;
+        period->latency_sum += latency;
+        period->latency_count++;
+    }
+    if (jitter > period->jitter_max) {
+        period->jitter_max = jitter;
+    }
+}
+
+void sink_stats_init(sink_stats_t *stats, logger_t *logger, const char *name, int interval_seconds,
+                     bool check_annexb) {
+    memset(stats, 0, sizeof(*stats));
+    stats->logger = logger;
+    stats->name = name;
+    stats->interval = interval_seconds > 0 ? (uint64_t) interval_seconds * 1000000 : 0;
+    stats->check_annexb = check_annexb;
+}
+
+void sink_stats_add(sink_stats_t *stats, uint64_t now, const unsigned char *data, int data_len, uint64_t pts,
+                    h264_nal_index_t const *nal_index) {
+    if (!stats->total.start) {
+        sink_stats_period_reset(&stats->total, now);
+        sink_stats_period_reset(&stats->period, now);
+    } else if (stats->interval && now - stats->period.start >= stats->interval) {
+        sink_stats_log(stats, "last period", &stats->period, now);
+        sink_stats_period_reset(&stats->period, now);
+    }
+
+    bool lost = !data;
+    bool malformed = data && stats->check_annexb && !sink_stats_check_annexb(data, data_len, nal_index);
+    bool has_latency = pts != 0;
+    int64_t latency = (int64_t) now - (int64_t) pts;
+    if (has_latency && stats->last_pts) {
+        int64_t d = ((int64_t) now - (int64_t) stats->last_arrival) - ((int64_t) pts - (int64_t) stats->last_pts);
+        stats->jitter += (llabs(d) - stats->jitter) / 16.0;
+    }
+    if (has_latency) {
+        stats->last_arrival = now;
+        stats->last_pts = pts;
+    }
+    if (malformed) {
+        logger_log(stats->logger, LOGGER_WARNING, "%s got a frame of %d bytes that is no well formed Annex-B",
+                   stats->name, data_len);
+    }
+
+    sink_stats_period_add(&stats->period, data ? data_len : 0, lost, malformed, has_latency, latency,
+                          (int64_t) stats->jitter);
+    sink_stats_period_add(&stats->total, data ? data_len : 0, lost, malformed, has_latency, latency,
+                          (int64_t) stats->jitter);
+}
+
+void sink_stats_flush(sink_stats_t *stats) {
+    stats->last_arrival = 0;
+    stats->last_pts = 0;
+}
+
+void sink_stats_finish(sink_stats_t *stats, uint64_t now) {
+    if (stats->total.start) {
+        sink_stats_log(stats, "total", &stats->total, now);
+    }
+}
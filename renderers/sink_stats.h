@@ -0,0 +1,74 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * What the dummy renderers measure with -bench, so a receiver without a display or audio
+ * output still tells how fast and how evenly frames make it through the network and the
+ * pipeline, e.g. fed by rpiplay_loadgen. Not thread safe, each renderer feeds its own.
+ */
+
+#ifndef SINK_STATS_H
+#define SINK_STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../lib/logger.h"
+#include "h264-bitstream/h264_nal_index.h"
+
+typedef struct sink_stats_period_s {
+    uint64_t start; // raop_ntp_get_local_time the period began at
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t lost; // Frames handed over as lost, audio only
+    uint64_t malformed; // Frames that failed the Annex-B check
+    int64_t latency_min; // Micro seconds from a frame's pts to its arrival, negative while early
+    int64_t latency_max;
+    int64_t latency_sum;
+    uint64_t latency_count; // Frames with a pts
+    int64_t jitter_max;
+} sink_stats_period_t;
+
+typedef struct sink_stats_s {
+    logger_t *logger;
+    const char *name;
+    uint64_t interval; // Micro seconds between summaries, 0 only logs the total at the end
+    bool check_annexb;
+
+    // Arrival and pts of the previous frame, 0 after a flush
+    uint64_t last_arrival;
+    uint64_t last_pts;
+    // RFC 3550 interarrival jitter in micro seconds: how much the gaps between arrivals differ
+    // from the gaps between the pts, smoothed over 16 frames
+    double jitter;
+
+    sink_stats_period_t period;
+    sink_stats_period_t total;
+} sink_stats_t;
+
+void sink_stats_init(sink_stats_t *stats, logger_t *logger, const char *name, int interval_seconds,
+                     bool check_annexb);
+/* data NULL counts a lost frame, nal_index may be NULL and is then found by scanning */
+void sink_stats_add(sink_stats_t *stats, uint64_t now, const unsigned char *data, int data_len, uint64_t pts,
+                    h264_nal_index_t const *nal_index);
+/* Forgets the previous frame, so the gap to the next one does not count as jitter */
+void sink_stats_flush(sink_stats_t *stats);
+/* Logs the summary of everything since init, once the renderer is done */
+void sink_stats_finish(sink_stats_t *stats, uint64_t now);
+
+#endif //SINK_STATS_H
@@ -0,0 +1,79 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Plays the movies senders cast by URL (AirPlay video, POST /play), fetching the HLS playlist
+ * or MP4 file itself and decoding it in hardware where it can, instead of the sender decoding
+ * and encoding it again for the mirror. Every function may be called from any thread.
+ */
+
+#ifndef URL_PLAYER_H
+#define URL_PLAYER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include "../lib/logger.h"
+
+typedef struct url_player_config_s {
+    const char *video_sink; // GStreamer video sink element, NULL lets playbin pick one
+    const char *video_decoders; // Comma separated decoders to prefer in order, NULL uses the built-in list
+} url_player_config_t;
+
+typedef struct url_player_state_s {
+    double duration; // Seconds, 0 while unknown, like for a live stream
+    double position; // Seconds
+    double rate; // 0 while paused, 1 while playing
+    bool ready; // The movie is loaded and the position may be changed
+} url_player_state_t;
+
+typedef struct url_player_s url_player_t;
+
+typedef struct url_player_funcs_s {
+    /**
+     * Replaces whatever plays with the movie at url, returns once it is loaded and playing or
+     * false if it cannot be played. It starts at start_seconds if that is positive, otherwise
+     * at start_fraction of its duration.
+     */
+    bool (*play)(url_player_t *player, const char *url, double start_seconds, double start_fraction);
+    void (*seek)(url_player_t *player, double position);
+    /* 0 pauses, anything else plays on at the normal rate */
+    void (*set_rate)(url_player_t *player, double rate);
+    void (*stop)(url_player_t *player);
+    /* Fills in state and returns true while a movie is loaded or loading, false once it stopped or failed */
+    bool (*get_state)(url_player_t *player, url_player_state_t *state);
+    void (*destroy)(url_player_t *player);
+} url_player_funcs_t;
+
+typedef struct url_player_s {
+    url_player_funcs_t const *funcs;
+    logger_t *logger;
+} url_player_t;
+
+typedef url_player_t *(*url_player_init_func_t)(logger_t *logger, url_player_config_t const *config);
+
+url_player_t *url_player_gstreamer_init(logger_t *logger, url_player_config_t const *config);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //URL_PLAYER_H
@@ -0,0 +1,307 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Playing cast movies with playbin, which brings the HTTP source, the HLS demuxer and the
+ * decoders. decodebin picks decoders by their rank, so the hardware decoders the video renderer
+ * would use are ranked above everything else once, and the software ones are what is left when
+ * none of them takes the stream.
+ *
+ * A movie is loaded by pausing a new playbin and waiting for it to preroll, which fetches the
+ * playlist and the first segment, then seeking to the start position and playing it.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <gst/gst.h>
+
+#include "url_player.h"
+#include "gstreamer_registry.h"
+
+/* How long loading a movie may take until the first picture is decoded */
+#define URL_PLAYER_LOAD_TIMEOUT (15 * GST_SECOND)
+
+typedef struct url_player_gstreamer_s {
+    url_player_t base;
+    char *video_sink;
+
+    GMutex mutex;
+    GstElement *playbin; // NULL while nothing is loaded
+    double rate;
+    bool ready;
+    bool finished; // The movie ended or failed, playbin waits to be stopped
+} url_player_gstreamer_t;
+
+static const url_player_funcs_t url_player_gstreamer_funcs;
+
+/* Ranks the decoders above any other, in the order they are listed */
+static void url_player_gstreamer_prefer_decoders(const char *decoders) {
+    gchar **names = g_strsplit(decoders, ",", -1);
+    int count = g_strv_length(names);
+    for (int i = 0; i < count; i++) {
+        GstElementFactory *factory = gst_element_factory_find(g_strstrip(names[i]));
+        if (factory) {
+            gst_plugin_feature_set_rank(GST_PLUGIN_FEATURE(factory), GST_RANK_PRIMARY + count - i);
+            gst_object_unref(factory);
+        }
+    }
+    g_strfreev(names);
+}
+
+/* From a streaming thread, the movie is left as it is until the sender stops it */
+static void url_player_gstreamer_bus_message(GstBus *bus, GstMessage *message, gpointer data) {
+    url_player_gstreamer_t *p = data;
+    g_mutex_lock(&p->mutex);
+    // Messages of a playbin that was replaced in the meantime are of no interest
+    bool current = p->playbin && gst_object_has_as_ancestor(GST_MESSAGE_SRC(message), GST_OBJECT(p->playbin));
+    if (current) {
+        p->finished = true;
+        p->rate = 0;
+    }
+    g_mutex_unlock(&p->mutex);
+    if (!current) {
+        return;
+    }
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+        GError *error = NULL;
+        gst_message_parse_error(message, &error, NULL);
+        logger_log(p->base.logger, LOGGER_ERR, "Playback error from %s: %s", GST_OBJECT_NAME(message->src),
+                   error->message);
+        g_error_free(error);
+    } else {
+        logger_log(p->base.logger, LOGGER_INFO, "Playback reached the end of the movie");
+    }
+}
+
+url_player_t *url_player_gstreamer_init(logger_t *logger, url_player_config_t const *config) {
+    url_player_gstreamer_t *player;
+
+    gstreamer_registry_wait();
+
+    GstElementFactory *playbin = gst_element_factory_find("playbin");
+    if (!playbin) {
+        logger_log(logger, LOGGER_ERR, "GStreamer playbin not found, cast movies cannot be played");
+        return NULL;
+    }
+    gst_object_unref(playbin);
+
+    if (config->video_sink) {
+        GstElementFactory *factory = gst_element_factory_find(config->video_sink);
+        if (!factory) {
+            logger_log(logger, LOGGER_ERR, "GStreamer video sink %s not found", config->video_sink);
+            return NULL;
+        }
+        gst_object_unref(factory);
+    }
+
+    if (config->video_decoders) {
+        url_player_gstreamer_prefer_decoders(config->video_decoders);
+    } else {
+        url_player_gstreamer_prefer_decoders(GSTREAMER_H264_DECODERS);
+        url_player_gstreamer_prefer_decoders(GSTREAMER_H265_DECODERS);
+    }
+
+    player = calloc(1, sizeof(url_player_gstreamer_t));
+    assert(player);
+    player->base.funcs = &url_player_gstreamer_funcs;
+    player->base.logger = logger;
+    player->video_sink = config->video_sink ? strdup(config->video_sink) : NULL;
+    g_mutex_init(&player->mutex);
+    return &player->base;
+}
+
+/* Takes the playbin out of the player, for the caller to shut down outside the mutex */
+static GstElement *url_player_gstreamer_detach(url_player_gstreamer_t *p) {
+    GstElement *playbin = p->playbin;
+    p->playbin = NULL;
+    p->ready = false;
+    p->finished = false;
+    p->rate = 0;
+    return playbin;
+}
+
+static void url_player_gstreamer_shutdown(GstElement *playbin) {
+    if (playbin) {
+        gst_element_set_state(playbin, GST_STATE_NULL);
+        gst_object_unref(playbin);
+    }
+}
+
+static bool url_player_gstreamer_play(url_player_t *player, const char *url, double start_seconds,
+                                      double start_fraction) {
+    url_player_gstreamer_t *p = (url_player_gstreamer_t *)player;
+
+    gchar *protocol = gst_uri_get_protocol(url);
+    if (!protocol || !gst_uri_protocol_is_supported(GST_URI_SRC, protocol)) {
+        logger_log(player->logger, LOGGER_ERR, "Cannot play %s, no GStreamer source for its protocol", url);
+        g_free(protocol);
+        return false;
+    }
+    g_free(protocol);
+
+    GstElement *playbin = gst_element_factory_make("playbin", "url_player");
+    if (!playbin) {
+        logger_log(player->logger, LOGGER_ERR, "Could not create a GStreamer playbin");
+        return false;
+    }
+    g_object_set(playbin, "uri", url, NULL);
+    if (p->video_sink) {
+        // A sink of its own for every movie, a sink cannot move from one playbin to the next
+        g_object_set(playbin, "video-sink", gst_element_factory_make(p->video_sink, NULL), NULL);
+    }
+    GstBus *bus = gst_element_get_bus(playbin);
+    gst_bus_enable_sync_message_emission(bus);
+    g_signal_connect(bus, "sync-message::error", G_CALLBACK(url_player_gstreamer_bus_message), p);
+    g_signal_connect(bus, "sync-message::eos", G_CALLBACK(url_player_gstreamer_bus_message), p);
+    gst_object_unref(bus);
+
+    g_mutex_lock(&p->mutex);
+    GstElement *previous = url_player_gstreamer_detach(p);
+    p->playbin = gst_object_ref(playbin);
+    g_mutex_unlock(&p->mutex);
+    // Frees the display for the new movie
+    url_player_gstreamer_shutdown(previous);
+
+    logger_log(player->logger, LOGGER_INFO, "Loading %s", url);
+    // Without the mutex, so the state can be polled and the movie stopped while it loads
+    gst_element_set_state(playbin, GST_STATE_PAUSED);
+    GstState state = GST_STATE_NULL;
+    GstStateChangeReturn ret = gst_element_get_state(playbin, &state, NULL, URL_PLAYER_LOAD_TIMEOUT);
+
+    g_mutex_lock(&p->mutex);
+    bool loaded = p->playbin == playbin && !p->finished && ret != GST_STATE_CHANGE_FAILURE &&
+                  state == GST_STATE_PAUSED;
+    g_mutex_unlock(&p->mutex);
+
+    double start = start_seconds;
+    if (loaded) {
+        // Outside the mutex too, seeking waits for the streaming threads, which may wait for the bus handler
+        gint64 duration = 0;
+        if (start <= 0 && start_fraction > 0 && gst_element_query_duration(playbin, GST_FORMAT_TIME, &duration)) {
+            start = start_fraction * duration / GST_SECOND;
+        }
+        if (start > 0) {
+            gst_element_seek_simple(playbin, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT,
+                                    (gint64) (start * GST_SECOND));
+        }
+        gst_element_set_state(playbin, GST_STATE_PLAYING);
+    }
+
+    g_mutex_lock(&p->mutex);
+    bool current = p->playbin == playbin;
+    if (current && loaded) {
+        p->ready = true;
+        p->rate = 1;
+    } else if (current) {
+        gst_object_unref(url_player_gstreamer_detach(p));
+    }
+    g_mutex_unlock(&p->mutex);
+
+    if (current && loaded) {
+        logger_log(player->logger, LOGGER_INFO, "Playing %s from %.1f s", url, start > 0 ? start : 0);
+    } else {
+        // Stopped or replaced while loading, the state change above may have started it again
+        logger_log(player->logger, current ? LOGGER_ERR : LOGGER_INFO, current ? "Could not load %s" :
+                   "Loading %s was cancelled", url);
+        gst_element_set_state(playbin, GST_STATE_NULL);
+    }
+    gst_object_unref(playbin);
+    return current && loaded;
+}
+
+/* A reference to the loaded playbin, NULL if there is none, to work on outside the mutex */
+static GstElement *url_player_gstreamer_get_loaded(url_player_gstreamer_t *p) {
+    g_mutex_lock(&p->mutex);
+    GstElement *playbin = p->ready && !p->finished ? gst_object_ref(p->playbin) : NULL;
+    g_mutex_unlock(&p->mutex);
+    return playbin;
+}
+
+static void url_player_gstreamer_seek(url_player_t *player, double position) {
+    GstElement *playbin = url_player_gstreamer_get_loaded((url_player_gstreamer_t *)player);
+    if (playbin) {
+        gst_element_seek_simple(playbin, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT,
+                                (gint64) (position * GST_SECOND));
+        gst_object_unref(playbin);
+    }
+}
+
+static void url_player_gstreamer_set_rate(url_player_t *player, double rate) {
+    url_player_gstreamer_t *p = (url_player_gstreamer_t *)player;
+    GstElement *playbin = url_player_gstreamer_get_loaded(p);
+    if (playbin) {
+        g_mutex_lock(&p->mutex);
+        p->rate = rate != 0 ? 1 : 0;
+        g_mutex_unlock(&p->mutex);
+        gst_element_set_state(playbin, rate != 0 ? GST_STATE_PLAYING : GST_STATE_PAUSED);
+        gst_object_unref(playbin);
+    }
+}
+
+static void url_player_gstreamer_stop(url_player_t *player) {
+    url_player_gstreamer_t *p = (url_player_gstreamer_t *)player;
+    g_mutex_lock(&p->mutex);
+    GstElement *playbin = url_player_gstreamer_detach(p);
+    g_mutex_unlock(&p->mutex);
+    if (playbin) {
+        logger_log(player->logger, LOGGER_INFO, "Stopped playing the movie");
+    }
+    url_player_gstreamer_shutdown(playbin);
+}
+
+static bool url_player_gstreamer_get_state(url_player_t *player, url_player_state_t *state) {
+    url_player_gstreamer_t *p = (url_player_gstreamer_t *)player;
+    memset(state, 0, sizeof(*state));
+    g_mutex_lock(&p->mutex);
+    bool loaded = p->playbin && !p->finished;
+    GstElement *playbin = loaded && p->ready ? gst_object_ref(p->playbin) : NULL;
+    state->rate = p->rate;
+    g_mutex_unlock(&p->mutex);
+    if (playbin) {
+        gint64 value;
+        if (gst_element_query_duration(playbin, GST_FORMAT_TIME, &value) && value > 0) {
+            state->duration = (double) value / GST_SECOND;
+        }
+        if (gst_element_query_position(playbin, GST_FORMAT_TIME, &value) && value > 0) {
+            state->position = (double) value / GST_SECOND;
+        }
+        state->ready = true;
+        gst_object_unref(playbin);
+    }
+    return loaded;
+}
+
+static void url_player_gstreamer_destroy(url_player_t *player) {
+    url_player_gstreamer_t *p = (url_player_gstreamer_t *)player;
+    url_player_gstreamer_stop(player);
+    free(p->video_sink);
+    g_mutex_clear(&p->mutex);
+    free(p);
+}
+
+static const url_player_funcs_t url_player_gstreamer_funcs = {
+    .play = url_player_gstreamer_play,
+    .seek = url_player_gstreamer_seek,
+    .set_rate = url_player_gstreamer_set_rate,
+    .stop = url_player_gstreamer_stop,
+    .get_state = url_player_gstreamer_get_state,
+    .destroy = url_player_gstreamer_destroy,
+};
@@ -34,6 +34,8 @@ extern "C" {
 #include <stdbool.h>
 #include "../lib/logger.h"
 #include "../lib/raop_ntp.h"
+#include "../lib/stream.h"
+#include "h264-bitstream/h264_nal_index.h"
 
 typedef enum background_mode_e {
     BACKGROUND_MODE_ON,   // Always show background
@@ -44,7 +46,9 @@ typedef enum background_mode_e {
 typedef enum video_renderer_type_e {
     VIDEO_RENDERER_DUMMY,
     VIDEO_RENDERER_RPI,
-    VIDEO_RENDERER_GSTREAMER
+    VIDEO_RENDERER_GSTREAMER,
+    VIDEO_RENDERER_V4L2,
+    VIDEO_RENDERER_FFMPEG
 } video_renderer_type_t;
 
 typedef enum flip_mode_e {
@@ -54,18 +58,101 @@ typedef enum flip_mode_e {
     FLIP_BOTH
 } flip_mode_t;
 
+/* How a photo replaces the one before it, see show_photo */
+typedef enum video_transition_e {
+    VIDEO_TRANSITION_NONE,
+    VIDEO_TRANSITION_DISSOLVE,
+    VIDEO_TRANSITION_SLIDE_LEFT,
+    VIDEO_TRANSITION_SLIDE_RIGHT
+} video_transition_t;
+
 typedef struct video_renderer_config_s {
     background_mode_t background_mode;
     bool low_latency;
+    int latency_target; // ms between a frame's pts and its presentation, where the renderer honours it
     int rotation;
     flip_mode_t flip;
+    int input_buffer_count; // Decoder input buffers, 0 keeps the decoder default
+    int input_buffer_size; // Bytes per decoder input buffer, 0 keeps the decoder default
+    const char *video_sink; // GStreamer video sink element, NULL lets autovideosink pick one
+    const char *video_decoders; // Comma separated GStreamer H.264 (and H.265) decoders to try in order, NULL uses the built-in list
+    int tiles; // Mirrors sharing the display in a grid, 0 or 1 fills the whole screen
+    int tile; // Grid cell of this renderer, counted row by row from the top left
+    bool measure_latency; // Read the timecode of rpiplay_loadgen -tc back from decoded frames, where the renderer can
+    bool switch_to_60hz; // Switch HDMI to the 60 Hz CEA mode of the same size while mirroring, where the renderer can
+    bool double_decoder; // Bring up a new geometry on a standby decoder and switch the display over once it shows, rpi renderer
+    int resync_threshold; // ms, a quarter of how late a frame may be before the rpi renderer restarts its clock from it, 0 keeps 100
+    int max_dec_frame_buffering; // Frames the rpi decoder may hold back, written into the SPS, 0 keeps 4
+    int omx_latency_target; // ms the rpi renderer's display holds its queue at by steering the clock itself, 0 steers in software
+    int omx_latency_speed; // Speed factor and inflection point of that steering, 0 keeps the renderer's defaults
+    int omx_latency_inflection;
+    bool hevc; // Get ready for H.265 streams too, where the renderer can, see supports_hevc
+    int bench_interval; // Seconds between the dummy renderer's throughput summaries, -1 measures nothing, 0 only at the end
+    bool bench_check; // The dummy renderer checks every frame is well formed Annex-B
 } video_renderer_config_t;
 
 typedef struct video_renderer_s video_renderer_t;
 
+/* One piece of a frame handed over in segments, e.g. a patched SPS between the original bytes */
+typedef struct video_segment_s {
+    const unsigned char *data;
+    int size;
+} video_segment_t;
+
 typedef struct video_renderer_funcs_s {
     void (*start)(video_renderer_t *renderer);
-    void (*render_buffer)(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts, int type);
+    /* Optional, idles the renderer between mirrors until start is called again. Without it
+     * a renderer that is only wanted while mirroring is destroyed instead. */
+    void (*stop)(video_renderer_t *renderer);
+    /* nal_index locates every NAL unit in data, so renderers need not scan for start codes */
+    void (*render_buffer)(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts, int type,
+                          h264_nal_index_t const *nal_index);
+    /**
+     * Optional, render_buffer for a frame in segments of whole NAL units, which the renderer copies
+     * straight into its input buffers instead of the caller concatenating them first. The offsets
+     * in nal_index count as if the segments were one buffer.
+     */
+    void (*render_frame)(video_renderer_t *renderer, raop_ntp_t *ntp, video_segment_t const *segments, int count,
+                         uint64_t pts, int type, h264_nal_index_t const *nal_index);
+    /**
+     * Optional zero-copy input, all three may be NULL. acquire_buffer hands out a buffer of at
+     * least size bytes for a frame to be decrypted into, or NULL to fall back to render_buffer.
+     * Every acquired buffer is either rendered with render_acquired or given back with release_buffer.
+     */
+    unsigned char *(*acquire_buffer)(video_renderer_t *renderer, int size, void **handle);
+    void (*render_acquired)(video_renderer_t *renderer, raop_ntp_t *ntp, void *handle, int data_len, uint64_t pts,
+                            h264_nal_index_t const *nal_index);
+    void (*release_buffer)(video_renderer_t *renderer, void *handle);
+    /**
+     * Optional slice pipelining, a frame comes in parts of whole NAL units while it is still being
+     * received, the last part with end_of_frame set. Returning false on the first part refuses the
+     * frame, which then comes whole through render_buffer.
+     */
+    bool (*render_nals)(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts,
+                        bool end_of_frame);
+    /* Optional, true while render_buffer would have to wait for the decoder to free up input buffers */
+    bool (*is_congested)(video_renderer_t *renderer);
+    /* Optional, the raop_ntp_get_local_time of the first vsync of the display at or after time,
+     * time itself as long as the renderer does not know */
+    uint64_t (*next_vsync)(video_renderer_t *renderer, uint64_t time);
+    /**
+     * Called ahead of the parameter sets of a new stream geometry, may be NULL
+     * @param known_geometry the session streamed with exactly these parameter sets before,
+     *        so the renderer can reuse the port configuration it saw back then
+     */
+    void (*reconfigure)(video_renderer_t *renderer, int width, int height, bool known_geometry);
+    /**
+     * Optional, called ahead of reconfigure with the codec the parameter sets and the frames
+     * after them are in. Only ever H.265 for a renderer with supports_hevc set. Returns false
+     * if the decoder could not be switched over.
+     */
+    bool (*set_codec)(video_renderer_t *renderer, video_codec_t codec);
+    /**
+     * Optional, the sender stopped sending frames but kept the session, e.g. a static screen.
+     * The renderer powers its decoder down and keeps the last picture on display; it is
+     * resumed ahead of the parameter sets that come again with the first new frame.
+     */
+    void (*pause)(video_renderer_t *renderer, bool paused);
     void (*flush)(video_renderer_t *renderer);
     void (*destroy)(video_renderer_t *renderer);
     /**
@@ -77,17 +164,54 @@ typedef struct video_renderer_funcs_s {
      *       -1: a connection lost
      */
     void (*update_background)(video_renderer_t *renderer, int type);
+    /**
+     * Optional, the picture on display scaled to width x height as a malloc'd JPEG in *jpeg.
+     * Waits at most timeout_ms for it, returns the size of the JPEG or -1 if there is none.
+     * Called from another thread than the frames, renderers spend nothing on it in between.
+     */
+    int (*snapshot)(video_renderer_t *renderer, int width, int height, int timeout_ms, unsigned char **jpeg);
+    /**
+     * Optional pair, show_photo decodes a JPEG and shows it fit to the screen above the video,
+     * in place of the photo before, until hide_photo. Returns once the transition is over, or
+     * false if the photo cannot be shown. Renderers without transitions cut to the new photo.
+     * Called from other threads than the frames, but never two at once.
+     */
+    bool (*show_photo)(video_renderer_t *renderer, const unsigned char *jpeg, int size, video_transition_t transition);
+    void (*hide_photo)(video_renderer_t *renderer);
 } video_renderer_funcs_t;
 
 typedef struct video_renderer_s {
     video_renderer_funcs_t const *funcs;
     logger_t *logger;
     video_renderer_type_t type;
+    /**
+     * Startup milestones of the current stream as raop_ntp_get_local_time, 0 until reached or
+     * if the renderer cannot tell. Cleared again by flush.
+     */
+    uint64_t decoder_ready_time; // The decoder output is configured for the stream
+    uint64_t first_render_time; // The first picture went to the display
+    /* Mode of the screen found at init, 0 where the renderer cannot tell */
+    int display_width;
+    int display_height;
+    double display_refresh_rate; // Hz, fractional for the NTSC rates like 59.94
+    /* Set at init if the config asked for H.265 and the renderer can decode it */
+    bool supports_hevc;
+    /**
+     * Set by the renderer, on the thread frames come in on, once its decoder lost the frames
+     * the next ones refer to, e.g. in a stall recovery. The frames since the latest IDR are
+     * then fed again ahead of the next frame, if the mirror kept them, with timestamps just
+     * before its own, and the flag is cleared. Until then the renderer waits for an IDR.
+     */
+    bool needs_gop;
 } video_renderer_t;
 
+typedef video_renderer_t *(*video_init_func_t)(logger_t *logger, video_renderer_config_t const *config);
+
 video_renderer_t *video_renderer_dummy_init(logger_t *logger, video_renderer_config_t const *config);
 video_renderer_t *video_renderer_rpi_init(logger_t *logger, video_renderer_config_t const *config);
 video_renderer_t *video_renderer_gstreamer_init(logger_t *logger, video_renderer_config_t const *config);
+video_renderer_t *video_renderer_v4l2_init(logger_t *logger, video_renderer_config_t const *config);
+video_renderer_t *video_renderer_ffmpeg_init(logger_t *logger, video_renderer_config_t const *config);
 
 #ifdef __cplusplus
 }
@@ -18,6 +18,7 @@
  */
 
 #include "video_renderer.h"
+#include "sink_stats.h"
 
 #include <stdlib.h>
 #include <assert.h>
@@ -28,6 +29,8 @@
 
 typedef struct video_renderer_dummy_s {
     video_renderer_t base;
+    bool bench; // Measures what it gets instead of dropping it unseen
+    sink_stats_t stats;
 } video_renderer_dummy_t;
 
 static const video_renderer_funcs_t video_renderer_dummy_funcs;
@@ -41,20 +44,42 @@ video_renderer_t *video_renderer_dummy_init(logger_t *logger, video_renderer_con
     renderer->base.logger = logger;
     renderer->base.funcs = &video_renderer_dummy_funcs;
     renderer->base.type = VIDEO_RENDERER_DUMMY;
+    // Takes whatever it gets
+    renderer->base.supports_hevc = config->hevc;
+    if (config->measure_latency) {
+        logger_log(logger, LOGGER_WARNING, "The dummy renderer decodes nothing, no latency is measured");
+    }
+    if (config->bench_interval >= 0) {
+        renderer->bench = true;
+        sink_stats_init(&renderer->stats, logger, "Dummy video renderer", config->bench_interval, config->bench_check);
+    }
     return &renderer->base;
 }
 
 static void video_renderer_dummy_start(video_renderer_t *renderer) {
 }
 
-static void video_renderer_dummy_render_buffer(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts, int type) {
+static void video_renderer_dummy_render_buffer(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts, int type,
+                                               h264_nal_index_t const *nal_index) {
+    video_renderer_dummy_t *r = (video_renderer_dummy_t *) renderer;
+    if (r->bench) {
+        sink_stats_add(&r->stats, raop_ntp_get_local_time(ntp), data, data_len, pts, nal_index);
+    }
 }
 
 static void video_renderer_dummy_flush(video_renderer_t *renderer) {
+    video_renderer_dummy_t *r = (video_renderer_dummy_t *) renderer;
+    if (r->bench) {
+        sink_stats_flush(&r->stats);
+    }
 }
 
 static void video_renderer_dummy_destroy(video_renderer_t *renderer) {
     if (renderer) {
+        video_renderer_dummy_t *r = (video_renderer_dummy_t *) renderer;
+        if (r->bench) {
+            sink_stats_finish(&r->stats, raop_ntp_get_local_time(NULL));
+        }
         free(renderer);
     }
 }
@@ -0,0 +1,947 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include "video_renderer.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/hwcontext_drm.h>
+#include <libavutil/pixdesc.h>
+
+#include "../lib/media_clock.h"
+#include "../lib/simd_kernels.h"
+
+#if defined(HAS_EGL_PRESENTER)
+#include "egl_presenter.h"
+#endif
+
+/*
+ * H264 and H265 renderer for desktop GPUs through libavcodec. Frames are decoded synchronously on the
+ * thread that hands them over, with VAAPI or NVDEC where available and in software otherwise,
+ * and shown on a DRM/KMS plane like with the v4l2 renderer. VAAPI pictures are exported as
+ * DRM PRIME buffers and scanned out where they were decoded, other pictures are copied into
+ * a dumb buffer first. Where the plane cannot rotate or flip as asked, the GPU draws the
+ * pictures onto the display instead, see egl_presenter.h.
+ *
+ * Without a GPU decoder, as on the Raspberry Pi 5, which has none for H.264, decoding is spread
+ * over the cores by slices, never by frames, and the loop filter is skipped while the decoder
+ * cannot keep up with the frame rate, which is the costliest step that can be left out.
+ */
+
+#define DRM_MAX_CARDS 4
+// Surfaces beyond what the decoder needs: one on screen, one being switched to
+#define EXTRA_HW_FRAMES 2
+// Pictures due further in the future than this are shown right away, the timestamps are off
+#define MAX_PRESENT_DELAY_US 500000
+// Software decoding taking more than this share of the frame interval skips more of the loop
+// filter, less than the lower one skips less again, each at most once per LOOP_FILTER_HOLD_US
+#define LOOP_FILTER_SKIP_LOAD 0.8
+#define LOOP_FILTER_RESTORE_LOAD 0.5
+#define LOOP_FILTER_HOLD_US 1000000
+// Frame interval assumed until the timestamps tell, and the ones they may tell
+#define DEFAULT_FRAME_INTERVAL_US 16667
+#define MIN_FRAME_INTERVAL_US 8000
+#define MAX_FRAME_INTERVAL_US 100000
+
+// Tried in order, CUDA is NVDEC
+static const enum AVHWDeviceType video_renderer_ffmpeg_hw_types[] = {
+    AV_HWDEVICE_TYPE_VAAPI,
+    AV_HWDEVICE_TYPE_CUDA,
+};
+
+// How much of the loop filter software decoding skips, from none to that of every frame
+static const enum AVDiscard video_renderer_ffmpeg_loop_filter_levels[] = {
+    AVDISCARD_DEFAULT,
+    AVDISCARD_NONREF,
+    AVDISCARD_ALL,
+};
+#define LOOP_FILTER_LEVELS \
+    (int) (sizeof(video_renderer_ffmpeg_loop_filter_levels) / sizeof(video_renderer_ffmpeg_loop_filter_levels[0]))
+
+typedef struct video_renderer_ffmpeg_dumb_s {
+    uint32_t handle;
+    uint32_t fb_id;
+    uint32_t pitch;
+    unsigned char *map;
+    size_t size;
+#if defined(HAS_EGL_PRESENTER)
+    egl_presenter_image_t *image;
+#endif
+} video_renderer_ffmpeg_dumb_t;
+
+typedef struct video_renderer_ffmpeg_s {
+    video_renderer_t base;
+    video_renderer_config_t const *config;
+    // Only used for timestamps, set by the first frame
+    raop_ntp_t *ntp;
+
+    AVCodecContext *codec;
+    video_codec_t codec_id;
+    AVBufferRef *hw_device;
+    enum AVPixelFormat hw_format;
+    AVPacket *packet;
+    AVFrame *frame;
+    // Download target of hardware pictures that cannot be scanned out
+    AVFrame *sw_frame;
+    // Cleared for good once the display refuses a DRM PRIME picture, which only VAAPI surfaces export to
+    bool zero_copy;
+    uint64_t decode_errors;
+
+    // Set once libavcodec settled on decoding in software, which the loop filter skipping is for
+    bool software;
+    // Averages of the time a frame takes to decode and of the time between frames, in us
+    double decode_time;
+    double frame_interval;
+    uint64_t last_pts;
+    int loop_filter_level;
+    uint64_t loop_filter_changed;
+    void (*interleave_bytes)(unsigned char *dst, const unsigned char *a, const unsigned char *b, size_t count);
+
+    int drm_fd;
+    uint32_t crtc_id;
+    // Selects the CRTC in vblank requests, and its refresh period in us
+    uint32_t vblank_pipe;
+    uint64_t vblank_period;
+    uint32_t plane_id;
+    int display_width;
+    int display_height;
+    bool rotated;
+#if defined(HAS_EGL_PRESENTER)
+    // Set when the GPU presents instead of the plane
+    egl_presenter_t *egl;
+#endif
+
+    // The picture on screen, which must stay allocated until the plane switched away from it
+    AVFrame *shown_frame;
+    uint32_t shown_fb_id;
+    bool shown_fb_owned;
+
+    // Double buffered copies of pictures that are not scanned out in place
+    video_renderer_ffmpeg_dumb_t dumb[2];
+    int dumb_width;
+    int dumb_height;
+    int next_dumb;
+
+    // Visible picture and where it lands on the display
+    int src_width, src_height;
+    int dst_x, dst_y, dst_width, dst_height;
+} video_renderer_ffmpeg_t;
+
+static const video_renderer_funcs_t video_renderer_ffmpeg_funcs;
+static void video_renderer_ffmpeg_destroy(video_renderer_t *renderer);
+
+static bool video_renderer_ffmpeg_plane_supports(drmModePlane *plane, uint32_t format) {
+    for (uint32_t i = 0; i < plane->count_formats; i++) {
+        if (plane->formats[i] == format) return true;
+    }
+    return false;
+}
+
+/* Finds a driven display and an unused plane on it that can scan out NV12 */
+static bool video_renderer_ffmpeg_find_plane(video_renderer_ffmpeg_t *r, int fd) {
+    drmModeRes *res = drmModeGetResources(fd);
+    if (!res) {
+        return false;
+    }
+
+    int crtc_index = -1;
+    for (int i = 0; i < res->count_crtcs && crtc_index == -1; i++) {
+        drmModeCrtc *crtc = drmModeGetCrtc(fd, res->crtcs[i]);
+        if (!crtc) continue;
+        if (crtc->mode_valid && crtc->buffer_id) {
+            crtc_index = i;
+            r->crtc_id = crtc->crtc_id;
+            r->display_width = crtc->mode.hdisplay;
+            r->display_height = crtc->mode.vdisplay;
+            r->base.display_width = r->display_width;
+            r->base.display_height = r->display_height;
+            r->base.display_refresh_rate = crtc->mode.vrefresh;
+            if (crtc->mode.clock && crtc->mode.htotal && crtc->mode.vtotal) {
+                r->base.display_refresh_rate = crtc->mode.clock * 1000.0 / crtc->mode.htotal / crtc->mode.vtotal;
+                r->vblank_period = (uint64_t) crtc->mode.htotal * crtc->mode.vtotal * 1000 / crtc->mode.clock;
+            }
+            r->vblank_pipe = i == 0 ? 0 : i == 1 ? DRM_VBLANK_SECONDARY :
+                             (i << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK;
+        }
+        drmModeFreeCrtc(crtc);
+    }
+    drmModeFreeResources(res);
+    if (crtc_index == -1) {
+        return false;
+    }
+
+    drmModePlaneRes *planes = drmModeGetPlaneResources(fd);
+    if (!planes) {
+        return false;
+    }
+    r->plane_id = 0;
+    for (uint32_t i = 0; i < planes->count_planes && !r->plane_id; i++) {
+        drmModePlane *plane = drmModeGetPlane(fd, planes->planes[i]);
+        if (!plane) continue;
+        if ((plane->possible_crtcs & (1u << crtc_index)) && !plane->fb_id &&
+            video_renderer_ffmpeg_plane_supports(plane, DRM_FORMAT_NV12)) {
+            r->plane_id = plane->plane_id;
+        }
+        drmModeFreePlane(plane);
+    }
+    drmModeFreePlaneResources(planes);
+    return r->plane_id != 0;
+}
+
+static int video_renderer_ffmpeg_open_display(video_renderer_ffmpeg_t *r) {
+    char path[32];
+    for (int i = 0; i < DRM_MAX_CARDS; i++) {
+        snprintf(path, sizeof(path), "/dev/dri/card%d", i);
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd == -1) continue;
+        drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+        if (video_renderer_ffmpeg_find_plane(r, fd)) {
+            logger_log(r->base.logger, LOGGER_INFO, "Presenting on %s plane %u, %dx%d",
+                       path, r->plane_id, r->display_width, r->display_height);
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+/* KMS rotates counter-clockwise, the -r option turns the picture clockwise like the OpenMAX renderer */
+static void video_renderer_ffmpeg_setup_rotation(video_renderer_ffmpeg_t *r) {
+    int rotation = ((r->config->rotation % 360) + 360) % 360;
+    uint64_t value;
+    switch (rotation) {
+        case 90: value = DRM_MODE_ROTATE_270; break;
+        case 180: value = DRM_MODE_ROTATE_180; break;
+        case 270: value = DRM_MODE_ROTATE_90; break;
+        default: value = DRM_MODE_ROTATE_0; break;
+    }
+    if (r->config->flip == FLIP_HORIZONTAL || r->config->flip == FLIP_BOTH) value |= DRM_MODE_REFLECT_X;
+    if (r->config->flip == FLIP_VERTICAL || r->config->flip == FLIP_BOTH) value |= DRM_MODE_REFLECT_Y;
+    r->rotated = rotation == 90 || rotation == 270;
+    if (value == DRM_MODE_ROTATE_0) {
+        return;
+    }
+
+    bool applied = false;
+    drmModeObjectProperties *props = drmModeObjectGetProperties(r->drm_fd, r->plane_id, DRM_MODE_OBJECT_PLANE);
+    for (uint32_t i = 0; props && i < props->count_props && !applied; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty(r->drm_fd, props->props[i]);
+        if (!prop) continue;
+        if (!strcmp(prop->name, "rotation")) {
+            applied = drmModeObjectSetProperty(r->drm_fd, r->plane_id, DRM_MODE_OBJECT_PLANE,
+                                               prop->prop_id, value) == 0;
+        }
+        drmModeFreeProperty(prop);
+    }
+    drmModeFreeObjectProperties(props);
+    if (!applied) {
+#if defined(HAS_EGL_PRESENTER)
+        r->egl = egl_presenter_init(r->base.logger, r->drm_fd, r->crtc_id, r->config);
+        if (r->egl) {
+            logger_log(r->base.logger, LOGGER_INFO, "Display plane cannot rotate or flip, the GPU does instead");
+            return;
+        }
+#endif
+        logger_log(r->base.logger, LOGGER_WARNING, "Display plane does not support the requested rotation or flip");
+        r->rotated = false;
+    }
+}
+
+/* Scales the visible picture to fit the display, keeping its aspect ratio */
+static void video_renderer_ffmpeg_update_layout(video_renderer_ffmpeg_t *r, int width, int height) {
+    if (width == r->src_width && height == r->src_height) {
+        return;
+    }
+    r->src_width = width;
+    r->src_height = height;
+    if (r->rotated) {
+        int swap = width;
+        width = height;
+        height = swap;
+    }
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    if ((int64_t) width * r->display_height > (int64_t) height * r->display_width) {
+        r->dst_width = r->display_width;
+        r->dst_height = (int) ((int64_t) r->display_width * height / width);
+    } else {
+        r->dst_height = r->display_height;
+        r->dst_width = (int) ((int64_t) r->display_height * width / height);
+    }
+    r->dst_x = (r->display_width - r->dst_width) / 2;
+    r->dst_y = (r->display_height - r->dst_height) / 2;
+    logger_log(r->base.logger, LOGGER_INFO, "Decoding %dx%d, shown at %dx%d",
+               r->src_width, r->src_height, r->dst_width, r->dst_height);
+}
+
+/* Called by libavcodec once it parsed the parameter sets, picks the hardware surfaces where it can */
+static enum AVPixelFormat video_renderer_ffmpeg_get_format(AVCodecContext *codec, const enum AVPixelFormat *formats) {
+    video_renderer_ffmpeg_t *r = codec->opaque;
+    if (!r->base.decoder_ready_time && r->ntp) {
+        r->base.decoder_ready_time = raop_ntp_get_local_time(r->ntp);
+    }
+    for (const enum AVPixelFormat *format = formats; *format != AV_PIX_FMT_NONE; format++) {
+        if (*format == r->hw_format) {
+            r->software = false;
+            return *format;
+        }
+    }
+    if (r->hw_format != AV_PIX_FMT_NONE) {
+        logger_log(r->base.logger, LOGGER_WARNING, "The GPU cannot decode this stream, decoding in software");
+    }
+    r->software = true;
+    return avcodec_default_get_format(codec, formats);
+}
+
+static enum AVPixelFormat video_renderer_ffmpeg_hw_format(const AVCodec *decoder, enum AVHWDeviceType type) {
+    for (int i = 0;; i++) {
+        const AVCodecHWConfig *config = avcodec_get_hw_config(decoder, i);
+        if (!config) {
+            return AV_PIX_FMT_NONE;
+        }
+        if ((config->methods & AV_CODEC_HW_CONFIG_METHOD_HW_DEVICE_CTX) && config->device_type == type) {
+            return config->pix_fmt;
+        }
+    }
+}
+
+static const char *video_renderer_ffmpeg_codec_name(video_codec_t codec) {
+    return codec == VIDEO_CODEC_H265 ? "H.265" : "H.264";
+}
+
+static int video_renderer_ffmpeg_open_decoder(video_renderer_ffmpeg_t *r, video_codec_t codec) {
+    const char *name = video_renderer_ffmpeg_codec_name(codec);
+    const AVCodec *decoder = avcodec_find_decoder(codec == VIDEO_CODEC_H265 ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264);
+    if (!decoder) {
+        logger_log(r->base.logger, LOGGER_ERR, "libavcodec has no %s decoder", name);
+        return -1;
+    }
+    r->codec_id = codec;
+    r->codec = avcodec_alloc_context3(decoder);
+    if (!r->codec) {
+        return -1;
+    }
+
+    r->hw_format = AV_PIX_FMT_NONE;
+    for (unsigned int i = 0; i < sizeof(video_renderer_ffmpeg_hw_types) / sizeof(video_renderer_ffmpeg_hw_types[0]); i++) {
+        enum AVHWDeviceType type = video_renderer_ffmpeg_hw_types[i];
+        enum AVPixelFormat format = video_renderer_ffmpeg_hw_format(decoder, type);
+        if (format == AV_PIX_FMT_NONE || av_hwdevice_ctx_create(&r->hw_device, type, NULL, NULL, 0) < 0) {
+            continue;
+        }
+        r->hw_format = format;
+        r->codec->hw_device_ctx = av_buffer_ref(r->hw_device);
+        r->codec->extra_hw_frames = EXTRA_HW_FRAMES;
+        logger_log(r->base.logger, LOGGER_INFO, "Decoding %s with %s", name, av_hwdevice_get_type_name(type));
+        break;
+    }
+    if (r->hw_format == AV_PIX_FMT_NONE) {
+        logger_log(r->base.logger, LOGGER_INFO, "No VAAPI or NVDEC device, decoding %s in software", name);
+    }
+
+    // Every frame comes out of the call that decodes it: no reordering delay, and no frame threads,
+    // each of which would hold back one more frame. Slice threads take one thread per core.
+    r->codec->opaque = r;
+    r->codec->get_format = video_renderer_ffmpeg_get_format;
+    r->codec->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    r->codec->thread_type = FF_THREAD_SLICE;
+    r->codec->thread_count = 0;
+    if (avcodec_open2(r->codec, decoder, NULL) < 0) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not open the %s decoder", name);
+        return -1;
+    }
+    r->software = r->hw_format == AV_PIX_FMT_NONE;
+    r->decode_time = 0;
+    r->frame_interval = DEFAULT_FRAME_INTERVAL_US;
+    r->last_pts = 0;
+    r->loop_filter_level = 0;
+    r->loop_filter_changed = 0;
+    return 0;
+}
+
+/*
+ * Skips more of the loop filter while software decoding takes most of the frame interval, and
+ * less again once it has room to spare. Skipping it on frames that others refer to leaves
+ * blocking that carries on until the next IDR, better than the decoder falling behind for good.
+ */
+static void video_renderer_ffmpeg_update_load(video_renderer_ffmpeg_t *r, uint64_t pts, uint64_t decode_time) {
+    if (r->last_pts && pts > r->last_pts) {
+        double interval = (double) (pts - r->last_pts);
+        if (interval >= MIN_FRAME_INTERVAL_US && interval <= MAX_FRAME_INTERVAL_US) {
+            r->frame_interval += (interval - r->frame_interval) / 16;
+        }
+    }
+    r->last_pts = pts;
+    r->decode_time = r->decode_time ? r->decode_time + (decode_time - r->decode_time) / 16 : decode_time;
+    if (!r->software) {
+        return;
+    }
+
+    uint64_t now = media_clock_now();
+    if (now - r->loop_filter_changed < LOOP_FILTER_HOLD_US) {
+        return;
+    }
+    double load = r->decode_time / r->frame_interval;
+    int level = r->loop_filter_level;
+    if (load > LOOP_FILTER_SKIP_LOAD && level < LOOP_FILTER_LEVELS - 1) {
+        level++;
+    } else if (load < LOOP_FILTER_RESTORE_LOAD && level > 0) {
+        level--;
+    }
+    if (level == r->loop_filter_level) {
+        return;
+    }
+    // Read by the decoder for every slice, so it changes with the next frame
+    r->codec->skip_loop_filter = video_renderer_ffmpeg_loop_filter_levels[level];
+    r->loop_filter_level = level;
+    r->loop_filter_changed = now;
+    logger_log(r->base.logger, LOGGER_INFO, "Software decoding takes %.0f%% of the frame interval, %s",
+               load * 100, level == 0 ? "applying the loop filter again" :
+               level == 1 ? "skipping the loop filter of non-reference frames" :
+               "skipping the loop filter of every frame");
+}
+
+static void video_renderer_ffmpeg_close_decoder(video_renderer_ffmpeg_t *r) {
+    avcodec_free_context(&r->codec);
+    av_buffer_unref(&r->hw_device);
+}
+
+video_renderer_t *video_renderer_ffmpeg_init(logger_t *logger, video_renderer_config_t const *config) {
+    video_renderer_ffmpeg_t *renderer;
+    renderer = calloc(1, sizeof(video_renderer_ffmpeg_t));
+    if (!renderer) {
+        return NULL;
+    }
+    renderer->base.logger = logger;
+    renderer->base.funcs = &video_renderer_ffmpeg_funcs;
+    renderer->base.type = VIDEO_RENDERER_FFMPEG;
+    renderer->config = config;
+    renderer->zero_copy = true;
+    renderer->interleave_bytes = simd_kernels()->interleave_bytes;
+
+    renderer->drm_fd = video_renderer_ffmpeg_open_display(renderer);
+    if (renderer->drm_fd == -1) {
+        logger_log(logger, LOGGER_ERR, "Could not find an active display with a free NV12 plane");
+        goto fail;
+    }
+    video_renderer_ffmpeg_setup_rotation(renderer);
+
+    renderer->packet = av_packet_alloc();
+    renderer->frame = av_frame_alloc();
+    renderer->sw_frame = av_frame_alloc();
+    if (!renderer->packet || !renderer->frame || !renderer->sw_frame) {
+        goto fail;
+    }
+    if (video_renderer_ffmpeg_open_decoder(renderer, VIDEO_CODEC_H264) < 0) {
+        goto fail;
+    }
+    // The decoder for it is opened once a stream asks for it, possibly in software only
+    if (config->hevc) {
+        renderer->base.supports_hevc = avcodec_find_decoder(AV_CODEC_ID_HEVC) != NULL;
+        if (!renderer->base.supports_hevc) {
+            logger_log(logger, LOGGER_WARNING, "libavcodec has no H.265 decoder");
+        }
+    }
+
+    if (config->background_mode != BACKGROUND_MODE_OFF) {
+        logger_log(logger, LOGGER_DEBUG, "The ffmpeg renderer leaves the background to the console");
+    }
+    return &renderer->base;
+
+    fail:
+    video_renderer_ffmpeg_destroy(&renderer->base);
+    return NULL;
+}
+
+static void video_renderer_ffmpeg_free_dumb(video_renderer_ffmpeg_t *r) {
+    for (int i = 0; i < 2; i++) {
+        video_renderer_ffmpeg_dumb_t *dumb = &r->dumb[i];
+        if (dumb->map) {
+            munmap(dumb->map, dumb->size);
+        }
+#if defined(HAS_EGL_PRESENTER)
+        egl_presenter_release(r->egl, dumb->image);
+#endif
+        if (dumb->fb_id) {
+            drmModeRmFB(r->drm_fd, dumb->fb_id);
+        }
+        if (dumb->handle) {
+            struct drm_mode_destroy_dumb destroy;
+            memset(&destroy, 0, sizeof(destroy));
+            destroy.handle = dumb->handle;
+            drmIoctl(r->drm_fd, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+        }
+        memset(dumb, 0, sizeof(*dumb));
+    }
+    r->dumb_width = 0;
+    r->dumb_height = 0;
+}
+
+static int video_renderer_ffmpeg_alloc_dumb(video_renderer_ffmpeg_t *r, video_renderer_ffmpeg_dumb_t *dumb,
+                                            int width, int height) {
+    struct drm_mode_create_dumb create;
+    memset(&create, 0, sizeof(create));
+    create.width = width;
+    create.height = height * 3 / 2;
+    create.bpp = 8;
+    if (drmIoctl(r->drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create)) {
+        return -1;
+    }
+    dumb->handle = create.handle;
+    dumb->pitch = create.pitch;
+    dumb->size = create.size;
+
+    uint32_t handles[4] = {create.handle, create.handle}, pitches[4] = {create.pitch, create.pitch};
+    uint32_t offsets[4] = {0, create.pitch * height};
+    if (drmModeAddFB2(r->drm_fd, width, height, DRM_FORMAT_NV12, handles, pitches, offsets, &dumb->fb_id, 0)) {
+        dumb->fb_id = 0;
+        return -1;
+    }
+
+    struct drm_mode_map_dumb map;
+    memset(&map, 0, sizeof(map));
+    map.handle = create.handle;
+    if (drmIoctl(r->drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &map)) {
+        return -1;
+    }
+    void *start = mmap(NULL, create.size, PROT_READ | PROT_WRITE, MAP_SHARED, r->drm_fd, map.offset);
+    if (start == MAP_FAILED) {
+        return -1;
+    }
+    dumb->map = start;
+
+#if defined(HAS_EGL_PRESENTER)
+    if (r->egl) {
+        egl_presenter_picture_t picture;
+        memset(&picture, 0, sizeof(picture));
+        picture.width = width;
+        picture.height = height;
+        picture.format = DRM_FORMAT_NV12;
+        picture.modifier = DRM_FORMAT_MOD_INVALID;
+        picture.num_planes = 2;
+        if (drmPrimeHandleToFD(r->drm_fd, dumb->handle, DRM_CLOEXEC, &picture.fds[0])) {
+            return -1;
+        }
+        picture.fds[1] = picture.fds[0];
+        picture.pitches[0] = picture.pitches[1] = dumb->pitch;
+        picture.offsets[1] = dumb->pitch * height;
+        dumb->image = egl_presenter_import(r->egl, &picture);
+        close(picture.fds[0]);
+        if (!dumb->image) {
+            return -1;
+        }
+    }
+#endif
+    return 0;
+}
+
+/* Copies an NV12 or planar 4:2:0 picture into the next dumb buffer, which is returned */
+static video_renderer_ffmpeg_dumb_t *video_renderer_ffmpeg_copy_picture(video_renderer_ffmpeg_t *r, const AVFrame *frame) {
+    int width = (frame->width + 1) & ~1;
+    int height = (frame->height + 1) & ~1;
+    if (width != r->dumb_width || height != r->dumb_height) {
+        // Switching off the plane first, it may still scan out of the old buffers
+        if (r->shown_fb_id && !r->shown_fb_owned) {
+            drmModeSetPlane(r->drm_fd, r->plane_id, r->crtc_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+            r->shown_fb_id = 0;
+        }
+        video_renderer_ffmpeg_free_dumb(r);
+        for (int i = 0; i < 2; i++) {
+            if (video_renderer_ffmpeg_alloc_dumb(r, &r->dumb[i], width, height) < 0) {
+                logger_log(r->base.logger, LOGGER_ERR, "Could not allocate %dx%d display buffers %d %s",
+                           width, height, errno, strerror(errno));
+                video_renderer_ffmpeg_free_dumb(r);
+                return NULL;
+            }
+        }
+        r->dumb_width = width;
+        r->dumb_height = height;
+    }
+
+    video_renderer_ffmpeg_dumb_t *dumb = &r->dumb[r->next_dumb];
+    r->next_dumb ^= 1;
+    unsigned char *luma = dumb->map;
+    unsigned char *chroma = dumb->map + dumb->pitch * height;
+    for (int y = 0; y < frame->height; y++) {
+        memcpy(luma + y * dumb->pitch, frame->data[0] + y * frame->linesize[0], frame->width);
+    }
+    if (frame->format == AV_PIX_FMT_NV12) {
+        for (int y = 0; y < height / 2; y++) {
+            memcpy(chroma + y * dumb->pitch, frame->data[1] + y * frame->linesize[1], width);
+        }
+    } else if (frame->format == AV_PIX_FMT_YUV420P || frame->format == AV_PIX_FMT_YUVJ420P) {
+        for (int y = 0; y < height / 2; y++) {
+            r->interleave_bytes(chroma + y * dumb->pitch, frame->data[1] + y * frame->linesize[1],
+                                frame->data[2] + y * frame->linesize[2], width / 2);
+        }
+    } else {
+        logger_log(r->base.logger, LOGGER_ERR, "Decoded pictures in %s cannot be displayed",
+                   av_get_pix_fmt_name(frame->format));
+        return NULL;
+    }
+    return dumb;
+}
+
+/*
+ * Wraps the DRM PRIME export of a VAAPI picture into a framebuffer. The framebuffer keeps the
+ * buffer objects, so the GEM handles are closed right away. VAAPI exports NV12 as one layer
+ * per plane, which scan out together as a single NV12 framebuffer.
+ */
+static uint32_t video_renderer_ffmpeg_import_picture(video_renderer_ffmpeg_t *r, const AVDRMFrameDescriptor *desc,
+                                                     int width, int height) {
+    uint32_t handles[4] = {0}, pitches[4] = {0}, offsets[4] = {0};
+    uint64_t modifiers[4] = {0};
+    uint32_t objects[AV_DRM_MAX_PLANES] = {0};
+    uint32_t format = desc->nb_layers == 1 ? desc->layers[0].format : DRM_FORMAT_NV12;
+    uint32_t fb_id = 0;
+    int plane = 0;
+
+    for (int i = 0; i < desc->nb_objects; i++) {
+        if (drmPrimeFDToHandle(r->drm_fd, desc->objects[i].fd, &objects[i])) {
+            logger_log(r->base.logger, LOGGER_ERR, "Could not import picture into DRM %d %s", errno, strerror(errno));
+            goto out;
+        }
+    }
+    for (int l = 0; l < desc->nb_layers; l++) {
+        for (int p = 0; p < desc->layers[l].nb_planes && plane < 4; p++, plane++) {
+            const AVDRMPlaneDescriptor *src = &desc->layers[l].planes[p];
+            handles[plane] = objects[src->object_index];
+            pitches[plane] = src->pitch;
+            offsets[plane] = src->offset;
+            modifiers[plane] = desc->objects[src->object_index].format_modifier;
+        }
+    }
+    if (modifiers[0] != DRM_FORMAT_MOD_INVALID) {
+        if (drmModeAddFB2WithModifiers(r->drm_fd, width, height, format, handles, pitches, offsets, modifiers,
+                                       &fb_id, DRM_MODE_FB_MODIFIERS)) {
+            fb_id = 0;
+        }
+    } else if (drmModeAddFB2(r->drm_fd, width, height, format, handles, pitches, offsets, &fb_id, 0)) {
+        fb_id = 0;
+    }
+
+    out:
+    for (int i = 0; i < desc->nb_objects; i++) {
+        // Objects may be the same buffer imported twice, which yields the same handle
+        bool closed = false;
+        for (int j = 0; j < i; j++) {
+            if (objects[j] == objects[i]) closed = true;
+        }
+        if (objects[i] && !closed) {
+            struct drm_gem_close gem_close;
+            memset(&gem_close, 0, sizeof(gem_close));
+            gem_close.handle = objects[i];
+            drmIoctl(r->drm_fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
+        }
+    }
+    return fb_id;
+}
+
+static void video_renderer_ffmpeg_release_shown(video_renderer_ffmpeg_t *r) {
+    if (r->shown_fb_owned && r->shown_fb_id) {
+        drmModeRmFB(r->drm_fd, r->shown_fb_id);
+    }
+    av_frame_free(&r->shown_frame);
+    r->shown_fb_id = 0;
+    r->shown_fb_owned = false;
+}
+
+/* The DRM PRIME export of a VAAPI picture, holding a reference to the surface, or NULL */
+static AVFrame *video_renderer_ffmpeg_map_picture(video_renderer_ffmpeg_t *r, const AVFrame *frame) {
+    AVFrame *mapped = av_frame_alloc();
+    if (!mapped) {
+        return NULL;
+    }
+    mapped->format = AV_PIX_FMT_DRM_PRIME;
+    if (av_hwframe_map(mapped, frame, AV_HWFRAME_MAP_READ) < 0) {
+        av_frame_free(&mapped);
+    }
+    return mapped;
+}
+
+/* Copies a picture that is not scanned out in place into a dumb buffer, downloading it from the GPU first */
+static video_renderer_ffmpeg_dumb_t *video_renderer_ffmpeg_copy_frame(video_renderer_ffmpeg_t *r, const AVFrame *frame) {
+    if (frame->format == r->hw_format) {
+        av_frame_unref(r->sw_frame);
+        if (av_hwframe_transfer_data(r->sw_frame, frame, 0) < 0) {
+            logger_log(r->base.logger, LOGGER_ERR, "Could not download the decoded picture");
+            return NULL;
+        }
+        frame = r->sw_frame;
+    }
+    return video_renderer_ffmpeg_copy_picture(r, frame);
+}
+
+static void video_renderer_ffmpeg_wait(video_renderer_ffmpeg_t *r, const AVFrame *frame) {
+    if (!r->config->low_latency && r->ntp) {
+        int64_t wait = frame->pts - (int64_t) raop_ntp_get_local_time(r->ntp);
+        if (wait > 0 && wait < MAX_PRESENT_DELAY_US) {
+            usleep(wait);
+        }
+    }
+}
+
+static void video_renderer_ffmpeg_disable_zero_copy(video_renderer_ffmpeg_t *r) {
+    logger_log(r->base.logger, LOGGER_WARNING, "Decoded pictures cannot be shown in place, copying them instead");
+    r->zero_copy = false;
+}
+
+#if defined(HAS_EGL_PRESENTER)
+static egl_presenter_image_t *video_renderer_ffmpeg_import_egl(video_renderer_ffmpeg_t *r, const AVDRMFrameDescriptor *desc,
+                                                               int width, int height) {
+    egl_presenter_picture_t picture;
+    memset(&picture, 0, sizeof(picture));
+    picture.width = width;
+    picture.height = height;
+    picture.format = desc->nb_layers == 1 ? desc->layers[0].format : DRM_FORMAT_NV12;
+    picture.modifier = desc->objects[0].format_modifier;
+    for (int l = 0; l < desc->nb_layers; l++) {
+        for (int p = 0; p < desc->layers[l].nb_planes && picture.num_planes < EGL_PRESENTER_MAX_PLANES; p++) {
+            const AVDRMPlaneDescriptor *src = &desc->layers[l].planes[p];
+            picture.fds[picture.num_planes] = desc->objects[src->object_index].fd;
+            picture.offsets[picture.num_planes] = src->offset;
+            picture.pitches[picture.num_planes] = src->pitch;
+            picture.num_planes++;
+        }
+    }
+    return egl_presenter_import(r->egl, &picture);
+}
+
+/* The GPU is done with the picture once it is shown, so nothing is held on to across frames */
+static void video_renderer_ffmpeg_present_egl(video_renderer_ffmpeg_t *r, AVFrame *frame) {
+    AVFrame *mapped = NULL;
+    egl_presenter_image_t *image = NULL;
+    bool owned = false;
+
+    if (r->zero_copy && frame->format == AV_PIX_FMT_VAAPI) {
+        mapped = video_renderer_ffmpeg_map_picture(r, frame);
+        if (mapped) {
+            image = video_renderer_ffmpeg_import_egl(r, (AVDRMFrameDescriptor *) mapped->data[0],
+                                                     frame->width, frame->height);
+            owned = true;
+        }
+        if (!image) {
+            video_renderer_ffmpeg_disable_zero_copy(r);
+        }
+    }
+    if (!image) {
+        video_renderer_ffmpeg_dumb_t *dumb = video_renderer_ffmpeg_copy_frame(r, frame);
+        if (!dumb) {
+            av_frame_free(&mapped);
+            return;
+        }
+        image = dumb->image;
+        owned = false;
+    }
+
+    video_renderer_ffmpeg_wait(r, frame);
+    if (egl_presenter_show(r->egl, image) == 0 && !r->base.first_render_time) {
+        r->base.first_render_time = raop_ntp_get_local_time(r->ntp);
+    }
+    if (owned) {
+        egl_presenter_release(r->egl, image);
+    }
+    av_frame_free(&mapped);
+}
+#endif
+
+static void video_renderer_ffmpeg_present(video_renderer_ffmpeg_t *r, AVFrame *frame) {
+    AVFrame *mapped = NULL;
+    uint32_t fb_id = 0;
+    bool owned = false;
+
+#if defined(HAS_EGL_PRESENTER)
+    if (r->egl) {
+        video_renderer_ffmpeg_present_egl(r, frame);
+        return;
+    }
+#endif
+
+    if (r->zero_copy && frame->format == AV_PIX_FMT_VAAPI) {
+        mapped = video_renderer_ffmpeg_map_picture(r, frame);
+        if (mapped) {
+            fb_id = video_renderer_ffmpeg_import_picture(r, (AVDRMFrameDescriptor *) mapped->data[0],
+                                                         frame->width, frame->height);
+            owned = true;
+        }
+        if (!fb_id) {
+            video_renderer_ffmpeg_disable_zero_copy(r);
+            av_frame_free(&mapped);
+            owned = false;
+        }
+    }
+    if (!fb_id) {
+        video_renderer_ffmpeg_dumb_t *dumb = video_renderer_ffmpeg_copy_frame(r, frame);
+        if (!dumb) {
+            return;
+        }
+        fb_id = dumb->fb_id;
+    }
+    video_renderer_ffmpeg_update_layout(r, frame->width, frame->height);
+    video_renderer_ffmpeg_wait(r, frame);
+
+    if (drmModeSetPlane(r->drm_fd, r->plane_id, r->crtc_id, fb_id, 0,
+                        r->dst_x, r->dst_y, r->dst_width, r->dst_height,
+                        0, 0, r->src_width << 16, r->src_height << 16)) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not show picture %d %s", errno, strerror(errno));
+        if (owned) drmModeRmFB(r->drm_fd, fb_id);
+        av_frame_free(&mapped);
+        return;
+    }
+    if (!r->base.first_render_time) {
+        r->base.first_render_time = raop_ntp_get_local_time(r->ntp);
+    }
+
+    // The plane scans out of the new picture now, the previous surface can be decoded into again
+    video_renderer_ffmpeg_release_shown(r);
+    // The mapping holds a reference to the VAAPI surface it was made of
+    r->shown_frame = mapped;
+    r->shown_fb_id = fb_id;
+    r->shown_fb_owned = owned;
+}
+
+static void video_renderer_ffmpeg_start(video_renderer_t *renderer) {
+
+}
+
+static void video_renderer_ffmpeg_render_buffer(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts, int type,
+                                                h264_nal_index_t const *nal_index) {
+    video_renderer_ffmpeg_t *r = (video_renderer_ffmpeg_t *)renderer;
+    // No decoder after a failed codec switch, until the next parameter sets
+    if (data_len == 0 || !r->codec) return;
+    LOGGER_DEBUG_HOT(renderer->logger, "Got h264 data of %d bytes", data_len);
+    r->ntp = ntp;
+
+    // Not reference counted, so libavcodec copies it into a padded buffer of its own
+    r->packet->data = data;
+    r->packet->size = data_len;
+    r->packet->pts = pts;
+    uint64_t start = media_clock_now();
+    int ret = avcodec_send_packet(r->codec, r->packet);
+    r->packet->data = NULL;
+    r->packet->size = 0;
+    if (ret < 0) {
+        r->decode_errors++;
+        logger_log(renderer->logger, LOGGER_DEBUG, "The decoder refused a frame, %llu so far", r->decode_errors);
+        return;
+    }
+    // The wait for the picture's time in present does not count towards the decoder's load
+    while (avcodec_receive_frame(r->codec, r->frame) == 0) {
+        video_renderer_ffmpeg_update_load(r, pts, media_clock_now() - start);
+        video_renderer_ffmpeg_present(r, r->frame);
+        av_frame_unref(r->frame);
+        start = media_clock_now();
+    }
+}
+
+/* A decoder context is made for one codec, switching means opening a new one */
+static bool video_renderer_ffmpeg_set_codec(video_renderer_t *renderer, video_codec_t codec) {
+    video_renderer_ffmpeg_t *r = (video_renderer_ffmpeg_t *)renderer;
+    if (codec == r->codec_id && r->codec) {
+        return true;
+    }
+    // The picture on screen holds a reference to its surface, and so to the device, until it is replaced
+    video_renderer_ffmpeg_close_decoder(r);
+    if (video_renderer_ffmpeg_open_decoder(r, codec) < 0) {
+        video_renderer_ffmpeg_close_decoder(r);
+        return false;
+    }
+    return true;
+}
+
+static void video_renderer_ffmpeg_flush(video_renderer_t *renderer) {
+    video_renderer_ffmpeg_t *r = (video_renderer_ffmpeg_t *)renderer;
+    // The picture on screen stays there until the next stream replaces it
+    if (r->codec) avcodec_flush_buffers(r->codec);
+    r->base.decoder_ready_time = 0;
+    r->base.first_render_time = 0;
+}
+
+static void video_renderer_ffmpeg_destroy(video_renderer_t *renderer) {
+    video_renderer_ffmpeg_t *r = (video_renderer_ffmpeg_t *)renderer;
+    if (!r) {
+        return;
+    }
+    if (r->drm_fd != -1 && r->shown_fb_id) {
+        drmModeSetPlane(r->drm_fd, r->plane_id, r->crtc_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    }
+    video_renderer_ffmpeg_release_shown(r);
+    if (r->drm_fd != -1) {
+        video_renderer_ffmpeg_free_dumb(r);
+#if defined(HAS_EGL_PRESENTER)
+        egl_presenter_destroy(r->egl);
+#endif
+        close(r->drm_fd);
+    }
+    av_packet_free(&r->packet);
+    av_frame_free(&r->frame);
+    av_frame_free(&r->sw_frame);
+    video_renderer_ffmpeg_close_decoder(r);
+    free(r);
+}
+
+static void video_renderer_ffmpeg_update_background(video_renderer_t *renderer, int type) {
+
+}
+
+/* The plane switches to a new picture at the next vblank, so pictures are best handed over just before one */
+static uint64_t video_renderer_ffmpeg_next_vsync(video_renderer_t *renderer, uint64_t time) {
+    video_renderer_ffmpeg_t *r = (video_renderer_ffmpeg_t *)renderer;
+    if (r->drm_fd == -1 || !r->vblank_period) {
+        return time;
+    }
+    drmVBlank vblank;
+    memset(&vblank, 0, sizeof(vblank));
+    vblank.request.type = DRM_VBLANK_RELATIVE | r->vblank_pipe;
+    vblank.request.sequence = 0;
+    if (drmWaitVBlank(r->drm_fd, &vblank)) {
+        return time;
+    }
+    // vblank times are on the monotonic clock, MEDIA_CLOCK like the local times
+    uint64_t last = (uint64_t) vblank.reply.tval_sec * 1000000 + vblank.reply.tval_usec;
+    if (time <= last) {
+        return time;
+    }
+    return last + (time - last + r->vblank_period - 1) / r->vblank_period * r->vblank_period;
+}
+
+static const video_renderer_funcs_t video_renderer_ffmpeg_funcs = {
+    .start = video_renderer_ffmpeg_start,
+    .render_buffer = video_renderer_ffmpeg_render_buffer,
+    .next_vsync = video_renderer_ffmpeg_next_vsync,
+    .set_codec = video_renderer_ffmpeg_set_codec,
+    .flush = video_renderer_ffmpeg_flush,
+    .destroy = video_renderer_ffmpeg_destroy,
+    .update_background = video_renderer_ffmpeg_update_background,
+};
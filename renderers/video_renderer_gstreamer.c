@@ -17,41 +17,344 @@
  * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
  */
 
-#include "video_renderer.h"
+#include "video_renderer_gstreamer.h"
 #include <assert.h>
 #include <gst/gst.h>
 #include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "gstreamer_frame_pool.h"
+#include "gstreamer_clock.h"
+#include "gstreamer_registry.h"
+#include "../lib/timecode.h"
+#include "../lib/histogram.h"
+#include "frame_stages.h"
+
+// Frames the mirror thread may decrypt into GStreamer owned memory, more fall back to copying
+#define VIDEO_FRAME_POOL_SIZE 16
+// What an appsrc queues for a sink that falls behind, a handful of large frames, before pushes block
+#define VIDEO_SOURCE_MAX_BYTES (2 * 1024 * 1024)
 
 typedef struct video_renderer_gstreamer_s {
     video_renderer_t base;
     GstElement *appsrc, *pipeline, *sink;
+    // With H.265, a source and decoder per codec, and the selector pad each decoder feeds
+    GstElement *sources[2];
+    GstElement *selector;
+    GstPad *selector_pads[2];
+    // What decoded frames are linked to, the latency queue in front of the sink when synced
+    GstElement *display;
+    gstreamer_frame_pool_t *frame_pool;
+    // From the enough-data of the source to its next need-data, see video_renderer_gstreamer_watch_source
+    atomic_bool congested;
+    // Frames play at their pts plus the latency target, otherwise as soon as they are decoded
+    bool synced;
+    uint64_t latency_target;
+
+    // With measure_latency, from the sender's timecode to the sink, see video_renderer_gstreamer_timecode_probe
+    bool measure_latency;
+    // raop_ntp local minus remote time as of the last frame pushed
+    atomic_llong remote_offset;
+    bool readback_failed;
+    histogram_t latency_histogram;
+    // From the appsrc to the decoder output and on to the sink, see video_renderer_gstreamer_stage_key
+    frame_stages_t stages;
+
+    // A frame the sink took, caught for a snapshot by a probe that is only there while one is asked for
+    GMutex snapshot_mutex;
+    GCond snapshot_cond;
+    GstSample *snapshot_sample;
 } video_renderer_gstreamer_t;
 
 static const video_renderer_funcs_t video_renderer_gstreamer_funcs;
 
-static gboolean check_plugins(void)
-{
-    int i;
-    gboolean ret;
-    GstRegistry *registry;
-    const gchar *needed[] = {"app", "libav", "playback", "autodetect", "videoparsersbad", NULL};
-
-    registry = gst_registry_get();
-    ret = TRUE;
-    for (i = 0; i < g_strv_length((gchar **)needed); i++) {
-        GstPlugin *plugin;
-        plugin = gst_registry_find_plugin(registry, needed[i]);
-        if (!plugin) {
-            g_print("Required gstreamer plugin '%s' not found\n", needed[i]);
-            ret = FALSE;
-            continue;
+/*
+ * The pts a buffer was pushed with. Synced frames carry it as the PTS in pipeline time, unsynced
+ * ones as the bare DTS, which a decoder may hand on as the PTS of the picture.
+ */
+static bool video_renderer_gstreamer_stage_key(video_renderer_gstreamer_t *r, GstBuffer *buffer, uint64_t *pts) {
+    if (r->synced) {
+        if (!GST_BUFFER_PTS_IS_VALID(buffer)) return false;
+        *pts = GST_BUFFER_PTS(buffer) / GST_USECOND;
+    } else if (GST_BUFFER_DTS_IS_VALID(buffer)) {
+        *pts = GST_BUFFER_DTS(buffer);
+    } else if (GST_BUFFER_PTS_IS_VALID(buffer)) {
+        *pts = GST_BUFFER_PTS(buffer);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static GstPadProbeReturn video_renderer_gstreamer_decoded_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    video_renderer_gstreamer_t *r = data;
+    uint64_t pts;
+    if (video_renderer_gstreamer_stage_key(r, GST_PAD_PROBE_INFO_BUFFER(info), &pts)) {
+        frame_stages_decoded(&r->stages, pts, raop_ntp_get_local_time(NULL));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+/* Shown when the sink takes the frame, or when it is due if the sink is synced, as with the timecode */
+static GstPadProbeReturn video_renderer_gstreamer_presented_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    video_renderer_gstreamer_t *r = data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    uint64_t shown = raop_ntp_get_local_time(NULL);
+    uint64_t pts;
+    if (!video_renderer_gstreamer_stage_key(r, buffer, &pts)) {
+        return GST_PAD_PROBE_OK;
+    }
+    if (r->synced && pts + r->latency_target > shown) {
+        shown = pts + r->latency_target;
+    }
+    frame_stages_presented(&r->stages, pts, shown);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Notes when the pictures come out of the named decoder, the src pad of decodebin is added later */
+static void video_renderer_gstreamer_probe_decoder(video_renderer_gstreamer_t *r, const char *name) {
+    GstElement *decoder = gst_bin_get_by_name(GST_BIN(r->pipeline), name);
+    GstPad *src_pad = gst_element_get_static_pad(decoder, "src");
+    if (src_pad) {
+        gst_pad_add_probe(src_pad, GST_PAD_PROBE_TYPE_BUFFER, video_renderer_gstreamer_decoded_probe, r, NULL);
+        gst_object_unref(src_pad);
+    }
+    gst_object_unref(decoder);
+}
+
+/*
+ * Links the decoder output straight to an explicitly chosen sink when the sink takes
+ * its caps, so kmssink or waylandsink can scan out the decoder's buffers (DMABUF if
+ * both sides support it). Only when they disagree is a videoconvert put in between.
+ */
+static void video_renderer_gstreamer_pad_added(GstElement *decodebin, GstPad *pad, gpointer data) {
+    video_renderer_gstreamer_t *r = data;
+    GstPad *sink_pad = gst_element_get_static_pad(r->display, "sink");
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    if (!caps) {
+        caps = gst_pad_query_caps(pad, NULL);
+    }
+
+    if (gst_pad_is_linked(sink_pad) ||
+        !g_str_has_prefix(gst_structure_get_name(gst_caps_get_structure(caps, 0)), "video/")) {
+        gst_caps_unref(caps);
+        gst_object_unref(sink_pad);
+        return;
+    }
+
+    GstCaps *sink_caps = gst_pad_query_caps(sink_pad, NULL);
+    gboolean direct = gst_caps_can_intersect(caps, sink_caps);
+    gst_caps_unref(sink_caps);
+
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, video_renderer_gstreamer_decoded_probe, r, NULL);
+    if (direct && gst_pad_link(pad, sink_pad) == GST_PAD_LINK_OK) {
+        logger_log(r->base.logger, LOGGER_INFO, "Decoder output goes straight to the video sink");
+    } else {
+        GstElement *convert = gst_element_factory_make("videoconvert", NULL);
+        GstPad *convert_pad = gst_element_get_static_pad(convert, "sink");
+        gst_bin_add(GST_BIN(r->pipeline), convert);
+        gst_element_link(convert, r->display);
+        gst_element_sync_state_with_parent(convert);
+        if (gst_pad_link(pad, convert_pad) != GST_PAD_LINK_OK) {
+            logger_log(r->base.logger, LOGGER_ERR, "Could not link decoder output to the video sink");
+        } else {
+            logger_log(r->base.logger, LOGGER_INFO, "Video sink cannot take the decoder output, converting it");
+        }
+        gst_object_unref(convert_pad);
+    }
+    gst_caps_unref(caps);
+    gst_object_unref(sink_pad);
+}
+
+/*
+ * Reads the sender's timecode back from every frame the sink is handed. A synced sink holds
+ * the frame until its running time plus the latency target, which is raop_ntp local time, so
+ * that is when it shows up, an unsynced one shows it right away. Scanout is not accounted for.
+ */
+static GstPadProbeReturn video_renderer_gstreamer_timecode_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    video_renderer_gstreamer_t *r = data;
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    uint64_t shown = raop_ntp_get_local_time(NULL);
+    if (r->readback_failed) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    GstVideoInfo video_info;
+    GstVideoFrame frame;
+    bool mapped = caps && gst_video_info_from_caps(&video_info, caps) &&
+                  GST_VIDEO_INFO_COMP_DEPTH(&video_info, 0) == 8 &&
+                  gst_video_frame_map(&frame, &video_info, buffer, GST_MAP_READ);
+    if (caps) gst_caps_unref(caps);
+    if (!mapped) {
+        logger_log(r->base.logger, LOGGER_WARNING, "Cannot read back the frames the video sink takes, "
+                   "no latency is measured");
+        r->readback_failed = true;
+        return GST_PAD_PROBE_OK;
+    }
+    uint64_t remote_time;
+    bool found = timecode_read(GST_VIDEO_FRAME_COMP_DATA(&frame, 0), GST_VIDEO_FRAME_WIDTH(&frame),
+                               GST_VIDEO_FRAME_HEIGHT(&frame), GST_VIDEO_FRAME_COMP_STRIDE(&frame, 0),
+                               GST_VIDEO_FRAME_COMP_PSTRIDE(&frame, 0), &remote_time);
+    gst_video_frame_unmap(&frame);
+    if (!found) {
+        return GST_PAD_PROBE_OK;
+    }
+
+    if (r->synced && GST_BUFFER_PTS_IS_VALID(buffer)) {
+        uint64_t due = GST_BUFFER_PTS(buffer) / GST_USECOND + r->latency_target;
+        if (due > shown) shown = due;
+    }
+    uint64_t sent = remote_time + atomic_load_explicit(&r->remote_offset, memory_order_relaxed);
+    histogram_record(&r->latency_histogram, shown > sent ? shown - sent : 0);
+    return GST_PAD_PROBE_OK;
+}
+
+/* Takes the next frame the sink is handed for video_renderer_gstreamer_snapshot and removes itself */
+static GstPadProbeReturn video_renderer_gstreamer_snapshot_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data) {
+    video_renderer_gstreamer_t *r = data;
+    GstCaps *caps = gst_pad_get_current_caps(pad);
+    g_mutex_lock(&r->snapshot_mutex);
+    if (!r->snapshot_sample && caps) {
+        r->snapshot_sample = gst_sample_new(GST_PAD_PROBE_INFO_BUFFER(info), caps, NULL, NULL);
+        g_cond_signal(&r->snapshot_cond);
+    }
+    g_mutex_unlock(&r->snapshot_mutex);
+    if (caps) gst_caps_unref(caps);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+static void video_renderer_gstreamer_log_latency(video_renderer_gstreamer_t *r) {
+    if (r->measure_latency && atomic_load(&r->latency_histogram.total) > 0) {
+        histogram_log(&r->latency_histogram, r->base.logger, LOGGER_INFO, "video glass-to-glass");
+    }
+    frame_stages_log(&r->stages, r->base.logger);
+}
+
+static const gchar *const required_plugins[] = {"app", "playback", "autodetect", "videoparsersbad", NULL};
+
+#define DEFAULT_VIDEO_DECODERS GSTREAMER_H264_DECODERS
+#define DEFAULT_HEVC_DECODERS GSTREAMER_H265_DECODERS
+
+#define H264_CAPS "video/x-h264,stream-format=byte-stream,alignment=au"
+#define H265_CAPS "video/x-h265,stream-format=byte-stream,alignment=au"
+
+/* Whether the sink accepts any of the formats the decoder can put out, without a conversion */
+static gboolean video_renderer_gstreamer_caps_match(const char *decoder_name, const char *sink_name) {
+    GstElement *decoder = gst_element_factory_make(decoder_name, NULL);
+    GstElement *sink = gst_element_factory_make(sink_name, NULL);
+    gboolean match = FALSE;
+    if (decoder && sink) {
+        GstPad *src_pad = gst_element_get_static_pad(decoder, "src");
+        GstPad *sink_pad = gst_element_get_static_pad(sink, "sink");
+        if (src_pad && sink_pad) {
+            GstCaps *src_caps = gst_pad_query_caps(src_pad, NULL);
+            GstCaps *sink_caps = gst_pad_query_caps(sink_pad, NULL);
+            match = gst_caps_can_intersect(src_caps, sink_caps);
+            gst_caps_unref(src_caps);
+            gst_caps_unref(sink_caps);
         }
-        gst_object_unref(plugin);
+        if (src_pad) gst_object_unref(src_pad);
+        if (sink_pad) gst_object_unref(sink_pad);
+    }
+    if (decoder) gst_object_unref(gst_object_ref_sink(decoder));
+    if (sink) gst_object_unref(gst_object_ref_sink(sink));
+    return match;
+}
+
+/*
+ * The GstVideoOrientationMethod turning the picture clockwise by the rotation and then flipping it,
+ * in one step. videoflip, glvideoflip and the rotate-method of sinks all take its values. -1 for
+ * a rotation that is no multiple of 90 degrees.
+ */
+static int video_renderer_gstreamer_orientation(video_renderer_config_t const *config) {
+    // Rows are the rotation, columns the flip: none, horizontal, vertical, both
+    static const int methods[4][4] = {
+        {GST_VIDEO_ORIENTATION_IDENTITY, GST_VIDEO_ORIENTATION_HORIZ, GST_VIDEO_ORIENTATION_VERT, GST_VIDEO_ORIENTATION_180},
+        {GST_VIDEO_ORIENTATION_90R, GST_VIDEO_ORIENTATION_UL_LR, GST_VIDEO_ORIENTATION_UR_LL, GST_VIDEO_ORIENTATION_90L},
+        {GST_VIDEO_ORIENTATION_180, GST_VIDEO_ORIENTATION_VERT, GST_VIDEO_ORIENTATION_HORIZ, GST_VIDEO_ORIENTATION_IDENTITY},
+        {GST_VIDEO_ORIENTATION_90L, GST_VIDEO_ORIENTATION_UR_LL, GST_VIDEO_ORIENTATION_UL_LR, GST_VIDEO_ORIENTATION_90R},
+    };
+    int rotation = ((config->rotation % 360) + 360) % 360;
+    if (rotation % 90) {
+        return -1;
+    }
+    int flip = config->flip == FLIP_HORIZONTAL ? 1 : config->flip == FLIP_VERTICAL ? 2 : config->flip == FLIP_BOTH ? 3 : 0;
+    return methods[rotation / 90][flip];
+}
+
+/* Whether the element exists and has the property */
+static gboolean video_renderer_gstreamer_has_property(const char *element_name, const char *property) {
+    GstElement *element = gst_element_factory_make(element_name, NULL);
+    if (!element) {
+        return FALSE;
+    }
+    gboolean found = g_object_class_find_property(G_OBJECT_GET_CLASS(element), property) != NULL;
+    gst_object_unref(gst_object_ref_sink(element));
+    return found;
+}
+
+/*
+ * Properties for a software decoder from gst-libav, which threads by frames by default and so
+ * holds back a frame per thread. Slice threads add no delay; frames of a single slice then decode
+ * on one core, which a Raspberry Pi 5 core does at 1080p60.
+ */
+static const char *video_renderer_gstreamer_decoder_options(const char *decoder) {
+    if (g_str_has_prefix(decoder, "avdec_") && video_renderer_gstreamer_has_property(decoder, "thread-type")) {
+        return " thread-type=slice";
     }
-    return ret;
+    return "";
 }
 
+static gboolean video_renderer_gstreamer_has_element(const char *element_name) {
+    GstElementFactory *factory = gst_element_factory_find(element_name);
+    if (factory) {
+        gst_object_unref(factory);
+    }
+    return factory != NULL;
+}
+
+/* The input-selector pad the decoder of that name is linked to */
+static GstPad *video_renderer_gstreamer_selector_pad(GstElement *pipeline, const char *decoder_name) {
+    GstElement *decoder = gst_bin_get_by_name(GST_BIN(pipeline), decoder_name);
+    GstPad *src_pad = gst_element_get_static_pad(decoder, "src");
+    GstPad *selector_pad = gst_pad_get_peer(src_pad);
+    gst_object_unref(src_pad);
+    gst_object_unref(decoder);
+    return selector_pad;
+}
+
+static void video_renderer_gstreamer_need_data(GstAppSrc *source, guint length, gpointer data) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *) data;
+    atomic_store_explicit(&r->congested, false, memory_order_relaxed);
+}
+
+static void video_renderer_gstreamer_enough_data(GstAppSrc *source, gpointer data) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *) data;
+    atomic_store_explicit(&r->congested, true, memory_order_relaxed);
+}
+
+/*
+ * Bounds what the source queues for a slow sink. Once it is full it says enough-data, and
+ * is_congested has the mirror drop frames the others do not depend on; a frame pushed anyway
+ * blocks until there is room, so frames queue up in front of the mirror's latency budget
+ * instead of in memory.
+ */
+static void video_renderer_gstreamer_watch_source(video_renderer_gstreamer_t *r, GstElement *source) {
+    g_object_set(source, "max-bytes", (guint64) VIDEO_SOURCE_MAX_BYTES, "block", TRUE, NULL);
+    g_signal_connect(source, "need-data", G_CALLBACK(video_renderer_gstreamer_need_data), r);
+    g_signal_connect(source, "enough-data", G_CALLBACK(video_renderer_gstreamer_enough_data), r);
+}
+
+typedef enum video_renderer_gstreamer_orient_e {
+    ORIENT_NONE,
+    ORIENT_SINK, // The sink turns the picture as it draws it, at no cost
+    ORIENT_GL,   // glvideoflip on the GPU, in front of a GL sink
+    ORIENT_CPU   // videoflip, which copies every frame
+} video_renderer_gstreamer_orient_t;
+
 video_renderer_t *video_renderer_gstreamer_init(logger_t *logger, video_renderer_config_t const *config) {
     video_renderer_gstreamer_t *renderer;
     GError *error = NULL;
@@ -59,67 +362,192 @@ video_renderer_t *video_renderer_gstreamer_init(logger_t *logger, video_renderer
     renderer = calloc(1, sizeof(video_renderer_gstreamer_t));
     assert(renderer);
 
-    gst_init(NULL, NULL);
+    // Usually prewarmed by the audio renderer, see gstreamer_registry.h
+    gstreamer_registry_wait();
 
     renderer->base.logger = logger;
     renderer->base.funcs = &video_renderer_gstreamer_funcs;
     renderer->base.type = VIDEO_RENDERER_GSTREAMER;
 
-    assert(check_plugins());
-
-    // Begin the video pipeline
-    GString *launch = g_string_new("appsrc name=video_source stream-type=0 format=GST_FORMAT_TIME is-live=true !"
-                                   "queue ! decodebin ! videoconvert ! ");
-    // Setup rotation
-    if (config->rotation != 0) {
-        switch (config->rotation) {
-        case 90:
-        case -270:
-            g_string_append(launch, "videoflip method=clockwise ! ");
-            break;
-        case -90:
-        case 270:
-            g_string_append(launch, "videoflip method=counterclockwise ! ");
-            break;
-        case 180:
-        case -180:
-            g_string_append(launch, "videoflip method=rotate-180 ! ");
-            break;
-        default:
-            printf("Error: Rotation must be +/- 0,90,180,270\n");
-            g_string_free(launch, TRUE);
+    assert(gstreamer_registry_has_plugins(required_plugins));
+
+    renderer->frame_pool = gstreamer_frame_pool_init(logger, VIDEO_FRAME_POOL_SIZE);
+    assert(renderer->frame_pool);
+    renderer->synced = !config->low_latency;
+    renderer->latency_target = (uint64_t) config->latency_target * 1000;
+    renderer->measure_latency = config->measure_latency;
+    atomic_init(&renderer->remote_offset, 0);
+    atomic_init(&renderer->congested, false);
+    histogram_init(&renderer->latency_histogram);
+    frame_stages_init(&renderer->stages);
+    g_mutex_init(&renderer->snapshot_mutex);
+    g_cond_init(&renderer->snapshot_cond);
+    if (config->video_sink) {
+        GstElementFactory *factory = gst_element_factory_find(config->video_sink);
+        if (!factory) {
+            logger_log(logger, LOGGER_ERR, "GStreamer video sink %s not found", config->video_sink);
+            gstreamer_frame_pool_destroy(renderer->frame_pool);
             free(renderer);
             return NULL;
         }
+        gst_object_unref(factory);
     }
 
-    // Setup flip
-    if (config->flip != FLIP_NONE) {
-        switch (config->flip) {
-        case FLIP_HORIZONTAL:
-            g_string_append(launch, "videoflip method=horizontal-flip ! ");
-            break;
-        case FLIP_VERTICAL:
-            g_string_append(launch, "videoflip method=vertical-flip ! ");
-            break;
-        case FLIP_BOTH:
-            g_string_append(launch, "videoflip method=rotate-180 ! ");
-            break;
-        case FLIP_NONE:
-        default:
-            break;
+    int orientation = video_renderer_gstreamer_orientation(config);
+    if (orientation < 0) {
+        printf("Error: Rotation must be +/- 0,90,180,270\n");
+        gstreamer_frame_pool_destroy(renderer->frame_pool);
+        free(renderer);
+        return NULL;
+    }
+
+    // The cheapest way to rotate and flip first: a sink with a rotate-method, then GL, then the CPU
+    const char *sink_name = config->video_sink ? config->video_sink : "autovideosink";
+    video_renderer_gstreamer_orient_t orient = ORIENT_NONE;
+    if (orientation != GST_VIDEO_ORIENTATION_IDENTITY) {
+        // autovideosink hides which sink it picks, glimagesink stands in for it when rotating
+        const char *candidate = config->video_sink ? config->video_sink : "glimagesink";
+        bool gl_sink = g_str_has_prefix(candidate, "gl") && video_renderer_gstreamer_has_element(candidate);
+        if (video_renderer_gstreamer_has_property(candidate, "rotate-method")) {
+            orient = ORIENT_SINK;
+            sink_name = candidate;
+        } else if (gl_sink && video_renderer_gstreamer_has_element("glvideoflip")) {
+            orient = ORIENT_GL;
+            sink_name = candidate;
+        } else {
+            orient = ORIENT_CPU;
         }
+        logger_log(logger, LOGGER_INFO, "Rotating and flipping %s", orient == ORIENT_SINK ? "in the video sink" :
+                   orient == ORIENT_GL ? "on the GPU" : "on the CPU");
+    }
+    if (config->measure_latency && (orient == ORIENT_GL || orient == ORIENT_CPU)) {
+        logger_log(logger, LOGGER_WARNING, "The timecode cannot be read from rotated or flipped frames");
     }
 
-    // Finish the pipeline
-    g_string_append(launch, "autovideosink name=video_sink sync=false");
+    // An explicit sink takes the decoder output as is if it can, unless frames have to be transformed.
+    // So does a GL sink rotating by itself, which uploads whatever it gets.
+    bool direct_sink = (config->video_sink || orient == ORIENT_SINK) && (orient == ORIENT_NONE || orient == ORIENT_SINK);
+
+    gchar *decoder = gstreamer_registry_find_element(config->video_decoders ? config->video_decoders :
+                                                    DEFAULT_VIDEO_DECODERS, H264_CAPS, GST_PAD_SINK);
+    if (decoder) {
+        logger_log(logger, LOGGER_INFO, "Using GStreamer H.264 decoder %s", decoder);
+    } else {
+        logger_log(logger, LOGGER_WARNING, "None of the preferred H.264 decoders is installed, letting decodebin pick one");
+    }
+
+    // H.265 gets a source and decoder of its own, and a selector picks which decoder the display shows
+    gchar *hevc_decoder = NULL;
+    if (config->hevc && !decoder) {
+        logger_log(logger, LOGGER_WARNING, "H.265 needs a known H.264 decoder as well, leaving it out");
+    } else if (config->hevc) {
+        if (config->video_decoders) {
+            hevc_decoder = gstreamer_registry_find_element(config->video_decoders, H265_CAPS, GST_PAD_SINK);
+        }
+        if (!hevc_decoder) {
+            hevc_decoder = gstreamer_registry_find_element(DEFAULT_HEVC_DECODERS, H265_CAPS, GST_PAD_SINK);
+        }
+        if (hevc_decoder && video_renderer_gstreamer_has_element("h265parse") &&
+            video_renderer_gstreamer_has_element("input-selector")) {
+            logger_log(logger, LOGGER_INFO, "Using GStreamer H.265 decoder %s", hevc_decoder);
+        } else {
+            logger_log(logger, LOGGER_WARNING, "No H.265 decoder is installed, mirroring in H.264 only");
+            g_free(hevc_decoder);
+            hevc_decoder = NULL;
+        }
+    }
+
+    // Begin the video pipeline. Mirror frames are whole access units in Annex-B, saying so skips typefinding
+    GString *launch = g_string_new(NULL);
+    if (hevc_decoder) {
+        // The sources link to the selector further down
+        g_string_append(launch, "input-selector name=video_select sync-streams=false ");
+    } else {
+        g_string_append(launch, "appsrc name=video_source stream-type=0 format=GST_FORMAT_TIME is-live=true "
+                                "caps=" H264_CAPS " ! queue ! ");
+        if (decoder) {
+            g_string_append_printf(launch, "h264parse ! %s name=video_decoder%s ", decoder,
+                                   video_renderer_gstreamer_decoder_options(decoder));
+        } else {
+            g_string_append(launch, "decodebin name=video_decoder ");
+        }
+    }
+    // decodebin only knows its output once it plugged a decoder, the sink is linked from pad-added then
+    bool link_later = direct_sink && !decoder;
+    if (orient == ORIENT_GL) {
+        // glupload takes the decoder output in any format and memory it can, so nothing is converted on the CPU
+        g_string_append_printf(launch, "! glupload ! glcolorconvert ! glvideoflip method=%d ! ", orientation);
+    } else if (!direct_sink || (decoder && !video_renderer_gstreamer_caps_match(decoder, sink_name)) ||
+               (hevc_decoder && !video_renderer_gstreamer_caps_match(hevc_decoder, sink_name))) {
+        g_string_append(launch, "! videoconvert ! ");
+    } else if (decoder) {
+        g_string_append(launch, "! ");
+    }
+    if (orient == ORIENT_CPU) {
+        g_string_append_printf(launch, "videoflip method=%d ! ", orientation);
+    }
+
+    // Finish the pipeline. Synced, decoded frames queue up for the sink at most the latency target,
+    // older ones are dropped so a slow sink cannot make the latency grow
+    if (renderer->synced) {
+        g_string_append_printf(launch, "queue name=video_display max-size-buffers=0 max-size-bytes=0 "
+                               "max-size-time=%llu leaky=downstream ! ",
+                               (unsigned long long) config->latency_target * GST_MSECOND);
+    }
+    g_string_append_printf(launch, "%s name=video_sink sync=%s", sink_name, renderer->synced ? "true" : "false");
+    if (orient == ORIENT_SINK) {
+        g_string_append_printf(launch, " rotate-method=%d", orientation);
+    }
+    if (hevc_decoder) {
+        g_string_append_printf(launch, " appsrc name=video_source stream-type=0 format=GST_FORMAT_TIME is-live=true "
+                               "caps=" H264_CAPS " ! queue ! h264parse ! %s name=video_decoder%s ! video_select.",
+                               decoder, video_renderer_gstreamer_decoder_options(decoder));
+        g_string_append_printf(launch, " appsrc name=video_source_h265 stream-type=0 format=GST_FORMAT_TIME is-live=true "
+                               "caps=" H265_CAPS " ! queue ! h265parse ! %s name=video_decoder_h265%s ! video_select.",
+                               hevc_decoder, video_renderer_gstreamer_decoder_options(hevc_decoder));
+    }
+    g_free(decoder);
 
     renderer->pipeline = gst_parse_launch(launch->str, &error);
     g_assert(renderer->pipeline);
     g_string_free(launch, TRUE);
 
     renderer->appsrc = gst_bin_get_by_name(GST_BIN(renderer->pipeline), "video_source");
+    video_renderer_gstreamer_watch_source(renderer, renderer->appsrc);
+    if (hevc_decoder) {
+        renderer->sources[VIDEO_CODEC_H264] = renderer->appsrc;
+        renderer->sources[VIDEO_CODEC_H265] = gst_bin_get_by_name(GST_BIN(renderer->pipeline), "video_source_h265");
+        video_renderer_gstreamer_watch_source(renderer, renderer->sources[VIDEO_CODEC_H265]);
+        renderer->selector = gst_bin_get_by_name(GST_BIN(renderer->pipeline), "video_select");
+        renderer->selector_pads[VIDEO_CODEC_H264] = video_renderer_gstreamer_selector_pad(renderer->pipeline, "video_decoder");
+        renderer->selector_pads[VIDEO_CODEC_H265] = video_renderer_gstreamer_selector_pad(renderer->pipeline,
+                                                                                          "video_decoder_h265");
+        g_object_set(renderer->selector, "active-pad", renderer->selector_pads[VIDEO_CODEC_H264], NULL);
+        renderer->base.supports_hevc = true;
+        g_free(hevc_decoder);
+    }
     renderer->sink = gst_bin_get_by_name(GST_BIN(renderer->pipeline), "video_sink");
+    renderer->display = renderer->synced ? gst_bin_get_by_name(GST_BIN(renderer->pipeline), "video_display") :
+                        renderer->sink;
+    if (renderer->synced) {
+        gstreamer_clock_setup(renderer->pipeline, config->latency_target);
+    }
+    if (link_later) {
+        GstElement *decoder = gst_bin_get_by_name(GST_BIN(renderer->pipeline), "video_decoder");
+        g_signal_connect(decoder, "pad-added", G_CALLBACK(video_renderer_gstreamer_pad_added), renderer);
+        gst_object_unref(decoder);
+    }
+    video_renderer_gstreamer_probe_decoder(renderer, "video_decoder");
+    if (renderer->selector) {
+        video_renderer_gstreamer_probe_decoder(renderer, "video_decoder_h265");
+    }
+    GstPad *sink_pad = gst_element_get_static_pad(renderer->sink, "sink");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, video_renderer_gstreamer_presented_probe, renderer, NULL);
+    if (config->measure_latency) {
+        gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, video_renderer_gstreamer_timecode_probe, renderer, NULL);
+        logger_log(logger, LOGGER_INFO, "Measuring glass-to-glass latency from the timecode of rpiplay_loadgen -tc");
+    }
+    gst_object_unref(sink_pad);
 
     return &renderer->base;
 }
@@ -129,7 +557,42 @@ static void video_renderer_gstreamer_start(video_renderer_t *renderer) {
     gst_element_set_state(r->pipeline, GST_STATE_PLAYING);
 }
 
-static void video_renderer_gstreamer_render_buffer(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts, int type) {
+/* Between mirrors, READY lets go of the sink and decoder but keeps the pipeline for the next one */
+static void video_renderer_gstreamer_stop(video_renderer_t *renderer) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
+    gst_element_set_state(r->pipeline, GST_STATE_READY);
+    video_renderer_gstreamer_log_latency(r);
+}
+
+/*
+ * PAUSED keeps the decoder and the last picture of the sink. The base time is pinned when
+ * synced, so the frames after PLAYING are due as before; unsynced ones are shown right away.
+ */
+static void video_renderer_gstreamer_pause(video_renderer_t *renderer, bool paused) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
+    gst_element_set_state(r->pipeline, paused ? GST_STATE_PAUSED : GST_STATE_PLAYING);
+}
+
+/* The timecode probe runs on a streaming thread the connection's raop_ntp may be gone for by then */
+static void video_renderer_gstreamer_track_clock(video_renderer_gstreamer_t *r, raop_ntp_t *ntp) {
+    uint64_t now = raop_ntp_get_local_time(ntp);
+    atomic_store_explicit(&r->remote_offset, (long long) (now - raop_ntp_convert_local_time(ntp, now)),
+                          memory_order_relaxed);
+}
+
+static void video_renderer_gstreamer_push(video_renderer_gstreamer_t *r, GstBuffer *buffer, uint64_t pts) {
+    if (!r->synced) {
+        GST_BUFFER_DTS(buffer) = (GstClockTime)pts;
+    } else if (pts) {
+        // Parameter sets carry no time and go with the next frame
+        GST_BUFFER_PTS(buffer) = gstreamer_clock_pts(pts);
+    }
+    frame_stages_submitted(&r->stages, pts, raop_ntp_get_local_time(NULL));
+    gst_app_src_push_buffer(GST_APP_SRC(r->appsrc), buffer);
+}
+
+static void video_renderer_gstreamer_render_buffer(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts, int type,
+                                                   h264_nal_index_t const *nal_index) {
     video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
     GstBuffer *buffer;
 
@@ -137,20 +600,88 @@ static void video_renderer_gstreamer_render_buffer(video_renderer_t *renderer, r
 
     buffer = gst_buffer_new_and_alloc(data_len);
     assert(buffer != NULL);
-    GST_BUFFER_DTS(buffer) = (GstClockTime)pts;
     gst_buffer_fill(buffer, 0, data, data_len);
-    gst_app_src_push_buffer(GST_APP_SRC(r->appsrc), buffer);
+    if (r->measure_latency) video_renderer_gstreamer_track_clock(r, ntp);
+    video_renderer_gstreamer_push(r, buffer, pts);
 }
 
-void video_renderer_gstreamer_flush(video_renderer_t *renderer) {
+/*
+ * Zero-copy input: the mirror thread decrypts frames into pool memory, which is wrapped
+ * into a GstBuffer as is and goes back to the pool once the pipeline is done with it.
+ */
+static unsigned char *video_renderer_gstreamer_acquire_buffer(video_renderer_t *renderer, int size, void **handle) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
+    return gstreamer_frame_pool_acquire(r->frame_pool, size, handle);
+}
+
+static void video_renderer_gstreamer_render_acquired(video_renderer_t *renderer, raop_ntp_t *ntp, void *handle, int data_len,
+                                                     uint64_t pts, h264_nal_index_t const *nal_index) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
+    GstBuffer *buffer = gstreamer_frame_pool_wrap(r->frame_pool, handle, data_len);
+    assert(buffer != NULL);
+    if (r->measure_latency) video_renderer_gstreamer_track_clock(r, ntp);
+    video_renderer_gstreamer_push(r, buffer, pts);
+}
+
+static void video_renderer_gstreamer_release_buffer(video_renderer_t *renderer, void *handle) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
+    gstreamer_frame_pool_release(r->frame_pool, handle);
+}
+
+static bool video_renderer_gstreamer_is_congested(video_renderer_t *renderer) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
+    return atomic_load_explicit(&r->congested, memory_order_relaxed);
+}
+
+/* Both decoders are always there, frames just go to the other source and the selector shows its decoder */
+static bool video_renderer_gstreamer_set_codec(video_renderer_t *renderer, video_codec_t codec) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
+    if (!r->selector) {
+        return codec == VIDEO_CODEC_H264;
+    }
+    if (r->appsrc != r->sources[codec]) {
+        r->appsrc = r->sources[codec];
+        g_object_set(r->selector, "active-pad", r->selector_pads[codec], NULL);
+        logger_log(renderer->logger, LOGGER_INFO, "Decoding %s", codec == VIDEO_CODEC_H265 ? "H.265" : "H.264");
+    }
+    return true;
+}
+
+GstElement *video_renderer_gstreamer_get_pipeline(video_renderer_t *renderer) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
+    assert(renderer->type == VIDEO_RENDERER_GSTREAMER);
+    return r->pipeline;
+}
 
+void video_renderer_gstreamer_flush(video_renderer_t *renderer) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
+    // Timestamps are absolute, so the running time must not be reset
+    gst_element_send_event(r->pipeline, gst_event_new_flush_start());
+    gst_element_send_event(r->pipeline, gst_event_new_flush_stop(FALSE));
+    // The flush emptied the sources
+    atomic_store_explicit(&r->congested, false, memory_order_relaxed);
+    frame_stages_flush(&r->stages);
+    video_renderer_gstreamer_log_latency(r);
 }
 
 void video_renderer_gstreamer_destroy(video_renderer_t *renderer) {
     video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
     gst_app_src_end_of_stream(GST_APP_SRC(r->appsrc));
     gst_element_set_state(r->pipeline, GST_STATE_NULL);
+    if (r->selector) {
+        gst_object_unref(r->selector_pads[VIDEO_CODEC_H264]);
+        gst_object_unref(r->selector_pads[VIDEO_CODEC_H265]);
+        gst_object_unref(r->selector);
+        gst_object_unref(r->sources[VIDEO_CODEC_H265]);
+    }
     gst_object_unref(r->pipeline);
+    video_renderer_gstreamer_log_latency(r);
+    // The pipeline dropped its buffers on the way to NULL, so every pooled frame is back
+    gstreamer_frame_pool_destroy(r->frame_pool);
+    g_clear_pointer(&r->snapshot_sample, gst_sample_unref);
+    g_cond_clear(&r->snapshot_cond);
+    g_mutex_clear(&r->snapshot_mutex);
+    frame_stages_destroy(&r->stages);
     if (renderer) {
         free(renderer);
     }
@@ -160,10 +691,74 @@ void video_renderer_gstreamer_update_background(video_renderer_t *renderer, int
 
 }
 
+/*
+ * Catches the next frame at the sink with a one-shot probe and scales and encodes it with
+ * gst_video_convert_sample, off the streaming thread. Nothing is added to the pipeline for it,
+ * so the decoder keeps negotiating straight with the sink, and frames pay nothing in between.
+ */
+static int video_renderer_gstreamer_snapshot(video_renderer_t *renderer, int width, int height, int timeout_ms,
+                                             unsigned char **jpeg) {
+    video_renderer_gstreamer_t *r = (video_renderer_gstreamer_t *)renderer;
+    GstPad *sink_pad = gst_element_get_static_pad(r->sink, "sink");
+    gint64 deadline = g_get_monotonic_time() + (gint64) timeout_ms * G_TIME_SPAN_MILLISECOND;
+
+    g_mutex_lock(&r->snapshot_mutex);
+    // One a timed out request caught after all would be stale by now
+    g_clear_pointer(&r->snapshot_sample, gst_sample_unref);
+    gulong probe = gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, video_renderer_gstreamer_snapshot_probe,
+                                     r, NULL);
+    while (!r->snapshot_sample && g_cond_wait_until(&r->snapshot_cond, &r->snapshot_mutex, deadline));
+    GstSample *sample = r->snapshot_sample;
+    r->snapshot_sample = NULL;
+    g_mutex_unlock(&r->snapshot_mutex);
+    if (!sample) {
+        // No frame came, the probe is still there
+        gst_pad_remove_probe(sink_pad, probe);
+    }
+    gst_object_unref(sink_pad);
+    if (!sample) {
+        return -1;
+    }
+
+    GstCaps *caps = gst_caps_new_simple("image/jpeg", "width", G_TYPE_INT, width, "height", G_TYPE_INT, height, NULL);
+    GError *error = NULL;
+    GstSample *converted = gst_video_convert_sample(sample, caps, (GstClockTime) timeout_ms * GST_MSECOND, &error);
+    gst_caps_unref(caps);
+    gst_sample_unref(sample);
+    if (!converted) {
+        logger_log(renderer->logger, LOGGER_WARNING, "Could not encode a snapshot: %s",
+                   error ? error->message : "unknown error");
+        g_clear_error(&error);
+        return -1;
+    }
+
+    GstMapInfo map;
+    int size = -1;
+    GstBuffer *buffer = gst_sample_get_buffer(converted);
+    if (buffer && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        *jpeg = malloc(map.size);
+        if (*jpeg) {
+            memcpy(*jpeg, map.data, map.size);
+            size = (int) map.size;
+        }
+        gst_buffer_unmap(buffer, &map);
+    }
+    gst_sample_unref(converted);
+    return size;
+}
+
 static const video_renderer_funcs_t video_renderer_gstreamer_funcs = {
     .start = video_renderer_gstreamer_start,
+    .stop = video_renderer_gstreamer_stop,
     .render_buffer = video_renderer_gstreamer_render_buffer,
+    .acquire_buffer = video_renderer_gstreamer_acquire_buffer,
+    .render_acquired = video_renderer_gstreamer_render_acquired,
+    .release_buffer = video_renderer_gstreamer_release_buffer,
+    .is_congested = video_renderer_gstreamer_is_congested,
+    .set_codec = video_renderer_gstreamer_set_codec,
+    .pause = video_renderer_gstreamer_pause,
     .flush = video_renderer_gstreamer_flush,
     .destroy = video_renderer_gstreamer_destroy,
     .update_background = video_renderer_gstreamer_update_background,
+    .snapshot = video_renderer_gstreamer_snapshot,
 };
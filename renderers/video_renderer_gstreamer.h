@@ -0,0 +1,32 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef VIDEO_RENDERER_GSTREAMER_H
+#define VIDEO_RENDERER_GSTREAMER_H
+
+#include <gst/gst.h>
+#include "video_renderer.h"
+
+/*
+ * The pipeline the GStreamer video renderer plays in. The GStreamer audio renderer adds
+ * its branch to it, so both share one clock and one set of pipeline threads.
+ */
+GstElement *video_renderer_gstreamer_get_pipeline(video_renderer_t *renderer);
+
+#endif //VIDEO_RENDERER_GSTREAMER_H
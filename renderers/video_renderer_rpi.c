@@ -25,11 +25,20 @@
 #include <string.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "bcm_host.h"
 #include "ilclient.h"
 #include "../lib/threads.h"
+#include "../lib/media_clock.h"
+#include "../lib/metrics.h"
+#include "../lib/mem_account.h"
+#include "../lib/probes.h"
+#include "../lib/flight_recorder.h"
+#include "../lib/jpeg_writer.h"
 #include "h264-bitstream/h264_stream.h"
+#include "h264-bitstream/h264_sps_patch.h"
+#include "frame_stages.h"
 
 /*
  * H264 renderer using OpenMAX for hardware accelerated decoding
@@ -40,28 +49,191 @@
 #define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 #define LAYER_VIDEO 2
 #define LAYER_BACKGROUND 1
+#define MAX_DEC_FRAME_BUFFERING 4
+#define RESYNC_THRESHOLD_MS 100
+// The clock catches up with frames up to this many times the resync threshold late, later ones restart it
+#define RESYNC_LAST_RESORT_FACTOR 4
+// The SPS/PPS packet is tiny, anything larger is passed on without patching
+#define MAX_PARAMETER_SETS_SIZE 1024
+// Segments of a frame render_frame takes, two more are needed to splice in the patched SPS
+#define MAX_FRAME_SEGMENTS 16
+// Longest the render thread waits for the decoder to return an input buffer before dropping a frame
+#define INPUT_BUFFER_TIMEOUT_MS 100
+// Decoder output configurations remembered, enough for both orientations
+#define GEOMETRY_CACHE_SIZE 4
+// The clock sync compares the OMX media time with the NTP timeline this often
+#define CLOCK_SYNC_INTERVAL_US 500000
+// Offsets below this are left alone, so the clock scale does not hunt around 1.0
+#define CLOCK_SYNC_DEADBAND_US 2000
+// Larger offsets are corrected over roughly this long
+#define CLOCK_SYNC_WINDOW_US 2000000
+// Largest clock scale change per sync step and largest deviation from 1.0, in Q16
+#define CLOCK_SCALE_STEP 64
+#define CLOCK_SCALE_MAX_DEVIATION 655
+// Further behind than this the clock runs CLOCK_SCALE_CATCH_UP_DEVIATION fast until nearly back
+#define CLOCK_CATCH_UP_US 40000
+#define CLOCK_CATCH_UP_EXIT_US 10000
+#define CLOCK_SCALE_CATCH_UP_DEVIATION 1311
+#define CLOCK_SCALE_CATCH_UP_STEP 655
+#define CLOCK_SCALE_UNITY 65536
+// OMX_IndexConfigLatencyTarget of the display for live streams, as the firmware's own players use it
+#define LATENCY_TARGET_FILTER 2
+#define LATENCY_TARGET_SHIFT 3
+#define LATENCY_TARGET_SPEED -135
+#define LATENCY_TARGET_INFLECTION 500
+#define LATENCY_TARGET_ADJUST_CAP 20
+// Longest a flush waits for the end of stream marker to come out of the pipeline
+#define FLUSH_EOS_TIMEOUT_MS 1000
+// Longest a port flush is waited for, a wedged decoder may never confirm one
+#define FLUSH_PORT_TIMEOUT_MS 100
+// The decoder reports a stall once its output stopped moving for this long
+#define STALL_DETECT_MS 200
+// A stall that lasts this long while frames keep coming in is not going to clear up on its own
+#define STALL_RECOVERY_MS 500
+// Longest the decoder is kept waiting for an IDR after a recovery before it takes any frame again
+#define STALL_IDR_WAIT_MS 2000
+// Decoder chains with double_decoder, the one on the display and the standby for the next geometry
+#define DECODER_CHAINS 2
+// Longest a new geometry may take to come out of the standby decoder before the switch is given up
+#define CHAIN_SWITCH_TIMEOUT_MS 1000
+
+typedef struct video_renderer_rpi_geometry_s {
+    int width;
+    int height;
+    OMX_PARAM_PORTDEFINITIONTYPE decoder_output;
+} video_renderer_rpi_geometry_t;
+
+/*
+ * A decoder with its scheduler and display element, the clock is shared by all chains. In
+ * low-latency mode there is neither, the decoder is tunnelled straight to the display and every
+ * picture is shown as soon as it is decoded.
+ */
+typedef struct video_renderer_rpi_chain_s {
+    COMPONENT_T *video_decoder;
+    COMPONENT_T *video_renderer;
+    COMPONENT_T *video_scheduler;
+    // Decoder to scheduler, scheduler to display, clock to scheduler and the end of the list,
+    // or decoder to display and the end of the list in low-latency mode
+    TUNNEL_T tunnels[4];
+
+    // Input buffers not currently owned by the decoder, counted back up by EmptyBufferDone
+    int free_input_buffers;
+    // pts of the input buffers the decoder holds, in the order EmptyBufferDone returns them, 0 for
+    // the ones that do not end a frame. Guarded by input_mutex like free_input_buffers
+    uint64_t pending_pts[FRAME_STAGES_SLOTS];
+    unsigned int pending_head;
+    unsigned int pending_tail;
+    // Bytes of input buffers charged to MEM_TAG_OMX while they are enabled
+    long input_memory;
+    bool tunnels_ready;
+    // Set when the decoder output was configured ahead of the port settings change
+    video_renderer_rpi_geometry_t *preconfigured;
+} video_renderer_rpi_chain_t;
+
+// Clock output of each chain's scheduler, 81 goes to the audio renderer
+static const int video_renderer_rpi_clock_ports[DECODER_CHAINS] = { 80, 82 };
 
 typedef struct video_renderer_rpi_s {
     video_renderer_t base;
     video_renderer_config_t const *config;
 
-    uint16_t background_visits;
+    // Connections currently open, guarded by drain_mutex once the drain thread runs
+    int background_visits;
     DISPMANX_ELEMENT_HANDLE_T background_element;
 
     ILCLIENT_T *client;
-    COMPONENT_T *video_decoder;
-    COMPONENT_T *video_renderer;
-    COMPONENT_T *video_scheduler;
+    // NULL in low-latency mode
     COMPONENT_T *clock;
-
-    COMPONENT_T *components[5];
-    TUNNEL_T tunnels[4];
+    // The second chain only with double_decoder
+    video_renderer_rpi_chain_t chains[DECODER_CHAINS];
+    int chain_count;
+    // The chain the stream is fed to and the one on the display. They differ while a new geometry
+    // is on its way through the standby decoder, see video_renderer_rpi_begin_switch
+    video_renderer_rpi_chain_t *chain;
+    video_renderer_rpi_chain_t *shown;
+    // The chain switched away from, hidden with the next frame once the new picture covers it
+    video_renderer_rpi_chain_t *retiring;
+    uint64_t switch_time;
+
+    COMPONENT_T *components[3 * DECODER_CHAINS + 2];
+    int component_count;
 
     uint64_t first_packet_time;
     uint64_t input_frames;
+    // Q16 scale the OMX clock runs at, nudged to keep it on the NTP timeline
+    int clock_scale;
+    bool clock_catching_up;
+    uint64_t last_clock_sync;
+    // Size of each decoder input buffer, larger frames are copied in chunks
+    int input_buffer_size;
+
+    // Guards the free_input_buffers and pending_pts of the chains
+    mutex_handle_t input_mutex;
+    cond_handle_t input_cond;
+    uint64_t dropped_frames;
+
+    sps_patch_cache_t sps_patch_cache;
+
+    // Decode and present stages of the frames, see omx_empty_buffer_done
+    frame_stages_t stages;
+    // The frame whose buffers are being submitted, render thread only
+    uint64_t stage_pts;
+    // Media time of the clock minus local time in us as of the last clock sync
+    int clock_offset;
+
+    // Geometry announced by the parameter sets most recently sent to the decoder
+    int width;
+    int height;
+    video_renderer_rpi_geometry_t geometries[GEOMETRY_CACHE_SIZE];
+    int next_geometry;
+    // Set between sessions, the components stay set up and the next stream may reuse the decoder output
+    bool standby;
+
+    // Monotonic time in us the decoder output stalled at, 0 while it flows. Written by the stall callback
+    uint64_t stalled_since;
+    // Frames fed to the decoder since it stalled, a paused sender sends none and is no stall to recover from
+    int stalled_frames;
+    // Parameter sets last sent to the decoder, fed again after a recovery
+    uint8_t parameter_sets[MAX_PARAMETER_SETS_SIZE];
+    int parameter_sets_size;
+    // After a recovery frames are dropped until an IDR restarts the decoder from a clean state
+    bool waiting_for_idr;
+    uint64_t recovery_time;
+    uint64_t recoveries;
+
+    // A frame is being fed in parts by render_nals, the rest of it is dropped once one part did not fit
+    bool frame_in_parts;
+    bool dropping_parts;
+    // OMX_BUFFERFLAG_SYNCFRAME once a part of the frame held an IDR slice
+    OMX_U32 part_flags;
+
+    // Opened by the first next_vsync call, the vsync callback then keeps time of the display refresh
+    DISPMANX_DISPLAY_HANDLE_T vsync_display;
+    bool vsync_unavailable;
+    uint64_t last_vsync;
+    uint64_t vsync_period;
+
+    // Drains the stream after a session, off the RTSP thread, see video_renderer_rpi_flush,
+    // and shows or hides the background, see video_renderer_rpi_update_background
+    thread_handle_t drain_thread;
+    mutex_handle_t drain_mutex;
+    cond_handle_t drain_cond;
+    bool drain_requested;
+    bool background_requested;
+    bool drain_stopping;
+    bool draining;
+
+    // HDMI mode to go back to after a mirror ran in the 60 Hz mode, see video_renderer_rpi_switch_mode
+    bool mode_switched;
+    HDMI_MODE_T saved_hdmi_mode;
+    HDMI_RES_GROUP_T saved_group;
+    uint32_t saved_mode;
+    uint32_t saved_clock_type;
 } video_renderer_rpi_t;
 
 static const video_renderer_funcs_t video_renderer_rpi_funcs;
+static THREAD_RETVAL video_renderer_rpi_drain_thread(void *arg);
+static void video_renderer_rpi_wait_for_drain(video_renderer_rpi_t *r);
 
 /* From: https://github.com/popcornmix/omxplayer/blob/master/omxplayer.cpp#L455
  * Licensed under the GPLv2 */
@@ -110,8 +282,20 @@ static void video_renderer_rpi_remove_background(video_renderer_rpi_t *renderer)
     renderer->background_element = 0;
 }
 
-static void video_renderer_rpi_update_background(video_renderer_t *renderer, int type) {
-    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
+static void video_renderer_rpi_apply_background(video_renderer_rpi_t *r, int visits) {
+    if (r->config->background_mode == BACKGROUND_MODE_ON) {
+        video_renderer_rpi_render_background(r);
+    } else if (r->config->background_mode == BACKGROUND_MODE_AUTO) {
+        // Show background when connection is made and hide background when all connections are gone
+        if (visits > 0) {
+            video_renderer_rpi_render_background(r);
+        } else {
+            video_renderer_rpi_remove_background(r);
+        }
+    }
+}
+
+static void video_renderer_rpi_count_visits(video_renderer_rpi_t *r, int type) {
     if (type < 0) {
         r->background_visits--;
     } else if (type > 0) {
@@ -120,25 +304,38 @@ static void video_renderer_rpi_update_background(video_renderer_t *renderer, int
     if (r->background_visits < 0) {
         r->background_visits = 0;
     }
+}
 
-    if (r->config->background_mode == BACKGROUND_MODE_ON) {
-        video_renderer_rpi_render_background(r);
-    } else if (r->config->background_mode == BACKGROUND_MODE_AUTO) {
-        // Show background when connection is made and hide background when all connections are gone
-        if (r->background_visits > 0) {
-            video_renderer_rpi_render_background(r);
-        } else {
-            video_renderer_rpi_remove_background(r);
-        }
+/*
+ * Called on the httpd thread as connections come and go. The dispmanx updates wait for the
+ * compositor, so only the count is taken here and the drain thread shows or hides the
+ * background: requests made while it is busy fold into one update for the latest count.
+ */
+static void video_renderer_rpi_update_background(video_renderer_t *renderer, int type) {
+    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
+    if (!r->drain_thread) {
+        video_renderer_rpi_count_visits(r, type);
+        video_renderer_rpi_apply_background(r, r->background_visits);
+        return;
     }
+    MUTEX_LOCK(r->drain_mutex);
+    video_renderer_rpi_count_visits(r, type);
+    r->background_requested = true;
+    COND_BROADCAST(r->drain_cond);
+    MUTEX_UNLOCK(r->drain_mutex);
 }
 
 static void video_renderer_rpi_destroy_decoder(video_renderer_rpi_t *renderer) {
-    ilclient_disable_tunnel(&renderer->tunnels[0]);
-    ilclient_disable_tunnel(&renderer->tunnels[1]);
-    ilclient_disable_tunnel(&renderer->tunnels[2]);
-    ilclient_disable_port_buffers(renderer->video_decoder, 130, NULL, NULL, NULL);
-    ilclient_teardown_tunnels(renderer->tunnels);
+    for (int i = 0; i < renderer->chain_count; i++) {
+        video_renderer_rpi_chain_t *chain = &renderer->chains[i];
+        ilclient_disable_tunnel(&chain->tunnels[0]);
+        ilclient_disable_tunnel(&chain->tunnels[1]);
+        ilclient_disable_tunnel(&chain->tunnels[2]);
+        ilclient_disable_port_buffers(chain->video_decoder, 130, NULL, NULL, NULL);
+        mem_account_charge(MEM_TAG_OMX, 0, -chain->input_memory);
+        chain->input_memory = 0;
+        ilclient_teardown_tunnels(chain->tunnels);
+    }
 
     ilclient_state_transition(renderer->components, OMX_StateIdle);
     ilclient_state_transition(renderer->components, OMX_StateLoaded);
@@ -148,43 +345,221 @@ static void video_renderer_rpi_destroy_decoder(video_renderer_rpi_t *renderer) {
     ilclient_destroy(renderer->client);
 }
 
+static uint64_t video_renderer_rpi_now_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Runs on a VideoCore thread, the render thread acts on stalls, see video_renderer_rpi_recover_stall */
 static void omx_event_handler(void *userdata, COMPONENT_T *comp, OMX_U32 data) {
     video_renderer_rpi_t *renderer = (video_renderer_rpi_t *) userdata;
-    logger_log(renderer->base.logger, LOGGER_DEBUG, "Video renderer config change: %p: %d", comp, data);
+    // Only the chain being fed counts, a standby decoder has nothing to put out
+    if (comp != renderer->chain->video_decoder || data != OMX_IndexConfigBufferStall) {
+        logger_log(renderer->base.logger, LOGGER_DEBUG, "Video renderer config change: %p: %d", comp, data);
+        return;
+    }
+
+    OMX_CONFIG_BUFFERSTALLTYPE stall;
+    memset(&stall, 0, sizeof(OMX_CONFIG_BUFFERSTALLTYPE));
+    stall.nSize = sizeof(OMX_CONFIG_BUFFERSTALLTYPE);
+    stall.nVersion.nVersion = OMX_VERSION;
+    stall.nPortIndex = 131;
+    if (OMX_GetConfig(ilclient_get_handle(comp), OMX_IndexConfigBufferStall, &stall) != OMX_ErrorNone) {
+        return;
+    }
+    uint64_t now = video_renderer_rpi_now_us();
+    if (stall.bStalled) {
+        if (!ATOMIC_LOAD(renderer->stalled_since)) {
+            ATOMIC_STORE(renderer->stalled_since, now - STALL_DETECT_MS * 1000ull);
+            metrics_add(METRIC_VIDEO_DECODER_STALLS, 1);
+            flight_recorder_trigger("video decoder output stall");
+            logger_log(renderer->base.logger, LOGGER_DEBUG, "Video decoder output stalled");
+        }
+    } else {
+        uint64_t stalled_since = ATOMIC_EXCHANGE(renderer->stalled_since, 0);
+        if (stalled_since) {
+            logger_log(renderer->base.logger, LOGGER_DEBUG, "Video decoder output resumed after %llu ms",
+                       (now - stalled_since) / 1000);
+        }
+    }
 }
 
-static int video_renderer_rpi_init_decoder(video_renderer_rpi_t *renderer) {
-    memset(renderer->components, 0, sizeof(renderer->components));
-    memset(renderer->tunnels, 0, sizeof(renderer->tunnels));
+/* Refresh rate of the HDMI output in Hz, 0 if there is none */
+static double video_renderer_rpi_hdmi_refresh_rate(void) {
+    TV_DISPLAY_STATE_T state;
+    memset(&state, 0, sizeof(state));
+    if (vc_tv_get_display_state(&state) != 0 || !(state.state & (VC_HDMI_HDMI | VC_HDMI_DVI))) {
+        return 0;
+    }
+    double refresh_rate = state.display.hdmi.frame_rate;
+    // The NTSC pixel clock of the 24, 30 and 60 Hz families runs 1000/1001 slower, 60 Hz is 59.94 Hz then
+    HDMI_PROPERTY_PARAM_T clock_type;
+    memset(&clock_type, 0, sizeof(clock_type));
+    clock_type.property = HDMI_PROPERTY_PIXEL_CLOCK_TYPE;
+    if (state.display.hdmi.frame_rate % 6 == 0 && vc_tv_hdmi_get_property(&clock_type) == 0 &&
+        clock_type.param1 == HDMI_PIXEL_CLOCK_TYPE_NTSC) {
+        refresh_rate = refresh_rate * 1000 / 1001;
+    }
+    return refresh_rate;
+}
 
-    bcm_host_init();
+/*
+ * A 50 Hz or 59.94 Hz panel shows a 60 fps mirror with a frame repeated or dropped every so
+ * often, which the scheduler cannot hide. With switch_to_60hz the HDMI output runs the 60 Hz
+ * CEA mode of the same size for as long as a mirror streams, and the mode it had in between.
+ */
+static void video_renderer_rpi_switch_mode(video_renderer_rpi_t *r, bool mirroring) {
+    if (!r->config->switch_to_60hz || mirroring == r->mode_switched) {
+        return;
+    }
+    HDMI_PROPERTY_PARAM_T clock_type;
+    memset(&clock_type, 0, sizeof(clock_type));
+    clock_type.property = HDMI_PROPERTY_PIXEL_CLOCK_TYPE;
+
+    if (!mirroring) {
+        clock_type.param1 = r->saved_clock_type;
+        vc_tv_hdmi_set_property(&clock_type);
+        if (vc_tv_hdmi_power_on_explicit_new(r->saved_hdmi_mode, r->saved_group, r->saved_mode) != 0) {
+            logger_log(r->base.logger, LOGGER_ERR, "Could not switch HDMI back to its mode");
+        }
+        r->mode_switched = false;
+        return;
+    }
 
-    video_renderer_rpi_update_background(&renderer->base, 0);
+    TV_DISPLAY_STATE_T state;
+    memset(&state, 0, sizeof(state));
+    if (vc_tv_get_display_state(&state) != 0 || !(state.state & (VC_HDMI_HDMI | VC_HDMI_DVI))) {
+        return;
+    }
+    TV_SUPPORTED_MODE_NEW_T modes[TV_MAX_SUPPORTED_MODES];
+    HDMI_RES_GROUP_T preferred_group;
+    uint32_t preferred_mode;
+    int count = vc_tv_hdmi_get_supported_modes_new(HDMI_RES_GROUP_CEA, modes, TV_MAX_SUPPORTED_MODES,
+                                                   &preferred_group, &preferred_mode);
+    TV_SUPPORTED_MODE_NEW_T *mode = NULL;
+    for (int i = 0; i < count && !mode; i++) {
+        if (modes[i].width == state.display.hdmi.width && modes[i].height == state.display.hdmi.height &&
+            modes[i].frame_rate == 60 && modes[i].scan_mode == 0) {
+            mode = &modes[i];
+        }
+    }
+    if (!mode) {
+        logger_log(r->base.logger, LOGGER_INFO, "The display has no 60 Hz mode at %dx%d, keeping its mode",
+                   state.display.hdmi.width, state.display.hdmi.height);
+        return;
+    }
+    if (vc_tv_hdmi_get_property(&clock_type) != 0) {
+        clock_type.param1 = HDMI_PIXEL_CLOCK_TYPE_PAL;
+    }
+    if (state.display.hdmi.group == HDMI_RES_GROUP_CEA && state.display.hdmi.mode == mode->code &&
+        clock_type.param1 == HDMI_PIXEL_CLOCK_TYPE_PAL) {
+        return;
+    }
+    r->saved_hdmi_mode = (state.state & VC_HDMI_DVI) ? HDMI_MODE_DVI : HDMI_MODE_HDMI;
+    r->saved_group = state.display.hdmi.group;
+    r->saved_mode = state.display.hdmi.mode;
+    r->saved_clock_type = clock_type.param1;
+    double refresh_rate = video_renderer_rpi_hdmi_refresh_rate();
+
+    clock_type.param1 = HDMI_PIXEL_CLOCK_TYPE_PAL;
+    vc_tv_hdmi_set_property(&clock_type);
+    if (vc_tv_hdmi_power_on_explicit_new(r->saved_hdmi_mode, HDMI_RES_GROUP_CEA, mode->code) != 0) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not switch HDMI to CEA mode %u", mode->code);
+        clock_type.param1 = r->saved_clock_type;
+        vc_tv_hdmi_set_property(&clock_type);
+        return;
+    }
+    logger_log(r->base.logger, LOGGER_INFO, "Switched HDMI from %.2f Hz to CEA mode %u, %dx%d at 60 Hz",
+               refresh_rate, mode->code, mode->width, mode->height);
+    r->mode_switched = true;
+}
 
-    if ((renderer->client = ilclient_init()) == NULL) {
-        return -3;
+/*
+ * The tunnelled ports only tell when the decoder took the last input buffer of a frame in, which
+ * is as close to its decode time as OMX lets us see. The scheduler shows the picture once the
+ * clock's media time reaches its pts, which sync_clock keeps track of, the display of the low
+ * latency mode takes it whenever it is done and is not measured.
+ */
+static void video_renderer_rpi_frame_decoded(video_renderer_rpi_t *r, uint64_t pts) {
+    uint64_t now = raop_ntp_get_local_time(NULL);
+    frame_stages_decoded(&r->stages, pts, now);
+    if (r->clock) {
+        uint64_t shown = pts - ATOMIC_LOAD(r->clock_offset);
+        frame_stages_presented(&r->stages, pts, shown > now ? shown : now);
     }
+}
 
-    if (OMX_Init() != OMX_ErrorNone) {
-        ilclient_destroy(renderer->client);
-        return -4;
+static void omx_empty_buffer_done(void *userdata, COMPONENT_T *comp) {
+    video_renderer_rpi_t *renderer = (video_renderer_rpi_t *) userdata;
+    for (int i = 0; i < renderer->chain_count; i++) {
+        video_renderer_rpi_chain_t *chain = &renderer->chains[i];
+        if (comp == chain->video_decoder) {
+            MUTEX_LOCK(renderer->input_mutex);
+            chain->free_input_buffers++;
+            PROBE1(omx_video_return, chain->free_input_buffers);
+            uint64_t pts = 0;
+            if (chain->pending_tail != chain->pending_head) {
+                pts = chain->pending_pts[chain->pending_tail++ % FRAME_STAGES_SLOTS];
+            }
+            COND_SIGNAL(renderer->input_cond);
+            MUTEX_UNLOCK(renderer->input_mutex);
+            if (pts) {
+                video_renderer_rpi_frame_decoded(renderer, pts);
+            }
+            return;
+        }
     }
+}
+
+// The list ends at the first NULL, so it is kept without gaps
+static void video_renderer_rpi_add_component(video_renderer_rpi_t *renderer, COMPONENT_T *component) {
+    assert(renderer->component_count < (int) (sizeof(renderer->components) / sizeof(renderer->components[0])) - 1);
+    renderer->components[renderer->component_count++] = component;
+}
+
+/*
+ * Lets the display speed the clock up or slow it down to hold its queue at the configured
+ * latency, like the firmware's players do for live streams, instead of sync_clock doing it.
+ */
+static void video_renderer_rpi_set_latency_target(video_renderer_rpi_t *renderer, video_renderer_rpi_chain_t *chain) {
+    const video_renderer_config_t *config = renderer->config;
+    OMX_CONFIG_LATENCYTARGETTYPE latency_target;
+    memset(&latency_target, 0, sizeof(OMX_CONFIG_LATENCYTARGETTYPE));
+    latency_target.nSize = sizeof(OMX_CONFIG_LATENCYTARGETTYPE);
+    latency_target.nVersion.nVersion = OMX_VERSION;
+    latency_target.nPortIndex = 90;
+    latency_target.bEnabled = OMX_TRUE;
+    latency_target.nFilter = LATENCY_TARGET_FILTER;
+    latency_target.nTarget = config->omx_latency_target * 1000;
+    latency_target.nShift = LATENCY_TARGET_SHIFT;
+    latency_target.nSpeedFactor = config->omx_latency_speed ? config->omx_latency_speed : LATENCY_TARGET_SPEED;
+    latency_target.nInterFactor = config->omx_latency_inflection ? config->omx_latency_inflection : LATENCY_TARGET_INFLECTION;
+    latency_target.nAdjCap = LATENCY_TARGET_ADJUST_CAP;
+    if (OMX_SetConfig(ilclient_get_handle(chain->video_renderer), OMX_IndexConfigLatencyTarget,
+                      &latency_target) != OMX_ErrorNone) {
+        logger_log(renderer->base.logger, LOGGER_DEBUG, "Could not set the video latency target");
+    }
+}
+
+/* Creates and sets up the decoder, scheduler and display element of one chain, the clock must exist unless low-latency */
+static int video_renderer_rpi_init_chain(video_renderer_rpi_t *renderer, int index) {
+    video_renderer_rpi_chain_t *chain = &renderer->chains[index];
 
     // Create video_decode
-    if (ilclient_create_component(renderer->client, &renderer->video_decoder, "video_decode",
+    if (ilclient_create_component(renderer->client, &chain->video_decoder, "video_decode",
                                   ILCLIENT_DISABLE_ALL_PORTS | ILCLIENT_ENABLE_INPUT_BUFFERS) != 0) {
-        video_renderer_rpi_destroy_decoder(renderer);
         return -14;
     }
-    renderer->components[0] = renderer->video_decoder;
+    video_renderer_rpi_add_component(renderer, chain->video_decoder);
+    renderer->chain_count = index + 1;
 
     // Create video_renderer
-    if (ilclient_create_component(renderer->client, &renderer->video_renderer, "video_render",
+    if (ilclient_create_component(renderer->client, &chain->video_renderer, "video_render",
                                   ILCLIENT_DISABLE_ALL_PORTS) != 0) {
-        video_renderer_rpi_destroy_decoder(renderer);
         return -14;
     }
-    renderer->components[1] = renderer->video_renderer;
+    video_renderer_rpi_add_component(renderer, chain->video_renderer);
 
     // Register to video stalls
     OMX_CONFIG_REQUESTCALLBACKTYPE request_callback;
@@ -194,58 +569,37 @@ static int video_renderer_rpi_init_decoder(video_renderer_rpi_t *renderer) {
     request_callback.nPortIndex = 131;
     request_callback.nIndex = OMX_IndexConfigBufferStall;
     request_callback.bEnable = OMX_TRUE;
-    if (OMX_SetConfig(ilclient_get_handle(renderer->video_decoder), OMX_IndexConfigRequestCallback,
+    if (OMX_SetConfig(ilclient_get_handle(chain->video_decoder), OMX_IndexConfigRequestCallback,
                       &request_callback) != OMX_ErrorNone) {
         logger_log(renderer->base.logger, LOGGER_DEBUG, "Could not request video stall callback");
         return -14;
     }
-    ilclient_set_configchanged_callback(renderer->client, omx_event_handler, renderer);
-
-    // Create clock
-    if (ilclient_create_component(renderer->client, &renderer->clock, "clock",
-                                  ILCLIENT_DISABLE_ALL_PORTS) != 0) {
-        video_renderer_rpi_destroy_decoder(renderer);
-        return -14;
-    }
-    renderer->components[2] = renderer->clock;
-
-    // Set the reference clock to the video clock
-    OMX_TIME_CONFIG_ACTIVEREFCLOCKTYPE active_ref_clock;
-    memset(&active_ref_clock, 0, sizeof(OMX_TIME_CONFIG_ACTIVEREFCLOCKTYPE));
-    active_ref_clock.nSize = sizeof(OMX_TIME_CONFIG_ACTIVEREFCLOCKTYPE);
-    active_ref_clock.nVersion.nVersion = OMX_VERSION;
-    active_ref_clock.eClock = OMX_TIME_RefClockVideo;
-    if (OMX_SetConfig(ilclient_get_handle(renderer->clock), OMX_IndexConfigTimeActiveRefClock,
-                      &active_ref_clock) != OMX_ErrorNone) {
-        video_renderer_rpi_destroy_decoder(renderer);
-        return -13;
+    OMX_CONFIG_BUFFERSTALLTYPE stall;
+    memset(&stall, 0, sizeof(OMX_CONFIG_BUFFERSTALLTYPE));
+    stall.nSize = sizeof(OMX_CONFIG_BUFFERSTALLTYPE);
+    stall.nVersion.nVersion = OMX_VERSION;
+    stall.nPortIndex = 131;
+    stall.nDelay = STALL_DETECT_MS * 1000;
+    if (OMX_SetConfig(ilclient_get_handle(chain->video_decoder), OMX_IndexConfigBufferStall,
+                      &stall) != OMX_ErrorNone) {
+        logger_log(renderer->base.logger, LOGGER_DEBUG, "Could not set the video stall delay");
     }
 
-    // Setup clock
-    OMX_TIME_CONFIG_CLOCKSTATETYPE clock_state;
-    memset(&clock_state, 0, sizeof(OMX_TIME_CONFIG_CLOCKSTATETYPE));
-    clock_state.nSize = sizeof(OMX_TIME_CONFIG_CLOCKSTATETYPE);
-    clock_state.nVersion.nVersion = OMX_VERSION;
-    clock_state.eState = OMX_TIME_ClockStateWaitingForStartTime;
-    clock_state.nWaitMask = 1;
-    if (OMX_SetParameter(ilclient_get_handle(renderer->clock), OMX_IndexConfigTimeClockState,
-                         &clock_state) != OMX_ErrorNone) {
-        video_renderer_rpi_destroy_decoder(renderer);
-        return -13;
-    }
-
-    // Create video_scheduler
-    if (ilclient_create_component(renderer->client, &renderer->video_scheduler, "video_scheduler",
-                                  ILCLIENT_DISABLE_ALL_PORTS) != 0) {
-        video_renderer_rpi_destroy_decoder(renderer);
-        return -14;
+    if (renderer->clock) {
+        // Create video_scheduler
+        if (ilclient_create_component(renderer->client, &chain->video_scheduler, "video_scheduler",
+                                      ILCLIENT_DISABLE_ALL_PORTS) != 0) {
+            return -14;
+        }
+        video_renderer_rpi_add_component(renderer, chain->video_scheduler);
+
+        // Create tunnels
+        set_tunnel(&chain->tunnels[0], chain->video_decoder, 131, chain->video_scheduler, 10);
+        set_tunnel(&chain->tunnels[1], chain->video_scheduler, 11, chain->video_renderer, 90);
+        set_tunnel(&chain->tunnels[2], renderer->clock, video_renderer_rpi_clock_ports[index], chain->video_scheduler, 12);
+    } else {
+        set_tunnel(&chain->tunnels[0], chain->video_decoder, 131, chain->video_renderer, 90);
     }
-    renderer->components[3] = renderer->video_scheduler;
-
-    // Create tunnels
-    set_tunnel(&renderer->tunnels[0], renderer->video_decoder, 131, renderer->video_scheduler, 10);
-    set_tunnel(&renderer->tunnels[1], renderer->video_scheduler, 11, renderer->video_renderer, 90);
-    set_tunnel(&renderer->tunnels[2], renderer->clock, 80, renderer->video_scheduler, 12);
 
     // Setup renderer
     OMX_CONFIG_DISPLAYREGIONTYPE display_region;
@@ -256,17 +610,37 @@ static int video_renderer_rpi_init_decoder(video_renderer_rpi_t *renderer) {
     display_region.set = OMX_DISPLAY_SET_FULLSCREEN | OMX_DISPLAY_SET_LAYER;
     display_region.fullscreen = OMX_TRUE;
     display_region.layer = LAYER_VIDEO;
+    if (index > 0) {
+        // The standby chain stays invisible until it takes over the display
+        display_region.set |= OMX_DISPLAY_SET_ALPHA;
+        display_region.alpha = 0;
+    }
+    if (renderer->config->tiles > 1) {
+        // Let the hardware scaler fit the picture into this renderer's cell of the grid
+        uint32_t display_width, display_height;
+        if (graphics_get_display_size(0, &display_width, &display_height) < 0) {
+            return -13;
+        }
+        int columns = 1;
+        while (columns * columns < renderer->config->tiles) columns++;
+        int rows = (renderer->config->tiles + columns - 1) / columns;
+        display_region.set |= OMX_DISPLAY_SET_DEST_RECT | OMX_DISPLAY_SET_NOASPECT;
+        display_region.fullscreen = OMX_FALSE;
+        display_region.noaspect = OMX_FALSE;
+        display_region.dest_rect.width = display_width / columns;
+        display_region.dest_rect.height = display_height / rows;
+        display_region.dest_rect.x_offset = (renderer->config->tile % columns) * display_region.dest_rect.width;
+        display_region.dest_rect.y_offset = (renderer->config->tile / columns) * display_region.dest_rect.height;
+    }
 
-    if (OMX_SetConfig(ilclient_get_handle(renderer->video_renderer), OMX_IndexConfigDisplayRegion,
+    if (OMX_SetConfig(ilclient_get_handle(chain->video_renderer), OMX_IndexConfigDisplayRegion,
                       &display_region) != OMX_ErrorNone) {
         logger_log(renderer->base.logger, LOGGER_DEBUG, "Could not set renderer to fullscreen");
-        video_renderer_rpi_destroy_decoder(renderer);
         return -13;
     }
 
     // Setup clock tunnel
-    if (ilclient_setup_tunnel(&renderer->tunnels[2], 0, 0) != 0) {
-        video_renderer_rpi_destroy_decoder(renderer);
+    if (renderer->clock && ilclient_setup_tunnel(&chain->tunnels[2], 0, 0) != 0) {
         return -15;
     }
 
@@ -279,17 +653,15 @@ static int video_renderer_rpi_init_decoder(video_renderer_rpi_t *renderer) {
         // Check the rotation here
         if (rotation != 90 && rotation != -90 && rotation != 180 && rotation != -180 && rotation != 270 && rotation != -270) {
             printf("Error: Rotation must be +/- 0,90,180,270\n");
-            video_renderer_rpi_destroy_decoder(renderer);
             return -15;
         }
         omx_rotation.nRotation = rotation;
         omx_rotation.nPortIndex = 90;
         omx_rotation.nVersion.nVersion = OMX_VERSION;
-        OMX_ERRORTYPE error = OMX_SetConfig(ilclient_get_handle(renderer->video_renderer), OMX_IndexConfigCommonRotate,
+        OMX_ERRORTYPE error = OMX_SetConfig(ilclient_get_handle(chain->video_renderer), OMX_IndexConfigCommonRotate,
                                             &omx_rotation);
         if (error != OMX_ErrorNone) {
             printf("Error: %x\n", error);
-            video_renderer_rpi_destroy_decoder(renderer);
             return -15;
         }
     }
@@ -315,17 +687,20 @@ static int video_renderer_rpi_init_decoder(video_renderer_rpi_t *renderer) {
         }
         omx_mirror.nPortIndex = 90;
         omx_mirror.nVersion.nVersion = OMX_VERSION;
-        OMX_ERRORTYPE error = OMX_SetConfig(ilclient_get_handle(renderer->video_renderer), OMX_IndexConfigCommonMirror,
+        OMX_ERRORTYPE error = OMX_SetConfig(ilclient_get_handle(chain->video_renderer), OMX_IndexConfigCommonMirror,
                                             &omx_mirror);
         if (error != OMX_ErrorNone) {
             printf("Error: %x\n", error);
-            video_renderer_rpi_destroy_decoder(renderer);
             return -15;
         }
     }
 
+    if (renderer->clock && renderer->config->omx_latency_target > 0) {
+        video_renderer_rpi_set_latency_target(renderer, chain);
+    }
+
     // Set decoder format
-    ilclient_change_component_state(renderer->video_decoder, OMX_StateIdle);
+    ilclient_change_component_state(chain->video_decoder, OMX_StateIdle);
     OMX_VIDEO_PARAM_PORTFORMATTYPE format;
     memset(&format, 0, sizeof(OMX_VIDEO_PARAM_PORTFORMATTYPE));
     format.nSize = sizeof(OMX_VIDEO_PARAM_PORTFORMATTYPE);
@@ -333,18 +708,144 @@ static int video_renderer_rpi_init_decoder(video_renderer_rpi_t *renderer) {
     format.nPortIndex = 130;
     format.eCompressionFormat = OMX_VIDEO_CodingAVC;
 
-    if (OMX_SetParameter(ilclient_get_handle(renderer->video_decoder), OMX_IndexParamVideoPortFormat,
-                         &format) != OMX_ErrorNone ||
-        ilclient_enable_port_buffers(renderer->video_decoder, 130, NULL, NULL, NULL) != 0) {
-        video_renderer_rpi_destroy_decoder(renderer);
+    if (OMX_SetParameter(ilclient_get_handle(chain->video_decoder), OMX_IndexParamVideoPortFormat,
+                         &format) != OMX_ErrorNone) {
+        return -15;
+    }
+
+    // Fewer buffers keep less video in flight, more or larger ones absorb bursts of big frames
+    OMX_PARAM_PORTDEFINITIONTYPE decoder_input;
+    memset(&decoder_input, 0, sizeof(OMX_PARAM_PORTDEFINITIONTYPE));
+    decoder_input.nSize = sizeof(OMX_PARAM_PORTDEFINITIONTYPE);
+    decoder_input.nVersion.nVersion = OMX_VERSION;
+    decoder_input.nPortIndex = 130;
+    if (OMX_GetParameter(ilclient_get_handle(chain->video_decoder), OMX_IndexParamPortDefinition,
+                         &decoder_input) != OMX_ErrorNone) {
+        return -15;
+    }
+    if (renderer->config->input_buffer_count > 0 || renderer->config->input_buffer_size > 0) {
+        if (renderer->config->input_buffer_count > 0) {
+            decoder_input.nBufferCountActual = renderer->config->input_buffer_count;
+            if (decoder_input.nBufferCountActual < decoder_input.nBufferCountMin) {
+                decoder_input.nBufferCountActual = decoder_input.nBufferCountMin;
+            }
+        }
+        if (renderer->config->input_buffer_size > 0) {
+            decoder_input.nBufferSize = renderer->config->input_buffer_size;
+        }
+        if (OMX_SetParameter(ilclient_get_handle(chain->video_decoder), OMX_IndexParamPortDefinition,
+                             &decoder_input) != OMX_ErrorNone) {
+            logger_log(renderer->base.logger, LOGGER_WARNING, "Decoder refused %u input buffers of %u bytes, keeping its defaults",
+                       decoder_input.nBufferCountActual, decoder_input.nBufferSize);
+            OMX_GetParameter(ilclient_get_handle(chain->video_decoder), OMX_IndexParamPortDefinition, &decoder_input);
+        }
+    }
+    // Both chains get the same, so zero-copy input fits whichever one is fed
+    renderer->input_buffer_size = decoder_input.nBufferSize;
+    chain->free_input_buffers = decoder_input.nBufferCountActual;
+    logger_log(renderer->base.logger, LOGGER_DEBUG, "Decoder uses %u input buffers of %u bytes",
+               decoder_input.nBufferCountActual, decoder_input.nBufferSize);
+
+    if (ilclient_enable_port_buffers(chain->video_decoder, 130, NULL, NULL, NULL) != 0) {
         return -15;
     }
+    chain->input_memory = (long) decoder_input.nBufferCountActual * decoder_input.nBufferSize;
+    mem_account_charge(MEM_TAG_OMX, 0, chain->input_memory);
+    return 1;
+}
+
+static int video_renderer_rpi_init_chains(video_renderer_rpi_t *renderer) {
+    // A second chain costs another decoder's worth of GPU memory, so only if asked for
+    int chains = renderer->config->double_decoder ? DECODER_CHAINS : 1;
+    for (int i = 0; i < chains; i++) {
+        int ret = video_renderer_rpi_init_chain(renderer, i);
+        if (ret != 1) {
+            video_renderer_rpi_destroy_decoder(renderer);
+            return ret;
+        }
+    }
+    renderer->chain = &renderer->chains[0];
+    renderer->shown = renderer->chain;
+    renderer->retiring = NULL;
 
     // Components are started in video_renderer_start()
 
     return 1;
 }
 
+static int video_renderer_rpi_init_decoder(video_renderer_rpi_t *renderer) {
+    memset(renderer->components, 0, sizeof(renderer->components));
+    renderer->component_count = 0;
+    memset(renderer->chains, 0, sizeof(renderer->chains));
+    renderer->chain_count = 0;
+
+    bcm_host_init();
+
+    uint32_t display_width, display_height;
+    if (graphics_get_display_size(0, &display_width, &display_height) >= 0) {
+        renderer->base.display_width = display_width;
+        renderer->base.display_height = display_height;
+    }
+    renderer->base.display_refresh_rate = renderer->config->switch_to_60hz ? 60 : video_renderer_rpi_hdmi_refresh_rate();
+
+    // The drain thread is not up yet, the background of BACKGROUND_MODE_ON is shown right away
+    video_renderer_rpi_apply_background(renderer, renderer->background_visits);
+
+    if ((renderer->client = ilclient_init()) == NULL) {
+        return -3;
+    }
+
+    if (OMX_Init() != OMX_ErrorNone) {
+        ilclient_destroy(renderer->client);
+        return -4;
+    }
+
+    ilclient_set_configchanged_callback(renderer->client, omx_event_handler, renderer);
+    ilclient_set_empty_buffer_done_callback(renderer->client, omx_empty_buffer_done, renderer);
+
+    // Timestamps are ignored in low-latency mode, which needs neither clock nor scheduler then
+    if (renderer->config->low_latency) {
+        renderer->clock = NULL;
+        logger_log(renderer->base.logger, LOGGER_INFO, "Video decoder tunnelled straight to the display");
+        return video_renderer_rpi_init_chains(renderer);
+    }
+
+    // Create clock
+    if (ilclient_create_component(renderer->client, &renderer->clock, "clock",
+                                  ILCLIENT_DISABLE_ALL_PORTS) != 0) {
+        video_renderer_rpi_destroy_decoder(renderer);
+        return -14;
+    }
+    video_renderer_rpi_add_component(renderer, renderer->clock);
+
+    // Set the reference clock to the video clock
+    OMX_TIME_CONFIG_ACTIVEREFCLOCKTYPE active_ref_clock;
+    memset(&active_ref_clock, 0, sizeof(OMX_TIME_CONFIG_ACTIVEREFCLOCKTYPE));
+    active_ref_clock.nSize = sizeof(OMX_TIME_CONFIG_ACTIVEREFCLOCKTYPE);
+    active_ref_clock.nVersion.nVersion = OMX_VERSION;
+    active_ref_clock.eClock = OMX_TIME_RefClockVideo;
+    if (OMX_SetConfig(ilclient_get_handle(renderer->clock), OMX_IndexConfigTimeActiveRefClock,
+                      &active_ref_clock) != OMX_ErrorNone) {
+        video_renderer_rpi_destroy_decoder(renderer);
+        return -13;
+    }
+
+    // Setup clock
+    OMX_TIME_CONFIG_CLOCKSTATETYPE clock_state;
+    memset(&clock_state, 0, sizeof(OMX_TIME_CONFIG_CLOCKSTATETYPE));
+    clock_state.nSize = sizeof(OMX_TIME_CONFIG_CLOCKSTATETYPE);
+    clock_state.nVersion.nVersion = OMX_VERSION;
+    clock_state.eState = OMX_TIME_ClockStateWaitingForStartTime;
+    clock_state.nWaitMask = 1;
+    if (OMX_SetParameter(ilclient_get_handle(renderer->clock), OMX_IndexConfigTimeClockState,
+                         &clock_state) != OMX_ErrorNone) {
+        video_renderer_rpi_destroy_decoder(renderer);
+        return -13;
+    }
+
+    return video_renderer_rpi_init_chains(renderer);
+}
+
 video_renderer_t *video_renderer_rpi_init(logger_t *logger, video_renderer_config_t const *config) {
     video_renderer_rpi_t *renderer;
     renderer = calloc(1, sizeof(video_renderer_rpi_t));
@@ -359,10 +860,30 @@ video_renderer_t *video_renderer_rpi_init(logger_t *logger, video_renderer_confi
 
     renderer->first_packet_time = 0;
     renderer->input_frames = 0;
+    renderer->clock_scale = CLOCK_SCALE_UNITY;
+    if (config->measure_latency) {
+        // Decoded pictures go from the decoder to the scheduler and the display tunnelled, never through the CPU
+        logger_log(logger, LOGGER_WARNING, "The rpi renderer cannot read frames back, no latency is measured");
+    }
+    MUTEX_CREATE(renderer->input_mutex);
+    COND_CREATE(renderer->input_cond);
+    frame_stages_init(&renderer->stages);
 
     if (video_renderer_rpi_init_decoder(renderer) != 1) {
+        frame_stages_destroy(&renderer->stages);
+        COND_DESTROY(renderer->input_cond);
+        MUTEX_DESTROY(renderer->input_mutex);
         free(renderer);
-        renderer = NULL;
+        return NULL;
+    }
+
+    MUTEX_CREATE(renderer->drain_mutex);
+    COND_CREATE(renderer->drain_cond);
+    THREAD_CREATE(renderer->drain_thread, video_renderer_rpi_drain_thread, renderer);
+    if (!renderer->drain_thread) {
+        logger_log(logger, LOGGER_WARNING, "Could not start the drain thread, sessions are flushed on the RTSP thread");
+    } else {
+        thread_set_name(renderer->drain_thread, "drain");
     }
 
     return &renderer->base;
@@ -373,155 +894,1069 @@ ILCLIENT_T *video_renderer_rpi_get_ilclient(video_renderer_rpi_t *renderer) {
     return renderer->client;
 }
 
-// Not static because the audio renderer may need to refer to it
+// Not static because the audio renderer may need to refer to it, NULL in low-latency mode
 COMPONENT_T *video_renderer_rpi_get_clock(video_renderer_rpi_t *renderer) {
     return renderer->clock;
 }
 
 static void video_renderer_rpi_start(video_renderer_t *renderer) {
     video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
-    ilclient_change_component_state(r->clock, OMX_StateExecuting);
-    ilclient_change_component_state(r->video_decoder, OMX_StateExecuting);
+    if (r->clock) {
+        ilclient_change_component_state(r->clock, OMX_StateExecuting);
+    }
+    for (int i = 0; i < r->chain_count; i++) {
+        ilclient_change_component_state(r->chains[i].video_decoder, OMX_StateExecuting);
+    }
 }
 
-static void video_renderer_rpi_render_buffer(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len,
-                                  uint64_t pts, int type) {
-    if (data_len == 0) return;
+static bool video_renderer_rpi_get_decoder_output(video_renderer_rpi_chain_t *chain, OMX_PARAM_PORTDEFINITIONTYPE *port) {
+    memset(port, 0, sizeof(OMX_PARAM_PORTDEFINITIONTYPE));
+    port->nSize = sizeof(OMX_PARAM_PORTDEFINITIONTYPE);
+    port->nVersion.nVersion = OMX_VERSION;
+    port->nPortIndex = 131;
+    return OMX_GetParameter(ilclient_get_handle(chain->video_decoder), OMX_IndexParamPortDefinition,
+                            port) == OMX_ErrorNone;
+}
 
-    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
+static bool video_renderer_rpi_same_output(OMX_PARAM_PORTDEFINITIONTYPE const *a, OMX_PARAM_PORTDEFINITIONTYPE const *b) {
+    return a->format.video.nFrameWidth == b->format.video.nFrameWidth &&
+           a->format.video.nFrameHeight == b->format.video.nFrameHeight &&
+           a->format.video.nStride == b->format.video.nStride &&
+           a->format.video.nSliceHeight == b->format.video.nSliceHeight &&
+           a->format.video.eColorFormat == b->format.video.eColorFormat;
+}
 
-    logger_log(renderer->logger, LOGGER_DEBUG, "Got h264 data of %d bytes", data_len);
-    r->input_frames++;
+static video_renderer_rpi_geometry_t *video_renderer_rpi_find_geometry(video_renderer_rpi_t *renderer, int width, int height) {
+    for (int i = 0; i < GEOMETRY_CACHE_SIZE; i++) {
+        video_renderer_rpi_geometry_t *geometry = &renderer->geometries[i];
+        if (geometry->decoder_output.nSize && geometry->width == width && geometry->height == height) {
+            return geometry;
+        }
+    }
+    return NULL;
+}
 
-    uint8_t *modified_data = NULL;
+static void video_renderer_rpi_cache_geometry(video_renderer_rpi_t *renderer, OMX_PARAM_PORTDEFINITIONTYPE const *decoder_output) {
+    video_renderer_rpi_geometry_t *geometry = video_renderer_rpi_find_geometry(renderer, renderer->width, renderer->height);
+    if (!geometry) {
+        geometry = &renderer->geometries[renderer->next_geometry];
+        renderer->next_geometry = (renderer->next_geometry + 1) % GEOMETRY_CACHE_SIZE;
+    }
+    geometry->width = renderer->width;
+    geometry->height = renderer->height;
+    geometry->decoder_output = *decoder_output;
+}
 
-    if (type == 0) {
-        // This reduces the Raspberry Pi H264 decode pipeline delay from about 11 to 6 frames for RPiPlay.
-        // Described at https://www.raspberrypi.org/forums/viewtopic.php?t=41053
-        logger_log(renderer->logger, LOGGER_DEBUG, "Injecting max_dec_frame_buffering");
-        int sps_start, sps_end;
-        int sps_size = find_nal_unit(data, data_len, &sps_start, &sps_end);
-        if (sps_size > 0) {
-            const int sps_wiggle_room = 12;
-            const unsigned char nal_marker[] = { 0x0, 0x0, 0x0, 0x1 };
-            int modified_data_len = data_len + sps_wiggle_room + sizeof(nal_marker);
-            modified_data = malloc(modified_data_len);
-
-            h264_stream_t *h = h264_new();
-            h->nal->nal_unit_type = NAL_UNIT_TYPE_SPS;
-            h->sps->vui.bitstream_restriction_flag = 1;
-            h->sps->vui.max_dec_frame_buffering = 4;
-
-            int new_sps_size = write_nal_unit(h, modified_data + sps_start, sps_wiggle_room);
-            if (new_sps_size > 0 && new_sps_size <= sps_wiggle_room) {
-                memcpy(modified_data, data, sps_start);
-                memcpy(modified_data + sps_start + new_sps_size, nal_marker, sizeof(nal_marker));
-                memcpy(modified_data + sps_start + new_sps_size + sizeof(nal_marker), data + sps_start, data_len - sps_start);
-                data = modified_data;
-                data_len = data_len + new_sps_size + sizeof(nal_marker);
-            } else {
-                free(modified_data);
-                modified_data = NULL;
-            }
-            h264_free(h);
-        } else {
-            logger_log(renderer->logger, LOGGER_ERR, "Could not find sps boundaries");
-        }
+static void video_renderer_rpi_set_layer(video_renderer_rpi_t *r, video_renderer_rpi_chain_t *chain, int layer, int alpha) {
+    OMX_CONFIG_DISPLAYREGIONTYPE display_region;
+    memset(&display_region, 0, sizeof(OMX_CONFIG_DISPLAYREGIONTYPE));
+    display_region.nSize = sizeof(OMX_CONFIG_DISPLAYREGIONTYPE);
+    display_region.nVersion.nVersion = OMX_VERSION;
+    display_region.nPortIndex = 90;
+    display_region.set = OMX_DISPLAY_SET_LAYER | OMX_DISPLAY_SET_ALPHA;
+    display_region.layer = layer;
+    display_region.alpha = alpha;
+    if (OMX_SetConfig(ilclient_get_handle(chain->video_renderer), OMX_IndexConfigDisplayRegion,
+                      &display_region) != OMX_ErrorNone) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not move the video to layer %d", layer);
     }
+}
 
-    if (ilclient_remove_event(r->video_decoder, OMX_EventPortSettingsChanged, 131, 0, 0, 1) == 0) {
-        logger_log(renderer->logger, LOGGER_DEBUG, "Port settings changed!!");
+/* Hides a chain and takes its decoder output down, the next stream it gets sets it up again */
+static void video_renderer_rpi_retire_chain(video_renderer_rpi_t *r, video_renderer_rpi_chain_t *chain) {
+    video_renderer_rpi_set_layer(r, chain, LAYER_VIDEO, 0);
+    ilclient_disable_tunnel(&chain->tunnels[0]);
+    ilclient_disable_tunnel(&chain->tunnels[1]);
+    chain->tunnels_ready = false;
+    chain->preconfigured = NULL;
+    if (r->retiring == chain) {
+        r->retiring = NULL;
+    }
+}
+
+/*
+ * With double_decoder a new geometry goes to the standby chain, whose decoder runs through
+ * OMX_EventPortSettingsChanged and gets its tunnels set up off screen, while the display keeps
+ * the last picture of the old one. Once the new output is set up the standby chain is raised
+ * above the old one, see video_renderer_rpi_handle_port_settings, so rotations and resolution
+ * changes never show an empty screen.
+ */
+static bool video_renderer_rpi_begin_switch(video_renderer_rpi_t *r) {
+    if (r->chain_count < DECODER_CHAINS || r->chain != r->shown || !r->chain->tunnels_ready) {
+        return false;
+    }
+    video_renderer_rpi_chain_t *standby = r->chain == &r->chains[0] ? &r->chains[1] : &r->chains[0];
+    // Still underneath from the last switch
+    if (r->retiring == standby) {
+        video_renderer_rpi_retire_chain(r, standby);
+    }
+    r->chain = standby;
+    r->switch_time = video_renderer_rpi_now_us();
+    ATOMIC_STORE(r->stalled_since, 0);
+    r->stalled_frames = 0;
+    logger_log(r->base.logger, LOGGER_DEBUG, "Decoding %dx%d on the standby decoder", r->width, r->height);
+    return true;
+}
+
+/*
+ * Rotating back to a geometry the decoder already produced does not need a round trip through
+ * OMX_EventPortSettingsChanged. The output port and the scheduler (or display) input are set to the remembered
+ * definition before the new parameter sets reach the decoder, which then finds its output already
+ * matching and the tunnel never has to be torn down and set up again.
+ */
+static void video_renderer_rpi_reconfigure(video_renderer_t *renderer, int width, int height, bool known_geometry) {
+    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
+    video_renderer_rpi_wait_for_drain(r);
+    video_renderer_rpi_chain_t *chain = r->chain;
+
+    bool changed = width != r->width || height != r->height;
+    // The first stream after a standby may reuse an output cached by an earlier session
+    bool reuse = known_geometry || r->standby;
+    r->width = width;
+    r->height = height;
+    r->standby = false;
+    if (changed && video_renderer_rpi_begin_switch(r)) {
+        return;
+    }
+    if (!changed || !reuse || !chain->tunnels_ready) {
+        return;
+    }
+
+    video_renderer_rpi_geometry_t *geometry = video_renderer_rpi_find_geometry(r, width, height);
+    if (!geometry) {
+        return;
+    }
+
+    OMX_PARAM_PORTDEFINITIONTYPE sink_input = geometry->decoder_output;
+    sink_input.nPortIndex = chain->tunnels[0].sink_port;
+
+    ilclient_disable_tunnel(&chain->tunnels[0]);
+    if (OMX_SetParameter(ilclient_get_handle(chain->video_decoder), OMX_IndexParamPortDefinition,
+                         &geometry->decoder_output) != OMX_ErrorNone ||
+        OMX_SetParameter(ilclient_get_handle(chain->tunnels[0].sink), OMX_IndexParamPortDefinition,
+                         &sink_input) != OMX_ErrorNone) {
+        logger_log(renderer->logger, LOGGER_ERR, "Could not configure decoder output for %dx%d", width, height);
+        chain->preconfigured = NULL;
+    } else {
+        logger_log(renderer->logger, LOGGER_DEBUG, "Configured decoder output for known geometry %dx%d", width, height);
+        chain->preconfigured = geometry;
+    }
+    if (ilclient_enable_tunnel(&chain->tunnels[0]) != 0) {
+        logger_log(renderer->logger, LOGGER_ERR, "Could not enable decoder tunnel");
+        chain->preconfigured = NULL;
+    }
+}
+
+static void video_renderer_rpi_handle_port_settings(video_renderer_rpi_t *r, raop_ntp_t *ntp) {
+    video_renderer_rpi_chain_t *chain = r->chain;
+
+    // The first picture of the new chain went to the display with the last frame
+    if (r->retiring && r->retiring != chain) {
+        video_renderer_rpi_retire_chain(r, r->retiring);
+    }
+    if (ilclient_remove_event(chain->video_decoder, OMX_EventPortSettingsChanged, 131, 0, 0, 1) == 0) {
+        logger_log(r->base.logger, LOGGER_DEBUG, "Port settings changed!!");
 
         uint64_t time_diff = raop_ntp_get_local_time(ntp) - r->first_packet_time;
-        logger_log(renderer->logger, LOGGER_DEBUG, "Video pipeline delay is %llu frames or %llu us",
+        logger_log(r->base.logger, LOGGER_DEBUG, "Video pipeline delay is %llu frames or %llu us",
                    r->input_frames, time_diff);
 
-        if (ilclient_setup_tunnel(&r->tunnels[0], 0, 0) != 0) {
-            logger_log(renderer->logger, LOGGER_ERR, "Could not setup decoder tunnel");
+        OMX_PARAM_PORTDEFINITIONTYPE decoder_output;
+        bool have_decoder_output = video_renderer_rpi_get_decoder_output(chain, &decoder_output);
+        if (have_decoder_output && chain->preconfigured &&
+            video_renderer_rpi_same_output(&chain->preconfigured->decoder_output, &decoder_output)) {
+            logger_log(r->base.logger, LOGGER_DEBUG, "Decoder output already configured for %dx%d",
+                       r->width, r->height);
+        } else {
+            if (ilclient_setup_tunnel(&chain->tunnels[0], 0, 0) != 0) {
+                logger_log(r->base.logger, LOGGER_ERR, "Could not setup decoder tunnel");
+            }
+
+            if (chain->video_scheduler) {
+                ilclient_change_component_state(chain->video_scheduler, OMX_StateExecuting);
+
+                if (ilclient_setup_tunnel(&chain->tunnels[1], 0, 1000) != 0) {
+                    logger_log(r->base.logger, LOGGER_ERR, "Could not setup scheduler tunnel");
+                }
+            }
+
+            ilclient_change_component_state(chain->video_renderer, OMX_StateExecuting);
+            chain->tunnels_ready = true;
+        }
+        if (chain != r->shown) {
+            // The old picture stays underneath until the new one covered it
+            video_renderer_rpi_set_layer(r, r->shown, LAYER_VIDEO, 255);
+            video_renderer_rpi_set_layer(r, chain, LAYER_VIDEO + 1, 255);
+            logger_log(r->base.logger, LOGGER_INFO, "Switched to the standby decoder for %dx%d after %llu ms",
+                       r->width, r->height, (video_renderer_rpi_now_us() - r->switch_time) / 1000);
+            r->retiring = r->shown;
+            r->shown = chain;
         }
+        // The picture that raised the event goes on to the display right away
+        if (!r->base.decoder_ready_time) {
+            r->base.decoder_ready_time = raop_ntp_get_local_time(ntp);
+            r->base.first_render_time = r->base.decoder_ready_time;
+        }
+        if (have_decoder_output) {
+            video_renderer_rpi_cache_geometry(r, &decoder_output);
+        }
+        chain->preconfigured = NULL;
+    }
+}
 
-        ilclient_change_component_state(r->video_scheduler, OMX_StateExecuting);
+/*
+ * Takes a free decoder input buffer, waiting at most timeout_ms for the decoder to return one.
+ * Returns NULL instead of blocking the render thread for longer.
+ */
+static OMX_BUFFERHEADERTYPE *video_renderer_rpi_get_input_buffer(video_renderer_rpi_t *r, video_renderer_rpi_chain_t *chain,
+                                                                  int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(COND_CLOCK, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
 
-        if (ilclient_setup_tunnel(&r->tunnels[1], 0, 1000) != 0) {
-            logger_log(renderer->logger, LOGGER_ERR, "Could not setup scheduler tunnel");
+    for (;;) {
+        // Never called with input_mutex held, ilclient may run its callbacks under its own lock
+        OMX_BUFFERHEADERTYPE *buffer = ilclient_get_input_buffer(chain->video_decoder, 130, 0);
+        MUTEX_LOCK(r->input_mutex);
+        if (buffer) {
+            chain->free_input_buffers--;
+            MUTEX_UNLOCK(r->input_mutex);
+            return buffer;
+        }
+        // ilclient lists a buffer before EmptyBufferDone counts it, so an empty list means none is free
+        chain->free_input_buffers = 0;
+        int ret = timeout_ms == 0 ? -1 : 0;
+        while (chain->free_input_buffers <= 0 && ret == 0) {
+            ret = COND_TIMEDWAIT(r->input_cond, r->input_mutex, &deadline);
         }
+        MUTEX_UNLOCK(r->input_mutex);
+        if (ret != 0) {
+            return NULL;
+        }
+    }
+}
+
+/* Notes the pts of a buffer about to go to the decoder, for omx_empty_buffer_done to pick up */
+static void video_renderer_rpi_push_pending(video_renderer_rpi_t *r, video_renderer_rpi_chain_t *chain, uint64_t pts) {
+    MUTEX_LOCK(r->input_mutex);
+    chain->pending_pts[chain->pending_head++ % FRAME_STAGES_SLOTS] = pts;
+    MUTEX_UNLOCK(r->input_mutex);
+}
+
+static bool video_renderer_rpi_is_congested(video_renderer_t *renderer) {
+    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
+    MUTEX_LOCK(r->input_mutex);
+    bool congested = r->chain->free_input_buffers <= 0;
+    MUTEX_UNLOCK(r->input_mutex);
+    return congested;
+}
 
-        ilclient_change_component_state(r->video_renderer, OMX_StateExecuting);
+static void video_renderer_rpi_set_clock_scale(video_renderer_rpi_t *r, int scale) {
+    if (!r->clock || scale == r->clock_scale) return;
+    OMX_TIME_CONFIG_SCALETYPE clock_scale;
+    memset(&clock_scale, 0, sizeof(OMX_TIME_CONFIG_SCALETYPE));
+    clock_scale.nSize = sizeof(OMX_TIME_CONFIG_SCALETYPE);
+    clock_scale.nVersion.nVersion = OMX_VERSION;
+    clock_scale.xScale = scale;
+    if (OMX_SetConfig(ilclient_get_handle(r->clock), OMX_IndexConfigTimeScale, &clock_scale) != OMX_ErrorNone) {
+        logger_log(r->base.logger, LOGGER_DEBUG, "Could not set clock scale");
+        return;
     }
+    r->clock_scale = scale;
+}
 
-    int offset = 0;
-    while (offset < data_len) {
-        OMX_BUFFERHEADERTYPE *buffer = ilclient_get_input_buffer(r->video_decoder, 130, 0);
-        if (buffer == NULL) logger_log(renderer->logger, LOGGER_ERR, "Got NULL buffer!");
-        if (!buffer)
-            exit(-1);
-            //break;
+/*
+ * Buffer timestamps are NTP-mapped local times and the clock starts at the local time of the
+ * first buffer, so its media time should keep matching the local time. Drift between the two is
+ * corrected by running the clock slightly faster or slower rather than by seeking.
+ */
+static void video_renderer_rpi_sync_clock(video_renderer_rpi_t *r, raop_ntp_t *ntp) {
+    uint64_t now = raop_ntp_get_local_time(ntp);
+    if (now - r->last_clock_sync < CLOCK_SYNC_INTERVAL_US) return;
+    r->last_clock_sync = now;
+
+    OMX_TIME_CONFIG_TIMESTAMPTYPE media_time;
+    memset(&media_time, 0, sizeof(OMX_TIME_CONFIG_TIMESTAMPTYPE));
+    media_time.nSize = sizeof(OMX_TIME_CONFIG_TIMESTAMPTYPE);
+    media_time.nVersion.nVersion = OMX_VERSION;
+    media_time.nPortIndex = OMX_ALL;
+    if (OMX_GetConfig(ilclient_get_handle(r->clock), OMX_IndexConfigTimeCurrentMediaTime,
+                      &media_time) != OMX_ErrorNone) {
+        return;
+    }
+    // Positive if the clock runs ahead, frames are then shown before their time
+    int64_t offset = ilclient_ticks_to_s64(media_time.nTimestamp) - (int64_t) raop_ntp_get_local_time(ntp);
+    ATOMIC_STORE(r->clock_offset, (int) offset);
+    // The display steers the clock by its latency target then
+    if (r->config->omx_latency_target > 0) {
+        return;
+    }
+
+    // Far behind, frames are shown late until the clock has run fast long enough to catch up
+    if (offset < -CLOCK_CATCH_UP_US) {
+        r->clock_catching_up = true;
+    } else if (offset > -CLOCK_CATCH_UP_EXIT_US) {
+        r->clock_catching_up = false;
+    }
+    int target = CLOCK_SCALE_UNITY;
+    if (r->clock_catching_up) {
+        target = CLOCK_SCALE_UNITY + CLOCK_SCALE_CATCH_UP_DEVIATION;
+    } else if (offset > CLOCK_SYNC_DEADBAND_US || offset < -CLOCK_SYNC_DEADBAND_US) {
+        target = CLOCK_SCALE_UNITY - (int) (offset * CLOCK_SCALE_UNITY / CLOCK_SYNC_WINDOW_US);
+        if (target > CLOCK_SCALE_UNITY + CLOCK_SCALE_MAX_DEVIATION) target = CLOCK_SCALE_UNITY + CLOCK_SCALE_MAX_DEVIATION;
+        if (target < CLOCK_SCALE_UNITY - CLOCK_SCALE_MAX_DEVIATION) target = CLOCK_SCALE_UNITY - CLOCK_SCALE_MAX_DEVIATION;
+    }
+    int scale = r->clock_scale;
+    // Into and out of catching up in larger steps, or the way back down would overshoot by far
+    int step = r->clock_catching_up || scale > CLOCK_SCALE_UNITY + CLOCK_SCALE_MAX_DEVIATION ?
+               CLOCK_SCALE_CATCH_UP_STEP : CLOCK_SCALE_STEP;
+    if (target > scale) scale = MIN(target, scale + step);
+    if (target < scale) scale = target > scale - step ? target : scale - step;
+    LOGGER_DEBUG_HOT(r->base.logger, "Clock offset is %lld us, clock scale %d/65536", offset, scale);
+    video_renderer_rpi_set_clock_scale(r, scale);
+}
+
+/* frame_end is set on the last buffer of a frame */
+static void video_renderer_rpi_submit_buffer(video_renderer_rpi_t *r, raop_ntp_t *ntp, OMX_BUFFERHEADERTYPE *buffer,
+                                             int filled_len, uint64_t pts, OMX_U32 flags, bool frame_end) {
+    int64_t video_delay = ((int64_t) raop_ntp_get_local_time(ntp)) - ((int64_t) pts);
+    LOGGER_DEBUG_HOT(r->base.logger, "Video delay is %lld", video_delay);
+    int resync_threshold = r->config->resync_threshold > 0 ? r->config->resync_threshold : RESYNC_THRESHOLD_MS;
+    if (video_delay > resync_threshold * RESYNC_LAST_RESORT_FACTOR * 1000ll)
+        r->first_packet_time = 0;
+
+    buffer->nFilledLen = filled_len;
+    buffer->nOffset = 0;
+    buffer->nFlags = 0;
+
+    if (!r->config->low_latency) buffer->nTimeStamp = ilclient_ticks_from_s64(pts);
+    if (r->first_packet_time == 0) {
+        buffer->nFlags = OMX_BUFFERFLAG_STARTTIME;
+        r->first_packet_time = raop_ntp_get_local_time(ntp);
+        if (!r->config->low_latency) buffer->nTimeStamp = ilclient_ticks_from_s64(r->first_packet_time);
+        // The clock restarts at this buffer, so it starts out in sync again
+        video_renderer_rpi_set_clock_scale(r, CLOCK_SCALE_UNITY);
+        r->clock_catching_up = false;
+        r->last_clock_sync = r->first_packet_time;
+    } else if (!r->config->low_latency) {
+        video_renderer_rpi_sync_clock(r, ntp);
+    }
+
+    buffer->nFlags |= flags;
 
-        int64_t video_delay = ((int64_t) raop_ntp_get_local_time(ntp)) - ((int64_t) pts);
-        logger_log(renderer->logger, LOGGER_DEBUG, "Video delay is %lld", video_delay);
-        if (video_delay > 100000)
-            r->first_packet_time = 0;
+    if (pts != r->stage_pts) {
+        r->stage_pts = pts;
+        frame_stages_submitted(&r->stages, pts, raop_ntp_get_local_time(NULL));
+    }
+    video_renderer_rpi_push_pending(r, r->chain, frame_end ? pts : 0);
 
-        int chunk_size = MIN(data_len - offset, buffer->nAllocLen);
-        memcpy(buffer->pBuffer, data + offset, chunk_size);
+    PROBE3(omx_video_submit, pts, filled_len, buffer->nFlags);
+    if (OMX_EmptyThisBuffer(ilclient_get_handle(r->chain->video_decoder), buffer) != OMX_ErrorNone) {
+        logger_log(r->base.logger, LOGGER_ERR, "Video decoder refused processing buffer");
+    }
+}
 
+/* Copies size bytes from offset on in the segments taken back to back */
+static void video_renderer_rpi_copy_segments(video_segment_t const *segments, int count, int offset,
+                                             unsigned char *dst, int size) {
+    int segment = 0;
+    while (segment < count && offset >= segments[segment].size) {
+        offset -= segments[segment].size;
+        segment++;
+    }
+    for (int filled = 0; filled < size; segment++, offset = 0) {
+        int part = MIN(segments[segment].size - offset, size - filled);
+        memcpy(dst + filled, segments[segment].data + offset, part);
+        filled += part;
+    }
+}
+
+/*
+ * How much of a full buffer to submit so that it ends a NAL unit: up to the last start code in
+ * it, or all of it if a single NAL unit fills it. Only called with data following the buffer.
+ */
+static int video_renderer_rpi_nal_aligned(const unsigned char *data, int size) {
+    for (int i = size - 3; i > 0; i--) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            int start = data[i - 1] == 0 ? i - 1 : i;
+            return start > 0 ? start : size;
+        }
+    }
+    return size;
+}
+
+/*
+ * Copies the segments back to back into as many decoder input buffers as it takes, false if the
+ * decoder did not free one up in time. Buffers are cut where NAL units end, so that the decoder
+ * can parse each one on its own. flags go on every buffer, end_flags on the last one, on an empty
+ * one if there is no data. Whole access units end in OMX_BUFFERFLAG_ENDOFFRAME, without it the
+ * decoder holds the frame back until the next one starts.
+ */
+static bool video_renderer_rpi_feed_segments(video_renderer_rpi_t *r, raop_ntp_t *ntp, video_segment_t const *segments,
+                                             int count, uint64_t pts, OMX_U32 flags, OMX_U32 end_flags) {
+    int data_len = 0;
+    for (int i = 0; i < count; i++) {
+        data_len += segments[i].size;
+    }
+
+    int offset = 0;
+    bool ended = !end_flags;
+    while (offset < data_len || !ended) {
+        OMX_BUFFERHEADERTYPE *buffer = video_renderer_rpi_get_input_buffer(r, r->chain, INPUT_BUFFER_TIMEOUT_MS);
+        if (!buffer) {
+            // Blocking here would stall the whole mirror pipeline, the decoder copes with a lost frame
+            r->dropped_frames++;
+            metrics_add(METRIC_VIDEO_DECODER_STALLS, 1);
+            flight_recorder_trigger("video decoder input stall");
+            logger_log(r->base.logger, LOGGER_WARNING, "Decoder input stalled for %d ms, dropped %d of %d bytes (%llu frames so far)",
+                       INPUT_BUFFER_TIMEOUT_MS, data_len - offset, data_len, r->dropped_frames);
+            return false;
+        }
+
+        int chunk_size = MIN(data_len - offset, (int) buffer->nAllocLen);
+        video_renderer_rpi_copy_segments(segments, count, offset, buffer->pBuffer, chunk_size);
+        OMX_U32 buffer_flags = flags;
+        if (offset + chunk_size < data_len) {
+            // The rest of the cut NAL unit goes into the next buffer
+            int aligned = video_renderer_rpi_nal_aligned(buffer->pBuffer, chunk_size);
+            if (aligned < chunk_size) {
+                chunk_size = aligned;
+                buffer_flags |= OMX_BUFFERFLAG_ENDOFNAL;
+            }
+        }
         offset += chunk_size;
 
-        buffer->nFilledLen = chunk_size;
-        buffer->nOffset = 0;
+        // Parts of a frame in slices end NAL units, only the last one ends the frame
+        bool frame_end = offset == data_len && (!(end_flags & OMX_BUFFERFLAG_ENDOFNAL) || (end_flags & OMX_BUFFERFLAG_ENDOFFRAME));
+        if (offset == data_len && end_flags) {
+            buffer_flags |= end_flags;
+            ended = true;
+        }
+        video_renderer_rpi_submit_buffer(r, ntp, buffer, chunk_size, pts, buffer_flags, frame_end);
+    }
+    return true;
+}
+
+static bool video_renderer_rpi_feed(video_renderer_rpi_t *r, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts,
+                                    OMX_U32 flags, OMX_U32 end_flags) {
+    video_segment_t segment = { data, data_len };
+    return video_renderer_rpi_feed_segments(r, ntp, &segment, 1, pts, flags, end_flags);
+}
+
+/* The parameter sets go to the decoder as codec configuration, an access unit of their own */
+static void video_renderer_rpi_feed_parameter_sets(video_renderer_rpi_t *r, raop_ntp_t *ntp, uint64_t pts) {
+    video_renderer_rpi_feed(r, ntp, r->parameter_sets, r->parameter_sets_size, pts, OMX_BUFFERFLAG_CODECCONFIG,
+                            OMX_BUFFERFLAG_ENDOFFRAME);
+}
+
+/* OMX_BUFFERFLAG_SYNCFRAME for a frame with an IDR slice, decoding can start at it */
+static OMX_U32 video_renderer_rpi_frame_flags(h264_nal_index_t const *nal_index) {
+    for (int i = 0; nal_index && i < nal_index->count; i++) {
+        if (nal_index->nals[i].nal_unit_type == NAL_UNIT_TYPE_CODED_SLICE_IDR) {
+            return OMX_BUFFERFLAG_SYNCFRAME;
+        }
+    }
+    return 0;
+}
+
+/*
+ * ilclient_flush_tunnels with a bound, it waits for every port forever and a wedged decoder would
+ * take the thread calling it down with it. A port that does not confirm in time is left as it is.
+ */
+static void video_renderer_rpi_flush_tunnels(video_renderer_rpi_t *r, video_renderer_rpi_chain_t *chain) {
+    for (TUNNEL_T *tunnel = chain->tunnels; tunnel->source; tunnel++) {
+        OMX_SendCommand(ilclient_get_handle(tunnel->source), OMX_CommandFlush, tunnel->source_port, NULL);
+        OMX_SendCommand(ilclient_get_handle(tunnel->sink), OMX_CommandFlush, tunnel->sink_port, NULL);
+        if (ilclient_wait_for_event(tunnel->source, OMX_EventCmdComplete, OMX_CommandFlush, 0, tunnel->source_port, 0,
+                                    ILCLIENT_PORT_FLUSH, FLUSH_PORT_TIMEOUT_MS) != 0 ||
+            ilclient_wait_for_event(tunnel->sink, OMX_EventCmdComplete, OMX_CommandFlush, 0, tunnel->sink_port, 0,
+                                    ILCLIENT_PORT_FLUSH, FLUSH_PORT_TIMEOUT_MS) != 0) {
+            logger_log(r->base.logger, LOGGER_WARNING, "Port %d or %d did not flush in %d ms", tunnel->source_port,
+                       tunnel->sink_port, FLUSH_PORT_TIMEOUT_MS);
+        }
+    }
+}
+
+/* Drops what went to the standby decoder and goes back to feeding the chain on the display */
+static void video_renderer_rpi_abandon_switch(video_renderer_rpi_t *r) {
+    video_renderer_rpi_chain_t *standby = r->chain;
+    OMX_SendCommand(ilclient_get_handle(standby->video_decoder), OMX_CommandFlush, 130, NULL);
+    ilclient_wait_for_event(standby->video_decoder, OMX_EventCmdComplete, OMX_CommandFlush, 0, 130, 0,
+                            ILCLIENT_PORT_FLUSH, INPUT_BUFFER_TIMEOUT_MS);
+    // A late event would otherwise set up a stale output the next time this chain is switched to
+    ilclient_remove_event(standby->video_decoder, OMX_EventPortSettingsChanged, 131, 0, 0, 1);
+    video_renderer_rpi_retire_chain(r, standby);
+
+    r->chain = r->shown;
+    ATOMIC_STORE(r->stalled_since, 0);
+    r->stalled_frames = 0;
+}
+
+/*
+ * A standby decoder that did not come up with the new geometry in time is given up on, the
+ * parameter sets go to the chain on the display instead, which then restarts from the next IDR
+ * like after a recovery.
+ */
+static void video_renderer_rpi_check_switch(video_renderer_rpi_t *r, raop_ntp_t *ntp, uint64_t pts) {
+    uint64_t now = video_renderer_rpi_now_us();
+    if (r->chain == r->shown || now - r->switch_time < CHAIN_SWITCH_TIMEOUT_MS * 1000ull) {
+        return;
+    }
+
+    logger_log(r->base.logger, LOGGER_WARNING, "The standby decoder did not put out %dx%d in %d ms, staying on the one on the display",
+               r->width, r->height, CHAIN_SWITCH_TIMEOUT_MS);
+    video_renderer_rpi_abandon_switch(r);
+    if (r->parameter_sets_size) {
+        video_renderer_rpi_feed_parameter_sets(r, ntp, pts);
+    }
+    r->waiting_for_idr = true;
+    r->base.needs_gop = true;
+    r->recovery_time = now;
+}
+
+/*
+ * A corrupt or lost frame can wedge the VideoCore decoder, which then keeps taking input while
+ * its output stays frozen until the sender reconnects. Once a stall outlasts STALL_RECOVERY_MS
+ * with frames still coming in, the decoder and the tunnels behind it are flushed, the parameter
+ * sets are fed again and frames are dropped until an IDR restarts decoding from scratch: the
+ * one the mirror kept, which needs_gop asks for, or else the sender's next.
+ */
+static void video_renderer_rpi_recover_stall(video_renderer_rpi_t *r, raop_ntp_t *ntp, uint64_t pts) {
+    video_renderer_rpi_check_switch(r, ntp, pts);
+
+    uint64_t stalled_since = ATOMIC_LOAD(r->stalled_since);
+    if (!stalled_since) {
+        r->stalled_frames = 0;
+        return;
+    }
+    int max_dec_frame_buffering = r->config->max_dec_frame_buffering > 0 ?
+                                  r->config->max_dec_frame_buffering : MAX_DEC_FRAME_BUFFERING;
+    // The decoder may hold back up to max_dec_frame_buffering frames without being stuck
+    uint64_t now = video_renderer_rpi_now_us();
+    if (++r->stalled_frames <= max_dec_frame_buffering || now - stalled_since < STALL_RECOVERY_MS * 1000ull ||
+        !r->parameter_sets_size) {
+        return;
+    }
+
+    r->recoveries++;
+    metrics_add(METRIC_VIDEO_DECODER_RECOVERIES, 1);
+    flight_recorder_trigger("video decoder restart");
+    logger_log(r->base.logger, LOGGER_WARNING, "Video decoder stalled for %llu ms, restarting it (%llu recoveries so far)",
+               (now - stalled_since) / 1000, r->recoveries);
+
+    OMX_SendCommand(ilclient_get_handle(r->chain->video_decoder), OMX_CommandFlush, 130, NULL);
+    ilclient_wait_for_event(r->chain->video_decoder, OMX_EventCmdComplete, OMX_CommandFlush, 0, 130, 0,
+                            ILCLIENT_PORT_FLUSH, INPUT_BUFFER_TIMEOUT_MS);
+    video_renderer_rpi_flush_tunnels(r, r->chain);
+    ATOMIC_STORE(r->stalled_since, 0);
+    r->stalled_frames = 0;
+
+    // The clock restarts at the parameter sets, as on a resync
+    r->first_packet_time = 0;
+    video_renderer_rpi_feed_parameter_sets(r, ntp, pts);
+    r->waiting_for_idr = true;
+    r->base.needs_gop = true;
+    r->recovery_time = now;
+}
+
+/* Whether a frame may go to the decoder after a recovery, only an IDR or a late enough frame can */
+static bool video_renderer_rpi_resume_at_idr(video_renderer_rpi_t *r, h264_nal_index_t const *nal_index) {
+    if (!r->waiting_for_idr) {
+        return true;
+    }
+    uint64_t waited = video_renderer_rpi_now_us() - r->recovery_time;
+    for (int i = 0; i < nal_index->count; i++) {
+        if (nal_index->nals[i].nal_unit_type == NAL_UNIT_TYPE_CODED_SLICE_IDR) {
+            logger_log(r->base.logger, LOGGER_INFO, "Video decoder resumed at an IDR %llu ms after its recovery", waited / 1000);
+            r->waiting_for_idr = false;
+            return true;
+        }
+    }
+    if (waited > STALL_IDR_WAIT_MS * 1000ull) {
+        // The sender has no IDR coming, a few corrupt frames beat a frozen picture
+        logger_log(r->base.logger, LOGGER_WARNING, "No IDR %d ms after the video decoder recovery, resuming anyway", STALL_IDR_WAIT_MS);
+        r->waiting_for_idr = false;
+        return true;
+    }
+    r->dropped_frames++;
+    metrics_add(METRIC_VIDEO_FRAMES_DROPPED, 1);
+    return false;
+}
+
+/*
+ * Zero-copy input: frames that fit into a single decoder input buffer are decrypted straight
+ * into it by the mirror thread, so render_acquired only has to hand the buffer to the decoder.
+ */
+static unsigned char *video_renderer_rpi_acquire_buffer(video_renderer_t *renderer, int size, void **handle) {
+    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
+    // The frame is copied in by render_frame instead, which waits for the drain
+    if (size > r->input_buffer_size || ATOMIC_LOAD(r->draining)) {
+        return NULL;
+    }
+    OMX_BUFFERHEADERTYPE *buffer = video_renderer_rpi_get_input_buffer(r, r->chain, 0);
+    if (!buffer) {
+        return NULL;
+    }
+    // ilclient leaves pAppPrivate alone, the chain may change before the buffer comes back
+    buffer->pAppPrivate = r->chain;
+    *handle = buffer;
+    return buffer->pBuffer;
+}
+
+static void video_renderer_rpi_release_buffer(video_renderer_t *renderer, void *handle) {
+    OMX_BUFFERHEADERTYPE *buffer = handle;
+    video_renderer_rpi_chain_t *chain = buffer->pAppPrivate;
+
+    // Input buffers only find their way back through the decoder, an empty one is simply returned
+    buffer->nFilledLen = 0;
+    buffer->nOffset = 0;
+    buffer->nFlags = 0;
+    if (OMX_EmptyThisBuffer(ilclient_get_handle(chain->video_decoder), buffer) != OMX_ErrorNone) {
+        logger_log(renderer->logger, LOGGER_ERR, "Video decoder refused an empty buffer");
+    }
+}
+
+static void video_renderer_rpi_render_acquired(video_renderer_t *renderer, raop_ntp_t *ntp, void *handle, int data_len,
+                                               uint64_t pts, h264_nal_index_t const *nal_index) {
+    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
+
+    LOGGER_DEBUG_HOT(renderer->logger, "Got h264 data of %d bytes in place", data_len);
+    r->input_frames++;
+
+    video_renderer_rpi_recover_stall(r, ntp, pts);
+    if (!video_renderer_rpi_resume_at_idr(r, nal_index)) {
+        video_renderer_rpi_release_buffer(renderer, handle);
+        return;
+    }
+    video_renderer_rpi_handle_port_settings(r, ntp);
+    OMX_U32 flags = video_renderer_rpi_frame_flags(nal_index);
+    OMX_BUFFERHEADERTYPE *buffer = handle;
+    if (buffer->pAppPrivate != r->chain) {
+        // Acquired before a switch to the other chain, its decoder takes a copy
+        video_renderer_rpi_feed(r, ntp, buffer->pBuffer, data_len, pts, flags, OMX_BUFFERFLAG_ENDOFFRAME);
+        video_renderer_rpi_release_buffer(renderer, handle);
+        return;
+    }
+    video_renderer_rpi_submit_buffer(r, ntp, buffer, data_len, pts, flags | OMX_BUFFERFLAG_ENDOFFRAME, true);
+}
+
+/*
+ * Slice pipelining: the decoder starts on the first slices of a large frame while the rest is
+ * still on the network. Every part ends a NAL unit, the last one the frame. After a recovery
+ * frames are refused, whether one may go on is only known once all of it is there.
+ */
+static bool video_renderer_rpi_render_nals(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len,
+                                           uint64_t pts, bool end_of_frame) {
+    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
 
-        if (!r->config->low_latency) buffer->nTimeStamp = ilclient_ticks_from_s64(pts);
-        if (r->first_packet_time == 0) {
-            buffer->nFlags = OMX_BUFFERFLAG_STARTTIME;
-            r->first_packet_time = raop_ntp_get_local_time(ntp);
-            if (!r->config->low_latency) buffer->nTimeStamp = ilclient_ticks_from_s64(r->first_packet_time);
+    if (!r->frame_in_parts) {
+        video_renderer_rpi_wait_for_drain(r);
+        video_renderer_rpi_recover_stall(r, ntp, pts);
+        if (r->waiting_for_idr) {
+            return false;
         }
+        LOGGER_DEBUG_HOT(renderer->logger, "Got h264 data in parts");
+        r->input_frames++;
+        video_renderer_rpi_handle_port_settings(r, ntp);
+        r->frame_in_parts = true;
+        r->dropping_parts = false;
+        r->part_flags = 0;
+    }
+    // Parts start with the start code of their first NAL unit, a frame's IDR slices come first
+    if (data_len > 4 && (data[4] & 0x1f) == NAL_UNIT_TYPE_CODED_SLICE_IDR) {
+        r->part_flags = OMX_BUFFERFLAG_SYNCFRAME;
+    }
+    if (!r->dropping_parts && (data_len > 0 || end_of_frame)) {
+        OMX_U32 end_flags = OMX_BUFFERFLAG_ENDOFNAL | (end_of_frame ? OMX_BUFFERFLAG_ENDOFFRAME : 0);
+        r->dropping_parts = !video_renderer_rpi_feed(r, ntp, data, data_len, pts, r->part_flags, end_flags);
+    }
+    if (end_of_frame) {
+        r->frame_in_parts = false;
+    }
+    return true;
+}
 
-        // Mark the last buffer if we had to split the data (probably not necessary)
-        if (chunk_size < data_len && offset == data_len) {
-            buffer->nFlags = OMX_BUFFERFLAG_ENDOFFRAME;
+/*
+ * Splices the patched SPS in place of the original one, the segment holding it is split around
+ * it and the rest of the frame is passed on as it is. Returns the new number of segments, or
+ * count if the SPS could not be patched.
+ */
+static int video_renderer_rpi_patch_sps(video_renderer_rpi_t *r, video_segment_t const *segments, int count,
+                                        h264_nal_index_t const *nal_index, video_segment_t *patched) {
+    const h264_nal_index_entry_t *sps = NULL;
+    for (int i = 0; i < nal_index->count; i++) {
+        if (nal_index->nals[i].nal_unit_type == NAL_UNIT_TYPE_SPS) {
+            sps = &nal_index->nals[i];
+            break;
         }
+    }
+    memcpy(patched, segments, count * sizeof(video_segment_t));
+    if (!sps) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not patch sps, passing it on unchanged");
+        return count;
+    }
+
+    int segment = 0, start = 0;
+    while (segment < count && start + segments[segment].size <= sps->offset) {
+        start += segments[segment].size;
+        segment++;
+    }
+    if (segment == count || sps->offset + sps->size > start + segments[segment].size || count + 2 > MAX_FRAME_SEGMENTS) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not patch an sps split across segments, passing it on unchanged");
+        return count;
+    }
+
+    const unsigned char *data = segments[segment].data + sps->offset - start;
+    int patched_sps_size = 0;
+    const uint8_t *patched_sps = sps_patch_cache_get(&r->sps_patch_cache, data, sps->size,
+                                                     r->config->max_dec_frame_buffering > 0 ?
+                                                     r->config->max_dec_frame_buffering : MAX_DEC_FRAME_BUFFERING,
+                                                     &patched_sps_size);
+    if (!patched_sps) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not patch sps, passing it on unchanged");
+        return count;
+    }
+
+    logger_log(r->base.logger, LOGGER_DEBUG, "Injecting max_dec_frame_buffering");
+    int before = sps->offset - start;
+    int after = segments[segment].size - before - sps->size;
+    int n = segment;
+    if (before > 0) {
+        patched[n++] = (video_segment_t) { segments[segment].data, before };
+    }
+    patched[n++] = (video_segment_t) { patched_sps, patched_sps_size };
+    if (after > 0) {
+        patched[n++] = (video_segment_t) { data + sps->size, after };
+    }
+    memcpy(patched + n, segments + segment + 1, (count - segment - 1) * sizeof(video_segment_t));
+    return n + count - segment - 1;
+}
 
-        if (OMX_EmptyThisBuffer(ilclient_get_handle(r->video_decoder), buffer) != OMX_ErrorNone) {
-            logger_log(renderer->logger, LOGGER_ERR, "Video decoder refused processing buffer");
+static void video_renderer_rpi_render_frame(video_renderer_t *renderer, raop_ntp_t *ntp, video_segment_t const *segments,
+                                            int count, uint64_t pts, int type, h264_nal_index_t const *nal_index) {
+    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
+    video_segment_t patched[MAX_FRAME_SEGMENTS];
+
+    int data_len = 0;
+    for (int i = 0; i < count; i++) {
+        data_len += segments[i].size;
+    }
+    if (data_len == 0) return;
+
+    video_renderer_rpi_wait_for_drain(r);
+    LOGGER_DEBUG_HOT(renderer->logger, "Got h264 data of %d bytes in %d segments", data_len, count);
+    r->input_frames++;
+
+    if (type == 0) {
+        video_renderer_rpi_switch_mode(r, true);
+
+        // This reduces the Raspberry Pi H264 decode pipeline delay from about 11 to 6 frames for RPiPlay.
+        // Described at https://www.raspberrypi.org/forums/viewtopic.php?t=41053
+        if (count <= MAX_FRAME_SEGMENTS) {
+            count = video_renderer_rpi_patch_sps(r, segments, count, nal_index, patched);
+            segments = patched;
         }
 
+        // Kept for feeding them again after a recovery, the only copy the parameter sets need
+        int size = 0;
+        for (int i = 0; i < count; i++) {
+            size += segments[i].size;
+        }
+        if (size <= MAX_PARAMETER_SETS_SIZE) {
+            r->parameter_sets_size = 0;
+            for (int i = 0; i < count; i++) {
+                memcpy(r->parameter_sets + r->parameter_sets_size, segments[i].data, segments[i].size);
+                r->parameter_sets_size += segments[i].size;
+            }
+        }
+    } else {
+        video_renderer_rpi_recover_stall(r, ntp, pts);
+        if (!video_renderer_rpi_resume_at_idr(r, nal_index)) {
+            return;
+        }
     }
 
-    if (modified_data) {
-        // We overwrote the data buffer to inject the max_dec_frame_buffering before,
-        // so we need to free the data buffer here
-        free(modified_data);
+    video_renderer_rpi_handle_port_settings(r, ntp);
+    if (type == 0) {
+        video_renderer_rpi_feed_segments(r, ntp, segments, count, pts, OMX_BUFFERFLAG_CODECCONFIG, OMX_BUFFERFLAG_ENDOFFRAME);
+    } else {
+        video_renderer_rpi_feed_segments(r, ntp, segments, count, pts, video_renderer_rpi_frame_flags(nal_index),
+                                         OMX_BUFFERFLAG_ENDOFFRAME);
     }
 }
 
+static void video_renderer_rpi_render_buffer(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len,
+                                  uint64_t pts, int type, h264_nal_index_t const *nal_index) {
+    video_segment_t segment = { data, data_len };
+    video_renderer_rpi_render_frame(renderer, ntp, &segment, 1, pts, type, nal_index);
+}
+
+/*
+ * Ends a session and puts the renderer into standby. The components stay executing with their
+ * tunnels and the decoder output set up, only the stream is drained and the clock restarted, so
+ * the next session does not have to wait for the pipeline to be built again. Every wait in here
+ * is bounded, if the end of stream marker does not come out the decoder ports are flushed.
+ */
+static void video_renderer_rpi_drain(video_renderer_rpi_t *r) {
+    video_renderer_t *renderer = &r->base;
+
+    // A switch still waiting for the standby decoder is called off, the stream ends on the display
+    if (r->chain != r->shown) {
+        video_renderer_rpi_abandon_switch(r);
+    }
+    if (r->retiring) {
+        video_renderer_rpi_retire_chain(r, r->retiring);
+    }
+    video_renderer_rpi_chain_t *chain = r->chain;
+
+    // Nothing to drain if no frame was sent, the end of stream marker would never come out
+    if (r->input_frames > 0) {
+        OMX_BUFFERHEADERTYPE *buffer = video_renderer_rpi_get_input_buffer(r, chain, INPUT_BUFFER_TIMEOUT_MS);
+        if (buffer == NULL) {
+            logger_log(renderer->logger, LOGGER_ERR, "Got NULL buffer while flushing!");
+        } else {
+            buffer->nFilledLen = 0;
+            buffer->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN | OMX_BUFFERFLAG_EOS;
+            video_renderer_rpi_push_pending(r, chain, 0);
+            if (OMX_EmptyThisBuffer(ilclient_get_handle(chain->video_decoder), buffer) != OMX_ErrorNone) {
+                logger_log(renderer->logger, LOGGER_ERR, "Video decoder refused processing buffer while flushing!");
+            }
+
+            // Wait until EOS reaches renderer
+            if (ilclient_wait_for_event(chain->video_renderer, OMX_EventBufferFlag, 90, 0, OMX_BUFFERFLAG_EOS, 0,
+                                        ILCLIENT_BUFFER_FLAG_EOS, FLUSH_EOS_TIMEOUT_MS) != 0) {
+                logger_log(renderer->logger, LOGGER_WARNING, "End of stream did not reach the renderer while flushing");
+                buffer = NULL;
+            }
+        }
+        if (buffer == NULL) {
+            // The decoder holds on to what it has, its input is thrown away rather than drained
+            OMX_SendCommand(ilclient_get_handle(chain->video_decoder), OMX_CommandFlush, 130, NULL);
+            if (ilclient_wait_for_event(chain->video_decoder, OMX_EventCmdComplete, OMX_CommandFlush, 0, 130, 0,
+                                        ILCLIENT_PORT_FLUSH, FLUSH_PORT_TIMEOUT_MS) != 0) {
+                logger_log(renderer->logger, LOGGER_WARNING, "Video decoder did not flush its input in %d ms",
+                           FLUSH_PORT_TIMEOUT_MS);
+            }
+        }
+        video_renderer_rpi_flush_tunnels(r, chain);
+    }
+
+    // The clock waits for the start time of the next session's first frame again, on the chain it goes to
+    if (r->clock) {
+        OMX_TIME_CONFIG_CLOCKSTATETYPE clock_state;
+        memset(&clock_state, 0, sizeof(OMX_TIME_CONFIG_CLOCKSTATETYPE));
+        clock_state.nSize = sizeof(OMX_TIME_CONFIG_CLOCKSTATETYPE);
+        clock_state.nVersion.nVersion = OMX_VERSION;
+        clock_state.eState = OMX_TIME_ClockStateStopped;
+        OMX_SetConfig(ilclient_get_handle(r->clock), OMX_IndexConfigTimeClockState, &clock_state);
+        clock_state.eState = OMX_TIME_ClockStateWaitingForStartTime;
+        clock_state.nWaitMask = 1 << (video_renderer_rpi_clock_ports[chain - r->chains] - 80);
+        if (OMX_SetConfig(ilclient_get_handle(r->clock), OMX_IndexConfigTimeClockState,
+                          &clock_state) != OMX_ErrorNone) {
+            logger_log(renderer->logger, LOGGER_ERR, "Could not reset the video clock");
+        }
+        video_renderer_rpi_set_clock_scale(r, CLOCK_SCALE_UNITY);
+    }
+
+    r->first_packet_time = 0;
+    r->input_frames = 0;
+    // Whatever the decoder did not return by now is not going to line up with the next stream
+    MUTEX_LOCK(r->input_mutex);
+    chain->pending_tail = chain->pending_head;
+    MUTEX_UNLOCK(r->input_mutex);
+    r->stage_pts = 0;
+    frame_stages_flush(&r->stages);
+    frame_stages_log(&r->stages, renderer->logger);
+    r->width = 0;
+    r->height = 0;
+    chain->preconfigured = NULL;
+    r->standby = true;
+    video_renderer_rpi_switch_mode(r, false);
+    ATOMIC_STORE(r->stalled_since, 0);
+    r->stalled_frames = 0;
+    r->parameter_sets_size = 0;
+    r->waiting_for_idr = false;
+    r->base.needs_gop = false;
+    r->frame_in_parts = false;
+    r->base.decoder_ready_time = 0;
+    r->base.first_render_time = 0;
+}
+
+static THREAD_RETVAL video_renderer_rpi_drain_thread(void *arg) {
+    video_renderer_rpi_t *r = arg;
+
+    MUTEX_LOCK(r->drain_mutex);
+    while (!r->drain_stopping) {
+        if (r->background_requested) {
+            r->background_requested = false;
+            int visits = r->background_visits;
+            MUTEX_UNLOCK(r->drain_mutex);
+            video_renderer_rpi_apply_background(r, visits);
+            MUTEX_LOCK(r->drain_mutex);
+            continue;
+        }
+        if (!r->drain_requested) {
+            COND_WAIT(r->drain_cond, r->drain_mutex);
+            continue;
+        }
+        MUTEX_UNLOCK(r->drain_mutex);
+        video_renderer_rpi_drain(r);
+        MUTEX_LOCK(r->drain_mutex);
+        r->drain_requested = false;
+        ATOMIC_STORE(r->draining, false);
+        COND_BROADCAST(r->drain_cond);
+    }
+    MUTEX_UNLOCK(r->drain_mutex);
+    return 0;
+}
+
+/*
+ * Called on the RTSP thread when a connection goes, so the drain is only started here: the next
+ * sender can connect right away, and only its first frame waits for the drain to finish.
+ */
 static void video_renderer_rpi_flush(video_renderer_t *renderer) {
     video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
-    OMX_BUFFERHEADERTYPE *buffer = ilclient_get_input_buffer(r->video_decoder, 130, 1);
-    if (buffer == NULL) logger_log(renderer->logger, LOGGER_ERR, "Got NULL buffer while flushing!");
-    if (!buffer)
+    if (!r->drain_thread) {
+        video_renderer_rpi_drain(r);
         return;
+    }
+    MUTEX_LOCK(r->drain_mutex);
+    r->drain_requested = true;
+    ATOMIC_STORE(r->draining, true);
+    COND_BROADCAST(r->drain_cond);
+    MUTEX_UNLOCK(r->drain_mutex);
+}
 
-    buffer->nFilledLen = 0;
-    buffer->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN | OMX_BUFFERFLAG_EOS;
-    if (OMX_EmptyThisBuffer(ilclient_get_handle(r->video_decoder), buffer) != OMX_ErrorNone) {
-        logger_log(renderer->logger, LOGGER_ERR, "Video decoder refused processing buffer while flushing!");
+/* The decoder idles in OMX_StatePause, the renderer keeps showing the picture it has */
+static void video_renderer_rpi_pause(video_renderer_t *renderer, bool paused) {
+    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
+    video_renderer_rpi_wait_for_drain(r);
+    if (ilclient_change_component_state(r->chain->video_decoder, paused ? OMX_StatePause : OMX_StateExecuting) != 0) {
+        logger_log(renderer->logger, LOGGER_WARNING, "Could not %s the video decoder", paused ? "pause" : "resume");
+        return;
     }
+    if (!paused) {
+        // No output while paused is no stall, and the clock restarts in sync at the next buffer
+        ATOMIC_STORE(r->stalled_since, 0);
+        r->stalled_frames = 0;
+        r->first_packet_time = 0;
+    }
+}
 
-    // Wait until EOS reaches renderer
-    ilclient_wait_for_event(r->video_renderer, OMX_EventBufferFlag, 90, 0, OMX_BUFFERFLAG_EOS, 0,
-                            ILCLIENT_BUFFER_FLAG_EOS, -1);
-    ilclient_flush_tunnels(r->tunnels, 0);
+/* Holds back whatever touches the decoder until a drain in progress is done, which is bounded */
+static void video_renderer_rpi_wait_for_drain(video_renderer_rpi_t *r) {
+    if (!ATOMIC_LOAD(r->draining)) {
+        return;
+    }
+    MUTEX_LOCK(r->drain_mutex);
+    while (r->drain_requested) {
+        COND_WAIT(r->drain_cond, r->drain_mutex);
+    }
+    MUTEX_UNLOCK(r->drain_mutex);
+}
 
-    r->first_packet_time = 0;
+/* Runs on a VideoCore thread once per display refresh */
+static void video_renderer_rpi_vsync(DISPMANX_UPDATE_HANDLE_T update, void *arg) {
+    video_renderer_rpi_t *r = (video_renderer_rpi_t *) arg;
+    // The clock of raop_ntp_get_local_time
+    uint64_t now = media_clock_now();
+
+    uint64_t last = ATOMIC_LOAD(r->last_vsync);
+    if (last && now > last) {
+        uint64_t interval = now - last;
+        uint64_t period = ATOMIC_LOAD(r->vsync_period);
+        // A late callback shows up as a longer interval and is left out of the average
+        if (!period) {
+            period = interval;
+        } else if (interval < period * 3 / 2) {
+            period = (int64_t) period + ((int64_t) interval - (int64_t) period) / 16;
+        }
+        ATOMIC_STORE(r->vsync_period, period);
+    }
+    ATOMIC_STORE(r->last_vsync, now);
+}
+
+static uint64_t video_renderer_rpi_next_vsync(video_renderer_t *renderer, uint64_t time) {
+    video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
+    if (r->vsync_unavailable) {
+        return time;
+    }
+    if (!r->vsync_display) {
+        r->vsync_display = vc_dispmanx_display_open(0);
+        if (!r->vsync_display || vc_dispmanx_vsync_callback(r->vsync_display, video_renderer_rpi_vsync, r) != 0) {
+            logger_log(renderer->logger, LOGGER_WARNING, "Could not follow the display refresh, frames are not aligned to it");
+            if (r->vsync_display) vc_dispmanx_display_close(r->vsync_display);
+            r->vsync_display = 0;
+            r->vsync_unavailable = true;
+        }
+        return time;
+    }
+    uint64_t last = ATOMIC_LOAD(r->last_vsync);
+    uint64_t period = ATOMIC_LOAD(r->vsync_period);
+    if (!last || !period || time <= last) {
+        return time;
+    }
+    return last + (time - last + period - 1) / period * period;
+}
+
+/*
+ * The HVS scales the composed display down into a small resource as it reads it, so the
+ * decoder pipeline is left alone and only the few pixels of the snapshot are copied to the ARM.
+ */
+static int video_renderer_rpi_snapshot(video_renderer_t *renderer, int width, int height, int timeout_ms,
+                                       unsigned char **jpeg) {
+    DISPMANX_DISPLAY_HANDLE_T display = vc_dispmanx_display_open(0);
+    if (!display) {
+        return -1;
+    }
+    uint32_t vc_image_ptr;
+    DISPMANX_RESOURCE_HANDLE_T resource = vc_dispmanx_resource_create(VC_IMAGE_RGB888, width, height, &vc_image_ptr);
+    int pitch = (width * 3 + 31) & ~31;
+    unsigned char *pixels = malloc((size_t) pitch * height);
+    int size = -1;
+    if (resource && pixels && vc_dispmanx_snapshot(display, resource, DISPMANX_NO_ROTATE) == 0) {
+        VC_RECT_T rect;
+        vc_dispmanx_rect_set(&rect, 0, 0, width, height);
+        if (vc_dispmanx_resource_read_data(resource, &rect, pixels, pitch) == 0) {
+            size = jpeg_write_rgb(pixels, pitch, 3, width, height, 80, jpeg);
+        }
+    }
+    if (size < 0) {
+        logger_log(renderer->logger, LOGGER_WARNING, "Could not take a snapshot of the display");
+    }
+    free(pixels);
+    if (resource) vc_dispmanx_resource_delete(resource);
+    vc_dispmanx_display_close(display);
+    return size;
 }
 
 static void video_renderer_rpi_destroy(video_renderer_t *renderer) {
     video_renderer_rpi_t *r = (video_renderer_rpi_t *)renderer;
     if (renderer) {
-        // Only flush if data was sent through, gets stuck otherwise
-        if (r->first_packet_time) video_renderer_rpi_flush(renderer);
+        if (r->vsync_display) {
+            vc_dispmanx_vsync_callback(r->vsync_display, NULL, NULL);
+            vc_dispmanx_display_close(r->vsync_display);
+        }
+        if (r->drain_thread) {
+            MUTEX_LOCK(r->drain_mutex);
+            r->drain_stopping = true;
+            COND_BROADCAST(r->drain_cond);
+            MUTEX_UNLOCK(r->drain_mutex);
+            THREAD_JOIN(r->drain_thread);
+        }
+        if (r->input_frames) video_renderer_rpi_drain(r);
+        video_renderer_rpi_switch_mode(r, false);
         video_renderer_rpi_destroy_decoder(r);
+        COND_DESTROY(r->drain_cond);
+        MUTEX_DESTROY(r->drain_mutex);
+        frame_stages_destroy(&r->stages);
+        COND_DESTROY(r->input_cond);
+        MUTEX_DESTROY(r->input_mutex);
         free(renderer);
     }
 }
@@ -529,7 +1964,17 @@ static void video_renderer_rpi_destroy(video_renderer_t *renderer) {
 static const video_renderer_funcs_t video_renderer_rpi_funcs = {
     .start = video_renderer_rpi_start,
     .render_buffer = video_renderer_rpi_render_buffer,
+    .render_frame = video_renderer_rpi_render_frame,
+    .acquire_buffer = video_renderer_rpi_acquire_buffer,
+    .render_acquired = video_renderer_rpi_render_acquired,
+    .release_buffer = video_renderer_rpi_release_buffer,
+    .render_nals = video_renderer_rpi_render_nals,
+    .is_congested = video_renderer_rpi_is_congested,
+    .next_vsync = video_renderer_rpi_next_vsync,
+    .reconfigure = video_renderer_rpi_reconfigure,
+    .pause = video_renderer_rpi_pause,
     .flush = video_renderer_rpi_flush,
     .destroy = video_renderer_rpi_destroy,
     .update_background = video_renderer_rpi_update_background,
+    .snapshot = video_renderer_rpi_snapshot,
 };
@@ -0,0 +1,1208 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include "video_renderer.h"
+
+#include <stdlib.h>
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+#include <linux/dma-buf.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+#include <drm_fourcc.h>
+
+#include "../lib/threads.h"
+#include "../lib/metrics.h"
+#include "../lib/flight_recorder.h"
+#include "../lib/histogram.h"
+#include "frame_stages.h"
+#include "../lib/timecode.h"
+#if defined(HAS_EGL_PRESENTER)
+#include "egl_presenter.h"
+#endif
+
+/*
+ * H264 renderer for V4L2 memory-to-memory decoders, like bcm2835-codec on the
+ * Raspberry Pi 4 and most other SBCs, and H265 where the same decoder takes it. Frames are queued to the stateful decoder
+ * as they arrive, decoded pictures are exported as DMABUFs and scanned out by
+ * a DRM/KMS plane, so no pixel ever passes through the CPU. Where the plane cannot rotate or
+ * flip as asked, the GPU draws the pictures onto the display instead, see egl_presenter.h.
+ */
+
+// The bcm2835-codec decoder, other nodes are probed when it is missing
+#define V4L2_DECODER_DEVICE "/dev/video10"
+#define V4L2_MAX_DEVICES 32
+#define DRM_MAX_CARDS 4
+// Bitstream buffers used when the configuration leaves the choice to the renderer
+#define DEFAULT_OUTPUT_BUFFERS 6
+#define DEFAULT_OUTPUT_BUFFER_SIZE (512 * 1024)
+#define MAX_OUTPUT_BUFFERS 32
+// Picture buffers beyond the decoder minimum: one on screen, one waiting for the next scanout
+#define EXTRA_CAPTURE_BUFFERS 2
+#define MAX_CAPTURE_BUFFERS 32
+// Longest the render thread waits for the decoder to return a bitstream buffer before dropping a frame
+#define OUTPUT_BUFFER_TIMEOUT_MS 100
+#define POLL_TIMEOUT_MS 100
+// Pictures due further in the future than this are shown right away, the timestamps are off
+#define MAX_PRESENT_DELAY_US 500000
+
+typedef enum video_renderer_v4l2_output_state_e {
+    OUTPUT_FREE,
+    OUTPUT_ACQUIRED, // Handed to the mirror thread by acquire_buffer
+    OUTPUT_QUEUED    // Owned by the decoder
+} video_renderer_v4l2_output_state_t;
+
+typedef struct video_renderer_v4l2_output_s {
+    unsigned char *start;
+    size_t length;
+    video_renderer_v4l2_output_state_t state;
+} video_renderer_v4l2_output_t;
+
+typedef struct video_renderer_v4l2_capture_s {
+    int num_planes;
+    int dmabuf_fds[VIDEO_MAX_PLANES];
+    uint32_t gem_handles[VIDEO_MAX_PLANES];
+    uint32_t fb_id;
+    // The luma plane, only mapped to read the timecode back with measure_latency
+    const unsigned char *map;
+    size_t map_length;
+#if defined(HAS_EGL_PRESENTER)
+    egl_presenter_image_t *image;
+#endif
+} video_renderer_v4l2_capture_t;
+
+typedef struct video_renderer_v4l2_s {
+    video_renderer_t base;
+    video_renderer_config_t const *config;
+
+    int fd;
+    // Only used for timestamps, set by the first frame
+    raop_ntp_t *ntp;
+
+    // Bitstream side of the decoder, filled by the render and mirror threads
+    mutex_handle_t output_mutex;
+    video_renderer_v4l2_output_t *output;
+    int output_count;
+    // output points at one of these, the other keeps what is still acquired from before a codec switch
+    video_renderer_v4l2_output_t output_sets[2][MAX_OUTPUT_BUFFERS];
+    video_codec_t codec;
+    uint64_t input_frames;
+    uint64_t dropped_frames;
+
+    // Picture side of the decoder, only touched by the display thread once started
+    thread_handle_t thread;
+    bool running;
+    video_renderer_v4l2_capture_t capture[MAX_CAPTURE_BUFFERS];
+    int capture_count;
+    bool capture_streaming;
+    int displayed;
+    int capture_pitch;
+
+    int drm_fd;
+    uint32_t crtc_id;
+    // Selects the CRTC in vblank requests, and its refresh period in us
+    uint32_t vblank_pipe;
+    uint64_t vblank_period;
+    uint32_t plane_id;
+    int display_width;
+    int display_height;
+    bool rotated;
+#if defined(HAS_EGL_PRESENTER)
+    // Set when the GPU presents instead of the plane
+    egl_presenter_t *egl;
+#endif
+
+    // Visible picture and where it lands on the display
+    int src_x, src_y, src_width, src_height;
+    int dst_x, dst_y, dst_width, dst_height;
+
+    // From the sender's timecode to the plane update, recorded by the display thread
+    histogram_t latency_histogram;
+    // From queueing the bitstream to dequeueing the picture, and from there to the plane update
+    frame_stages_t stages;
+} video_renderer_v4l2_t;
+
+static const video_renderer_funcs_t video_renderer_v4l2_funcs;
+static void video_renderer_v4l2_destroy(video_renderer_t *renderer);
+
+static int xioctl(int fd, unsigned long request, void *arg) {
+    int ret;
+    do {
+        ret = ioctl(fd, request, arg);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
+
+static uint32_t video_renderer_v4l2_pixelformat(video_codec_t codec) {
+    return codec == VIDEO_CODEC_H265 ? V4L2_PIX_FMT_HEVC : V4L2_PIX_FMT_H264;
+}
+
+static const char *video_renderer_v4l2_codec_name(video_codec_t codec) {
+    return codec == VIDEO_CODEC_H265 ? "H.265" : "H.264";
+}
+
+static bool video_renderer_v4l2_is_decoder(int fd, uint32_t pixelformat) {
+    struct v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(fd, VIDIOC_QUERYCAP, &cap) == -1) {
+        return false;
+    }
+    uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_M2M_MPLANE) || !(caps & V4L2_CAP_STREAMING)) {
+        return false;
+    }
+
+    struct v4l2_fmtdesc fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    for (fmt.index = 0; xioctl(fd, VIDIOC_ENUM_FMT, &fmt) == 0; fmt.index++) {
+        if (fmt.pixelformat == pixelformat) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int video_renderer_v4l2_open_decoder(logger_t *logger) {
+    char path[32];
+    for (int i = -1; i < V4L2_MAX_DEVICES; i++) {
+        if (i == -1) {
+            snprintf(path, sizeof(path), "%s", V4L2_DECODER_DEVICE);
+        } else {
+            snprintf(path, sizeof(path), "/dev/video%d", i);
+            if (!strcmp(path, V4L2_DECODER_DEVICE)) continue;
+        }
+        int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd == -1) continue;
+        if (video_renderer_v4l2_is_decoder(fd, V4L2_PIX_FMT_H264)) {
+            logger_log(logger, LOGGER_INFO, "Using V4L2 H.264 decoder %s", path);
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+static bool video_renderer_v4l2_plane_supports(drmModePlane *plane, uint32_t format) {
+    for (uint32_t i = 0; i < plane->count_formats; i++) {
+        if (plane->formats[i] == format) return true;
+    }
+    return false;
+}
+
+/* Finds a driven display and an unused plane on it that can scan out NV12 */
+static bool video_renderer_v4l2_find_plane(video_renderer_v4l2_t *r, int fd) {
+    drmModeRes *res = drmModeGetResources(fd);
+    if (!res) {
+        return false;
+    }
+
+    int crtc_index = -1;
+    for (int i = 0; i < res->count_crtcs && crtc_index == -1; i++) {
+        drmModeCrtc *crtc = drmModeGetCrtc(fd, res->crtcs[i]);
+        if (!crtc) continue;
+        if (crtc->mode_valid && crtc->buffer_id) {
+            crtc_index = i;
+            r->crtc_id = crtc->crtc_id;
+            r->display_width = crtc->mode.hdisplay;
+            r->display_height = crtc->mode.vdisplay;
+            r->base.display_width = r->display_width;
+            r->base.display_height = r->display_height;
+            r->base.display_refresh_rate = crtc->mode.vrefresh;
+            if (crtc->mode.clock && crtc->mode.htotal && crtc->mode.vtotal) {
+                // vrefresh is rounded, the pixel clock in kHz tells 59.94 from 60 Hz
+                r->base.display_refresh_rate = crtc->mode.clock * 1000.0 / crtc->mode.htotal / crtc->mode.vtotal;
+                r->vblank_period = (uint64_t) crtc->mode.htotal * crtc->mode.vtotal * 1000 / crtc->mode.clock;
+            }
+            r->vblank_pipe = i == 0 ? 0 : i == 1 ? DRM_VBLANK_SECONDARY :
+                             (i << DRM_VBLANK_HIGH_CRTC_SHIFT) & DRM_VBLANK_HIGH_CRTC_MASK;
+        }
+        drmModeFreeCrtc(crtc);
+    }
+    drmModeFreeResources(res);
+    if (crtc_index == -1) {
+        return false;
+    }
+
+    drmModePlaneRes *planes = drmModeGetPlaneResources(fd);
+    if (!planes) {
+        return false;
+    }
+    r->plane_id = 0;
+    for (uint32_t i = 0; i < planes->count_planes && !r->plane_id; i++) {
+        drmModePlane *plane = drmModeGetPlane(fd, planes->planes[i]);
+        if (!plane) continue;
+        // The primary plane is busy with the console or desktop, the video goes on top of it
+        if ((plane->possible_crtcs & (1u << crtc_index)) && !plane->fb_id &&
+            video_renderer_v4l2_plane_supports(plane, DRM_FORMAT_NV12)) {
+            r->plane_id = plane->plane_id;
+        }
+        drmModeFreePlane(plane);
+    }
+    drmModeFreePlaneResources(planes);
+    return r->plane_id != 0;
+}
+
+static int video_renderer_v4l2_open_display(video_renderer_v4l2_t *r) {
+    char path[32];
+    for (int i = 0; i < DRM_MAX_CARDS; i++) {
+        snprintf(path, sizeof(path), "/dev/dri/card%d", i);
+        int fd = open(path, O_RDWR | O_CLOEXEC);
+        if (fd == -1) continue;
+        drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+        if (video_renderer_v4l2_find_plane(r, fd)) {
+            logger_log(r->base.logger, LOGGER_INFO, "Presenting on %s plane %u, %dx%d",
+                       path, r->plane_id, r->display_width, r->display_height);
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+/* KMS rotates counter-clockwise, the -r option turns the picture clockwise like the OpenMAX renderer */
+static void video_renderer_v4l2_setup_rotation(video_renderer_v4l2_t *r) {
+    int rotation = ((r->config->rotation % 360) + 360) % 360;
+    uint64_t value;
+    switch (rotation) {
+        case 90: value = DRM_MODE_ROTATE_270; break;
+        case 180: value = DRM_MODE_ROTATE_180; break;
+        case 270: value = DRM_MODE_ROTATE_90; break;
+        default: value = DRM_MODE_ROTATE_0; break;
+    }
+    if (r->config->flip == FLIP_HORIZONTAL || r->config->flip == FLIP_BOTH) value |= DRM_MODE_REFLECT_X;
+    if (r->config->flip == FLIP_VERTICAL || r->config->flip == FLIP_BOTH) value |= DRM_MODE_REFLECT_Y;
+    r->rotated = rotation == 90 || rotation == 270;
+    if (value == DRM_MODE_ROTATE_0) {
+        return;
+    }
+
+    bool applied = false;
+    drmModeObjectProperties *props = drmModeObjectGetProperties(r->drm_fd, r->plane_id, DRM_MODE_OBJECT_PLANE);
+    for (uint32_t i = 0; props && i < props->count_props && !applied; i++) {
+        drmModePropertyRes *prop = drmModeGetProperty(r->drm_fd, props->props[i]);
+        if (!prop) continue;
+        if (!strcmp(prop->name, "rotation")) {
+            applied = drmModeObjectSetProperty(r->drm_fd, r->plane_id, DRM_MODE_OBJECT_PLANE,
+                                               prop->prop_id, value) == 0;
+        }
+        drmModeFreeProperty(prop);
+    }
+    drmModeFreeObjectProperties(props);
+    if (!applied) {
+#if defined(HAS_EGL_PRESENTER)
+        r->egl = egl_presenter_init(r->base.logger, r->drm_fd, r->crtc_id, r->config);
+        if (r->egl) {
+            logger_log(r->base.logger, LOGGER_INFO, "Display plane cannot rotate or flip, the GPU does instead");
+            return;
+        }
+#endif
+        logger_log(r->base.logger, LOGGER_WARNING, "Display plane does not support the requested rotation or flip");
+        r->rotated = false;
+    }
+}
+
+static int video_renderer_v4l2_setup_output(video_renderer_v4l2_t *r) {
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    fmt.fmt.pix_mp.pixelformat = video_renderer_v4l2_pixelformat(r->codec);
+    fmt.fmt.pix_mp.num_planes = 1;
+    fmt.fmt.pix_mp.plane_fmt[0].sizeimage = r->config->input_buffer_size > 0 ?
+                                            r->config->input_buffer_size : DEFAULT_OUTPUT_BUFFER_SIZE;
+    if (xioctl(r->fd, VIDIOC_S_FMT, &fmt) == -1) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not set %s input format %d %s",
+                   video_renderer_v4l2_codec_name(r->codec), errno, strerror(errno));
+        return -1;
+    }
+
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = r->config->input_buffer_count > 0 ? r->config->input_buffer_count : DEFAULT_OUTPUT_BUFFERS;
+    if (req.count > MAX_OUTPUT_BUFFERS) req.count = MAX_OUTPUT_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(r->fd, VIDIOC_REQBUFS, &req) == -1 || req.count == 0) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not allocate decoder input buffers %d %s", errno, strerror(errno));
+        return -1;
+    }
+
+    for (r->output_count = 0; r->output_count < (int) req.count; r->output_count++) {
+        struct v4l2_plane planes[VIDEO_MAX_PLANES];
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = r->output_count;
+        buf.m.planes = planes;
+        buf.length = VIDEO_MAX_PLANES;
+        if (xioctl(r->fd, VIDIOC_QUERYBUF, &buf) == -1) {
+            return -1;
+        }
+        void *start = mmap(NULL, planes[0].length, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, planes[0].m.mem_offset);
+        if (start == MAP_FAILED) {
+            logger_log(r->base.logger, LOGGER_ERR, "Could not map decoder input buffer %d %s", errno, strerror(errno));
+            return -1;
+        }
+        r->output[r->output_count].start = start;
+        r->output[r->output_count].length = planes[0].length;
+        r->output[r->output_count].state = OUTPUT_FREE;
+    }
+    logger_log(r->base.logger, LOGGER_DEBUG, "Decoder input uses %d buffers of %zu bytes",
+               r->output_count, r->output[0].length);
+
+    struct v4l2_event_subscription sub;
+    memset(&sub, 0, sizeof(sub));
+    sub.type = V4L2_EVENT_SOURCE_CHANGE;
+    if (xioctl(r->fd, VIDIOC_SUBSCRIBE_EVENT, &sub) == -1) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not subscribe to decoder events %d %s", errno, strerror(errno));
+        return -1;
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    if (xioctl(r->fd, VIDIOC_STREAMON, &type) == -1) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not start decoder input %d %s", errno, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+video_renderer_t *video_renderer_v4l2_init(logger_t *logger, video_renderer_config_t const *config) {
+    video_renderer_v4l2_t *renderer;
+    renderer = calloc(1, sizeof(video_renderer_v4l2_t));
+    if (!renderer) {
+        return NULL;
+    }
+    renderer->base.logger = logger;
+    renderer->base.funcs = &video_renderer_v4l2_funcs;
+    renderer->base.type = VIDEO_RENDERER_V4L2;
+    renderer->config = config;
+    renderer->drm_fd = -1;
+    renderer->displayed = -1;
+    renderer->output = renderer->output_sets[0];
+    histogram_init(&renderer->latency_histogram);
+    frame_stages_init(&renderer->stages);
+    MUTEX_CREATE(renderer->output_mutex);
+
+    renderer->fd = video_renderer_v4l2_open_decoder(logger);
+    if (renderer->fd == -1) {
+        logger_log(logger, LOGGER_ERR, "Could not find a V4L2 H.264 decoder");
+        goto fail;
+    }
+    if (config->hevc) {
+        renderer->base.supports_hevc = video_renderer_v4l2_is_decoder(renderer->fd, V4L2_PIX_FMT_HEVC);
+        if (!renderer->base.supports_hevc) {
+            logger_log(logger, LOGGER_WARNING, "The V4L2 decoder does not take H.265");
+        }
+    }
+
+    renderer->drm_fd = video_renderer_v4l2_open_display(renderer);
+    if (renderer->drm_fd == -1) {
+        logger_log(logger, LOGGER_ERR, "Could not find an active display with a free NV12 plane");
+        goto fail;
+    }
+    video_renderer_v4l2_setup_rotation(renderer);
+
+    if (video_renderer_v4l2_setup_output(renderer) < 0) {
+        goto fail;
+    }
+
+    if (config->background_mode != BACKGROUND_MODE_OFF) {
+        logger_log(logger, LOGGER_DEBUG, "The V4L2 renderer leaves the background to the console");
+    }
+    return &renderer->base;
+
+    fail:
+    video_renderer_v4l2_destroy(&renderer->base);
+    return NULL;
+}
+
+static void video_renderer_v4l2_free_capture(video_renderer_v4l2_t *r) {
+    if (r->capture_streaming) {
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        xioctl(r->fd, VIDIOC_STREAMOFF, &type);
+        r->capture_streaming = false;
+    }
+    if (r->displayed != -1) {
+        // Removing the framebuffer would switch the plane off anyway, do it explicitly
+        drmModeSetPlane(r->drm_fd, r->plane_id, r->crtc_id, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        r->displayed = -1;
+    }
+    for (int i = 0; i < r->capture_count; i++) {
+        video_renderer_v4l2_capture_t *capture = &r->capture[i];
+        if (capture->fb_id) {
+            drmModeRmFB(r->drm_fd, capture->fb_id);
+        }
+        for (int p = 0; p < capture->num_planes; p++) {
+            // Planes of one buffer may share a GEM handle, close each only once
+            bool shared = false;
+            for (int q = 0; q < p; q++) {
+                if (capture->gem_handles[q] == capture->gem_handles[p]) shared = true;
+            }
+            if (capture->gem_handles[p] && !shared) {
+                struct drm_gem_close gem_close;
+                memset(&gem_close, 0, sizeof(gem_close));
+                gem_close.handle = capture->gem_handles[p];
+                drmIoctl(r->drm_fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
+            }
+            if (capture->dmabuf_fds[p] >= 0) {
+                close(capture->dmabuf_fds[p]);
+            }
+        }
+        if (capture->map) {
+            munmap((void *) capture->map, capture->map_length);
+        }
+#if defined(HAS_EGL_PRESENTER)
+        egl_presenter_release(r->egl, capture->image);
+#endif
+        memset(capture, 0, sizeof(*capture));
+    }
+    if (r->capture_count) {
+        struct v4l2_requestbuffers req;
+        memset(&req, 0, sizeof(req));
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        req.memory = V4L2_MEMORY_MMAP;
+        xioctl(r->fd, VIDIOC_REQBUFS, &req);
+        r->capture_count = 0;
+    }
+}
+
+#if defined(HAS_EGL_PRESENTER)
+/* The same layout the framebuffer gets in video_renderer_v4l2_import_capture, described to EGL instead */
+static int video_renderer_v4l2_import_egl(video_renderer_v4l2_t *r, video_renderer_v4l2_capture_t *capture,
+                                          struct v4l2_pix_format_mplane *pix, uint32_t drm_format) {
+    egl_presenter_picture_t picture;
+    memset(&picture, 0, sizeof(picture));
+    picture.width = pix->width;
+    picture.height = pix->height;
+    picture.format = drm_format;
+    picture.modifier = DRM_FORMAT_MOD_INVALID;
+    picture.num_planes = drm_format == DRM_FORMAT_NV12 ? 2 : 3;
+    uint32_t pitch = pix->plane_fmt[0].bytesperline;
+    for (int p = 0; p < picture.num_planes; p++) {
+        if (capture->num_planes == 1) {
+            picture.fds[p] = capture->dmabuf_fds[0];
+            picture.pitches[p] = p == 0 || drm_format == DRM_FORMAT_NV12 ? pitch : pitch / 2;
+            picture.offsets[p] = p == 0 ? 0 : pitch * pix->height + (p == 2 ? pitch / 2 * pix->height / 2 : 0);
+        } else {
+            picture.fds[p] = capture->dmabuf_fds[p < capture->num_planes ? p : 0];
+            picture.pitches[p] = pix->plane_fmt[p < capture->num_planes ? p : 0].bytesperline;
+        }
+    }
+    picture.crop_x = r->src_x;
+    picture.crop_y = r->src_y;
+    picture.crop_width = r->src_width;
+    picture.crop_height = r->src_height;
+    capture->image = egl_presenter_import(r->egl, &picture);
+    return capture->image ? 0 : -1;
+}
+#endif
+
+static int video_renderer_v4l2_import_capture(video_renderer_v4l2_t *r, int index, struct v4l2_pix_format_mplane *pix,
+                                              uint32_t drm_format) {
+    video_renderer_v4l2_capture_t *capture = &r->capture[index];
+    capture->num_planes = pix->num_planes;
+    for (int p = 0; p < VIDEO_MAX_PLANES; p++) {
+        capture->dmabuf_fds[p] = -1;
+    }
+
+    for (int p = 0; p < capture->num_planes; p++) {
+        struct v4l2_exportbuffer expbuf;
+        memset(&expbuf, 0, sizeof(expbuf));
+        expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        expbuf.index = index;
+        expbuf.plane = p;
+        expbuf.flags = O_RDONLY | O_CLOEXEC;
+        if (xioctl(r->fd, VIDIOC_EXPBUF, &expbuf) == -1) {
+            logger_log(r->base.logger, LOGGER_ERR, "Could not export picture buffer %d %s", errno, strerror(errno));
+            return -1;
+        }
+        capture->dmabuf_fds[p] = expbuf.fd;
+#if defined(HAS_EGL_PRESENTER)
+        if (r->egl) continue;
+#endif
+        if (drmPrimeFDToHandle(r->drm_fd, expbuf.fd, &capture->gem_handles[p])) {
+            logger_log(r->base.logger, LOGGER_ERR, "Could not import picture buffer into DRM %d %s", errno, strerror(errno));
+            return -1;
+        }
+    }
+    if (r->config->measure_latency) {
+        void *map = mmap(NULL, pix->plane_fmt[0].sizeimage, PROT_READ, MAP_SHARED, capture->dmabuf_fds[0], 0);
+        if (map == MAP_FAILED) {
+            logger_log(r->base.logger, LOGGER_WARNING, "Could not map picture buffer %d for reading the timecode %d %s",
+                       index, errno, strerror(errno));
+        } else {
+            capture->map = map;
+            capture->map_length = pix->plane_fmt[0].sizeimage;
+        }
+    }
+
+#if defined(HAS_EGL_PRESENTER)
+    if (r->egl) {
+        return video_renderer_v4l2_import_egl(r, capture, pix, drm_format);
+    }
+#endif
+
+    uint32_t handles[4] = {0}, pitches[4] = {0}, offsets[4] = {0};
+    uint32_t pitch = pix->plane_fmt[0].bytesperline;
+    if (capture->num_planes == 1) {
+        // Colour planes follow each other in one buffer, padded to the coded height
+        handles[0] = handles[1] = capture->gem_handles[0];
+        pitches[0] = pitch;
+        offsets[1] = pitch * pix->height;
+        if (drm_format == DRM_FORMAT_NV12) {
+            pitches[1] = pitch;
+        } else {
+            handles[2] = capture->gem_handles[0];
+            pitches[1] = pitches[2] = pitch / 2;
+            offsets[2] = offsets[1] + pitch / 2 * pix->height / 2;
+        }
+    } else {
+        for (int p = 0; p < capture->num_planes && p < 4; p++) {
+            handles[p] = capture->gem_handles[p];
+            pitches[p] = pix->plane_fmt[p].bytesperline;
+        }
+    }
+    if (drmModeAddFB2(r->drm_fd, pix->width, pix->height, drm_format, handles, pitches, offsets, &capture->fb_id, 0)) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not create framebuffer for picture buffer %d %s", errno, strerror(errno));
+        capture->fb_id = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/* Scales the visible picture to fit the display, keeping its aspect ratio */
+static void video_renderer_v4l2_update_layout(video_renderer_v4l2_t *r) {
+    int width = r->rotated ? r->src_height : r->src_width;
+    int height = r->rotated ? r->src_width : r->src_height;
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    if ((int64_t) width * r->display_height > (int64_t) height * r->display_width) {
+        r->dst_width = r->display_width;
+        r->dst_height = (int) ((int64_t) r->display_width * height / width);
+    } else {
+        r->dst_height = r->display_height;
+        r->dst_width = (int) ((int64_t) r->display_height * width / height);
+    }
+    r->dst_x = (r->display_width - r->dst_width) / 2;
+    r->dst_y = (r->display_height - r->dst_height) / 2;
+}
+
+/*
+ * Called on the source change event the decoder raises once it parsed the parameter
+ * sets of a new geometry. Picture buffers are sized for it, exported and imported as
+ * framebuffers once, so presenting a decoded picture later on is a single plane update.
+ */
+static int video_renderer_v4l2_setup_capture(video_renderer_v4l2_t *r) {
+    video_renderer_v4l2_free_capture(r);
+
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    if (xioctl(r->fd, VIDIOC_G_FMT, &fmt) == -1) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not query decoder output format %d %s", errno, strerror(errno));
+        return -1;
+    }
+    if (fmt.fmt.pix_mp.pixelformat != V4L2_PIX_FMT_NV12) {
+        fmt.fmt.pix_mp.pixelformat = V4L2_PIX_FMT_NV12;
+        xioctl(r->fd, VIDIOC_S_FMT, &fmt);
+    }
+
+    uint32_t drm_format;
+    switch (fmt.fmt.pix_mp.pixelformat) {
+        case V4L2_PIX_FMT_NV12:
+        case V4L2_PIX_FMT_NV12M:
+            drm_format = DRM_FORMAT_NV12;
+            break;
+        case V4L2_PIX_FMT_YUV420:
+        case V4L2_PIX_FMT_YUV420M:
+            drm_format = DRM_FORMAT_YUV420;
+            break;
+        default:
+            logger_log(r->base.logger, LOGGER_ERR, "Decoder output format %.4s cannot be displayed",
+                       (char *) &fmt.fmt.pix_mp.pixelformat);
+            return -1;
+    }
+
+    r->src_x = 0;
+    r->src_y = 0;
+    r->src_width = fmt.fmt.pix_mp.width;
+    r->src_height = fmt.fmt.pix_mp.height;
+    r->capture_pitch = fmt.fmt.pix_mp.plane_fmt[0].bytesperline;
+    struct v4l2_selection sel;
+    memset(&sel, 0, sizeof(sel));
+    sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sel.target = V4L2_SEL_TGT_COMPOSE;
+    if (xioctl(r->fd, VIDIOC_G_SELECTION, &sel) == 0) {
+        r->src_x = sel.r.left;
+        r->src_y = sel.r.top;
+        r->src_width = sel.r.width;
+        r->src_height = sel.r.height;
+    }
+    video_renderer_v4l2_update_layout(r);
+
+    struct v4l2_control ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.id = V4L2_CID_MIN_BUFFERS_FOR_CAPTURE;
+    int min_buffers = xioctl(r->fd, VIDIOC_G_CTRL, &ctrl) == 0 ? ctrl.value : 4;
+
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = min_buffers + EXTRA_CAPTURE_BUFFERS;
+    if (req.count > MAX_CAPTURE_BUFFERS) req.count = MAX_CAPTURE_BUFFERS;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(r->fd, VIDIOC_REQBUFS, &req) == -1 || req.count == 0) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not allocate picture buffers %d %s", errno, strerror(errno));
+        return -1;
+    }
+    r->capture_count = req.count;
+
+    for (int i = 0; i < r->capture_count; i++) {
+        if (video_renderer_v4l2_import_capture(r, i, &fmt.fmt.pix_mp, drm_format) < 0) {
+            video_renderer_v4l2_free_capture(r);
+            return -1;
+        }
+        struct v4l2_plane planes[VIDEO_MAX_PLANES];
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        memset(planes, 0, sizeof(planes));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        buf.m.planes = planes;
+        buf.length = fmt.fmt.pix_mp.num_planes;
+        if (xioctl(r->fd, VIDIOC_QBUF, &buf) == -1) {
+            logger_log(r->base.logger, LOGGER_ERR, "Could not queue picture buffer %d %s", errno, strerror(errno));
+            video_renderer_v4l2_free_capture(r);
+            return -1;
+        }
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    if (xioctl(r->fd, VIDIOC_STREAMON, &type) == -1) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not start decoder output %d %s", errno, strerror(errno));
+        video_renderer_v4l2_free_capture(r);
+        return -1;
+    }
+    r->capture_streaming = true;
+    logger_log(r->base.logger, LOGGER_INFO, "Decoding %dx%d into %d picture buffers, shown at %dx%d",
+               r->src_width, r->src_height, r->capture_count, r->dst_width, r->dst_height);
+    return 0;
+}
+
+static void video_renderer_v4l2_queue_capture(video_renderer_v4l2_t *r, int index) {
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    memset(planes, 0, sizeof(planes));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    buf.m.planes = planes;
+    buf.length = r->capture[index].num_planes;
+    if (xioctl(r->fd, VIDIOC_QBUF, &buf) == -1) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not requeue picture buffer %d %s", errno, strerror(errno));
+    }
+}
+
+/* The plane shows the picture from the next vblank on, which is not accounted for */
+static void video_renderer_v4l2_measure_latency(video_renderer_v4l2_t *r, int index) {
+    video_renderer_v4l2_capture_t *capture = &r->capture[index];
+    if (!capture->map || !r->ntp) {
+        return;
+    }
+    struct dma_buf_sync sync;
+    sync.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ;
+    ioctl(capture->dmabuf_fds[0], DMA_BUF_IOCTL_SYNC, &sync);
+    uint64_t remote_time;
+    bool found = timecode_read(capture->map + r->src_y * r->capture_pitch + r->src_x, r->src_width, r->src_height,
+                               r->capture_pitch, 1, &remote_time);
+    sync.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ;
+    ioctl(capture->dmabuf_fds[0], DMA_BUF_IOCTL_SYNC, &sync);
+    if (found) {
+        uint64_t shown = raop_ntp_get_local_time(r->ntp);
+        uint64_t sent = raop_ntp_convert_remote_time(r->ntp, remote_time);
+        histogram_record(&r->latency_histogram, shown > sent ? shown - sent : 0);
+    }
+}
+
+static void video_renderer_v4l2_present(video_renderer_v4l2_t *r, int index, uint64_t pts) {
+    raop_ntp_t *ntp = r->ntp;
+    if (!r->config->low_latency && ntp) {
+        int64_t wait = (int64_t) pts - (int64_t) raop_ntp_get_local_time(ntp);
+        if (wait > 0 && wait < MAX_PRESENT_DELAY_US) {
+            usleep(wait);
+        }
+    }
+
+#if defined(HAS_EGL_PRESENTER)
+    if (r->egl) {
+        // The GPU drew the picture already, the decoder can have it back right away
+        if (egl_presenter_show(r->egl, r->capture[index].image) == 0) {
+            frame_stages_presented(&r->stages, pts, raop_ntp_get_local_time(NULL));
+            if (!r->base.first_render_time) {
+                r->base.first_render_time = raop_ntp_get_local_time(ntp);
+            }
+            if (r->config->measure_latency) {
+                video_renderer_v4l2_measure_latency(r, index);
+            }
+        }
+        video_renderer_v4l2_queue_capture(r, index);
+        return;
+    }
+#endif
+
+    if (drmModeSetPlane(r->drm_fd, r->plane_id, r->crtc_id, r->capture[index].fb_id, 0,
+                        r->dst_x, r->dst_y, r->dst_width, r->dst_height,
+                        r->src_x << 16, r->src_y << 16, r->src_width << 16, r->src_height << 16)) {
+        logger_log(r->base.logger, LOGGER_ERR, "Could not show picture %d %s", errno, strerror(errno));
+        video_renderer_v4l2_queue_capture(r, index);
+        return;
+    }
+    frame_stages_presented(&r->stages, pts, raop_ntp_get_local_time(NULL));
+    if (!r->base.first_render_time) {
+        r->base.first_render_time = raop_ntp_get_local_time(ntp);
+    }
+    if (r->config->measure_latency) {
+        video_renderer_v4l2_measure_latency(r, index);
+    }
+    // The plane scans out of the new picture now, the previous one can be decoded into again
+    if (r->displayed != -1) {
+        video_renderer_v4l2_queue_capture(r, r->displayed);
+    }
+    r->displayed = index;
+}
+
+static void video_renderer_v4l2_dequeue_capture(video_renderer_v4l2_t *r) {
+    if (!r->capture_streaming) {
+        return;
+    }
+    for (;;) {
+        struct v4l2_plane planes[VIDEO_MAX_PLANES];
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        memset(planes, 0, sizeof(planes));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.m.planes = planes;
+        buf.length = VIDEO_MAX_PLANES;
+        if (xioctl(r->fd, VIDIOC_DQBUF, &buf) == -1) {
+            return;
+        }
+        if (planes[0].bytesused == 0 || (buf.flags & V4L2_BUF_FLAG_ERROR)) {
+            video_renderer_v4l2_queue_capture(r, buf.index);
+            continue;
+        }
+        uint64_t pts = (uint64_t) buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+        frame_stages_decoded(&r->stages, pts, raop_ntp_get_local_time(NULL));
+        video_renderer_v4l2_present(r, buf.index, pts);
+    }
+}
+
+static void video_renderer_v4l2_handle_events(video_renderer_v4l2_t *r) {
+    struct v4l2_event event;
+    for (;;) {
+        memset(&event, 0, sizeof(event));
+        if (xioctl(r->fd, VIDIOC_DQEVENT, &event) == -1) {
+            return;
+        }
+        if (event.type == V4L2_EVENT_SOURCE_CHANGE &&
+            (event.u.src_change.changes & V4L2_EVENT_SRC_CH_RESOLUTION)) {
+            if (video_renderer_v4l2_setup_capture(r) == 0 && !r->base.decoder_ready_time) {
+                r->base.decoder_ready_time = raop_ntp_get_local_time(r->ntp);
+            }
+        }
+    }
+}
+
+static THREAD_RETVAL video_renderer_v4l2_thread(void *arg) {
+    video_renderer_v4l2_t *r = arg;
+    while (r->running) {
+        struct pollfd pfd;
+        pfd.fd = r->fd;
+        pfd.events = POLLIN | POLLPRI;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, POLL_TIMEOUT_MS) <= 0) {
+            continue;
+        }
+        if (pfd.revents & POLLPRI) {
+            video_renderer_v4l2_handle_events(r);
+        }
+        if (pfd.revents & POLLIN) {
+            video_renderer_v4l2_dequeue_capture(r);
+        } else if (pfd.revents & POLLERR) {
+            // Reported while neither queue holds buffers, e.g. before the first frame
+            sleepms(10);
+        }
+    }
+    return 0;
+}
+
+static void video_renderer_v4l2_start(video_renderer_t *renderer) {
+    video_renderer_v4l2_t *r = (video_renderer_v4l2_t *)renderer;
+    r->running = true;
+    THREAD_CREATE(r->thread, video_renderer_v4l2_thread, r);
+    if (!r->thread) {
+        logger_log(renderer->logger, LOGGER_ERR, "Could not start the V4L2 display thread");
+        r->running = false;
+    }
+}
+
+/* Takes back bitstream buffers the decoder is done with, called with output_mutex held */
+static void video_renderer_v4l2_reclaim_output(video_renderer_v4l2_t *r) {
+    for (;;) {
+        struct v4l2_plane planes[VIDEO_MAX_PLANES];
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.m.planes = planes;
+        buf.length = VIDEO_MAX_PLANES;
+        if (xioctl(r->fd, VIDIOC_DQBUF, &buf) == -1) {
+            return;
+        }
+        if (buf.index < (uint32_t) r->output_count) {
+            r->output[buf.index].state = OUTPUT_FREE;
+        }
+    }
+}
+
+static video_renderer_v4l2_output_t *video_renderer_v4l2_get_output(video_renderer_v4l2_t *r, int timeout_ms) {
+    for (;;) {
+        MUTEX_LOCK(r->output_mutex);
+        video_renderer_v4l2_reclaim_output(r);
+        for (int i = 0; i < r->output_count; i++) {
+            if (r->output[i].state == OUTPUT_FREE) {
+                r->output[i].state = OUTPUT_ACQUIRED;
+                MUTEX_UNLOCK(r->output_mutex);
+                return &r->output[i];
+            }
+        }
+        MUTEX_UNLOCK(r->output_mutex);
+
+        if (timeout_ms <= 0) {
+            return NULL;
+        }
+        struct pollfd pfd;
+        pfd.fd = r->fd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout_ms) <= 0 || !(pfd.revents & POLLOUT)) {
+            return NULL;
+        }
+        // A buffer came back, grab it even if that takes another round
+        timeout_ms = 1;
+    }
+}
+
+static bool video_renderer_v4l2_is_congested(video_renderer_t *renderer) {
+    video_renderer_v4l2_t *r = (video_renderer_v4l2_t *)renderer;
+    bool congested = true;
+    MUTEX_LOCK(r->output_mutex);
+    video_renderer_v4l2_reclaim_output(r);
+    for (int i = 0; i < r->output_count && congested; i++) {
+        if (r->output[i].state == OUTPUT_FREE) congested = false;
+    }
+    MUTEX_UNLOCK(r->output_mutex);
+    return congested;
+}
+
+static void video_renderer_v4l2_queue_output(video_renderer_v4l2_t *r, video_renderer_v4l2_output_t *output,
+                                             int filled_len, uint64_t pts) {
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    memset(planes, 0, sizeof(planes));
+    buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = output - r->output;
+    buf.m.planes = planes;
+    buf.length = 1;
+    planes[0].bytesused = filled_len;
+    // The decoder copies the timestamp to the picture, where the display thread picks it up
+    buf.timestamp.tv_sec = pts / 1000000;
+    buf.timestamp.tv_usec = pts % 1000000;
+    frame_stages_submitted(&r->stages, pts, raop_ntp_get_local_time(NULL));
+
+    MUTEX_LOCK(r->output_mutex);
+    if (xioctl(r->fd, VIDIOC_QBUF, &buf) == -1) {
+        logger_log(r->base.logger, LOGGER_ERR, "Video decoder refused processing buffer %d %s", errno, strerror(errno));
+        output->state = OUTPUT_FREE;
+    } else {
+        output->state = OUTPUT_QUEUED;
+    }
+    MUTEX_UNLOCK(r->output_mutex);
+}
+
+static void video_renderer_v4l2_render_buffer(video_renderer_t *renderer, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts, int type,
+                                              h264_nal_index_t const *nal_index) {
+    video_renderer_v4l2_t *r = (video_renderer_v4l2_t *)renderer;
+    if (data_len == 0) return;
+    LOGGER_DEBUG_HOT(renderer->logger, "Got h264 data of %d bytes", data_len);
+    r->ntp = ntp;
+    r->input_frames++;
+
+    // The stateful decoder parses the bitstream itself, frames larger than a buffer are split anywhere
+    int offset = 0;
+    while (offset < data_len) {
+        video_renderer_v4l2_output_t *output = video_renderer_v4l2_get_output(r, OUTPUT_BUFFER_TIMEOUT_MS);
+        if (!output) {
+            r->dropped_frames++;
+            metrics_add(METRIC_VIDEO_DECODER_STALLS, 1);
+            flight_recorder_trigger("video decoder input stall");
+            logger_log(renderer->logger, LOGGER_WARNING, "Video decoder did not return an input buffer in %d ms, "
+                       "dropped %llu of %llu frames", OUTPUT_BUFFER_TIMEOUT_MS, r->dropped_frames, r->input_frames);
+            return;
+        }
+        int chunk = data_len - offset;
+        if (chunk > (int) output->length) chunk = output->length;
+        memcpy(output->start, data + offset, chunk);
+        video_renderer_v4l2_queue_output(r, output, chunk, pts);
+        offset += chunk;
+    }
+}
+
+/*
+ * Zero-copy input: frames that fit into a single bitstream buffer are decrypted straight
+ * into the mapped decoder memory by the mirror thread.
+ */
+static unsigned char *video_renderer_v4l2_acquire_buffer(video_renderer_t *renderer, int size, void **handle) {
+    video_renderer_v4l2_t *r = (video_renderer_v4l2_t *)renderer;
+    if (r->output_count == 0 || size > (int) r->output[0].length) {
+        return NULL;
+    }
+    video_renderer_v4l2_output_t *output = video_renderer_v4l2_get_output(r, 0);
+    if (!output) {
+        return NULL;
+    }
+    *handle = output;
+    return output->start;
+}
+
+/* Whether an acquired buffer is left over from before a codec switch, called with output_mutex held */
+static bool video_renderer_v4l2_is_retired(video_renderer_v4l2_t *r, video_renderer_v4l2_output_t *output) {
+    return output < r->output || output >= r->output + MAX_OUTPUT_BUFFERS;
+}
+
+static void video_renderer_v4l2_unmap_retired(video_renderer_v4l2_t *r, video_renderer_v4l2_output_t *output) {
+    munmap(output->start, output->length);
+    memset(output, 0, sizeof(*output));
+}
+
+static void video_renderer_v4l2_render_acquired(video_renderer_t *renderer, raop_ntp_t *ntp, void *handle, int data_len,
+                                                uint64_t pts, h264_nal_index_t const *nal_index) {
+    video_renderer_v4l2_t *r = (video_renderer_v4l2_t *)renderer;
+    video_renderer_v4l2_output_t *output = handle;
+    MUTEX_LOCK(r->output_mutex);
+    bool retired = video_renderer_v4l2_is_retired(r, output);
+    MUTEX_UNLOCK(r->output_mutex);
+    if (retired) {
+        // Decrypted before the switch to the codec it is in, copied into a buffer of the current format
+        video_renderer_v4l2_render_buffer(renderer, ntp, output->start, data_len, pts, 1, nal_index);
+        MUTEX_LOCK(r->output_mutex);
+        video_renderer_v4l2_unmap_retired(r, output);
+        MUTEX_UNLOCK(r->output_mutex);
+        return;
+    }
+    LOGGER_DEBUG_HOT(renderer->logger, "Got h264 data of %d bytes in place", data_len);
+    r->ntp = ntp;
+    r->input_frames++;
+    video_renderer_v4l2_queue_output(r, output, data_len, pts);
+}
+
+static void video_renderer_v4l2_release_buffer(video_renderer_t *renderer, void *handle) {
+    video_renderer_v4l2_t *r = (video_renderer_v4l2_t *)renderer;
+    video_renderer_v4l2_output_t *output = handle;
+    MUTEX_LOCK(r->output_mutex);
+    if (video_renderer_v4l2_is_retired(r, output)) {
+        video_renderer_v4l2_unmap_retired(r, output);
+    } else {
+        output->state = OUTPUT_FREE;
+    }
+    MUTEX_UNLOCK(r->output_mutex);
+}
+
+/*
+ * The coded format of the decoder input can only change while it has no buffers, so they are
+ * reallocated. Those the mirror thread is decrypting into stay mapped in the other set of
+ * output_sets until they come back through render_acquired or release_buffer. The decoder then
+ * raises a source change for the new stream, as for a new geometry.
+ */
+static bool video_renderer_v4l2_set_codec(video_renderer_t *renderer, video_codec_t codec) {
+    video_renderer_v4l2_t *r = (video_renderer_v4l2_t *)renderer;
+    if (codec == r->codec && r->output_count > 0) {
+        return true;
+    }
+    MUTEX_LOCK(r->output_mutex);
+    video_renderer_v4l2_output_t *next = r->output == r->output_sets[0] ? r->output_sets[1] : r->output_sets[0];
+    for (int i = 0; i < MAX_OUTPUT_BUFFERS; i++) {
+        if (next[i].start) {
+            // Still held from the switch before this one, which cannot have been long ago
+            MUTEX_UNLOCK(r->output_mutex);
+            logger_log(renderer->logger, LOGGER_ERR, "Cannot switch the video decoder to %s twice in a row",
+                       video_renderer_v4l2_codec_name(codec));
+            return false;
+        }
+    }
+
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    xioctl(r->fd, VIDIOC_STREAMOFF, &type);
+    for (int i = 0; i < r->output_count; i++) {
+        if (r->output[i].state != OUTPUT_ACQUIRED) {
+            munmap(r->output[i].start, r->output[i].length);
+            memset(&r->output[i], 0, sizeof(r->output[i]));
+        }
+    }
+    // Buffers that are still mapped are orphaned, the memory goes once they are unmapped
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    req.memory = V4L2_MEMORY_MMAP;
+    xioctl(r->fd, VIDIOC_REQBUFS, &req);
+
+    r->output = next;
+    r->output_count = 0;
+    r->codec = codec;
+    if (video_renderer_v4l2_setup_output(r) < 0) {
+        // Without input buffers every frame is dropped until the next parameter sets try again
+        for (int i = 0; i < r->output_count; i++) {
+            munmap(r->output[i].start, r->output[i].length);
+            memset(&r->output[i], 0, sizeof(r->output[i]));
+        }
+        r->output_count = 0;
+        MUTEX_UNLOCK(r->output_mutex);
+        return false;
+    }
+    MUTEX_UNLOCK(r->output_mutex);
+    logger_log(renderer->logger, LOGGER_INFO, "Video decoder switched to %s", video_renderer_v4l2_codec_name(codec));
+    return true;
+}
+
+static void video_renderer_v4l2_log_latency(video_renderer_v4l2_t *r) {
+    if (r->config->measure_latency && atomic_load(&r->latency_histogram.total) > 0) {
+        histogram_log(&r->latency_histogram, r->base.logger, LOGGER_INFO, "video glass-to-glass");
+    }
+    frame_stages_log(&r->stages, r->base.logger);
+}
+
+static void video_renderer_v4l2_flush(video_renderer_t *renderer) {
+    video_renderer_v4l2_t *r = (video_renderer_v4l2_t *)renderer;
+    int type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+
+    // Stopping the input queue hands every queued bitstream buffer back without decoding it
+    MUTEX_LOCK(r->output_mutex);
+    xioctl(r->fd, VIDIOC_STREAMOFF, &type);
+    for (int i = 0; i < r->output_count; i++) {
+        if (r->output[i].state == OUTPUT_QUEUED) r->output[i].state = OUTPUT_FREE;
+    }
+    if (xioctl(r->fd, VIDIOC_STREAMON, &type) == -1) {
+        logger_log(renderer->logger, LOGGER_ERR, "Could not restart decoder input %d %s", errno, strerror(errno));
+    }
+    MUTEX_UNLOCK(r->output_mutex);
+    r->base.decoder_ready_time = 0;
+    r->base.first_render_time = 0;
+    frame_stages_flush(&r->stages);
+    video_renderer_v4l2_log_latency(r);
+}
+
+static void video_renderer_v4l2_destroy(video_renderer_t *renderer) {
+    video_renderer_v4l2_t *r = (video_renderer_v4l2_t *)renderer;
+    if (!r) {
+        return;
+    }
+    if (r->running) {
+        r->running = false;
+        THREAD_JOIN(r->thread);
+    }
+    video_renderer_v4l2_log_latency(r);
+    if (r->fd != -1) {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+        xioctl(r->fd, VIDIOC_STREAMOFF, &type);
+        if (r->drm_fd != -1) {
+            video_renderer_v4l2_free_capture(r);
+        }
+        for (int i = 0; i < MAX_OUTPUT_BUFFERS; i++) {
+            if (r->output_sets[0][i].start) munmap(r->output_sets[0][i].start, r->output_sets[0][i].length);
+            if (r->output_sets[1][i].start) munmap(r->output_sets[1][i].start, r->output_sets[1][i].length);
+        }
+        close(r->fd);
+    }
+#if defined(HAS_EGL_PRESENTER)
+    egl_presenter_destroy(r->egl);
+#endif
+    if (r->drm_fd != -1) {
+        close(r->drm_fd);
+    }
+    MUTEX_DESTROY(r->output_mutex);
+    frame_stages_destroy(&r->stages);
+    free(r);
+}
+
+static void video_renderer_v4l2_update_background(video_renderer_t *renderer, int type) {
+
+}
+
+/* The plane switches to a new picture at the next vblank, so pictures are best handed over just before one */
+static uint64_t video_renderer_v4l2_next_vsync(video_renderer_t *renderer, uint64_t time) {
+    video_renderer_v4l2_t *r = (video_renderer_v4l2_t *)renderer;
+    if (r->drm_fd == -1 || !r->vblank_period) {
+        return time;
+    }
+    // A relative wait for no vblank at all returns the time of the last one right away
+    drmVBlank vblank;
+    memset(&vblank, 0, sizeof(vblank));
+    vblank.request.type = DRM_VBLANK_RELATIVE | r->vblank_pipe;
+    vblank.request.sequence = 0;
+    if (drmWaitVBlank(r->drm_fd, &vblank)) {
+        return time;
+    }
+    // vblank times are on the monotonic clock, MEDIA_CLOCK like the local times
+    uint64_t last = (uint64_t) vblank.reply.tval_sec * 1000000 + vblank.reply.tval_usec;
+    if (time <= last) {
+        return time;
+    }
+    return last + (time - last + r->vblank_period - 1) / r->vblank_period * r->vblank_period;
+}
+
+static const video_renderer_funcs_t video_renderer_v4l2_funcs = {
+    .start = video_renderer_v4l2_start,
+    .render_buffer = video_renderer_v4l2_render_buffer,
+    .acquire_buffer = video_renderer_v4l2_acquire_buffer,
+    .render_acquired = video_renderer_v4l2_render_acquired,
+    .release_buffer = video_renderer_v4l2_release_buffer,
+    .is_congested = video_renderer_v4l2_is_congested,
+    .next_vsync = video_renderer_v4l2_next_vsync,
+    .set_codec = video_renderer_v4l2_set_codec,
+    .flush = video_renderer_v4l2_flush,
+    .destroy = video_renderer_v4l2_destroy,
+    .update_background = video_renderer_v4l2_update_background,
+};
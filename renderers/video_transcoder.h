@@ -0,0 +1,80 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Decodes the mirror, scales it down and encodes it again at a lower bitrate, for outputs like
+ * the restream that go over links too slow for the stream as sent. Transcoders work on threads
+ * of their own next to the renderer and never hold up the mirror: what they cannot keep up with
+ * is dropped.
+ */
+
+#ifndef VIDEO_TRANSCODER_H
+#define VIDEO_TRANSCODER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "../lib/logger.h"
+#include "../lib/stream.h"
+#include "../lib/video_frame.h"
+
+typedef struct video_transcoder_config_s {
+    int width; // Size of the encoded picture, the mirror is letterboxed into it
+    int height;
+    int bitrate; // kbit/s
+    int keyframe_interval; // Frames from one IDR frame to the next, so viewers can join at any time
+    const char *video_decoders; // Comma separated decoders to try in order, NULL uses the built-in list
+    const char *video_encoders; // Comma separated H.264 encoders to try in order, NULL uses the built-in list
+} video_transcoder_config_t;
+
+/**
+ * Gets every encoded frame, from a thread of the transcoder. The frame is an Annex-B H.264 access
+ * unit with its nal_index, an IDR frame with the parameter sets in front, and is only valid for the call.
+ */
+typedef void (*video_transcoder_output_t)(void *cls, const h264_decode_struct *frame);
+
+typedef struct video_transcoder_s video_transcoder_t;
+
+typedef struct video_transcoder_funcs_s {
+    /* Called with every frame of the mirror, parameter sets included, copies what it keeps */
+    void (*push)(video_transcoder_t *transcoder, const h264_decode_struct *data);
+    /* push for a frame the transcoder takes the reference to, and holds instead of a copy */
+    void (*push_frame)(video_transcoder_t *transcoder, video_frame_t *frame);
+    /* Drops what is queued, for a new mirror, which starts with its parameter sets again */
+    void (*flush)(video_transcoder_t *transcoder);
+    void (*destroy)(video_transcoder_t *transcoder);
+} video_transcoder_funcs_t;
+
+typedef struct video_transcoder_s {
+    video_transcoder_funcs_t const *funcs;
+    logger_t *logger;
+} video_transcoder_t;
+
+typedef video_transcoder_t *(*video_transcoder_init_func_t)(logger_t *logger, video_transcoder_config_t const *config,
+                                                            video_transcoder_output_t output, void *cls);
+
+video_transcoder_t *video_transcoder_gstreamer_init(logger_t *logger, video_transcoder_config_t const *config,
+                                                    video_transcoder_output_t output, void *cls);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //VIDEO_TRANSCODER_H
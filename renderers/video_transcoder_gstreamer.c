@@ -0,0 +1,419 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Transcoding with GStreamer, hardware decoder ! leaky queue ! scaler ! hardware encoder, with
+ * the same decoders as the video renderer and the first of the OpenMAX, V4L2 M2M, VA-API and
+ * NVENC encoders that is installed, x264 as the last resort.
+ *
+ * Frames are queued, by reference where they come as a video_frame_t and as a copy otherwise,
+ * and pushed into the pipeline from the transcoder's thread, which holds on to them until the
+ * decoder is done. At most VIDEO_TRANSCODER_HELD_FRAMES are held, so the mirror never runs
+ * out of buffers for the transcoder. Decoded pictures the encoder cannot keep up with are
+ * dropped by the leaky queue, which costs nothing but the picture. Only if the decoder itself falls behind
+ * does the input queue fill up; then frames no other frame refers to are dropped, or, if it
+ * has to be a reference frame, everything up to the next parameter sets or IDR frame.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+
+#include "video_transcoder.h"
+#include "gstreamer_registry.h"
+#include "../lib/metrics.h"
+
+#define VIDEO_TRANSCODER_QUEUE_FRAMES 8
+/* Frames queued or in the pipeline, well below the 32 the mirror lets a video_process_frame callee hold */
+#define VIDEO_TRANSCODER_HELD_FRAMES 16
+/* What the decoder may have waiting in front of it, before pushing blocks the transcoder's thread */
+#define VIDEO_TRANSCODER_INPUT_BYTES (2 * 1024 * 1024)
+
+#define DEFAULT_VIDEO_ENCODERS "v4l2h264enc,omxh264enc,vah264enc,vaapih264enc,nvh264enc,x264enc"
+/* Scale on the GPU or ISP where there is an element for it */
+#define DEFAULT_VIDEO_SCALERS "v4l2convert,vapostproc,vaapipostproc"
+
+#define H264_CAPS "video/x-h264,stream-format=byte-stream,alignment=au"
+
+#define NAL_TYPE_IDR 5
+
+/* How each encoder is told its bitrate, in kbit/s times bitrate_scale, and its keyframe interval */
+typedef struct video_transcoder_encoder_s {
+    const char *name;
+    const char *format;
+    int bitrate_scale;
+} video_transcoder_encoder_t;
+
+static const video_transcoder_encoder_t encoders[] = {
+    // The Pi's encoder only negotiates with a level downstream
+    {"v4l2h264enc", "v4l2h264enc extra-controls=\"controls,video_bitrate=%d,h264_i_frame_period=%d,"
+                    "repeat_sequence_header=1\" ! video/x-h264,level=(string)4", 1000},
+    {"omxh264enc", "omxh264enc control-rate=variable target-bitrate=%d periodicty-idr=%d", 1000},
+    {"vah264enc", "vah264enc bitrate=%d key-int-max=%d", 1},
+    {"vaapih264enc", "vaapih264enc bitrate=%d keyframe-period=%d", 1},
+    {"nvh264enc", "nvh264enc bitrate=%d gop-size=%d", 1},
+    {"x264enc", "x264enc bitrate=%d key-int-max=%d tune=zerolatency speed-preset=ultrafast", 1},
+};
+
+typedef struct video_transcoder_gstreamer_s {
+    video_transcoder_t base;
+    GstElement *pipeline, *appsrc, *appsink;
+    video_transcoder_output_t output;
+    void *cls;
+
+    GThread *thread;
+    GMutex mutex;
+    GCond cond;
+    video_frame_t *queue[VIDEO_TRANSCODER_QUEUE_FRAMES];
+    int head;
+    int count;
+    // Queued plus pushed into the pipeline and not yet given back, counted without the mutex
+    gint held;
+    // After a reference frame was dropped, frames are left out up to the next parameter sets or IDR frame
+    bool skipping;
+    bool stopping;
+} video_transcoder_gstreamer_t;
+
+/* A frame inside the pipeline */
+typedef struct video_transcoder_pushed_s {
+    video_transcoder_gstreamer_t *transcoder;
+    video_frame_t *frame;
+} video_transcoder_pushed_t;
+
+static const video_transcoder_funcs_t video_transcoder_gstreamer_funcs;
+
+/* The leaky queue drops a picture whenever it is full */
+static void video_transcoder_gstreamer_overrun(GstElement *queue, gpointer data) {
+    metrics_add(METRIC_TRANSCODE_FRAMES_DROPPED, 1);
+}
+
+static void video_transcoder_gstreamer_bus_message(GstBus *bus, GstMessage *message, gpointer data) {
+    video_transcoder_gstreamer_t *t = data;
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+        GError *error = NULL;
+        gst_message_parse_error(message, &error, NULL);
+        logger_log(t->base.logger, LOGGER_ERR, "Transcoder error from %s: %s", GST_OBJECT_NAME(message->src),
+                   error->message);
+        g_error_free(error);
+    }
+}
+
+/* Hands an encoded access unit to the output with the index of its NAL units */
+static GstFlowReturn video_transcoder_gstreamer_new_sample(GstAppSink *sink, gpointer data) {
+    video_transcoder_gstreamer_t *t = data;
+    GstSample *sample = gst_app_sink_pull_sample(sink);
+    if (!sample) {
+        return GST_FLOW_EOS;
+    }
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    GstMapInfo map;
+    if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+
+    h264_decode_struct frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.frame_type = 1;
+    frame.data = map.data;
+    frame.data_len = (int) map.size;
+    frame.pts = GST_BUFFER_PTS_IS_VALID(buffer) ? GST_BUFFER_PTS(buffer) / GST_USECOND : 0;
+    frame.codec = VIDEO_CODEC_H264;
+
+    bool complete = true;
+    h264_nal_index_t *index = &frame.nal_index;
+    for (int i = 0; i + 3 <= frame.data_len; i++) {
+        if (map.data[i] || map.data[i + 1] || map.data[i + 2] != 1) {
+            continue;
+        }
+        if (index->count) {
+            // The zero in front of a four byte start code belongs to it
+            h264_nal_index_entry_t *last = &index->nals[index->count - 1];
+            last->size = i - last->offset - (i > 0 && !map.data[i - 1] ? 1 : 0);
+        }
+        if (index->count == H264_NAL_INDEX_MAX || i + 3 == frame.data_len) {
+            complete = index->count < H264_NAL_INDEX_MAX;
+            break;
+        }
+        h264_nal_index_entry_t *nal = &index->nals[index->count++];
+        nal->offset = i + 3;
+        nal->size = frame.data_len - nal->offset;
+        nal->nal_unit_type = map.data[nal->offset] & 0x1f;
+        nal->nal_ref_idc = (map.data[nal->offset] >> 5) & 0x3;
+        frame.is_idr |= nal->nal_unit_type == NAL_TYPE_IDR;
+        frame.is_reference |= nal->nal_ref_idc != 0;
+        i += 2;
+    }
+    if (!complete) {
+        logger_log(t->base.logger, LOGGER_WARNING, "Transcoder put out a frame of more than %d NAL units",
+                   H264_NAL_INDEX_MAX);
+    } else if (index->count) {
+        t->output(t->cls, &frame);
+    }
+    gst_buffer_unmap(buffer, &map);
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+}
+
+/* Frames are released by the pipeline once it no longer needs their data */
+static void video_transcoder_gstreamer_frame_done(gpointer data) {
+    video_transcoder_pushed_t *pushed = data;
+    video_frame_release(pushed->frame);
+    g_atomic_int_add(&pushed->transcoder->held, -1);
+    g_free(pushed);
+}
+
+/* Feeds the queued frames to the pipeline, blocking while the decoder is busy */
+static gpointer video_transcoder_gstreamer_thread(gpointer data) {
+    video_transcoder_gstreamer_t *t = data;
+    g_mutex_lock(&t->mutex);
+    while (true) {
+        while (!t->count && !t->stopping) {
+            g_cond_wait(&t->cond, &t->mutex);
+        }
+        if (t->stopping) {
+            break;
+        }
+        video_frame_t *frame = t->queue[t->head];
+        t->head = (t->head + 1) % VIDEO_TRANSCODER_QUEUE_FRAMES;
+        t->count--;
+        g_mutex_unlock(&t->mutex);
+
+        const h264_decode_struct *data = video_frame_get(frame);
+        video_transcoder_pushed_t *pushed = g_new(video_transcoder_pushed_t, 1);
+        pushed->transcoder = t;
+        pushed->frame = frame;
+        GstBuffer *buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, data->data, data->data_len, 0,
+                                                        data->data_len, pushed, video_transcoder_gstreamer_frame_done);
+        // Parameter sets carry no time and go with the next frame
+        if (data->frame_type != 0) {
+            GST_BUFFER_PTS(buffer) = data->pts * GST_USECOND;
+        }
+        gst_app_src_push_buffer(GST_APP_SRC(t->appsrc), buffer);
+        g_mutex_lock(&t->mutex);
+    }
+    g_mutex_unlock(&t->mutex);
+    return NULL;
+}
+
+video_transcoder_t *video_transcoder_gstreamer_init(logger_t *logger, video_transcoder_config_t const *config,
+                                                    video_transcoder_output_t output, void *cls) {
+    video_transcoder_gstreamer_t *transcoder;
+    GError *error = NULL;
+
+    assert(config->width > 0 && config->height > 0 && config->bitrate > 0);
+
+    gstreamer_registry_wait();
+
+    gchar *decoder = gstreamer_registry_find_element(config->video_decoders ? config->video_decoders :
+                                                     GSTREAMER_H264_DECODERS, H264_CAPS, GST_PAD_SINK);
+    gchar *encoder = gstreamer_registry_find_element(config->video_encoders ? config->video_encoders :
+                                                     DEFAULT_VIDEO_ENCODERS, "video/x-h264", GST_PAD_SRC);
+    if (!decoder || !encoder) {
+        logger_log(logger, LOGGER_ERR, "No GStreamer H.264 %s installed to transcode with",
+                   decoder ? "encoder" : "decoder");
+        g_free(decoder);
+        g_free(encoder);
+        return NULL;
+    }
+    gchar *scaler = gstreamer_registry_find_element(DEFAULT_VIDEO_SCALERS, "video/x-raw", GST_PAD_SRC);
+
+    GString *launch = g_string_new(NULL);
+    // Any memory, so hardware scalers and encoders can hand over their buffers without a copy
+    g_string_append_printf(launch, "appsrc name=transcode_source stream-type=0 format=GST_FORMAT_TIME is-live=true "
+                           "block=true max-bytes=%d caps=" H264_CAPS " ! h264parse ! %s ! "
+                           "queue name=transcode_queue leaky=downstream max-size-buffers=2 max-size-bytes=0 "
+                           "max-size-time=0 ! %s ! video/x-raw(ANY),width=%d,height=%d,pixel-aspect-ratio=1/1 ! ",
+                           VIDEO_TRANSCODER_INPUT_BYTES, decoder, scaler ? scaler : "videoscale add-borders=true ! videoconvert",
+                           config->width, config->height);
+    const video_transcoder_encoder_t *settings = NULL;
+    for (unsigned int i = 0; i < sizeof(encoders) / sizeof(encoders[0]); i++) {
+        if (!strcmp(encoders[i].name, encoder)) {
+            settings = &encoders[i];
+        }
+    }
+    if (settings) {
+        g_string_append_printf(launch, settings->format, config->bitrate * settings->bitrate_scale,
+                               config->keyframe_interval);
+    } else {
+        logger_log(logger, LOGGER_WARNING, "Transcoding with %s at its default bitrate and keyframe interval", encoder);
+        g_string_append(launch, encoder);
+    }
+    // Every IDR frame gets the parameter sets in front, for viewers joining later
+    g_string_append(launch, " ! h264parse config-interval=-1 ! " H264_CAPS
+                    " ! appsink name=transcode_sink sync=false max-buffers=4 drop=true");
+
+    logger_log(logger, LOGGER_INFO, "Transcoding to %dx%d at %d kbit/s with %s, %s and %s", config->width,
+               config->height, config->bitrate, decoder, scaler ? scaler : "videoscale", encoder);
+    g_free(decoder);
+    g_free(encoder);
+    g_free(scaler);
+
+    GstElement *pipeline = gst_parse_launch(launch->str, &error);
+    g_string_free(launch, TRUE);
+    if (!pipeline || error) {
+        logger_log(logger, LOGGER_ERR, "Could not build the transcoder: %s", error ? error->message : "unknown error");
+        g_clear_error(&error);
+        if (pipeline) gst_object_unref(pipeline);
+        return NULL;
+    }
+
+    transcoder = calloc(1, sizeof(video_transcoder_gstreamer_t));
+    assert(transcoder);
+    transcoder->base.funcs = &video_transcoder_gstreamer_funcs;
+    transcoder->base.logger = logger;
+    transcoder->output = output;
+    transcoder->cls = cls;
+    transcoder->pipeline = pipeline;
+    transcoder->appsrc = gst_bin_get_by_name(GST_BIN(pipeline), "transcode_source");
+    transcoder->appsink = gst_bin_get_by_name(GST_BIN(pipeline), "transcode_sink");
+    // Nothing can be decoded before the first parameter sets
+    transcoder->skipping = true;
+    g_mutex_init(&transcoder->mutex);
+    g_cond_init(&transcoder->cond);
+
+    GstElement *queue = gst_bin_get_by_name(GST_BIN(pipeline), "transcode_queue");
+    g_signal_connect(queue, "overrun", G_CALLBACK(video_transcoder_gstreamer_overrun), transcoder);
+    gst_object_unref(queue);
+    GstAppSinkCallbacks callbacks = { .new_sample = video_transcoder_gstreamer_new_sample };
+    gst_app_sink_set_callbacks(GST_APP_SINK(transcoder->appsink), &callbacks, transcoder, NULL);
+    GstBus *bus = gst_element_get_bus(pipeline);
+    gst_bus_enable_sync_message_emission(bus);
+    g_signal_connect(bus, "sync-message::error", G_CALLBACK(video_transcoder_gstreamer_bus_message), transcoder);
+    gst_object_unref(bus);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    transcoder->thread = g_thread_new("transcoder", video_transcoder_gstreamer_thread, transcoder);
+    return &transcoder->base;
+}
+
+static void video_transcoder_gstreamer_free_copy(void *opaque, unsigned char *data) {
+    g_free(data);
+}
+
+/*
+ * Queues data, by the reference in frame or, if frame is NULL, as a copy. Drops the frame if the
+ * decoder is too far behind, and releases frame then.
+ */
+static void video_transcoder_gstreamer_queue(video_transcoder_gstreamer_t *t, const h264_decode_struct *data,
+                                             video_frame_t *frame) {
+    if (!data->data || data->data_len <= 0 || data->codec != VIDEO_CODEC_H264) {
+        video_frame_release(frame);
+        return;
+    }
+    bool entry_point = data->frame_type == 0 || data->is_idr;
+
+    g_mutex_lock(&t->mutex);
+    if (t->skipping && !entry_point) {
+        metrics_add(METRIC_TRANSCODE_FRAMES_DROPPED, 1);
+        g_mutex_unlock(&t->mutex);
+        video_frame_release(frame);
+        return;
+    }
+    if (t->count == VIDEO_TRANSCODER_QUEUE_FRAMES || g_atomic_int_get(&t->held) >= VIDEO_TRANSCODER_HELD_FRAMES) {
+        metrics_add(METRIC_TRANSCODE_FRAMES_DROPPED, 1);
+        if (data->frame_type != 0 && !data->is_reference) {
+            g_mutex_unlock(&t->mutex);
+            video_frame_release(frame);
+            return;
+        }
+        if (!t->skipping) {
+            logger_log(t->base.logger, LOGGER_WARNING, "Transcoder cannot decode the mirror fast enough, "
+                       "skipping to the next keyframe");
+        }
+        t->skipping = true;
+        g_mutex_unlock(&t->mutex);
+        video_frame_release(frame);
+        return;
+    }
+    if (!frame) {
+        h264_decode_struct copy = *data;
+        copy.data = g_malloc(data->data_len);
+        copy.buffer_handle = NULL;
+        memcpy(copy.data, data->data, data->data_len);
+        frame = video_frame_wrap(&copy, video_transcoder_gstreamer_free_copy, NULL);
+        if (!frame) {
+            g_free(copy.data);
+            g_mutex_unlock(&t->mutex);
+            return;
+        }
+    }
+    t->queue[(t->head + t->count) % VIDEO_TRANSCODER_QUEUE_FRAMES] = frame;
+    t->count++;
+    g_atomic_int_inc(&t->held);
+    t->skipping = false;
+    g_cond_signal(&t->cond);
+    g_mutex_unlock(&t->mutex);
+}
+
+static void video_transcoder_gstreamer_push(video_transcoder_t *transcoder, const h264_decode_struct *data) {
+    video_transcoder_gstreamer_queue((video_transcoder_gstreamer_t *)transcoder, data, NULL);
+}
+
+static void video_transcoder_gstreamer_push_frame(video_transcoder_t *transcoder, video_frame_t *frame) {
+    video_transcoder_gstreamer_queue((video_transcoder_gstreamer_t *)transcoder, video_frame_get(frame), frame);
+}
+
+/* Empties the queue, called with the mutex held */
+static void video_transcoder_gstreamer_clear(video_transcoder_gstreamer_t *t) {
+    for (; t->count > 0; t->count--) {
+        video_frame_release(t->queue[t->head]);
+        g_atomic_int_add(&t->held, -1);
+        t->head = (t->head + 1) % VIDEO_TRANSCODER_QUEUE_FRAMES;
+    }
+}
+
+static void video_transcoder_gstreamer_flush(video_transcoder_t *transcoder) {
+    video_transcoder_gstreamer_t *t = (video_transcoder_gstreamer_t *)transcoder;
+    g_mutex_lock(&t->mutex);
+    video_transcoder_gstreamer_clear(t);
+    t->skipping = true;
+    g_mutex_unlock(&t->mutex);
+    gst_element_send_event(t->pipeline, gst_event_new_flush_start());
+    gst_element_send_event(t->pipeline, gst_event_new_flush_stop(FALSE));
+}
+
+static void video_transcoder_gstreamer_destroy(video_transcoder_t *transcoder) {
+    video_transcoder_gstreamer_t *t = (video_transcoder_gstreamer_t *)transcoder;
+    g_mutex_lock(&t->mutex);
+    t->stopping = true;
+    g_cond_signal(&t->cond);
+    g_mutex_unlock(&t->mutex);
+    // Unblocks the thread if it waits in a push
+    gst_element_set_state(t->pipeline, GST_STATE_NULL);
+    g_thread_join(t->thread);
+    video_transcoder_gstreamer_clear(t);
+    gst_object_unref(t->appsrc);
+    gst_object_unref(t->appsink);
+    gst_object_unref(t->pipeline);
+    g_cond_clear(&t->cond);
+    g_mutex_clear(&t->mutex);
+    free(t);
+}
+
+static const video_transcoder_funcs_t video_transcoder_gstreamer_funcs = {
+    .push = video_transcoder_gstreamer_push,
+    .push_frame = video_transcoder_gstreamer_push_frame,
+    .flush = video_transcoder_gstreamer_flush,
+    .destroy = video_transcoder_gstreamer_destroy,
+};
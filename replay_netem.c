@@ -0,0 +1,310 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "replay_netem.h"
+
+static const char *const replay_stream_names[REPLAY_STREAM_COUNT] = { "mirror", "audio", "control" };
+
+typedef struct replay_netem_packet_s {
+    uint64_t due;
+    // Breaks ties in due in the order the packets came in
+    uint64_t sequence;
+    replay_stream_t stream;
+    unsigned char *data;
+    int len;
+} replay_netem_packet_t;
+
+typedef struct replay_netem_stream_s {
+    bool active;
+    replay_netem_config_t config;
+    uint64_t random;
+    bool bad;
+    // Latest due time handed out, the mirror stream keeps its order by it
+    uint64_t last_due;
+
+    uint64_t packets;
+    uint64_t lost;
+    uint64_t duplicated;
+    uint64_t reordered;
+} replay_netem_stream_t;
+
+struct replay_netem_s {
+    replay_netem_stream_t streams[REPLAY_STREAM_COUNT];
+    // A binary min-heap on due and sequence
+    replay_netem_packet_t *held;
+    int held_count;
+    int held_capacity;
+    uint64_t sequence;
+};
+
+static uint64_t replay_netem_splitmix(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/* A uniform draw from [0, 1), xorshift64* */
+static double replay_netem_random(replay_netem_stream_t *stream) {
+    stream->random ^= stream->random >> 12;
+    stream->random ^= stream->random << 25;
+    stream->random ^= stream->random >> 27;
+    return ((stream->random * 0x2545f4914f6cdd1dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static bool replay_netem_before(const replay_netem_packet_t *a, const replay_netem_packet_t *b) {
+    return a->due < b->due || (a->due == b->due && a->sequence < b->sequence);
+}
+
+static void replay_netem_push(replay_netem_t *netem, replay_netem_packet_t *packet) {
+    if (netem->held_count == netem->held_capacity) {
+        int capacity = netem->held_capacity ? netem->held_capacity * 2 : 256;
+        replay_netem_packet_t *held = realloc(netem->held, capacity * sizeof(replay_netem_packet_t));
+        if (!held) {
+            free(packet->data);
+            return;
+        }
+        netem->held = held;
+        netem->held_capacity = capacity;
+    }
+    int i = netem->held_count++;
+    while (i > 0 && replay_netem_before(packet, &netem->held[(i - 1) / 2])) {
+        netem->held[i] = netem->held[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    netem->held[i] = *packet;
+}
+
+static void replay_netem_pop(replay_netem_t *netem) {
+    replay_netem_packet_t last = netem->held[--netem->held_count];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= netem->held_count) break;
+        if (child + 1 < netem->held_count && replay_netem_before(&netem->held[child + 1], &netem->held[child])) child++;
+        if (!replay_netem_before(&netem->held[child], &last)) break;
+        netem->held[i] = netem->held[child];
+        i = child;
+    }
+    if (netem->held_count > 0) netem->held[i] = last;
+}
+
+/* A probability such as 2% or 0.02 */
+static int replay_netem_parse_chance(const char *value, double *chance) {
+    char *end;
+    double parsed = strtod(value, &end);
+    if (end == value) return -1;
+    if (*end == '%') {
+        parsed /= 100;
+        end++;
+    }
+    if (*end || parsed < 0 || parsed > 1) return -1;
+    *chance = parsed;
+    return 0;
+}
+
+static int replay_netem_parse_ms(const char *value, int *us) {
+    char *end;
+    double parsed = strtod(value, &end);
+    if (end == value || *end || parsed < 0 || parsed > 60000) return -1;
+    *us = (int) (parsed * 1000);
+    return 0;
+}
+
+int replay_netem_parse(const char *spec, replay_stream_t *stream, replay_netem_config_t *config) {
+    const char *colon = strchr(spec, ':');
+    int i;
+    for (i = 0; i < REPLAY_STREAM_COUNT; i++) {
+        if (colon && (size_t) (colon - spec) == strlen(replay_stream_names[i]) &&
+            !strncmp(spec, replay_stream_names[i], colon - spec)) break;
+    }
+    if (i == REPLAY_STREAM_COUNT) {
+        fprintf(stderr, "Error: -netem takes mirror:, audio: or control: before the impairments.\n");
+        return -1;
+    }
+    *stream = (replay_stream_t) i;
+    memset(config, 0, sizeof(*config));
+
+    char parameters[256];
+    snprintf(parameters, sizeof(parameters), "%s", colon + 1);
+    char *save = NULL;
+    for (char *parameter = strtok_r(parameters, ",", &save); parameter; parameter = strtok_r(NULL, ",", &save)) {
+        char *value = strchr(parameter, '=');
+        if (!value) {
+            fprintf(stderr, "Error: The netem impairment %s needs a value.\n", parameter);
+            return -1;
+        }
+        *value++ = '\0';
+        int ret = 0;
+        if (!strcmp(parameter, "loss")) {
+            ret = replay_netem_parse_chance(value, &config->loss);
+        } else if (!strcmp(parameter, "burst")) {
+            // enter/leave[/loss], the loss in the bad state defaults to every packet
+            char *leave = strchr(value, '/');
+            char *loss = leave ? strchr(leave + 1, '/') : NULL;
+            if (!leave) {
+                ret = -1;
+            } else {
+                *leave++ = '\0';
+                if (loss) *loss++ = '\0';
+                config->burst_loss = 1;
+                ret = replay_netem_parse_chance(value, &config->burst_enter) |
+                      replay_netem_parse_chance(leave, &config->burst_leave) |
+                      (loss ? replay_netem_parse_chance(loss, &config->burst_loss) : 0);
+                if (config->burst_leave == 0) ret = -1;
+            }
+        } else if (!strcmp(parameter, "dup")) {
+            ret = replay_netem_parse_chance(value, &config->duplicate);
+        } else if (!strcmp(parameter, "reorder")) {
+            ret = replay_netem_parse_chance(value, &config->reorder);
+        } else if (!strcmp(parameter, "delay")) {
+            ret = replay_netem_parse_ms(value, &config->delay_us);
+        } else if (!strcmp(parameter, "jitter")) {
+            ret = replay_netem_parse_ms(value, &config->jitter_us);
+        } else {
+            fprintf(stderr, "Error: Unknown netem impairment %s.\n", parameter);
+            return -1;
+        }
+        if (ret) {
+            fprintf(stderr, "Error: Invalid value %s for the netem impairment %s.\n", value, parameter);
+            return -1;
+        }
+    }
+    if (*stream == REPLAY_STREAM_MIRROR &&
+        (config->loss || config->burst_enter || config->duplicate || config->reorder)) {
+        fprintf(stderr, "Error: The mirror stream runs over TCP and only takes delay and jitter.\n");
+        return -1;
+    }
+    return 0;
+}
+
+replay_netem_t *replay_netem_init(uint64_t seed) {
+    replay_netem_t *netem = calloc(1, sizeof(replay_netem_t));
+    if (!netem) {
+        return NULL;
+    }
+    for (int i = 0; i < REPLAY_STREAM_COUNT; i++) {
+        uint64_t state = seed + i;
+        netem->streams[i].random = replay_netem_splitmix(&state) | 1;
+    }
+    return netem;
+}
+
+void replay_netem_destroy(replay_netem_t *netem) {
+    if (netem) {
+        for (int i = 0; i < netem->held_count; i++) {
+            free(netem->held[i].data);
+        }
+        free(netem->held);
+        free(netem);
+    }
+}
+
+void replay_netem_set(replay_netem_t *netem, replay_stream_t stream, const replay_netem_config_t *config) {
+    netem->streams[stream].config = *config;
+    netem->streams[stream].active = true;
+}
+
+static void replay_netem_hold(replay_netem_t *netem, replay_stream_t stream, const unsigned char *data, int len,
+                              uint64_t now) {
+    replay_netem_stream_t *s = &netem->streams[stream];
+    const replay_netem_config_t *config = &s->config;
+
+    int64_t delay = 0;
+    if (config->reorder > 0 && replay_netem_random(s) < config->reorder) {
+        // Straight out, past whatever of this stream is still held
+        s->reordered++;
+    } else {
+        delay = config->delay_us;
+        if (config->jitter_us > 0) {
+            delay += (int64_t) ((replay_netem_random(s) * 2 - 1) * config->jitter_us);
+        }
+        if (delay < 0) delay = 0;
+    }
+    uint64_t due = now + (uint64_t) delay;
+    if (stream == REPLAY_STREAM_MIRROR && due < s->last_due) {
+        due = s->last_due;
+    }
+    if (due > s->last_due) s->last_due = due;
+
+    replay_netem_packet_t packet;
+    packet.due = due;
+    packet.sequence = netem->sequence++;
+    packet.stream = stream;
+    packet.len = len;
+    packet.data = malloc(len);
+    if (!packet.data) {
+        return;
+    }
+    memcpy(packet.data, data, len);
+    replay_netem_push(netem, &packet);
+}
+
+void replay_netem_submit(replay_netem_t *netem, replay_stream_t stream, const unsigned char *data, int len, uint64_t now) {
+    replay_netem_stream_t *s = &netem->streams[stream];
+    s->packets++;
+    if (!s->active) {
+        replay_netem_hold(netem, stream, data, len, now);
+        return;
+    }
+
+    const replay_netem_config_t *config = &s->config;
+    // Gilbert-Elliott: the state moves on with every packet, each state loses at its own rate
+    if (config->burst_enter > 0) {
+        double transition = replay_netem_random(s);
+        s->bad = s->bad ? transition >= config->burst_leave : transition < config->burst_enter;
+    }
+    double loss = s->bad ? config->burst_loss : config->loss;
+    if (loss > 0 && replay_netem_random(s) < loss) {
+        s->lost++;
+        return;
+    }
+    replay_netem_hold(netem, stream, data, len, now);
+    if (config->duplicate > 0 && replay_netem_random(s) < config->duplicate) {
+        s->duplicated++;
+        replay_netem_hold(netem, stream, data, len, now);
+    }
+}
+
+void replay_netem_flush(replay_netem_t *netem, uint64_t now, replay_netem_send_t send, void *cls) {
+    while (netem->held_count > 0 && netem->held[0].due <= now) {
+        replay_netem_packet_t packet = netem->held[0];
+        replay_netem_pop(netem);
+        send(cls, packet.stream, packet.data, packet.len);
+        free(packet.data);
+    }
+}
+
+uint64_t replay_netem_next_due(const replay_netem_t *netem) {
+    return netem->held_count > 0 ? netem->held[0].due : UINT64_MAX;
+}
+
+void replay_netem_log(const replay_netem_t *netem, logger_t *logger) {
+    for (int i = 0; i < REPLAY_STREAM_COUNT; i++) {
+        const replay_netem_stream_t *s = &netem->streams[i];
+        if (!s->active) continue;
+        logger_log(logger, LOGGER_INFO, "Netem %s: %llu packets, %llu lost, %llu duplicated, %llu reordered",
+                   replay_stream_names[i], (unsigned long long) s->packets, (unsigned long long) s->lost,
+                   (unsigned long long) s->duplicated, (unsigned long long) s->reordered);
+    }
+}
@@ -0,0 +1,78 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef REPLAY_NETEM_H
+#define REPLAY_NETEM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lib/logger.h"
+
+/*
+ * Network impairments for rpiplay_replay, in the manner of Linux netem: loss, independent or
+ * in bursts after the Gilbert-Elliott model, duplication, delay, jitter and reordering, set
+ * per stream. Packets go in as the replay sends them and come out at the time they are due.
+ * Every stream draws from a generator of its own seeded from one seed, so a replay with the
+ * same seed and trace loses, duplicates and delays the same packets.
+ *
+ * The mirror stream runs over TCP, which neither loses nor reorders, so it only takes delay
+ * and jitter and keeps its order.
+ */
+
+typedef enum replay_stream_e {
+    REPLAY_STREAM_MIRROR,
+    REPLAY_STREAM_AUDIO,
+    REPLAY_STREAM_CONTROL,
+    REPLAY_STREAM_COUNT
+} replay_stream_t;
+
+typedef struct replay_netem_config_s {
+    double loss; // Chance of losing a packet, in the good state of the Gilbert-Elliott model
+    double burst_enter; // Chance per packet of going into the bad state, 0 for independent losses
+    double burst_leave; // Chance per packet of going back to the good state
+    double burst_loss; // Chance of losing a packet in the bad state
+    double duplicate; // Chance of sending a packet twice, the copy delayed on its own
+    double reorder; // Chance of a packet going out right away, ahead of the delayed ones
+    int delay_us;
+    int jitter_us; // Delays vary evenly by up to this much either way, which reorders too
+} replay_netem_config_t;
+
+typedef struct replay_netem_s replay_netem_t;
+
+typedef void (*replay_netem_send_t)(void *cls, replay_stream_t stream, const unsigned char *data, int len);
+
+/* Parses "stream:name=value,..." as in -netem, returns -1 with a message for the user if it does not */
+int replay_netem_parse(const char *spec, replay_stream_t *stream, replay_netem_config_t *config);
+
+replay_netem_t *replay_netem_init(uint64_t seed);
+void replay_netem_destroy(replay_netem_t *netem);
+void replay_netem_set(replay_netem_t *netem, replay_stream_t stream, const replay_netem_config_t *config);
+
+/* Takes a copy of a packet sent at local time now, for flush to send when it is due */
+void replay_netem_submit(replay_netem_t *netem, replay_stream_t stream, const unsigned char *data, int len, uint64_t now);
+/* Sends the packets due by now in the order they are due */
+void replay_netem_flush(replay_netem_t *netem, uint64_t now, replay_netem_send_t send, void *cls);
+/* Local time the next packet is due at, UINT64_MAX with none held */
+uint64_t replay_netem_next_due(const replay_netem_t *netem);
+
+/* What was done to the packets of the impaired streams */
+void replay_netem_log(const replay_netem_t *netem, logger_t *logger);
+
+#endif //REPLAY_NETEM_H
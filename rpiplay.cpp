@@ -19,19 +19,49 @@
 
 #include <stddef.h>
 #include <cstring>
+#include <cerrno>
 #include <signal.h>
 #include <unistd.h>
 #include <string>
 #include <vector>
 #include <fstream>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <time.h>
 
 #include "log.h"
+#include "pipeline.h"
 #include "lib/raop.h"
 #include "lib/stream.h"
 #include "lib/logger.h"
 #include "lib/dnssd.h"
+#include "lib/crypto.h"
+#include "lib/threads.h"
+#include "lib/recorder.h"
+#include "lib/restream.h"
+#include "lib/shm_ring.h"
+#include "lib/webrtc.h"
+#include "lib/netwatch.h"
+#include "lib/audio_format.h"
+#include "lib/memlock.h"
+#include "lib/perf_counters.h"
+#include "lib/thermal.h"
+#include "lib/pm_qos.h"
+#include "lib/netutils.h"
+#include "lib/cpu_features.h"
+#include "lib/simd_kernels.h"
+#include "lib/sync_group.h"
+#include "lib/genlock.h"
+#include "lib/sd_daemon.h"
+#include "lib/video_frame.h"
+#include "lib/flight_recorder.h"
+#include "lib/gop_cache.h"
 #include "renderers/video_renderer.h"
 #include "renderers/audio_renderer.h"
+#include "renderers/renderer_list.h"
+#include "renderers/video_transcoder.h"
+#include "renderers/url_player.h"
 
 #define VERSION "1.2"
 
@@ -42,60 +72,234 @@
 #define DEFAULT_DEBUG_LOG false
 #define DEFAULT_ROTATE 0
 #define DEFAULT_FLIP FLIP_NONE
+#define DEFAULT_AUDIO_BUFFER_LENGTH 32
+#define DEFAULT_VIDEO_QUEUE_DEPTH 4
+#define DEFAULT_VIDEO_LATENCY_BUDGET 0
+#define DEFAULT_LATENCY_TARGET 150
+#define DEFAULT_AUDIO_BATCH 30
+#define DEFAULT_MAX_SESSIONS 1
+#define DEFAULT_IDLE_TIMEOUT 30
+#define MAX_SESSIONS 4
+#define DEFAULT_RECEIVERS 1
+#define MAX_RECEIVERS 8
+#define DEFAULT_TRACE_SIZE 64
+#define DEFAULT_FLIGHT_DIR "/tmp"
+// Frames since the last IDR every mirror keeps for a decoder that starts over, beyond that it waits for the next IDR
+#define SESSION_GOP_MAX_FRAMES 600
+#define SESSION_GOP_MAX_BYTES (8 * 1024 * 1024)
+#define DEFAULT_SHM_SIZE 16
+// Two seconds of a 30 fps mirror, how long a viewer joining the transcoded restream waits
+#define DEFAULT_TRANSCODE_KEYFRAME_INTERVAL 60
+// Size of the /snapshot.jpg on the metrics port, and how long to wait for a frame for it
+#define SNAPSHOT_WIDTH 320
+#define SNAPSHOT_HEIGHT 180
+#define SNAPSHOT_TIMEOUT 1000
+// Playout delay of a video wall node unless -vp sets one, frames need one to be held back to the wall's schedule
+#define DEFAULT_GENLOCK_PLAYOUT_DELAY 100
 #define DEFAULT_HW_ADDRESS { (char) 0x48, (char) 0x5d, (char) 0x60, (char) 0x7c, (char) 0xee, (char) 0x22 }
 
-int start_server(std::vector<char> hw_addr, std::string name, bool debug_log,
-                 video_renderer_config_t const *video_config, audio_renderer_config_t const *audio_config);
-
-int stop_server();
+typedef struct server_config_s {
+    int audio_buffer_length;
+    int video_queue_depth;
+    int video_latency_budget;
+    int video_playout_delay;
+    // Video wall the first receiver leads or follows, empty for none
+    std::string genlock_group;
+    genlock_role_t genlock_role;
+    int mirror_receive_buffer;
+    int mirror_busy_poll;
+    int max_sessions;
+    // Pixels per second the decoder keeps up with over all mirrors, 0 admits every mirror
+    uint64_t decode_capacity;
+    // Close the oldest mirrors for a new one the decoder has no room for, instead of refusing it
+    bool preempt;
+    int receivers;
+    int metrics_port;
+    std::string key_file;
+    std::string trace_file;
+    int trace_size;
+    std::string recording_dir;
+    // Where the flight recorder is dumped on a stall or SIGUSR1
+    std::string flight_dir;
+    std::vector<std::string> restream_addresses;
+    // Restreams a transcoded mirror if the bitrate is set, the mirror as received otherwise
+    video_transcoder_config_t restream_transcode;
+    std::string shm_name;
+    // Serves the page and signaling for WebRTC viewers on this port, 0 for none
+    int webrtc_port;
+    // Display advertised to senders, 0 for the default; display_auto takes it from the video renderer
+    int display_width;
+    int display_height;
+    int display_refresh_rate;
+    bool display_auto;
+    bool lazy_video;
+    bool slice_pipelining;
+    // Bounds of the adaptive NTP polling interval, 0 for the default
+    int ntp_poll_min;
+    int ntp_poll_max;
+    // Send RTCP receiver reports on the audio control channel
+    bool receiver_reports;
+    // Seconds without a packet from the sender before its session is closed, 0 never closes one
+    int idle_timeout;
+    // Seconds of audio a buffered stream queues, 0 keeps senders on the realtime stream
+    int buffered_audio;
+    // Lock all memory at startup, so the media threads never wait for a page fault
+    bool lock_memory;
+    // Count CPU cycles and friends by pipeline stage with the hardware performance counters
+    bool perf_counters;
+    // Ask senders for less and drop sooner while the Pi is throttled
+    bool thermal;
+    // Deepest C-state exit latency to allow while sessions stream, -1 to leave the CPU alone
+    int pm_latency;
+    // Share of the maximum clock the cores stay at while sessions stream, 0 for no floor
+    int pm_floor;
+    // Fetch and play the movies senders cast by URL, instead of them mirroring the movie
+    bool play_urls;
+} server_config_t;
 
-typedef video_renderer_t *(*video_init_func_t)(logger_t *logger, video_renderer_config_t const *config);
-typedef audio_renderer_t *(*audio_init_func_t)(logger_t *logger, video_renderer_t *video_renderer, audio_renderer_config_t const *config);
-
-typedef struct video_renderer_list_entry_s {
+/*
+ * Tunings of the whole pipeline that go together, from the network buffers to the decoder.
+ * -lp applies one where it appears among the options, so later options override parts of it.
+ */
+typedef struct latency_profile_s {
     const char *name;
     const char *description;
-    video_init_func_t init_func;
-} video_renderer_list_entry_t;
+    bool low_latency; // Present frames as they are decoded instead of on the sender's clock
+    int latency_target;
+    int audio_buffer_length;
+    int video_queue_depth;
+    int video_latency_budget;
+    int input_buffer_count; // 0 keeps the decoder default
+    int max_dec_frame_buffering;
+    int resync_threshold;
+    int audio_batch;
+} latency_profile_t;
 
-typedef struct audio_renderer_list_entry_s {
-    const char *name;
-    const char *description;
-    audio_init_func_t init_func;
-} audio_renderer_list_entry_t;
+static const latency_profile_t latency_profiles[] = {
+    // Streams from iOS have no B-frames, so a single frame of decoder buffering is safe for them
+    { "ultra", "Lowest latency, for games and presenting; stutters on a busy network",
+      true, 60, 8, 1, 100, 8, 1, 50, 0 },
+    { "balanced", "What rpiplay does without -lp",
+      DEFAULT_LOW_LATENCY, DEFAULT_LATENCY_TARGET, DEFAULT_AUDIO_BUFFER_LENGTH, DEFAULT_VIDEO_QUEUE_DEPTH,
+      DEFAULT_VIDEO_LATENCY_BUDGET, 0, 4, 100, DEFAULT_AUDIO_BATCH },
+    { "smooth", "Rides out Wi-Fi congestion and decoder stalls, for films; adds about half a second",
+      false, 400, 96, 12, 0, 40, 16, 250, 80 },
+};
+
+// Everything the command line and the config file set
+typedef struct options_s {
+    std::string server_name;
+    bool debug_log;
+    server_config_t server;
+    video_renderer_config_t video;
+    audio_renderer_config_t audio;
+} options_t;
+
+int start_server(std::vector<char> hw_addr, std::string name, bool debug_log, server_config_t const *server_config,
+                 video_renderer_config_t const *video_config, audio_renderer_config_t const *audio_config);
+
+int stop_server();
+
+// Per-connection context handed back by raop as the callbacks' cls
+typedef struct session_s {
+    int tile; // Renderer slot of the stream, -1 until the connection starts streaming
+    // Local times the connection reached each raop_milestone_t, 0 until then
+    std::atomic<uint64_t> milestones[RAOP_MILESTONE_COUNT];
+    bool timeline_logged;
+    // Set by the video thread once the mirror's parameter sets arrive, read by the audio thread
+    std::atomic<recorder_t *> recorder;
+    // With -mix the connection's own stream into the audio renderer, and the format it was switched to
+    audio_renderer_t *audio;
+    audio_format_t audio_format;
+    bool audio_opened;
+    // Set once the mirror was shown on the single renderer, see session_holds_display
+    std::atomic<bool> displayed;
+    // The mirror's parameter sets and frames since its last IDR, created with the first frame
+    gop_cache_t *gop;
+} session_t;
 
 static bool running = false;
-static dnssd_t *dnssd = NULL;
-static raop_t *raop = NULL;
+static netwatch_t *netwatch = NULL;
+static thermal_t *thermal = NULL;
+static pm_qos_t *pm_qos = NULL;
+static genlock_t *genlock = NULL;
+// With -i every receiver has its own name, port and MAC address, the first one's raop serves
+// the connections of all of them and only it serves metrics and writes the trace
+static int receivers = 0;
+static raop_t *raops[MAX_RECEIVERS];
+static dnssd_t *dnssds[MAX_RECEIVERS];
+// Listening sockets systemd passed for socket activation, one per receiver in order
+static int activated_fds = 0;
+// Receivers that have their listening socket, passed or bound early, and are advertised on it
+static bool receiver_registered[MAX_RECEIVERS];
 static video_init_func_t video_init_func = NULL;
 static audio_init_func_t audio_init_func = NULL;
 static video_renderer_t *video_renderer = NULL;
 static audio_renderer_t *audio_renderer = NULL;
 static logger_t *render_logger = NULL;
+// Format the audio renderer was last switched to, only the session that has audio switches it
+static audio_format_t audio_renderer_format;
+// With -mix every connection plays its audio through a stream of its own, see open_stream
+static bool mix_audio = false;
+// Output latency of the audio renderer the receivers last advertised, see advertise_audio_latency
+static std::atomic<int> advertised_audio_latency(-1);
+static std::string recording_dir;
+static std::atomic<int> recording_count(0);
+// Passes one mirror at a time on to the -rtp subscribers, the first to send its parameter sets
+static restream_t *restreamer = NULL;
+static std::atomic<session_t *> restream_owner(NULL);
+// With -rtpt the restream is fed by the transcoder, from its thread; restream_restart tells it of a new mirror
+static video_transcoder_t *restream_transcoder = NULL;
+static std::atomic<bool> restream_restart(false);
+// Likewise publishes one mirror at a time into shared memory for -shm
+static shm_ring_t *shm_ring = NULL;
+static std::atomic<session_t *> shm_owner(NULL);
+// And serves one to browsers for -webrtc
+static webrtc_t *webrtc = NULL;
+static std::atomic<session_t *> webrtc_owner(NULL);
+// Without tiles, the presenter whose mirror the one video renderer shows
+static std::atomic<session_t *> display_owner(NULL);
+// With -play the movies senders cast by URL, one at a time, stopped with the connection that cast it
+static url_player_t *url_player = NULL;
+static std::atomic<session_t *> cast_owner(NULL);
+// The sender whose AirPlay photo video_renderer shows, hidden with its connection. photo_mutex
+// keeps photos in order, and with -lazy photo_holds_video is set while they hold the renderer
+static session_t *photo_owner = NULL;
+static bool photo_holds_video = false;
+static std::mutex photo_mutex;
 
-static const video_renderer_list_entry_t video_renderers[] = {
-#if defined(HAS_RPI_RENDERER)
-    {"rpi", "Raspberry Pi OpenMAX accelerated H.264 renderer", video_renderer_rpi_init},
-#endif
-#if defined(HAS_GSTREAMER_RENDERER)
-    {"gstreamer", "GStreamer H.264 renderer", video_renderer_gstreamer_init},
-#endif
-#if defined(HAS_DUMMY_RENDERER)
-    {"dummy", "Dummy renderer; does not actually display video", video_renderer_dummy_init},
-#endif
-};
+// With more than one session every mirror gets its own renderer in a cell of the screen,
+// tile_renderers[0] is video_renderer and the only one the audio renderer is tied to
+static int max_sessions = DEFAULT_MAX_SESSIONS;
+static video_renderer_config_t tile_configs[MAX_SESSIONS];
+static video_renderer_t *tile_renderers[MAX_SESSIONS];
+static session_t *tile_owners[MAX_SESSIONS];
+static std::mutex tile_mutex;
 
-static const audio_renderer_list_entry_t audio_renderers[] = {
-#if defined(HAS_RPI_RENDERER)
-    {"rpi", "AAC renderer using fdk-aac for decoding and OpenMAX for rendering", audio_renderer_rpi_init},
-#endif
-#if defined(HAS_GSTREAMER_RENDERER)
-    {"gstreamer", "GStreamer audio renderer", audio_renderer_gstreamer_init},
-#endif
-#if defined(HAS_DUMMY_RENDERER)
-    {"dummy", "Dummy renderer; does not actually play audio", audio_renderer_dummy_init},
-#endif
-};
+// With -lazy video_renderer is only started while at least one mirror streams, and kept idle
+// in between if it can be, or else destroyed
+static bool lazy_video = false;
+static video_renderer_config_t const *lazy_video_config = NULL;
+static int video_users = 0;
+static std::mutex video_mutex;
+
+static void apply_latency_profile(latency_profile_t const *profile, options_t *options) {
+    options->video.low_latency = options->audio.low_latency = profile->low_latency;
+    options->video.latency_target = options->audio.latency_target = profile->latency_target;
+    options->server.audio_buffer_length = profile->audio_buffer_length;
+    options->server.video_queue_depth = profile->video_queue_depth;
+    options->server.video_latency_budget = profile->video_latency_budget;
+    options->video.input_buffer_count = profile->input_buffer_count;
+    options->video.max_dec_frame_buffering = profile->max_dec_frame_buffering;
+    options->video.resync_threshold = options->audio.resync_threshold = profile->resync_threshold;
+    options->audio.batch_ms = profile->audio_batch;
+}
+
+// Options are read from config_file, if given, and then command_line, again on SIGHUP
+static std::string program_name;
+static std::string config_file;
+static std::vector<std::string> command_line;
+static volatile sig_atomic_t reload_requested = 0;
 
 static void signal_handler(int sig) {
     switch (sig) {
@@ -103,6 +307,13 @@ static void signal_handler(int sig) {
         case SIGTERM:
             running = 0;
             break;
+        case SIGUSR1:
+            if (receivers) raop_log_stats(raops[0]);
+            flight_recorder_request("SIGUSR1");
+            break;
+        case SIGHUP:
+            reload_requested = 1;
+            break;
     }
 }
 
@@ -114,6 +325,8 @@ static void init_signals(void) {
     sigact.sa_flags = 0;
     sigaction(SIGINT, &sigact, NULL);
     sigaction(SIGTERM, &sigact, NULL);
+    sigaction(SIGUSR1, &sigact, NULL);
+    sigaction(SIGHUP, &sigact, NULL);
 }
 
 static int parse_hw_addr(std::string str, std::vector<char> &hw_addr) {
@@ -136,34 +349,82 @@ std::string find_mac() {
     return mac_address;
 }
 
-static video_init_func_t find_video_init_func(const char *name) {
-    for (int i = 0; i < sizeof(video_renderers)/sizeof(video_renderers[0]); i++) {
-        if (!strcmp(name, video_renderers[i].name)) {
-            return video_renderers[i].init_func;
-        }
-    }
-    return NULL;
-}
-
-static audio_init_func_t find_audio_init_func(const char *name) {
-    for (int i = 0; i < sizeof(audio_renderers)/sizeof(audio_renderers[0]); i++) {
-        if (!strcmp(name, audio_renderers[i].name)) {
-            return audio_renderers[i].init_func;
-        }
-    }
-    return NULL;
-}
-
-void print_info(char *name) {
+void print_info(const char *name) {
     printf("RPiPlay %s: An open-source AirPlay mirroring server for Raspberry Pi\n", VERSION);
-    printf("Usage: %s [-n name] [-b (on|auto|off)] [-r (90|180|270)] [-l] [-a (hdmi|analog|off)] [-vr renderer] [-ar renderer]\n", name);
+    printf("Usage: %s [-conf file] [-n name] [-b (on|auto|off)] [-r (90|180|270)] [-res WxH[@fps]|auto] [-lazy] [-cea60] [-dd] [-hevc] [-play] [-l] [-lp profile] [-a (hdmi|analog|off)] [-lt ms] [-jb packets] [-vq frames] [-vd ms] [-vp ms] [-genlock role[:name]] [-nal] [-rb KB] [-bp us] [-ntp min:max] [-rtcp] [-idle seconds] [-ba seconds] [-rs ms] [-olt ms[:speed:inflection]] [-ab ms] [-fdk] [-mix] [-group name] [-dfb frames] [-m sessions] [-dc WxH@fps] [-preempt] [-i receivers] [-key file] [-mp port] [-trace file] [-ts MB] [-rec dir] [-fr dir] [-rtp host:port] [-rtpt WxH@kbps] [-shm name] [-webrtc port] [-tc] [-bench seconds[:annexb]] [-mlock] [-perf] [-thermal (on|off)] [-pmqos us[:floor]|off] [-qos spec|off] [-sched spec] [-vs sink] [-vdec list] [-vr renderer] [-ar renderer]\n", name);
     printf("Options:\n");
+    printf("-conf file            Read options from file first, one per line, and reload it on SIGHUP\n");
     printf("-n name               Specify the network name of the AirPlay server\n");
     printf("-b (on|auto|off)      Show black background always, only during active connection, or never\n");
     printf("-r (90|180|270)       Specify image rotation in multiples of 90 degrees\n");
     printf("-f (horiz|vert|both)  Specify image flipping (horiz = horizontal, vert = vertical, both = both)\n");
+    printf("-res WxH[@fps]|auto   Ask senders for a mirror of this size and frame rate, or of the screen's (default 1920x1080@60)\n");
+    printf("-lazy                 Start the video renderer only while a mirror streams, for audio-only receivers\n");
+    printf("-cea60                Switch HDMI to the 60 Hz mode of the same size while mirroring (rpi renderer)\n");
+    printf("-dd                   Decode new resolutions and rotations on a second decoder, no blank screen (rpi renderer)\n");
+    printf("-hevc                 Offer mirroring in H.265 if the video renderer can decode it (v4l2, ffmpeg, gstreamer)\n");
+    printf("-play                 Fetch and play the movies apps cast, instead of the sender mirroring them (GStreamer)\n");
     printf("-l                    Enable low-latency mode (disables render clock)\n");
+    printf("-lp profile           Tune the whole pipeline for latency or smoothness, later options override it:\n");
+    for (int i = 0; i < sizeof(latency_profiles)/sizeof(latency_profiles[0]); i++) {
+        printf("    %s: %s\n", latency_profiles[i].name, latency_profiles[i].description);
+    }
     printf("-a (hdmi|analog|off)  Set audio output device\n");
+    printf("-lt ms                Set how long after its timestamp the gstreamer renderers present a frame (default %d)\n", DEFAULT_LATENCY_TARGET);
+    printf("-jb packets           Set the maximum audio jitter buffer depth, the buffer adapts below it (default %d)\n", DEFAULT_AUDIO_BUFFER_LENGTH);
+    printf("-vq frames            Set how many received video frames may queue up for a busy decoder (default %d)\n", DEFAULT_VIDEO_QUEUE_DEPTH);
+    printf("-vd ms                Drop late video frames once they are this far behind, 0 never drops (default %d)\n", DEFAULT_VIDEO_LATENCY_BUDGET);
+    printf("-vp ms                Hold bursts of video frames back to show them on the sender's cadence, at most this long (default: off)\n");
+    printf("-genlock role[:name]  Flip each frame on the same refresh as the other displays of a video wall, role is\n");
+    printf("                      leader for one receiver and follower for the rest (default name wall), implies -l\n");
+    printf("                      and -vp %d unless -vp is given\n", DEFAULT_GENLOCK_PLAYOUT_DELAY);
+    printf("-nal                  Feed the rpi decoder the slices of a frame while the rest is still arriving\n");
+    printf("-rb KB                Set the receive buffer of the mirror connection (default: system)\n");
+    printf("-bp us                Busy poll the mirror connection for this long before sleeping (default: off)\n");
+    printf("-ntp min:max          Bound the adaptive NTP polling interval in ms (default 1000:8000)\n");
+    printf("-rtcp                 Send the sender RTCP receiver reports on the loss and jitter of the audio\n");
+    printf("-idle seconds         Close a session once its sender went silent for this long, 0 never does (default %d)\n", DEFAULT_IDLE_TIMEOUT);
+    printf("-ba seconds           Offer senders buffered audio, queued this far ahead for music (default: off)\n");
+    printf("-rs ms                Resync the rpi renderers once playback is 4x this late (default 100)\n");
+    printf("-olt ms[:speed:inflection] Let the rpi renderers' OMX clock steer itself to hold this latency (default off)\n");
+    printf("-ab ms                Collect this much audio into each buffer of the rpi renderer, 0 for one frame (default %d)\n", DEFAULT_AUDIO_BATCH);
+    printf("-fdk                  Decode AAC with fdk-aac in the gstreamer audio renderer instead of decodebin\n");
+    printf("-mix                  Play the audio of simultaneous senders together, mixed in the alsa renderer\n");
+    printf("-group name           Play audio in sync with the other receivers of this group on the network, in the alsa renderer\n");
+    printf("-dfb frames           Set the frames the rpi renderer lets the decoder hold back, 1 to 16 (default 4)\n");
+    printf("-m sessions           Allow up to this many simultaneous mirrors tiled on screen, at most %d (default %d)\n", MAX_SESSIONS, DEFAULT_MAX_SESSIONS);
+    printf("-dc WxH@fps           Admit mirrors only while the decoder keeps up with this much video over all of them\n");
+    printf("-preempt              With -dc, close the oldest mirrors to make room for a new one instead of refusing it\n");
+    printf("-i receivers          Announce this many receivers, each with its own name, port and MAC address, at most %d (default %d)\n", MAX_RECEIVERS, DEFAULT_RECEIVERS);
+    printf("-key file             Keep the pairing identity in file, so senders know the receiver after a restart\n");
+    printf("-mp port              Serve Prometheus metrics at http://<host>:port/metrics (default: off)\n");
+    printf("-trace file           Record the received streams and their keys into file for offline replay\n");
+    printf("-ts MB                Set the size of the trace file, the oldest records are overwritten (default %d)\n", DEFAULT_TRACE_SIZE);
+    printf("-rec dir              Record every mirroring session into dir as fragmented MP4, without re-encoding\n");
+    printf("-fr dir               Dump the last seconds of frame timings into dir on a stall or SIGUSR1 (default %s)\n", DEFAULT_FLIGHT_DIR);
+    printf("-rtp host:port        Restream the mirror as H.264 over RTP to a unicast or multicast address, repeatable\n");
+    printf("                      IPv6 addresses are written as [address]:port\n");
+    printf("-rtpt WxH@kbps        Restream the mirror transcoded to WxH at kbps, for links too slow for the original\n");
+    printf("-shm name             Publish the mirror into the shared memory object name, e.g. /rpiplay, for local consumers\n");
+    printf("-webrtc port          Let browsers watch the mirror at http://<address>:port/ over WebRTC\n");
+    printf("-tc                   Measure glass-to-glass latency from the timecode video of rpiplay_loadgen -tc\n");
+    printf("-bench seconds[:annexb] Have the dummy renderers log throughput, latency and jitter every so many seconds\n");
+    printf("                      and at the end, 0 only at the end, annexb also checks every video frame\n");
+    printf("-mlock                Lock all memory at startup and prefault the media buffers\n");
+    printf("-perf                 Count CPU cycles, instructions and misses by pipeline stage\n");
+    printf("-thermal (on|off)     Ask senders for less and drop sooner while the Pi is throttled (default on)\n");
+    printf("-pmqos us[:floor]|off Keep the cores within us of waking and at least at floor %% of their clock\n");
+    printf("                      while sessions stream, needs root (default: %d:0)\n", PM_QOS_DEFAULT_LATENCY_US);
+    printf("-qos role:dscp[:priority] Mark the sockets of a role for Wi-Fi QoS, repeatable, or off for none\n");
+    printf("                      roles: timing, control, audio, mirror; dscp: 0-63, ef, afXY or csN\n");
+    printf("-sched role:policy[:priority[:cpus]] Set the scheduling of a thread role, repeatable, e.g. audio:fifo:50:3\n");
+    printf("                      roles: httpd, worker, ntp, audio, mirror, render; policies: other, fifo, rr\n");
+    printf("-aes (auto|openssl|afalg) Run AES in OpenSSL or the kernel, bench_crypto shows which is faster (default: auto)\n");
+    printf("-vb buffers           Set the number of decoder input buffers of the rpi and v4l2 renderers (default: decoder default)\n");
+    printf("-vbs bytes            Set the size of each decoder input buffer of the rpi and v4l2 renderers (default: decoder default)\n");
+    printf("-vs sink              Set the GStreamer video sink, e.g. kmssink or waylandsink (default: autovideosink)\n");
+    printf("-vdec list            Set the GStreamer H.264 and H.265 decoders to try in order, comma separated\n");
+    printf("                      (default: v4l2h264dec,vah264dec,vaapih264dec,nvh264dec,avdec_h264)\n");
     printf("-vr renderer          Set video renderer to use. Available renderers:\n");
     for (int i = 0; i < sizeof(video_renderers)/sizeof(video_renderers[0]); i++) {
         printf("    %s: %s%s\n", video_renderers[i].name, video_renderers[i].description, i == 0 ? " [Default]" : "");
@@ -176,144 +437,1190 @@ void print_info(char *name) {
     printf("-v/-h                 Displays this help and version information\n");
 }
 
-int main(int argc, char *argv[]) {
-    init_signals();
-    
-    std::string server_name = DEFAULT_NAME;
-    std::vector<char> server_hw_addr = DEFAULT_HW_ADDRESS;
-    bool debug_log = DEFAULT_DEBUG_LOG;
-
-    video_renderer_config_t video_config;
-    video_config.background_mode = DEFAULT_BACKGROUND_MODE;
-    video_config.low_latency = DEFAULT_LOW_LATENCY;
-    video_config.rotation = DEFAULT_ROTATE;
-    video_config.flip = DEFAULT_FLIP;
-    
-    audio_renderer_config_t audio_config;
-    audio_config.device = DEFAULT_AUDIO_DEVICE;
-    audio_config.low_latency = DEFAULT_LOW_LATENCY;
-    
-    // Default to the best available renderer
-    video_init_func = video_renderers[0].init_func;
-    audio_init_func = audio_renderers[0].init_func;
+static void init_options(options_t *options) {
+    options->server_name = DEFAULT_NAME;
+    options->debug_log = DEFAULT_DEBUG_LOG;
+
+    options->server.audio_buffer_length = DEFAULT_AUDIO_BUFFER_LENGTH;
+    options->server.video_queue_depth = DEFAULT_VIDEO_QUEUE_DEPTH;
+    options->server.video_latency_budget = DEFAULT_VIDEO_LATENCY_BUDGET;
+    options->server.video_playout_delay = 0;
+    options->server.genlock_group.clear();
+    options->server.genlock_role = GENLOCK_LEADER;
+    options->server.mirror_receive_buffer = 0;
+    options->server.mirror_busy_poll = 0;
+    options->server.max_sessions = DEFAULT_MAX_SESSIONS;
+    options->server.decode_capacity = 0;
+    options->server.preempt = false;
+    options->server.receivers = DEFAULT_RECEIVERS;
+    options->server.metrics_port = 0;
+    options->server.webrtc_port = 0;
+    options->server.trace_size = DEFAULT_TRACE_SIZE;
+    options->server.flight_dir = DEFAULT_FLIGHT_DIR;
+    memset(&options->server.restream_transcode, 0, sizeof(options->server.restream_transcode));
+    options->server.display_width = 0;
+    options->server.display_height = 0;
+    options->server.display_refresh_rate = 0;
+    options->server.display_auto = false;
+    options->server.lazy_video = false;
+    options->server.play_urls = false;
+    options->server.slice_pipelining = false;
+    options->server.ntp_poll_min = 0;
+    options->server.ntp_poll_max = 0;
+    options->server.receiver_reports = false;
+    options->server.idle_timeout = DEFAULT_IDLE_TIMEOUT;
+    options->server.buffered_audio = 0;
+    options->server.lock_memory = false;
+    options->server.perf_counters = false;
+    options->server.thermal = true;
+    options->server.pm_latency = PM_QOS_DEFAULT_LATENCY_US;
+    options->server.pm_floor = 0;
+
+    options->video.background_mode = DEFAULT_BACKGROUND_MODE;
+    options->video.low_latency = DEFAULT_LOW_LATENCY;
+    options->video.latency_target = DEFAULT_LATENCY_TARGET;
+    options->video.rotation = DEFAULT_ROTATE;
+    options->video.flip = DEFAULT_FLIP;
+    options->video.input_buffer_count = 0;
+    options->video.input_buffer_size = 0;
+    options->video.video_sink = NULL;
+    options->video.video_decoders = NULL;
+    options->video.tiles = 0;
+    options->video.tile = 0;
+    options->video.measure_latency = false;
+    options->video.switch_to_60hz = false;
+    options->video.double_decoder = false;
+    options->video.hevc = false;
+    options->video.resync_threshold = 0;
+    options->video.max_dec_frame_buffering = 0;
+    options->video.omx_latency_target = 0;
+    options->video.omx_latency_speed = 0;
+    options->video.omx_latency_inflection = 0;
+    options->video.bench_interval = -1;
+    options->video.bench_check = false;
+
+    options->audio.device = DEFAULT_AUDIO_DEVICE;
+    options->audio.low_latency = DEFAULT_LOW_LATENCY;
+    options->audio.latency_target = DEFAULT_LATENCY_TARGET;
+    options->audio.resync_threshold = 0;
+    options->audio.batch_ms = DEFAULT_AUDIO_BATCH;
+    options->audio.omx_latency_target = 0;
+    options->audio.omx_latency_speed = 0;
+    options->audio.omx_latency_inflection = 0;
+    options->audio.decode_aac = false;
+    options->audio.mix = false;
+    options->audio.bench_interval = -1;
+    options->audio.sync_group = NULL;
+}
+
+/*
+ * Reads options from a file, one per line as on the command line, with the value after the
+ * first blank so it may contain spaces itself. Blank lines and lines starting with # are skipped.
+ */
+static bool load_config_file(std::string const &path, std::vector<std::string> &args) {
+    std::ifstream file(path.c_str());
+    if (!file) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') continue;
+        size_t end = line.find_first_of(" \t\r", start);
+        std::string option = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        args.push_back(option[0] == '-' ? option : "-" + option);
+        if (end == std::string::npos) continue;
+        size_t value_start = line.find_first_not_of(" \t", end);
+        size_t value_end = line.find_last_not_of(" \t\r");
+        if (value_start != std::string::npos && value_end >= value_start) {
+            args.push_back(line.substr(value_start, value_end - value_start + 1));
+        }
+    }
+    return true;
+}
 
-    // Parse arguments
-    for (int i = 1; i < argc; i++) {
-        std::string arg(argv[i]);
+/*
+ * Parses options as given on the command line or in a config file, false after printing why
+ * they are invalid. When reloading, options that can only be applied at startup are skipped.
+ */
+static bool parse_options(std::vector<std::string> const &args, options_t *options, bool reloading) {
+    for (size_t i = 0; i < args.size(); i++) {
+        std::string const &arg = args[i];
+        // Renderers, thread settings and the AES backend are only set up at startup
+        if (reloading && (arg == "-sched" || arg == "-qos" || arg == "-aes" || arg == "-vr" || arg == "-ar")) {
+            i++;
+            continue;
+        }
         if (arg == "-n") {
-            if (i == argc - 1) continue;
-            server_name = std::string(argv[++i]);
+            if (i == args.size() - 1) continue;
+            options->server_name = args[++i];
         } else if (arg == "-b") {
             // For backwards-compatibility, make just -b disable the background
-            if (i == argc - 1 || argv[i + 1][0] == '-') {
-                video_config.background_mode = BACKGROUND_MODE_OFF;
+            if (i == args.size() - 1 || args[i + 1][0] == '-') {
+                options->video.background_mode = BACKGROUND_MODE_OFF;
                 continue;
             }
 
-            std::string background_mode(argv[++i]);
-            video_config.background_mode = background_mode == "off" ? BACKGROUND_MODE_OFF :
+            std::string background_mode(args[++i]);
+            options->video.background_mode = background_mode == "off" ? BACKGROUND_MODE_OFF :
                                            background_mode == "auto" ? BACKGROUND_MODE_AUTO :
                                            BACKGROUND_MODE_ON;
         } else if (arg == "-a") {
-            if (i == argc - 1) continue;
-            std::string audio_device_name(argv[++i]);
-            audio_config.device = audio_device_name == "hdmi" ? AUDIO_DEVICE_HDMI :
+            if (i == args.size() - 1) continue;
+            std::string audio_device_name(args[++i]);
+            options->audio.device = audio_device_name == "hdmi" ? AUDIO_DEVICE_HDMI :
                                   audio_device_name == "analog" ? AUDIO_DEVICE_ANALOG :
                                   AUDIO_DEVICE_NONE;
         } else if (arg == "-l") {
-            video_config.low_latency = !video_config.low_latency;
-            audio_config.low_latency = !audio_config.low_latency;
+            options->video.low_latency = !options->video.low_latency;
+            options->audio.low_latency = !options->audio.low_latency;
+        } else if (arg == "-lp") {
+            if (i == args.size() - 1) continue;
+            std::string const &name = args[++i];
+            size_t count = sizeof(latency_profiles) / sizeof(latency_profiles[0]);
+            size_t profile;
+            for (profile = 0; profile < count && name != latency_profiles[profile].name; profile++);
+            if (profile == count) {
+                fprintf(stderr, "Error: Unknown latency profile %s.\n", name.c_str());
+                return false;
+            }
+            apply_latency_profile(&latency_profiles[profile], options);
+        } else if (arg == "-lt") {
+            if (i == args.size() - 1) continue;
+            options->video.latency_target = options->audio.latency_target = atoi(args[++i].c_str());
+            if (options->video.latency_target <= 0) {
+                fprintf(stderr, "Error: The latency target must be a positive number of milliseconds.\n");
+                return false;
+            }
+        } else if (arg == "-jb") {
+            if (i == args.size() - 1) continue;
+            options->server.audio_buffer_length = atoi(args[++i].c_str());
+            if (options->server.audio_buffer_length <= 0) {
+                fprintf(stderr, "Error: The audio jitter buffer depth must be a positive number of packets.\n");
+                return false;
+            }
+        } else if (arg == "-vq") {
+            if (i == args.size() - 1) continue;
+            options->server.video_queue_depth = atoi(args[++i].c_str());
+            if (options->server.video_queue_depth <= 0) {
+                fprintf(stderr, "Error: The video queue depth must be a positive number of frames.\n");
+                return false;
+            }
+        } else if (arg == "-vd") {
+            if (i == args.size() - 1) continue;
+            options->server.video_latency_budget = atoi(args[++i].c_str());
+            if (options->server.video_latency_budget < 0) {
+                fprintf(stderr, "Error: The video latency budget must not be negative.\n");
+                return false;
+            }
+        } else if (arg == "-vp") {
+            if (i == args.size() - 1) continue;
+            options->server.video_playout_delay = atoi(args[++i].c_str());
+            if (options->server.video_playout_delay < 0) {
+                fprintf(stderr, "Error: The video playout delay must not be negative.\n");
+                return false;
+            }
+        } else if (arg == "-genlock") {
+            if (i == args.size() - 1) continue;
+            std::string const &spec = args[++i];
+            size_t colon = spec.find(':');
+            std::string role = spec.substr(0, colon);
+            std::string group = colon == std::string::npos ? "wall" : spec.substr(colon + 1);
+            if ((role != "leader" && role != "follower") || group.empty() || group.size() > GENLOCK_MAX_NAME) {
+                fprintf(stderr, "Error: -genlock takes leader or follower, then optionally : and a wall name of 1 to %d characters.\n",
+                        GENLOCK_MAX_NAME);
+                return false;
+            }
+            options->server.genlock_role = role == "leader" ? GENLOCK_LEADER : GENLOCK_FOLLOWER;
+            options->server.genlock_group = group;
+        } else if (arg == "-nal") {
+            options->server.slice_pipelining = true;
+        } else if (arg == "-rb") {
+            if (i == args.size() - 1) continue;
+            options->server.mirror_receive_buffer = atoi(args[++i].c_str());
+            if (options->server.mirror_receive_buffer <= 0) {
+                fprintf(stderr, "Error: The mirror receive buffer must be a positive number of KB.\n");
+                return false;
+            }
+        } else if (arg == "-bp") {
+            if (i == args.size() - 1) continue;
+            options->server.mirror_busy_poll = atoi(args[++i].c_str());
+            if (options->server.mirror_busy_poll <= 0) {
+                fprintf(stderr, "Error: The busy poll time must be a positive number of microseconds.\n");
+                return false;
+            }
+        } else if (arg == "-m") {
+            if (i == args.size() - 1) continue;
+            options->server.max_sessions = atoi(args[++i].c_str());
+            if (options->server.max_sessions < 1 || options->server.max_sessions > MAX_SESSIONS) {
+                fprintf(stderr, "Error: The number of simultaneous mirrors must be between 1 and %d.\n", MAX_SESSIONS);
+                return false;
+            }
+        } else if (arg == "-dc") {
+            if (i == args.size() - 1) continue;
+            int width = 0, height = 0, fps = 0;
+            if (sscanf(args[++i].c_str(), "%dx%d@%d", &width, &height, &fps) != 3 || width <= 0 || height <= 0 || fps <= 0) {
+                fprintf(stderr, "Error: Invalid decoder capacity %s, expected WxH@fps.\n", args[i].c_str());
+                return false;
+            }
+            options->server.decode_capacity = (uint64_t) width * height * fps;
+        } else if (arg == "-preempt") {
+            options->server.preempt = true;
+        } else if (arg == "-i") {
+            if (i == args.size() - 1) continue;
+            options->server.receivers = atoi(args[++i].c_str());
+            if (options->server.receivers < 1 || options->server.receivers > MAX_RECEIVERS) {
+                fprintf(stderr, "Error: The number of receivers must be between 1 and %d.\n", MAX_RECEIVERS);
+                return false;
+            }
+        } else if (arg == "-mp") {
+            if (i == args.size() - 1) continue;
+            options->server.metrics_port = atoi(args[++i].c_str());
+            if (options->server.metrics_port <= 0 || options->server.metrics_port > 65535) {
+                fprintf(stderr, "Error: The metrics port must be between 1 and 65535.\n");
+                return false;
+            }
+        } else if (arg == "-key") {
+            if (i == args.size() - 1) continue;
+            options->server.key_file = args[++i];
+        } else if (arg == "-trace") {
+            if (i == args.size() - 1) continue;
+            options->server.trace_file = args[++i];
+        } else if (arg == "-ts") {
+            if (i == args.size() - 1) continue;
+            options->server.trace_size = atoi(args[++i].c_str());
+            if (options->server.trace_size <= 0) {
+                fprintf(stderr, "Error: The trace size must be positive.\n");
+                return false;
+            }
+        } else if (arg == "-rec") {
+            if (i == args.size() - 1) continue;
+            options->server.recording_dir = args[++i];
+        } else if (arg == "-fr") {
+            if (i == args.size() - 1) continue;
+            options->server.flight_dir = args[++i];
+        } else if (arg == "-rtp") {
+            if (i == args.size() - 1) continue;
+            options->server.restream_addresses.push_back(args[++i]);
+        } else if (arg == "-rtpt") {
+            if (i == args.size() - 1) continue;
+            video_transcoder_config_t *transcode = &options->server.restream_transcode;
+            if (sscanf(args[++i].c_str(), "%dx%d@%d", &transcode->width, &transcode->height, &transcode->bitrate) != 3 ||
+                transcode->width <= 0 || transcode->height <= 0 || transcode->bitrate <= 0 ||
+                transcode->width % 2 || transcode->height % 2) {
+                fprintf(stderr, "Error: Invalid transcode %s, expected WxH@kbps with an even width and height.\n",
+                        args[i].c_str());
+                return false;
+            }
+            transcode->keyframe_interval = DEFAULT_TRANSCODE_KEYFRAME_INTERVAL;
+        } else if (arg == "-shm") {
+            if (i == args.size() - 1) continue;
+            options->server.shm_name = args[++i];
+            if (options->server.shm_name.size() < 2 || options->server.shm_name[0] != '/' ||
+                options->server.shm_name.find('/', 1) != std::string::npos) {
+                fprintf(stderr, "Error: The shared memory name must be a / followed by a name without further slashes.\n");
+                return false;
+            }
+        } else if (arg == "-webrtc") {
+            if (i == args.size() - 1) continue;
+            options->server.webrtc_port = atoi(args[++i].c_str());
+            if (options->server.webrtc_port <= 0 || options->server.webrtc_port > 65535) {
+                fprintf(stderr, "Error: Invalid WebRTC port %s.\n", args[i].c_str());
+                return false;
+            }
+        } else if (arg == "-ntp") {
+            if (i == args.size() - 1) continue;
+            if (sscanf(args[++i].c_str(), "%d:%d", &options->server.ntp_poll_min, &options->server.ntp_poll_max) != 2 ||
+                options->server.ntp_poll_min <= 0 || options->server.ntp_poll_max < options->server.ntp_poll_min) {
+                fprintf(stderr, "Error: Invalid NTP polling interval %s, expected min:max in milliseconds.\n", args[i].c_str());
+                return false;
+            }
+        } else if (arg == "-rtcp") {
+            options->server.receiver_reports = true;
+        } else if (arg == "-idle") {
+            if (i == args.size() - 1) continue;
+            options->server.idle_timeout = atoi(args[++i].c_str());
+            if (options->server.idle_timeout < 0) {
+                fprintf(stderr, "Error: The idle timeout must not be negative.\n");
+                return false;
+            }
+        } else if (arg == "-ba") {
+            if (i == args.size() - 1) continue;
+            options->server.buffered_audio = atoi(args[++i].c_str());
+            if (options->server.buffered_audio < 0 || options->server.buffered_audio > 60) {
+                fprintf(stderr, "Error: The buffered audio must be between 0 and 60 seconds.\n");
+                return false;
+            }
+        } else if (arg == "-rs") {
+            if (i == args.size() - 1) continue;
+            options->video.resync_threshold = options->audio.resync_threshold = atoi(args[++i].c_str());
+            if (options->video.resync_threshold <= 0) {
+                fprintf(stderr, "Error: The resync threshold must be a positive number of milliseconds.\n");
+                return false;
+            }
+        } else if (arg == "-olt") {
+            if (i == args.size() - 1) continue;
+            int target = 0, speed = 0, inflection = 0;
+            if (sscanf(args[++i].c_str(), "%d:%d:%d", &target, &speed, &inflection) < 1 || target <= 0) {
+                fprintf(stderr, "Error: The OMX latency target must be ms[:speed:inflection] with a positive ms.\n");
+                return false;
+            }
+            options->video.omx_latency_target = options->audio.omx_latency_target = target;
+            options->video.omx_latency_speed = options->audio.omx_latency_speed = speed;
+            options->video.omx_latency_inflection = options->audio.omx_latency_inflection = inflection;
+        } else if (arg == "-fdk") {
+            options->audio.decode_aac = true;
+        } else if (arg == "-mix") {
+            options->audio.mix = true;
+        } else if (arg == "-group") {
+            if (i == args.size() - 1) continue;
+            std::string const &group = args[++i];
+            if (group.empty() || group.size() > SYNC_GROUP_MAX_NAME) {
+                fprintf(stderr, "Error: The sync group name must be 1 to %d characters.\n", SYNC_GROUP_MAX_NAME);
+                return false;
+            }
+            options->audio.sync_group = strdup(group.c_str());
+        } else if (arg == "-ab") {
+            if (i == args.size() - 1) continue;
+            options->audio.batch_ms = atoi(args[++i].c_str());
+            if (options->audio.batch_ms < 0) {
+                fprintf(stderr, "Error: The audio batch must be a number of milliseconds.\n");
+                return false;
+            }
+        } else if (arg == "-dfb") {
+            if (i == args.size() - 1) continue;
+            options->video.max_dec_frame_buffering = atoi(args[++i].c_str());
+            if (options->video.max_dec_frame_buffering <= 0 || options->video.max_dec_frame_buffering > 16) {
+                fprintf(stderr, "Error: The decoder frame buffering must be between 1 and 16 frames.\n");
+                return false;
+            }
+        } else if (arg == "-conf") {
+            // Read by main before any other option
+            i++;
+        } else if (arg == "-mlock") {
+            // Only applied at startup
+            options->server.lock_memory = true;
+        } else if (arg == "-perf") {
+            // Only applied at startup
+            options->server.perf_counters = true;
+        } else if (arg == "-thermal") {
+            if (i == args.size() - 1) continue;
+            std::string thermal(args[++i]);
+            if (thermal != "on" && thermal != "off") {
+                fprintf(stderr, "Error: -thermal takes on or off.\n");
+                return false;
+            }
+            options->server.thermal = thermal == "on";
+        } else if (arg == "-pmqos") {
+            if (i == args.size() - 1) continue;
+            if (args[++i] == "off") {
+                options->server.pm_latency = -1;
+                options->server.pm_floor = 0;
+                continue;
+            }
+            int latency, floor = 0;
+            int fields = sscanf(args[i].c_str(), "%d:%d", &latency, &floor);
+            if (fields < 1 || latency < 0 || floor < 0 || floor > 100) {
+                fprintf(stderr, "Error: Invalid CPU latency %s, expected us[:floor percent] or off.\n", args[i].c_str());
+                return false;
+            }
+            options->server.pm_latency = latency;
+            options->server.pm_floor = floor;
+        } else if (arg == "-tc") {
+            options->video.measure_latency = true;
+        } else if (arg == "-bench") {
+            if (i == args.size() - 1) continue;
+            char check[8] = "";
+            int fields = sscanf(args[++i].c_str(), "%d:%7s", &options->video.bench_interval, check);
+            if (fields < 1 || options->video.bench_interval < 0 || (fields == 2 && strcmp(check, "annexb") != 0)) {
+                fprintf(stderr, "Error: Invalid benchmark interval %s, expected seconds[:annexb].\n", args[i].c_str());
+                return false;
+            }
+            options->video.bench_check = fields == 2;
+            options->audio.bench_interval = options->video.bench_interval;
+        } else if (arg == "-cea60") {
+            options->video.switch_to_60hz = true;
+        } else if (arg == "-dd") {
+            options->video.double_decoder = true;
+        } else if (arg == "-hevc") {
+            options->video.hevc = true;
+        } else if (arg == "-play") {
+            options->server.play_urls = true;
+        } else if (arg == "-sched") {
+            if (i == args.size() - 1) continue;
+            thread_role_t role;
+            thread_config_t thread_config;
+            if (thread_config_parse(args[++i].c_str(), &role, &thread_config) < 0) {
+                fprintf(stderr, "Error: Invalid thread setting %s, expected role:policy[:priority[:cpus]].\n", args[i].c_str());
+                return false;
+            }
+            thread_set_role_config(role, &thread_config);
+        } else if (arg == "-qos") {
+            if (i == args.size() - 1) continue;
+            if (args[++i] == "off") {
+                netutils_disable_qos();
+                continue;
+            }
+            netutils_qos_role_t role;
+            netutils_qos_t qos;
+            if (netutils_qos_parse(args[i].c_str(), &role, &qos) < 0) {
+                fprintf(stderr, "Error: Invalid QoS setting %s, expected role:dscp[:priority].\n", args[i].c_str());
+                return false;
+            }
+            netutils_set_qos(role, &qos);
+        } else if (arg == "-aes") {
+            if (i == args.size() - 1) continue;
+            std::string backend_name(args[++i]);
+            crypto_aes_backend_t backend = backend_name == "openssl" ? CRYPTO_AES_OPENSSL :
+                                           backend_name == "afalg" ? CRYPTO_AES_AFALG :
+                                           CRYPTO_AES_AUTO;
+            if (crypto_set_aes_backend(backend) < 0) {
+                fprintf(stderr, "Error: The AES backend %s is not available.\n", backend_name.c_str());
+                return false;
+            }
+        } else if (arg == "-vb") {
+            if (i == args.size() - 1) continue;
+            options->video.input_buffer_count = atoi(args[++i].c_str());
+            if (options->video.input_buffer_count <= 0) {
+                fprintf(stderr, "Error: The number of decoder input buffers must be positive.\n");
+                return false;
+            }
+        } else if (arg == "-vbs") {
+            if (i == args.size() - 1) continue;
+            options->video.input_buffer_size = atoi(args[++i].c_str());
+            if (options->video.input_buffer_size <= 0) {
+                fprintf(stderr, "Error: The decoder input buffer size must be a positive number of bytes.\n");
+                return false;
+            }
+        } else if (arg == "-vs") {
+            if (i == args.size() - 1) continue;
+            options->video.video_sink = strdup(args[++i].c_str());
+        } else if (arg == "-vdec") {
+            if (i == args.size() - 1) continue;
+            options->video.video_decoders = strdup(args[++i].c_str());
         } else if (arg == "-r") {
-            video_config.rotation = atoi(argv[++i]);
+            if (i == args.size() - 1) continue;
+            options->video.rotation = atoi(args[++i].c_str());
+        } else if (arg == "-res") {
+            if (i == args.size() - 1) continue;
+            std::string resolution(args[++i]);
+            if (resolution == "auto") {
+                options->server.display_auto = true;
+                continue;
+            }
+            int fields = sscanf(resolution.c_str(), "%dx%d@%d", &options->server.display_width,
+                                &options->server.display_height, &options->server.display_refresh_rate);
+            if (fields < 2 || options->server.display_width <= 0 || options->server.display_height <= 0 ||
+                (fields == 3 && options->server.display_refresh_rate <= 0)) {
+                fprintf(stderr, "Error: Invalid resolution %s, expected WxH, WxH@fps or auto.\n", args[i].c_str());
+                return false;
+            }
+        } else if (arg == "-lazy") {
+            options->server.lazy_video = true;
         } else if (arg == "-f") {
-            if (i == argc - 1) continue;
-            std::string flip_type(argv[++i]);
-            video_config.flip = flip_type == "horiz" ? FLIP_HORIZONTAL :
+            if (i == args.size() - 1) continue;
+            std::string flip_type(args[++i]);
+            options->video.flip = flip_type == "horiz" ? FLIP_HORIZONTAL :
                                 flip_type == "vert" ? FLIP_VERTICAL :
                                 flip_type == "both" ? FLIP_BOTH :
                                 FLIP_NONE;
         } else if (arg == "-d") {
-            debug_log = !debug_log;
+            options->debug_log = !options->debug_log;
         } else if (arg == "-vr") {
-            if (i == argc - 1) {
+            if (i == args.size() - 1) {
                 fprintf(stderr, "Error: You must supply the name of a video renderer after the -vr argument.\n");
-                exit(1);
+                return false;
             }
-            video_init_func = find_video_init_func(argv[++i]);
+            video_init_func = find_video_init_func(args[++i].c_str());
             if (!video_init_func) {
-                fprintf(stderr, "Error: Unable to locate video renderer \"%s\".\n", argv[i]);
-                exit(1);
+                fprintf(stderr, "Error: Unable to locate video renderer \"%s\".\n", args[i].c_str());
+                return false;
             }
         } else if (arg == "-ar") {
-            if (i == argc - 1) {
+            if (i == args.size() - 1) {
                 fprintf(stderr, "Error: You must supply the name of an audio renderer after the -ar argument.\n");
-                exit(1);
+                return false;
             }
-            audio_init_func = find_audio_init_func(argv[++i]);
+            audio_init_func = find_audio_init_func(args[++i].c_str());
             if (!audio_init_func) {
-                fprintf(stderr, "Error: Unable to locate audio renderer \"%s\".\n", argv[i]);
-                exit(1);
+                fprintf(stderr, "Error: Unable to locate audio renderer \"%s\".\n", args[i].c_str());
+                return false;
             }
         } else if (arg == "-h" || arg == "-v") {
-            print_info(argv[0]);
+            print_info(program_name.c_str());
             exit(0);
         }
     }
 
+    // A video wall flips frames when they are released to the decoder, not on a renderer clock of each node
+    if (!options->server.genlock_group.empty()) {
+        options->video.low_latency = true;
+        if (!options->server.video_playout_delay) options->server.video_playout_delay = DEFAULT_GENLOCK_PLAYOUT_DELAY;
+    }
+    return true;
+}
+
+// The config file first, so the command line overrides it
+static bool read_options(options_t *options, bool reloading) {
+    std::vector<std::string> args;
+    if (!config_file.empty() && !load_config_file(config_file, args)) {
+        fprintf(stderr, "Error: Could not read the config file %s.\n", config_file.c_str());
+        return false;
+    }
+    args.insert(args.end(), command_line.begin(), command_line.end());
+    init_options(options);
+    return parse_options(args, options, reloading);
+}
+
+// The settings of a receiver that a reload can change
+static void configure_raop(raop_t *raop, server_config_t const *server_config, bool debug_log) {
+    raop_set_log_level(raop, debug_log ? RAOP_LOG_DEBUG : LOGGER_INFO);
+    raop_set_audio_buffer_length(raop, server_config->audio_buffer_length);
+    raop_set_video_queue_depth(raop, server_config->video_queue_depth);
+    raop_set_video_latency_budget(raop, server_config->video_latency_budget);
+    raop_set_video_playout_delay(raop, server_config->video_playout_delay);
+    raop_set_mirror_socket_options(raop, server_config->mirror_receive_buffer, server_config->mirror_busy_poll);
+    raop_set_ntp_poll_interval(raop, server_config->ntp_poll_min, server_config->ntp_poll_max);
+    raop_set_receiver_reports(raop, server_config->receiver_reports);
+    raop_set_idle_timeout(raop, server_config->idle_timeout);
+}
+
+/* Applies what changed in the config file since startup, for the sessions that start from now on */
+static void reload_options(options_t *options) {
+    options_t reloaded;
+    if (!read_options(&reloaded, true)) {
+        LOGE("Keeping the running configuration, %s is invalid", config_file.empty() ? "the command line" : config_file.c_str());
+        return;
+    }
+    server_config_t *server_config = &reloaded.server;
+    for (int i = 0; i < receivers; i++) configure_raop(raops[i], server_config, reloaded.debug_log);
+    logger_set_level(render_logger, reloaded.debug_log ? LOGGER_DEBUG : LOGGER_INFO);
+    options->debug_log = reloaded.debug_log;
+    options->server.audio_buffer_length = server_config->audio_buffer_length;
+    options->server.video_queue_depth = server_config->video_queue_depth;
+    options->server.video_latency_budget = server_config->video_latency_budget;
+    options->server.video_playout_delay = server_config->video_playout_delay;
+    options->server.mirror_receive_buffer = server_config->mirror_receive_buffer;
+    options->server.mirror_busy_poll = server_config->mirror_busy_poll;
+    options->server.ntp_poll_min = server_config->ntp_poll_min;
+    options->server.ntp_poll_max = server_config->ntp_poll_max;
+    options->server.receiver_reports = server_config->receiver_reports;
+    options->server.idle_timeout = server_config->idle_timeout;
+    LOGI("Reloaded the configuration, -d -jb -vq -vd -vp -rb -bp -ntp and -rtcp apply to new sessions, -idle to all, the rest on restart");
+}
+
+int main(int argc, char *argv[]) {
+    init_signals();
+    activated_fds = sd_daemon_listen_fds();
+
+    program_name = argv[0];
+    command_line.assign(argv + 1, argv + argc);
+    for (size_t i = 0; i + 1 < command_line.size(); i++) {
+        if (command_line[i] == "-conf") config_file = command_line[i + 1];
+    }
+
+    // Default to the best available renderer
+    video_init_func = video_renderers[0].init_func;
+    audio_init_func = audio_renderers[0].init_func;
+
+    std::vector<char> server_hw_addr = DEFAULT_HW_ADDRESS;
+    // Renderers keep pointers to the configs, so these live as long as the server
+    static options_t options;
+    if (!read_options(&options, false)) {
+        exit(1);
+    }
+
+    // Before any thread is created, so their stacks are locked at the reduced size
+    if (options.server.lock_memory) {
+        if (memlock_all() < 0) {
+            LOGE("Could not lock memory: %s. Raise RLIMIT_MEMLOCK or grant CAP_IPC_LOCK.", strerror(errno));
+        } else {
+            LOGI("Locked all memory, thread stacks are limited to %d kB", MEMLOCK_STACK_SIZE / 1024);
+        }
+    }
+
     std::string mac_address = find_mac();
     if (!mac_address.empty()) {
         server_hw_addr.clear();
         parse_hw_addr(mac_address, server_hw_addr);
     }
 
-    if (start_server(server_hw_addr, server_name, debug_log, &video_config, &audio_config) != 0) {
+    if (start_server(server_hw_addr, options.server_name, options.debug_log, &options.server, &options.video, &options.audio) != 0) {
         return 1;
     }
 
     running = true;
     while (running) {
         sleep(1);
+        if (reload_requested) {
+            reload_requested = 0;
+            reload_options(&options);
+        }
+        flight_recorder_dump_pending(options.server.flight_dir.c_str(), render_logger);
     }
 
     LOGI("Stopping...");
+    sd_daemon_notify("STOPPING=1");
     stop_server();
 }
 
 // Server callbacks
-extern "C" void conn_init(void *cls) {
-    if (video_renderer) video_renderer->funcs->update_background(video_renderer, 1);
+
+// Renderer of the connection's stream, claims a free tile when it starts streaming
+static video_renderer_t *session_video_renderer(session_t *session) {
+    if (max_sessions == 1) return video_renderer;
+    std::lock_guard<std::mutex> lock(tile_mutex);
+    if (session->tile < 0) {
+        for (int i = 0; i < max_sessions; i++) {
+            if (!tile_owners[i]) {
+                tile_owners[i] = session;
+                session->tile = i;
+                LOGI("Mirror %p is shown in tile %d", session, i);
+                break;
+            }
+        }
+        if (session->tile < 0) return NULL;
+    }
+    return tile_renderers[session->tile];
+}
+
+// Audio only plays along with the first tile, whose renderer the audio shares its clock with
+static bool session_has_audio(session_t *session) {
+    return max_sessions == 1 || (session_video_renderer(session) && session->tile == 0);
 }
 
+// The renderer the connection's audio goes to, with -mix a stream of its own opened on first use
+static audio_renderer_t *session_audio_renderer(session_t *session) {
+    if (!audio_renderer) return NULL;
+    if (!mix_audio) return session_has_audio(session) ? audio_renderer : NULL;
+    if (!session->audio_opened) {
+        session->audio_opened = true;
+        session->audio = audio_renderer->funcs->open_stream(audio_renderer);
+        if (!session->audio) LOGE("Could not open an audio stream for %p, its audio is not played", session);
+    }
+    return session->audio;
+}
+
+/*
+ * Logs how long each step from the RTSP SETUP to the first displayed picture took. Steps the
+ * renderer cannot report are left out.
+ */
+static void log_session_timeline(session_t *session, video_renderer_t *renderer) {
+    static const char *names[RAOP_MILESTONE_COUNT] = {
+        "setup", "fairplay", "mirror accept", "parameter sets", "first frame"
+    };
+    uint64_t setup = session->milestones[RAOP_MILESTONE_SETUP];
+    if (session->timeline_logged || !setup) return;
+    session->timeline_logged = true;
+
+    std::string summary;
+    char step[64];
+    for (int i = 1; i < RAOP_MILESTONE_COUNT; i++) {
+        uint64_t time = session->milestones[i];
+        if (!time) continue;
+        snprintf(step, sizeof(step), ", %s +%lld ms", names[i], ((long long) time - (long long) setup) / 1000);
+        summary += step;
+    }
+    if (renderer && renderer->decoder_ready_time) {
+        snprintf(step, sizeof(step), ", decoder ready +%lld ms",
+                 ((long long) renderer->decoder_ready_time - (long long) setup) / 1000);
+        summary += step;
+    }
+    if (renderer && renderer->first_render_time) {
+        snprintf(step, sizeof(step), ", first picture shown +%lld ms",
+                 ((long long) renderer->first_render_time - (long long) setup) / 1000);
+        summary += step;
+    }
+    LOGI("Session timeline: setup%s", summary.c_str());
+}
+
+extern "C" void *conn_init(void *cls) {
+    // A lazily started renderer only counts mirrors, it is gone while there are none
+    if (!lazy_video && video_renderer) video_renderer->funcs->update_background(video_renderer, 1);
+    session_t *session = new session_t;
+    session->tile = -1;
+    for (int i = 0; i < RAOP_MILESTONE_COUNT; i++) session->milestones[i] = 0;
+    session->timeline_logged = false;
+    session->recorder = NULL;
+    session->audio = NULL;
+    audio_format_init_default(&session->audio_format);
+    session->audio_opened = false;
+    session->displayed = false;
+    session->gop = NULL;
+    pm_qos_session_start(pm_qos);
+    return session;
+}
+
+extern "C" void session_milestone(void *cls, raop_milestone_t milestone, uint64_t time) {
+    session_t *session = (session_t *) cls;
+    session->milestones[milestone] = time;
+}
+
+extern "C" void photo_hide(void *cls);
+
 extern "C" void conn_destroy(void *cls) {
-    if (video_renderer) video_renderer->funcs->update_background(video_renderer, -1);
+    session_t *session = (session_t *) cls;
+    if (!lazy_video && video_renderer) video_renderer->funcs->update_background(video_renderer, -1);
+    pm_qos_session_end(pm_qos);
+    // Renderers that never report the first picture get their timeline logged here
+    log_session_timeline(session, NULL);
+    if (session->tile >= 0) {
+        std::lock_guard<std::mutex> lock(tile_mutex);
+        tile_owners[session->tile] = NULL;
+    }
+    recorder_destroy(session->recorder);
+    if (session->audio) session->audio->funcs->destroy(session->audio);
+    session_t *owner = session;
+    restream_owner.compare_exchange_strong(owner, NULL);
+    owner = session;
+    shm_owner.compare_exchange_strong(owner, NULL);
+    owner = session;
+    webrtc_owner.compare_exchange_strong(owner, NULL);
+    owner = session;
+    display_owner.compare_exchange_strong(owner, NULL);
+    owner = session;
+    if (cast_owner.compare_exchange_strong(owner, NULL)) url_player->funcs->stop(url_player);
+    photo_hide(session);
+    gop_cache_destroy(session->gop);
+    delete session;
+}
+
+// Each mirror gets a file of its own, named after when it started
+static void session_start_recording(session_t *session) {
+    char name[64];
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(name, sizeof(name), "rpiplay-%Y%m%d-%H%M%S", &local);
+    std::string path = recording_dir + "/" + name + "-" + std::to_string(++recording_count) + ".mp4";
+    session->recorder = recorder_init(render_logger, path.c_str());
+}
+
+extern "C" int video_start(void *cls) {
+    std::lock_guard<std::mutex> lock(video_mutex);
+    if (video_users == 0) {
+        LOGI("Starting the video renderer for a mirror");
+        if (!video_renderer) {
+            if ((video_renderer = video_init_func(render_logger, lazy_video_config)) == NULL) {
+                LOGE("Could not init video renderer");
+                return -1;
+            }
+            video_renderer->funcs->update_background(video_renderer, 1);
+        }
+        video_renderer->funcs->start(video_renderer);
+    }
+    video_users++;
+    return 0;
+}
+
+// Called once the mirror's threads are gone, so nothing renders into video_renderer anymore
+extern "C" void video_stop(void *cls) {
+    std::lock_guard<std::mutex> lock(video_mutex);
+    if (--video_users == 0) {
+        LOGI("No mirror left, stopping the video renderer");
+        if (video_renderer->funcs->stop) {
+            video_renderer->funcs->stop(video_renderer);
+        } else {
+            video_renderer->funcs->destroy(video_renderer);
+            video_renderer = NULL;
+        }
+    }
+}
+
+// Holds video_mutex so -lazy cannot destroy the renderer meanwhile, frames do not take it
+extern "C" int snapshot(void *cls, unsigned char **jpeg) {
+    std::lock_guard<std::mutex> lock(video_mutex);
+    if (!video_renderer || !video_renderer->funcs->snapshot || (lazy_video && video_users == 0)) {
+        return -1;
+    }
+    return video_renderer->funcs->snapshot(video_renderer, SNAPSHOT_WIDTH, SNAPSHOT_HEIGHT, SNAPSHOT_TIMEOUT, jpeg);
+}
+
+extern "C" int playback_start(void *cls, const char *url, double start_seconds, double start_fraction) {
+    if (!url_player) return -1;
+    cast_owner = (session_t *) cls;
+    return url_player->funcs->play(url_player, url, start_seconds, start_fraction) ? 0 : -1;
+}
+
+extern "C" void playback_scrub(void *cls, double position) {
+    if (url_player) url_player->funcs->seek(url_player, position);
+}
+
+extern "C" void playback_rate(void *cls, double rate) {
+    if (url_player) url_player->funcs->set_rate(url_player, rate);
+}
+
+extern "C" void playback_stop(void *cls) {
+    session_t *owner = (session_t *) cls;
+    if (url_player && cast_owner.compare_exchange_strong(owner, NULL)) url_player->funcs->stop(url_player);
+}
+
+extern "C" int playback_info(void *cls, raop_playback_info_t *info) {
+    url_player_state_t state;
+    if (!url_player || !url_player->funcs->get_state(url_player, &state)) return -1;
+    info->duration = state.duration;
+    info->position = state.position;
+    info->rate = state.rate;
+    info->ready_to_play = state.ready;
+    return 0;
+}
+
+// Every renderer's video_transition_t in the order of raop_photo_transition_t
+static video_transition_t photo_transition(raop_photo_transition_t transition) {
+    switch (transition) {
+    case RAOP_PHOTO_TRANSITION_DISSOLVE: return VIDEO_TRANSITION_DISSOLVE;
+    case RAOP_PHOTO_TRANSITION_SLIDE_LEFT: return VIDEO_TRANSITION_SLIDE_LEFT;
+    case RAOP_PHOTO_TRANSITION_SLIDE_RIGHT: return VIDEO_TRANSITION_SLIDE_RIGHT;
+    default: return VIDEO_TRANSITION_NONE;
+    }
+}
+
+extern "C" int photo_show(void *cls, const unsigned char *jpeg, int size, raop_photo_transition_t transition) {
+    std::lock_guard<std::mutex> lock(photo_mutex);
+    // -lazy brings the renderer up for photos like for a mirror
+    if (lazy_video && !photo_holds_video) {
+        if (video_start(NULL) < 0) return -1;
+        photo_holds_video = true;
+    }
+    std::lock_guard<std::mutex> video_lock(video_mutex);
+    if (!video_renderer || !video_renderer->funcs->show_photo) {
+        LOGE("The video renderer cannot show photos");
+        return -1;
+    }
+    photo_owner = (session_t *) cls;
+    return video_renderer->funcs->show_photo(video_renderer, jpeg, size, photo_transition(transition)) ? 0 : -1;
+}
+
+// Only the sender of the photo on display takes it down
+extern "C" void photo_hide(void *cls) {
+    std::lock_guard<std::mutex> lock(photo_mutex);
+    if (!photo_owner || photo_owner != (session_t *) cls) return;
+    photo_owner = NULL;
+    {
+        std::lock_guard<std::mutex> video_lock(video_mutex);
+        if (video_renderer && video_renderer->funcs->hide_photo) video_renderer->funcs->hide_photo(video_renderer);
+    }
+    if (photo_holds_video) {
+        photo_holds_video = false;
+        video_stop(NULL);
+    }
+}
+
+// Tells senders how far behind its pts the audio renderer plays, whenever it measured something new
+static void advertise_audio_latency() {
+    int latency = ATOMIC_LOAD(audio_renderer->output_latency);
+    if (advertised_audio_latency.exchange(latency) == latency) return;
+    for (int i = 0; i < receivers; i++) raop_set_audio_output_latency(raops[i], latency);
 }
 
 extern "C" void audio_process(void *cls, raop_ntp_t *ntp, aac_decode_struct *data) {
-    if (audio_renderer != NULL) {
-        audio_renderer->funcs->render_buffer(audio_renderer, ntp, data->data, data->data_len, data->pts);
+    // Recordings hold the AAC-ELD of screen mirroring
+    audio_format_t mirror_format;
+    audio_format_init_default(&mirror_format);
+    recorder_t *recorder = ((session_t *) cls)->recorder;
+    if (recorder && audio_format_equal(data->format, &mirror_format)) recorder_audio(recorder, data);
+    session_t *session = (session_t *) cls;
+    audio_renderer_t *renderer = session_audio_renderer(session);
+    if (renderer) {
+        audio_format_t *format = mix_audio ? &session->audio_format : &audio_renderer_format;
+        if (renderer->funcs->set_format && !audio_format_equal(data->format, format)) {
+            LOGI("Playing %s audio at %d Hz", audio_format_get_codec_name(data->format->codec), data->format->sample_rate);
+            renderer->funcs->set_format(renderer, data->format);
+            *format = *data->format;
+        }
+        renderer->funcs->render_buffer(renderer, ntp, data->data, data->data_len, data->pts);
+        advertise_audio_latency();
     }
 }
 
-extern "C" void video_process(void *cls, raop_ntp_t *ntp, h264_decode_struct *data) {
-    if (video_renderer != NULL) {
-        video_renderer->funcs->render_buffer(video_renderer, ntp, data->data, data->data_len, data->pts, data->frame_type);
+// Whether another presenter's mirror is on the one renderer, the session's frames then wait for the handover
+static bool session_behind_presenter(session_t *session) {
+    session_t *owner = display_owner;
+    return max_sessions == 1 && owner && owner != session;
+}
+
+extern "C" int conn_superseded(void *cls) {
+    session_t *session = (session_t *) cls;
+    return max_sessions == 1 && session->displayed && display_owner != session;
+}
+
+extern "C" unsigned char *video_acquire_buffer(void *cls, int size, void **handle) {
+    // Decoder input buffers are for the presenter, a waiting mirror's frames come by copy
+    if (session_behind_presenter((session_t *) cls)) return NULL;
+    video_renderer_t *renderer = session_video_renderer((session_t *) cls);
+    if (renderer && renderer->funcs->acquire_buffer) {
+        return renderer->funcs->acquire_buffer(renderer, size, handle);
     }
+    return NULL;
+}
+
+extern "C" void video_release_buffer(void *cls, void *handle) {
+    video_renderer_t *renderer = session_video_renderer((session_t *) cls);
+    renderer->funcs->release_buffer(renderer, handle);
+}
+
+extern "C" int audio_underruns(void *cls) {
+    audio_renderer_t *renderer = session_audio_renderer((session_t *) cls);
+    return renderer ? ATOMIC_LOAD(renderer->underruns) : 0;
+}
+
+extern "C" int video_backpressure(void *cls) {
+    video_renderer_t *renderer = session_video_renderer((session_t *) cls);
+    return renderer && renderer->funcs->is_congested && renderer->funcs->is_congested(renderer);
+}
+
+extern "C" uint64_t video_next_vsync(void *cls, uint64_t time) {
+    video_renderer_t *renderer = session_video_renderer((session_t *) cls);
+    return renderer && renderer->funcs->next_vsync ? renderer->funcs->next_vsync(renderer, time) : time;
+}
+
+#if defined(HAS_GSTREAMER_RENDERER)
+static void restream_transcoded(void *cls, const h264_decode_struct *frame) {
+    if (restream_restart.exchange(false)) restream_reset(restreamer);
+    restream_video(restreamer, frame);
+}
+#endif
+
+// One frame of the mirror on its way through video_pipeline, frame holds data if it came by reference
+struct video_input {
+    session_t *session;
+    raop_ntp_t *ntp;
+    const h264_decode_struct *data;
+    video_frame_ptr frame;
+};
+
+// Recordings, restreams, the shared memory ring and WebRTC carry H.264 only
+static bool video_input_is_h264(const video_input &input) {
+    return input.data->codec == VIDEO_CODEC_H264;
+}
+
+// Recorded before rendering, which may hand an acquired buffer back to the decoder
+static auto record_stage = [](video_input &input) -> bool {
+    const h264_decode_struct *data = input.data;
+    if (!video_input_is_h264(input) && data->frame_type == 0 && (!recording_dir.empty() || restreamer || shm_ring || webrtc)) {
+        LOGW("The mirror streams H.265, which is not recorded, restreamed, shared or served over WebRTC");
+    }
+    if (video_input_is_h264(input) && !recording_dir.empty()) {
+        if (!input.session->recorder && data->frame_type == 0) session_start_recording(input.session);
+        if (input.session->recorder) recorder_video(input.session->recorder, data);
+    }
+    return true;
+};
+
+// The transcoder keeps a reference to a frame that came by reference instead of a copy
+static auto restream_stage = [](video_input &input) -> bool {
+    const h264_decode_struct *data = input.data;
+    if (!video_input_is_h264(input) || !restreamer) return true;
+    session_t *owner = NULL;
+    if (data->frame_type == 0 && restream_owner.compare_exchange_strong(owner, input.session)) {
+        if (restream_transcoder) {
+            restream_transcoder->funcs->flush(restream_transcoder);
+            restream_restart = true;
+        } else {
+            restream_reset(restreamer);
+        }
+    }
+    if (restream_owner == input.session) {
+        if (restream_transcoder && input.frame) {
+            restream_transcoder->funcs->push_frame(restream_transcoder, input.frame.share().release());
+        } else if (restream_transcoder) {
+            restream_transcoder->funcs->push(restream_transcoder, data);
+        } else {
+            restream_video(restreamer, data);
+        }
+    }
+    return true;
+};
+
+static auto publish_stage = [](video_input &input) -> bool {
+    if (!video_input_is_h264(input) || !shm_ring) return true;
+    session_t *owner = NULL;
+    if (input.data->frame_type == 0) shm_owner.compare_exchange_strong(owner, input.session);
+    if (shm_owner == input.session) shm_ring_video(shm_ring, input.data);
+    return true;
+};
+
+// Viewers that joined for the previous mirror are caught up again with the next one's first IDR
+static auto webrtc_stage = [](video_input &input) -> bool {
+    if (!video_input_is_h264(input) || !webrtc) return true;
+    session_t *owner = NULL;
+    if (input.data->frame_type == 0 && webrtc_owner.compare_exchange_strong(owner, input.session)) {
+        webrtc_reset(webrtc);
+    }
+    if (webrtc_owner == input.session) webrtc_video(webrtc, input.data);
+    return true;
+};
+
+// Keeps what a decoder starting in the middle of the mirror needs, see render_gop
+static auto gop_stage = [](video_input &input) -> bool {
+    session_t *session = input.session;
+    if (!session->gop) session->gop = gop_cache_init(SESSION_GOP_MAX_FRAMES, SESSION_GOP_MAX_BYTES);
+    if (session->gop) gop_cache_add(session->gop, input.data);
+    return true;
+};
+
+static void render_copied(video_renderer_t *renderer, raop_ntp_t *ntp, const h264_decode_struct *data) {
+    if (data->frame_type == 0 && renderer->funcs->set_codec && !renderer->funcs->set_codec(renderer, data->codec)) {
+        LOGE("The video renderer could not switch to %s", data->codec == VIDEO_CODEC_H264 ? "H.264" : "H.265");
+    }
+    if (data->frame_type == 0 && renderer->funcs->reconfigure) {
+        renderer->funcs->reconfigure(renderer, data->width, data->height, data->known_geometry);
+    }
+    renderer->funcs->render_buffer(renderer, ntp, data->data, data->data_len, data->pts, data->frame_type,
+                                   &data->nal_index);
+}
+
+/*
+ * Catches a decoder that starts in the middle of the mirror up to frame, the latest one the
+ * gop stage kept, with the parameter sets if asked for and the frames from the last IDR up to
+ * frame. They get timestamps a micro second apart that end just before frame's, so the decoder
+ * goes through them at once and the renderer shows frame as if it had never been away.
+ * Returns how many frames went ahead of frame, -1 if nothing was kept since the last IDR and
+ * the decoder has to wait for the next.
+ */
+static int render_gop(session_t *session, video_renderer_t *renderer, raop_ntp_t *ntp,
+                      const h264_decode_struct *frame, bool parameter_sets) {
+    int count = session->gop ? gop_cache_get_count(session->gop) : 0;
+    if (!count || frame->frame_type == 0) return -1;
+    const h264_decode_struct *kept = gop_cache_get_parameter_sets(session->gop);
+    if (parameter_sets && kept) render_copied(renderer, ntp, kept);
+    // The last one kept is frame itself, which the caller renders
+    for (int i = 0; i < count - 1; i++) {
+        h264_decode_struct replay = *gop_cache_get_frame(session->gop, i);
+        replay.pts = frame->pts - (count - 1 - i);
+        render_copied(renderer, ntp, &replay);
+    }
+    return count - 1;
+}
+
+/*
+ * Presenter handover on the one renderer there is without tiles: a mirror that starts while
+ * another one is shown takes the display over as soon as it has an IDR frame, the renderer goes
+ * on decoding without a teardown in between. Usually that was long enough ago that render_gop
+ * catches the decoder up at once. From then on the previous presenter's frames are dropped,
+ * and raop closes its connection in the background.
+ */
+static bool session_holds_display(video_input &input, video_renderer_t *renderer) {
+    session_t *session = input.session;
+    const h264_decode_struct *data = input.data;
+    if (max_sessions > 1) return true;
+    session_t *owner = display_owner;
+    for (;;) {
+        if (owner == session) return true;
+        // Superseded, it is on its way out
+        if (session->displayed) return false;
+        // The parameter sets wait in the gop cache
+        if (owner && data->frame_type == 0) return false;
+        if (data->frame_type != 0 && !data->is_idr && !(session->gop && gop_cache_get_count(session->gop))) return false;
+        if (display_owner.compare_exchange_strong(owner, session)) break;
+    }
+    session->displayed = true;
+    if (owner) LOGI("Mirror %p takes the display over from %p", session, owner);
+    // The frames refused so far, parameter sets included
+    if (data->frame_type != 0) render_gop(session, renderer, input.ntp, data, true);
+    return true;
+}
+
+static auto render_stage = [](video_input &&input) {
+    const h264_decode_struct *data = input.data;
+    // Rendered in parts already, the stages before only needed the whole frame
+    if (data->rendered) return;
+    bool h264 = video_input_is_h264(input);
+    video_renderer_t *renderer = session_video_renderer(input.session);
+    if (renderer && !h264 && !renderer->supports_hevc) {
+        if (data->frame_type == 0) LOGE("The video renderer cannot decode H.265, dropping the mirror's video");
+        if (data->buffer_handle) renderer->funcs->release_buffer(renderer, data->buffer_handle);
+        return;
+    }
+    if (renderer && !session_holds_display(input, renderer)) {
+        if (data->buffer_handle) renderer->funcs->release_buffer(renderer, data->buffer_handle);
+        return;
+    }
+    if (renderer && renderer->needs_gop) {
+        renderer->needs_gop = false;
+        int caught_up = render_gop(input.session, renderer, input.ntp, data, false);
+        if (caught_up > 0) LOGI("Caught the video decoder up with the %d frames since the last IDR", caught_up);
+    }
+    if (data->buffer_handle) {
+        renderer->funcs->render_acquired(renderer, input.ntp, data->buffer_handle, data->data_len, data->pts,
+                                         &data->nal_index);
+    } else if (renderer != NULL) {
+        render_copied(renderer, input.ntp, data);
+    }
+    if (renderer && renderer->first_render_time) log_session_timeline(input.session, renderer);
+};
+
+// Every frame of every session goes through these stages in turn, add one to the list to tap the video
+static auto video_pipeline = pipeline::make_source(
+    [](session_t *session, raop_ntp_t *ntp, const h264_decode_struct *data, video_frame_ptr frame) {
+        return video_input{session, ntp, data, std::move(frame)};
+    },
+    pipeline::make_transform(record_stage), pipeline::make_transform(restream_stage),
+    pipeline::make_transform(publish_stage), pipeline::make_transform(webrtc_stage),
+    pipeline::make_transform(gop_stage), pipeline::make_sink(render_stage));
+
+extern "C" void video_process(void *cls, raop_ntp_t *ntp, h264_decode_struct *data) {
+    video_pipeline((session_t *) cls, ntp, data, video_frame_ptr());
+}
+
+extern "C" void video_process_frame(void *cls, raop_ntp_t *ntp, video_frame_t *frame) {
+    video_frame_ptr ref(frame);
+    const h264_decode_struct *data = ref.get();
+    video_pipeline((session_t *) cls, ntp, data, std::move(ref));
+}
+
+extern "C" int video_process_nals(void *cls, raop_ntp_t *ntp, unsigned char *data, int data_len, uint64_t pts,
+                                  int end_of_frame) {
+    session_t *session = (session_t *) cls;
+    // Whole frames decide the handover, until the mirror holds the display
+    if (max_sessions == 1 && display_owner != session) return -1;
+    video_renderer_t *renderer = session_video_renderer(session);
+    if (!renderer || !renderer->funcs->render_nals) return -1;
+    if (!renderer->funcs->render_nals(renderer, ntp, data, data_len, pts, end_of_frame)) return -1;
+    if (end_of_frame && renderer->first_render_time) log_session_timeline(session, renderer);
+    return 0;
 }
 
 extern "C" void audio_flush(void *cls) {
-    if (audio_renderer) audio_renderer->funcs->flush(audio_renderer);
+    session_t *session = (session_t *) cls;
+    // A connection that never played has no stream of its own to flush
+    if (mix_audio && !session->audio) return;
+    audio_renderer_t *renderer = session_audio_renderer(session);
+    if (renderer) renderer->funcs->flush(renderer);
 }
 
 extern "C" void video_flush(void *cls) {
-    if (video_renderer) video_renderer->funcs->flush(video_renderer);
+    session_t *session = (session_t *) cls;
+    // A connection that never streamed has no tile of its own to flush, a superseded one no renderer
+    if (max_sessions > 1 && session->tile < 0) return;
+    if (session_behind_presenter(session)) return;
+    video_renderer_t *renderer = session_video_renderer(session);
+    if (renderer) renderer->funcs->flush(renderer);
+}
+
+extern "C" void video_pause(void *cls, int paused) {
+    video_renderer_t *renderer = session_video_renderer((session_t *) cls);
+    if (!renderer || !renderer->funcs->pause || session_behind_presenter((session_t *) cls)) return;
+    LOGD("Mirror %p %s", cls, paused ? "paused, powering the decoder down" : "resumed");
+    renderer->funcs->pause(renderer, paused);
 }
 
 extern "C" void audio_set_volume(void *cls, float volume) {
-    if (audio_renderer != NULL) {
-        audio_renderer->funcs->set_volume(audio_renderer, volume);
+    // Without -mix every sender sets the volume of the one renderer
+    audio_renderer_t *renderer = mix_audio ? session_audio_renderer((session_t *) cls) : audio_renderer;
+    if (renderer != NULL) {
+        renderer->funcs->set_volume(renderer, volume);
     }
 }
 
+// Senders only look again after a while, unless the services are announced anew
+extern "C" void network_changed(void *cls) {
+    LOGI("Announcing the AirPlay services again");
+    for (int i = 0; i < receivers; i++) dnssd_reregister(dnssds[i]);
+}
+
+extern "C" void thermal_changed(void *cls, int pressure) {
+    for (int i = 0; i < receivers; i++) raop_set_thermal_pressure(raops[i], pressure);
+}
+
 extern "C" void log_callback(void *cls, int level, const char *msg) {
     switch (level) {
         case LOGGER_DEBUG: {
@@ -338,7 +1645,160 @@ extern "C" void log_callback(void *cls, int level, const char *msg) {
 
 }
 
-int start_server(std::vector<char> hw_addr, std::string name, bool debug_log,
+// Connections a receiver bound early keeps waiting until it starts, a sender opens one or two
+#define EARLY_LISTEN_BACKLOG 16
+
+/* Binds a port for a receiver before it starts, -1 if that failed and raop_start has to */
+static int listen_early(unsigned short *port) {
+    *port = 0;
+    int fd = netutils_init_socket(port, 0, 0);
+    if (fd == -1) return -1;
+    if (listen(fd, EARLY_LISTEN_BACKLOG) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Sets up the receivers and their dnssd while the renderers come up. Every receiver gets its
+ * listening socket here, the one systemd passed or one bound right away, and is advertised on
+ * it at once: senders find it while the renderers are still loading, and connections made
+ * before they are up wait in the socket's backlog until raop_start.
+ */
+static int init_receivers(raop_callbacks_t *raop_cbs, std::vector<char> const &hw_addr, std::string const &name,
+                          bool debug_log, server_config_t const *server_config) {
+    for (receivers = 0; receivers < server_config->receivers; receivers++) {
+        raop_t *raop = raop_init(10, raop_cbs);
+        if (raop == NULL) {
+            LOGE("Error initializing raop!");
+            return -1;
+        }
+        raops[receivers] = raop;
+        raop_set_log_callback(raop, log_callback, NULL);
+        configure_raop(raop, server_config, debug_log);
+        if (!server_config->key_file.empty()) {
+            // Every receiver is a device of its own to senders, so each needs its own key
+            std::string key_file = server_config->key_file;
+            if (receivers > 0) key_file += "." + std::to_string(receivers + 1);
+            raop_set_key_file(raop, key_file.c_str());
+        }
+        if (receivers > 0) raop_set_host(raop, raops[0]);
+    }
+    raop_set_metrics_port(raops[0], server_config->metrics_port);
+    // The frames of a wall must all come from one sender, so only the first receiver is part of it
+    if (!server_config->genlock_group.empty()) {
+        genlock = genlock_init(render_logger, server_config->genlock_group.c_str(), server_config->genlock_role);
+        if (!genlock) {
+            LOGE("Could not join video wall %s", server_config->genlock_group.c_str());
+            return -1;
+        }
+        raop_set_genlock(raops[0], genlock);
+    }
+    if (!server_config->trace_file.empty()) {
+        raop_set_trace_file(raops[0], server_config->trace_file.c_str(), server_config->trace_size);
+    }
+    recording_dir = server_config->recording_dir;
+
+    // Further receivers tell themselves apart by a number after the name and the last byte of the MAC address
+    for (int i = 0; i < receivers; i++) {
+        std::string receiver_name = i == 0 ? name : name + " " + std::to_string(i + 1);
+        std::vector<char> receiver_hw_addr = hw_addr;
+        receiver_hw_addr.back() += i;
+
+        int error;
+        dnssds[i] = dnssd_init(receiver_name.c_str(), receiver_name.length(), receiver_hw_addr.data(),
+                               receiver_hw_addr.size(), &error);
+        if (error) {
+            LOGE("Could not initialize dnssd library!");
+            return -2;
+        }
+        raop_set_dnssd(raops[i], dnssds[i]);
+
+        unsigned short port = 0;
+        int fd = -1;
+        if (i < activated_fds) {
+            if (sd_daemon_is_listening_stream(SD_LISTEN_FDS_START + i)) {
+                fd = SD_LISTEN_FDS_START + i;
+                port = netutils_get_local_port(fd);
+                LOGI("Advertising %s on port %d passed by systemd", receiver_name.c_str(), port);
+            } else {
+                LOGW("Socket %d passed by systemd is no listening TCP socket, %s binds a port of its own",
+                     SD_LISTEN_FDS_START + i, receiver_name.c_str());
+            }
+        }
+        if (fd == -1 && (fd = listen_early(&port)) == -1) {
+            LOGD("Could not bind a port for %s early, advertising it once it starts", receiver_name.c_str());
+            continue;
+        }
+        raop_set_listen_fd(raops[i], fd);
+        dnssd_register_raop(dnssds[i], port);
+        dnssd_register_airplay(dnssds[i], port + 1);
+        receiver_registered[i] = true;
+    }
+    if (activated_fds > receivers) {
+        LOGW("systemd passed %d sockets for %d receivers, the rest go unused", activated_fds, receivers);
+    }
+    return 0;
+}
+
+/*
+ * Brings up the video and audio renderers, the slowest part of the start with OMX or a GStreamer
+ * registry to load, on a thread of its own while the receivers and dnssd come up
+ */
+static int init_renderers(server_config_t const *server_config, video_renderer_config_t const *video_config,
+                          audio_renderer_config_t const *audio_config) {
+    max_sessions = server_config->max_sessions;
+    lazy_video = server_config->lazy_video;
+    if (lazy_video) {
+        if (max_sessions > 1 || server_config->display_auto || video_config->hevc) {
+            LOGE("-lazy cannot be combined with -m, -res auto or -hevc, which need the video renderer up front");
+            return -1;
+        }
+        // The audio renderer then keeps its own clock, as it must outlive every mirror
+        lazy_video_config = video_config;
+        LOGI("The video renderer is started for each mirror");
+    } else if (max_sessions == 1) {
+        if ((video_renderer = video_init_func(render_logger, video_config)) == NULL) {
+            LOGE("Could not init video renderer");
+            return -1;
+        }
+    } else {
+        LOGI("Showing up to %d mirrors side by side", max_sessions);
+        for (int i = 0; i < max_sessions; i++) {
+            tile_configs[i] = *video_config;
+            tile_configs[i].tiles = max_sessions;
+            tile_configs[i].tile = i;
+            // The first tile's renderer takes care of the background for all of them
+            if (i > 0) tile_configs[i].background_mode = BACKGROUND_MODE_OFF;
+            if (i > 0) tile_configs[i].switch_to_60hz = false;
+            if ((tile_renderers[i] = video_init_func(render_logger, &tile_configs[i])) == NULL) {
+                LOGE("Could not init video renderer for tile %d", i);
+                return -1;
+            }
+        }
+        video_renderer = tile_renderers[0];
+    }
+
+    if (audio_config->device == AUDIO_DEVICE_NONE) {
+        LOGI("Audio disabled");
+    } else if ((audio_renderer = audio_init_func(render_logger, video_renderer, audio_config)) ==
+               NULL) {
+        LOGE("Could not init audio renderer");
+        return -1;
+    }
+    mix_audio = audio_renderer && audio_config->mix && audio_renderer->funcs->open_stream;
+    if (audio_renderer && audio_config->mix && !mix_audio) {
+        LOGW("The audio renderer cannot mix the audio of several senders, ignoring -mix");
+    }
+    if (audio_renderer && audio_config->sync_group && audio_renderer->type != AUDIO_RENDERER_ALSA) {
+        LOGW("Only the alsa renderer plays in a sync group, ignoring -group");
+    }
+
+    return 0;
+}
+
+int start_server(std::vector<char> hw_addr, std::string name, bool debug_log, server_config_t const *server_config,
                  video_renderer_config_t const *video_config, audio_renderer_config_t const *audio_config) {
     raop_callbacks_t raop_cbs;
     memset(&raop_cbs, 0, sizeof(raop_cbs));
@@ -346,67 +1806,217 @@ int start_server(std::vector<char> hw_addr, std::string name, bool debug_log,
     raop_cbs.conn_destroy = conn_destroy;
     raop_cbs.audio_process = audio_process;
     raop_cbs.video_process = video_process;
+    raop_cbs.video_process_frame = video_process_frame;
+    raop_cbs.video_acquire_buffer = video_acquire_buffer;
+    raop_cbs.video_release_buffer = video_release_buffer;
+    raop_cbs.video_backpressure = video_backpressure;
+    raop_cbs.audio_underruns = audio_underruns;
+    raop_cbs.video_next_vsync = video_next_vsync;
+    if (server_config->slice_pipelining) raop_cbs.video_process_nals = video_process_nals;
     raop_cbs.audio_flush = audio_flush;
     raop_cbs.video_flush = video_flush;
+    raop_cbs.video_pause = video_pause;
     raop_cbs.audio_set_volume = audio_set_volume;
-
-    raop = raop_init(10, &raop_cbs);
-    if (raop == NULL) {
-        LOGE("Error initializing raop!");
-        return -1;
+    raop_cbs.session_milestone = session_milestone;
+    raop_cbs.conn_superseded = conn_superseded;
+    raop_cbs.snapshot = snapshot;
+    if (server_config->lazy_video) {
+        raop_cbs.video_start = video_start;
+        raop_cbs.video_stop = video_stop;
     }
-
-    raop_set_log_callback(raop, log_callback, NULL);
-    raop_set_log_level(raop, debug_log ? RAOP_LOG_DEBUG : LOGGER_INFO);
+    if (server_config->play_urls) {
+        raop_cbs.playback_start = playback_start;
+        raop_cbs.playback_scrub = playback_scrub;
+        raop_cbs.playback_rate = playback_rate;
+        raop_cbs.playback_stop = playback_stop;
+        raop_cbs.playback_info = playback_info;
+    }
+    raop_cbs.photo_show = photo_show;
+    raop_cbs.photo_hide = photo_hide;
 
     render_logger = logger_init();
     logger_set_callback(render_logger, log_callback, NULL);
     logger_set_level(render_logger, debug_log ? LOGGER_DEBUG : LOGGER_INFO);
 
-    if (video_config->low_latency) logger_log(render_logger, LOGGER_INFO, "Using low-latency mode");
+    if (server_config->perf_counters && perf_counters_start(render_logger) < 0) {
+        LOGE("Could not open the performance counters: %s. Lower /proc/sys/kernel/perf_event_paranoid.", strerror(errno));
+    }
 
-    if ((video_renderer = video_init_func(render_logger, video_config)) == NULL) {
-        LOGE("Could not init video renderer");
-        return -1;
+    char features[64];
+    LOGD("CPU features: %s, SIMD kernels: %s", cpu_features_format(cpu_features(), features, sizeof(features)),
+         simd_kernels()->name);
+
+    int renderers_result = -1;
+    std::thread renderer_thread([&] { renderers_result = init_renderers(server_config, video_config, audio_config); });
+    int receivers_result = init_receivers(&raop_cbs, hw_addr, name, debug_log, server_config);
+    renderer_thread.join();
+    if (renderers_result < 0 || receivers_result < 0) {
+        return receivers_result < 0 ? receivers_result : renderers_result;
     }
 
-    if (audio_config->device == AUDIO_DEVICE_NONE) {
-        LOGI("Audio disabled");
-    } else if ((audio_renderer = audio_init_func(render_logger, video_renderer, audio_config)) ==
-               NULL) {
-        LOGE("Could not init audio renderer");
-        return -1;
+
+    if (!server_config->restream_addresses.empty()) {
+        restreamer = restream_init(render_logger);
+        for (std::string const &address : server_config->restream_addresses) {
+            if (restream_add_subscriber(restreamer, address.c_str()) < 0) {
+                LOGE("Could not restream to %s, expected address:port or [address]:port", address.c_str());
+                return -1;
+            }
+        }
+        if (server_config->restream_transcode.bitrate) {
+#if defined(HAS_GSTREAMER_RENDERER)
+            video_transcoder_config_t transcode = server_config->restream_transcode;
+            transcode.video_decoders = video_config->video_decoders;
+            restream_transcoder = video_transcoder_gstreamer_init(render_logger, &transcode, restream_transcoded, NULL);
+#endif
+            if (!restream_transcoder) {
+                LOGE("Could not set up transcoding for the restream, it needs the GStreamer renderer's plugins");
+                return -1;
+            }
+        }
+    } else if (server_config->restream_transcode.bitrate) {
+        LOGW("-rtpt only applies to a restream, which -rtp sets up");
+    }
+
+    if (!server_config->shm_name.empty()) {
+        shm_ring = shm_ring_init(render_logger, server_config->shm_name.c_str(), DEFAULT_SHM_SIZE);
+        if (!shm_ring) return -1;
+    }
+
+    if (server_config->webrtc_port) {
+        unsigned short port = server_config->webrtc_port;
+        webrtc = webrtc_init(render_logger);
+        if (!webrtc || webrtc_start(webrtc, &port) < 0) {
+            LOGE("Could not serve WebRTC viewers on port %d", server_config->webrtc_port);
+            return -1;
+        }
+    }
+
+    if (server_config->play_urls) {
+#if defined(HAS_GSTREAMER_RENDERER)
+        url_player_config_t player_config;
+        player_config.video_sink = video_config->video_sink;
+        player_config.video_decoders = video_config->video_decoders;
+        url_player = url_player_gstreamer_init(render_logger, &player_config);
+#endif
+        if (!url_player) {
+            LOGE("Could not set up playing cast movies, it needs the GStreamer renderer's plugins");
+            return -1;
+        }
     }
 
-    if (video_renderer) video_renderer->funcs->start(video_renderer);
-    if (audio_renderer) audio_renderer->funcs->start(audio_renderer);
+    if (video_config->low_latency) logger_log(render_logger, LOGGER_INFO, "Using low-latency mode");
+
+    int display_width = server_config->display_width;
+    int display_height = server_config->display_height;
+    double display_refresh_rate = server_config->display_refresh_rate;
+    if (server_config->display_auto) {
+        if (video_renderer->display_width) {
+            display_width = video_renderer->display_width;
+            display_height = video_renderer->display_height;
+            display_refresh_rate = video_renderer->display_refresh_rate;
+        } else {
+            LOGI("The video renderer cannot tell the screen size, advertising the default display");
+        }
+    }
+    if (display_width || display_refresh_rate) {
+        for (int i = 0; i < receivers; i++) raop_set_display(raops[i], display_width, display_height, display_refresh_rate);
+        LOGI("Advertising a %dx%d display at %.2f Hz", display_width ? display_width : 1920,
+             display_width ? display_height : 1080, display_refresh_rate ? display_refresh_rate : 60.0);
+    }
+
+    if (server_config->decode_capacity) {
+        // Guests use the accounting of the first receiver, it speaks for all of them
+        raop_set_decode_capacity(raops[0], server_config->decode_capacity, server_config->preempt);
+        LOGI("Admitting mirrors while the decoder keeps up with %llu pixels per second",
+             (unsigned long long) server_config->decode_capacity);
+    }
 
-    unsigned short port = 0;
-    raop_start(raop, &port);
-    raop_set_port(raop, port);
+    if (video_config->hevc && video_renderer) {
+        // Tiles share the config, so the first renderer speaks for all of them
+        if (!video_renderer->supports_hevc) LOGW("The video renderer cannot decode H.265, mirroring in H.264 only");
+        for (int i = 0; i < receivers; i++) raop_set_hevc(raops[i], video_renderer->supports_hevc);
+    }
 
-    int error;
-    dnssd = dnssd_init(name.c_str(), strlen(name.c_str()), hw_addr.data(), hw_addr.size(), &error);
-    if (error) {
-        LOGE("Could not initialize dnssd library!");
-        return -2;
+    if (max_sessions == 1) {
+        if (video_renderer) video_renderer->funcs->start(video_renderer);
+    } else {
+        for (int i = 0; i < max_sessions; i++) tile_renderers[i]->funcs->start(tile_renderers[i]);
+    }
+    if (audio_renderer) {
+        audio_renderer->funcs->start(audio_renderer);
+        audio_format_init_default(&audio_renderer_format);
+        for (int i = 0; i < receivers; i++) raop_set_audio_formats(raops[i], audio_renderer->formats);
+        for (int i = 0; i < receivers; i++) raop_set_buffered_audio(raops[i], server_config->buffered_audio);
+        advertise_audio_latency();
     }
 
-    raop_set_dnssd(raop, dnssd);
+    for (int i = 0; i < receivers; i++) {
+        std::string receiver_name = i == 0 ? name : name + " " + std::to_string(i + 1);
+        unsigned short port = 0;
+        if (raop_start(raops[i], &port) < 0) {
+            LOGE("Could not start receiver %s", receiver_name.c_str());
+            return -1;
+        }
+        raop_set_port(raops[i], port);
+        LOGI("Listening for AirPlay connections to %s on port %d", receiver_name.c_str(), port);
 
-    dnssd_register_raop(dnssd, port);
-    dnssd_register_airplay(dnssd, port + 1);
+        // A socket bound in init_receivers was advertised before the receiver came up
+        if (!receiver_registered[i]) {
+            dnssd_register_raop(dnssds[i], port);
+            dnssd_register_airplay(dnssds[i], port + 1);
+        }
+    }
+    netwatch = netwatch_init(render_logger, network_changed, NULL);
+    if (server_config->thermal) thermal = thermal_init(render_logger, thermal_changed, NULL);
+    if (server_config->pm_latency >= 0) {
+        pm_qos = pm_qos_init(render_logger, server_config->pm_latency, server_config->pm_floor);
+    }
 
+    // Everything up to here is logged right away, so a failed start shows why before exiting.
+    // From now on the media threads must not wait for the console.
+    for (int i = 0; i < receivers; i++) raop_set_log_async(raops[i], 1);
+    logger_set_async(render_logger, 1);
+
+    sd_daemon_notify("READY=1");
     return 0;
 }
 
 int stop_server() {
-    raop_destroy(raop);
-    dnssd_unregister_raop(dnssd);
-    dnssd_unregister_airplay(dnssd);
+    netwatch_destroy(netwatch);
+    thermal_destroy(thermal);
+    thermal = NULL;
+    // Stopping the first receiver closes the connections of all of them
+    if (receivers) raop_stop(raops[0]);
+    for (int i = receivers - 1; i >= 0; i--) {
+        raop_destroy(raops[i]);
+        if (dnssds[i]) {
+            dnssd_unregister_raop(dnssds[i]);
+            dnssd_unregister_airplay(dnssds[i]);
+        }
+    }
+    receivers = 0;
+    // After the connections, which end their sessions on the way out
+    pm_qos_destroy(pm_qos);
+    pm_qos = NULL;
+    genlock_destroy(genlock);
+    genlock = NULL;
     // If we don't destroy these two in the correct order, we get a deadlock from the ilclient library
     if (audio_renderer) audio_renderer->funcs->destroy(audio_renderer);
-    if (video_renderer) video_renderer->funcs->destroy(video_renderer);
+    if (max_sessions == 1) {
+        if (video_renderer) video_renderer->funcs->destroy(video_renderer);
+    } else {
+        for (int i = 0; i < max_sessions; i++) {
+            if (tile_renderers[i]) tile_renderers[i]->funcs->destroy(tile_renderers[i]);
+        }
+    }
+    // The connections are gone, so nothing plays a cast movie any more
+    if (url_player) url_player->funcs->destroy(url_player);
+    // The transcoder's thread restreams, so it goes first
+    if (restream_transcoder) restream_transcoder->funcs->destroy(restream_transcoder);
+    restream_destroy(restreamer);
+    shm_ring_destroy(shm_ring);
+    webrtc_destroy(webrtc);
     logger_destroy(render_logger);
     return 0;
 }
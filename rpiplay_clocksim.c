@@ -0,0 +1,369 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Runs the clock sync of the receiver, raop_ntp and the rtp to ntp mapping of raop_rtp, against
+ * a simulated sender on a simulated clock. The sender's clock is offset from and runs at a skew
+ * to the receiver's, its NTP server answers over a network with asymmetric delay, queueing jitter
+ * and loss, and it sends an audio sync packet every second. Every 100 ms of simulated time the
+ * receiver's idea of the sender's clock and of the play time of the current audio sample are
+ * compared to the truth. Everything is drawn from one seeded generator, so a run is repeatable
+ * to the last micro second and takes well under a second for an hour of simulated time.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "lib/logger.h"
+#include "lib/byteutils.h"
+#include "lib/raop.h"
+#include "lib/raop_ntp.h"
+#include "lib/raop_rtp.h"
+
+#define DEFAULT_DURATION 600
+#define DEFAULT_WARMUP 5
+#define DEFAULT_DELAY_MS 2.0
+#define DEFAULT_JITTER_MS 1.0
+#define DEFAULT_SKEW_PPM 20.0
+#define DEFAULT_OFFSET_S 3600.0
+/* Receiver's clock at the start of the simulation, some time in 2026 */
+#define CLOCKSIM_START_US 1780000000000000ull
+/* Between receiving a request and sending the response on the sender */
+#define CLOCKSIM_TURNAROUND_US 50
+#define CLOCKSIM_SYNC_INTERVAL_US 1000000
+#define CLOCKSIM_MEASURE_INTERVAL_US 100000
+#define CLOCKSIM_SAMPLE_RATE 44100
+/* The sender stamps the rtp time of a sync packet this many samples ahead of its ntp time */
+#define CLOCKSIM_SYNC_RTP_LATENCY (CLOCKSIM_SAMPLE_RATE / 4)
+
+typedef struct clocksim_s {
+    /* Receiver's clock, the one true time of the simulation */
+    uint64_t now;
+    uint64_t random;
+
+    /* Sender's clock is start + offset + (now - start) * (1 + skew) */
+    double offset_us;
+    double skew;
+    double forward_delay_us;
+    double back_delay_us;
+    double jitter_us;
+    double loss;
+
+    /* The response to the request in flight, 0 while there is none */
+    uint64_t response_time;
+    unsigned char response[32];
+
+    uint32_t rtp_start;
+    int requests;
+    int lost;
+} clocksim_t;
+
+typedef struct clocksim_errors_s {
+    const char *name;
+    int64_t *values;
+    int count;
+    int capacity;
+} clocksim_errors_t;
+
+static logger_t *logger = NULL;
+
+static void log_callback(void *cls, int level, const char *msg) {
+    printf("%s\n", msg);
+}
+
+/* xorshift64*, uniform in [0, 1) */
+static double clocksim_random(clocksim_t *sim) {
+    sim->random ^= sim->random >> 12;
+    sim->random ^= sim->random << 25;
+    sim->random ^= sim->random >> 27;
+    return ((sim->random * 0x2545f4914f6cdd1dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Base delay plus queueing, which only ever adds to it and is mostly short */
+static uint64_t clocksim_delay(clocksim_t *sim, double base_us) {
+    double queueing = sim->jitter_us > 0 ? -log(1.0 - clocksim_random(sim)) * sim->jitter_us : 0;
+    return (uint64_t) (base_us + queueing);
+}
+
+static uint64_t clocksim_remote_time(clocksim_t *sim, uint64_t local_time) {
+    double elapsed = (double) (int64_t) (local_time - CLOCKSIM_START_US);
+    return CLOCKSIM_START_US + (int64_t) (sim->offset_us + elapsed * (1.0 + sim->skew));
+}
+
+/* The sample of the sender's audio clock, which runs off its system clock, playing at local_time */
+static uint32_t clocksim_rtp_time(clocksim_t *sim, uint64_t local_time) {
+    double elapsed = (double) (int64_t) (clocksim_remote_time(sim, local_time) - clocksim_remote_time(sim, CLOCKSIM_START_US));
+    return sim->rtp_start + (uint32_t) (int64_t) floor(elapsed * CLOCKSIM_SAMPLE_RATE / 1000000.0);
+}
+
+static uint64_t clocksim_get_local_time(void *cls) {
+    return ((clocksim_t *) cls)->now;
+}
+
+/* The sender's NTP server: stamps arrival and departure on its own clock and sends the request time back */
+static int clocksim_send(void *cls, const unsigned char *packet, int len) {
+    clocksim_t *sim = cls;
+
+    sim->requests++;
+    if (len < 32 || sim->response_time) {
+        return -1;
+    }
+    if (sim->loss > 0 && clocksim_random(sim) < sim->loss) {
+        sim->lost++;
+        return len;
+    }
+    uint64_t arrival = sim->now + clocksim_delay(sim, sim->forward_delay_us);
+    uint64_t departure = arrival + CLOCKSIM_TURNAROUND_US;
+    memset(sim->response, 0, sizeof(sim->response));
+    sim->response[0] = 0x80;
+    sim->response[1] = 0xd3;
+    memcpy(sim->response + 8, packet + 24, 8);
+    byteutils_put_ntp_timestamp(sim->response, 16, clocksim_remote_time(sim, arrival));
+    byteutils_put_ntp_timestamp(sim->response, 24, clocksim_remote_time(sim, departure));
+    sim->response_time = departure + clocksim_delay(sim, sim->back_delay_us);
+    return len;
+}
+
+static void clocksim_errors_add(clocksim_errors_t *errors, int64_t error) {
+    if (errors->count == errors->capacity) {
+        int capacity = errors->capacity ? errors->capacity * 2 : 1024;
+        int64_t *values = realloc(errors->values, capacity * sizeof(int64_t));
+        if (!values) {
+            return;
+        }
+        errors->values = values;
+        errors->capacity = capacity;
+    }
+    errors->values[errors->count++] = error;
+}
+
+static int clocksim_compare_abs(const void *a, const void *b) {
+    int64_t x = llabs(*(const int64_t *) a);
+    int64_t y = llabs(*(const int64_t *) b);
+    return x < y ? -1 : x > y;
+}
+
+static void clocksim_errors_report(clocksim_errors_t *errors) {
+    if (!errors->count) {
+        printf("%-9s no measurements\n", errors->name);
+        return;
+    }
+    double sum = 0;
+    for (int i = 0; i < errors->count; i++) {
+        sum += errors->values[i];
+    }
+    qsort(errors->values, errors->count, sizeof(int64_t), clocksim_compare_abs);
+    int n = errors->count;
+    printf("%-9s |error| p50 %lld us, p90 %lld us, p99 %lld us, max %lld us, mean error %+.1f us over %d measurements\n",
+           errors->name, llabs(errors->values[n / 2]), llabs(errors->values[n * 9 / 10]),
+           llabs(errors->values[n * 99 / 100]), llabs(errors->values[n - 1]), sum / n, n);
+}
+
+static void print_info(char *name) {
+    printf("rpiplay_clocksim: Measures the clock sync of rpiplay against a simulated sender\n");
+    printf("Usage: %s [-offset s] [-skew ppm] [-delay ms[:ms]] [-jitter ms] [-loss %%] [-t s] [-warmup s] [-seed n] [-d]\n", name);
+    printf("Options:\n");
+    printf("-offset s             Sender's clock ahead of the receiver's by this much (default %.0f)\n", DEFAULT_OFFSET_S);
+    printf("-skew ppm             Sender's clock runs this much faster (default %.0f)\n", DEFAULT_SKEW_PPM);
+    printf("-delay ms[:ms]        One way network delay, to the sender and back if they differ (default %.1f)\n", DEFAULT_DELAY_MS);
+    printf("-jitter ms            Mean of the exponential queueing delay added to every packet (default %.1f)\n", DEFAULT_JITTER_MS);
+    printf("-loss %%               Chance of an NTP request or its response getting lost (default 0)\n");
+    printf("-t s                  Simulated time (default %d)\n", DEFAULT_DURATION);
+    printf("-warmup s             Leave the first seconds out of the errors (default %d)\n", DEFAULT_WARMUP);
+    printf("-seed n               Seed of the delays and losses (default 1)\n");
+    printf("-d                    Enable debug logging\n");
+    printf("-v/-h                 Displays this help\n");
+}
+
+int main(int argc, char *argv[]) {
+    clocksim_t sim;
+    int duration = DEFAULT_DURATION;
+    int warmup = DEFAULT_WARMUP;
+    uint64_t seed = 1;
+    bool debug_log = false;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.offset_us = DEFAULT_OFFSET_S * 1000000.0;
+    sim.skew = DEFAULT_SKEW_PPM / 1000000.0;
+    sim.forward_delay_us = sim.back_delay_us = DEFAULT_DELAY_MS * 1000.0;
+    sim.jitter_us = DEFAULT_JITTER_MS * 1000.0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "-offset")) {
+            if (i == argc - 1) continue;
+            sim.offset_us = atof(argv[++i]) * 1000000.0;
+        } else if (!strcmp(arg, "-skew")) {
+            if (i == argc - 1) continue;
+            sim.skew = atof(argv[++i]) / 1000000.0;
+        } else if (!strcmp(arg, "-delay")) {
+            if (i == argc - 1) continue;
+            char *end;
+            sim.forward_delay_us = sim.back_delay_us = strtod(argv[++i], &end) * 1000.0;
+            if (*end == ':') {
+                sim.back_delay_us = strtod(end + 1, &end) * 1000.0;
+            }
+            if (*end || sim.forward_delay_us < 0 || sim.back_delay_us < 0) {
+                fprintf(stderr, "Error: The delay must be ms or forward:back ms.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-jitter")) {
+            if (i == argc - 1) continue;
+            sim.jitter_us = atof(argv[++i]) * 1000.0;
+            if (sim.jitter_us < 0) {
+                fprintf(stderr, "Error: The jitter must not be negative.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-loss")) {
+            if (i == argc - 1) continue;
+            sim.loss = atof(argv[++i]) / 100.0;
+            if (sim.loss < 0 || sim.loss >= 1) {
+                fprintf(stderr, "Error: The loss must be at least 0 and below 100%%.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-t")) {
+            if (i == argc - 1) continue;
+            duration = atoi(argv[++i]);
+            if (duration < 1) {
+                fprintf(stderr, "Error: The duration must be a positive number of seconds.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-warmup")) {
+            if (i == argc - 1) continue;
+            warmup = atoi(argv[++i]);
+            if (warmup < 0) {
+                fprintf(stderr, "Error: The warmup must not be negative.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-seed")) {
+            if (i == argc - 1) continue;
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(arg, "-d")) {
+            debug_log = true;
+        } else if (!strcmp(arg, "-h") || !strcmp(arg, "-v")) {
+            print_info(argv[0]);
+            exit(0);
+        } else {
+            fprintf(stderr, "Error: Unknown option %s. Run with -h for a list.\n", arg);
+            exit(1);
+        }
+    }
+
+    logger = logger_init();
+    logger_set_callback(logger, log_callback, NULL);
+    // Lost packets make raop_ntp log every timeout as an error
+    logger_set_level(logger, debug_log ? LOGGER_DEBUG : LOGGER_CRIT);
+
+    sim.now = CLOCKSIM_START_US;
+    sim.random = (seed * 0x9e3779b97f4a7c15ull) | 1;
+    sim.rtp_start = (uint32_t) (clocksim_random(&sim) * 4294967296.0);
+
+    const unsigned char remote[4] = { 127, 0, 0, 1 };
+    unsigned char aeskey[16] = { 0 }, aesiv[16] = { 0 }, ecdh_secret[32] = { 0 };
+    raop_callbacks_t callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+
+    raop_ntp_t *ntp = raop_ntp_init(logger, remote, sizeof(remote), 7010);
+    raop_rtp_t *rtp = ntp ? raop_rtp_init(logger, &callbacks, ntp, remote, sizeof(remote), aeskey, aesiv, ecdh_secret, 0) : NULL;
+    if (!rtp) {
+        fprintf(stderr, "Error: Could not set up the receiver.\n");
+        exit(1);
+    }
+    raop_ntp_transport_t transport = { &sim, clocksim_get_local_time, clocksim_send };
+    raop_ntp_set_transport(ntp, &transport);
+    raop_ntp_start(ntp, NULL);
+
+    clocksim_errors_t ntp_errors = { "ntp" };
+    clocksim_errors_t rtp_errors = { "rtp" };
+    uint64_t end = CLOCKSIM_START_US + (uint64_t) duration * 1000000;
+    uint64_t measure_from = CLOCKSIM_START_US + (uint64_t) warmup * 1000000;
+    uint64_t next_timer = raop_ntp_run_timer(ntp);
+    uint64_t next_sync = CLOCKSIM_START_US + CLOCKSIM_SYNC_INTERVAL_US;
+    uint64_t next_measure = CLOCKSIM_START_US + CLOCKSIM_MEASURE_INTERVAL_US;
+    /* Sent and arrival time of the sync packet on its way, 0 while there is none */
+    uint64_t sync_sent = 0, sync_arrival = 0;
+    int syncs = 0;
+
+    while (sim.now < end) {
+        uint64_t next = next_measure;
+        if (next_timer && next_timer < next) next = next_timer;
+        if (sim.response_time && sim.response_time < next) next = sim.response_time;
+        if (next_sync < next) next = next_sync;
+        if (sync_arrival && sync_arrival < next) next = sync_arrival;
+        sim.now = next;
+
+        if (sim.response_time && sim.response_time <= sim.now) {
+            uint64_t arrival = sim.response_time;
+            sim.response_time = 0;
+            if (sim.loss > 0 && clocksim_random(&sim) < sim.loss) {
+                sim.lost++;
+            } else {
+                raop_ntp_receive(ntp, sim.response, sizeof(sim.response), arrival);
+            }
+            next_timer = raop_ntp_run_timer(ntp);
+        }
+        if (next_timer && next_timer <= sim.now) {
+            next_timer = raop_ntp_run_timer(ntp);
+        }
+        if (next_sync <= sim.now) {
+            sync_sent = next_sync;
+            sync_arrival = sync_sent + clocksim_delay(&sim, sim.back_delay_us);
+            next_sync += CLOCKSIM_SYNC_INTERVAL_US;
+        }
+        if (sync_arrival && sync_arrival <= sim.now) {
+            // What raop_rtp makes of the rtp and ntp time in a sync packet on its control port
+            uint32_t packet_rtp = clocksim_rtp_time(&sim, sync_sent) + CLOCKSIM_SYNC_RTP_LATENCY;
+            uint64_t remote_time = clocksim_remote_time(&sim, sync_sent);
+            raop_rtp_sync_clock(rtp, packet_rtp - CLOCKSIM_SYNC_RTP_LATENCY, raop_ntp_convert_remote_time(ntp, remote_time));
+            sync_arrival = 0;
+            syncs++;
+        }
+        if (next_measure <= sim.now) {
+            if (sim.now >= measure_from) {
+                uint64_t remote_time = clocksim_remote_time(&sim, sim.now);
+                clocksim_errors_add(&ntp_errors, (int64_t) (raop_ntp_convert_remote_time(ntp, remote_time) - sim.now));
+                if (syncs) {
+                    // The sample playing now, taken after the sender's own rounding
+                    uint32_t rtp_time = clocksim_rtp_time(&sim, sim.now);
+                    clocksim_errors_add(&rtp_errors, (int64_t) (raop_rtp_convert_rtp_time(rtp, rtp_time) - sim.now));
+                }
+            }
+            next_measure += CLOCKSIM_MEASURE_INTERVAL_US;
+        }
+    }
+
+    printf("Simulated %d s: offset %.3f s, skew %.1f ppm, delay %.2f/%.2f ms, jitter %.2f ms, loss %.1f%%, seed %llu\n",
+           duration, sim.offset_us / 1000000.0, sim.skew * 1000000.0, sim.forward_delay_us / 1000.0,
+           sim.back_delay_us / 1000.0, sim.jitter_us / 1000.0, sim.loss * 100.0, (unsigned long long) seed);
+    printf("%d NTP requests, %d lost packets, %d audio syncs, round trip %lld us\n", sim.requests, sim.lost,
+           syncs, (long long) raop_ntp_get_round_trip_delay(ntp));
+    clocksim_errors_report(&ntp_errors);
+    clocksim_errors_report(&rtp_errors);
+
+    raop_rtp_destroy(rtp);
+    raop_ntp_destroy(ntp);
+    logger_destroy(logger);
+    free(ntp_errors.values);
+    free(rtp_errors.values);
+    return 0;
+}
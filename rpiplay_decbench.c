@@ -0,0 +1,441 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Feeds an H.264 Annex-B stream from a file straight into a video renderer, as fast as it takes
+ * the frames, with no network, decryption or render queue in front of it. The stream is split
+ * into access units and indexed up front, so the loop does nothing but hand frames over. Reports
+ * the sustained frame rate, the latency of each submit and the CPU time the process spent, which
+ * makes the decoder backends comparable on their own.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "lib/logger.h"
+#include "lib/histogram.h"
+#include "lib/raop_ntp.h"
+#include "renderers/renderer_list.h"
+#include "renderers/h264-bitstream/h264_stream.h"
+
+#define DEFAULT_LATENCY_TARGET 150
+#define DEFAULT_WARMUP_FRAMES 30
+/* How long a congested renderer is left alone before it is asked again */
+#define DECBENCH_CONGESTED_WAIT_US 500
+
+/* One buffer for render_buffer: the parameter sets of a stream (type 0) or a frame (type 1) */
+typedef struct decbench_unit_s {
+    unsigned char *data;
+    int size;
+    int type;
+    int width;
+    int height;
+    h264_nal_index_t nal_index;
+} decbench_unit_t;
+
+typedef struct decbench_stream_s {
+    decbench_unit_t *units;
+    int count;
+    int capacity;
+    int frames;
+    int skipped;
+} decbench_stream_t;
+
+static volatile sig_atomic_t running = 1;
+
+static void signal_handler(int sig) {
+    running = 0;
+}
+
+static void log_callback(void *cls, int level, const char *msg) {
+    printf("%s\n", msg);
+}
+
+static unsigned char *read_file(const char *path, int *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char *buf = length > 0 ? malloc(length) : NULL;
+    if (!buf || fread(buf, 1, length, file) != (size_t) length) {
+        free(buf);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *size = (int) length;
+    return buf;
+}
+
+static void unit_append(decbench_unit_t *unit, const unsigned char *nal, int nal_size) {
+    h264_nal_index_entry_t *entry = &unit->nal_index.nals[unit->nal_index.count++];
+    unit->data = realloc(unit->data, unit->size + 4 + nal_size);
+    unsigned char *dst = unit->data + unit->size;
+    dst[0] = 0; dst[1] = 0; dst[2] = 0; dst[3] = 1;
+    memcpy(dst + 4, nal, nal_size);
+    entry->offset = unit->size + 4;
+    entry->size = nal_size;
+    entry->nal_unit_type = nal[0] & 0x1f;
+    entry->nal_ref_idc = (nal[0] >> 5) & 0x3;
+    unit->size += 4 + nal_size;
+}
+
+/* Hands the unit over to the stream and starts the next one empty, units without NALs are dropped */
+static void stream_close_unit(decbench_stream_t *stream, decbench_unit_t *unit) {
+    if (unit->nal_index.count == 0) {
+        return;
+    }
+    if (stream->count == stream->capacity) {
+        stream->capacity = stream->capacity ? 2 * stream->capacity : 256;
+        stream->units = realloc(stream->units, stream->capacity * sizeof(decbench_unit_t));
+    }
+    if (unit->type == 1) {
+        stream->frames++;
+    }
+    stream->units[stream->count++] = *unit;
+    int type = unit->type;
+    memset(unit, 0, sizeof(decbench_unit_t));
+    unit->type = type;
+}
+
+/* The picture size an SPS codes for, cropped, 0 if it does not parse. AirPlay only sends 4:2:0. */
+static void parse_sps_size(h264_stream_t *h264, const unsigned char *nal, int nal_size, int *width, int *height) {
+    *width = *height = 0;
+    if (read_nal_unit(h264, (uint8_t *) nal, nal_size) < 0 || h264->nal->nal_unit_type != 7) {
+        return;
+    }
+    sps_t *sps = h264->sps;
+    int crop_unit_y = 2 * (2 - sps->frame_mbs_only_flag);
+    *width = (sps->pic_width_in_mbs_minus1 + 1) * 16;
+    *height = (sps->pic_height_in_map_units_minus1 + 1) * 16 * (2 - sps->frame_mbs_only_flag);
+    if (sps->frame_cropping_flag) {
+        *width -= 2 * (sps->frame_crop_left_offset + sps->frame_crop_right_offset);
+        *height -= crop_unit_y * (sps->frame_crop_top_offset + sps->frame_crop_bottom_offset);
+    }
+}
+
+/*
+ * Splits the stream into the units render_buffer takes, the way raop_rtp_mirror hands them over:
+ * SPS and PPS together as type 0, then each access unit as type 1. A new access unit starts with
+ * an access unit delimiter, SEI or parameter set after a slice, or with a slice that starts at
+ * macroblock 0 once the current one has a slice.
+ */
+static int split_stream(unsigned char *buf, int size, decbench_stream_t *stream) {
+    h264_stream_t *h264 = h264_new();
+    decbench_unit_t sets = { .type = 0 };
+    decbench_unit_t frame = { .type = 1 };
+    bool frame_has_slice = false;
+    bool corrupt = false;
+    int offset = 0;
+    int nal_start, nal_end;
+    while (offset < size) {
+        int ret = find_nal_unit(buf + offset, size - offset, &nal_start, &nal_end);
+        if (ret == 0) break;
+        const unsigned char *nal = buf + offset + nal_start;
+        int nal_size = nal_end - nal_start;
+        offset += nal_end;
+        if (nal_size < 1) {
+            if (ret < 0) break;
+            continue;
+        }
+
+        int nal_type = nal[0] & 0x1f;
+        bool slice = nal_type == 1 || nal_type == 5;
+        bool starts_unit = (slice && nal_size > 1 && (nal[1] & 0x80)) || nal_type == 6 || nal_type == 7 ||
+                           nal_type == 8 || nal_type == 9;
+        if (frame_has_slice && starts_unit) {
+            if (corrupt) {
+                stream->skipped++;
+                free(frame.data);
+                memset(&frame, 0, sizeof(frame));
+                frame.type = 1;
+            }
+            stream_close_unit(stream, &frame);
+            frame_has_slice = corrupt = false;
+        }
+
+        if (nal_type == 7 || nal_type == 8) {
+            if (sets.nal_index.count == H264_NAL_INDEX_MAX) {
+                continue;
+            }
+            if (nal_type == 7) {
+                parse_sps_size(h264, nal, nal_size, &sets.width, &sets.height);
+            }
+            unit_append(&sets, nal, nal_size);
+        } else {
+            if (slice && !frame_has_slice) {
+                stream_close_unit(stream, &sets);
+                frame_has_slice = true;
+            }
+            if (frame.nal_index.count == H264_NAL_INDEX_MAX) {
+                corrupt = true;
+                continue;
+            }
+            unit_append(&frame, nal, nal_size);
+        }
+        if (ret < 0) break;
+    }
+    if (frame_has_slice && !corrupt) {
+        stream_close_unit(stream, &frame);
+    } else {
+        stream->skipped += corrupt;
+        free(frame.data);
+    }
+    free(sets.data);
+    h264_free(h264);
+    return stream->frames > 0 && stream->units[0].type == 0 ? 0 : -1;
+}
+
+static void free_stream(decbench_stream_t *stream) {
+    for (int i = 0; i < stream->count; i++) {
+        free(stream->units[i].data);
+    }
+    free(stream->units);
+}
+
+static uint64_t process_cpu_time_us(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (uint64_t) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ull +
+           (uint64_t) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+static void print_info(char *name) {
+    printf("rpiplay_decbench: Feeds an H.264 Annex-B stream straight into a video renderer as fast as it takes it\n");
+    printf("Usage: %s [-vr renderer] [-n frames] [-t seconds] [-w frames] [-size WxH] [-d] stream.h264\n", name);
+    printf("Options:\n");
+    printf("-vr renderer          Set video renderer to use. Available renderers:\n");
+    for (unsigned int i = 0; i < sizeof(video_renderers)/sizeof(video_renderers[0]); i++) {
+        printf("    %s: %s%s\n", video_renderers[i].name, video_renderers[i].description, i == 0 ? " [Default]" : "");
+    }
+    printf("-n frames             Stop after this many frames, looping the stream as often as needed\n");
+    printf("                      (default: the stream once)\n");
+    printf("-t seconds            Stop after this long, looping the stream as often as needed\n");
+    printf("-w frames             Leave the first frames out of the figures while the decoder starts up (default %d)\n",
+           DEFAULT_WARMUP_FRAMES);
+    printf("-size WxH             Picture size to configure the renderer with where the SPS does not parse\n");
+    printf("-d                    Enable debug logging\n");
+    printf("-v/-h                 Displays this help\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *stream_path = NULL;
+    bool debug_log = false;
+    long long max_frames = 0;
+    int max_seconds = 0;
+    int warmup_frames = DEFAULT_WARMUP_FRAMES;
+    int default_width = 0;
+    int default_height = 0;
+    video_init_func_t video_init_func = video_renderers[0].init_func;
+
+    /* Frames are presented as soon as they are decoded, the pts only orders them */
+    video_renderer_config_t video_config;
+    memset(&video_config, 0, sizeof(video_config));
+    video_config.background_mode = BACKGROUND_MODE_OFF;
+    video_config.latency_target = DEFAULT_LATENCY_TARGET;
+    video_config.flip = FLIP_NONE;
+    video_config.low_latency = true;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "-vr")) {
+            if (i == argc - 1) continue;
+            if ((video_init_func = find_video_init_func(argv[++i])) == NULL) {
+                fprintf(stderr, "Error: Invalid video renderer %s. Run with -h for a list.\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-n")) {
+            if (i == argc - 1) continue;
+            max_frames = atoll(argv[++i]);
+            if (max_frames <= 0) {
+                fprintf(stderr, "Error: Invalid frame count %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-t")) {
+            if (i == argc - 1) continue;
+            max_seconds = atoi(argv[++i]);
+            if (max_seconds <= 0) {
+                fprintf(stderr, "Error: Invalid duration %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-w")) {
+            if (i == argc - 1) continue;
+            warmup_frames = atoi(argv[++i]);
+            if (warmup_frames < 0) {
+                fprintf(stderr, "Error: Invalid warmup %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-size")) {
+            if (i == argc - 1) continue;
+            if (sscanf(argv[++i], "%dx%d", &default_width, &default_height) != 2 ||
+                default_width <= 0 || default_height <= 0) {
+                fprintf(stderr, "Error: Invalid size %s, expected WxH\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-d")) {
+            debug_log = true;
+        } else if (!strcmp(arg, "-h") || !strcmp(arg, "-v")) {
+            print_info(argv[0]);
+            exit(0);
+        } else if (arg[0] != '-' && !stream_path) {
+            stream_path = arg;
+        }
+    }
+    if (!stream_path) {
+        print_info(argv[0]);
+        exit(1);
+    }
+
+    int file_size;
+    unsigned char *file = read_file(stream_path, &file_size);
+    if (!file) {
+        fprintf(stderr, "Error: Could not read %s\n", stream_path);
+        exit(1);
+    }
+    decbench_stream_t stream = { 0 };
+    int split = split_stream(file, file_size, &stream);
+    free(file);
+    if (split < 0) {
+        fprintf(stderr, "Error: %s is no H.264 Annex-B stream starting with its SPS and PPS\n", stream_path);
+        free_stream(&stream);
+        exit(1);
+    }
+    for (int i = 0; i < stream.count; i++) {
+        decbench_unit_t *unit = &stream.units[i];
+        if (unit->type == 0 && (unit->width <= 0 || unit->height <= 0)) {
+            if (default_width <= 0) {
+                fprintf(stderr, "Error: The SPS does not give a picture size, pass it with -size WxH\n");
+                free_stream(&stream);
+                exit(1);
+            }
+            unit->width = default_width;
+            unit->height = default_height;
+        }
+    }
+    if (!max_frames && !max_seconds) {
+        max_frames = stream.frames;
+    }
+
+    logger_t *logger = logger_init();
+    logger_set_callback(logger, log_callback, NULL);
+    logger_set_level(logger, debug_log ? LOGGER_DEBUG : LOGGER_INFO);
+    logger_log(logger, LOGGER_INFO, "%s: %d frames in %d access units at %dx%d, %d skipped with more than %d NAL units",
+               stream_path, stream.frames, stream.count, stream.units[0].width, stream.units[0].height,
+               stream.skipped, H264_NAL_INDEX_MAX);
+
+    video_renderer_t *renderer = video_init_func(logger, &video_config);
+    if (!renderer) {
+        fprintf(stderr, "Error: Could not init video renderer\n");
+        logger_destroy(logger);
+        free_stream(&stream);
+        exit(1);
+    }
+    renderer->funcs->start(renderer);
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    histogram_t submit_histogram;
+    histogram_init(&submit_histogram);
+    const decbench_unit_t *last_sets = NULL;
+    long long frames = 0;
+    long long measured_frames = 0;
+    uint64_t measured_bytes = 0;
+    uint64_t congested_us = 0;
+    uint64_t start_time = raop_ntp_get_local_time(NULL);
+    uint64_t end_time = max_seconds ? start_time + (uint64_t) max_seconds * 1000000ull : 0;
+    uint64_t measure_start_time = start_time;
+    uint64_t measure_start_cpu = process_cpu_time_us();
+    uint64_t pts = start_time;
+    for (int i = 0; running; i = (i + 1) % stream.count) {
+        decbench_unit_t *unit = &stream.units[i];
+        if (unit->type == 0) {
+            /* Looping round to the same parameter sets is no new geometry to the renderer */
+            bool known = last_sets && last_sets->size == unit->size && !memcmp(last_sets->data, unit->data, unit->size);
+            if (renderer->funcs->reconfigure) {
+                renderer->funcs->reconfigure(renderer, unit->width, unit->height, known);
+            }
+            renderer->funcs->render_buffer(renderer, NULL, unit->data, unit->size, pts, 0, &unit->nal_index);
+            last_sets = unit;
+            continue;
+        }
+
+        uint64_t submit_start = raop_ntp_get_local_time(NULL);
+        while (running && renderer->funcs->is_congested && renderer->funcs->is_congested(renderer)) {
+            usleep(DECBENCH_CONGESTED_WAIT_US);
+        }
+        uint64_t submit_ready = raop_ntp_get_local_time(NULL);
+        pts = submit_ready;
+        renderer->funcs->render_buffer(renderer, NULL, unit->data, unit->size, pts, 1, &unit->nal_index);
+        uint64_t submit_end = raop_ntp_get_local_time(NULL);
+        frames++;
+
+        if (frames == warmup_frames) {
+            measure_start_time = submit_end;
+            measure_start_cpu = process_cpu_time_us();
+        } else if (frames > warmup_frames) {
+            histogram_record(&submit_histogram, submit_end - submit_start);
+            congested_us += submit_ready - submit_start;
+            measured_frames++;
+            measured_bytes += unit->size;
+        }
+        if ((max_frames && frames >= max_frames) || (end_time && submit_end >= end_time)) {
+            break;
+        }
+    }
+    uint64_t measure_end_time = raop_ntp_get_local_time(NULL);
+    uint64_t measure_end_cpu = process_cpu_time_us();
+
+    int ret = 0;
+    if (measured_frames > 0) {
+        double seconds = (measure_end_time - measure_start_time) / 1000000.0;
+        double cpu_seconds = (measure_end_cpu - measure_start_cpu) / 1000000.0;
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cores < 1) cores = 1;
+        logger_log(logger, LOGGER_INFO, "Fed %lld frames after %d warmup frames in %.2f s: %.1f fps, %.2f Mbit/s",
+                   measured_frames, warmup_frames, seconds, measured_frames / seconds,
+                   measured_bytes * 8 / seconds / 1000000.0);
+        logger_log(logger, LOGGER_INFO, "Submit latency p50 %u us, p90 %u us, p99 %u us, max %u us, "
+                   "%.1f%% of the time waiting for a congested renderer",
+                   histogram_percentile(&submit_histogram, 50), histogram_percentile(&submit_histogram, 90),
+                   histogram_percentile(&submit_histogram, 99), histogram_percentile(&submit_histogram, 100),
+                   100.0 * congested_us / (measure_end_time - measure_start_time));
+        logger_log(logger, LOGGER_INFO, "CPU time %.2f s: %.1f%% of one core, %.1f%% of all %ld, %.0f us per frame",
+                   cpu_seconds, 100.0 * cpu_seconds / seconds, 100.0 * cpu_seconds / seconds / cores, cores,
+                   cpu_seconds * 1000000.0 / measured_frames);
+        histogram_log(&submit_histogram, logger, LOGGER_DEBUG, "Submit latency");
+    } else {
+        logger_log(logger, LOGGER_ERR, "No frames fed after the %d warmup frames", warmup_frames);
+        ret = 1;
+    }
+
+    renderer->funcs->flush(renderer);
+    renderer->funcs->destroy(renderer);
+    logger_destroy(logger);
+    free_stream(&stream);
+    return ret;
+}
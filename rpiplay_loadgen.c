@@ -0,0 +1,1295 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Synthetic AirPlay mirroring senders for load testing a running rpiplay. Every client goes
+ * through /info, pair-setup, pair-verify, fp-setup and the SETUP requests like an iPhone would,
+ * then streams the H.264 video and AAC-ELD audio of a trace recorded with rpiplay -trace, looped
+ * and encrypted with its own session keys, optionally padded up to a given video bitrate. With
+ * -tc the video is replaced with a generated timecode video rpiplay -tc measures latency from.
+ *
+ * There is no FairPlay encryption on this side: the client sends a random ekey and derives the
+ * AES key the receiver will get out of it by running the receiver's own playfair code on the
+ * messages it sent.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <openssl/rand.h>
+
+#include "lib/logger.h"
+#include "lib/threads.h"
+#include "lib/byteutils.h"
+#include "lib/bplist.h"
+#include "lib/histogram.h"
+#include "lib/trace.h"
+#include "lib/crypto.h"
+#include "lib/fairplay.h"
+#include "lib/mirror_buffer.h"
+#include "lib/raop_buffer.h"
+#include "lib/raop_ntp.h"
+#include "lib/timecode.h"
+
+#define DEFAULT_CLIENTS 1
+#define DEFAULT_DURATION 30
+#define LOADGEN_USER_AGENT "AirPlay/381.13"
+/* Between the starts of two clients, so the handshakes do not all land in the same instant */
+#define LOADGEN_CLIENT_STAGGER_MS 100
+#define LOADGEN_SYNC_INTERVAL_US 1000000
+#define LOADGEN_FEEDBACK_INTERVAL_US 2000000
+#define LOADGEN_RTSP_HEADER_MAX 4096
+#define LOADGEN_RTSP_BODY_MAX (1024 * 1024)
+#define LOADGEN_SAMPLE_RATE 44100
+/* The receiver takes the rtp time in a sync packet as playing this many samples after its ntp time */
+#define LOADGEN_SYNC_RTP_LATENCY 11025
+#define LOADGEN_MIRROR_HEADER_LEN 128
+/* H.264 filler data NAL: 4 byte length, NAL header and rbsp trailing bits */
+#define LOADGEN_FILLER_MIN_LEN 6
+/* Timecode video is one macroblock per timecode cell */
+#define LOADGEN_TIMECODE_WIDTH (TIMECODE_COLUMNS * 16)
+#define LOADGEN_TIMECODE_HEIGHT (TIMECODE_ROWS * 16)
+#define LOADGEN_TIMECODE_FPS 30
+#define LOADGEN_TIMECODE_PROFILE 66
+#define LOADGEN_TIMECODE_LEVEL 30
+/* Room for an escaped I_PCM slice: 384 samples and a few header bits per macroblock */
+#define LOADGEN_TIMECODE_FRAME_MAX (TIMECODE_COLUMNS * TIMECODE_ROWS * 400 + 64)
+
+typedef enum loadgen_packet_type_e {
+    LOADGEN_PACKET_CODEC,
+    LOADGEN_PACKET_FRAME,
+    LOADGEN_PACKET_AUDIO
+} loadgen_packet_type_t;
+
+typedef struct loadgen_packet_s {
+    loadgen_packet_type_t type;
+    /* Since the first packet of the recording, in micro seconds */
+    uint64_t time;
+    /* Mirror packets with their 128 byte header, audio packets with their 12 byte rtp header, all decrypted */
+    unsigned char *data;
+    int length;
+} loadgen_packet_t;
+
+typedef struct loadgen_recording_s {
+    loadgen_packet_t *packets;
+    int count;
+    int capacity;
+    /* One pass of the loop, a little longer than the recording so its first and last packets do not coincide */
+    uint64_t duration;
+    int max_length;
+    int frames;
+    uint64_t frame_bytes;
+    int audio_packets;
+    uint64_t audio_start;
+    uint32_t audio_first_rtp;
+    /* Filler appended to every frame to reach the requested bitrate, 0 for none */
+    int filler_length;
+    /* Frames are generated when sent, showing the timecode of the time they are due */
+    bool timecode;
+} loadgen_recording_t;
+
+typedef struct loadgen_client_s {
+    int index;
+    thread_handle_t thread;
+    const char *error;
+
+    int rtsp_fd;
+    int cseq;
+    char url[128];
+    struct sockaddr_storage server_addr;
+    socklen_t server_addrlen;
+
+    unsigned char ekey[72];
+    unsigned char aeskey[16];
+    unsigned char aesiv[16];
+    unsigned char ecdh_secret[X25519_KEY_SIZE];
+    uint64_t stream_connection_id;
+
+    unsigned short mirror_port;
+    unsigned short audio_data_port;
+    unsigned short audio_control_port;
+    int mirror_fd;
+    int audio_fd;
+    mirror_buffer_t *mirror_cipher;
+    aes_ctx_t *audio_cipher;
+    uint16_t audio_seqnum;
+    uint32_t audio_rtp_base;
+
+    uint64_t handshake_time;
+    uint64_t frames_sent;
+    uint64_t audio_packets_sent;
+    uint64_t bytes_sent;
+    uint64_t stream_start;
+    uint64_t stream_end;
+    histogram_t lag_histogram;
+} loadgen_client_t;
+
+static volatile sig_atomic_t running = 1;
+static logger_t *logger = NULL;
+static loadgen_recording_t recording;
+
+static int ntp_sock = -1;
+static unsigned short ntp_port = 0;
+static atomic_int ntp_running;
+
+static void signal_handler(int sig) {
+    running = 0;
+}
+
+static void log_callback(void *cls, int level, const char *msg) {
+    printf("%s\n", msg);
+}
+
+static int send_all(int fd, const void *data, int len) {
+    const unsigned char *bytes = data;
+    while (len > 0) {
+        ssize_t sent = send(fd, bytes, len, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        bytes += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, unsigned char *data, int len) {
+    while (len > 0) {
+        ssize_t received = recv(fd, data, len, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return -1;
+        data += received;
+        len -= received;
+    }
+    return 0;
+}
+
+static void random_bytes(unsigned char *data, int len) {
+    if (RAND_bytes(data, len) != 1) {
+        for (int i = 0; i < len; i++) data[i] = rand();
+    }
+}
+
+/* The mirror stream carries the sender's wall clock as an ntp timestamp without the 1900 epoch */
+static uint64_t loadgen_mirror_timestamp(uint64_t time) {
+    uint64_t seconds = time / 1000000;
+    uint64_t fraction = ((time % 1000000) << 32) / 1000000;
+    return (seconds << 32) | fraction;
+}
+
+/* Answers the receivers' NTP requests from the local wall clock, for all clients */
+static THREAD_RETVAL loadgen_ntp_thread(void *arg) {
+    unsigned char request[128];
+    unsigned char response[32];
+    while (atomic_load_explicit(&ntp_running, memory_order_relaxed)) {
+        struct sockaddr_storage saddr;
+        socklen_t saddrlen = sizeof(saddr);
+        int len = recvfrom(ntp_sock, request, sizeof(request), 0, (struct sockaddr *) &saddr, &saddrlen);
+        uint64_t receive_time = raop_ntp_get_local_time(NULL);
+        if (len < 32) {
+            continue;
+        }
+        memset(response, 0, sizeof(response));
+        response[0] = 0x80;
+        response[1] = 0xd3;
+        response[3] = 0x07;
+        // Origin timestamp, the transmit timestamp of the request
+        memcpy(response + 8, request + 24, 8);
+        byteutils_put_ntp_timestamp(response, 16, receive_time);
+        byteutils_put_ntp_timestamp(response, 24, raop_ntp_get_local_time(NULL));
+        sendto(ntp_sock, response, sizeof(response), 0, (struct sockaddr *) &saddr, saddrlen);
+    }
+    return 0;
+}
+
+static int loadgen_recording_add(loadgen_recording_t *rec, loadgen_packet_type_t type, uint64_t time,
+                                 const unsigned char *data, int length) {
+    if (rec->count == rec->capacity) {
+        int capacity = rec->capacity ? rec->capacity * 2 : 4096;
+        loadgen_packet_t *packets = realloc(rec->packets, capacity * sizeof(loadgen_packet_t));
+        if (!packets) {
+            return -1;
+        }
+        rec->packets = packets;
+        rec->capacity = capacity;
+    }
+    loadgen_packet_t *packet = &rec->packets[rec->count];
+    packet->data = malloc(length);
+    if (!packet->data) {
+        return -1;
+    }
+    memcpy(packet->data, data, length);
+    packet->type = type;
+    packet->time = time;
+    packet->length = length;
+    if (length > rec->max_length) rec->max_length = length;
+    rec->count++;
+    return 0;
+}
+
+/*
+ * Decrypts the video and audio of the first session of the trace with its recorded keys, the
+ * clients encrypt them again with their own
+ */
+static int loadgen_read_recording(trace_reader_t *reader, loadgen_recording_t *rec) {
+    trace_session_keys_t keys;
+    bool have_keys = false;
+    mirror_buffer_t *mirror_buffer = NULL;
+    raop_buffer_t *raop_buffer = NULL;
+    unsigned char *payload = NULL;
+    int payload_capacity = 0;
+    uint64_t first_time = 0;
+    bool have_first_time = false;
+    int ret = 0;
+
+    trace_record_header_t header;
+    const unsigned char *data;
+    while ((data = trace_reader_next(reader, &header))) {
+        if (header.type == TRACE_RECORD_SESSION_KEYS) {
+            if (have_keys || header.length != sizeof(keys)) break;
+            memcpy(&keys, data, sizeof(keys));
+            have_keys = true;
+            raop_buffer = raop_buffer_init(logger, 32, keys.aeskey, keys.aesiv, keys.ecdh_secret);
+            continue;
+        }
+        if (!have_keys) {
+            continue;
+        }
+        if (header.type == TRACE_RECORD_MIRROR_STREAM && header.length == sizeof(uint64_t)) {
+            uint64_t stream_connection_id;
+            memcpy(&stream_connection_id, data, sizeof(stream_connection_id));
+            mirror_buffer_destroy(mirror_buffer);
+            mirror_buffer = mirror_buffer_init(logger, keys.aeskey, keys.ecdh_secret);
+            mirror_buffer_init_aes(mirror_buffer, stream_connection_id);
+            continue;
+        }
+        bool is_mirror = header.type == TRACE_RECORD_MIRROR_PACKET && header.length >= LOADGEN_MIRROR_HEADER_LEN &&
+                         mirror_buffer && (data[4] == 0 || data[4] == 1);
+        // Packets of 16 bytes and less carry no audio
+        bool is_audio = header.type == TRACE_RECORD_RTP_DATA && header.length > 16 && raop_buffer;
+        if (!is_mirror && !is_audio) {
+            continue;
+        }
+        if ((int) header.length > payload_capacity) {
+            payload_capacity = header.length * 2;
+            unsigned char *buffer = realloc(payload, payload_capacity);
+            if (!buffer) {
+                ret = -1;
+                break;
+            }
+            payload = buffer;
+        }
+        if (!have_first_time) {
+            first_time = header.time;
+            have_first_time = true;
+        }
+        // Records of different threads may be a little out of order
+        uint64_t time = header.time > first_time ? header.time - first_time : 0;
+        if (is_mirror) {
+            memcpy(payload, data, header.length);
+            if (data[4] == 0) {
+                mirror_buffer_decrypt(mirror_buffer, payload + LOADGEN_MIRROR_HEADER_LEN,
+                                      payload + LOADGEN_MIRROR_HEADER_LEN, header.length - LOADGEN_MIRROR_HEADER_LEN);
+                rec->frames++;
+                rec->frame_bytes += header.length - LOADGEN_MIRROR_HEADER_LEN;
+            }
+            ret = loadgen_recording_add(rec, data[4] == 0 ? LOADGEN_PACKET_FRAME : LOADGEN_PACKET_CODEC, time,
+                                        payload, header.length);
+        } else {
+            unsigned int payload_size;
+            memcpy(payload, data, 12);
+            raop_buffer_decrypt(raop_buffer, (unsigned char *) data, payload + 12, header.length - 12, &payload_size);
+            if (rec->audio_packets == 0) {
+                rec->audio_start = time;
+                rec->audio_first_rtp = byteutils_get_int_be(payload, 4);
+            }
+            rec->audio_packets++;
+            ret = loadgen_recording_add(rec, LOADGEN_PACKET_AUDIO, time, payload, 12 + payload_size);
+        }
+        if (ret < 0) {
+            break;
+        }
+    }
+    mirror_buffer_destroy(mirror_buffer);
+    raop_buffer_destroy(raop_buffer);
+    free(payload);
+    if (ret < 0 || rec->count == 0) {
+        return -1;
+    }
+    uint64_t span = rec->packets[rec->count - 1].time;
+    rec->duration = span + (rec->count > 1 ? span / (rec->count - 1) : 1000000);
+    return 0;
+}
+
+/* Pads the frames with filler data so the video alone reaches bitrate, the decoders skip it */
+static void loadgen_set_bitrate(loadgen_recording_t *rec, int kbps) {
+    if (kbps <= 0 || rec->frames == 0) {
+        return;
+    }
+    uint64_t target_bytes = (uint64_t) kbps * 125 * rec->duration / 1000000;
+    if (target_bytes <= rec->frame_bytes) {
+        logger_log(logger, LOGGER_WARNING, "The recording already runs at %llu kbit/s, sending it unpadded",
+                   (unsigned long long) (rec->frame_bytes * 8000 / rec->duration));
+        return;
+    }
+    int filler_length = (int) ((target_bytes - rec->frame_bytes) / rec->frames);
+    rec->filler_length = filler_length >= LOADGEN_FILLER_MIN_LEN ? filler_length : 0;
+    if (rec->filler_length) {
+        logger_log(logger, LOGGER_INFO, "Padding every frame with %d bytes of filler data for %d kbit/s of video",
+                   rec->filler_length, kbps);
+    }
+}
+
+static void loadgen_write_filler(unsigned char *data, int length) {
+    int nal_size = length - 4;
+    data[0] = nal_size >> 24;
+    data[1] = nal_size >> 16;
+    data[2] = nal_size >> 8;
+    data[3] = nal_size;
+    data[4] = 0x0c;
+    memset(data + 5, 0xff, length - LOADGEN_FILLER_MIN_LEN);
+    data[length - 1] = 0x80;
+}
+
+/* Writes the rbsp of a NAL unit MSB first, data has to start out zeroed */
+typedef struct loadgen_bits_s {
+    unsigned char *data;
+    int bits;
+} loadgen_bits_t;
+
+static void loadgen_put_bits(loadgen_bits_t *b, uint32_t value, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        if ((value >> i) & 1) {
+            b->data[b->bits / 8] |= 0x80 >> (b->bits % 8);
+        }
+        b->bits++;
+    }
+}
+
+/* Exp-Golomb code of value */
+static void loadgen_put_ue(loadgen_bits_t *b, uint32_t value) {
+    int length = 32 - __builtin_clz(value + 1);
+    loadgen_put_bits(b, 0, length - 1);
+    loadgen_put_bits(b, value + 1, length);
+}
+
+static void loadgen_align_bits(loadgen_bits_t *b) {
+    b->bits = (b->bits + 7) / 8 * 8;
+}
+
+/* rbsp_trailing_bits, returns the rbsp length */
+static int loadgen_finish_bits(loadgen_bits_t *b) {
+    loadgen_put_bits(b, 1, 1);
+    loadgen_align_bits(b);
+    return b->bits / 8;
+}
+
+/* Escapes an rbsp into a NAL unit behind a 4 byte length, returns the bytes written */
+static int loadgen_write_nal(unsigned char *data, const unsigned char *rbsp, int rbsp_length) {
+    int length = 4;
+    int zeros = 0;
+    for (int i = 0; i < rbsp_length; i++) {
+        if (zeros == 2 && rbsp[i] <= 3) {
+            data[length++] = 0x03;
+            zeros = 0;
+        }
+        data[length++] = rbsp[i];
+        zeros = rbsp[i] ? 0 : zeros + 1;
+    }
+    int nal_size = length - 4;
+    data[0] = nal_size >> 24;
+    data[1] = nal_size >> 16;
+    data[2] = nal_size >> 8;
+    data[3] = nal_size;
+    return length;
+}
+
+/*
+ * Codec packet payload (an avcC record) for the timecode video: constrained baseline, one
+ * reference frame, picture order from the decoding order and deblocking left to the slices
+ */
+static int loadgen_timecode_codec(unsigned char *data) {
+    unsigned char sps_rbsp[32] = { 0x67, LOADGEN_TIMECODE_PROFILE, 0xc0, LOADGEN_TIMECODE_LEVEL };
+    loadgen_bits_t b = { sps_rbsp, 32 };
+    loadgen_put_ue(&b, 0); // seq_parameter_set_id
+    loadgen_put_ue(&b, 0); // log2_max_frame_num_minus4
+    loadgen_put_ue(&b, 2); // pic_order_cnt_type
+    loadgen_put_ue(&b, 1); // max_num_ref_frames
+    loadgen_put_bits(&b, 0, 1); // gaps_in_frame_num_value_allowed_flag
+    loadgen_put_ue(&b, LOADGEN_TIMECODE_WIDTH / 16 - 1);
+    loadgen_put_ue(&b, LOADGEN_TIMECODE_HEIGHT / 16 - 1);
+    loadgen_put_bits(&b, 1, 1); // frame_mbs_only_flag
+    loadgen_put_bits(&b, 1, 1); // direct_8x8_inference_flag
+    loadgen_put_bits(&b, 0, 1); // frame_cropping_flag
+    loadgen_put_bits(&b, 0, 1); // vui_parameters_present_flag
+    int sps_length = loadgen_finish_bits(&b);
+
+    unsigned char pps_rbsp[16] = { 0x68 };
+    b.data = pps_rbsp;
+    b.bits = 8;
+    loadgen_put_ue(&b, 0); // pic_parameter_set_id
+    loadgen_put_ue(&b, 0); // seq_parameter_set_id
+    loadgen_put_bits(&b, 0, 2); // CAVLC, bottom_field_pic_order_in_frame_present_flag
+    loadgen_put_ue(&b, 0); // num_slice_groups_minus1
+    loadgen_put_ue(&b, 0); // num_ref_idx_l0_default_active_minus1
+    loadgen_put_ue(&b, 0); // num_ref_idx_l1_default_active_minus1
+    loadgen_put_bits(&b, 0, 3); // weighted_pred_flag, weighted_bipred_idc
+    loadgen_put_ue(&b, 0); // pic_init_qp_minus26, se(0)
+    loadgen_put_ue(&b, 0); // pic_init_qs_minus26, se(0)
+    loadgen_put_ue(&b, 0); // chroma_qp_index_offset, se(0)
+    loadgen_put_bits(&b, 1, 1); // deblocking_filter_control_present_flag
+    loadgen_put_bits(&b, 0, 2); // constrained_intra_pred_flag, redundant_pic_cnt_present_flag
+    int pps_length = loadgen_finish_bits(&b);
+
+    unsigned char nal[64];
+    int length = 0;
+    data[length++] = 1;
+    data[length++] = LOADGEN_TIMECODE_PROFILE;
+    data[length++] = 0xc0;
+    data[length++] = LOADGEN_TIMECODE_LEVEL;
+    data[length++] = 0xff; // 4 byte NAL lengths
+    data[length++] = 0xe1; // One SPS
+    int nal_length = loadgen_write_nal(nal, sps_rbsp, sps_length) - 4;
+    data[length++] = nal_length >> 8;
+    data[length++] = nal_length;
+    memcpy(data + length, nal + 4, nal_length);
+    length += nal_length;
+    data[length++] = 1; // One PPS
+    nal_length = loadgen_write_nal(nal, pps_rbsp, pps_length) - 4;
+    data[length++] = nal_length >> 8;
+    data[length++] = nal_length;
+    memcpy(data + length, nal + 4, nal_length);
+    return length + nal_length;
+}
+
+/*
+ * An IDR frame showing the timecode of time, every macroblock I_PCM so the receiver decodes
+ * exactly the samples written here whatever its decoder. Returns the bytes written to data.
+ */
+static int loadgen_timecode_frame(unsigned char *data, uint64_t time, int idr_pic_id) {
+    static const int mbs = LOADGEN_TIMECODE_WIDTH / 16 * LOADGEN_TIMECODE_HEIGHT / 16;
+    unsigned char luma[LOADGEN_TIMECODE_WIDTH * LOADGEN_TIMECODE_HEIGHT];
+    unsigned char rbsp[LOADGEN_TIMECODE_FRAME_MAX];
+    timecode_render(luma, LOADGEN_TIMECODE_WIDTH, LOADGEN_TIMECODE_HEIGHT, LOADGEN_TIMECODE_WIDTH, time);
+
+    memset(rbsp, 0, sizeof(rbsp));
+    rbsp[0] = 0x65;
+    loadgen_bits_t b = { rbsp, 8 };
+    loadgen_put_ue(&b, 0); // first_mb_in_slice
+    loadgen_put_ue(&b, 7); // I slice, and so are all others
+    loadgen_put_ue(&b, 0); // pic_parameter_set_id
+    loadgen_put_bits(&b, 0, 4); // frame_num
+    // Consecutive IDR pictures must differ in idr_pic_id
+    loadgen_put_ue(&b, idr_pic_id & 0xffff);
+    loadgen_put_bits(&b, 0, 2); // no_output_of_prior_pics_flag, long_term_reference_flag
+    loadgen_put_ue(&b, 0); // slice_qp_delta, se(0)
+    loadgen_put_ue(&b, 1); // disable_deblocking_filter_idc
+    for (int mb = 0; mb < mbs; mb++) {
+        loadgen_put_ue(&b, 25); // I_PCM
+        loadgen_align_bits(&b);
+        int mb_x = mb % (LOADGEN_TIMECODE_WIDTH / 16) * 16;
+        int mb_y = mb / (LOADGEN_TIMECODE_WIDTH / 16) * 16;
+        for (int y = 0; y < 16; y++) {
+            memcpy(rbsp + b.bits / 8, luma + (mb_y + y) * LOADGEN_TIMECODE_WIDTH + mb_x, 16);
+            b.bits += 16 * 8;
+        }
+        // Neutral chroma for both 8x8 planes
+        memset(rbsp + b.bits / 8, 128, 2 * 64);
+        b.bits += 2 * 64 * 8;
+    }
+    return loadgen_write_nal(data, rbsp, loadgen_finish_bits(&b));
+}
+
+/*
+ * Replaces the video of the recording with the timecode video at LOADGEN_TIMECODE_FPS, the
+ * audio stays. The frames only get their picture when sent.
+ */
+static int loadgen_use_timecode(loadgen_recording_t *rec) {
+    loadgen_recording_t timecode;
+    memset(&timecode, 0, sizeof(timecode));
+    unsigned char packet[LOADGEN_MIRROR_HEADER_LEN + 128];
+    memset(packet, 0, sizeof(packet));
+    int32_t payload_size = loadgen_timecode_codec(packet + LOADGEN_MIRROR_HEADER_LEN);
+    memcpy(packet, &payload_size, sizeof(payload_size));
+    packet[4] = 1;
+    float width = LOADGEN_TIMECODE_WIDTH, height = LOADGEN_TIMECODE_HEIGHT;
+    memcpy(packet + 40, &width, sizeof(width));
+    memcpy(packet + 44, &height, sizeof(height));
+    memcpy(packet + 56, &width, sizeof(width));
+    memcpy(packet + 60, &height, sizeof(height));
+    if (loadgen_recording_add(&timecode, LOADGEN_PACKET_CODEC, 0, packet, LOADGEN_MIRROR_HEADER_LEN + payload_size) < 0) {
+        return -1;
+    }
+
+    unsigned char *frame = malloc(LOADGEN_TIMECODE_FRAME_MAX);
+    if (!frame) {
+        return -1;
+    }
+    int frame_length = loadgen_timecode_frame(frame, 1, 0);
+    free(frame);
+    memset(packet, 0, LOADGEN_MIRROR_HEADER_LEN);
+    int ret = 0;
+    int i = 0;
+    for (uint64_t k = 0; ret == 0; k++) {
+        uint64_t time = k * 1000000 / LOADGEN_TIMECODE_FPS;
+        bool more_frames = time < rec->duration;
+        for (; ret == 0 && i < rec->count && (!more_frames || rec->packets[i].time <= time); i++) {
+            const loadgen_packet_t *audio = &rec->packets[i];
+            if (audio->type == LOADGEN_PACKET_AUDIO) {
+                ret = loadgen_recording_add(&timecode, audio->type, audio->time, audio->data, audio->length);
+            }
+        }
+        if (!more_frames) {
+            break;
+        }
+        if (ret == 0) {
+            ret = loadgen_recording_add(&timecode, LOADGEN_PACKET_FRAME, time, packet, LOADGEN_MIRROR_HEADER_LEN);
+        }
+        timecode.frames++;
+        timecode.frame_bytes += frame_length;
+    }
+    for (i = 0; i < rec->count; i++) {
+        free(rec->packets[i].data);
+    }
+    free(rec->packets);
+    if (ret < 0) {
+        return -1;
+    }
+    timecode.duration = rec->duration;
+    timecode.audio_packets = rec->audio_packets;
+    timecode.audio_start = rec->audio_start;
+    timecode.audio_first_rtp = rec->audio_first_rtp;
+    if (timecode.max_length < LOADGEN_MIRROR_HEADER_LEN + LOADGEN_TIMECODE_FRAME_MAX) {
+        timecode.max_length = LOADGEN_MIRROR_HEADER_LEN + LOADGEN_TIMECODE_FRAME_MAX;
+    }
+    timecode.timecode = true;
+    *rec = timecode;
+    return 0;
+}
+
+static void loadgen_server_address(const loadgen_client_t *client, unsigned short port, struct sockaddr_storage *addr) {
+    memcpy(addr, &client->server_addr, client->server_addrlen);
+    if (addr->ss_family == AF_INET6) {
+        ((struct sockaddr_in6 *) addr)->sin6_port = htons(port);
+    } else {
+        ((struct sockaddr_in *) addr)->sin_port = htons(port);
+    }
+}
+
+static int loadgen_connect(loadgen_client_t *client, int type, unsigned short port) {
+    struct sockaddr_storage addr;
+    loadgen_server_address(client, port, &addr);
+    int fd = socket(addr.ss_family, type, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &addr, client->server_addrlen) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (type == SOCK_STREAM) {
+        int option = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+    }
+    return fd;
+}
+
+/*
+ * Sends an RTSP request and reads the response of a successful one, the body is malloc'ed and
+ * NULL when there is none
+ */
+static int loadgen_request(loadgen_client_t *client, const char *method, const char *url, const char *content_type,
+                           const void *body, int body_len, unsigned char **response, int *response_len) {
+    char header[LOADGEN_RTSP_HEADER_MAX + 1];
+    int header_len = snprintf(header, sizeof(header), "%s %s RTSP/1.0\r\nCSeq: %d\r\nUser-Agent: %s\r\n",
+                              method, url, ++client->cseq, LOADGEN_USER_AGENT);
+    if (body_len > 0) {
+        header_len += snprintf(header + header_len, sizeof(header) - header_len,
+                               "Content-Type: %s\r\nContent-Length: %d\r\n", content_type, body_len);
+    }
+    header_len += snprintf(header + header_len, sizeof(header) - header_len, "\r\n");
+    if (send_all(client->rtsp_fd, header, header_len) < 0 ||
+        (body_len > 0 && send_all(client->rtsp_fd, body, body_len) < 0)) {
+        return -1;
+    }
+
+    // The header ends at the first empty line, whatever was read past it belongs to the body
+    int used = 0;
+    char *end = NULL;
+    while (!end) {
+        if (used == LOADGEN_RTSP_HEADER_MAX) {
+            return -1;
+        }
+        ssize_t received = recv(client->rtsp_fd, header + used, LOADGEN_RTSP_HEADER_MAX - used, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) {
+            return -1;
+        }
+        used += received;
+        header[used] = '\0';
+        end = strstr(header, "\r\n\r\n");
+    }
+    int body_start = (int) (end - header) + 4;
+    *end = '\0';
+    if (strncmp(header, "RTSP/1.0 200", 12)) {
+        return -1;
+    }
+    int content_length = 0;
+    const char *length_header = strstr(header, "\r\nContent-Length:");
+    if (length_header) {
+        content_length = atoi(length_header + strlen("\r\nContent-Length:"));
+    }
+    if (content_length < 0 || content_length > LOADGEN_RTSP_BODY_MAX) {
+        return -1;
+    }
+    unsigned char *data = NULL;
+    if (content_length > 0) {
+        data = malloc(content_length);
+        if (!data) {
+            return -1;
+        }
+        int buffered = used - body_start < content_length ? used - body_start : content_length;
+        memcpy(data, header + body_start, buffered);
+        if (recv_all(client->rtsp_fd, data + buffered, content_length - buffered) < 0) {
+            free(data);
+            return -1;
+        }
+    }
+    if (response) {
+        *response = data;
+        *response_len = content_length;
+    } else {
+        free(data);
+    }
+    return 0;
+}
+
+static void loadgen_put_int_be(unsigned char *data, uint32_t value) {
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+/* The first 16 bytes of SHA512(prefix || secret), how both sides derive their AES keys */
+static void loadgen_derive_key(const unsigned char *prefix, int prefix_len, const unsigned char *secret,
+                               unsigned char key[16]) {
+    unsigned char hash[64];
+    sha_ctx_t *ctx = sha_init();
+    sha_update(ctx, prefix, prefix_len);
+    sha_update(ctx, secret, X25519_KEY_SIZE);
+    sha_final(ctx, hash, NULL);
+    sha_destroy(ctx);
+    memcpy(key, hash, 16);
+}
+
+/* pair-setup and pair-verify, leaves the shared ECDH secret in the client */
+static int loadgen_pair(loadgen_client_t *client) {
+    static const char salt_key[] = "Pair-Verify-AES-Key";
+    static const char salt_iv[] = "Pair-Verify-AES-IV";
+    ed25519_key_t *ed_ours = ed25519_key_generate();
+    x25519_key_t *ecdh_ours = x25519_key_generate();
+    ed25519_key_t *ed_theirs = NULL;
+    x25519_key_t *ecdh_theirs = NULL;
+    aes_ctx_t *aes_ctx = NULL;
+    unsigned char *response = NULL;
+    int response_len = 0;
+    int ret = -1;
+
+    unsigned char verify[4 + 2 * X25519_KEY_SIZE] = { 1, 0, 0, 0 };
+    x25519_key_get_raw(verify + 4, ecdh_ours);
+    ed25519_key_get_raw(verify + 4 + X25519_KEY_SIZE, ed_ours);
+
+    client->error = "pair-setup";
+    if (loadgen_request(client, "POST", "/pair-setup", "application/octet-stream", verify + 4 + X25519_KEY_SIZE,
+                        ED25519_KEY_SIZE, &response, &response_len) < 0 || response_len != ED25519_KEY_SIZE) {
+        goto cleanup;
+    }
+    ed_theirs = ed25519_key_from_raw(response);
+    free(response);
+    response = NULL;
+
+    client->error = "pair-verify";
+    if (loadgen_request(client, "POST", "/pair-verify", "application/octet-stream", verify, sizeof(verify),
+                        &response, &response_len) < 0 || response_len != X25519_KEY_SIZE + 64) {
+        goto cleanup;
+    }
+    ecdh_theirs = x25519_key_from_raw(response);
+    x25519_derive_secret(client->ecdh_secret, ecdh_ours, ecdh_theirs);
+
+    unsigned char key[16];
+    unsigned char iv[16];
+    loadgen_derive_key((const unsigned char *) salt_key, strlen(salt_key), client->ecdh_secret, key);
+    loadgen_derive_key((const unsigned char *) salt_iv, strlen(salt_iv), client->ecdh_secret, iv);
+    aes_ctx = aes_ctr_init(key, iv);
+
+    // The receiver signed both public ECDH keys, its own first, with the first 64 bytes of the key stream
+    unsigned char signature[64];
+    unsigned char message[2 * X25519_KEY_SIZE];
+    aes_ctr_decrypt(aes_ctx, response + X25519_KEY_SIZE, signature, sizeof(signature));
+    memcpy(message, response, X25519_KEY_SIZE);
+    memcpy(message + X25519_KEY_SIZE, verify + 4, X25519_KEY_SIZE);
+    if (!ed25519_verify(signature, sizeof(signature), message, sizeof(message), ed_theirs)) {
+        client->error = "pair-verify signature check";
+        goto cleanup;
+    }
+
+    // And the sender signs them the other way round, with the next 64
+    unsigned char finish[4 + 64] = { 0, 0, 0, 0 };
+    memcpy(message, verify + 4, X25519_KEY_SIZE);
+    memcpy(message + X25519_KEY_SIZE, response, X25519_KEY_SIZE);
+    ed25519_sign(finish + 4, 64, message, sizeof(message), ed_ours);
+    aes_ctr_encrypt(aes_ctx, finish + 4, finish + 4, 64);
+    if (loadgen_request(client, "POST", "/pair-verify", "application/octet-stream", finish, sizeof(finish),
+                        NULL, NULL) < 0) {
+        goto cleanup;
+    }
+    client->error = NULL;
+    ret = 0;
+
+    cleanup:
+    free(response);
+    aes_ctr_destroy(aes_ctx);
+    x25519_key_destroy(ecdh_theirs);
+    x25519_key_destroy(ecdh_ours);
+    ed25519_key_destroy(ed_theirs);
+    ed25519_key_destroy(ed_ours);
+    return ret;
+}
+
+/* Both fp-setup phases, then picks an ekey and works out the AES key the receiver will decrypt from it */
+static int loadgen_fairplay(loadgen_client_t *client) {
+    unsigned char *response = NULL;
+    int response_len = 0;
+
+    unsigned char setup[16] = { 'F', 'P', 'L', 'Y', 0x03, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x04, 0x02, 0x00,
+                                client->index % 4, 0xbb };
+    unsigned char setup_response[142];
+    client->error = "fp-setup";
+    if (loadgen_request(client, "POST", "/fp-setup", "application/octet-stream", setup, sizeof(setup),
+                        &response, &response_len) < 0 || response_len != sizeof(setup_response)) {
+        free(response);
+        return -1;
+    }
+    memcpy(setup_response, response, sizeof(setup_response));
+    free(response);
+
+    // The receiver keeps the whole second message as the key material and echoes its last 20 bytes,
+    // the message starts with the mode again
+    unsigned char handshake[164] = { 'F', 'P', 'L', 'Y', 0x03, 0x01, 0x03, 0x00, 0x00, 0x00, 0x00, 0x98 };
+    handshake[12] = setup[14];
+    random_bytes(handshake + 13, sizeof(handshake) - 13);
+    unsigned char handshake_response[32];
+    if (loadgen_request(client, "POST", "/fp-setup", "application/octet-stream", handshake, sizeof(handshake),
+                        &response, &response_len) < 0 || response_len != sizeof(handshake_response) ||
+        memcmp(response + 12, handshake + 144, 20)) {
+        free(response);
+        return -1;
+    }
+    memcpy(handshake_response, response, sizeof(handshake_response));
+    free(response);
+
+    static const unsigned char ekey_header[12] = { 'F', 'P', 'L', 'Y', 0x01, 0x02, 0x01, 0x00, 0x00, 0x00, 0x00, 0x3c };
+    memcpy(client->ekey, ekey_header, sizeof(ekey_header));
+    random_bytes(client->ekey + sizeof(ekey_header), sizeof(client->ekey) - sizeof(ekey_header));
+    fairplay_t *fairplay = fairplay_init(logger);
+    if (!fairplay || fairplay_setup(fairplay, setup, setup_response) < 0 ||
+        fairplay_handshake(fairplay, handshake, handshake_response) < 0 ||
+        fairplay_decrypt(fairplay, client->ekey, client->aeskey) < 0) {
+        client->error = "FairPlay key derivation";
+        fairplay_destroy(fairplay);
+        return -1;
+    }
+    fairplay_destroy(fairplay);
+    client->error = NULL;
+    return 0;
+}
+
+/* Sends a SETUP with the plist under root, the response body is left for the caller to free */
+static int loadgen_setup_request(loadgen_client_t *client, bplist_writer_t *writer, int root,
+                                 unsigned char **response, int *response_len) {
+    char *body = NULL;
+    uint32_t body_len = 0;
+    if (bplist_write(writer, root, &body, &body_len) < 0) {
+        return -1;
+    }
+    *response = NULL;
+    int ret = loadgen_request(client, "SETUP", client->url, "application/x-apple-binary-plist", body, body_len,
+                              response, response_len);
+    free(body);
+    if (ret < 0 || !*response) {
+        free(*response);
+        *response = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/* A port of the single stream in a SETUP response, 0 if it has none */
+static unsigned short loadgen_stream_port(const unsigned char *response, int response_len, const char *key) {
+    bplist_t plist;
+    if (bplist_parse(&plist, response, response_len) < 0) {
+        return 0;
+    }
+    int streams_node = bplist_dict_get(&plist, bplist_root(&plist), "streams");
+    uint64_t port = 0;
+    bplist_get_uint(&plist, bplist_dict_get(&plist, bplist_array_get_item(&plist, streams_node, 0), key), &port);
+    return (unsigned short) port;
+}
+
+/* The keys and timing SETUP, then one SETUP each for the mirror and the audio stream, and RECORD */
+static int loadgen_setup(loadgen_client_t *client) {
+    bplist_writer_t writer;
+    unsigned char *response = NULL;
+    int response_len = 0;
+
+    random_bytes(client->aesiv, sizeof(client->aesiv));
+    bplist_writer_init(&writer);
+    int root = bplist_new_dict(&writer);
+    bplist_dict_set(&writer, root, "ekey", bplist_new_data(&writer, client->ekey, sizeof(client->ekey)));
+    bplist_dict_set(&writer, root, "eiv", bplist_new_data(&writer, client->aesiv, sizeof(client->aesiv)));
+    bplist_dict_set(&writer, root, "timingPort", bplist_new_uint(&writer, ntp_port));
+    bplist_dict_set(&writer, root, "isScreenMirroringSession", bplist_new_bool(&writer, 1));
+    client->error = "SETUP of the keys";
+    if (loadgen_setup_request(client, &writer, root, &response, &response_len) < 0) {
+        return -1;
+    }
+    free(response);
+
+    random_bytes((unsigned char *) &client->stream_connection_id, sizeof(client->stream_connection_id));
+    client->stream_connection_id >>= 1;
+    bplist_writer_init(&writer);
+    root = bplist_new_dict(&writer);
+    int streams_node = bplist_new_array(&writer);
+    int stream_node = bplist_new_dict(&writer);
+    bplist_dict_set(&writer, stream_node, "type", bplist_new_uint(&writer, 110));
+    bplist_dict_set(&writer, stream_node, "streamConnectionID", bplist_new_uint(&writer, client->stream_connection_id));
+    bplist_array_append(&writer, streams_node, stream_node);
+    bplist_dict_set(&writer, root, "streams", streams_node);
+    client->error = "SETUP of the mirror stream";
+    if (loadgen_setup_request(client, &writer, root, &response, &response_len) < 0) {
+        return -1;
+    }
+    client->mirror_port = loadgen_stream_port(response, response_len, "dataPort");
+    free(response);
+    if (!client->mirror_port) {
+        return -1;
+    }
+
+    // Sync packets go out from the same socket as the audio, so the receiver's resend requests come back to it
+    struct sockaddr_storage addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.ss_family = client->server_addr.ss_family;
+    socklen_t addrlen = client->server_addrlen;
+    client->audio_fd = socket(addr.ss_family, SOCK_DGRAM, 0);
+    if (client->audio_fd == -1 || bind(client->audio_fd, (struct sockaddr *) &addr, addrlen) == -1 ||
+        getsockname(client->audio_fd, (struct sockaddr *) &addr, &addrlen) == -1) {
+        client->error = "audio socket";
+        return -1;
+    }
+    unsigned short control_port = ntohs(addr.ss_family == AF_INET6 ? ((struct sockaddr_in6 *) &addr)->sin6_port :
+                                        ((struct sockaddr_in *) &addr)->sin_port);
+    bplist_writer_init(&writer);
+    root = bplist_new_dict(&writer);
+    streams_node = bplist_new_array(&writer);
+    stream_node = bplist_new_dict(&writer);
+    bplist_dict_set(&writer, stream_node, "type", bplist_new_uint(&writer, 96));
+    // AAC-ELD, 480 samples per frame
+    bplist_dict_set(&writer, stream_node, "ct", bplist_new_uint(&writer, 8));
+    bplist_dict_set(&writer, stream_node, "spf", bplist_new_uint(&writer, 480));
+    bplist_dict_set(&writer, stream_node, "controlPort", bplist_new_uint(&writer, control_port));
+    bplist_array_append(&writer, streams_node, stream_node);
+    bplist_dict_set(&writer, root, "streams", streams_node);
+    client->error = "SETUP of the audio stream";
+    if (loadgen_setup_request(client, &writer, root, &response, &response_len) < 0) {
+        return -1;
+    }
+    client->audio_data_port = loadgen_stream_port(response, response_len, "dataPort");
+    client->audio_control_port = loadgen_stream_port(response, response_len, "controlPort");
+    free(response);
+    if (!client->audio_data_port || !client->audio_control_port) {
+        return -1;
+    }
+
+    client->error = "RECORD";
+    if (loadgen_request(client, "RECORD", client->url, NULL, NULL, 0, NULL, NULL) < 0) {
+        return -1;
+    }
+    client->error = "mirror connection";
+    client->mirror_fd = loadgen_connect(client, SOCK_STREAM, client->mirror_port);
+    if (client->mirror_fd == -1) {
+        return -1;
+    }
+
+    // Encrypted the way mirror_buffer_init_aes and raop_buffer_init_key_iv set up the decryption, CTR is its own inverse
+    client->mirror_cipher = mirror_buffer_init(logger, client->aeskey, client->ecdh_secret);
+    mirror_buffer_init_aes(client->mirror_cipher, client->stream_connection_id);
+    unsigned char audio_key[16];
+    loadgen_derive_key(client->aeskey, sizeof(client->aeskey), client->ecdh_secret, audio_key);
+    client->audio_cipher = aes_cbc_init(audio_key, client->aesiv, AES_ENCRYPT);
+    client->error = NULL;
+    return 0;
+}
+
+static void loadgen_send_sync(loadgen_client_t *client, const struct sockaddr_storage *addr, uint64_t now,
+                              uint32_t rtp_now, bool first) {
+    unsigned char packet[20] = { first ? 0x90 : 0x80, 0xd4, 0x00, 0x04 };
+    loadgen_put_int_be(packet + 4, rtp_now + LOADGEN_SYNC_RTP_LATENCY);
+    byteutils_put_ntp_timestamp(packet, 8, now);
+    loadgen_put_int_be(packet + 16, rtp_now + LOADGEN_SYNC_RTP_LATENCY);
+    sendto(client->audio_fd, packet, sizeof(packet), 0, (const struct sockaddr *) addr, client->server_addrlen);
+}
+
+/* Loops the recording until end_time, every packet due at its recorded offset from the start of its pass */
+static void loadgen_stream(loadgen_client_t *client, uint64_t end_time) {
+    const loadgen_recording_t *rec = &recording;
+    unsigned char *buffer = malloc(rec->max_length + rec->filler_length);
+    if (!buffer) {
+        client->error = "streaming";
+        return;
+    }
+    struct sockaddr_storage data_addr, control_addr;
+    loadgen_server_address(client, client->audio_data_port, &data_addr);
+    loadgen_server_address(client, client->audio_control_port, &control_addr);
+    random_bytes((unsigned char *) &client->audio_seqnum, sizeof(client->audio_seqnum));
+    random_bytes((unsigned char *) &client->audio_rtp_base, sizeof(client->audio_rtp_base));
+    uint32_t loop_rtp = (uint32_t) (rec->duration * LOADGEN_SAMPLE_RATE / 1000000);
+
+    uint64_t start = raop_ntp_get_local_time(NULL);
+    client->stream_start = start;
+    loadgen_send_sync(client, &control_addr, start, client->audio_rtp_base, true);
+    uint64_t next_sync = start + LOADGEN_SYNC_INTERVAL_US;
+    uint64_t next_feedback = start + LOADGEN_FEEDBACK_INTERVAL_US;
+
+    for (uint64_t loop = 0; running && !client->error; loop++) {
+        for (int i = 0; i < rec->count && running && !client->error; i++) {
+            const loadgen_packet_t *packet = &rec->packets[i];
+            uint64_t due = start + loop * rec->duration + packet->time;
+            if (due >= end_time) {
+                goto done;
+            }
+            uint64_t now = raop_ntp_get_local_time(NULL);
+            if (due > now) {
+                usleep(due - now);
+                now = raop_ntp_get_local_time(NULL);
+            }
+            histogram_record(&client->lag_histogram, now > due ? now - due : 0);
+
+            int length = packet->length;
+            memcpy(buffer, packet->data, length);
+            if (packet->type == LOADGEN_PACKET_AUDIO) {
+                uint32_t rtp = client->audio_rtp_base + (byteutils_get_int_be(buffer, 4) - rec->audio_first_rtp) +
+                               (uint32_t) loop * loop_rtp;
+                buffer[2] = client->audio_seqnum >> 8;
+                buffer[3] = client->audio_seqnum;
+                client->audio_seqnum++;
+                loadgen_put_int_be(buffer + 4, rtp);
+                aes_cbc_reset_iv(client->audio_cipher, client->aesiv);
+                aes_cbc_encrypt(client->audio_cipher, buffer + 12, buffer + 12, (length - 12) / 16 * 16);
+                sendto(client->audio_fd, buffer, length, 0, (struct sockaddr *) &data_addr, client->server_addrlen);
+                client->audio_packets_sent++;
+            } else {
+                if (packet->type == LOADGEN_PACKET_FRAME) {
+                    if (rec->timecode) {
+                        length += loadgen_timecode_frame(buffer + length, due, (int) client->frames_sent);
+                    }
+                    if (rec->filler_length) {
+                        loadgen_write_filler(buffer + length, rec->filler_length);
+                        length += rec->filler_length;
+                    }
+                    int32_t payload_size = length - LOADGEN_MIRROR_HEADER_LEN;
+                    memcpy(buffer, &payload_size, sizeof(payload_size));
+                    mirror_buffer_decrypt(client->mirror_cipher, buffer + LOADGEN_MIRROR_HEADER_LEN,
+                                          buffer + LOADGEN_MIRROR_HEADER_LEN, payload_size);
+                    client->frames_sent++;
+                }
+                uint64_t timestamp = loadgen_mirror_timestamp(due);
+                memcpy(buffer + 8, &timestamp, sizeof(timestamp));
+                if (send_all(client->mirror_fd, buffer, length) < 0) {
+                    client->error = "mirror stream";
+                }
+            }
+            client->bytes_sent += length;
+
+            if (now >= next_sync) {
+                int64_t audio_time = (int64_t) (now - start) - (int64_t) rec->audio_start;
+                loadgen_send_sync(client, &control_addr, now,
+                                  client->audio_rtp_base + (uint32_t) (audio_time * LOADGEN_SAMPLE_RATE / 1000000), false);
+                next_sync += LOADGEN_SYNC_INTERVAL_US;
+            }
+            if (now >= next_feedback) {
+                if (loadgen_request(client, "POST", "/feedback", NULL, NULL, 0, NULL, NULL) < 0) {
+                    client->error = "feedback";
+                }
+                next_feedback += LOADGEN_FEEDBACK_INTERVAL_US;
+            }
+        }
+    }
+    done:
+    client->stream_end = raop_ntp_get_local_time(NULL);
+    free(buffer);
+}
+
+typedef struct loadgen_thread_args_s {
+    loadgen_client_t *client;
+    uint64_t end_time;
+} loadgen_thread_args_t;
+
+static THREAD_RETVAL loadgen_client_thread(void *arg) {
+    loadgen_thread_args_t *args = arg;
+    loadgen_client_t *client = args->client;
+    uint64_t start = raop_ntp_get_local_time(NULL);
+    unsigned short port = ntohs(client->server_addr.ss_family == AF_INET6 ?
+                                ((struct sockaddr_in6 *) &client->server_addr)->sin6_port :
+                                ((struct sockaddr_in *) &client->server_addr)->sin_port);
+
+    client->rtsp_fd = loadgen_connect(client, SOCK_STREAM, port);
+    if (client->rtsp_fd == -1) {
+        client->error = "connect";
+    } else if (loadgen_request(client, "GET", "/info", NULL, NULL, 0, NULL, NULL) < 0) {
+        client->error = "/info";
+    } else if (loadgen_pair(client) == 0 && loadgen_fairplay(client) == 0 && loadgen_setup(client) == 0) {
+        client->handshake_time = raop_ntp_get_local_time(NULL) - start;
+        logger_log(logger, LOGGER_DEBUG, "Client %d streaming after a %.1f ms handshake", client->index,
+                   client->handshake_time / 1000.0);
+        loadgen_stream(client, args->end_time);
+        if (!client->error) {
+            loadgen_request(client, "TEARDOWN", client->url, NULL, NULL, 0, NULL, NULL);
+        }
+    }
+    if (client->error) {
+        logger_log(logger, LOGGER_ERR, "Client %d failed at %s", client->index, client->error);
+    }
+    if (client->mirror_fd != -1) close(client->mirror_fd);
+    if (client->audio_fd != -1) close(client->audio_fd);
+    if (client->rtsp_fd != -1) close(client->rtsp_fd);
+    mirror_buffer_destroy(client->mirror_cipher);
+    aes_cbc_destroy(client->audio_cipher);
+    return 0;
+}
+
+static void loadgen_histogram_add(histogram_t *sum, const histogram_t *histogram) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        atomic_store(&sum->counts[i], atomic_load(&sum->counts[i]) + atomic_load(&histogram->counts[i]));
+    }
+    atomic_store(&sum->total, atomic_load(&sum->total) + atomic_load(&histogram->total));
+    if (atomic_load(&histogram->max) > atomic_load(&sum->max)) {
+        atomic_store(&sum->max, atomic_load(&histogram->max));
+    }
+}
+
+static void print_info(char *name) {
+    printf("rpiplay_loadgen: Streams a trace recorded with rpiplay -trace to an AirPlay server from synthetic senders\n");
+    printf("Usage: %s [-c clients] [-b kbit/s] [-t seconds] [-tc] [-d] trace host port\n", name);
+    printf("Options:\n");
+    printf("-c clients            Number of senders mirroring at the same time (default %d)\n", DEFAULT_CLIENTS);
+    printf("-b kbit/s             Pad the video of every sender up to this bitrate (default as recorded)\n");
+    printf("-t seconds            How long to stream, the recording is looped (default %d)\n", DEFAULT_DURATION);
+    printf("-tc                   Send a timecode video instead of the recorded one, for rpiplay -tc\n");
+    printf("-d                    Enable debug logging\n");
+    printf("-v/-h                 Displays this help\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *positional[3] = { NULL, NULL, NULL };
+    int positional_count = 0;
+    int clients = DEFAULT_CLIENTS;
+    int bitrate = 0;
+    int duration = DEFAULT_DURATION;
+    bool timecode = false;
+    bool debug_log = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "-c")) {
+            if (i == argc - 1) continue;
+            clients = atoi(argv[++i]);
+            if (clients < 1) {
+                fprintf(stderr, "Error: At least one client is needed.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-b")) {
+            if (i == argc - 1) continue;
+            bitrate = atoi(argv[++i]);
+            if (bitrate < 0) {
+                fprintf(stderr, "Error: The bitrate must not be negative.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-t")) {
+            if (i == argc - 1) continue;
+            duration = atoi(argv[++i]);
+            if (duration < 1) {
+                fprintf(stderr, "Error: The duration must be a positive number of seconds.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-tc")) {
+            timecode = true;
+        } else if (!strcmp(arg, "-d")) {
+            debug_log = true;
+        } else if (!strcmp(arg, "-h") || !strcmp(arg, "-v")) {
+            print_info(argv[0]);
+            exit(0);
+        } else if (arg[0] != '-' && positional_count < 3) {
+            positional[positional_count++] = arg;
+        } else {
+            fprintf(stderr, "Error: Unknown option %s. Run with -h for a list.\n", arg);
+            exit(1);
+        }
+    }
+    if (positional_count < 3) {
+        print_info(argv[0]);
+        exit(1);
+    }
+    const char *trace_path = positional[0];
+
+    logger = logger_init();
+    logger_set_callback(logger, log_callback, NULL);
+    logger_set_level(logger, debug_log ? LOGGER_DEBUG : LOGGER_INFO);
+
+    trace_reader_t *reader = trace_reader_open(trace_path);
+    if (!reader) {
+        fprintf(stderr, "Error: %s is not a trace recorded with rpiplay -trace.\n", trace_path);
+        exit(1);
+    }
+    if (loadgen_read_recording(reader, &recording) < 0) {
+        fprintf(stderr, "Error: The first session of %s has no video or audio to send.\n", trace_path);
+        exit(1);
+    }
+    trace_reader_close(reader);
+    if (timecode && loadgen_use_timecode(&recording) < 0) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        exit(1);
+    }
+    loadgen_set_bitrate(&recording, bitrate);
+
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(positional[1], positional[2], &hints, &result) != 0) {
+        fprintf(stderr, "Error: Could not resolve %s port %s.\n", positional[1], positional[2]);
+        exit(1);
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    // One NTP server for all clients, the receiver asks the address the RTSP connection came from
+    struct sockaddr_storage ntp_addr;
+    memset(&ntp_addr, 0, sizeof(ntp_addr));
+    ntp_addr.ss_family = result->ai_family;
+    socklen_t ntp_addrlen = result->ai_addrlen;
+    ntp_sock = socket(result->ai_family, SOCK_DGRAM, 0);
+    if (ntp_sock == -1 || bind(ntp_sock, (struct sockaddr *) &ntp_addr, ntp_addrlen) == -1 ||
+        getsockname(ntp_sock, (struct sockaddr *) &ntp_addr, &ntp_addrlen) == -1) {
+        fprintf(stderr, "Error: Could not open the NTP socket.\n");
+        exit(1);
+    }
+    ntp_port = ntohs(ntp_addr.ss_family == AF_INET6 ? ((struct sockaddr_in6 *) &ntp_addr)->sin6_port :
+                     ((struct sockaddr_in *) &ntp_addr)->sin_port);
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;
+    setsockopt(ntp_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    thread_handle_t ntp_thread;
+    atomic_store(&ntp_running, 1);
+    THREAD_CREATE(ntp_thread, loadgen_ntp_thread, NULL);
+
+    logger_log(logger, LOGGER_INFO, "Sending a %.2f s recording of %d frames and %d audio packets to %s port %s "
+               "from %d clients for %d s", recording.duration / 1000000.0, recording.frames, recording.audio_packets,
+               positional[1], positional[2], clients, duration);
+
+    loadgen_client_t *client_list = calloc(clients, sizeof(loadgen_client_t));
+    loadgen_thread_args_t *args = calloc(clients, sizeof(loadgen_thread_args_t));
+    if (!client_list || !args) {
+        fprintf(stderr, "Error: Out of memory.\n");
+        exit(1);
+    }
+    uint64_t end_time = raop_ntp_get_local_time(NULL) + (uint64_t) duration * 1000000;
+    int started = 0;
+    for (int i = 0; i < clients && running; i++) {
+        loadgen_client_t *client = &client_list[i];
+        client->index = i + 1;
+        client->rtsp_fd = client->mirror_fd = client->audio_fd = -1;
+        memcpy(&client->server_addr, result->ai_addr, result->ai_addrlen);
+        client->server_addrlen = result->ai_addrlen;
+        unsigned char session_id[8];
+        random_bytes(session_id, sizeof(session_id));
+        snprintf(client->url, sizeof(client->url), "rtsp://%s/%llu", positional[1],
+                 (unsigned long long) byteutils_get_long(session_id, 0));
+        histogram_init(&client->lag_histogram);
+        args[i].client = client;
+        args[i].end_time = end_time;
+        THREAD_CREATE(client->thread, loadgen_client_thread, &args[i]);
+        started++;
+        sleepms(LOADGEN_CLIENT_STAGGER_MS);
+    }
+    freeaddrinfo(result);
+
+    int failed = 0;
+    uint64_t total_bytes = 0;
+    histogram_t lag_histogram, handshake_histogram;
+    histogram_init(&lag_histogram);
+    histogram_init(&handshake_histogram);
+    for (int i = 0; i < started; i++) {
+        loadgen_client_t *client = &client_list[i];
+        THREAD_JOIN(client->thread);
+        if (client->error) {
+            failed++;
+            continue;
+        }
+        double seconds = client->stream_end > client->stream_start ?
+                         (client->stream_end - client->stream_start) / 1000000.0 : 1e-6;
+        logger_log(logger, LOGGER_INFO, "Client %d: %.1f ms handshake, sent %llu frames and %llu audio packets, %.2f Mbit/s",
+                   client->index, client->handshake_time / 1000.0, (unsigned long long) client->frames_sent,
+                   (unsigned long long) client->audio_packets_sent, client->bytes_sent * 8 / seconds / 1000000.0);
+        total_bytes += client->bytes_sent;
+        histogram_record(&handshake_histogram, client->handshake_time);
+        loadgen_histogram_add(&lag_histogram, &client->lag_histogram);
+    }
+    atomic_store(&ntp_running, 0);
+    THREAD_JOIN(ntp_thread);
+    close(ntp_sock);
+
+    logger_log(logger, LOGGER_INFO, "%d of %d clients streamed, %.2f Mbit/s in total", started - failed, clients,
+               total_bytes * 8 / (double) duration / 1000000.0);
+    histogram_log(&handshake_histogram, logger, LOGGER_INFO, "loadgen handshake");
+    histogram_log(&lag_histogram, logger, LOGGER_INFO, "loadgen send lag");
+
+    for (int i = 0; i < recording.count; i++) {
+        free(recording.packets[i].data);
+    }
+    free(recording.packets);
+    free(client_list);
+    free(args);
+    logger_destroy(logger);
+    return failed > 0 || started < clients;
+}
@@ -0,0 +1,814 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Replays a trace recorded with rpiplay -trace through raop_rtp_mirror, raop_rtp and raop_buffer
+ * into the renderers, without an AirPlay sender. The recorded packets go to the loopback ports a
+ * sender would use, and a stand-in for the sender's NTP server keeps the remote clock in step with
+ * the replayed timestamps. Replays either in real time, as recorded, or as fast as the pipeline
+ * takes the packets, and reports the throughput and latency of each stage. With -netem the packets
+ * pass through simulated network impairments on their way to the ports.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "lib/logger.h"
+#include "lib/threads.h"
+#include "lib/byteutils.h"
+#include "lib/histogram.h"
+#include "lib/metrics.h"
+#include "lib/trace.h"
+#include "lib/alloc_watch.h"
+#include "lib/stream.h"
+#include "lib/raop_ntp.h"
+#include "lib/raop_rtp.h"
+#include "lib/raop_rtp_mirror.h"
+#include "renderers/renderer_list.h"
+#include "replay_netem.h"
+
+#define DEFAULT_AUDIO_BUFFER_LENGTH 32
+#define DEFAULT_VIDEO_QUEUE_DEPTH 4
+#define DEFAULT_LATENCY_TARGET 150
+/* How long the pipelines get to hand the last packets to the renderers before they are stopped */
+#define REPLAY_DRAIN_MS 1000
+/* Longest a replay as fast as possible waits for the audio pipeline to catch up, in case a packet never comes out */
+#define REPLAY_AUDIO_WAIT_US 100000
+
+typedef struct replay_record_s {
+    trace_record_header_t header;
+    const unsigned char *data;
+} replay_record_t;
+
+typedef struct replay_session_s {
+    replay_record_t *records;
+    int count;
+    trace_session_keys_t keys;
+    bool has_stream_id;
+    uint64_t stream_id;
+    int mirror_packets;
+    int audio_packets;
+} replay_session_t;
+
+typedef struct replay_stream_stats_s {
+    uint64_t packets;
+    uint64_t bytes;
+} replay_stream_stats_t;
+
+/* Where the packets of each stream go, and how many got there */
+typedef struct replay_sender_s {
+    int mirror_fd;
+    int audio_fd;
+    struct sockaddr_in data_addr;
+    struct sockaddr_in control_addr;
+    replay_stream_stats_t stats[REPLAY_STREAM_COUNT];
+} replay_sender_t;
+
+static volatile sig_atomic_t running = 1;
+static logger_t *logger = NULL;
+static video_renderer_t *video_renderer = NULL;
+static audio_renderer_t *audio_renderer = NULL;
+
+/* Written by the renderer threads of the pipelines, read once they are stopped */
+static uint64_t video_frames_rendered = 0;
+static uint64_t video_last_render_time = 0;
+static atomic_uint audio_packets_rendered;
+static uint64_t audio_last_render_time = 0;
+static histogram_t audio_submit_histogram;
+
+/*
+ * The replay clock: trace time clock_trace_time was replayed at local time clock_local_time,
+ * and the sender's clock ran remote_offset ahead of the receiver's while recording
+ */
+static mutex_handle_t clock_mutex;
+static uint64_t clock_trace_time;
+static uint64_t clock_local_time;
+static int64_t remote_offset;
+
+static int ntp_sock = -1;
+static atomic_int ntp_running;
+
+static void signal_handler(int sig) {
+    running = 0;
+}
+
+static void log_callback(void *cls, int level, const char *msg) {
+    printf("%s\n", msg);
+}
+
+static void replay_clock_set(uint64_t trace_time, uint64_t local_time) {
+    MUTEX_LOCK(clock_mutex);
+    clock_trace_time = trace_time;
+    clock_local_time = local_time;
+    MUTEX_UNLOCK(clock_mutex);
+}
+
+/* What the sender's clock read during the recording at the trace time being replayed right now */
+static uint64_t replay_remote_time(void) {
+    uint64_t now = raop_ntp_get_local_time(NULL);
+    MUTEX_LOCK(clock_mutex);
+    uint64_t trace_time = clock_trace_time + (now - clock_local_time);
+    MUTEX_UNLOCK(clock_mutex);
+    return trace_time + remote_offset;
+}
+
+/* Answers the receiver's NTP requests from the replay clock, as the sender would have */
+static THREAD_RETVAL replay_ntp_thread(void *arg) {
+    unsigned char request[128];
+    unsigned char response[32];
+    while (atomic_load_explicit(&ntp_running, memory_order_relaxed)) {
+        struct sockaddr_storage saddr;
+        socklen_t saddrlen = sizeof(saddr);
+        int len = recvfrom(ntp_sock, request, sizeof(request), 0, (struct sockaddr *) &saddr, &saddrlen);
+        if (len < 32) {
+            continue;
+        }
+        memset(response, 0, sizeof(response));
+        response[0] = 0x80;
+        response[1] = 0xd3;
+        response[3] = 0x07;
+        // Origin timestamp, the transmit timestamp of the request
+        memcpy(response + 8, request + 24, 8);
+        uint64_t remote_time = replay_remote_time();
+        byteutils_put_ntp_timestamp(response, 16, remote_time);
+        byteutils_put_ntp_timestamp(response, 24, remote_time);
+        sendto(ntp_sock, response, sizeof(response), 0, (struct sockaddr *) &saddr, saddrlen);
+    }
+    return 0;
+}
+
+/*
+ * The offset between the sender's and the receiver's clock while recording, from the recorded
+ * NTP exchange with the least delay, or failing that from the first mirror frame
+ */
+static bool replay_estimate_offset(const replay_session_t *session, int64_t *offset) {
+    int64_t best_delay = INT64_MAX;
+    for (int i = 0; i < session->count; i++) {
+        const replay_record_t *record = &session->records[i];
+        if (record->header.type != TRACE_RECORD_NTP_RESPONSE || record->header.length < 32) continue;
+        unsigned char *response = (unsigned char *) record->data;
+        int64_t t0 = (int64_t) byteutils_get_ntp_timestamp(response, 8);
+        int64_t t1 = (int64_t) byteutils_get_ntp_timestamp(response, 16);
+        int64_t t2 = (int64_t) byteutils_get_ntp_timestamp(response, 24);
+        int64_t t3 = (int64_t) record->header.time;
+        int64_t delay = (t3 - t0) - (t2 - t1);
+        if (delay < best_delay) {
+            best_delay = delay;
+            *offset = ((t1 - t0) + (t2 - t3)) / 2;
+        }
+    }
+    if (best_delay != INT64_MAX) {
+        return true;
+    }
+    for (int i = 0; i < session->count; i++) {
+        const replay_record_t *record = &session->records[i];
+        if (record->header.type == TRACE_RECORD_MIRROR_PACKET && record->header.length >= 128 &&
+            record->data[4] == 0) {
+            uint64_t remote = raop_ntp_timestamp_to_micro_seconds(byteutils_get_long((unsigned char *) record->data, 8), false);
+            *offset = (int64_t) remote - (int64_t) record->header.time;
+            return true;
+        }
+    }
+    *offset = 0;
+    return false;
+}
+
+/* Collects the records of the given session, counted from 1, the ones before its keys are unusable */
+static int replay_read_session(trace_reader_t *reader, int index, replay_session_t *session, int *sessions) {
+    int capacity = 4096;
+    int current = 0;
+    int skipped = 0;
+    trace_record_header_t header;
+    const unsigned char *data;
+
+    memset(session, 0, sizeof(*session));
+    session->records = malloc(capacity * sizeof(replay_record_t));
+    if (!session->records) {
+        return -1;
+    }
+    while ((data = trace_reader_next(reader, &header))) {
+        if (header.type == TRACE_RECORD_SESSION_KEYS) {
+            current++;
+            if (current == index && header.length == sizeof(trace_session_keys_t)) {
+                memcpy(&session->keys, data, sizeof(session->keys));
+            }
+            continue;
+        }
+        if (current == 0) {
+            skipped++;
+            continue;
+        }
+        if (current != index) {
+            continue;
+        }
+        if (header.type == TRACE_RECORD_MIRROR_STREAM && header.length == sizeof(uint64_t)) {
+            memcpy(&session->stream_id, data, sizeof(session->stream_id));
+            session->has_stream_id = true;
+        }
+        if (header.type == TRACE_RECORD_MIRROR_PACKET) session->mirror_packets++;
+        if (header.type == TRACE_RECORD_RTP_DATA) session->audio_packets++;
+        if (session->count == capacity) {
+            capacity *= 2;
+            replay_record_t *records = realloc(session->records, capacity * sizeof(replay_record_t));
+            if (!records) {
+                return -1;
+            }
+            session->records = records;
+        }
+        session->records[session->count].header = header;
+        session->records[session->count].data = data;
+        session->count++;
+    }
+    if (skipped) {
+        logger_log(logger, LOGGER_WARNING, "Skipping %d records from before the first session keys, "
+                   "the trace ring wrapped past the start of that session", skipped);
+    }
+    *sessions = current;
+    return 0;
+}
+
+/* A loopback socket on any free port */
+static int replay_socket(int type, unsigned short *port) {
+    int fd = socket(AF_INET, type, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+        getsockname(fd, (struct sockaddr *) &addr, &addrlen) == -1) {
+        close(fd);
+        return -1;
+    }
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 100000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static struct sockaddr_in replay_loopback_address(unsigned short port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    return addr;
+}
+
+/* Seconds from the start of the replay until time, never zero so rates stay finite */
+static double replay_seconds_until(uint64_t replay_start, uint64_t time) {
+    return time > replay_start ? (time - replay_start) / 1000000.0 : 1e-6;
+}
+
+static int send_all(int fd, const unsigned char *data, int len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+static void replay_send(void *cls, replay_stream_t stream, const unsigned char *data, int len) {
+    replay_sender_t *sender = cls;
+    switch (stream) {
+        case REPLAY_STREAM_MIRROR:
+            if (sender->mirror_fd == -1) return;
+            if (send_all(sender->mirror_fd, data, len) < 0) {
+                logger_log(logger, LOGGER_ERR, "The mirror connection closed after %llu packets",
+                           (unsigned long long) sender->stats[stream].packets);
+                close(sender->mirror_fd);
+                sender->mirror_fd = -1;
+                return;
+            }
+            break;
+        case REPLAY_STREAM_AUDIO:
+            if (sender->audio_fd == -1) return;
+            sendto(sender->audio_fd, data, len, 0, (struct sockaddr *) &sender->data_addr, sizeof(sender->data_addr));
+            break;
+        case REPLAY_STREAM_CONTROL:
+            if (sender->audio_fd == -1) return;
+            sendto(sender->audio_fd, data, len, 0, (struct sockaddr *) &sender->control_addr, sizeof(sender->control_addr));
+            break;
+        default:
+            return;
+    }
+    sender->stats[stream].packets++;
+    sender->stats[stream].bytes += len;
+}
+
+/* Sleeps until local time due, sending what the impairments held back as it comes due */
+static uint64_t replay_wait(replay_netem_t *netem, replay_sender_t *sender, uint64_t due) {
+    uint64_t now = raop_ntp_get_local_time(NULL);
+    while (running) {
+        if (netem) replay_netem_flush(netem, now, replay_send, sender);
+        if (now >= due) break;
+        uint64_t wake = netem && replay_netem_next_due(netem) < due ? replay_netem_next_due(netem) : due;
+        if (wake > now) usleep(wake - now);
+        now = raop_ntp_get_local_time(NULL);
+    }
+    return now;
+}
+
+static void audio_process(void *cls, raop_ntp_t *ntp, aac_decode_struct *data) {
+    uint64_t start = raop_ntp_get_local_time(ntp);
+    if (audio_renderer) {
+        audio_renderer->funcs->render_buffer(audio_renderer, ntp, data->data, data->data_len, data->pts);
+    }
+    audio_last_render_time = raop_ntp_get_local_time(ntp);
+    histogram_record(&audio_submit_histogram, audio_last_render_time - start);
+    atomic_store_explicit(&audio_packets_rendered,
+                          atomic_load_explicit(&audio_packets_rendered, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+static unsigned char *video_acquire_buffer(void *cls, int size, void **handle) {
+    if (video_renderer->funcs->acquire_buffer) {
+        return video_renderer->funcs->acquire_buffer(video_renderer, size, handle);
+    }
+    return NULL;
+}
+
+static void video_release_buffer(void *cls, void *handle) {
+    video_renderer->funcs->release_buffer(video_renderer, handle);
+}
+
+static int video_backpressure(void *cls) {
+    return video_renderer->funcs->is_congested && video_renderer->funcs->is_congested(video_renderer);
+}
+
+static void video_process(void *cls, raop_ntp_t *ntp, h264_decode_struct *data) {
+    if (data->buffer_handle) {
+        video_renderer->funcs->render_acquired(video_renderer, ntp, data->buffer_handle, data->data_len, data->pts,
+                                               &data->nal_index);
+    } else {
+        if (data->frame_type == 0 && video_renderer->funcs->reconfigure) {
+            video_renderer->funcs->reconfigure(video_renderer, data->width, data->height, data->known_geometry);
+        }
+        video_renderer->funcs->render_buffer(video_renderer, ntp, data->data, data->data_len, data->pts,
+                                             data->frame_type, &data->nal_index);
+    }
+    if (data->frame_type == 1) {
+        video_frames_rendered++;
+        video_last_render_time = raop_ntp_get_local_time(ntp);
+    }
+}
+
+/* Like rpiplay, so -allocs covers the frames passed by reference */
+static void video_process_frame(void *cls, raop_ntp_t *ntp, video_frame_t *frame) {
+    h264_decode_struct data = *video_frame_get(frame);
+    video_process(cls, ntp, &data);
+    video_frame_release(frame);
+}
+
+static void audio_flush(void *cls) {
+    if (audio_renderer) audio_renderer->funcs->flush(audio_renderer);
+}
+
+static void audio_set_volume(void *cls, float volume) {
+    if (audio_renderer) audio_renderer->funcs->set_volume(audio_renderer, volume);
+}
+
+static void print_info(char *name) {
+    printf("rpiplay_replay: Replays a trace recorded with rpiplay -trace through the receive pipeline\n");
+    printf("Usage: %s [-s session] [-max] [-l] [-a (hdmi|analog|off)] [-jb packets] [-vq frames] [-vd ms] [-vr renderer] [-ar renderer] [-netem stream:spec] [-seed n] [-allocs s] [-d] trace\n", name);
+    printf("Options:\n");
+    printf("-s session            Replay this session of the trace, counted from 1 (default 1)\n");
+    printf("-max                  Replay as fast as the pipeline takes the packets instead of in real time,\n");
+    printf("                      renderers then present frames as soon as they are decoded\n");
+    printf("-l                    Enable low-latency mode (disables render clock)\n");
+    printf("-a (hdmi|analog|off)  Set audio output device\n");
+    printf("-jb packets           Set the maximum audio jitter buffer depth (default %d)\n", DEFAULT_AUDIO_BUFFER_LENGTH);
+    printf("-vq frames            Set how many received video frames may queue up for a busy decoder (default %d)\n", DEFAULT_VIDEO_QUEUE_DEPTH);
+    printf("-vd ms                Drop late video frames once they are this far behind, 0 never drops (default 0)\n");
+    printf("-vr renderer          Set video renderer to use. Available renderers:\n");
+    for (unsigned int i = 0; i < sizeof(video_renderers)/sizeof(video_renderers[0]); i++) {
+        printf("    %s: %s%s\n", video_renderers[i].name, video_renderers[i].description, i == 0 ? " [Default]" : "");
+    }
+    printf("-ar renderer          Set audio renderer to use. Available renderers:\n");
+    for (unsigned int i = 0; i < sizeof(audio_renderers)/sizeof(audio_renderers[0]); i++) {
+        printf("    %s: %s%s\n", audio_renderers[i].name, audio_renderers[i].description, i == 0 ? " [Default]" : "");
+    }
+    printf("-netem stream:spec    Impair the mirror, audio or control stream on its way to the pipeline, spec is\n");
+    printf("                      a comma separated list of loss=2%%, burst=enter/leave[/loss] (Gilbert-Elliott),\n");
+    printf("                      dup=1%%, reorder=5%%, delay=ms and jitter=ms; the mirror only takes delay and jitter\n");
+    printf("-seed n               Seed the random impairments, the same seed impairs the same packets (default 1)\n");
+    printf("-allocs s             Fail the replay if the mirror, audio, decode or render threads allocate\n");
+    printf("                      memory after the first s seconds of the trace, needs a build with ALLOC_WATCH\n");
+    printf("-d                    Enable debug logging\n");
+    printf("-v/-h                 Displays this help\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *trace_path = NULL;
+    int session_index = 1;
+    bool max_speed = false;
+    bool debug_log = false;
+    int audio_buffer_length = DEFAULT_AUDIO_BUFFER_LENGTH;
+    int video_queue_depth = DEFAULT_VIDEO_QUEUE_DEPTH;
+    int video_latency_budget = 0;
+    int alloc_warmup = -1;
+    uint64_t netem_seed = 1;
+    replay_netem_t *netem = NULL;
+    replay_netem_config_t netem_configs[REPLAY_STREAM_COUNT];
+    bool netem_streams[REPLAY_STREAM_COUNT] = { false };
+    video_init_func_t video_init_func = video_renderers[0].init_func;
+    audio_init_func_t audio_init_func = audio_renderers[0].init_func;
+
+    video_renderer_config_t video_config;
+    memset(&video_config, 0, sizeof(video_config));
+    video_config.background_mode = BACKGROUND_MODE_OFF;
+    video_config.latency_target = DEFAULT_LATENCY_TARGET;
+    video_config.flip = FLIP_NONE;
+
+    audio_renderer_config_t audio_config;
+    memset(&audio_config, 0, sizeof(audio_config));
+    audio_config.device = AUDIO_DEVICE_HDMI;
+    audio_config.latency_target = DEFAULT_LATENCY_TARGET;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "-s")) {
+            if (i == argc - 1) continue;
+            session_index = atoi(argv[++i]);
+            if (session_index < 1) {
+                fprintf(stderr, "Error: Sessions are counted from 1.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-max")) {
+            max_speed = true;
+        } else if (!strcmp(arg, "-l")) {
+            video_config.low_latency = audio_config.low_latency = true;
+        } else if (!strcmp(arg, "-a")) {
+            if (i == argc - 1) continue;
+            const char *device = argv[++i];
+            audio_config.device = !strcmp(device, "hdmi") ? AUDIO_DEVICE_HDMI :
+                                  !strcmp(device, "analog") ? AUDIO_DEVICE_ANALOG : AUDIO_DEVICE_NONE;
+        } else if (!strcmp(arg, "-jb")) {
+            if (i == argc - 1) continue;
+            audio_buffer_length = atoi(argv[++i]);
+            if (audio_buffer_length <= 0) {
+                fprintf(stderr, "Error: The audio jitter buffer depth must be a positive number of packets.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-vq")) {
+            if (i == argc - 1) continue;
+            video_queue_depth = atoi(argv[++i]);
+            if (video_queue_depth <= 0) {
+                fprintf(stderr, "Error: The video queue depth must be a positive number of frames.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-vd")) {
+            if (i == argc - 1) continue;
+            video_latency_budget = atoi(argv[++i]);
+            if (video_latency_budget < 0) {
+                fprintf(stderr, "Error: The video latency budget must not be negative.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-vr")) {
+            if (i == argc - 1) continue;
+            if ((video_init_func = find_video_init_func(argv[++i])) == NULL) {
+                fprintf(stderr, "Error: Invalid video renderer %s. Run with -h for a list.\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-ar")) {
+            if (i == argc - 1) continue;
+            if ((audio_init_func = find_audio_init_func(argv[++i])) == NULL) {
+                fprintf(stderr, "Error: Invalid audio renderer %s. Run with -h for a list.\n", argv[i]);
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-netem")) {
+            if (i == argc - 1) continue;
+            replay_stream_t stream;
+            replay_netem_config_t config;
+            if (replay_netem_parse(argv[++i], &stream, &config) < 0) {
+                exit(1);
+            }
+            netem_configs[stream] = config;
+            netem_streams[stream] = true;
+        } else if (!strcmp(arg, "-seed")) {
+            if (i == argc - 1) continue;
+            netem_seed = strtoull(argv[++i], NULL, 10);
+        } else if (!strcmp(arg, "-allocs")) {
+            if (i == argc - 1) continue;
+            alloc_warmup = atoi(argv[++i]);
+            if (alloc_warmup < 0) {
+                fprintf(stderr, "Error: The warm-up before allocations count must not be negative.\n");
+                exit(1);
+            }
+            if (!alloc_watch_is_available()) {
+                fprintf(stderr, "Error: -allocs needs a build configured with -DALLOC_WATCH=ON.\n");
+                exit(1);
+            }
+        } else if (!strcmp(arg, "-d")) {
+            debug_log = true;
+        } else if (!strcmp(arg, "-h") || !strcmp(arg, "-v")) {
+            print_info(argv[0]);
+            exit(0);
+        } else if (arg[0] != '-' && !trace_path) {
+            trace_path = arg;
+        } else {
+            fprintf(stderr, "Error: Unknown option %s. Run with -h for a list.\n", arg);
+            exit(1);
+        }
+    }
+    if (!trace_path) {
+        print_info(argv[0]);
+        exit(1);
+    }
+    // Renderers that hold every frame until its timestamp would throttle the replay to real time
+    if (max_speed) {
+        video_config.low_latency = audio_config.low_latency = true;
+    }
+
+    logger = logger_init();
+    logger_set_callback(logger, log_callback, NULL);
+    logger_set_level(logger, debug_log ? LOGGER_DEBUG : LOGGER_INFO);
+
+    trace_reader_t *reader = trace_reader_open(trace_path);
+    if (!reader) {
+        fprintf(stderr, "Error: %s is not a trace recorded with rpiplay -trace.\n", trace_path);
+        exit(1);
+    }
+    replay_session_t session;
+    int sessions;
+    if (replay_read_session(reader, session_index, &session, &sessions) < 0) {
+        fprintf(stderr, "Error: Out of memory reading %s.\n", trace_path);
+        exit(1);
+    }
+    if (session_index > sessions || session.count == 0) {
+        fprintf(stderr, "Error: %s holds %d sessions with keys, session %d has nothing to replay.\n",
+                trace_path, sessions, session_index);
+        exit(1);
+    }
+    bool has_mirror = session.mirror_packets > 0 && session.has_stream_id;
+    bool has_audio = session.audio_packets > 0;
+    if (session.mirror_packets > 0 && !session.has_stream_id) {
+        logger_log(logger, LOGGER_WARNING, "The mirror stream setup is missing from the trace, skipping the video");
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+
+    if ((video_renderer = video_init_func(logger, &video_config)) == NULL) {
+        fprintf(stderr, "Error: Could not init video renderer.\n");
+        exit(1);
+    }
+    if (audio_config.device != AUDIO_DEVICE_NONE &&
+        (audio_renderer = audio_init_func(logger, video_renderer, &audio_config)) == NULL) {
+        fprintf(stderr, "Error: Could not init audio renderer.\n");
+        exit(1);
+    }
+    video_renderer->funcs->start(video_renderer);
+    if (audio_renderer) audio_renderer->funcs->start(audio_renderer);
+    histogram_init(&audio_submit_histogram);
+
+    for (int i = 0; i < REPLAY_STREAM_COUNT; i++) {
+        if (!netem_streams[i]) continue;
+        if (!netem && !(netem = replay_netem_init(netem_seed))) {
+            fprintf(stderr, "Error: Out of memory for the network impairments.\n");
+            exit(1);
+        }
+        replay_netem_set(netem, (replay_stream_t) i, &netem_configs[i]);
+    }
+
+    MUTEX_CREATE(clock_mutex);
+    if (!replay_estimate_offset(&session, &remote_offset)) {
+        logger_log(logger, LOGGER_WARNING, "No NTP exchange or video in the session, the audio timestamps may be off");
+    }
+    unsigned short ntp_port;
+    ntp_sock = replay_socket(SOCK_DGRAM, &ntp_port);
+    if (ntp_sock == -1) {
+        fprintf(stderr, "Error: Could not open the NTP socket.\n");
+        exit(1);
+    }
+    replay_clock_set(session.records[0].header.time, raop_ntp_get_local_time(NULL));
+    thread_handle_t ntp_thread;
+    atomic_store(&ntp_running, 1);
+    THREAD_CREATE(ntp_thread, replay_ntp_thread, NULL);
+
+    raop_callbacks_t callbacks;
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.audio_process = audio_process;
+    callbacks.video_process = video_process;
+    callbacks.video_process_frame = video_process_frame;
+    callbacks.video_acquire_buffer = video_acquire_buffer;
+    callbacks.video_release_buffer = video_release_buffer;
+    callbacks.video_backpressure = video_backpressure;
+    callbacks.audio_flush = audio_flush;
+    callbacks.audio_set_volume = audio_set_volume;
+
+    const unsigned char remote[] = { 127, 0, 0, 1 };
+    unsigned short timing_lport = 0;
+    raop_ntp_t *ntp = raop_ntp_init(logger, remote, sizeof(remote), ntp_port);
+    raop_ntp_start(ntp, &timing_lport);
+
+    replay_sender_t sender;
+    memset(&sender, 0, sizeof(sender));
+    sender.mirror_fd = -1;
+    sender.audio_fd = -1;
+
+    raop_rtp_mirror_t *mirror = NULL;
+    if (has_mirror) {
+        mirror = raop_rtp_mirror_init(logger, &callbacks, ntp, remote, sizeof(remote), session.keys.aeskey,
+                                      session.keys.ecdh_secret, video_queue_depth, video_latency_budget);
+        raop_rtp_init_mirror_aes(mirror, session.stream_id);
+        unsigned short mirror_port = 0;
+        raop_rtp_start_mirror(mirror, 0, &mirror_port);
+        struct sockaddr_in addr = replay_loopback_address(mirror_port);
+        sender.mirror_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(sender.mirror_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+            fprintf(stderr, "Error: Could not connect to the mirror port %d.\n", mirror_port);
+            exit(1);
+        }
+        int option = 1;
+        setsockopt(sender.mirror_fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+    }
+
+    raop_rtp_t *rtp = NULL;
+    if (has_audio) {
+        rtp = raop_rtp_init(logger, &callbacks, ntp, remote, sizeof(remote), session.keys.aeskey,
+                            session.keys.aesiv, session.keys.ecdh_secret, audio_buffer_length);
+        // Resend requests come back to this socket and are left unanswered, the trace has what it has
+        unsigned short control_rport;
+        sender.audio_fd = replay_socket(SOCK_DGRAM, &control_rport);
+        unsigned short control_lport = 0, data_lport = 0;
+        raop_rtp_start_audio(rtp, 1, control_rport, &control_lport, &data_lport);
+        sender.data_addr = replay_loopback_address(data_lport);
+        sender.control_addr = replay_loopback_address(control_lport);
+    }
+
+    logger_log(logger, LOGGER_INFO, "Replaying session %d of %d, %d records with %d mirror and %d audio packets%s",
+               session_index, sessions, session.count, has_mirror ? session.mirror_packets : 0,
+               session.audio_packets, max_speed ? " as fast as possible" : "");
+
+    const replay_stream_stats_t *mirror_stats = &sender.stats[REPLAY_STREAM_MIRROR];
+    const replay_stream_stats_t *data_stats = &sender.stats[REPLAY_STREAM_AUDIO];
+    const replay_stream_stats_t *control_stats = &sender.stats[REPLAY_STREAM_CONTROL];
+    histogram_t lag_histogram;
+    histogram_init(&lag_histogram);
+    uint64_t trace_start = session.records[0].header.time;
+    uint64_t trace_end = trace_start;
+    uint64_t replay_start = raop_ntp_get_local_time(NULL);
+    replay_clock_set(trace_start, replay_start);
+    bool alloc_watch_armed = false;
+
+    for (int i = 0; i < session.count && running; i++) {
+        const replay_record_t *record = &session.records[i];
+        // Records of different threads may be a little out of order
+        uint64_t trace_time = record->header.time > trace_start ? record->header.time : trace_start;
+        if (trace_time > trace_end) trace_end = trace_time;
+        // The pools and queues of the pipeline fill up during the warm-up, from then on nothing may allocate
+        if (alloc_warmup >= 0 && !alloc_watch_armed && trace_time - trace_start >= alloc_warmup * 1000000ull) {
+            alloc_watch_arm();
+            alloc_watch_armed = true;
+        }
+        uint64_t now = raop_ntp_get_local_time(NULL);
+        if (max_speed) {
+            replay_clock_set(trace_time, now);
+        } else {
+            uint64_t due = replay_start + (trace_time - trace_start);
+            now = replay_wait(netem, &sender, due);
+            histogram_record(&lag_histogram, now > due ? now - due : 0);
+        }
+
+        replay_stream_t stream;
+        switch (record->header.type) {
+            case TRACE_RECORD_MIRROR_PACKET:
+                stream = REPLAY_STREAM_MIRROR;
+                break;
+            case TRACE_RECORD_RTP_DATA:
+                stream = REPLAY_STREAM_AUDIO;
+                if (max_speed && sender.audio_fd != -1) {
+                    // Nothing pushes back on UDP, keep the socket and the jitter buffer from overflowing
+                    uint64_t wait_start = raop_ntp_get_local_time(NULL);
+                    while (data_stats->packets - atomic_load_explicit(&audio_packets_rendered, memory_order_relaxed) >=
+                           (unsigned int) audio_buffer_length &&
+                           raop_ntp_get_local_time(NULL) - wait_start < REPLAY_AUDIO_WAIT_US) {
+                        usleep(100);
+                    }
+                }
+                break;
+            case TRACE_RECORD_RTP_CONTROL:
+                stream = REPLAY_STREAM_CONTROL;
+                break;
+            default:
+                continue;
+        }
+        if (netem) {
+            replay_netem_submit(netem, stream, record->data, record->header.length, now);
+            replay_netem_flush(netem, now, replay_send, &sender);
+        } else {
+            replay_send(&sender, stream, record->data, record->header.length);
+        }
+    }
+    // The impairments may still hold packets back
+    while (netem && running && replay_netem_next_due(netem) != UINT64_MAX) {
+        replay_wait(netem, &sender, replay_netem_next_due(netem));
+    }
+    uint64_t replay_end = raop_ntp_get_local_time(NULL);
+    if (running) sleepms(REPLAY_DRAIN_MS);
+    // Before the teardown, which frees what the session allocated
+    alloc_watch_disarm();
+
+    // Stopping the mirror logs the per-stage latency histograms of its pipeline
+    if (sender.mirror_fd != -1) close(sender.mirror_fd);
+    if (mirror) {
+        raop_rtp_mirror_stop(mirror);
+        raop_rtp_mirror_destroy(mirror);
+    }
+    if (rtp) {
+        raop_rtp_stop(rtp);
+        raop_rtp_destroy(rtp);
+    }
+    if (sender.audio_fd != -1) close(sender.audio_fd);
+    raop_ntp_stop(ntp);
+    raop_ntp_destroy(ntp);
+    atomic_store(&ntp_running, 0);
+    THREAD_JOIN(ntp_thread);
+    close(ntp_sock);
+
+    double trace_seconds = (trace_end - trace_start) / 1000000.0;
+    double replay_seconds = replay_seconds_until(replay_start, replay_end);
+    logger_log(logger, LOGGER_INFO, "Replayed %.2f s of the trace in %.2f s, %.2fx real time", trace_seconds,
+               replay_seconds, trace_seconds / replay_seconds);
+    if (!max_speed) {
+        histogram_log(&lag_histogram, logger, LOGGER_INFO, "replay send lag");
+    }
+    if (has_mirror) {
+        // Rates of the rendered output count until the last frame came out, which may be after the last send
+        logger_log(logger, LOGGER_INFO, "Mirror: sent %llu packets, %.2f Mbit/s, rendered %llu frames, %.1f frames/s, %u dropped",
+                   (unsigned long long) mirror_stats->packets, mirror_stats->bytes * 8 / replay_seconds / 1000000.0,
+                   (unsigned long long) video_frames_rendered,
+                   video_frames_rendered / replay_seconds_until(replay_start, video_last_render_time),
+                   atomic_load(&metrics_values[METRIC_VIDEO_FRAMES_DROPPED]));
+    }
+    if (has_audio) {
+        logger_log(logger, LOGGER_INFO, "Audio: sent %llu data and %llu control packets, rendered %llu packets, "
+                   "%.1f packets/s, %u late, %u lost",
+                   (unsigned long long) data_stats->packets, (unsigned long long) control_stats->packets,
+                   (unsigned long long) atomic_load(&audio_packets_rendered),
+                   atomic_load(&audio_packets_rendered) / replay_seconds_until(replay_start, audio_last_render_time),
+                   atomic_load(&metrics_values[METRIC_AUDIO_PACKETS_LATE]),
+                   atomic_load(&metrics_values[METRIC_AUDIO_PACKETS_LOST]));
+        histogram_log(&audio_submit_histogram, logger, LOGGER_INFO, "audio renderer submit");
+    }
+
+    if (netem) replay_netem_log(netem, logger);
+
+    unsigned long steady_allocations = 0;
+    if (alloc_warmup >= 0) {
+        if (alloc_watch_armed) {
+            steady_allocations = alloc_watch_report(logger);
+        } else {
+            logger_log(logger, LOGGER_WARNING, "The trace is shorter than the %d s warm-up, allocations were not checked",
+                       alloc_warmup);
+        }
+    }
+
+    if (audio_renderer) audio_renderer->funcs->destroy(audio_renderer);
+    video_renderer->funcs->destroy(video_renderer);
+    MUTEX_DESTROY(clock_mutex);
+    replay_netem_destroy(netem);
+    free(session.records);
+    trace_reader_close(reader);
+    logger_destroy(logger);
+    // A replay that renders nothing is a regression, not a result, and so is one that allocates in steady state
+    return (has_mirror && video_frames_rendered == 0) || (has_audio && atomic_load(&audio_packets_rendered) == 0) ||
+           steady_allocations > 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * RPiPlay - An open-source AirPlay mirroring server for Raspberry Pi
+ * Copyright (C) 2026 RPiPlay contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+/*
+ * Reads the mirror rpiplay -shm publishes and writes it to stdout as an Annex-B H.264 stream,
+ * for piping into a player or encoder, and as the reference consumer of the protocol in
+ * lib/shm_ring.h. Waits for rpiplay to come up and follows it across restarts.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "lib/shm_ring.h"
+
+#define DEFAULT_SHM_NAME "/rpiplay"
+/* How often an idle ring is looked at, about a quarter of a frame at 60 fps */
+#define POLL_INTERVAL_US 4000
+#define REOPEN_INTERVAL_US 500000
+
+static volatile sig_atomic_t running = 1;
+
+static void signal_handler(int sig) {
+    running = 0;
+}
+
+static bool write_all(const unsigned char *data, int size) {
+    return fwrite(data, 1, size, stdout) == (size_t) size && fflush(stdout) == 0;
+}
+
+static void print_info(char *name) {
+    printf("rpiplay_shmcat: Writes the mirror rpiplay -shm publishes to stdout as Annex-B H.264\n");
+    printf("Usage: %s [-v] [name]\n", name);
+    printf("Options:\n");
+    printf("name                  Shared memory object rpiplay -shm was given (default %s)\n", DEFAULT_SHM_NAME);
+    printf("-v                    Log the frames and lost frames to stderr\n");
+    printf("-h                    Displays this help\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *name = DEFAULT_SHM_NAME;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-v")) {
+            verbose = true;
+        } else if (!strcmp(argv[i], "-h")) {
+            print_info(argv[0]);
+            exit(0);
+        } else if (argv[i][0] != '-') {
+            name = argv[i];
+        } else {
+            fprintf(stderr, "Error: Unknown option %s. Run with -h for a list.\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, signal_handler);
+
+    int buffer_size = 1 << 20;
+    unsigned char *buffer = malloc(buffer_size);
+    shm_ring_reader_t reader;
+    shm_ring_record_t record;
+    bool open = false;
+    uint64_t lost = 0;
+
+    while (running && buffer) {
+        if (!open) {
+            if (shm_ring_reader_open(&reader, name) < 0) {
+                usleep(REOPEN_INTERVAL_US);
+                continue;
+            }
+            open = true;
+            lost = 0;
+            // Without the parameter sets record in the ring the stream starts from those in the header
+            int size = shm_ring_read_parameter_sets(&reader, buffer, buffer_size);
+            if (reader.pos == reader.header->sync_pos) size = 0;
+            if (size > 0 && !write_all(buffer, size)) break;
+            if (verbose) fprintf(stderr, "Reading %s\n", name);
+        }
+
+        int ret = shm_ring_read(&reader, &record, buffer, buffer_size);
+        if (ret == SHM_RING_READ_CLOSED) {
+            shm_ring_reader_close(&reader);
+            open = false;
+            if (verbose) fprintf(stderr, "%s was closed\n", name);
+        } else if (ret == SHM_RING_READ_SMALL_BUFFER) {
+            free(buffer);
+            buffer_size = record.size;
+            buffer = malloc(buffer_size);
+        } else if (ret == SHM_RING_READ_AGAIN) {
+            usleep(POLL_INTERVAL_US);
+        } else {
+            if (verbose && reader.lost != lost) {
+                fprintf(stderr, "Fell behind the writer, frames were lost\n");
+                lost = reader.lost;
+            }
+            if (verbose) {
+                fprintf(stderr, "Record %llu: %d bytes%s%s, pts %llu\n", (unsigned long long) record.sequence, ret,
+                        record.flags & SHM_RING_FLAG_PARAMETER_SETS ? ", parameter sets" : "",
+                        record.flags & SHM_RING_FLAG_IDR ? ", IDR" : "", (unsigned long long) record.pts);
+            }
+            if (!write_all(buffer, ret)) break;
+        }
+    }
+
+    if (open) shm_ring_reader_close(&reader);
+    free(buffer);
+    return 0;
+}